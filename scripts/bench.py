@@ -0,0 +1,182 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2024 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+
+#
+#  Headless benchmark. Spawns two armies on a fixed map, sends them into 
+#  battle and records the per-subsystem timings for a fixed number of 20Hz 
+#  ticks. The results are written out as JSON and the engine exits.
+#
+#  Arguments (passed to the engine as '--name=value'):
+#      bench_units - number of units per faction (default: 256)
+#      bench_ticks - number of 20Hz ticks to run for (default: 600)
+#      bench_out   - path of the results file (default: bench.json)
+#
+#  The field cache lookups are recorded over the run and the hit rates of 
+#  replaying them against each of the cache replacement policies are also 
+#  written out.
+#
+
+import pf
+import pf_bench
+import math
+
+import rts.units.knight
+import rts.units.berzerker
+
+
+def int_arg(name, default):
+    value = pf.get_arg(name)
+    return default if value is None else int(value)
+
+ARMY_SIZE = int_arg("bench_units", 256)
+NTICKS = int_arg("bench_ticks", 600)
+OUT_PATH = pf.get_arg("bench_out") or "bench.json"
+
+SPACING = 12
+NROWS = 8
+
+DIR_RIGHT = (0.0, 1.0/math.sqrt(2.0), 0.0, 1.0/math.sqrt(2.0))
+DIR_LEFT = (0.0, -1.0/math.sqrt(2.0), 0.0, 1.0/math.sqrt(2.0))
+
+armies = [[], []]
+ticks = 0
+frame_times_ms = []
+totals = {}
+
+def setup_scene():
+
+    pf.set_ambient_light_color((1.0, 1.0, 1.0))
+    pf.set_emit_light_color((1.0, 1.0, 1.0))
+    pf.set_emit_light_pos((1664.0, 1024.0, 384.0))
+
+    pf.load_map("assets/maps", "plain.pfmap")
+
+    pf.add_faction("RED", (255, 0, 0, 255))
+    pf.add_faction("BLUE", (0, 0, 255, 255))
+    pf.set_diplomacy_state(0, 1, pf.DIPLOMACY_STATE_WAR)
+
+    pf.set_faction_controllable(0, False)
+    pf.set_faction_controllable(1, False)
+
+def spawn(cls, dirname, faction_id, x, z, rot):
+
+    name = cls.__name__
+    unit = cls("assets/models/" + dirname, dirname + ".pfobj", name)
+    unit.pos = (float(x), float(pf.map_height_at_point(x, z)), float(z))
+    unit.rotation = rot
+    unit.faction_id = faction_id
+    unit.selection_radius = 3.0
+    unit.vision_range = 35.0
+    unit.hold_position()
+    armies[faction_id].append(unit)
+
+def setup_armies():
+
+    # The placement is a pure function of ARMY_SIZE, so that every 
+    # run of the benchmark starts from the same state
+    ncols = int(math.ceil(float(ARMY_SIZE) / NROWS))
+    for i in range(ARMY_SIZE):
+        r = i % NROWS - NROWS // 2
+        c = i // NROWS - ncols // 2
+        spawn(rts.units.knight.Knight, "knight", 0, -(r * SPACING) + 35.0, c * SPACING, DIR_RIGHT)
+        spawn(rts.units.berzerker.Berzerker, "berzerker", 1, (r * SPACING) - 35.0, c * SPACING, DIR_LEFT)
+
+def accumulate(name, node):
+
+    entry = totals.setdefault(name, [0.0, 0])
+    entry[0] += node["ms_delta"]
+    entry[1] += 1
+    for child in node["children"]:
+        accumulate(name + "/" + child["name"], child)
+
+def on_update_end(user, event):
+
+    frame_times_ms.append(pf.prev_frame_ms())
+    for thread, tree in pf.prev_frame_perfstats().items():
+        for child in tree["children"]:
+            accumulate(thread + "/" + child["name"], child)
+
+def write_results():
+
+    times = sorted(frame_times_ms)
+    def percentile(p):
+        return times[min(len(times) - 1, int(len(times) * p))] if times else 0
+
+    lines = []
+    lines.append('{')
+    lines.append('  "units_per_faction": %d,' % ARMY_SIZE)
+    lines.append('  "ticks": %d,' % NTICKS)
+    lines.append('  "frames": %d,' % len(times))
+    lines.append('  "frame_ms": {"avg": %f, "p50": %d, "p99": %d, "max": %d},' % (
+        float(sum(times)) / max(len(times), 1), percentile(0.5), percentile(0.99), times[-1] if times else 0))
+    lines.append('  "scopes": {')
+    scopes = sorted(totals.items())
+    for i, (name, (ms, calls)) in enumerate(scopes):
+        sep = ',' if i < len(scopes) - 1 else ''
+        lines.append('    "%s": {"total_ms": %f, "calls": %d}%s' % (name.replace('"', '\\"'), ms, calls, sep))
+    lines.append('  },')
+    lines.append('  "fieldcache_policies": {')
+    policies = sorted(pf_bench.fieldcache_policies().items())
+    for i, (name, rates) in enumerate(policies):
+        sep = ',' if i < len(policies) - 1 else ''
+        lines.append('    "%s": {%s}%s' % (name, ", ".join('"%s": %s' % (k, v) for k, v in sorted(rates.items())), sep))
+    lines.append('  }')
+    lines.append('}')
+
+    with open(OUT_PATH, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+def on_20hz_tick(user, event):
+
+    global ticks
+    ticks += 1
+    if ticks == 1:
+        for unit in armies[0]:
+            unit.attack((-100, 0))
+        for unit in armies[1]:
+            unit.attack((+100, 0))
+    if ticks == NTICKS:
+        pf.unregister_event_handler(pf.EVENT_UPDATE_END, on_update_end)
+        pf.unregister_event_handler(pf.EVENT_20HZ_TICK, on_20hz_tick)
+        write_results()
+        pf.global_event(pf.SDL_QUIT, None)
+
+
+pf.settings_set("pf.game.fieldcache_trace", True, persist=False)
+setup_scene()
+setup_armies()
+
+pf.register_event_handler(pf.EVENT_UPDATE_END, on_update_end, None)
+pf.register_event_handler(pf.EVENT_20HZ_TICK, on_20hz_tick, None)
@@ -36,6 +36,10 @@ import pf
 
 class DisappearingTextTask(pf.Task):
 
+    def __new__(cls, *args, **kwargs):
+        # Never receives any messages
+        return super(DisappearingTextTask, cls).__new__(cls, micro=True)
+
     def __init__(self, text, bounds, color, duration, travel=50):
         self.text = text
         self.bounds = bounds
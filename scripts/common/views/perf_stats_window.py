@@ -102,6 +102,41 @@ class PerfStatsWindow(pf.Window):
             .format(used=nav_stats["grid_path_used"], cap=nav_stats["grid_path_max"], hr=nav_stats["grid_path_hit_rate"]), \
             (0, 255, 0))
 
+        nfields = max(nav_stats["volatile_fields"], 1)
+        self.layout_row_dynamic(20, 1)
+        self.label_colored_wrap("[Enemy Seek/Surround Fields] Fields: {nf:06d}   References: {nr:06d}   Per Field: {pf:02.02f}" \
+            .format(nf=nav_stats["volatile_fields"], nr=nav_stats["volatile_refs"], 
+            pf=float(nav_stats["volatile_refs"]) / nfields), \
+            (0, 255, 0))
+
+    def stack_stats_tab(self):
+        for stats in pf.get_stack_perfstats():
+            self.layout_row_dynamic(20, 1)
+            self.label_colored_wrap("[{size:>5d} KiB Stacks] Live: {live:04d}  High Water: {hw:04d}  Cached: {cached:04d}  Mapped: {mapped:04d}" \
+                .format(size=stats["stack_size"] / 1024, live=stats["live"], hw=stats["high_water"], 
+                cached=stats["cached"], mapped=stats["mapped"]), \
+                (0, 255, 0))
+
+    def mem_stats_tab(self):
+        for stats in pf.get_mem_perfstats():
+            self.layout_row_dynamic(20, 1)
+            self.label_colored_wrap("[{name}] Size: {size:.02f} MiB  High Water: {hw:.02f} MiB  Blocks: {count:d}" \
+                .format(name=stats["name"], size=stats["bytes"] / (1024.0 * 1024.0), 
+                hw=stats["high_water"] / (1024.0 * 1024.0), count=stats["count"]), \
+                (0, 255, 0))
+        for stats in pf.get_slab_perfstats():
+            self.layout_row_dynamic(20, 1)
+            name = "{size:>4d} B Slabs".format(size=stats["block_size"]) if stats["block_size"] else "Large Blocks"
+            self.label_colored_wrap("[{name}] Live: {live:06d}  High Water: {hw:06d}  Cached: {cached:06d}  Slabs: {slabs:04d}" \
+                .format(name=name, live=stats["live"], hw=stats["high_water"], 
+                cached=stats["cached"], slabs=stats["slabs"]), \
+                (0, 255, 0))
+
+    def counters_tab(self):
+        for name, value in sorted(pf.prev_frame_counters().items()):
+            self.layout_row_dynamic(20, 1)
+            self.label_colored_wrap("{name}: {value}".format(name=name, value=value), (0, 255, 0))
+
     def threads_tab(self):
         for name in self.frame_perfstats[self.tickindex]:
             t_frame_times = [0] * 100
@@ -174,4 +209,7 @@ class PerfStatsWindow(pf.Window):
         self.tree(pf.NK_TREE_TAB, "Threads", pf.NK_MINIMIZED, self.threads_tab)
         self.tree(pf.NK_TREE_TAB, "Renderer Info", pf.NK_MINIMIZED, self.render_info_tab)
         self.tree(pf.NK_TREE_TAB, "Navigation Stats", pf.NK_MINIMIZED, self.nav_stats_tab)
+        self.tree(pf.NK_TREE_TAB, "Task Stack Stats", pf.NK_MINIMIZED, self.stack_stats_tab)
+        self.tree(pf.NK_TREE_TAB, "Memory Stats", pf.NK_MINIMIZED, self.mem_stats_tab)
+        self.tree(pf.NK_TREE_TAB, "Counters", pf.NK_MINIMIZED, self.counters_tab)
 
@@ -0,0 +1,77 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2024 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+
+#
+#  Converts model textures to block-compressed KTX2 files, which the engine
+#  loads in place of the source images. Files that are already up-to-date
+#  are skipped.
+#
+#  Arguments (passed to the engine as '--name=value'):
+#      cook_dir - directory to convert, recursively (default: assets/models)
+#
+
+import os
+import pf
+
+EXTENSIONS = (".png", ".jpg", ".jpeg", ".tga", ".bmp")
+
+def up_to_date(src, dst):
+    return os.path.exists(dst) and os.path.getmtime(dst) >= os.path.getmtime(src)
+
+cook_dir = pf.get_arg("cook_dir")
+if cook_dir is None:
+    cook_dir = os.path.join(pf.get_basedir(), "assets", "models")
+
+ncooked, nskipped, nfailed = 0, 0, 0
+for root, dirs, files in os.walk(cook_dir):
+    for name in files:
+        if not name.lower().endswith(EXTENSIONS):
+            continue
+        src = os.path.join(root, name)
+        dst = os.path.splitext(src)[0] + ".ktx2"
+        if up_to_date(src, dst):
+            nskipped += 1
+            continue
+        try:
+            pf.cook_texture(src, dst)
+            ncooked += 1
+        except RuntimeError:
+            print("Failed to convert: {0}".format(src))
+            nfailed += 1
+
+print("Converted {0} textures ({1} up-to-date, {2} failed)".format(ncooked, nskipped, nfailed))
+
+pf.global_event(pf.SDL_QUIT, None)
+
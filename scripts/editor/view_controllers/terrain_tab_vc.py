@@ -64,34 +64,42 @@ class TerrainTabVC(vc.ViewController):
         global_r = self.selected_tile[0][0] * pf.TILES_PER_CHUNK_HEIGHT + self.selected_tile[1][0]
         global_c = self.selected_tile[0][1] * pf.TILES_PER_CHUNK_WIDTH  + self.selected_tile[1][1]
 
-        for r in range(-(self.view.brush_size_idx), (self.view.brush_size_idx) + 1):
-            for c in range(-(self.view.brush_size_idx), (self.view.brush_size_idx) + 1):
-
-                if self.view.blend_textures:
-                    bm = pf.BLEND_MODE_BLUR
-                else:
-                    bm = pf.BLEND_MODE_NOBLEND
-
-                tile_coords = globals.active_map.relative_tile_coords(global_r, global_c, r, c)
-                if tile_coords is not None:
-
-                    top_mat = globals.active_map.materials[self.view.selected_mat_idx]
-                    side_mat = globals.active_map.materials[self.view.selected_side_mat_idx]
-
-                    if self.view.brush_type_idx == Brush.TEXTURE:
-                        globals.active_map.update_tile_mat(tile_coords, top_mat, bm, self.view.blend_normals)
-                    elif self.view.brush_type_idx == Brush.ELEVATION:
-                        center_height = self.view.heights[self.view.selected_height_idx]
-                        globals.active_map.update_tile(tile_coords, center_height, pf.TILETYPE_FLAT, side_mat, 0, bm, self.view.blend_normals)
-                    elif self.view.brush_type_idx == Brush.SHALLOW_WAT:
-                        globals.active_map.update_tile(tile_coords, SHALLOW_WAT_ELEV, pf.TILETYPE_FLAT, side_mat, 0, bm, self.view.blend_normals)
-                    elif self.view.brush_type_idx == Brush.DEEP_WAT:
-                        globals.active_map.update_tile(tile_coords, DEEP_WAT_ELEV, pf.TILETYPE_FLAT, side_mat, 0, bm, self.view.blend_normals)
+        # Rebuild the meshes of all the painted tiles in one go
+        pf.begin_tile_edits()
+        try:
+            for r in range(-(self.view.brush_size_idx), (self.view.brush_size_idx) + 1):
+                for c in range(-(self.view.brush_size_idx), (self.view.brush_size_idx) + 1):
+
+                    if self.view.blend_textures:
+                        bm = pf.BLEND_MODE_BLUR
+                    else:
+                        bm = pf.BLEND_MODE_NOBLEND
+
+                    tile_coords = globals.active_map.relative_tile_coords(global_r, global_c, r, c)
+                    if tile_coords is not None:
+
+                        top_mat = globals.active_map.materials[self.view.selected_mat_idx]
+                        side_mat = globals.active_map.materials[self.view.selected_side_mat_idx]
+
+                        if self.view.brush_type_idx == Brush.TEXTURE:
+                            globals.active_map.update_tile_mat(tile_coords, top_mat, bm, self.view.blend_normals)
+                        elif self.view.brush_type_idx == Brush.ELEVATION:
+                            center_height = self.view.heights[self.view.selected_height_idx]
+                            globals.active_map.update_tile(tile_coords, center_height, pf.TILETYPE_FLAT, side_mat, 0, bm, self.view.blend_normals)
+                        elif self.view.brush_type_idx == Brush.SHALLOW_WAT:
+                            globals.active_map.update_tile(tile_coords, SHALLOW_WAT_ELEV, pf.TILETYPE_FLAT, side_mat, 0, bm, self.view.blend_normals)
+                        elif self.view.brush_type_idx == Brush.DEEP_WAT:
+                            globals.active_map.update_tile(tile_coords, DEEP_WAT_ELEV, pf.TILETYPE_FLAT, side_mat, 0, bm, self.view.blend_normals)
+
+            if ((self.view.brush_type_idx == Brush.ELEVATION and self.view.edges_type_idx == 0) \
+            or  (self.view.brush_type_idx in [Brush.SHALLOW_WAT, Brush.DEEP_WAT])):
+                self.__paint_smooth_border(self.view.brush_size_idx + 1, 'down')
+                self.__paint_smooth_border(self.view.brush_size_idx + 1, 'up')
+        finally:
+            pf.end_tile_edits()
 
         if ((self.view.brush_type_idx == Brush.ELEVATION and self.view.edges_type_idx == 0) \
         or  (self.view.brush_type_idx in [Brush.SHALLOW_WAT, Brush.DEEP_WAT])):
-            self.__paint_smooth_border(self.view.brush_size_idx + 1, 'down')
-            self.__paint_smooth_border(self.view.brush_size_idx + 1, 'up')
             self.__update_objects_for_height_change()
 
     def __smoothed_tile(self, tile_coords, dir):
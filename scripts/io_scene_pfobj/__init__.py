@@ -95,6 +95,13 @@ class ExportPFOBJ(bpy.types.Operator, ExportHelper):
         default=False
     )
 
+    generate_lods = BoolProperty(
+        name="Generate Reduced-Detail Meshes",
+        description="When none of the selected objects have the _LOD1 or _LOD2 suffix, export " \
+            "decimated copies of the meshes as the reduced-detail levels.",
+        default=False
+    )
+
     def execute(self, context):
         from . import export_pfobj
         from mathutils import Matrix
@@ -39,7 +39,12 @@ from mathutils import Quaternion
 from mathutils import Euler
 from mathutils import Vector
 
-PFOBJ_VER = 1.0
+PFOBJ_VER = 1.1
+
+# Objects with these suffixes hold the reduced-detail meshes of the other selected
+# objects. When there are none, they can be generated with the Decimate modifier.
+LOD_SUFFIXES = ("_LOD1", "_LOD2")
+GENERATED_LOD_RATIOS = (0.5, 0.2)
 
 def mesh_triangulate(mesh):
     import bmesh
@@ -67,11 +72,110 @@ def current_pose_bbox(global_matrix, mesh_objs, local_origin):
 
     return min_x, max_x, min_y, max_y, min_z, max_z
 
-def save(operator, context, filepath, global_matrix, export_bbox, local_origin):
+def lod_level(obj):
+    for i, suffix in enumerate(LOD_SUFFIXES):
+        if obj.name.endswith(suffix):
+            return i + 1
+    return 0
+
+def decimated_mesh(obj, ratio):
+    # Only the decimation is applied - the exported vertices are always in the 
+    # rest pose, so the other modifiers (ex. Armature) are disabled temporarily
+    saved = [(mod, mod.show_viewport) for mod in obj.modifiers]
+    for mod, _ in saved:
+        mod.show_viewport = False
+
+    dec = obj.modifiers.new(name="PFOBJ_LOD", type='DECIMATE')
+    dec.ratio = ratio
+    mesh = obj.to_mesh(bpy.context.scene, True, 'PREVIEW')
+    obj.modifiers.remove(dec)
+
+    for mod, show in saved:
+        mod.show_viewport = show
+    return mesh
+
+def write_vertices(ofile, obj, mesh, arms, textured_mats, global_matrix, local_origin):
+    for face in mesh.polygons:
+        for loop_idx in face.loop_indices:
+
+            ws_mat = Matrix.Identity(4) if local_origin else obj.matrix_world
+            trans = global_matrix * ws_mat
+
+            v = mesh.vertices[mesh.loops[loop_idx].vertex_index]
+            v_co_world = trans * v.co
+
+            line = "v {v.x:.6f} {v.y:.6f} {v.z:.6f}\n"
+            line = line.format(v=v_co_world)
+            ofile.write(line)
+
+            uv_coords = mesh.uv_layers.active.data[loop_idx].uv
+            line = "vt {uv.x:.6f} {uv.y:.6f}\n"
+            line = line.format(uv=uv_coords)
+            ofile.write(line)
+
+            # The following line will give per-face normals instead
+            # Make it an option at some point ...
+            #normal = global_matrix * mesh.loops[loop_idx].normal
+            normal = global_matrix * v.normal
+            line = "vn {n[0]:.6f} {n[1]:.6f} {n[2]:.6f}\n"
+            line = line.format(n=normal)
+            ofile.write(line)
+
+            line = "vw ";
+            joint_idx_weight_map = {}
+            for vg in v.groups:
+
+                if vg.weight == 0:
+                    continue
+
+                bone_name = obj.vertex_groups[vg.group].name
+                if bone_name not in arms[0].data.bones.keys():
+                    continue
+
+                joint = arms[0].data.bones[bone_name]
+                joint_idx = arms[0].data.bones.values().index(joint)
+
+                joint_idx_weight_map[joint_idx] = vg.weight
+
+            # Write the joints ordered by weight - we only use the top 6 highest weights
+            # in the engine
+            from operator import itemgetter
+            for tuple in sorted(joint_idx_weight_map.items(), key=itemgetter(1), reverse=True):
+                next_elem = " {g}/{w:.6f}"
+                next_elem = next_elem.format(g=tuple[0], w=tuple[1])
+                line += next_elem
+
+            line += "\n"
+            ofile.write(line)
+
+            mat_name = mesh.materials[face.material_index].name
+            #mat_idx = textured_mats.index( mesh.materials[face.material_index] )
+            mat_idx = [mat.name for mat in textured_mats].index(mat_name)
+            line = "vm {idx}\n"
+            line = line.format(idx=mat_idx)
+            ofile.write(line)
+
+def save(operator, context, filepath, global_matrix, export_bbox, local_origin, generate_lods):
     with open(filepath, "w", encoding="ascii") as ofile:
 
-        mesh_objs = [obj for obj in bpy.context.selected_objects if obj.type == 'MESH']
-        meshes = [obj.data for obj in mesh_objs]
+        sel_objs  = [obj for obj in bpy.context.selected_objects if obj.type == 'MESH']
+        mesh_objs = [obj for obj in sel_objs if lod_level(obj) == 0]
+        lod_objs  = [[obj for obj in sel_objs if lod_level(obj) == l + 1] for l in range(len(LOD_SUFFIXES))]
+
+        base_meshes = [(obj, obj.data) for obj in mesh_objs]
+        generated = []
+        if any(lod_objs):
+            lod_meshes = [[(obj, obj.data) for obj in objs] for objs in lod_objs if objs]
+        elif generate_lods:
+            lod_meshes = []
+            for ratio in GENERATED_LOD_RATIOS:
+                level = [(obj, decimated_mesh(obj, ratio)) for obj in mesh_objs]
+                generated += [mesh for obj, mesh in level]
+                lod_meshes.append(level)
+        else:
+            lod_meshes = []
+
+        meshes = [obj.data for obj in sel_objs] + generated
         arms   = [obj for obj in bpy.context.selected_objects if obj.type == 'ARMATURE']
 
         all_textured_mats = []
@@ -91,9 +195,13 @@ def save(operator, context, filepath, global_matrix, export_bbox, local_origin):
             mesh.calc_normals_split()
 
         num_verts = 0
-        for mesh in meshes: 
+        for obj, mesh in base_meshes: 
             num_verts += sum([face.loop_total for face in mesh.polygons])
 
+        lod_verts = []
+        for level in lod_meshes:
+            lod_verts.append(str(sum([sum([face.loop_total for face in mesh.polygons]) for obj, mesh in level])))
+
         num_joints    = sum([len(arm.pose.bones) for arm in arms])
         num_as        = len(bpy.data.actions.items())
         num_materials = len(textured_mats)
@@ -110,73 +218,19 @@ def save(operator, context, filepath, global_matrix, export_bbox, local_origin):
         ofile.write("num_as         " + str(num_as) + "\n")
         ofile.write("frame_counts   " + " ".join(frame_counts) + "\n")
         ofile.write("has_collision  " + str(1 if export_bbox is True else 0) + "\n")
+        ofile.write("num_lods       " + str(len(lod_verts)) + "\n")
+        ofile.write("lod_verts      " + " ".join(lod_verts) + "\n")
 
         #####################################################################
         # Write vertices and their attributes 
         #####################################################################
 
-        for obj in mesh_objs:
-            mesh = obj.data
-
-            for face in mesh.polygons:
-                for loop_idx in face.loop_indices:
-
-                    ws_mat = Matrix.Identity(4) if local_origin else obj.matrix_world
-                    trans = global_matrix * ws_mat
+        for obj, mesh in base_meshes:
+            write_vertices(ofile, obj, mesh, arms, textured_mats, global_matrix, local_origin)
 
-                    v = mesh.vertices[mesh.loops[loop_idx].vertex_index]
-                    v_co_world = trans * v.co
-
-                    line = "v {v.x:.6f} {v.y:.6f} {v.z:.6f}\n"
-                    line = line.format(v=v_co_world)
-                    ofile.write(line)
-
-                    uv_coords = mesh.uv_layers.active.data[loop_idx].uv
-                    line = "vt {uv.x:.6f} {uv.y:.6f}\n"
-                    line = line.format(uv=uv_coords)
-                    ofile.write(line)
-
-                    # The following line will give per-face normals instead
-                    # Make it an option at some point ...
-                    #normal = global_matrix * mesh.loops[loop_idx].normal
-                    normal = global_matrix * v.normal
-                    line = "vn {n[0]:.6f} {n[1]:.6f} {n[2]:.6f}\n"
-                    line = line.format(n=normal)
-                    ofile.write(line)
-
-                    line = "vw ";
-                    joint_idx_weight_map = {}
-                    for vg in v.groups:
-
-                        if vg.weight == 0:
-                            continue
-
-                        bone_name = obj.vertex_groups[vg.group].name
-                        if bone_name not in arms[0].data.bones.keys():
-                            continue
-
-                        joint = arms[0].data.bones[bone_name]
-                        joint_idx = arms[0].data.bones.values().index(joint)
-
-                        joint_idx_weight_map[joint_idx] = vg.weight
-
-                    # Write the joints ordered by weight - we only use the top 6 highest weights
-                    # in the engine
-                    from operator import itemgetter
-                    for tuple in sorted(joint_idx_weight_map.items(), key=itemgetter(1), reverse=True):
-                        next_elem = " {g}/{w:.6f}"
-                        next_elem = next_elem.format(g=tuple[0], w=tuple[1])
-                        line += next_elem
-
-                    line += "\n"
-                    ofile.write(line)
-
-                    mat_name = mesh.materials[face.material_index].name
-                    #mat_idx = textured_mats.index( mesh.materials[face.material_index] )
-                    mat_idx = [mat.name for mat in textured_mats].index(mat_name)
-                    line = "vm {idx}\n"
-                    line = line.format(idx=mat_idx)
-                    ofile.write(line)
+        for level in lod_meshes:
+            for obj, mesh in level:
+                write_vertices(ofile, obj, mesh, arms, textured_mats, global_matrix, local_origin)
 
         #####################################################################
         # Write materials 
@@ -309,5 +363,8 @@ def save(operator, context, filepath, global_matrix, export_bbox, local_origin):
         line = "z_bounds {a:.6f} {b:.6f}\n".format(a=min_z, b=max_z)
         ofile.write(line)
 
+        for mesh in generated:
+            bpy.data.meshes.remove(mesh)
+
         return {'FINISHED'}
 
@@ -0,0 +1,170 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2024 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+
+#
+#  Driver for the engine's micro-benchmarks. The native ones are exposed 
+#  by the 'pf_bench' module, which is not a part of the 'pf' API.
+#
+#  Arguments (passed to the engine as '--name=value'):
+#      bench_suite  - one of: pos_index, hash_map, math, containers, 
+#                     nav_queues, pickle (default: all of them)
+#      bench_units  - number of entities for 'pos_index' (default: 5000)
+#      bench_ticks  - number of simulated ticks for 'pos_index' (default: 100)
+#      bench_map    - map loaded for 'nav_queues' (default: plain.pfmap)
+#      bench_runs   - number of runs for 'nav_queues' (default: 10)
+#      bench_scale  - multiplier for the size of the 'pickle' object graphs 
+#                     (default: 1)
+#      bench_repeat - number of times each 'pickle' graph is pickled 
+#                     (default: 5)
+#
+
+import pf
+import pf_bench
+
+def int_arg(name, default):
+    value = pf.get_arg(name)
+    return default if value is None else int(value)
+
+def bench_pos_index():
+    nents = int_arg("bench_units", 5000)
+    nticks = int_arg("bench_ticks", 100)
+    results = pf_bench.position_index(nents, nticks)
+    print("Position index benchmark: {0} entities, {1} ticks".format(nents, nticks))
+    for name in ("quadtree", "grid"):
+        r = results[name]
+        print("  {name:<8} insert: {insert_ms:8.2f} ms  move: {move_ms:8.2f} ms  query: {query_ms:8.2f} ms  copy: {copy_ms:8.2f} ms  found: {found}" \
+            .format(name=name, **r))
+
+def bench_hash_map():
+    print("Hash map benchmark (times in ms)")
+    for n in (1000, 10000, 100000):
+        results = pf_bench.hash_maps(n)
+        for name in ("khash", "flat_map"):
+            r = results[name]
+            print("  {n:>6} {name:<8} insert: {insert_ms:8.2f}  hit: {hit_ms:8.2f}  miss: {miss_ms:8.2f}  delete: {delete_ms:8.2f}  iterate: {iterate_ms:8.2f}" \
+                .format(n=n, name=name, **r))
+
+def bench_math():
+    ops = ("mult4x4", "mult4x1", "inverse", "quat_mult", "mult4x4_batch", "mult4x1_batch")
+    print("Math benchmark (times in ms)")
+    for n in (64, 1024, 16384):
+        results = pf_bench.math(n)
+        for name in ("scalar", "simd"):
+            r = results[name]
+            print("  {n:>6} {name:<7} ".format(n=n, name=name) \
+                + "  ".join("{op}: {ms:8.2f}".format(op=op, ms=r[op + "_ms"]) for op in ops))
+
+def bench_containers():
+    print("Container benchmark (times in ms)")
+    for n in (1000, 10000, 100000):
+        results = pf_bench.containers(n)
+        for name in ("vec", "queue", "pqueue", "khash", "lru", "mpool"):
+            r = results[name]
+            print("  {n:>6} {name:<7} insert: {insert_ms:8.2f}  lookup: {lookup_ms:8.2f}  delete: {delete_ms:8.2f}  iterate: {iterate_ms:8.2f}" \
+                .format(n=n, name=name, **r))
+
+def bench_nav_queues():
+    mapname = pf.get_arg("bench_map") or "plain.pfmap"
+    nruns = int_arg("bench_runs", 10)
+    pf.load_map("assets/maps", mapname)
+    results = pf_bench.nav_queues(nruns)
+    print("Navigation queue benchmark: {0}, {1} runs".format(mapname, nruns))
+    for name in ("binary_heap", "indexed_heap", "bucket_queue"):
+        r = results[name]
+        print("  {name:<12} integrate: {integrate_ms:8.2f} ms  fields: {fields:6d}  checksum: {checksum:.1f}" \
+            .format(name=name, **r))
+
+class Unit(object):
+    def __init__(self, i):
+        self.uid = i
+        self.hp = 100.0 - (i % 50)
+        self.name = "unit_%d" % i
+        self.orders = [(i, i + 1), (i * 2, i * 3)]
+
+def make_workloads(scale):
+    n = 10000 * scale
+    ints = list(range(n * 10))
+    floats = [float(i) * 0.5 for i in range(n * 5)]
+    strdict = dict(("key_%d" % i, float(i)) for i in range(n * 2))
+    tuples = [(i, float(i), "s%d" % (i % 100)) for i in range(n)]
+    nested = dict((i, {"pos": (float(i), 0.0, float(-i)), "tags": ["a", "b", str(i % 10)]}) for i in range(n))
+    units = [Unit(i) for i in range(n // 2)]
+    return [
+        ("ints", ints),
+        ("floats", floats),
+        ("str_dict", strdict),
+        ("tuples", tuples),
+        ("nested_dicts", nested),
+        ("instances", units),
+    ]
+
+def time_ms(func, arg, repeat):
+    best = None
+    ret = None
+    for _ in range(repeat):
+        begin = pf.get_ticks()
+        ret = func(arg)
+        elapsed = pf.ticks_delta(begin, pf.get_ticks())
+        best = elapsed if best is None else min(best, elapsed)
+    return best, ret
+
+def bench_pickle():
+    scale = int_arg("bench_scale", 1)
+    repeat = int_arg("bench_repeat", 5)
+    print("Pickle benchmark: scale {0}, best of {1}".format(scale, repeat))
+    for name, obj in make_workloads(scale):
+        pickle_ms, s = time_ms(pf.pickle_object, obj, repeat)
+        unpickle_ms, _ = time_ms(pf.unpickle_object, s, repeat)
+        print("  {0:<14} pickle: {1:6d} ms  unpickle: {2:6d} ms  size: {3:10d} bytes" \
+            .format(name, pickle_ms, unpickle_ms, len(s)))
+
+SUITES = [
+    ("pos_index",  bench_pos_index),
+    ("hash_map",   bench_hash_map),
+    ("math",       bench_math),
+    ("containers", bench_containers),
+    ("nav_queues", bench_nav_queues),
+    ("pickle",     bench_pickle),
+]
+
+suite = pf.get_arg("bench_suite")
+names = [name for name, _ in SUITES]
+if suite is not None and suite not in names:
+    print("Unknown benchmark suite '{0}' (expected one of: {1})".format(suite, ", ".join(names)))
+for name, func in SUITES:
+    if suite is None or suite == name:
+        func()
+
+pf.global_event(pf.SDL_QUIT, None)
@@ -45,9 +45,11 @@ class AnimCombatable(pf.AnimEntity, pf.CombatableEntity, cont.Controllable):
     Mixin base that extends animated and combatable entities with behaviours for 
     playing specific animations on attack and death, as well as adds 'hold positon'
     and 'attack' actions.
-        
+
+    Subclasses declaring __slots__ must include 'attacking'.
     """
     __metaclass__ = ABCMeta
+    __slots__ = ()
 
     def __init__(self, path, pfobj, name, **kwargs):
         super(AnimCombatable, self).__init__(path, pfobj, name, **kwargs)
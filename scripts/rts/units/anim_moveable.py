@@ -43,8 +43,11 @@ class AnimMoveable(pf.AnimEntity, pf.MovableEntity, cont.Controllable):
     """ 
     Mixin base that extends animated entities with behaviours for playing specific
     animations on movement, as well as adds 'move' and 'stop' actions.
+
+    Subclasses declaring __slots__ must include 'moving'.
     """
     __metaclass__ = ABCMeta
+    __slots__ = ()
 
     def __init__(self, path, pfobj, name, **kwargs):
         super(AnimMoveable, self).__init__(path, pfobj, name, **kwargs)
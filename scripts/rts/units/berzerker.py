@@ -36,6 +36,7 @@ import anim_moveable as am
 import anim_combatable as ac
 
 class Berzerker(am.AnimMoveable, ac.AnimCombatable):
+    __slots__ = ('moving', 'attacking')
 
     def __init__(self, path, pfobj, name):
         super(Berzerker, self).__init__(path, pfobj, name, 
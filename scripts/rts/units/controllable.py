@@ -40,8 +40,13 @@ import rts.action
 class Controllable(pf.Entity):
     """
     Mixin base that adds the ability to customize the entity's actions in the action pad.
+
+    The unit mixins declare empty __slots__ so that a concrete unit type can opt out of
+    the per-instance __dict__ by listing all of its state (including the state of the
+    mixins it derives from) in its own __slots__.
     """
     __metaclass__ = ABCMeta
+    __slots__ = ()
 
     def __init__(self, path, pfobj, name, **kwargs):
         super(Controllable, self).__init__(path, pfobj, name, **kwargs)
@@ -35,6 +35,8 @@
 import anim_moveable as am
 
 class Deer(am.AnimMoveable):
+    __slots__ = ('moving',)
+
     def __init__(self, path, pfobj, name):
         super(Deer, self).__init__(path, pfobj, name, idle_clip=self.idle_anim())
         self.speed = 20.0
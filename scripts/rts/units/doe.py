@@ -35,6 +35,7 @@
 import anim_moveable as am
 
 class Doe(am.AnimMoveable):
+    __slots__ = ('moving',)
 
     def __init__(self, path, pfobj, name):
         super(Doe, self).__init__(path, pfobj, name, idle_clip=self.idle_anim())
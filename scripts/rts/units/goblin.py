@@ -36,6 +36,7 @@ import anim_moveable as am
 import anim_combatable as ac
 
 class Goblin(am.AnimMoveable, ac.AnimCombatable):
+    __slots__ = ('moving', 'attacking', 'attack_anim_idx')
 
     def __init__(self, path, pfobj, name):
         self.attack_anim_idx = 0
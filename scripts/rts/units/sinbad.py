@@ -40,6 +40,7 @@ import weakref
 import rts.action
 
 class Sinbad(am.AnimMoveable, ac.AnimCombatable):
+    __slots__ = ('moving', 'attacking', 'idle_idx', 'idle_map', 'attack_idx', 'attack_map')
 
     def __init__(self, path, pfobj, name):
         self.idle_idx = 0
@@ -0,0 +1,169 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 430 core
+
+/* Every invocation tests one instance of a multi-draw call against the 
+ * planes of the view frustum. The draw IDs of the instances that pass are 
+ * compacted to the front of their command's instance range, and the command's 
+ * instance count is incremented, so that the output command buffer can be 
+ * consumed by glMultiDrawArraysIndirect directly.
+ */
+
+#define WORKGROUP_SIZE  (64)
+
+struct draw_cmd{
+    uint count;
+    uint instance_count;
+    uint first_index;
+    uint base_instance;
+};
+
+layout(local_size_x = WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = 0) readonly buffer in_cmds
+{
+    /* (number of commands, number of instances, unused, unused) */
+    uvec4    dims;
+    /* The frustum planes as (inward-facing normal, distance) */
+    vec4     planes[6];
+    draw_cmd cmds[];
+};
+layout(std430, binding = 1) readonly buffer in_bounds
+{
+    /* The object-space AABB of every command's mesh as (min, max) pairs */
+    vec4     bounds[];
+};
+layout(std430, binding = 2) buffer o_cmds
+{
+    draw_cmd out_cmds[];
+};
+layout(std430, binding = 3) writeonly buffer o_ids
+{
+    int      draw_ids[];
+};
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+/* Per-instance buffer contents:
+ *  +--------------------------------------------------+ <-- base
+ *  | mat4x4_t (16 floats)                             | (model matrix)
+ *  +--------------------------------------------------+
+ *  | ...                                              |
+ *  +--------------------------------------------------+
+ */
+
+uniform samplerBuffer attrbuff;
+uniform int attrbuff_offset;
+uniform int attr_stride;
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+vec4 read_vec4(int base)
+{
+    int size = textureSize(attrbuff);
+    return vec4(
+        texelFetch(attrbuff, (base + 0) % size).r,
+        texelFetch(attrbuff, (base + 1) % size).r,
+        texelFetch(attrbuff, (base + 2) % size).r,
+        texelFetch(attrbuff, (base + 3) % size).r
+    );
+}
+
+mat4 read_mat4(int base)
+{
+    return mat4(
+        read_vec4(base +  0),
+        read_vec4(base +  4),
+        read_vec4(base +  8),
+        read_vec4(base + 12)
+    );
+}
+
+/* Find the last command whose instance range begins at or before 'inst' */
+uint cmd_for_instance(uint inst)
+{
+    uint lo = 0u, hi = dims.x - 1u;
+    while(lo < hi) {
+        uint mid = (lo + hi + 1u) / 2u;
+        if(cmds[mid].base_instance <= inst)
+            lo = mid;
+        else
+            hi = mid - 1u;
+    }
+    return lo;
+}
+
+bool box_visible(mat4 model, vec3 bmin, vec3 bmax)
+{
+    vec3 center = (model * vec4((bmin + bmax) * 0.5, 1.0)).xyz;
+    vec3 half_ext = (bmax - bmin) * 0.5;
+
+    for(int i = 0; i < 6; i++) {
+
+        vec3 n = planes[i].xyz;
+        /* The projected radius of the transformed box onto the plane normal */
+        float r = half_ext.x * abs(dot(n, model[0].xyz))
+                + half_ext.y * abs(dot(n, model[1].xyz))
+                + half_ext.z * abs(dot(n, model[2].xyz));
+
+        if(dot(n, center) + planes[i].w < -r)
+            return false;
+    }
+    return true;
+}
+
+void main()
+{
+    uint inst = gl_GlobalInvocationID.x;
+    if(inst >= dims.y)
+        return;
+
+    uint cmd = cmd_for_instance(inst);
+    int size = textureSize(attrbuff);
+    int base = (attrbuff_offset / 4 + int(inst) * attr_stride) % size;
+    mat4 model = read_mat4(base);
+
+    if(!box_visible(model, bounds[cmd * 2u].xyz, bounds[cmd * 2u + 1u].xyz))
+        return;
+
+    uint slot = atomicAdd(out_cmds[cmd].instance_count, 1u);
+    draw_ids[cmds[cmd].base_instance + slot] = int(inst);
+}
+
@@ -0,0 +1,83 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 430 core
+
+/* Every invocation reduces one HIZ_BLOCK x HIZ_BLOCK block of the depth
+ * buffer to its farthest depth value. This is the base level of the depth 
+ * pyramid, which is read back and used for occlusion culling on the CPU.
+ */
+
+#define WORKGROUP_SIZE  (8)
+#define HIZ_BLOCK       (16)
+
+layout(local_size_x = WORKGROUP_SIZE, local_size_y = WORKGROUP_SIZE, local_size_z = 1) in;
+
+layout(std430, binding = 0) writeonly buffer o_depths
+{
+    float depths[];
+};
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform sampler2D texture0;
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+void main()
+{
+    ivec2 size = textureSize(texture0, 0);
+    ivec2 out_size = (size + HIZ_BLOCK - 1) / HIZ_BLOCK;
+    ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+
+    if(any(greaterThanEqual(cell, out_size)))
+        return;
+
+    ivec2 begin = cell * HIZ_BLOCK;
+    ivec2 end = min(begin + HIZ_BLOCK, size);
+    float farthest = 0.0;
+
+    for(int y = begin.y; y < end.y; y++) {
+    for(int x = begin.x; x < end.x; x++) {
+        farthest = max(farthest, texelFetch(texture0, ivec2(x, y), 0).r);
+    }}
+
+    depths[cell.y * out_size.x + cell.x] = farthest;
+}
+
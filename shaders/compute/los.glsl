@@ -0,0 +1,158 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 430 core
+
+/* Every invocation computes the visibility of one tile of one job. 
+ *   gl_GlobalInvocationID.x - the tile column within the chunk
+ *   gl_GlobalInvocationID.y - the tile row within the chunk
+ *   gl_GlobalInvocationID.z - the job index
+ * A tile is visible when straight lines from its' center and from its' 
+ * (slightly inset) corners to the center of the target tile don't pass 
+ * through any blocked tile. All coordinates are in tiles, relative to the 
+ * blocked mask origin.
+ */
+
+#define WORD_BITS   (32)
+#define CORNER_OFF  (0.45)
+
+struct los_job{
+    int   chunk_r;
+    int   chunk_c;
+    int   target_r;
+    int   target_c;
+};
+
+layout(local_size_x = 32, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = 0) readonly buffer in_jobs
+{
+    /* (mask rows, mask columns, words per mask row, unused) */
+    ivec4   dims;
+    los_job jobs[];
+};
+layout(std430, binding = 1) readonly buffer in_mask
+{
+    uint    blocked[];
+};
+layout(std430, binding = 2) writeonly buffer o_data
+{
+    uint    visible[];
+};
+
+shared uint s_word;
+
+bool blocked_at(ivec2 tile)
+{
+    if(tile.x < 0 || tile.x >= dims.x || tile.y < 0 || tile.y >= dims.y)
+        return true;
+    uint word = blocked[tile.x * dims.z + tile.y / WORD_BITS];
+    return ((word >> (tile.y % WORD_BITS)) & 0x1u) != 0u;
+}
+
+/* Visit every tile touched by the segment (Amanatides & Woo) */
+bool ray_clear(vec2 from, vec2 to)
+{
+    ivec2 curr = ivec2(floor(from));
+    ivec2 end = ivec2(floor(to));
+    vec2 delta = to - from;
+
+    ivec2 dir = ivec2(sign(delta));
+    vec2 inv = vec2(
+        delta.x != 0.0 ? 1.0 / abs(delta.x) : 1e30,
+        delta.y != 0.0 ? 1.0 / abs(delta.y) : 1e30
+    );
+    vec2 next = vec2(
+        dir.x == 0 ? 1e30 : (dir.x > 0 ? (float(curr.x) + 1.0 - from.x) : (from.x - float(curr.x))) * inv.x,
+        dir.y == 0 ? 1e30 : (dir.y > 0 ? (float(curr.y) + 1.0 - from.y) : (from.y - float(curr.y))) * inv.y
+    );
+
+    int nsteps = abs(end.x - curr.x) + abs(end.y - curr.y);
+    for(int i = 0; i <= nsteps; i++) {
+
+        /* The target tile itself may be blocked (ex. when attacking) */
+        if(curr == end)
+            break;
+        if(blocked_at(curr))
+            return false;
+
+        if(next.x < next.y) {
+            next.x += inv.x;
+            curr.x += dir.x;
+        }else{
+            next.y += inv.y;
+            curr.y += dir.y;
+        }
+    }
+    return true;
+}
+
+void main()
+{
+    uint job_idx = gl_GlobalInvocationID.z;
+    uint cols = gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+    uint rows = gl_NumWorkGroups.y * gl_WorkGroupSize.y;
+
+    if(gl_LocalInvocationIndex == 0u)
+        s_word = 0u;
+    barrier();
+
+    los_job job = jobs[job_idx];
+    ivec2 tile = ivec2(
+        job.chunk_r * int(rows) + int(gl_GlobalInvocationID.y),
+        job.chunk_c * int(cols) + int(gl_GlobalInvocationID.x)
+    );
+    vec2 center = vec2(tile) + vec2(0.5);
+    vec2 target = vec2(job.target_r, job.target_c) + vec2(0.5);
+
+    bool vis = !blocked_at(tile)
+            && ray_clear(center, target)
+            && ray_clear(center + vec2(-CORNER_OFF, -CORNER_OFF), target)
+            && ray_clear(center + vec2(-CORNER_OFF,  CORNER_OFF), target)
+            && ray_clear(center + vec2( CORNER_OFF, -CORNER_OFF), target)
+            && ray_clear(center + vec2( CORNER_OFF,  CORNER_OFF), target);
+
+    if(vis)
+        atomicOr(s_word, 1u << gl_LocalInvocationID.x);
+    barrier();
+
+    if(gl_LocalInvocationIndex == 0u) {
+        uint words_per_row = cols / WORD_BITS;
+        uint idx = job_idx * rows * words_per_row
+                 + gl_GlobalInvocationID.y * words_per_row
+                 + gl_GlobalInvocationID.x / WORD_BITS;
+        visible[idx] = s_word;
+    }
+}
@@ -0,0 +1,114 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#version 330 core
+#extension GL_ARB_bindless_texture : require
+
+/*****************************************************************************/
+/* INPUTS                                                                    */
+/*****************************************************************************/
+
+in VertexToFrag {
+         vec2 uv;
+    flat int  mat_idx;
+         vec3 world_pos;
+         vec3 normal;
+         vec4 light_space_pos;
+    flat int  draw_id;
+}from_vertex;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+/* The resident handles of all the material texture arrays */
+uniform usamplerBuffer tex_handles;
+
+/* Per-instance buffer contents:
+ *  +--------------------------------------------------+ <-- base
+ *  | mat4x4_t (16 floats)                             | (model matrix)
+ *  +--------------------------------------------------+
+ *  | vec2_t[16] (32 floats)                           | (material:handle index, slice)
+ *  +--------------------------------------------------+
+ *  ...
+ *	| depends on the instance type (animated, etc.)    |
+ *  ...
+ */
+
+uniform samplerBuffer attrbuff;
+uniform int attrbuff_offset;
+uniform int attr_stride;
+uniform int attr_offset;
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+int inst_attr_base(int draw_id)
+{
+    int size = textureSize(attrbuff);
+    int inst_offset = draw_id * attr_stride;
+    return (attrbuff_offset / 4 + inst_offset) % size;
+}
+
+vec2 read_vec2(int base)
+{
+    int size = textureSize(attrbuff);
+
+    return vec2(
+        texelFetch(attrbuff, (base + 0) % size).r,
+        texelFetch(attrbuff, (base + 1) % size).r
+    );
+}
+
+float inst_tex_alpha(int draw_id, int mat_idx, vec2 uv)
+{
+    int size = textureSize(attrbuff);
+    int table_base = (inst_attr_base(draw_id) + 16) % size;
+
+    vec2 tex_lookup = read_vec2(table_base + mat_idx * 2);
+    uvec2 handle = texelFetch(tex_handles, int(tex_lookup.x)).rg;
+    return texture(sampler2DArray(handle), vec3(uv, tex_lookup.y)).a;
+}
+
+void main()
+{
+    /* Same alpha test as in the shading pass, so that the depth is only 
+     * written where the surface will be drawn */
+    if(inst_tex_alpha(from_vertex.draw_id, from_vertex.mat_idx, from_vertex.uv) <= 0.5)
+        discard;
+}
+
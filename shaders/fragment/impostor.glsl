@@ -0,0 +1,90 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+/*****************************************************************************/
+/* INPUTS                                                                    */
+/*****************************************************************************/
+
+in VertexToFrag {
+         vec2  uv;
+    flat int   layer;
+         float fade;
+}from_vertex;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out vec4 o_frag_color;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform sampler2DArray impostor_atlas;
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+/* 4x4 ordered dither threshold in (0, 1) */
+float dither_threshold(ivec2 frag)
+{
+    const float bayer[16] = float[16](
+         0.0,  8.0,  2.0, 10.0,
+        12.0,  4.0, 14.0,  6.0,
+         3.0, 11.0,  1.0,  9.0,
+        15.0,  7.0, 13.0,  5.0
+    );
+    int idx = (frag.y % 4) * 4 + (frag.x % 4);
+    return (bayer[idx] + 0.5) / 16.0;
+}
+
+void main()
+{
+    vec4 tex_color = texture(impostor_atlas, vec3(from_vertex.uv, from_vertex.layer));
+    if(tex_color.a <= 0.5)
+        discard;
+
+    /* Fade in with a screen-door pattern so that the sprites need no 
+     * sorting, and the mesh being faded out can be drawn as usual */
+    if(from_vertex.fade < dither_threshold(ivec2(gl_FragCoord.xy)))
+        discard;
+
+    o_frag_color = vec4(tex_color.rgb, 1.0);
+}
+
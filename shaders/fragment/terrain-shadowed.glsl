@@ -54,6 +54,7 @@
 
 #define SHADOW_MAP_BIAS 0.002
 #define SHADOW_MULTIPLIER 0.7
+#define MAX_CASCADES      4
 
 #define STATE_UNEXPLORED 0
 #define STATE_IN_FOG     1
@@ -87,12 +88,20 @@ out vec4 o_frag_color;
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
 
-uniform vec3 ambient_color;
-uniform vec3 light_color;
-uniform vec3 light_pos;
-uniform vec3 view_pos;
-
-uniform sampler2D shadow_map;
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
+uniform sampler2DArray shadow_map;
+uniform mat4 shadow_cascade_trans[MAX_CASCADES];
+uniform vec4 shadow_cascade_scale;
+uniform int  shadow_cascade_count;
 
 uniform sampler2DArray tex_array0;
 
@@ -264,17 +273,51 @@ vec4 bilinear_interp_vec4
     );
 }
 
-float shadow_factor(vec4 light_space_pos)
+/* Find the first cascade containing the position. Returns the UV within 
+ * its' layer and the depth in 'xyz' and the layer index in 'w', or a
+ * negative 'w' if the position falls outside of all the cascades.
+ * Like the single shadow map before it, the last cascade is only bounded
+ * by the texture size and shadows the positions past its' far edges with
+ * its' edge texels.
+ */
+vec4 cascade_coords(vec3 world_pos)
 {
-    vec3 proj_coords = (light_space_pos.xyz / light_space_pos.w) * 0.5 + 0.5;
-    if(proj_coords.x < 0 || proj_coords.x >= textureSize(shadow_map, 0).x)
-        return 0.0;
-    if(proj_coords.y < 0 || proj_coords.y >= textureSize(shadow_map, 0).y)
+    for(int i = 0; i < shadow_cascade_count; i++) {
+
+        vec4 ls_pos = shadow_cascade_trans[i] * vec4(world_pos, 1.0);
+        vec3 proj_coords = (ls_pos.xyz / ls_pos.w) * 0.5 + 0.5;
+        vec2 bound = (i == shadow_cascade_count - 1) ? vec2(textureSize(shadow_map, 0).xy) 
+                                                     : vec2(1.0);
+        if(proj_coords.x < 0.0 || proj_coords.x >= bound.x)
+            continue;
+        if(proj_coords.y < 0.0 || proj_coords.y >= bound.y)
+            continue;
+        return vec4(proj_coords.xy * shadow_cascade_scale[i], proj_coords.z, float(i));
+    }
+    return vec4(0.0, 0.0, 0.0, -1.0);
+}
+
+/* Sample the depth of the cascade at an offset from 'coords'. The samples
+ * are clamped to the cascade's region of its' layer, which the edge clamping 
+ * of the texture does not do for the cascades rendered at a lower resolution.
+ */
+float cascade_depth(vec4 coords, vec2 offset)
+{
+    float scale = shadow_cascade_scale[int(coords.w)];
+    vec2 half_texel = 0.5 / textureSize(shadow_map, 0).xy;
+    vec2 uv = clamp(coords.xy + offset, vec2(0.0), vec2(scale) - half_texel);
+    return texture(shadow_map, vec3(uv, coords.w)).r;
+}
+
+float shadow_factor(vec3 world_pos)
+{
+    vec4 proj_coords = cascade_coords(world_pos);
+    if(proj_coords.w < 0.0)
         return 0.0;
     if(proj_coords.z > 0.95)
         return 0.0;
 
-    float closest_depth = texture(shadow_map, proj_coords.xy).r;
+    float closest_depth = cascade_depth(proj_coords, vec2(0.0));
     float current_depth = proj_coords.z;
     if(current_depth - SHADOW_MAP_BIAS > closest_depth) {
         return 1.0;
@@ -283,24 +326,22 @@ float shadow_factor(vec4 light_space_pos)
     }
 }
 
-float shadow_factor_pcf(vec4 light_space_pos)
+float shadow_factor_pcf(vec3 world_pos)
 {
-    vec3 proj_coords = (light_space_pos.xyz / light_space_pos.w) * 0.5 + 0.5;
-    if(proj_coords.x < 0 || proj_coords.x >= textureSize(shadow_map, 0).x)
-        return 0.0;
-    if(proj_coords.y < 0 || proj_coords.y >= textureSize(shadow_map, 0).y)
+    vec4 proj_coords = cascade_coords(world_pos);
+    if(proj_coords.w < 0.0)
         return 0.0;
     if(proj_coords.z > 0.95)
         return 0.0;
 
     float shadow = 0.0;
-    vec2 texel_size = 1.0 / textureSize(shadow_map, 0);
+    vec2 texel_size = 1.0 / textureSize(shadow_map, 0).xy;
     float current_depth = proj_coords.z;
 
     for(int x = -1; x <= 1; x++) {
     for(int y = -1; y <= 1; y++) {
 
-        float pcf_depth = texture(shadow_map, proj_coords.xy + vec2(x, y) * texel_size).r; 
+        float pcf_depth = cascade_depth(proj_coords, vec2(x, y) * texel_size); 
         shadow += (current_depth - SHADOW_MAP_BIAS > pcf_depth ? 1.0 : 0.0);
     }}
 
@@ -308,7 +349,7 @@ float shadow_factor_pcf(vec4 light_space_pos)
     return shadow;
 }
 
-float shadow_factor_poisson(vec4 light_space_pos)
+float shadow_factor_poisson(vec3 world_pos)
 {
     vec2 poisson_disk[4] = vec2[](
         vec2( -0.94201624,  -0.39906216 ),
@@ -317,22 +358,20 @@ float shadow_factor_poisson(vec4 light_space_pos)
         vec2(  0.34495938,   0.29387760 )
     );
 
-    vec3 proj_coords = (light_space_pos.xyz / light_space_pos.w) * 0.5 + 0.5;
-    if(proj_coords.x < 0 || proj_coords.x >= textureSize(shadow_map, 0).x)
-        return 0.0;
-    if(proj_coords.y < 0 || proj_coords.y >= textureSize(shadow_map, 0).y)
+    vec4 proj_coords = cascade_coords(world_pos);
+    if(proj_coords.w < 0.0)
         return 0.0;
     if(proj_coords.z > 0.95)
         return 0.0;
 
     float current_depth = proj_coords.z;
-    float closest_depth = texture(shadow_map, proj_coords.xy).r;
+    float closest_depth = cascade_depth(proj_coords, vec2(0.0));
     float shadow = (current_depth - SHADOW_MAP_BIAS > closest_depth) ? 1.0 : 0.0;
     float visibility = 1.0;
 
     for(int i = 0; i < 4; i++) {
     
-        float depth = texture(shadow_map, proj_coords.xy + poisson_disk[i]/256.0).r; 
+        float depth = cascade_depth(proj_coords, poisson_disk[i]/256.0); 
         if(current_depth - SHADOW_MAP_BIAS <= depth)
             visibility -= 0.25;
     }
@@ -514,7 +553,7 @@ void main()
     vec3 specular = SPECULAR_STRENGTH * light_color * (spec * TERRAIN_SPECULAR);
 
     vec4 final_color = vec4( (ambient + diffuse + specular) * tex_color.xyz, 1.0);
-    float shadow = shadow_factor_poisson(from_vertex.light_space_pos);
+    float shadow = shadow_factor_poisson(from_vertex.world_pos);
     if(shadow > 0.0) {
         o_frag_color = vec4(final_color.xyz * (SHADOW_MULTIPLIER + (1.0 - shadow) * (1.0 - SHADOW_MULTIPLIER)), 1.0);
     }else{
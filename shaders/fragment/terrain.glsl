@@ -83,10 +83,15 @@ layout(location = 0) out vec4 o_frag_color;
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
 
-uniform vec3 ambient_color;
-uniform vec3 light_color;
-uniform vec3 light_pos;
-uniform vec3 view_pos;
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
 
 uniform sampler2DArray tex_array0;
 
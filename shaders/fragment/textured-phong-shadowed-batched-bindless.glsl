@@ -0,0 +1,248 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+#extension GL_ARB_bindless_texture : require
+
+#define SPECULAR_STRENGTH  0.5
+#define SPECULAR_SHININESS 2
+
+#define SHADOW_MAP_BIAS 0.002
+#define SHADOW_MULTIPLIER 0.7
+#define MAX_CASCADES      4
+
+/*****************************************************************************/
+/* INPUTS                                                                    */
+/*****************************************************************************/
+
+in VertexToFrag {
+         vec2 uv;
+    flat int  mat_idx;
+         vec3 world_pos;
+         vec3 normal;
+         vec4 light_space_pos;
+    flat int  draw_id;
+}from_vertex;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out vec4 o_frag_color;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
+#ifdef FEATURE_SHADOWS
+uniform sampler2DArray shadow_map;
+uniform mat4 shadow_cascade_trans[MAX_CASCADES];
+uniform vec4 shadow_cascade_scale;
+uniform int  shadow_cascade_count;
+#endif
+
+/* The resident handles of all the material texture arrays */
+uniform usamplerBuffer tex_handles;
+
+/* Per-instance buffer contents:
+ *  +--------------------------------------------------+ <-- base
+ *  | mat4x4_t (16 floats)                             | (model matrix)
+ *  +--------------------------------------------------+
+ *  | vec2_t[16] (32 floats)                           | (material:handle index, slice)
+ *  +--------------------------------------------------+
+ *  | {float, float, vec3_t, vec3_t}[16] (128 floats)  | (material properties)
+ *  +--------------------------------------------------+
+ *  ...
+ *	| depends on the instance type (animated, etc.)    |
+ *  ...
+ */
+
+uniform samplerBuffer attrbuff;
+uniform int attrbuff_offset;
+uniform int attr_stride;
+uniform int attr_offset;
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+#ifdef FEATURE_SHADOWS
+
+/* Find the first cascade containing the position. Returns the UV within 
+ * its' layer and the depth in 'xyz' and the layer index in 'w', or a
+ * negative 'w' if the position falls outside of all the cascades.
+ * Like the single shadow map before it, the last cascade is only bounded
+ * by the texture size and shadows the positions past its' far edges with
+ * its' edge texels.
+ */
+vec4 cascade_coords(vec3 world_pos)
+{
+    for(int i = 0; i < shadow_cascade_count; i++) {
+
+        vec4 ls_pos = shadow_cascade_trans[i] * vec4(world_pos, 1.0);
+        vec3 proj_coords = (ls_pos.xyz / ls_pos.w) * 0.5 + 0.5;
+        vec2 bound = (i == shadow_cascade_count - 1) ? vec2(textureSize(shadow_map, 0).xy) 
+                                                     : vec2(1.0);
+        if(proj_coords.x < 0.0 || proj_coords.x >= bound.x)
+            continue;
+        if(proj_coords.y < 0.0 || proj_coords.y >= bound.y)
+            continue;
+        return vec4(proj_coords.xy * shadow_cascade_scale[i], proj_coords.z, float(i));
+    }
+    return vec4(0.0, 0.0, 0.0, -1.0);
+}
+
+/* Sample the depth of the cascade at an offset from 'coords'. The samples
+ * are clamped to the cascade's region of its' layer, which the edge clamping 
+ * of the texture does not do for the cascades rendered at a lower resolution.
+ */
+float cascade_depth(vec4 coords, vec2 offset)
+{
+    float scale = shadow_cascade_scale[int(coords.w)];
+    vec2 half_texel = 0.5 / textureSize(shadow_map, 0).xy;
+    vec2 uv = clamp(coords.xy + offset, vec2(0.0), vec2(scale) - half_texel);
+    return texture(shadow_map, vec3(uv, coords.w)).r;
+}
+
+float shadow_factor(vec3 world_pos)
+{
+    vec4 proj_coords = cascade_coords(world_pos);
+    if(proj_coords.w < 0.0)
+        return 0.0;
+    if(proj_coords.z > 0.95)
+        return 0.0;
+
+    float closest_depth = cascade_depth(proj_coords, vec2(0.0));
+    float current_depth = proj_coords.z;
+    if(current_depth - SHADOW_MAP_BIAS > closest_depth) {
+        return 1.0;
+    }else {
+        return 0.0;
+    }
+}
+
+#endif
+
+int inst_attr_base(int draw_id)
+{
+    int size = textureSize(attrbuff);
+    int inst_offset = draw_id * attr_stride;
+    return (attrbuff_offset / 4 + inst_offset) % size;
+}
+
+vec3 read_vec3(int base)
+{
+    int size = textureSize(attrbuff);
+
+    return vec3(
+        texelFetch(attrbuff, (base + 0) % size).r,
+        texelFetch(attrbuff, (base + 1) % size).r,
+        texelFetch(attrbuff, (base + 2) % size).r
+    );
+}
+
+vec2 read_vec2(int base)
+{
+    int size = textureSize(attrbuff);
+
+    return vec2(
+        texelFetch(attrbuff, (base + 0) % size).r,
+        texelFetch(attrbuff, (base + 1) % size).r
+    );
+}
+
+vec4 inst_tex_color(int draw_id, int mat_idx, vec2 uv)
+{
+    int size = textureSize(attrbuff);
+    int table_base = (inst_attr_base(draw_id) + 16) % size;
+
+    vec2 tex_lookup = read_vec2(table_base + mat_idx * 2);
+    uvec2 handle = texelFetch(tex_handles, int(tex_lookup.x)).rg;
+    return texture(sampler2DArray(handle), vec3(uv, tex_lookup.y));
+}
+
+void main()
+{
+    int base = inst_attr_base(from_vertex.draw_id);
+    int size = textureSize(attrbuff);
+
+    float ambient_intensity = texelFetch(attrbuff, (base + 48 + from_vertex.mat_idx * 8) % size).r;
+    vec3 diffuse_clr =  read_vec3(base + 48 + (from_vertex.mat_idx * 8) + 2);
+    vec3 specular_clr = read_vec3(base + 48 + (from_vertex.mat_idx * 8) + 5);
+
+    vec4 tex_color = inst_tex_color(from_vertex.draw_id, from_vertex.mat_idx, from_vertex.uv);
+
+    /* Simple alpha test to reject transparent pixels (with mipmapping) */
+    tex_color.rgb *= tex_color.a;
+    if(tex_color.a <= 0.5)
+        discard;
+
+    /* Ambient calculations */
+    vec3 ambient = ambient_intensity * ambient_color;
+
+    /* Diffuse calculations */
+    vec3 light_dir = normalize(light_pos - from_vertex.world_pos);  
+    float diff = max(dot(from_vertex.normal, light_dir), 0.0);
+    vec3 diffuse = light_color * (diff * diffuse_clr);
+
+    /* Specular calculations */
+    vec3 view_dir = normalize(view_pos - from_vertex.world_pos);
+    vec3 reflect_dir = reflect(-light_dir, from_vertex.normal);  
+    float spec = pow(max(dot(view_dir, reflect_dir), 0.0), SPECULAR_SHININESS);
+    vec3 specular = SPECULAR_STRENGTH * light_color * (spec * specular_clr);
+
+    vec4 final_color = vec4( (ambient + diffuse + specular) * tex_color.xyz, 1.0);
+#ifdef FEATURE_SHADOWS
+    float shadow = shadow_factor(from_vertex.world_pos);
+    if(shadow > 0.0) {
+        o_frag_color = vec4(final_color.xyz * SHADOW_MULTIPLIER, 1.0);
+    }else{
+        o_frag_color = final_color;
+    }
+#else
+    o_frag_color = final_color;
+#endif
+}
+
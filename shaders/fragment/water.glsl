@@ -56,6 +56,7 @@
 
 in VertexToFrag {
     vec4 clip_space_pos;
+    vec4 reflect_clip_pos;
     vec3 world_pos;
     vec2 uv;
     vec3 view_dir;
@@ -82,7 +83,15 @@ uniform float water_move_factor;
 uniform float cam_near;
 uniform float cam_far;
 
-uniform vec3 light_color;
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
 
 uniform vec2 water_tiling;
 
@@ -280,7 +289,9 @@ void main()
     vec2 refract_uv = clamp(ndc_pos + tot_dist, 0.001, 0.999);
     vec4 refract_clr = texture(refraction_tex, refract_uv);
 
-    vec2 reflect_uv = vec2(ndc_pos.x, -ndc_pos.y) + tot_dist;
+    /* The reflection may have been drawn on an earlier frame, reproject into it */
+    vec2 reflect_ndc = (from_vertex.reflect_clip_pos.xy / from_vertex.reflect_clip_pos.w)/2.0 + 0.5;
+    vec2 reflect_uv = vec2(reflect_ndc.x, -reflect_ndc.y) + tot_dist;
     reflect_uv.x = clamp(reflect_uv.x, 0.001, 0.999);
     reflect_uv.y = clamp(reflect_uv.y, -0.999, -0.001);
     vec4 reflect_clr = texture(reflection_tex, reflect_uv);
@@ -40,8 +40,16 @@ layout (location = 1) in vec3 in_color;
 layout (location = 2) in vec2 in_offset;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
 
 out VertexToFrag {
          vec4 color;
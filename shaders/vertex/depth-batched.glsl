@@ -42,7 +42,16 @@ layout (location = 4) in int  in_draw_id;
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
 
-uniform mat4 light_space_transform;
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
 uniform vec4 clip_plane0;
 
 /* Per-instance buffer contents:
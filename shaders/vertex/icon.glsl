@@ -0,0 +1,101 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+#version 330 core
+
+layout (location = 0) in vec3  in_pos;
+layout (location = 1) in vec2  in_uv;
+/* Per-instance attributes */
+layout (location = 2) in vec3  in_pos_ws;
+layout (location = 3) in vec2  in_offset;
+layout (location = 4) in int   in_slot;
+
+/* Must match the definitions in gl_icons.c */
+#define ATLAS_DIM       (2048)
+#define CELL_DIM        (64)
+#define CELLS_PER_ROW   (ATLAS_DIM / CELL_DIM)
+
+#define VRES_SCALE      (curr_res.y / 1080.0)
+#define CURR_ICON_SIZE  (32.0 * VRES_SCALE)
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out VertexToFrag {
+         vec2 uv;
+}to_fragment;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+/* Should be set up for screenspace rendering */
+
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
+uniform ivec2 curr_res;
+/* The game camera's transform, for placing the icons over the entities */
+uniform mat4  cam_view_proj;
+
+/*****************************************************************************/
+/* PROGRAM
+/*****************************************************************************/
+
+void main()
+{
+    /* Sample half a texel inside the cell so that the neighbouring 
+     * icons don't bleed in with linear filtering */
+    vec2 cell = vec2(in_slot % CELLS_PER_ROW, in_slot / CELLS_PER_ROW) * CELL_DIM;
+    to_fragment.uv = (cell + 0.5 + in_uv * (CELL_DIM - 1.0)) / ATLAS_DIM;
+
+    /* Convert the worldspace position to an SDL screenspace position */
+    vec4 clip = cam_view_proj * vec4(in_pos_ws, 1.0);
+    vec2 ndc = clip.xy / clip.w;
+    vec2 res = vec2(curr_res);
+    vec2 top_ss = vec2((ndc.x + 1.0) * res.x / 2.0, 
+                       res.y - ((ndc.y + 1.0) * res.y / 2.0));
+
+    vec2 ss_pos = top_ss + in_offset * VRES_SCALE + in_pos.xy * (CURR_ICON_SIZE / 2.0);
+    gl_Position = projection * view * vec4(ss_pos, 0.0, 1.0);
+}
+
@@ -0,0 +1,95 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+/* Must match the atlas layout in gl_impostor.c */
+#define IMPOSTOR_DIRS   8
+#define IMPOSTOR_ROWS   8
+
+layout (location = 0) in vec3  in_pos;
+layout (location = 1) in vec2  in_uv;
+/* Per-instance attributes */
+layout (location = 2) in vec4  in_center_size; /* worldspace center, half extent */
+layout (location = 3) in ivec3 in_cell;        /* atlas layer, column, row */
+layout (location = 4) in float in_fade;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out VertexToFrag {
+         vec2  uv;
+    flat int   layer;
+         float fade;
+}to_fragment;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
+uniform vec4 clip_plane0;
+
+/*****************************************************************************/
+/* PROGRAM
+/*****************************************************************************/
+
+void main()
+{
+    /* Span the quad along the camera's right and up axes, the same 
+     * way that the views in the atlas were framed */
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 ws_pos = in_center_size.xyz 
+                + (right * in_pos.x + up * in_pos.y) * in_center_size.w;
+
+    to_fragment.uv = (vec2(in_cell.y, in_cell.z) + in_uv) / vec2(IMPOSTOR_DIRS, IMPOSTOR_ROWS);
+    to_fragment.layer = in_cell.x;
+    to_fragment.fade = in_fade;
+
+    gl_Position = projection * view * vec4(ws_pos, 1.0);
+    gl_ClipDistance[0] = dot(vec4(ws_pos, 1.0), clip_plane0);
+}
+
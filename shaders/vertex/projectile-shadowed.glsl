@@ -0,0 +1,114 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+layout (location = 0) in vec3 in_pos;
+layout (location = 1) in vec2 in_uv;
+layout (location = 2) in vec3 in_normal;
+layout (location = 3) in int  in_material_idx;
+
+/* Per-instance attributes */
+layout (location = 4) in vec3 in_inst_pos;
+layout (location = 5) in vec3 in_inst_vel;
+layout (location = 6) in vec3 in_inst_scale;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out VertexToFrag {
+         vec2 uv;
+    flat int  mat_idx;
+         vec3 world_pos;
+         vec3 normal;
+         vec4 light_space_pos;
+}to_fragment;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
+uniform vec4 clip_plane0;
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+/* The projectile faces along its' velocity: it is rotated about the Y axis 
+ * (yaw) and then about the Z axis (pitch). The sines and cosines of both 
+ * angles are taken directly from the velocity components.
+ */
+mat4 instance_model()
+{
+    float h = length(in_inst_vel.xz);
+    float l = length(in_inst_vel);
+
+    float cy = (h > 0.0) ? in_inst_vel.z / h : 1.0;
+    float sy = (h > 0.0) ? in_inst_vel.x / h : 0.0;
+    float cz = (l > 0.0) ? h / l : 1.0;
+    float sz = (l > 0.0) ? in_inst_vel.y / l : 0.0;
+
+    vec3 c0 = vec3( cy * cz, sz,  -sy * cz) * in_inst_scale;
+    vec3 c1 = vec3(-cy * sz, cz,   sy * sz) * in_inst_scale;
+    vec3 c2 = vec3( sy,      0.0,  cy     ) * in_inst_scale;
+
+    return mat4(vec4(c0, 0.0), vec4(c1, 0.0), vec4(c2, 0.0), vec4(in_inst_pos, 1.0));
+}
+
+void main()
+{
+    mat4 model = instance_model();
+
+    to_fragment.uv = in_uv;
+    to_fragment.mat_idx = in_material_idx;
+    to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
+    to_fragment.normal = normalize(mat3(model) * in_normal);
+    to_fragment.light_space_pos = light_space_transform * vec4(to_fragment.world_pos, 1.0);
+
+    gl_Position = projection * view * vec4(to_fragment.world_pos, 1.0);
+    gl_ClipDistance[0] = dot(vec4(to_fragment.world_pos, 1.0), clip_plane0);
+}
+
@@ -35,8 +35,6 @@
 
 #version 330 core
 
-#define MAX_JOINTS 96
-
 layout (location = 0) in vec3  in_pos;
 layout (location = 4) in ivec3 in_joint_indices0;
 layout (location = 5) in ivec3 in_joint_indices1;
@@ -48,16 +46,40 @@ layout (location = 7) in vec3  in_joint_weights1;
 /*****************************************************************************/
 
 uniform mat4 model;
-uniform mat4 light_space_transform;
+
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
 uniform vec4 clip_plane0;
 
-uniform mat4 anim_curr_pose_mats[MAX_JOINTS];
-uniform mat4 anim_inv_bind_mats [MAX_JOINTS];
+/* Baked skinning matrices of all the loaded animations, 4 texels each. 
+ * 'pose_base' is the first matrix of the current frame.
+ */
+uniform samplerBuffer posebuff;
+uniform int pose_base;
 
 /*****************************************************************************/
 /* PROGRAM                                                                   */
 /*****************************************************************************/
 
+mat4 anim_skin_mat(int base, int joint_idx)
+{
+    int texel = (base + joint_idx) * 4;
+    return mat4(
+        texelFetch(posebuff, texel + 0),
+        texelFetch(posebuff, texel + 1),
+        texelFetch(posebuff, texel + 2),
+        texelFetch(posebuff, texel + 3)
+    );
+}
+
 void main()
 {
     float tot_weight = in_joint_weights0[0] + in_joint_weights0[1] + in_joint_weights0[2]
@@ -81,15 +103,14 @@ void main()
             int joint_idx = int(w_idx < 3 ? in_joint_indices0[w_idx % 3]
                                           : in_joint_indices1[w_idx % 3]);
 
-            mat4 inv_bind_mat = anim_inv_bind_mats [joint_idx];
-            mat4 pose_mat     = anim_curr_pose_mats[joint_idx];
+            mat4 skin_mat = anim_skin_mat(pose_base, joint_idx);
 
             float weight = w_idx < 3 ? in_joint_weights0[w_idx % 3]
                                      : in_joint_weights1[w_idx % 3];
             float fraction = weight / tot_weight;
 
-            mat4 bone_mat = fraction * pose_mat * inv_bind_mat;
-            mat3 rot_mat = fraction * mat3(transpose(inverse(pose_mat * inv_bind_mat)));
+            mat4 bone_mat = fraction * skin_mat;
+            mat3 rot_mat = fraction * mat3(transpose(inverse(skin_mat)));
             
             new_pos += (bone_mat * vec4(in_pos, 1.0)).xyz;
         }
@@ -35,8 +35,6 @@
 
 #version 330 core
 
-#define MAX_JOINTS      (96)
-
 layout (location = 0) in vec3  in_pos;
 layout (location = 1) in vec2  in_uv;
 layout (location = 2) in vec3  in_normal;
@@ -64,9 +62,16 @@ out VertexToFrag {
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
 
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 light_space_transform;
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
 uniform vec4 clip_plane0;
 
 /* The per-instance static attributes have the follwing layout in the buffer:
@@ -80,12 +85,10 @@ uniform vec4 clip_plane0;
  *  +--------------------------------------------------+
  *  | mat4x4_t (16 floats)                             | (normal matrix)
  *  +--------------------------------------------------+
- *  | MAX_JOINTS * mat4x4_t (1536 floats)              | (curr pose matrices)
- *  +--------------------------------------------------+
- *  | MAX_JOINTS * mat4x4_t (1536 floats)              | (inverse bind pose matrices)
+ *  | vec4_t (4 floats)                                | (pose base, num joints)
  *  +--------------------------------------------------+
  *
- * In total, 3264 floats (13056 bytes) are pushed per instance.
+ * In total, 196 floats (784 bytes) are pushed per instance.
  */
 
 uniform samplerBuffer attrbuff;
@@ -93,6 +96,9 @@ uniform int attrbuff_offset;
 uniform int attr_stride;
 uniform int attr_offset;
 
+/* Baked skinning matrices of all the loaded animations, 4 texels each. */
+uniform samplerBuffer posebuff;
+
 /*****************************************************************************/
 /* PROGRAM                                                                   */
 /*****************************************************************************/
@@ -126,22 +132,28 @@ mat4 read_mat4(int base)
     );
 }
 
-mat4 anim_curr_pose_mats(int joint_idx)
+int anim_pose_base(int base)
 {
-    int base = inst_attr_base(in_draw_id) + 176 + 16;
-    return read_mat4(base + (16 * joint_idx));
+    int size = textureSize(attrbuff);
+    return int(texelFetch(attrbuff, (base + 176 + 16) % size).r);
 }
 
-mat4 anim_inv_bind_mats(int joint_idx)
+mat4 anim_skin_mat(int base, int joint_idx)
 {
-    int base = inst_attr_base(in_draw_id) + 176 + 16 + (MAX_JOINTS * 16);
-    return read_mat4(base + (16 * joint_idx));
+    int texel = (base + joint_idx) * 4;
+    return mat4(
+        texelFetch(posebuff, texel + 0),
+        texelFetch(posebuff, texel + 1),
+        texelFetch(posebuff, texel + 2),
+        texelFetch(posebuff, texel + 3)
+    );
 }
 
 void main()
 {
     int base = inst_attr_base(in_draw_id);
     mat4 model = read_mat4(base);
+    int pose_base = anim_pose_base(base);
 
     to_fragment.uv = in_uv;
     to_fragment.mat_idx = in_material_idx;
@@ -179,15 +191,14 @@ void main()
             int joint_idx = int(w_idx < 3 ? in_joint_indices0[w_idx % 3]
                                           : in_joint_indices1[w_idx % 3]);
 
-            mat4 inv_bind_mat = anim_inv_bind_mats (joint_idx);
-            mat4 pose_mat     = anim_curr_pose_mats(joint_idx);
+            mat4 skin_mat = anim_skin_mat(pose_base, joint_idx);
 
             float weight = w_idx < 3 ? in_joint_weights0[w_idx % 3]
                                      : in_joint_weights1[w_idx % 3];
             float fraction = weight / tot_weight;
 
-            mat4 bone_mat = fraction * pose_mat * inv_bind_mat;
-            mat3 rot_mat = fraction * mat3(transpose(inverse(pose_mat * inv_bind_mat)));
+            mat4 bone_mat = fraction * skin_mat;
+            mat3 rot_mat = fraction * mat3(transpose(inverse(skin_mat)));
             
             new_pos += (bone_mat * vec4(in_pos, 1.0)).xyz;
             new_normal += rot_mat * in_normal;
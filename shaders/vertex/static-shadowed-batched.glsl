@@ -58,10 +58,16 @@ out VertexToFrag {
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
 
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
 
-uniform mat4 light_space_transform;
 uniform vec4 clip_plane0;
 
 /* Per-instance buffer contents:
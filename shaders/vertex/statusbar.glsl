@@ -35,10 +35,12 @@
 
 #version 330 core
 
-layout (location = 0) in vec3 in_pos;
-layout (location = 1) in vec2 in_uv;
-
-#define MAX_HBS   (256)
+layout (location = 0) in vec3  in_pos;
+layout (location = 1) in vec2  in_uv;
+/* Per-instance attributes */
+layout (location = 2) in float in_health_pc;
+layout (location = 3) in vec3  in_top_pos_ws;
+layout (location = 4) in int   in_yoffset;
 
 /* Must match the definition in the fragment shader */
 #define CURR_HB_HEIGHT  (max(4.0/1080 * curr_res.y, 4.0))
@@ -58,13 +60,20 @@ out VertexToFrag {
 /*****************************************************************************/
 
 /* Should be set up for screenspace rendering */
-uniform mat4 view;
-uniform mat4 projection;
 
-uniform ivec2 curr_res;
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
 
-uniform vec2  ent_top_offsets_ss[MAX_HBS];
-uniform float ent_health_pc[MAX_HBS];
+uniform ivec2 curr_res;
+/* The game camera's transform, for placing the bars over the entities */
+uniform mat4  cam_view_proj;
 
 /*****************************************************************************/
 /* PROGRAM
@@ -73,10 +82,17 @@ uniform float ent_health_pc[MAX_HBS];
 void main()
 {
     to_fragment.uv = in_uv;
-    to_fragment.health_pc = ent_health_pc[gl_InstanceID];
+    to_fragment.health_pc = in_health_pc;
+
+    /* Convert the worldspace position to an SDL screenspace position */
+    vec4 clip = cam_view_proj * vec4(in_top_pos_ws, 1.0);
+    vec2 ndc = clip.xy / clip.w;
+    vec2 res = vec2(curr_res);
+    vec2 top_ss = vec2((ndc.x + 1.0) * res.x / 2.0, 
+                       res.y - ((ndc.y + 1.0) * res.y / 2.0) + float(in_yoffset));
 
     vec2 ss_pos = vec2(in_pos.x * CURR_HB_WIDTH, in_pos.y * CURR_HB_HEIGHT);
-    ss_pos += ent_top_offsets_ss[gl_InstanceID];
+    ss_pos += top_ss;
     gl_Position = projection * view * vec4(ss_pos, 0.0, 1.0);
 }
 
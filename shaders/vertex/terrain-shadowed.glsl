@@ -35,9 +35,10 @@
 
 #version 330 core
 
-layout (location = 0) in vec3  in_pos;
-layout (location = 1) in vec2  in_uv;
-layout (location = 2) in vec3  in_normal;
+/* The packed layout of 'struct terrain_vert_packed' */
+layout (location = 0) in vec3  in_qpos;
+layout (location = 1) in vec2  in_quv;
+layout (location = 2) in vec2  in_oct_normal;
 layout (location = 3) in int   in_material_idx;
 
 layout (location = 4) in int   in_blend_mode;
@@ -74,17 +75,48 @@ out VertexToGeo {
 /*****************************************************************************/
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 light_space_transform;
+
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
 uniform vec4 clip_plane0;
 
+/*****************************************************************************/
+/* CONSTANTS                                                                 */
+/*****************************************************************************/
+
+/* Must match the steps in 'gl_vertex.h' and the chunk center in 'gl_tile.c' */
+const vec3 POS_STEP = vec3(1.0 / 128.0, 1.0 / 32.0, 1.0 / 128.0);
+const vec3 POS_ORIGIN = vec3(-128.0, 0.0, 128.0);
+const float UV_STEP = 1.0 / 256.0;
+
 /*****************************************************************************/
 /* PROGRAM
 /*****************************************************************************/
 
+vec3 oct_decode(vec2 e)
+{
+    vec3 v = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if(v.z < 0.0) {
+        vec2 signs = vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+        v.xy = (1.0 - abs(v.yx)) * signs;
+    }
+    return normalize(v);
+}
+
 void main()
 {
+    vec3 in_pos = in_qpos * POS_STEP + POS_ORIGIN;
+    vec2 in_uv = in_quv * UV_STEP;
+    vec3 in_normal = oct_decode(in_oct_normal);
+
     to_fragment.uv = in_uv;
     to_fragment.mat_idx = in_material_idx;
     to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
@@ -52,7 +52,15 @@ out VertexToFrag {
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
 
-uniform mat4 projection;
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
 
 /*****************************************************************************/
 /* PROGRAM                                                                   */
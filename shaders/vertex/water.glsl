@@ -43,6 +43,7 @@ layout (location = 0) in vec3 in_pos;
 
 out VertexToFrag {
     vec4 clip_space_pos;
+    vec4 reflect_clip_pos;
     vec3 world_pos;
     vec2 uv;
     vec3 view_dir;
@@ -54,13 +55,21 @@ out VertexToFrag {
 /*****************************************************************************/
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
-uniform vec3 view_pos;
-uniform vec3 light_pos;
+layout(std140) uniform frame_data {
+    mat4 view;
+    mat4 projection;
+    mat4 light_space_transform;
+    vec3 view_pos;
+    vec3 light_pos;
+    vec3 light_color;
+    vec3 ambient_color;
+};
+
 
 uniform vec2 water_tiling;
+/* The camera transform at the time the reflection texture was drawn */
+uniform mat4 reflect_view_proj;
 
 /*****************************************************************************/
 /* PROGRAM
@@ -72,6 +81,7 @@ void main()
     vec4 clip_space_pos = projection * view * ws_pos;
 
     to_fragment.clip_space_pos = clip_space_pos;
+    to_fragment.reflect_clip_pos = reflect_view_proj * ws_pos;
     to_fragment.world_pos = ws_pos.xyz;
     to_fragment.uv = vec2(in_pos.x/2.0 + 0.5, in_pos.z/2.0 + 0.5) * water_tiling;
     to_fragment.view_dir = normalize(view_pos - ws_pos.xyz);
@@ -45,25 +45,53 @@
 #include "../lib/public/pf_string.h"
 #include "../render/public/render.h"
 #include "../render/public/render_ctrl.h"
+#include "../lib/public/vec.h"
+#include "../sched.h"
 
 #include <SDL.h>
 
 #include <string.h>
 #include <assert.h>
 
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+/* Bounds of the components other than the largest one of a unit quaternion */
+#define ROT_COMP_RANGE (0.70710678f)
+
 #define CHK_TRUE_RET(_pred)   \
     do{                       \
         if(!(_pred))          \
             return false;     \
     }while(0)
 
+#define UPDATE_GRAIN (256)
+
+enum{
+    ANIM_NOTIFY_CYCLE_FINISHED = (1 << 0),
+    ANIM_NOTIFY_FINISHED       = (1 << 1),
+};
+
+struct anim_notify{
+    khiter_t bucket;
+    uint32_t uid;
+    int      events;
+};
+
 KHASH_MAP_INIT_INT(ctx, struct anim_ctx)
+VEC_TYPE(notify, struct anim_notify)
+VEC_IMPL(static inline, notify, struct anim_notify)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static khash_t(ctx) *s_anim_ctx;
+/* Events raised by the last update, filled in by the worker tasks */
+static vec_notify_t  s_notify;
+static SDL_atomic_t  s_nnotify;
+/* The ticks of the last update. This only advances while the simulation 
+ * is running, so the ambient clips driven by it are frozen while paused. */
+static SDL_atomic_t  s_update_ticks;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -89,19 +117,51 @@ static const struct anim_clip *a_clip_for_name(const struct anim_data *data, con
     return NULL;
 }
 
-static void a_mat_from_sqt(const struct SQT *sqt, mat4x4_t *out)
+static uint16_t a_quantize_unorm16(float val)
 {
-    mat4x4_t rot, trans, scale;
-    mat4x4_t tmp;
+    val = (val + ROT_COMP_RANGE) / (2.0f * ROT_COMP_RANGE);
+    val = MIN(MAX(val, 0.0f), 1.0f);
+    return (uint16_t)(val * 65535.0f + 0.5f);
+}
 
-    PFM_Mat4x4_MakeScale(sqt->scale.x, sqt->scale.y, sqt->scale.z, &scale);
-    PFM_Mat4x4_MakeTrans(sqt->trans.x, sqt->trans.y, sqt->trans.z, &trans);
-    PFM_Mat4x4_RotFromQuat(&sqt->quat_rotation, &rot);
+static float a_dequantize_unorm16(uint16_t val)
+{
+    return (val / 65535.0f) * (2.0f * ROT_COMP_RANGE) - ROT_COMP_RANGE;
+}
 
+static void a_mat_from_sqt(const struct SQT *sqt, mat4x4_t *out)
+{
     /*  (T * R * S) 
+     *
+     * Composed directly: the scale only multiplies the columns of the 
+     * rotation (same one as PFM_Mat4x4_RotFromQuat) and the translation
+     * becomes the last column, so there is no need to build the three 
+     * matrices and multiply them out.
      */
-    PFM_Mat4x4_Mult4x4(&rot, &scale, &tmp);
-    PFM_Mat4x4_Mult4x4(&trans, &tmp, out);
+    const quat_t *q = &sqt->quat_rotation;
+    const float scale[3] = {sqt->scale.x, sqt->scale.y, sqt->scale.z};
+
+    const float xx = q->x * q->x, yy = q->y * q->y, zz = q->z * q->z;
+    const float xy = q->x * q->y, xz = q->x * q->z, yz = q->y * q->z;
+    const float wx = q->w * q->x, wy = q->w * q->y, wz = q->w * q->z;
+
+    const float rot[3][3] = {
+        {1 - 2*(yy + zz),     2*(xy - wz),     2*(xz + wy)},
+        {    2*(xy + wz), 1 - 2*(xx + zz),     2*(yz - wx)},
+        {    2*(xz - wy),     2*(yz + wx), 1 - 2*(xx + yy)},
+    };
+
+    for(int c = 0; c < 3; c++) {
+        for(int r = 0; r < 3; r++) {
+            out->cols[c][r] = rot[c][r] * scale[c];
+        }
+        out->cols[c][3] = 0.0f;
+    }
+
+    out->cols[3][0] = sqt->trans.x;
+    out->cols[3][1] = sqt->trans.y;
+    out->cols[3][2] = sqt->trans.z;
+    out->cols[3][3] = 1.0f;
 }
 
 static void a_make_bind_mat(int joint_idx, const struct skeleton *skel, mat4x4_t *out)
@@ -130,28 +190,130 @@ static void a_make_bind_mat(int joint_idx, const struct skeleton *skel, mat4x4_t
     *out = bind_trans;
 }
 
-static void a_make_pose_mat(uint32_t uid, int joint_idx, const struct skeleton *skel, mat4x4_t *out)
+/* Ambient contexts are timed with the ticks of the last update rather than 
+ * the wall clock, the others are advanced with the wall clock.
+ */
+static uint32_t a_ticks(enum anim_mode mode)
 {
-    struct anim_ctx *ctx = a_ctx_for_uid(uid);
-    struct anim_sample *sample = &ctx->active->samples[ctx->curr_frame];
+    if(mode == ANIM_MODE_AMBIENT)
+        return SDL_AtomicGet(&s_update_ticks);
+    return SDL_GetTicks();
+}
 
-    mat4x4_t pose_trans;
-    PFM_Mat4x4_Identity(&pose_trans);
+/* Ambient contexts are never advanced - their frame follows from the time 
+ * elapsed since the clip was set. The phase is derived from the entity's 
+ * UID, so that it is stable across save and load. 
+ */
+static int a_ctx_frame(uint32_t uid, const struct anim_ctx *ctx)
+{
+    if(ctx->mode != ANIM_MODE_AMBIENT)
+        return ctx->curr_frame;
+
+    /* The clip may have been set after the last update */
+    int32_t elapsed = (int32_t)(a_ticks(ctx->mode) - ctx->curr_frame_start_ticks);
+    elapsed = MAX(elapsed, 0);
+    uint64_t frame = ((uint64_t)elapsed * ctx->key_fps) / 1000 + (uid * 2654435761u);
+    return frame % ctx->active->num_frames;
+}
 
-    /* Same as a_make_bind_mat, except for the current pose. */
-    while(joint_idx >= 0) {
+/* Walks up the bone heirarchy like a_make_bind_mat, but for the pose of the 
+ * sample. The object-space transform of every joint is kept in 'globals' and 
+ * reused by its' children, so that a whole sample is built with a single 
+ * multiplication per joint.
+ */
+static mat4x4_t *a_sample_global(const struct anim_sample *sample, int joint_idx, 
+                                 const struct skeleton *skel, mat4x4_t *globals, bool *done)
+{
+    if(done[joint_idx])
+        return &globals[joint_idx];
+
+    struct SQT sqt;
+    mat4x4_t to_parent;
+    A_KeyToSQT(&sample->keys[joint_idx], &sqt);
+    a_mat_from_sqt(&sqt, &to_parent);
+
+    int parent_idx = skel->joints[joint_idx].parent_idx;
+    if(parent_idx < 0) {
+        globals[joint_idx] = to_parent;
+    }else{
+        mat4x4_t *parent = a_sample_global(sample, parent_idx, skel, globals, done);
+        PFM_Mat4x4_Mult4x4(parent, &to_parent, &globals[joint_idx]);
+    }
 
-        struct joint *joint = &skel->joints[joint_idx];
-        struct SQT   *pose_sqt = &sample->local_joint_poses[joint_idx];
-        mat4x4_t to_parent, to_curr = pose_trans;
+    done[joint_idx] = true;
+    return &globals[joint_idx];
+}
 
-        a_mat_from_sqt(pose_sqt, &to_parent);
-        PFM_Mat4x4_Mult4x4(&to_parent, &to_curr, &pose_trans);
+static void a_ctx_set_clip(struct anim_ctx *ctx, const struct anim_clip *clip,
+                           enum anim_mode mode, unsigned key_fps, uint32_t ticks)
+{
+    ctx->active = clip;
+    ctx->mode = mode;
+    ctx->key_fps = key_fps;
+    ctx->curr_frame = 0;
+    ctx->curr_frame_start_ticks = ticks;
+    ctx->curr_aabb = &clip->samples[0].sample_aabb;
+}
 
-        joint_idx = joint->parent_idx;
+/* Advances the context to the next key frame if it is due. Returns a mask 
+ * of the ANIM_NOTIFY_* events that should be raised for it. 
+ */
+static int a_ctx_advance(struct anim_ctx *ctx, uint32_t curr_ticks)
+{
+    float frame_period_secs = 1.0f/ctx->key_fps;
+    float elapsed_secs = (curr_ticks - ctx->curr_frame_start_ticks)/1000.0f;
+    int ret = 0;
+
+    if(elapsed_secs <= frame_period_secs)
+        return 0;
+
+    ctx->curr_frame = (ctx->curr_frame + 1) % ctx->active->num_frames;
+    ctx->curr_frame_start_ticks = curr_ticks;
+    ctx->curr_aabb = &ctx->active->samples[ctx->curr_frame].sample_aabb;
+
+    if(ctx->curr_frame == ctx->active->num_frames - 1) {
+
+        ret |= ANIM_NOTIFY_CYCLE_FINISHED;
+        if(ctx->mode == ANIM_MODE_ONCE) {
+            ret |= ANIM_NOTIFY_FINISHED;
+        }
+    }
+
+    if(ctx->curr_frame == 0 && ctx->mode == ANIM_MODE_ONCE) {
+        a_ctx_set_clip(ctx, ctx->idle, ANIM_MODE_LOOP, ctx->key_fps, curr_ticks);
     }
+    return ret;
+}
+
+static void a_update_range(size_t begin, size_t end, void *arg)
+{
+    uint32_t curr_ticks = *(uint32_t*)arg;
+
+    for(khiter_t k = begin; k < end; k++) {
+
+        if(!kh_exist(s_anim_ctx, k))
+            continue;
+
+        if(kh_value(s_anim_ctx, k).mode == ANIM_MODE_AMBIENT)
+            continue;
+
+        int events = a_ctx_advance(&kh_value(s_anim_ctx, k), curr_ticks);
+        if(!events)
+            continue;
 
-    *out = pose_trans;
+        int idx = SDL_AtomicAdd(&s_nnotify, 1);
+        s_notify.array[idx] = (struct anim_notify){
+            .bucket = k,
+            .uid = kh_key(s_anim_ctx, k),
+            .events = events
+        };
+    }
+}
+
+static int a_notify_compare(const void *a, const void *b)
+{
+    const struct anim_notify *na = a, *nb = b;
+    return (na->bucket > nb->bucket) - (na->bucket < nb->bucket);
 }
 
 /*****************************************************************************/
@@ -175,60 +337,55 @@ void A_SetActiveClip(uint32_t uid, const char *name,
     const struct anim_clip *clip = a_clip_for_name(ctx->data, name);
     assert(clip);
 
-    ctx->active = clip;
-    ctx->mode = mode;
-    ctx->key_fps = key_fps;
-    ctx->curr_frame = 0;
-    ctx->curr_frame_start_ticks = SDL_GetTicks();
+    a_ctx_set_clip(ctx, clip, mode, key_fps, a_ticks(mode));
 }
 
 void A_Update(void)
 {
-    uint32_t curr_ticks = SDL_GetTicks();
-    uint32_t uid;
-
-    kh_foreach(s_anim_ctx, uid, (struct anim_ctx){0}, {
-
-        struct anim_ctx *ctx = a_ctx_for_uid(uid);
-        float frame_period_secs = 1.0f/ctx->key_fps;
-        float elapsed_secs = (curr_ticks - ctx->curr_frame_start_ticks)/1000.0f;
-
-        if(elapsed_secs > frame_period_secs) {
+    PERF_ENTER();
 
-            ctx->curr_frame = (ctx->curr_frame + 1) % ctx->active->num_frames;
-            ctx->curr_frame_start_ticks = curr_ticks;
+    uint32_t curr_ticks = SDL_GetTicks();
+    SDL_AtomicSet(&s_update_ticks, curr_ticks);
+    if(!vec_notify_resize(&s_notify, kh_size(s_anim_ctx)))
+        PERF_RETURN_VOID();
+
+    /* The contexts are independent of each other, so the hash buckets are 
+     * split between the workers. The events can only be raised from the 
+     * main thread and are deferred until all the contexts are advanced, 
+     * then sorted to be sent in the same order as a serial walk would.
+     */
+    SDL_AtomicSet(&s_nnotify, 0);
+    Sched_ParallelFor(kh_begin(s_anim_ctx), kh_end(s_anim_ctx), UPDATE_GRAIN, 
+        a_update_range, &curr_ticks);
 
-            if(ctx->curr_frame == ctx->active->num_frames - 1) {
+    s_notify.size = SDL_AtomicGet(&s_nnotify);
+    qsort(s_notify.array, vec_size(&s_notify), sizeof(struct anim_notify), a_notify_compare);
 
-                E_Entity_Notify(EVENT_ANIM_CYCLE_FINISHED, uid, NULL, ES_ENGINE);
-                if(ctx->mode == ANIM_MODE_ONCE) {
-                    E_Entity_Notify(EVENT_ANIM_FINISHED, uid, NULL, ES_ENGINE);
-                }
-            }
+    for(int i = 0; i < vec_size(&s_notify); i++) {
 
-            if(ctx->curr_frame == 0 && ctx->mode == ANIM_MODE_ONCE) {
-                A_SetActiveClip(uid, ctx->idle->name, ANIM_MODE_LOOP, ctx->key_fps);
-            }
+        const struct anim_notify *curr = &vec_AT(&s_notify, i);
+        if(curr->events & ANIM_NOTIFY_CYCLE_FINISHED) {
+            E_Entity_Notify(EVENT_ANIM_CYCLE_FINISHED, curr->uid, NULL, ES_ENGINE);
+        }
+        if(curr->events & ANIM_NOTIFY_FINISHED) {
+            E_Entity_Notify(EVENT_ANIM_FINISHED, curr->uid, NULL, ES_ENGINE);
         }
-    });
+    }
+    vec_notify_reset(&s_notify);
+
+    PERF_RETURN_VOID();
 }
 
-void A_GetRenderState(uint32_t uid, size_t *out_njoints, 
-                      mat4x4_t *out_curr_pose, const mat4x4_t **out_inv_bind_pose)
+void A_GetRenderState(uint32_t uid, int lod, size_t *out_njoints, size_t *out_pose_base)
 {
-    PERF_ENTER();
-
+    assert(lod >= 0);
     struct anim_ctx *ctx = a_ctx_for_uid(uid);
     const struct anim_data *data = ctx->data;
 
-    for(int j = 0; j < data->skel.num_joints; j++) {
-        a_make_pose_mat(uid, j, &data->skel, out_curr_pose + j);
-    }
+    int frame = a_ctx_frame(uid, ctx) & ~((1 << lod) - 1);
 
     *out_njoints = data->skel.num_joints;
-    *out_inv_bind_pose = data->skel.inv_bind_poses;
-
-    PERF_RETURN_VOID();
+    *out_pose_base = ctx->active->pose_base + frame * data->skel.num_joints;
 }
 
 const struct skeleton *A_GetBindSkeleton(uint32_t uid)
@@ -271,17 +428,70 @@ const struct skeleton *A_GetCurrPoseSkeleton(uint32_t uid)
 
     ret->inv_bind_poses = (void*)((char*)ret->bind_sqts + num_joints * sizeof(struct SQT));
 
+    mat4x4_t *globals = malloc(MAX(num_joints, 1) * (sizeof(mat4x4_t) + sizeof(bool)));
+    if(!globals) {
+        free(ret);
+        return NULL;
+    }
+    bool *done = (bool*)(globals + num_joints);
+    memset(done, 0, num_joints * sizeof(bool));
+
+    const struct anim_sample *sample = &ctx->active->samples[a_ctx_frame(uid, ctx)];
     for(int i = 0; i < ret->num_joints; i++) {
     
         /* Update the inverse bind matrices for the current frame */
-        mat4x4_t pose_mat;
-        a_make_pose_mat(uid, i, ret, &pose_mat);
-        PFM_Mat4x4_Inverse(&pose_mat, &ret->inv_bind_poses[i]);
+        mat4x4_t *pose_mat = a_sample_global(sample, i, ret, globals, done);
+        PFM_Mat4x4_Inverse(pose_mat, &ret->inv_bind_poses[i]);
     }
 
+    free(globals);
     return ret;
 }
 
+void A_KeyFromSQT(const struct SQT *in, struct anim_key *out)
+{
+    const float *q = in->quat_rotation.raw;
+    int max_idx = 0;
+    for(int i = 1; i < 4; i++) {
+        if(fabsf(q[i]) > fabsf(q[max_idx]))
+            max_idx = i;
+    }
+
+    /* q and -q are the same rotation - flip it so that the dropped 
+     * component is positive and can be recovered from the others. */
+    float len = sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    float scale = (len > 0.0f) ? 1.0f / len : 0.0f;
+    if(q[max_idx] < 0.0f)
+        scale = -scale;
+
+    int n = 0;
+    for(int i = 0; i < 4; i++) {
+        if(i == max_idx)
+            continue;
+        out->rot[n++] = a_quantize_unorm16(q[i] * scale);
+    }
+    out->rot_max_idx = max_idx;
+    out->scale = in->scale;
+    out->trans = in->trans;
+}
+
+void A_KeyToSQT(const struct anim_key *in, struct SQT *out)
+{
+    float *q = out->quat_rotation.raw;
+    float sum = 0.0f;
+    int n = 0;
+
+    for(int i = 0; i < 4; i++) {
+        if(i == in->rot_max_idx)
+            continue;
+        q[i] = a_dequantize_unorm16(in->rot[n++]);
+        sum += q[i] * q[i];
+    }
+    q[in->rot_max_idx] = sqrtf(MAX(1.0f - sum, 0.0f));
+    out->scale = in->scale;
+    out->trans = in->trans;
+}
+
 void A_PrepareInvBindMatrices(const struct skeleton *skel)
 {
     assert(skel->inv_bind_poses);
@@ -294,10 +504,62 @@ void A_PrepareInvBindMatrices(const struct skeleton *skel)
     }
 }
 
+bool A_PrepareSkinMatrices(struct anim_data *data)
+{
+    const size_t njoints = data->skel.num_joints;
+    size_t nmats = 0;
+
+    for(int i = 0; i < data->num_anims; i++) {
+        nmats += data->anims[i].num_frames * njoints;
+    }
+
+    mat4x4_t *mats = malloc(MAX(nmats, 1) * sizeof(mat4x4_t));
+    if(!mats)
+        goto fail_mats;
+
+    mat4x4_t *globals = malloc(MAX(njoints, 1) * (sizeof(mat4x4_t) + sizeof(bool)));
+    if(!globals)
+        goto fail_globals;
+    bool *done = (bool*)(globals + njoints);
+
+    mat4x4_t *curr = mats;
+    for(int i = 0; i < data->num_anims; i++) {
+
+        const struct anim_clip *clip = &data->anims[i];
+        for(int f = 0; f < clip->num_frames; f++) {
+
+            memset(done, 0, njoints * sizeof(bool));
+            for(int j = 0; j < njoints; j++) {
+
+                mat4x4_t *pose = a_sample_global(&clip->samples[f], j, &data->skel, globals, done);
+                PFM_Mat4x4_Mult4x4(pose, &data->skel.inv_bind_poses[j], curr++);
+            }
+        }
+    }
+    free(globals);
+
+    size_t base = R_PoseBuffAdd(mats, nmats);
+    for(int i = 0; i < data->num_anims; i++) {
+
+        data->anims[i].pose_base = base;
+        base += data->anims[i].num_frames * njoints;
+    }
+
+    free(mats);
+    return true;
+
+fail_globals:
+    free(mats);
+fail_mats:
+    return false;
+}
+
 const struct aabb *A_GetCurrPoseAABB(uint32_t uid)
 {
     struct anim_ctx *ctx = a_ctx_for_uid(uid);
-    return &ctx->active->samples[ctx->curr_frame].sample_aabb;
+    if(ctx->mode == ANIM_MODE_AMBIENT)
+        return &ctx->active->samples[a_ctx_frame(uid, ctx)].sample_aabb;
+    return ctx->curr_aabb;
 }
 
 void A_AddTimeDelta(uint32_t uid, uint32_t dt)
@@ -365,7 +627,7 @@ bool A_SaveState(struct SDL_RWops *stream, uint32_t uid)
 
     struct attr curr_frame_ticks_elapsed = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = SDL_GetTicks() - ctx->curr_frame_start_ticks
+        .val.as_int = a_ticks(ctx->mode) - ctx->curr_frame_start_ticks
     };
     CHK_TRUE_RET(Attr_Write(stream, &curr_frame_ticks_elapsed, "curr_frame_ticks_elapsed"));
 
@@ -403,7 +665,10 @@ bool A_LoadState(struct SDL_RWops *stream, uint32_t uid)
 
     CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
     CHK_TRUE_RET(attr.type == TYPE_INT);
-    ctx->curr_frame_start_ticks = SDL_GetTicks() - attr.val.as_int;
+    ctx->curr_frame_start_ticks = a_ticks(ctx->mode) - attr.val.as_int;
+
+    CHK_TRUE_RET(ctx->curr_frame >= 0 && ctx->curr_frame < ctx->active->num_frames);
+    ctx->curr_aabb = &ctx->active->samples[ctx->curr_frame].sample_aabb;
 
     return true;
 }
@@ -416,11 +681,17 @@ void A_ClearState(void)
 bool A_Init(void)
 {
     s_anim_ctx = kh_init(ctx);
-    return (s_anim_ctx != NULL);
+    if(!s_anim_ctx)
+        return false;
+
+    vec_notify_init(&s_notify);
+    SDL_AtomicSet(&s_update_ticks, SDL_GetTicks());
+    return true;
 }
 
 void A_Shutdown(void)
 {
+    vec_notify_destroy(&s_notify);
     kh_destroy(ctx, s_anim_ctx);
 }
 
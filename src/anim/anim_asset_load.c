@@ -105,23 +105,24 @@ static bool al_read_anim_clip(SDL_RWops *stream, struct anim_clip *out,
         for(int j = 0; j < header->num_joints; j++) {
 
             int joint_idx;  /* unused */
-            struct SQT *curr_joint_trans = &out->samples[f].local_joint_poses[j];
+            struct SQT curr_joint_trans;
         
             READ_LINE(stream, line, fail);
             if(!sscanf(line, "%d %f/%f/%f %f/%f/%f/%f %f/%f/%f",
                 &joint_idx, 
-                &curr_joint_trans->scale.x,
-                &curr_joint_trans->scale.y,
-                &curr_joint_trans->scale.z,
-                &curr_joint_trans->quat_rotation.x,
-                &curr_joint_trans->quat_rotation.y,
-                &curr_joint_trans->quat_rotation.z,
-                &curr_joint_trans->quat_rotation.w,
-                &curr_joint_trans->trans.x,
-                &curr_joint_trans->trans.y,
-                &curr_joint_trans->trans.z)) {
+                &curr_joint_trans.scale.x,
+                &curr_joint_trans.scale.y,
+                &curr_joint_trans.scale.z,
+                &curr_joint_trans.quat_rotation.x,
+                &curr_joint_trans.quat_rotation.y,
+                &curr_joint_trans.quat_rotation.z,
+                &curr_joint_trans.quat_rotation.w,
+                &curr_joint_trans.trans.x,
+                &curr_joint_trans.trans.y,
+                &curr_joint_trans.trans.z)) {
                 goto fail;
             }
+            A_KeyFromSQT(&curr_joint_trans, &out->samples[f].keys[j]);
         
         }
 
@@ -152,19 +153,87 @@ size_t al_data_buffsize_from_header(const struct pfobj_hdr *header)
     /*
      * For each frame of each animation clip, we also require:
      *
-     *    1. a 'struct anim_sample' (for referencing this frame's SQT array)
-     *    2. num_joint number of 'struct SQT's (each joint's transform
+     *    1. a 'struct anim_sample' (for referencing this frame's key array)
+     *    2. num_joint number of 'struct anim_key's (each joint's transform
      *       for the current frame)
      */
     for(unsigned as_idx  = 0; as_idx < header->num_as; as_idx++) {
 
         ret += header->frame_counts[as_idx] * 
-               (sizeof(struct anim_sample) + header->num_joints * sizeof(struct SQT));
+               (sizeof(struct anim_sample) + header->num_joints * sizeof(struct anim_key));
     }
 
     return ret;
 }
 
+/* Offsets of the arrays within the cooked animation data */
+struct al_cooked_layout{
+    size_t inv_bind_poses;
+    size_t bind_sqts;
+    size_t joints;
+    size_t clip_names;
+    size_t sample_aabbs;
+    size_t joint_poses;
+    size_t size;
+};
+
+static struct al_cooked_layout al_cooked_layout(const struct pfobj_hdr *header)
+{
+    size_t nframes = 0;
+    for(int i = 0; i < header->num_as; i++) {
+        nframes += header->frame_counts[i];
+    }
+
+    struct al_cooked_layout ret;
+    size_t off = 0;
+
+    ret.inv_bind_poses = off;
+    off += AL_COOKED_ROUNDUP(header->num_joints * sizeof(mat4x4_t));
+    ret.bind_sqts = off;
+    off += AL_COOKED_ROUNDUP(header->num_joints * sizeof(struct SQT));
+    ret.joints = off;
+    off += AL_COOKED_ROUNDUP(header->num_joints * sizeof(struct joint));
+    ret.clip_names = off;
+    off += AL_COOKED_ROUNDUP(header->num_as * ANIM_NAME_LEN);
+    ret.sample_aabbs = off;
+    off += AL_COOKED_ROUNDUP(nframes * sizeof(struct aabb));
+    ret.joint_poses = off;
+    off += nframes * header->num_joints * sizeof(struct anim_key);
+
+    ret.size = off;
+    return ret;
+}
+
+static void al_write_cooked(const struct pfobj_hdr *header, const struct anim_data *data, 
+                            void *cooked)
+{
+    const struct al_cooked_layout layout = al_cooked_layout(header);
+    char *base = cooked;
+    size_t njoints = header->num_joints;
+
+    memcpy(base + layout.inv_bind_poses, data->skel.inv_bind_poses, njoints * sizeof(mat4x4_t));
+    memcpy(base + layout.bind_sqts, data->skel.bind_sqts, njoints * sizeof(struct SQT));
+    memcpy(base + layout.joints, data->skel.joints, njoints * sizeof(struct joint));
+
+    char *name = base + layout.clip_names;
+    struct aabb *aabb = (void*)(base + layout.sample_aabbs);
+    struct anim_key *poses = (void*)(base + layout.joint_poses);
+
+    for(int i = 0; i < data->num_anims; i++) {
+
+        const struct anim_clip *clip = &data->anims[i];
+        memcpy(name, clip->name, ANIM_NAME_LEN);
+        name += ANIM_NAME_LEN;
+
+        for(int f = 0; f < clip->num_frames; f++) {
+
+            *aabb++ = clip->samples[f].sample_aabb;
+            memcpy(poses, clip->samples[f].keys, njoints * sizeof(struct anim_key));
+            poses += njoints;
+        }
+    }
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -191,13 +260,14 @@ size_t A_AL_CtxBuffSize(void)
  *  | struct anim_samples[num_as      |
  *  |    * num_frames]                |
  *  +---------------------------------+
- *  | struct SQT[num_as * num_joints] |
+ *  | struct anim_key[num_as *        |
+ *  |    num_frames * num_joints]     |
  *  |    (stored in clip-major order) |
  *  +---------------------------------+
  *
  */
 
-void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
+void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream, void *cooked)
 {
     struct anim_data *ret = malloc(al_data_buffsize_from_header(header));
     if(!ret)
@@ -239,8 +309,8 @@ void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
 
         for(int f = 0; f < header->frame_counts[i]; f++) {
 
-            ret->anims[i].samples[f].local_joint_poses = (void*)unused_base;
-            unused_base += sizeof(struct SQT) * header->num_joints;
+            ret->anims[i].samples[f].keys = (void*)unused_base;
+            unused_base += sizeof(struct anim_key) * header->num_joints;
         }
     }
 
@@ -261,6 +331,99 @@ void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
     }
 
     A_PrepareInvBindMatrices(&ret->skel);
+    if(!A_PrepareSkinMatrices(ret))
+        goto fail_parse;
+
+    if(cooked) {
+        al_write_cooked(header, ret, cooked);
+    }
+    return ret;
+
+fail_parse:
+    free(ret);
+fail_alloc:
+    return NULL;
+}
+
+/*
+ * Cooked animation data layout (each array aligned to AL_COOKED_ALIGN):
+ *
+ *  +---------------------------------+ <-- base
+ *  | mat4x4_t[num_joints] (inv. bind)|
+ *  +---------------------------------+
+ *  | struct SQT[num_joints] (bind)   |
+ *  +---------------------------------+
+ *  | struct joint[num_joints]        |
+ *  +---------------------------------+
+ *  | char[num_as][ANIM_NAME_LEN]     |
+ *  +---------------------------------+
+ *  | struct aabb[num_as * num_frames]|
+ *  +---------------------------------+
+ *  | struct anim_key[num_as *        |
+ *  |    num_frames * num_joints]     |
+ *  |    (stored in clip-major order) |
+ *  +---------------------------------+
+ *
+ */
+
+size_t A_AL_CookedSize(const struct pfobj_hdr *header)
+{
+    return al_cooked_layout(header).size;
+}
+
+void *A_AL_PrivFromCooked(const struct pfobj_hdr *header, void *cooked)
+{
+    const struct al_cooked_layout layout = al_cooked_layout(header);
+    char *base = cooked;
+
+    size_t nframes = 0;
+    for(int i = 0; i < header->num_as; i++) {
+        nframes += header->frame_counts[i];
+    }
+
+    /* Only the bookkeeping is allocated; the bulk of the data is 
+     * referenced in the cooked buffer directly. */
+    struct anim_data *ret = malloc(sizeof(struct anim_data) 
+        + header->num_as * sizeof(struct anim_clip) 
+        + nframes * sizeof(struct anim_sample));
+    if(!ret)
+        goto fail_alloc;
+
+    ret->num_anims = header->num_as; 
+    ret->skel.num_joints = header->num_joints;
+    ret->skel.inv_bind_poses = (void*)(base + layout.inv_bind_poses);
+    ret->skel.bind_sqts = (void*)(base + layout.bind_sqts);
+    ret->skel.joints = (void*)(base + layout.joints);
+    ret->anims = (void*)(ret + 1);
+
+    struct anim_sample *samples = (void*)(ret->anims + header->num_as);
+    const char *name = base + layout.clip_names;
+    const struct aabb *aabb = (void*)(base + layout.sample_aabbs);
+    struct anim_key *poses = (void*)(base + layout.joint_poses);
+
+    for(int i = 0; i < header->num_as; i++) {
+
+        struct anim_clip *clip = &ret->anims[i];
+        memcpy(clip->name, name, ANIM_NAME_LEN);
+        clip->name[ANIM_NAME_LEN-1] = '\0';
+        name += ANIM_NAME_LEN;
+
+        clip->skel = &ret->skel;
+        clip->num_frames = header->frame_counts[i];
+        clip->samples = samples;
+        samples += clip->num_frames;
+
+        for(int f = 0; f < clip->num_frames; f++) {
+
+            clip->samples[f].keys = poses;
+            clip->samples[f].sample_aabb = *aabb++;
+            poses += header->num_joints;
+        }
+    }
+
+    if(!A_PrepareSkinMatrices(ret))
+        goto fail_parse;
+
     return ret;
 
 fail_parse:
@@ -299,16 +462,17 @@ void A_AL_DumpPrivate(FILE *stream, void *priv_data)
         for(int f = 0; f < ac->num_frames; f++) {
             for(int j = 0; j < ac->skel->num_joints; j++) {
 
-                struct SQT *sqt = &ac->samples[f].local_joint_poses[j]; 
+                struct SQT sqt;
+                A_KeyToSQT(&ac->samples[f].keys[j], &sqt);
 
                 float roll, pitch, yaw;
-                PFM_Quat_ToEuler(&sqt->quat_rotation, &roll, &pitch, &yaw);
+                PFM_Quat_ToEuler(&sqt.quat_rotation, &roll, &pitch, &yaw);
 
                 fprintf(stream, "\t%d %f/%f/%f %f/%f/%f %f/%f/%f\n",
                     j + 1,
-                    sqt->scale.x, sqt->scale.y, sqt->scale.z,
-                    roll,         pitch,        yaw,
-                    sqt->trans.x, sqt->trans.y, sqt->trans.z);
+                    sqt.scale.x, sqt.scale.y, sqt.scale.z,
+                    roll,        pitch,       yaw,
+                    sqt.trans.x, sqt.trans.y, sqt.trans.z);
             }
         }
     } 
@@ -46,6 +46,8 @@ struct anim_ctx{
     unsigned                key_fps;
     int                     curr_frame;
     uint32_t                curr_frame_start_ticks;
+    /* Bounds of the current frame, kept up to date with 'curr_frame' */
+    const struct aabb      *curr_aabb;
 };
 
 #endif
@@ -41,12 +41,25 @@
 #include "../phys/public/collision.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 #define ANIM_NAME_LEN  32
 
+/* A joint's local transform at one key frame. The rotation is kept in the 
+ * 'smallest three' form: the component with the largest magnitude is dropped 
+ * and follows from the unit length, and the other three are quantized to 16 
+ * bits over [-1/sqrt(2), 1/sqrt(2)]. 
+ */
+struct anim_key{
+    vec3_t   scale;
+    vec3_t   trans;
+    uint16_t rot[3];
+    uint16_t rot_max_idx;
+};
+
 struct anim_sample{
-    struct SQT  *local_joint_poses;
-    struct aabb  sample_aabb;
+    struct anim_key *keys;
+    struct aabb      sample_aabb;
 };
 
 struct anim_clip{
@@ -54,6 +67,9 @@ struct anim_clip{
     struct skeleton    *skel;
     unsigned            num_frames;
     struct anim_sample *samples;
+    /* Index of the first frame's skinning matrices in the shared pose 
+     * buffer. The frames follow each other, 'num_joints' matrices apart. */
+    size_t              pose_base;
 };
 
 struct anim_data{
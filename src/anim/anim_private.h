@@ -37,6 +37,16 @@
 #define ANIM_PRIVATE_H
 
 struct skeleton;
+struct anim_data;
+struct anim_key;
+struct SQT;
+
+/* Conversions between the full and the compact (quantized rotation) form of 
+ * a joint's local transform. The rotation comes back normalized and with 
+ * its' largest component positive. 
+ */
+void A_KeyFromSQT(const struct SQT *in, struct anim_key *out);
+void A_KeyToSQT(const struct anim_key *in, struct SQT *out);
 
 /* Computes the inverse bind matrix for each joint based on the 
  * joint's bind SQT. The inverse bind matrix will be used by the vertex
@@ -48,4 +58,11 @@ struct skeleton;
  */
 void A_PrepareInvBindMatrices(const struct skeleton *skel);
 
+/* Bakes the skinning matrix (pose * inverse bind pose) of every joint for 
+ * every frame of every clip and uploads them to the shared pose buffer, 
+ * setting the 'pose_base' of each clip. Must be called after the inverse 
+ * bind matrices have been prepared.
+ */
+bool A_PrepareSkinMatrices(struct anim_data *data);
+
 #endif
@@ -50,6 +50,10 @@ struct skeleton;
 enum anim_mode{
     ANIM_MODE_LOOP,
     ANIM_MODE_ONCE,
+    /* Loops the clip on a clock started when it was set, for ambient props
+     * which never need events. The context is skipped by 'A_Update' and the
+     * current frame is only derived when it is queried. */
+    ANIM_MODE_AMBIENT,
 };
 
 
@@ -67,19 +71,25 @@ void                   A_SetIdleClip(uint32_t uid, const char *name,
 /* ---------------------------------------------------------------------------
  * If anim_mode is 'ANIM_MODE_ONCE', the entity will fire an 'EVENT_ANIM_FINISHED'
  * event and go back to playing the 'idle' animtion once the clip has played once. 
- * Otherwise, it will keep looping the clip.
+ * Otherwise, it will keep looping the clip. In 'ANIM_MODE_AMBIENT', no events are
+ * fired and each entity starts at a different offset into the clip, so that
+ * props placed together don't move in lockstep.
  * ---------------------------------------------------------------------------
  */
 void                   A_SetActiveClip(uint32_t uid, const char *name, 
                                        enum anim_mode mode, unsigned key_fps);
 
 /* ---------------------------------------------------------------------------
- * Retreive a copy of the state needed to render an animated entity.
+ * Retreive the state needed to render an animated entity: the number of 
+ * joints and the index of the current frame's first skinning matrix in the 
+ * shared pose buffer. At a 'lod' of N, only every (2^N)th key frame of the 
+ * clip is shown, so that distant entities playing the same clip end up
+ * sharing the same pose more often. The animation's timing (and the events 
+ * it raises) is not affected.
  * ---------------------------------------------------------------------------
  */
-void                   A_GetRenderState(uint32_t uid, size_t *out_njoints, 
-                                        mat4x4_t *out_curr_pose, 
-                                        const mat4x4_t **out_inv_bind_pose);
+void                   A_GetRenderState(uint32_t uid, int lod, size_t *out_njoints, 
+                                        size_t *out_pose_base);
 
 /* ---------------------------------------------------------------------------
  * Simple utility to get a reference to the skeleton structure in its' default
@@ -185,10 +195,26 @@ size_t A_AL_CtxBuffSize(void);
 
 /* ---------------------------------------------------------------------------
  * Consumes lines of the stream and uses them to populate the private data, 
- * which is then returned in a malloc'd buffer.
+ * which is then returned in a malloc'd buffer. If 'cooked' is not NULL, the 
+ * cooked form of the data (A_AL_CookedSize bytes) is written to it as well.
  * ---------------------------------------------------------------------------
  */
-void  *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream);
+void  *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream, void *cooked);
+
+/* ---------------------------------------------------------------------------
+ * Gives the size (in bytes) of the cooked animation data of a model: the
+ * skeleton with its inverse bind matrices and the joint poses of every clip. 
+ * ---------------------------------------------------------------------------
+ */
+size_t A_AL_CookedSize(const struct pfobj_hdr *header);
+
+/* ---------------------------------------------------------------------------
+ * Creates the private animation data from cooked data. The skeleton and the
+ * joint poses are referenced in-place, so the cooked buffer must stay valid 
+ * (and writable) for the lifetime of the returned data.
+ * ---------------------------------------------------------------------------
+ */
+void  *A_AL_PrivFromCooked(const struct pfobj_hdr *header, void *cooked);
 
 /* ---------------------------------------------------------------------------
  * Dumps private animation data in PF Object format.
@@ -46,6 +46,7 @@
 #include "lib/public/pf_string.h"
 #include "lib/public/mpool_allocator.h"
 #include "lib/public/mem.h"
+#include "lib/public/vec.h"
 
 #include <SDL.h>
 
@@ -55,6 +56,21 @@
 #include <string.h>
 #include <stdlib.h> 
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+#define AL_CACHE_MAGIC      (0x4f434650) /* 'PFCO' */
+#define AL_CACHE_VERSION    (3)
+#define AL_CACHE_ORG        "PermafrostEngine"
+#define AL_CACHE_APP        "modelcache"
+#define AL_FNV_BASIS        (0xcbf29ce484222325ull)
+#define AL_FNV_PRIME        (0x100000001b3ull)
 
 #define CHK_TRUE_RET(_pred)             \
     do{                                 \
@@ -69,9 +85,60 @@ struct shared_resource{
     const char  *basedir;
     const char  *filename;
     struct aabb  aabb;
+    /* The data is owned by the entry of an identical file loaded earlier */
+    bool         alias;
 };
 
+/* Cooked models are stored in the user's cache directory, keyed by the path 
+ * of their source PFOBJ file, and are invalidated whenever the source is 
+ * modified. The header is followed by the cooked render data and then by the 
+ * cooked animation data.
+ */
+struct al_cache_header{
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    src_size;
+    uint64_t    src_mtime;
+    uint32_t    num_verts;
+    uint32_t    num_joints;
+    uint32_t    num_materials;
+    uint32_t    num_as;
+    uint32_t    frame_counts[MAX_ANIM_SETS];
+    uint32_t    has_collision;
+    uint32_t    num_lods;
+    uint32_t    lod_verts[MAX_MESH_LODS - 1];
+    struct aabb aabb;
+    uint64_t    render_size;
+    uint64_t    anim_size;
+    uint64_t    checksum;
+};
+
+#define AL_CACHE_PAYLOAD    AL_COOKED_ROUNDUP(sizeof(struct al_cache_header))
+
+struct al_stamp{
+    uint64_t size;
+    uint64_t mtime;
+};
+
+/* The cooked data is referenced in-place by the loaded resources, so the 
+ * mappings are kept for as long as the resources are. They are private 
+ * copy-on-write mappings; the files themselves are never modified. 
+ */
+struct al_mapping{
+    unsigned char *base;
+    size_t         size;
+#if defined(_WIN32)
+    HANDLE         file;
+    HANDLE         map;
+#endif
+};
+
+VEC_TYPE(mapping, struct al_mapping)
+VEC_IMPL(static inline, mapping, struct al_mapping)
+
 KHASH_MAP_INIT_STR(entity_res, struct shared_resource)
+/* Maps the hash of a loaded PFOBJ file's contents to its path */
+KHASH_MAP_INIT_INT64(content_res, const char*)
 KHASH_MAP_INIT_INT(uid_ent, struct entity*)
 
 MPOOL_ALLOCATOR_TYPE(ent, struct entity)
@@ -83,8 +150,12 @@ MPOOL_ALLOCATOR_IMPL(static, ent, struct entity)
 /*****************************************************************************/
 
 static khash_t(entity_res) *s_name_resource_table;
+static khash_t(content_res) *s_content_table;
 static khash_t(uid_ent)    *s_uid_ent_table;
 static mpa_ent_t            s_mpool;
+static vec_mapping_t        s_mappings;
+static uint64_t             s_nparsed, s_nmapped, s_nshared;
+static uint64_t             s_parse_ticks, s_map_ticks;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -142,6 +213,33 @@ static bool al_parse_pfobj_header(SDL_RWops *stream, struct pfobj_hdr *out)
         goto fail;
     out->has_collision = tmp;
 
+    out->num_lods = 0;
+    if(out->version < 1.1f)
+        return true;
+
+    READ_LINE(stream, line, fail);
+    if(!sscanf(line, "num_lods %d", &out->num_lods))
+        goto fail;
+
+    if(out->num_lods > MAX_MESH_LODS - 1)
+        goto fail;
+
+    READ_LINE(stream, line, fail);
+    if(!(strstr(line, "lod_verts")))
+        goto fail;
+
+    /* Consume the first token, the property name 'lod_verts' */
+    string = pf_strtok_r(line, " \t", &saveptr);
+    for(int i = 0; i < out->num_lods; i++) {
+
+        string = pf_strtok_r(NULL, " \t", &saveptr);
+        if(!string)
+            goto fail;
+
+        if(!sscanf(string, "%d", &out->lod_verts[i]))
+            goto fail;
+    }
+
     return true;
 
 fail:
@@ -174,18 +272,333 @@ fail:
     return false;
 }
 
-static bool al_get_resource(const char *path, const char *basedir, 
-                            const char *pfobj_name, struct shared_resource *out)
+static uint64_t al_hash(uint64_t hash, const void *data, size_t size)
 {
-    SDL_RWops *stream;
-    struct pfobj_hdr header;
+    const unsigned char *curr = data;
+    while(size >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, curr, sizeof(word));
+        hash = (hash ^ word) * AL_FNV_PRIME;
+        hash ^= hash >> 29;
+        curr += sizeof(word);
+        size -= sizeof(word);
+    }
+    while(size--) {
+        hash = (hash ^ *curr++) * AL_FNV_PRIME;
+    }
+    return hash;
+}
 
-    khiter_t k = kh_get(entity_res, s_name_resource_table, path);
-    if(k != kh_end(s_name_resource_table)) {
+static bool al_map(const char *path, struct al_mapping *out)
+{
+#if defined(_WIN32)
+    out->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, 
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(out->file == INVALID_HANDLE_VALUE)
+        goto fail_open;
 
-        *out = kh_value(s_name_resource_table, k);
-        return true;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(out->file, &size) || size.QuadPart == 0)
+        goto fail_size;
+
+    out->map = CreateFileMappingA(out->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if(!out->map)
+        goto fail_size;
+
+    out->base = MapViewOfFile(out->map, FILE_MAP_COPY, 0, 0, 0);
+    if(!out->base)
+        goto fail_view;
+
+    out->size = size.QuadPart;
+    return true;
+
+fail_view:
+    CloseHandle(out->map);
+fail_size:
+    CloseHandle(out->file);
+fail_open:
+    return false;
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        goto fail_open;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+        goto fail_map;
+
+    void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if(base == MAP_FAILED)
+        goto fail_map;
+
+    close(fd);
+    out->base = base;
+    out->size = st.st_size;
+    return true;
+
+fail_map:
+    close(fd);
+fail_open:
+    return false;
+#endif
+}
+
+static void al_unmap(struct al_mapping *mapping)
+{
+#if defined(_WIN32)
+    UnmapViewOfFile(mapping->base);
+    CloseHandle(mapping->map);
+    CloseHandle(mapping->file);
+#else
+    munmap(mapping->base, mapping->size);
+#endif
+}
+
+static bool al_content_hash(const char *path, uint64_t *out)
+{
+    struct al_mapping mapping;
+    if(!al_map(path, &mapping))
+        return false;
+
+    *out = al_hash(AL_FNV_BASIS, mapping.base, mapping.size);
+    al_unmap(&mapping);
+    return true;
+}
+
+static bool al_same_contents(const char *a, const char *b)
+{
+    struct al_mapping ma, mb;
+    bool ret = false;
+
+    if(!al_map(a, &ma))
+        goto fail_a;
+    if(!al_map(b, &mb))
+        goto fail_b;
+
+    ret = (ma.size == mb.size) && (0 == memcmp(ma.base, mb.base, ma.size));
+
+    al_unmap(&mb);
+fail_b:
+    al_unmap(&ma);
+fail_a:
+    return ret;
+}
+
+/* Models with the same contents share their render and animation data, 
+ * regardless of their names. The materials' textures are loaded relative 
+ * to the directory of the model, so the textures of models from different 
+ * directories must be identical as well.
+ */
+static bool al_find_identical(uint64_t content_hash, const char *path, 
+                              const char *basedir, struct shared_resource *out)
+{
+    khiter_t k = kh_get(content_res, s_content_table, content_hash);
+    if(k == kh_end(s_content_table))
+        return false;
+
+    const char *orig_path = kh_value(s_content_table, k);
+    k = kh_get(entity_res, s_name_resource_table, orig_path);
+    assert(k != kh_end(s_name_resource_table));
+    struct shared_resource orig = kh_value(s_name_resource_table, k);
+
+    if(!al_same_contents(orig_path, path))
+        return false;
+
+    if(0 != strcmp(orig.basedir, basedir)) {
+
+        const char *texname;
+        for(size_t i = 0; (texname = R_AL_TexName(orig.render_private, i)); i++) {
+
+            char orig_tex[512], tex[512];
+            pf_snprintf(orig_tex, sizeof(orig_tex), "%s/%s/%s", g_basepath, orig.basedir, texname);
+            pf_snprintf(tex, sizeof(tex), "%s/%s/%s", g_basepath, basedir, texname);
+            if(!al_same_contents(orig_tex, tex))
+                return false;
+        }
+    }
+
+    *out = orig;
+    out->alias = true;
+    return true;
+}
+
+static bool al_stamp(const char *path, struct al_stamp *out)
+{
+#if defined(_WIN32)
+    struct _stat64 st;
+    if(_stat64(path, &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if(stat(path, &st) != 0)
+        return false;
+#endif
+    out->size = st.st_size;
+    out->mtime = st.st_mtime;
+    return true;
+}
+
+static bool al_cache_path(const char *path, char *out, size_t maxout)
+{
+    char *dir = SDL_GetPrefPath(AL_CACHE_ORG, AL_CACHE_APP);
+    if(!dir)
+        return false;
+
+    uint64_t key = al_hash(AL_FNV_BASIS, path, strlen(path));
+    int len = pf_snprintf(out, maxout, "%s%016llx.pfcobj", dir, (unsigned long long)key);
+    SDL_free(dir);
+    return (len > 0 && len < maxout);
+}
+
+static struct pfobj_hdr al_cache_pfobj_hdr(const struct al_cache_header *hdr)
+{
+    struct pfobj_hdr ret = {
+        .version = 1.0f,
+        .num_verts = hdr->num_verts,
+        .num_joints = hdr->num_joints,
+        .num_materials = hdr->num_materials,
+        .num_as = hdr->num_as,
+        .has_collision = hdr->has_collision,
+        .num_lods = hdr->num_lods,
+    };
+    for(int i = 0; i < hdr->num_as; i++) {
+        ret.frame_counts[i] = hdr->frame_counts[i];
+    }
+    for(int i = 0; i < hdr->num_lods; i++) {
+        ret.lod_verts[i] = hdr->lod_verts[i];
+    }
+    return ret;
+}
+
+static bool al_save_cooked(const char *cache_path, const struct al_stamp *stamp, 
+                           const struct pfobj_hdr *header, const struct aabb *aabb,
+                           const void *payload, size_t render_size, size_t anim_size)
+{
+    size_t payload_size = AL_COOKED_ROUNDUP(render_size) + anim_size;
+    struct al_cache_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+
+    hdr.magic = AL_CACHE_MAGIC;
+    hdr.version = AL_CACHE_VERSION;
+    hdr.src_size = stamp->size;
+    hdr.src_mtime = stamp->mtime;
+    hdr.num_verts = header->num_verts;
+    hdr.num_joints = header->num_joints;
+    hdr.num_materials = header->num_materials;
+    hdr.num_as = header->num_as;
+    for(int i = 0; i < header->num_as; i++) {
+        hdr.frame_counts[i] = header->frame_counts[i];
+    }
+    hdr.has_collision = header->has_collision;
+    hdr.num_lods = header->num_lods;
+    for(int i = 0; i < header->num_lods; i++) {
+        hdr.lod_verts[i] = header->lod_verts[i];
     }
+    hdr.aabb = *aabb;
+    hdr.render_size = render_size;
+    hdr.anim_size = anim_size;
+    hdr.checksum = al_hash(AL_FNV_BASIS, payload, payload_size);
+
+    char tmp_path[512];
+    if(pf_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path) >= sizeof(tmp_path))
+        goto fail_path;
+
+    SDL_RWops *stream = SDL_RWFromFile(tmp_path, "wb");
+    if(!stream)
+        goto fail_path;
+
+    const unsigned char pad[AL_COOKED_ALIGN] = {0};
+    size_t npad = AL_CACHE_PAYLOAD - sizeof(hdr);
+
+    if(SDL_RWwrite(stream, &hdr, sizeof(hdr), 1) != 1)
+        goto fail_write;
+    if(npad && SDL_RWwrite(stream, pad, npad, 1) != 1)
+        goto fail_write;
+    if(SDL_RWwrite(stream, payload, payload_size, 1) != 1)
+        goto fail_write;
+    if(SDL_RWclose(stream) != 0)
+        goto fail_close;
+
+    /* Only ever expose a complete file under the final name */
+    remove(cache_path);
+    if(rename(tmp_path, cache_path) != 0)
+        goto fail_close;
+    return true;
+
+fail_write:
+    SDL_RWclose(stream);
+fail_close:
+    remove(tmp_path);
+fail_path:
+    return false;
+}
+
+static bool al_load_cooked(const char *cache_path, const struct al_stamp *stamp,
+                           const char *abs_basedir, struct shared_resource *out)
+{
+    struct al_mapping mapping;
+    if(!al_map(cache_path, &mapping))
+        goto fail_map;
+
+    struct al_cache_header hdr;
+    if(mapping.size < AL_CACHE_PAYLOAD)
+        goto fail_header;
+    memcpy(&hdr, mapping.base, sizeof(hdr));
+
+    if(hdr.magic != AL_CACHE_MAGIC
+    || hdr.version != AL_CACHE_VERSION
+    || hdr.src_size != stamp->size
+    || hdr.src_mtime != stamp->mtime
+    || hdr.num_as > MAX_ANIM_SETS
+    || hdr.num_lods > MAX_MESH_LODS - 1
+    || !hdr.has_collision)
+        goto fail_header;
+
+    struct pfobj_hdr header = al_cache_pfobj_hdr(&hdr);
+    size_t render_size = R_AL_CookedSize(&header);
+    size_t anim_offset = AL_COOKED_ROUNDUP(render_size);
+    size_t anim_size = A_AL_CookedSize(&header);
+
+    if(hdr.render_size != render_size || hdr.anim_size != anim_size)
+        goto fail_header;
+    if(mapping.size != AL_CACHE_PAYLOAD + anim_offset + anim_size)
+        goto fail_header;
+
+    unsigned char *payload = mapping.base + AL_CACHE_PAYLOAD;
+    if(al_hash(AL_FNV_BASIS, payload, anim_offset + anim_size) != hdr.checksum)
+        goto fail_header;
+
+    if(!vec_mapping_push(&s_mappings, mapping))
+        goto fail_header;
+
+    out->anim_private = A_AL_PrivFromCooked(&header, payload + anim_offset);
+    if(!out->anim_private)
+        goto fail_anim;
+
+    /* From here on, the render thread may reference the mapping */
+    out->render_private = R_AL_PrivFromCooked(abs_basedir, &header, payload);
+    if(!out->render_private)
+        goto fail_render;
+
+    out->ent_flags = (header.num_as > 0) ? ENTITY_FLAG_ANIMATED : 0;
+    out->aabb = hdr.aabb;
+    return true;
+
+fail_render:
+    PF_FREE(out->anim_private);
+fail_anim:
+    vec_mapping_pop(&s_mappings);
+fail_header:
+    al_unmap(&mapping);
+fail_map:
+    return false;
+}
+
+static bool al_load_text(const char *path, const char *abs_basedir, const char *cache_path, 
+                         const struct al_stamp *stamp, struct shared_resource *out)
+{
+    SDL_RWops *stream;
+    struct pfobj_hdr header;
 
     stream = SDL_RWFromFile(path, "r");
     if(!stream)
@@ -194,17 +607,26 @@ static bool al_get_resource(const char *path, const char *basedir,
     if(!al_parse_pfobj_header(stream, &header))
         goto fail_parse;
 
-    char abs_basedir[512];
-    pf_snprintf(abs_basedir, sizeof(abs_basedir), "%s/%s", g_basepath, basedir);
+    /* The cooked form of the model is gathered while parsing it so that it 
+     * can be saved to the cache and loaded without any parsing next time.
+     */
+    size_t render_size = R_AL_CookedSize(&header);
+    size_t anim_offset = AL_COOKED_ROUNDUP(render_size);
+    size_t anim_size = A_AL_CookedSize(&header);
+    unsigned char *cooked = NULL;
+
+    if(cache_path) {
+        cooked = calloc(1, anim_offset + anim_size);
+    }
 
     out->ent_flags = 0;
-    out->render_private = R_AL_PrivFromStream(abs_basedir, &header, stream);
+    out->render_private = R_AL_PrivFromStream(abs_basedir, &header, stream, cooked);
     if(!out->render_private)
-        goto fail_parse;
+        goto fail_load;
 
-    out->anim_private = A_AL_PrivFromStream(&header, stream);
+    out->anim_private = A_AL_PrivFromStream(&header, stream, cooked ? cooked + anim_offset : NULL);
     if(!out->anim_private)
-        goto fail_parse;
+        goto fail_load;
 
     if(header.num_as > 0) {
         out->ent_flags |= ENTITY_FLAG_ANIMATED;
@@ -212,29 +634,83 @@ static bool al_get_resource(const char *path, const char *basedir,
 
     if(!header.has_collision) {
         fprintf(stderr, "Imported entities required to have bounding boxes.\n");
-        goto fail_parse;
+        goto fail_load;
     }
 
     if(!AL_ParseAABB(stream, &out->aabb))
-        goto fail_parse;
+        goto fail_load;
 
-    out->basedir = pf_strdup(basedir);
-    out->filename = pf_strdup(pfobj_name);
-
-    int put_ret;
-    k = kh_put(entity_res, s_name_resource_table, pf_strdup(path), &put_ret);
-    assert(put_ret != -1 && put_ret != 0);
-    kh_value(s_name_resource_table, k) = *out;
+    if(cooked) {
+        al_save_cooked(cache_path, stamp, &header, &out->aabb, cooked, render_size, anim_size);
+    }
 
+    free(cooked);
     SDL_RWclose(stream);
     return true;
 
+fail_load:
+    free(cooked);
 fail_parse:
     SDL_RWclose(stream);
 fail_init:
     return false;
 }
 
+static bool al_get_resource(const char *path, const char *basedir, 
+                            const char *pfobj_name, struct shared_resource *out)
+{
+    khiter_t k = kh_get(entity_res, s_name_resource_table, path);
+    if(k != kh_end(s_name_resource_table)) {
+
+        *out = kh_value(s_name_resource_table, k);
+        return true;
+    }
+
+    uint64_t content_hash = 0;
+    bool hashed = al_content_hash(path, &content_hash);
+    if(hashed && al_find_identical(content_hash, path, basedir, out)) {
+        s_nshared++;
+        goto insert;
+    }
+
+    char abs_basedir[512];
+    pf_snprintf(abs_basedir, sizeof(abs_basedir), "%s/%s", g_basepath, basedir);
+
+    struct al_stamp stamp = {0};
+    char cache_path[512];
+    bool cache = al_stamp(path, &stamp) && al_cache_path(path, cache_path, sizeof(cache_path));
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    if(cache && al_load_cooked(cache_path, &stamp, abs_basedir, out)) {
+        s_nmapped++;
+        s_map_ticks += SDL_GetPerformanceCounter() - begin;
+    }else if(al_load_text(path, abs_basedir, cache ? cache_path : NULL, &stamp, out)) {
+        s_nparsed++;
+        s_parse_ticks += SDL_GetPerformanceCounter() - begin;
+    }else{
+        return false;
+    }
+    out->alias = false;
+
+insert:
+    out->basedir = pf_strdup(basedir);
+    out->filename = pf_strdup(pfobj_name);
+
+    const char *key = pf_strdup(path);
+    int put_ret;
+    k = kh_put(entity_res, s_name_resource_table, key, &put_ret);
+    assert(put_ret != -1 && put_ret != 0);
+    kh_value(s_name_resource_table, k) = *out;
+
+    if(hashed && !out->alias) {
+        k = kh_put(content_res, s_content_table, content_hash, &put_ret);
+        if(put_ret != -1 && put_ret != 0) {
+            kh_value(s_content_table, k) = key;
+        }
+    }
+    return true;
+}
+
 static void al_save_mapping(uint32_t uid, struct entity *ent)
 {
     int ret;
@@ -337,6 +813,7 @@ bool AL_EntitySetPFObj(uint32_t uid, const char *base_path, const char *pfobj_na
     ent->render_private = new_res.render_private;
     ent->anim_private = new_res.anim_private;
     ent->identity_aabb = new_res.aabb;
+    Entity_InvalidateOBB(uid);
 
     flags |= new_res.ent_flags;
     if(flags & ENTITY_FLAG_ANIMATED) {
@@ -366,6 +843,16 @@ void AL_EntityFree(uint32_t uid)
     mpa_ent_free(&s_mpool, entity);
 }
 
+bool AL_ReserveEntities(size_t count)
+{
+    size_t nents = kh_size(s_uid_ent_table) + count;
+    if(!mpa_ent_reserve(&s_mpool, s_mpool.size + count))
+        return false;
+    if(kh_resize(uid_ent, s_uid_ent_table, nents + nents / 3 + 1) < 0)
+        return false;
+    return true;
+}
+
 void AL_ClearState(void)
 {
     kh_clear(uid_ent, s_uid_ent_table);
@@ -405,6 +892,16 @@ bool AL_NameForRenderPrivate(void *render_private, char out_dir[],
     return true;
 }
 
+void AL_GetLoadStats(struct al_load_stats *out)
+{
+    double freq = SDL_GetPerformanceFrequency();
+    out->nparsed = s_nparsed;
+    out->nmapped = s_nmapped;
+    out->nshared = s_nshared;
+    out->parse_ms = s_parse_ticks * 1000.0 / freq;
+    out->map_ms = s_map_ticks * 1000.0 / freq;
+}
+
 bool AL_PreloadPFObj(const char *base_path, const char *pfobj_name)
 {
     struct shared_resource res;
@@ -515,6 +1012,10 @@ bool AL_Init(void)
     if(!s_name_resource_table)
         goto fail_name_res_table;
 
+    s_content_table = kh_init(content_res);
+    if(!s_content_table)
+        goto fail_content_table;
+
     s_uid_ent_table = kh_init(uid_ent);
     if(!s_uid_ent_table)
         goto fail_uid_ent_table;
@@ -523,11 +1024,14 @@ bool AL_Init(void)
     if(!mpa_ent_reserve(&s_mpool, 1024))
         goto fail_mpool;
 
+    vec_mapping_init(&s_mappings);
     return true;
 
 fail_mpool:
     kh_destroy(uid_ent, s_uid_ent_table);
 fail_uid_ent_table:
+    kh_destroy(content_res, s_content_table);
+fail_content_table:
     kh_destroy(entity_res, s_name_resource_table);
 fail_name_res_table:
     return false;
@@ -540,14 +1044,22 @@ void AL_Shutdown(void)
 
     kh_foreach(s_name_resource_table, key, curr, {
         PF_FREE(key);
-        PF_FREE(curr.render_private);
-        PF_FREE(curr.anim_private);
+        if(!curr.alias) {
+            PF_FREE(curr.render_private);
+            PF_FREE(curr.anim_private);
+        }
         PF_FREE(curr.basedir);
         PF_FREE(curr.filename);
     });
     kh_destroy(uid_ent, s_uid_ent_table);
+    kh_destroy(content_res, s_content_table);
     kh_destroy(entity_res, s_name_resource_table);
     mpa_ent_destroy(&s_mpool);
+
+    for(int i = 0; i < vec_size(&s_mappings); i++) {
+        al_unmap(&vec_AT(&s_mappings, i));
+    }
+    vec_mapping_destroy(&s_mappings);
 }
 
 bool AL_SaveOBB(SDL_RWops *stream, const struct obb *obb)
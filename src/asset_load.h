@@ -37,13 +37,21 @@
 #define ASSET_LOAD_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #include <SDL.h> /* for SDL_RWops */
 
 #define MAX_ANIM_SETS 16
+/* The full-detail mesh and up to 2 reduced-detail levels */
+#define MAX_MESH_LODS 3
 #define MAX_LINE_LEN  256
 
+/* Alignment of the arrays within cooked model data */
+#define AL_COOKED_ALIGN (16)
+#define AL_COOKED_ROUNDUP(_size) \
+    (((_size) + (AL_COOKED_ALIGN - 1)) & ~((size_t)AL_COOKED_ALIGN - 1))
+
 #define READ_LINE(rwops, buff, fail_label)              \
     do{                                                 \
         if(!AL_ReadLine(rwops, buff))                   \
@@ -65,6 +73,19 @@ struct pfobj_hdr{
     unsigned num_as;
     unsigned frame_counts[MAX_ANIM_SETS];
     bool     has_collision;
+    /* The number of reduced-detail levels whose vertices follow the 
+     * 'num_verts' vertices of the full mesh (version 1.1 and up) */
+    unsigned num_lods;
+    unsigned lod_verts[MAX_MESH_LODS - 1];
+};
+
+/* Model loading totals since startup */
+struct al_load_stats{
+    uint64_t nparsed;  /* loaded from the PFOBJ text */
+    uint64_t nmapped;  /* loaded from the cooked model cache */
+    uint64_t nshared;  /* identical to an already loaded model */
+    double   parse_ms;
+    double   map_ms;
 };
 
 struct pfmap_hdr{
@@ -84,10 +105,12 @@ bool           AL_EntityFromPFObj(const char *base_path, const char *pfobj_name,
 struct entity *AL_EntityGet(uint32_t uid);
 bool           AL_EntitySetPFObj(uint32_t uid, const char *base_path, const char *pfobj_name);
 void           AL_EntityFree(uint32_t uid);
+bool           AL_ReserveEntities(size_t count);
 void          *AL_RenderPrivateForName(const char *base_path, const char *pfobj_name);
 bool           AL_NameForRenderPrivate(void *render_private, char out_dir[], 
                                        char out_name[]);
 bool           AL_PreloadPFObj(const char *base_path, const char *pfobj_name);
+void           AL_GetLoadStats(struct al_load_stats *out);
 
 struct map    *AL_MapFromPFMapStream(SDL_RWops *stream, bool update_navgrid);
 void           AL_MapFree(struct map *map);
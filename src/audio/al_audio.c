@@ -56,6 +56,7 @@
 
 #include <AL/al.h>
 #include <AL/alc.h>
+#include <AL/alext.h>
 #include <SDL.h>
 
 
@@ -64,6 +65,12 @@
 #define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
 #define EPSILON         (1.0f/1024)
 
+#define MUSIC_NUM_BUFFERS   (4)
+#define MUSIC_NUM_CHUNKS    (4)
+#define MUSIC_CHUNK_SIZE    (64 * 1024)
+#define WAVE_FORMAT_PCM     (0x0001)
+#define WAVE_FORMAT_EXT     (0xFFFE)
+
 #define CHK_TRUE_RET(_pred)             \
     do{                                 \
         if(!(_pred))                    \
@@ -76,7 +83,63 @@ struct al_buffer{
     ALenum format;
 };
 
+/* A decoder turns a music file into a stream of raw PCM frames that 
+ * can be handed to OpenAL as-is. Only the decoder thread ever touches 
+ * an open decoder. 
+ */
+struct music_decoder{
+    SDL_RWops *rw;
+    Uint8     *mem;
+    Uint32     remaining;
+    ALenum     format;
+    ALsizei    freq;
+    size_t     frame_size;
+};
+
+struct decoder_desc{
+    const char *ext;
+    bool      (*open)(struct music_decoder *dec, const char *path);
+    size_t    (*read)(struct music_decoder *dec, void *out, size_t maxbytes);
+    void      (*close)(struct music_decoder *dec);
+};
+
+struct music_chunk{
+    unsigned char data[MUSIC_CHUNK_SIZE];
+    size_t        size;
+    ALenum        format;
+    ALsizei       freq;
+};
+
+/* The decoder thread fills a small ring of staging chunks from the 
+ * current track and the main thread moves them into the queued OpenAL 
+ * buffers of the music source. Bumping the generation invalidates 
+ * everything the decoder has not yet published. 
+ */
+struct music_stream{
+    SDL_Thread        *thread;
+    SDL_mutex         *lock;
+    SDL_cond          *cond;
+    bool               quit;
+    /* Protected by the lock */
+    char               path[NK_MAX_PATH_LEN];
+    bool               pending;
+    bool               eof;
+    bool               failed;
+    unsigned           generation;
+    size_t             head;
+    size_t             count;
+    struct music_chunk chunks[MUSIC_NUM_CHUNKS];
+    /* Main thread only */
+    const char        *track;
+    ALuint             buffers[MUSIC_NUM_BUFFERS];
+    ALuint             free[MUSIC_NUM_BUFFERS];
+    size_t             nfree;
+};
+
+typedef void (*index_func_t)(const char *path, const char *name, void *user);
+
 KHASH_MAP_INIT_STR(buffer, struct al_buffer)
+KHASH_MAP_INIT_STR(path, const char*)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -85,7 +148,7 @@ KHASH_MAP_INIT_STR(buffer, struct al_buffer)
 static ALCdevice             *s_device = NULL;
 static ALCcontext            *s_context = NULL;
 
-static khash_t(buffer)       *s_music;
+static khash_t(path)         *s_music;
 static khash_t(buffer)       *s_effects;
 static ALuint                 s_music_source;
 static ALuint                 s_foreground_sources[AUDIO_NUM_FG_CHANNELS];
@@ -94,24 +157,18 @@ static bool                   s_mute_on_focus_loss = false;
 static ALfloat                s_master_volume = 0.5f;
 static ALfloat                s_music_volume = 0.5f;
 static enum playback_mode     s_music_mode = MUSIC_MODE_PLAYLIST;
+static struct music_stream    s_stream;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool audio_load_wav(const char *path, struct al_buffer *out)
+static ALenum audio_al_format(const struct SDL_AudioSpec *spec)
 {
-    struct SDL_AudioSpec spec;
-    Uint8 *audio_buff;
-    Uint32 audio_len;
-
-    if(!SDL_LoadWAV(path, &spec, &audio_buff, &audio_len))
-        return false;
-
     ALenum format = -1;
-    switch(spec.channels) {
+    switch(spec->channels) {
     case 1:
-        switch(spec.format) {
+        switch(spec->format) {
         case AUDIO_U8:
         case AUDIO_S8:
             format = AL_FORMAT_MONO8;
@@ -122,7 +179,7 @@ static bool audio_load_wav(const char *path, struct al_buffer *out)
         }
         break;
     case 2:
-        switch(spec.format) {
+        switch(spec->format) {
         case AUDIO_U8:
         case AUDIO_S8:
             format = AL_FORMAT_STEREO8;
@@ -132,9 +189,24 @@ static bool audio_load_wav(const char *path, struct al_buffer *out)
             break;
         }
         break;
-    default: assert(0);
     }
-    assert(format >= 0);
+    return format;
+}
+
+static bool audio_load_wav(const char *path, struct al_buffer *out)
+{
+    struct SDL_AudioSpec spec;
+    Uint8 *audio_buff;
+    Uint32 audio_len;
+
+    if(!SDL_LoadWAV(path, &spec, &audio_buff, &audio_len))
+        return false;
+
+    ALenum format = audio_al_format(&spec);
+    if(format < 0) {
+        SDL_FreeWAV(audio_buff);
+        return false;
+    }
 
     ALuint buffer;
     alGenBuffers(1, &buffer);
@@ -154,6 +226,292 @@ static void audio_free_buffer(struct al_buffer *buff)
     AL_ASSERT_OK();
 }
 
+static bool wav_open_decoded(struct music_decoder *dec, const char *path)
+{
+    struct SDL_AudioSpec spec;
+    Uint8 *audio_buff;
+    Uint32 audio_len;
+
+    if(!SDL_LoadWAV(path, &spec, &audio_buff, &audio_len))
+        goto fail_load;
+
+    ALenum format = audio_al_format(&spec);
+    if(format < 0)
+        goto fail_format;
+
+    dec->rw = SDL_RWFromConstMem(audio_buff, audio_len);
+    if(!dec->rw)
+        goto fail_format;
+
+    dec->mem = audio_buff;
+    dec->remaining = audio_len;
+    dec->format = format;
+    dec->freq = spec.freq;
+    dec->frame_size = spec.channels * SDL_AUDIO_BITSIZE(spec.format) / 8;
+    return true;
+
+fail_format:
+    SDL_FreeWAV(audio_buff);
+fail_load:
+    return false;
+}
+
+/* Plain PCM data is streamed straight from the file. Anything that 
+ * needs real decoding (ADPCM, etc.) is handed to SDL and then streamed 
+ * from memory, which still keeps the work off the main thread and 
+ * defers it until the track is actually played.
+ */
+static bool wav_open(struct music_decoder *dec, const char *path)
+{
+    memset(dec, 0, sizeof(*dec));
+
+    SDL_RWops *rw = SDL_RWFromFile(path, "rb");
+    if(!rw)
+        return false;
+
+    Uint8 riff[12];
+    if(SDL_RWread(rw, riff, sizeof(riff), 1) != 1)
+        goto fail;
+    if(memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4))
+        goto fail;
+
+    bool have_fmt = false;
+    Uint16 tag = 0, channels = 0, bits = 0;
+    Uint32 freq = 0;
+
+    while(true) {
+
+        Uint8 id[4];
+        if(SDL_RWread(rw, id, sizeof(id), 1) != 1)
+            goto fail;
+        Uint32 size = SDL_ReadLE32(rw);
+        Sint64 next = SDL_RWtell(rw) + size + (size & 1);
+
+        if(!memcmp(id, "data", 4)) {
+            if(!have_fmt)
+                goto fail;
+            dec->remaining = size;
+            break;
+        }
+
+        if(!memcmp(id, "fmt ", 4)) {
+            if(size < 16)
+                goto fail;
+            tag = SDL_ReadLE16(rw);
+            channels = SDL_ReadLE16(rw);
+            freq = SDL_ReadLE32(rw);
+            SDL_ReadLE32(rw); /* byte rate */
+            SDL_ReadLE16(rw); /* block align */
+            bits = SDL_ReadLE16(rw);
+            if(tag == WAVE_FORMAT_EXT && size >= 26) {
+                SDL_ReadLE16(rw); /* extension size */
+                SDL_ReadLE16(rw); /* valid bits */
+                SDL_ReadLE32(rw); /* channel mask */
+                tag = SDL_ReadLE16(rw);
+            }
+            have_fmt = true;
+        }
+
+        if(SDL_RWseek(rw, next, RW_SEEK_SET) < 0)
+            goto fail;
+    }
+
+    bool pcm = (tag == WAVE_FORMAT_PCM)
+            && (bits == 8 || bits == 16)
+            && (channels == 1 || channels == 2);
+    if(!pcm) {
+        SDL_RWclose(rw);
+        return wav_open_decoded(dec, path);
+    }
+
+    dec->format = audio_al_format(&(struct SDL_AudioSpec){
+        .format = (bits == 8) ? AUDIO_U8 : AUDIO_S16LSB,
+        .channels = channels
+    });
+    dec->freq = freq;
+    dec->frame_size = channels * bits / 8;
+    dec->rw = rw;
+    return true;
+
+fail:
+    SDL_RWclose(rw);
+    return false;
+}
+
+static size_t wav_read(struct music_decoder *dec, void *out, size_t maxbytes)
+{
+    size_t want = MIN(maxbytes, dec->remaining);
+    want -= want % dec->frame_size;
+
+    size_t nread = SDL_RWread(dec->rw, out, 1, want);
+    nread -= nread % dec->frame_size;
+    dec->remaining = (nread < want) ? 0 : dec->remaining - nread;
+    return nread;
+}
+
+static void wav_close(struct music_decoder *dec)
+{
+    SDL_RWclose(dec->rw);
+    if(dec->mem) {
+        SDL_FreeWAV(dec->mem);
+    }
+}
+
+static const struct decoder_desc s_decoders[] = {
+    {".wav", wav_open, wav_read, wav_close},
+};
+
+static const struct decoder_desc *audio_decoder_for(const char *path)
+{
+    for(int i = 0; i < ARR_SIZE(s_decoders); i++) {
+        if(pf_endswith(path, s_decoders[i].ext))
+            return &s_decoders[i];
+    }
+    return NULL;
+}
+
+static int music_decode_thread(void *arg)
+{
+    const struct decoder_desc *desc = NULL;
+    struct music_decoder dec;
+    bool done = true;
+
+    SDL_LockMutex(s_stream.lock);
+    while(!s_stream.quit) {
+
+        if(s_stream.pending) {
+
+            char path[NK_MAX_PATH_LEN];
+            pf_strlcpy(path, s_stream.path, sizeof(path));
+            unsigned gen = s_stream.generation;
+            s_stream.pending = false;
+            SDL_UnlockMutex(s_stream.lock);
+
+            if(desc) {
+                desc->close(&dec);
+            }
+            desc = audio_decoder_for(path);
+            if(desc && !desc->open(&dec, path)) {
+                desc = NULL;
+            }
+            done = (desc == NULL);
+
+            SDL_LockMutex(s_stream.lock);
+            if(gen == s_stream.generation && !desc) {
+                s_stream.failed = true;
+            }
+            continue;
+        }
+
+        if(done || s_stream.count == MUSIC_NUM_CHUNKS) {
+            SDL_CondWait(s_stream.cond, s_stream.lock);
+            continue;
+        }
+
+        /* The slot at the head is not visible to the main thread until 
+         * the count is bumped, so it can be filled without the lock. */
+        unsigned gen = s_stream.generation;
+        struct music_chunk *chunk = &s_stream.chunks[s_stream.head];
+        SDL_UnlockMutex(s_stream.lock);
+
+        size_t nread = desc->read(&dec, chunk->data, sizeof(chunk->data));
+
+        SDL_LockMutex(s_stream.lock);
+        if(gen != s_stream.generation)
+            continue;
+
+        if(nread == 0) {
+            s_stream.eof = true;
+            done = true;
+            continue;
+        }
+
+        chunk->size = nread;
+        chunk->format = dec.format;
+        chunk->freq = dec.freq;
+        s_stream.head = (s_stream.head + 1) % MUSIC_NUM_CHUNKS;
+        s_stream.count++;
+    }
+    SDL_UnlockMutex(s_stream.lock);
+
+    if(desc) {
+        desc->close(&dec);
+    }
+    return 0;
+}
+
+static bool audio_stream_init(void)
+{
+    memset(&s_stream, 0, sizeof(s_stream));
+
+    if(NULL == (s_stream.lock = SDL_CreateMutex()))
+        goto fail_lock;
+
+    if(NULL == (s_stream.cond = SDL_CreateCond()))
+        goto fail_cond;
+
+    alGenBuffers(MUSIC_NUM_BUFFERS, s_stream.buffers);
+    if(alGetError() != AL_NO_ERROR)
+        goto fail_buffers;
+
+    memcpy(s_stream.free, s_stream.buffers, sizeof(s_stream.free));
+    s_stream.nfree = MUSIC_NUM_BUFFERS;
+
+    s_stream.thread = SDL_CreateThread(music_decode_thread, "music_decode", NULL);
+    if(!s_stream.thread)
+        goto fail_thread;
+
+    return true;
+
+fail_thread:
+    alDeleteBuffers(MUSIC_NUM_BUFFERS, s_stream.buffers);
+fail_buffers:
+    SDL_DestroyCond(s_stream.cond);
+fail_cond:
+    SDL_DestroyMutex(s_stream.lock);
+fail_lock:
+    return false;
+}
+
+static void audio_stream_shutdown(void)
+{
+    SDL_LockMutex(s_stream.lock);
+    s_stream.quit = true;
+    SDL_CondSignal(s_stream.cond);
+    SDL_UnlockMutex(s_stream.lock);
+    SDL_WaitThread(s_stream.thread, NULL);
+
+    alDeleteBuffers(MUSIC_NUM_BUFFERS, s_stream.buffers);
+    SDL_DestroyCond(s_stream.cond);
+    SDL_DestroyMutex(s_stream.lock);
+}
+
+/* Stops the music source and throws away everything that was decoded 
+ * for the previous track. A NULL path leaves the stream idle. 
+ */
+static void audio_stream_reset(const char *path)
+{
+    alSourceStop(s_music_source);
+    alSourcei(s_music_source, AL_BUFFER, 0);
+    AL_ASSERT_OK();
+
+    memcpy(s_stream.free, s_stream.buffers, sizeof(s_stream.free));
+    s_stream.nfree = MUSIC_NUM_BUFFERS;
+
+    SDL_LockMutex(s_stream.lock);
+    s_stream.generation++;
+    s_stream.head = 0;
+    s_stream.count = 0;
+    s_stream.eof = false;
+    s_stream.failed = false;
+    s_stream.pending = (path != NULL);
+    if(path) {
+        pf_strlcpy(s_stream.path, path, sizeof(s_stream.path));
+    }
+    SDL_CondSignal(s_stream.cond);
+    SDL_UnlockMutex(s_stream.lock);
+}
+
 static void audio_create_global_source(ALuint *src, ALfloat volume)
 {
     alGenSources(1, src);
@@ -168,7 +526,8 @@ static void audio_create_global_source(ALuint *src, ALfloat volume)
     AL_ASSERT_OK();
 }
 
-static void audio_index_directory(const char *prefix, const char *dir, khash_t(buffer) *table)
+static void audio_index_directory(const char *prefix, const char *dir, 
+                                  index_func_t func, void *user)
 {
     char absdir[NK_MAX_PATH_LEN];
     pf_snprintf(absdir, sizeof(absdir), "%s/%s", g_basepath, dir);
@@ -193,47 +552,85 @@ static void audio_index_directory(const char *prefix, const char *dir, khash_t(b
             }
             pf_strlcat(newprefix, files[i].name, sizeof(newprefix));
 
-            audio_index_directory(newprefix, dirpath, table);
+            audio_index_directory(newprefix, dirpath, func, user);
             continue;
         }
 
-        if(!pf_endswith(files[i].name, ".wav"))
+        const char *ext = strrchr(files[i].name, '.');
+        if(!ext)
             continue;
 
         char path[NK_MAX_PATH_LEN];
         pf_snprintf(path, sizeof(path), "%s/%s", absdir, files[i].name);
 
-        struct al_buffer audio;
-        if(!audio_load_wav(path, &audio))
-            continue;
-
         char name[NK_MAX_PATH_LEN] = "";
         if(prefix && strlen(prefix) > 0) {
             pf_strlcat(name, prefix, sizeof(name));
             pf_strlcat(name, "/", sizeof(name));
         }
         pf_strlcat(name, files[i].name, sizeof(name));
-        name[strlen(name) - strlen(".wav")] = '\0';
+        name[strlen(name) - strlen(ext)] = '\0';
 
-        const char *key = pf_strdup(name);
-        if(!key) {
-            audio_free_buffer(&audio);
-            continue;
-        }
-
-        int status;
-        khiter_t k = kh_put(buffer, table, key, &status);
-        if(status == -1) {
-            free((void*)key);
-            audio_free_buffer(&audio);
-            continue;
-        }
-        kh_value(table, k) = audio;
+        func(path, name, user);
     }
 
     free(files);
 }
 
+static void audio_index_effect(const char *path, const char *name, void *user)
+{
+    khash_t(buffer) *table = user;
+
+    if(!pf_endswith(path, ".wav"))
+        return;
+
+    struct al_buffer audio;
+    if(!audio_load_wav(path, &audio))
+        return;
+
+    const char *key = pf_strdup(name);
+    if(!key) {
+        audio_free_buffer(&audio);
+        return;
+    }
+
+    int status;
+    khiter_t k = kh_put(buffer, table, key, &status);
+    if(status == -1) {
+        free((void*)key);
+        audio_free_buffer(&audio);
+        return;
+    }
+    kh_value(table, k) = audio;
+}
+
+/* Music is only indexed here - tracks are opened and decoded on demand 
+ * when they start playing.
+ */
+static void audio_index_music(const char *path, const char *name, void *user)
+{
+    khash_t(path) *table = user;
+
+    if(!audio_decoder_for(path))
+        return;
+
+    const char *key = pf_strdup(name);
+    const char *val = pf_strdup(path);
+    if(!key || !val)
+        goto fail;
+
+    int status;
+    khiter_t k = kh_put(path, table, key, &status);
+    if(status == -1)
+        goto fail;
+    kh_value(table, k) = val;
+    return;
+
+fail:
+    free((void*)key);
+    free((void*)val);
+}
+
 static bool audio_volume_validate(const struct sval *val)
 {
     if(val->type != ST_TYPE_FLOAT)
@@ -363,36 +760,12 @@ static void audio_window_event(void *user, void *arg)
     }
 }
 
-static const char *audio_music_name(ALuint buffer)
-{
-    const char *name;
-    struct al_buffer curr;
-
-    kh_foreach(s_music, name, curr, {
-        if(curr.buffer == buffer)
-            return name;
-    });
-    return NULL;
-}
-
-static bool audio_name_music(const char *name, ALint *out)
-{
-    khiter_t k = kh_get(buffer, s_music, name);
-    if(k == kh_end(s_music))
-        return false;
-    *out = kh_value(s_music, k).buffer;
-    return true;
-}
-
 static void audio_next_music_track(void)
 {
     STALLOC(const char*, tracks, kh_size(s_music));
     size_t ntracks = Audio_GetAllMusic(kh_size(s_music), tracks);
 
-    ALint play_buffer = 0;
-    alGetSourcei(s_music_source, AL_BUFFER, &play_buffer);
-
-    const char *curr = audio_music_name(play_buffer);
+    const char *curr = s_stream.track;
     const char *next = curr;
 
     int curr_idx = -1;
@@ -428,6 +801,61 @@ static void audio_next_music_track(void)
     STFREE(tracks);
 }
 
+static void audio_update_music(void)
+{
+    if(!s_stream.track)
+        return;
+
+    ALint nprocessed = 0;
+    alGetSourcei(s_music_source, AL_BUFFERS_PROCESSED, &nprocessed);
+    while(nprocessed-- > 0) {
+        ALuint buffer;
+        alSourceUnqueueBuffers(s_music_source, 1, &buffer);
+        s_stream.free[s_stream.nfree++] = buffer;
+    }
+
+    SDL_LockMutex(s_stream.lock);
+    size_t nconsumed = 0;
+    while(s_stream.nfree > 0 && s_stream.count > 0) {
+
+        size_t tail = (s_stream.head + MUSIC_NUM_CHUNKS - s_stream.count) % MUSIC_NUM_CHUNKS;
+        const struct music_chunk *chunk = &s_stream.chunks[tail];
+        ALuint buffer = s_stream.free[--s_stream.nfree];
+
+        alBufferData(buffer, chunk->format, chunk->data, chunk->size, chunk->freq);
+        alSourceQueueBuffers(s_music_source, 1, &buffer);
+        s_stream.count--;
+        nconsumed++;
+    }
+    bool drained = s_stream.eof && (s_stream.count == 0);
+    bool failed = s_stream.failed;
+    if(nconsumed > 0) {
+        SDL_CondSignal(s_stream.cond);
+    }
+    SDL_UnlockMutex(s_stream.lock);
+    AL_ASSERT_OK();
+
+    if(failed) {
+        Audio_PlayMusic(NULL);
+        return;
+    }
+
+    ALint nqueued = 0, src_state;
+    alGetSourcei(s_music_source, AL_BUFFERS_QUEUED, &nqueued);
+    alGetSourcei(s_music_source, AL_SOURCE_STATE, &src_state);
+
+    /* Either the first chunks of a track have arrived or the decoder 
+     * couldn't keep up and the source ran dry */
+    if(src_state != AL_PLAYING && nqueued > 0) {
+        alSourcePlay(s_music_source);
+        AL_ASSERT_OK();
+    }
+
+    if(drained && nqueued == 0) {
+        audio_next_music_track();
+    }
+}
+
 static void audio_update_listener(void)
 {
     vec3_t cam_pos = Camera_GetPos(G_GetActiveCamera());
@@ -452,15 +880,27 @@ static void audio_update_listener(void)
 
 static void audio_on_update(void *user, void *event)
 {
-    ALint src_state;
-    alGetSourcei(s_music_source, AL_SOURCE_STATE, &src_state);
-
-    if(src_state == AL_STOPPED) {
-        audio_next_music_track();
-    }
+    audio_update_music();
     audio_update_listener();
 }
 
+/* A loopback device only produces samples when they are explicitly 
+ * requested. Since we never request any, nothing is ever mixed or output, 
+ * but all the source and buffer state is maintained as usual. 
+ */
+static ALCdevice *audio_open_loopback_device(void)
+{
+    if(!alcIsExtensionPresent(NULL, "ALC_SOFT_loopback"))
+        return NULL;
+
+    LPALCLOOPBACKOPENDEVICESOFT open_loopback = 
+        (LPALCLOOPBACKOPENDEVICESOFT)alcGetProcAddress(NULL, "alcLoopbackOpenDeviceSOFT");
+    if(!open_loopback)
+        return NULL;
+
+    return open_loopback(NULL);
+}
+
 static int compare_strings(const void* a, const void* b)
 {
     const char *stra = *(const char **)a;
@@ -503,16 +943,29 @@ static void on_render_3d(void *user, void *event)
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-bool Audio_Init(void)
+bool Audio_Init(bool headless)
 {
-    if(NULL == (s_device = alcOpenDevice(NULL)))
+    if(headless) {
+        s_device = audio_open_loopback_device();
+    }else{
+        s_device = alcOpenDevice(NULL);
+    }
+    if(NULL == s_device)
         goto fail_open;
 
-    if(NULL == (s_context = alcCreateContext(s_device, NULL)))
+    static const ALCint loopback_attrs[] = {
+        ALC_FORMAT_CHANNELS_SOFT,   ALC_STEREO_SOFT,
+        ALC_FORMAT_TYPE_SOFT,       ALC_SHORT_SOFT,
+        ALC_FREQUENCY,              44100,
+        0
+    };
+    const ALCint *attrs = headless ? loopback_attrs : NULL;
+
+    if(NULL == (s_context = alcCreateContext(s_device, attrs)))
         goto fail_context;
     alcMakeContextCurrent(s_context);
 
-    if(NULL == (s_music = kh_init(buffer)))
+    if(NULL == (s_music = kh_init(path)))
         goto fail_music_table;
 
     if(NULL == (s_effects = kh_init(buffer)))
@@ -524,11 +977,14 @@ bool Audio_Init(void)
     }
     alListenerf(AL_GAIN, s_master_volume);
 
+    if(!audio_stream_init())
+        goto fail_stream;
+
     if(!Audio_Effect_Init())
         goto fail_effects;
 
-    audio_index_directory(NULL, "assets/music", s_music);
-    audio_index_directory(NULL, "assets/sounds", s_effects);
+    audio_index_directory(NULL, "assets/music", audio_index_music, s_music);
+    audio_index_directory(NULL, "assets/sounds", audio_index_effect, s_effects);
 
     audio_create_settings();
 
@@ -538,11 +994,13 @@ bool Audio_Init(void)
     return true;
 
 fail_effects:
+    audio_stream_shutdown();
+fail_stream:
     alDeleteSources(1, &s_music_source);
     alDeleteSources(AUDIO_NUM_FG_CHANNELS, s_foreground_sources);
     kh_destroy(buffer, s_effects);
 fail_effects_table:
-    kh_destroy(buffer, s_music);
+    kh_destroy(path, s_music);
 fail_music_table:
     alcMakeContextCurrent(NULL);
     alcDestroyContext(s_context);
@@ -555,10 +1013,13 @@ fail_open:
 void Audio_Shutdown(void)
 {
     const char *name;
+    const char *path;
     struct al_buffer curr;
 
     alSourceStop(s_music_source);
+    alSourcei(s_music_source, AL_BUFFER, 0);
     alDeleteSources(1, &s_music_source);
+    audio_stream_shutdown();
 
     for(int i = 0; i < AUDIO_NUM_FG_CHANNELS; i++) {
         alSourceStop(s_foreground_sources[i]);
@@ -567,11 +1028,11 @@ void Audio_Shutdown(void)
 
     Audio_Effect_Shutdown();
 
-    kh_foreach(s_music, name, curr, {
+    kh_foreach(s_music, name, path, {
         free((void*)name);
-        audio_free_buffer(&curr);
+        free((void*)path);
     });
-    kh_destroy(buffer, s_music);
+    kh_destroy(path, s_music);
 
     kh_foreach(s_effects, name, curr, {
         free((void*)name);
@@ -590,24 +1051,19 @@ void Audio_Shutdown(void)
 
 bool Audio_PlayMusic(const char *name)
 {
-    ALint src_state;
-    alGetSourcei(s_music_source, AL_SOURCE_STATE, &src_state);
-
     if(name == NULL) {
-        alSourceStop(s_music_source);
-        alSourcei(s_music_source, AL_BUFFER, 0);
+        audio_stream_reset(NULL);
+        s_stream.track = NULL;
         return true;
     }
 
-    ALint play_buffer = 0;
-    if(!audio_name_music(name, &play_buffer))
+    khiter_t k = kh_get(path, s_music, name);
+    if(k == kh_end(s_music))
         return false;
 
-    alSourceStop(s_music_source);
-    alSourcei(s_music_source, AL_BUFFER, play_buffer);
-    alSourcePlay(s_music_source);
-
-    AL_ASSERT_OK();
+    /* Playback starts once the decoder has produced the first chunk */
+    audio_stream_reset(kh_value(s_music, k));
+    s_stream.track = kh_key(s_music, k);
     return true;
 }
 
@@ -655,7 +1111,7 @@ size_t Audio_GetAllMusic(size_t maxout, const char *out[])
     size_t ntracks = 0;
 
     const char *name;
-    kh_foreach(s_music, name, (struct al_buffer){0}, {
+    kh_foreach(s_music, name, (const char*){0}, {
         tracks[ntracks++] = name;
     });
     qsort(tracks, ntracks, sizeof(const char*), compare_strings);
@@ -669,9 +1125,7 @@ size_t Audio_GetAllMusic(size_t maxout, const char *out[])
 
 const char *Audio_CurrMusic(void)
 {
-    ALint play_buffer = 0;
-    alGetSourcei(s_music_source, AL_BUFFER, &play_buffer);
-    return audio_music_name(play_buffer);
+    return s_stream.track;
 }
 
 const char *Audio_ErrString(ALenum err)
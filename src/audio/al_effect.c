@@ -46,12 +46,14 @@
 #include "../map/public/map.h"
 #include "../map/public/tile.h"
 #include "../lib/public/vec.h"
+#include "../lib/public/khash.h"
 #include "../lib/public/quadtree.h"
 #include "../lib/public/pf_string.h"
 
 #include <stdint.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include <AL/al.h>
 #include <AL/alc.h>
@@ -59,7 +61,19 @@
 
 #define MIN(a, b)       ((a) < (b) ? (a) : (b))
 #define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
-#define INVALID_SOURCE  (~((ALuint)0))
+
+/* The number of OpenAL sources reserved for positional effects. Fewer 
+ * may be available on some hardware. */
+#define MAX_VOICES      (48)
+#define MAX_GROUPS      (512)
+/* Identical effects which start within this many milliseconds of each 
+ * other, and are in the same cell, are played by a single voice */
+#define MERGE_WINDOW_MS (50)
+#define MERGE_CELL_SIZE (HEARING_RANGE / 4.0f)
+#define MAX_MERGE_GAIN  (3.0f)
+/* Voices which are already playing are favoured over new ones, so that 
+ * effects of similar priority don't keep stealing each other's voice */
+#define PLAYING_BONUS   (1.5f)
 
 #define CHK_TRUE_RET(_pred)             \
     do{                                 \
@@ -70,9 +84,31 @@
 struct al_effect{
     uint32_t uid;
     vec3_t   pos;
+    ALint    buffer;
     uint32_t start_tick;
     uint32_t end_tick;
+};
+
+/* A set of audible, identical effects played by the same voice. The 
+ * leader is the oldest effect of the group, which also sets the offset 
+ * into the track. */
+struct effect_group{
+    uint32_t leader;
+    ALint    buffer;
+    uint32_t start_tick;
+    uint32_t end_tick;
+    vec3_t   pos;
+    int      count;
+    float    priority;
+    int      voice;
+};
+
+struct voice{
     ALuint   source;
+    bool     in_use;
+    bool     keep;
+    uint32_t leader;
+    int      count;
 };
 
 VEC_TYPE(effect, struct al_effect)
@@ -82,14 +118,28 @@ QUADTREE_TYPE(effect, struct al_effect)
 QUADTREE_PROTOTYPES(static, effect, struct al_effect)
 QUADTREE_IMPL(static, effect, struct al_effect)
 
+KHASH_MAP_INIT_INT64(group, int)
+KHASH_MAP_INIT_INT(voice, int)
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static vec_effect_t     s_effects;
-static qt_effect_t      s_effect_tree;
-static vec_effect_t     s_active;
-static ALfloat          s_effect_volume = 5.0f;
+static vec_effect_t        s_effects;
+static qt_effect_t         s_effect_tree;
+static ALfloat             s_effect_volume = 5.0f;
+
+static struct voice        s_voices[MAX_VOICES];
+static size_t              s_nvoices;
+/* Maps the leader of a group to the voice playing it */
+static khash_t(voice)     *s_voice_index;
+
+static struct effect_group s_groups[MAX_GROUPS];
+static khash_t(group)     *s_group_index;
+
+/* The effect clock does not advance while the audio is paused */
+static uint32_t            s_paused_ms;
+static bool                s_paused;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -100,22 +150,44 @@ static bool effects_equal(const struct al_effect *a, const struct al_effect *b)
     return (a->uid == b->uid);
 }
 
-static int compare_effects(const void* a, const void* b)
+static uint32_t audio_now(void)
+{
+    return SDL_GetTicks() - s_paused_ms;
+}
+
+static float audio_group_gain(int count)
 {
-    struct al_effect *effa = (struct al_effect*)a;
-    struct al_effect *effb = (struct al_effect*)b;
-    return (effa->uid - effb->uid);
+    return s_effect_volume * MIN(sqrtf(count), MAX_MERGE_GAIN);
 }
 
-static void audio_update_active_set(vec_effect_t *active)
+static uint64_t audio_group_key(const struct al_effect *effect)
 {
-    vec_effect_reset(active);
+    uint64_t bucket = effect->start_tick / MERGE_WINDOW_MS;
+    uint64_t cell_x = (int32_t)floorf(effect->pos.x / MERGE_CELL_SIZE);
+    uint64_t cell_z = (int32_t)floorf(effect->pos.z / MERGE_CELL_SIZE);
+
+    /* The candidate effects are all within hearing range and not older
+     * than their track, so the truncated fields cannot collide */
+    return ((uint64_t)(effect->buffer & 0xffff) << 48)
+         | ((bucket & 0xffffff) << 24)
+         | ((cell_x & 0xfff) << 12)
+         | ((cell_z & 0xfff) << 0);
+}
 
+/* Gather the effects that can currently be heard, merging the identical 
+ * ones, and rank them by their loudness at the listener's position.
+ */
+static size_t audio_collect_groups(struct effect_group *out, size_t maxout)
+{
     vec2_t center = Audio_ListenerPosXZ();
     struct al_effect potential[512];
     size_t npotential = qt_effect_inrange_circle(&s_effect_tree, center.x, center.z, HEARING_RANGE,
         potential, ARR_SIZE(potential));
 
+    const uint32_t now = audio_now();
+    size_t ngroups = 0;
+    kh_clear(group, s_group_index);
+
     for(int i = 0; i < npotential; i++) {
 
         const struct al_effect *curr = &potential[i];
@@ -123,10 +195,95 @@ static void audio_update_active_set(vec_effect_t *active)
         if(!G_Fog_PlayerVisible(xz_pos))
             continue;
 
-        if(SDL_TICKS_PASSED(SDL_GetTicks(), curr->end_tick))
+        if(SDL_TICKS_PASSED(now, curr->end_tick))
+            continue;
+
+        int status;
+        khiter_t k = kh_put(group, s_group_index, audio_group_key(curr), &status);
+        if(status == -1)
             continue;
 
-        vec_effect_push(active, potential[i]);
+        if(status == 0) {
+            struct effect_group *group = &out[kh_value(s_group_index, k)];
+            if(curr->uid < group->leader) {
+                group->leader = curr->uid;
+                group->start_tick = curr->start_tick;
+                group->end_tick = curr->end_tick;
+            }
+            PFM_Vec3_Add(&group->pos, (vec3_t*)&curr->pos, &group->pos);
+            group->count++;
+            continue;
+        }
+
+        if(ngroups == maxout) {
+            kh_del(group, s_group_index, k);
+            continue;
+        }
+        kh_value(s_group_index, k) = ngroups;
+        out[ngroups++] = (struct effect_group){
+            .leader = curr->uid,
+            .buffer = curr->buffer,
+            .start_tick = curr->start_tick,
+            .end_tick = curr->end_tick,
+            .pos = curr->pos,
+            .count = 1,
+            .voice = -1,
+        };
+    }
+
+    for(int i = 0; i < ngroups; i++) {
+
+        struct effect_group *curr = &out[i];
+        PFM_Vec3_Scale(&curr->pos, 1.0f / curr->count, &curr->pos);
+
+        float dx = curr->pos.x - center.x;
+        float dz = curr->pos.z - center.z;
+        curr->priority = curr->count / (1.0f + sqrtf(dx * dx + dz * dz));
+
+        khiter_t k = kh_get(voice, s_voice_index, curr->leader);
+        if(k != kh_end(s_voice_index)) {
+            curr->voice = kh_value(s_voice_index, k);
+            curr->priority *= PLAYING_BONUS;
+        }
+    }
+    return ngroups;
+}
+
+static void audio_swap_groups(struct effect_group *a, struct effect_group *b)
+{
+    struct effect_group tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/* Partially order the groups (by quickselect) so that the 'k' highest 
+ * priority ones come first, in no particular order. 'k' must be less 
+ * than 'n'.
+ */
+static void audio_select_top(struct effect_group *groups, size_t n, size_t k)
+{
+    assert(k < n);
+    size_t lo = 0, hi = n - 1;
+
+    while(lo < hi) {
+
+        audio_swap_groups(&groups[lo + (hi - lo) / 2], &groups[hi]);
+        const float pivot = groups[hi].priority;
+
+        size_t store = lo;
+        for(size_t i = lo; i < hi; i++) {
+            if(groups[i].priority > pivot)
+                audio_swap_groups(&groups[i], &groups[store++]);
+        }
+        audio_swap_groups(&groups[store], &groups[hi]);
+
+        /* Everything before 'store' now has a higher priority than it */
+        if(store == k)
+            return;
+        if(store < k)
+            lo = store + 1;
+        else
+            hi = store - 1;
     }
 }
 
@@ -139,65 +296,102 @@ static size_t audio_nsamples(ALuint buffer)
     return nbytes * 8 / (channels * bits);
 }
 
-static void audio_advance(const struct al_effect *effect)
+static ALint audio_sample_offset(ALint buffer, uint32_t start_tick, uint32_t end_tick)
 {
-    ALint state;
-    alGetSourcei(effect->source, AL_SOURCE_STATE, &state);
-    assert(state == AL_INITIAL);
-
-    uint32_t curr = SDL_GetTicks();
-    uint32_t elapsed = curr - effect->start_tick;
-    uint32_t total = effect->end_tick - effect->start_tick;
-
-    ALint buffer;
-    alGetSourcei(effect->source, AL_BUFFER, &buffer);
+    uint32_t elapsed = audio_now() - start_tick;
+    uint32_t total = end_tick - start_tick;
     const size_t nsamples = audio_nsamples(buffer);
 
+    if(total == 0 || nsamples == 0)
+        return 0;
+
     ALint sample_offset = (((float)elapsed) / total) * nsamples;
-    sample_offset = MIN(sample_offset, nsamples-1);
-    alSourcei(effect->source, AL_SAMPLE_OFFSET, sample_offset);
-    AL_ASSERT_OK();
+    return MIN(sample_offset, nsamples-1);
 }
 
-static void audio_active_difference(vec_effect_t *curr, vec_effect_t *prev,
-                                    vec_effect_t *added, vec_effect_t *removed)
+static void audio_voice_release(int idx)
 {
-    vec_effect_reset(added);
-    vec_effect_reset(removed);
-
-    size_t n = vec_size(curr);
-    size_t m = vec_size(prev);
-
-    qsort(curr->array, n, sizeof(struct al_effect), compare_effects);
-    qsort(prev->array, m, sizeof(struct al_effect), compare_effects);
-
-    /* use the algorithm for finding the symmetric difference 
-     * of two sorted arrays: */
-
-    size_t nchanged = 0;
-    int i = 0, j = 0;
-    while(i < n && j < m) {
-
-        if(curr->array[i].uid < prev->array[j].uid) {
-            vec_effect_push(added, curr->array[i]);
-            i++;
-        }else if(prev->array[j].uid < curr->array[i].uid) {
-            vec_effect_push(removed, prev->array[j]);
-            j++;
-        }else{
-            i++;
-            j++;
-        }
+    struct voice *voice = &s_voices[idx];
+    assert(voice->in_use);
+
+    alSourceStop(voice->source);
+    alSourceRewind(voice->source);
+    alSourcei(voice->source, AL_BUFFER, 0);
+
+    khiter_t k = kh_get(voice, s_voice_index, voice->leader);
+    assert(k != kh_end(s_voice_index));
+    kh_del(voice, s_voice_index, k);
+    voice->in_use = false;
+}
+
+static bool audio_voice_start(int idx, const struct effect_group *group)
+{
+    struct voice *voice = &s_voices[idx];
+    assert(!voice->in_use);
+
+    int status;
+    khiter_t k = kh_put(voice, s_voice_index, group->leader, &status);
+    if(status == -1)
+        return false;
+
+    alSourcei(voice->source, AL_BUFFER, group->buffer);
+    alSource3f(voice->source, AL_POSITION, group->pos.x, group->pos.y, group->pos.z);
+    alSourcef(voice->source, AL_GAIN, audio_group_gain(group->count));
+    alSourcei(voice->source, AL_SAMPLE_OFFSET, 
+        audio_sample_offset(group->buffer, group->start_tick, group->end_tick));
+    alSourcePlay(voice->source);
+
+    if(alGetError() != AL_NO_ERROR) {
+        alSourceStop(voice->source);
+        alSourcei(voice->source, AL_BUFFER, 0);
+        kh_del(voice, s_voice_index, k);
+        return false;
     }
 
-    while(i < n) {
-        vec_effect_push(added, curr->array[i]);
-        i++;
+    kh_value(s_voice_index, k) = idx;
+    voice->in_use = true;
+    voice->leader = group->leader;
+    voice->count = group->count;
+    return true;
+}
+
+/* Keep playing the groups which already have a voice, steal the voices
+ * of all the others and hand them out to the new groups.
+ */
+static void audio_assign_voices(struct effect_group *groups, size_t nplay)
+{
+    for(int i = 0; i < s_nvoices; i++) {
+        s_voices[i].keep = false;
+    }
+    for(int i = 0; i < nplay; i++) {
+        if(groups[i].voice >= 0)
+            s_voices[groups[i].voice].keep = true;
+    }
+    for(int i = 0; i < s_nvoices; i++) {
+        if(s_voices[i].in_use && !s_voices[i].keep)
+            audio_voice_release(i);
     }
 
-    while(j < m) {
-        vec_effect_push(removed, prev->array[j]);
-        j++;
+    int next_free = 0;
+    for(int i = 0; i < nplay; i++) {
+
+        const struct effect_group *curr = &groups[i];
+        if(curr->voice >= 0) {
+
+            struct voice *voice = &s_voices[curr->voice];
+            alSource3f(voice->source, AL_POSITION, curr->pos.x, curr->pos.y, curr->pos.z);
+            if(voice->count != curr->count) {
+                alSourcef(voice->source, AL_GAIN, audio_group_gain(curr->count));
+                voice->count = curr->count;
+            }
+            continue;
+        }
+
+        while(next_free < s_nvoices && s_voices[next_free].in_use)
+            next_free++;
+        if(next_free == s_nvoices)
+            break;
+        audio_voice_start(next_free, curr);
     }
 }
 
@@ -205,44 +399,17 @@ static void on_update_start(void *user, void *event)
 {
     PERF_PUSH("audio_effect::on_update_start");
 
-    vec_effect_t prev, added, removed;
-    vec_effect_init(&prev);
-    vec_effect_init(&added);
-    vec_effect_init(&removed);
-
-    vec_effect_copy(&prev, &s_active);
-
-    audio_update_active_set(&s_active);
-    audio_active_difference(&s_active, &prev, &added, &removed);
-
-    for(int i = 0; i < vec_size(&added); i++) {
-        struct al_effect *curr = &added.array[i];
-        audio_advance(curr);
-        alSourcef(curr->source, AL_GAIN, s_effect_volume);
-        alSourcePlay(curr->source);
-        /* We couldn't play the source - possibly due to hitting 
-         * the maximum source limit on our hardware. Keep huffing 
-         * and puffing along. There unfortunaly doesn't seem to be
-         * a foolproof, portable way to query this limit in OpenAL.
-         */
-        if(alGetError() != AL_NO_ERROR) {
-            alSourceStop(curr->source);
-            int idx = vec_effect_indexof(&s_active, *curr, effects_equal);
-            assert(idx >= 0);
-            vec_effect_del(&s_active, idx);
-        }
-    }
+    if(s_paused)
+        goto done;
 
-    for(int i = 0; i < vec_size(&removed); i++) {
-        struct al_effect *curr = &removed.array[i];
-        alSourceStop(curr->source);
-        alSourceRewind(curr->source);
+    size_t ngroups = audio_collect_groups(s_groups, ARR_SIZE(s_groups));
+    size_t nplay = MIN(ngroups, s_nvoices);
+    if(ngroups > nplay) {
+        audio_select_top(s_groups, ngroups, nplay);
     }
+    audio_assign_voices(s_groups, nplay);
 
-    vec_effect_destroy(&prev);
-    vec_effect_destroy(&added);
-    vec_effect_destroy(&removed);
-
+done:
     AL_ASSERT_OK();
     PERF_POP();
 }
@@ -254,7 +421,7 @@ static void on_new_map(void *user, void *event)
         return;
 
     Audio_EffectClearState();
-    assert(vec_size(&s_active) == 0);
+    assert(kh_size(s_voice_index) == 0);
     assert(vec_size(&s_effects) == 0);
     assert(s_effect_tree.nrecs == 0);
 
@@ -276,24 +443,19 @@ static void on_new_map(void *user, void *event)
 static void on_1hz_tick(void *user, void *event)
 {
     PERF_PUSH("audio_effect::on_1hz_tick");
-    uint32_t now = SDL_GetTicks();
+    uint32_t now = audio_now();
 
+    /* Voices playing expired effects are released on the next update */
     for(int i = vec_size(&s_effects)-1; i >= 0; i--) {
         struct al_effect curr = s_effects.array[i];
         if(!SDL_TICKS_PASSED(now, curr.end_tick))
             continue;
 
-        int idx = vec_effect_indexof(&s_active, curr, effects_equal);
-        if(idx != -1)
-            continue;
-
-        alDeleteSources(1, &curr.source);
         vec_effect_del(&s_effects, i);
         qt_effect_delete(&s_effect_tree, curr.pos.x, curr.pos.z, curr);
     }
 
     assert(s_effect_tree.nrecs == vec_size(&s_effects));
-    AL_ASSERT_OK();
     PERF_POP();
 }
 
@@ -310,9 +472,11 @@ static void audio_effect_volume_commit(const struct sval *val)
 {
     s_effect_volume = val->as_float;
 
-    for(int i = 0; i < vec_size(&s_active); i++) {
-        const struct al_effect *curr = &vec_AT(&s_active, i);
-        alSourcef(curr->source, AL_GAIN, s_effect_volume);
+    for(int i = 0; i < s_nvoices; i++) {
+        const struct voice *curr = &s_voices[i];
+        if(!curr->in_use)
+            continue;
+        alSourcef(curr->source, AL_GAIN, audio_group_gain(curr->count));
     }
     Audio_SetForegroundEffectVolume(s_effect_volume);
 }
@@ -335,39 +499,34 @@ static void audio_create_settings(void)
     assert(status == SS_OKAY);
 }
 
-static void audio_make_effect_source(ALuint *out, vec3_t pos, ALint buffer)
+/* Reserve up to MAX_VOICES sources up front. The limit can't be queried 
+ * portably, so stop at the first failure. */
+static void audio_make_voices(void)
 {
-    ALuint source;
-    alGenSources(1, &source);
-
-    /* Resort to dropping the request if we are not able 
-     * to generate more sources */
-    ALenum error = alGetError();
-    if(error == AL_OUT_OF_MEMORY) {
-        *out = INVALID_SOURCE;
-        return;
-    }
+    s_nvoices = 0;
+    for(int i = 0; i < MAX_VOICES; i++) {
+
+        ALuint source;
+        alGenSources(1, &source);
+        if(alGetError() != AL_NO_ERROR)
+            break;
+
+        alSourcef(source,  AL_PITCH, 1);
+        alSourcef(source,  AL_GAIN, s_effect_volume);
+        alSource3f(source, AL_VELOCITY, 0, 0, 0);
+        alSourcei(source,  AL_LOOPING, AL_FALSE);
+        alSourcei(source,  AL_SOURCE_RELATIVE, AL_FALSE);
+        alSourcef(source,  AL_MAX_DISTANCE, HEARING_RANGE * 2.0f);
+        alSourcef(source,  AL_ROLLOFF_FACTOR, 0.5f);
 
-    alSourcef(source,  AL_PITCH, 1);
-    alSourcef(source,  AL_GAIN, s_effect_volume);
-    alSourcei(source,  AL_BUFFER, buffer);
-    alSource3f(source, AL_POSITION, pos.x, pos.y, pos.z);
-    alSource3f(source, AL_VELOCITY, 0, 0, 0);
-    alSourcei(source,  AL_LOOPING, AL_FALSE);
-    alSourcei(source,  AL_SOURCE_RELATIVE, AL_FALSE);
-    alSourcef(source,  AL_MAX_DISTANCE, HEARING_RANGE * 2.0f);
-    alSourcef(source,  AL_ROLLOFF_FACTOR, 0.5f);
-
-    *out = source;
+        s_voices[s_nvoices++] = (struct voice){ .source = source };
+    }
     AL_ASSERT_OK();
 }
 
 static bool audio_save_effect(SDL_RWops *stream, const struct al_effect *effect)
 {
-    ALint buffer;
-    alGetSourcei(effect->source, AL_BUFFER, &buffer);
-
-    const char *name = Audio_GetEffectName(buffer);
+    const char *name = Audio_GetEffectName(effect->buffer);
     struct attr name_attr = (struct attr){ .type = TYPE_STRING, };
     pf_strlcpy(name_attr.val.as_string, name, sizeof(name_attr.val.as_string));
     CHK_TRUE_RET(Attr_Write(stream, &name_attr, "name"));
@@ -384,19 +543,17 @@ static bool audio_save_effect(SDL_RWops *stream, const struct al_effect *effect)
     };
     CHK_TRUE_RET(Attr_Write(stream, &pos_attr, "pos"));
 
-    ALint offset;
-    alGetSourcei(effect->source, AL_SAMPLE_OFFSET, &offset);
     struct attr offset_attr = (struct attr){
         .type = TYPE_INT, 
-        .val.as_int = offset
+        .val.as_int = audio_sample_offset(effect->buffer, effect->start_tick, effect->end_tick)
     };
     CHK_TRUE_RET(Attr_Write(stream, &offset_attr, "offset"));
 
-    ALint state;
-    alGetSourcei(effect->source, AL_SOURCE_STATE, &state);
+    /* Kept for compatibility - the voices are re-assigned after loading */
+    bool playing = (kh_get(voice, s_voice_index, effect->uid) != kh_end(s_voice_index));
     struct attr state_attr = (struct attr){
         .type = TYPE_INT, 
-        .val.as_int = state
+        .val.as_int = playing ? AL_PLAYING : AL_INITIAL
     };
     CHK_TRUE_RET(Attr_Write(stream, &state_attr, "state"));
 
@@ -426,64 +583,26 @@ static bool audio_load_effect(SDL_RWops *stream)
 
     CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
     CHK_TRUE_RET(attr.type == TYPE_INT);
-    ALint state = attr.val.as_int;
 
     ALint buffer;
     if(Audio_GetEffectBuffer(name, &buffer)) {
 
-        ALuint source;
-        audio_make_effect_source(&source, pos, buffer);
-        if(source == INVALID_SOURCE)
-            return false;
-        alSourcei(source, AL_SAMPLE_OFFSET, offset);
-
-        if(alGetError() != AL_NO_ERROR) {
-            alDeleteSources(1, &source);
-            return true;
-        }
-
-        switch(state){
-        case AL_INITIAL:
-            break;
-        case AL_PLAYING:
-            alSourcePlay(source);
-            break;
-        case AL_PAUSED:
-            alSourcePlay(source);
-            alSourcePause(source);
-            break;
-        case AL_STOPPED:
-            alSourcePlay(source);
-            alSourceStop(source);
-            break;
-        }
-
-        if(alGetError() != AL_NO_ERROR) {
-            alSourceStop(source);
-            alDeleteSources(1, &source);
-            return true;
-        }
-
         const size_t nsamples = audio_nsamples(buffer);
         const float duration = Audio_BufferDuration(buffer);
-        const float elapsed = (((float)offset) / nsamples) * duration;
+        const float elapsed = nsamples ? (((float)offset) / nsamples) * duration : 0.0f;
 
-        uint32_t start_tick = SDL_GetTicks() - elapsed * 1000;
+        uint32_t start_tick = audio_now() - elapsed * 1000;
         uint32_t end_tick = start_tick + duration * 1000;
 
         struct al_effect effect = (struct al_effect) {
             .uid = uid,
             .pos = pos,
+            .buffer = buffer,
             .start_tick = start_tick,
             .end_tick = end_tick,
-            .source = source
         };
         vec_effect_push(&s_effects, effect);
         qt_effect_insert(&s_effect_tree, pos.x, pos.z, effect);
-
-        if(state == AL_PLAYING || state == AL_PAUSED) {
-            vec_effect_push(&s_active, effect);
-        }
     }
     return true;
 }
@@ -509,10 +628,15 @@ bool Audio_Effect_Init(void)
     if(!qt_effect_reserve(&s_effect_tree, 4096))
         goto fail_tree;
 
-    vec_effect_init(&s_active);
-    if(!vec_effect_resize(&s_effects, 64))
-        goto fail_active;
+    s_group_index = kh_init(group);
+    if(!s_group_index || kh_resize(group, s_group_index, MAX_GROUPS) < 0)
+        goto fail_groups;
+
+    s_voice_index = kh_init(voice);
+    if(!s_voice_index || kh_resize(voice, s_voice_index, MAX_VOICES) < 0)
+        goto fail_voices;
 
+    audio_make_voices();
     audio_create_settings();
     E_Global_Register(EVENT_NEW_GAME, on_new_map, NULL, G_ALL);
     E_Global_Register(EVENT_SESSION_LOADED, on_new_map, NULL, G_ALL);
@@ -521,7 +645,10 @@ bool Audio_Effect_Init(void)
     E_Global_Register(EVENT_1HZ_TICK, on_1hz_tick, NULL, G_RUNNING);
     return true;
 
-fail_active:
+fail_voices:
+    kh_destroy(voice, s_voice_index);
+fail_groups:
+    kh_destroy(group, s_group_index);
     qt_effect_destroy(&s_effect_tree);
 fail_tree:
     vec_effect_destroy(&s_effects);
@@ -531,15 +658,11 @@ fail_vec:
 
 void Audio_Effect_Shutdown(void)
 {
-    for(int i = 0; i < vec_size(&s_active); i++) {
-        struct al_effect *curr = &s_active.array[i];
-        alSourceStop(curr->source);
-    }
-
-    for(int i = 0; i < vec_size(&s_effects); i++) {
-        struct al_effect *curr = &s_effects.array[i];
-        alDeleteSources(1, &curr->source);
+    for(int i = 0; i < s_nvoices; i++) {
+        alSourceStop(s_voices[i].source);
+        alDeleteSources(1, &s_voices[i].source);
     }
+    s_nvoices = 0;
 
     E_Global_Unregister(EVENT_NEW_GAME, on_new_map);
     E_Global_Unregister(EVENT_SESSION_LOADED, on_new_map);
@@ -547,7 +670,8 @@ void Audio_Effect_Shutdown(void)
     E_Global_Unregister(EVENT_UPDATE_START, on_update_start);
     E_Global_Unregister(EVENT_1HZ_TICK, on_1hz_tick);
 
-    vec_effect_destroy(&s_active);
+    kh_destroy(voice, s_voice_index);
+    kh_destroy(group, s_group_index);
     vec_effect_destroy(&s_effects);
     qt_effect_destroy(&s_effect_tree);
 }
@@ -558,21 +682,16 @@ bool Audio_Effect_Add(vec3_t pos, const char *track)
     if(!Audio_GetEffectBuffer(track, &buffer))
         return false;
 
-    ALuint source;
-    audio_make_effect_source(&source, pos, buffer);
-    if(source == INVALID_SOURCE)
-        return false;
-
-    uint32_t start_tick = SDL_GetTicks();
+    uint32_t start_tick = audio_now();
     float duration = Audio_BufferDuration(buffer);
     uint32_t end_tick = start_tick + duration * 1000;
 
     struct al_effect effect = (struct al_effect) {
         .uid = Entity_NewUID(),
         .pos = pos,
+        .buffer = buffer,
         .start_tick = start_tick,
         .end_tick = end_tick,
-        .source = source
     };
 
     vec_effect_push(&s_effects, effect);
@@ -587,35 +706,33 @@ float Audio_EffectVolume(void)
 
 void Audio_EffectPause(void)
 {
-    for(int i = 0; i < vec_size(&s_active); i++) {
-        struct al_effect *curr = &s_active.array[i];
-        alSourcePause(curr->source);
+    for(int i = 0; i < s_nvoices; i++) {
+        if(s_voices[i].in_use)
+            alSourcePause(s_voices[i].source);
     }
+    s_paused = true;
 }
 
 void Audio_EffectResume(uint32_t dt)
 {
-    for(int i = 0; i < vec_size(&s_active); i++) {
-        struct al_effect *curr = &s_active.array[i];
-        alSourcePlay(curr->source);
-        curr->start_tick += dt;
-        curr->end_tick += dt;
+    for(int i = 0; i < s_nvoices; i++) {
+        if(s_voices[i].in_use)
+            alSourcePlay(s_voices[i].source);
     }
+    s_paused_ms += dt;
+    s_paused = false;
 }
 
 void Audio_EffectClearState(void)
 {
-    for(int i = 0; i < vec_size(&s_active); i++) {
-        struct al_effect *curr = &s_active.array[i];
-        alSourceStop(curr->source);
-    }
-    for(int i = 0; i < vec_size(&s_effects); i++) {
-        struct al_effect *curr = &s_effects.array[i];
-        alDeleteSources(1, &curr->source);
+    for(int i = 0; i < s_nvoices; i++) {
+        if(s_voices[i].in_use)
+            audio_voice_release(i);
     }
-    vec_effect_reset(&s_active);
+    assert(kh_size(s_voice_index) == 0);
     vec_effect_reset(&s_effects);
     qt_effect_clear(&s_effect_tree);
+    s_paused = false;
 }
 
 bool Audio_EffectSaveState(struct SDL_RWops *stream)
@@ -53,7 +53,10 @@ enum playback_mode{
     MUSIC_MODE_SHUFFLE,
 };
 
-bool        Audio_Init(void);
+/* In 'headless' mode, no audio is output and no sound device is
+ * required, but the audio state is otherwise maintained as usual.
+ */
+bool        Audio_Init(bool headless);
 void        Audio_Shutdown(void);
 bool        Audio_PlayMusic(const char *name);
 void        Audio_PlayMusicFirst(void);
@@ -189,6 +189,7 @@ static void fps_cam_on_mousemove(void *unused, void *event_arg)
     SDL_Event *e = (SDL_Event*)event_arg;
 
     Camera_ChangeDirection(cam, e->motion.xrel, e->motion.yrel);
+    Camera_LatchPublish(cam);
 }
 
 static void fps_cam_on_update_end(void *unused1, void *unused2)
@@ -234,7 +235,7 @@ static void fps_cam_on_update_end(void *unused1, void *unused2)
     if(ctx->right_state != KEY_RELEASED) PFM_Vec3_Add(&dir, &right, &dir);
     
     Camera_MoveDirectionTick(cam, dir);
-    Camera_TickFinishPerspective(cam);
+    Camera_TickFinishPerspectiveLatched(cam);
 }
 
 static void rts_cam_on_mousemove(void *unused, void *event_arg)
@@ -408,13 +409,13 @@ static void rts_cam_on_update_end(void *unused1, void *unused2)
     }
 
     Camera_MoveDirectionTick(cam, dir);
-    Camera_TickFinishPerspective(cam);
+    Camera_TickFinishPerspectiveLatched(cam);
 }
 
 static void free_cam_on_update_end(void *unused1, void *unused2)
 {
     struct camera *cam = s_cam_ctx.active;
-    Camera_TickFinishPerspective(cam);
+    Camera_TickFinishPerspectiveLatched(cam);
 }
 
 /*****************************************************************************/
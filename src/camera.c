@@ -66,9 +66,24 @@ struct camera {
     struct bound_box bounds;
 };
 
+/* The latest state of the player's camera. It is written by the main 
+ * thread and sampled by the render thread right before it sets up the 
+ * view, so that a frame that has been queued behind others is drawn 
+ * with the newest camera rather than the one it was simulated with. 
+ * The sequence count is odd while a write is in progress.
+ */
+struct cam_latch{
+    SDL_atomic_t seq;
+    vec3_t       pos;
+    vec3_t       front;
+    vec3_t       up;
+    float        aspect;
+};
+
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define EPSILON (1.0f/1024)
+#define LATCH_MAX_RETRIES (8)
 
 /*****************************************************************************/
 /* GLOBAL VARIABLES                                                          */
@@ -76,6 +91,12 @@ struct camera {
 
 const unsigned g_sizeof_camera = sizeof(struct camera);
 
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct cam_latch s_latch;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -87,6 +108,54 @@ static bool camera_pos_in_bounds(const struct camera *cam)
         && (cam->pos.z >= cam->bounds.z && cam->pos.z <= cam->bounds.z + cam->bounds.h);
 }
 
+static bool camera_latch_read(vec3_t *out_pos, vec3_t *out_front, vec3_t *out_up, float *out_aspect)
+{
+    for(int i = 0; i < LATCH_MAX_RETRIES; i++) {
+
+        int begin = SDL_AtomicGet(&s_latch.seq);
+        if(begin == 0)
+            return false;
+        if(begin & 0x1)
+            continue;
+        SDL_MemoryBarrierAcquire();
+
+        *out_pos = s_latch.pos;
+        *out_front = s_latch.front;
+        *out_up = s_latch.up;
+        *out_aspect = s_latch.aspect;
+
+        SDL_MemoryBarrierAcquire();
+        if(SDL_AtomicGet(&s_latch.seq) == begin)
+            return true;
+    }
+    return false;
+}
+
+/* Executed by the render thread in place of setting the view and projection 
+ * that the frame was simulated with. These are only used if the latch has 
+ * not been published yet or is being written to for too long. 
+ */
+static void camera_set_latched_view(const mat4x4_t *view, const vec3_t *pos, const mat4x4_t *proj)
+{
+    vec3_t lpos, lfront, lup;
+    float aspect;
+
+    if(!camera_latch_read(&lpos, &lfront, &lup, &aspect)) {
+        R_GL_SetViewMatAndPos(view, pos);
+        R_GL_SetProj(proj);
+        return;
+    }
+
+    mat4x4_t lview, lproj;
+    vec3_t target;
+    PFM_Vec3_Add(&lpos, &lfront, &target);
+    PFM_Mat4x4_MakeLookAt(&lpos, &target, &lup, &lview);
+    PFM_Mat4x4_MakePerspective(DEG_TO_RAD(45.0f), aspect, CAM_Z_NEAR_DIST, CONFIG_DRAWDIST, &lproj);
+
+    R_GL_SetViewMatAndPos(&lview, &lpos);
+    R_GL_SetProj(&lproj);
+}
+
 static void camera_move_within_bounds(struct camera *cam)
 {
     /* X is increasing to the left in our coordinate system */
@@ -368,6 +437,53 @@ void Camera_TickFinishPerspective(struct camera *cam)
     cam->prev_frame_ts = SDL_GetTicks();
 }
 
+void Camera_LatchPublish(const struct camera *cam)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    int w, h;
+    Engine_WinDrawableSize(&w, &h);
+
+    SDL_AtomicAdd(&s_latch.seq, 1);
+    SDL_MemoryBarrierRelease();
+
+    s_latch.pos = cam->pos;
+    s_latch.front = cam->front;
+    s_latch.up = cam->up;
+    s_latch.aspect = ((GLfloat)w)/h;
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicAdd(&s_latch.seq, 1);
+}
+
+void Camera_TickFinishPerspectiveLatched(struct camera *cam)
+{
+    mat4x4_t view, proj;
+
+    Camera_LatchPublish(cam);
+
+    vec3_t target;
+    PFM_Vec3_Add(&cam->pos, &cam->front, &target);
+    PFM_Mat4x4_MakeLookAt(&cam->pos, &target, &cam->up, &view);
+
+    int w, h;
+    Engine_WinDrawableSize(&w, &h);
+    PFM_Mat4x4_MakePerspective(DEG_TO_RAD(45.0f), ((GLfloat)w)/h, CAM_Z_NEAR_DIST, CONFIG_DRAWDIST, &proj);
+
+    R_PushCmd((struct rcmd){
+        .func = camera_set_latched_view,
+        .nargs = 3,
+        .args = {
+            R_PushArg(&view, sizeof(view)),
+            R_PushArg(&cam->pos, sizeof(cam->pos)),
+            R_PushArg(&proj, sizeof(proj)),
+        },
+    });
+
+    /* Update our last timestamp */
+    cam->prev_frame_ts = SDL_GetTicks();
+}
+
 void Camera_TickFinishOrthographic(struct camera *cam, vec2_t bot_left, vec2_t top_right)
 {
     mat4x4_t view, proj;
@@ -92,6 +92,14 @@ void           Camera_ChangeDirection  (struct camera *cam, int dx, int dy);
 void           Camera_TickFinishPerspective(struct camera *cam);
 void           Camera_TickFinishOrthographic(struct camera *cam, vec2_t bot_left, vec2_t top_right);
 
+/* Same as 'Camera_TickFinishPerspective', but the render thread will draw the 
+ * frame with whatever camera state was last published at the time it gets 
+ * to it. To be used for the player's camera only. 
+ */
+void           Camera_TickFinishPerspectiveLatched(struct camera *cam);
+/* Makes the camera's current state visible to the render thread. */
+void           Camera_LatchPublish(const struct camera *cam);
+
 void           Camera_MakeFrustum(const struct camera *cam, struct frustum *out);
 
 #endif
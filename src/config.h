@@ -40,12 +40,22 @@
 #include <SDL.h>
 
 #define CONFIG_SCHED_TARGET_FPS     (30)
+/* The time that a script task may run for during a single tick before it's 
+ * preempted and resumed on the next one. Zero disables the preemption. 
+ */
+#define CONFIG_SCRIPT_TASK_SLICE_US (2000)
 #define CONFIG_USE_BATCH_RENDERING  (true)
 
 /* The far end of the camera's clipping frustrum, in OpenGL coordinates */
 #define CONFIG_DRAWDIST             (1000)
 #define CONFIG_TILE_TEX_RES         (128)
 #define CONFIG_ARR_TEX_RES          (512)
+/* The default for 'pf.video.texture_budget_mb'. Only the textures which are 
+ * not referenced are evicted to stay within it */
+#define CONFIG_TEXTURE_BUDGET_MB    (512)
+/* The default for 'pf.video.terrain_budget_chunks'. Maps with more chunks 
+ * only keep the terrain meshes around the camera resident */
+#define CONFIG_TERRAIN_BUDGET_CHUNKS (4096)
 #define CONFIG_LOADING_SCREEN       "assets/loading_screens/default.png"
 
 #define CONFIG_SHADOW_MAP_RES       (2048)
@@ -66,9 +76,35 @@
 #define CONFIG_FLOW_CACHE_SZ        (2048)
 #define CONFIG_MAPPING_CACHE_SZ     (4096)
 #define CONFIG_GRID_PATH_CACHE_SZ   (8192)
+#define CONFIG_ROUTE_CACHE_SZ       (1024)
+/* Build the integration fields of single chunks with row-wise sweeps 
+ * rather than with a priority queue. Both produce identical fields. 
+ */
+#define CONFIG_FIELD_SWEEP_INTEGRATION (true)
+
+/* Persist baked navigation data (portals, portal links and islands) to 
+ * disk, keyed by a hash of the cost fields, and reuse it on the next load. 
+ */
+#define CONFIG_NAV_CACHE (true)
 
 #define CONFIG_FRAME_STEP_HOTKEY    (SDL_SCANCODE_SPACE)
 
+/* The most frames that the simulation is allowed to run ahead of the 
+ * render thread ('pf.video.frame_latency'). Every frame of latency takes 
+ * up one more render workspace. 
+ */
+#define CONFIG_MAX_FRAME_LATENCY    (2)
+
+/* The highest simulation speed multiplier that can be requested. 
+ */
+#define CONFIG_MAX_SIM_SPEED        (8)
+
+/* The default and highest number of milliseconds a frame on which nothing 
+ * visible changed may be skipped for ('pf.video.idle_max_latency'). 
+ */
+#define CONFIG_IDLE_MAX_LATENCY_MS      (100)
+#define CONFIG_IDLE_MAX_LATENCY_MAX_MS  (1000)
+
 /* Some debug configurations to allow overriding malloc/free and friends 
  * on Linux builds to assist in debuggin memory problems. See debug_malloc.c
  * for details.
@@ -76,12 +76,23 @@ struct iconlist{
     const char *icons[MAX_ICONS]; 
 };
 
+/* World-space OBBs, one for the current pose bounds and one for the 
+ * identity bounds. A slot is valid as long as its' source AABB is still 
+ * the one the entity would use - animated entities point at a different 
+ * AABB every frame, so a pose change invalidates the slot implicitly. 
+ */
+struct obb_cache{
+    const struct aabb *src[2];
+    struct obb         obb[2];
+};
+
 MPOOL_TYPE(taglist, struct taglist)
 MPOOL_PROTOTYPES(static, taglist, struct taglist)
 MPOOL_IMPL(static, taglist, struct taglist)
 
 KHASH_MAP_INIT_INT(tags, struct taglist)
 KHASH_MAP_INIT_INT(icons, struct iconlist)
+KHASH_MAP_INIT_INT(obb, struct obb_cache)
 __KHASH_IMPL(trans, extern, khint32_t, struct transform, 1, kh_int_hash_func, kh_int_hash_equal)
 
 /*****************************************************************************/
@@ -96,6 +107,7 @@ static kh_ents_t        *s_tag_ent_map;
 static kh_tags_t        *s_ent_tag_map;
 static kh_trans_t       *s_ent_trans_map;
 static kh_icons_t       *s_ent_icons_map;
+static kh_obb_t         *s_ent_obb_map;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -298,6 +310,42 @@ static struct result disappear_task(void *arg)
     return NULL_RESULT;
 }
 
+static const struct aabb *entity_obb_source(uint32_t uid, bool identity)
+{
+    uint32_t flags = G_FlagsGet(uid);
+
+    if((flags & ENTITY_FLAG_ANIMATED) && !identity) {
+        return A_GetCurrPoseAABB(uid);
+    }else {
+        struct entity *ent = AL_EntityGet(uid);
+        return &ent->identity_aabb;
+    }
+}
+
+static void entity_compute_obb(uint32_t uid, const struct aabb *aabb, struct obb *out)
+{
+    mat4x4_t model;
+    Entity_ModelMatrix(uid, &model);
+    vec3_t scale = Entity_GetScale(uid);
+    Entity_CurrentOBBFrom(aabb, model, scale, out);
+}
+
+static struct obb_cache *entity_obb_cache(uint32_t uid)
+{
+    khiter_t k = kh_get(obb, s_ent_obb_map, uid);
+    if(k != kh_end(s_ent_obb_map))
+        return &kh_value(s_ent_obb_map, k);
+
+    int status;
+    k = kh_put(obb, s_ent_obb_map, uid, &status);
+    if(status == -1)
+        return NULL;
+
+    kh_value(s_ent_obb_map, k).src[0] = NULL;
+    kh_value(s_ent_obb_map, k).src[1] = NULL;
+    return &kh_value(s_ent_obb_map, k);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -323,20 +371,44 @@ void Entity_SetNextUID(uint32_t uid)
 
 void Entity_CurrentOBB(uint32_t uid, struct obb *out, bool identity)
 {
-    const struct aabb *aabb;
-    uint32_t flags = G_FlagsGet(uid);
+    const struct aabb *aabb = entity_obb_source(uid, identity);
 
-    if((flags & ENTITY_FLAG_ANIMATED) && !identity) {
-        aabb = A_GetCurrPoseAABB(uid);
-    }else {
-        struct entity *ent = AL_EntityGet(uid);
-        aabb = &ent->identity_aabb;
+    /* The cache is owned by the main thread. Worker tasks (ex. flow 
+     * field computations) compute the bounds without touching it. */
+    struct obb_cache *cache = NULL;
+    if(SDL_ThreadID() == g_main_thread_id) {
+        cache = entity_obb_cache(uid);
     }
 
-    mat4x4_t model;
-    Entity_ModelMatrix(uid, &model);
-    vec3_t scale = Entity_GetScale(uid);
-    Entity_CurrentOBBFrom(aabb, model, scale, out);
+    if(!cache) {
+        entity_compute_obb(uid, aabb, out);
+        return;
+    }
+
+    if(cache->src[identity] != aabb) {
+        entity_compute_obb(uid, aabb, &cache->obb[identity]);
+        cache->src[identity] = aabb;
+    }
+    *out = cache->obb[identity];
+}
+
+void Entity_CurrentOBBs(size_t count, const uint32_t uids[], struct obb out[], bool identity)
+{
+    for(size_t i = 0; i < count; i++) {
+        Entity_CurrentOBB(uids[i], &out[i], identity);
+    }
+}
+
+void Entity_InvalidateOBB(uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    khiter_t k = kh_get(obb, s_ent_obb_map, uid);
+    if(k == kh_end(s_ent_obb_map))
+        return;
+
+    kh_value(s_ent_obb_map, k).src[0] = NULL;
+    kh_value(s_ent_obb_map, k).src[1] = NULL;
 }
 
 vec3_t Entity_CenterPos(uint32_t uid)
@@ -347,6 +419,13 @@ vec3_t Entity_CenterPos(uint32_t uid)
 }
 
 vec3_t Entity_TopCenterPointWS(uint32_t uid)
+{
+    mat4x4_t model; 
+    Entity_ModelMatrix(uid, &model);
+    return Entity_TopCenterPointWSFrom(uid, model);
+}
+
+vec3_t Entity_TopCenterPointWSFrom(uint32_t uid, mat4x4_t model)
 {
     const struct entity *ent = AL_EntityGet(uid);
     const struct aabb *aabb = &ent->identity_aabb;
@@ -358,10 +437,7 @@ vec3_t Entity_TopCenterPointWS(uint32_t uid)
         1.0f
     };
 
-    mat4x4_t model; 
     vec4_t out_ws_homo;
-
-    Entity_ModelMatrix(uid, &model);
     PFM_Mat4x4_Mult4x1(&model, &top_center_homo, &out_ws_homo);
 
     return (vec3_t) {
@@ -582,8 +658,14 @@ bool Entity_Init(void)
     if(!s_ent_icons_map)
         goto fail_ent_icons_map;
 
+    s_ent_obb_map = kh_init(obb);
+    if(!s_ent_obb_map)
+        goto fail_ent_obb_map;
+
     return true;
 
+fail_ent_obb_map:
+    kh_destroy(icons, s_ent_icons_map);
 fail_ent_icons_map:
     kh_destroy(trans, s_ent_trans_map);
 fail_ent_trans_map:
@@ -598,6 +680,7 @@ fail_strintern:
 
 void Entity_Shutdown(void)
 {
+    kh_destroy(obb, s_ent_obb_map);
     kh_destroy(icons, s_ent_icons_map);
     kh_destroy(trans, s_ent_trans_map);
     kh_destroy(tags, s_ent_tag_map);
@@ -607,6 +690,7 @@ void Entity_Shutdown(void)
 
 void Entity_ClearState(void)
 {
+    kh_clear(obb, s_ent_obb_map);
     kh_clear(icons, s_ent_icons_map);
     kh_clear(trans, s_ent_trans_map);
     kh_clear(tags, s_ent_tag_map);
@@ -630,6 +714,7 @@ void Entity_SetRot(uint32_t uid, quat_t rot)
         assert(status != -1);
     }
     kh_value(s_ent_trans_map, k).rotation = rot;
+    Entity_InvalidateOBB(uid);
     G_UpdateBounds(uid);
 }
 
@@ -649,6 +734,7 @@ void Entity_SetScale(uint32_t uid, vec3_t scale)
         assert(status != -1);
     }
     kh_value(s_ent_trans_map, k).scale = scale;
+    Entity_InvalidateOBB(uid);
     G_UpdateBounds(uid);
 }
 
@@ -659,6 +745,11 @@ void Entity_Remove(uint32_t uid)
         kh_del(trans, s_ent_trans_map, k);
     }
 
+    k = kh_get(obb, s_ent_obb_map, uid);
+    if(k != kh_end(s_ent_obb_map)) {
+        kh_del(obb, s_ent_obb_map, k);
+    }
+
     Entity_ClearTags(uid);
     k = kh_get(tags, s_ent_tag_map, uid);
     if(k != kh_end(s_ent_tag_map)) {
@@ -718,8 +809,8 @@ void Entity_CurrentOBBFrom(const struct aabb *aabb, mat4x4_t model, vec3_t scale
     };
 
     vec4_t obb_verts_homo[8];
+    PFM_Mat4x4_Mult4x1Batch(&model, identity_verts_homo, 8, obb_verts_homo);
     for(int i = 0; i < 8; i++) {
-        PFM_Mat4x4_Mult4x1(&model, identity_verts_homo + i, obb_verts_homo + i);
         out->corners[i] = (vec3_t){
             obb_verts_homo[i].x / obb_verts_homo[i].w,
             obb_verts_homo[i].y / obb_verts_homo[i].w,
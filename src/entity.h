@@ -90,6 +90,8 @@ struct ent_stat_rstate{
     mat4x4_t         model;
     bool             translucent;
     struct tile_desc td; /* For binning to a chunk batch */
+    struct aabb      aabb; /* Object-space bounds, for GPU culling */
+    int              lod;  /* Mesh level of detail to draw */
 };
 
 /* State needed for rendering an animated entity */
@@ -99,8 +101,19 @@ struct ent_anim_rstate{
     mat4x4_t        model;
     bool            translucent;
     size_t          njoints;
-    const mat4x4_t *inv_bind_pose; /* static, use shallow copy */
-    mat4x4_t        curr_pose[MAX_JOINTS];
+    size_t          pose_base; /* Current frame's first matrix in the pose buffer */
+    int             lod;       /* Mesh level of detail to draw */
+};
+
+/* State needed for rendering an animated entity as a camera-facing sprite
+ * sampled from pre-rendered views of one of its frames */
+struct ent_impostor_rstate{
+    uint32_t        uid;
+    void           *render_private;
+    mat4x4_t        model;
+    struct aabb     aabb;      /* Bind-pose bounds, framing the pre-rendered views */
+    size_t          pose_base; /* The frame to show */
+    float           fade;      /* Coverage, from 0 (hidden) to 1 (opaque) */
 };
 
 struct transform{
@@ -114,6 +127,9 @@ VEC_IMPL(static inline, rstat, struct ent_stat_rstate)
 VEC_TYPE(ranim, struct ent_anim_rstate)
 VEC_IMPL(static inline, ranim, struct ent_anim_rstate)
 
+VEC_TYPE(rimp, struct ent_impostor_rstate)
+VEC_IMPL(static inline, rimp, struct ent_impostor_rstate)
+
 KHASH_DECLARE(trans, khint32_t, struct transform)
 
 struct map;
@@ -126,6 +142,10 @@ void     Entity_ModelMatrix(uint32_t uid, mat4x4_t *out);
 uint32_t Entity_NewUID(void);
 void     Entity_SetNextUID(uint32_t uid);
 void     Entity_CurrentOBB(uint32_t uid, struct obb *out, bool identity);
+void     Entity_CurrentOBBs(size_t count, const uint32_t uids[], struct obb out[], bool identity);
+/* Must be called whenever any of the inputs of the entity's world-space 
+ * bounds (position, rotation, scale, model) are changed */
+void     Entity_InvalidateOBB(uint32_t uid);
 vec3_t   Entity_CenterPos(uint32_t uid);
 vec3_t   Entity_TopCenterPointWS(uint32_t uid);
 void     Entity_FaceTowards(uint32_t uid, vec2_t point);
@@ -156,6 +176,7 @@ khash_t(trans) *Entity_CopyTransforms(void);
 quat_t          Entity_GetRotFrom(khash_t(trans) *table, uint32_t uid);
 vec3_t          Entity_GetScaleFrom(khash_t(trans) *table, uint32_t uid);
 void            Entity_ModelMatrixFrom(vec3_t pos, quat_t rot, vec3_t scale, mat4x4_t *out);
+vec3_t          Entity_TopCenterPointWSFrom(uint32_t uid, mat4x4_t model);
 void            Entity_CurrentOBBFrom(const struct aabb *aabb, mat4x4_t model, 
                                       vec3_t scale, struct obb *out);
 
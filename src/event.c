@@ -44,6 +44,7 @@
 #include "game/public/game.h"
 
 #include <assert.h>
+#include <string.h>
 
 
 enum handler_type{
@@ -75,6 +76,10 @@ struct event{
  * entity ID, we will assume entity IDs will never reach this high.
  */
 #define GLOBAL_ID (~((uint32_t)0))
+/* Used in the place of the entity ID for the handlers which receive all 
+ * the entity events of a given type at once, at the end of the tick.
+ */
+#define BATCH_ID  (GLOBAL_ID - 1)
 
 VEC_TYPE(hd, struct handler_desc)
 VEC_IMPL(static inline, hd, struct handler_desc)
@@ -84,6 +89,48 @@ KHASH_MAP_INIT_INT64(handler_desc, vec_hd_t)
 QUEUE_TYPE(event, struct event)
 QUEUE_IMPL(static, event, struct event)
 
+MPSC_QUEUE_TYPE(event, struct event)
+MPSC_QUEUE_IMPL(static, event, struct event)
+
+VEC_TYPE(sobj, script_opaque_t)
+VEC_IMPL(static inline, sobj, script_opaque_t)
+
+/* The number of handlers registered for an engine event. This allows 
+ * skipping the table lookups for events that nobody is listening to. 
+ */
+struct handler_count{
+    uint32_t nglobal;
+    uint32_t nentity;
+    uint32_t nbatched;
+};
+
+/* Entity events of a single type accumulated during a tick for 
+ * delivery to the batched handlers. 
+ */
+struct event_batch{
+    vec_entity_t uids;
+    vec_sobj_t   args;
+};
+
+/* The handler lists of the global and batched handlers of an engine event, 
+ * cached to skip the table lookup. The cached pointers are into the table, 
+ * so they are only valid until the next time the table is modified. 
+ */
+struct handler_cache{
+    uint32_t  gen;
+    vec_hd_t *global;
+    vec_hd_t *batched;
+};
+
+/* Both queues retain their capacity as they are swapped, so they will only 
+ * grow during the first ticks which generate more events than this.
+ */
+#define EVENT_QUEUE_INIT_CAP    (16384)
+/* The number of nested dispatches which get to use a preallocated buffer 
+ * for their handler snapshot.
+ */
+#define MAX_DISPATCH_DEPTH      (8)
+
 #define STR(_event) [_event - EVENT_UPDATE_START] = #_event
 
 /*****************************************************************************/
@@ -154,11 +201,24 @@ static const char *s_event_str_table[] = {
     STR(EVENT_RALLY_POINT_SET),
     STR(EVENT_UNIT_BECAME_IDLE),
     STR(EVENT_UNIT_BECAME_ACTIVE),
+    STR(EVENT_PERF_BUDGET_EXCEEDED),
 };
 
+#define NUM_ENGINE_EVENTS (sizeof(s_event_str_table)/sizeof(const char *))
+
 static khash_t(handler_desc) *s_event_handler_table;
+static struct handler_count   s_handler_counts[NUM_ENGINE_EVENTS];
+static struct event_batch     s_event_batches[NUM_ENGINE_EVENTS];
 static queue(event)           s_event_queues[2];
 static int                    s_front_queue_idx = 0;
+/* Events notified from outside the main thread. These get appended to 
+ * the queue as it's serviced. */
+static mpsc(event)            s_event_inbox;
+/* Incremented whenever any handler is registered or unregistered */
+static uint32_t               s_handler_gen = 1;
+static struct handler_cache   s_handler_cache[NUM_ENGINE_EVENTS];
+static vec_hd_t               s_dispatch_scratch[MAX_DISPATCH_DEPTH];
+static int                    s_dispatch_depth = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -211,6 +271,29 @@ static bool e_is_timer_event(enum eventtype type)
     return false;
 }
 
+static struct handler_count *e_counts(enum eventtype event)
+{
+    if(event < EVENT_UPDATE_START || event - EVENT_UPDATE_START >= NUM_ENGINE_EVENTS)
+        return NULL;
+    return &s_handler_counts[event - EVENT_UPDATE_START];
+}
+
+static void e_update_count(uint64_t key, int delta)
+{
+    uint32_t uid = key >> 32;
+    struct handler_count *counts = e_counts(key & ~((uint32_t)0));
+    if(!counts)
+        return;
+
+    if(uid == GLOBAL_ID) {
+        counts->nglobal += delta;
+    }else if(uid == BATCH_ID) {
+        counts->nbatched += delta;
+    }else {
+        counts->nentity += delta;
+    }
+}
+
 static bool e_register_handler(uint64_t key, struct handler_desc *desc)
 {
     khiter_t k;
@@ -239,6 +322,8 @@ static bool e_register_handler(uint64_t key, struct handler_desc *desc)
         kh_value(s_event_handler_table, k) = vec;
     }
 
+    s_handler_gen++;
+    e_update_count(key, 1);
     return true;
 }
 
@@ -266,6 +351,8 @@ static bool e_unregister_handler(uint64_t key, const struct handler_desc *desc)
     vec_hd_del(&vec, idx);
     kh_value(s_event_handler_table, k) = vec;
 
+    s_handler_gen++;
+    e_update_count(key, -1);
     return true;
 }
 
@@ -300,30 +387,73 @@ static void e_invoke(const struct handler_desc hd, struct event event)
     }
 }
 
-static void e_handle_event(struct event event, bool immediate)
+static void e_batch_push(struct event event)
 {
-    if((G_GetSimState() != G_RUNNING) && e_is_timer_event(event.type))
-        return;
+    struct event_batch *batch = &s_event_batches[event.type - EVENT_UPDATE_START];
+    script_opaque_t script_arg = (event.source == ES_SCRIPT) 
+        ? S_UnwrapIfWeakref(event.arg)
+        : S_WrapEngineEventArg(event.type, event.arg);
+    assert(script_arg);
+
+    vec_entity_push(&batch->uids, event.receiver_id);
+    vec_sobj_push(&batch->args, script_arg);
+}
 
-    Sched_HandleEvent(event.type, event.arg, event.source, immediate);
+static void e_batch_clear(struct event_batch *batch)
+{
+    for(int i = 0; i < vec_size(&batch->args); i++) {
+        S_Release(vec_AT(&batch->args, i));
+    }
+    vec_entity_reset(&batch->uids);
+    vec_sobj_reset(&batch->args);
+}
+
+static vec_hd_t *e_lookup(uint64_t key)
+{
+    khiter_t k = kh_get(handler_desc, s_event_handler_table, key);
+    if(k == kh_end(s_event_handler_table))
+        return NULL;
+    return &kh_value(s_event_handler_table, k);
+}
+
+static vec_hd_t *e_handlers(uint32_t receiver_id, enum eventtype type)
+{
+    uint64_t key = e_key(receiver_id, type);
+    if(receiver_id != GLOBAL_ID && receiver_id != BATCH_ID)
+        return e_lookup(key);
+
+    if(type < EVENT_UPDATE_START || type - EVENT_UPDATE_START >= NUM_ENGINE_EVENTS)
+        return e_lookup(key);
+
+    struct handler_cache *cache = &s_handler_cache[type - EVENT_UPDATE_START];
+    if(cache->gen != s_handler_gen) {
+        cache->global = e_lookup(e_key(GLOBAL_ID, type));
+        cache->batched = e_lookup(e_key(BATCH_ID, type));
+        cache->gen = s_handler_gen;
+    }
+    return (receiver_id == GLOBAL_ID) ? cache->global : cache->batched;
+}
 
+static bool e_should_run(const struct handler_desc *hd, struct event event, 
+                         bool immediate, enum simstate ss)
+{
+    if(!immediate && ((hd->simmask & ss) == 0))
+        return false;
+    if(event.tick != hd->register_tick && SDL_TICKS_PASSED(hd->register_tick, event.tick))
+        return false;
+    return true;
+}
+
+/* The execution of an event handler can cause one or more event handlers 
+ * to be unregistered. We want to provide a guarantee that once an event 
+ * handler is unregistered, it will never be executed. So, keep fetching 
+ * the handlers vector from the table after every execution, in case it's
+ * been changed by the prior handler call.
+ */
+static void e_dispatch_refetching(struct event event, bool immediate, vec_hd_t *execd_handlers)
+{
     uint64_t key = e_key(event.receiver_id, event.type);
     enum simstate ss = G_GetSimState();
-
-    if(event.receiver_id != GLOBAL_ID 
-    && G_EntityIsZombie(event.receiver_id) 
-    && !e_zombie_can_receive(event.type))
-        return;
-    
-    /* The execution of an event handler can cause one or more event handlers 
-     * to be unregistered. We want to provide a guarantee that once an event 
-     * handler is unregistered, it will never be executed. So, keep fetching 
-     * the handlers vector from the table after every execution, in case it's
-     * been changed by the prior handler call.
-     */
-
-    vec_hd_t execd_handlers;
-    vec_hd_init(&execd_handlers);
     bool ran; 
 
     vec_hd_t curr;
@@ -346,15 +476,13 @@ static void e_handle_event(struct event event, bool immediate)
              * and must not be dereferenced 
              */
             struct handler_desc elem = vec_AT(&curr, i);
-            int idx = vec_hd_indexof(&execd_handlers, elem, e_ptrs_equal); 
+            int idx = vec_hd_indexof(execd_handlers, elem, e_ptrs_equal); 
             if(idx != -1)
                 continue;
             /* memoize any handlers that we've already ran */
-            vec_hd_push(&execd_handlers, elem);
+            vec_hd_push(execd_handlers, elem);
 
-            if(!immediate && ((elem.simmask & ss) == 0))
-                continue;
-            if(event.tick != elem.register_tick && SDL_TICKS_PASSED(elem.register_tick, event.tick))
+            if(!e_should_run(&elem, event, immediate, ss))
                 continue;
 
             e_invoke(elem, event);
@@ -364,25 +492,151 @@ static void e_handle_event(struct event event, bool immediate)
     
     }while(ran);
 
-    vec_hd_destroy(&execd_handlers);
     vec_hd_destroy(&curr);
+}
+
+/* Handlers are run from a snapshot of the handler list for as long as no 
+ * handler gets registered or unregistered. When that happens, fall back 
+ * to re-fetching the list after every handler.
+ */
+static void e_dispatch(struct event event, bool immediate)
+{
+    vec_hd_t *live = e_handlers(event.receiver_id, event.type);
+    if(!live || vec_size(live) == 0)
+        return;
+
+    vec_hd_t local, *snapshot = &local;
+    if(s_dispatch_depth < MAX_DISPATCH_DEPTH) {
+        snapshot = &s_dispatch_scratch[s_dispatch_depth];
+    }else{
+        vec_hd_init(&local);
+    }
+    s_dispatch_depth++;
+
+    vec_hd_reset(snapshot);
+    vec_hd_copy(snapshot, live);
+
+    enum simstate ss = G_GetSimState();
+    uint32_t gen = s_handler_gen;
+    size_t nhandlers = vec_size(snapshot);
+    size_t i;
+
+    for(i = 0; i < nhandlers; i++) {
+
+        struct handler_desc *elem = &vec_AT(snapshot, i);
+        if(!e_should_run(elem, event, immediate, ss))
+            continue;
+
+        e_invoke(*elem, event);
+        if(s_handler_gen != gen)
+            break;
+    }
+
+    if(i < nhandlers) {
+
+        vec_hd_t execd_handlers;
+        vec_hd_init(&execd_handlers);
+        for(int j = 0; j <= i; j++) {
+            vec_hd_push(&execd_handlers, vec_AT(snapshot, j));
+        }
+        e_dispatch_refetching(event, immediate, &execd_handlers);
+        vec_hd_destroy(&execd_handlers);
+    }
+
+    s_dispatch_depth--;
+    if(snapshot == &local) {
+        vec_hd_destroy(&local);
+    }
+}
+
+static void e_handle_event(struct event event, bool immediate)
+{
+    if((G_GetSimState() != G_RUNNING) && e_is_timer_event(event.type))
+        return;
+
+    PERF_COUNTER_ADD("events.handled", 1);
+    Sched_HandleEvent(event.type, event.arg, event.source, immediate);
+
+    if(event.receiver_id != GLOBAL_ID 
+    && G_EntityIsZombie(event.receiver_id) 
+    && !e_zombie_can_receive(event.type))
+        return;
+
+    const struct handler_count *counts = e_counts(event.type);
+    if(counts && event.receiver_id != GLOBAL_ID && counts->nbatched) {
+        e_batch_push(event);
+    }
+
+    if(!counts
+    || (event.receiver_id == GLOBAL_ID && counts->nglobal)
+    || (event.receiver_id != GLOBAL_ID && counts->nentity)) {
+        e_dispatch(event, immediate);
+    }
 
     if(event.source == ES_SCRIPT)
         S_Release(event.arg);
 }
 
+/* Deliver the entity events accumulated during the tick to the batched 
+ * handlers. Each handler gets a single list of (uid, arg) tuples per 
+ * event type instead of one call per event.
+ */
+static void e_flush_batches(uint32_t ticks)
+{
+    for(int i = 0; i < NUM_ENGINE_EVENTS; i++) {
+
+        struct event_batch *batch = &s_event_batches[i];
+        if(vec_size(&batch->uids) == 0)
+            continue;
+
+        /* The handlers may cause more events of the same type to be 
+         * generated - those will be delivered during the next tick. */
+        script_opaque_t list = NULL;
+        if(s_handler_counts[i].nbatched) {
+            list = S_PackEventBatch(vec_size(&batch->uids), batch->uids.array, batch->args.array);
+        }
+        e_batch_clear(batch);
+        if(!list)
+            continue;
+
+        enum eventtype type = EVENT_UPDATE_START + i;
+        e_dispatch((struct event){type, list, ES_SCRIPT, BATCH_ID, ticks}, false);
+        S_Release(list);
+    }
+}
+
+static void e_push(struct event *event)
+{
+    if(SDL_ThreadID() != g_main_thread_id) {
+        mpsc_event_push(&s_event_inbox, event);
+        return;
+    }
+    queue_event_push(&s_event_queues[s_front_queue_idx], event);
+}
+
+static void e_drain_inbox(queue_event_t *queue)
+{
+    struct event event;
+    while(mpsc_event_pop(&s_event_inbox, &event)) {
+        queue_event_push(queue, &event);
+    }
+}
+
 static void e_notify_entities_update_start(uint32_t ticks, bool immediate)
 {
     uint64_t key;
     vec_hd_t curr;
     (void)curr;
 
+    if(e_counts(EVENT_UPDATE_START)->nentity == 0)
+        return;
+
     kh_foreach(s_event_handler_table, key, curr, {
 
         if((key & 0xffffffff) != EVENT_UPDATE_START)
             continue;
         uint32_t uid = key >> 32;
-        if(uid == GLOBAL_ID)
+        if(uid == GLOBAL_ID || uid == BATCH_ID)
             continue;
         e_handle_event( (struct event){EVENT_UPDATE_START, NULL, ES_ENGINE, uid, ticks}, immediate);
     });
@@ -398,11 +652,22 @@ bool E_Init(void)
     if(!s_event_handler_table)
         goto fail_table;
 
-    if(!queue_event_init(&s_event_queues[0], 2048))
+    if(!queue_event_init(&s_event_queues[0], EVENT_QUEUE_INIT_CAP))
         goto fail_front_queue;
-    if(!queue_event_init(&s_event_queues[1], 2048))
+    if(!queue_event_init(&s_event_queues[1], EVENT_QUEUE_INIT_CAP))
         goto fail_back_queue;
 
+    mpsc_event_init(&s_event_inbox);
+    memset(s_handler_counts, 0, sizeof(s_handler_counts));
+    memset(s_handler_cache, 0, sizeof(s_handler_cache));
+    s_handler_gen = 1;
+    for(int i = 0; i < MAX_DISPATCH_DEPTH; i++) {
+        vec_hd_init(&s_dispatch_scratch[i]);
+    }
+    for(int i = 0; i < NUM_ENGINE_EVENTS; i++) {
+        vec_entity_init(&s_event_batches[i].uids);
+        vec_sobj_init(&s_event_batches[i].args);
+    }
     return true;
         
 fail_back_queue:
@@ -425,9 +690,21 @@ void E_Shutdown(void)
         vec_hd_destroy(&vec);
     }
 
+    for(int i = 0; i < NUM_ENGINE_EVENTS; i++) {
+        e_batch_clear(&s_event_batches[i]);
+        vec_entity_destroy(&s_event_batches[i].uids);
+        vec_sobj_destroy(&s_event_batches[i].args);
+    }
+
+    for(int i = 0; i < MAX_DISPATCH_DEPTH; i++) {
+        vec_hd_destroy(&s_dispatch_scratch[i]);
+    }
+
     kh_destroy(handler_desc, s_event_handler_table);
+    mpsc_event_destroy(&s_event_inbox);
     queue_event_destroy(&s_event_queues[1]);
     queue_event_destroy(&s_event_queues[0]);
+    s_handler_gen++;
 }
 
 void E_ServiceQueue(void)
@@ -437,6 +714,7 @@ void E_ServiceQueue(void)
 
     queue_event_t *queue = &s_event_queues[s_front_queue_idx];
     s_front_queue_idx = (s_front_queue_idx + 1) % 2;
+    e_drain_inbox(queue);
 
     e_handle_event( (struct event){EVENT_UPDATE_START, NULL, ES_ENGINE, GLOBAL_ID, ticks}, false);
     e_notify_entities_update_start(ticks, false);
@@ -448,6 +726,7 @@ void E_ServiceQueue(void)
         /* event arg already released */
     }
 
+    e_flush_batches(ticks);
     e_handle_event( (struct event){EVENT_UPDATE_END, NULL, ES_ENGINE, GLOBAL_ID, ticks}, false);
 
     PERF_RETURN_VOID();
@@ -455,7 +734,11 @@ void E_ServiceQueue(void)
 
 void E_ClearPendingEvents(void)
 {
+    e_drain_inbox(&s_event_queues[s_front_queue_idx]);
     queue_event_clear(&s_event_queues[s_front_queue_idx]);
+    for(int i = 0; i < NUM_ENGINE_EVENTS; i++) {
+        e_batch_clear(&s_event_batches[i]);
+    }
 }
 
 void E_FlushEventQueue(void)
@@ -464,6 +747,7 @@ void E_FlushEventQueue(void)
 
         queue_event_t *queue = &s_event_queues[s_front_queue_idx];
         s_front_queue_idx = (s_front_queue_idx + 1) % 2;
+        e_drain_inbox(queue);
 
         struct event event;
         while(queue_event_pop(queue, &event)) {
@@ -480,7 +764,8 @@ void E_FlushEventQueue(void)
 bool E_EventsQueued(void)
 {
     return (queue_size(s_event_queues[0]) > 0) 
-        || (queue_size(s_event_queues[1]) > 0);
+        || (queue_size(s_event_queues[1]) > 0)
+        || (mpsc_size(s_event_inbox) > 0);
 }
 
 void E_DeleteScriptHandlers(void)
@@ -503,6 +788,7 @@ void E_DeleteScriptHandlers(void)
             S_Release(hd.handler.as_script_callable);
             S_Release(hd.user_arg); 
             vec_hd_del(&curr, i);
+            e_update_count(key, -1);
         }
 
         khiter_t k = kh_get(handler_desc, s_event_handler_table, key);
@@ -521,6 +807,7 @@ void E_DeleteScriptHandlers(void)
         vec_hd_destroy(&kh_value(s_event_handler_table, k));
         kh_del(handler_desc, s_event_handler_table, k);
     }
+    s_handler_gen++;
 }
 
 size_t E_GetScriptHandlers(size_t max_out, struct script_handler *out)
@@ -542,9 +829,11 @@ size_t E_GetScriptHandlers(size_t max_out, struct script_handler *out)
                 break;
 
             assert(hd.handler.as_script_callable && hd.user_arg);
+            uint32_t id = key >> 32;
             out[ret] = (struct script_handler){
                 .event = key & ~((uint32_t)0),
-                .id = key >> 32,
+                .id = (id == BATCH_ID) ? GLOBAL_ID : id,
+                .batched = (id == BATCH_ID),
                 .simmask = hd.simmask,
                 .handler = hd.handler.as_script_callable,
                 .arg = (script_opaque_t)hd.user_arg
@@ -562,7 +851,7 @@ size_t E_GetScriptHandlers(size_t max_out, struct script_handler *out)
 void E_Global_Notify(enum eventtype event, void *event_arg, enum event_source source)
 {
     struct event e = (struct event){event, event_arg, source, GLOBAL_ID, SDL_GetTicks()};
-    queue_event_push(&s_event_queues[s_front_queue_idx], &e);
+    e_push(&e);
 }
 
 bool E_Global_Register(enum eventtype event, handler_t handler, void *user_arg, int simmask)
@@ -608,6 +897,31 @@ bool E_Global_ScriptUnregister(enum eventtype event, script_opaque_t handler)
     return e_unregister_handler(e_key(GLOBAL_ID, event), &hd);
 }
 
+bool E_Global_ScriptRegisterBatched(enum eventtype event, script_opaque_t handler, 
+                                    script_opaque_t user_arg, int simmask)
+{
+    if(!e_counts(event))
+        return false;
+
+    struct handler_desc hd;
+    hd.type = HANDLER_TYPE_SCRIPT;
+    hd.handler.as_script_callable = handler;
+    hd.user_arg = user_arg;
+    hd.simmask = simmask;
+    hd.register_tick = SDL_GetTicks();
+
+    return e_register_handler(e_key(BATCH_ID, event), &hd);
+}
+
+bool E_Global_ScriptUnregisterBatched(enum eventtype event, script_opaque_t handler)
+{
+    struct handler_desc hd;
+    hd.type = HANDLER_TYPE_SCRIPT;
+    hd.handler.as_script_callable = handler;
+
+    return e_unregister_handler(e_key(BATCH_ID, event), &hd);
+}
+
 void E_Global_NotifyImmediate(enum eventtype event, void *event_arg, enum event_source source)
 {
     struct event e = (struct event){event, event_arg, source, GLOBAL_ID, SDL_GetTicks()};
@@ -667,7 +981,7 @@ void E_Entity_Notify(enum eventtype event, uint32_t ent_uid, void *event_arg,
                      enum event_source source)
 {
     struct event e = (struct event){event, event_arg, source, ent_uid, SDL_GetTicks()};
-    queue_event_push(&s_event_queues[s_front_queue_idx], &e);
+    e_push(&e);
 }
 
 void E_Entity_NotifyImmediate(enum eventtype event, uint32_t ent_uid, void *event_arg, 
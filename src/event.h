@@ -123,6 +123,7 @@ enum eventtype{
     EVENT_RALLY_POINT_SET,
     EVENT_UNIT_BECAME_IDLE,
     EVENT_UNIT_BECAME_ACTIVE,
+    EVENT_PERF_BUDGET_EXCEEDED,
 
     EVENT_ENGINE_LAST = 0x1ffff,
 };
@@ -137,6 +138,7 @@ typedef void (*handler_t)(void*, void*);
 struct script_handler{
     enum eventtype  event;
     uint32_t        id;
+    bool            batched;
     int             simmask;
     script_opaque_t handler;
     script_opaque_t arg;
@@ -160,6 +162,8 @@ bool        E_EventsQueued(void);
 /* EVENT GLOBAL                                                              */
 /*###########################################################################*/
 
+/* May be called from any thread. The events notified from outside the main 
+ * thread are delivered the next time the queue is serviced. */
 void E_Global_Notify(enum eventtype event, void *event_arg, enum event_source);
 void E_Global_NotifyImmediate(enum eventtype event, void *event_arg, enum event_source);
 
@@ -170,6 +174,12 @@ bool E_Global_Unregister(enum eventtype event, handler_t handler);
 bool E_Global_ScriptRegister(enum eventtype event, script_opaque_t handler, 
                              script_opaque_t user_arg, int simmask);
 bool E_Global_ScriptUnregister(enum eventtype event, script_opaque_t handler);
+/* Batched handlers are invoked once at the end of the tick with a list of 
+ * (uid, arg) tuples for all the entity events of the specified type. Only
+ * engine events may be subscribed to in this way. */
+bool E_Global_ScriptRegisterBatched(enum eventtype event, script_opaque_t handler, 
+                                    script_opaque_t user_arg, int simmask);
+bool E_Global_ScriptUnregisterBatched(enum eventtype event, script_opaque_t handler);
 
 
 /*###########################################################################*/
@@ -184,6 +194,7 @@ bool E_Entity_ScriptRegister(enum eventtype event, uint32_t ent_uid,
                              script_opaque_t handler, script_opaque_t user_arg, int simmask);
 bool E_Entity_ScriptUnregister(enum eventtype event, uint32_t ent_uid, 
                                script_opaque_t handler);
+/* May be called from any thread, same as 'E_Global_Notify' */
 void E_Entity_Notify(enum eventtype, uint32_t ent_uid, void *event_arg, enum event_source);
 void E_Entity_NotifyImmediate(enum eventtype event, uint32_t ent_uid, void *event_arg, 
                               enum event_source source);
@@ -41,6 +41,8 @@
 #include "position.h"
 #include "storage_site.h"
 #include "harvester.h"
+#include "think.h"
+#include "resource_id.h"
 #include "../event.h"
 #include "../entity.h"
 #include "../settings.h"
@@ -56,6 +58,9 @@
 #include <assert.h>
 
 #define TRANSIENT_STATE_TICKS        (2) 
+/* Every worker is re-evaluated at least once every this many ticks */
+#define THINK_PERIOD_TICKS           (2)
+#define THINK_BUDGET_US              (1000)
 #define TRANSPORT_UNIT_COST_DISTANCE (150)
 #define ARR_SIZE(a)                  (sizeof(a)/sizeof((a)[0]))
 
@@ -81,6 +86,10 @@ struct automation_state{
     int               transient_ticks;
     bool              automatic_transport;
     uint32_t          transport_target;
+    /* The tick on which this entity last thought */
+    uint32_t          last_tick;
+    /* Position in the idle list of its' faction, or -1 when not idle */
+    int               idle_idx;
 };
 
 struct cost_mapping{
@@ -102,6 +111,20 @@ static void on_order_issued(void *user, void *event);
 static khash_t(state) *s_entity_state_table;
 /* Maps storage sites to the number of automated transporters servicing it */
 static khash_t(count) *s_transport_count;
+static struct think_sched s_think;
+static uint32_t        s_tick;
+/* The 'job board': for every resource id, the storage sites which currently 
+ * desire it. Rebuilt lazily, only when the storage sites' demand epoch has 
+ * moved since the last rebuild, so that idle workers searching for a job on 
+ * the same tick share one scan of the sites.
+ */
+static vec_entity_t    s_board[MAX_RESOURCE_IDS];
+static uint32_t        s_board_epoch;
+static bool            s_board_valid;
+/* The idle workers of every faction, kept up to date on every transition 
+ * to or from the 'IDLE' state, so that the idle queries (polled by the UI 
+ * every frame) don't need to look at the active workers. */
+static vec_entity_t    s_idle[MAX_FACTIONS];
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -132,6 +155,42 @@ static void astate_remove(uint32_t uid)
         kh_del(state, s_entity_state_table, k);
 }
 
+static void idle_insert(uint32_t uid, struct automation_state *astate, int faction_id)
+{
+    assert(astate->idle_idx == -1);
+    if(!vec_entity_push(&s_idle[faction_id], uid))
+        return;
+    astate->idle_idx = vec_size(&s_idle[faction_id]) - 1;
+}
+
+static void idle_erase(uint32_t uid, struct automation_state *astate, int faction_id)
+{
+    if(astate->idle_idx == -1)
+        return;
+
+    vec_entity_t *list = &s_idle[faction_id];
+    assert(vec_AT(list, astate->idle_idx) == uid);
+
+    /* Move the last entry into the vacated slot */
+    uint32_t last = vec_entity_pop(list);
+    if(last != uid) {
+        struct automation_state *moved = astate_get(last);
+        assert(moved);
+        vec_AT(list, astate->idle_idx) = last;
+        moved->idle_idx = astate->idle_idx;
+    }
+    astate->idle_idx = -1;
+}
+
+static void set_state(uint32_t uid, struct automation_state *astate, enum worker_state state)
+{
+    if(astate->state == STATE_IDLE && state != STATE_IDLE)
+        idle_erase(uid, astate, G_GetFactionID(uid));
+    if(astate->state != STATE_IDLE && state == STATE_IDLE)
+        idle_insert(uid, astate, G_GetFactionID(uid));
+    astate->state = state;
+}
+
 static bool idle(uint32_t uid)
 {
     uint32_t flags = G_FlagsGet(uid);
@@ -148,17 +207,6 @@ static bool idle(uint32_t uid)
     return true;
 }
 
-static bool transporter_compatible_for_resource(uint32_t worker, uint32_t site, const char *rname)
-{
-    if(!G_StorageSite_Desires(site, rname))
-        return false;
-    if(G_Harvester_GetDoNotTransport(worker, rname))
-        return false;
-    if(G_Harvester_GetMaxCarry(worker, rname) == 0)
-        return false;
-    return true;
-}
-
 static int transport_job_cost(uint32_t worker, uint32_t site, int *out_num_assigned, float *out_dist)
 {
     /* The job 'cost' takes into account both the distance from
@@ -209,48 +257,69 @@ static int compare_jobs(const void *a, const void *b)
     return 0;
 }
 
-static uint32_t target_site_for_resource(uint32_t uid, const char *rname)
+static void refresh_job_board(void)
 {
-    uint32_t ret = NULL_UID;
+    uint32_t epoch = G_StorageSite_DemandEpoch();
+    if(s_board_valid && epoch == s_board_epoch)
+        return;
+
+    for(int i = 0; i < MAX_RESOURCE_IDS; i++) {
+        vec_entity_reset(&s_board[i]);
+    }
 
     vec_entity_t sites;
     vec_entity_init(&sites);
     G_StorageSite_GetAll(&sites);
 
-    const size_t nsites = vec_size(&sites);
-    STALLOC(struct cost_mapping, costs, nsites);
-
-    /* Prune sites which are not compatible */
-    for(int i = nsites - 1; i >= 0; i--) {
+    for(int i = 0; i < vec_size(&sites); i++) {
         uint32_t site = vec_AT(&sites, i);
-        if(!transporter_compatible_for_resource(uid, site, rname)) {
-            vec_entity_del(&sites, i);
+        rmask_t mask = G_StorageSite_DesiredMask(site);
+        while(mask) {
+            int id = rmask_pop(&mask);
+            vec_entity_push(&s_board[id], site);
         }
     }
 
-    size_t left = vec_size(&sites);
-    for(int i = 0; i < left; i++) {
+    vec_entity_destroy(&sites);
+    s_board_epoch = epoch;
+    s_board_valid = true;
+}
 
-        uint32_t site = vec_AT(&sites, i);
+static uint32_t target_site_for_resource(uint32_t uid, const char *rname)
+{
+    int id = G_ResourceId_Find(rname);
+    if(id < 0)
+        return NULL_UID;
+    if(G_Harvester_GetDoNotTransport(uid, rname))
+        return NULL_UID;
+    if(G_Harvester_GetMaxCarry(uid, rname) == 0)
+        return NULL_UID;
+
+    refresh_job_board();
+    vec_entity_t *sites = &s_board[id];
+
+    bool found = false;
+    struct cost_mapping best = {0};
+
+    for(int i = 0; i < vec_size(sites); i++) {
+
+        uint32_t site = vec_AT(sites, i);
         int num_assigned;
         float distance;
         int cost = transport_job_cost(uid, site, &num_assigned, &distance);
 
-        costs[i] = (struct cost_mapping){
+        struct cost_mapping curr = (struct cost_mapping){
             .site = site,
             .cost = cost,
             .num_assigned = num_assigned,
             .distance = distance,
         };
+        if(!found || compare_jobs(&curr, &best) < 0) {
+            best = curr;
+            found = true;
+        }
     }
-    qsort(costs, left, sizeof(struct cost_mapping), compare_jobs);
-    if(left > 0) {
-        ret = costs[0].site;
-    }
-
-    STFREE(costs);
-    vec_entity_destroy(&sites);
-    return ret;
+    return found ? best.site : NULL_UID;
 }
 
 static uint32_t target_site(uint32_t uid)
@@ -294,93 +363,99 @@ static int get_assigned_transporters(uint32_t site)
     return kh_val(s_transport_count, k);
 }
 
-static void recompute_idle(void)
+static void recompute_idle(uint32_t uid, struct automation_state *astate)
 {
-    uint32_t uid;
-    struct automation_state *astate;
-
-    kh_foreach_val_ptr(s_entity_state_table, uid, astate, {
-        
-        switch(astate->state) {
-        case STATE_IDLE: {
-            if(!idle(uid)) {
-                astate->state = STATE_WAKING;
-            }
-            break;
+    /* Entities don't think on every tick - count all the ticks since 
+     * the last time the entity thought towards the transient period */
+    int elapsed = s_tick - astate->last_tick;
+    astate->last_tick = s_tick;
+
+    switch(astate->state) {
+    case STATE_IDLE: {
+        if(!idle(uid)) {
+            set_state(uid, astate, STATE_WAKING);
         }
-        case STATE_WAKING: {
-            if(idle(uid)) {
-                astate->transient_ticks = 0;
-                astate->state = STATE_IDLE;
-                break;
-            }
-            astate->transient_ticks++;
-            if(astate->transient_ticks == TRANSIENT_STATE_TICKS) {
-                astate->transient_ticks = 0;
-                astate->state = STATE_ACTIVE;
-                E_Global_Notify(EVENT_UNIT_BECAME_ACTIVE, (void*)((uintptr_t)uid), ES_ENGINE);
-            }
+        break;
+    }
+    case STATE_WAKING: {
+        if(idle(uid)) {
+            astate->transient_ticks = 0;
+            set_state(uid, astate, STATE_IDLE);
             break;
         }
-        case STATE_ACTIVE: {
-            if(idle(uid)) {
-                astate->state = STATE_STOPPING;
-            }
-            break;
+        astate->transient_ticks += elapsed;
+        if(astate->transient_ticks >= TRANSIENT_STATE_TICKS) {
+            astate->transient_ticks = 0;
+            set_state(uid, astate, STATE_ACTIVE);
+            E_Global_Notify(EVENT_UNIT_BECAME_ACTIVE, (void*)((uintptr_t)uid), ES_ENGINE);
         }
-        case STATE_STOPPING: {
-            if(!idle(uid)) {
-                astate->transient_ticks = 0;
-                astate->state = STATE_ACTIVE;
-                break;
-            }
-            astate->transient_ticks++;
-            if(astate->transient_ticks == TRANSIENT_STATE_TICKS) {
-                astate->transient_ticks = 0;
-                astate->state = STATE_IDLE;
-                if(astate->transport_target != NULL_UID) {
-                    try_decrement_assigned_transporters(astate->transport_target);
-                    astate->transport_target = NULL_UID;
-                }
-                E_Global_Notify(EVENT_UNIT_BECAME_IDLE, (void*)((uintptr_t)uid), ES_ENGINE);
-            }
+        break;
+    }
+    case STATE_ACTIVE: {
+        if(idle(uid)) {
+            set_state(uid, astate, STATE_STOPPING);
+        }
+        break;
+    }
+    case STATE_STOPPING: {
+        if(!idle(uid)) {
+            astate->transient_ticks = 0;
+            set_state(uid, astate, STATE_ACTIVE);
             break;
         }
-        default: assert(0);
+        astate->transient_ticks += elapsed;
+        if(astate->transient_ticks >= TRANSIENT_STATE_TICKS) {
+            astate->transient_ticks = 0;
+            set_state(uid, astate, STATE_IDLE);
+            if(astate->transport_target != NULL_UID) {
+                try_decrement_assigned_transporters(astate->transport_target);
+                astate->transport_target = NULL_UID;
+            }
+            E_Global_Notify(EVENT_UNIT_BECAME_IDLE, (void*)((uintptr_t)uid), ES_ENGINE);
         }
-    });
+        break;
+    }
+    default: assert(0);
+    }
 }
 
-static void assign_transport_jobs(void)
+static void assign_transport_job(uint32_t uid, struct automation_state *astate)
 {
-    uint32_t uid;
-    struct automation_state *astate;
+    if(astate->state != STATE_IDLE)
+        return;
 
-    kh_foreach_val_ptr(s_entity_state_table, uid, astate, {
+    if(!(G_FlagsGet(uid) & ENTITY_FLAG_HARVESTER))
+        return;
+    
+    if(!astate->automatic_transport)
+        return;
 
-        if(astate->state != STATE_IDLE)
-            continue;
+    uint32_t site = target_site(uid);
+    if(site == NULL_UID)
+        return;
 
-        if(!(G_FlagsGet(uid) & ENTITY_FLAG_HARVESTER))
-            continue;
-        
-        if(!astate->automatic_transport)
-            continue;
+    increment_assigned_transporters(site);
+    astate->transport_target = site;
+    G_Harvester_Transport(uid, site);
+}
 
-        uint32_t site = target_site(uid);
-        if(site == NULL_UID)
-            continue;
+static void think(uint32_t uid, void *user)
+{
+    struct automation_state *astate = astate_get(uid);
+    assert(astate);
 
-        increment_assigned_transporters(site);
-        astate->transport_target = site;
-        G_Harvester_Transport(uid, site);
-    });
+    recompute_idle(uid, astate);
+    /* The event handlers may have added entities, moving the table */
+    astate = astate_get(uid);
+    if(!astate)
+        return;
+    assign_transport_job(uid, astate);
 }
 
 static void on_20hz_tick(void *user, void *event)
 {
-    recompute_idle();
-    assign_transport_jobs();
+    s_tick++;
+    G_Think_Run(&s_think);
 }
 
 static void on_update_ui(void *user, void *event)
@@ -461,6 +536,9 @@ static void on_order_issued(void *user, void *event)
     if(!astate)
         return;
 
+    /* The order will likely change the worker's state */
+    G_Think_Bump(&s_think, uid);
+
     if(!astate->automatic_transport)
         return;
 
@@ -485,8 +563,17 @@ bool G_Automation_AddEntity(uint32_t uid)
         .transient_ticks = 0,
         .automatic_transport = false,
         .transport_target = NULL_UID,
+        .last_tick = s_tick,
+        .idle_idx = -1,
     };
-    return astate_set(uid, state);
+    if(!astate_set(uid, state))
+        return false;
+    if(!G_Think_AddEntity(&s_think, uid)) {
+        astate_remove(uid);
+        return false;
+    }
+    idle_insert(uid, astate_get(uid), G_GetFactionID(uid));
+    return true;
 }
 
 void G_Automation_RemoveEntity(uint32_t uid)
@@ -494,7 +581,9 @@ void G_Automation_RemoveEntity(uint32_t uid)
     struct automation_state *astate = astate_get(uid);
     if(!astate)
         return;
+    idle_erase(uid, astate, G_GetFactionID(uid));
     E_Entity_Unregister(EVENT_ORDER_ISSUED, uid, on_order_issued);
+    G_Think_RemoveEntity(&s_think, uid);
     astate_remove(uid);
 }
 
@@ -504,12 +593,24 @@ bool G_Automation_Init(void)
         goto fail_entity_state_table;
     if((s_transport_count = kh_init(count)) == NULL)
         goto fail_transport_count_table;
+    if(!G_Think_Init(&s_think, think, NULL, THINK_PERIOD_TICKS, THINK_BUDGET_US))
+        goto fail_think;
 
+    for(int i = 0; i < MAX_RESOURCE_IDS; i++) {
+        vec_entity_init(&s_board[i]);
+    }
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        vec_entity_init(&s_idle[i]);
+    }
+    s_board_valid = false;
+    s_tick = 0;
     E_Global_Register(EVENT_20HZ_TICK, on_20hz_tick, NULL, G_RUNNING);
     E_Global_Register(EVENT_UPDATE_UI, on_update_ui, NULL, G_RUNNING);
     E_Global_Register(EVENT_ORDER_ISSUED, on_order_issued, NULL, G_RUNNING);
     return true;
 
+fail_think:
+    kh_destroy(count, s_transport_count);
 fail_transport_count_table:
     kh_destroy(state, s_entity_state_table);
 fail_entity_state_table:
@@ -521,22 +622,37 @@ void G_Automation_Shutdown(void)
     E_Global_Unregister(EVENT_ORDER_ISSUED, on_order_issued);
     E_Global_Unregister(EVENT_UPDATE_UI, on_update_ui);
     E_Global_Unregister(EVENT_20HZ_TICK, on_20hz_tick);
+    for(int i = 0; i < MAX_RESOURCE_IDS; i++) {
+        vec_entity_destroy(&s_board[i]);
+    }
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        vec_entity_destroy(&s_idle[i]);
+    }
+    G_Think_Destroy(&s_think);
     kh_destroy(count, s_transport_count);
     kh_destroy(state, s_entity_state_table);
 }
 
 void G_Automation_GetIdle(vec_entity_t *out)
 {
-    size_t ret = 0;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        G_Automation_GetIdleForFaction(i, out);
+    }
+}
 
-    uint32_t uid;
-    struct automation_state *astate;
+void G_Automation_GetIdleForFaction(int faction_id, vec_entity_t *out)
+{
+    assert(faction_id >= 0 && faction_id < MAX_FACTIONS);
+    vec_entity_concat(out, &s_idle[faction_id]);
+}
 
-    kh_foreach_val_ptr(s_entity_state_table, uid, astate, {
-        if(astate->state != STATE_IDLE)
-            continue;
-        vec_entity_push(out, uid);
-    });
+void G_Automation_UpdateFactionID(uint32_t uid, int oldfac, int newfac)
+{
+    struct automation_state *astate = astate_get(uid);
+    if(!astate || astate->idle_idx == -1)
+        return;
+    idle_erase(uid, astate, oldfac);
+    idle_insert(uid, astate, newfac);
 }
 
 bool G_Automation_IsIdle(uint32_t uid)
@@ -675,7 +791,8 @@ bool G_Automation_LoadState(struct SDL_RWops *stream)
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
-        astate->state = attr.val.as_int;
+        CHK_TRUE_RET(attr.val.as_int >= STATE_IDLE && attr.val.as_int <= STATE_STOPPING);
+        set_state(uid, astate, attr.val.as_int);
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
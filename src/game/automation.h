@@ -46,6 +46,7 @@ void G_Automation_Shutdown(void);
 
 bool G_Automation_AddEntity(uint32_t uid);
 void G_Automation_RemoveEntity(uint32_t uid);
+void G_Automation_UpdateFactionID(uint32_t uid, int oldfac, int newfac);
 
 bool G_Automation_SaveState(struct SDL_RWops *stream);
 bool G_Automation_LoadState(struct SDL_RWops *stream);
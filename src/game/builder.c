@@ -38,6 +38,7 @@
 #include "harvester.h"
 #include "storage_site.h"
 #include "game_private.h"
+#include "entity_index.h"
 #include "movement.h"
 #include "position.h"
 #include "public/game.h"
@@ -362,6 +363,7 @@ void G_Builder_AddEntity(uint32_t uid)
         .build_speed = 0.0,
         .target_uid = UID_NONE,
     });
+    G_EntIndex_AddComponent(uid, ENT_COMP_BUILDER);
 }
 
 void G_Builder_RemoveEntity(uint32_t uid)
@@ -373,6 +375,7 @@ void G_Builder_RemoveEntity(uint32_t uid)
     E_Entity_Unregister(EVENT_MOTION_START, uid, on_motion_begin);
     E_Entity_Unregister(EVENT_ANIM_CYCLE_FINISHED, uid, on_build_anim_finished);
     builderstate_remove(uid);
+    G_EntIndex_RemoveComponent(uid, ENT_COMP_BUILDER);
 }
 
 void G_Builder_SetBuildSpeed(uint32_t uid, int speed)
@@ -35,7 +35,9 @@
 
 #include "building.h"
 #include "game_private.h"
+#include "entity_index.h"
 #include "storage_site.h"
+#include "resource_id.h"
 #include "fog_of_war.h"
 #include "public/game.h"
 #include "../event.h"
@@ -48,30 +50,14 @@
 #include "../lib/public/khash.h"
 #include "../lib/public/vec.h"
 #include "../lib/public/attr.h"
-#include "../lib/public/mpool_allocator.h"
-#include "../lib/public/string_intern.h"
 #include "../lib/public/pf_string.h"
 #include "../lib/public/stalloc.h"
+#include "../lib/public/slab.h"
+#include "../lib/public/slab_khash.h"
 
 #include <assert.h>
 #include <stdint.h>
 
-
-static void *pmalloc(size_t size);
-static void *pcalloc(size_t n, size_t size);
-static void *prealloc(void *ptr, size_t size);
-static void  pfree(void *ptr);
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  pmalloc
-#define kcalloc  pcalloc
-#define krealloc prealloc
-#define kfree    pfree
-
 #define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
 #define MARKER_DIR          "assets/models/build_site_marker"
 #define MARKER_OBJ          "build-site-marker.pfobj"
@@ -86,8 +72,6 @@ static void  pfree(void *ptr);
             return false;               \
     }while(0)
 
-KHASH_MAP_INIT_STR(int, int)
-
 VEC_TYPE(uid, uint32_t)
 VEC_IMPL(static inline, uid, uint32_t)
 
@@ -108,25 +92,10 @@ struct buildstate{
     bool       is_storage_site;
     vec2_t     rally_point;
     struct obb obb;
-    kh_int_t  *required;
+    /* Kept out of line, since the state table gets copied every tick */
+    struct rtable_int *required;
 };
 
-typedef char buff_t[512];
-
-MPOOL_ALLOCATOR_TYPE(buff, buff_t)
-MPOOL_ALLOCATOR_PROTOTYPES(static, buff, buff_t)
-MPOOL_ALLOCATOR_IMPL(static, buff, buff_t)
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  malloc
-#define kcalloc  calloc
-#define krealloc realloc
-#define kfree    free
-
 KHASH_MAP_INIT_INT(state, struct buildstate)
 KHASH_SET_INIT_INT64(td)
 
@@ -137,9 +106,6 @@ KHASH_SET_INIT_INT64(td)
 static const struct map     *s_map;
 static khash_t(state)       *s_entity_state_table;
 
-static mpa_buff_t            s_mpool;
-static khash_t(stridx)      *s_stridx;
-static mp_strbuff_t          s_stringpool;
 static struct memstack       s_eventargs;
 static bool                  s_set_rally_on_lclick = false;
 
@@ -147,36 +113,6 @@ static bool                  s_set_rally_on_lclick = false;
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static void *pmalloc(size_t size)
-{
-    if(size > sizeof(buff_t))
-        return NULL;
-    return mpa_buff_alloc(&s_mpool);
-}
-
-static void *pcalloc(size_t n, size_t size)
-{
-    void *ret = pmalloc(n * size);
-    if(!ret)
-        return NULL;
-    memset(ret, 0, n * size);
-    return ret;
-}
-
-static void *prealloc(void *ptr, size_t size)
-{
-    if(!ptr)
-        return pmalloc(size);
-    if(size <= sizeof(buff_t))
-        return ptr;
-    return NULL;
-}
-
-static void pfree(void *ptr)
-{
-    mpa_buff_free(&s_mpool, ptr);
-}
-
 static struct buildstate *buildstate_get(uint32_t uid)
 {
     khiter_t k = kh_get(state, s_entity_state_table, uid);
@@ -204,7 +140,7 @@ static void buildstate_remove(uint32_t uid)
     if(k != kh_end(s_entity_state_table)) {
 
         struct buildstate *bs = &kh_value(s_entity_state_table, k);
-        kh_destroy(int, bs->required);
+        slab_free(bs->required);
         vec_uid_destroy(&bs->markers);
         kh_del(state, s_entity_state_table, k);
     }
@@ -368,38 +304,22 @@ static void building_clear_markers(struct buildstate *bs)
     }
 }
 
-static bool bstate_set_key(khash_t(int) *table, const char *name, int val)
+static bool bstate_set_key(struct rtable_int *table, const char *name, int val)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(int, table, key);
-    if(k != kh_end(table)) {
-        kh_value(table, k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(int, table, key, &status);
-    if(status == -1)
+    int id = G_ResourceId_Get(name);
+    if(id < 0)
         return false;
 
-    assert(status == 1);
-    kh_value(table, k) = val;
+    rtable_put(table, id, val);
     return true;
 }
 
-static bool bstate_get_key(khash_t(int) *table, const char *name, int *out)
+static bool bstate_get_key(const struct rtable_int *table, const char *name, int *out)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_ResourceId_Find(name);
+    if(!rtable_has(table, id))
         return false;
-
-    khiter_t k = kh_get(int, table, key);
-    if(k == kh_end(table))
-        return false;
-    *out = kh_value(table, k);
+    *out = table->vals[id];
     return true;
 }
 
@@ -481,18 +401,12 @@ static void on_mousedown(void *user, void *event)
 
 bool G_Building_Init(const struct map *map)
 {
-    mpa_buff_init(&s_mpool, 1024, 0);
-
-    if(!mpa_buff_reserve(&s_mpool, 1024))
-        goto fail_mpool; 
     if(NULL == (s_entity_state_table = kh_init(state)))
         goto fail_table;
     if(0 != kh_resize(state, s_entity_state_table, 2048))
         goto fail_res;
-    if(!si_init(&s_stringpool, &s_stridx, 512))
-        goto fail_res;
     if(!stalloc_init(&s_eventargs))
-        goto fail_eventargs;
+        goto fail_res;
 
     E_Global_Register(EVENT_RENDER_3D_PRE, on_render_3d, NULL, 
         G_RUNNING | G_PAUSED_FULL | G_PAUSED_UI_RUNNING);
@@ -501,13 +415,9 @@ bool G_Building_Init(const struct map *map)
     s_map = map;
     return true;
 
-fail_eventargs:
-    si_shutdown(&s_stringpool, s_stridx);
 fail_res:
     kh_destroy(state, s_entity_state_table);
 fail_table:
-    mpa_buff_destroy(&s_mpool);
-fail_mpool:
     return false;
 }
 
@@ -524,12 +434,11 @@ void G_Building_Shutdown(void)
 
     kh_foreach(s_entity_state_table, key, curr, {
         vec_uid_destroy(&curr.markers);
+        slab_free(curr.required);
     });
 
     stalloc_destroy(&s_eventargs);
-    si_shutdown(&s_stringpool, s_stridx);
     kh_destroy(state, s_entity_state_table);
-    mpa_buff_destroy(&s_mpool);
 }
 
 bool G_Building_AddEntity(uint32_t uid)
@@ -549,11 +458,11 @@ bool G_Building_AddEntity(uint32_t uid)
         .rally_point = G_Pos_GetXZ(uid)
     };
 
-    new_bs.required = kh_init(int);
+    new_bs.required = slab_calloc(1, sizeof(struct rtable_int));
     if(!new_bs.required)
         return false;
 
-    vec_uid_init(&new_bs.markers);
+    vec_uid_init_alloc(&new_bs.markers, slab_realloc, slab_free);
     buildstate_set(uid, new_bs);
 
     uint32_t newflags = G_FlagsGet(uid);
@@ -567,7 +476,7 @@ bool G_Building_AddEntity(uint32_t uid)
     G_FlagsSet(uid, newflags);
     G_StorageSite_SetUseAlt(uid, true);
 
-    return true;
+    return G_EntIndex_AddComponent(uid, ENT_COMP_BUILDING);
 }
 
 void G_Building_RemoveEntity(uint32_t uid)
@@ -597,6 +506,7 @@ void G_Building_RemoveEntity(uint32_t uid)
     E_Entity_Unregister(EVENT_STORAGE_SITE_AMOUNT_CHANGED, uid, on_amount_changed);
     building_clear_markers(bs);
     buildstate_remove(uid);
+    G_EntIndex_RemoveComponent(uid, ENT_COMP_BUILDING);
 }
 
 void *G_Building_CopyState(void)
@@ -604,6 +514,12 @@ void *G_Building_CopyState(void)
     return kh_copy_state(s_entity_state_table);
 }
 
+void G_Building_FreeState(void *state)
+{
+    khash_t(state) *table = (khash_t(state)*)state;
+    kh_destroy(state, table);
+}
+
 bool G_Building_IsFoundedFrom(void *state, uint32_t uid)
 {
     khash_t(state) *table = (khash_t(state)*)state;
@@ -686,11 +602,10 @@ bool G_Building_Found(uint32_t uid, bool blocking)
         bs->obb = obb;
     }
 
-    const char *key;
-    int amount;
-    kh_foreach(bs->required, key, amount, {
-        G_StorageSite_SetAltCapacity(uid, key, amount);
-        G_StorageSite_SetAltDesired(uid, key, amount);
+    int id, amount;
+    rtable_foreach(bs->required, id, amount, {
+        G_StorageSite_SetAltCapacity(uid, G_ResourceId_Name(id), amount);
+        G_StorageSite_SetAltDesired(uid, G_ResourceId_Name(id), amount);
     });
 
     E_Entity_Register(EVENT_STORAGE_SITE_AMOUNT_CHANGED, uid, on_amount_changed, 
@@ -918,13 +833,12 @@ size_t G_Building_GetAllRequired(uint32_t uid, size_t maxout,
     assert(bs);
 
     size_t ret = 0;
-    const char *key;
-    int amount;
-    kh_foreach(bs->required, key, amount, {
+    int id, amount;
+    rtable_foreach(bs->required, id, amount, {
 
         if(ret == maxout)
             return ret;
-        names[ret] = key;
+        names[ret] = G_ResourceId_Name(id);
         amounts[ret] = amount;
         ret++;
     });
@@ -1048,16 +962,17 @@ bool G_Building_SaveState(struct SDL_RWops *stream)
 
         struct attr num_required = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.required)
+            .val.as_int = rtable_size(curr.required)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_required, "num_required"));
 
-        const char *required_key;
+        int required_id;
         int required_amount;
-        kh_foreach(curr.required, required_key, required_amount, {
+        rtable_foreach(curr.required, required_id, required_amount, {
         
             struct attr required_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(required_key_attr.val.as_string, required_key, sizeof(required_key_attr.val.as_string));
+            pf_strlcpy(required_key_attr.val.as_string, G_ResourceId_Name(required_id), 
+                sizeof(required_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &required_key_attr, "required_key"));
 
             struct attr required_amount_attr = (struct attr){
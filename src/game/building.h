@@ -53,6 +53,8 @@ void G_Building_UpdateFactionID(uint32_t uid, int oldfac, int newfac);
 bool G_Building_NeedsRepair(uint32_t uid);
 
 void *G_Building_CopyState(void);
+/* The copy is slab-allocated, so it must be freed through this */
+void  G_Building_FreeState(void *state);
 bool  G_Building_IsFoundedFrom(void *state, uint32_t uid);
 bool  G_Building_IsCompletedFrom(void *state, uint32_t uid);
 
@@ -57,14 +57,17 @@
 #include "../map/public/map.h"
 #include "../lib/public/pf_string.h"
 #include "../lib/public/mem.h"
+#include "../lib/public/stalloc.h"
 
 #include <assert.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdlib.h>
 
 
 #define EPSILON         (1.0/1024)
 #define MAX_SAVED_VOS   (512)
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
 
 VEC_TYPE(vec2, vec2_t)
 VEC_IMPL(static inline, vec2, vec2_t)
@@ -87,6 +90,14 @@ struct HRVO{
     vec2_t xz_right_side;
 };
 
+/* A potential new velocity on the boundary of the combined VO, in worldspace 
+ * coordinates, along with its' distance from the desired velocity. 
+ */
+struct candidate{
+    vec2_t point;
+    float  dist;
+};
+
 struct saved_ctx{
     struct cp_ent cpent;
     vec2_t        ent_des_v;
@@ -203,13 +214,12 @@ static struct HRVO compute_hrvo(struct cp_ent ent, struct cp_ent neighb)
     return ret;
 }
 
-static size_t compute_all_vos(struct cp_ent ent, vec_cp_ent_t stat_neighbs, 
-                              struct VO *out)
+static size_t compute_all_vos(struct cp_ent ent, const struct cp_ent *stat_neighbs, 
+                              size_t nstat, struct VO *out)
 {
     size_t ret = 0; 
 
-    for(struct cp_ent *nb = stat_neighbs.array; 
-        nb < stat_neighbs.array + vec_size(&stat_neighbs); nb++) {
+    for(const struct cp_ent *nb = stat_neighbs; nb < stat_neighbs + nstat; nb++) {
 
         if(same_position(ent.xz_pos, nb->xz_pos))
             continue;
@@ -219,14 +229,13 @@ static size_t compute_all_vos(struct cp_ent ent, vec_cp_ent_t stat_neighbs,
     return ret;
 }
 
-static size_t compute_all_hrvos(struct cp_ent ent, vec_cp_ent_t dyn_neighbs, 
-                                struct HRVO *out)
+static size_t compute_all_hrvos(struct cp_ent ent, const struct cp_ent *dyn_neighbs, 
+                                size_t ndyn, struct HRVO *out)
 {
     size_t ret = 0; 
 
-    for(int i = 0; i < vec_size(&dyn_neighbs); i++) {
+    for(const struct cp_ent *nb = dyn_neighbs; nb < dyn_neighbs + ndyn; nb++) {
 
-        struct cp_ent *nb = &vec_AT(&dyn_neighbs, i);
         if(same_position(ent.xz_pos, nb->xz_pos))
             continue;
         out[ret++] = compute_hrvo(ent, *nb);
@@ -304,7 +313,8 @@ static void rays_repr(const struct HRVO *hrvos, size_t n_hrvos,
     }
 }
 
-static size_t compute_vo_xpoints(struct line_2d *rays, size_t n_rays, vec_vec2_t *inout)
+static size_t compute_vo_xpoints(const struct line_2d *rays, size_t n_rays, 
+                                 vec2_t des_v_ws, struct candidate *out)
 {
     size_t ret = 0;
     for(int i = 0; i < n_rays; i++) {
@@ -313,15 +323,12 @@ static size_t compute_vo_xpoints(struct line_2d *rays, size_t n_rays, vec_vec2_t
             if(i == j) 
                 continue;
 
-            vec2_t isec_point;
+            vec2_t isec_point, delta;
             if(!C_RayRayIntersection2D(rays[i], rays[j], &isec_point))
                 continue;
 
-            if(inside_pcr(rays, n_rays, isec_point))
-                continue;
-
-            vec_vec2_push(inout, isec_point);
-            ret++;
+            PFM_Vec2_Sub(&isec_point, &des_v_ws, &delta);
+            out[ret++] = (struct candidate){isec_point, PFM_Vec2_Len(&delta)};
         }
     }
 
@@ -329,9 +336,10 @@ static size_t compute_vo_xpoints(struct line_2d *rays, size_t n_rays, vec_vec2_t
 }
 
 static size_t compute_vdes_proj_points(struct line_2d *rays, size_t n_rays,
-                                       vec2_t des_v, vec_vec2_t *inout)
+                                       vec2_t des_v, vec2_t des_v_ws, 
+                                       struct candidate *out)
 {
-    vec2_t proj;
+    vec2_t proj, delta;
     size_t ret = 0;
 
     for(int i = 0; i < n_rays; i++) {
@@ -342,57 +350,79 @@ static size_t compute_vdes_proj_points(struct line_2d *rays, size_t n_rays,
         PFM_Vec2_Scale(&rays[i].dir, len, &proj);
         PFM_Vec2_Add(&rays[i].point, &proj, &proj);
 
-        if(!inside_pcr(rays, n_rays, proj)) {
-        
-            vec_vec2_push(inout, proj);
-            ret++;
-        }
+        PFM_Vec2_Sub(&proj, &des_v_ws, &delta);
+        out[ret++] = (struct candidate){proj, PFM_Vec2_Len(&delta)};
     }
 
     return ret;
 }
 
-static vec2_t compute_vnew(const vec_vec2_t *outside_points, vec2_t des_v, vec2_t ent_xz_pos)
+static int compare_candidates(const void *a, const void *b)
 {
-    float min_dist = INFINITY, len;
-    vec2_t ret = (vec2_t){0.0f, 0.0f};
+    float da = ((const struct candidate*)a)->dist;
+    float db = ((const struct candidate*)b)->dist;
+    return (da > db) - (da < db);
+}
+
+/* The new velocity is the candidate point closest to the desired velocity 
+ * which is outside of the combined VO. Testing a point against the combined 
+ * VO is linear in the number of rays, so we order the candidates by distance 
+ * and only test them until the first admissible one is found. 
+ */
+static bool compute_vnew(const struct line_2d *rays, size_t n_rays, 
+                         struct candidate *cands, size_t ncands,
+                         vec2_t ent_xz_pos, vec2_t *out)
+{
+    qsort(cands, ncands, sizeof(struct candidate), compare_candidates);
+
+    for(int i = 0; i < ncands; i++) {
 
-    for(int i = 0; i < vec_size(outside_points); i++) {
+        if(inside_pcr(rays, n_rays, cands[i].point))
+            continue;
 
         /* The points are in worldspace coordinates. Convert them to the entity's 
          * local space to get the admissible velocities. */
-        vec2_t curr = vec_AT(outside_points, i), diff;
-        PFM_Vec2_Sub(&curr, &ent_xz_pos, &curr);
-
-        PFM_Vec2_Sub(&des_v, &curr, &diff);
-        if((len = PFM_Vec2_Len(&diff)) < min_dist) {
+        PFM_Vec2_Sub(&cands[i].point, &ent_xz_pos, out);
+        return true;
+    }
+    return false;
+}
 
-            min_dist = len;
-            ret = curr;
-        }
+static void save_debug_xpoints(const struct line_2d *rays, size_t n_rays, 
+                               const struct candidate *cands, size_t ncands)
+{
+    vec_vec2_reset(&s_debug_saved.xpoints);
+    for(int i = 0; i < ncands; i++) {
+        if(inside_pcr(rays, n_rays, cands[i].point))
+            continue;
+        vec_vec2_push(&s_debug_saved.xpoints, cands[i].point);
     }
-    return ret;
 }
 
-static void remove_furthest(vec2_t xz_pos, vec_cp_ent_t *dyn_inout, vec_cp_ent_t *stat_inout)
+static void remove_furthest(vec2_t xz_pos, struct cp_ent *dyn, size_t *inout_ndyn,
+                            struct cp_ent *stat, size_t *inout_nstat)
 {
     float max_dist = -INFINITY;
-    vec_cp_ent_t *del_vec = NULL;
+    struct cp_ent *del_arr = NULL;
+    size_t *del_size = NULL;
     int del_idx = -1;
 
     for(int i = 0; i < 2; i++) {
     
-        vec_cp_ent_t *curr_vec = (i == 0) ? dyn_inout : stat_inout;
-        for(int j = 0; j < vec_size(curr_vec); j++) {
+        struct cp_ent *curr_arr = (i == 0) ? dyn : stat;
+        size_t *curr_size = (i == 0) ? inout_ndyn : inout_nstat;
+
+        for(int j = 0; j < *curr_size; j++) {
         
             float len;
             vec2_t diff;
-            struct cp_ent *ent = &vec_AT(curr_vec, j);
+            struct cp_ent *ent = &curr_arr[j];
 
             PFM_Vec2_Sub(&xz_pos, &ent->xz_pos, &diff);
             if((len = PFM_Vec2_Len(&diff)) > max_dist) {
                 max_dist = len; 
-                del_vec = curr_vec;
+                del_arr = curr_arr;
+                del_size = curr_size;
                 del_idx = j;
             }
         }
@@ -400,7 +430,9 @@ static void remove_furthest(vec2_t xz_pos, vec_cp_ent_t *dyn_inout, vec_cp_ent_t
 
     if(max_dist > -INFINITY) {
         assert(del_idx != -1);
-        vec_cp_ent_del(del_vec, del_idx);
+        memmove(del_arr + del_idx, del_arr + del_idx + 1, 
+            (*del_size - del_idx - 1) * sizeof(struct cp_ent));
+        (*del_size)--;
     }
 }
 
@@ -536,36 +568,40 @@ static void on_render_3d(void *user, void *event)
     STFREE(right_rays);
 }
 
-static bool clearpath_new_velocity(struct cp_ent cpent,
-                                   uint32_t ent_uid,
-                                   vec2_t ent_des_v,
-                                   const vec_cp_ent_t dyn_neighbs,
-                                   const vec_cp_ent_t stat_neighbs,
-                                   bool save_debug,
+static bool clearpath_new_velocity(struct memstack *scratch,
+                                   const struct cp_agent *agent,
+                                   const struct cp_ent *dyn_neighbs, size_t ndyn,
+                                   const struct cp_ent *stat_neighbs, size_t nstat,
                                    vec2_t *out)
 {
-    bool status = false;
-    STALLOC(struct HRVO, dyn_hrvos, vec_size(&dyn_neighbs));
-    STALLOC(struct VO, stat_vos, vec_size(&stat_neighbs));
+    struct cp_ent cpent = agent->ent;
+    vec2_t ent_des_v = agent->des_v;
+
+    struct HRVO *dyn_hrvos = stalloc(scratch, MAX(ndyn, 1) * sizeof(struct HRVO));
+    struct VO *stat_vos = stalloc(scratch, MAX(nstat, 1) * sizeof(struct VO));
+    if(!dyn_hrvos || !stat_vos)
+        return false;
 
-    size_t n_hrvos = compute_all_hrvos(cpent, dyn_neighbs, dyn_hrvos);
-    size_t n_vos = compute_all_vos(cpent, stat_neighbs, (struct VO*)stat_vos);
+    size_t n_hrvos = compute_all_hrvos(cpent, dyn_neighbs, ndyn, dyn_hrvos);
+    size_t n_vos = compute_all_vos(cpent, stat_neighbs, nstat, stat_vos);
 
     /* We may have skipped the neighbours that are at the exact same 
      * or nearly same position as the entity.
      */
-    assert(n_hrvos <= vec_size(&dyn_neighbs));
-    assert(n_vos <= vec_size(&stat_neighbs));
+    assert(n_hrvos <= ndyn);
+    assert(n_vos <= nstat);
 
     /* Following the ClearPath approach, which is applicable to many variations 
      * of velocity obstacles, we represent the combined hybrid reciprocal velocity 
      * obstacle as a union of line segments. 
      */
     const size_t n_rays = (n_hrvos + n_vos) * 2;
-    STALLOC(struct line_2d, rays, n_rays);
+    struct line_2d *rays = stalloc(scratch, MAX(n_rays, 1) * sizeof(struct line_2d));
+    if(!rays)
+        return false;
     rays_repr(dyn_hrvos, n_hrvos, stat_vos, n_vos, rays);
 
-    if(save_debug) {
+    if(agent->save_debug) {
 
         size_t nsaved_hrvos = n_hrvos <= MAX_SAVED_VOS ? n_hrvos : MAX_SAVED_VOS;
         memcpy(s_debug_saved.hrvos, dyn_hrvos, nsaved_hrvos * sizeof(struct HRVO));
@@ -587,51 +623,73 @@ static bool clearpath_new_velocity(struct cp_ent cpent,
     PFM_Vec2_Add(&cpent.xz_pos, &ent_des_v, &des_v_ws);
     if(!inside_pcr(rays, n_rays, des_v_ws)) {
 
-        s_debug_saved.des_v_in_pcr = false;
+        if(agent->save_debug) {
+            s_debug_saved.des_v_in_pcr = false;
+        }
         *out = ent_des_v;
-        status = true;
-        goto out;
+        return true;
     }
 
-    vec_vec2_t xpoints;
-    vec_vec2_init(&xpoints);
+    const size_t max_cands = n_rays * n_rays;
+    struct candidate *cands = stalloc(scratch, MAX(max_cands, 1) * sizeof(struct candidate));
+    if(!cands)
+        return false;
 
     /* The line segments are intersected pairwise and the intersection points 
      * inside the combined hybrid reciprocal velocity obstacle are discarded. 
      * The remaining intersection points are permissible new velocities on the 
      * boundary of the combined hybrid reciprocal velocity obstacle.
      */
-    compute_vo_xpoints(rays, n_rays, &xpoints); 
+    size_t ncands = compute_vo_xpoints(rays, n_rays, des_v_ws, cands); 
 
     /* In addition we project the preferred velocity (des_v) on to the line 
      * segments (xz_left_side and xz_right_side of each hrvo) and also retain 
      * those points that are outside the combined hybrid reciprocal velocity 
      * obstacle.
      */
-    compute_vdes_proj_points(rays, n_rays, ent_des_v, &xpoints);
-
-    if(vec_size(&xpoints) == 0) {
-        goto out;    
-    }
+    ncands += compute_vdes_proj_points(rays, n_rays, ent_des_v, des_v_ws, cands + ncands);
+    assert(ncands <= max_cands);
 
-    vec2_t ret = compute_vnew(&xpoints, ent_des_v, cpent.xz_pos);
+    vec2_t ret;
+    if(!compute_vnew(rays, n_rays, cands, ncands, cpent.xz_pos, &ret))
+        return false;
 
-    if(save_debug) {
+    if(agent->save_debug) {
     
-        vec_vec2_copy(&s_debug_saved.xpoints, &xpoints);
+        save_debug_xpoints(rays, n_rays, cands, ncands);
         s_debug_saved.v_new = ret;
         s_debug_saved.des_v_in_pcr = true;
     }
 
-    vec_vec2_destroy(&xpoints);
     *out = ret;
-    status = true;
+    return true;
+}
+
+static vec2_t agent_new_velocity(struct memstack *scratch, const struct cp_agent *agent)
+{
+    /* Take a private copy of the neighbours, since we may need to discard 
+     * some of them if there is no admissible velocity. 
+     */
+    size_t ndyn = agent->ndyn, nstat = agent->nstat;
+    struct cp_ent *dyn = stalloc(scratch, MAX(ndyn, 1) * sizeof(struct cp_ent));
+    struct cp_ent *stat = stalloc(scratch, MAX(nstat, 1) * sizeof(struct cp_ent));
+    if(!dyn || !stat)
+        return (vec2_t){0.0f, 0.0f};
+
+    memcpy(dyn, agent->dyn_neighbs, ndyn * sizeof(struct cp_ent));
+    memcpy(stat, agent->stat_neighbs, nstat * sizeof(struct cp_ent));
 
-out:
-    STFREE(dyn_hrvos);
-    STFREE(stat_vos);
-    STFREE(rays);
-    return status;
+    do{
+        vec2_t ret;
+        bool found = clearpath_new_velocity(scratch, agent, dyn, ndyn, stat, nstat, &ret);
+        if(found)
+            return ret;
+
+        remove_furthest(agent->ent.xz_pos, dyn, &ndyn, stat, &nstat);
+
+    }while(ndyn > 0 && nstat > 0);
+
+    return (vec2_t){0.0f, 0.0f};
 }
 
 static bool entities_equal(uint32_t *a, uint32_t *b)
@@ -676,26 +734,15 @@ void G_ClearPath_Shutdown(void)
     vec_vec2_destroy(&s_debug_saved.xpoints);
 }
 
-vec2_t G_ClearPath_NewVelocity(struct cp_ent cpent,
-                               uint32_t ent_uid,
-                               vec2_t ent_des_v,
-                               vec_cp_ent_t dyn_neighbs,
-                               vec_cp_ent_t stat_neighbs,
-                               bool save_debug)
+void G_ClearPath_NewVelocities(struct memstack *scratch, size_t nagents,
+                               const struct cp_agent *agents, vec2_t *out)
 {
     PERF_ENTER();
 
-    do{
-        vec2_t ret;
-        bool found = clearpath_new_velocity(cpent, ent_uid, ent_des_v, 
-            dyn_neighbs, stat_neighbs, save_debug, &ret);
-        if(found)
-            PERF_RETURN(ret);
-
-        remove_furthest(cpent.xz_pos, &dyn_neighbs, &stat_neighbs);
-
-    }while(vec_size(&dyn_neighbs) > 0 && vec_size(&stat_neighbs) > 0);
+    for(int i = 0; i < nagents; i++) {
+        out[i] = agent_new_velocity(scratch, &agents[i]);
+    }
 
-    PERF_RETURN((vec2_t){0.0f, 0.0f});
+    PERF_RETURN_VOID();
 }
 
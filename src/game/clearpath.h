@@ -49,6 +49,7 @@
 #define CLEARPATH_BUFFER_RADIUS    (0.0f)
 
 struct map;
+struct memstack;
 
 struct cp_ent{
     vec2_t xz_pos;
@@ -56,6 +57,20 @@ struct cp_ent{
     float  radius;
 };
 
+/* A single entity of a batched ClearPath query. The neighbour arrays 
+ * are only read by the solver and may be shared between agents. 
+ */
+struct cp_agent{
+    struct cp_ent        ent;
+    uint32_t             uid;
+    vec2_t               des_v;
+    const struct cp_ent *dyn_neighbs;
+    size_t               ndyn;
+    const struct cp_ent *stat_neighbs;
+    size_t               nstat;
+    bool                 save_debug;
+};
+
 VEC_TYPE(cp_ent, struct cp_ent)
 VEC_IMPL(static inline, cp_ent, struct cp_ent)
 
@@ -63,12 +78,12 @@ void G_ClearPath_Init(const struct map *map);
 void G_ClearPath_Shutdown(void);
 bool G_ClearPath_ShouldSaveDebug(uint32_t ent_uid);
 
-vec2_t G_ClearPath_NewVelocity(struct cp_ent ent,
-                               uint32_t ent_uid,
-                               vec2_t ent_des_v,
-                               vec_cp_ent_t dyn_neighbs,
-                               vec_cp_ent_t stat_neighbs,
-                               bool save_debug);
+/* Compute the collision-free velocities for a batch of agents. All working 
+ * memory is taken from 'scratch', which must not be shared with other threads 
+ * for the duration of the call. The caller is responsible for clearing it.
+ */
+void G_ClearPath_NewVelocities(struct memstack *scratch, size_t nagents,
+                               const struct cp_agent *agents, vec2_t *out);
 
 #endif
 
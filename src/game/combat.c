@@ -35,11 +35,13 @@
 
 #include "combat.h"
 #include "game_private.h"
+#include "entity_index.h"
 #include "movement.h"
 #include "building.h"
 #include "fog_of_war.h"
 #include "position.h"
 #include "garrison.h"
+#include "think.h"
 #include "public/game.h"
 #include "../ui.h"
 #include "../event.h"
@@ -74,6 +76,10 @@
 #define ARR_SIZE(a)                 (sizeof(a)/sizeof(a[0]))
 #define X_BINS_PER_CHUNK            (8)
 #define Z_BINS_PER_CHUNK            (8)
+#define NUM_BIN_LEVELS              (4)
+#define MAX_SHARED_CANDIDATES       (512)
+/* Entities that are not in combat look for targets at least once every this many ticks */
+#define IDLE_THINK_PERIOD_TICKS     (2)
 #define MAX_COMBAT_TASKS            (64)
 
 #define CHK_TRUE_RET(_pred)         \
@@ -152,6 +158,24 @@ struct combatstate{
 
 struct combat_work_in{
     uint32_t ent_uid;
+    /* Faction and bin of the entity - the work is sorted by this so that 
+     * entities sharing a bin are processed back-to-back by the same task */
+    uint32_t bin_key;
+};
+
+/* Target acquisition results which depend only on the entity's faction and 
+ * the bin it is in. Each task keeps one of these and reuses it for as long as 
+ * consecutive entities share the same key.
+ */
+struct acquire_cache{
+    bool     valid;
+    int      faction_id;
+    int      binx, binz;
+    bool     have_enemy_near;
+    bool     enemy_near;
+    bool     have_cands;
+    size_t   ncands;
+    uint32_t cands[MAX_SHARED_CANDIDATES];
 };
 
 enum combat_action{
@@ -189,15 +213,14 @@ struct combat_gamestate{
     uint16_t               player_factions;
     bool                   fog_enabled;
     khash_t(id)           *flags;
-    khash_t(pos)          *positions;
-    qt_ent_t              *postree;
+    struct pos_snapshot   *positions;
     void                  *transforms;
     khash_t(range)        *sel_radiuses;
     khash_t(id)           *faction_ids;
     enum diplomacy_state (*diptable)[MAX_FACTIONS];
     void                  *buildstate;
     khash_t(aabb)         *aabbs;
-    uint32_t              *fog_state;
+    struct fog_snapshot   *fog_state;
 };
 
 struct combat_work{
@@ -237,19 +260,45 @@ struct combat_cmd{
     struct attr          args[4];
 };
 
+/* A hit which has landed, but whose damage has not yet been dealt */
+struct pending_hit{
+    uint32_t target;
+    /* The order in which the hit landed */
+    uint32_t seq;
+    /* The damage before the target's armour or, for a death, unused */
+    float    dmg;
+};
+
+/* A ranged attack which has been made, but whose projectile has not yet been fired */
+struct pending_shot{
+    uint32_t         uid;
+    vec3_t           src;
+    vec3_t           dst;
+    float            dmg;
+    struct proj_desc pd;
+};
+
 KHASH_MAP_INIT_INT(state, struct combatstate)
+KHASH_MAP_INIT_INT64(cmdidx, uint64_t)
 
 QUEUE_TYPE(cmd, struct combat_cmd)
 QUEUE_IMPL(static, cmd, struct combat_cmd)
 
+MPSC_QUEUE_TYPE(cmd, struct combat_cmd)
+MPSC_QUEUE_IMPL(static, cmd, struct combat_cmd)
+
+VEC_TYPE(hit, struct pending_hit)
+VEC_IMPL(static inline, hit, struct pending_hit)
+
+VEC_TYPE(shot, struct pending_shot)
+VEC_IMPL(static inline, shot, struct pending_shot)
+
 static void combat_push_cmd(struct combat_cmd cmd);
 static void on_attack_anim_finish(void *user, void *event);
 static void on_death_anim_finish(void *user, void *event);
 static void do_stop_attack(uint32_t uid);
 static bool entity_dead(uint32_t uid);
-static struct combat_cmd *snoop_most_recent_command(enum combat_cmd_type type, void *arg,
-                                                    bool (*pred)(void*, struct combat_cmd*));
-static bool uids_match(void *arg, struct combat_cmd *cmd);
+static struct combat_cmd *snoop_most_recent_command(enum combat_cmd_type type, uint32_t uid);
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -269,13 +318,36 @@ static const char *s_name_for_state[] = {
 static khash_t(state)    *s_entity_state_table;
 /* For saving/restoring state */
 static vec_entity_t       s_dying_ents;
+/* The hits are buffered and resolved in batches (see 'combat_resolve_hits') */
+static vec_hit_t          s_pending_hits;
+static vec_hit_t          s_hit_deaths;
+/* The shots are buffered and fired in batches (see 'combat_fire_shots') */
+static vec_shot_t         s_pending_shots;
 static const struct map  *s_map;
 /* How many units of a faction currently currently occupy that bin.
- * For quickly finding that there are no enemy units nearby */
-static uint16_t          *s_fac_refcnts[MAX_FACTIONS];
+ * For quickly finding that there are no enemy units nearby. Level 0 
+ * holds the finest bins and every bin of the next level sums up a 2x2 
+ * block of bins of the previous level. */
+static uint32_t          *s_fac_refcnts[MAX_FACTIONS][NUM_BIN_LEVELS];
+static int                s_bin_cols[NUM_BIN_LEVELS];
+static int                s_bin_rows[NUM_BIN_LEVELS];
 
 static struct combat_work s_combat_work;
+/* Time-slices the target acquisition of entities not in combat. The ones 
+ * in combat are always updated on every tick. */
+static struct think_sched s_idle_think;
 static queue_cmd_t        s_combat_commands;
+/* Commands pushed from outside the main thread, which get moved over to 
+ * the command queue by the main thread before it is read. */
+static mpsc(cmd)          s_combat_inbox;
+/* The sequence number of the most recent queued command of every type 
+ * which is snooped, keyed by the entity and the type. The command at the 
+ * head of the queue has sequence number 's_cmd_head_seq'. When the index 
+ * can't be updated, the queue is scanned instead until it is drained. */
+static khash_t(cmdidx)   *s_cmd_index;
+static bool               s_cmd_index_valid = true;
+static uint64_t           s_cmd_head_seq = 0;
+static uint64_t           s_cmd_next_seq = 0;
 static unsigned long      s_last_tick;
 
 /*****************************************************************************/
@@ -347,14 +419,44 @@ static bool enemies(uint32_t a, uint32_t b)
     return (ds == DIPLOMACY_STATE_WAR);
 }
 
-static bool enemies_in_bin(int faction_id, struct map_resolution binres, struct tile_desc td)
+static float bin_len(void)
+{
+    return MAX(
+        (float)(X_COORDS_PER_TILE * TILES_PER_CHUNK_WIDTH)  / X_BINS_PER_CHUNK,
+        (float)(Z_COORDS_PER_TILE * TILES_PER_CHUNK_HEIGHT) / Z_BINS_PER_CHUNK
+    );
+}
+
+static bool bin_for_pos(vec2_t pos, int *out_x, int *out_z)
+{
+    struct map_resolution mapres;
+    M_GetResolution(s_map, &mapres);
+
+    struct map_resolution binres = (struct map_resolution){
+        mapres.chunk_w, mapres.chunk_h,
+        X_BINS_PER_CHUNK, Z_BINS_PER_CHUNK,
+		mapres.field_w, mapres.field_h
+    };
+
+    struct tile_desc td;
+    if(!M_Tile_DescForPoint2D(binres, M_GetPos(s_map), pos, &td))
+        return false;
+
+    *out_x = td.chunk_c * X_BINS_PER_CHUNK + td.tile_c;
+    *out_z = td.chunk_r * Z_BINS_PER_CHUNK + td.tile_r;
+    return true;
+}
+
+static size_t bin_idx(int level, int x, int z)
+{
+    return z * s_bin_cols[level] + x;
+}
+
+static uint16_t enemy_factions(int faction_id)
 {
     struct combat_gamestate *gs = &s_combat_work.gamestate;
     uint16_t facs = gs->factions;
-
-    size_t x = td.chunk_c * X_BINS_PER_CHUNK + td.tile_c;
-    size_t z = td.chunk_r * Z_BINS_PER_CHUNK + td.tile_r;
-    size_t idx = x * (binres.chunk_w * binres.tile_w) + z;
+    uint16_t ret = 0;
 
     for(int i = 0; facs; facs >>= 1, i++) {
 
@@ -367,53 +469,111 @@ static bool enemies_in_bin(int faction_id, struct map_resolution binres, struct
         G_GetDiplomacyStateFrom(gs->diptable, faction_id, i, &ds);
         if(ds != DIPLOMACY_STATE_WAR)
             continue;
+        ret |= (0x1 << i);
+    }
+    return ret;
+}
 
-        if(s_fac_refcnts[i][idx] > 0)
+static bool enemies_in_bin(uint16_t enemies, int level, int x, int z)
+{
+    size_t idx = bin_idx(level, x, z);
+    for(int i = 0; enemies; enemies >>= 1, i++) {
+        if((enemies & 0x1) && s_fac_refcnts[i][level][idx] > 0)
             return true;
     }
     return false;
 }
 
-static bool maybe_enemy_near(uint32_t uid)
+/* Descend the bin pyramid, only visiting the bins that are both occupied 
+ * by an enemy and overlap the [minx, maxx] x [minz, maxz] rectangle of 
+ * level 0 bins. */
+static bool enemies_in_rect(uint16_t enemies, int level, int x, int z,
+                            int minx, int maxx, int minz, int maxz)
 {
-    PERF_ENTER();
-    struct combat_gamestate *gs = &s_combat_work.gamestate;
-    vec2_t pos = G_Pos_GetXZFrom(gs->positions, uid);
-    int binlen = MAX(
-        (float)(X_COORDS_PER_TILE * TILES_PER_CHUNK_WIDTH)  / X_BINS_PER_CHUNK,
-        (float)(Z_COORDS_PER_TILE * TILES_PER_CHUNK_HEIGHT) / Z_BINS_PER_CHUNK
-    );
-    int binrange = ceil(TARGET_ACQUISITION_RANGE / binlen);
+    if(!enemies_in_bin(enemies, level, x, z))
+        return false;
 
-    struct map_resolution mapres;
-    M_GetResolution(s_map, &mapres);
+    int x0 = x << level, x1 = ((x + 1) << level) - 1;
+    int z0 = z << level, z1 = ((z + 1) << level) - 1;
+    if(x0 >= minx && x1 <= maxx && z0 >= minz && z1 <= maxz)
+        return true;
 
-    struct map_resolution binres = (struct map_resolution){
-        mapres.chunk_w, mapres.chunk_h,
-        X_BINS_PER_CHUNK, Z_BINS_PER_CHUNK,
-		mapres.field_w, mapres.field_h
-    };
+    for(int dz = 0; dz < 2; dz++) {
+    for(int dx = 0; dx < 2; dx++) {
 
-    struct tile_desc td;
-    bool found = M_Tile_DescForPoint2D(binres, M_GetPos(s_map), pos, &td);
-    assert(found);
+        int cx = 2 * x + dx, cz = 2 * z + dz;
+        if(cx >= s_bin_cols[level - 1] || cz >= s_bin_rows[level - 1])
+            continue;
+
+        int cx0 = cx << (level - 1), cx1 = ((cx + 1) << (level - 1)) - 1;
+        int cz0 = cz << (level - 1), cz1 = ((cz + 1) << (level - 1)) - 1;
+        if(cx1 < minx || cx0 > maxx || cz1 < minz || cz0 > maxz)
+            continue;
 
-    size_t binx = td.chunk_c * X_COORDS_PER_TILE + td.tile_c;
-    size_t binz = td.chunk_r * Z_COORDS_PER_TILE + td.tile_r;
+        if(enemies_in_rect(enemies, level - 1, cx, cz, minx, maxx, minz, maxz))
+            return true;
+    }}
+    return false;
+}
 
-    for(int dr = -binrange; dr <= binrange; dr++) {
-    for(int dc = -binrange; dc <= binrange; dc++) {
+static bool enemy_near_bin(int faction_id, int binx, int binz)
+{
+    PERF_ENTER();
 
-        struct tile_desc bin = td;
-        if(!M_Tile_RelativeDesc(binres, &bin, dc, dr))
-            continue;
-        int faction_id = G_GetFactionIDFrom(gs->faction_ids, uid);
-        if(enemies_in_bin(faction_id, binres, bin))
+    uint16_t enemies = enemy_factions(faction_id);
+    if(!enemies)
+        PERF_RETURN(false);
+
+    int binrange = ceil(TARGET_ACQUISITION_RANGE / bin_len());
+    int minx = MAX(binx - binrange, 0), maxx = MIN(binx + binrange, s_bin_cols[0] - 1);
+    int minz = MAX(binz - binrange, 0), maxz = MIN(binz + binrange, s_bin_rows[0] - 1);
+
+    const int top = NUM_BIN_LEVELS - 1;
+    for(int z = (minz >> top); z <= (maxz >> top); z++) {
+    for(int x = (minx >> top); x <= (maxx >> top); x++) {
+        if(enemies_in_rect(enemies, top, x, z, minx, maxx, minz, maxz))
             PERF_RETURN(true);
     }}
     PERF_RETURN(false);
 }
 
+static bool acquire_cache_update(struct acquire_cache *cache, uint32_t uid)
+{
+    struct combat_gamestate *gs = &s_combat_work.gamestate;
+    vec2_t pos = G_Pos_GetXZFrom(gs->positions, uid);
+    int faction_id = G_GetFactionIDFrom(gs->faction_ids, uid);
+    int binx, binz;
+
+    if(!bin_for_pos(pos, &binx, &binz))
+        return false;
+
+    if(cache->valid
+    && cache->faction_id == faction_id
+    && cache->binx == binx
+    && cache->binz == binz)
+        return true;
+
+    cache->valid = true;
+    cache->faction_id = faction_id;
+    cache->binx = binx;
+    cache->binz = binz;
+    cache->have_enemy_near = false;
+    cache->have_cands = false;
+    return true;
+}
+
+static bool maybe_enemy_near(uint32_t uid, struct acquire_cache *cache)
+{
+    /* Let the full search decide for entities outside the map bounds */
+    if(!acquire_cache_update(cache, uid))
+        return true;
+    if(!cache->have_enemy_near) {
+        cache->enemy_near = enemy_near_bin(cache->faction_id, cache->binx, cache->binz);
+        cache->have_enemy_near = true;
+    }
+    return cache->enemy_near;
+}
+
 static void entity_move_in_range(uint32_t uid, uint32_t target)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -501,28 +661,44 @@ static bool entity_can_attack(uint32_t uid, uint32_t target)
     return (PFM_Vec2_Len(&delta) <= cs->stats.attack_range);
 }
 
-static bool valid_enemy(uint32_t curr, void *arg)
+static bool can_target_air(uint32_t ent, uint32_t curr)
 {
     struct combat_gamestate *gs = &s_combat_work.gamestate;
-    uint32_t ent = (uintptr_t)arg;
     uint32_t ent_flags = G_FlagsGetFrom(gs->flags, ent);
     uint32_t curr_flags = G_FlagsGetFrom(gs->flags, curr);
 
     struct combatstate *ent_cs = combatstate_get(ent);
     assert(ent_cs);
 
-    if(curr == ent)
+    if(!(ent_flags & ENTITY_FLAG_AIR)
+    && (curr_flags & ENTITY_FLAG_AIR)
+    && (ent_cs->stats.attack_range == 0.0f))
         return false;
+    return true;
+}
+
+/* The part of the target validity check that only depends 
+ * on the faction of the attacker and not the attacker itself. */
+static bool valid_enemy_of_faction(uint32_t curr, void *arg)
+{
+    struct combat_gamestate *gs = &s_combat_work.gamestate;
+    int faction_id = (intptr_t)arg;
+    uint32_t curr_flags = G_FlagsGetFrom(gs->flags, curr);
+
     if(!(curr_flags & ENTITY_FLAG_COMBATABLE))
         return false;
     if((curr_flags & ENTITY_FLAG_BUILDING) 
     && !G_Building_IsFoundedFrom(gs->buildstate, curr))
         return false;
-    if(!enemies(ent, curr))
+
+    int curr_faction_id = G_GetFactionIDFrom(gs->faction_ids, curr);
+    if(curr_faction_id == faction_id)
         return false;
-    if(!(ent_flags & ENTITY_FLAG_AIR)
-    && (curr_flags & ENTITY_FLAG_AIR)
-    && (ent_cs->stats.attack_range == 0.0f))
+
+    enum diplomacy_state ds;
+    bool result = G_GetDiplomacyStateFrom(gs->diptable, faction_id, curr_faction_id, &ds);
+    assert(result);
+    if(ds != DIPLOMACY_STATE_WAR)
         return false;
 
     struct combatstate *cs = combatstate_get(curr);
@@ -540,6 +716,19 @@ static bool valid_enemy(uint32_t curr, void *arg)
     return true;
 }
 
+static bool valid_enemy(uint32_t curr, void *arg)
+{
+    struct combat_gamestate *gs = &s_combat_work.gamestate;
+    uint32_t ent = (uintptr_t)arg;
+    int faction_id = G_GetFactionIDFrom(gs->faction_ids, ent);
+
+    if(curr == ent)
+        return false;
+    if(!can_target_air(ent, curr))
+        return false;
+    return valid_enemy_of_faction(curr, (void*)((intptr_t)faction_id));
+}
+
 static quat_t quat_from_vec(vec2_t dir)
 {
     assert(PFM_Vec2_Len(&dir) > EPSILON);
@@ -656,19 +845,22 @@ static void entity_die(uint32_t uid)
     }
 }
 
+static void combat_queue_hit(uint32_t target, float dmg)
+{
+    struct pending_hit hit = (struct pending_hit){
+        .target = target,
+        .seq = vec_size(&s_pending_hits),
+        .dmg = dmg
+    };
+    vec_hit_push(&s_pending_hits, hit);
+}
+
 static void entity_melee_attack(uint32_t uid, uint32_t target)
 {
     ASSERT_IN_MAIN_THREAD();
 
     struct combatstate *cs = combatstate_get(uid);
-    struct combatstate *target_cs = combatstate_get(cs->target_uid);
-
-    float dmg = cs->stats.base_dmg  * (1.0f - target_cs->stats.base_armour_pc);
-    target_cs->current_hp = MAX(0, target_cs->current_hp - dmg);
-
-    if(target_cs->current_hp == 0 && target_cs->stats.max_hp > 0) {
-        entity_die(target);
-    }
+    combat_queue_hit(target, cs->stats.base_dmg);
 }
 
 static void entity_ranged_attack(uint32_t uid, uint32_t target)
@@ -679,19 +871,65 @@ static void entity_ranged_attack(uint32_t uid, uint32_t target)
     struct combatstate *cs = combatstate_get(uid);
     assert(cs);
 
-    vec3_t ent_pos = Entity_CenterPos(uid);
-    vec3_t target_pos = Entity_CenterPos(target);
-    float ent_dmg = cs->stats.base_dmg;
+    struct pending_shot shot = (struct pending_shot){
+        .uid = uid,
+        .src = Entity_CenterPos(uid),
+        .dst = Entity_CenterPos(target),
+        .dmg = cs->stats.base_dmg,
+        .pd = cs->pd
+    };
+    vec_shot_push(&s_pending_shots, shot);
+}
 
-    vec3_t vel;
-    if(!P_Projectile_VelocityForTarget(ent_pos, target_pos, cs->pd.speed, &vel)) {
-        /* We resort to just shooting nothing when we can't hit our target. This case 
-         * should never be hit so long as the initial velocity is high enough */
+/* Fire the projectiles of all the ranged attacks made since the last call. 
+ * The launch velocities are solved for in blocks, rather than one shot at 
+ * a time.
+ */
+static void combat_fire_shots(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    size_t nshots = vec_size(&s_pending_shots);
+    if(nshots == 0)
         return;
+
+    PERF_ENTER();
+    PERF_COUNTER_ADD("combat.shots_fired", nshots);
+
+    struct combat_gamestate *gs = &s_combat_work.gamestate;
+    enum{ BLOCK_SIZE = 64 };
+
+    vec3_t src[BLOCK_SIZE], dst[BLOCK_SIZE], vel[BLOCK_SIZE];
+    float speeds[BLOCK_SIZE];
+    bool ok[BLOCK_SIZE];
+
+    for(size_t base = 0; base < nshots; base += BLOCK_SIZE) {
+
+        size_t nblock = MIN(nshots - base, BLOCK_SIZE);
+        for(size_t i = 0; i < nblock; i++) {
+            const struct pending_shot *shot = &vec_AT(&s_pending_shots, base + i);
+            src[i] = shot->src;
+            dst[i] = shot->dst;
+            speeds[i] = shot->pd.speed;
+        }
+
+        P_Projectile_VelocitiesForTargets(nblock, src, dst, speeds, vel, ok);
+
+        for(size_t i = 0; i < nblock; i++) {
+            /* We resort to just shooting nothing when we can't hit our target. This case 
+             * should never be hit so long as the initial velocity is high enough */
+            if(!ok[i])
+                continue;
+
+            const struct pending_shot *shot = &vec_AT(&s_pending_shots, base + i);
+            P_Projectile_Add(shot->src, vel[i], shot->uid, 
+                G_GetFactionIDFrom(gs->faction_ids, shot->uid), shot->dmg, 
+                PROJ_ONLY_HIT_COMBATABLE | PROJ_ONLY_HIT_ENEMIES, shot->pd);
+        }
     }
 
-    P_Projectile_Add(ent_pos, vel, uid, G_GetFactionIDFrom(gs->faction_ids, uid), 
-        ent_dmg, PROJ_ONLY_HIT_COMBATABLE | PROJ_ONLY_HIT_ENEMIES, cs->pd);
+    vec_shot_reset(&s_pending_shots);
+    PERF_RETURN_VOID();
 }
 
 static bool garrisoned(uint32_t uid)
@@ -701,6 +939,100 @@ static bool garrisoned(uint32_t uid)
     return (flags & ENTITY_FLAG_GARRISONED);
 }
 
+static int compare_hits(const void *a, const void *b)
+{
+    const struct pending_hit *ha = a, *hb = b;
+    if(ha->target != hb->target)
+        return (ha->target < hb->target) ? -1 : 1;
+    if(ha->seq != hb->seq)
+        return (ha->seq < hb->seq) ? -1 : 1;
+    return 0;
+}
+
+static int compare_deaths(const void *a, const void *b)
+{
+    const struct pending_hit *ha = a, *hb = b;
+    if(ha->seq != hb->seq)
+        return (ha->seq < hb->seq) ? -1 : 1;
+    return 0;
+}
+
+/* Deal the damage of all the hits which have landed since the last call. 
+ * The hits are grouped by target, so that every target's state is only 
+ * looked up once, and the deaths are only processed once all the damage 
+ * has been dealt, in the order of the killing hits. As a result, all the 
+ * hits of a batch land at the same time: an entity killed in the batch 
+ * still lands its' own hits from the same batch.
+ */
+static void combat_resolve_hits(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    size_t nhits = vec_size(&s_pending_hits);
+    if(nhits == 0)
+        return;
+
+    PERF_ENTER();
+    PERF_COUNTER_ADD("combat.hits_resolved", nhits);
+
+    qsort(s_pending_hits.array, nhits, sizeof(struct pending_hit), compare_hits);
+    vec_hit_reset(&s_hit_deaths);
+
+    size_t begin = 0;
+    while(begin < nhits) {
+
+        uint32_t target = vec_AT(&s_pending_hits, begin).target;
+        size_t end = begin + 1;
+        while(end < nhits && vec_AT(&s_pending_hits, end).target == target)
+            end++;
+
+        if(entity_dead(target) || garrisoned(target)) {
+            begin = end;
+            continue;
+        }
+
+        struct combatstate *cs = combatstate_get(target);
+        float multiplier = 1.0f - cs->stats.base_armour_pc;
+        int hp = cs->current_hp;
+
+        for(size_t i = begin; i < end; i++) {
+
+            const struct pending_hit *hit = &vec_AT(&s_pending_hits, i);
+            hp = MAX(0, hp - hit->dmg * multiplier);
+
+            /* Any further hits would land on an already dead entity */
+            if(hp == 0 && cs->stats.max_hp > 0) {
+                vec_hit_push(&s_hit_deaths, *hit);
+                break;
+            }
+        }
+
+        cs->current_hp = hp;
+        G_Think_Bump(&s_idle_think, target);
+        begin = end;
+    }
+    vec_hit_reset(&s_pending_hits);
+
+    size_t ndeaths = vec_size(&s_hit_deaths);
+    qsort(s_hit_deaths.array, ndeaths, sizeof(struct pending_hit), compare_deaths);
+
+    for(int i = 0; i < ndeaths; i++) {
+        uint32_t uid = vec_AT(&s_hit_deaths, i).target;
+        if(entity_dead(uid))
+            continue;
+        entity_die(uid);
+    }
+    vec_hit_reset(&s_hit_deaths);
+
+    PERF_RETURN_VOID();
+}
+
+static void combat_flush_attacks(void)
+{
+    combat_fire_shots();
+    combat_resolve_hits();
+}
+
 static void on_death_anim_finish(void *user, void *event)
 {
     uint32_t self = (uintptr_t)user;
@@ -729,6 +1061,7 @@ static void do_add_entity(uint32_t uid, enum combat_stance initial)
         .pd = combat_default_proj(),
     };
     combatstate_set(uid, &new_cs);
+    G_Think_AddEntity(&s_idle_think, uid);
 }
 
 static void do_remove_entity(uint32_t uid)
@@ -751,6 +1084,7 @@ static void do_remove_entity(uint32_t uid)
     PF_FREE(cs->pd.pfobj);
 
     combat_dying_remove(uid);
+    G_Think_RemoveEntity(&s_idle_think, uid);
     combatstate_remove(uid);
 }
 
@@ -802,13 +1136,7 @@ static void do_proj_tryhit(struct proj_hit *hit)
     if(entity_dead(hit->ent_uid) || garrisoned(hit->ent_uid))
         return;
 
-    struct combatstate *cs = combatstate_get(hit->ent_uid);
-    float dmg = hit->cookie * (1.0f - cs->stats.base_armour_pc);
-    cs->current_hp = MAX(0, cs->current_hp - dmg);
-
-    if(cs->current_hp == 0 && cs->stats.max_hp > 0) {
-        entity_die(hit->ent_uid);
-    }
+    combat_queue_hit(hit->ent_uid, hit->cookie);
 }
 
 static void do_set_stance(uint32_t uid, enum combat_stance stance)
@@ -834,6 +1162,7 @@ static void do_set_stance(uint32_t uid, enum combat_stance stance)
     }
 
     cs->stance = stance;
+    G_Think_Bump(&s_idle_think, uid);
 }
 
 static void do_clear_saved_move_cmd(uint32_t uid)
@@ -892,9 +1221,9 @@ static void do_stop_attack(uint32_t uid)
     }
 
     cs->state = STATE_NOT_IN_COMBAT;
+    G_Think_Bump(&s_idle_think, uid);
 
-    struct combat_cmd *cmd = snoop_most_recent_command(COMBAT_CMD_CLEAR_SAVED_MOVE_CMD,
-        (void*)(uintptr_t)uid, uids_match);
+    struct combat_cmd *cmd = snoop_most_recent_command(COMBAT_CMD_CLEAR_SAVED_MOVE_CMD, uid);
 
     if(!cmd && cs->move_cmd_interrupted) {
         assert(cs->stance != COMBAT_STANCE_HOLD_POSITION);
@@ -921,50 +1250,30 @@ static void do_add_ref(int faction_id, vec2_t pos)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    struct map_resolution mapres;
-    M_GetResolution(s_map, &mapres);
-
-    struct map_resolution binres = (struct map_resolution){
-        mapres.chunk_w, mapres.chunk_h,
-        X_BINS_PER_CHUNK, Z_BINS_PER_CHUNK,
-		mapres.field_w, mapres.field_h
-    };
-
-    struct tile_desc td;
-    if(!M_Tile_DescForPoint2D(binres, M_GetPos(s_map), pos, &td))
+    int x, z;
+    if(!bin_for_pos(pos, &x, &z))
         return;
 
-    size_t x = td.chunk_c * X_BINS_PER_CHUNK + td.tile_c;
-    size_t z = td.chunk_r * Z_BINS_PER_CHUNK + td.tile_r;
-    size_t idx = x * (binres.chunk_w * binres.tile_w) + z;
-
-    assert(s_fac_refcnts[faction_id][idx] < UINT16_MAX);
-    s_fac_refcnts[faction_id][idx]++;
+    for(int i = 0; i < NUM_BIN_LEVELS; i++) {
+        size_t idx = bin_idx(i, x >> i, z >> i);
+        assert(s_fac_refcnts[faction_id][i][idx] < UINT32_MAX);
+        s_fac_refcnts[faction_id][i][idx]++;
+    }
 }
 
 static void do_remove_ref(int faction_id, vec2_t pos)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    struct map_resolution mapres;
-    M_GetResolution(s_map, &mapres);
-
-    struct map_resolution binres = (struct map_resolution){
-        mapres.chunk_w, mapres.chunk_h,
-        X_BINS_PER_CHUNK, Z_BINS_PER_CHUNK,
-		mapres.field_w, mapres.field_h
-    };
-
-    struct tile_desc td;
-    if(!M_Tile_DescForPoint2D(binres, M_GetPos(s_map), pos, &td))
+    int x, z;
+    if(!bin_for_pos(pos, &x, &z))
         return;
 
-    size_t x = td.chunk_c * X_BINS_PER_CHUNK + td.tile_c;
-    size_t z = td.chunk_r * Z_BINS_PER_CHUNK + td.tile_r;
-    size_t idx = x * (binres.chunk_w * binres.tile_w) + z;
-
-    assert(s_fac_refcnts[faction_id][idx] > 0);
-    s_fac_refcnts[faction_id][idx]--;
+    for(int i = 0; i < NUM_BIN_LEVELS; i++) {
+        size_t idx = bin_idx(i, x >> i, z >> i);
+        assert(s_fac_refcnts[faction_id][i][idx] > 0);
+        s_fac_refcnts[faction_id][i][idx]--;
+    }
 }
 
 static void do_update_ref(int oldfac, int newfac, vec2_t pos)
@@ -1096,13 +1405,13 @@ static void entity_stop_combat(uint32_t uid)
     struct combatstate *cs = combatstate_get(uid);
     assert(cs);
     cs->state = STATE_NOT_IN_COMBAT; 
+    G_Think_Bump(&s_idle_think, uid);
 
     uint32_t flags = G_FlagsGet(uid);
     if(!(flags & ENTITY_FLAG_MOVABLE))
         return;
 
-    struct combat_cmd *cmd = snoop_most_recent_command(COMBAT_CMD_SET_RANGE,
-        (void*)(uintptr_t)uid, uids_match);
+    struct combat_cmd *cmd = snoop_most_recent_command(COMBAT_CMD_SET_RANGE, uid);
 
     if(!cmd && cs->move_cmd_interrupted) {
         G_Move_SetDest(uid, cs->move_cmd_xz, cs->move_cmd_attacking);
@@ -1112,17 +1421,75 @@ static void entity_stop_combat(uint32_t uid)
     }
 }
 
-uint32_t closest_eligible_entity(uint32_t uid)
+/* All the enemies of the cached faction that are within target acquisition 
+ * range of some point in the cached bin. */
+static const uint32_t *shared_candidates(struct acquire_cache *cache, size_t *out_count)
+{
+    struct combat_gamestate *gs = &s_combat_work.gamestate;
+
+    if(!cache->have_cands) {
+
+        const float xlen = (float)(X_COORDS_PER_TILE * TILES_PER_CHUNK_WIDTH)  / X_BINS_PER_CHUNK;
+        const float zlen = (float)(Z_COORDS_PER_TILE * TILES_PER_CHUNK_HEIGHT) / Z_BINS_PER_CHUNK;
+        vec3_t map_pos = M_GetPos(s_map);
+
+        /* Recall X increases to the left in our engine */
+        vec2_t bin_center = (vec2_t){
+            map_pos.x - (cache->binx + 0.5f) * xlen,
+            map_pos.z + (cache->binz + 0.5f) * zlen
+        };
+        float range = TARGET_ACQUISITION_RANGE + bin_len() * sqrtf(2.0f) / 2.0f;
+
+        cache->ncands = G_Pos_EntsInCircleWithPredFrom(
+            gs->positions, gs->flags, bin_center, range, cache->cands, 
+            ARR_SIZE(cache->cands), valid_enemy_of_faction, 
+            (void*)((intptr_t)cache->faction_id));
+        cache->have_cands = true;
+    }
+    *out_count = cache->ncands;
+    return cache->cands;
+}
+
+uint32_t closest_eligible_entity(uint32_t uid, struct acquire_cache *cache)
 {
     struct combat_gamestate *gs = &s_combat_work.gamestate;
     struct combatstate *cs = combatstate_get(uid);
     vec2_t pos = G_Pos_GetXZFrom(gs->positions, uid);
     float range = MAX(TARGET_ACQUISITION_RANGE, cs->stats.attack_range);
-    int faction_id = G_GetFactionIDFrom(gs->faction_ids, uid);
+
+    if(range <= TARGET_ACQUISITION_RANGE && acquire_cache_update(cache, uid)) {
+
+        size_t ncands;
+        const uint32_t *cands = shared_candidates(cache, &ncands);
+
+        float min_dist = INFINITY;
+        uint32_t ret = NULL_UID;
+
+        for(int i = 0; i < ncands; i++) {
+
+            vec2_t enemy_pos = G_Pos_GetXZFrom(gs->positions, cands[i]);
+            vec2_t delta;
+            PFM_Vec2_Sub(&pos, &enemy_pos, &delta);
+            float dist = PFM_Vec2_Len(&delta);
+
+            if(dist > range)
+                continue;
+            if(!can_target_air(uid, cands[i]))
+                continue;
+            if(entities_adjacent(uid, cands[i]))
+                return cands[i];
+
+            if(dist < min_dist) {
+                min_dist = dist;
+                ret = cands[i];
+            }
+        }
+        return ret;
+    }
 
     uint32_t ents[128];
     size_t nents = G_Pos_EntsInCircleWithPredFrom(
-        gs->postree, gs->flags, pos, range, ents, 
+        gs->positions, gs->flags, pos, range, ents, 
         ARR_SIZE(ents), valid_enemy, (void*)((uintptr_t)uid));
 
     if(!nents)
@@ -1156,7 +1523,8 @@ uint32_t closest_eligible_entity(uint32_t uid)
     return ret;
 }
 
-static void entity_compute_update(uint32_t uid, struct combat_work_out *out)
+static void entity_compute_update(uint32_t uid, struct combat_work_out *out, 
+                                  struct acquire_cache *cache)
 {
     struct combat_gamestate *gs = &s_combat_work.gamestate;
     uint32_t flags = G_FlagsGetFrom(gs->flags, uid);
@@ -1182,10 +1550,10 @@ static void entity_compute_update(uint32_t uid, struct combat_work_out *out)
         if(curr->stats.base_dmg == 0)
             break;
 
-        if(!maybe_enemy_near(uid))
+        if(!maybe_enemy_near(uid, cache))
             break;
 
-        uint32_t enemy = closest_eligible_entity(uid);
+        uint32_t enemy = closest_eligible_entity(uid, cache);
         if(enemy == NULL_UID)
             break;
 
@@ -1205,7 +1573,7 @@ static void entity_compute_update(uint32_t uid, struct combat_work_out *out)
         assert(flags & ENTITY_FLAG_MOVABLE);
 
         /* Handle the case where our target dies before we reach it */
-        uint32_t enemy = closest_eligible_entity(uid);
+        uint32_t enemy = closest_eligible_entity(uid, cache);
         if(enemy == NULL_UID) {
 
             out->action = COMBAT_ACTION_STOP_COMBAT;
@@ -1327,7 +1695,7 @@ static void entity_compute_update(uint32_t uid, struct combat_work_out *out)
             }
 
             /* Check if there's another suitable target */
-            uint32_t enemy = closest_eligible_entity(uid);
+            uint32_t enemy = closest_eligible_entity(uid, cache);
             if(enemy == NULL_UID) {
                 out->notify_attack_end = true;
                 out->action = COMBAT_ACTION_STOP_COMBAT;
@@ -1497,32 +1865,110 @@ static void entity_apply_update(struct combat_work_out *out)
     }
 }
 
-static void combat_push_cmd(struct combat_cmd cmd)
+static bool cmd_indexed(enum combat_cmd_type type)
+{
+    switch(type) {
+    case COMBAT_CMD_ADD:
+    case COMBAT_CMD_SET_STANCE:
+    case COMBAT_CMD_SET_CURRENT_HP:
+    case COMBAT_CMD_SET_BASE_ARMOUR:
+    case COMBAT_CMD_SET_BASE_DAMAGE:
+    case COMBAT_CMD_SET_MAX_HP:
+    case COMBAT_CMD_SET_RANGE:
+    case COMBAT_CMD_CLEAR_SAVED_MOVE_CMD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static uint64_t cmd_index_key(uint32_t uid, enum combat_cmd_type type)
+{
+    return (((uint64_t)uid) << 5) | type;
+}
+
+static void combat_enqueue_cmd(struct combat_cmd *cmd)
 {
-    queue_cmd_push(&s_combat_commands, &cmd);
+    if(!queue_cmd_push(&s_combat_commands, cmd))
+        return;
+
+    uint64_t seq = s_cmd_next_seq++;
+    if(!cmd_indexed(cmd->type))
+        return;
+
+    int ret;
+    uint32_t uid = cmd->args[0].val.as_int;
+    khiter_t k = kh_put(cmdidx, s_cmd_index, cmd_index_key(uid, cmd->type), &ret);
+    if(ret == -1) {
+        s_cmd_index_valid = false;
+        return;
+    }
+    kh_value(s_cmd_index, k) = seq;
 }
 
-static bool uids_match(void *arg, struct combat_cmd *cmd)
+static bool combat_pop_cmd(struct combat_cmd *out)
 {
-    uint32_t desired_uid = (uintptr_t)arg;
-    uint32_t actual_uid = cmd->args[0].val.as_int;
-    return (desired_uid == actual_uid);
+    if(!queue_cmd_pop(&s_combat_commands, out))
+        return false;
+
+    s_cmd_head_seq++;
+    if(queue_size(s_combat_commands) == 0) {
+        kh_clear(cmdidx, s_cmd_index);
+        s_cmd_index_valid = true;
+    }
+    return true;
 }
 
-static struct combat_cmd *snoop_most_recent_command(enum combat_cmd_type type, void *arg,
-                                                    bool (*pred)(void*, struct combat_cmd*))
+static void combat_drain_inbox(void)
 {
     ASSERT_IN_MAIN_THREAD();
 
+    struct combat_cmd cmd;
+    while(mpsc_cmd_pop(&s_combat_inbox, &cmd)) {
+        combat_enqueue_cmd(&cmd);
+    }
+}
+
+/* Commands may be pushed from any thread. The ones pushed by the main 
+ * thread are ordered after those from other threads which have already 
+ * been received. */
+static void combat_push_cmd(struct combat_cmd cmd)
+{
+    if(SDL_ThreadID() != g_main_thread_id) {
+        mpsc_cmd_push(&s_combat_inbox, &cmd);
+        return;
+    }
+    combat_drain_inbox();
+    combat_enqueue_cmd(&cmd);
+}
+
+static struct combat_cmd *snoop_most_recent_command(enum combat_cmd_type type, uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(cmd_indexed(type));
+
+    combat_drain_inbox();
     if(queue_size(s_combat_commands) == 0)
         return NULL;
 
+    if(s_cmd_index_valid) {
+        khiter_t k = kh_get(cmdidx, s_cmd_index, cmd_index_key(uid, type));
+        if(k == kh_end(s_cmd_index))
+            return NULL;
+
+        uint64_t seq = kh_value(s_cmd_index, k);
+        if(seq < s_cmd_head_seq)
+            return NULL;
+
+        assert(seq - s_cmd_head_seq < queue_size(s_combat_commands));
+        return &queue_at(s_combat_commands, seq - s_cmd_head_seq);
+    }
+
     size_t left = queue_size(s_combat_commands);
     for(int i = s_combat_commands.itail; left > 0;) {
         struct combat_cmd *curr = &s_combat_commands.mem[i];
-        if(curr->type == type)
-            if(pred(arg, curr))
-                return curr;
+        if(curr->type == type && curr->args[0].val.as_int == uid)
+            return curr;
         i--;
         left--;
         if(i < 0) {
@@ -1534,8 +1980,20 @@ static struct combat_cmd *snoop_most_recent_command(enum combat_cmd_type type, v
 
 static void combat_process_cmds(void)
 {
+    combat_drain_inbox();
+
     struct combat_cmd cmd;
-    while(queue_cmd_pop(&s_combat_commands, &cmd)) {
+    while(combat_pop_cmd(&cmd)) {
+
+        /* The buffered attacks must see the state from before these commands */
+        if(cmd.type == COMBAT_CMD_SET_CURRENT_HP
+        || cmd.type == COMBAT_CMD_SET_MAX_HP
+        || cmd.type == COMBAT_CMD_SET_BASE_ARMOUR
+        || cmd.type == COMBAT_CMD_SET_PROJ_DESC
+        || cmd.type == COMBAT_CMD_REMOVE) {
+            combat_flush_attacks();
+        }
+
         switch(cmd.type) {
         case COMBAT_CMD_ADD: {
             uint32_t uid = cmd.args[0].val.as_int;
@@ -1648,26 +2106,28 @@ static void combat_process_cmds(void)
             assert(0);
         }
     }
+    combat_flush_attacks();
 }
 
-static void combat_work(int begin_idx, int end_idx)
+static void combat_work(int begin_idx, int end_idx, struct acquire_cache *cache)
 {
     for(int i = begin_idx; i <= end_idx; i++) {
     
         struct combat_work_in *in = &s_combat_work.in[i];
         struct combat_work_out *out = &s_combat_work.out[i];
-        entity_compute_update(in->ent_uid, out);
+        entity_compute_update(in->ent_uid, out, cache);
     }
 }
 
 static struct result combat_task(void *arg)
 {
     struct combat_task_arg *combat_arg = arg;
+    struct acquire_cache cache = {.valid = false};
     size_t ncomputed = 0;
 
     for(int i = combat_arg->begin_idx; i <= combat_arg->end_idx; i++) {
 
-        combat_work(i, i);
+        combat_work(i, i, &cache);
         ncomputed++;
 
         if(ncomputed % 64 == 0)
@@ -1711,15 +2171,14 @@ static void combat_copy_gamestate(void)
     s_combat_work.gamestate.player_factions = G_GetPlayerControlledFactions();
     s_combat_work.gamestate.fog_enabled = G_Fog_Enabled();
     s_combat_work.gamestate.flags = G_FlagsCopyTable();
-    s_combat_work.gamestate.positions = G_Pos_CopyTable();
-    s_combat_work.gamestate.postree = G_Pos_CopyQuadTree();
+    s_combat_work.gamestate.positions = G_Pos_AcquireSnapshot();
     s_combat_work.gamestate.transforms = Entity_CopyTransforms();
     s_combat_work.gamestate.sel_radiuses = G_SelectionRadiusCopyTable();
     s_combat_work.gamestate.faction_ids = G_FactionIDCopyTable();
     s_combat_work.gamestate.diptable = G_CopyDiplomacyTable();
     s_combat_work.gamestate.buildstate = G_Building_CopyState();
     s_combat_work.gamestate.aabbs = combat_copy_aabbs();
-    s_combat_work.gamestate.fog_state = G_Fog_CopyState();
+    s_combat_work.gamestate.fog_state = G_Fog_AcquireSnapshot();
     PERF_RETURN_VOID();
 }
 
@@ -1731,13 +2190,9 @@ static void combat_release_gamestate(void)
         s_combat_work.gamestate.flags = NULL;
     }
     if(s_combat_work.gamestate.positions) {
-        kh_destroy(pos, s_combat_work.gamestate.positions);
+        G_Pos_ReleaseSnapshot(s_combat_work.gamestate.positions);
         s_combat_work.gamestate.positions = NULL;
     }
-    if(s_combat_work.gamestate.postree) {
-        G_Pos_DestroyQuadTree(s_combat_work.gamestate.postree);
-        s_combat_work.gamestate.postree = NULL;
-    }
     if(s_combat_work.gamestate.transforms) {
         kh_destroy(trans, s_combat_work.gamestate.transforms);
         s_combat_work.gamestate.transforms = NULL;
@@ -1755,7 +2210,7 @@ static void combat_release_gamestate(void)
         s_combat_work.gamestate.diptable = NULL;
     }
     if(s_combat_work.gamestate.buildstate) {
-        kh_destroy(state, s_combat_work.gamestate.buildstate);
+        G_Building_FreeState(s_combat_work.gamestate.buildstate);
         s_combat_work.gamestate.buildstate = NULL;
     }
     if(s_combat_work.gamestate.aabbs) {
@@ -1763,7 +2218,7 @@ static void combat_release_gamestate(void)
         s_combat_work.gamestate.aabbs = NULL;
     }
     if(s_combat_work.gamestate.fog_state) {
-        PF_FREE(s_combat_work.gamestate.fog_state);
+        G_Fog_ReleaseSnapshot(s_combat_work.gamestate.fog_state);
         s_combat_work.gamestate.fog_state = NULL;
     }
     PERF_RETURN_VOID();
@@ -1796,6 +2251,7 @@ static void combat_finish_work(void)
         struct combat_work_out *out = &s_combat_work.out[i];
         entity_apply_update(out);
     }
+    combat_flush_attacks();
     PERF_POP();
 
     stalloc_clear(&s_combat_work.mem);
@@ -1807,9 +2263,29 @@ static void combat_finish_work(void)
     PERF_RETURN_VOID();
 }
 
-static void combat_push_work(struct combat_work_in in)
+static void combat_push_work(uint32_t uid)
 {
-    s_combat_work.in[s_combat_work.nwork++] = in;
+    struct combat_gamestate *gs = &s_combat_work.gamestate;
+    vec2_t pos = G_Pos_GetXZFrom(gs->positions, uid);
+    int faction_id = G_GetFactionIDFrom(gs->faction_ids, uid);
+
+    int binx = 0, binz = 0;
+    bin_for_pos(pos, &binx, &binz);
+
+    s_combat_work.in[s_combat_work.nwork++] = (struct combat_work_in){
+        .ent_uid = uid,
+        .bin_key = (faction_id << 24) | bin_idx(0, binx, binz)
+    };
+}
+
+static int compare_work(const void *a, const void *b)
+{
+    const struct combat_work_in *wa = a, *wb = b;
+    if(wa->bin_key != wb->bin_key)
+        return (wa->bin_key < wb->bin_key) ? -1 : 1;
+    if(wa->ent_uid != wb->ent_uid)
+        return (wa->ent_uid < wb->ent_uid) ? -1 : 1;
+    return 0;
 }
 
 static void combat_submit_work(void)
@@ -1817,7 +2293,9 @@ static void combat_submit_work(void)
     if(s_combat_work.nwork == 0)
         return;
 
-    size_t ntasks = SDL_GetCPUCount();
+    qsort(s_combat_work.in, s_combat_work.nwork, sizeof(s_combat_work.in[0]), compare_work);
+
+    size_t ntasks = Sched_Concurrency();
     if(s_combat_work.nwork < 64)
         ntasks = 1;
     ntasks = MIN(ntasks, MAX_COMBAT_TASKS);
@@ -1835,13 +2313,23 @@ static void combat_submit_work(void)
             &s_combat_work.futures[s_combat_work.ntasks], TASK_BIG_STACK);
 
         if(s_combat_work.tids[s_combat_work.ntasks] == NULL_TID) {
-            combat_work(arg->begin_idx, arg->end_idx);
+            struct acquire_cache *cache = stalloc(&s_combat_work.mem, sizeof(struct acquire_cache));
+            cache->valid = false;
+            combat_work(arg->begin_idx, arg->end_idx, cache);
         }else{
             s_combat_work.ntasks++;
         }
     }
 }
 
+static void idle_think(uint32_t uid, void *user)
+{
+    const struct combatstate *cs = combatstate_get(uid);
+    assert(cs);
+    if(cs->state == STATE_NOT_IN_COMBAT)
+        combat_push_work(uid);
+}
+
 static void on_20hz_tick(void *user, void *event)
 {
     if(s_last_tick == g_frame_idx)
@@ -1857,9 +2345,12 @@ static void on_20hz_tick(void *user, void *event)
     combat_copy_gamestate();
 
     uint32_t uid;
-    kh_foreach_key(s_entity_state_table, uid, {
-        combat_push_work((struct combat_work_in){uid});
+    struct combatstate *cs;
+    kh_foreach_val_ptr(s_entity_state_table, uid, cs, {
+        if(cs->state != STATE_NOT_IN_COMBAT)
+            combat_push_work(uid);
     });
+    G_Think_Run(&s_idle_think);
     combat_submit_work();
     s_last_tick = g_frame_idx;
 
@@ -2092,18 +2583,36 @@ bool G_Combat_Init(const struct map *map)
     if(!queue_cmd_init(&s_combat_commands, 256))
         goto fail_queue;
 
+    if(NULL == (s_cmd_index = kh_init(cmdidx)))
+        goto fail_index;
+    s_cmd_index_valid = true;
+    s_cmd_head_seq = 0;
+    s_cmd_next_seq = 0;
+    mpsc_cmd_init(&s_combat_inbox);
+
+    if(!G_Think_Init(&s_idle_think, idle_think, NULL, IDLE_THINK_PERIOD_TICKS, 0))
+        goto fail_think;
+
     struct map_resolution res;
     M_GetResolution(map, &res);
 
+    for(int i = 0; i < NUM_BIN_LEVELS; i++) {
+        int scale = (1 << i);
+        s_bin_cols[i] = (res.chunk_w * X_BINS_PER_CHUNK + scale - 1) / scale;
+        s_bin_rows[i] = (res.chunk_h * Z_BINS_PER_CHUNK + scale - 1) / scale;
+    }
+
     for(int i = 0; i < MAX_FACTIONS; i++) {
-        s_fac_refcnts[i] = calloc((res.chunk_w * X_BINS_PER_CHUNK) 
-                                * (res.chunk_h * Z_BINS_PER_CHUNK) 
-                                * sizeof(uint16_t), 1);
-        if(!s_fac_refcnts[i])
+    for(int j = 0; j < NUM_BIN_LEVELS; j++) {
+        s_fac_refcnts[i][j] = calloc(s_bin_cols[j] * s_bin_rows[j] * sizeof(uint32_t), 1);
+        if(!s_fac_refcnts[i][j])
             goto fail_refcnts;
-    }
+    }}
 
     vec_entity_init(&s_dying_ents);
+    vec_hit_init(&s_pending_hits);
+    vec_hit_init(&s_hit_deaths);
+    vec_shot_init(&s_pending_shots);
     E_Global_Register(EVENT_20HZ_TICK, on_20hz_tick, NULL, G_RUNNING);
     E_Global_Register(SDL_MOUSEBUTTONDOWN, on_mousedown, NULL, G_RUNNING);
     E_Global_Register(EVENT_RENDER_3D_POST, on_render_3d, NULL, G_ALL);
@@ -2114,7 +2623,13 @@ bool G_Combat_Init(const struct map *map)
 
 fail_refcnts:
     for(int i = 0; i < MAX_FACTIONS; i++)
-        PF_FREE(s_fac_refcnts[i]);
+        for(int j = 0; j < NUM_BIN_LEVELS; j++)
+            PF_FREE(s_fac_refcnts[i][j]);
+    G_Think_Destroy(&s_idle_think);
+fail_think:
+    mpsc_cmd_destroy(&s_combat_inbox);
+    kh_destroy(cmdidx, s_cmd_index);
+fail_index:
     queue_cmd_destroy(&s_combat_commands);
 fail_queue:
     stalloc_destroy(&s_combat_work.mem);
@@ -2140,18 +2655,26 @@ void G_Combat_Shutdown(void)
     });
 
     combat_release_gamestate();
+    vec_shot_destroy(&s_pending_shots);
+    vec_hit_destroy(&s_hit_deaths);
+    vec_hit_destroy(&s_pending_hits);
     vec_entity_destroy(&s_dying_ents);
     for(int i = 0; i < MAX_FACTIONS; i++) {
-        PF_FREE(s_fac_refcnts[i]);
+        for(int j = 0; j < NUM_BIN_LEVELS; j++) {
+            PF_FREE(s_fac_refcnts[i][j]);
+        }
     }
+    G_Think_Destroy(&s_idle_think);
     queue_cmd_destroy(&s_combat_commands);
+    mpsc_cmd_destroy(&s_combat_inbox);
+    kh_destroy(cmdidx, s_cmd_index);
     stalloc_destroy(&s_combat_work.mem);
     kh_destroy(state, s_entity_state_table);
 }
 
 bool G_Combat_HasWork(void)
 {
-    return (queue_size(s_combat_commands) > 0);
+    return (queue_size(s_combat_commands) > 0 || mpsc_size(s_combat_inbox) > 0);
 }
 
 void G_Combat_FlushWork(void)
@@ -2173,6 +2696,7 @@ void G_Combat_AddEntity(uint32_t uid, enum combat_stance initial)
             .val.as_int = initial
         }
     });
+    G_EntIndex_AddComponent(uid, ENT_COMP_COMBAT);
 }
 
 void G_Combat_RemoveEntity(uint32_t uid)
@@ -2184,6 +2708,7 @@ void G_Combat_RemoveEntity(uint32_t uid)
             .val.as_int = uid
         }
     });
+    G_EntIndex_RemoveComponent(uid, ENT_COMP_COMBAT);
 }
 
 void G_Combat_SetStance(uint32_t uid, enum combat_stance stance)
@@ -2203,13 +2728,11 @@ void G_Combat_SetStance(uint32_t uid, enum combat_stance stance)
 
 enum combat_stance G_Combat_GetStance(uint32_t uid)
 {
-    struct combat_cmd *cmd = snoop_most_recent_command(COMBAT_CMD_SET_STANCE,
-        (void*)(uintptr_t)uid, uids_match);
+    struct combat_cmd *cmd = snoop_most_recent_command(COMBAT_CMD_SET_STANCE, uid);
     if(cmd) {
         return cmd->args[1].val.as_int;
     }
-    cmd = snoop_most_recent_command(COMBAT_CMD_ADD,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_ADD, uid);
     if(cmd) {
         return cmd->args[1].val.as_int;
     }
@@ -2385,13 +2908,11 @@ bool G_Combat_IsDying(uint32_t uid)
 int G_Combat_GetCurrentHP(uint32_t uid)
 {
     struct combat_cmd *cmd;
-    cmd = snoop_most_recent_command(COMBAT_CMD_SET_CURRENT_HP,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_SET_CURRENT_HP, uid);
     if(cmd) {
         return cmd->args[1].val.as_int;
     }
-    cmd = snoop_most_recent_command(COMBAT_CMD_ADD,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_ADD, uid);
     if(cmd) {
         return 0;
     }
@@ -2419,13 +2940,11 @@ void G_Combat_SetBaseArmour(uint32_t uid, float armour_pc)
 float G_Combat_GetBaseArmour(uint32_t uid)
 {
     struct combat_cmd *cmd;
-    cmd = snoop_most_recent_command(COMBAT_CMD_SET_BASE_ARMOUR,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_SET_BASE_ARMOUR, uid);
     if(cmd) {
         return cmd->args[1].val.as_float;
     }
-    cmd = snoop_most_recent_command(COMBAT_CMD_ADD,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_ADD, uid);
     if(cmd) {
         return 0.0f;
     }
@@ -2453,13 +2972,11 @@ void G_Combat_SetBaseDamage(uint32_t uid, int dmg)
 int G_Combat_GetBaseDamage(uint32_t uid)
 {
     struct combat_cmd *cmd;
-    cmd = snoop_most_recent_command(COMBAT_CMD_SET_BASE_DAMAGE,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_SET_BASE_DAMAGE, uid);
     if(cmd) {
         return cmd->args[1].val.as_int;
     }
-    cmd = snoop_most_recent_command(COMBAT_CMD_ADD,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_ADD, uid);
     if(cmd) {
         return 0;
     }
@@ -2502,13 +3019,11 @@ void G_Combat_SetMaxHP(uint32_t uid, int hp)
 int G_Combat_GetMaxHP(uint32_t uid)
 {
     struct combat_cmd *cmd;
-    cmd = snoop_most_recent_command(COMBAT_CMD_SET_MAX_HP,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_SET_MAX_HP, uid);
     if(cmd) {
         return cmd->args[1].val.as_int;
     }
-    cmd = snoop_most_recent_command(COMBAT_CMD_ADD,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_ADD, uid);
     if(cmd) {
         return 0;
     }
@@ -2561,13 +3076,11 @@ void G_Combat_SetProjDesc(uint32_t uid, const struct proj_desc *pd)
 float G_Combat_GetRange(uint32_t uid)
 {
     struct combat_cmd *cmd;
-    cmd = snoop_most_recent_command(COMBAT_CMD_SET_RANGE,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_SET_RANGE, uid);
     if(cmd) {
         return cmd->args[1].val.as_float;
     }
-    cmd = snoop_most_recent_command(COMBAT_CMD_ADD,
-        (void*)(uintptr_t)uid, uids_match);
+    cmd = snoop_most_recent_command(COMBAT_CMD_ADD, uid);
     if(cmd) {
         return 0.0f;
     }
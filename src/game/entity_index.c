@@ -0,0 +1,364 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "entity_index.h"
+#include "../lib/public/khash.h"
+#include "../main.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+KHASH_MAP_INIT_INT(slot, uint32_t)
+
+struct slot{
+    uint32_t uid;
+    uint32_t gen;
+    bool     live;
+    uint32_t comps;
+    /* Position of the slot in the member list of every component it has */
+    uint32_t member_idx[ENT_COMP_MAX];
+};
+
+struct members{
+    size_t    size;
+    size_t    capacity;
+    uint32_t *slots;
+    uint32_t *uids;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static khash_t(slot)  *s_uid_slot;
+static struct slot    *s_slots;
+static size_t          s_slots_end;
+static size_t          s_slots_cap;
+/* The freed slots below 's_slots_end', reused last-in first-out */
+static uint32_t       *s_free;
+static size_t          s_nfree;
+static struct members  s_members[ENT_COMP_MAX];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool ei_grow_slots(size_t need)
+{
+    if(need <= s_slots_cap)
+        return true;
+
+    size_t newcap = s_slots_cap ? s_slots_cap * 2 : 1024;
+    while(newcap < need)
+        newcap *= 2;
+
+    struct slot *slots = realloc(s_slots, newcap * sizeof(struct slot));
+    if(!slots)
+        return false;
+    memset(slots + s_slots_cap, 0, (newcap - s_slots_cap) * sizeof(struct slot));
+    s_slots = slots;
+
+    uint32_t *free_slots = realloc(s_free, newcap * sizeof(uint32_t));
+    if(!free_slots)
+        return false;
+    s_free = free_slots;
+
+    s_slots_cap = newcap;
+    return true;
+}
+
+static bool ei_grow_members(struct members *mem, size_t need)
+{
+    if(need <= mem->capacity)
+        return true;
+
+    size_t newcap = mem->capacity ? mem->capacity * 2 : 256;
+    while(newcap < need)
+        newcap *= 2;
+
+    uint32_t *slots = realloc(mem->slots, newcap * sizeof(uint32_t));
+    if(!slots)
+        return false;
+    mem->slots = slots;
+
+    uint32_t *uids = realloc(mem->uids, newcap * sizeof(uint32_t));
+    if(!uids)
+        return false;
+    mem->uids = uids;
+
+    mem->capacity = newcap;
+    return true;
+}
+
+static void ei_members_remove(enum ent_comp comp, uint32_t slot)
+{
+    struct members *mem = &s_members[comp];
+    uint32_t idx = s_slots[slot].member_idx[comp];
+    assert(idx < mem->size && mem->slots[idx] == slot);
+
+    /* Move the last member into the freed position */
+    uint32_t last = mem->slots[mem->size - 1];
+    mem->slots[idx] = last;
+    mem->uids[idx] = mem->uids[mem->size - 1];
+    s_slots[last].member_idx[comp] = idx;
+    mem->size--;
+
+    s_slots[slot].comps &= ~(1u << comp);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_EntIndex_Init(void)
+{
+    if(!(s_uid_slot = kh_init(slot)))
+        return false;
+    s_slots = NULL;
+    s_slots_end = 0;
+    s_slots_cap = 0;
+    s_free = NULL;
+    s_nfree = 0;
+    memset(s_members, 0, sizeof(s_members));
+    return true;
+}
+
+void G_EntIndex_Shutdown(void)
+{
+    for(int i = 0; i < ENT_COMP_MAX; i++) {
+        free(s_members[i].slots);
+        free(s_members[i].uids);
+    }
+    memset(s_members, 0, sizeof(s_members));
+    free(s_slots);
+    free(s_free);
+    s_slots = NULL;
+    s_free = NULL;
+    s_slots_end = s_slots_cap = s_nfree = 0;
+    kh_destroy(slot, s_uid_slot);
+    s_uid_slot = NULL;
+}
+
+void G_EntIndex_Clear(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    /* Keep the generations, so that references taken before the 
+     * clear don't resolve to the entities added after it. */
+    for(size_t i = 0; i < s_slots_end; i++) {
+        if(!s_slots[i].live)
+            continue;
+        s_slots[i].live = false;
+        s_slots[i].comps = 0;
+        s_slots[i].gen++;
+    }
+    for(int i = 0; i < ENT_COMP_MAX; i++) {
+        s_members[i].size = 0;
+    }
+    s_slots_end = 0;
+    s_nfree = 0;
+    kh_clear(slot, s_uid_slot);
+}
+
+bool G_EntIndex_Reserve(size_t count)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    size_t nents = kh_size(s_uid_slot) + count;
+    if(!ei_grow_slots(nents))
+        return false;
+    /* The khash load factor is 0.77 */
+    if(kh_resize(slot, s_uid_slot, nents + nents / 3 + 1) < 0)
+        return false;
+    return true;
+}
+
+uint32_t G_EntIndex_Add(uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    int status;
+    khiter_t k = kh_put(slot, s_uid_slot, uid, &status);
+    if(status == -1)
+        return ENT_SLOT_NONE;
+    if(status == 0)
+        return kh_val(s_uid_slot, k);
+
+    uint32_t slot;
+    if(s_nfree > 0) {
+        slot = s_free[--s_nfree];
+    }else{
+        if(!ei_grow_slots(s_slots_end + 1)) {
+            kh_del(slot, s_uid_slot, k);
+            return ENT_SLOT_NONE;
+        }
+        slot = s_slots_end++;
+    }
+
+    struct slot *curr = &s_slots[slot];
+    assert(!curr->live);
+    curr->uid = uid;
+    curr->live = true;
+    curr->comps = 0;
+    kh_val(s_uid_slot, k) = slot;
+    return slot;
+}
+
+void G_EntIndex_Remove(uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    khiter_t k = kh_get(slot, s_uid_slot, uid);
+    if(k == kh_end(s_uid_slot))
+        return;
+
+    uint32_t slot = kh_val(s_uid_slot, k);
+    kh_del(slot, s_uid_slot, k);
+
+    struct slot *curr = &s_slots[slot];
+    for(int i = 0; i < ENT_COMP_MAX && curr->comps; i++) {
+        if(curr->comps & (1u << i))
+            ei_members_remove(i, slot);
+    }
+    curr->live = false;
+    curr->gen++;
+
+    /* The free list has room for every slot */
+    s_free[s_nfree++] = slot;
+}
+
+uint32_t G_EntIndex_Slot(uint32_t uid)
+{
+    khiter_t k = kh_get(slot, s_uid_slot, uid);
+    if(k == kh_end(s_uid_slot))
+        return ENT_SLOT_NONE;
+    return kh_val(s_uid_slot, k);
+}
+
+uint32_t G_EntIndex_Uid(uint32_t slot)
+{
+    assert(slot < s_slots_end && s_slots[slot].live);
+    return s_slots[slot].uid;
+}
+
+size_t G_EntIndex_SlotsEnd(void)
+{
+    return s_slots_end;
+}
+
+size_t G_EntIndex_Count(void)
+{
+    return kh_size(s_uid_slot);
+}
+
+bool G_EntIndex_Ref(uint32_t uid, struct ent_ref *out)
+{
+    uint32_t slot = G_EntIndex_Slot(uid);
+    if(slot == ENT_SLOT_NONE)
+        return false;
+    *out = (struct ent_ref){slot, s_slots[slot].gen};
+    return true;
+}
+
+bool G_EntIndex_Deref(struct ent_ref ref, uint32_t *out_uid)
+{
+    if(ref.slot >= s_slots_end)
+        return false;
+    const struct slot *curr = &s_slots[ref.slot];
+    if(!curr->live || curr->gen != ref.gen)
+        return false;
+    *out_uid = curr->uid;
+    return true;
+}
+
+bool G_EntIndex_AddComponent(uint32_t uid, enum ent_comp comp)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(comp >= 0 && comp < ENT_COMP_MAX);
+
+    uint32_t slot = G_EntIndex_Slot(uid);
+    if(slot == ENT_SLOT_NONE)
+        return false;
+
+    struct slot *curr = &s_slots[slot];
+    if(curr->comps & (1u << comp))
+        return true;
+
+    struct members *mem = &s_members[comp];
+    if(!ei_grow_members(mem, mem->size + 1))
+        return false;
+
+    curr->member_idx[comp] = mem->size;
+    mem->slots[mem->size] = slot;
+    mem->uids[mem->size] = uid;
+    mem->size++;
+    curr->comps |= (1u << comp);
+    return true;
+}
+
+void G_EntIndex_RemoveComponent(uint32_t uid, enum ent_comp comp)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(comp >= 0 && comp < ENT_COMP_MAX);
+
+    uint32_t slot = G_EntIndex_Slot(uid);
+    if(slot == ENT_SLOT_NONE)
+        return;
+    if(!(s_slots[slot].comps & (1u << comp)))
+        return;
+    ei_members_remove(comp, slot);
+}
+
+bool G_EntIndex_HasComponent(uint32_t uid, enum ent_comp comp)
+{
+    uint32_t slot = G_EntIndex_Slot(uid);
+    if(slot == ENT_SLOT_NONE)
+        return false;
+    return !!(s_slots[slot].comps & (1u << comp));
+}
+
+size_t G_EntIndex_Members(enum ent_comp comp, const uint32_t **out_slots, 
+                          const uint32_t **out_uids)
+{
+    assert(comp >= 0 && comp < ENT_COMP_MAX);
+    const struct members *mem = &s_members[comp];
+    if(out_slots)
+        *out_slots = mem->slots;
+    if(out_uids)
+        *out_uids = mem->uids;
+    return mem->size;
+}
+
@@ -0,0 +1,123 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef ENTITY_INDEX_H
+#define ENTITY_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* A registry giving every live entity a dense slot index, so that the game 
+ * subsystems can keep per-entity data in flat arrays indexed by the slot 
+ * instead of each keying its own hash table by the sparse uid. A freed slot 
+ * is handed out again to the next entity, and every slot carries a generation 
+ * counter that is bumped when it is freed, so that an 'ent_ref' can detect 
+ * that its entity is gone. 
+ *
+ * The registry also records which subsystems ('components') every entity is 
+ * registered with. Each component keeps a dense member list, so iterating 
+ * over all the entities with a component touches only those entities. Slots 
+ * are not saved - they are assigned anew as the entities are re-added on 
+ * load. All functions must be called from the main thread.
+ */
+
+#define ENT_SLOT_NONE  (~(uint32_t)0)
+
+enum ent_comp{
+    ENT_COMP_ANIM,
+    ENT_COMP_MOVEMENT,
+    ENT_COMP_COMBAT,
+    ENT_COMP_BUILDING,
+    ENT_COMP_BUILDER,
+    ENT_COMP_HARVESTER,
+    ENT_COMP_RESOURCE,
+    ENT_COMP_STORAGE_SITE,
+    ENT_COMP_GARRISON,
+    ENT_COMP_GARRISONABLE,
+    ENT_COMP_MAX
+};
+
+struct ent_ref{
+    uint32_t slot;
+    uint32_t gen;
+};
+
+bool            G_EntIndex_Init(void);
+void            G_EntIndex_Shutdown(void);
+void            G_EntIndex_Clear(void);
+/* Size the registry for 'count' more entities */
+bool            G_EntIndex_Reserve(size_t count);
+
+/* Returns the slot given to the entity, or ENT_SLOT_NONE on failure */
+uint32_t        G_EntIndex_Add(uint32_t uid);
+/* Releases the entity's slot and removes it from all its components. 
+ * Removing an entity that is not in the registry is a no-op. */
+void            G_EntIndex_Remove(uint32_t uid);
+
+/* Returns ENT_SLOT_NONE if the entity is not in the registry */
+uint32_t        G_EntIndex_Slot(uint32_t uid);
+uint32_t        G_EntIndex_Uid(uint32_t slot);
+/* One past the highest slot that is in use. Arrays indexed by slot which 
+ * are this long can be indexed by the slot of any live entity. */
+size_t          G_EntIndex_SlotsEnd(void);
+size_t          G_EntIndex_Count(void);
+
+bool            G_EntIndex_Ref(uint32_t uid, struct ent_ref *out);
+/* Returns false if the referenced entity has since been removed */
+bool            G_EntIndex_Deref(struct ent_ref ref, uint32_t *out_uid);
+
+bool            G_EntIndex_AddComponent(uint32_t uid, enum ent_comp comp);
+void            G_EntIndex_RemoveComponent(uint32_t uid, enum ent_comp comp);
+bool            G_EntIndex_HasComponent(uint32_t uid, enum ent_comp comp);
+
+/* The slots and uids of all the entities having the component, in parallel 
+ * arrays and in no particular order. The arrays are invalidated when the 
+ * component is next added to or removed from an entity. */
+size_t          G_EntIndex_Members(enum ent_comp comp, const uint32_t **out_slots, 
+                                   const uint32_t **out_uids);
+
+#define G_EntIndex_FOREACH(comp, uidvar, ...)                                   \
+    do{                                                                         \
+        const uint32_t *__slots, *__uids;                                       \
+        size_t __n = G_EntIndex_Members((comp), &__slots, &__uids);             \
+        for(size_t __i = 0; __i < __n; __i++) {                                 \
+            (uidvar) = __uids[__i];                                             \
+            __VA_ARGS__;                                                        \
+        }                                                                       \
+    }while(0)
+
+#endif
+
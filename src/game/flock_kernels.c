@@ -0,0 +1,481 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "flock_kernels.h"
+
+#include <math.h>
+#include <SDL.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) \
+ || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLOCK_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/* Range reduction and polynomial constants for exp (Cephes) */
+#define EXP_HI      ( 88.3762626647949f)
+#define EXP_LO      (-88.3762626647949f)
+#define LOG2EF      (1.44269504088896341f)
+#define EXP_C1      (0.693359375f)
+#define EXP_C2      (-2.12194440e-4f)
+#define EXP_P0      (1.9875691500E-4f)
+#define EXP_P1      (1.3981999507E-3f)
+#define EXP_P2      (8.3334519073E-3f)
+#define EXP_P3      (4.1665795894E-2f)
+#define EXP_P4      (1.6666665459E-1f)
+#define EXP_P5      (5.0000001201E-1f)
+
+struct flock_kernels{
+    const char *name;
+    vec2_t (*cohesion)(const float*, const float*, size_t, vec2_t, float, float, float);
+    vec2_t (*separation)(const float*, const float*, const float*, size_t, float, float, float);
+    vec2_t (*alignment)(const float*, const float*, const float*, const float*, size_t, 
+                        vec2_t, float, float, size_t*);
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static vec2_t cohesion_scalar(const float *pos_x, const float *pos_z, size_t n,
+                              vec2_t pos, float inner, float radius, float decay)
+{
+    vec2_t ret = (vec2_t){0.0f, 0.0f};
+    for(size_t i = 0; i < n; i++) {
+
+        float dx = pos_x[i] - pos.x;
+        float dz = pos_z[i] - pos.z;
+        float t = (sqrtf(dx * dx + dz * dz) - inner) / radius;
+        float scale = expf(decay * t);
+
+        ret.x += pos_x[i] * scale;
+        ret.z += pos_z[i] * scale;
+    }
+    return ret;
+}
+
+static vec2_t separation_scalar(const float *diff_x, const float *diff_z, const float *radius, 
+                                size_t n, float ratio, float decay, float eps)
+{
+    vec2_t ret = (vec2_t){0.0f, 0.0f};
+    for(size_t i = 0; i < n; i++) {
+
+        float len = sqrtf(diff_x[i] * diff_x[i] + diff_z[i] * diff_z[i]);
+        if(len < eps)
+            continue;
+
+        float t = (len - radius[i] * ratio) / len;
+        float scale = expf(decay * t);
+
+        ret.x += diff_x[i] * scale;
+        ret.z += diff_z[i] * scale;
+    }
+    return ret;
+}
+
+static vec2_t alignment_scalar(const float *pos_x, const float *pos_z, 
+                               const float *vel_x, const float *vel_z, size_t n,
+                               vec2_t pos, float radius, float eps, size_t *inout_count)
+{
+    vec2_t ret = (vec2_t){0.0f, 0.0f};
+    for(size_t i = 0; i < n; i++) {
+
+        float dx = pos_x[i] - pos.x;
+        float dz = pos_z[i] - pos.z;
+        if(dx * dx + dz * dz >= radius * radius)
+            continue;
+        if(vel_x[i] * vel_x[i] + vel_z[i] * vel_z[i] < eps * eps)
+            continue;
+
+        ret.x += vel_x[i];
+        ret.z += vel_z[i];
+        (*inout_count)++;
+    }
+    return ret;
+}
+
+#if FLOCK_X86
+
+static __m128 exp_sse(__m128 x)
+{
+    x = _mm_min_ps(x, _mm_set1_ps(EXP_HI));
+    x = _mm_max_ps(x, _mm_set1_ps(EXP_LO));
+
+    /* exp(x) = 2^n * exp(r), where n = round(x / ln(2)) */
+    __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(LOG2EF)), _mm_set1_ps(0.5f));
+    __m128 tmp = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+    __m128 mask = _mm_and_ps(_mm_cmpgt_ps(tmp, fx), _mm_set1_ps(1.0f));
+    fx = _mm_sub_ps(tmp, mask);
+
+    x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(EXP_C1)));
+    x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(EXP_C2)));
+
+    __m128 z = _mm_mul_ps(x, x);
+    __m128 y = _mm_set1_ps(EXP_P0);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P1));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P2));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P3));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P4));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P5));
+    y = _mm_add_ps(_mm_mul_ps(y, z), x);
+    y = _mm_add_ps(y, _mm_set1_ps(1.0f));
+
+    __m128i n = _mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127));
+    __m128 pow2n = _mm_castsi128_ps(_mm_slli_epi32(n, 23));
+    return _mm_mul_ps(y, pow2n);
+}
+
+static float hsum_sse(__m128 v)
+{
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+static vec2_t cohesion_sse(const float *pos_x, const float *pos_z, size_t n,
+                           vec2_t pos, float inner, float radius, float decay)
+{
+    const __m128 px = _mm_set1_ps(pos.x);
+    const __m128 pz = _mm_set1_ps(pos.z);
+    const __m128 vinner = _mm_set1_ps(inner);
+    const __m128 vscale = _mm_set1_ps(decay / radius);
+
+    __m128 sum_x = _mm_setzero_ps();
+    __m128 sum_z = _mm_setzero_ps();
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4) {
+
+        __m128 x = _mm_loadu_ps(pos_x + i);
+        __m128 z = _mm_loadu_ps(pos_z + i);
+        __m128 dx = _mm_sub_ps(x, px);
+        __m128 dz = _mm_sub_ps(z, pz);
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+        __m128 scale = exp_sse(_mm_mul_ps(_mm_sub_ps(len, vinner), vscale));
+
+        sum_x = _mm_add_ps(sum_x, _mm_mul_ps(x, scale));
+        sum_z = _mm_add_ps(sum_z, _mm_mul_ps(z, scale));
+    }
+
+    vec2_t ret = cohesion_scalar(pos_x + i, pos_z + i, n - i, pos, inner, radius, decay);
+    ret.x += hsum_sse(sum_x);
+    ret.z += hsum_sse(sum_z);
+    return ret;
+}
+
+static vec2_t separation_sse(const float *diff_x, const float *diff_z, const float *radius, 
+                             size_t n, float ratio, float decay, float eps)
+{
+    const __m128 vratio = _mm_set1_ps(ratio);
+    const __m128 vdecay = _mm_set1_ps(decay);
+    const __m128 veps = _mm_set1_ps(eps);
+
+    __m128 sum_x = _mm_setzero_ps();
+    __m128 sum_z = _mm_setzero_ps();
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4) {
+
+        __m128 dx = _mm_loadu_ps(diff_x + i);
+        __m128 dz = _mm_loadu_ps(diff_z + i);
+        __m128 r = _mm_loadu_ps(radius + i);
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+        __m128 valid = _mm_cmpge_ps(len, veps);
+
+        __m128 t = _mm_div_ps(_mm_sub_ps(len, _mm_mul_ps(r, vratio)), _mm_max_ps(len, veps));
+        __m128 scale = _mm_and_ps(exp_sse(_mm_mul_ps(t, vdecay)), valid);
+
+        sum_x = _mm_add_ps(sum_x, _mm_mul_ps(dx, scale));
+        sum_z = _mm_add_ps(sum_z, _mm_mul_ps(dz, scale));
+    }
+
+    vec2_t ret = separation_scalar(diff_x + i, diff_z + i, radius + i, n - i, ratio, decay, eps);
+    ret.x += hsum_sse(sum_x);
+    ret.z += hsum_sse(sum_z);
+    return ret;
+}
+
+static vec2_t alignment_sse(const float *pos_x, const float *pos_z, 
+                            const float *vel_x, const float *vel_z, size_t n,
+                            vec2_t pos, float radius, float eps, size_t *inout_count)
+{
+    const __m128 px = _mm_set1_ps(pos.x);
+    const __m128 pz = _mm_set1_ps(pos.z);
+    const __m128 vradius_sq = _mm_set1_ps(radius * radius);
+    const __m128 veps_sq = _mm_set1_ps(eps * eps);
+
+    __m128 sum_x = _mm_setzero_ps();
+    __m128 sum_z = _mm_setzero_ps();
+    size_t count = 0;
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4) {
+
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(pos_x + i), px);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(pos_z + i), pz);
+        __m128 vx = _mm_loadu_ps(vel_x + i);
+        __m128 vz = _mm_loadu_ps(vel_z + i);
+
+        __m128 dist_sq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+        __m128 vel_sq = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vz, vz));
+        __m128 mask = _mm_and_ps(_mm_cmplt_ps(dist_sq, vradius_sq), _mm_cmpge_ps(vel_sq, veps_sq));
+
+        sum_x = _mm_add_ps(sum_x, _mm_and_ps(vx, mask));
+        sum_z = _mm_add_ps(sum_z, _mm_and_ps(vz, mask));
+
+        int bits = _mm_movemask_ps(mask);
+        count += (bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+    }
+
+    vec2_t ret = alignment_scalar(pos_x + i, pos_z + i, vel_x + i, vel_z + i, n - i, 
+        pos, radius, eps, inout_count);
+    ret.x += hsum_sse(sum_x);
+    ret.z += hsum_sse(sum_z);
+    *inout_count += count;
+    return ret;
+}
+
+TARGET_AVX2
+static __m256 exp_avx2(__m256 x)
+{
+    x = _mm256_min_ps(x, _mm256_set1_ps(EXP_HI));
+    x = _mm256_max_ps(x, _mm256_set1_ps(EXP_LO));
+
+    __m256 fx = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(LOG2EF)), 
+        _mm256_set1_ps(0.5f)));
+
+    x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(EXP_C1)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(EXP_C2)));
+
+    __m256 z = _mm256_mul_ps(x, x);
+    __m256 y = _mm256_set1_ps(EXP_P0);
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P1));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P2));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P3));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P4));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(EXP_P5));
+    y = _mm256_add_ps(_mm256_mul_ps(y, z), x);
+    y = _mm256_add_ps(y, _mm256_set1_ps(1.0f));
+
+    __m256i n = _mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127));
+    __m256 pow2n = _mm256_castsi256_ps(_mm256_slli_epi32(n, 23));
+    return _mm256_mul_ps(y, pow2n);
+}
+
+TARGET_AVX2
+static float hsum_avx2(__m256 v)
+{
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    return hsum_sse(_mm_add_ps(lo, hi));
+}
+
+TARGET_AVX2
+static vec2_t cohesion_avx2(const float *pos_x, const float *pos_z, size_t n,
+                            vec2_t pos, float inner, float radius, float decay)
+{
+    const __m256 px = _mm256_set1_ps(pos.x);
+    const __m256 pz = _mm256_set1_ps(pos.z);
+    const __m256 vinner = _mm256_set1_ps(inner);
+    const __m256 vscale = _mm256_set1_ps(decay / radius);
+
+    __m256 sum_x = _mm256_setzero_ps();
+    __m256 sum_z = _mm256_setzero_ps();
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8) {
+
+        __m256 x = _mm256_loadu_ps(pos_x + i);
+        __m256 z = _mm256_loadu_ps(pos_z + i);
+        __m256 dx = _mm256_sub_ps(x, px);
+        __m256 dz = _mm256_sub_ps(z, pz);
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz)));
+        __m256 scale = exp_avx2(_mm256_mul_ps(_mm256_sub_ps(len, vinner), vscale));
+
+        sum_x = _mm256_add_ps(sum_x, _mm256_mul_ps(x, scale));
+        sum_z = _mm256_add_ps(sum_z, _mm256_mul_ps(z, scale));
+    }
+
+    vec2_t ret = cohesion_sse(pos_x + i, pos_z + i, n - i, pos, inner, radius, decay);
+    ret.x += hsum_avx2(sum_x);
+    ret.z += hsum_avx2(sum_z);
+    return ret;
+}
+
+TARGET_AVX2
+static vec2_t separation_avx2(const float *diff_x, const float *diff_z, const float *radius, 
+                              size_t n, float ratio, float decay, float eps)
+{
+    const __m256 vratio = _mm256_set1_ps(ratio);
+    const __m256 vdecay = _mm256_set1_ps(decay);
+    const __m256 veps = _mm256_set1_ps(eps);
+
+    __m256 sum_x = _mm256_setzero_ps();
+    __m256 sum_z = _mm256_setzero_ps();
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8) {
+
+        __m256 dx = _mm256_loadu_ps(diff_x + i);
+        __m256 dz = _mm256_loadu_ps(diff_z + i);
+        __m256 r = _mm256_loadu_ps(radius + i);
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz)));
+        __m256 valid = _mm256_cmp_ps(len, veps, _CMP_GE_OQ);
+
+        __m256 t = _mm256_div_ps(_mm256_sub_ps(len, _mm256_mul_ps(r, vratio)), 
+            _mm256_max_ps(len, veps));
+        __m256 scale = _mm256_and_ps(exp_avx2(_mm256_mul_ps(t, vdecay)), valid);
+
+        sum_x = _mm256_add_ps(sum_x, _mm256_mul_ps(dx, scale));
+        sum_z = _mm256_add_ps(sum_z, _mm256_mul_ps(dz, scale));
+    }
+
+    vec2_t ret = separation_sse(diff_x + i, diff_z + i, radius + i, n - i, ratio, decay, eps);
+    ret.x += hsum_avx2(sum_x);
+    ret.z += hsum_avx2(sum_z);
+    return ret;
+}
+
+TARGET_AVX2
+static vec2_t alignment_avx2(const float *pos_x, const float *pos_z, 
+                             const float *vel_x, const float *vel_z, size_t n,
+                             vec2_t pos, float radius, float eps, size_t *inout_count)
+{
+    const __m256 px = _mm256_set1_ps(pos.x);
+    const __m256 pz = _mm256_set1_ps(pos.z);
+    const __m256 vradius_sq = _mm256_set1_ps(radius * radius);
+    const __m256 veps_sq = _mm256_set1_ps(eps * eps);
+
+    __m256 sum_x = _mm256_setzero_ps();
+    __m256 sum_z = _mm256_setzero_ps();
+    size_t count = 0;
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8) {
+
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(pos_x + i), px);
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(pos_z + i), pz);
+        __m256 vx = _mm256_loadu_ps(vel_x + i);
+        __m256 vz = _mm256_loadu_ps(vel_z + i);
+
+        __m256 dist_sq = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+        __m256 vel_sq = _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vz, vz));
+        __m256 mask = _mm256_and_ps(_mm256_cmp_ps(dist_sq, vradius_sq, _CMP_LT_OQ), 
+                                    _mm256_cmp_ps(vel_sq, veps_sq, _CMP_GE_OQ));
+
+        sum_x = _mm256_add_ps(sum_x, _mm256_and_ps(vx, mask));
+        sum_z = _mm256_add_ps(sum_z, _mm256_and_ps(vz, mask));
+
+        unsigned bits = _mm256_movemask_ps(mask);
+        for(; bits; bits &= bits - 1)
+            count++;
+    }
+
+    vec2_t ret = alignment_sse(pos_x + i, pos_z + i, vel_x + i, vel_z + i, n - i, 
+        pos, radius, eps, inout_count);
+    ret.x += hsum_avx2(sum_x);
+    ret.z += hsum_avx2(sum_z);
+    *inout_count += count;
+    return ret;
+}
+
+#endif /* FLOCK_X86 */
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static const struct flock_kernels s_scalar_kernels = {
+    "scalar", cohesion_scalar, separation_scalar, alignment_scalar
+};
+
+#if FLOCK_X86
+static const struct flock_kernels s_sse_kernels = {
+    "sse2", cohesion_sse, separation_sse, alignment_sse
+};
+static const struct flock_kernels s_avx2_kernels = {
+    "avx2", cohesion_avx2, separation_avx2, alignment_avx2
+};
+#endif
+
+static const struct flock_kernels *s_kernels = &s_scalar_kernels;
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void G_Flock_SelectKernels(void)
+{
+    s_kernels = &s_scalar_kernels;
+#if FLOCK_X86
+    if(SDL_HasSSE2())
+        s_kernels = &s_sse_kernels;
+    if(SDL_HasAVX2())
+        s_kernels = &s_avx2_kernels;
+#endif
+}
+
+const char *G_Flock_KernelName(void)
+{
+    return s_kernels->name;
+}
+
+vec2_t G_Flock_CohesionSum(const float *pos_x, const float *pos_z, size_t n,
+                           vec2_t pos, float inner, float radius, float decay)
+{
+    return s_kernels->cohesion(pos_x, pos_z, n, pos, inner, radius, decay);
+}
+
+vec2_t G_Flock_SeparationSum(const float *diff_x, const float *diff_z, const float *radius, 
+                             size_t n, float ratio, float decay, float eps)
+{
+    return s_kernels->separation(diff_x, diff_z, radius, n, ratio, decay, eps);
+}
+
+vec2_t G_Flock_AlignmentSum(const float *pos_x, const float *pos_z, 
+                            const float *vel_x, const float *vel_z, size_t n,
+                            vec2_t pos, float radius, float eps, size_t *inout_count)
+{
+    return s_kernels->alignment(pos_x, pos_z, vel_x, vel_z, n, pos, radius, eps, inout_count);
+}
+
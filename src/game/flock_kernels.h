@@ -0,0 +1,68 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef FLOCK_KERNELS_H
+#define FLOCK_KERNELS_H
+
+#include "../pf_math.h"
+#include <stddef.h>
+
+/* Packed kernels for accumulating the flocking forces over arrays of 
+ * neighbours. An SSE2 or AVX2 implementation is selected at runtime based 
+ * on what the CPU supports, with a scalar fallback.
+ */
+
+void        G_Flock_SelectKernels(void);
+const char *G_Flock_KernelName(void);
+
+/* Returns the sum of pos[i] * exp(decay * (|pos[i] - pos| - inner) / radius) 
+ * over the 'n' positions. */
+vec2_t G_Flock_CohesionSum(const float *pos_x, const float *pos_z, size_t n,
+                           vec2_t pos, float inner, float radius, float decay);
+
+/* Returns the sum of diff[i] * exp(decay * (|diff[i]| - radius[i] * ratio) / |diff[i]|) 
+ * over the 'n' offsets, skipping those shorter than 'eps'. */
+vec2_t G_Flock_SeparationSum(const float *diff_x, const float *diff_z, const float *radius, 
+                             size_t n, float ratio, float decay, float eps);
+
+/* Returns the sum of the velocities which are at least 'eps' long, of all the
+ * entities which are within 'radius' of 'pos'. The number of such entities 
+ * is added to 'inout_count'. */
+vec2_t G_Flock_AlignmentSum(const float *pos_x, const float *pos_z, 
+                            const float *vel_x, const float *vel_z, size_t n,
+                            vec2_t pos, float radius, float eps, size_t *inout_count);
+
+#endif
+
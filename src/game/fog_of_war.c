@@ -37,6 +37,7 @@
 #include "public/game.h"
 #include "position.h"
 #include "game_private.h"
+#include "../main.h"
 #include "../event.h"
 #include "../settings.h"
 #include "../sched.h"
@@ -52,6 +53,8 @@
 
 #include <stdint.h>
 #include <assert.h>
+#include <string.h>
+#include <limits.h>
 #include <SDL.h>
 
 
@@ -59,8 +62,14 @@
 #define MAX(a, b)               ((a) > (b) ? (a) : (b))
 #define CLAMP(a, min, max)      (MIN(MAX((a), (min)), (max)))
 #define ARR_SIZE(a)             (sizeof(a)/sizeof(a[0]))
-#define FAC_STATE(val, fac_id)  (((val) >> ((fac_id) * 2)) & 0x3)
 #define IDX(r, width, c)        ((r) * (width) + (c))
+#define WORD_BITS               (64)
+#define SEEN_CACHE_SIZE         (256)
+#define SEEN_CACHE_MAX_WORDS    (128)
+#define SNAP_BLOCK_ROWS         (16)
+/* The number of words of a mask covering the tiles in the specified bounds */
+#define MASK_NWORDS(rmin, rmax, cmin, cmax) \
+    (((rmax) - (rmin) + 1) * ((cmax) / WORD_BITS - (cmin) / WORD_BITS + 1))
 
 #define CHK_TRUE_RET(_pred)             \
     do{                                 \
@@ -79,40 +88,205 @@ PQUEUE_IMPL(static, td, struct tile_desc)
 
 KHASH_SET_INIT_INT(uid)
 
+/* A rectangular window of the fog bitplanes. The columns are aligned to
+ * the words of the planes, so that the masks can be combined with them 
+ * a whole word at a time. 
+ */
+struct fog_mask{
+    int       r0, nrows;
+    int       w0, nwords;
+    uint64_t *bits;
+};
+
+/* The tiles seen from the center of an origin tile. These only depend on
+ * the origin tile, the vision radius and the heights of the surrounding 
+ * terrain, so they are cached for units that keep moving between the same
+ * tiles. */
+struct seen_entry{
+    bool      valid;
+    int       r, c;
+    int       height;
+    float     radius;
+    uint64_t  bits[SEEN_CACHE_MAX_WORDS];
+};
+
+/* A copy of 'SNAP_BLOCK_ROWS' rows of the 'visible' plane of a faction. 
+ * Blocks are immutable once published, and are shared between all the 
+ * snapshots taken while the rows they cover did not change. The 
+ * reference count is only ever touched from the main thread.
+ */
+struct fog_block{
+    int       refcount;
+    uint64_t  words[];
+};
+
+/* A view of the 'visible' planes of all factions, at the time it was 
+ * acquired. The blocks are in faction-major order. */
+struct fog_snapshot{
+    int               refcount;
+    size_t            row_words;
+    int               nblocks;
+    struct fog_block *blocks[];
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static const struct map *s_map;
-/* Holds a 32-bit value for every tile of the map. The chunks are stored in row-major
- * order. Within a chunk, the tiles are in row-major order. Each 32-bit value encodes
- * a 2-bit faction state for up to 16 factions. */
-static uint32_t         *s_fog_state;
-/* How many units of a faction currently 'see' every tile. */
+/* The fog state is kept as bitplanes holding one bit for every tile of the
+ * map, with the tiles in row-major order across chunk boundaries. Every 
+ * faction has a plane of the tiles it currently sees, and a plane of the 
+ * tiles it has ever seen. A tile is 'in fog' when it's been explored but 
+ * is not visible. Every row is padded to a whole number of words. */
+static uint64_t         *s_visible[MAX_FACTIONS];
+static uint64_t         *s_explored[MAX_FACTIONS];
+static int               s_rows, s_cols;
+static size_t            s_row_words;
+/* How many units of a faction currently 'see' every tile, in the same 
+ * order as the bits of the planes. */
 static uint8_t          *s_vision_refcnts[MAX_FACTIONS];
 /* Cache all the entities that have been explored by the player, for faster queries */
 static khash_t(uid)     *s_explored_cache;
+static struct seen_entry *s_seen_cache;
+/* The chunks whose fog state changed since it was last sent to the 
+ * render thread. Only these get re-uploaded. */
+static bool             *s_dirty_chunks;
+/* The latest copy of every block of the 'visible' planes, and whether its 
+ * rows have changed since the copy was made. The snapshots handed out to 
+ * readers are assembled from these, so each acquire only copies the 
+ * blocks that were written to since the previous one. */
+static struct fog_block **s_blocks;
+static bool             *s_blocks_dirty;
+static int               s_nblocks;
+static bool              s_any_block_dirty;
+static struct fog_snapshot *s_last_snapshot;
+/* The factions whose fog state is shown, as of the last upload */
+static uint16_t          s_player_mask;
 static bool              s_enabled = true;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool fog_any_matches(uint32_t val, enum fog_state state)
+static int popcount64(uint64_t word)
 {
-    for(;val; val >>= 2) {
-        if((val & 0x3) == state)
-            return true;
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ull);
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (int)((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+static int lowest_bit(uint64_t word)
+{
+    assert(word);
+    return popcount64((word & -word) - 1);
+}
+
+static int highest_bit(uint64_t word)
+{
+    assert(word);
+#if defined(__GNUC__)
+    return (WORD_BITS - 1) - __builtin_clzll(word);
+#else
+    int ret = 0;
+    while(word >>= 1)
+        ret++;
+    return ret;
+#endif
+}
+
+static void mark_dirty(int rmin, int rmax, int cmin, int cmax)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    for(int cr = rmin / res.tile_h; cr <= rmax / res.tile_h; cr++) {
+    for(int cc = cmin / res.tile_w; cc <= cmax / res.tile_w; cc++) {
+        s_dirty_chunks[cr * res.chunk_w + cc] = true;
+    }}
+}
+
+static void mark_all_dirty(void)
+{
+    if(!s_map)
+        return;
+
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+    memset(s_dirty_chunks, true, sizeof(bool) * res.chunk_w * res.chunk_h);
+}
+
+static void mark_blocks_dirty(int faction_id, int rmin, int rmax)
+{
+    if(!s_blocks_dirty)
+        return;
+
+    for(int b = rmin / SNAP_BLOCK_ROWS; b <= rmax / SNAP_BLOCK_ROWS; b++) {
+        s_blocks_dirty[faction_id * s_nblocks + b] = true;
     }
-    return false;
+    s_any_block_dirty = true;
 }
 
-static void fog_set_state(uint32_t *inout_tileval, int faction_id, enum fog_state state)
+static void mark_all_blocks_dirty(void)
 {
-    assert(state >= 0 && state < 4);
-    uint32_t val = *inout_tileval & ~(0x3 << faction_id * 2);
-    val |= (state << (faction_id * 2));
-    *inout_tileval = val;
+    if(!s_blocks_dirty)
+        return;
+
+    memset(s_blocks_dirty, true, sizeof(bool) * s_nblocks * MAX_FACTIONS);
+    s_any_block_dirty = true;
+}
+
+static void block_release(struct fog_block *block)
+{
+    if(block && --block->refcount == 0)
+        free(block);
+}
+
+static size_t block_rows(int b)
+{
+    return MIN(SNAP_BLOCK_ROWS, s_rows - b * SNAP_BLOCK_ROWS);
+}
+
+static void snapshot_release(struct fog_snapshot *snap)
+{
+    if(!snap || --snap->refcount > 0)
+        return;
+
+    for(int i = 0; i < snap->nblocks * MAX_FACTIONS; i++) {
+        block_release(snap->blocks[i]);
+    }
+    free(snap);
+}
+
+static const uint64_t *snapshot_row(const struct fog_snapshot *snap, int faction_id, int r)
+{
+    const struct fog_block *block = snap->blocks[faction_id * snap->nblocks + r / SNAP_BLOCK_ROWS];
+    return block->words + (r % SNAP_BLOCK_ROWS) * snap->row_words;
+}
+
+static void td_row_col(struct tile_desc td, int *out_r, int *out_c)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    *out_r = td.chunk_r * res.tile_h + td.tile_r;
+    *out_c = td.chunk_c * res.tile_w + td.tile_c;
+}
+
+static struct tile_desc td_for_row_col(int r, int c)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    return (struct tile_desc){
+        r / res.tile_h, c / res.tile_w,
+        r % res.tile_h, c % res.tile_w
+    };
 }
 
 static int td_index(struct tile_desc td)
@@ -125,18 +299,198 @@ static int td_index(struct tile_desc td)
         + (td.tile_r * res.tile_w + td.tile_c);
 }
 
-static void update_tile(int faction_id, struct tile_desc td, int delta)
+static bool plane_test(const uint64_t *plane, size_t row_words, int r, int c)
+{
+    return (plane[r * row_words + c / WORD_BITS] >> (c % WORD_BITS)) & 0x1;
+}
+
+static void plane_set(uint64_t *plane, int r, int c)
 {
-    uint8_t old = s_vision_refcnts[faction_id][td_index(td)];
-    uint8_t new = old + delta;
+    plane[r * s_row_words + c / WORD_BITS] |= (((uint64_t)1) << (c % WORD_BITS));
+}
 
-    if(new) {
-        fog_set_state(s_fog_state + td_index(td), faction_id, STATE_VISIBLE);
-    }else{
-        fog_set_state(s_fog_state + td_index(td), faction_id, STATE_IN_FOG);
+static enum fog_state fog_tile_state(int faction_id, int r, int c)
+{
+    if(plane_test(s_visible[faction_id], s_row_words, r, c))
+        return STATE_VISIBLE;
+    if(plane_test(s_explored[faction_id], s_row_words, r, c))
+        return STATE_IN_FOG;
+    return STATE_UNEXPLORED;
+}
+
+static size_t fac_planes(uint64_t *const planes[], uint16_t fac_mask, const uint64_t *out[])
+{
+    size_t ret = 0;
+    for(int i = 0; fac_mask; fac_mask >>= 1, i++) {
+        if(fac_mask & 0x1)
+            out[ret++] = planes[i];
+    }
+    return ret;
+}
+
+static void mask_init(struct fog_mask *mask, int rmin, int rmax, int cmin, int cmax, uint64_t *bits)
+{
+    mask->r0 = rmin;
+    mask->nrows = rmax - rmin + 1;
+    mask->w0 = cmin / WORD_BITS;
+    mask->nwords = cmax / WORD_BITS - mask->w0 + 1;
+    mask->bits = bits;
+    memset(bits, 0, sizeof(uint64_t) * mask->nrows * mask->nwords);
+}
+
+static void mask_set(struct fog_mask *mask, int r, int c)
+{
+    int wr = r - mask->r0;
+    int wc = c / WORD_BITS - mask->w0;
+    assert(wr >= 0 && wr < mask->nrows);
+    assert(wc >= 0 && wc < mask->nwords);
+    mask->bits[wr * mask->nwords + wc] |= (((uint64_t)1) << (c % WORD_BITS));
+}
+
+static void mask_or(uint64_t *plane, const struct fog_mask *mask)
+{
+    for(int r = 0; r < mask->nrows; r++) {
+
+        uint64_t *dst = plane + (mask->r0 + r) * s_row_words + mask->w0;
+        const uint64_t *src = mask->bits + r * mask->nwords;
+        for(int w = 0; w < mask->nwords; w++) {
+            dst[w] |= src[w];
+        }
     }
+}
 
-    s_vision_refcnts[faction_id][td_index(td)] = new;
+static void mask_andnot(uint64_t *plane, const struct fog_mask *mask)
+{
+    for(int r = 0; r < mask->nrows; r++) {
+
+        uint64_t *dst = plane + (mask->r0 + r) * s_row_words + mask->w0;
+        const uint64_t *src = mask->bits + r * mask->nwords;
+        for(int w = 0; w < mask->nwords; w++) {
+            dst[w] &= ~src[w];
+        }
+    }
+}
+
+/* Count the tiles of the mask which are set in at least one of the planes */
+static size_t mask_count(const uint64_t *planes[], size_t nplanes, size_t row_words, 
+                         const struct fog_mask *mask)
+{
+    size_t ret = 0;
+    for(int r = 0; r < mask->nrows; r++) {
+
+        size_t base = (mask->r0 + r) * row_words + mask->w0;
+        const uint64_t *src = mask->bits + r * mask->nwords;
+
+        for(int w = 0; w < mask->nwords; w++) {
+
+            if(!src[w])
+                continue;
+            uint64_t any = 0;
+            for(int i = 0; i < nplanes; i++) {
+                any |= planes[i][base + w];
+            }
+            ret += popcount64(any & src[w]);
+        }
+    }
+    return ret;
+}
+
+static void tiles_bounds(const struct tile_desc *tds, size_t ntiles, 
+                         int *out_rmin, int *out_rmax, int *out_cmin, int *out_cmax)
+{
+    *out_rmin = INT_MAX, *out_cmin = INT_MAX;
+    *out_rmax = INT_MIN, *out_cmax = INT_MIN;
+
+    for(int i = 0; i < ntiles; i++) {
+        int r, c;
+        td_row_col(tds[i], &r, &c);
+        *out_rmin = MIN(*out_rmin, r);
+        *out_rmax = MAX(*out_rmax, r);
+        *out_cmin = MIN(*out_cmin, c);
+        *out_cmax = MAX(*out_cmax, c);
+    }
+}
+
+/* Same as mask_count, but over the planes of a snapshot */
+static size_t snapshot_mask_count(const struct fog_snapshot *snap, uint16_t fac_mask, 
+                                  const struct fog_mask *mask)
+{
+    int factions[MAX_FACTIONS];
+    size_t nfacs = 0;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(fac_mask & (0x1 << i))
+            factions[nfacs++] = i;
+    }
+
+    size_t ret = 0;
+    for(int r = 0; r < mask->nrows; r++) {
+
+        const uint64_t *rows[MAX_FACTIONS];
+        for(int i = 0; i < nfacs; i++) {
+            rows[i] = snapshot_row(snap, factions[i], mask->r0 + r) + mask->w0;
+        }
+        const uint64_t *src = mask->bits + r * mask->nwords;
+
+        for(int w = 0; w < mask->nwords; w++) {
+
+            if(!src[w])
+                continue;
+            uint64_t any = 0;
+            for(int i = 0; i < nfacs; i++) {
+                any |= rows[i][w];
+            }
+            ret += popcount64(any & src[w]);
+        }
+    }
+    return ret;
+}
+
+static void mask_set_tiles(struct fog_mask *mask, const struct tile_desc *tds, size_t ntiles)
+{
+    for(int i = 0; i < ntiles; i++) {
+        int r, c;
+        td_row_col(tds[i], &r, &c);
+        mask_set(mask, r, c);
+    }
+}
+
+/* Returns true if any of the tiles is set in any of the planes */
+static bool fog_tiles_match(const uint64_t *planes[], size_t nplanes, size_t row_words, 
+                            const struct tile_desc *tds, size_t ntiles)
+{
+    if(ntiles == 0 || nplanes == 0)
+        return false;
+
+    int rmin, rmax, cmin, cmax;
+    tiles_bounds(tds, ntiles, &rmin, &rmax, &cmin, &cmax);
+
+    STALLOC(uint64_t, bits, MASK_NWORDS(rmin, rmax, cmin, cmax));
+    struct fog_mask mask;
+    mask_init(&mask, rmin, rmax, cmin, cmax, bits);
+    mask_set_tiles(&mask, tds, ntiles);
+
+    size_t count = mask_count(planes, nplanes, row_words, &mask);
+    STFREE(bits);
+    return (count > 0);
+}
+
+static void fog_explore_tiles(int faction_id, const struct tile_desc *tds, size_t ntiles)
+{
+    if(ntiles == 0)
+        return;
+
+    int rmin, rmax, cmin, cmax;
+    tiles_bounds(tds, ntiles, &rmin, &rmax, &cmin, &cmax);
+
+    STALLOC(uint64_t, bits, MASK_NWORDS(rmin, rmax, cmin, cmax));
+    struct fog_mask mask;
+    mask_init(&mask, rmin, rmax, cmin, cmax, bits);
+    mask_set_tiles(&mask, tds, ntiles);
+
+    mask_or(s_explored[faction_id], &mask);
+    if(s_player_mask & (0x1 << faction_id))
+        mark_dirty(rmin, rmax, cmin, cmax);
+    STFREE(bits);
 }
 
 static size_t neighbours(struct tile_desc curr, struct tile_desc *out)
@@ -269,26 +623,34 @@ void td_delta(struct tile_desc a, struct tile_desc b, int *out_dr, int *out_dc)
     *out_dc = bc - ac;
 }
 
-static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int delta)
+static void seen_bounds(int origin_r, int origin_c, float radius, 
+                        int *out_rmin, int *out_rmax, int *out_cmin, int *out_cmax)
 {
-    if(radius == 0.0f)
-        return;
+    const int tile_x_radius = ceil(radius / X_COORDS_PER_TILE) + 1;
+    const int tile_z_radius = ceil(radius / Z_COORDS_PER_TILE) + 1;
 
+    *out_rmin = MAX(origin_r - tile_z_radius, 0);
+    *out_rmax = MIN(origin_r + tile_z_radius, s_rows - 1);
+    *out_cmin = MAX(origin_c - tile_x_radius, 0);
+    *out_cmax = MIN(origin_c + tile_x_radius, s_cols - 1);
+}
+
+/* Flood fill outwards from the origin tile, stopping at the tiles which
+ * block the line of sight and at the shadows cast by them. The tiles that
+ * are reached are set in the mask. */
+static void fog_compute_seen(struct tile_desc origin, int origin_height, float radius, 
+                             struct fog_mask *seen)
+{
     struct map_resolution res;
     M_GetResolution(s_map, &res);
 
-    struct tile_desc origin;
-    bool status = M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &origin);
-    assert(status);
-
-    struct tile *tile;
-    M_TileForDesc(s_map, origin, &tile);
-    int origin_height = M_Tile_BaseHeight(tile);
-
     const int tile_x_radius = ceil(radius / X_COORDS_PER_TILE) + 1;
     const int tile_z_radius = ceil(radius / Z_COORDS_PER_TILE) + 1;
     assert(tile_x_radius && tile_z_radius);
 
+    int origin_r, origin_c;
+    td_row_col(origin, &origin_r, &origin_c);
+
     /* Declare a byte for every tile within a box having a half-length of 'radius' 
      * that surrounds the position. When the position is near the map edge, some
      * elements may be unused.  wf_blocked[tile_x_radius][tile_z_radius] gives the 
@@ -305,7 +667,7 @@ static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int
 
     pq_td_push(&frontier, 0.0f, origin);
     visited[IDX(tile_x_radius, 2 * tile_x_radius + 1, tile_z_radius)] = true;
-    update_tile(faction_id, origin, delta);
+    mask_set(seen, origin_r, origin_c);
 
     while(pq_size(&frontier) > 0) {
 
@@ -344,83 +706,165 @@ static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int
             if(td_los_blocked(neighbs[i], origin_height))
                 continue;
 
-            update_tile(faction_id, neighbs[i], delta);
+            mask_set(seen, origin_r + dr, origin_c + dc);
             pq_td_push(&frontier, PFM_Vec2_Len(&origin_delta), neighbs[i]);
         }
     }
 
     pq_td_destroy(&frontier);
-
     STFREE(wf_blocked);
     STFREE(visited);
 }
 
-static bool fog_obj_matches(uint32_t *state, uint16_t fac_mask, const struct obb *obj, 
-                            enum fog_state *states, size_t nstates)
+static uint32_t seen_hash(int r, int c, float radius)
 {
-    assert(Sched_UsingBigStack());
+    uint32_t rbits;
+    memcpy(&rbits, &radius, sizeof(rbits));
 
-    vec3_t pos = M_GetPos(s_map);
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
+    uint32_t ret = 2166136261u;
+    ret = (ret ^ (uint32_t)r) * 16777619u;
+    ret = (ret ^ (uint32_t)c) * 16777619u;
+    ret = (ret ^ rbits) * 16777619u;
+    return ret;
+}
 
-    uint32_t facstate_mask = 0;
-    for(int i = 0; fac_mask; fac_mask >>= 1, i++) {
-        if(fac_mask & 0x1) {
-            facstate_mask |= (0x3 << (i * 2));
+/* Fill the mask (which must already be initialized to the bounds given 
+ * by 'seen_bounds') with the tiles seen from the origin tile, using the 
+ * cached result when there is one. 
+ */
+static void fog_get_seen(struct tile_desc origin, float radius, struct fog_mask *out)
+{
+    struct tile *tile;
+    M_TileForDesc(s_map, origin, &tile);
+    int origin_height = M_Tile_BaseHeight(tile);
+
+    int r, c;
+    td_row_col(origin, &r, &c);
+
+    const size_t nwords = out->nrows * out->nwords;
+    struct seen_entry *entry = &s_seen_cache[seen_hash(r, c, radius) % SEEN_CACHE_SIZE];
+
+    if(entry->valid 
+    && entry->r == r 
+    && entry->c == c
+    && entry->height == origin_height 
+    && entry->radius == radius) {
+
+        memcpy(out->bits, entry->bits, sizeof(uint64_t) * nwords);
+        return;
+    }
+
+    fog_compute_seen(origin, origin_height, radius, out);
+    if(nwords > SEEN_CACHE_MAX_WORDS)
+        return;
+
+    entry->valid = true;
+    entry->r = r;
+    entry->c = c;
+    entry->height = origin_height;
+    entry->radius = radius;
+    memcpy(entry->bits, out->bits, sizeof(uint64_t) * nwords);
+}
+
+/* Drop the tiles set in both masks, leaving only the tiles seen 
+ * exclusively from one or the other. */
+static void mask_symdiff(struct fog_mask *a, struct fog_mask *b)
+{
+    const int rmin = MAX(a->r0, b->r0);
+    const int rmax = MIN(a->r0 + a->nrows, b->r0 + b->nrows);
+    const int wmin = MAX(a->w0, b->w0);
+    const int wmax = MIN(a->w0 + a->nwords, b->w0 + b->nwords);
+
+    for(int r = rmin; r < rmax; r++) {
+
+        uint64_t *wa = a->bits + (r - a->r0) * a->nwords - a->w0;
+        uint64_t *wb = b->bits + (r - b->r0) * b->nwords - b->w0;
+
+        for(int w = wmin; w < wmax; w++) {
+            uint64_t both = wa[w] & wb[w];
+            wa[w] &= ~both;
+            wb[w] &= ~both;
         }
     }
+}
 
-    struct tile_desc tds[4096];
-    size_t ntiles = M_Tile_AllUnderObj(pos, res, obj, tds, ARR_SIZE(tds));
+/* Adjust the reference counts of every tile of the mask and update the 
+ * faction's planes a word at a time. When removing vision, only the tiles 
+ * which are no longer seen by any unit get cleared from the 'visible' plane.
+ */
+static void fog_apply_seen(int faction_id, struct fog_mask *seen, int delta)
+{
+    int rmin = INT_MAX, rmax = INT_MIN;
+    int cmin = INT_MAX, cmax = INT_MIN;
 
-    for(int i = 0; i < ntiles; i++) {
+    uint8_t *refcnts = s_vision_refcnts[faction_id];
+    for(int r = 0; r < seen->nrows; r++) {
+    for(int w = 0; w < seen->nwords; w++) {
 
-        int idx = td_index(tds[i]);
-        uint32_t fac_state = state[idx] & facstate_mask;
+        uint64_t *word = &seen->bits[r * seen->nwords + w];
+        if(!*word)
+            continue;
 
-        for(int j = 0; j < nstates; j++) {
-            if(fog_any_matches(fac_state, states[j]))
-                return true;
+        rmin = MIN(rmin, seen->r0 + r);
+        rmax = MAX(rmax, seen->r0 + r);
+        cmin = MIN(cmin, (seen->w0 + w) * WORD_BITS + lowest_bit(*word));
+        cmax = MAX(cmax, (seen->w0 + w) * WORD_BITS + highest_bit(*word));
+
+        for(uint64_t left = *word; left; left &= (left - 1)) {
+
+            int bit = lowest_bit(left);
+            int idx = (seen->r0 + r) * s_cols + (seen->w0 + w) * WORD_BITS + bit;
+            refcnts[idx] += delta;
+
+            if(delta < 0 && refcnts[idx] > 0)
+                *word &= ~(((uint64_t)1) << bit);
         }
+    }}
+
+    if(delta > 0) {
+        mask_or(s_visible[faction_id], seen);
+        mask_or(s_explored[faction_id], seen);
+    }else{
+        mask_andnot(s_visible[faction_id], seen);
     }
-    return false;
+
+    if(rmin <= rmax)
+        mark_blocks_dirty(faction_id, rmin, rmax);
+
+    if((s_player_mask & (0x1 << faction_id)) && rmin <= rmax)
+        mark_dirty(rmin, rmax, cmin, cmax);
 }
 
-static bool fog_circle_matches(uint16_t fac_mask, vec2_t xz_center, float radius, 
-                               enum fog_state *states, size_t nstates)
+static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int delta)
 {
-    assert(Sched_UsingBigStack());
+    if(radius == 0.0f)
+        return;
 
-    vec3_t pos = M_GetPos(s_map);
     struct map_resolution res;
     M_GetResolution(s_map, &res);
 
-    uint32_t facstate_mask = 0;
-    for(int i = 0; fac_mask; fac_mask >>= 1, i++) {
-        if(fac_mask & 0x1) {
-            facstate_mask |= (0x3 << (i * 2));
-        }
-    }
+    struct tile_desc origin;
+    bool status = M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &origin);
+    assert(status);
 
-    struct tile_desc tds[4096];
-    size_t ntiles = M_Tile_AllUnderCircle(res, xz_center, radius, M_GetPos(s_map), tds, ARR_SIZE(tds));
+    int r, c;
+    td_row_col(origin, &r, &c);
 
-    for(int i = 0; i < ntiles; i++) {
+    int rmin, rmax, cmin, cmax;
+    seen_bounds(r, c, radius, &rmin, &rmax, &cmin, &cmax);
 
-        int idx = td_index(tds[i]);
-        uint32_t fac_state = s_fog_state[idx] & facstate_mask;
+    STALLOC(uint64_t, bits, MASK_NWORDS(rmin, rmax, cmin, cmax));
+    struct fog_mask seen;
+    mask_init(&seen, rmin, rmax, cmin, cmax, bits);
 
-        for(int j = 0; j < nstates; j++) {
-            if(fog_any_matches(fac_state, states[j]))
-                return true;
-        }
-    }
-    return false;
+    fog_get_seen(origin, radius, &seen);
+    fog_apply_seen(faction_id, &seen, delta);
+
+    STFREE(bits);
 }
 
-static bool fog_rect_matches(uint16_t fac_mask, vec2_t xz_center, float halfx, float halfz, 
-                             enum fog_state *states, size_t nstates)
+static bool fog_obj_matches(uint64_t *const planes[], size_t row_words, uint16_t fac_mask, 
+                            const struct obb *obj)
 {
     assert(Sched_UsingBigStack());
 
@@ -428,28 +872,45 @@ static bool fog_rect_matches(uint16_t fac_mask, vec2_t xz_center, float halfx, f
     struct map_resolution res;
     M_GetResolution(s_map, &res);
 
-    uint32_t facstate_mask = 0;
-    for(int i = 0; fac_mask; fac_mask >>= 1, i++) {
-        if(fac_mask & 0x1) {
-            facstate_mask |= (0x3 << (i * 2));
-        }
-    }
+    struct tile_desc tds[4096];
+    size_t ntiles = M_Tile_AllUnderObj(pos, res, obj, tds, ARR_SIZE(tds));
+
+    const uint64_t *facplanes[MAX_FACTIONS];
+    size_t nplanes = fac_planes(planes, fac_mask, facplanes);
+    return fog_tiles_match(facplanes, nplanes, row_words, tds, ntiles);
+}
+
+static bool fog_circle_matches(uint64_t *const planes[], uint16_t fac_mask, 
+                               vec2_t xz_center, float radius)
+{
+    assert(Sched_UsingBigStack());
+
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
 
     struct tile_desc tds[4096];
-    size_t ntiles = M_Tile_AllUnderAABB(res, xz_center, halfx, halfz, 
-        M_GetPos(s_map), tds, ARR_SIZE(tds));
+    size_t ntiles = M_Tile_AllUnderCircle(res, xz_center, radius, M_GetPos(s_map), tds, ARR_SIZE(tds));
 
-    for(int i = 0; i < ntiles; i++) {
+    const uint64_t *facplanes[MAX_FACTIONS];
+    size_t nplanes = fac_planes(planes, fac_mask, facplanes);
+    return fog_tiles_match(facplanes, nplanes, s_row_words, tds, ntiles);
+}
 
-        int idx = td_index(tds[i]);
-        uint32_t fac_state = s_fog_state[idx] & facstate_mask;
+static bool fog_rect_matches(uint64_t *const planes[], uint16_t fac_mask, 
+                             vec2_t xz_center, float halfx, float halfz)
+{
+    assert(Sched_UsingBigStack());
 
-        for(int j = 0; j < nstates; j++) {
-            if(fog_any_matches(fac_state, states[j]))
-                return true;
-        }
-    }
-    return false;
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    struct tile_desc tds[4096];
+    size_t ntiles = M_Tile_AllUnderAABB(res, xz_center, halfx, halfz, 
+        M_GetPos(s_map), tds, ARR_SIZE(tds));
+
+    const uint64_t *facplanes[MAX_FACTIONS];
+    size_t nplanes = fac_planes(planes, fac_mask, facplanes);
+    return fog_tiles_match(facplanes, nplanes, s_row_words, tds, ntiles);
 }
 
 static void on_render_3d(void *user, void *event)
@@ -477,14 +938,20 @@ bool G_Fog_Init(const struct map *map)
 {
     struct map_resolution res;
     M_GetResolution(map, &res);
-    const size_t ntiles = res.chunk_w * res.chunk_h * res.tile_w * res.tile_h;
 
-    s_fog_state = calloc(sizeof(s_fog_state[0]), ntiles);
-    if(!s_fog_state)
-        goto fail;
+    s_rows = res.chunk_h * res.tile_h;
+    s_cols = res.chunk_w * res.tile_w;
+    s_row_words = (s_cols + WORD_BITS - 1) / WORD_BITS;
+    const size_t plane_words = s_rows * s_row_words;
 
     for(int i = 0; i < MAX_FACTIONS; i++) {
-        s_vision_refcnts[i] = calloc(sizeof(s_vision_refcnts[0]), ntiles);
+        s_visible[i] = calloc(sizeof(uint64_t), plane_words);
+        if(!s_visible[i])
+            goto fail;
+        s_explored[i] = calloc(sizeof(uint64_t), plane_words);
+        if(!s_explored[i])
+            goto fail;
+        s_vision_refcnts[i] = calloc(sizeof(s_vision_refcnts[0][0]), s_rows * s_cols);
         if(!s_vision_refcnts[i])
             goto fail;
     }
@@ -493,14 +960,40 @@ bool G_Fog_Init(const struct map *map)
     if(!s_explored_cache)
         goto fail;
 
+    s_seen_cache = calloc(SEEN_CACHE_SIZE, sizeof(struct seen_entry));
+    if(!s_seen_cache)
+        goto fail;
+
+    s_dirty_chunks = malloc(sizeof(bool) * res.chunk_w * res.chunk_h);
+    if(!s_dirty_chunks)
+        goto fail;
+
+    s_nblocks = (s_rows + SNAP_BLOCK_ROWS - 1) / SNAP_BLOCK_ROWS;
+    s_blocks = calloc(s_nblocks * MAX_FACTIONS, sizeof(struct fog_block*));
+    if(!s_blocks)
+        goto fail;
+
+    s_blocks_dirty = malloc(sizeof(bool) * s_nblocks * MAX_FACTIONS);
+    if(!s_blocks_dirty)
+        goto fail;
+
     s_map = map;
+    s_player_mask = 0;
+    s_last_snapshot = NULL;
+    mark_all_dirty();
+    mark_all_blocks_dirty();
     E_Global_Register(EVENT_RENDER_3D_POST, on_render_3d, NULL, G_RUNNING | G_PAUSED_UI_RUNNING | G_PAUSED_FULL);
     return true;
 
 fail:
     kh_destroy(uid, s_explored_cache);
-    PF_FREE(s_fog_state);
+    PF_FREE(s_seen_cache);
+    PF_FREE(s_dirty_chunks);
+    PF_FREE(s_blocks);
+    PF_FREE(s_blocks_dirty);
     for(int i = 0; i < MAX_FACTIONS; i++) {
+        PF_FREE(s_visible[i]);
+        PF_FREE(s_explored[i]);
         PF_FREE(s_vision_refcnts[i]);
     }
     return false;
@@ -511,11 +1004,26 @@ void G_Fog_Shutdown(void)
     E_Global_Unregister(EVENT_RENDER_3D_POST, on_render_3d);
 
     kh_destroy(uid, s_explored_cache);
-    PF_FREE(s_fog_state);
+    PF_FREE(s_seen_cache);
+    PF_FREE(s_dirty_chunks);
+
+    /* Outstanding snapshots keep their own references to the blocks */
+    snapshot_release(s_last_snapshot);
+    s_last_snapshot = NULL;
+    for(int i = 0; i < s_nblocks * MAX_FACTIONS; i++) {
+        block_release(s_blocks[i]);
+    }
+    PF_FREE(s_blocks);
+    PF_FREE(s_blocks_dirty);
+    s_nblocks = 0;
 
     for(int i = 0; i < MAX_FACTIONS; i++) {
+        PF_FREE(s_visible[i]);
+        PF_FREE(s_explored[i]);
         PF_FREE(s_vision_refcnts[i]);
     }
+    memset(s_visible, 0, sizeof(s_visible));
+    memset(s_explored, 0, sizeof(s_explored));
     memset(s_vision_refcnts, 0, sizeof(s_vision_refcnts));
     s_map = NULL;
 }
@@ -530,6 +1038,61 @@ void G_Fog_RemoveVision(vec2_t xz_pos, int faction_id, float radius)
     fog_update_visible(faction_id, xz_pos, radius, -1);
 }
 
+void G_Fog_MoveVision(vec2_t old_xz_pos, vec2_t new_xz_pos, int faction_id, float radius)
+{
+    if(radius == 0.0f)
+        return;
+
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    struct tile_desc old_origin, new_origin;
+    bool status = M_Tile_DescForPoint2D(res, M_GetPos(s_map), old_xz_pos, &old_origin);
+    assert(status);
+    status = M_Tile_DescForPoint2D(res, M_GetPos(s_map), new_xz_pos, &new_origin);
+    assert(status);
+    (void)status;
+
+    /* The vision is computed from the center of the origin tile */
+    if(0 == memcmp(&old_origin, &new_origin, sizeof(struct tile_desc)))
+        return;
+
+    int old_r, old_c, new_r, new_c;
+    td_row_col(old_origin, &old_r, &old_c);
+    td_row_col(new_origin, &new_r, &new_c);
+
+    int old_rmin, old_rmax, old_cmin, old_cmax;
+    seen_bounds(old_r, old_c, radius, &old_rmin, &old_rmax, &old_cmin, &old_cmax);
+
+    int new_rmin, new_rmax, new_cmin, new_cmax;
+    seen_bounds(new_r, new_c, radius, &new_rmin, &new_rmax, &new_cmin, &new_cmax);
+
+    STALLOC(uint64_t, old_bits, MASK_NWORDS(old_rmin, old_rmax, old_cmin, old_cmax));
+    STALLOC(uint64_t, new_bits, MASK_NWORDS(new_rmin, new_rmax, new_cmin, new_cmax));
+
+    struct fog_mask old_seen, new_seen;
+    mask_init(&old_seen, old_rmin, old_rmax, old_cmin, old_cmax, old_bits);
+    mask_init(&new_seen, new_rmin, new_rmax, new_cmin, new_cmax, new_bits);
+
+    fog_get_seen(old_origin, radius, &old_seen);
+    fog_get_seen(new_origin, radius, &new_seen);
+
+    /* The reference counts of tiles seen from both positions stay the same */
+    mask_symdiff(&old_seen, &new_seen);
+    fog_apply_seen(faction_id, &old_seen, -1);
+    fog_apply_seen(faction_id, &new_seen, +1);
+
+    STFREE(old_bits);
+    STFREE(new_bits);
+}
+
+void G_Fog_InvalidateLOSCache(void)
+{
+    if(!s_seen_cache)
+        return;
+    memset(s_seen_cache, 0, sizeof(struct seen_entry) * SEEN_CACHE_SIZE);
+}
+
 void G_Fog_ExploreCircle(vec2_t xz_pos, int faction_id, float radius)
 {
     assert(Sched_UsingBigStack());
@@ -539,11 +1102,7 @@ void G_Fog_ExploreCircle(vec2_t xz_pos, int faction_id, float radius)
 
     struct tile_desc tds[4096];
     size_t ntiles = M_Tile_AllUnderCircle(res, xz_pos, radius, M_GetPos(s_map), tds, ARR_SIZE(tds));
-
-    for(int i = 0; i < ntiles; i++) {
-        update_tile(faction_id, tds[i], +1);
-        update_tile(faction_id, tds[i], -1);
-    }
+    fog_explore_tiles(faction_id, tds, ntiles);
 }
 
 void G_Fog_ExploreRectangle(vec2_t xz_pos, int faction_id, float halfx, float halfz)
@@ -555,11 +1114,7 @@ void G_Fog_ExploreRectangle(vec2_t xz_pos, int faction_id, float halfx, float ha
 
     struct tile_desc tds[4096];
     size_t ntiles = M_Tile_AllUnderAABB(res, xz_pos, halfx, halfz, M_GetPos(s_map), tds, ARR_SIZE(tds));
-
-    for(int i = 0; i < ntiles; i++) {
-        update_tile(faction_id, tds[i], +1);
-        update_tile(faction_id, tds[i], -1);
-    }
+    fog_explore_tiles(faction_id, tds, ntiles);
 }
 
 bool G_Fog_Visible(int faction_id, vec2_t xz_pos)
@@ -571,7 +1126,9 @@ bool G_Fog_Visible(int faction_id, vec2_t xz_pos)
     if(!M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &td))
         return false;
 
-    return (FAC_STATE(s_fog_state[td_index(td)], faction_id) == STATE_VISIBLE);
+    int r, c;
+    td_row_col(td, &r, &c);
+    return plane_test(s_visible[faction_id], s_row_words, r, c);
 }
 
 bool G_Fog_PlayerVisible(vec2_t xz_pos)
@@ -586,14 +1143,16 @@ bool G_Fog_PlayerVisible(vec2_t xz_pos)
     if(!M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &td))
         return false;
 
+    int r, c;
+    td_row_col(td, &r, &c);
+
     bool controllable[MAX_FACTIONS];
     uint16_t facs = G_GetFactions(NULL, NULL, controllable);
-    uint32_t fs = s_fog_state[td_index(td)];
 
     for(int i = 0; facs; facs >>= 1, i++) {
         if(!(facs & 0x1) || !controllable[i])
             continue;
-        if(FAC_STATE(fs, i) == STATE_VISIBLE)
+        if(plane_test(s_visible[i], s_row_words, r, c))
             return true;
     }
     return false;
@@ -608,7 +1167,9 @@ bool G_Fog_Explored(int faction_id, vec2_t xz_pos)
     if(!M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &td))
         return false;
 
-    return (FAC_STATE(s_fog_state[td_index(td)], faction_id) != STATE_UNEXPLORED);
+    int r, c;
+    td_row_col(td, &r, &c);
+    return plane_test(s_explored[faction_id], s_row_words, r, c);
 }
 
 bool G_Fog_PlayerExplored(vec2_t xz_pos)
@@ -623,14 +1184,16 @@ bool G_Fog_PlayerExplored(vec2_t xz_pos)
     if(!M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &td))
         return false;
 
+    int r, c;
+    td_row_col(td, &r, &c);
+
     bool controllable[MAX_FACTIONS];
     uint16_t facs = G_GetFactions(NULL, NULL, controllable);
-    uint32_t fs = s_fog_state[td_index(td)];
 
     for(int i = 0; facs; facs >>= 1, i++) {
         if(!(facs & 0x1) || !controllable[i])
             continue;
-        if(FAC_STATE(fs, i) != STATE_UNEXPLORED)
+        if(plane_test(s_explored[i], s_row_words, r, c))
             return true;
     }
     return false;
@@ -664,7 +1227,9 @@ void G_Fog_RenderChunkVisibility(int faction_id, int chunk_r, int chunk_c, mat4x
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z};
 
         struct tile_desc curr = (struct tile_desc){chunk_r, chunk_c, r, c};
-        enum fog_state state = FAC_STATE(s_fog_state[td_index(curr)], faction_id);
+        int tr, tc;
+        td_row_col(curr, &tr, &tc);
+        enum fog_state state = fog_tile_state(faction_id, tr, tc);
         *colors_base++ = state == STATE_UNEXPLORED ? (vec3_t){0.0f, 0.0f, 0.0f}
                        : state == STATE_IN_FOG     ? (vec3_t){1.0f, 1.0f, 0.0f}
                        : state == STATE_VISIBLE    ? (vec3_t){0.0f, 1.0f, 0.0f}
@@ -699,49 +1264,86 @@ void G_Fog_UpdateVisionState(void)
     bool controllable[MAX_FACTIONS];
     uint16_t facs = G_GetFactions(NULL, NULL, controllable);
 
-    uint32_t player_mask = 0;
+    uint16_t player_mask = 0;
     for(int i = 0; facs; facs >>= 1, i++) {
         if((facs & 0x1) && controllable[i])
-            player_mask |= (0x3 << (i * 2));
+            player_mask |= (0x1 << i);
+    }
+
+    if(player_mask != s_player_mask) {
+        s_player_mask = player_mask;
+        mark_all_dirty();
     }
 
     struct map_resolution res;
     M_GetResolution(s_map, &res);
 
-    size_t size = res.chunk_h * res.tile_h * res.chunk_w * res.tile_w;
-    unsigned char *visbuff = stalloc(&G_GetSimWS()->args, size);
-
-    if(!s_enabled) {
-        memset(visbuff, STATE_VISIBLE, size);
-        goto submit;
+    const size_t nchunks = res.chunk_w * res.chunk_h;
+    size_t ndirty = 0;
+    for(int i = 0; i < nchunks; i++) {
+        ndirty += s_dirty_chunks[i];
     }
 
-    for(int cr = 0; cr < res.chunk_h; cr++) {
-    for(int cc = 0; cc < res.chunk_w; cc++) {
+    if(ndirty == 0)
+        PERF_RETURN_VOID();
+
+    const size_t tiles_per_chunk = res.tile_w * res.tile_h;
+    unsigned char *visbuff = stalloc(&G_GetSimWS()->args, ndirty * tiles_per_chunk);
+    int *chunks = stalloc(&G_GetSimWS()->args, ndirty * sizeof(int));
+
+    const uint64_t *visible[MAX_FACTIONS], *explored[MAX_FACTIONS];
+    size_t nplanes = fac_planes(s_visible, player_mask, visible);
+    fac_planes(s_explored, player_mask, explored);
+
+    size_t ichunk = 0;
+    for(int i = 0; i < nchunks; i++) {
+
+        if(!s_dirty_chunks[i])
+            continue;
+        s_dirty_chunks[i] = false;
+
+        unsigned char *out = visbuff + ichunk * tiles_per_chunk;
+        chunks[ichunk++] = i;
+
+        if(!s_enabled) {
+            memset(out, STATE_VISIBLE, tiles_per_chunk);
+            continue;
+        }
+
+        const int chunk_r = i / res.chunk_w;
+        const int chunk_c = i % res.chunk_w;
 
         for(int tr = 0; tr < res.tile_h; tr++) {
         for(int tc = 0; tc < res.tile_w; tc++) {
 
-            struct tile_desc td = (struct tile_desc){cr, cc, tr, tc};
-            int idx = td_index(td);
-            uint32_t player_state = s_fog_state[idx] & player_mask;
+            int r = chunk_r * res.tile_h + tr;
+            int c = chunk_c * res.tile_w + tc;
+            size_t word = r * s_row_words + c / WORD_BITS;
+            int bit = c % WORD_BITS;
+
+            uint64_t vis = 0, exp = 0;
+            for(int j = 0; j < nplanes; j++) {
+                vis |= visible[j][word];
+                exp |= explored[j][word];
+            }
 
-            if(!player_state)
-                visbuff[idx] = STATE_UNEXPLORED;
-            else if(fog_any_matches(player_state, STATE_VISIBLE))
-                visbuff[idx] = STATE_VISIBLE;
+            if((vis >> bit) & 0x1)
+                *out++ = STATE_VISIBLE;
+            else if((exp >> bit) & 0x1)
+                *out++ = STATE_IN_FOG;
             else
-                visbuff[idx] = STATE_IN_FOG;
+                *out++ = STATE_UNEXPLORED;
         }}
-    }}
+    }
+    assert(ichunk == ndirty);
 
-submit:
     R_PushCmd((struct rcmd){
         .func = R_GL_MapUpdateFog,
-        .nargs = 2,
+        .nargs = 3,
         .args = {
             visbuff,
-            R_PushArg(&size, sizeof(size)),
+            chunks,
+            R_PushArg(&ndirty, sizeof(ndirty)),
         },
     });
     PERF_RETURN_VOID();
@@ -756,8 +1358,7 @@ bool G_Fog_ObjExplored(uint16_t fac_mask, uint32_t uid, const struct obb *obb)
     if(k != kh_end(s_explored_cache))
         return true;
 
-    enum fog_state states[] = {STATE_IN_FOG, STATE_VISIBLE};
-    bool result = fog_obj_matches(s_fog_state, fac_mask, obb, states, ARR_SIZE(states));
+    bool result = fog_obj_matches(s_explored, s_row_words, fac_mask, obb);
 
     if(result) {
         int status;
@@ -772,8 +1373,7 @@ bool G_Fog_ObjVisible(uint16_t fac_mask, const struct obb *obb)
     if(!s_enabled)
         return true;
 
-    enum fog_state states[] = {STATE_VISIBLE};
-    return fog_obj_matches(s_fog_state, fac_mask, obb, states, ARR_SIZE(states));
+    return fog_obj_matches(s_visible, s_row_words, fac_mask, obb);
 }
 
 bool G_Fog_CircleExplored(uint16_t fac_mask, vec2_t xz_pos, float radius)
@@ -781,8 +1381,7 @@ bool G_Fog_CircleExplored(uint16_t fac_mask, vec2_t xz_pos, float radius)
     if(!s_enabled)
         return true;
 
-    enum fog_state states[] = {STATE_IN_FOG, STATE_VISIBLE};
-    return fog_circle_matches(fac_mask, xz_pos, radius, states, ARR_SIZE(states));
+    return fog_circle_matches(s_explored, fac_mask, xz_pos, radius);
 }
 
 bool G_Fog_RectExplored(uint16_t fac_mask, vec2_t xz_pos, float halfx, float halfz)
@@ -790,22 +1389,16 @@ bool G_Fog_RectExplored(uint16_t fac_mask, vec2_t xz_pos, float halfx, float hal
     if(!s_enabled)
         return true;
 
-    enum fog_state states[] = {STATE_IN_FOG, STATE_VISIBLE};
-    return fog_rect_matches(fac_mask, xz_pos, halfx, halfz, states, ARR_SIZE(states));
+    return fog_rect_matches(s_explored, fac_mask, xz_pos, halfx, halfz);
 }
 
 bool G_Fog_NearVisibleWater(uint16_t fac_mask, vec2_t xz_pos, float radius)
 {
-    vec3_t pos = M_GetPos(s_map);
     struct map_resolution res;
     M_GetResolution(s_map, &res);
 
-    uint32_t facstate_mask = 0;
-    for(int i = 0; fac_mask; fac_mask >>= 1, i++) {
-        if(fac_mask & 0x1) {
-            facstate_mask |= (0x3 << (i * 2));
-        }
-    }
+    const uint64_t *explored[MAX_FACTIONS];
+    size_t nplanes = fac_planes(s_explored, fac_mask, explored);
 
     struct tile_desc tds[4096];
     size_t ntiles = M_Tile_AllUnderCircle(res, xz_pos, radius, M_GetPos(s_map), tds, ARR_SIZE(tds));
@@ -822,15 +1415,10 @@ bool G_Fog_NearVisibleWater(uint16_t fac_mask, vec2_t xz_pos, float radius)
         if(!s_enabled)
             return true;
 
-        int idx = td_index(tds[i]);
-        uint32_t fac_state = s_fog_state[idx] & facstate_mask;
-
-        enum fog_state states[] = {
-            STATE_IN_FOG,
-            STATE_VISIBLE
-        };
-        for(int j = 0; j < ARR_SIZE(states); j++) {
-            if(fog_any_matches(fac_state, states[j]))
+        int r, c;
+        td_row_col(tds[i], &r, &c);
+        for(int j = 0; j < nplanes; j++) {
+            if(plane_test(explored[j], s_row_words, r, c))
                 return true;
         }
     }
@@ -866,16 +1454,20 @@ bool G_Fog_SaveState(struct SDL_RWops *stream)
     };
     CHK_TRUE_RET(Attr_Write(stream, &ntiles_attr, "num_tiles"));
 
-    for(int i = 0; i < ntiles; i++) {
+    /* The tiles are written in the chunk-major order of the original 
+     * per-tile state array, with the visible tiles saved as 'in fog'. */
+    for(int cr = 0; cr < res.chunk_h; cr++) {
+    for(int cc = 0; cc < res.chunk_w; cc++) {
+    for(int tr = 0; tr < res.tile_h; tr++) {
+    for(int tc = 0; tc < res.tile_w; tc++) {
+
+        int r, c;
+        td_row_col((struct tile_desc){cr, cc, tr, tc}, &r, &c);
 
-        uint32_t fs = s_fog_state[i];
+        uint32_t fs = 0;
         for(int j = 0; j < MAX_FACTIONS; j++) {
-            enum fog_state curr = (fs >> (j * 2)) & 0x3;
-            if(curr == STATE_VISIBLE) {
-                curr = STATE_IN_FOG;
-            }
-            fs = fs & ~(0x3 << (j * 2));
-            fs = fs | (curr << (j * 2));
+            if(plane_test(s_explored[j], s_row_words, r, c))
+                fs |= (STATE_IN_FOG << (j * 2));
         }
 
         struct attr tilestate = (struct attr){
@@ -883,7 +1475,7 @@ bool G_Fog_SaveState(struct SDL_RWops *stream)
             .val.as_int = fs
         };
         CHK_TRUE_RET(Attr_Write(stream, &tilestate, "tilestate"));
-    }
+    }}}}
 
     return true;
 }
@@ -899,73 +1491,157 @@ bool G_Fog_LoadState(struct SDL_RWops *stream)
     CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
     CHK_TRUE_RET(attr.type == TYPE_INT);
     const size_t ntiles = attr.val.as_int;
+    CHK_TRUE_RET(ntiles == s_rows * s_cols);
 
-    for(int i = 0; i < ntiles; i++) {
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        memset(s_visible[i], 0, sizeof(uint64_t) * s_rows * s_row_words);
+        memset(s_explored[i], 0, sizeof(uint64_t) * s_rows * s_row_words);
+    }
+
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    for(int cr = 0; cr < res.chunk_h; cr++) {
+    for(int cc = 0; cc < res.chunk_w; cc++) {
+    for(int tr = 0; tr < res.tile_h; tr++) {
+    for(int tc = 0; tc < res.tile_w; tc++) {
     
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
-        s_fog_state[i] = attr.val.as_int;
-    }
 
+        int r, c;
+        td_row_col((struct tile_desc){cr, cc, tr, tc}, &r, &c);
+
+        uint32_t fs = attr.val.as_int;
+        for(int j = 0; j < MAX_FACTIONS; j++) {
+            enum fog_state curr = (fs >> (j * 2)) & 0x3;
+            if(curr == STATE_VISIBLE)
+                plane_set(s_visible[j], r, c);
+            if(curr != STATE_UNEXPLORED)
+                plane_set(s_explored[j], r, c);
+        }
+    }}}}
+
+    mark_all_dirty();
+    mark_all_blocks_dirty();
     return true;
 }
 
 void G_Fog_ExploreMap(int faction_id)
 {
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
-
-    for(int chunk_c = 0; chunk_c < res.chunk_w; chunk_c++) {
-    for(int chunk_r = 0; chunk_r < res.chunk_h; chunk_r++) {
-
-        for(int tile_c = 0; tile_c < res.tile_w; tile_c++) {
-        for(int tile_r = 0; tile_r < res.tile_h; tile_r++) {
+    for(int r = 0; r < s_rows; r++) {
+    for(int w = 0; w < s_row_words; w++) {
 
-            struct tile_desc td = (struct tile_desc) {
-                chunk_r, chunk_c,
-                tile_r, tile_c
-            };
-            uint32_t ts = s_fog_state[td_index(td)];
-            if(((ts >> (faction_id * 2)) & 0x3) == STATE_UNEXPLORED) {
-                ts &= ~(0x3 << (faction_id * 2));
-                ts |= (STATE_IN_FOG << (faction_id * 2));
-            }
-            s_fog_state[td_index(td)] = ts;
-        }}
+        int nbits = MIN(s_cols - w * WORD_BITS, WORD_BITS);
+        uint64_t bits = (nbits == WORD_BITS) ? ~((uint64_t)0) : ((((uint64_t)1) << nbits) - 1);
+        s_explored[faction_id][r * s_row_words + w] |= bits;
     }}
+    mark_all_dirty();
 }
 
-uint32_t *G_Fog_CopyState(void)
+struct fog_snapshot *G_Fog_AcquireSnapshot(void)
 {
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
-    const size_t ntiles = res.chunk_w * res.chunk_h * res.tile_w * res.tile_h;
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
 
-    uint32_t *ret = malloc(sizeof(s_fog_state[0]) * ntiles);
+    if(s_last_snapshot && !s_any_block_dirty) {
+        s_last_snapshot->refcount++;
+        PERF_RETURN(s_last_snapshot);
+    }
+
+    struct fog_snapshot *ret = malloc(sizeof(struct fog_snapshot) 
+                                    + sizeof(struct fog_block*) * s_nblocks * MAX_FACTIONS);
     if(!ret)
-        return NULL;
+        PERF_RETURN(NULL);
 
-    memcpy(ret, s_fog_state, sizeof(s_fog_state[0]) * ntiles);
-    return ret;
+    /* Re-publish only the blocks whose rows have been written to */
+    size_t ncopied = 0;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+    for(int b = 0; b < s_nblocks; b++) {
+
+        int idx = i * s_nblocks + b;
+        if(!s_blocks_dirty[idx] && s_blocks[idx])
+            continue;
+
+        size_t nwords = block_rows(b) * s_row_words;
+        struct fog_block *block = malloc(sizeof(struct fog_block) + sizeof(uint64_t) * nwords);
+        if(!block) {
+            free(ret);
+            PERF_RETURN(NULL);
+        }
+        block->refcount = 1;
+        memcpy(block->words, s_visible[i] + b * SNAP_BLOCK_ROWS * s_row_words, 
+            sizeof(uint64_t) * nwords);
+
+        block_release(s_blocks[idx]);
+        s_blocks[idx] = block;
+        s_blocks_dirty[idx] = false;
+        ncopied++;
+    }}
+
+    ret->refcount = 1;
+    ret->row_words = s_row_words;
+    ret->nblocks = s_nblocks;
+    for(int i = 0; i < s_nblocks * MAX_FACTIONS; i++) {
+        ret->blocks[i] = s_blocks[i];
+        ret->blocks[i]->refcount++;
+    }
+
+    s_any_block_dirty = false;
+    snapshot_release(s_last_snapshot);
+    s_last_snapshot = ret;
+    ret->refcount++;
+
+    PERF_COUNTER_ADD("fog.snapshot_blocks_copied", ncopied);
+    PERF_RETURN(ret);
+}
+
+void G_Fog_ReleaseSnapshot(struct fog_snapshot *snap)
+{
+    ASSERT_IN_MAIN_THREAD();
+    snapshot_release(snap);
 }
 
-bool G_Fog_ObjVisibleFrom(uint32_t *state, bool enabled, uint16_t fac_mask, const struct obb *obb)
+bool G_Fog_ObjVisibleFrom(const struct fog_snapshot *snap, bool enabled, 
+                          uint16_t fac_mask, const struct obb *obb)
 {
+    assert(Sched_UsingBigStack());
+
     if(!enabled)
         return true;
 
-    enum fog_state states[] = {STATE_VISIBLE};
-    return fog_obj_matches(state, fac_mask, obb, states, ARR_SIZE(states));
+    vec3_t pos = M_GetPos(s_map);
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+
+    struct tile_desc tds[4096];
+    size_t ntiles = M_Tile_AllUnderObj(pos, res, obb, tds, ARR_SIZE(tds));
+    if(ntiles == 0 || (fac_mask & ((1 << MAX_FACTIONS) - 1)) == 0)
+        return false;
+
+    int rmin, rmax, cmin, cmax;
+    tiles_bounds(tds, ntiles, &rmin, &rmax, &cmin, &cmax);
+
+    STALLOC(uint64_t, bits, MASK_NWORDS(rmin, rmax, cmin, cmax));
+    struct fog_mask mask;
+    mask_init(&mask, rmin, rmax, cmin, cmax, bits);
+    mask_set_tiles(&mask, tds, ntiles);
+
+    size_t count = snapshot_mask_count(snap, fac_mask, &mask);
+    STFREE(bits);
+    return (count > 0);
 }
 
 void G_Fog_Enable(void)
 {
     s_enabled = true;
+    mark_all_dirty();
 }
 
 void G_Fog_Disable(void)
 {
     s_enabled = false;
+    mark_all_dirty();
 }
 
 bool G_Fog_Enabled(void)
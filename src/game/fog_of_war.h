@@ -43,6 +43,7 @@
 struct map;
 struct obb;
 struct SDL_RWops;
+struct fog_snapshot;
 
 
 bool G_Fog_Init(const struct map *map);
@@ -51,6 +52,11 @@ void G_Fog_Shutdown(void);
 void G_Fog_AddVision(vec2_t xz_pos, int faction_id, float radius);
 void G_Fog_RemoveVision(vec2_t xz_pos, int faction_id, float radius);
 void G_Fog_UpdateVisionRange(vec2_t xz_pos, int faction_id, float oldr, float newr);
+/* Equivalent to removing the vision at the old position and adding it at 
+ * the new one, but only touches the tiles that are not seen from both. */
+void G_Fog_MoveVision(vec2_t old_xz_pos, vec2_t new_xz_pos, int faction_id, float radius);
+/* Must be called when the terrain heights change */
+void G_Fog_InvalidateLOSCache(void);
 
 bool G_Fog_CircleExplored(uint16_t fac_mask, vec2_t xz_pos, float radius);
 bool G_Fog_RectExplored(uint16_t fac_mask, vec2_t xz_pos, float halfx, float halfz);
@@ -67,9 +73,15 @@ bool G_Fog_LoadState(struct SDL_RWops *stream);
 
 bool G_Fog_Enabled(void);
 
-uint32_t *G_Fog_CopyState(void);
-bool      G_Fog_ObjVisibleFrom(uint32_t *state, bool enabled, 
-                               uint16_t fac_mask, const struct obb *obb);
+/* A read-only view of the 'visible' fog state at the time it was acquired. 
+ * The state is stored in blocks of rows that are shared between snapshots, 
+ * so acquiring one only copies the blocks that changed since the previous 
+ * acquire. Snapshots must be acquired and released from the main thread, 
+ * but can be read from any thread. */
+struct fog_snapshot *G_Fog_AcquireSnapshot(void);
+void                 G_Fog_ReleaseSnapshot(struct fog_snapshot *snap);
+bool                 G_Fog_ObjVisibleFrom(const struct fog_snapshot *snap, bool enabled, 
+                                          uint16_t fac_mask, const struct obb *obb);
 
 #endif
 
@@ -58,6 +58,7 @@
 
 #include <SDL.h>
 #include <assert.h>
+#include <float.h>
 
 #define COLUMN_WIDTH_RATIO       (4.0f)
 #define RANK_WIDTH_RATIO         (0.25f)
@@ -76,6 +77,10 @@
 #define EPSILON                  (1.0f/1024)
 #define FIELD_RECOMPUTE_INTERVAL (1.0f) /* seconds */
 #define MAX_CELL_ASSIGNMENT_WORK (256)
+#define MAX_EXACT_ASSIGNMENT     (64)
+#define AUCTION_EPS_FACTOR       (4.0)
+#define MAX_CACHED_FIELDS        (1024)
+#define FIELD_CACHE_TTL          (30000) /* milliseconds */
 #define IDX(r, width, c)         (r * width + c)
 
 #define CHK_TRUE_RET(_pred)             \
@@ -160,6 +165,28 @@ struct refcounted_map{
     struct map   *snapshot;
 };
 
+/* Everything that the contents of a cell arrival field depend on. Fields 
+ * with equal keys are identical and can be shared between units.
+ */
+struct field_key{
+    struct cell_field_work_input input;
+    /* Hash of the cells blocked out by other subformations */
+    uint64_t                     blockers;
+    /* Sum of the blocker versions of the chunks the field spans */
+    uint64_t                     nav_version;
+};
+
+struct field_entry{
+    struct field_key             key;
+    /* Number of units currently holding the field (main thread only) */
+    int                          refcount;
+    uint32_t                     last_used;
+    struct refcounted_map       *map;
+    uint32_t                     tid;
+    struct future                future;
+    struct cell_arrival_field    field;
+};
+
 struct cell_field_work{
     bool                         consumed;
     bool                         recompute_pending;
@@ -170,6 +197,12 @@ struct cell_field_work{
     struct future                future;
     struct cell_field_work_input input;
     struct cell_arrival_field    result;
+    /* The shared field that is currently published for the unit 
+     * and the one that will replace it once it's computed. When 
+     * 'pending' is NULL, the result is computed into 'result'.
+     */
+    struct field_entry          *entry;
+    struct field_entry          *pending;
 };
 
 VEC_TYPE(work, struct cell_field_work)
@@ -179,6 +212,7 @@ KHASH_MAP_INIT_INT(assignment, struct coord)
 KHASH_MAP_INIT_INT(reverse, uint32_t);
 KHASH_MAP_INIT_INT(result, struct cell_arrival_field*)
 KHASH_MAP_INIT_INT64(map, struct refcounted_map*)
+KHASH_MAP_INIT_INT64(field, struct field_entry*)
 
 QUEUE_TYPE(coord, struct coord)
 QUEUE_IMPL(static, coord, struct coord)
@@ -334,6 +368,12 @@ static khash_t(type)      *s_preferred;
 static formation_id_t      s_next_id;
 static SDL_TLSID           s_workspace;
 static queue_event_t       s_events;
+/* Cell arrival fields shared between all formations, keyed by 
+ * the hash of their field_key. */
+static khash_t(field)     *s_field_cache;
+/* Per-chunk counters bumped whenever something blocks or unblocks 
+ * a part of the chunk. */
+static uint32_t           *s_nav_versions;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -1368,6 +1408,230 @@ static void clean_up_map_snapshots(struct formation *formation)
     }
 }
 
+static struct range2d chunks_overlapping(vec2_t pos, float half_x, float half_z)
+{
+    struct map_resolution res;
+    M_NavGetResolution(s_map, &res);
+    vec3_t map_pos = M_GetPos(s_map);
+
+    /* Recall X increases to the left in our engine */
+    int min_c = floorf((map_pos.x - (pos.x + half_x)) / res.field_w);
+    int max_c = floorf((map_pos.x - (pos.x - half_x)) / res.field_w);
+    int min_r = floorf(((pos.z - half_z) - map_pos.z) / res.field_h);
+    int max_r = floorf(((pos.z + half_z) - map_pos.z) / res.field_h);
+
+    return (struct range2d){
+        .min_r = CLAMP(min_r, 0, res.chunk_h - 1),
+        .max_r = CLAMP(max_r, 0, res.chunk_h - 1),
+        .min_c = CLAMP(min_c, 0, res.chunk_w - 1),
+        .max_c = CLAMP(max_c, 0, res.chunk_w - 1),
+    };
+}
+
+static void bump_nav_versions(const struct entity_block_desc *desc)
+{
+    struct map_resolution res;
+    M_NavGetResolution(s_map, &res);
+
+    struct range2d range = chunks_overlapping(desc->pos, desc->radius, desc->radius);
+    for(int r = range.min_r; r <= range.max_r; r++) {
+    for(int c = range.min_c; c <= range.max_c; c++) {
+        s_nav_versions[r * res.chunk_w + c]++;
+    }}
+}
+
+static uint64_t field_nav_version(vec2_t center)
+{
+    struct map_resolution res;
+    M_NavGetResolution(s_map, &res);
+
+    const float tile_x_dim = res.field_w / res.tile_w;
+    const float tile_z_dim = res.field_h / res.tile_h;
+    const float field_x_dim = tile_x_dim * CELL_ARRIVAL_FIELD_RES;
+    const float field_z_dim = tile_z_dim * CELL_ARRIVAL_FIELD_RES;
+
+    /* The counters only ever increase, so any change within the 
+     * field's bounds will result in a different sum. */
+    uint64_t ret = 0;
+    struct range2d range = chunks_overlapping(center, field_x_dim / 2.0f, field_z_dim / 2.0f);
+    for(int r = range.min_r; r <= range.max_r; r++) {
+    for(int c = range.min_c; c <= range.max_c; c++) {
+        ret += s_nav_versions[r * res.chunk_w + c];
+    }}
+    return ret;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *curr = data;
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ curr[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t blockers_hash(struct formation *formation, struct subformation *sub)
+{
+    uint64_t ret = 14695981039346656037ull;
+    for(int i = 0; i < vec_size(&formation->subformations); i++) {
+        struct subformation *curr = &vec_AT(&formation->subformations, i);
+        if(!(sub->blocked & (((uint64_t)0x1) << i)))
+            continue;
+        ret = fnv1a(ret, &curr->faction_id, sizeof(curr->faction_id));
+        ret = fnv1a(ret, &curr->unit_radius, sizeof(curr->unit_radius));
+        for(int j = 0; j < vec_size(&curr->cells); j++) {
+            struct cell *cell = &vec_AT(&curr->cells, j);
+            if(cell->state != CELL_OCCUPIED)
+                continue;
+            ret = fnv1a(ret, &cell->pos, sizeof(cell->pos));
+        }
+    }
+    return ret;
+}
+
+static struct result cached_field_task(void *arg)
+{
+    PERF_ENTER();
+
+    struct field_entry *entry = arg;
+    struct cell_field_work_input *input = &entry->key.input;
+    struct refcounted_map *map = entry->map;
+    void *workspace = get_workspace();
+    size_t size = workspace_size();
+
+    M_NavCellArrivalFieldCreate(map->snapshot, CELL_ARRIVAL_FIELD_RES, CELL_ARRIVAL_FIELD_RES, 
+        input->layer, input->enemy_faction_mask, input->cell_tile, input->center_tile,
+        (uint8_t*)&entry->field, workspace, size);
+
+    bool ret = SDL_AtomicDecRef(&map->refcount);
+    PERF_RETURN(NULL_RESULT);
+}
+
+/* Returns a referenced entry holding (or about to hold) the field for the 
+ * specified input, dispatching its' computation on a miss. Returns NULL 
+ * if the field cannot be cached, in which case it must be computed 
+ * separately.
+ */
+static struct field_entry *field_cache_get(struct formation *parent, struct subformation *sub,
+                                           vec2_t center, const struct cell_field_work_input *input)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    struct field_key key;
+    memset(&key, 0, sizeof(key));
+    key.input.layer = input->layer;
+    key.input.enemy_faction_mask = input->enemy_faction_mask;
+    key.input.cell_tile = input->cell_tile;
+    key.input.center_tile = input->center_tile;
+    key.blockers = blockers_hash(parent, sub);
+    key.nav_version = field_nav_version(center);
+
+    uint64_t hash = fnv1a(14695981039346656037ull, &key, sizeof(key));
+    uint32_t now = SDL_GetTicks();
+
+    khiter_t k = kh_get(field, s_field_cache, hash);
+    if(k != kh_end(s_field_cache)) {
+        struct field_entry *entry = kh_val(s_field_cache, k);
+        if(0 != memcmp(&entry->key, &key, sizeof(key)))
+            return NULL;
+        entry->refcount++;
+        entry->last_used = now;
+        return entry;
+    }
+
+    if(kh_size(s_field_cache) >= MAX_CACHED_FIELDS)
+        return NULL;
+
+    struct field_entry *entry = malloc(sizeof(struct field_entry));
+    if(!entry)
+        return NULL;
+
+    int ret;
+    k = kh_put(field, s_field_cache, hash, &ret);
+    if(ret == -1) {
+        PF_FREE(entry);
+        return NULL;
+    }
+    kh_val(s_field_cache, k) = entry;
+
+    entry->key = key;
+    entry->refcount = 1;
+    entry->last_used = now;
+    entry->map = map_snapshot_get(parent, sub);
+
+    SDL_AtomicSet(&entry->future.status, FUTURE_INCOMPLETE);
+    entry->tid = Sched_Create(31, cached_field_task, entry, &entry->future, 0);
+    if(entry->tid == NULL_TID) {
+        cached_field_task(entry);
+        SDL_AtomicSet(&entry->future.status, FUTURE_COMPLETE);
+    }
+    return entry;
+}
+
+static void field_entry_release(struct field_entry *entry)
+{
+    assert(entry->refcount > 0);
+    entry->refcount--;
+}
+
+static void field_entry_complete(struct field_entry *entry)
+{
+    if(entry->tid == NULL_TID)
+        return;
+    while(!Sched_FutureIsReady(&entry->future)) {
+        Sched_RunSync(entry->tid);
+    }
+}
+
+/* Wait for all outstanding shared field computations. These may be 
+ * holding snapshots owned by any one formation.
+ */
+static void complete_field_cache_work(void)
+{
+    struct field_entry *entry;
+    kh_foreach_value(s_field_cache, entry, {
+        field_entry_complete(entry);
+    });
+}
+
+static void evict_cached_fields(bool all)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    uint64_t todel[1024];
+    size_t ndel = 0;
+    uint32_t now = SDL_GetTicks();
+    bool full = (kh_size(s_field_cache) >= MAX_CACHED_FIELDS);
+
+    uint64_t key;
+    struct field_entry *entry;
+    kh_foreach(s_field_cache, key, entry, {
+        if(ndel == ARR_SIZE(todel))
+            break;
+        if(entry->refcount > 0)
+            continue;
+        if(!Sched_FutureIsReady(&entry->future))
+            continue;
+        if(all || full || SDL_TICKS_PASSED(now, entry->last_used + FIELD_CACHE_TTL)) {
+            todel[ndel++] = key;
+        }
+    });
+
+    for(int i = 0; i < ndel; i++) {
+        khiter_t k = kh_get(field, s_field_cache, todel[i]);
+        assert(k != kh_end(s_field_cache));
+        PF_FREE(kh_val(s_field_cache, k));
+        kh_del(field, s_field_cache, k);
+    }
+}
+
+static bool cell_field_work_ready(const struct cell_field_work *work)
+{
+    if(work->pending)
+        return Sched_FutureIsReady(&work->pending->future);
+    return Sched_FutureIsReady(&work->future);
+}
+
 static void mark_unused_cells(struct subformation *formation)
 {
     size_t ncells = formation->nrows * formation->ncols;
@@ -1597,15 +1861,11 @@ static void init_subformations(struct formation *formation)
     STFREE(types);
 }
 
-/* The cost matrix holds the distance between every entity
- * and every cell.
+/* Collect the coordinates of the first 'nents' cells which are in use.
  */
-static void create_cost_matrix(struct cell_assignment_work *work, int *out_costs, 
-                               struct coord *out_idx_to_cell)
+static void collect_used_cells(struct cell_assignment_work *work, struct coord *out_idx_to_cell)
 {
     size_t nents = kh_size(work->ents);
-    int *out_rows = out_costs;
-
     size_t cell_idx = 0;
     for(int i = 0; i < nents; i++) {
         struct cell *cell;
@@ -1619,12 +1879,26 @@ static void create_cost_matrix(struct cell_assignment_work *work, int *out_costs
         };
     }
     assert(cell_idx == work->nrows * work->ncols);
+}
+
+/* The cost matrix holds the distance between every entity
+ * and every cell.
+ */
+static void create_cost_matrix(struct cell_assignment_work *work, int *out_costs, 
+                               struct coord *out_idx_to_cell)
+{
+    size_t nents = kh_size(work->ents);
+    int *out_rows = out_costs;
+
+    collect_used_cells(work, out_idx_to_cell);
 
     int i = 0;
     uint32_t uid;
     kh_foreach_key(work->ents, uid, {
 
-        vec2_t pos = G_Pos_GetXZFrom(work->positions, uid);
+        khiter_t k = kh_get(pos, work->positions, uid);
+        assert(k != kh_end(work->positions));
+        vec2_t pos = (vec2_t){kh_val(work->positions, k).x, kh_val(work->positions, k).z};
         size_t cell_idx = 0;
         for(int j = 0; j < nents; j++) {
             struct coord cell_coord = out_idx_to_cell[j];
@@ -2018,10 +2292,38 @@ iterate:
     return ret;
 }
 
+static void commit_cell_assignment(struct cell_assignment_work *work, 
+                                   const struct coord *assignment,
+                                   const struct coord *idx_to_cell)
+{
+    int i = 0;
+    uint32_t uid;
+    kh_foreach_key(work->ents, uid, {
+        /* Add an entity:cell mapping */
+        int status;
+        khiter_t k = kh_put(assignment, work->assignment, uid, &status);
+        assert(status != -1);
+        size_t meta_idx = assignment[i].c;
+        struct coord cell_coord = idx_to_cell[meta_idx];
+        kh_val(work->assignment, k) = cell_coord;
+        size_t cell_idx = CELL_IDX(cell_coord.r, cell_coord.c, work->ncols);
+        struct cell *cell = &vec_AT(&work->cells, cell_idx);
+        if(cell->state != CELL_NOT_PLACED) {
+            cell->state = CELL_OCCUPIED;
+        }
+        /* Add a cell:entity mapping */
+        khiter_t l = kh_put(reverse, work->reverse, cell_idx, &status);
+        assert(status != -1);
+        kh_val(work->reverse, l) = uid;
+
+        i++;
+    });
+}
+
 /* Use the Hungarian algorithm to find an optimal assignment of entities to cells
  * (minimizing the combined distance that needs to be traveled by the entities).
  */
-static void compute_cell_assignment(struct cell_assignment_work *work)
+static void compute_cell_assignment_exact(struct cell_assignment_work *work)
 {
     size_t nents = kh_size(work->ents);
     STALLOC(int, costs, nents * nents);
@@ -2074,35 +2376,147 @@ static void compute_cell_assignment(struct cell_assignment_work *work)
         }
     }while(min_lines < nents);
 
-    int i = 0;
+    commit_cell_assignment(work, assignment, idx_to_cell);
+
+    STFREE(costs);
+    STFREE(next);
+    STFREE(assignment);
+    STFREE(idx_to_cell);
+}
+
+static double auction_cost(const vec2_t *ent_pos, const vec2_t *cell_pos, const bool *placed, 
+                           double unplaced_cost, int i, int j)
+{
+    if(!placed[j])
+        return unplaced_cost;
+    double dx = cell_pos[j].x - ent_pos[i].x;
+    double dz = cell_pos[j].z - ent_pos[i].z;
+    return dx * dx + dz * dz;
+}
+
+/* Use an auction (with epsilon scaling) to find the assignment for larger 
+ * groups. The costs are the same as for the exact solver, but they are 
+ * evaluated on the fly, making the memory use linear in the number of 
+ * entities. Each entity bids for the cell with the best value (negative 
+ * cost minus price) and raises its' price by the margin over the second 
+ * best cell. Since every cell which is not placed has the same cost for 
+ * all entities, the cost that is chosen for such cells doesn't affect the 
+ * result. The final epsilon of 1/(n+1) distance units squared keeps the 
+ * result within a unit of the optimal total.
+ */
+static void compute_cell_assignment_auction(struct cell_assignment_work *work)
+{
+    size_t nents = kh_size(work->ents);
+    STALLOC(vec2_t, ent_pos, nents);
+    STALLOC(vec2_t, cell_pos, nents);
+    STALLOC(bool, placed, nents);
+    STALLOC(double, prices, nents);
+    STALLOC(int, owner, nents);
+    STALLOC(int, stack, nents);
+    STALLOC(struct coord, assignment, nents);
+    STALLOC(struct coord, idx_to_cell, nents);
+
+    collect_used_cells(work, idx_to_cell);
+    for(int j = 0; j < nents; j++) {
+        struct coord cell_coord = idx_to_cell[j];
+        const struct cell *cell = &vec_AT(&work->cells, 
+            CELL_IDX(cell_coord.r, cell_coord.c, work->ncols));
+        placed[j] = (cell->state != CELL_NOT_PLACED);
+        cell_pos[j] = cell->pos;
+        prices[j] = 0.0;
+    }
+
+    int n = 0;
     uint32_t uid;
     kh_foreach_key(work->ents, uid, {
-        /* Add an entity:cell mapping */
-        int status;
-        khiter_t k = kh_put(assignment, work->assignment, uid, &status);
-        assert(status != -1);
-        size_t meta_idx = assignment[i].c;
-        struct coord cell_coord = idx_to_cell[meta_idx];
-        kh_val(work->assignment, k) = cell_coord;
-        size_t cell_idx = CELL_IDX(cell_coord.r, cell_coord.c, work->ncols);
-        struct cell *cell = &vec_AT(&work->cells, cell_idx);
-        if(cell->state != CELL_NOT_PLACED) {
-            cell->state = CELL_OCCUPIED;
+        khiter_t k = kh_get(pos, work->positions, uid);
+        assert(k != kh_end(work->positions));
+        ent_pos[n++] = (vec2_t){kh_val(work->positions, k).x, kh_val(work->positions, k).z};
+    });
+
+    double max_cost = 0.0;
+    for(int i = 0; i < nents; i++) {
+        for(int j = 0; j < nents; j++) {
+            if(!placed[j])
+                continue;
+            max_cost = MAX(max_cost, auction_cost(ent_pos, cell_pos, placed, 0.0, i, j));
         }
-        /* Add a cell:entity mapping */
-        khiter_t l = kh_put(reverse, work->reverse, cell_idx, &status);
-        assert(status != -1);
-        kh_val(work->reverse, l) = uid;
+    }
 
-        i++;
-    });
+    const double final_eps = 1.0 / (nents + 1);
+    double eps = MAX(max_cost / AUCTION_EPS_FACTOR, final_eps);
+    size_t nbids = 0;
 
-    STFREE(costs);
-    STFREE(next);
+    while(true) {
+
+        size_t nstack = 0;
+        for(int i = 0; i < nents; i++) {
+            assignment[i] = (struct coord){i, -1};
+            owner[i] = -1;
+            stack[nstack++] = nents - 1 - i;
+        }
+
+        while(nstack > 0) {
+
+            int i = stack[--nstack];
+            double best = -DBL_MAX, second = -DBL_MAX;
+            int best_j = -1;
+
+            for(int j = 0; j < nents; j++) {
+                double value = -auction_cost(ent_pos, cell_pos, placed, max_cost, i, j) - prices[j];
+                if(value > best) {
+                    second = best;
+                    best = value;
+                    best_j = j;
+                }else if(value > second) {
+                    second = value;
+                }
+            }
+            assert(best_j >= 0);
+
+            double incr = (second == -DBL_MAX) ? eps : (best - second) + eps;
+            prices[best_j] += incr;
+
+            if(owner[best_j] != -1) {
+                assignment[owner[best_j]].c = -1;
+                stack[nstack++] = owner[best_j];
+            }
+            owner[best_j] = i;
+            assignment[i].c = best_j;
+
+            if((++nbids % nents) == 0) {
+                Sched_TryYield();
+            }
+        }
+
+        if(eps <= final_eps)
+            break;
+        eps = MAX(eps / AUCTION_EPS_FACTOR, final_eps);
+    }
+
+    commit_cell_assignment(work, assignment, idx_to_cell);
+
+    STFREE(ent_pos);
+    STFREE(cell_pos);
+    STFREE(placed);
+    STFREE(prices);
+    STFREE(owner);
+    STFREE(stack);
     STFREE(assignment);
     STFREE(idx_to_cell);
 }
 
+static void compute_cell_assignment(struct cell_assignment_work *work)
+{
+    /* The exact solver needs quadratic memory and cubic time, 
+     * so it's only used for small groups */
+    if(kh_size(work->ents) <= MAX_EXACT_ASSIGNMENT) {
+        compute_cell_assignment_exact(work);
+    }else{
+        compute_cell_assignment_auction(work);
+    }
+}
+
 static mat4x4_t cell_field_model_matrix(vec2_t center)
 {
     struct map_resolution nav_res;
@@ -2980,7 +3394,7 @@ static bool event_triggered_recalculate(struct formation *formation, struct bloc
 
 static void on_entity_unblock(void *user, void *event)
 {
-    uint32_t uid = (uintptr_t)event;
+    bump_nav_versions(event);
     uint32_t tick = SDL_GetTicks();
     struct block_event block_event = (struct block_event){
         .type = EVENT_MOVABLE_ENTITY_UNBLOCK,
@@ -2992,6 +3406,7 @@ static void on_entity_unblock(void *user, void *event)
 
 static void on_entity_block(void *user, void *event)
 {
+    bump_nav_versions(event);
     uint32_t tick = SDL_GetTicks();
     struct block_event block_event = (struct block_event){
         .type = EVENT_MOVABLE_ENTITY_BLOCK,
@@ -3003,6 +3418,7 @@ static void on_entity_block(void *user, void *event)
 
 static void on_building_found(void *user, void *event)
 {
+    bump_nav_versions(event);
     uint32_t tick = SDL_GetTicks();
     struct block_event block_event = (struct block_event){
         .type = EVENT_MOVABLE_ENTITY_BLOCK,
@@ -3014,6 +3430,7 @@ static void on_building_found(void *user, void *event)
 
 static void on_building_remove(void *user, void *event)
 {
+    bump_nav_versions(event);
     uint32_t tick = SDL_GetTicks();
     struct block_event block_event = (struct block_event){
         .type = EVENT_MOVABLE_ENTITY_UNBLOCK,
@@ -3063,6 +3480,13 @@ static void on_1hz_tick(void *user, void *event)
 static void destroy_subformation(struct subformation *formation)
 {
     complete_cell_field_work(formation, false);
+    for(int i = 0; i < vec_size(&formation->futures); i++) {
+        struct cell_field_work *curr = &vec_AT(&formation->futures, i);
+        if(curr->entry)
+            field_entry_release(curr->entry);
+        if(curr->pending)
+            field_entry_release(curr->pending);
+    }
     vec_work_destroy(&formation->futures);
     vec_cell_destroy(&formation->cells);
     kh_destroy(result, formation->results);
@@ -3093,6 +3517,7 @@ static void destroy_formation(struct formation *formation)
         destroy_subformation(sub);
     }
     vec_assignment_work_destroy(&formation->work);
+    complete_field_cache_work();
     clean_up_map_snapshots(formation);
     assert(kh_size(formation->map_snapshots) == 0);
     kh_destroy(map, formation->map_snapshots);
@@ -3190,13 +3615,12 @@ static void dispatch_cell_task(struct formation *parent, vec2_t center, uint32_t
                                struct subformation *formation, struct cell_field_work *work, 
                                struct cell *cell, struct result (*func)(void*))
 {
-    struct refcounted_map *rmap = map_snapshot_get(parent, formation);
     struct map_resolution res;
-    M_NavGetResolution(rmap->snapshot, &res);
-    vec3_t map_pos = M_GetPos(rmap->snapshot);
+    M_NavGetResolution(s_map, &res);
+    vec3_t map_pos = M_GetPos(s_map);
 
     vec2_t bpos = bin_to_tile_clamped(cell->reachable_pos, center);
-    bpos = M_ClampedMapCoordinate(rmap->snapshot, bpos);
+    bpos = M_ClampedMapCoordinate(s_map, bpos);
 
     struct tile_desc cell_td;
     bool exists = M_Tile_DescForPoint2D(res, map_pos, bpos, &cell_td);
@@ -3209,7 +3633,6 @@ static void dispatch_cell_task(struct formation *parent, vec2_t center, uint32_t
 
     work->consumed = false;
     work->recompute_pending = false;
-    work->map = rmap;
     work->uid = uid;
     work->last_update_ticks = SDL_GetTicks();
 
@@ -3218,10 +3641,27 @@ static void dispatch_cell_task(struct formation *parent, vec2_t center, uint32_t
     work->input.cell_tile = cell_td;
     work->input.center_tile = center_td;
 
+    if(work->pending) {
+        field_entry_release(work->pending);
+        work->pending = NULL;
+    }
+
+    /* Fields that don't depend on the unit's current position can 
+     * be shared by all units heading to the same cell. */
+    if(func == cell_field_task) {
+        work->pending = field_cache_get(parent, formation, center, &work->input);
+    }
+    if(work->pending) {
+        work->map = NULL;
+        work->tid = NULL_TID;
+        return;
+    }
+
+    work->map = map_snapshot_get(parent, formation);
     SDL_AtomicSet(&work->future.status, FUTURE_INCOMPLETE);
     work->tid = Sched_Create(31, func, work, &work->future, 0);
     if(work->tid == NULL_TID) {
-        func(&work->result);
+        func(work);
         SDL_AtomicSet(&work->future.status, FUTURE_COMPLETE);
     }
 }
@@ -3234,8 +3674,21 @@ static void dispatch_cell_field_work(struct formation *parent, vec2_t center,
      * task is dispatched. 
      */
     size_t nents = kh_size(formation->ents);
+    size_t nprev = vec_size(&formation->futures);
+    for(int i = nents; i < nprev; i++) {
+        struct cell_field_work *curr = &vec_AT(&formation->futures, i);
+        if(curr->entry)
+            field_entry_release(curr->entry);
+        if(curr->pending)
+            field_entry_release(curr->pending);
+    }
     vec_work_resize(&formation->futures, nents);
     formation->futures.size = nents;
+    for(int i = nprev; i < nents; i++) {
+        struct cell_field_work *curr = &vec_AT(&formation->futures, i);
+        curr->entry = NULL;
+        curr->pending = NULL;
+    }
 
     int i = 0;
     uint32_t uid;
@@ -3256,6 +3709,10 @@ static void complete_cell_field_work(struct subformation *formation, bool yield)
 {
     for(int j = 0; j < vec_size(&formation->futures); j++) {
         struct cell_field_work *curr = &vec_AT(&formation->futures, j);
+        if(curr->pending) {
+            field_entry_complete(curr->pending);
+            continue;
+        }
         if(curr->tid == NULL_TID)
             continue;
         while(!Sched_FutureIsReady(&curr->future)) {
@@ -3291,6 +3748,7 @@ static void on_update_start(void *user, void *event)
 
     /* Consume cell field work results 
      */
+    evict_cached_fields(false);
     kh_foreach_ptr(s_formations, formation, {
 
         clean_up_map_snapshots(formation);
@@ -3309,12 +3767,18 @@ static void on_update_start(void *user, void *event)
                     dispatch_cell_task(formation, formation->center, uid, sub, curr, cell,
                         cell_field_task);
                 }
-                if(!curr->consumed && Sched_FutureIsReady(&curr->future)) {
-                    /* Publish the result */
+                if(!curr->consumed && cell_field_work_ready(curr)) {
+                    /* Publish the result, dropping the previously published 
+                     * shared field, if any */
+                    if(curr->entry)
+                        field_entry_release(curr->entry);
+                    curr->entry = curr->pending;
+                    curr->pending = NULL;
+
                     int ret;
                     khiter_t k = kh_put(result, sub->results, curr->uid, &ret);
                     assert(ret != -1);
-                    kh_val(sub->results, k) = &curr->result;
+                    kh_val(sub->results, k) = curr->entry ? &curr->entry->field : &curr->result;
                     curr->consumed = true;
                 }
             }
@@ -3441,7 +3905,7 @@ static void recompute_cell_arrival_fields(struct formation *parent, vec2_t cente
     uint32_t uid;
     kh_foreach_key(formation->ents, uid, {
         struct cell_field_work *curr = &vec_AT(&formation->futures, i);
-        if(!curr->consumed && !Sched_FutureIsReady(&curr->future)) {
+        if(!curr->consumed && !cell_field_work_ready(curr)) {
             curr->recompute_pending = true;
             continue;
         }
@@ -4246,6 +4710,13 @@ bool G_Formation_Init(const struct map *map)
 
     if(!queue_event_init(&s_events, 512))
         goto fail_tls;
+    if(NULL == (s_field_cache = kh_init(field)))
+        goto fail_field_cache;
+
+    struct map_resolution res;
+    M_NavGetResolution(map, &res);
+    if(NULL == (s_nav_versions = calloc(res.chunk_w * res.chunk_h, sizeof(uint32_t))))
+        goto fail_nav_versions;
 
     s_map = map;
     s_next_id = 0;
@@ -4260,6 +4731,10 @@ bool G_Formation_Init(const struct map *map)
     E_Global_Register(EVENT_1HZ_TICK, on_1hz_tick, NULL, G_RUNNING);
     return true;
 
+fail_nav_versions:
+    kh_destroy(field, s_field_cache);
+fail_field_cache:
+    queue_event_destroy(&s_events);
 fail_tls:
     kh_destroy(type, s_preferred);
 fail_preferred:
@@ -4279,6 +4754,8 @@ void G_Formation_Shutdown(void)
         clear_mappings(formation);
         destroy_formation(formation);
     });
+    evict_cached_fields(true);
+    assert(kh_size(s_field_cache) == 0);
 
     E_Global_Unregister(EVENT_1HZ_TICK, on_1hz_tick);
     E_Global_Unregister(EVENT_BUILDING_FOUNDED, on_building_found);
@@ -4288,6 +4765,8 @@ void G_Formation_Shutdown(void)
     E_Global_Unregister(EVENT_UPDATE_START, on_update_start);
     E_Global_Unregister(EVENT_RENDER_3D_POST, on_render_3d);
 
+    PF_FREE(s_nav_versions);
+    kh_destroy(field, s_field_cache);
     queue_event_destroy(&s_events);
     kh_destroy(type, s_preferred);
     kh_destroy(formation, s_formations);
@@ -44,10 +44,14 @@
 #include "clearpath.h"
 #include "position.h"
 #include "fog_of_war.h"
+#include "occlusion.h"
 #include "building.h"
 #include "builder.h"
 #include "harvester.h"
 #include "storage_site.h"
+#include "resource_id.h"
+#include "entity_index.h"
+#include "resource_index.h"
 #include "resource.h"
 #include "region.h"
 #include "garrison.h"
@@ -73,6 +77,7 @@
 #include "../main.h"
 #include "../ui.h"
 #include "../perf.h"
+#include "../replay.h"
 #include "../cursor.h"
 #include "../sched.h"
 
@@ -85,6 +90,24 @@
 #define CAM_SENS            0.05f
 #define MAX_VIS_RANGE       150.0f
 #define WATER_ADJ_DISTANCE  25.0f
+#define CULL_BATCH_SIZE     256
+/* The factor by which the bind pose bounds of animated entities are grown 
+ * to also cover the poses of their animations when binned for culling */
+#define ANIM_BOUNDS_SLACK   2.0f
+#define DRAW_LIST_GRAIN     256
+#define ANIM_LOD_NEAR_DIST  300.0f
+#define ANIM_LOD_FAR_DIST   500.0f
+/* The fractions of the screen height covered by an entity's bounding sphere 
+ * below which its' first and second reduced-detail meshes are drawn. Shadows 
+ * switch earlier, as their silhouettes are softened by the filtering anyway. */
+#define MESH_LOD_NEAR_SIZE          0.10f
+#define MESH_LOD_FAR_SIZE           0.04f
+#define MESH_LOD_SHADOW_NEAR_SIZE   0.20f
+#define MESH_LOD_SHADOW_FAR_SIZE    0.08f
+/* Animated entities smaller than this are drawn only as impostors. Up to 
+ * IMPOSTOR_FADE_SIZE, the impostor is faded in over the mesh. */
+#define IMPOSTOR_FULL_SIZE          0.02f
+#define IMPOSTOR_FADE_SIZE          0.03f
 
 #define MIN(a, b)           ((a) < (b) ? (a) : (b))
 #define MAX(a, b)           ((a) > (b) ? (a) : (b))
@@ -100,6 +123,7 @@ VEC_IMPL(extern, obb, struct obb)
 __KHASH_IMPL(entity,  extern, khint32_t, uint32_t, 0, kh_int_hash_func, kh_int_hash_equal)
 __KHASH_IMPL(id,      extern, khint32_t, int,      1, kh_int_hash_func, kh_int_hash_equal)
 __KHASH_IMPL(range,   extern, khint32_t, float,    1, kh_int_hash_func, kh_int_hash_equal)
+__KHASH_IMPL(icon_slot, extern, kh_cstr_t, int,    1, kh_str_hash_func, kh_str_hash_equal)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -107,10 +131,54 @@ __KHASH_IMPL(range,   extern, khint32_t, float,    1, kh_int_hash_func, kh_int_h
 
 static struct gamestate s_gs;
 
+/* Settings which are read every frame */
+static struct{
+    sett_handle_t healthbar_mode;
+    sett_handle_t anim_lod;
+    sett_handle_t mesh_lod;
+    sett_handle_t impostors;
+    sett_handle_t shadows_enabled;
+    sett_handle_t gpu_culling;
+    sett_handle_t depth_prepass;
+    sett_handle_t shadow_cascades;
+    sett_handle_t water_refraction;
+    sett_handle_t water_reflection;
+    sett_handle_t water_quality;
+    sett_handle_t terrain_lod;
+}s_sett;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static bool g_init_setting_handles(void)
+{
+    struct{
+        sett_handle_t *out;
+        const char    *name;
+    }handles[] = {
+        {&s_sett.healthbar_mode,    "pf.game.healthbar_mode"},
+        {&s_sett.anim_lod,          "pf.game.anim_lod"},
+        {&s_sett.mesh_lod,          "pf.video.mesh_lod"},
+        {&s_sett.impostors,         "pf.video.impostors"},
+        {&s_sett.shadows_enabled,   "pf.video.shadows_enabled"},
+        {&s_sett.gpu_culling,       "pf.video.gpu_culling"},
+        {&s_sett.depth_prepass,     "pf.video.depth_prepass"},
+        {&s_sett.shadow_cascades,   "pf.video.shadow_cascades"},
+        {&s_sett.water_refraction,  "pf.video.water_refraction"},
+        {&s_sett.water_reflection,  "pf.video.water_reflection"},
+        {&s_sett.water_quality,     "pf.video.water_quality"},
+        {&s_sett.terrain_lod,       "pf.video.terrain_lod"},
+    };
+
+    for(int i = 0; i < ARR_SIZE(handles); i++) {
+        *handles[i].out = Settings_GetHandle(handles[i].name);
+        if(*handles[i].out == SETT_HANDLE_INVALID)
+            return false;
+    }
+    return true;
+}
+
 static vec2_t g_default_minimap_pos(void)
 {
     struct sval res = (struct sval){ 
@@ -160,6 +228,7 @@ static void g_init_map(void)
     M_InitMinimap(s_gs.map, g_default_minimap_pos());
     M_InitCopyPools(s_gs.map);
     G_Pos_Init(s_gs.map);
+    G_ResourceIndex_Init(s_gs.map);
     G_Building_Init(s_gs.map);
     G_Garrison_Init(s_gs.map);
     G_Fog_Init(s_gs.map);
@@ -175,27 +244,48 @@ static void g_init_map(void)
     N_ClearState();
 }
 
-static void g_shadow_pass(struct render_input *in)
+/* The map only builds the water and air navigation layers once an entity 
+ * that moves on them is around. */
+static void g_ensure_nav_layers(uint32_t flags)
 {
-    vec3_t pos = Camera_GetPos(in->cam);
-    vec3_t dir = Camera_GetDir(in->cam);
+    if(!s_gs.map)
+        return;
+    if(!(flags & (ENTITY_FLAG_WATER | ENTITY_FLAG_AIR)))
+        return;
+    M_NavEnsureLayer(s_gs.map, Entity_NavLayerWithRadius(flags, 0.0f));
+}
 
+static void g_cascade_pass(struct render_input *in, int idx, const struct frustum *clip)
+{
     R_PushCmd((struct rcmd){ 
         .func = R_GL_DepthPassBegin, 
         .nargs = 3,
         .args = { 
-            R_PushArg(&in->light_pos, sizeof(in->light_pos)),
-            R_PushArg(&pos, sizeof(pos)),
-            R_PushArg(&dir, sizeof(dir)),
+            R_PushArg(&in->cascades[idx], sizeof(in->cascades[idx])),
+            R_PushArg(&idx, sizeof(idx)),
+            R_PushArg(&in->ncascades, sizeof(in->ncascades)),
         },
     });
 
+    R_PushCmd((struct rcmd){
+        .func = R_GL_DepthPassBeginStatic,
+        .nargs = 1,
+        .args = { R_PushArg(&in->static_shadow_hash, sizeof(in->static_shadow_hash)) },
+    });
+
     if(in->map) {
-        M_RenderVisibleMap(in->map, in->cam, true, RENDER_PASS_DEPTH);
+        M_RenderVisibleMapClipped(in->map, in->cam, clip, true, false, RENDER_PASS_DEPTH);
     }
 
 #if CONFIG_USE_BATCH_RENDERING
 
+    R_PushCmd((struct rcmd){
+        .func = R_GL_Batch_RenderStaticDepthMap,
+        .nargs = 1,
+        .args = { in }
+    });
+    R_PushCmd((struct rcmd){ R_GL_DepthPassEndStatic, 0 });
+
     R_PushCmd((struct rcmd){
         .func = R_GL_Batch_RenderDepthMap,
         .nargs = 1,
@@ -203,6 +293,20 @@ static void g_shadow_pass(struct render_input *in)
     });
 
 #else // !CONFIG_USE_BATCH_RENDERING
+    for(int i = 0; i < vec_size(&in->light_vis_static); i++) {
+    
+        struct ent_stat_rstate *curr = &vec_AT(&in->light_vis_static, i);
+        R_PushCmd((struct rcmd){
+            .func = R_GL_RenderDepthMap,
+            .nargs = 2,
+            .args = {
+                curr->render_private,
+                R_PushArg(&curr->model, sizeof(curr->model)),
+            },
+        });
+    }
+    R_PushCmd((struct rcmd){ R_GL_DepthPassEndStatic, 0 });
+
     for(int i = 0; i < vec_size(&in->light_vis_anim); i++) {
     
         struct ent_anim_rstate *curr = &vec_AT(&in->light_vis_anim, i);
@@ -213,12 +317,10 @@ static void g_shadow_pass(struct render_input *in)
 
         R_PushCmd((struct rcmd){
             .func = R_GL_SetAnimUniforms,
-            .nargs = 4,
+            .nargs = 2,
             .args = {
-                (void*)curr->inv_bind_pose, 
-                R_PushArg(curr->curr_pose, sizeof(curr->curr_pose)),
                 R_PushArg(&normal, sizeof(normal)),
-                R_PushArg(&curr->njoints, sizeof(curr->njoints)),
+                R_PushArg(&curr->pose_base, sizeof(curr->pose_base)),
             },
         });
 
@@ -249,10 +351,68 @@ static void g_shadow_pass(struct render_input *in)
     R_PushCmd((struct rcmd){ R_GL_DepthPassEnd, 0 });
 }
 
+static void g_shadow_pass(struct render_input *in)
+{
+    if(in->ncascades == 1) {
+        g_cascade_pass(in, 0, NULL);
+    }else{
+
+        for(int i = 0; i < in->ncascades; i++) {
+
+            if(!in->cascades[i].update)
+                continue;
+
+            /* The batched depth passes read the casters from the render input,
+             * so each cascade gets a copy holding only its' own casters */
+            const struct cascade_input *cin = &in->cascade_in[i];
+            struct render_input *copy = R_PushArg(in, sizeof(*in));
+            copy->light_vis_stat = cin->light_vis_stat;
+            copy->light_vis_anim = cin->light_vis_anim;
+            copy->light_vis_static = cin->light_vis_static;
+            copy->static_shadow_hash = cin->static_shadow_hash;
+            g_cascade_pass(copy, i, &cin->frustum);
+        }
+    }
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_ShadowsSetCascades,
+        .nargs = 2,
+        .args = {
+            R_PushArg(in->cascades, sizeof(in->cascades)),
+            R_PushArg(&in->ncascades, sizeof(in->ncascades)),
+        },
+    });
+}
+
+static void g_depth_prepass(struct render_input *in)
+{
+#if CONFIG_USE_BATCH_RENDERING
+    R_PushCmd((struct rcmd){
+        .func = R_GL_Batch_DrawDepthPrepass,
+        .nargs = 1,
+        .args = { in }
+    });
+#endif
+}
+
 static void g_draw_pass(struct render_input *in)
 {
+    /* The occluders captured for culling must be the terrain alone, so the
+     * prepass goes after the capture when there is one */
+    bool prepass_first = in->depth_prepass && !(in->map && in->occlusion_capture);
+    if(prepass_first) {
+        g_depth_prepass(in);
+    }
+
     if(in->map) {
-        M_RenderVisibleMap(in->map, in->cam, in->shadows, RENDER_PASS_REGULAR);
+        M_RenderVisibleMap(in->map, in->cam, in->shadows, in->terrain_lod, RENDER_PASS_REGULAR);
+        if(in->occlusion_capture) {
+            G_Occl_PushCapture(in->cam);
+        }
+    }
+
+    if(in->depth_prepass && !prepass_first) {
+        g_depth_prepass(in);
     }
 
 #if CONFIG_USE_BATCH_RENDERING
@@ -274,12 +434,10 @@ static void g_draw_pass(struct render_input *in)
 
         R_PushCmd((struct rcmd){
             .func = R_GL_SetAnimUniforms,
-            .nargs = 4,
+            .nargs = 2,
             .args = {
-                (void*)curr->inv_bind_pose, 
-                R_PushArg(curr->curr_pose, sizeof(curr->curr_pose)),
                 R_PushArg(&normal, sizeof(normal)),
-                R_PushArg(&curr->njoints, sizeof(curr->njoints)),
+                R_PushArg(&curr->pose_base, sizeof(curr->pose_base)),
             },
         });
 
@@ -308,18 +466,43 @@ static void g_draw_pass(struct render_input *in)
         });
     }
 #endif
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_ImpostorDraw,
+        .nargs = 1,
+        .args = { in }
+    });
+}
+
+/* The model matrix the entity is drawn with. Moving entities are drawn 
+ * in between their last two simulated positions. 
+ */
+static void g_render_model_matrix(uint32_t uid, mat4x4_t *out)
+{
+    vec3_t pos;
+    quat_t rot;
+    if(!G_Move_GetRenderTransform(uid, &pos, &rot)) {
+        Entity_ModelMatrix(uid, out);
+        return;
+    }
+    Entity_ModelMatrixFrom(pos, rot, Entity_GetScale(uid), out);
+}
+
+static vec2_t g_render_pos_xz(uint32_t uid)
+{
+    vec3_t pos;
+    quat_t rot;
+    if(!G_Move_GetRenderTransform(uid, &pos, &rot))
+        return G_Pos_GetXZ(uid);
+    return (vec2_t){pos.x, pos.z};
 }
 
 static void g_render_healthbars(void)
 {
     PERF_ENTER();
 
-    struct sval hb_setting;
-    ss_e status = Settings_Get("pf.game.healthbar_mode", &hb_setting);
-    assert(status == SS_OKAY);
-    (void)status;
-
-    if(hb_setting.as_int == HB_MODE_NEVER)
+    int hb_mode = Settings_ReadInt(s_sett.healthbar_mode);
+    if(hb_mode == HB_MODE_NEVER)
         PERF_RETURN_VOID();
 
     size_t max_ents = vec_size(&s_gs.visible);
@@ -348,15 +531,17 @@ static void g_render_healthbars(void)
 
         if(curr_health == 0 || max_health == 0)
             continue;
-        if(hb_setting.as_int == HB_MODE_DAMAGED && curr_health == max_health)
+        if(hb_mode == HB_MODE_DAMAGED && curr_health == max_health)
             continue;
 
         int yoffset = -20;
-        if((G_FlagsGet(curr) & ENTITY_FLAG_STORAGE_SITE) && G_StorageSite_GetShowUI()) {
+        if((flags & ENTITY_FLAG_STORAGE_SITE) && G_StorageSite_GetShowUI()) {
             yoffset += G_StorageSite_GetWindowHeight(curr) / 8.0f;
         }
 
-        ent_top_pos_ws[num_combat_visible] = Entity_TopCenterPointWS(curr);
+        mat4x4_t model;
+        g_render_model_matrix(curr, &model);
+        ent_top_pos_ws[num_combat_visible] = Entity_TopCenterPointWSFrom(curr, model);
         ent_health_pc[num_combat_visible] = ((GLfloat)curr_health)/max_health;
         ent_yoffsets[num_combat_visible] = yoffset;
 
@@ -368,9 +553,9 @@ static void g_render_healthbars(void)
         .nargs = 5,
         .args = {
             R_PushArg(&num_combat_visible, sizeof(num_combat_visible)),
-            R_PushArg(ent_health_pc, max_ents * sizeof(GLfloat)),
-            R_PushArg(ent_top_pos_ws, max_ents * sizeof(vec3_t)),
-            R_PushArg(ent_yoffsets, max_ents * sizeof(int)),
+            R_PushArg(ent_health_pc, num_combat_visible * sizeof(GLfloat)),
+            R_PushArg(ent_top_pos_ws, num_combat_visible * sizeof(vec3_t)),
+            R_PushArg(ent_yoffsets, num_combat_visible * sizeof(int)),
             R_PushArg(s_gs.active_cam, g_sizeof_camera),
         },
     });
@@ -382,54 +567,221 @@ static void g_render_healthbars(void)
     PERF_RETURN_VOID();
 }
 
-static void g_sort_stat_list(vec_rstat_t *inout)
+static int g_icon_slot(const char *path)
 {
-    PERF_ENTER();
-    int i = 1;
-    while(i < vec_size(inout)) {
-        int j = i;
-        while(j > 0 && vec_AT(inout, j - 1).translucent && !vec_AT(inout, j).translucent) {
-
-            struct ent_stat_rstate tmp = vec_AT(inout, j - 1);
-            vec_AT(inout, j - 1) = vec_AT(inout, j);
-            vec_AT(inout, j) = tmp;
-            j--;
-        }
-        i++;
+    khiter_t k = kh_get(icon_slot, s_gs.icon_slots, path);
+    if(k != kh_end(s_gs.icon_slots))
+        return kh_value(s_gs.icon_slots, k);
+
+    int slot = kh_size(s_gs.icon_slots);
+    if(slot == R_ICON_ATLAS_SLOTS)
+        return -1;
+
+    char *key = pf_strdup(path);
+    if(!key)
+        return -1;
+
+    int ret;
+    k = kh_put(icon_slot, s_gs.icon_slots, key, &ret);
+    if(ret == -1) {
+        PF_FREE(key);
+        return -1;
     }
-    PERF_RETURN_VOID();
+    kh_value(s_gs.icon_slots, k) = slot;
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_IconAtlasSet,
+        .nargs = 2,
+        .args = {
+            R_PushArg(&slot, sizeof(slot)),
+            R_PushArg(path, strlen(path) + 1),
+        },
+    });
+    return slot;
 }
 
-static void g_sort_anim_list(vec_ranim_t *inout)
+static void g_render_unit_icons(void)
 {
     PERF_ENTER();
-    int i = 1;
-    while(i < vec_size(inout)) {
-        int j = i;
-        while(j > 0 && vec_AT(inout, j - 1).translucent && !vec_AT(inout, j).translucent) {
-
-            struct ent_anim_rstate tmp = vec_AT(inout, j - 1);
-            vec_AT(inout, j - 1) = vec_AT(inout, j);
-            vec_AT(inout, j) = tmp;
-            j--;
+
+    size_t max_icons = vec_size(&s_gs.visible) * MAX_ICONS;
+    size_t num_icons = 0;
+
+    STALLOC(vec3_t, icon_pos_ws, max_icons);
+    STALLOC(vec2_t, icon_offsets, max_icons);
+    STALLOC(int, icon_slots, max_icons);
+
+    for(int i = 0; i < vec_size(&s_gs.visible); i++) {
+
+        uint32_t uid = vec_AT(&s_gs.visible, i);
+        const char *icons[MAX_ICONS];
+        size_t nicons = Entity_GetIcons(uid, ARR_SIZE(icons), icons);
+        if(nicons == 0 || G_EntityIsZombie(uid))
+            continue;
+
+        float yoffset = 2.0f;
+        if((G_FlagsGet(uid) & ENTITY_FLAG_STORAGE_SITE) && G_StorageSite_GetShowUI()) {
+            yoffset += G_StorageSite_GetWindowHeight(uid) / 8.0f;
+        }
+
+        mat4x4_t model;
+        g_render_model_matrix(uid, &model);
+        vec3_t top = Entity_TopCenterPointWSFrom(uid, model);
+
+        /* The icons are laid out in a row of 32x32 cells, centered 
+         * over the entity */
+        for(int j = 0; j < nicons; j++) {
+
+            int slot = g_icon_slot(icons[j]);
+            if(slot < 0)
+                continue;
+
+            icon_pos_ws[num_icons] = top;
+            icon_offsets[num_icons] = (vec2_t){32.0f * j + 16.0f - 16.0f * nicons, yoffset};
+            icon_slots[num_icons] = slot;
+            num_icons++;
         }
-        i++;
     }
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_DrawIcons,
+        .nargs = 5,
+        .args = {
+            R_PushArg(&num_icons, sizeof(num_icons)),
+            R_PushArg(icon_pos_ws, num_icons * sizeof(vec3_t)),
+            R_PushArg(icon_offsets, num_icons * sizeof(vec2_t)),
+            R_PushArg(icon_slots, num_icons * sizeof(int)),
+            R_PushArg(s_gs.active_cam, g_sizeof_camera),
+        },
+    });
+
+    STFREE(icon_pos_ws);
+    STFREE(icon_offsets);
+    STFREE(icon_slots);
+
     PERF_RETURN_VOID();
 }
 
-static void g_make_draw_list(vec_entity_t ents, vec_rstat_t *out_stat, vec_ranim_t *out_anim,
-                             bool onlycasters)
+static int g_anim_lod(uint32_t uid, vec2_t cam_xz)
 {
-    PERF_ENTER();
-    struct map_resolution res;
-    if(s_gs.map) {
-        M_GetResolution(s_gs.map, &res);
+    vec2_t delta, pos = G_Pos_GetXZ(uid);
+    PFM_Vec2_Sub(&cam_xz, &pos, &delta);
+    float dist = PFM_Vec2_Len(&delta);
+
+    if(dist < ANIM_LOD_NEAR_DIST)
+        return 0;
+    if(dist < ANIM_LOD_FAR_DIST)
+        return 1;
+    return 2;
+}
+
+/* The fraction of the screen height spanned by the entity's bounding sphere */
+static float g_screen_size(uint32_t uid, const struct entity *ent, vec3_t cam_pos)
+{
+    const struct aabb *aabb = &ent->identity_aabb;
+    vec3_t half = (vec3_t){
+        (aabb->x_max - aabb->x_min) / 2.0f,
+        (aabb->y_max - aabb->y_min) / 2.0f,
+        (aabb->z_max - aabb->z_min) / 2.0f,
+    };
+    vec3_t scale = Entity_GetScale(uid);
+    float radius = PFM_Vec3_Len(&half) * MAX(MAX(scale.x, scale.y), scale.z);
+
+    vec3_t delta, pos = G_Pos_Get(uid);
+    PFM_Vec3_Sub(&cam_pos, &pos, &delta);
+    float dist = PFM_Vec3_Len(&delta);
+    if(dist <= radius)
+        return INFINITY;
+
+    return radius / (dist * tanf(CAM_FOV_RAD / 2.0f));
+}
+
+static int g_mesh_lod(float size, bool shadow)
+{
+    float near = shadow ? MESH_LOD_SHADOW_NEAR_SIZE : MESH_LOD_NEAR_SIZE;
+    float far = shadow ? MESH_LOD_SHADOW_FAR_SIZE : MESH_LOD_FAR_SIZE;
+
+    if(size >= near)
+        return 0;
+    if(size >= far)
+        return 1;
+    return 2;
+}
+
+/* The part of a draw list built from one range of the entities. In every
+ * buffer, the opaque entries are written from the front and the translucent 
+ * ones from the back, so that the ranges can be joined into lists with all
+ * the opaque entities ahead of the translucent ones, without sorting them. 
+ */
+struct draw_range{
+    bool                        failed;
+    size_t                      cap;
+    struct ent_stat_rstate     *stat;
+    size_t                      nstat[2];
+    struct ent_stat_rstate     *statics;
+    size_t                      nstatic[2];
+    struct ent_anim_rstate     *anim;
+    size_t                      nanim[2];
+    struct ent_impostor_rstate *imp;
+    size_t                      nimp;
+};
+
+struct draw_list_work{
+    const vec_entity_t         *ents;
+    bool                        onlycasters;
+    bool                        want_imp;
+    bool                        want_static;
+    bool                        anim_lod;
+    bool                        mesh_lod;
+    bool                        impostors;
+    bool                        has_map;
+    struct map_resolution       res;
+    vec3_t                      map_pos;
+    vec3_t                      cam_pos;
+    struct draw_range          *ranges;
+};
+
+#define DRAW_RANGE_PUSH(_buff, _counts, _cap, _translucent, _entry)             \
+    do{                                                                         \
+        if(_translucent) {                                                      \
+            (_buff)[(_cap) - ++(_counts)[1]] = (_entry);                        \
+        }else{                                                                  \
+            (_buff)[(_counts)[0]++] = (_entry);                                 \
+        }                                                                       \
+    }while(0)
+
+static void g_draw_range_build(struct draw_list_work *work, size_t idx)
+{
+    struct draw_range *range = &work->ranges[idx];
+    size_t begin = idx * DRAW_LIST_GRAIN;
+    size_t end = MIN(begin + DRAW_LIST_GRAIN, vec_size(work->ents));
+    size_t cap = end - begin;
+
+    /* Allocated from the arena of the thread building the range */
+    memset(range, 0, sizeof(*range));
+    range->cap = cap;
+    range->stat = Sched_FrameAlloc(sizeof(struct ent_stat_rstate) * cap);
+    range->anim = Sched_FrameAlloc(sizeof(struct ent_anim_rstate) * cap);
+    if(work->want_static) {
+        range->statics = Sched_FrameAlloc(sizeof(struct ent_stat_rstate) * cap);
+    }
+    if(work->want_imp) {
+        range->imp = Sched_FrameAlloc(sizeof(struct ent_impostor_rstate) * cap);
     }
+    if(!range->stat || !range->anim
+    || (work->want_static && !range->statics)
+    || (work->want_imp && !range->imp)) {
+        range->failed = true;
+        return;
+    }
+
+    const bool onlycasters = work->onlycasters;
+    const vec3_t cam_pos = work->cam_pos;
+    const vec2_t cam_xz = (vec2_t){cam_pos.x, cam_pos.z};
 
-    for(int i = 0; i < vec_size(&ents); i++) {
+    for(size_t i = begin; i < end; i++) {
 
-        uint32_t curr = vec_AT(&ents, i);
+        uint32_t curr = vec_AT(work->ents, i);
         uint32_t flags = G_FlagsGet(curr);
         const struct entity *ent = AL_EntityGet(curr);
 
@@ -442,49 +794,211 @@ static void g_make_draw_list(vec_entity_t ents, vec_rstat_t *out_stat, vec_ranim
         if(onlycasters && !(flags & ENTITY_FLAG_COLLISION))
             continue;
 
-        PERF_PUSH("process entity");
-
         mat4x4_t model;
-        Entity_ModelMatrix(curr, &model);
+        g_render_model_matrix(curr, &model);
+        bool anim = !!(flags & ENTITY_FLAG_ANIMATED);
+        bool translucent = !!(flags & ENTITY_FLAG_TRANSLUCENT);
+        bool imp = work->impostors && anim && !translucent;
+        float size = (work->mesh_lod || imp) ? g_screen_size(curr, ent, cam_pos) : INFINITY;
+        int lod = work->mesh_lod ? g_mesh_lod(size, onlycasters) : 0;
+
+        /* Impostors cast no shadows */
+        if(imp && onlycasters && size < IMPOSTOR_FULL_SIZE)
+            continue;
+
+        if(imp && work->want_imp && size < IMPOSTOR_FADE_SIZE) {
 
-        if(flags & ENTITY_FLAG_ANIMATED) {
+            int anim_level = work->anim_lod ? g_anim_lod(curr, cam_xz) : 0;
+            size_t njoints;
+            struct ent_impostor_rstate rstate = (struct ent_impostor_rstate){
+                .uid = curr,
+                .render_private = ent->render_private, 
+                .model = model,
+                .aabb = ent->identity_aabb,
+                .fade = MIN(1.0f, (IMPOSTOR_FADE_SIZE - size) 
+                                / (IMPOSTOR_FADE_SIZE - IMPOSTOR_FULL_SIZE)),
+            };
+            A_GetRenderState(curr, anim_level, &njoints, &rstate.pose_base);
+            range->imp[range->nimp++] = rstate;
+
+            if(size < IMPOSTOR_FULL_SIZE)
+                continue;
+        }
+
+        if(anim) {
 
             struct ent_anim_rstate rstate = (struct ent_anim_rstate){
                 .uid = curr,
                 .render_private = ent->render_private, 
                 .model = model,
-                .translucent = !!(flags & ENTITY_FLAG_TRANSLUCENT),
+                .translucent = translucent,
+                .lod = lod,
             };
-            A_GetRenderState(curr, &rstate.njoints, rstate.curr_pose, &rstate.inv_bind_pose);
-            vec_ranim_push(out_anim, rstate);
+            int anim_level = work->anim_lod ? g_anim_lod(curr, cam_xz) : 0;
+            A_GetRenderState(curr, anim_level, &rstate.njoints, &rstate.pose_base);
+            DRAW_RANGE_PUSH(range->anim, range->nanim, cap, translucent, rstate);
 
         }else{
         
             struct tile_desc td = {0};
-            if(s_gs.map) {
-                M_Tile_DescForPoint2D(res, M_GetPos(s_gs.map), G_Pos_GetXZ(curr), &td);
+            if(work->has_map) {
+                M_Tile_DescForPoint2D(work->res, work->map_pos, G_Pos_GetXZ(curr), &td);
             }
 
             struct ent_stat_rstate rstate = (struct ent_stat_rstate){
                 .uid = curr,
                 .render_private = ent->render_private, 
                 .model = model,
-                .translucent = !!(flags & ENTITY_FLAG_TRANSLUCENT),
-                .td = td
+                .translucent = translucent,
+                .td = td,
+                .aabb = ent->identity_aabb,
+                .lod = lod,
             };
-            vec_rstat_push(out_stat, rstate);
+            if(work->want_static && !(flags & ENTITY_FLAG_MOVABLE)) {
+                DRAW_RANGE_PUSH(range->statics, range->nstatic, cap, translucent, rstate);
+            }else{
+                DRAW_RANGE_PUSH(range->stat, range->nstat, cap, translucent, rstate);
+            }
         }
-        PERF_POP();
     }
+}
 
-    g_sort_stat_list(out_stat);
-    g_sort_anim_list(out_anim);
+static void g_draw_range_task(size_t begin, size_t end, void *arg)
+{
+    PERF_ENTER();
+    for(size_t i = begin; i < end; i++) {
+        g_draw_range_build(arg, i);
+    }
     PERF_RETURN_VOID();
 }
 
+/* Append the entries of all the ranges to the list, the opaque ones first. The 
+ * translucent entries sit at the back of every range buffer in reverse order. */
+#define DRAW_LIST_JOIN(_name, _out, _ranges, _nranges, _buff, _counts)          \
+    do{                                                                         \
+        size_t __total = vec_size(_out);                                        \
+        for(size_t __r = 0; __r < (_nranges); __r++) {                          \
+            __total += (_ranges)[__r]._counts[0] + (_ranges)[__r]._counts[1];   \
+        }                                                                       \
+        if(!vec_##_name##_resize((_out), __total))                              \
+            break;                                                              \
+        for(size_t __r = 0; __r < (_nranges); __r++) {                          \
+            const struct draw_range *__curr = &(_ranges)[__r];                  \
+            if(__curr->_counts[0] == 0)                                         \
+                continue;                                                       \
+            memcpy((_out)->array + (_out)->size, __curr->_buff,                 \
+                __curr->_counts[0] * sizeof(*__curr->_buff));                   \
+            (_out)->size += __curr->_counts[0];                                 \
+        }                                                                       \
+        for(size_t __r = 0; __r < (_nranges); __r++) {                          \
+            const struct draw_range *__curr = &(_ranges)[__r];                  \
+            for(size_t __i = 0; __i < __curr->_counts[1]; __i++) {              \
+                (_out)->array[(_out)->size++]                                   \
+                    = __curr->_buff[__curr->cap - 1 - __i];                     \
+            }                                                                   \
+        }                                                                       \
+    }while(0)
+
+static void g_make_draw_list(vec_entity_t ents, vec_rstat_t *out_stat, vec_ranim_t *out_anim,
+                             vec_rimp_t *out_imp, vec_rstat_t *out_static, bool onlycasters)
+{
+    PERF_ENTER();
+
+    struct draw_list_work work = (struct draw_list_work){
+        .ents = &ents,
+        .onlycasters = onlycasters,
+        .want_imp = (out_imp != NULL),
+        .want_static = (out_static != NULL),
+        .anim_lod = Settings_ReadBool(s_sett.anim_lod),
+        .mesh_lod = Settings_ReadBool(s_sett.mesh_lod),
+        .impostors = Settings_ReadBool(s_sett.impostors),
+        .has_map = (s_gs.map != NULL),
+        .cam_pos = Camera_GetPos(s_gs.active_cam),
+    };
+    if(s_gs.map) {
+        M_GetResolution(s_gs.map, &work.res);
+        work.map_pos = M_GetPos(s_gs.map);
+    }
+
+    /* The entity state that is read here is only written by the main thread, 
+     * which is busy running ranges itself until all of them are done. */
+    size_t nranges = (vec_size(&ents) + DRAW_LIST_GRAIN - 1) / DRAW_LIST_GRAIN;
+    STALLOC(struct draw_range, ranges, MAX(nranges, 1));
+    work.ranges = ranges;
+    Sched_ParallelFor(0, nranges, 1, g_draw_range_task, &work);
+
+    /* A range whose buffers couldn't be had from its' worker's arena gets 
+     * another chance on the main thread, else it is skipped for this frame. */
+    for(size_t i = 0; i < nranges; i++) {
+        if(!ranges[i].failed)
+            continue;
+        g_draw_range_build(&work, i);
+        if(ranges[i].failed) {
+            memset(&ranges[i], 0, sizeof(ranges[i]));
+        }
+    }
+
+    PERF_PUSH("join ranges");
+    DRAW_LIST_JOIN(rstat, out_stat, ranges, nranges, stat, nstat);
+    DRAW_LIST_JOIN(ranim, out_anim, ranges, nranges, anim, nanim);
+    if(out_static) {
+        DRAW_LIST_JOIN(rstat, out_static, ranges, nranges, statics, nstatic);
+    }
+    if(out_imp) {
+        size_t total = vec_size(out_imp);
+        for(size_t i = 0; i < nranges; i++) {
+            total += ranges[i].nimp;
+        }
+        if(vec_rimp_resize(out_imp, total)) {
+            for(size_t i = 0; i < nranges; i++) {
+                if(ranges[i].nimp == 0)
+                    continue;
+                memcpy(out_imp->array + out_imp->size, ranges[i].imp, 
+                    ranges[i].nimp * sizeof(struct ent_impostor_rstate));
+                out_imp->size += ranges[i].nimp;
+            }
+        }
+    }
+    PERF_POP();
+
+    STFREE(ranges);
+    PERF_RETURN_VOID();
+}
+
+static uint64_t g_static_shadow_hash(const vec_rstat_t *list)
+{
+    /* FNV-1a over the mesh, level of detail and transform of every static caster */
+    uint64_t hash = 14695981039346656037ull;
+
+    for(int i = 0; i < vec_size(list); i++) {
+
+        const struct ent_stat_rstate *curr = &vec_AT(list, i);
+        const unsigned char *bytes[] = {
+            (const unsigned char*)&curr->render_private,
+            (const unsigned char*)&curr->lod,
+            (const unsigned char*)&curr->model
+        };
+        const size_t sizes[] = {
+            sizeof(curr->render_private), 
+            sizeof(curr->lod), 
+            sizeof(curr->model)
+        };
+
+        for(int j = 0; j < ARR_SIZE(bytes); j++) {
+            for(size_t k = 0; k < sizes[j]; k++) {
+                hash ^= bytes[j][k];
+                hash *= 1099511628211ull;
+            }
+        }
+    }
+    return hash;
+}
+
+/* The render input lists are built directly in the render workspace, so 
+ * that they can be handed over to the render thread without a copy. */
 static void *stackmalloc(size_t size)
 {
-    return stalloc(&s_gs.render_data_stack, size);
+    return R_AllocArg(size);
 }
 
 static void *stackrealloc(void *ptr, size_t size)
@@ -505,43 +1019,134 @@ static void stackfree(void *ptr)
     /* no-op */
 }
 
-static void g_create_render_input(struct render_input *out)
+static void g_make_cascade_lists(struct render_input *out)
 {
     PERF_ENTER();
 
-    struct sval shadows_setting;
-    ss_e status = Settings_Get("pf.video.shadows_enabled", &shadows_setting);
-    assert(status == SS_OKAY);
+    for(int i = 0; i < out->ncascades; i++) {
+
+        struct cascade_input *cin = &out->cascade_in[i];
+        vec_rstat_init_alloc(&cin->light_vis_stat, stackrealloc, stackfree);
+        vec_ranim_init_alloc(&cin->light_vis_anim, stackrealloc, stackfree);
+        vec_rstat_init_alloc(&cin->light_vis_static, stackrealloc, stackfree);
+
+        if(!out->cascades[i].update)
+            continue;
+
+        vec_rstat_resize(&cin->light_vis_stat, vec_size(&out->light_vis_stat));
+        vec_ranim_resize(&cin->light_vis_anim, vec_size(&out->light_vis_anim));
+        vec_rstat_resize(&cin->light_vis_static, vec_size(&out->light_vis_static));
+    }
+
+    /* The lists are already sorted, and stay sorted after filtering */
+    const vec_rstat_t *stat_lists[] = {&out->light_vis_stat, &out->light_vis_static};
+    for(int l = 0; l < ARR_SIZE(stat_lists); l++) {
+        for(int i = 0; i < vec_size(stat_lists[l]); i++) {
+
+            const struct ent_stat_rstate *curr = &vec_AT(stat_lists[l], i);
+            struct obb obb;
+            Entity_CurrentOBB(curr->uid, &obb, false);
+
+            for(int j = 0; j < out->ncascades; j++) {
+
+                struct cascade_input *cin = &out->cascade_in[j];
+                if(!out->cascades[j].update)
+                    continue;
+                if(!C_FrustumOBBIntersectionExact(&cin->frustum, &obb))
+                    continue;
+                vec_rstat_push(l == 0 ? &cin->light_vis_stat : &cin->light_vis_static, *curr);
+            }
+        }
+    }
+
+    for(int i = 0; i < vec_size(&out->light_vis_anim); i++) {
+
+        const struct ent_anim_rstate *curr = &vec_AT(&out->light_vis_anim, i);
+        struct obb obb;
+        Entity_CurrentOBB(curr->uid, &obb, false);
+
+        for(int j = 0; j < out->ncascades; j++) {
+
+            struct cascade_input *cin = &out->cascade_in[j];
+            if(!out->cascades[j].update)
+                continue;
+            if(!C_FrustumOBBIntersectionExact(&cin->frustum, &obb))
+                continue;
+            vec_ranim_push(&cin->light_vis_anim, *curr);
+        }
+    }
+
+    for(int i = 0; i < out->ncascades; i++) {
+        struct cascade_input *cin = &out->cascade_in[i];
+        cin->static_shadow_hash = g_static_shadow_hash(&cin->light_vis_static);
+    }
+
+    PERF_RETURN_VOID();
+}
+
+static void g_create_render_input(struct render_input *out)
+{
+    PERF_ENTER();
 
     out->cam = s_gs.active_cam;
     out->map = s_gs.prev_tick_map;
-    out->shadows = shadows_setting.as_bool;
+    out->shadows = Settings_ReadBool(s_sett.shadows_enabled);
     out->light_pos = s_gs.light_pos;
 
+    out->gpu_culling = Settings_ReadBool(s_sett.gpu_culling) && R_ComputeShaderSupported();
+    out->occlusion_capture = G_Occl_Enabled();
+    out->depth_prepass = Settings_ReadBool(s_sett.depth_prepass);
+    out->terrain_lod = Settings_ReadBool(s_sett.terrain_lod);
+    Camera_MakeFrustum(s_gs.active_cam, &out->cam_frustum);
+    R_LightVisibilityFrustum(s_gs.active_cam, &out->light_frustum);
+
     vec_rstat_init_alloc(&out->cam_vis_stat, stackrealloc, stackfree);
     vec_ranim_init_alloc(&out->cam_vis_anim, stackrealloc, stackfree);
+    vec_rimp_init_alloc(&out->cam_vis_imp, stackrealloc, stackfree);
 
     vec_rstat_init_alloc(&out->light_vis_stat, stackrealloc, stackfree);
     vec_ranim_init_alloc(&out->light_vis_anim, stackrealloc, stackfree);
+    vec_rstat_init_alloc(&out->light_vis_static, stackrealloc, stackfree);
 
     vec_rstat_resize(&out->cam_vis_stat, 2048);
     vec_ranim_resize(&out->cam_vis_anim, 2048);
+    vec_rimp_resize(&out->cam_vis_imp, 2048);
 
     vec_rstat_resize(&out->light_vis_stat, 2048);
     vec_ranim_resize(&out->light_vis_anim, 2048);
-
-    g_make_draw_list(s_gs.visible, &out->cam_vis_stat, &out->cam_vis_anim, false);
-    g_make_draw_list(s_gs.light_visible, &out->light_vis_stat, &out->light_vis_anim, true);
+    vec_rstat_resize(&out->light_vis_static, 2048);
+
+    g_make_draw_list(s_gs.visible, &out->cam_vis_stat, &out->cam_vis_anim, 
+        &out->cam_vis_imp, NULL, false);
+    g_make_draw_list(s_gs.light_visible, &out->light_vis_stat, &out->light_vis_anim, 
+        NULL, &out->light_vis_static, true);
+    out->static_shadow_hash = g_static_shadow_hash(&out->light_vis_static);
+
+    out->ncascades = out->shadows ? Settings_ReadInt(s_sett.shadow_cascades) : 1;
+    if(out->shadows) {
+        struct frustum frusta[R_SHADOW_MAX_CASCADES];
+        R_LightCascades(s_gs.active_cam, s_gs.light_pos, out->ncascades, out->cascades, frusta);
+        for(int i = 0; i < out->ncascades; i++) {
+            out->cascade_in[i].frustum = frusta[i];
+        }
+    }
+    if(out->ncascades > 1) {
+        g_make_cascade_lists(out);
+    }
 
     PERF_RETURN_VOID();
 }
 
-static void g_destroy_render_input(void)
+static struct render_input *g_push_render_input(const struct render_input *in)
 {
-    stalloc_clear(&s_gs.render_data_stack);
+    struct render_input *ret = R_PushArg(in, sizeof(*in));
+    ret->cam = R_PushArg(in->cam, g_sizeof_camera);
+    return ret;
 }
 
-static void *g_push_render_input(struct render_input in)
+/* Make a copy of the input, including its' lists, which can be modified
+ * without affecting the original */
+static struct render_input *g_copy_render_input(struct render_input in)
 {
     struct render_input *ret = R_PushArg(&in, sizeof(in));
 
@@ -555,6 +1160,10 @@ static void *g_push_render_input(struct render_input in)
         ret->cam_vis_anim.array = R_PushArg(in.cam_vis_anim.array, 
             in.cam_vis_anim.size * sizeof(struct ent_anim_rstate));
     }
+    if(in.cam_vis_imp.size) {
+        ret->cam_vis_imp.array = R_PushArg(in.cam_vis_imp.array, 
+            in.cam_vis_imp.size * sizeof(struct ent_impostor_rstate));
+    }
 
     if(in.light_vis_stat.size) {
         ret->light_vis_stat.array = R_PushArg(in.light_vis_stat.array, 
@@ -564,6 +1173,29 @@ static void *g_push_render_input(struct render_input in)
         ret->light_vis_anim.array = R_PushArg(in.light_vis_anim.array, 
             in.light_vis_anim.size * sizeof(struct ent_anim_rstate));
     }
+    if(in.light_vis_static.size) {
+        ret->light_vis_static.array = R_PushArg(in.light_vis_static.array, 
+            in.light_vis_static.size * sizeof(struct ent_stat_rstate));
+    }
+
+    for(int i = 0; i < in.ncascades && in.ncascades > 1; i++) {
+
+        const struct cascade_input *cin = &in.cascade_in[i];
+        struct cascade_input *cout = &ret->cascade_in[i];
+
+        if(cin->light_vis_stat.size) {
+            cout->light_vis_stat.array = R_PushArg(cin->light_vis_stat.array, 
+                cin->light_vis_stat.size * sizeof(struct ent_stat_rstate));
+        }
+        if(cin->light_vis_anim.size) {
+            cout->light_vis_anim.array = R_PushArg(cin->light_vis_anim.array, 
+                cin->light_vis_anim.size * sizeof(struct ent_anim_rstate));
+        }
+        if(cin->light_vis_static.size) {
+            cout->light_vis_static.array = R_PushArg(cin->light_vis_static.array, 
+                cin->light_vis_static.size * sizeof(struct ent_stat_rstate));
+        }
+    }
 
     return ret;
 }
@@ -573,6 +1205,15 @@ static bool bool_val_validate(const struct sval *new_val)
     return (new_val->type == ST_TYPE_BOOL);
 }
 
+static bool shadow_cascades_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    if(new_val->as_int < 1 || new_val->as_int > R_SHADOW_MAX_CASCADES)
+        return false;
+    return true;
+}
+
 static bool cam_zoom_validate(const struct sval *new_val)
 {
     if(new_val->type != ST_TYPE_INT)
@@ -611,6 +1252,15 @@ static bool int_validate(const struct sval *new_val)
     return true;
 }
 
+static bool pos_index_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    if(new_val->as_int < POS_INDEX_QUADTREE || new_val->as_int > POS_INDEX_GRID)
+        return false;
+    return true;
+}
+
 static bool hb_mode_validate(const struct sval *new_val)
 {
     if(new_val->type != ST_TYPE_INT)
@@ -665,11 +1315,9 @@ static bool g_save_anim_state(SDL_RWops *stream)
     size_t nanim = 0;
 
     uint32_t curr;
-    kh_foreach_key(s_gs.active, curr, {
+    G_EntIndex_FOREACH(ENT_COMP_ANIM, curr, {
 
         uint32_t flags = G_FlagsGet(curr);
-        if(!(flags & ENTITY_FLAG_ANIMATED))
-            continue;
         if(flags & ENTITY_FLAG_MARKER)
             continue;
         nanim++;
@@ -681,11 +1329,9 @@ static bool g_save_anim_state(SDL_RWops *stream)
     };
     CHK_TRUE_RET(Attr_Write(stream, &num_anim, "num_anim"));
 
-    kh_foreach_key(s_gs.active, curr, {
+    G_EntIndex_FOREACH(ENT_COMP_ANIM, curr, {
 
         uint32_t flags = G_FlagsGet(curr);
-        if(!(flags & ENTITY_FLAG_ANIMATED))
-            continue;
         if(flags & ENTITY_FLAG_MARKER)
             continue;
 
@@ -720,60 +1366,232 @@ static bool g_load_anim_state(SDL_RWops *stream)
         CHK_TRUE_RET(A_LoadState(stream, uid));
         Sched_TryYield();
     }
-
-    return true;
+
+    return true;
+}
+
+static size_t g_num_factions(void)
+{
+    size_t ret = 0;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(s_gs.factions_allocd & (0x1 << i))
+            ret++;
+    }
+    return ret;
+}
+
+static int g_alloc_faction(void)
+{
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(0 == (s_gs.factions_allocd & (0x1 << i))) {
+            s_gs.factions_allocd |= (0x1 << i);
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint16_t g_player_mask(void)
+{
+    bool controllable[MAX_FACTIONS];
+    uint16_t facs = G_GetFactions(NULL, NULL, controllable);
+
+    uint16_t ret = 0;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(facs & (0x1 << i) && controllable[i])
+            ret |= (0x1 << i);
+    }
+    return ret;
+}
+
+static bool g_ent_visible(uint16_t playermask, uint32_t uid, const struct obb *obb)
+{
+    if(!s_gs.map)
+        return true;
+
+    uint32_t flags = G_FlagsGet(uid);
+    if(flags & ENTITY_FLAG_MARKER)
+        return true;
+
+    if(!(flags & ENTITY_FLAG_MOVABLE)
+    ||  (flags & ENTITY_FLAG_RESOURCE)
+    ||  (flags & ENTITY_FLAG_BUILDING)) {
+        return G_Fog_ObjExplored(playermask, uid, obb);
+    }
+
+    return G_Fog_ObjVisible(playermask, obb);
+}
+
+/* Entities are gathered in fixed-size batches so that their bounding boxes 
+ * can be tested against the view frusta with the packed collision kernels.
+ */
+struct cull_batch{
+    size_t         count;
+    uint32_t       uids[CULL_BATCH_SIZE];
+    struct obb     obbs[CULL_BATCH_SIZE];
+    float          soa_data[12][CULL_BATCH_SIZE];
+    struct obb_soa soa;
+};
+
+static void g_cull_batch_init(struct cull_batch *batch)
+{
+    batch->count = 0;
+    for(int i = 0; i < 3; i++) {
+        batch->soa.center[i] = batch->soa_data[i];
+        for(int j = 0; j < 3; j++) {
+            batch->soa.extent[i][j] = batch->soa_data[3 + i * 3 + j];
+        }
+    }
+}
+
+/* Entities of a batch which is not 'tested' are already known to lie 
+ * within both frusta. */
+static void g_cull_batch_flush(struct cull_batch *batch, uint16_t pm,
+                               const struct frustum *cam_frust,
+                               const struct frustum *light_frust,
+                               bool occlusion, bool tested)
+{
+    bool cam_mask[CULL_BATCH_SIZE];
+    bool light_mask[CULL_BATCH_SIZE];
+
+    Entity_CurrentOBBs(batch->count, batch->uids, batch->obbs, false);
+
+    if(tested) {
+        for(size_t i = 0; i < batch->count; i++) {
+            C_OBBSoASet(&batch->soa, i, &batch->obbs[i]);
+        }
+        /* Note that there may be some false positives due to using the fast frustum cull. */
+        C_FrustumOBBIntersectionBatch(cam_frust, &batch->soa, batch->count, cam_mask);
+        C_FrustumOBBIntersectionBatch(light_frust, &batch->soa, batch->count, light_mask);
+    }else{
+        memset(cam_mask, true, batch->count * sizeof(bool));
+        memset(light_mask, true, batch->count * sizeof(bool));
+    }
+    size_t noccluded = 0;
+
+    for(size_t i = 0; i < batch->count; i++) {
+
+        uint32_t uid = batch->uids[i];
+        const struct obb *obb = &batch->obbs[i];
+        bool vis_checked = false;
+        bool vis = false;
+
+        /* Only the camera view is culled - the shadows of the occluded 
+         * entities may still fall on the visible terrain */
+        if(cam_mask[i] && occlusion && G_Occl_OBBOccluded(obb)) {
+            cam_mask[i] = false;
+            noccluded++;
+        }
+
+        if(cam_mask[i]) {
+            vis = g_ent_visible(pm, uid, obb);
+            vis_checked = true;
+            if(vis) {
+                vec_entity_push(&s_gs.visible, uid);
+                vec_obb_push(&s_gs.visible_obbs, *obb);
+            }
+        }
+
+        if(light_mask[i]) {
+            if(!vis_checked) {
+                vis = g_ent_visible(pm, uid, obb);
+            }
+            uint32_t flags = G_FlagsGet(uid);
+            if(vis || !(flags & ENTITY_FLAG_MOVABLE)) {
+                vec_entity_push(&s_gs.light_visible, uid);
+            }
+        }
+    }
+    PERF_COUNTER_ADD("game.entities_occluded", noccluded);
+    batch->count = 0;
 }
 
-static size_t g_num_factions(void)
+/* A bound on the distance of any point of the entity from its' position, 
+ * regardless of its' rotation. */
+static float g_cull_radius(uint32_t uid)
 {
-    size_t ret = 0;
-    for(int i = 0; i < MAX_FACTIONS; i++) {
-        if(s_gs.factions_allocd & (0x1 << i))
-            ret++;
-    }
-    return ret;
+    const struct entity *ent = AL_EntityGet(uid);
+    const struct aabb *aabb = &ent->identity_aabb;
+    vec3_t reach = (vec3_t){
+        MAX(fabsf(aabb->x_min), fabsf(aabb->x_max)),
+        MAX(fabsf(aabb->y_min), fabsf(aabb->y_max)),
+        MAX(fabsf(aabb->z_min), fabsf(aabb->z_max)),
+    };
+    vec3_t scale = Entity_GetScale(uid);
+    float radius = PFM_Vec3_Len(&reach) 
+                 * MAX(MAX(fabsf(scale.x), fabsf(scale.y)), fabsf(scale.z));
+
+    if(G_FlagsGet(uid) & ENTITY_FLAG_ANIMATED)
+        radius *= ANIM_BOUNDS_SLACK;
+    return radius;
 }
 
-static int g_alloc_faction(void)
+static void g_cull_bin_refresh(size_t idx, const struct pos_bin *bin)
 {
-    for(int i = 0; i < MAX_FACTIONS; i++) {
-        if(0 == (s_gs.factions_allocd & (0x1 << i))) {
-            s_gs.factions_allocd |= (0x1 << i);
-            return i;
-        }
+    float radius = 0.0f;
+    for(uint32_t i = 0; i < bin->count; i++) {
+        uint32_t uid = bin->uids[i];
+        if(kh_get(entity, s_gs.active, uid) == kh_end(s_gs.active))
+            continue;
+        radius = MAX(radius, g_cull_radius(uid));
     }
-    return -1;
+    G_Pos_BinSetRadius(idx, radius);
 }
 
-static uint16_t g_player_mask(void)
+/* The entities are culled a map chunk at a time: the chunks which lie outside 
+ * of both frusta are skipped as a whole and the entities of the chunks which 
+ * lie fully within both of them are accepted without testing each one. Only
+ * the entities of the remaining chunks are tested individually. */
+static void g_cull_bins(struct cull_batch *tested, struct cull_batch *accepted, 
+                        uint16_t pm, const struct frustum *cam_frust, 
+                        const struct frustum *light_frust, bool occlusion)
 {
-    bool controllable[MAX_FACTIONS];
-    uint16_t facs = G_GetFactions(NULL, NULL, controllable);
+    size_t nrejected = 0, naccepted = 0;
+    size_t nbins = G_Pos_NumBins();
 
-    uint16_t ret = 0;
-    for(int i = 0; i < MAX_FACTIONS; i++) {
-        if(facs & (0x1 << i) && controllable[i])
-            ret |= (0x1 << i);
-    }
-    return ret;
-}
+    for(size_t i = 0; i < nbins; i++) {
 
-static bool g_ent_visible(uint16_t playermask, uint32_t uid, const struct obb *obb)
-{
-    if(!s_gs.map)
-        return true;
+        const struct pos_bin *bin = G_Pos_Bin(i);
+        if(bin->count == 0)
+            continue;
+        if(bin->dirty)
+            g_cull_bin_refresh(i, bin);
 
-    uint32_t flags = G_FlagsGet(uid);
-    if(flags & ENTITY_FLAG_MARKER)
-        return true;
+        enum volume_intersec_type cam = VOLUME_INTERSEC_INTERSECTION;
+        enum volume_intersec_type light = VOLUME_INTERSEC_INTERSECTION;
+        struct aabb bounds;
 
-    if(!(flags & ENTITY_FLAG_MOVABLE)
-    ||  (flags & ENTITY_FLAG_RESOURCE)
-    ||  (flags & ENTITY_FLAG_BUILDING)) {
-        return G_Fog_ObjExplored(playermask, uid, obb);
+        if(G_Pos_BinBounds(i, &bounds)) {
+            cam = C_FrustumAABBIntersectionFast(cam_frust, &bounds);
+            light = C_FrustumAABBIntersectionFast(light_frust, &bounds);
+        }
+
+        if(cam == VOLUME_INTERSEC_OUTSIDE && light == VOLUME_INTERSEC_OUTSIDE) {
+            nrejected++;
+            continue;
+        }
+
+        bool accept = (cam == VOLUME_INTERSEC_INSIDE && light == VOLUME_INTERSEC_INSIDE);
+        struct cull_batch *batch = accept ? accepted : tested;
+        naccepted += accept;
+
+        for(uint32_t j = 0; j < bin->count; j++) {
+
+            uint32_t uid = bin->uids[j];
+            if(kh_get(entity, s_gs.active, uid) == kh_end(s_gs.active))
+                continue;
+
+            batch->uids[batch->count++] = uid;
+            if(batch->count == CULL_BATCH_SIZE) {
+                g_cull_batch_flush(batch, pm, cam_frust, light_frust, occlusion, !accept);
+            }
+        }
     }
 
-    return G_Fog_ObjVisible(playermask, obb);
+    g_cull_batch_flush(tested, pm, cam_frust, light_frust, occlusion, true);
+    g_cull_batch_flush(accepted, pm, cam_frust, light_frust, occlusion, false);
+    PERF_COUNTER_ADD("game.cull_bins_rejected", nrejected);
+    PERF_COUNTER_ADD("game.cull_bins_accepted", naccepted);
 }
 
 static bool g_entities_equal(uint32_t *a, uint32_t *b)
@@ -789,8 +1607,10 @@ static void g_clear_map_state(void)
         M_FreeMinimap(s_gs.map);
         G_Garrison_Shutdown();
         G_Building_Shutdown();
-        G_Fog_Shutdown();
+        /* The in-flight combat work reads the fog snapshot against the 
+         * fog module's map, so it must be completed first */
         G_Combat_Shutdown();
+        G_Fog_Shutdown();
         G_Formation_Shutdown();
         G_Move_Shutdown();
         G_Builder_Shutdown();
@@ -799,7 +1619,9 @@ static void g_clear_map_state(void)
         G_Harvester_Shutdown();
         G_Automation_Shutdown();
         G_ClearPath_Shutdown();
+        G_ResourceIndex_Shutdown();
         G_Pos_Shutdown();
+        G_Occl_Clear();
         M_DestroyCopyPools();
 
         AL_MapFree(s_gs.map);
@@ -807,12 +1629,16 @@ static void g_clear_map_state(void)
     }
 
     if(s_gs.prev_tick_map) {
-        /* The render thread still owns the previous tick map. Wait 
-         * for it to complete before we free the buffer. */
+        /* The render thread still owns the previous tick maps. Wait 
+         * for it to complete before we free the buffers. */
         Engine_WaitRenderWorkDone();
-        PF_FREE(s_gs.prev_tick_map);
+        for(int i = 0; i < ARR_SIZE(s_gs.prev_tick_maps); i++) {
+            PF_FREE(s_gs.prev_tick_maps[i]);
+            s_gs.prev_tick_maps[i] = NULL;
+        }
         s_gs.prev_tick_map = NULL;
     }
+    M_ClearVisibleChunks();
 }
 
 static void g_set_contextual_cursor(void)
@@ -911,6 +1737,92 @@ static void g_create_settings(void)
     });
     assert(status == SS_OKAY);
 
+    /* Only takes effect the next time a map is loaded */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.position_index",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = POS_INDEX_QUADTREE
+        },
+        .prio = 0,
+        .validate = pos_index_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Generate LOS fields with a compute shader, batching all the chunks 
+     * requested during a tick into one dispatch. The fields become available 
+     * once read back by a later tick. Ignored when compute shaders are not 
+     * supported. */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.gpu_los",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Show only every 2nd or 4th key frame on distant animated entities, 
+     * so that more of them share a pose. */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.anim_lod",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Recompute the steering of distant, uncrowded entities at a reduced 
+     * rate (10 or 5 Hz), integrating their last velocity in between. */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.movement_lod",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Build the enemy seek and surround fields in the background, using 
+     * them from the next movement tick on. Entities keep their previous
+     * steering while their field is outstanding. */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.deferred_nav_fields",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Draw moving entities blended between their last two movement 
+     * ticks instead of snapping to the latest simulated position. */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.movement_interpolation",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
     status = Settings_Create((struct setting){
         .name = "pf.game.fog_of_war_enabled",
         .val = (struct sval) {
@@ -947,6 +1859,50 @@ static void g_create_settings(void)
     });
     assert(status == SS_OKAY);
 
+    /* The number of slices the shadow map is split into. With a single one,
+     * a fixed region around the camera is covered, as before. */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.shadow_cascades",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 1
+        },
+        .prio = 0,
+        .validate = shadow_cascades_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Cull the instances of the batched static entities against the view 
+     * frustum in a compute shader, which writes the indirect draw commands. 
+     * Ignored when compute shaders are not supported. */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.gpu_culling",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Skip drawing the entities which are hidden behind the terrain, using
+     * the terrain depth of the previous frame. Ignored when compute shaders 
+     * are not supported. */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.occlusion_culling",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
     status = Settings_Create((struct setting){
         .name = "pf.debug.navigation_layer",
         .val = (struct sval) {
@@ -1205,53 +2161,245 @@ static void g_create_settings(void)
     });
 }
 
-static void g_render_minimap_units(void)
+static void g_render_minimap_units(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(Sched_UsingBigStack());
+    PERF_ENTER();
+
+    STALLOC(vec2_t, positions, kh_size(s_gs.active));
+    STALLOC(vec3_t, colors, kh_size(s_gs.active));
+    size_t nunits = 0;
+
+    vec3_t color_map[MAX_FACTIONS];
+    uint16_t facs = G_GetFactions(NULL, color_map, NULL);
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(facs & (0x1 << i)) {
+            PFM_Vec3_Scale(&color_map[i], 1.0f / 255, &color_map[i]);
+        }
+    }
+
+    uint32_t curr;
+    kh_foreach_key(s_gs.active, curr, {
+
+        uint32_t flags = G_FlagsGet(curr);
+        if(!s_gs.minimap_render_all 
+        && !(flags & (ENTITY_FLAG_MOVABLE | ENTITY_FLAG_BUILDING)))
+            continue;
+        vec2_t xz_pos = G_Pos_GetXZ(curr);
+        if(!G_Fog_PlayerVisible(xz_pos))
+            continue;
+        positions[nunits] = M_WorldCoordsToNormMapCoords(s_gs.map, xz_pos);
+        colors[nunits] = color_map[G_GetFactionID(curr)];
+        nunits++;
+    });
+
+    M_RenderMinimapUnits(s_gs.map, nunits, positions, colors);
+
+    STFREE(positions);
+    STFREE(colors);
+
+    PERF_RETURN_VOID();
+}
+
+static int g_compare_uids(const void *a, const void *b)
+{
+    uint32_t uida = *(const uint32_t*)a;
+    uint32_t uidb = *(const uint32_t*)b;
+    return (uida > uidb) - (uida < uidb);
+}
+
+static bool g_uid_in_sorted(const uint32_t *uids, size_t nuids, uint32_t uid)
+{
+    return (NULL != bsearch(&uid, uids, nuids, sizeof(uint32_t), g_compare_uids));
+}
+
+static void g_remove_from_subsystems(uint32_t uid)
+{
+    A_RemoveEntity(uid);
+    G_Sel_Remove(uid);
+    G_Move_RemoveEntity(uid);
+    G_Formation_RemoveEntity(uid);
+    G_Combat_RemoveEntity(uid);
+    G_Building_RemoveEntity(uid);
+    G_Builder_RemoveEntity(uid);
+    G_Harvester_RemoveEntity(uid);
+    G_Resource_RemoveEntity(uid);
+    G_StorageSite_RemoveEntity(uid);
+    G_Garrison_RemoveGarrison(uid);
+    G_Garrison_RemoveGarrisonable(uid);
+    G_Automation_RemoveEntity(uid);
+    G_Region_RemoveEnt(uid);
+    G_Pos_Delete(uid);
+    G_EntIndex_Remove(uid);
+    Entity_Remove(uid);
+
+    khiter_t k = kh_get(id, s_gs.ent_faction_map, uid);
+    assert(k != kh_end(s_gs.ent_faction_map));
+    kh_del(id, s_gs.ent_faction_map, k);
+
+    k = kh_get(range, s_gs.ent_visrange_map, uid);
+    assert(k != kh_end(s_gs.ent_visrange_map));
+    kh_del(range, s_gs.ent_visrange_map, k);
+
+    k = kh_get(range, s_gs.selection_radiuses, uid);
+    assert(k != kh_end(s_gs.selection_radiuses));
+    kh_del(range, s_gs.selection_radiuses, k);
+}
+
+/* Same as calling g_delete_gpuid for every entity, except that the 
+ * [1:table_size] range of GPU IDs is restored in a single pass at the 
+ * end, instead of shuffling one entry down per deleted entity. */
+static void g_delete_gpuids(const uint32_t *uids, size_t nuids)
+{
+    if(nuids == 0)
+        return;
+
+    uint32_t old_size = kh_size(s_gs.ent_gpu_id_map);
+    STALLOC(uint32_t, holes, nuids);
+    size_t nholes = 0;
+
+    for(size_t i = 0; i < nuids; i++) {
+
+        khiter_t k = kh_get(entity, s_gs.dynamic, uids[i]);
+        assert(k != kh_end(s_gs.dynamic));
+        kh_del(entity, s_gs.dynamic, k);
+
+        k = kh_get(id, s_gs.ent_gpu_id_map, uids[i]);
+        assert(k != kh_end(s_gs.ent_gpu_id_map));
+        uint32_t old_id = kh_value(s_gs.ent_gpu_id_map, k);
+        kh_del(id, s_gs.ent_gpu_id_map, k);
+
+        k = kh_get(id, s_gs.gpu_id_ent_map, old_id);
+        assert(k != kh_end(s_gs.gpu_id_ent_map));
+        kh_del(id, s_gs.gpu_id_ent_map, k);
+
+        holes[nholes++] = old_id;
+    }
+
+    /* Every surviving ID above the new table size gets moved into one 
+     * of the freed slots at or below it. There are exactly as many of 
+     * the former as there are of the latter. */
+    uint32_t new_size = kh_size(s_gs.ent_gpu_id_map);
+    size_t next_hole = 0;
+
+    for(uint32_t gpu_id = new_size + 1; gpu_id <= old_size; gpu_id++) {
+
+        khiter_t k = kh_get(id, s_gs.gpu_id_ent_map, gpu_id);
+        if(k == kh_end(s_gs.gpu_id_ent_map))
+            continue;
+
+        while(holes[next_hole] > new_size)
+            next_hole++;
+        assert(next_hole < nholes);
+        uint32_t new_id = holes[next_hole++];
+
+        uint32_t uid = kh_value(s_gs.gpu_id_ent_map, k);
+        kh_del(id, s_gs.gpu_id_ent_map, k);
+
+        k = kh_get(id, s_gs.ent_gpu_id_map, uid);
+        assert(k != kh_end(s_gs.ent_gpu_id_map));
+        kh_value(s_gs.ent_gpu_id_map, k) = new_id;
+
+        int ret;
+        k = kh_put(id, s_gs.gpu_id_ent_map, new_id, &ret);
+        assert(ret != -1);
+        kh_value(s_gs.gpu_id_ent_map, k) = uid;
+    }
+
+    STFREE(holes);
+    assert(kh_size(s_gs.dynamic) == kh_size(s_gs.ent_gpu_id_map));
+    assert(kh_size(s_gs.ent_gpu_id_map) == kh_size(s_gs.gpu_id_ent_map));
+}
+
+/* Drop the removed entities from the visible lists with a single 
+ * compaction pass over each list. */
+static void g_compact_visible(const uint32_t *uids, size_t nuids)
 {
-    ASSERT_IN_MAIN_THREAD();
-    assert(Sched_UsingBigStack());
-    PERF_ENTER();
+    size_t nvis = 0;
+    for(size_t i = 0; i < vec_size(&s_gs.visible); i++) {
+        if(g_uid_in_sorted(uids, nuids, vec_AT(&s_gs.visible, i)))
+            continue;
+        vec_AT(&s_gs.visible, nvis) = vec_AT(&s_gs.visible, i);
+        vec_AT(&s_gs.visible_obbs, nvis) = vec_AT(&s_gs.visible_obbs, i);
+        nvis++;
+    }
+    s_gs.visible.size = nvis;
+    s_gs.visible_obbs.size = nvis;
 
-    STALLOC(vec2_t, positions, kh_size(s_gs.active));
-    STALLOC(vec3_t, colors, kh_size(s_gs.active));
-    size_t nunits = 0;
+    size_t nlight = 0;
+    for(size_t i = 0; i < vec_size(&s_gs.light_visible); i++) {
+        if(g_uid_in_sorted(uids, nuids, vec_AT(&s_gs.light_visible, i)))
+            continue;
+        vec_AT(&s_gs.light_visible, nlight++) = vec_AT(&s_gs.light_visible, i);
+    }
+    s_gs.light_visible.size = nlight;
+}
 
-    vec3_t color_map[MAX_FACTIONS];
-    G_GetFactions(NULL, color_map, NULL);
+/* The entities that died over the course of the tick are torn down 
+ * together: each one is still removed from every subsystem, but the 
+ * visible lists are compacted and the GPU IDs are recycled only once 
+ * for the whole batch. */
+static void g_remove_batch(void)
+{
+    vec_entity_t tmp = s_gs.removing;
+    s_gs.removing = s_gs.removed;
+    s_gs.removed = tmp;
 
-    uint32_t curr;
-    kh_foreach_key(s_gs.active, curr, {
+    size_t nqueued = vec_size(&s_gs.removing);
+    uint32_t *uids = s_gs.removing.array;
+    qsort(uids, nqueued, sizeof(uint32_t), g_compare_uids);
 
-        uint32_t flags = G_FlagsGet(curr);
-        if(!s_gs.minimap_render_all 
-        && !(flags & (ENTITY_FLAG_MOVABLE | ENTITY_FLAG_BUILDING)))
+    /* Drop any duplicates, and any entities that have already been 
+     * removed from the simulation. */
+    size_t nuids = 0;
+    for(size_t i = 0; i < nqueued; i++) {
+
+        if(nuids > 0 && uids[nuids - 1] == uids[i])
             continue;
-        vec2_t xz_pos = G_Pos_GetXZ(curr);
-        if(!G_Fog_PlayerVisible(xz_pos))
+
+        khiter_t k = kh_get(entity, s_gs.active, uids[i]);
+        if(k == kh_end(s_gs.active))
             continue;
-        vec3_t norm_color = color_map[G_GetFactionID(curr)];
-        PFM_Vec3_Scale(&norm_color, 1.0f / 255, &norm_color);
+        kh_del(entity, s_gs.active, k);
+        uids[nuids++] = uids[i];
+    }
 
-        positions[nunits] = M_WorldCoordsToNormMapCoords(s_gs.map, xz_pos);
-        colors[nunits] = norm_color;
-        nunits++;
-    });
+    STALLOC(uint32_t, movable, nuids + 1);
+    size_t nmovable = 0;
+    for(size_t i = 0; i < nuids; i++) {
+        if(G_FlagsGet(uids[i]) & ENTITY_FLAG_MOVABLE)
+            movable[nmovable++] = uids[i];
+    }
+    g_delete_gpuids(movable, nmovable);
+    STFREE(movable);
 
-    M_RenderMinimapUnits(s_gs.map, nunits, positions, colors);
+    g_compact_visible(uids, nuids);
 
-    STFREE(positions);
-    STFREE(colors);
+    for(size_t i = 0; i < nuids; i++) {
+        g_remove_from_subsystems(uids[i]);
+    }
+    for(size_t i = 0; i < nuids; i++) {
+        G_FreeEntity(uids[i]);
+    }
 
-    PERF_RETURN_VOID();
+    if(nuids > 0) {
+        G_Sel_MarkHoveredDirty();
+    }
+    PERF_COUNTER_ADD("game.entities_removed", nuids);
+    vec_entity_reset(&s_gs.removing);
 }
 
 static void g_remove_queued(void)
 {
-    for(int i = 0; i < vec_size(&s_gs.removed); i++) {
-        uint32_t curr = vec_AT(&s_gs.removed, i);
-        G_RemoveEntity(curr);
-        G_FreeEntity(curr);
+    if(vec_size(&s_gs.removed) == 0)
+        return;
+
+    PERF_ENTER();
+    while(vec_size(&s_gs.removed) > 0) {
+        g_remove_batch();
     }
-    vec_entity_reset(&s_gs.removed);
+    PERF_RETURN_VOID();
 }
 
 static void g_prune_water_input(struct render_input *in)
@@ -1291,6 +2439,16 @@ static void g_prune_water_input(struct render_input *in)
         }
     }
 
+    for(int i = vec_size(&in->cam_vis_imp) - 1; i >= 0; i--) {
+
+        const struct ent_impostor_rstate *rstate = &vec_AT(&in->cam_vis_imp, i);
+        vec2_t xz_pos = G_Pos_GetXZ(rstate->uid);
+
+        if(!G_Fog_NearVisibleWater(pm, xz_pos, WATER_ADJ_DISTANCE)) {
+            vec_rimp_del(&in->cam_vis_imp, i);
+        }
+    }
+
     for(int i = vec_size(&in->light_vis_anim) - 1; i >= 0; i--) {
 
         const struct ent_anim_rstate *rstate = &vec_AT(&in->light_vis_anim, i);
@@ -1342,69 +2500,6 @@ void g_delete_gpuid(uint32_t uid)
     assert(kh_size(s_gs.ent_gpu_id_map) == kh_size(s_gs.gpu_id_ent_map));
 }
 
-static void on_update_ui(void *user, void *event)
-{
-    if(!s_gs.show_unit_icons)
-        return;
-
-    struct nk_style_item bg_style = (struct nk_style_item){
-        .type = NK_STYLE_ITEM_COLOR,
-        .data.color = (struct nk_color){0, 0, 0, 0}
-    };
-
-    struct nk_context *ctx = UI_GetContext();
-    nk_style_push_style_item(ctx, &ctx->style.window.fixed_background, bg_style);
-    nk_style_push_vec2(ctx, &ctx->style.window.padding, nk_vec2(0.0f, 0.0f));
-    nk_style_push_vec2(ctx, &ctx->style.window.spacing, nk_vec2(0.0f, 0.0f));
-
-    for(int i = 0; i < vec_size(&s_gs.visible); i++) {
-
-        uint32_t uid = vec_AT(&s_gs.visible, i);
-        const char *icons[MAX_ICONS];
-        size_t nicons = Entity_GetIcons(uid, ARR_SIZE(icons), icons);
-        if(nicons == 0 || G_EntityIsZombie(uid))
-            continue;
-
-        char name[256];
-        pf_snprintf(name, sizeof(name), "__icons__.%x", uid);
-
-        const vec2_t vres = (vec2_t){1920, 1080};
-        const vec2_t adj_vres = UI_ArAdjustedVRes(vres);
-
-        vec2_t ss_pos = Entity_TopScreenPos(uid, adj_vres.x, adj_vres.y);
-        const int width = 32 * nicons;
-        const int height = 32;
-
-        float yoffset = 0;
-        if((G_FlagsGet(uid) & ENTITY_FLAG_STORAGE_SITE) && G_StorageSite_GetShowUI()) {
-            yoffset = G_StorageSite_GetWindowHeight(uid) / 8.0f;
-        }
-
-        const vec2_t pos = (vec2_t){ss_pos.x - width/2, ss_pos.y - 14 + yoffset};
-        const int flags = NK_WINDOW_NOT_INTERACTIVE | NK_WINDOW_BACKGROUND | NK_WINDOW_NO_SCROLLBAR;
-
-        struct rect adj_bounds = UI_BoundsForAspectRatio(
-            (struct rect){pos.x, pos.y, width, height}, 
-            vres, adj_vres, ANCHOR_DEFAULT
-        );
-
-        if(nk_begin_with_vres(ctx, name, 
-            (struct nk_rect){adj_bounds.x, adj_bounds.y, adj_bounds.w, adj_bounds.h}, 
-            flags, (struct nk_vec2i){adj_vres.x, adj_vres.y})) {
-
-            nk_layout_row_begin(ctx, NK_STATIC, 32, nicons);
-            nk_layout_row_push(ctx, 32);
-            for(int i = 0; i < nicons; i++) {
-                nk_image_texpath(ctx, icons[i]);
-            }
-        }
-        nk_end(ctx);
-    }
-    nk_style_pop_vec2(ctx);
-    nk_style_pop_vec2(ctx);
-    nk_style_pop_style_item(ctx);
-}
-
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -1413,19 +2508,21 @@ bool G_Init(void)
 {
     ASSERT_IN_MAIN_THREAD();
 
+    if(!g_init_setting_handles())
+        return false;
+
     vec_entity_init(&s_gs.visible);
     vec_entity_init(&s_gs.light_visible);
     vec_obb_init(&s_gs.visible_obbs);
     vec_entity_init(&s_gs.removed);
+    vec_entity_init(&s_gs.removing);
     g_create_settings();
+    C_SelectKernels();
 
     vec_entity_resize(&s_gs.visible, 2048);
     vec_entity_resize(&s_gs.light_visible, 2048);
     vec_obb_resize(&s_gs.visible_obbs, 2048);
 
-    if(!stalloc_init(&s_gs.render_data_stack))
-        return false;
-
     s_gs.active = kh_init(entity);
     if(!s_gs.active)
         goto fail_active;
@@ -1458,17 +2555,32 @@ bool G_Init(void)
     if(!s_gs.ent_flag_map)
         goto fail_ent_flag_map;
 
+    s_gs.icon_slots = kh_init(icon_slot);
+    if(!s_gs.icon_slots)
+        goto fail_icon_slots;
+
     if(!g_init_camera())
         goto fail_cam; 
 
-    if(!R_InitWS(&s_gs.ws[0]))
-        goto fail_ws;
-
-    if(!R_InitWS(&s_gs.ws[1])) {
-        R_DestroyWS(&s_gs.ws[0]);
+    int nws = 0;
+    for(; nws < ARR_SIZE(s_gs.ws); nws++) {
+        if(!R_InitWS(&s_gs.ws[nws]))
+            break;
+    }
+    if(nws < ARR_SIZE(s_gs.ws)) {
+        while(nws--) {
+            R_DestroyWS(&s_gs.ws[nws]);
+        }
         goto fail_ws;
     }
 
+    if(!G_Occl_Init())
+        goto fail_occl;
+    if(!G_ResourceId_Init())
+        goto fail_resource_id;
+    if(!G_EntIndex_Init())
+        goto fail_ent_index;
+
     G_ClearState();
 
     G_Sel_Init();
@@ -1479,18 +2591,28 @@ bool G_Init(void)
     R_PushCmd((struct rcmd){ R_GL_WaterInit, 0 });
 
     s_gs.prev_tick_map = NULL;
+    memset(s_gs.prev_tick_maps, 0, sizeof(s_gs.prev_tick_maps));
+    s_gs.nws = 2;
     s_gs.curr_ws_idx = 0;
+    s_gs.render_ws_idx = 1;
     s_gs.light_pos = (vec3_t){120.0f, 150.0f, 120.0f};
     s_gs.ss = G_RUNNING;
     s_gs.requested_ss = G_RUNNING;
-
-    E_Global_Register(EVENT_UPDATE_UI, on_update_ui, NULL, 
-        G_RUNNING | G_PAUSED_UI_RUNNING | G_PAUSED_FULL);
     return true;
 
+fail_ent_index:
+    G_ResourceId_Shutdown();
+fail_resource_id:
+    G_Occl_Shutdown();
+fail_occl:
+    for(int i = 0; i < ARR_SIZE(s_gs.ws); i++) {
+        R_DestroyWS(&s_gs.ws[i]);
+    }
 fail_ws:
     Camera_Free(s_gs.active_cam);
 fail_cam:
+    kh_destroy(icon_slot, s_gs.icon_slots);
+fail_icon_slots:
     kh_destroy(id, s_gs.ent_flag_map);
 fail_ent_flag_map:
     kh_destroy(id, s_gs.gpu_id_ent_map);
@@ -1518,16 +2640,26 @@ bool G_LoadMap(SDL_RWops *stream, bool update_navgrid)
     g_clear_map_state();
 
     size_t copysize = AL_MapShallowCopySize(stream);
-    s_gs.prev_tick_map = malloc(copysize);
-    if(!s_gs.prev_tick_map)
+    for(int i = 0; i < ARR_SIZE(s_gs.prev_tick_maps); i++) {
+        s_gs.prev_tick_maps[i] = malloc(copysize);
+        if(s_gs.prev_tick_maps[i])
+            continue;
+        while(i--) {
+            PF_FREE(s_gs.prev_tick_maps[i]);
+            s_gs.prev_tick_maps[i] = NULL;
+        }
         PERF_RETURN(false);
+    }
+    s_gs.prev_tick_map = s_gs.prev_tick_maps[s_gs.curr_ws_idx];
 
     s_gs.map = AL_MapFromPFMapStream(stream, update_navgrid);
     if(!s_gs.map)
         PERF_RETURN(false);
 
     g_init_map();
-    M_AL_ShallowCopy((struct map*)s_gs.prev_tick_map, s_gs.map);
+    for(int i = 0; i < ARR_SIZE(s_gs.prev_tick_maps); i++) {
+        M_AL_ShallowCopy((struct map*)s_gs.prev_tick_maps[i], s_gs.map);
+    }
 
     E_Global_Notify(EVENT_NEW_GAME, s_gs.map, ES_ENGINE);
 
@@ -1564,6 +2696,7 @@ void G_ClearState(void)
 
     kh_clear(entity, s_gs.active);
     kh_clear(entity, s_gs.dynamic);
+    G_EntIndex_Clear();
     kh_clear(id, s_gs.ent_gpu_id_map);
     kh_clear(id, s_gs.gpu_id_ent_map);
     kh_clear(id, s_gs.ent_faction_map);
@@ -1602,6 +2735,7 @@ void G_ClearState(void)
     });
     G_SetLightPos((vec3_t){1.0f, 1.0f, 1.0f});
     R_PushCmd((struct rcmd) { R_GL_Batch_Reset, 0 });
+    R_PushCmd((struct rcmd) { R_GL_ImpostorReset, 0 });
 
     PERF_RETURN_VOID();
 }
@@ -1620,8 +2754,10 @@ bool G_HasWork(void)
 void G_ClearRenderWork(void)
 {
     Engine_WaitRenderWorkDone();
-    R_ClearWS(&s_gs.ws[0]);
-    R_ClearWS(&s_gs.ws[1]);
+    R_TextureLoadClear();
+    for(int i = 0; i < ARR_SIZE(s_gs.ws); i++) {
+        R_ClearWS(&s_gs.ws[i]);
+    }
 }
 
 bool G_GetMinimapPos(float *out_x, float *out_y)
@@ -1711,6 +2847,17 @@ bool G_MapHeightAtPoint(vec2_t xz, float *out_height)
     return true;
 }
 
+size_t G_MapRaycastBatch(size_t nrays, const vec3_t origins[], const vec3_t dirs[],
+                         const float max_dists[], struct map_ray_hit out[])
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_gs.map)
+        return 0;
+
+    return M_RaycastBatch(s_gs.map, nrays, origins, dirs, max_dists, out);
+}
+
 bool G_MapClosestPathable(vec2_t xz, vec2_t *out, enum nav_layer layer)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -1719,9 +2866,37 @@ bool G_MapClosestPathable(vec2_t xz, vec2_t *out, enum nav_layer layer)
         *out = xz;
         return true;
     }
+    M_NavEnsureLayer(s_gs.map, layer);
     return M_NavClosestPathable(s_gs.map, layer, xz, out);
 }
 
+bool G_MapBenchmarkNavQueues(enum nav_layer layer, int nruns, 
+                             struct nav_queue_bench_result out[NAV_BENCH_NQUEUES])
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_gs.map)
+        return false;
+    if(!M_NavEnsureLayer(s_gs.map, layer))
+        return false;
+
+    M_NavBenchmarkQueues(s_gs.map, layer, nruns, out);
+    return true;
+}
+
+bool G_MapPreloadNavLayers(bool water, bool air)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_gs.map)
+        return false;
+    if(water && !M_NavEnsureLayer(s_gs.map, NAV_LAYER_WATER_1X1))
+        return false;
+    if(air && !M_NavEnsureLayer(s_gs.map, NAV_LAYER_AIR_1X1))
+        return false;
+    return true;
+}
+
 bool G_PointInsideMap(vec2_t xz)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -1758,6 +2933,9 @@ void G_BakeNavDataForScene(void)
     kh_foreach_key(s_gs.active, curr, {
 
         uint32_t flags = G_FlagsGet(curr);
+        /* The entities may have been added before the map was set */
+        g_ensure_nav_layers(flags);
+
         if(!(flags & ENTITY_FLAG_COLLISION))
             continue;
         if(flags & ENTITY_FLAG_MOVABLE)
@@ -1773,10 +2951,7 @@ void G_BakeNavDataForScene(void)
         Sched_TryYield();
     });
 
-    M_NavUpdatePortals(s_gs.map);
-    Sched_TryYield();
-
-    M_NavUpdateIslandsField(s_gs.map);
+    M_NavUpdateBakedData(s_gs.map);
     Sched_TryYield();
 
     PERF_RETURN_VOID();
@@ -1798,15 +2973,20 @@ void G_Shutdown(void)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    E_Global_Unregister(EVENT_UPDATE_UI, on_update_ui);
     G_ClearState();
 
-    R_DestroyWS(&s_gs.ws[0]);
-    R_DestroyWS(&s_gs.ws[1]);
-
+    /* Commands are recorded in the workspaces' arenas, so this must 
+     * precede the workspaces being destroyed. */
     R_PushCmd((struct rcmd){ R_GL_WaterShutdown, 0 });
 
+    for(int i = 0; i < ARR_SIZE(s_gs.ws); i++) {
+        R_DestroyWS(&s_gs.ws[i]);
+    }
+    G_Occl_Shutdown();
+
     G_StorageSite_Shutdown();
+    G_EntIndex_Shutdown();
+    G_ResourceId_Shutdown();
     G_Timer_Shutdown();
     G_Sel_Shutdown();
 
@@ -1819,12 +2999,18 @@ void G_Shutdown(void)
     kh_destroy(id, s_gs.ent_faction_map);
     kh_destroy(id, s_gs.ent_flag_map);
     kh_destroy(range, s_gs.ent_visrange_map);
+
+    const char *key;
+    kh_foreach_key(s_gs.icon_slots, key, {
+        PF_FREE(key);
+    });
+    kh_destroy(icon_slot, s_gs.icon_slots);
     kh_destroy(range, s_gs.selection_radiuses);
     vec_entity_destroy(&s_gs.light_visible);
     vec_entity_destroy(&s_gs.visible);
     vec_obb_destroy(&s_gs.visible_obbs);
     vec_entity_destroy(&s_gs.removed);
-    stalloc_destroy(&s_gs.render_data_stack);
+    vec_entity_destroy(&s_gs.removing);
 }
 
 void G_Update(void)
@@ -1858,33 +3044,27 @@ void G_Update(void)
     }
 
     PERF_PUSH("visibility culling");
-    kh_foreach_key(s_gs.active, curr, {
+    struct cull_batch batch, accepted;
+    g_cull_batch_init(&batch);
+    g_cull_batch_init(&accepted);
 
-        struct obb obb;
-        Entity_CurrentOBB(curr, &obb, false);
-        bool vis_checked = false;
-        bool vis = false;
+    G_Occl_Update();
+    bool occlusion = (s_gs.map != NULL) && G_Occl_Enabled();
 
-        /* Note that there may be some false positives due to using the fast frustum cull. */
-        if(C_FrustumOBBIntersectionFast(&cam_frust, &obb) != VOLUME_INTERSEC_OUTSIDE) {
-            vis = g_ent_visible(pm, curr, &obb);
-            vis_checked = true;
-            if(vis) {
-                vec_entity_push(&s_gs.visible, curr);
-                vec_obb_push(&s_gs.visible_obbs, obb);
-            }
-        }
+    if(s_gs.map) {
+        g_cull_bins(&batch, &accepted, pm, &cam_frust, &light_frust, occlusion);
+    }else{
+        kh_foreach_key(s_gs.active, curr, {
 
-        if(C_FrustumOBBIntersectionFast(&light_frust, &obb) != VOLUME_INTERSEC_OUTSIDE) {
-            if(!vis_checked) {
-                vis = g_ent_visible(pm, curr, &obb);
-            }
-            uint32_t flags = G_FlagsGet(curr);
-            if(vis || !(flags & ENTITY_FLAG_MOVABLE)) {
-                vec_entity_push(&s_gs.light_visible, curr);
+            batch.uids[batch.count++] = curr;
+
+            if(batch.count == CULL_BATCH_SIZE) {
+                g_cull_batch_flush(&batch, pm, &cam_frust, &light_frust, occlusion, true);
             }
-        }
-    });
+        });
+        g_cull_batch_flush(&batch, pm, &cam_frust, &light_frust, occlusion, true);
+    }
+    PERF_COUNTER_ADD("game.entities_culled", kh_size(s_gs.active) - vec_size(&s_gs.visible));
     PERF_POP();
 
     if(s_gs.map) {
@@ -1895,7 +3075,10 @@ void G_Update(void)
     P_Projectile_Update();
     g_set_contextual_cursor();
 
-    E_Global_NotifyImmediate(EVENT_UPDATE_UI, NULL, ES_ENGINE);
+    /* The UI is only updated on frames that get drawn */
+    if(G_Timer_FramePresented()) {
+        E_Global_NotifyImmediate(EVENT_UPDATE_UI, NULL, ES_ENGINE);
+    }
 
     PERF_RETURN_VOID();
 }
@@ -1910,43 +3093,43 @@ void G_Render(void)
     R_PushCmd((struct rcmd){ R_GL_BeginFrame, 0 });
     E_Global_NotifyImmediate(EVENT_RENDER_3D_PRE, NULL, ES_ENGINE);
 
+    if(s_gs.map) {
+        M_UpdateResidency(s_gs.map, s_gs.active_cam);
+    }
+
     struct render_input in;
     g_create_render_input(&in);
 
-    struct render_input *rcopy = g_push_render_input(in);
+    struct render_input *rcopy = g_push_render_input(&in);
     G_RenderMapAndEntities(rcopy);
 
-    struct sval refract_setting;
-    status = Settings_Get("pf.video.water_refraction", &refract_setting);
-    assert(status == SS_OKAY);
-
-    struct sval reflect_setting;
-    status = Settings_Get("pf.video.water_reflection", &reflect_setting);
-    assert(status == SS_OKAY);
-
     if(s_gs.map && M_WaterMaybeVisible(s_gs.map, s_gs.active_cam)) {
 
-        g_prune_water_input(&in);
-        struct render_input *water_rcopy = g_push_render_input(in);
+        struct render_input *water_rcopy = g_copy_render_input(in);
+        g_prune_water_input(water_rcopy);
+
+        bool refract = Settings_ReadBool(s_sett.water_refraction);
+        bool reflect = Settings_ReadBool(s_sett.water_reflection);
+        int quality = Settings_ReadInt(s_sett.water_quality);
 
         R_PushCmd((struct rcmd){
             .func = R_GL_DrawWater,
-            .nargs = 3,
+            .nargs = 4,
             .args = { 
                 water_rcopy,
-                R_PushArg(&refract_setting.as_bool, sizeof(bool)),
-                R_PushArg(&reflect_setting.as_bool, sizeof(bool)),
+                R_PushArg(&refract, sizeof(bool)),
+                R_PushArg(&reflect, sizeof(bool)),
+                R_PushArg(&quality, sizeof(int)),
             },
         });
     }
-    g_destroy_render_input();
 
     enum selection_type sel_type;
     const vec_entity_t *selected = G_Sel_Get(&sel_type);
     for(int i = 0; i < vec_size(selected); i++) {
 
         uint32_t curr = vec_AT(selected, i);
-        vec2_t curr_pos = G_Pos_GetXZ(curr);
+        vec2_t curr_pos = g_render_pos_xz(curr);
         const float width = 0.4f;
         uint32_t flags = G_FlagsGet(curr);
 
@@ -1987,6 +3170,9 @@ void G_Render(void)
     if(!s_gs.hide_healthbars) {
         g_render_healthbars();
     }
+    if(s_gs.show_unit_icons) {
+        g_render_unit_icons();
+    }
 
     E_Global_NotifyImmediate(EVENT_RENDER_UI, NULL, ES_ENGINE);
 
@@ -2014,13 +3200,29 @@ void G_FlagsSet(uint32_t uid, uint32_t flags)
 {
     ASSERT_IN_MAIN_THREAD();
 
+    uint32_t old_flags = 0;
     khiter_t k = kh_get(id, s_gs.ent_flag_map, uid);
     if(k == kh_end(s_gs.ent_flag_map)) {
         int status;
         k = kh_put(id, s_gs.ent_flag_map, uid, &status);
         assert(status != -1);
+    }else{
+        old_flags = kh_value(s_gs.ent_flag_map, k);
     }
     kh_value(s_gs.ent_flag_map, k) = flags;
+    G_Pos_UpdateFlags(uid, old_flags, flags);
+    g_ensure_nav_layers(flags);
+
+    /* The animation component follows the flag, which changes with the model */
+    if((old_flags ^ flags) & ENTITY_FLAG_ANIMATED) {
+        if(flags & ENTITY_FLAG_ANIMATED)
+            G_EntIndex_AddComponent(uid, ENT_COMP_ANIM);
+        else
+            G_EntIndex_RemoveComponent(uid, ENT_COMP_ANIM);
+        if(s_gs.map) {
+            G_Pos_InvalidateBin(uid);
+        }
+    }
 }
 
 uint32_t G_FlagsGet(uint32_t uid)
@@ -2042,6 +3244,41 @@ khash_t(id) *G_FlagsCopyTable(void)
     return kh_copy_id(s_gs.ent_flag_map);
 }
 
+bool G_ReserveEntities(size_t count)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    /* Size the tables for the final entity count up-front, so that a large 
+     * batch of G_AddEntity calls doesn't rehash every table several times. 
+     * The khash load factor is 0.77, hence the extra headroom. */
+    size_t nents = kh_size(s_gs.active) + count;
+    khint_t nbuckets = nents + nents / 3 + 1;
+
+    if(kh_resize(entity, s_gs.active, nbuckets) < 0)
+        return false;
+    if(kh_resize(id, s_gs.ent_faction_map, nbuckets) < 0)
+        return false;
+    if(kh_resize(range, s_gs.ent_visrange_map, nbuckets) < 0)
+        return false;
+    if(kh_resize(range, s_gs.selection_radiuses, nbuckets) < 0)
+        return false;
+    if(kh_resize(id, s_gs.ent_flag_map, nbuckets) < 0)
+        return false;
+    if(!G_EntIndex_Reserve(count))
+        return false;
+
+    nents = kh_size(s_gs.dynamic) + count;
+    nbuckets = nents + nents / 3 + 1;
+
+    if(kh_resize(entity, s_gs.dynamic, nbuckets) < 0)
+        return false;
+    if(kh_resize(id, s_gs.ent_gpu_id_map, nbuckets) < 0)
+        return false;
+    if(kh_resize(id, s_gs.gpu_id_ent_map, nbuckets) < 0)
+        return false;
+    return true;
+}
+
 bool G_AddEntity(uint32_t uid, uint32_t flags, vec3_t pos)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -2054,6 +3291,9 @@ bool G_AddEntity(uint32_t uid, uint32_t flags, vec3_t pos)
     if(ret == -1 || ret == 0)
         return false;
 
+    if(G_EntIndex_Add(uid) == ENT_SLOT_NONE)
+        return false;
+
     k = kh_put(id, s_gs.ent_faction_map, uid, &ret);
     if(ret == -1 || ret == 0)
         return false;
@@ -2072,8 +3312,12 @@ bool G_AddEntity(uint32_t uid, uint32_t flags, vec3_t pos)
     G_FlagsSet(uid, flags);
     G_Pos_Set(uid, pos);
 
-    if(flags & ENTITY_FLAG_ANIMATED)
+    /* The flags may be left over from an earlier entity with the same 
+     * uid, in which case G_FlagsSet sees no change of the animated flag */
+    if(flags & ENTITY_FLAG_ANIMATED) {
         A_AddEntity(uid);
+        G_EntIndex_AddComponent(uid, ENT_COMP_ANIM);
+    }
 
     if(flags & ENTITY_FLAG_STORAGE_SITE)
         G_StorageSite_AddEntity(uid);
@@ -2155,35 +3399,7 @@ bool G_RemoveEntity(uint32_t uid)
         vec_entity_del(&s_gs.light_visible, idx);
     }
 
-    A_RemoveEntity(uid);
-    G_Sel_Remove(uid);
-    G_Move_RemoveEntity(uid);
-    G_Formation_RemoveEntity(uid);
-    G_Combat_RemoveEntity(uid);
-    G_Building_RemoveEntity(uid);
-    G_Builder_RemoveEntity(uid);
-    G_Harvester_RemoveEntity(uid);
-    G_Resource_RemoveEntity(uid);
-    G_StorageSite_RemoveEntity(uid);
-    G_Garrison_RemoveGarrison(uid);
-    G_Garrison_RemoveGarrisonable(uid);
-    G_Automation_RemoveEntity(uid);
-    G_Region_RemoveEnt(uid);
-    G_Pos_Delete(uid);
-    Entity_Remove(uid);
-
-    k = kh_get(id, s_gs.ent_faction_map, uid);
-    assert(k != kh_end(s_gs.ent_faction_map));
-    kh_del(id, s_gs.ent_faction_map, k);
-
-    k = kh_get(range, s_gs.ent_visrange_map, uid);
-    assert(k != kh_end(s_gs.ent_visrange_map));
-    kh_del(range, s_gs.ent_visrange_map, k);
-
-    k = kh_get(range, s_gs.selection_radiuses, uid);
-    assert(k != kh_end(s_gs.selection_radiuses));
-    kh_del(range, s_gs.selection_radiuses, k);
-
+    g_remove_from_subsystems(uid);
     G_Sel_MarkHoveredDirty();
     return true;
 }
@@ -2385,6 +3601,7 @@ void G_SetFactionID(uint32_t uid, int faction_id)
     G_StorageSite_UpdateFaction(uid, old, faction_id);
     G_Resource_UpdateFactionID(uid, old, faction_id);
     G_Building_UpdateFactionID(uid, old, faction_id);
+    G_Automation_UpdateFactionID(uid, old, faction_id);
 }
 
 int G_GetFactionID(uint32_t uid)
@@ -2580,9 +3797,28 @@ bool G_UpdateTile(const struct tile_desc *desc, const struct tile *tile)
 
     if(!s_gs.map)
         return false;
+    G_Fog_InvalidateLOSCache();
     return M_AL_UpdateTile(s_gs.map, desc, tile);
 }
 
+void G_BeginTileEdits(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_gs.map)
+        return;
+    M_AL_BeginTileEdits(s_gs.map);
+}
+
+void G_EndTileEdits(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_gs.map)
+        return;
+    M_AL_EndTileEdits(s_gs.map);
+}
+
 bool G_GetTile(const struct tile_desc *desc, struct tile *out)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -2606,6 +3842,11 @@ const khash_t(entity) *G_GetAllEntsSet(void)
     return s_gs.active;
 }
 
+const vec_entity_t *G_GetVisibleEnts(void)
+{
+    return &s_gs.visible;
+}
+
 void G_SetSimState(enum simstate ss)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -2728,28 +3969,74 @@ struct render_workspace *G_GetSimWS(void)
 
 struct render_workspace *G_GetRenderWS(void)
 {
-    return &s_gs.ws[(s_gs.curr_ws_idx + 1) % 2];
+    ASSERT_IN_MAIN_THREAD();
+
+    return &s_gs.ws[s_gs.render_ws_idx];
 }
 
 void G_SwapBuffers(void)
 {
     ASSERT_IN_MAIN_THREAD();
 
+    /* The next workspace in the ring is the oldest one that has been 
+     * handed over to the render thread - the caller must have waited 
+     * for it to be done with it. */
     int sim_idx = s_gs.curr_ws_idx;
-    int render_idx = (sim_idx + 1) % 2;
+    int next_idx = (sim_idx + 1) % s_gs.nws;
 
     if(s_gs.map) {
-        M_AL_ShallowCopy((struct map*)s_gs.prev_tick_map, s_gs.map);
+        M_AL_ShallowCopy((struct map*)s_gs.prev_tick_maps[sim_idx], s_gs.map);
+        M_AL_ShallowCopy((struct map*)s_gs.prev_tick_maps[next_idx], s_gs.map);
     }
 
     g_remove_queued();
-    assert(queue_size(s_gs.ws[render_idx].commands) == 0);
-    R_ClearWS(&s_gs.ws[render_idx]);
-    s_gs.curr_ws_idx = render_idx;
+    R_TextureLoadFlush();
+    assert(s_gs.ws[next_idx].head == NULL);
+    R_ClearWS(&s_gs.ws[next_idx]);
+    s_gs.render_ws_idx = sim_idx;
+    s_gs.curr_ws_idx = next_idx;
+    s_gs.prev_tick_map = s_gs.prev_tick_maps[next_idx];
 
     g_change_simstate();
 }
 
+static void g_swap_ws(int a, int b)
+{
+    struct render_workspace tmp_ws = s_gs.ws[a];
+    s_gs.ws[a] = s_gs.ws[b];
+    s_gs.ws[b] = tmp_ws;
+
+    const struct map *tmp_map = s_gs.prev_tick_maps[a];
+    s_gs.prev_tick_maps[a] = s_gs.prev_tick_maps[b];
+    s_gs.prev_tick_maps[b] = tmp_map;
+}
+
+void G_SetFrameLatency(int nframes)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    int nws = nframes + 1;
+    assert(nws >= 2 && nws <= ARR_SIZE(s_gs.ws));
+    if(nws == s_gs.nws)
+        return;
+
+    /* Once the render thread is idle, only the simulation workspace and the 
+     * one to be handed over next hold commands. Move them to the start and 
+     * the end of the new ring, where the following swaps expect them. */
+    Engine_WaitRenderWorkDone();
+
+    g_swap_ws(s_gs.curr_ws_idx, 0);
+    if(s_gs.render_ws_idx == 0) {
+        s_gs.render_ws_idx = s_gs.curr_ws_idx;
+    }
+    g_swap_ws(s_gs.render_ws_idx, nws - 1);
+
+    s_gs.nws = nws;
+    s_gs.curr_ws_idx = 0;
+    s_gs.render_ws_idx = nws - 1;
+    s_gs.prev_tick_map = s_gs.prev_tick_maps[0];
+}
+
 bool G_MapLoaded(void)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -2806,6 +4093,7 @@ void G_NotifyOrderIssued(uint32_t uid, bool clear_harvester)
     if(flags & ENTITY_FLAG_COMBATABLE) {
         G_Combat_ClearSavedMoveCmd(uid);
     }
+    Replay_RecordOrder(uid);
     E_Global_Notify(EVENT_ORDER_ISSUED, (void*)(uintptr_t)uid, ES_ENGINE);
 }
 
@@ -2824,6 +4112,9 @@ void G_UpdateBounds(uint32_t uid)
 
     G_Building_UpdateBounds(uid);
     G_Resource_UpdateBounds(uid);
+    if(s_gs.map) {
+        G_Pos_InvalidateBin(uid);
+    }
 }
 
 void G_SetShowUnitIcons(bool show)
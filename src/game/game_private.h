@@ -53,6 +53,8 @@ enum ctx_action{
 
 const khash_t(entity) *G_GetDynamicEntsSet(void);
 const khash_t(entity) *G_GetAllEntsSet(void);
+/* The entities which passed the visibility culling on the current frame */
+const vec_entity_t    *G_GetVisibleEnts(void);
 
 enum ctx_action        G_CurrContextualAction(void);
 void                   G_NotifyOrderIssued(uint32_t uid, bool clear_harvester);
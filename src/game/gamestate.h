@@ -39,14 +39,15 @@
 #include "public/game.h"
 #include "faction.h"
 #include "selection.h"
+#include "../config.h"
 #include "../lib/public/vec.h"
-#include "../lib/public/stalloc.h"
 #include "../render/public/render_ctrl.h"
 
 #include <stdint.h>
 
 KHASH_DECLARE(id, khint32_t, int)
 KHASH_DECLARE(range, khint32_t, float)
+KHASH_DECLARE(icon_slot, kh_cstr_t, int)
 
 
 struct gamestate{
@@ -87,6 +88,12 @@ struct gamestate{
      *-------------------------------------------------------------------------
      */
     bool                    show_unit_icons;
+    /*-------------------------------------------------------------------------
+     * Table mapping an icon path to its' slot in the renderer's icon atlas.
+     * Each icon is only copied into the atlas the first time it is seen.
+     *-------------------------------------------------------------------------
+     */
+    khash_t(icon_slot)     *icon_slots;
     /*-------------------------------------------------------------------------
      * The camera from which the scene is currently being rendered.
      *-------------------------------------------------------------------------
@@ -170,20 +177,28 @@ struct gamestate{
      */
     enum diplomacy_state    diplomacy_table[MAX_FACTIONS][MAX_FACTIONS];
     /*-------------------------------------------------------------------------
-     * The index indo the 'ws' field, where the rendering commands are stored.
-     * The previous frame workspace is owned by the render thread. The render
-     * and simulatino workspaces are swapped at the end of every frame.
+     * The first 'nws' entries of 'ws' form a ring of workspaces where the 
+     * rendering commands are stored. 'curr_ws_idx' is the workspace of the 
+     * frame being simulated and 'render_ws_idx' is the last finished frame,
+     * which is handed over to the render thread next. The remaining ones may
+     * still be owned by the render thread. At the end of every frame, the 
+     * simulation moves on to the next workspace in the ring.
      *-------------------------------------------------------------------------
      */
     int                     curr_ws_idx;
-    struct render_workspace ws[2];
+    int                     render_ws_idx;
+    int                     nws;
+    struct render_workspace ws[CONFIG_MAX_FRAME_LATENCY + 1];
     /*-------------------------------------------------------------------------
      * A readonly snapshot (copy) of the map from the previous simulation tick. 
      * This is used by the render thread for making certain queries like size,
-     * height at a point, etc.
+     * height at a point, etc. There is one snapshot per workspace, such that 
+     * the ones referenced by frames that are still being rendered are never
+     * overwritten. 'prev_tick_map' is the one of the current workspace.
      *-------------------------------------------------------------------------
      */
     const struct map       *prev_tick_map;
+    const struct map       *prev_tick_maps[CONFIG_MAX_FRAME_LATENCY + 1];
     /*-------------------------------------------------------------------------
      * Entities currently scheduled for removal. They will be removed from the
      * game simulation at the end of the tick.
@@ -191,10 +206,11 @@ struct gamestate{
      */
     vec_entity_t            removed;
     /*-------------------------------------------------------------------------
-     * Stack allocator used for per-frame render descriptors.
+     * The batch of removals currently being processed. Tearing down an entity
+     * may schedule further removals, which then go into the next batch.
      *-------------------------------------------------------------------------
      */
-    struct memstack         render_data_stack;
+    vec_entity_t            removing;
 };
 
 #endif
@@ -35,6 +35,7 @@
 
 #include "garrison.h"
 #include "game_private.h"
+#include "entity_index.h"
 #include "fog_of_war.h"
 #include "selection.h"
 #include "movement.h"
@@ -98,6 +99,10 @@ struct garrisonable_state{
     int               capacity;
     int               current;
     vec_entity_t      garrisoned;
+    /* The text of the overlay, formatted for 'ui_current'/'ui_capacity' */
+    int               ui_current;
+    int               ui_capacity;
+    char              ui_text[32];
 };
 
 struct evict_work{
@@ -195,25 +200,30 @@ static void on_update_ui(void *user, void *event)
     if(!s_show_ui)
         return;
 
-    uint32_t uid;
-    struct garrisonable_state gbs;
     struct nk_context *ctx = UI_GetContext();
+    const vec_entity_t *visible = G_GetVisibleEnts();
 
     nk_style_push_style_item(ctx, &ctx->style.window.fixed_background, s_bg_style);
 
-    kh_foreach(s_garrisonable_state_table, uid, gbs, {
+    const vec2_t vres = (vec2_t){1920, 1080};
+    const vec2_t adj_vres = UI_ArAdjustedVRes(vres);
 
-        struct obb obb;
-        Entity_CurrentOBB(uid, &obb, true);
-        if(!G_Fog_ObjExplored(G_GetPlayerControlledFactions(), uid, &obb))
+    for(int i = 0; i < vec_size(visible); i++) {
+
+        uint32_t uid = vec_AT(visible, i);
+        struct garrisonable_state *gbs = gb_state_get(uid);
+        if(!gbs)
             continue;
 
+        if(gbs->ui_current != gbs->current || gbs->ui_capacity != gbs->capacity) {
+            pf_snprintf(gbs->ui_text, sizeof(gbs->ui_text), "%d / %d", gbs->current, gbs->capacity);
+            gbs->ui_current = gbs->current;
+            gbs->ui_capacity = gbs->capacity;
+        }
+
         char name[256];
         pf_snprintf(name, sizeof(name), "__garrisonable__.%x", uid);
 
-        const vec2_t vres = (vec2_t){1920, 1080};
-        const vec2_t adj_vres = UI_ArAdjustedVRes(vres);
-
         vec2_t ss_pos = Entity_TopScreenPos(uid, adj_vres.x, adj_vres.y);
         const int width = 100;
         const int height = 32;
@@ -229,9 +239,6 @@ static void on_update_ui(void *user, void *event)
             (struct nk_rect){adj_bounds.x, adj_bounds.y, adj_bounds.w, adj_bounds.h}, 
             flags, (struct nk_vec2i){adj_vres.x, adj_vres.y})) {
 
-            char text[32];
-            pf_snprintf(text, sizeof(text), "%d / %d", gbs.current, gbs.capacity);
-
             nk_layout_row_begin(ctx, NK_STATIC, 24, 3);
             nk_layout_row_push(ctx, 24);
             nk_image_texpath(ctx, s_garrison_icon_path);
@@ -240,10 +247,10 @@ static void on_update_ui(void *user, void *event)
             nk_spacing(ctx, 1);
 
             nk_layout_row_push(ctx, 72);
-            nk_label_colored(ctx, text, NK_TEXT_ALIGN_LEFT | NK_TEXT_ALIGN_MIDDLE, s_font_clr);
+            nk_label_colored(ctx, gbs->ui_text, NK_TEXT_ALIGN_LEFT | NK_TEXT_ALIGN_MIDDLE, s_font_clr);
         }
         nk_end(ctx);
-    });
+    }
     nk_style_pop_style_item(ctx);
 }
 
@@ -771,12 +778,15 @@ bool G_Garrison_AddGarrison(uint32_t uid)
     gus.target_rendevouz_issued = false;
     gus.state = STATE_NOT_GARRISONED;
     gus.wait_ticks = 0;
-    return gu_state_set(uid, gus);
+    if(!gu_state_set(uid, gus))
+        return false;
+    return G_EntIndex_AddComponent(uid, ENT_COMP_GARRISON);
 }
 
 void G_Garrison_RemoveGarrison(uint32_t uid)
 {
     gu_state_remove(uid);
+    G_EntIndex_RemoveComponent(uid, ENT_COMP_GARRISON);
 }
 
 bool G_Garrison_AddGarrisonable(uint32_t uid)
@@ -786,13 +796,18 @@ bool G_Garrison_AddGarrisonable(uint32_t uid)
     gbs.wait_ticks = 0;
     gbs.capacity = 0;
     gbs.current = 0;
+    gbs.ui_current = -1;
+    gbs.ui_capacity = -1;
     vec_entity_init(&gbs.garrisoned);
-    return gb_state_set(uid, gbs);
+    if(!gb_state_set(uid, gbs))
+        return false;
+    return G_EntIndex_AddComponent(uid, ENT_COMP_GARRISONABLE);
 }
 
 void G_Garrison_RemoveGarrisonable(uint32_t uid)
 {
     gb_state_remove(uid);
+    G_EntIndex_RemoveComponent(uid, ENT_COMP_GARRISONABLE);
 }
 
 void G_Garrison_SetCapacityConsumed(uint32_t uid, int capacity)
@@ -37,6 +37,9 @@
 #include "movement.h"
 #include "resource.h"
 #include "storage_site.h"
+#include "entity_index.h"
+#include "resource_id.h"
+#include "resource_index.h"
 #include "game_private.h"
 #include "public/game.h"
 #include "../sched.h"
@@ -48,9 +51,9 @@
 #include "../lib/public/vec.h"
 #include "../lib/public/khash.h"
 #include "../lib/public/pf_string.h"
-#include "../lib/public/string_intern.h"
-#include "../lib/public/mpool_allocator.h"
 #include "../lib/public/attr.h"
+#include "../lib/public/slab.h"
+#include "../lib/public/slab_khash.h"
 
 #include <stddef.h>
 #include <assert.h>
@@ -68,24 +71,6 @@
             return false;               \
     }while(0)
 
-static void *pmalloc(size_t size);
-static void *pcalloc(size_t n, size_t size);
-static void *prealloc(void *ptr, size_t size);
-static void  pfree(void *ptr);
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  pmalloc
-#define kcalloc  pcalloc
-#define krealloc prealloc
-#define kfree    pfree
-
-KHASH_MAP_INIT_STR(int, int)
-KHASH_MAP_INIT_STR(float, float)
-
 VEC_TYPE(name, const char*)
 VEC_IMPL(static, name, const char*)
 
@@ -107,10 +92,14 @@ struct hstate{
     uint32_t    res_uid;
     vec2_t      res_last_pos;
     const char *res_name;         /* borrowed */
-    kh_float_t *gather_speeds;    /* How much of each resource the entity gets each cycle */
-    kh_int_t   *max_carry;        /* The maximum amount of each resource the entity can carry */
-    kh_int_t   *curr_carry;       /* The amount of each resource the entity currently holds */
-    kh_int_t   *do_not_transport; /* Per-resource flag to disable transporting */
+    /* How much of each resource the entity gets each cycle */
+    struct rtable_float gather_speeds;
+    /* The maximum amount of each resource the entity can carry */
+    struct rtable_int   max_carry;
+    /* The amount of each resource the entity currently holds */
+    struct rtable_int   curr_carry;
+    /* Per-resource flag to disable transporting */
+    struct rtable_int   do_not_transport;
     vec_name_t  priority;         /* The order in which the harvester will transport resources */
     bool        drop_off_only;
     float       accum;            /* How much we gathered - only integer amounts are taken */ 
@@ -143,22 +132,6 @@ struct valid_resource_arg{
     uint32_t       exclude;
 };
 
-typedef char buff_t[512];
-
-MPOOL_ALLOCATOR_TYPE(buff, buff_t)
-MPOOL_ALLOCATOR_PROTOTYPES(static, buff, buff_t)
-MPOOL_ALLOCATOR_IMPL(static, buff, buff_t)
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  malloc
-#define kcalloc  calloc
-#define krealloc realloc
-#define kfree    free
-
 KHASH_MAP_INIT_INT(state, struct hstate)
 
 static void on_motion_begin_harvest(void *user, void *event);
@@ -175,9 +148,6 @@ static void on_harvest_anim_finished_source(void *user, void *event);
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static mpa_buff_t        s_mpool;
-static khash_t(stridx)  *s_stridx;
-static mp_strbuff_t      s_stringpool;
 static khash_t(state)   *s_entity_state_table;
 static const struct map *s_map;
 
@@ -190,36 +160,6 @@ static bool              s_transport_on_lclick = false;
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static void *pmalloc(size_t size)
-{
-    if(size > sizeof(buff_t))
-        return NULL;
-    return mpa_buff_alloc(&s_mpool);
-}
-
-static void *pcalloc(size_t n, size_t size)
-{
-    void *ret = pmalloc(n * size);
-    if(!ret)
-        return NULL;
-    memset(ret, 0, n * size);
-    return ret;
-}
-
-static void *prealloc(void *ptr, size_t size)
-{
-    if(!ptr)
-        return pmalloc(size);
-    if(size <= sizeof(buff_t))
-        return ptr;
-    return NULL;
-}
-
-static void pfree(void *ptr)
-{
-    mpa_buff_free(&s_mpool, ptr);
-}
-
 static int ss_desired(uint32_t uid, const char *rname)
 {
     if(G_StorageSite_GetUseAlt(uid)) {
@@ -267,29 +207,18 @@ static void hstate_remove(uint32_t uid)
 static void hstate_destroy(struct hstate *hs)
 {
     vec_name_destroy(&hs->priority);
-    kh_destroy(float, hs->gather_speeds);
-    kh_destroy(int, hs->max_carry);
-    kh_destroy(int, hs->curr_carry);
-    kh_destroy(int, hs->do_not_transport);
 }
 
 static bool hstate_init(struct hstate *hs)
 {
-    vec_name_init_alloc(&hs->priority, prealloc, pfree);
-    if(!vec_name_resize(&hs->priority, sizeof(buff_t) / sizeof(char*)))
+    vec_name_init_alloc(&hs->priority, slab_realloc, slab_free);
+    if(!vec_name_resize(&hs->priority, 8))
         return false;
 
-    hs->gather_speeds = kh_init(float);
-    hs->max_carry = kh_init(int);
-    hs->curr_carry = kh_init(int);
-    hs->do_not_transport = kh_init(int);
-
-    if(!hs->gather_speeds || !hs->max_carry 
-    || !hs->curr_carry || !hs->do_not_transport) {
-
-        hstate_destroy(hs);
-        return false;
-    }
+    rtable_clear(&hs->gather_speeds);
+    rtable_clear(&hs->max_carry);
+    rtable_clear(&hs->curr_carry);
+    rtable_clear(&hs->do_not_transport);
 
     hs->ss_uid = NULL_UID;
     hs->res_uid = NULL_UID;
@@ -305,75 +234,41 @@ static bool hstate_init(struct hstate *hs)
     return true;
 }
 
-static bool hstate_set_key_int(khash_t(int) *table, const char *name, int val)
+static bool hstate_set_key_int(struct rtable_int *table, const char *name, int val)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_ResourceId_Get(name);
+    if(id < 0)
         return false;
 
-    khiter_t k = kh_get(int, table, key);
-    if(k != kh_end(table)) {
-        kh_value(table, k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(int, table, key, &status);
-    if(status == -1) {
-        return false;
-    }
-
-    assert(status == 1);
-    kh_value(table, k) = val;
+    rtable_put(table, id, val);
     return true;
 }
 
-static bool hstate_get_key_int(khash_t(int) *table, const char *name, int *out)
+static bool hstate_get_key_int(const struct rtable_int *table, const char *name, int *out)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(int, table, key);
-    if(k == kh_end(table))
+    int id = G_ResourceId_Find(name);
+    if(!rtable_has(table, id))
         return false;
-    *out = kh_value(table, k);
+    *out = table->vals[id];
     return true;
 }
 
-static bool hstate_set_key_float(khash_t(float) *table, const char *name, float val)
+static bool hstate_set_key_float(struct rtable_float *table, const char *name, float val)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_ResourceId_Get(name);
+    if(id < 0)
         return false;
 
-    khiter_t k = kh_get(float, table, key);
-    if(k != kh_end(table)) {
-        kh_value(table, k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(float, table, key, &status);
-    if(status == -1) {
-        return false;
-    }
-
-    assert(status == 1);
-    kh_value(table, k) = val;
+    rtable_put(table, id, val);
     return true;
 }
 
-static bool hstate_get_key_float(khash_t(float) *table, const char *name, float *out)
+static bool hstate_get_key_float(const struct rtable_float *table, const char *name, float *out)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_ResourceId_Find(name);
+    if(!rtable_has(table, id))
         return false;
-
-    khiter_t k = kh_get(float, table, key);
-    if(k == kh_end(table))
-        return false;
-    *out = kh_value(table, k);
+    *out = table->vals[id];
     return true;
 }
 
@@ -532,22 +427,41 @@ static bool valid_resource(uint32_t uid, void *arg)
     return true;
 }
 
+static uint32_t nearest_storage_site_with_pred(uint32_t uid, vec2_t pos, 
+                                               bool (*pred)(uint32_t, void*), 
+                                               struct searcharg *arg)
+{
+    uint32_t ret = NULL_UID;
+    G_ResourceIndex_NearestStorageSites(G_GetFactionID(uid), pos, 0.0f, 
+        pred, (void*)arg, &ret, 1);
+    return ret;
+}
+
+static uint32_t nearest_resource_with_pred(vec2_t pos, struct valid_resource_arg *arg, 
+                                           float max_range)
+{
+    uint32_t ret = NULL_UID;
+    G_ResourceIndex_NearestResources(G_ResourceId_Find(arg->rname), pos, max_range, 
+        valid_resource, (void*)arg, &ret, 1);
+    return ret;
+}
+
 uint32_t nearest_storage_site_dropoff(uint32_t uid, const char *rname)
 {
     vec2_t pos = G_Pos_GetXZ(uid);
     struct searcharg arg = (struct searcharg){uid, NULL_UID, rname};
-    return G_Pos_NearestWithPred(pos, valid_storage_site_dropoff, (void*)&arg, 0.0f);
+    return nearest_storage_site_with_pred(uid, pos, valid_storage_site_dropoff, &arg);
 }
 
 uint32_t nearest_storage_site_source(uint32_t uid, uint32_t storage, const char *rname, enum tstrategy strat)
 {
     vec2_t pos = G_Pos_GetXZ(storage);
     struct searcharg arg = (struct searcharg){uid, storage, rname, strat};
-    uint32_t ret = G_Pos_NearestWithPred(pos, valid_storage_site_source, (void*)&arg, 0.0f);
+    uint32_t ret = nearest_storage_site_with_pred(uid, pos, valid_storage_site_source, &arg);
 
     if((ret == NULL_UID) && (strat == TRANSPORT_STRATEGY_EXCESS)) {
         arg = (struct searcharg){uid, storage, rname, TRANSPORT_STRATEGY_NEAREST};
-        ret = G_Pos_NearestWithPred(pos, valid_storage_site_source, (void*)&arg, 0.0f);
+        ret = nearest_storage_site_with_pred(uid, pos, valid_storage_site_source, &arg);
     }
     return ret;
 }
@@ -562,7 +476,7 @@ uint32_t nearest_resource(uint32_t uid, const char *name)
         .rname = name,
         .exclude = UID_NONE
     };
-    return G_Pos_NearestWithPred(pos, valid_resource, (void*)&arg, REACQUIRE_RADIUS);
+    return nearest_resource_with_pred(pos, &arg, REACQUIRE_RADIUS);
 }
 
 uint32_t nearest_resource_with_exclusion(uint32_t uid, const char *name, uint32_t exclude)
@@ -575,7 +489,7 @@ uint32_t nearest_resource_with_exclusion(uint32_t uid, const char *name, uint32_
         .rname = name,
         .exclude = exclude
     };
-    return G_Pos_NearestWithPred(pos, valid_resource, (void*)&arg, REACQUIRE_RADIUS);
+    return nearest_resource_with_pred(pos, &arg, REACQUIRE_RADIUS);
 }
 
 static void finish_harvesting(struct hstate *hs, uint32_t uid)
@@ -597,12 +511,11 @@ static void finish_harvesting(struct hstate *hs, uint32_t uid)
 
 static const char *carried_resource_name(struct hstate *hs)
 {
-    const char *key;
-    int curr;
+    int id, curr;
 
-    kh_foreach(hs->curr_carry, key, curr, {
+    rtable_foreach(&hs->curr_carry, id, curr, {
         if(curr > 0)
-            return key;
+            return G_ResourceId_Name(id);
     });
     return NULL;
 }
@@ -684,8 +597,7 @@ uint32_t target_resource(uint32_t uid, struct hstate *hs, const char *rname)
             .rname = rname,
             .exclude = UID_NONE,
         };
-        return G_Pos_NearestWithPred(hs->res_last_pos, valid_resource, 
-            (void*)&arg, REACQUIRE_RADIUS);
+        return nearest_resource_with_pred(hs->res_last_pos, &arg, REACQUIRE_RADIUS);
     }
     return hs->res_uid;
 }
@@ -1376,7 +1288,7 @@ static const char *transport_resource(struct hstate *hs, uint32_t target)
 
         const char *rname = vec_AT(&hs->priority, i);
         int do_not_transport = 0;
-        hstate_get_key_int(hs->do_not_transport, rname, &do_not_transport);
+        hstate_get_key_int(&hs->do_not_transport, rname, &do_not_transport);
         if(do_not_transport)
             continue;
 
@@ -1410,7 +1322,7 @@ static const char *pick_up_resource(struct hstate *hs, uint32_t target)
 static bool harvester_can_gather(struct hstate *hs, const char *rname)
 {
     float speed = 0.0f;
-    hstate_get_key_float(hs->gather_speeds, rname, &speed);
+    hstate_get_key_float(&hs->gather_speeds, rname, &speed);
     return (speed > 0.0f);
 }
 
@@ -1597,7 +1509,7 @@ static bool harvester_transport_from_resources(uint32_t harvester, uint32_t stor
         .rname = rname,
         .exclude = UID_NONE,
     };
-    uint32_t resource = G_Pos_NearestWithPred(pos, valid_resource, (void*)&arg, 0);
+    uint32_t resource = nearest_resource_with_pred(pos, &arg, 0.0f);
     if(resource == NULL_UID)
         return false;
 
@@ -1661,26 +1573,13 @@ static void on_render_ui(void *user, void *event)
 
 bool G_Harvester_Init(const struct map *map)
 {
-    mpa_buff_init(&s_mpool, 1024, 0);
-
-    if(!mpa_buff_reserve(&s_mpool, 1024))
-        goto fail_mpool; 
     if(!(s_entity_state_table = kh_init(state)))
-        goto fail_table;
-    if(!si_init(&s_stringpool, &s_stridx, 512))
-        goto fail_strintern;
+        return false;
 
     s_map = map;
     E_Global_Register(SDL_MOUSEBUTTONDOWN, on_mousedown, NULL, G_RUNNING);
     E_Global_Register(EVENT_RENDER_UI, on_render_ui, NULL, G_RUNNING);
     return true;
-
-fail_strintern:
-    kh_destroy(state, s_entity_state_table);
-fail_table:
-    mpa_buff_destroy(&s_mpool);
-fail_mpool:
-    return false;
 }
 
 void G_Harvester_Shutdown(void)
@@ -1689,9 +1588,7 @@ void G_Harvester_Shutdown(void)
     E_Global_Unregister(EVENT_RENDER_UI, on_render_ui);
     E_Global_Unregister(SDL_MOUSEBUTTONDOWN, on_mousedown);
 
-    si_shutdown(&s_stringpool, s_stridx);
     kh_destroy(state, s_entity_state_table);
-    mpa_buff_destroy(&s_mpool);
 }
 
 bool G_Harvester_AddEntity(uint32_t uid)
@@ -1701,7 +1598,7 @@ bool G_Harvester_AddEntity(uint32_t uid)
         return false;
     if(!hstate_set(uid, hs))
         return false;
-    return true;
+    return G_EntIndex_AddComponent(uid, ENT_COMP_HARVESTER);
 }
 
 void G_Harvester_RemoveEntity(uint32_t uid)
@@ -1713,13 +1610,14 @@ void G_Harvester_RemoveEntity(uint32_t uid)
     G_Harvester_Stop(uid);
     hstate_destroy(hs);
     hstate_remove(uid);
+    G_EntIndex_RemoveComponent(uid, ENT_COMP_HARVESTER);
 }
 
 bool G_Harvester_SetGatherSpeed(uint32_t uid, const char *rname, float speed)
 {
     struct hstate *hs = hstate_get(uid);
     assert(hs);
-    return hstate_set_key_float(hs->gather_speeds, rname, speed);
+    return hstate_set_key_float(&hs->gather_speeds, rname, speed);
 }
 
 float G_Harvester_GetGatherSpeed(uint32_t uid, const char *rname)
@@ -1728,7 +1626,7 @@ float G_Harvester_GetGatherSpeed(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    hstate_get_key_float(hs->gather_speeds, rname, &ret);
+    hstate_get_key_float(&hs->gather_speeds, rname, &ret);
     return ret;
 }
 
@@ -1737,7 +1635,7 @@ bool G_Harvester_SetMaxCarry(uint32_t uid, const char *rname, int max)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
+    const char *key = G_ResourceId_Intern(rname);
     if(!key)
         return false;
 
@@ -1746,7 +1644,7 @@ bool G_Harvester_SetMaxCarry(uint32_t uid, const char *rname, int max)
     }else{
         hstate_insert_prio(hs, key);
     }
-    return hstate_set_key_int(hs->max_carry, rname, max);
+    return hstate_set_key_int(&hs->max_carry, rname, max);
 }
 
 int G_Harvester_GetMaxCarry(uint32_t uid, const char *rname)
@@ -1755,7 +1653,7 @@ int G_Harvester_GetMaxCarry(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    hstate_get_key_int(hs->max_carry, rname, &ret);
+    hstate_get_key_int(&hs->max_carry, rname, &ret);
     return ret;
 }
 
@@ -1763,7 +1661,7 @@ bool G_Harvester_SetCurrCarry(uint32_t uid, const char *rname, int curr)
 {
     struct hstate *hs = hstate_get(uid);
     assert(hs);
-    return hstate_set_key_int(hs->curr_carry, rname, curr);
+    return hstate_set_key_int(&hs->curr_carry, rname, curr);
 }
 
 int G_Harvester_GetCurrCarry(uint32_t uid, const char *rname)
@@ -1772,7 +1670,7 @@ int G_Harvester_GetCurrCarry(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    hstate_get_key_int(hs->curr_carry, rname, &ret);
+    hstate_get_key_int(&hs->curr_carry, rname, &ret);
     return ret;
 }
 
@@ -1780,7 +1678,7 @@ void G_Harvester_ClearCurrCarry(uint32_t uid)
 {
     struct hstate *hs = hstate_get(uid);
     assert(hs);
-    kh_clear(int, hs->curr_carry);
+    rtable_clear(&hs->curr_carry);
 
     if(hs->state == STATE_HARVESTING_SEEK_STORAGE 
     || hs->state == STATE_TRANSPORT_PUTTING) {
@@ -1810,7 +1708,7 @@ bool G_Harvester_IncreaseTransportPrio(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
+    const char *key = G_ResourceId_Intern(rname);
     if(!key)
         return false;
 
@@ -1832,7 +1730,7 @@ bool G_Harvester_DecreaseTransportPrio(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
+    const char *key = G_ResourceId_Intern(rname);
     if(!key)
         return false;
 
@@ -1865,11 +1763,10 @@ int G_Harvester_GetCurrTotalCarry(uint32_t uid)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    const char *key;
-    (void)key;
-    int curr;
+    int id, curr;
+    (void)id;
 
-    kh_foreach(hs->curr_carry, key, curr, {
+    rtable_foreach(&hs->curr_carry, id, curr, {
         ret += curr;
     });
 
@@ -1880,7 +1777,7 @@ bool G_Harvester_SetDoNotTransport(uint32_t uid, const char *rname, bool set)
 {
     struct hstate *hs = hstate_get(uid);
     assert(hs);
-    return hstate_set_key_int(hs->do_not_transport, rname, set);
+    return hstate_set_key_int(&hs->do_not_transport, rname, set);
 }
 
 bool G_Harvester_GetDoNotTransport(uint32_t uid, const char *rname)
@@ -1889,7 +1786,7 @@ bool G_Harvester_GetDoNotTransport(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    hstate_get_key_int(hs->do_not_transport, rname, &ret);
+    hstate_get_key_int(&hs->do_not_transport, rname, &ret);
     return ret;
 }
 
@@ -2353,16 +2250,17 @@ bool G_Harvester_SaveState(struct SDL_RWops *stream)
 
         struct attr num_speeds = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.gather_speeds)
+            .val.as_int = rtable_size(&curr.gather_speeds)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_speeds, "num_speeds"));
 
-        const char *speed_key;
+        int speed_id;
         float speed_amount;
-        kh_foreach(curr.gather_speeds, speed_key, speed_amount, {
+        rtable_foreach(&curr.gather_speeds, speed_id, speed_amount, {
         
             struct attr speed_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(speed_key_attr.val.as_string, speed_key, sizeof(speed_key_attr.val.as_string));
+            pf_strlcpy(speed_key_attr.val.as_string, G_ResourceId_Name(speed_id), 
+                sizeof(speed_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &speed_key_attr, "speed_key"));
 
             struct attr speed_amount_attr = (struct attr){
@@ -2375,16 +2273,17 @@ bool G_Harvester_SaveState(struct SDL_RWops *stream)
 
         struct attr num_max = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.max_carry)
+            .val.as_int = rtable_size(&curr.max_carry)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_max, "num_max"));
 
-        const char *max_key;
+        int max_id;
         int max_amount;
-        kh_foreach(curr.max_carry, max_key, max_amount, {
+        rtable_foreach(&curr.max_carry, max_id, max_amount, {
         
             struct attr max_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(max_key_attr.val.as_string, max_key, sizeof(max_key_attr.val.as_string));
+            pf_strlcpy(max_key_attr.val.as_string, G_ResourceId_Name(max_id), 
+                sizeof(max_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &max_key_attr, "max_key"));
 
             struct attr max_amount_attr = (struct attr){
@@ -2397,16 +2296,17 @@ bool G_Harvester_SaveState(struct SDL_RWops *stream)
 
         struct attr num_carry = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.curr_carry)
+            .val.as_int = rtable_size(&curr.curr_carry)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_carry, "num_carry"));
 
-        const char *curr_key;
+        int curr_id;
         int curr_amount;
-        kh_foreach(curr.curr_carry, curr_key, curr_amount, {
+        rtable_foreach(&curr.curr_carry, curr_id, curr_amount, {
         
             struct attr curr_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(curr_key_attr.val.as_string, curr_key, sizeof(curr_key_attr.val.as_string));
+            pf_strlcpy(curr_key_attr.val.as_string, G_ResourceId_Name(curr_id), 
+                sizeof(curr_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &curr_key_attr, "curr_key"));
 
             struct attr curr_amount_attr = (struct attr){
@@ -2419,15 +2319,16 @@ bool G_Harvester_SaveState(struct SDL_RWops *stream)
 
         struct attr num_dnt = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.do_not_transport)
+            .val.as_int = rtable_size(&curr.do_not_transport)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_dnt, "num_dnt"));
 
         int curr_flag;
-        kh_foreach(curr.do_not_transport, curr_key, curr_flag, {
+        rtable_foreach(&curr.do_not_transport, curr_id, curr_flag, {
         
             struct attr curr_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(curr_key_attr.val.as_string, curr_key, sizeof(curr_key_attr.val.as_string));
+            pf_strlcpy(curr_key_attr.val.as_string, G_ResourceId_Name(curr_id), 
+                sizeof(curr_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &curr_key_attr, "curr_key"));
 
             struct attr curr_flag_attr = (struct attr){
@@ -2593,7 +2494,8 @@ bool G_Harvester_LoadState(struct SDL_RWops *stream)
         
             CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
             CHK_TRUE_RET(attr.type == TYPE_STRING);
-            const char *key = si_intern(attr.val.as_string, &s_stringpool, s_stridx);
+            const char *key = G_ResourceId_Intern(attr.val.as_string);
+            CHK_TRUE_RET(key);
             hs->res_name = key;
         }
 
@@ -2684,7 +2586,8 @@ bool G_Harvester_LoadState(struct SDL_RWops *stream)
             CHK_TRUE_RET(Attr_Parse(stream, &keyattr, true));
             CHK_TRUE_RET(keyattr.type == TYPE_STRING);
 
-            const char *key = si_intern(keyattr.val.as_string, &s_stringpool, s_stridx);
+            const char *key = G_ResourceId_Intern(keyattr.val.as_string);
+            CHK_TRUE_RET(key);
             vec_name_push(&hs->priority, key);
         }
         Sched_TryYield();
@@ -35,9 +35,11 @@
 
 #include "movement.h"
 #include "game_private.h"
+#include "entity_index.h"
 #include "formation.h"
 #include "combat.h"
 #include "clearpath.h"
+#include "flock_kernels.h"
 #include "position.h"
 #include "public/game.h"
 #include "../config.h"
@@ -67,6 +69,7 @@
 #include "../lib/public/stalloc.h"
 
 #include <assert.h>
+#include <string.h>
 #include <SDL.h>
 
 
@@ -97,7 +100,7 @@
     }while(0)
 
 #define VEL_HIST_LEN (14)
-#define MAX_MOVE_TASKS (64)
+#define MOVE_GRAIN     (64)
 
 enum arrival_state{
     /* Entity is moving towards the flock's destination point */
@@ -174,23 +177,42 @@ struct movestate{
     /* The target direction for 'turning' entities 
      */
     quat_t             target_dir;
+    /* Simulation level-of-detail state. Entities which are far from the camera 
+     * and not in close proximity to others only have their steering recomputed 
+     * every 'lod_period' ticks. On the ticks in between, the last computed 
+     * velocity keeps being integrated so positions stay smooth, and arrival is 
+     * still tested every tick. 
+     */
+    int                lod_period;
+    bool               lod_crowded;
+    bool               lod_skip;
+    /* The transforms the entity had before and after the last movement tick 
+     * which updated its' position. The renderer blends between the two so 
+     * that motion stays smooth at frame rates above the tick rate. 
+     */
+    vec3_t             interp_prev_pos;
+    vec3_t             interp_next_pos;
+    quat_t             interp_prev_rot;
+    uint32_t           interp_tick;
 };
 
 struct flock{
     khash_t(entity) *ents;
     vec2_t           target_xz; 
     dest_id_t        dest_id;
+    /* Copies of the destination's fields for the chunks the members
+     * occupy. Created lazily on the first desired velocity query. */
+    struct nav_flock_fields *fields;
 };
 
 struct move_work_in{
     uint32_t       ent_uid;
+    uint32_t       slot;
     vec2_t         ent_des_v;
     float          speed;
     vec2_t         cell_pos;
     struct cp_ent  cp_ent;
     bool           save_debug;
-    vec_cp_ent_t  *stat_neighbs;
-    vec_cp_ent_t  *dyn_neighbs;
     bool           has_dest_los;
     formation_id_t fid;
     bool           formation_assignment_ready;
@@ -202,11 +224,17 @@ struct move_work_in{
 struct move_work_out{
     uint32_t ent_uid;
     vec2_t   ent_vel;
+    size_t   ndyn_neighbs;
 };
 
-struct move_task_arg{
-    size_t begin_idx;
-    size_t end_idx;
+/* Scratch memory for the batched ClearPath solver. One is claimed by each
+ * parallel-for chunk for its' duration, so there are never more in use than 
+ * there are participants in the loop. 
+ */
+struct move_scratch{
+    SDL_atomic_t    in_use;
+    bool            init;
+    struct memstack mem;
 };
 
 /* The subset of the gamestate that is necessary 
@@ -216,23 +244,54 @@ struct move_task_arg{
  * or even be spread over multiple frames. 
  */
 struct move_gamestate{
-    khash_t(id)      *flags;
-    khash_t(pos)     *positions;
-    qt_ent_t         *postree;
-    khash_t(range)   *sel_radiuses;
-    khash_t(id)      *faction_ids;
-    const struct map *map;
+    khash_t(id)         *flags;
+    struct pos_snapshot *positions;
+    khash_t(range)      *sel_radiuses;
+    khash_t(id)         *faction_ids;
+    const struct map    *map;
+};
+
+struct slot_range{
+    uint32_t begin;
+    uint32_t end;
+};
+
+/* A dense structure-of-arrays copy of the per-entity movement state that 
+ * is read by the movement workers, indexed by a compact slot id. It is 
+ * rebuilt from the gamestate snapshot at every movement tick. The members 
+ * of every flock are assigned a contiguous range of slots, so that the 
+ * flocking forces stream through memory rather than scattering lookups 
+ * across the state tables.
+ */
+struct move_soa{
+    size_t              nslots;
+    uint32_t           *uid;
+    enum arrival_state *state;
+    float              *pos_x;
+    float              *pos_z;
+    float              *vel_x;
+    float              *vel_z;
+    float              *vdes_x;
+    float              *vdes_z;
+    float              *max_speed;
+    float              *radius;
+    uint32_t           *flags;
+    /* Index into 's_flocks', or -1 if the entity is not in a flock */
+    int                *flock;
+    /* The slots of every flock, indexed the same as 's_flocks' */
+    struct slot_range  *flock_slots;
+    /* Mapping of UID to slot */
+    khash_t(id)        *slot_table;
 };
 
 struct move_work{
     struct memstack       mem;
     struct move_gamestate gamestate;
+    struct move_soa       soa;
     struct move_work_in  *in;
     struct move_work_out *out;
     size_t                nwork;
-    size_t                ntasks;
-    uint32_t              tids[MAX_MOVE_TASKS];
-    struct future         futures[MAX_MOVE_TASKS];
+    struct pfor_work      pfor;
 };
 
 enum move_cmd_type{
@@ -240,6 +299,7 @@ enum move_cmd_type{
     MOVE_CMD_REMOVE,
     MOVE_CMD_STOP,
     MOVE_CMD_SET_DEST,
+    MOVE_CMD_SET_DEST_BATCH,
     MOVE_CMD_CHANGE_DIRECTION,
     MOVE_CMD_SET_ENTER_RANGE,
     MOVE_CMD_SET_SEEK_ENEMIES,
@@ -259,14 +319,33 @@ struct move_cmd{
     struct attr        args[6];
 };
 
+/* The kinds of commands which are looked up by entity while still queued */
+enum move_cmd_index{
+    MOVE_INDEX_DEST,
+    MOVE_INDEX_STILL,
+    MOVE_INDEX_SURROUND,
+    MOVE_INDEX_UPDATE_POS,
+    MOVE_INDEX_MAX_SPEED,
+};
+
 KHASH_MAP_INIT_INT(state, struct movestate)
+KHASH_MAP_INIT_INT64(cmdidx, uint64_t)
 
 QUEUE_TYPE(cmd, struct move_cmd)
 QUEUE_IMPL(static, cmd, struct move_cmd)
 
+MPSC_QUEUE_TYPE(cmd, struct move_cmd)
+MPSC_QUEUE_IMPL(static, cmd, struct move_cmd)
+
 VEC_TYPE(flock, struct flock)
 VEC_IMPL(static inline, flock, struct flock)
 
+VEC_TYPE(blocker_op, struct nav_blocker_op)
+VEC_IMPL(static inline, blocker_op, struct nav_blocker_op)
+
+/* For the short-lived selections of the move commands */
+VEC_TYPE_SBO(entity, uint32_t, 64)
+
 static void move_push_cmd(struct move_cmd cmd);
 static void do_set_dest(uint32_t uid, vec2_t dest_xz, bool attack);
 static void do_stop(uint32_t uid);
@@ -295,6 +374,13 @@ static void do_update_pos(uint32_t uid, vec2_t pos);
 #define SURROUND_LOW_WATER_Z            (CHUNK_HEIGHT/3.0f)
 #define SURROUND_HIGH_WATER_Z           (CHUNK_HEIGHT/2.0f)
 
+#define LOD_NEAR_DIST                   (250.0f)
+#define LOD_FAR_DIST                    (500.0f)
+#define LOD_TARGET_DIST                 (2.0f * CELL_ARRIVAL_RADIUS)
+#define LOD_PERIOD_NEAR                 (1) /* 20 Hz */
+#define LOD_PERIOD_MID                  (2) /* 10 Hz */
+#define LOD_PERIOD_FAR                  (4) /*  5 Hz */
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -318,9 +404,59 @@ static bool                    s_last_cmd_dest_valid = false;
 static dest_id_t               s_last_cmd_dest;
 
 static struct move_work        s_move_work;
+static struct move_scratch     s_move_scratch[SCHED_MAX_PFOR_HELPERS + 1];
 static queue_cmd_t             s_move_commands;
+/* Commands pushed from outside the main thread. They are moved over to 
+ * the command queue by the main thread before it is read. */
+static mpsc(cmd)               s_move_inbox;
+/* Maps an (entity, index kind) pair to the sequence number of the most 
+ * recent queued command of that kind, so that snooping the queue for an 
+ * entity's pending commands doesn't need to walk all of it. The entry 
+ * at the head of the queue has sequence number 's_cmd_head_seq'. The 
+ * index is marked invalid if an insertion fails, in which case the 
+ * queue is scanned until it has been drained. */
+static khash_t(cmdidx)        *s_cmd_index;
+static bool                    s_cmd_index_valid = true;
+static uint64_t                s_cmd_head_seq = 0;
+static uint64_t                s_cmd_next_seq = 0;
+/* The number of destination orders pushed since the queue was last 
+ * processed. Superseded orders are only searched for when there is 
+ * more than one of them. */
+static size_t                  s_pending_orders = 0;
+static khash_t(entity)        *s_order_uids;
+/* Blocker changes made while processing the tick's state transitions and
+ * commands. They are applied in a single batch once all the commands have 
+ * been processed, so that a mass stop or start only rasterizes each unit's 
+ * footprint once, and units that are unblocked and blocked again at the 
+ * same position don't touch the navigation data at all. */
+static vec_blocker_op_t        s_blocker_ops;
 static struct memstack         s_eventargs;
 static unsigned long           s_last_tick = 0;
+static uint32_t                s_move_tick = 0;
+/* Number of movement ticks whose position updates have been applied and 
+ * the time at which the last one took place, for render interpolation. 
+ */
+static uint32_t                s_interp_tick = 0;
+static uint64_t                s_interp_tick_time = 0;
+static bool                    s_interp_enabled = false;
+
+/* Settings which are read every tick or frame */
+static struct{
+    sett_handle_t movement_interpolation;
+    sett_handle_t movement_lod;
+    sett_handle_t deferred_nav_fields;
+    sett_handle_t navigation_layer;
+    sett_handle_t show_last_cmd_flow_field;
+    sett_handle_t show_first_sel_movestate;
+    sett_handle_t show_enemy_seek_fields;
+    sett_handle_t enemy_seek_fields_faction_id;
+    sett_handle_t show_navigation_blockers;
+    sett_handle_t show_navigation_portals;
+    sett_handle_t show_navigation_cost_base;
+    sett_handle_t show_chunk_boundaries;
+    sett_handle_t show_navigation_island_ids;
+    sett_handle_t show_navigation_local_island_ids;
+}s_sett;
 
 static const char *s_state_str[] = {
     [STATE_MOVING]              = STR(STATE_MOVING),
@@ -410,13 +546,45 @@ static struct flock *flock_for_dest(dest_id_t id)
     return NULL;
 }
 
+static void flush_blocker_ops(void)
+{
+    if(vec_size(&s_blocker_ops) == 0)
+        return;
+
+    M_NavBlockersUpdateBatch(s_map, vec_size(&s_blocker_ops), s_blocker_ops.array);
+    vec_blocker_op_reset(&s_blocker_ops);
+}
+
+static void push_blocker_op(vec2_t pos, float radius, int faction_id, 
+                            uint32_t flags, int ref_delta)
+{
+    struct nav_blocker_op op = (struct nav_blocker_op){
+        .xz_pos = pos,
+        .range = radius,
+        .faction_id = faction_id,
+        .flags = flags,
+        .ref_delta = ref_delta
+    };
+    if(vec_blocker_op_push(&s_blocker_ops, op))
+        return;
+
+    /* Fall back to applying the change right away, after the ones 
+     * that came before it */
+    flush_blocker_ops();
+    if(ref_delta > 0) {
+        M_NavBlockersIncref(pos, radius, faction_id, flags, s_map);
+    }else{
+        M_NavBlockersDecref(pos, radius, faction_id, flags, s_map);
+    }
+}
+
 static void entity_block(uint32_t uid)
 {
     float sel_radius = G_GetSelectionRadiusFrom(s_move_work.gamestate.sel_radiuses, uid);
     vec2_t pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
     uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
-    M_NavBlockersIncref(pos, sel_radius, 
-        G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, uid), flags, s_map);
+    push_blocker_op(pos, sel_radius, 
+        G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, uid), flags, +1);
 
     struct movestate *ms = movestate_get(uid);
     assert(!ms->blocking);
@@ -440,7 +608,7 @@ static void entity_unblock(uint32_t uid)
 
     int faction_id = G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, uid);
     uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
-    M_NavBlockersDecref(ms->last_stop_pos, ms->last_stop_radius, faction_id, flags, s_map);
+    push_blocker_op(ms->last_stop_pos, ms->last_stop_radius, faction_id, flags, -1);
     ms->blocking = false;
 
     struct entity_block_desc *desc = stalloc(&s_eventargs, sizeof(struct entity_block_desc));
@@ -478,9 +646,37 @@ static void vec2_truncate(vec2_t *inout, float max_len)
     }
 }
 
+static bool state_still(enum arrival_state state)
+{
+    return (state == STATE_ARRIVED || state == STATE_WAITING);
+}
+
 static bool ent_still(const struct movestate *ms)
 {
-    return (ms->state == STATE_ARRIVED || ms->state == STATE_WAITING);
+    return state_still(ms->state);
+}
+
+static int soa_slot(const struct move_soa *soa, uint32_t uid)
+{
+    khiter_t k = kh_get(id, soa->slot_table, uid);
+    if(k == kh_end(soa->slot_table))
+        return -1;
+    return kh_val(soa->slot_table, k);
+}
+
+static vec2_t soa_position(const struct move_soa *soa, uint32_t slot)
+{
+    return (vec2_t){soa->pos_x[slot], soa->pos_z[slot]};
+}
+
+static vec2_t soa_velocity(const struct move_soa *soa, uint32_t slot)
+{
+    return (vec2_t){soa->vel_x[slot], soa->vel_z[slot]};
+}
+
+static vec2_t soa_vdes(const struct move_soa *soa, uint32_t slot)
+{
+    return (vec2_t){soa->vdes_x[slot], soa->vdes_z[slot]};
 }
 
 static float entity_speed(uint32_t uid)
@@ -553,6 +749,7 @@ static void remove_from_flocks(uint32_t uid)
 
         if(kh_size(curr_flock->ents) == 0) {
             kh_destroy(entity, curr_flock->ents);
+            N_FlockFieldsFree(curr_flock->fields);
             vec_flock_del(&s_flocks, i);
         }
     }
@@ -563,7 +760,6 @@ static void filter_selection_pathable(const vec_entity_t *in_sel, vec_entity_t *
 {
     ASSERT_IN_MAIN_THREAD();
 
-    vec_entity_init(out_sel);
     for(int i = 0; i < vec_size(in_sel); i++) {
 
         uint32_t curr = vec_AT(in_sel, i);
@@ -598,6 +794,32 @@ static void split_into_layers(const vec_entity_t *sel, vec_entity_t layer_flocks
     }
 }
 
+static void make_flock_paths(const struct flock *flock, enum nav_layer layer, 
+                             bool attack, uint32_t first)
+{
+    size_t nents = kh_size(flock->ents);
+    vec2_t *srcs = malloc(nents * sizeof(vec2_t));
+    if(!srcs)
+        return;
+
+    size_t nsrcs = 0;
+    uint32_t curr;
+    kh_foreach_key(flock->ents, curr, {
+        srcs[nsrcs++] = G_Pos_GetXZFrom(s_move_work.gamestate.positions, curr);
+    });
+
+    dest_id_t dest_id;
+    if(attack) {
+        int faction_id = G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, first);
+        M_NavRequestPathBatchAttacking(s_map, nsrcs, srcs, flock->target_xz, faction_id,
+            layer, NULL, &dest_id);
+    }else{
+        M_NavRequestPathBatch(s_map, nsrcs, srcs, flock->target_xz, layer, NULL, &dest_id);
+    }
+    assert(dest_id == flock->dest_id);
+    free(srcs);
+}
+
 static bool make_flock(const vec_entity_t *units, vec2_t target_xz, 
                        enum nav_layer layer, bool attack, enum formation_type type)
 {
@@ -662,6 +884,10 @@ static bool make_flock(const vec_entity_t *units, vec2_t target_xz,
         return false;
     }
 
+    /* Make the paths of the whole flock up-front, rather than having every 
+     * entity make its' own request on the next movement tick */
+    make_flock_paths(&new_flock, layer, attack, first);
+
     /* If there is another flock with the same dest_id, then we merge the two flocks. */
     struct flock *merge_flock = flock_for_dest(new_flock.dest_id);
     if(merge_flock) {
@@ -686,22 +912,23 @@ static void make_flocks(const vec_entity_t *sel, vec2_t target_xz, vec2_t target
 {
     ASSERT_IN_MAIN_THREAD();
 
-    vec_entity_t fsel;
-    filter_selection_pathable(sel, &fsel);
+    vec_entity_sbo_t fsel;
+    vec_sbo_init(entity, &fsel);
+    filter_selection_pathable(sel, &fsel.vec);
 
-    if(vec_size(&fsel) == 0)
+    if(vec_size(&fsel.vec) == 0)
         return;
 
     vec_entity_t layer_flocks[NAV_LAYER_MAX];
-    split_into_layers(&fsel, layer_flocks);
+    split_into_layers(&fsel.vec, layer_flocks);
 
     for(int i = 0; i < NAV_LAYER_MAX; i++) {
         make_flock(layer_flocks + i, target_xz, i, attack, type);
         vec_entity_destroy(layer_flocks + i);
     }
 
-    G_Formation_Create(target_xz, target_orientation, &fsel, type);
-    vec_entity_destroy(&fsel);
+    G_Formation_Create(target_xz, target_orientation, &fsel.vec, type);
+    vec_entity_destroy(&fsel.vec);
 }
 
 static size_t adjacent_flock_members(uint32_t uid, const struct flock *flock, 
@@ -941,29 +1168,17 @@ static void on_render_3d(void *user, void *event)
     }
 
     const struct camera *cam = G_GetActiveCamera();
-    enum nav_layer layer;
-
-    struct sval setting;
-    ss_e status;
-    (void)status;
+    enum nav_layer layer = Settings_ReadInt(s_sett.navigation_layer);
+    M_NavRenderOverlayBegin();
 
-    status = Settings_Get("pf.debug.navigation_layer", &setting);
-    assert(status == SS_OKAY);
-    layer = setting.as_int;
-
-    status = Settings_Get("pf.debug.show_last_cmd_flow_field", &setting);
-    assert(status == SS_OKAY);
-    if(setting.as_bool && s_last_cmd_dest_valid) {
+    if(Settings_ReadBool(s_sett.show_last_cmd_flow_field) && s_last_cmd_dest_valid) {
         M_NavRenderVisiblePathFlowField(s_map, cam, s_last_cmd_dest);
     }
 
-    status = Settings_Get("pf.debug.show_first_sel_movestate", &setting);
-    assert(status == SS_OKAY);
-
     enum selection_type seltype;
     const vec_entity_t *sel = G_Sel_Get(&seltype);
 
-    if(setting.as_bool && vec_size(sel) > 0) {
+    if(Settings_ReadBool(s_sett.show_first_sel_movestate) && vec_size(sel) > 0) {
     
         uint32_t ent = vec_AT(sel, 0);
         struct movestate *ms = movestate_get(ent);
@@ -1025,51 +1240,36 @@ static void on_render_3d(void *user, void *event)
         }
     }
 
-    status = Settings_Get("pf.debug.show_enemy_seek_fields", &setting);
-    assert(status == SS_OKAY);
-    if(setting.as_bool) {
+    if(Settings_ReadBool(s_sett.show_enemy_seek_fields)) {
 
-        status = Settings_Get("pf.debug.enemy_seek_fields_faction_id", &setting);
-        assert(status == SS_OKAY);
-    
-        M_NavRenderVisibleEnemySeekField(s_map, cam, layer, setting.as_int);
+        int faction_id = Settings_ReadInt(s_sett.enemy_seek_fields_faction_id);
+        M_NavRenderVisibleEnemySeekField(s_map, cam, layer, faction_id);
     }
 
-    status = Settings_Get("pf.debug.show_navigation_blockers", &setting);
-    assert(status == SS_OKAY);
-    if(setting.as_bool) {
+    if(Settings_ReadBool(s_sett.show_navigation_blockers)) {
         M_NavRenderNavigationBlockers(s_map, cam, layer);
     }
 
-    status = Settings_Get("pf.debug.show_navigation_portals", &setting);
-    assert(status == SS_OKAY);
-    if(setting.as_bool) {
+    if(Settings_ReadBool(s_sett.show_navigation_portals)) {
         M_NavRenderNavigationPortals(s_map, cam, layer);
     }
 
-    status = Settings_Get("pf.debug.show_navigation_cost_base", &setting);
-    assert(status == SS_OKAY);
-    if(setting.as_bool) {
+    if(Settings_ReadBool(s_sett.show_navigation_cost_base)) {
         M_RenderVisiblePathableLayer(s_map, cam, layer);
     }
 
-    status = Settings_Get("pf.debug.show_chunk_boundaries", &setting);
-    assert(status == SS_OKAY);
-    if(setting.as_bool) {
+    if(Settings_ReadBool(s_sett.show_chunk_boundaries)) {
         M_RenderChunkBoundaries(s_map, cam);
     }
 
-    status = Settings_Get("pf.debug.show_navigation_island_ids", &setting);
-    assert(status == SS_OKAY);
-    if(setting.as_bool) {
+    if(Settings_ReadBool(s_sett.show_navigation_island_ids)) {
         M_NavRenderNavigationIslandIDs(s_map, cam, layer);
     }
 
-    status = Settings_Get("pf.debug.show_navigation_local_island_ids", &setting);
-    assert(status == SS_OKAY);
-    if(setting.as_bool) {
+    if(Settings_ReadBool(s_sett.show_navigation_local_island_ids)) {
         M_NavRenderNavigationLocalIslandIDs(s_map, cam, layer);
     }
+    M_NavRenderOverlayEnd();
 }
 
 static quat_t dir_quat_from_velocity(vec2_t velocity)
@@ -1085,12 +1285,12 @@ static quat_t dir_quat_from_velocity(vec2_t velocity)
     };
 }
 
-static void request_async_field(uint32_t uid)
+static void request_async_field(uint32_t uid, const struct map *map)
 {
     ASSERT_IN_MAIN_THREAD();
 
     struct movestate *ms = movestate_get(uid);
-    if(!ms || ent_still(ms))
+    if(!ms || ent_still(ms) || ms->lod_skip)
         return;
 
     vec2_t pos_xz = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
@@ -1102,7 +1302,7 @@ static void request_async_field(uint32_t uid)
         uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
         int layer = Entity_NavLayerWithRadius(flags, radius);
         int faction_id = G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, uid);
-        return M_NavRequestAsyncEnemySeekField(s_map, layer, pos_xz, faction_id);
+        return M_NavRequestAsyncEnemySeekField(map, layer, pos_xz, faction_id);
     }
     case STATE_SURROUND_ENTITY: {
 
@@ -1114,7 +1314,7 @@ static void request_async_field(uint32_t uid)
             uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
             int layer = Entity_NavLayerWithRadius(flags, radius);
             int faction_id = G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, uid);
-            return M_NavRequestAsyncSurroundField(s_map, layer, pos_xz, 
+            return M_NavRequestAsyncSurroundField(map, layer, pos_xz, 
                 ms->surround_target_uid, faction_id);
         }
         break;
@@ -1132,6 +1332,10 @@ static vec2_t ent_desired_velocity(uint32_t uid)
     vec2_t pos_xz = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
     struct flock *fl = flock_for_ent(uid);
 
+    if(fl && !fl->fields) {
+        fl->fields = N_FlockFieldsNew();
+    }
+
     switch(ms->state) {
     case STATE_TURNING:
         return (vec2_t){0.0f, 0.0f};
@@ -1141,12 +1345,16 @@ static vec2_t ent_desired_velocity(uint32_t uid)
         uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
         int layer = Entity_NavLayerWithRadius(flags, radius);
         int faction_id = G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, uid);
+        /* Keep steering along the previous field until the new one is ready */
+        if(M_NavEnemySeekFieldPending(s_map, layer, pos_xz, faction_id))
+            return ms->vdes;
         return M_NavDesiredEnemySeekVelocity(s_map, layer, pos_xz, faction_id);
     }
     case STATE_SURROUND_ENTITY: {
 
         if(!G_EntityExists(ms->surround_target_uid)) {
-            return M_NavDesiredPointSeekVelocity(s_map, fl->dest_id, pos_xz, fl->target_xz);
+            return M_NavFlockDesiredPointSeekVelocity(s_map, fl->fields, fl->dest_id, 
+                pos_xz, fl->target_xz);
         }
 
         vec2_t target_pos_xz = G_Pos_GetXZ(ms->surround_target_uid);
@@ -1168,10 +1376,13 @@ static vec2_t ent_desired_velocity(uint32_t uid)
             uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
             int layer = Entity_NavLayerWithRadius(flags, radius);
             int faction_id = G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, uid);
+            if(M_NavSurroundFieldPending(s_map, layer, pos_xz, ms->surround_target_uid))
+                return ms->vdes;
             return M_NavDesiredSurroundVelocity(s_map, layer, pos_xz, 
                 ms->surround_target_uid, faction_id);
         }else{
-            return M_NavDesiredPointSeekVelocity(s_map, fl->dest_id, pos_xz, fl->target_xz);
+            return M_NavFlockDesiredPointSeekVelocity(s_map, fl->fields, fl->dest_id, 
+                pos_xz, fl->target_xz);
         }
         break;
     }
@@ -1184,7 +1395,8 @@ static vec2_t ent_desired_velocity(uint32_t uid)
     }
     default:
         assert(fl);
-        return M_NavDesiredPointSeekVelocity(s_map, fl->dest_id, pos_xz, fl->target_xz);
+        return M_NavFlockDesiredPointSeekVelocity(s_map, fl->fields, fl->dest_id, 
+            pos_xz, fl->target_xz);
     }
 }
 
@@ -1212,21 +1424,20 @@ static vec2_t seek_force(uint32_t uid, vec2_t target_xz)
  * When not within line of sight of the destination, this will steer the entity along the 
  * flow field.
  */
-static vec2_t arrive_force_point(uint32_t uid, vec2_t target_xz, bool has_dest_los)
+static vec2_t arrive_force_point(uint32_t slot, vec2_t target_xz, bool has_dest_los)
 {
+    const struct move_soa *soa = &s_move_work.soa;
     vec2_t ret, desired_velocity;
-    vec2_t pos_xz = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
+    vec2_t pos_xz = soa_position(soa, slot);
+    vec2_t velocity = soa_velocity(soa, slot);
     float distance;
 
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
-
     if(has_dest_los) {
 
         PFM_Vec2_Sub(&target_xz, &pos_xz, &desired_velocity);
         distance = PFM_Vec2_Len(&desired_velocity);
         PFM_Vec2_Normal(&desired_velocity, &desired_velocity);
-        PFM_Vec2_Scale(&desired_velocity, ms->max_speed / MOVE_TICK_RES, &desired_velocity);
+        PFM_Vec2_Scale(&desired_velocity, soa->max_speed[slot] / MOVE_TICK_RES, &desired_velocity);
 
         if(distance < ARRIVE_SLOWING_RADIUS) {
             PFM_Vec2_Scale(&desired_velocity, distance / ARRIVE_SLOWING_RADIUS, &desired_velocity);
@@ -1234,18 +1445,19 @@ static vec2_t arrive_force_point(uint32_t uid, vec2_t target_xz, bool has_dest_l
 
     }else{
 
-        PFM_Vec2_Scale(&ms->vdes, ms->max_speed / MOVE_TICK_RES, &desired_velocity);
+        vec2_t vdes = soa_vdes(soa, slot);
+        PFM_Vec2_Scale(&vdes, soa->max_speed[slot] / MOVE_TICK_RES, &desired_velocity);
     }
 
-    PFM_Vec2_Sub(&desired_velocity, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&desired_velocity, &velocity, &ret);
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
-static vec2_t arrive_force_cell(uint32_t uid, vec2_t cell_xz)
+static vec2_t arrive_force_cell(uint32_t slot, vec2_t cell_xz)
 {
-    struct movestate *ms = movestate_get(uid);
-    vec2_t pos_xz = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
+    const struct move_soa *soa = &s_move_work.soa;
+    vec2_t pos_xz = soa_position(soa, slot);
     float distance;
 
     vec2_t desired_velocity;
@@ -1255,100 +1467,82 @@ static vec2_t arrive_force_cell(uint32_t uid, vec2_t cell_xz)
     if(distance < ARRIVE_SLOWING_RADIUS) {
         PFM_Vec2_Scale(&desired_velocity, distance / ARRIVE_SLOWING_RADIUS, &desired_velocity);
     }else{
-        PFM_Vec2_Scale(&ms->vdes, ms->max_speed / MOVE_TICK_RES, &desired_velocity);
+        vec2_t vdes = soa_vdes(soa, slot);
+        PFM_Vec2_Scale(&vdes, soa->max_speed[slot] / MOVE_TICK_RES, &desired_velocity);
     }
     return desired_velocity;
 }
 
-static vec2_t arrive_force_enemies(uint32_t uid)
+static vec2_t arrive_force_enemies(uint32_t slot)
 {
+    const struct move_soa *soa = &s_move_work.soa;
     vec2_t ret, desired_velocity;
-    vec2_t pos_xz = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
-    float distance;
-
-    const struct movestate *ms = movestate_get(uid);
-    assert(ms);
+    vec2_t vdes = soa_vdes(soa, slot);
+    vec2_t velocity = soa_velocity(soa, slot);
 
-    PFM_Vec2_Scale((vec2_t*)&ms->vdes, ms->max_speed / MOVE_TICK_RES, &desired_velocity);
-    PFM_Vec2_Sub(&desired_velocity, (vec2_t*)&ms->velocity, &ret);
+    PFM_Vec2_Scale(&vdes, soa->max_speed[slot] / MOVE_TICK_RES, &desired_velocity);
+    PFM_Vec2_Sub(&desired_velocity, &velocity, &ret);
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
 /* Alignment is a behaviour that causes a particular agent to line up with agents close by.
  */
-static vec2_t alignment_force(uint32_t uid, const struct flock *flock)
+static vec2_t alignment_force(uint32_t slot)
 {
-    vec2_t ret = (vec2_t){0.0f};
-    size_t neighbour_count = 0;
-
-    uint32_t curr;
-    kh_foreach_key(flock->ents, curr, {
-
-        if(curr == uid)
-            continue;
-
-        vec2_t diff;
-        vec2_t ent_xz_pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
-        vec2_t curr_xz_pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, curr);
+    const struct move_soa *soa = &s_move_work.soa;
+    const struct slot_range *range = &soa->flock_slots[soa->flock[slot]];
+    const float pos_x = soa->pos_x[slot];
+    const float pos_z = soa->pos_z[slot];
 
-        PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
-        if(PFM_Vec2_Len(&diff) < ALIGN_NEIGHBOUR_RADIUS) {
-
-            struct movestate *ms = movestate_get(uid);
-            assert(ms);
-
-            if(PFM_Vec2_Len(&ms->velocity) < EPSILON)
-                continue; 
+    const vec2_t pos = (vec2_t){soa->pos_x[slot], soa->pos_z[slot]};
+    size_t neighbour_count = 0;
 
-            PFM_Vec2_Add(&ret, &ms->velocity, &ret);
-            neighbour_count++;
-        }
-    });
+    /* Accumulate the ranges on either side of the entity's own slot */
+    vec2_t ret = G_Flock_AlignmentSum(
+        soa->pos_x + range->begin, soa->pos_z + range->begin,
+        soa->vel_x + range->begin, soa->vel_z + range->begin, slot - range->begin,
+        pos, ALIGN_NEIGHBOUR_RADIUS, EPSILON, &neighbour_count);
+    vec2_t after = G_Flock_AlignmentSum(
+        soa->pos_x + slot + 1, soa->pos_z + slot + 1,
+        soa->vel_x + slot + 1, soa->vel_z + slot + 1, range->end - slot - 1,
+        pos, ALIGN_NEIGHBOUR_RADIUS, EPSILON, &neighbour_count);
+    PFM_Vec2_Add(&ret, &after, &ret);
 
     if(0 == neighbour_count)
         return (vec2_t){0.0f};
 
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
+    vec2_t velocity = soa_velocity(soa, slot);
 
     PFM_Vec2_Scale(&ret, 1.0f / neighbour_count, &ret);
-    PFM_Vec2_Sub(&ret, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&ret, &velocity, &ret);
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
 /* Cohesion is a behaviour that causes agents to steer towards the center of mass of nearby agents.
  */
-static vec2_t cohesion_force(uint32_t uid, const struct flock *flock)
+static vec2_t cohesion_force(uint32_t slot)
 {
-    vec2_t COM = (vec2_t){0.0f};
-    size_t neighbour_count = 0;
-    vec2_t ent_xz_pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
-
-    uint32_t curr;
-    kh_foreach_key(flock->ents, curr, {
-
-        if(curr == uid)
-            continue;
-
-        vec2_t diff;
-        vec2_t curr_xz_pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, curr);
-        PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
-
-        float t = (PFM_Vec2_Len(&diff) 
-                - COHESION_NEIGHBOUR_RADIUS*0.75) / COHESION_NEIGHBOUR_RADIUS;
-        float scale = exp(-6.0f * t);
-
-        PFM_Vec2_Scale(&curr_xz_pos, scale, &curr_xz_pos);
-        PFM_Vec2_Add(&COM, &curr_xz_pos, &COM);
-        neighbour_count++;
-    });
+    const struct move_soa *soa = &s_move_work.soa;
+    const struct slot_range *range = &soa->flock_slots[soa->flock[slot]];
+    vec2_t ent_xz_pos = (vec2_t){soa->pos_x[slot], soa->pos_z[slot]};
+    const size_t neighbour_count = range->end - range->begin - 1;
 
     if(0 == neighbour_count)
         return (vec2_t){0.0f};
 
+    /* Accumulate the ranges on either side of the entity's own slot */
+    vec2_t COM = G_Flock_CohesionSum(
+        soa->pos_x + range->begin, soa->pos_z + range->begin, slot - range->begin, 
+        ent_xz_pos, COHESION_NEIGHBOUR_RADIUS*0.75f, COHESION_NEIGHBOUR_RADIUS, -6.0f);
+    vec2_t after = G_Flock_CohesionSum(
+        soa->pos_x + slot + 1, soa->pos_z + slot + 1, range->end - slot - 1, 
+        ent_xz_pos, COHESION_NEIGHBOUR_RADIUS*0.75f, COHESION_NEIGHBOUR_RADIUS, -6.0f);
+    PFM_Vec2_Add(&COM, &after, &COM);
+
     vec2_t ret;
+
     PFM_Vec2_Scale(&COM, 1.0f / neighbour_count, &COM);
     PFM_Vec2_Sub(&COM, &ent_xz_pos, &ret);
     vec2_truncate(&ret, MAX_FORCE);
@@ -1357,67 +1551,62 @@ static vec2_t cohesion_force(uint32_t uid, const struct flock *flock)
 
 /* Separation is a behaviour that causes agents to steer away from nearby agents.
  */
-static vec2_t separation_force(uint32_t uid, float buffer_dist)
+static vec2_t separation_force(uint32_t slot, float buffer_dist)
 {
-    vec2_t ret = (vec2_t){0.0f};
-    uint32_t ent_flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
+    const struct move_soa *soa = &s_move_work.soa;
+    const float pos_x = soa->pos_x[slot];
+    const float pos_z = soa->pos_z[slot];
+    const uint32_t ent_flags = soa->flags[slot];
+
     uint32_t near_ents[128];
-    int num_near = G_Pos_EntsInCircleFrom(s_move_work.gamestate.postree,
-        s_move_work.gamestate.flags,
-        G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid), 
+    int num_near = G_Pos_EntsInCircleFrom(s_move_work.gamestate.positions,
+        s_move_work.gamestate.flags, (vec2_t){pos_x, pos_z},
         SEPARATION_NEIGHB_RADIUS, near_ents, ARR_SIZE(near_ents));
 
+    /* Gather the eligible neighbours into contiguous arrays first */
+    float diff_x[ARR_SIZE(near_ents)];
+    float diff_z[ARR_SIZE(near_ents)];
+    float radius[ARR_SIZE(near_ents)];
+    int ncands = 0;
+
     for(int i = 0; i < num_near; i++) {
 
-        uint32_t curr = near_ents[i];
-        uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, curr);
-        if(curr == uid)
+        int curr = soa_slot(soa, near_ents[i]);
+        if(curr < 0 || curr == slot)
             continue;
+
+        uint32_t flags = soa->flags[curr];
         if(!(flags & ENTITY_FLAG_MOVABLE))
             continue;
         if((ent_flags & ENTITY_FLAG_AIR) != (flags & ENTITY_FLAG_AIR))
             continue;
 
-        vec2_t diff;
-        vec2_t ent_xz_pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
-        vec2_t curr_xz_pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, curr);
-
-        float radius = G_GetSelectionRadiusFrom(s_move_work.gamestate.sel_radiuses, uid) 
-                     + G_GetSelectionRadiusFrom(s_move_work.gamestate.sel_radiuses, curr) 
-                     + buffer_dist;
-        PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
-
-        if(PFM_Vec2_Len(&diff) < EPSILON)
-            continue;
-
-        /* Exponential decay with y=1 when diff = radius*0.85 
-         * Use smooth decay curves in order to curb the 'toggling' or oscillating 
-         * behaviour that may arise when there are discontinuities in the forces. 
-         */
-        float t = (PFM_Vec2_Len(&diff) - radius*0.85) / PFM_Vec2_Len(&diff);
-        float scale = exp(-20.0f * t);
-        PFM_Vec2_Scale(&diff, scale, &diff);
-
-        PFM_Vec2_Add(&ret, &diff, &ret);
+        diff_x[ncands] = soa->pos_x[curr] - pos_x;
+        diff_z[ncands] = soa->pos_z[curr] - pos_z;
+        radius[ncands] = soa->radius[slot] + soa->radius[curr] + buffer_dist;
+        ncands++;
     }
 
+    /* Exponential decay with y=1 when diff = radius*0.85 
+     * Use smooth decay curves in order to curb the 'toggling' or oscillating 
+     * behaviour that may arise when there are discontinuities in the forces. 
+     */
+    vec2_t sum = G_Flock_SeparationSum(diff_x, diff_z, radius, ncands, 0.85f, -20.0f, EPSILON);
+
     if(0 == num_near)
         return (vec2_t){0.0f};
 
-    PFM_Vec2_Scale(&ret, -1.0f, &ret);
+    vec2_t ret = (vec2_t){-sum.x, -sum.z};
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
-static vec2_t point_seek_total_force(uint32_t uid, const struct flock *flock, 
+static vec2_t point_seek_total_force(uint32_t slot, const struct flock *flock, 
                                      bool has_dest_los)
 {
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
-
-    vec2_t arrive = arrive_force_point(uid, flock->target_xz, has_dest_los);
-    vec2_t cohesion = cohesion_force(uid, flock);
-    vec2_t separation = separation_force(uid, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force_point(slot, flock->target_xz, has_dest_los);
+    vec2_t cohesion = cohesion_force(slot);
+    vec2_t separation = separation_force(slot, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&cohesion,   MOVE_COHESION_FORCE_SCALE, &cohesion);
@@ -1432,18 +1621,15 @@ static vec2_t point_seek_total_force(uint32_t uid, const struct flock *flock,
     return ret;
 }
 
-static vec2_t cell_seek_total_force(uint32_t uid, vec2_t cell_pos,
+static vec2_t cell_seek_total_force(uint32_t slot, vec2_t cell_pos,
                                     vec2_t cohesion, vec2_t alignment)
 {
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
-
     vec2_t delta;
-    vec2_t pos_xz = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
+    vec2_t pos_xz = soa_position(&s_move_work.soa, slot);
     PFM_Vec2_Sub(&cell_pos, &pos_xz, &delta);
 
-    vec2_t arrive = arrive_force_cell(uid, cell_pos);
-    vec2_t separation = separation_force(uid, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force_cell(slot, cell_pos);
+    vec2_t separation = separation_force(slot, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&separation, SEPARATION_FORCE_SCALE,    &separation);
@@ -1463,13 +1649,10 @@ static vec2_t cell_seek_total_force(uint32_t uid, vec2_t cell_pos,
     return ret;
 }
 
-static vec2_t enemy_seek_total_force(uint32_t uid)
+static vec2_t enemy_seek_total_force(uint32_t slot)
 {
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
-
-    vec2_t arrive = arrive_force_enemies(uid);
-    vec2_t separation = separation_force(uid, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force_enemies(slot);
+    vec2_t separation = separation_force(slot, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&separation, SEPARATION_FORCE_SCALE,    &separation);
@@ -1495,14 +1678,13 @@ static vec2_t new_pos_for_vel(uint32_t uid, vec2_t velocity)
 
 /* Nullify the components of the force which would guide
  * the entity towards an impassable tile. */
-static void nullify_impass_components(uint32_t uid, vec2_t *inout_force)
+static void nullify_impass_components(uint32_t slot, vec2_t *inout_force)
 {
+    const struct move_soa *soa = &s_move_work.soa;
     vec2_t nt_dims = N_TileDims();
-    float radius = G_GetSelectionRadiusFrom(s_move_work.gamestate.sel_radiuses, uid);
-    uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
-    enum nav_layer layer = Entity_NavLayerWithRadius(flags, radius);
+    enum nav_layer layer = Entity_NavLayerWithRadius(soa->flags[slot], soa->radius[slot]);
 
-    vec2_t pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
+    vec2_t pos = soa_position(soa, slot);
     vec2_t left =  (vec2_t){pos.x + nt_dims.x, pos.z};
     vec2_t right = (vec2_t){pos.x - nt_dims.x, pos.z};
     vec2_t top =   (vec2_t){pos.x, pos.z + nt_dims.z};
@@ -1529,71 +1711,67 @@ static void nullify_impass_components(uint32_t uid, vec2_t *inout_force)
         inout_force->z = 0.0f;
 }
 
-static vec2_t point_seek_vpref(uint32_t uid, const struct flock *flock, 
+static vec2_t point_seek_vpref(uint32_t slot, const struct flock *flock, 
                                bool has_dest_los, float speed)
 {
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
-
     vec2_t steer_force;
     for(int prio = 0; prio < 3; prio++) {
 
         switch(prio) {
         case 0: 
-            steer_force = point_seek_total_force(uid, flock, has_dest_los); 
+            steer_force = point_seek_total_force(slot, flock, has_dest_los); 
             break;
         case 1: 
-            steer_force = separation_force(uid, SEPARATION_BUFFER_DIST); 
+            steer_force = separation_force(slot, SEPARATION_BUFFER_DIST); 
             break;
         case 2: 
-            steer_force = arrive_force_point(uid, flock->target_xz, has_dest_los); 
+            steer_force = arrive_force_point(slot, flock->target_xz, has_dest_los); 
             break;
         }
 
-        nullify_impass_components(uid, &steer_force);
+        nullify_impass_components(slot, &steer_force);
         if(PFM_Vec2_Len(&steer_force) > MAX_FORCE * 0.01)
             break;
     }
 
     vec2_t accel, new_vel; 
+    vec2_t velocity = soa_velocity(&s_move_work.soa, slot);
     PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &accel);
 
-    PFM_Vec2_Add(&ms->velocity, &accel, &new_vel);
+    PFM_Vec2_Add(&velocity, &accel, &new_vel);
     vec2_truncate(&new_vel, speed / MOVE_TICK_RES);
 
     return new_vel;
 }
 
-static vec2_t cell_arrival_seek_vpref(uint32_t uid, vec2_t cell_pos, float speed,
+static vec2_t cell_arrival_seek_vpref(uint32_t slot, vec2_t cell_pos, float speed,
                                       vec2_t cohesion, vec2_t alignment, vec2_t drag)
 {
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
-
     vec2_t steer_force;
     for(int prio = 0; prio < 3; prio++) {
 
         switch(prio) {
         case 0: 
-            steer_force = cell_seek_total_force(uid, cell_pos, cohesion, alignment); 
+            steer_force = cell_seek_total_force(slot, cell_pos, cohesion, alignment); 
             break;
         case 1: 
-            steer_force = separation_force(uid, SEPARATION_BUFFER_DIST); 
+            steer_force = separation_force(slot, SEPARATION_BUFFER_DIST); 
             break;
         case 2: 
-            steer_force = arrive_force_cell(uid, cell_pos); 
+            steer_force = arrive_force_cell(slot, cell_pos); 
             break;
         }
 
-        nullify_impass_components(uid, &steer_force);
+        nullify_impass_components(slot, &steer_force);
         if(PFM_Vec2_Len(&steer_force) > MAX_FORCE * 0.01)
             break;
     }
 
     vec2_t accel, new_vel; 
+    vec2_t velocity = soa_velocity(&s_move_work.soa, slot);
     PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &accel);
 
-    PFM_Vec2_Add(&ms->velocity, &accel, &new_vel);
+    PFM_Vec2_Add(&velocity, &accel, &new_vel);
     vec2_truncate(&new_vel, speed / MOVE_TICK_RES);
     if(PFM_Vec2_Len(&drag) > EPSILON) {
         vec2_truncate(&new_vel, (speed * 0.75) / MOVE_TICK_RES);
@@ -1602,30 +1780,25 @@ static vec2_t cell_arrival_seek_vpref(uint32_t uid, vec2_t cell_pos, float speed
     return new_vel;
 }
 
-static vec2_t enemy_seek_vpref(uint32_t uid, float speed)
+static vec2_t enemy_seek_vpref(uint32_t slot, float speed)
 {
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
-
-    vec2_t steer_force = enemy_seek_total_force(uid);
+    vec2_t steer_force = enemy_seek_total_force(slot);
 
     vec2_t accel, new_vel; 
+    vec2_t velocity = soa_velocity(&s_move_work.soa, slot);
     PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &accel);
 
-    PFM_Vec2_Add(&ms->velocity, &accel, &new_vel);
+    PFM_Vec2_Add(&velocity, &accel, &new_vel);
     vec2_truncate(&new_vel, speed / MOVE_TICK_RES);
 
     return new_vel;
 }
 
-static vec2_t formation_point_seek_total_force(uint32_t uid, const struct flock *flock,
+static vec2_t formation_point_seek_total_force(uint32_t slot, const struct flock *flock,
                                                vec2_t cohesion, vec2_t alignment, bool has_dest_los)
 {
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
-
-    vec2_t arrive = arrive_force_point(uid, flock->target_xz, has_dest_los);
-    vec2_t separation = separation_force(uid, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force_point(slot, flock->target_xz, has_dest_los);
+    vec2_t separation = separation_force(slot, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&cohesion,   MOVE_COHESION_FORCE_SCALE, &cohesion);
@@ -1641,38 +1814,36 @@ static vec2_t formation_point_seek_total_force(uint32_t uid, const struct flock
     return ret;
 }
 
-static vec2_t formation_seek_vpref(uint32_t uid, const struct flock *flock, float speed,
-                                   vec2_t cohesion, vec2_t alignment, vec2_t drag,
+static vec2_t formation_seek_vpref(uint32_t slot, const struct flock *flock, 
+                                   float speed, vec2_t cohesion, vec2_t alignment, vec2_t drag,
                                    bool has_dest_los)
 {
-    struct movestate *ms = movestate_get(uid);
-    assert(ms);
-
     vec2_t steer_force;
     for(int prio = 0; prio < 3; prio++) {
 
         switch(prio) {
         case 0: 
-            steer_force = formation_point_seek_total_force(uid, flock, 
+            steer_force = formation_point_seek_total_force(slot, flock, 
                 cohesion, alignment, has_dest_los); 
             break;
         case 1: 
-            steer_force = separation_force(uid, SEPARATION_BUFFER_DIST); 
+            steer_force = separation_force(slot, SEPARATION_BUFFER_DIST); 
             break;
         case 2: 
-            steer_force = arrive_force_point(uid, flock->target_xz, has_dest_los); 
+            steer_force = arrive_force_point(slot, flock->target_xz, has_dest_los); 
             break;
         }
 
-        nullify_impass_components(uid, &steer_force);
+        nullify_impass_components(slot, &steer_force);
         if(PFM_Vec2_Len(&steer_force) > MAX_FORCE * 0.01)
             break;
     }
 
     vec2_t accel, new_vel; 
+    vec2_t velocity = soa_velocity(&s_move_work.soa, slot);
     PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &accel);
 
-    PFM_Vec2_Add(&ms->velocity, &accel, &new_vel);
+    PFM_Vec2_Add(&velocity, &accel, &new_vel);
     vec2_truncate(&new_vel, speed / MOVE_TICK_RES);
     if(PFM_Vec2_Len(&drag) > EPSILON) {
         vec2_truncate(&new_vel, (speed * 0.75) / MOVE_TICK_RES);
@@ -1724,28 +1895,126 @@ static vec2_t vel_wma(const struct movestate *ms)
     return ret;
 }
 
-static bool uids_match(void *arg, struct move_cmd *cmd)
+static uint64_t cmd_index_key(uint32_t uid, enum move_cmd_index kind)
+{
+    return (((uint64_t)uid) << 3) | kind;
+}
+
+static void cmd_index_set(uint32_t uid, enum move_cmd_index kind, uint64_t seq)
+{
+    int ret;
+    khiter_t k = kh_put(cmdidx, s_cmd_index, cmd_index_key(uid, kind), &ret);
+    if(ret == -1) {
+        s_cmd_index_valid = false;
+        return;
+    }
+    kh_value(s_cmd_index, k) = seq;
+}
+
+/* Returns false if the index can't be used and the queue must be scanned 
+ * instead. Otherwise, 'out' is set to the most recent queued command of 
+ * the kind for the entity, or NULL if there is none. The command may have 
+ * since been deleted or had the entity removed from its' batch. 
+ */
+static bool cmd_index_get(uint32_t uid, enum move_cmd_index kind, struct move_cmd **out)
+{
+    if(!s_cmd_index_valid)
+        return false;
+
+    *out = NULL;
+    khiter_t k = kh_get(cmdidx, s_cmd_index, cmd_index_key(uid, kind));
+    if(k == kh_end(s_cmd_index))
+        return true;
+
+    uint64_t seq = kh_value(s_cmd_index, k);
+    if(seq < s_cmd_head_seq)
+        return true;
+
+    assert(seq - s_cmd_head_seq < queue_size(s_move_commands));
+    *out = &queue_at(s_move_commands, seq - s_cmd_head_seq);
+    return true;
+}
+
+static bool batch_contains(const struct move_cmd *cmd, uint32_t uid)
+{
+    assert(cmd->type == MOVE_CMD_SET_DEST_BATCH);
+    const vec_entity_t *ents = cmd->args[0].val.as_pointer;
+    for(int i = 0; i < vec_size(ents); i++) {
+        if(vec_AT(ents, i) == uid)
+            return true;
+    }
+    return false;
+}
+
+static void move_drain_inbox(void);
+
+static struct move_cmd *snoop_most_recent_dest(uint32_t uid)
+{
+    move_drain_inbox();
+
+    struct move_cmd *cmd;
+    if(cmd_index_get(uid, MOVE_INDEX_DEST, &cmd)) {
+        if(!cmd)
+            return NULL;
+        if(!cmd->deleted 
+        && (cmd->type == MOVE_CMD_SET_DEST || batch_contains(cmd, uid)))
+            return cmd;
+    }
+
+    size_t left = queue_size(s_move_commands);
+    for(int i = s_move_commands.itail; left > 0;) {
+        struct move_cmd *curr = &s_move_commands.mem[i];
+        if(!curr->deleted) {
+            if(curr->type == MOVE_CMD_SET_DEST && curr->args[0].val.as_int == uid)
+                return curr;
+            if(curr->type == MOVE_CMD_SET_DEST_BATCH && batch_contains(curr, uid))
+                return curr;
+        }
+        i--;
+        left--;
+        if(i < 0) {
+            i = s_move_commands.capacity - 1; /* Wrap around */
+        }
+    }
+    return NULL;
+}
+
+static enum move_cmd_index index_for_type(enum move_cmd_type type)
 {
-    uint32_t desired_uid = (uintptr_t)arg;
-    uint32_t actual_uid = cmd->args[0].val.as_int;
-    return (desired_uid == actual_uid);
+    switch(type) {
+    case MOVE_CMD_SET_SURROUND_ENTITY:  return MOVE_INDEX_SURROUND;
+    case MOVE_CMD_UPDATE_POS:           return MOVE_INDEX_UPDATE_POS;
+    case MOVE_CMD_SET_MAX_SPEED:        return MOVE_INDEX_MAX_SPEED;
+    default: assert(0);
+    }
+    return 0;
 }
 
-static struct move_cmd *snoop_most_recent_command(enum move_cmd_type type, void *arg,
-                                                  bool (*pred)(void*, struct move_cmd*),
+static struct move_cmd *snoop_most_recent_command(enum move_cmd_type type, uint32_t uid, 
                                                   bool remove)
 {
+    move_drain_inbox();
+
     if(queue_size(s_move_commands) == 0)
         return NULL;
 
+    struct move_cmd *cmd;
+    if(cmd_index_get(uid, index_for_type(type), &cmd)) {
+        if(!cmd)
+            return NULL;
+        if(!cmd->deleted) {
+            assert(cmd->type == type && cmd->args[0].val.as_int == uid);
+            cmd->deleted = remove;
+            return cmd;
+        }
+    }
+
     size_t left = queue_size(s_move_commands);
     for(int i = s_move_commands.itail; left > 0;) {
         struct move_cmd *curr = &s_move_commands.mem[i];
-        if(!curr->deleted && curr->type == type) {
-            if(pred(arg, curr)) {
-                curr->deleted = true;
-                return curr;
-            }
+        if(!curr->deleted && curr->type == type && curr->args[0].val.as_int == uid) {
+            curr->deleted = remove;
+            return curr;
         }
         i--;
         left--;
@@ -1758,7 +2027,21 @@ static struct move_cmd *snoop_most_recent_command(enum move_cmd_type type, void
 
 static bool snoop_still(uint32_t uid)
 {
-    if(queue_size(s_move_commands) == 0) {
+    move_drain_inbox();
+
+    struct move_cmd *cmd = NULL;
+    if(queue_size(s_move_commands) > 0
+    && cmd_index_get(uid, MOVE_INDEX_STILL, &cmd) && cmd) {
+
+        if(cmd->type == MOVE_CMD_STOP)
+            return true;
+        if(cmd->type != MOVE_CMD_SET_DEST_BATCH)
+            return false;
+        if(!cmd->deleted && batch_contains(cmd, uid))
+            return false;
+    }
+
+    if(queue_size(s_move_commands) == 0 || (s_cmd_index_valid && !cmd)) {
         struct movestate *ms = movestate_get(uid);
         assert(ms);
         return (ms->state == STATE_ARRIVED);
@@ -1777,6 +2060,11 @@ static bool snoop_still(uint32_t uid)
                 return false;
             break;
         }
+        case MOVE_CMD_SET_DEST_BATCH: {
+            if(!curr->deleted && batch_contains(curr, uid))
+                return false;
+            break;
+        }
         case MOVE_CMD_STOP:
             if(curr->args[0].val.as_int == uid)
                 return true;
@@ -1799,8 +2087,7 @@ static bool snoop_still(uint32_t uid)
 static void flush_update_pos_commands(uint32_t uid)
 {
     struct move_cmd *cmd;
-    while((cmd = snoop_most_recent_command(MOVE_CMD_UPDATE_POS, 
-        (void*)(uintptr_t)uid, uids_match, true))) {
+    while((cmd = snoop_most_recent_command(MOVE_CMD_UPDATE_POS, uid, true))) {
 
         uint32_t uid = cmd->args[0].val.as_int;
         vec2_t pos = cmd->args[1].val.as_vec2;
@@ -1871,6 +2158,10 @@ static void entity_update(uint32_t uid, vec2_t new_vel)
     && M_NavPositionPathable(s_map, layer, new_pos_xz)) {
     
         vec3_t new_pos = (vec3_t){new_pos_xz.x, unit_height(uid, new_pos_xz), new_pos_xz.z};
+        ms->interp_prev_pos = G_Pos_GetFrom(s_move_work.gamestate.positions, uid);
+        ms->interp_prev_rot = Entity_GetRot(uid);
+        ms->interp_tick = s_interp_tick;
+
         G_Pos_Set(uid, new_pos);
         flush_update_pos_commands(uid);
         ms->velocity = new_vel;
@@ -1884,6 +2175,7 @@ static void entity_update(uint32_t uid, vec2_t new_vel)
         if(PFM_Vec2_Len(&wma) > EPSILON) {
             Entity_SetRot(uid, dir_quat_from_velocity(wma));
         }
+        ms->interp_next_pos = new_pos;
     }else{
         ms->velocity = (vec2_t){0.0f, 0.0f}; 
     }
@@ -2117,9 +2409,8 @@ static void entity_update(uint32_t uid, vec2_t new_vel)
     }
 }
 
-static void find_neighbours(uint32_t uid,
-                            vec_cp_ent_t *out_dyn,
-                            vec_cp_ent_t *out_stat)
+static bool find_neighbours(uint32_t slot, struct memstack *scratch,
+                            struct cp_agent *inout)
 {
     /* For the ClearPath algorithm, we only consider entities with
      * ENTITY_FLAG_MOVABLE set, as they are the only ones that may need
@@ -2128,45 +2419,52 @@ static void find_neighbours(uint32_t uid,
      * meaning they will not perform collision avoidance maneuvers of
      * their own. */
 
-    uint32_t ent_flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
+    const struct move_soa *soa = &s_move_work.soa;
+    uint32_t ent_flags = soa->flags[slot];
     uint32_t near_ents[512];
-    int num_near = G_Pos_EntsInCircleFrom(s_move_work.gamestate.postree, 
+    int num_near = G_Pos_EntsInCircleFrom(s_move_work.gamestate.positions, 
         s_move_work.gamestate.flags,
-        G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid), 
+        (vec2_t){soa->pos_x[slot], soa->pos_z[slot]}, 
         CLEARPATH_NEIGHBOUR_RADIUS, near_ents, ARR_SIZE(near_ents));
 
-    for(int i = 0; i < num_near; i++) {
+    struct cp_ent *dyn = stalloc(scratch, MAX(num_near, 1) * sizeof(struct cp_ent));
+    struct cp_ent *stat = stalloc(scratch, MAX(num_near, 1) * sizeof(struct cp_ent));
+    if(!dyn || !stat)
+        return false;
 
-        uint32_t curr = near_ents[i];
-        uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, curr);
+    inout->dyn_neighbs = dyn;
+    inout->stat_neighbs = stat;
+    inout->ndyn = 0;
+    inout->nstat = 0;
 
-        if(curr == uid)
+    for(int i = 0; i < num_near; i++) {
+
+        int curr = soa_slot(soa, near_ents[i]);
+        if(curr < 0 || curr == slot)
             continue;
 
+        uint32_t flags = soa->flags[curr];
         if(!(flags & ENTITY_FLAG_MOVABLE))
             continue;
 
-        if(G_GetSelectionRadiusFrom(s_move_work.gamestate.sel_radiuses, curr) == 0.0f)
+        if(soa->radius[curr] == 0.0f)
             continue;
 
         if((ent_flags & ENTITY_FLAG_AIR) != (flags & ENTITY_FLAG_AIR))
             continue;
 
-        struct movestate *ms = movestate_get(curr);
-        assert(ms);
-
-        vec2_t curr_xz_pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, curr);
         struct cp_ent newdesc = (struct cp_ent) {
-            .xz_pos = curr_xz_pos,
-            .xz_vel = ms->velocity,
-            .radius = G_GetSelectionRadiusFrom(s_move_work.gamestate.sel_radiuses, curr)
+            .xz_pos = (vec2_t){soa->pos_x[curr], soa->pos_z[curr]},
+            .xz_vel = soa_velocity(soa, curr),
+            .radius = soa->radius[curr]
         };
 
-        if(ent_still(ms))
-            vec_cp_ent_push(out_stat, newdesc);
+        if(state_still(soa->state[curr]))
+            stat[inout->nstat++] = newdesc;
         else
-            vec_cp_ent_push(out_dyn, newdesc);
+            dyn[inout->ndyn++] = newdesc;
     }
+    return true;
 }
 
 static void disband_empty_flocks(void)
@@ -2199,6 +2497,7 @@ static void disband_empty_flocks(void)
                 G_Formation_RemoveUnit(uid);
             });
             kh_destroy(entity, flock->ents);
+            N_FlockFieldsFree(flock->fields);
             vec_flock_del(&s_flocks, i);
         }
     }
@@ -2209,14 +2508,12 @@ static void do_add_entity(uint32_t uid, vec3_t pos, float selection_radius, int
 {
     ASSERT_IN_MAIN_THREAD();
 
-    int ret;
-    khiter_t k = kh_put(pos, s_move_work.gamestate.positions, uid, &ret);
-    assert(ret != -1);
-    kh_val(s_move_work.gamestate.positions, k) = pos;
-
-    qt_ent_insert(s_move_work.gamestate.postree, pos.x, pos.z, uid);
+    bool status = G_Pos_SnapshotSet(s_move_work.gamestate.positions, uid, pos);
+    assert(status);
+    (void)status;
 
-    k = kh_put(range, s_move_work.gamestate.sel_radiuses, uid, &ret);
+    int ret;
+    khiter_t k = kh_put(range, s_move_work.gamestate.sel_radiuses, uid, &ret);
     assert(ret != -1);
     kh_value(s_move_work.gamestate.sel_radiuses, k) = selection_radius;
 
@@ -2237,6 +2534,9 @@ static void do_add_entity(uint32_t uid, vec3_t pos, float selection_radius, int
         .max_speed = 0.0f,
         .surround_target_prev = (vec2_t){0},
         .surround_nearest_prev = (vec2_t){0},
+        .lod_period = LOD_PERIOD_NEAR,
+        .lod_crowded = false,
+        .lod_skip = false,
     };
     memset(new_ms.vel_hist, 0, sizeof(new_ms.vel_hist));
 
@@ -2335,9 +2635,9 @@ static void do_set_dest(uint32_t uid, vec2_t dest_xz, bool attack)
 
     /* Else, create a new flock and request a path for it.
      */
-    vec_entity_t flock;
-    vec_entity_init(&flock);
-    vec_entity_push(&flock, uid);
+    vec_entity_sbo_t flock;
+    vec_sbo_init(entity, &flock);
+    vec_entity_push(&flock.vec, uid);
 
     enum formation_type type = FORMATION_NONE;
     formation_id_t fid = G_Formation_GetForEnt(uid);
@@ -2345,8 +2645,8 @@ static void do_set_dest(uint32_t uid, vec2_t dest_xz, bool attack)
         type = G_Formation_Type(fid);
     }
 
-    make_flock(&flock, dest_xz, layer, attack, type);
-    vec_entity_destroy(&flock);
+    make_flock(&flock.vec, dest_xz, layer, attack, type);
+    vec_entity_destroy(&flock.vec);
 }
 
 static void do_set_change_direction(uint32_t uid, quat_t target)
@@ -2452,20 +2752,15 @@ static void do_update_pos(uint32_t uid, vec2_t pos)
         pos.z
     };
 
-    khiter_t k = kh_get(pos, s_move_work.gamestate.positions, uid);
-    assert(k != kh_end(s_move_work.gamestate.positions));
-    vec3_t oldpos = kh_val(s_move_work.gamestate.positions, k);
-    qt_ent_delete(s_move_work.gamestate.postree, oldpos.x, oldpos.z, uid);
-    qt_ent_insert(s_move_work.gamestate.postree, newpos.x, newpos.z, uid);
-    kh_val(s_move_work.gamestate.positions, k) = newpos;
+    G_Pos_SnapshotSet(s_move_work.gamestate.positions, uid, newpos);
 
     if(!ms->blocking)
         return;
 
     int faction_id = G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, uid);
     uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
-    M_NavBlockersDecref(ms->last_stop_pos, ms->last_stop_radius, faction_id, flags, s_map);
-    M_NavBlockersIncref(pos, ms->last_stop_radius, faction_id, flags, s_map);
+    push_blocker_op(ms->last_stop_pos, ms->last_stop_radius, faction_id, flags, -1);
+    push_blocker_op(pos, ms->last_stop_radius, faction_id, flags, +1);
     ms->last_stop_pos = pos;
 }
 
@@ -2485,8 +2780,8 @@ static void do_update_faction_id(uint32_t uid, int oldfac, int newfac)
         return;
 
     uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
-    M_NavBlockersDecref(ms->last_stop_pos, ms->last_stop_radius, oldfac, flags, s_map);
-    M_NavBlockersIncref(ms->last_stop_pos, ms->last_stop_radius, newfac, flags, s_map);
+    push_blocker_op(ms->last_stop_pos, ms->last_stop_radius, oldfac, flags, -1);
+    push_blocker_op(ms->last_stop_pos, ms->last_stop_radius, newfac, flags, +1);
 }
 
 static void do_update_selection_radius(uint32_t uid, float sel_radius)
@@ -2506,8 +2801,8 @@ static void do_update_selection_radius(uint32_t uid, float sel_radius)
 
     int faction_id = G_GetFactionIDFrom(s_move_work.gamestate.faction_ids, uid);
     uint32_t flags = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
-    M_NavBlockersDecref(ms->last_stop_pos, ms->last_stop_radius, faction_id, flags, s_map);
-    M_NavBlockersIncref(ms->last_stop_pos, sel_radius, faction_id, flags, s_map);
+    push_blocker_op(ms->last_stop_pos, ms->last_stop_radius, faction_id, flags, -1);
+    push_blocker_op(ms->last_stop_pos, sel_radius, faction_id, flags, +1);
     ms->last_stop_radius = sel_radius;
 }
 
@@ -2522,32 +2817,179 @@ static void do_set_max_speed(uint32_t uid, float speed)
 
 static void do_block(uint32_t uid, vec3_t newpos)
 {
-    khiter_t k = kh_get(pos, s_move_work.gamestate.positions, uid);
-    assert(k != kh_end(s_move_work.gamestate.positions));
-    vec3_t oldpos = kh_val(s_move_work.gamestate.positions, k);
-    qt_ent_delete(s_move_work.gamestate.postree, oldpos.x, oldpos.z, uid);
-    qt_ent_insert(s_move_work.gamestate.postree, newpos.x, newpos.z, uid);
-    kh_val(s_move_work.gamestate.positions, k) = newpos;
+    G_Pos_SnapshotSet(s_move_work.gamestate.positions, uid, newpos);
 
     entity_block(uid);
 }
 
-static void move_push_cmd(struct move_cmd cmd)
-{
-    queue_cmd_push(&s_move_commands, &cmd);
-}
-
-static void move_process_cmds(void)
+static void move_enqueue_cmd(struct move_cmd *cmd)
 {
-    struct move_cmd cmd;
-    while(queue_cmd_pop(&s_move_commands, &cmd)) {
+    if(cmd->type == MOVE_CMD_SET_DEST || cmd->type == MOVE_CMD_SET_DEST_BATCH) {
+        s_pending_orders++;
+    }
+    if(!queue_cmd_push(&s_move_commands, cmd))
+        return;
 
-        if(cmd.deleted)
-            continue;
+    uint64_t seq = s_cmd_next_seq++;
+    uint32_t uid = cmd->args[0].val.as_int;
 
-        switch(cmd.type) {
-        case MOVE_CMD_ADD: {
-            uint32_t uid = cmd.args[0].val.as_int;
+    switch(cmd->type) {
+    case MOVE_CMD_SET_DEST:
+        cmd_index_set(uid, MOVE_INDEX_DEST, seq);
+        cmd_index_set(uid, MOVE_INDEX_STILL, seq);
+        break;
+    case MOVE_CMD_SET_DEST_BATCH: {
+        const vec_entity_t *ents = cmd->args[0].val.as_pointer;
+        for(int i = 0; i < vec_size(ents); i++) {
+            cmd_index_set(vec_AT(ents, i), MOVE_INDEX_DEST, seq);
+            cmd_index_set(vec_AT(ents, i), MOVE_INDEX_STILL, seq);
+        }
+        break;
+    }
+    case MOVE_CMD_SET_SURROUND_ENTITY:
+        cmd_index_set(uid, MOVE_INDEX_SURROUND, seq);
+        /* fallthrough */
+    case MOVE_CMD_STOP:
+    case MOVE_CMD_CHANGE_DIRECTION:
+    case MOVE_CMD_SET_ENTER_RANGE:
+    case MOVE_CMD_SET_SEEK_ENEMIES:
+        cmd_index_set(uid, MOVE_INDEX_STILL, seq);
+        break;
+    case MOVE_CMD_UPDATE_POS:
+        cmd_index_set(uid, MOVE_INDEX_UPDATE_POS, seq);
+        break;
+    case MOVE_CMD_SET_MAX_SPEED:
+        cmd_index_set(uid, MOVE_INDEX_MAX_SPEED, seq);
+        break;
+    default:
+        break;
+    }
+}
+
+static bool move_pop_cmd(struct move_cmd *out)
+{
+    if(!queue_cmd_pop(&s_move_commands, out))
+        return false;
+
+    s_cmd_head_seq++;
+    if(queue_size(s_move_commands) == 0) {
+        kh_clear(cmdidx, s_cmd_index);
+        s_cmd_index_valid = true;
+    }
+    return true;
+}
+
+static void move_drain_inbox(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    struct move_cmd cmd;
+    while(mpsc_cmd_pop(&s_move_inbox, &cmd)) {
+        move_enqueue_cmd(&cmd);
+    }
+}
+
+/* Commands may be pushed from any thread. The ones pushed by the main 
+ * thread are ordered after those from other threads which have already 
+ * been received. */
+static void move_push_cmd(struct move_cmd cmd)
+{
+    if(SDL_ThreadID() != g_main_thread_id) {
+        mpsc_cmd_push(&s_move_inbox, &cmd);
+        return;
+    }
+    move_drain_inbox();
+    move_enqueue_cmd(&cmd);
+}
+
+static bool order_uid_seen(uint32_t uid)
+{
+    int ret;
+    kh_put(entity, s_order_uids, uid, &ret);
+    return (ret == 0);
+}
+
+/* Scripts may issue an order to an entity many times before the queue 
+ * is processed. Walk the queue from the newest command to the oldest 
+ * and drop the destination orders which will be overridden by a later 
+ * order, a stop or a removal of the same entity before they are used.
+ */
+static void move_dedup_orders(void)
+{
+    kh_clear(entity, s_order_uids);
+
+    size_t left = queue_size(s_move_commands);
+    for(int i = s_move_commands.itail; left > 0;) {
+
+        struct move_cmd *curr = &s_move_commands.mem[i];
+        if(curr->deleted)
+            goto next;
+
+        switch(curr->type) {
+        case MOVE_CMD_SET_DEST: {
+            if(order_uid_seen(curr->args[0].val.as_int))
+                curr->deleted = true;
+            break;
+        }
+        case MOVE_CMD_STOP:
+        case MOVE_CMD_REMOVE: {
+            order_uid_seen(curr->args[0].val.as_int);
+            break;
+        }
+        case MOVE_CMD_SET_DEST_BATCH: {
+            vec_entity_t *ents = curr->args[0].val.as_pointer;
+            size_t nleft = 0;
+            for(int j = 0; j < vec_size(ents); j++) {
+                uint32_t uid = vec_AT(ents, j);
+                if(order_uid_seen(uid))
+                    continue;
+                vec_AT(ents, nleft++) = uid;
+            }
+            ents->size = nleft;
+            break;
+        }
+        case MOVE_CMD_MAKE_FLOCKS: {
+            vec_entity_t *ents = curr->args[0].val.as_pointer;
+            for(int j = 0; j < vec_size(ents); j++) {
+                order_uid_seen(vec_AT(ents, j));
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    next:
+        i--;
+        left--;
+        if(i < 0) {
+            i = s_move_commands.capacity - 1; /* Wrap around */
+        }
+    }
+}
+
+static void move_process_cmds(void)
+{
+    move_drain_inbox();
+
+    if(s_pending_orders > 1) {
+        move_dedup_orders();
+    }
+    s_pending_orders = 0;
+
+    struct move_cmd cmd;
+    while(move_pop_cmd(&cmd)) {
+
+        if(cmd.deleted) {
+            if(cmd.type == MOVE_CMD_SET_DEST_BATCH) {
+                vec_entity_destroy(cmd.args[0].val.as_pointer);
+                PF_FREE(cmd.args[0].val.as_pointer);
+            }
+            continue;
+        }
+
+        switch(cmd.type) {
+        case MOVE_CMD_ADD: {
+            uint32_t uid = cmd.args[0].val.as_int;
             vec3_t pos = cmd.args[1].val.as_vec3;
             float radius = cmd.args[2].val.as_float;
             int faction_id = cmd.args[3].val.as_int;
@@ -2571,6 +3013,17 @@ static void move_process_cmds(void)
             do_set_dest(uid, dest_xz, attack);
             break;
         }
+        case MOVE_CMD_SET_DEST_BATCH: {
+            vec_entity_t *ents = (vec_entity_t*)cmd.args[0].val.as_pointer;
+            vec2_t dest_xz = cmd.args[1].val.as_vec2;
+            bool attack = cmd.args[2].val.as_bool;
+            for(int i = 0; i < vec_size(ents); i++) {
+                do_set_dest(vec_AT(ents, i), dest_xz, attack);
+            }
+            vec_entity_destroy(ents);
+            PF_FREE(ents);
+            break;
+        }
         case MOVE_CMD_CHANGE_DIRECTION: {
             uint32_t uid = cmd.args[0].val.as_int;
             quat_t target = cmd.args[1].val.as_quat;
@@ -2654,47 +3107,78 @@ static void move_process_cmds(void)
             assert(0);
         }
     }
+    flush_blocker_ops();
 }
 
-static void *cp_vec_realloc(void *ptr, size_t size)
+static struct move_scratch *move_scratch_acquire(void)
 {
-    if(!ptr)
-        return stalloc(&s_move_work.mem, size);
+    while(true) {
+        for(int i = 0; i < ARR_SIZE(s_move_scratch); i++) {
 
-    void *ret = stalloc(&s_move_work.mem, size);
-    if(!ret)
-        return NULL;
+            struct move_scratch *curr = &s_move_scratch[i];
+            if(!SDL_AtomicCAS(&curr->in_use, 0, 1))
+                continue;
 
-    assert(size % 2 == 0);
-    memcpy(ret, ptr, size / 2);
-    return ret;
+            if(!curr->init) {
+                if(!stalloc_init(&curr->mem)) {
+                    SDL_AtomicSet(&curr->in_use, 0);
+                    return NULL;
+                }
+                curr->init = true;
+            }
+            return curr;
+        }
+    }
 }
 
-static void cp_vec_free(void *ptr)
+static void move_scratch_release(struct move_scratch *scratch)
 {
-    /* no-op */
+    stalloc_clear(&scratch->mem);
+    SDL_AtomicSet(&scratch->in_use, 0);
 }
 
 static void move_work(int begin_idx, int end_idx)
 {
+    const size_t nagents = end_idx - begin_idx + 1;
+    struct move_scratch *scratch = move_scratch_acquire();
+    struct cp_agent *agents = NULL;
+    vec2_t *vels = NULL;
+
+    if(scratch) {
+        agents = stalloc(&scratch->mem, nagents * sizeof(struct cp_agent));
+        vels = stalloc(&scratch->mem, nagents * sizeof(vec2_t));
+    }
+
+    if(!agents || !vels) {
+        for(int i = begin_idx; i <= end_idx; i++) {
+            s_move_work.out[i] = (struct move_work_out){
+                .ent_uid = s_move_work.in[i].ent_uid,
+                .ent_vel = (vec2_t){0.0f, 0.0f},
+                .ndyn_neighbs = 0
+            };
+        }
+        goto out;
+    }
+
     for(int i = begin_idx; i <= end_idx; i++) {
     
         struct move_work_in *in = &s_move_work.in[i];
-        struct move_work_out *out = &s_move_work.out[i];
+        struct cp_agent *agent = &agents[i - begin_idx];
 
-        const struct movestate *ms = movestate_get(in->ent_uid);
-        const struct flock *flock = flock_for_ent(in->ent_uid);
+        const struct move_soa *soa = &s_move_work.soa;
+        const uint32_t slot = in->slot;
+        const int flock_idx = soa->flock[slot];
+        const struct flock *flock = (flock_idx >= 0) ? &vec_AT(&s_flocks, flock_idx) : NULL;
 
         /* Compute the preferred velocity */
         vec2_t vpref = (vec2_t){NAN, NAN};
-        enum arrival_state old_state = ms->state;
-        switch(ms->state) {
+        switch(soa->state[slot]) {
         case STATE_TURNING:
             vpref = (vec2_t){0.0f, 0.0f};
             break;
         case STATE_SEEK_ENEMIES: 
             assert(!flock);
-            vpref = enemy_seek_vpref(in->ent_uid, in->speed);
+            vpref = enemy_seek_vpref(slot, in->speed);
             break;
         case STATE_ARRIVING_TO_CELL:
             assert(flock);
@@ -2702,7 +3186,7 @@ static void move_work(int begin_idx, int end_idx)
                 vpref = (vec2_t){0.0f, 0.0f};
                 break;
             }
-            vpref = cell_arrival_seek_vpref(in->ent_uid, in->cell_pos, in->speed,
+            vpref = cell_arrival_seek_vpref(slot, in->cell_pos, in->speed,
                 in->normal_form_cohesion_force,
                 in->normal_form_align_force,
                 in->normal_form_drag_force);
@@ -2713,7 +3197,7 @@ static void move_work(int begin_idx, int end_idx)
                 vpref = (vec2_t){0.0f, 0.0f};
                 break;
             }
-            vpref = formation_seek_vpref(in->ent_uid, flock, in->speed, 
+            vpref = formation_seek_vpref(slot, flock, in->speed, 
                 in->normal_form_cohesion_force,
                 in->normal_form_align_force,
                 in->normal_form_drag_force,
@@ -2721,53 +3205,56 @@ static void move_work(int begin_idx, int end_idx)
             break;
         default:
             assert(flock);
-            vpref = point_seek_vpref(in->ent_uid, flock, in->has_dest_los, in->speed);
+            vpref = point_seek_vpref(slot, flock, in->has_dest_los, in->speed);
         }
         assert(vpref.x != NAN && vpref.z != NAN);
 
+        *agent = (struct cp_agent){
+            .ent = in->cp_ent,
+            .uid = in->ent_uid,
+            .des_v = vpref,
+            .save_debug = in->save_debug
+        };
+
         /* Find the entity's neighbours */
-        find_neighbours(in->ent_uid, in->dyn_neighbs, in->stat_neighbs);
+        if(!find_neighbours(slot, &scratch->mem, agent)) {
+            agent->dyn_neighbs = agent->stat_neighbs = NULL;
+            agent->ndyn = agent->nstat = 0;
+        }
+    }
 
-        /* Compute the velocity constrainted by potential collisions */
-        vec2_t new_vel = G_ClearPath_NewVelocity(in->cp_ent, in->ent_uid, 
-            vpref, *in->dyn_neighbs, *in->stat_neighbs, in->save_debug);
+    /* Compute the velocities constrainted by potential collisions */
+    G_ClearPath_NewVelocities(&scratch->mem, nagents, agents, vels);
 
-        out->ent_uid = in->ent_uid;
-        out->ent_vel = new_vel;
+    for(int i = begin_idx; i <= end_idx; i++) {
+        s_move_work.out[i] = (struct move_work_out){
+            .ent_uid = s_move_work.in[i].ent_uid,
+            .ent_vel = vels[i - begin_idx],
+            .ndyn_neighbs = agents[i - begin_idx].ndyn
+        };
+    }
+
+out:
+    if(scratch) {
+        move_scratch_release(scratch);
     }
 }
 
-static struct result move_task(void *arg)
+static void move_task(size_t begin, size_t end, void *arg)
 {
-    struct move_task_arg *move_arg = arg;
-    size_t ncomputed = 0;
-
-    for(int i = move_arg->begin_idx; i <= move_arg->end_idx; i++) {
-
-        move_work(i, i);
-        ncomputed++;
-
-        if(ncomputed % 64 == 0)
-            Task_Yield();
-    }
-    return NULL_RESULT;
+    move_work(begin, end - 1);
 }
 
 static void move_complete_work(void)
 {
-    for(int i = 0; i < s_move_work.ntasks; i++) {
-        while(!Sched_FutureIsReady(&s_move_work.futures[i])) {
-            Sched_RunSync(s_move_work.tids[i]);
-        }
-    }
+    Sched_ParallelForJoin(&s_move_work.pfor);
 }
 
 static void move_copy_gamestate(void)
 {
     PERF_ENTER();
     s_move_work.gamestate.flags = G_FlagsCopyTable();
-    s_move_work.gamestate.positions = G_Pos_CopyTable();
-    s_move_work.gamestate.postree = G_Pos_CopyQuadTree();
+    s_move_work.gamestate.positions = G_Pos_AcquireSnapshot();
     s_move_work.gamestate.sel_radiuses = G_SelectionRadiusCopyTable();
     s_move_work.gamestate.faction_ids = G_FactionIDCopyTable();
     s_move_work.gamestate.map = M_AL_CopyWithFields(s_map);
@@ -2777,18 +3264,17 @@ static void move_copy_gamestate(void)
 static void move_release_gamestate(void)
 {
     PERF_ENTER();
+    /* Deferred field jobs read the navigation data of the snapshot */
+    N_AwaitAsyncFields();
+
     if(s_move_work.gamestate.flags) {
         kh_destroy(id, s_move_work.gamestate.flags);
         s_move_work.gamestate.flags = NULL;
     }
     if(s_move_work.gamestate.positions) {
-        kh_destroy(pos, s_move_work.gamestate.positions);
+        G_Pos_ReleaseSnapshot(s_move_work.gamestate.positions);
         s_move_work.gamestate.positions = NULL;
     }
-    if(s_move_work.gamestate.postree) {
-        G_Pos_DestroyQuadTree(s_move_work.gamestate.postree);
-        s_move_work.gamestate.postree = NULL;
-    }
     if(s_move_work.gamestate.sel_radiuses) {
         kh_destroy(range, s_move_work.gamestate.sel_radiuses);
         s_move_work.gamestate.sel_radiuses = NULL;
@@ -2810,6 +3296,57 @@ static void move_update_gamestate(void)
     move_copy_gamestate();
 }
 
+static bool move_interp_enabled(void)
+{
+    return Settings_ReadBool(s_sett.movement_interpolation);
+}
+
+static bool move_init_setting_handles(void)
+{
+    struct{
+        sett_handle_t *out;
+        const char    *name;
+    }handles[] = {
+        {&s_sett.movement_interpolation,           "pf.game.movement_interpolation"},
+        {&s_sett.movement_lod,                     "pf.game.movement_lod"},
+        {&s_sett.deferred_nav_fields,              "pf.game.deferred_nav_fields"},
+        {&s_sett.navigation_layer,                 "pf.debug.navigation_layer"},
+        {&s_sett.show_last_cmd_flow_field,         "pf.debug.show_last_cmd_flow_field"},
+        {&s_sett.show_first_sel_movestate,         "pf.debug.show_first_sel_movestate"},
+        {&s_sett.show_enemy_seek_fields,           "pf.debug.show_enemy_seek_fields"},
+        {&s_sett.enemy_seek_fields_faction_id,     "pf.debug.enemy_seek_fields_faction_id"},
+        {&s_sett.show_navigation_blockers,         "pf.debug.show_navigation_blockers"},
+        {&s_sett.show_navigation_portals,          "pf.debug.show_navigation_portals"},
+        {&s_sett.show_navigation_cost_base,        "pf.debug.show_navigation_cost_base"},
+        {&s_sett.show_chunk_boundaries,            "pf.debug.show_chunk_boundaries"},
+        {&s_sett.show_navigation_island_ids,       "pf.debug.show_navigation_island_ids"},
+        {&s_sett.show_navigation_local_island_ids, "pf.debug.show_navigation_local_island_ids"},
+    };
+
+    for(int i = 0; i < ARR_SIZE(handles); i++) {
+        *handles[i].out = Settings_GetHandle(handles[i].name);
+        if(*handles[i].out == SETT_HANDLE_INVALID)
+            return false;
+    }
+    return true;
+}
+
+static quat_t quat_nlerp(quat_t a, quat_t b, float t)
+{
+    /* Take the shorter arc */
+    float dot = a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
+    float sign = (dot < 0.0f) ? -1.0f : 1.0f;
+
+    quat_t ret = (quat_t){
+        a.x + (sign * b.x - a.x) * t,
+        a.y + (sign * b.y - a.y) * t,
+        a.z + (sign * b.z - a.z) * t,
+        a.w + (sign * b.w - a.w) * t,
+    };
+    PFM_Quat_Normal(&ret, &ret);
+    return ret;
+}
+
 static void move_finish_work(void)
 {
     PERF_ENTER();
@@ -2826,6 +3363,7 @@ static void move_finish_work(void)
         struct movestate *ms = movestate_get(out->ent_uid);
         assert(ms);
 
+        ms->lod_crowded = (out->ndyn_neighbs > 0);
         ms->vnew = out->ent_vel;
         update_vel_hist(ms, ms->vnew);
 
@@ -2840,6 +3378,10 @@ static void move_finish_work(void)
     uint32_t key;
     struct movestate curr;
 
+    s_interp_tick++;
+    s_interp_tick_time = SDL_GetPerformanceCounter();
+    s_interp_enabled = move_interp_enabled();
+
     PERF_PUSH("position updates");
     kh_foreach(s_entity_state_table, key, curr, {
         /* The entity has been removed already */
@@ -2853,7 +3395,6 @@ static void move_finish_work(void)
     s_move_work.in = NULL;
     s_move_work.out = NULL;
     s_move_work.nwork = 0;
-    s_move_work.ntasks = 0;
 
     PERF_RETURN_VOID();
 }
@@ -2865,39 +3406,192 @@ static void move_prepare_work(void)
     s_move_work.out = stalloc(&s_move_work.mem, ndynamic * sizeof(struct move_work_out));
 }
 
+static void soa_push(struct move_soa *soa, uint32_t uid, int flock_idx)
+{
+    if(!G_EntityExists(uid))
+        return;
+
+    int ret;
+    khiter_t k = kh_put(id, soa->slot_table, uid, &ret);
+    if(ret <= 0)
+        return;
+
+    const struct movestate *ms = movestate_get(uid);
+    assert(ms);
+
+    uint32_t slot = soa->nslots++;
+    vec2_t pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
+    kh_val(soa->slot_table, k) = slot;
+
+    soa->uid[slot] = uid;
+    soa->state[slot] = ms->state;
+    soa->pos_x[slot] = pos.x;
+    soa->pos_z[slot] = pos.z;
+    soa->vel_x[slot] = ms->velocity.x;
+    soa->vel_z[slot] = ms->velocity.z;
+    soa->vdes_x[slot] = ms->vdes.x;
+    soa->vdes_z[slot] = ms->vdes.z;
+    soa->max_speed[slot] = ms->max_speed;
+    soa->radius[slot] = G_GetSelectionRadiusFrom(s_move_work.gamestate.sel_radiuses, uid);
+    soa->flags[slot] = G_FlagsGetFrom(s_move_work.gamestate.flags, uid);
+    soa->flock[slot] = flock_idx;
+}
+
+static void move_build_soa(void)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    struct move_soa *soa = &s_move_work.soa;
+    const size_t nents = kh_size(s_entity_state_table);
+    const size_t nflocks = vec_size(&s_flocks);
+
+    soa->nslots = 0;
+    soa->uid = stalloc(&s_move_work.mem, nents * sizeof(uint32_t));
+    soa->state = stalloc(&s_move_work.mem, nents * sizeof(enum arrival_state));
+    soa->pos_x = stalloc(&s_move_work.mem, nents * sizeof(float));
+    soa->pos_z = stalloc(&s_move_work.mem, nents * sizeof(float));
+    soa->vel_x = stalloc(&s_move_work.mem, nents * sizeof(float));
+    soa->vel_z = stalloc(&s_move_work.mem, nents * sizeof(float));
+    soa->vdes_x = stalloc(&s_move_work.mem, nents * sizeof(float));
+    soa->vdes_z = stalloc(&s_move_work.mem, nents * sizeof(float));
+    soa->max_speed = stalloc(&s_move_work.mem, nents * sizeof(float));
+    soa->radius = stalloc(&s_move_work.mem, nents * sizeof(float));
+    soa->flags = stalloc(&s_move_work.mem, nents * sizeof(uint32_t));
+    soa->flock = stalloc(&s_move_work.mem, nents * sizeof(int));
+    soa->flock_slots = stalloc(&s_move_work.mem, nflocks * sizeof(struct slot_range));
+
+    kh_clear(id, soa->slot_table);
+    kh_resize(id, soa->slot_table, nents);
+
+    /* Lay out the members of each flock contiguously */
+    for(int i = 0; i < nflocks; i++) {
+
+        uint32_t curr;
+        soa->flock_slots[i].begin = soa->nslots;
+        kh_foreach_key(vec_AT(&s_flocks, i).ents, curr, {
+            soa_push(soa, curr, i);
+        });
+        soa->flock_slots[i].end = soa->nslots;
+    }
+
+    uint32_t key;
+    kh_foreach_key(s_entity_state_table, key, {
+        soa_push(soa, key, -1);
+    });
+
+    assert(soa->nslots <= nents);
+    PERF_RETURN_VOID();
+}
+
 static void move_push_work(struct move_work_in in)
 {
     s_move_work.in[s_move_work.nwork++] = in;
 }
 
-static void move_submit_work(void)
+static bool move_lod_enabled(void)
 {
-    if(s_move_work.nwork == 0)
-        return;
+    return Settings_ReadBool(s_sett.movement_lod);
+}
 
-    size_t ntasks = SDL_GetCPUCount();
-    if(s_move_work.nwork < 64)
-        ntasks = 1;
-    ntasks = MIN(ntasks, MAX_MOVE_TASKS);
+static int lod_period(uint32_t uid, struct movestate *ms, 
+                      const struct frustum *frust, vec3_t cam_pos)
+{
+    /* States which require precise steering are never throttled */
+    if(ms->state != STATE_MOVING && ms->state != STATE_MOVING_IN_FORMATION)
+        return LOD_PERIOD_NEAR;
 
-    for(int i = 0; i < ntasks; i++) {
+    /* Entities which have just started moving or which had other dynamic 
+     * entities nearby on their last update need their velocity recomputed
+     * each tick to avoid collisions */
+    if(ms->lod_crowded || PFM_Vec2_Len(&ms->vnew) < EPSILON)
+        return LOD_PERIOD_NEAR;
 
-        struct move_task_arg *arg = stalloc(&s_move_work.mem, sizeof(struct move_task_arg));
-        size_t nitems = ceil((float)s_move_work.nwork / ntasks);
+    struct flock *flock = flock_for_ent(uid);
+    vec2_t xz_pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
+    if(flock) {
+        vec2_t delta;
+        PFM_Vec2_Sub(&flock->target_xz, &xz_pos, &delta);
+        if(PFM_Vec2_Len(&delta) < LOD_TARGET_DIST)
+            return LOD_PERIOD_NEAR;
+    }
 
-        arg->begin_idx = nitems * i;
-        arg->end_idx = MIN(nitems * (i + 1) - 1, s_move_work.nwork-1);
+    vec3_t pos = G_Pos_GetFrom(s_move_work.gamestate.positions, uid);
+    if(C_FrustumPointIntersectionFast(frust, pos) != VOLUME_INTERSEC_OUTSIDE)
+        return LOD_PERIOD_NEAR;
 
-        SDL_AtomicSet(&s_move_work.futures[s_move_work.ntasks].status, FUTURE_INCOMPLETE);
-        s_move_work.tids[s_move_work.ntasks] = Sched_Create(4, move_task, arg, 
-            &s_move_work.futures[s_move_work.ntasks], TASK_BIG_STACK);
+    vec2_t cam_xz = (vec2_t){cam_pos.x, cam_pos.z};
+    vec2_t delta;
+    PFM_Vec2_Sub(&cam_xz, &xz_pos, &delta);
+    float dist = PFM_Vec2_Len(&delta);
+
+    if(dist < LOD_NEAR_DIST)
+        return LOD_PERIOD_NEAR;
+    if(dist < LOD_FAR_DIST || G_Fog_PlayerVisible(xz_pos))
+        return LOD_PERIOD_MID;
+    return LOD_PERIOD_FAR;
+}
 
-        if(s_move_work.tids[s_move_work.ntasks] == NULL_TID) {
-            move_work(arg->begin_idx, arg->end_idx);
-        }else{
-            s_move_work.ntasks++;
+/* Decide which entities will have their steering recomputed on this tick. 
+ * The remaining ones will keep moving with their last computed velocity. 
+ * Updates of throttled entities are staggered across ticks using their UIDs.
+ */
+static void move_lod_update(void)
+{
+    PERF_ENTER();
+    s_move_tick++;
+
+    bool enabled = move_lod_enabled();
+    struct camera *cam = G_GetActiveCamera();
+    vec3_t cam_pos = Camera_GetPos(cam);
+    struct frustum frust;
+    Camera_MakeFrustum(cam, &frust);
+
+    int nskipped = 0;
+    uint32_t curr;
+
+    kh_foreach_key(G_GetDynamicEntsSet(), curr, {
+
+        struct movestate *ms = movestate_get(curr);
+        assert(ms);
+
+        ms->lod_skip = false;
+        if(!enabled || ent_still(ms)) {
+            ms->lod_period = LOD_PERIOD_NEAR;
+            continue;
         }
-    }
+
+        ms->lod_period = lod_period(curr, ms, &frust, cam_pos);
+        ms->lod_skip = (((s_move_tick + curr) % ms->lod_period) != 0);
+        nskipped += ms->lod_skip;
+    });
+
+    PERF_COUNTER_ADD("move.lod_skipped", nskipped);
+    (void)nskipped;
+    PERF_RETURN_VOID();
+}
+
+static int compare_work_slots(const void *a, const void *b)
+{
+    uint32_t sa = ((const struct move_work_in*)a)->slot;
+    uint32_t sb = ((const struct move_work_in*)b)->slot;
+    return (sa > sb) - (sa < sb);
+}
+
+static void move_submit_work(void)
+{
+    if(s_move_work.nwork == 0)
+        return;
+
+    /* Members of a flock are laid out contiguously in the SoA store. Ordering 
+     * the work by slot makes each batch cover (part of) a single flock, so that 
+     * the neighbourhoods that are processed together are spatially coherent. 
+     */
+    qsort(s_move_work.in, s_move_work.nwork, sizeof(struct move_work_in), 
+        compare_work_slots);
+
+    Sched_ParallelForAsync(&s_move_work.pfor, 0, s_move_work.nwork, 
+        MOVE_GRAIN, move_task, NULL);
 }
 
 static void on_20hz_tick(void *user, void *event)
@@ -2914,19 +3608,30 @@ static void on_20hz_tick(void *user, void *event)
 
     move_prepare_work();
     move_copy_gamestate();
+    move_build_soa();
 
+    move_lod_update();
     uint32_t curr;
 
     /* The field computations can read various gamestate 
      * from different threads. This is okay so long as nothing
-     * concurrently mutates it.
+     * concurrently mutates it. In deferred mode, the gamestate
+     * is only read here, on the main thread, and the fields are
+     * built against the navigation data of the snapshot. They 
+     * are collected when the snapshot is released on the next 
+     * tick. 
      */
     PERF_PUSH("compute volatile fields");
-    N_PrepareAsyncWork();
+    bool deferred = Settings_ReadBool(s_sett.deferred_nav_fields);
+    const struct map *fields_map = deferred ? s_move_work.gamestate.map : s_map;
+    N_PrepareAsyncWork(deferred);
     kh_foreach_key(G_GetDynamicEntsSet(), curr, {
-        request_async_field(curr);
+        request_async_field(curr, fields_map);
     });
-    N_AwaitAsyncFields();
+    N_SubmitAsyncFields();
+    if(!deferred) {
+        N_AwaitAsyncFields();
+    }
     PERF_POP();
 
     PERF_PUSH("desired velocity computations");
@@ -2935,22 +3640,12 @@ static void on_20hz_tick(void *user, void *event)
         struct movestate *ms = movestate_get(curr);
         assert(ms);
 
-        if(ent_still(ms))
+        if(ent_still(ms) || ms->lod_skip)
             continue;
 
         struct flock *flock = flock_for_ent(curr);
         ms->vdes = ent_desired_velocity(curr);
 
-        vec_cp_ent_t *dyn, *stat;
-        dyn = stalloc(&s_move_work.mem, sizeof(vec_cp_ent_t));
-        stat = stalloc(&s_move_work.mem, sizeof(vec_cp_ent_t));
-
-        vec_cp_ent_init_alloc(dyn, cp_vec_realloc, cp_vec_free);
-        vec_cp_ent_init_alloc(stat, cp_vec_realloc, cp_vec_free);
-
-        vec_cp_ent_resize(dyn, 16);
-        vec_cp_ent_resize(stat, 16);
-
         vec2_t pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, curr);
         float radius = G_GetSelectionRadiusFrom(s_move_work.gamestate.sel_radiuses, curr);
 
@@ -2965,18 +3660,22 @@ static void on_20hz_tick(void *user, void *event)
             cell_pos = G_Formation_CellPosition(curr);
         }
 
+        int slot = soa_slot(&s_move_work.soa, curr);
+        assert(slot >= 0);
+        s_move_work.soa.vdes_x[slot] = ms->vdes.x;
+        s_move_work.soa.vdes_z[slot] = ms->vdes.z;
+
         formation_id_t fid = G_Formation_GetForEnt(curr);
         move_push_work((struct move_work_in){
             .ent_uid = curr,
+            .slot = slot,
             .ent_des_v = ms->vdes,
             .speed = entity_speed(curr),
             .cell_pos = cell_pos,
             .cp_ent = curr_cp,
             .save_debug = G_ClearPath_ShouldSaveDebug(curr),
-            .stat_neighbs = stat,
-            .dyn_neighbs = dyn,
             .has_dest_los = (flock && (ms->state != STATE_SURROUND_ENTITY || !ms->using_surround_field)) 
-                          ? M_NavHasDestLOS(s_map, flock->dest_id, pos) : false,
+                          ? M_NavFlockHasDestLOS(s_map, flock->fields, flock->dest_id, pos) : false,
             .fid = fid,
             .formation_assignment_ready = (fid == NULL_FID) ? false 
                                                             : G_Formation_AssignmentReady(curr),
@@ -3007,6 +3706,9 @@ static void on_update(void *user, void *event)
 bool G_Move_Init(const struct map *map)
 {
     assert(map);
+    G_Flock_SelectKernels();
+    if(!move_init_setting_handles())
+        return false;
     if(NULL == (s_entity_state_table = kh_init(state))) {
         return false;
     }
@@ -3017,21 +3719,54 @@ bool G_Move_Init(const struct map *map)
         return NULL;
     }
 
+    if(NULL == (s_move_work.soa.slot_table = kh_init(id))) {
+        stalloc_destroy(&s_move_work.mem);
+        kh_destroy(state, s_entity_state_table);
+        return NULL;
+    }
+
     if(!queue_cmd_init(&s_move_commands, 256)) {
+        kh_destroy(id, s_move_work.soa.slot_table);
+        stalloc_destroy(&s_move_work.mem);
+        kh_destroy(state, s_entity_state_table);
+        return NULL;
+    }
+
+    if(NULL == (s_cmd_index = kh_init(cmdidx))) {
+        kh_destroy(id, s_move_work.soa.slot_table);
         stalloc_destroy(&s_move_work.mem);
         kh_destroy(state, s_entity_state_table);
+        queue_cmd_destroy(&s_move_commands);
         return NULL;
     }
+    s_cmd_index_valid = true;
+    s_cmd_head_seq = 0;
+    s_cmd_next_seq = 0;
+    mpsc_cmd_init(&s_move_inbox);
 
     if(!stalloc_init(&s_eventargs)) {
+        kh_destroy(cmdidx, s_cmd_index);
+        kh_destroy(id, s_move_work.soa.slot_table);
         stalloc_destroy(&s_move_work.mem);
         kh_destroy(state, s_entity_state_table);
         queue_cmd_destroy(&s_move_commands);
         return NULL;
     }
 
+    if(NULL == (s_order_uids = kh_init(entity))) {
+        stalloc_destroy(&s_eventargs);
+        kh_destroy(cmdidx, s_cmd_index);
+        kh_destroy(id, s_move_work.soa.slot_table);
+        stalloc_destroy(&s_move_work.mem);
+        kh_destroy(state, s_entity_state_table);
+        queue_cmd_destroy(&s_move_commands);
+        return NULL;
+    }
+    s_pending_orders = 0;
+
     vec_entity_init(&s_move_markers);
     vec_flock_init(&s_flocks);
+    vec_blocker_op_init(&s_blocker_ops);
 
     E_Global_Register(EVENT_UPDATE_START, on_update, NULL, G_RUNNING);
     E_Global_Register(SDL_MOUSEBUTTONDOWN, on_mousedown, NULL, G_RUNNING);
@@ -3069,17 +3804,32 @@ void G_Move_Shutdown(void)
     }
 
     move_release_gamestate();
+    for(int i = 0; i < vec_size(&s_flocks); i++) {
+        N_FlockFieldsFree(vec_AT(&s_flocks, i).fields);
+    }
     vec_flock_destroy(&s_flocks);
+    vec_blocker_op_destroy(&s_blocker_ops);
     vec_entity_destroy(&s_move_markers);
     stalloc_destroy(&s_eventargs);
     queue_cmd_destroy(&s_move_commands);
+    mpsc_cmd_destroy(&s_move_inbox);
+    kh_destroy(cmdidx, s_cmd_index);
+    kh_destroy(entity, s_order_uids);
+    for(int i = 0; i < ARR_SIZE(s_move_scratch); i++) {
+        if(s_move_scratch[i].init) {
+            stalloc_destroy(&s_move_scratch[i].mem);
+        }
+    }
+    memset(s_move_scratch, 0, sizeof(s_move_scratch));
+
+    kh_destroy(id, s_move_work.soa.slot_table);
     stalloc_destroy(&s_move_work.mem);
     kh_destroy(state, s_entity_state_table);
 }
 
 bool G_Move_HasWork(void)
 {
-    return (queue_size(s_move_commands) > 0);
+    return (queue_size(s_move_commands) > 0 || mpsc_size(s_move_inbox) > 0);
 }
 
 void G_Move_FlushWork(void)
@@ -3110,6 +3860,7 @@ void G_Move_AddEntity(uint32_t uid, vec3_t pos, float sel_radius, int faction_id
             .val.as_float = faction_id
         }
     });
+    G_EntIndex_AddComponent(uid, ENT_COMP_MOVEMENT);
 }
 
 void G_Move_RemoveEntity(uint32_t uid)
@@ -3122,11 +3873,11 @@ void G_Move_RemoveEntity(uint32_t uid)
             .val.as_int = uid
         }
     });
+    G_EntIndex_RemoveComponent(uid, ENT_COMP_MOVEMENT);
 }
 
 void G_Move_Stop(uint32_t uid)
 {
-    ASSERT_IN_MAIN_THREAD();
     move_push_cmd((struct move_cmd){
         .type = MOVE_CMD_STOP,
         .args[0] = {
@@ -3138,8 +3889,7 @@ void G_Move_Stop(uint32_t uid)
 
 bool G_Move_GetDest(uint32_t uid, vec2_t *out_xz, bool *out_attack)
 {
-    struct move_cmd *cmd = snoop_most_recent_command(MOVE_CMD_SET_DEST,
-        (void*)(uintptr_t)uid, uids_match, false);
+    struct move_cmd *cmd = snoop_most_recent_dest(uid);
 
     if(cmd) {
         *out_xz = cmd->args[1].val.as_vec2;
@@ -3157,8 +3907,8 @@ bool G_Move_GetDest(uint32_t uid, vec2_t *out_xz, bool *out_attack)
 
 bool G_Move_GetSurrounding(uint32_t uid, uint32_t *out_uid)
 {
-    struct move_cmd *cmd = snoop_most_recent_command(MOVE_CMD_SET_SURROUND_ENTITY,
-        (void*)(uintptr_t)uid, uids_match, false);
+    struct move_cmd *cmd = snoop_most_recent_command(MOVE_CMD_SET_SURROUND_ENTITY, 
+        uid, false);
 
     if(cmd) {
         *out_uid = cmd->args[1].val.as_int;
@@ -3183,7 +3933,6 @@ bool G_Move_Still(uint32_t uid)
 
 void G_Move_SetDest(uint32_t uid, vec2_t dest_xz, bool attack)
 {
-    ASSERT_IN_MAIN_THREAD();
     move_push_cmd((struct move_cmd){
         .type = MOVE_CMD_SET_DEST,
         .args[0] = {
@@ -3201,9 +3950,43 @@ void G_Move_SetDest(uint32_t uid, vec2_t dest_xz, bool attack)
     });
 }
 
-void G_Move_SetChangeDirection(uint32_t uid, quat_t target)
+void G_Move_SetDestBatch(const uint32_t *uids, size_t nents, vec2_t dest_xz, bool attack)
 {
     ASSERT_IN_MAIN_THREAD();
+    if(nents == 0)
+        return;
+
+    vec_entity_t *ents = malloc(sizeof(vec_entity_t));
+    if(!ents)
+        return;
+
+    vec_entity_init(ents);
+    if(!vec_entity_resize(ents, nents)) {
+        PF_FREE(ents);
+        return;
+    }
+    memcpy(ents->array, uids, nents * sizeof(uint32_t));
+    ents->size = nents;
+
+    move_push_cmd((struct move_cmd){
+        .type = MOVE_CMD_SET_DEST_BATCH,
+        .args[0] = {
+            .type = TYPE_POINTER,
+            .val.as_pointer = ents
+        },
+        .args[1] = {
+            .type = TYPE_VEC2,
+            .val.as_vec2 = dest_xz
+        },
+        .args[2] = {
+            .type = TYPE_BOOL,
+            .val.as_bool = attack
+        }
+    });
+}
+
+void G_Move_SetChangeDirection(uint32_t uid, quat_t target)
+{
     move_push_cmd((struct move_cmd){
         .type = MOVE_CMD_CHANGE_DIRECTION,
         .args[0] = {
@@ -3219,7 +4002,6 @@ void G_Move_SetChangeDirection(uint32_t uid, quat_t target)
 
 void G_Move_SetEnterRange(uint32_t uid, uint32_t target, float range)
 {
-    ASSERT_IN_MAIN_THREAD();
     move_push_cmd((struct move_cmd){
         .type = MOVE_CMD_SET_ENTER_RANGE,
         .args[0] = {
@@ -3251,7 +4033,6 @@ void G_Move_SetAttackOnLeftClick(void)
 
 void G_Move_SetSeekEnemies(uint32_t uid)
 {
-    ASSERT_IN_MAIN_THREAD();
     move_push_cmd((struct move_cmd){
         .type = MOVE_CMD_SET_SEEK_ENEMIES,
         .args[0] = {
@@ -3263,7 +4044,6 @@ void G_Move_SetSeekEnemies(uint32_t uid)
 
 void G_Move_SetSurroundEntity(uint32_t uid, uint32_t target)
 {
-    ASSERT_IN_MAIN_THREAD();
     move_push_cmd((struct move_cmd){
         .type = MOVE_CMD_SET_SURROUND_ENTITY,
         .args[0] = {
@@ -3279,7 +4059,6 @@ void G_Move_SetSurroundEntity(uint32_t uid, uint32_t target)
 
 void G_Move_UpdatePos(uint32_t uid, vec2_t pos)
 {
-    ASSERT_IN_MAIN_THREAD();
     move_push_cmd((struct move_cmd){
         .type = MOVE_CMD_UPDATE_POS,
         .args[0] = {
@@ -3374,8 +4153,8 @@ bool G_Move_GetClickEnabled(void)
 
 bool G_Move_GetMaxSpeed(uint32_t uid, float *out)
 {
-    struct move_cmd *cmd = snoop_most_recent_command(MOVE_CMD_SET_MAX_SPEED,
-        (void*)(uintptr_t)uid, uids_match, false);
+    struct move_cmd *cmd = snoop_most_recent_command(MOVE_CMD_SET_MAX_SPEED, 
+        uid, false);
 
     if(cmd) {
         *out = cmd->args[1].val.as_float;
@@ -3392,7 +4171,6 @@ bool G_Move_GetMaxSpeed(uint32_t uid, float *out)
 
 bool G_Move_SetMaxSpeed(uint32_t uid, float speed)
 {
-    ASSERT_IN_MAIN_THREAD();
     move_push_cmd((struct move_cmd){
         .type = MOVE_CMD_SET_MAX_SPEED,
         .args[0] = {
@@ -3473,49 +4251,38 @@ void G_Move_AttackInFormation(vec_entity_t *ents, vec2_t target,
     });
 }
 
-void G_Move_Upload(void)
+bool G_Move_GetRenderTransform(uint32_t uid, vec3_t *out_pos, quat_t *out_rot)
 {
-    ASSERT_IN_MAIN_THREAD();
-    PERF_ENTER();
-
-    const size_t nents = kh_size(G_GetDynamicEntsSet());
-    const size_t buffsize = nents * (sizeof(uint32_t) * 3 + sizeof(vec2_t));
-    struct render_workspace *ws = G_GetSimWS();
-    void *buff = stalloc(&ws->args, buffsize);
-    unsigned char *cursor = buff;
+    if(!s_interp_enabled)
+        return false;
 
-    for(int gpu_id = 1; gpu_id <= nents; gpu_id++) {
+    struct movestate *ms = movestate_get(uid);
+    if(!ms)
+        return false;
 
-        uint32_t uid = G_EntForGPUID(gpu_id);
-        khiter_t k = kh_get(state, s_entity_state_table, uid);
-        assert(k != kh_end(s_entity_state_table));
-        const struct movestate *curr = &kh_value(s_entity_state_table, k);
+    /* Only entities which moved on the last applied tick are blended */
+    if(ms->interp_tick + 1 != s_interp_tick)
+        return false;
 
-        const struct flock *flock;
-        uint32_t flock_id = flock_id_for_ent(uid, &flock);
-        uint32_t movestate = curr->state;
-        vec2_t pos = G_Pos_GetXZFrom(s_move_work.gamestate.positions, uid);
-        uint32_t has_dest_los = flock ? M_NavHasDestLOS(s_map, flock->dest_id, pos) : false;
-        vec2_t dest_xz = flock ? flock->target_xz : (vec2_t){0.0f, 0.0f};
+    /* The position was set from outside the movement system (ex. by a 
+     * scripting call) since the last tick - snap to it. 
+     */
+    vec3_t pos = G_Pos_GetFrom(s_move_work.gamestate.positions, uid);
+    if(memcmp(&pos, &ms->interp_next_pos, sizeof(pos)))
+        return false;
 
-        *((uint32_t*)cursor) = flock_id;        cursor += sizeof(uint32_t);
-        *((uint32_t*)cursor) = movestate;       cursor += sizeof(uint32_t);
-        *((uint32_t*)cursor) = has_dest_los;    cursor += sizeof(uint32_t);
-        *((vec2_t*)cursor) = dest_xz;           cursor += sizeof(vec2_t);
-    }
-    assert(cursor == ((unsigned char*)buff) + buffsize);
+    const double tick_secs = 1.0 / MOVE_TICK_RES;
+    double elapsed = (double)(SDL_GetPerformanceCounter() - s_interp_tick_time) 
+                   / SDL_GetPerformanceFrequency();
+    float alpha = MIN(elapsed / tick_secs, 1.0);
 
-    R_PushCmd((struct rcmd){
-        .func = R_GL_MoveUploadData,
-        .nargs = 3,
-        .args = {
-            buff,
-            R_PushArg(&nents, sizeof(nents)),
-            R_PushArg(&buffsize, sizeof(buffsize)),
-        },
-    });
+    vec3_t delta;
+    PFM_Vec3_Sub(&ms->interp_next_pos, &ms->interp_prev_pos, &delta);
+    PFM_Vec3_Scale(&delta, alpha, &delta);
+    PFM_Vec3_Add(&ms->interp_prev_pos, &delta, out_pos);
 
-    PERF_RETURN_VOID();
+    *out_rot = quat_nlerp(ms->interp_prev_rot, Entity_GetRot(uid), alpha);
+    return true;
 }
 
 bool G_Move_SaveState(struct SDL_RWops *stream)
@@ -3719,6 +4486,7 @@ bool G_Move_LoadState(struct SDL_RWops *stream)
 
         struct flock new_flock;
         new_flock.ents = kh_init(entity);
+        new_flock.fields = NULL;
         CHK_TRUE_RET(new_flock.ents);
 
         CHK_TRUE_JMP(Attr_Parse(stream, &attr, true), fail_flock);
@@ -3845,6 +4613,7 @@ bool G_Move_LoadState(struct SDL_RWops *stream)
         Sched_TryYield();
     }
 
+    flush_blocker_ops();
     return true;
 }
 
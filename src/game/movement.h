@@ -57,6 +57,8 @@ void G_Move_RemoveEntity(uint32_t uid);
 bool G_Move_GetDest(uint32_t uid, vec2_t *out_xz, bool *out_attack);
 bool G_Move_GetSurrounding(uint32_t uid, uint32_t *out_uid);
 
+/* These, along with G_Move_UpdatePos, G_Move_SetDest and G_Move_SetMaxSpeed, 
+ * only queue up a command and may be called from any thread. */
 void G_Move_Stop(uint32_t uid);
 void G_Move_SetSeekEnemies(uint32_t uid);
 void G_Move_SetSurroundEntity(uint32_t uid, uint32_t target);
@@ -72,7 +74,12 @@ void G_Move_BlockAt(uint32_t uid, vec3_t pos);
 
 bool G_Move_SaveState(struct SDL_RWops *stream);
 bool G_Move_LoadState(struct SDL_RWops *stream);
-void G_Move_Upload(void);
+/* Returns the entity's transform blended between the last two movement ticks 
+ * according to the time elapsed since the latest one. Returns false when the 
+ * entity's current transform should be used as is. Only reads the main thread's
+ * state, so it may also be called from tasks that the main thread is joining.
+ */
+bool G_Move_GetRenderTransform(uint32_t uid, vec3_t *out_pos, quat_t *out_rot);
 
 #endif
 
@@ -0,0 +1,297 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "occlusion.h"
+#include "../render/public/render.h"
+#include "../render/public/render_ctrl.h"
+#include "../phys/public/collision.h"
+#include "../camera.h"
+#include "../settings.h"
+#include "../perf.h"
+#include "../main.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define MAX_CELLS           (1 << 17)
+#define MAX_LEVELS          (16)
+#define MIN_W               (1.0f/1024.0f)
+
+struct readback{
+    float       *depths;
+    int          dims[2];
+    mat4x4_t     view_proj;
+    SDL_atomic_t nread;
+};
+
+/* Level 0 holds the farthest depth of every block of pixels and every 
+ * following level the farthest depth of 2x2 texels of the previous one.
+ */
+struct pyramid{
+    bool         valid;
+    int          nlevels;
+    int          dims[MAX_LEVELS][2];
+    size_t       offsets[MAX_LEVELS];
+    float       *data;
+    size_t       capacity;
+    mat4x4_t     view_proj;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct readback s_readback;
+static struct pyramid  s_pyramid;
+static sett_handle_t   s_occl_setting = SETT_HANDLE_INVALID;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static float level_at(int level, int x, int y)
+{
+    const int w = s_pyramid.dims[level][0];
+    return s_pyramid.data[s_pyramid.offsets[level] + y * w + x];
+}
+
+static bool occl_build_pyramid(const float *depths, const int dims[2])
+{
+    size_t total = 0;
+    int nlevels = 0;
+    int w = dims[0], h = dims[1];
+
+    while(nlevels < MAX_LEVELS) {
+        s_pyramid.dims[nlevels][0] = w;
+        s_pyramid.dims[nlevels][1] = h;
+        s_pyramid.offsets[nlevels] = total;
+        total += w * h;
+        nlevels++;
+        if(w == 1 && h == 1)
+            break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    if(total > s_pyramid.capacity)
+        return false;
+
+    memcpy(s_pyramid.data, depths, dims[0] * dims[1] * sizeof(float));
+
+    for(int l = 1; l < nlevels; l++) {
+
+        const int pw = s_pyramid.dims[l - 1][0], ph = s_pyramid.dims[l - 1][1];
+        float *out = s_pyramid.data + s_pyramid.offsets[l];
+
+        for(int y = 0; y < s_pyramid.dims[l][1]; y++) {
+        for(int x = 0; x < s_pyramid.dims[l][0]; x++) {
+
+            const int x0 = x * 2, x1 = MIN(x * 2 + 1, pw - 1);
+            const int y0 = y * 2, y1 = MIN(y * 2 + 1, ph - 1);
+            float farthest = MAX(MAX(level_at(l - 1, x0, y0), level_at(l - 1, x1, y0)),
+                                 MAX(level_at(l - 1, x0, y1), level_at(l - 1, x1, y1)));
+            *out++ = farthest;
+        }}
+    }
+
+    s_pyramid.nlevels = nlevels;
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Occl_Init(void)
+{
+    s_occl_setting = Settings_GetHandle("pf.video.occlusion_culling");
+    if(s_occl_setting == SETT_HANDLE_INVALID)
+        return false;
+
+    s_readback.depths = malloc(MAX_CELLS * sizeof(float));
+    if(!s_readback.depths)
+        goto fail_readback;
+
+    s_pyramid.capacity = MAX_CELLS * 2;
+    s_pyramid.data = malloc(s_pyramid.capacity * sizeof(float));
+    if(!s_pyramid.data)
+        goto fail_pyramid;
+
+    s_pyramid.valid = false;
+    SDL_AtomicSet(&s_readback.nread, 0);
+    return true;
+
+fail_pyramid:
+    free(s_readback.depths);
+    s_readback.depths = NULL;
+fail_readback:
+    return false;
+}
+
+void G_Occl_Shutdown(void)
+{
+    free(s_pyramid.data);
+    free(s_readback.depths);
+    s_pyramid.data = NULL;
+    s_readback.depths = NULL;
+    s_pyramid.valid = false;
+}
+
+void G_Occl_Clear(void)
+{
+    s_pyramid.valid = false;
+}
+
+bool G_Occl_Enabled(void)
+{
+    if(!Settings_ReadBool(s_occl_setting))
+        return false;
+    return R_ComputeShaderSupported();
+}
+
+void G_Occl_Update(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!G_Occl_Enabled()) {
+        s_pyramid.valid = false;
+        return;
+    }
+
+    int nread = SDL_AtomicGet(&s_readback.nread);
+    if(nread < 0)
+        return;
+
+    if(nread > 0) {
+        PERF_PUSH("occlusion pyramid");
+        if(nread == s_readback.dims[0] * s_readback.dims[1]
+        && occl_build_pyramid(s_readback.depths, s_readback.dims)) {
+            s_pyramid.view_proj = s_readback.view_proj;
+            s_pyramid.valid = true;
+        }
+        PERF_POP();
+    }
+
+    const size_t maxout = MAX_CELLS * sizeof(float);
+    SDL_AtomicSet(&s_readback.nread, -1);
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_HiZRead,
+        .nargs = 5,
+        .args = {
+            s_readback.depths,
+            R_PushArg(&maxout, sizeof(maxout)),
+            s_readback.dims,
+            &s_readback.view_proj,
+            &s_readback.nread
+        },
+    });
+}
+
+void G_Occl_PushCapture(const struct camera *cam)
+{
+    mat4x4_t view, proj, view_proj;
+    Camera_MakeViewMat(cam, &view);
+    Camera_MakeProjMat(cam, &proj);
+    PFM_Mat4x4_Mult4x4(&proj, &view, &view_proj);
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_HiZCapture,
+        .nargs = 1,
+        .args = { R_PushArg(&view_proj, sizeof(view_proj)) },
+    });
+}
+
+bool G_Occl_OBBOccluded(const struct obb *obb)
+{
+    if(!s_pyramid.valid)
+        return false;
+
+    const float w0 = s_pyramid.dims[0][0];
+    const float h0 = s_pyramid.dims[0][1];
+
+    float minx = FLT_MAX, maxx = -FLT_MAX;
+    float miny = FLT_MAX, maxy = -FLT_MAX;
+    float nearest = FLT_MAX;
+
+    for(int i = 0; i < 8; i++) {
+
+        vec4_t corner = (vec4_t){obb->corners[i].x, obb->corners[i].y, obb->corners[i].z, 1.0f};
+        vec4_t clip;
+        PFM_Mat4x4_Mult4x1(&s_pyramid.view_proj, &corner, &clip);
+
+        /* The box crosses the near plane */
+        if(clip.w < MIN_W)
+            return false;
+
+        float x = (clip.x / clip.w * 0.5f + 0.5f) * w0;
+        float y = (clip.y / clip.w * 0.5f + 0.5f) * h0;
+        float z = clip.z / clip.w * 0.5f + 0.5f;
+
+        minx = MIN(minx, x); maxx = MAX(maxx, x);
+        miny = MIN(miny, y); maxy = MAX(maxy, y);
+        nearest = MIN(nearest, z);
+    }
+
+    /* Nothing is known about the depth outside of the captured view */
+    if(minx < 0.0f || miny < 0.0f || maxx > w0 || maxy > h0)
+        return false;
+
+    int x0 = floorf(minx), x1 = MIN((int)floorf(maxx), (int)w0 - 1);
+    int y0 = floorf(miny), y1 = MIN((int)floorf(maxy), (int)h0 - 1);
+
+    /* Find the level where the box covers at most 2x2 texels */
+    int level = 0;
+    while(level + 1 < s_pyramid.nlevels && (x1 - x0 > 1 || y1 - y0 > 1)) {
+        x0 >>= 1; x1 >>= 1;
+        y0 >>= 1; y1 >>= 1;
+        level++;
+    }
+
+    float farthest = 0.0f;
+    for(int y = y0; y <= y1; y++) {
+    for(int x = x0; x <= x1; x++) {
+        farthest = MAX(farthest, level_at(level, x, y));
+    }}
+
+    return (nearest > farthest);
+}
+
@@ -0,0 +1,65 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <stdbool.h>
+
+struct obb;
+struct camera;
+
+/* Conservative occlusion culling against the terrain. The terrain depth is
+ * captured on the GPU every frame, reduced, and read back asynchronously. 
+ * Boxes are tested against a farthest-depth pyramid built from the most 
+ * recent capture, using the camera transform that the capture was made with.
+ */
+
+bool G_Occl_Init(void);
+void G_Occl_Shutdown(void);
+/* Drop the current pyramid, e.g. when the map changes */
+void G_Occl_Clear(void);
+bool G_Occl_Enabled(void);
+/* Should be called once per frame, before any boxes are tested. Picks up 
+ * the most recent readback and requests the next one. */
+void G_Occl_Update(void);
+/* Should be pushed right after the terrain has been drawn, and before any 
+ * entities, so that only the terrain acts as an occluder. */
+void G_Occl_PushCapture(const struct camera *cam);
+/* Returns true only if the box is certainly hidden behind the terrain. */
+bool G_Occl_OBBOccluded(const struct obb *obb);
+
+#endif
+
@@ -41,36 +41,117 @@
 #include "fog_of_war.h"
 #include "combat.h"
 #include "region.h"
+#include "resource_index.h"
 #include "public/game.h"
 #include "../main.h"
 #include "../perf.h"
 #include "../sched.h"
+#include "../settings.h"
 #include "../lib/public/mem.h"
 #include "../map/public/map.h"
 #include "../map/public/tile.h"
+#include "../phys/public/collision.h"
 #include "../render/public/render.h"
 #include "../render/public/render_ctrl.h"
 
 #include <assert.h>
 #include <float.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 QUADTREE_IMPL(extern, ent, uint32_t)
+SPATIAL_GRID_IMPL(extern, ent, uint32_t)
 __KHASH_IMPL(pos,  extern, khint32_t, vec3_t, 1, kh_int_hash_func, kh_int_hash_equal)
 
 #define POSBUF_INIT_SIZE (16384)
+#define POS_PAGE_SHIFT   (10)
+#define POS_PAGE_SIZE    (1 << POS_PAGE_SHIFT)
+#define POS_PAGE_MASK    (POS_PAGE_SIZE - 1)
 #define MAX_SEARCH_ENTS  (8192)
+#define GRID_CELL_SIZE   (2.0f * X_COORDS_PER_TILE)
+#define STATIC_CELL_SIZE (4.0f * X_COORDS_PER_TILE)
 #define MAX(a, b)        ((a) > (b) ? (a) : (b))
 #define MIN(a, b)        ((a) < (b) ? (a) : (b))
 #define ARR_SIZE(a)      (sizeof(a)/sizeof(a[0]))
 
+/* A fixed-size block of the position table. Pages are shared between the 
+ * live table and any outstanding snapshots, and are cloned on the first 
+ * write to a shared page. The reference count is only ever touched from
+ * the main thread.
+ */
+struct pos_page{
+    int      refcount;
+    uint32_t nvalid;
+    uint32_t valid[POS_PAGE_SIZE / 32];
+    vec3_t   pos[POS_PAGE_SIZE];
+};
+
+struct pos_static_rec{
+    float    x, z;
+    uint32_t uid;
+};
+
+/* An immutable index of the entities which were not movable when they were 
+ * positioned. The records are sorted by the row-major index of the grid cell 
+ * they fall in, so that a query reads one contiguous span of records per row 
+ * of cells. It is shared by the live state and the snapshots and is rebuilt 
+ * as a whole when the set of static entities changes. 
+ */
+struct pos_static{
+    int                    refcount;
+    float                  xmin, zmin;
+    int                    ncols, nrows;
+    /* 'ncols * nrows + 1' offsets into the records */
+    uint32_t              *cells;
+    struct pos_static_rec *recs;
+    size_t                 nrecs;
+};
+
+/* The area of a query. Circular queries also carry their bounding rectangle */
+struct pos_area{
+    vec2_t xz_min, xz_max;
+    vec2_t center;
+    float  range;
+    bool   circle;
+};
+
+enum pos_scope{
+    POS_SCOPE_ALL,
+    POS_SCOPE_STATIC,
+    POS_SCOPE_DYNAMIC,
+};
+
+KHASH_SET_INIT_INT(uid)
+/* The bin index in the upper and the slot in the lower 32 bits */
+KHASH_MAP_INIT_INT(binref, uint64_t)
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static khash_t(pos) *s_postable;
-/* The quadtree is always synchronized with the postable, at function call boundaries */
-static qt_ent_t      s_postree;
+static struct pos_table s_postable;
+/* The index is always synchronized with the postable, at function call boundaries. 
+ * It holds all the dynamic entities and the static entities which were added since 
+ * the static index was last built. */
+static struct pos_index s_postree;
+static float            s_xmin, s_xmax, s_zmin, s_zmax;
+/* The static index may still hold records of entities that have since been 
+ * removed from it - the live queries only keep those in 's_static_ents' until 
+ * it is rebuilt. */
+static struct pos_static *s_static;
+static khash_t(uid)     *s_static_ents;
+/* Static entities which are still held in the dynamic index */
+static khash_t(uid)     *s_pending_ents;
+static bool              s_static_dirty;
+/* The entities are also binned by the map chunk that their position falls in, 
+ * so that the visibility culling can accept or reject the entities of a chunk 
+ * as a whole. */
+static struct pos_bin    *s_bins;
+static size_t             s_nbins;
+static int                s_bin_cols, s_bin_rows;
+static float              s_bin_w, s_bin_h;
+static khash_t(binref)   *s_binrefs;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -86,6 +167,552 @@ static bool uids_equal(const uint32_t *a, const uint32_t *b)
     return (*a == *b);
 }
 
+static void page_release(struct pos_page *page)
+{
+    if(page && --page->refcount == 0)
+        free(page);
+}
+
+static bool table_init(struct pos_table *table, size_t reserve)
+{
+    table->size = 0;
+    table->npages = (reserve + POS_PAGE_SIZE - 1) / POS_PAGE_SIZE;
+    table->pages = calloc(table->npages, sizeof(struct pos_page*));
+    return (table->pages != NULL);
+}
+
+static void table_destroy(struct pos_table *table)
+{
+    for(size_t i = 0; i < table->npages; i++) {
+        page_release(table->pages[i]);
+    }
+    free(table->pages);
+    table->pages = NULL;
+    table->npages = 0;
+    table->size = 0;
+}
+
+static bool table_copy(const struct pos_table *from, struct pos_table *to)
+{
+    to->size = from->size;
+    to->npages = from->npages;
+    to->pages = malloc(MAX(from->npages, 1) * sizeof(struct pos_page*));
+    if(!to->pages)
+        return false;
+
+    memcpy(to->pages, from->pages, from->npages * sizeof(struct pos_page*));
+    for(size_t i = 0; i < to->npages; i++) {
+        if(to->pages[i])
+            to->pages[i]->refcount++;
+    }
+    return true;
+}
+
+static const vec3_t *table_get(const struct pos_table *table, uint32_t uid)
+{
+    size_t pidx = uid >> POS_PAGE_SHIFT;
+    uint32_t slot = uid & POS_PAGE_MASK;
+
+    if(pidx >= table->npages || !table->pages[pidx])
+        return NULL;
+
+    const struct pos_page *page = table->pages[pidx];
+    if(!(page->valid[slot / 32] & (1u << (slot % 32))))
+        return NULL;
+    return &page->pos[slot];
+}
+
+/* Returns a page holding the uid that is exclusively owned by the table,
+ * allocating or cloning it as necessary. */
+static struct pos_page *table_page_mut(struct pos_table *table, uint32_t uid)
+{
+    size_t pidx = uid >> POS_PAGE_SHIFT;
+
+    if(pidx >= table->npages) {
+        size_t new_npages = MAX(table->npages * 2, pidx + 1);
+        struct pos_page **new_pages = realloc(table->pages, new_npages * sizeof(struct pos_page*));
+        if(!new_pages)
+            return NULL;
+        memset(new_pages + table->npages, 0, (new_npages - table->npages) * sizeof(struct pos_page*));
+        table->pages = new_pages;
+        table->npages = new_npages;
+    }
+
+    struct pos_page *page = table->pages[pidx];
+    if(!page) {
+        page = calloc(1, sizeof(struct pos_page));
+        if(!page)
+            return NULL;
+        page->refcount = 1;
+        table->pages[pidx] = page;
+    }else if(page->refcount > 1) {
+        struct pos_page *clone = malloc(sizeof(struct pos_page));
+        if(!clone)
+            return NULL;
+        memcpy(clone, page, sizeof(struct pos_page));
+        clone->refcount = 1;
+        page->refcount--;
+        table->pages[pidx] = page = clone;
+    }
+    return page;
+}
+
+static bool table_set(struct pos_table *table, uint32_t uid, vec3_t pos)
+{
+    struct pos_page *page = table_page_mut(table, uid);
+    if(!page)
+        return false;
+
+    uint32_t slot = uid & POS_PAGE_MASK;
+    uint32_t bit = (1u << (slot % 32));
+    if(!(page->valid[slot / 32] & bit)) {
+        page->valid[slot / 32] |= bit;
+        page->nvalid++;
+        table->size++;
+    }
+    page->pos[slot] = pos;
+    return true;
+}
+
+static void table_delete(struct pos_table *table, uint32_t uid)
+{
+    size_t pidx = uid >> POS_PAGE_SHIFT;
+    assert(table_get(table, uid));
+
+    table->size--;
+    if(table->pages[pidx]->nvalid == 1) {
+        page_release(table->pages[pidx]);
+        table->pages[pidx] = NULL;
+        return;
+    }
+
+    struct pos_page *page = table_page_mut(table, uid);
+    if(!page) {
+        /* Leave the entry in place rather than corrupt a shared page */
+        table->size++;
+        return;
+    }
+
+    uint32_t slot = uid & POS_PAGE_MASK;
+    page->valid[slot / 32] &= ~(1u << (slot % 32));
+    page->nvalid--;
+}
+
+static bool index_init(struct pos_index *index, enum pos_index_type type,
+                       float xmin, float xmax, float zmin, float zmax)
+{
+    index->type = type;
+    switch(type) {
+    case POS_INDEX_QUADTREE:
+        qt_ent_init(&index->qt, xmin, xmax, zmin, zmax, uids_equal);
+        return qt_ent_reserve(&index->qt, POSBUF_INIT_SIZE);
+    case POS_INDEX_GRID:
+        return sg_ent_init(&index->sg, xmin, xmax, zmin, zmax, GRID_CELL_SIZE, uids_equal);
+    default: assert(0);
+    }
+    return false;
+}
+
+static void index_destroy(struct pos_index *index)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE: qt_ent_destroy(&index->qt); break;
+    case POS_INDEX_GRID:     sg_ent_destroy(&index->sg); break;
+    default: assert(0);
+    }
+}
+
+static bool index_copy(const struct pos_index *from, struct pos_index *to)
+{
+    to->type = from->type;
+    switch(from->type) {
+    case POS_INDEX_QUADTREE: return qt_ent_copy(&from->qt, &to->qt);
+    case POS_INDEX_GRID:     return sg_ent_copy(&from->sg, &to->sg);
+    default: assert(0);
+    }
+    return false;
+}
+
+static bool index_insert(struct pos_index *index, vec3_t pos, uint32_t uid)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE: return qt_ent_insert(&index->qt, pos.x, pos.z, uid);
+    case POS_INDEX_GRID:     return sg_ent_insert(&index->sg, pos.x, pos.z, uid);
+    default: assert(0);
+    }
+    return false;
+}
+
+static bool index_delete(struct pos_index *index, vec3_t pos, uint32_t uid)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE: return qt_ent_delete(&index->qt, pos.x, pos.z, uid);
+    case POS_INDEX_GRID:     return sg_ent_delete(&index->sg, pos.x, pos.z, uid);
+    default: assert(0);
+    }
+    return false;
+}
+
+static bool index_move(struct pos_index *index, vec3_t old_pos, vec3_t new_pos, uint32_t uid)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE:
+        qt_ent_delete(&index->qt, old_pos.x, old_pos.z, uid);
+        return qt_ent_insert(&index->qt, new_pos.x, new_pos.z, uid);
+    case POS_INDEX_GRID:
+        return sg_ent_move(&index->sg, old_pos.x, old_pos.z, new_pos.x, new_pos.z, uid);
+    default: assert(0);
+    }
+    return false;
+}
+
+static size_t index_size(const struct pos_index *index)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE: return index->qt.nrecs;
+    case POS_INDEX_GRID:     return index->sg.nrecs;
+    default: assert(0);
+    }
+    return 0;
+}
+
+static float index_len(const struct pos_index *index)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE: 
+        return MAX(index->qt.xmax - index->qt.xmin, index->qt.ymax - index->qt.ymin);
+    case POS_INDEX_GRID:
+        return MAX(index->sg.xmax - index->sg.xmin, index->sg.ymax - index->sg.ymin);
+    default: assert(0);
+    }
+    return 0.0f;
+}
+
+static int index_inrange_circle(const struct pos_index *index, vec2_t xz_point, float range,
+                                uint32_t *out, size_t maxout)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE: 
+        return qt_ent_inrange_circle((qt_ent_t*)&index->qt, xz_point.x, xz_point.z, range, out, maxout);
+    case POS_INDEX_GRID:
+        return sg_ent_inrange_circle(&index->sg, xz_point.x, xz_point.z, range, out, maxout);
+    default: assert(0);
+    }
+    return 0;
+}
+
+static int index_inrange_rect(const struct pos_index *index, vec2_t xz_min, vec2_t xz_max,
+                              uint32_t *out, size_t maxout)
+{
+    switch(index->type) {
+    case POS_INDEX_QUADTREE: 
+        return qt_ent_inrange_rect((qt_ent_t*)&index->qt, 
+            xz_min.x, xz_max.x, xz_min.z, xz_max.z, out, maxout);
+    case POS_INDEX_GRID:
+        return sg_ent_inrange_rect(&index->sg, 
+            xz_min.x, xz_max.x, xz_min.z, xz_max.z, out, maxout);
+    default: assert(0);
+    }
+    return 0;
+}
+
+static void static_release(struct pos_static *st)
+{
+    if(!st || --st->refcount > 0)
+        return;
+    free(st->cells);
+    free(st->recs);
+    free(st);
+}
+
+static void static_cell(const struct pos_static *st, float x, float z, int *out_r, int *out_c)
+{
+    int c = (x - st->xmin) / STATIC_CELL_SIZE;
+    int r = (z - st->zmin) / STATIC_CELL_SIZE;
+    *out_c = MIN(MAX(c, 0), st->ncols - 1);
+    *out_r = MIN(MAX(r, 0), st->nrows - 1);
+}
+
+static bool static_gather(khash_t(uid) *set, struct pos_static_rec *recs, size_t *inout_n)
+{
+    uint32_t uid;
+    kh_foreach_key(set, uid, {
+        const vec3_t *pos = table_get(&s_postable, uid);
+        if(!pos)
+            return false;
+        recs[(*inout_n)++] = (struct pos_static_rec){pos->x, pos->z, uid};
+    });
+    return true;
+}
+
+/* Bulk-load the static and pending entities, binning them with a counting sort */
+static struct pos_static *static_build(void)
+{
+    struct pos_static *ret = malloc(sizeof(struct pos_static));
+    if(!ret)
+        goto fail_alloc;
+
+    ret->refcount = 1;
+    ret->xmin = s_xmin;
+    ret->zmin = s_zmin;
+    ret->ncols = MAX(ceilf((s_xmax - s_xmin) / STATIC_CELL_SIZE), 1);
+    ret->nrows = MAX(ceilf((s_zmax - s_zmin) / STATIC_CELL_SIZE), 1);
+
+    size_t ncells = ret->ncols * ret->nrows;
+    size_t nents = kh_size(s_static_ents) + kh_size(s_pending_ents);
+
+    ret->cells = calloc(ncells + 1, sizeof(uint32_t));
+    if(!ret->cells)
+        goto fail_cells;
+
+    struct pos_static_rec *unsorted = malloc(MAX(nents, 1) * sizeof(struct pos_static_rec));
+    if(!unsorted)
+        goto fail_unsorted;
+
+    ret->recs = malloc(MAX(nents, 1) * sizeof(struct pos_static_rec));
+    if(!ret->recs)
+        goto fail_recs;
+
+    ret->nrecs = 0;
+    if(!static_gather(s_static_ents, unsorted, &ret->nrecs)
+    || !static_gather(s_pending_ents, unsorted, &ret->nrecs))
+        goto fail_gather;
+    assert(ret->nrecs == nents);
+
+    for(size_t i = 0; i < nents; i++) {
+        int r, c;
+        static_cell(ret, unsorted[i].x, unsorted[i].z, &r, &c);
+        ret->cells[r * ret->ncols + c + 1]++;
+    }
+    for(size_t i = 0; i < ncells; i++) {
+        ret->cells[i + 1] += ret->cells[i];
+    }
+
+    /* Scatter the records using the cell offsets as cursors, which leaves 
+     * each cell's offset pointing at the start of the next cell */
+    for(size_t i = 0; i < nents; i++) {
+        int r, c;
+        static_cell(ret, unsorted[i].x, unsorted[i].z, &r, &c);
+        ret->recs[ret->cells[r * ret->ncols + c]++] = unsorted[i];
+    }
+    memmove(ret->cells + 1, ret->cells, ncells * sizeof(uint32_t));
+    ret->cells[0] = 0;
+
+    free(unsorted);
+    return ret;
+
+fail_gather:
+    free(ret->recs);
+fail_recs:
+    free(unsorted);
+fail_unsorted:
+    free(ret->cells);
+fail_cells:
+    free(ret);
+fail_alloc:
+    return NULL;
+}
+
+/* Fold the pending static entities into a new static index. This is only 
+ * done on the main thread, as it modifies the dynamic index. */
+static void static_sync(void)
+{
+    if(!s_static_dirty || SDL_ThreadID() != g_main_thread_id)
+        return;
+
+    PERF_ENTER();
+    size_t nstatic = kh_size(s_static_ents) + kh_size(s_pending_ents);
+    if(kh_resize(uid, s_static_ents, nstatic) < 0)
+        PERF_RETURN_VOID();
+
+    struct pos_static *st = static_build();
+    if(!st)
+        PERF_RETURN_VOID();
+
+    uint32_t uid;
+    kh_foreach_key(s_pending_ents, uid, {
+        int status;
+        bool deleted = index_delete(&s_postree, *table_get(&s_postable, uid), uid);
+        assert(deleted);
+        (void)deleted;
+        kh_put(uid, s_static_ents, uid, &status);
+        assert(status != -1);
+    });
+    kh_clear(uid, s_pending_ents);
+
+    static_release(s_static);
+    s_static = st;
+    s_static_dirty = false;
+
+    PERF_COUNTER_ADD("pos.static_rebuilds", 1);
+    PERF_RETURN_VOID();
+}
+
+static int static_query(const struct pos_static *st, const struct pos_area *area, 
+                        khash_t(uid) *members, uint32_t *out, size_t maxout)
+{
+    int r0, c0, r1, c1;
+    static_cell(st, area->xz_min.x, area->xz_min.z, &r0, &c0);
+    static_cell(st, area->xz_max.x, area->xz_max.z, &r1, &c1);
+
+    int ret = 0;
+    for(int r = r0; r <= r1; r++) {
+
+        uint32_t begin = st->cells[r * st->ncols + c0];
+        uint32_t end = st->cells[r * st->ncols + c1 + 1];
+
+        for(uint32_t i = begin; i < end; i++) {
+
+            const struct pos_static_rec *rec = &st->recs[i];
+            if(ret == maxout)
+                return ret;
+
+            if(rec->x < area->xz_min.x || rec->x > area->xz_max.x
+            || rec->z < area->xz_min.z || rec->z > area->xz_max.z)
+                continue;
+
+            if(area->circle) {
+                float dx = rec->x - area->center.x;
+                float dz = rec->z - area->center.z;
+                if(dx * dx + dz * dz > area->range * area->range)
+                    continue;
+            }
+
+            if(members && kh_get(uid, members, rec->uid) == kh_end(members))
+                continue;
+
+            out[ret++] = rec->uid;
+        }
+    }
+    return ret;
+}
+
+static int filter_pending(uint32_t *candidates, int count, bool keep_pending)
+{
+    int ret = 0;
+    for(int i = 0; i < count; i++) {
+        bool pending = (kh_get(uid, s_pending_ents, candidates[i]) != kh_end(s_pending_ents));
+        if(pending == keep_pending)
+            candidates[ret++] = candidates[i];
+    }
+    return ret;
+}
+
+/* Merge the results of the dynamic and static indices. A NULL snapshot refers 
+ * to the live state. The snapshots are acquired with an up-to-date static index, 
+ * so only the live state has pending entities or stale static records. */
+static int pos_query(const struct pos_snapshot *snap, enum pos_scope scope, 
+                     const struct pos_area *area, uint32_t *out, size_t maxout)
+{
+    if(!snap) {
+        static_sync();
+    }
+
+    const struct pos_index *index = snap ? &snap->index : &s_postree;
+    const struct pos_static *st = snap ? snap->statics : s_static;
+    bool pending = !snap && kh_size(s_pending_ents) > 0;
+    int ret = 0;
+
+    if(scope != POS_SCOPE_STATIC || pending) {
+
+        ret = area->circle 
+            ? index_inrange_circle(index, area->center, area->range, out, maxout)
+            : index_inrange_rect(index, area->xz_min, area->xz_max, out, maxout);
+
+        if(pending && scope != POS_SCOPE_ALL) {
+            ret = filter_pending(out, ret, scope == POS_SCOPE_STATIC);
+        }
+    }
+
+    if(scope != POS_SCOPE_DYNAMIC && st) {
+        khash_t(uid) *members = (!snap && s_static_dirty) ? s_static_ents : NULL;
+        ret += static_query(st, area, members, out + ret, maxout - ret);
+    }
+    return ret;
+}
+
+static struct pos_area area_circle(vec2_t xz_point, float range)
+{
+    return (struct pos_area){
+        .xz_min = (vec2_t){xz_point.x - range, xz_point.z - range},
+        .xz_max = (vec2_t){xz_point.x + range, xz_point.z + range},
+        .center = xz_point,
+        .range = range,
+        .circle = true,
+    };
+}
+
+static struct pos_area area_rect(vec2_t xz_min, vec2_t xz_max)
+{
+    return (struct pos_area){
+        .xz_min = xz_min,
+        .xz_max = xz_max,
+        .circle = false,
+    };
+}
+
+static bool pos_is_static(uint32_t uid)
+{
+    return !(G_FlagsGet(uid) & ENTITY_FLAG_MOVABLE);
+}
+
+/* New static entities are held in the dynamic index until the static 
+ * index is next rebuilt */
+static bool pos_index_add(uint32_t uid, vec3_t pos)
+{
+    if(!index_insert(&s_postree, pos, uid))
+        return false;
+
+    if(pos_is_static(uid)) {
+        int status;
+        kh_put(uid, s_pending_ents, uid, &status);
+        if(status == -1) {
+            index_delete(&s_postree, pos, uid);
+            return false;
+        }
+        s_static_dirty = true;
+    }
+    return true;
+}
+
+static bool pos_index_remove(uint32_t uid, vec3_t pos)
+{
+    khiter_t k = kh_get(uid, s_static_ents, uid);
+    if(k != kh_end(s_static_ents)) {
+        kh_del(uid, s_static_ents, k);
+        s_static_dirty = true;
+        return true;
+    }
+
+    k = kh_get(uid, s_pending_ents, uid);
+    if(k != kh_end(s_pending_ents)) {
+        kh_del(uid, s_pending_ents, k);
+    }
+    return index_delete(&s_postree, pos, uid);
+}
+
+/* An entity keeps the class it was given when it was first positioned, 
+ * so that entities which stop moving don't make the static index churn */
+static bool pos_index_move(uint32_t uid, vec3_t old_pos, vec3_t new_pos)
+{
+    if(kh_get(uid, s_static_ents, uid) == kh_end(s_static_ents))
+        return index_move(&s_postree, old_pos, new_pos, uid);
+
+    if(!pos_index_remove(uid, old_pos))
+        return false;
+    if(!pos_index_add(uid, new_pos)) {
+        int status;
+        kh_put(uid, s_static_ents, uid, &status);
+        return false;
+    }
+    return true;
+}
+
+static size_t pos_index_size(void)
+{
+    return index_size(&s_postree) + kh_size(s_static_ents);
+}
+
 static int filter_garrisoned(khash_t(id) *flags, uint32_t *candidates, int count)
 {
     int ret = count;
@@ -107,6 +734,237 @@ static int filter_garrisoned(khash_t(id) *flags, uint32_t *candidates, int count
     return ret;
 }
 
+static uint32_t bench_rand(uint32_t *state)
+{
+    /* xorshift32 - we want the same sequence for both backends */
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return (*state = x);
+}
+
+static float bench_randf(uint32_t *state, float min, float max)
+{
+    return min + (bench_rand(state) / (float)UINT32_MAX) * (max - min);
+}
+
+static double bench_ms(uint64_t begin)
+{
+    return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void bench_index(enum pos_index_type type, size_t nents, int nticks, 
+                        struct pos_bench_result *out)
+{
+    const float len = 4 * TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
+    const float radius = 30.0f;
+
+    memset(out, 0, sizeof(*out));
+    vec3_t *positions = malloc(nents * sizeof(vec3_t));
+    uint32_t *found = malloc(MAX_SEARCH_ENTS * sizeof(uint32_t));
+    struct pos_index index;
+
+    if(!positions || !found)
+        goto fail_alloc;
+    if(!index_init(&index, type, -len/2.0f, len/2.0f, -len/2.0f, len/2.0f))
+        goto fail_alloc;
+
+    uint32_t seed = 0xdeadbeef;
+    for(int i = 0; i < nents; i++) {
+        positions[i] = (vec3_t){
+            bench_randf(&seed, -len/2.0f, len/2.0f), 0.0f,
+            bench_randf(&seed, -len/2.0f, len/2.0f)
+        };
+    }
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(int i = 0; i < nents; i++) {
+        index_insert(&index, positions[i], i + 1);
+    }
+    out->insert_ms = bench_ms(begin);
+
+    for(int t = 0; t < nticks; t++) {
+
+        begin = SDL_GetPerformanceCounter();
+        for(int i = 0; i < nents; i++) {
+            vec3_t new_pos = (vec3_t){
+                MIN(MAX(positions[i].x + bench_randf(&seed, -1.0f, 1.0f), -len/2.0f), len/2.0f), 0.0f,
+                MIN(MAX(positions[i].z + bench_randf(&seed, -1.0f, 1.0f), -len/2.0f), len/2.0f)
+            };
+            index_move(&index, positions[i], new_pos, i + 1);
+            positions[i] = new_pos;
+        }
+        out->move_ms += bench_ms(begin);
+
+        begin = SDL_GetPerformanceCounter();
+        for(int i = 0; i < nents; i++) {
+            vec2_t xz = (vec2_t){positions[i].x, positions[i].z};
+            out->nfound += index_inrange_circle(&index, xz, radius, found, MAX_SEARCH_ENTS);
+        }
+        out->query_ms += bench_ms(begin);
+
+        begin = SDL_GetPerformanceCounter();
+        struct pos_index copy;
+        if(index_copy(&index, &copy)) {
+            index_destroy(&copy);
+        }
+        out->copy_ms += bench_ms(begin);
+    }
+
+    index_destroy(&index);
+fail_alloc:
+    free(found);
+    free(positions);
+}
+
+static void bin_reset(struct pos_bin *bin)
+{
+    bin->ymin = FLT_MAX;
+    bin->ymax = -FLT_MAX;
+    bin->radius = 0.0f;
+    bin->dirty = false;
+}
+
+static size_t bin_index(vec3_t pos)
+{
+    if(pos.x < s_xmin || pos.x >= s_xmax || pos.z < s_zmin || pos.z >= s_zmax)
+        return s_nbins - 1;
+
+    int col = MIN((int)((pos.x - s_xmin) / s_bin_w), s_bin_cols - 1);
+    int row = MIN((int)((pos.z - s_zmin) / s_bin_h), s_bin_rows - 1);
+    return row * s_bin_cols + col;
+}
+
+static bool bin_reserve(struct pos_bin *bin)
+{
+    if(bin->count < bin->cap)
+        return true;
+
+    uint32_t newcap = MAX(bin->cap * 2, 16);
+    uint32_t *uids = realloc(bin->uids, newcap * sizeof(uint32_t));
+    if(!uids)
+        return false;
+
+    bin->uids = uids;
+    bin->cap = newcap;
+    return true;
+}
+
+static void bin_unlink(uint64_t ref)
+{
+    struct pos_bin *bin = &s_bins[ref >> 32];
+    uint32_t slot = (uint32_t)ref;
+    assert(slot < bin->count);
+
+    uint32_t last = bin->uids[--bin->count];
+    if(slot < bin->count) {
+        bin->uids[slot] = last;
+        khiter_t k = kh_get(binref, s_binrefs, last);
+        assert(k != kh_end(s_binrefs));
+        kh_value(s_binrefs, k) = ref;
+    }
+    if(bin->count == 0) {
+        bin_reset(bin);
+    }
+}
+
+static uint64_t bin_link(size_t idx, uint32_t uid, vec3_t pos)
+{
+    struct pos_bin *bin = &s_bins[idx];
+    assert(bin->count < bin->cap);
+
+    uint32_t slot = bin->count++;
+    bin->uids[slot] = uid;
+    bin->ymin = MIN(bin->ymin, pos.y);
+    bin->ymax = MAX(bin->ymax, pos.y);
+    bin->dirty = true;
+    return ((uint64_t)idx << 32) | slot;
+}
+
+static bool bin_add(uint32_t uid, vec3_t pos)
+{
+    size_t idx = bin_index(pos);
+    if(!bin_reserve(&s_bins[idx]))
+        return false;
+
+    int ret;
+    khiter_t k = kh_put(binref, s_binrefs, uid, &ret);
+    if(ret == -1)
+        return false;
+    assert(ret != 0);
+
+    kh_value(s_binrefs, k) = bin_link(idx, uid, pos);
+    return true;
+}
+
+static void bin_remove(uint32_t uid)
+{
+    khiter_t k = kh_get(binref, s_binrefs, uid);
+    assert(k != kh_end(s_binrefs));
+
+    uint64_t ref = kh_value(s_binrefs, k);
+    kh_del(binref, s_binrefs, k);
+    bin_unlink(ref);
+}
+
+static bool bin_move(uint32_t uid, vec3_t pos)
+{
+    khiter_t k = kh_get(binref, s_binrefs, uid);
+    assert(k != kh_end(s_binrefs));
+
+    uint64_t ref = kh_value(s_binrefs, k);
+    size_t idx = bin_index(pos);
+
+    if(idx == (ref >> 32)) {
+        struct pos_bin *bin = &s_bins[idx];
+        bin->ymin = MIN(bin->ymin, pos.y);
+        bin->ymax = MAX(bin->ymax, pos.y);
+        return true;
+    }
+
+    if(!bin_reserve(&s_bins[idx]))
+        return false;
+
+    bin_unlink(ref);
+    kh_value(s_binrefs, k) = bin_link(idx, uid, pos);
+    return true;
+}
+
+static bool bins_init(const struct map_resolution *res)
+{
+    s_bin_cols = res->chunk_w;
+    s_bin_rows = res->chunk_h;
+    s_bin_w = res->tile_w * X_COORDS_PER_TILE;
+    s_bin_h = res->tile_h * Z_COORDS_PER_TILE;
+    s_nbins = s_bin_cols * s_bin_rows + 1;
+
+    s_bins = calloc(s_nbins, sizeof(struct pos_bin));
+    if(!s_bins)
+        return false;
+
+    s_binrefs = kh_init(binref);
+    if(!s_binrefs) {
+        PF_FREE(s_bins);
+        return false;
+    }
+
+    for(size_t i = 0; i < s_nbins; i++) {
+        bin_reset(&s_bins[i]);
+    }
+    return true;
+}
+
+static void bins_destroy(void)
+{
+    for(size_t i = 0; i < s_nbins; i++) {
+        free(s_bins[i].uids);
+    }
+    PF_FREE(s_bins);
+    kh_destroy(binref, s_binrefs);
+    s_nbins = 0;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -115,103 +973,212 @@ bool G_Pos_Set(uint32_t uid, vec3_t pos)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    khiter_t k = kh_get(pos, s_postable, uid);
-    bool overwrite = (k != kh_end(s_postable));
+    const vec3_t *curr = table_get(&s_postable, uid);
+    bool overwrite = (curr != NULL);
     float vrange = G_GetVisionRange(uid);
+    vec3_t old_pos = overwrite ? *curr : pos;
 
     if(overwrite) {
-        vec3_t old_pos = kh_val(s_postable, k);
-        bool ret = qt_ent_delete(&s_postree, old_pos.x, old_pos.z, uid);
-        assert(ret);
+        /* Moving back into the original bin cannot fail */
+        if(!bin_move(uid, pos))
+            return false;
+        if(!pos_index_move(uid, old_pos, pos)) {
+            bin_move(uid, old_pos);
+            return false;
+        }
+        if(!table_set(&s_postable, uid, pos)) {
+            pos_index_move(uid, pos, old_pos);
+            bin_move(uid, old_pos);
+            return false;
+        }
 
         G_Combat_RemoveRef(G_GetFactionID(uid), (vec2_t){old_pos.x, old_pos.z});
-        G_Region_RemoveRef(uid, (vec2_t){old_pos.x, old_pos.z});
-        G_Fog_RemoveVision((vec2_t){old_pos.x, old_pos.z}, G_GetFactionID(uid), vrange);
-    }
+    }else{
 
-    if(!qt_ent_insert(&s_postree, pos.x, pos.z, uid))
-        return false;
-
-    if(!overwrite) {
-        int ret;
-        kh_put(pos, s_postable, uid, &ret); 
-        if(ret == -1) {
-            qt_ent_delete(&s_postree, pos.x, pos.z, uid);
+        if(!bin_add(uid, pos))
+            return false;
+        if(!pos_index_add(uid, pos)) {
+            bin_remove(uid);
+            return false;
+        }
+        if(!table_set(&s_postable, uid, pos)) {
+            pos_index_remove(uid, pos);
+            bin_remove(uid);
             return false;
         }
-        k = kh_get(pos, s_postable, uid);
     }
 
-    kh_val(s_postable, k) = pos;
-    assert(kh_size(s_postable) == s_postree.nrecs);
+    assert(s_postable.size == pos_index_size());
+    Entity_InvalidateOBB(uid);
 
     G_Move_UpdatePos(uid, (vec2_t){pos.x, pos.z});
+    G_ResourceIndex_UpdatePos(uid, (vec2_t){pos.x, pos.z});
     G_Combat_AddRef(G_GetFactionID(uid), (vec2_t){pos.x, pos.z});
-    G_Region_AddRef(uid, (vec2_t){pos.x, pos.z});
+    if(overwrite) {
+        G_Region_MoveRef(uid, (vec2_t){old_pos.x, old_pos.z}, (vec2_t){pos.x, pos.z});
+    }else{
+        G_Region_AddRef(uid, (vec2_t){pos.x, pos.z});
+    }
     G_Building_UpdateBounds(uid);
     G_Resource_UpdateBounds(uid);
-    G_Fog_AddVision((vec2_t){pos.x, pos.z}, G_GetFactionID(uid), vrange);
+
+    if(overwrite) {
+        G_Fog_MoveVision((vec2_t){old_pos.x, old_pos.z}, (vec2_t){pos.x, pos.z}, 
+            G_GetFactionID(uid), vrange);
+    }else{
+        G_Fog_AddVision((vec2_t){pos.x, pos.z}, G_GetFactionID(uid), vrange);
+    }
 
     return true; 
 }
 
 vec3_t G_Pos_Get(uint32_t uid)
 {
-    khiter_t k = kh_get(pos, s_postable, uid);
-    assert(k != kh_end(s_postable));
-    return kh_val(s_postable, k);
+    const vec3_t *pos = table_get(&s_postable, uid);
+    assert(pos);
+    return *pos;
 }
 
 vec2_t G_Pos_GetXZ(uint32_t uid)
 {
-    khiter_t k = kh_get(pos, s_postable, uid);
-    assert(k != kh_end(s_postable));
-    vec3_t pos = kh_val(s_postable, k);
-    return (vec2_t){pos.x, pos.z};
+    const vec3_t *pos = table_get(&s_postable, uid);
+    assert(pos);
+    return (vec2_t){pos->x, pos->z};
 }
 
-khash_t(pos) *G_Pos_CopyTable(void)
+struct pos_snapshot *G_Pos_AcquireSnapshot(void)
 {
-    return kh_copy_pos(s_postable);
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    static_sync();
+
+    struct pos_snapshot *ret = malloc(sizeof(struct pos_snapshot));
+    if(!ret)
+        goto fail_alloc;
+    if(!table_copy(&s_postable, &ret->table))
+        goto fail_table;
+
+    /* A failed static index rebuild leaves stale records in the static index, 
+     * which a snapshot has no way of filtering out */
+    if(s_static_dirty)
+        goto fail_index;
+    if(!index_copy(&s_postree, &ret->index))
+        goto fail_index;
+
+    ret->statics = s_static;
+    if(ret->statics) {
+        ret->statics->refcount++;
+    }
+    PERF_RETURN(ret);
+
+fail_index:
+    table_destroy(&ret->table);
+fail_table:
+    free(ret);
+fail_alloc:
+    PERF_RETURN(NULL);
 }
 
-vec3_t G_Pos_GetFrom(khash_t(pos) *table, uint32_t uid)
+void G_Pos_ReleaseSnapshot(struct pos_snapshot *snap)
 {
-    khiter_t k = kh_get(pos, table, uid);
-    assert(k != kh_end(table));
-    return kh_val(table, k);
+    ASSERT_IN_MAIN_THREAD();
+
+    table_destroy(&snap->table);
+    index_destroy(&snap->index);
+    static_release(snap->statics);
+    free(snap);
 }
 
-vec2_t G_Pos_GetXZFrom(khash_t(pos) *table, uint32_t uid)
+bool G_Pos_SnapshotSet(struct pos_snapshot *snap, uint32_t uid, vec3_t pos)
 {
-    khiter_t k = kh_get(pos, table, uid);
-    assert(k != kh_end(table));
-    vec3_t pos = kh_val(table, k);
-    return (vec2_t){pos.x, pos.z};
+    ASSERT_IN_MAIN_THREAD();
+    assert(kh_get(uid, s_static_ents, uid) == kh_end(s_static_ents));
+
+    const vec3_t *curr = table_get(&snap->table, uid);
+    if(curr) {
+        vec3_t old_pos = *curr;
+        if(!index_move(&snap->index, old_pos, pos, uid))
+            return false;
+        if(!table_set(&snap->table, uid, pos)) {
+            index_move(&snap->index, pos, old_pos, uid);
+            return false;
+        }
+    }else{
+        if(!index_insert(&snap->index, pos, uid))
+            return false;
+        if(!table_set(&snap->table, uid, pos)) {
+            index_delete(&snap->index, pos, uid);
+            return false;
+        }
+    }
+    return true;
+}
+
+vec3_t G_Pos_GetFrom(const struct pos_snapshot *snap, uint32_t uid)
+{
+    const vec3_t *pos = table_get(&snap->table, uid);
+    assert(pos);
+    return *pos;
+}
+
+vec2_t G_Pos_GetXZFrom(const struct pos_snapshot *snap, uint32_t uid)
+{
+    const vec3_t *pos = table_get(&snap->table, uid);
+    assert(pos);
+    return (vec2_t){pos->x, pos->z};
 }
 
 void G_Pos_Delete(uint32_t uid)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    khiter_t k = kh_get(pos, s_postable, uid);
-    assert(k != kh_end(s_postable));
+    const vec3_t *curr = table_get(&s_postable, uid);
+    assert(curr);
 
-    vec3_t pos = kh_val(s_postable, k);
-    kh_del(pos, s_postable, k);
+    vec3_t pos = *curr;
+    table_delete(&s_postable, uid);
 
-    bool ret = qt_ent_delete(&s_postree, pos.x, pos.z, uid);
+    bool ret = pos_index_remove(uid, pos);
     assert(ret);
-    assert(kh_size(s_postable) == s_postree.nrecs);
+    (void)ret;
+    bin_remove(uid);
+    assert(s_postable.size == pos_index_size());
+}
+
+void G_Pos_UpdateFlags(uint32_t uid, uint32_t old_flags, uint32_t new_flags)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if((old_flags & ENTITY_FLAG_MOVABLE) || !(new_flags & ENTITY_FLAG_MOVABLE))
+        return;
+
+    const vec3_t *curr = table_get(&s_postable, uid);
+    if(!curr)
+        return;
+
+    bool packed = (kh_get(uid, s_static_ents, uid) != kh_end(s_static_ents));
+    bool pending = (kh_get(uid, s_pending_ents, uid) != kh_end(s_pending_ents));
+    if(!packed && !pending)
+        return;
+
+    /* The entity is now held in the dynamic index only */
+    if(packed) {
+        if(!index_insert(&s_postree, *curr, uid))
+            return;
+        kh_del(uid, s_static_ents, kh_get(uid, s_static_ents, uid));
+    }else{
+        kh_del(uid, s_pending_ents, kh_get(uid, s_pending_ents, uid));
+    }
+    s_static_dirty = true;
+    assert(s_postable.size == pos_index_size());
 }
 
 void G_Pos_Garrison(uint32_t uid)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    khiter_t k = kh_get(pos, s_postable, uid);
-    assert(k != kh_end(s_postable));
-    vec3_t old_pos = kh_val(s_postable, k);
+    vec3_t old_pos = G_Pos_Get(uid);
     float vrange = G_GetVisionRange(uid);
 
     G_Combat_RemoveRef(G_GetFactionID(uid), (vec2_t){old_pos.x, old_pos.z});
@@ -223,14 +1190,13 @@ void G_Pos_Ungarrison(uint32_t uid, vec3_t pos)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    khiter_t k = kh_get(pos, s_postable, uid);
-    assert(k != kh_end(s_postable));
+    vec3_t old_pos = G_Pos_Get(uid);
+    pos_index_move(uid, old_pos, pos);
+    bin_move(uid, pos);
 
-    vec3_t old_pos = kh_val(s_postable, k);
-    qt_ent_delete(&s_postree, old_pos.x, old_pos.z, uid);
-    qt_ent_insert(&s_postree, pos.x, pos.z, uid);
-
-    kh_val(s_postable, k) = pos;
+    table_set(&s_postable, uid, pos);
+    Entity_InvalidateOBB(uid);
+    G_ResourceIndex_UpdatePos(uid, (vec2_t){pos.x, pos.z});
     float vrange = G_GetVisionRange(uid);
 
     G_Combat_AddRef(G_GetFactionID(uid), (vec2_t){pos.x, pos.z});
@@ -242,9 +1208,7 @@ bool G_Pos_Init(const struct map *map)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    if(NULL == (s_postable = kh_init(pos)))
-        return false;
-    if(kh_resize(pos, s_postable, POSBUF_INIT_SIZE) < 0)
+    if(!table_init(&s_postable, POSBUF_INIT_SIZE))
         return false;
 
     struct map_resolution res;
@@ -257,28 +1221,115 @@ bool G_Pos_Init(const struct map *map)
     float zmin = center.z - (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
     float zmax = center.z + (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
 
-    qt_ent_init(&s_postree, xmin, xmax, zmin, zmax, uids_equal);
-    if(!qt_ent_reserve(&s_postree, POSBUF_INIT_SIZE)) {
-        kh_destroy(pos, s_postable);
-        return false;
+    enum pos_index_type type = POS_INDEX_QUADTREE;
+    struct sval setting;
+    if(Settings_Get("pf.game.position_index", &setting) == SS_OKAY) {
+        type = setting.as_int;
     }
 
+    if(!index_init(&s_postree, type, xmin, xmax, zmin, zmax))
+        goto fail_index;
+
+    s_static_ents = kh_init(uid);
+    if(!s_static_ents)
+        goto fail_static;
+
+    s_pending_ents = kh_init(uid);
+    if(!s_pending_ents)
+        goto fail_pending;
+
+    if(!bins_init(&res))
+        goto fail_bins;
+
+    s_xmin = xmin;
+    s_xmax = xmax;
+    s_zmin = zmin;
+    s_zmax = zmax;
+    s_static = NULL;
+    s_static_dirty = false;
     return true;
+
+fail_bins:
+    kh_destroy(uid, s_pending_ents);
+fail_pending:
+    kh_destroy(uid, s_static_ents);
+fail_static:
+    index_destroy(&s_postree);
+fail_index:
+    table_destroy(&s_postable);
+    return false;
 }
 
 void G_Pos_Shutdown(void)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    kh_destroy(pos, s_postable);
-    qt_ent_destroy(&s_postree);
+    static_release(s_static);
+    s_static = NULL;
+    bins_destroy();
+    kh_destroy(uid, s_pending_ents);
+    kh_destroy(uid, s_static_ents);
+    table_destroy(&s_postable);
+    index_destroy(&s_postree);
+}
+
+size_t G_Pos_NumBins(void)
+{
+    return s_nbins;
+}
+
+const struct pos_bin *G_Pos_Bin(size_t idx)
+{
+    assert(idx < s_nbins);
+    return &s_bins[idx];
+}
+
+bool G_Pos_BinBounds(size_t idx, struct aabb *out)
+{
+    assert(idx < s_nbins);
+    const struct pos_bin *bin = &s_bins[idx];
+
+    if(idx == s_nbins - 1 || bin->count == 0)
+        return false;
+
+    int col = idx % s_bin_cols;
+    int row = idx / s_bin_cols;
+
+    *out = (struct aabb){
+        .x_min = s_xmin + col * s_bin_w - bin->radius,
+        .x_max = s_xmin + (col + 1) * s_bin_w + bin->radius,
+        .y_min = bin->ymin - bin->radius,
+        .y_max = bin->ymax + bin->radius,
+        .z_min = s_zmin + row * s_bin_h - bin->radius,
+        .z_max = s_zmin + (row + 1) * s_bin_h + bin->radius,
+    };
+    return true;
+}
+
+void G_Pos_BinSetRadius(size_t idx, float radius)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(idx < s_nbins);
+
+    s_bins[idx].radius = radius;
+    s_bins[idx].dirty = false;
+}
+
+void G_Pos_InvalidateBin(uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    khiter_t k = kh_get(binref, s_binrefs, uid);
+    if(k == kh_end(s_binrefs))
+        return;
+    s_bins[kh_value(s_binrefs, k) >> 32].dirty = true;
 }
 
 int G_Pos_EntsInRect(vec2_t xz_min, vec2_t xz_max, uint32_t *out, size_t maxout)
 {
     PERF_ENTER();
-    int ret = qt_ent_inrange_rect(&s_postree, 
-        xz_min.x, xz_max.x, xz_min.z, xz_max.z, out, maxout);
+    struct pos_area area = area_rect(xz_min, xz_max);
+    int ret = pos_query(NULL, POS_SCOPE_ALL, &area, out, maxout);
     ret = filter_garrisoned(NULL, out, ret);
     PERF_RETURN(ret);
 }
@@ -291,8 +1342,8 @@ int G_Pos_EntsInRectWithPred(vec2_t xz_min, vec2_t xz_max, uint32_t *out, size_t
 
     STALLOC(uint32_t, ent_ids, maxout);
 
-    int ntotal = qt_ent_inrange_rect(&s_postree, 
-        xz_min.x, xz_max.x, xz_min.z, xz_max.z, ent_ids, maxout);
+    struct pos_area area = area_rect(xz_min, xz_max);
+    int ntotal = pos_query(NULL, POS_SCOPE_ALL, &area, ent_ids, maxout);
     ntotal = filter_garrisoned(NULL, ent_ids, ntotal);
     int ret = 0;
 
@@ -312,8 +1363,8 @@ int G_Pos_EntsInCircle(vec2_t xz_point, float range, uint32_t *out, size_t maxou
 {
     PERF_ENTER();
     ASSERT_IN_MAIN_THREAD();
-    int ret = qt_ent_inrange_circle(&s_postree, 
-        xz_point.x, xz_point.z, range, out, maxout);
+    struct pos_area area = area_circle(xz_point, range);
+    int ret = pos_query(NULL, POS_SCOPE_ALL, &area, out, maxout);
     ret = filter_garrisoned(NULL, out, ret);
     PERF_RETURN(ret);
 }
@@ -322,35 +1373,65 @@ int G_Pos_EntsInCircleWithPred(vec2_t xz_point, float range, uint32_t *out, size
                                bool (*predicate)(uint32_t ent, void *arg), void *arg)
 {
     ASSERT_IN_MAIN_THREAD();
-    return G_Pos_EntsInCircleWithPredFrom(&s_postree, NULL, xz_point, range, out, maxout, predicate, arg);
+    return G_Pos_EntsInCircleWithPredFrom(NULL, NULL, xz_point, range, out, maxout, predicate, arg);
 }
 
-qt_ent_t *G_Pos_CopyQuadTree(void)
+static int pos_scoped_with_pred(enum pos_scope scope, vec2_t xz_point, float range, 
+                                uint32_t *out, size_t maxout,
+                                bool (*predicate)(uint32_t ent, void *arg), void *arg)
 {
-    qt_ent_t *ret = malloc(sizeof(qt_ent_t));
-    if(!ret)
-        return NULL;
-    qt_ent_copy(&s_postree, ret);
+    assert(Sched_UsingBigStack());
+
+    STALLOC(uint32_t, ent_ids, maxout);
+
+    struct pos_area area = area_circle(xz_point, range);
+    int ntotal = pos_query(NULL, scope, &area, ent_ids, maxout);
+    ntotal = filter_garrisoned(NULL, ent_ids, ntotal);
+    int ret = 0;
+
+    for(int i = 0; i < ntotal; i++) {
+
+        uint32_t curr = ent_ids[i];
+        if(!predicate(curr, arg))
+            continue;
+
+        out[ret++] = curr;
+    }
+
+    STFREE(ent_ids);
     return ret;
 }
 
-void G_Pos_DestroyQuadTree(qt_ent_t *tree)
+int G_Pos_StaticEntsInCircleWithPred(vec2_t xz_point, float range, uint32_t *out, size_t maxout,
+                                     bool (*predicate)(uint32_t ent, void *arg), void *arg)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+    int ret = pos_scoped_with_pred(POS_SCOPE_STATIC, xz_point, range, out, maxout, predicate, arg);
+    PERF_RETURN(ret);
+}
+
+int G_Pos_DynamicEntsInCircleWithPred(vec2_t xz_point, float range, uint32_t *out, size_t maxout,
+                                      bool (*predicate)(uint32_t ent, void *arg), void *arg)
 {
-    qt_ent_destroy(tree);
-    free(tree);
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+    int ret = pos_scoped_with_pred(POS_SCOPE_DYNAMIC, xz_point, range, out, maxout, predicate, arg);
+    PERF_RETURN(ret);
 }
 
-int G_Pos_EntsInCircleFrom(qt_ent_t *tree, khash_t(id) *flags, vec2_t xz_point, float range, 
-                           uint32_t *out, size_t maxout)
+int G_Pos_EntsInCircleFrom(const struct pos_snapshot *snap, khash_t(id) *flags, vec2_t xz_point, 
+                           float range, uint32_t *out, size_t maxout)
 {
     PERF_ENTER();
-    int ret = qt_ent_inrange_circle(tree, xz_point.x, xz_point.z, range, out, maxout);
+    struct pos_area area = area_circle(xz_point, range);
+    int ret = pos_query(snap, POS_SCOPE_ALL, &area, out, maxout);
     ret = filter_garrisoned(flags, out, ret);
     PERF_RETURN(ret);
 }
 
-int G_Pos_EntsInCircleWithPredFrom(qt_ent_t *tree, khash_t(id) *flags, vec2_t xz_point, float range, 
-                                   uint32_t *out, size_t maxout,
+int G_Pos_EntsInCircleWithPredFrom(const struct pos_snapshot *snap, khash_t(id) *flags, 
+                                   vec2_t xz_point, float range, uint32_t *out, size_t maxout,
                                    bool (*predicate)(uint32_t ent, void *arg), void *arg)
 {
     PERF_ENTER();
@@ -358,8 +1439,8 @@ int G_Pos_EntsInCircleWithPredFrom(qt_ent_t *tree, khash_t(id) *flags, vec2_t xz
 
     STALLOC(uint32_t, ent_ids, maxout);
 
-    int ntotal = qt_ent_inrange_circle(tree, 
-        xz_point.x, xz_point.z, range, ent_ids, maxout);
+    struct pos_area area = area_circle(xz_point, range);
+    int ntotal = pos_query(snap, POS_SCOPE_ALL, &area, ent_ids, maxout);
     ntotal = filter_garrisoned(flags, ent_ids, ntotal);
     int ret = 0;
 
@@ -385,7 +1466,7 @@ uint32_t G_Pos_NearestWithPred(vec2_t xz_point,
     assert(Sched_UsingBigStack());
 
     uint32_t ent_ids[MAX_SEARCH_ENTS];
-    const float qt_len = MAX(s_postree.xmax - s_postree.xmin, s_postree.ymax - s_postree.ymin);
+    const float qt_len = index_len(&s_postree);
     float len = (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / 8.0f;
 
     if(max_range == 0.0) {
@@ -398,8 +1479,8 @@ uint32_t G_Pos_NearestWithPred(vec2_t xz_point,
         float min_dist = FLT_MAX;
         uint32_t ret = NULL_UID;
 
-        int num_cands = qt_ent_inrange_circle(&s_postree, xz_point.x, xz_point.z,
-            len, ent_ids, ARR_SIZE(ent_ids));
+        struct pos_area area = area_circle(xz_point, len);
+        int num_cands = pos_query(NULL, POS_SCOPE_ALL, &area, ent_ids, ARR_SIZE(ent_ids));
         num_cands = filter_garrisoned(NULL, ent_ids, num_cands);
 
         for(int i = 0; i < num_cands; i++) {
@@ -437,25 +1518,34 @@ void G_Pos_Upload(void)
 {
     PERF_ENTER();
 
-    const size_t max_ents = kh_size(s_postable);
+    const size_t max_ents = s_postable.size;
     struct render_workspace *ws = G_GetSimWS();
     vec3_t *buff = stalloc(&ws->args, max_ents * sizeof(vec3_t));
     uint32_t *gpu_idbuff = stalloc(&ws->args, max_ents * sizeof(uint32_t));
 
-    uint32_t uid;
-    vec3_t curr;
     size_t nents = 0;
 
-    kh_foreach(s_postable, uid, curr, {
+    for(size_t i = 0; i < s_postable.npages; i++) {
 
-        uint32_t gpu_id = G_GPUIDForEnt(uid);
-        if(gpu_id == 0)
+        const struct pos_page *page = s_postable.pages[i];
+        if(!page)
             continue;
 
-        buff[nents] = curr;
-        gpu_idbuff[nents] = gpu_id;
-        nents++;
-    });
+        for(int j = 0; j < POS_PAGE_SIZE; j++) {
+
+            if(!(page->valid[j / 32] & (1u << (j % 32))))
+                continue;
+
+            uint32_t uid = (i << POS_PAGE_SHIFT) | j;
+            uint32_t gpu_id = G_GPUIDForEnt(uid);
+            if(gpu_id == 0)
+                continue;
+
+            buff[nents] = page->pos[j];
+            gpu_idbuff[nents] = gpu_id;
+            nents++;
+        }
+    }
     assert(nents == kh_size(G_GetDynamicEntsSet()));
 
     R_PushCmd((struct rcmd){
@@ -472,3 +1562,8 @@ void G_Pos_Upload(void)
     PERF_RETURN_VOID();
 }
 
+void G_Pos_BenchmarkIndices(size_t nents, int nticks, struct pos_bench_result out[2])
+{
+    bench_index(POS_INDEX_QUADTREE, nents, nticks, &out[POS_INDEX_QUADTREE]);
+    bench_index(POS_INDEX_GRID, nents, nticks, &out[POS_INDEX_GRID]);
+}
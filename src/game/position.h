@@ -40,34 +40,99 @@
 #include "../pf_math.h"
 #include "../lib/public/khash.h"
 #include "../lib/public/quadtree.h"
+#include "../lib/public/spatial_grid.h"
 
 struct map;
+struct aabb;
 
 QUADTREE_TYPE(ent, uint32_t)
 QUADTREE_PROTOTYPES(extern, ent, uint32_t)
 
+SPATIAL_GRID_TYPE(ent, uint32_t)
+SPATIAL_GRID_PROTOTYPES(extern, ent, uint32_t)
+
+/* Backed by the index selected by the 'pf.game.position_index' 
+ * setting at the time the map is loaded. */
+struct pos_index{
+    enum pos_index_type type;
+    union{
+        qt_ent_t qt;
+        sg_ent_t sg;
+    };
+};
+
+
+/* A uid-indexed table of positions, split into fixed-size pages 
+ * that can be shared between copies of the table. */
+struct pos_table{
+    size_t            size;
+    size_t            npages;
+    struct pos_page **pages;
+};
+
+/* A consistent view of all entity positions at the time it was acquired. 
+ * Acquiring a snapshot is cheap: the pages of the position table (and the 
+ * cells of the grid index) are shared with the live state and are only 
+ * copied when either side writes to them. Snapshots must be acquired, 
+ * modified and released from the main thread, but can be read from any 
+ * thread. */
+struct pos_static;
+
+/* The static index is immutable and shared with the live state. Only the 
+ * positions of movable entities may be changed in a snapshot. */
+struct pos_snapshot{
+    struct pos_table   table;
+    struct pos_index   index;
+    struct pos_static *statics;
+};
+
+/* The entities whose positions fall within one map chunk. The height range 
+ * of the positions only grows until the bin is emptied. The radius bounds the 
+ * extent of the entities about their positions and is left to the owner of 
+ * the bounds to refresh once the bin is marked dirty. */
+struct pos_bin{
+    uint32_t *uids;
+    uint32_t  count, cap;
+    float     ymin, ymax;
+    float     radius;
+    bool      dirty;
+};
+
 KHASH_DECLARE(pos, khint32_t, vec3_t)
 
 bool      G_Pos_Init(const struct map *map);
 void      G_Pos_Shutdown(void);
 void      G_Pos_Delete(uint32_t uid);
+/* Entities which become movable are moved out of the static index */
+void      G_Pos_UpdateFlags(uint32_t uid, uint32_t old_flags, uint32_t new_flags);
 void      G_Pos_Upload(void);
 
-qt_ent_t *G_Pos_CopyQuadTree(void);
-void      G_Pos_DestroyQuadTree(qt_ent_t *tree);
-int       G_Pos_EntsInCircleFrom(qt_ent_t *tree, khash_t(id) *flags, vec2_t xz_point, float range, 
+struct pos_snapshot *G_Pos_AcquireSnapshot(void);
+void      G_Pos_ReleaseSnapshot(struct pos_snapshot *snap);
+bool      G_Pos_SnapshotSet(struct pos_snapshot *snap, uint32_t uid, vec3_t pos);
+vec3_t    G_Pos_GetFrom(const struct pos_snapshot *snap, uint32_t uid);
+vec2_t    G_Pos_GetXZFrom(const struct pos_snapshot *snap, uint32_t uid);
+
+/* A NULL snapshot refers to the live position state */
+int       G_Pos_EntsInCircleFrom(const struct pos_snapshot *snap, khash_t(id) *flags, 
+                                 vec2_t xz_point, float range, 
                                  uint32_t *out, size_t maxout);
-int       G_Pos_EntsInCircleWithPredFrom(qt_ent_t *tree, khash_t(id) *flags, 
+int       G_Pos_EntsInCircleWithPredFrom(const struct pos_snapshot *snap, khash_t(id) *flags, 
                                          vec2_t xz_point, float range, 
                                          uint32_t *out, size_t maxout,
                                          bool (*predicate)(uint32_t ent, void *arg), void *arg);
 
-khash_t(pos) *G_Pos_CopyTable(void);
-vec3_t        G_Pos_GetFrom(khash_t(pos) *table, uint32_t uid);
-vec2_t        G_Pos_GetXZFrom(khash_t(pos) *table, uint32_t uid);
-
 void      G_Pos_Garrison(uint32_t uid);
 void      G_Pos_Ungarrison(uint32_t uid, vec3_t pos);
 
+/* The last bin holds the entities positioned outside of the map bounds, 
+ * and has no bounds of its own. */
+size_t    G_Pos_NumBins(void);
+const struct pos_bin *G_Pos_Bin(size_t idx);
+bool      G_Pos_BinBounds(size_t idx, struct aabb *out);
+void      G_Pos_BinSetRadius(size_t idx, float radius);
+/* Marks the bin of the entity dirty after a change of its bounds */
+void      G_Pos_InvalidateBin(uint32_t uid);
+
 #endif
 
@@ -38,10 +38,12 @@
 
 #include "../../entity.h"
 #include "../../map/public/map.h"
+#include "../../render/public/render.h"
 #include "../../lib/public/vec.h"
 #include "../../lib/public/khash.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <SDL.h>
 
 
@@ -89,6 +91,15 @@ enum simstate{
     G_ALL               = G_RUNNING | G_PAUSED_FULL | G_PAUSED_UI_RUNNING
 };
 
+/* The shadow casters of a single cascade, culled against its' light-space box */
+struct cascade_input{
+    struct frustum      frustum;
+    vec_rstat_t         light_vis_stat;
+    vec_ranim_t         light_vis_anim;
+    vec_rstat_t         light_vis_static;
+    uint64_t            static_shadow_hash;
+};
+
 struct render_input{
     const struct camera *cam;
     const struct map    *map;
@@ -97,10 +108,39 @@ struct render_input{
     /* The visible entities to render */
     vec_rstat_t         cam_vis_stat;
     vec_ranim_t         cam_vis_anim;
+    /* The animated entities too small on screen to be worth skinning, drawn 
+     * as sprites instead. Those fading in are also part of 'cam_vis_anim'. 
+     * They cast no shadows. */
+    vec_rimp_t          cam_vis_imp;
     /* The entities 'visible' from the light source PoV. They are 
      * used for rendering the shadow map. */
     vec_rstat_t         light_vis_stat;
     vec_ranim_t         light_vis_anim;
+    /* The light-visible entities which never move. Together with the map,
+     * they make up the cached static shadow layer, which is only redrawn 
+     * when 'static_shadow_hash' or the light transform changes. */
+    vec_rstat_t         light_vis_static;
+    uint64_t            static_shadow_hash;
+    /* The shadow map is split into 'ncascades' cascades. With more than one
+     * cascade, each gets its' own subset of the light-visible entities. With 
+     * a single one, the lists above are used as-is. */
+    int                 ncascades;
+    struct shadow_cascade cascades[R_SHADOW_MAX_CASCADES];
+    struct cascade_input cascade_in[R_SHADOW_MAX_CASCADES];
+    /* When set, the batched static entities are additionally culled 
+     * per-instance against these frusta on the GPU. */
+    bool                gpu_culling;
+    struct frustum      cam_frustum;
+    struct frustum      light_frustum;
+    /* When set, the depth buffer is captured for occlusion culling once 
+     * the terrain has been drawn. */
+    bool                occlusion_capture;
+    /* When set, the depth of the opaque batched entities is written 
+     * before the terrain and the entities are shaded. */
+    bool                depth_prepass;
+    /* When set, the distant terrain chunks are drawn with their reduced-
+     * detail meshes. */
+    bool                terrain_lod;
 };
 
 enum hb_mode{
@@ -116,6 +156,12 @@ enum formation_type{
     FORMATION_MAX
 };
 
+enum order_type{
+    ORDER_MOVE,
+    ORDER_ATTACK,
+    ORDER_STOP
+};
+
 /*###########################################################################*/
 /* GAME GENERAL                                                              */
 /*###########################################################################*/
@@ -132,6 +178,9 @@ void            G_ClearRenderWork(void);
 void            G_Update(void);
 void            G_Render(void);
 void            G_SwapBuffers(void);
+/* Set how many frames the simulation may run ahead of the render thread.
+ * Waits for the render thread to become idle if the latency changes. */
+void            G_SetFrameLatency(int nframes);
 
 /* This does not have any side effects besides  making draw calls, 
  * so it is safe to invoke from the render thread. 
@@ -147,7 +196,16 @@ void            G_SetMinimapRenderAllEntities(bool on);
 bool            G_MouseOverMinimap(void);
 bool            G_MouseInTargetMode(void);
 bool            G_MapHeightAtPoint(vec2_t xz, float *out_height);
+size_t          G_MapRaycastBatch(size_t nrays, const vec3_t origins[], const vec3_t dirs[],
+                                  const float max_dists[], struct map_ray_hit out[]);
 bool            G_MapClosestPathable(vec2_t xz, vec2_t *out, enum nav_layer layer);
+/* Compare the priority queues used for the field integration on the current map.
+ * Returns false if there is no map loaded. */
+/* Build the water and/or air navigation layers of the current map ahead of time, 
+ * instead of when the first entity that needs them is added. */
+bool            G_MapPreloadNavLayers(bool water, bool air);
+bool            G_MapBenchmarkNavQueues(enum nav_layer layer, int nruns, 
+                                        struct nav_queue_bench_result out[NAV_BENCH_NQUEUES]);
 bool            G_PointInsideMap(vec2_t xz);
 bool            G_PointOverWater(vec2_t xz);
 bool            G_PointOverLand(vec2_t xz);
@@ -155,6 +213,8 @@ bool            G_PointOverLand(vec2_t xz);
 void            G_BakeNavDataForScene(void);
 
 bool            G_AddEntity(uint32_t uid, uint32_t flags, vec3_t pos);
+/* Grow the entity tables to fit 'count' more entities without rehashing */
+bool            G_ReserveEntities(size_t count);
 bool            G_RemoveEntity(uint32_t uid);
 void            G_StopEntity(uint32_t uid, bool stop_move, bool stop_garrison);
 void            G_UpdateBounds(uint32_t uid);
@@ -191,6 +251,8 @@ void            G_MoveActiveCamera(vec2_t xz_ground_pos);
 
 bool            G_UpdateMinimapChunk(int chunk_r, int chunk_c);
 bool            G_UpdateTile(const struct tile_desc *desc, const struct tile *tile);
+void            G_BeginTileEdits(void);
+void            G_EndTileEdits(void);
 bool            G_GetTile(const struct tile_desc *desc, struct tile *out);
 
 void            G_SetSimState(enum simstate ss);
@@ -247,6 +309,7 @@ void                  G_Sel_Set(uint32_t *ents, size_t nents);
 void G_Move_SetMoveOnLeftClick(void);
 void G_Move_SetAttackOnLeftClick(void);
 void G_Move_SetDest(uint32_t uid, vec2_t dest_xz, bool attack);
+void G_Move_SetDestBatch(const uint32_t *uids, size_t nents, vec2_t dest_xz, bool attack);
 void G_Move_UpdateSelectionRadius(uint32_t uid, float sel_radius);
 bool G_Move_Still(uint32_t uid);
 void G_Move_SetClickEnabled(bool on);
@@ -298,6 +361,19 @@ enum combat_stance G_Combat_GetStance(uint32_t uid);
 /* GAME POSITION                                                             */
 /*###########################################################################*/
 
+enum pos_index_type{
+    POS_INDEX_QUADTREE,
+    POS_INDEX_GRID,
+};
+
+struct pos_bench_result{
+    double insert_ms;
+    double move_ms;
+    double query_ms;
+    double copy_ms;
+    size_t nfound;
+};
+
 bool           G_Pos_Set(uint32_t uid, vec3_t pos);
 vec3_t         G_Pos_Get(uint32_t uid);
 vec2_t         G_Pos_GetXZ(uint32_t uid);
@@ -308,12 +384,25 @@ int            G_Pos_EntsInRectWithPred(vec2_t xz_min, vec2_t xz_max, uint32_t *
 int            G_Pos_EntsInCircle(vec2_t xz_point, float range, uint32_t *out, size_t maxout);
 int            G_Pos_EntsInCircleWithPred(vec2_t xz_point, float range, uint32_t *out, size_t maxout,
                                   bool (*predicate)(uint32_t ent, void *arg), void *arg);
+/* Restrict the search to the entities which weren't movable when they were first 
+ * positioned (buildings, resources, etc.) or to the rest of the entities */
+int            G_Pos_StaticEntsInCircleWithPred(vec2_t xz_point, float range, 
+                                                uint32_t *out, size_t maxout,
+                                                bool (*predicate)(uint32_t ent, void *arg), void *arg);
+int            G_Pos_DynamicEntsInCircleWithPred(vec2_t xz_point, float range, 
+                                                 uint32_t *out, size_t maxout,
+                                                 bool (*predicate)(uint32_t ent, void *arg), void *arg);
 
 uint32_t       G_Pos_Nearest(vec2_t xz_point);
 uint32_t       G_Pos_NearestWithPred(vec2_t xz_point, 
                                      bool (*predicate)(uint32_t ent, void *arg), 
                                      void *arg, float max_range);
 
+/* Run the same sequence of inserts, moves, radius queries and copies of 
+ * 'nents' random positions against both index backends. out[] is indexed 
+ * by 'enum pos_index_type'. */
+void           G_Pos_BenchmarkIndices(size_t nents, int nticks, struct pos_bench_result out[2]);
+
 /*###########################################################################*/
 /* GAME FOG-OF-WAR                                                           */
 /*###########################################################################*/
@@ -523,9 +612,29 @@ void G_Garrison_SetEvictOnLeftClick(void);
 /*###########################################################################*/
 
 void G_Automation_GetIdle(vec_entity_t *out);
+void G_Automation_GetIdleForFaction(int faction_id, vec_entity_t *out);
 bool G_Automation_IsIdle(uint32_t uid);
 void G_Automation_SetAutomaticTransport(uint32_t uid, bool on);
 bool G_Automation_GetAutomaticTransport(uint32_t uid);
 
+/*###########################################################################*/
+/* GAME TIMER                                                                */
+/*###########################################################################*/
+
+/* Invoked for every elapsed real 60Hz timer interval */
+void G_Timer_Tick(void);
+/* Runs one of the queued simulation ticks, if any. Returns true if the 
+ * current frame should be rendered. */
+bool G_Timer_BeginFrame(void);
+/* Whether the current frame is skipped because nothing visible changed */
+bool G_Timer_FrameIdle(void);
+/* Make sure the next frame is rendered, even if it otherwise looks idle */
+void G_Timer_MarkDirty(void);
+/* The longest time in milliseconds an idle frame may get skipped for. Zero 
+ * renders every frame. */
+bool G_Timer_SetIdleMaxLatency(int ms);
+bool G_Timer_SetSpeed(int speed);
+int  G_Timer_GetSpeed(void);
+
 #endif
 
@@ -59,6 +59,11 @@
 #define MAX(a, b)    ((a) > (b) ? (a) : (b))
 #define ARR_SIZE(a)  (sizeof(a)/sizeof(a[0]))
 #define EPSILON      (1.0f/1024)
+#define MIN(a, b)    ((a) < (b) ? (a) : (b))
+#define CLAMP(a, min, max) (MIN(MAX((a), (min)), (max)))
+
+#define REGION_BIN_SIZE   (4 * X_COORDS_PER_TILE)
+#define MAX_REGIONS_AT    (512)
 
 #define CHK_TRUE_RET(_pred)             \
     do{                                 \
@@ -72,6 +77,26 @@ VEC_IMPL(static inline, str, const char*)
 VEC_TYPE(uid, uint32_t)
 VEC_IMPL(static inline, uid, uint32_t)
 
+/* A copy of the region's shape is kept alongside the name in every bin 
+ * the region overlaps, so that point queries don't need to go through 
+ * the name table for regions that don't contain the point. 
+ */
+struct region_ref{
+    const char *name;
+    enum region_type type;
+    vec2_t pos;
+    union{
+        float radius;
+        struct{
+            float xlen; 
+            float zlen;
+        };
+    };
+};
+
+VEC_TYPE(ref, struct region_ref)
+VEC_IMPL(static inline, ref, struct region_ref)
+
 struct region{
     enum region_type type;
     union{
@@ -101,9 +126,11 @@ KHASH_SET_INIT_STR(name)
 static const struct map *s_map;
 static khash_t(region)  *s_regions;
 static bool              s_render = false;
-/* Keep track of which regions intersect every chunk, 
- * making a poor man's 2-level tree */
-static vec_str_t        *s_intersecting;
+/* Keep track of which regions overlap every bin of a uniform 
+ * grid laid over the map */
+static vec_ref_t        *s_bins;
+static int               s_bins_w;
+static int               s_bins_h;
 static khash_t(name)    *s_dirty;
 /* Keep the event argument strings around for one tick, so that 
  * they can be used by the event handlers safely */
@@ -113,32 +140,6 @@ static vec_str_t         s_eventargs;
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool region_intersects_chunk(const struct region *reg, struct map_resolution res, struct tile_desc td)
-{
-    struct box chunk = M_Tile_ChunkBounds(res, M_GetPos(s_map), td.chunk_r, td.chunk_c);
-
-    switch(reg->type) {
-    case REGION_CIRCLE: {
-        return C_CircleRectIntersection(reg->pos, reg->radius, chunk);
-    }
-    case REGION_RECTANGLE: {
-        struct box bounds = (struct box) {
-            reg->pos.x + reg->xlen/2.0,
-            reg->pos.z - reg->zlen/2.0,
-            reg->xlen,
-            reg->zlen
-        };
-        return C_RectRectIntersection(bounds, chunk);
-    }
-    default: return (assert(0), false);
-    }
-}
-
-static bool compare_keys(const char **a, const char **b)
-{
-    return *a == *b;
-}
-
 static bool compare_uids(uint32_t *a, uint32_t *b)
 {
     return *a == *b;
@@ -151,50 +152,105 @@ static int compare_uint32s(const void* a, const void* b)
     return (uida - uidb);
 }
 
-static void region_update_intersecting(const char *name, const struct region *reg, int op)
+static bool region_bin_for_point(vec2_t point, int *out_r, int *out_c)
 {
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
+    vec3_t map_pos = M_GetPos(s_map);
+
+    /* Recall X increases to the left in our engine */
+    float dx = map_pos.x - point.x;
+    float dz = point.z - map_pos.z;
+    if(dx < 0.0f || dz < 0.0f)
+        return false;
+
+    int r = dz / REGION_BIN_SIZE;
+    int c = dx / REGION_BIN_SIZE;
+    if(r >= s_bins_h || c >= s_bins_w)
+        return false;
+
+    *out_r = r;
+    *out_c = c;
+    return true;
+}
+
+static bool region_intersects_bin(const struct region *reg, int r, int c)
+{
+    vec3_t map_pos = M_GetPos(s_map);
+    struct box bin = (struct box){
+        map_pos.x - c * REGION_BIN_SIZE,
+        map_pos.z + r * REGION_BIN_SIZE,
+        REGION_BIN_SIZE,
+        REGION_BIN_SIZE
+    };
 
-    int delta = 0;
-    int chunklen = MAX(X_COORDS_PER_TILE * res.chunk_w * res.tile_w, Z_COORDS_PER_TILE * res.chunk_h * res.tile_h);
+    switch(reg->type) {
+    case REGION_CIRCLE:
+        return C_CircleRectIntersection(reg->pos, reg->radius, bin);
+    case REGION_RECTANGLE:
+        /* the bin range is derived from the bounds already */
+        return true;
+    default: return (assert(0), false);
+    }
+}
 
+static void region_update_bins(const char *name, const struct region *reg, int op)
+{
+    vec2_t half = {0};
     switch(reg->type) {
     case REGION_CIRCLE:
-        delta = ceil(reg->radius / chunklen);
+        half = (vec2_t){reg->radius, reg->radius};
         break;
     case REGION_RECTANGLE:
-        delta = MAX(ceil(reg->xlen/2.0f / chunklen), ceil(reg->zlen/2.0f / chunklen));
+        half = (vec2_t){reg->xlen/2.0f, reg->zlen/2.0f};
         break;
     default: assert(0);
     }
 
-    struct tile_desc td;
-    if(!M_Tile_DescForPoint2D(res, M_GetPos(s_map), reg->pos, &td))
+    vec3_t map_pos = M_GetPos(s_map);
+    int cmin = floor((map_pos.x - (reg->pos.x + half.x)) / REGION_BIN_SIZE);
+    int cmax = floor((map_pos.x - (reg->pos.x - half.x)) / REGION_BIN_SIZE);
+    int rmin = floor(((reg->pos.z - half.z) - map_pos.z) / REGION_BIN_SIZE);
+    int rmax = floor(((reg->pos.z + half.z) - map_pos.z) / REGION_BIN_SIZE);
+
+    if(cmax < 0 || rmax < 0 || cmin >= s_bins_w || rmin >= s_bins_h)
         return;
 
-    for(int dr = -delta; dr <= delta; dr++) {
-    for(int dc = -delta; dc <= delta; dc++) {
+    cmin = CLAMP(cmin, 0, s_bins_w - 1);
+    cmax = CLAMP(cmax, 0, s_bins_w - 1);
+    rmin = CLAMP(rmin, 0, s_bins_h - 1);
+    rmax = CLAMP(rmax, 0, s_bins_h - 1);
 
-        struct tile_desc curr = td;
-        if(!M_Tile_RelativeDesc(res, &curr, dc * res.tile_h, dr * res.tile_w))
-            continue;
+    struct region_ref ref = (struct region_ref){
+        .name = name,
+        .type = reg->type,
+        .pos = reg->pos,
+    };
+    if(reg->type == REGION_CIRCLE) {
+        ref.radius = reg->radius;
+    }else{
+        ref.xlen = reg->xlen;
+        ref.zlen = reg->zlen;
+    }
+
+    for(int r = rmin; r <= rmax; r++) {
+    for(int c = cmin; c <= cmax; c++) {
 
-        if(!region_intersects_chunk(reg, res, curr))
+        if(!region_intersects_bin(reg, r, c))
             continue;
 
-        vec_str_t *chunk = &s_intersecting[curr.chunk_r * res.chunk_w + curr.chunk_c];
+        vec_ref_t *bin = &s_bins[r * s_bins_w + c];
 
         switch(op) {
         case REMOVE: {
-            int idx = vec_str_indexof(chunk, name, compare_keys);
-            if(idx != -1) {
-                vec_str_del(chunk, idx);
+            for(int i = 0; i < vec_size(bin); i++) {
+                if(vec_AT(bin, i).name == name) {
+                    vec_ref_del(bin, i);
+                    break;
+                }
             }
             break;
         }
         case ADD: {
-            vec_str_push(chunk, name);
+            vec_ref_push(bin, ref);
             break;
         }
         default: assert(0);
@@ -217,22 +273,22 @@ static bool region_add(const char *name, struct region reg)
         return false;
 
     kh_value(s_regions, k) = reg;
-    region_update_intersecting(key, &reg, ADD);
+    region_update_bins(key, &reg, ADD);
     return true;
 }
 
-static bool region_contains(const struct region *reg, vec2_t point)
+static bool region_ref_contains(const struct region_ref *ref, vec2_t point)
 {
-    switch(reg->type) {
+    switch(ref->type) {
     case REGION_CIRCLE: {
-        return C_PointInsideCircle2D(point, reg->pos, reg->radius);
+        return C_PointInsideCircle2D(point, ref->pos, ref->radius);
     }
     case REGION_RECTANGLE: {
         vec2_t corners[4] = {
-            (vec2_t){reg->pos.x + reg->xlen/2.0f, reg->pos.z - reg->zlen/2.0f},
-            (vec2_t){reg->pos.x - reg->xlen/2.0f, reg->pos.z - reg->zlen/2.0f},
-            (vec2_t){reg->pos.x - reg->xlen/2.0f, reg->pos.z + reg->zlen/2.0f},
-            (vec2_t){reg->pos.x + reg->xlen/2.0f, reg->pos.z + reg->zlen/2.0f},
+            (vec2_t){ref->pos.x + ref->xlen/2.0f, ref->pos.z - ref->zlen/2.0f},
+            (vec2_t){ref->pos.x - ref->xlen/2.0f, ref->pos.z - ref->zlen/2.0f},
+            (vec2_t){ref->pos.x - ref->xlen/2.0f, ref->pos.z + ref->zlen/2.0f},
+            (vec2_t){ref->pos.x + ref->xlen/2.0f, ref->pos.z + ref->zlen/2.0f},
         };
         return C_PointInsideRect2D(point, corners[0], corners[2], corners[1], corners[3]);
     }
@@ -241,50 +297,78 @@ static bool region_contains(const struct region *reg, vec2_t point)
     }
 }
 
-static size_t regions_at_point(vec2_t point, size_t maxout, struct region *out[], 
-                               const char *out_names[])
+/* The returned names are the region table keys, so they can be 
+ * compared by pointer. 
+ */
+static size_t regions_at_point(vec2_t point, size_t maxout, const char *out_names[])
 {
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
-
-    struct tile_desc td;
-    if(!M_Tile_DescForPoint2D(res, M_GetPos(s_map), point, &td))
+    int r, c;
+    if(!region_bin_for_point(point, &r, &c))
         return 0;
 
     size_t ret = 0;
-    vec_str_t *chunk = &s_intersecting[td.chunk_r * res.chunk_w + td.chunk_c];
-    for(int i = 0; i < vec_size(chunk); i++) {
+    const vec_ref_t *bin = &s_bins[r * s_bins_w + c];
+    for(int i = 0; i < vec_size(bin); i++) {
 
         if(ret == maxout)
             break;
 
-        const char *name = vec_AT(chunk, i);
-        khiter_t k = kh_get(region, s_regions, name);
-        assert(k != kh_end(s_regions));
-
-        struct region *reg = &kh_value(s_regions, k);
-        if(!region_contains(reg, point))
+        const struct region_ref *ref = &vec_AT(bin, i);
+        if(!region_ref_contains(ref, point))
             continue;
-
-        out[ret] = reg;
-        out_names[ret] = name;
-        ret++;
+        out_names[ret++] = ref->name;
     }
     return ret;
 }
 
+static bool names_contain(size_t nnames, const char *names[], const char *name)
+{
+    for(int i = 0; i < nnames; i++) {
+        if(names[i] == name)
+            return true;
+    }
+    return false;
+}
+
+static void region_remove_ent(const char *name, uint32_t uid)
+{
+    khiter_t k = kh_get(region, s_regions, name);
+    assert(k != kh_end(s_regions));
+    struct region *reg = &kh_value(s_regions, k);
+
+    int idx = vec_uid_indexof(&reg->curr_ents, uid, compare_uids);
+    if(idx == -1)
+        return;
+    vec_uid_del(&reg->curr_ents, idx);
+    kh_put(name, s_dirty, name, &(int){0});
+}
+
+static void region_add_ent(const char *name, uint32_t uid)
+{
+    khiter_t k = kh_get(region, s_regions, name);
+    assert(k != kh_end(s_regions));
+    struct region *reg = &kh_value(s_regions, k);
+
+    int idx = vec_uid_indexof(&reg->curr_ents, uid, compare_uids);
+    if(idx != -1)
+        return;
+    vec_uid_push(&reg->curr_ents, uid);
+    kh_put(name, s_dirty, name, &(int){0});
+}
+
+static bool region_tracks_ent(uint32_t uid)
+{
+    return G_EntityExists(uid) 
+        && !(G_FlagsGet(uid) & (ENTITY_FLAG_ZOMBIE | ENTITY_FLAG_MARKER));
+}
+
 static void regions_remove_ent(uint32_t uid, vec2_t pos)
 {
-    const char *names[512];
-    struct region *regs[512];
-    size_t nregs = regions_at_point(pos, ARR_SIZE(regs), regs, names);
+    const char *names[MAX_REGIONS_AT];
+    size_t nregs = regions_at_point(pos, ARR_SIZE(names), names);
 
     for(int i = 0; i < nregs; i++) {
-        int idx = vec_uid_indexof(&regs[i]->curr_ents, uid, compare_uids);
-        if(idx == -1)
-            continue;
-        vec_uid_del(&regs[i]->curr_ents, idx);
-        kh_put(name, s_dirty, names[i], &(int){0});
+        region_remove_ent(names[i], uid);
     }
 }
 
@@ -292,21 +376,44 @@ static void regions_add_ent(uint32_t uid, vec2_t pos)
 {
     assert(Sched_UsingBigStack());
 
-    if(!G_EntityExists(uid) || (G_FlagsGet(uid) & (ENTITY_FLAG_ZOMBIE | ENTITY_FLAG_MARKER)))
+    if(!region_tracks_ent(uid))
         return;
 
-    const char *names[512];
-    struct region *regs[512];
-    size_t nregs = regions_at_point(pos, ARR_SIZE(regs), regs, names);
+    const char *names[MAX_REGIONS_AT];
+    size_t nregs = regions_at_point(pos, ARR_SIZE(names), names);
 
     for(int i = 0; i < nregs; i++) {
+        region_add_ent(names[i], uid);
+    }
+}
+
+/* Only the regions that contain exactly one of the two positions are 
+ * touched. An entity that stays within (or outside of) a region doesn't 
+ * cause the region to be re-examined on the next update. 
+ */
+static void regions_move_ent(uint32_t uid, vec2_t oldpos, vec2_t newpos)
+{
+    assert(Sched_UsingBigStack());
 
-        int idx = vec_uid_indexof(&regs[i]->curr_ents, uid, compare_uids);
-        if(idx != -1)
+    const char *old_names[MAX_REGIONS_AT];
+    size_t nold = regions_at_point(oldpos, ARR_SIZE(old_names), old_names);
+
+    const char *new_names[MAX_REGIONS_AT];
+    size_t nnew = 0;
+    if(region_tracks_ent(uid)) {
+        nnew = regions_at_point(newpos, ARR_SIZE(new_names), new_names);
+    }
+
+    for(int i = 0; i < nold; i++) {
+        if(names_contain(nnew, new_names, old_names[i]))
             continue;
+        region_remove_ent(old_names[i], uid);
+    }
 
-        vec_uid_push(&regs[i]->curr_ents, uid);
-        kh_put(name, s_dirty, names[i], &(int){0});
+    for(int i = 0; i < nnew; i++) {
+        if(names_contain(nold, old_names, new_names[i]))
+            continue;
+        region_add_ent(new_names[i], uid);
     }
 }
 
@@ -531,13 +638,15 @@ bool G_Region_Init(const struct map *map)
     struct map_resolution res;
     M_GetResolution(map, &res);
 
-    s_intersecting = calloc(res.chunk_w * res.chunk_h, sizeof(vec_str_t));
-    if(!s_intersecting)
-        goto fail_intersecting;
+    s_bins_w = ceil(res.chunk_w * res.field_w / REGION_BIN_SIZE);
+    s_bins_h = ceil(res.chunk_h * res.field_h / REGION_BIN_SIZE);
 
-    for(int i = 0; i < res.chunk_w * res.chunk_h; i++) {
-        vec_str_t *vec = ((vec_str_t*)s_intersecting) + i;
-        vec_str_init(vec);
+    s_bins = calloc(s_bins_w * s_bins_h, sizeof(vec_ref_t));
+    if(!s_bins)
+        goto fail_bins;
+
+    for(int i = 0; i < s_bins_w * s_bins_h; i++) {
+        vec_ref_init(&s_bins[i]);
     }
 
     vec_str_init(&s_eventargs);
@@ -545,7 +654,7 @@ bool G_Region_Init(const struct map *map)
     s_map = map;
     return true;
 
-fail_intersecting:
+fail_bins:
     kh_destroy(name, s_dirty);
 fail_dirty:
     kh_destroy(region, s_regions);
@@ -555,14 +664,10 @@ fail_regions:
 
 void G_Region_Shutdown(void)
 {
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
-
-    for(int i = 0; i < res.chunk_w * res.chunk_h; i++) {
-        vec_str_t *vec = ((vec_str_t*)s_intersecting) + i;
-        vec_str_destroy(vec);
+    for(int i = 0; i < s_bins_w * s_bins_h; i++) {
+        vec_ref_destroy(&s_bins[i]);
     }
-    PF_FREE(s_intersecting);
+    PF_FREE(s_bins);
 
     const char *key;
     struct region reg;
@@ -645,7 +750,7 @@ void G_Region_Remove(const char *name)
         E_Entity_Notify(EVENT_EXITED_REGION, uid, (void*)arg, ES_ENGINE);
     }
 
-    region_update_intersecting(key, &kh_value(s_regions, k), REMOVE);
+    region_update_bins(key, &kh_value(s_regions, k), REMOVE);
     vec_uid_destroy(&kh_val(s_regions, k).curr_ents);
     vec_uid_destroy(&kh_val(s_regions, k).prev_ents);
     kh_del(region, s_regions, k);
@@ -672,9 +777,9 @@ bool G_Region_SetPos(const char *name, vec2_t pos)
     if(PFM_Vec2_Len(&delta) <= EPSILON)
         return true;
 
-    region_update_intersecting(key, reg, REMOVE);
+    region_update_bins(key, reg, REMOVE);
     reg->pos = pos;
-    region_update_intersecting(key, reg, ADD);
+    region_update_bins(key, reg, ADD);
 
     region_update_ents(key, reg);
     return true;
@@ -757,6 +862,11 @@ void G_Region_AddRef(uint32_t uid, vec2_t newpos)
     regions_add_ent(uid, newpos);
 }
 
+void G_Region_MoveRef(uint32_t uid, vec2_t oldpos, vec2_t newpos)
+{
+    regions_move_ent(uid, oldpos, newpos);
+}
+
 void G_Region_RemoveEnt(uint32_t uid)
 {
     vec2_t pos = G_Pos_GetXZ(uid);
@@ -1064,6 +1174,9 @@ bool G_Region_LoadState(struct SDL_RWops *stream)
         CHK_TRUE_RET(attr.type == TYPE_INT);
         const size_t num_curr = attr.val.as_int;
 
+        /* The saved contents take precedence over the ones that were 
+         * just computed when the region got added */
+        vec_uid_reset(&reg->curr_ents);
         for(int j = 0; j < num_curr; j++) {
 
             struct attr curr;
@@ -49,6 +49,7 @@ bool G_Region_Init(const struct map *map);
 void G_Region_Shutdown(void);
 void G_Region_RemoveRef(uint32_t uid, vec2_t oldpos);
 void G_Region_AddRef(uint32_t uid, vec2_t newpos);
+void G_Region_MoveRef(uint32_t uid, vec2_t oldpos, vec2_t newpos);
 void G_Region_RemoveEnt(uint32_t uid);
 void G_Region_Update(void);
 
@@ -35,8 +35,11 @@
 
 #include "resource.h"
 #include "game_private.h"
+#include "entity_index.h"
 #include "public/game.h"
 #include "storage_site.h"
+#include "resource_id.h"
+#include "resource_index.h"
 #include "../sched.h"
 #include "../event.h"
 #include "../entity.h"
@@ -55,8 +58,6 @@
             return false;               \
     }while(0)
 
-KHASH_MAP_INIT_STR(int, int)
-
 enum resource_state{
     STATE_NORMAL,
     STATE_REPLENISHING,
@@ -70,7 +71,7 @@ struct rstate{
     vec2_t      blocking_pos;
     float       blocking_radius;
     bool        replenishable;
-    kh_int_t   *replenish_resources;
+    struct rtable_int *replenish_resources;
     bool        is_storage_site;
     bool        ss_do_not_take_land;
     bool        ss_do_not_take_water;
@@ -176,21 +177,25 @@ bool G_Resource_AddEntity(uint32_t uid)
         .blocking_pos = G_Pos_GetXZ(uid),
         .blocking_radius = G_GetSelectionRadius(uid),
         .replenishable = false,
-        .replenish_resources = kh_init(int),
+        .replenish_resources = calloc(1, sizeof(struct rtable_int)),
         .is_storage_site = false,
         .ss_do_not_take_land = false,
         .ss_do_not_take_water = false,
         .state = STATE_NORMAL
     };
 
-    if(!rstate_set(uid, rs))
+    if(!rs.replenish_resources)
+        return false;
+    if(!rstate_set(uid, rs)) {
+        free(rs.replenish_resources);
         return false;
+    }
 
     uint32_t flags = G_FlagsGet(uid);
     if(!(flags & ENTITY_FLAG_BUILDING)) {
         M_NavBlockersIncref(rs.blocking_pos, rs.blocking_radius, G_GetFactionID(uid), flags, s_map);
     }
-    return true;
+    return G_EntIndex_AddComponent(uid, ENT_COMP_RESOURCE);
 }
 
 void G_Resource_RemoveEntity(uint32_t uid)
@@ -205,8 +210,10 @@ void G_Resource_RemoveEntity(uint32_t uid)
             flags, s_map);
     }
 
-    kh_destroy(int, rs->replenish_resources);
+    G_ResourceIndex_RemoveResource(uid);
+    free(rs->replenish_resources);
     rstate_remove(uid);
+    G_EntIndex_RemoveComponent(uid, ENT_COMP_RESOURCE);
 }
 
 void G_Resource_UpdateBounds(uint32_t uid)
@@ -273,16 +280,11 @@ bool G_Resource_SetReplenishAmount(uint32_t uid, const char *rname, int amount)
     struct rstate *rs = rstate_get(uid);
     assert(rs);
 
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_ResourceId_Get(rname);
+    if(id < 0)
         return false;
 
-    int status;
-    khiter_t k = kh_put(int, rs->replenish_resources, key, &status);
-    if(status == -1)
-        return false;
-
-    kh_val(rs->replenish_resources, k) = amount;
+    rtable_put(rs->replenish_resources, id, amount);
     return true;
 }
 
@@ -291,15 +293,11 @@ int G_Resource_GetReplenishAmount(uint32_t uid, const char *rname)
     struct rstate *rs = rstate_get(uid);
     assert(rs);
 
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
-    if(!key)
-        return 0;
-
-    khiter_t k = kh_get(int, rs->replenish_resources, key);
-    if(k == kh_end(rs->replenish_resources))
+    int id = G_ResourceId_Find(rname);
+    if(!rtable_has(rs->replenish_resources, id))
         return 0;
 
-    return kh_val(rs->replenish_resources, k);
+    return rs->replenish_resources->vals[id];
 }
 
 void G_Resource_SetReplenishing(uint32_t uid)
@@ -323,22 +321,20 @@ void G_Resource_SetReplenishing(uint32_t uid)
         G_StorageSite_SetDoNotTakeLand(uid, true);
         G_StorageSite_SetDoNotTakeWater(uid, true);
 
-        const char *rname;
-        int amount;
-        kh_foreach(rs->replenish_resources, rname, amount, {
-            G_StorageSite_SetCapacity(uid, rname, amount);
-            G_StorageSite_SetDesired(uid, rname, amount);
+        int id, amount;
+        rtable_foreach(rs->replenish_resources, id, amount, {
+            G_StorageSite_SetCapacity(uid, G_ResourceId_Name(id), amount);
+            G_StorageSite_SetDesired(uid, G_ResourceId_Name(id), amount);
         });
     }else{
         G_StorageSite_SetUseAlt(uid, true);
         G_StorageSite_SetDoNotTakeLand(uid, true);
         G_StorageSite_SetDoNotTakeWater(uid, true);
 
-        const char *rname;
-        int amount;
-        kh_foreach(rs->replenish_resources, rname, amount, {
-            G_StorageSite_SetAltCapacity(uid, rname, amount);
-            G_StorageSite_SetAltDesired(uid, rname, amount);
+        int id, amount;
+        rtable_foreach(rs->replenish_resources, id, amount, {
+            G_StorageSite_SetAltCapacity(uid, G_ResourceId_Name(id), amount);
+            G_StorageSite_SetAltDesired(uid, G_ResourceId_Name(id), amount);
         });
     }
 }
@@ -414,12 +410,14 @@ bool G_Resource_SetName(uint32_t uid, const char *name)
     struct rstate *rs = rstate_get(uid);
     assert(rs);
 
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_ResourceId_Get(name);
+    if(id < 0)
         return false;
 
+    const char *key = G_ResourceId_Name(id);
     rs->name = key;
     kh_put(name, s_all_names, key, &(int){0});
+    G_ResourceIndex_SetResource(uid, id);
     return true;
 }
 
@@ -529,18 +527,18 @@ bool G_Resource_SaveState(struct SDL_RWops *stream)
 
         struct attr num_replenish_resources = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.replenish_resources)
+            .val.as_int = rtable_size(curr.replenish_resources)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_replenish_resources, "num_replenish_resources"));
 
-        const char *key;
-        int value;
-        kh_foreach(curr.replenish_resources, key, value, {
+        int id, value;
+        rtable_foreach(curr.replenish_resources, id, value, {
 
             struct attr resource_name = (struct attr){
                 .type = TYPE_STRING,
             };
-            pf_strlcpy(resource_name.val.as_string, key, sizeof(resource_name.val.as_string));
+            pf_strlcpy(resource_name.val.as_string, G_ResourceId_Name(id),
+                sizeof(resource_name.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &resource_name, "resource_name"));
 
             struct attr resource_amount = (struct attr){
@@ -672,13 +670,14 @@ bool G_Resource_LoadState(struct SDL_RWops *stream)
 
             CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
             CHK_TRUE_RET(attr.type == TYPE_STRING);
-            const char *key = si_intern(attr.val.as_string, &s_stringpool, s_stridx);
+            char key[sizeof(attr.val.as_string)];
+            pf_strlcpy(key, attr.val.as_string, sizeof(key));
 
             CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
             CHK_TRUE_RET(attr.type == TYPE_INT);
             int amount = attr.val.as_int;
 
-            G_Resource_SetReplenishAmount(uid, key, amount);
+            CHK_TRUE_RET(G_Resource_SetReplenishAmount(uid, key, amount));
         }
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
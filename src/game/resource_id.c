@@ -0,0 +1,128 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "resource_id.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/pf_string.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+KHASH_MAP_INIT_STR(id, int)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static khash_t(id)  *s_ids;
+static char         *s_names[MAX_RESOURCE_IDS];
+static int           s_num_ids;
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_ResourceId_Init(void)
+{
+    if(!(s_ids = kh_init(id)))
+        return false;
+    if(0 != kh_resize(id, s_ids, MAX_RESOURCE_IDS * 2)) {
+        kh_destroy(id, s_ids);
+        return false;
+    }
+    s_num_ids = 0;
+    return true;
+}
+
+void G_ResourceId_Shutdown(void)
+{
+    for(int i = 0; i < s_num_ids; i++) {
+        free(s_names[i]);
+        s_names[i] = NULL;
+    }
+    s_num_ids = 0;
+    kh_destroy(id, s_ids);
+    s_ids = NULL;
+}
+
+int G_ResourceId_Find(const char *name)
+{
+    khiter_t k = kh_get(id, s_ids, name);
+    if(k == kh_end(s_ids))
+        return -1;
+    return kh_val(s_ids, k);
+}
+
+int G_ResourceId_Get(const char *name)
+{
+    int ret = G_ResourceId_Find(name);
+    if(ret >= 0)
+        return ret;
+
+    if(s_num_ids == MAX_RESOURCE_IDS)
+        return -1;
+
+    char *copy = pf_strdup(name);
+    if(!copy)
+        return -1;
+
+    int status;
+    khiter_t k = kh_put(id, s_ids, copy, &status);
+    if(status == -1) {
+        free(copy);
+        return -1;
+    }
+    assert(status == 1);
+
+    ret = s_num_ids++;
+    s_names[ret] = copy;
+    kh_val(s_ids, k) = ret;
+    return ret;
+}
+
+const char *G_ResourceId_Name(int id)
+{
+    assert(id >= 0 && id < s_num_ids);
+    return s_names[id];
+}
+
+const char *G_ResourceId_Intern(const char *name)
+{
+    int id = G_ResourceId_Get(name);
+    if(id < 0)
+        return NULL;
+    return s_names[id];
+}
+
@@ -0,0 +1,125 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef RESOURCE_ID_H
+#define RESOURCE_ID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* A registry giving every resource name that the game has seen a dense small 
+ * integer id. The per-entity resource amounts are kept in fixed-size arrays 
+ * indexed by the id, so that only the API boundary has to hash a name. The 
+ * ids live for the lifetime of the game module and are not saved - the 
+ * session files keep refering to resources by name.
+ */
+
+#define MAX_RESOURCE_IDS  (64)
+
+typedef uint64_t rmask_t;
+
+struct rtable_int{
+    rmask_t set;
+    int     vals[MAX_RESOURCE_IDS];
+};
+
+struct rtable_float{
+    rmask_t set;
+    float   vals[MAX_RESOURCE_IDS];
+};
+
+bool        G_ResourceId_Init(void);
+void        G_ResourceId_Shutdown(void);
+/* Returns the id of the resource, registering the name if it has not been 
+ * seen yet. Returns -1 if all the ids are already in use. */
+int         G_ResourceId_Get(const char *name);
+/* Returns the id of a registered resource, or -1 */
+int         G_ResourceId_Find(const char *name);
+const char *G_ResourceId_Name(int id);
+/* Returns the registry's copy of the name, which can be compared by pointer 
+ * and stays valid until shutdown. Returns NULL if the name can't be added. */
+const char *G_ResourceId_Intern(const char *name);
+
+static inline int rmask_pop(rmask_t *mask)
+{
+#if defined(_MSC_VER)
+    unsigned long ret;
+    _BitScanForward64(&ret, *mask);
+#else
+    int ret = __builtin_ctzll(*mask);
+#endif
+    *mask &= *mask - 1;
+    return (int)ret;
+}
+
+static inline int rmask_count(rmask_t mask)
+{
+    int ret = 0;
+    while(mask) {
+        mask &= mask - 1;
+        ret++;
+    }
+    return ret;
+}
+
+#define rtable_has(t, id)       ((id) >= 0 && (((t)->set >> (id)) & 0x1))
+#define rtable_size(t)          (rmask_count((t)->set))
+#define rtable_clear(t)         ((t)->set = 0)
+
+#define rtable_put(t, id, val)                                                  \
+    do{                                                                         \
+        (t)->set |= ((rmask_t)1 << (id));                                       \
+        (t)->vals[(id)] = (val);                                                \
+    }while(0)
+
+#define rtable_del(t, id)       ((t)->set &= ~((rmask_t)1 << (id)))
+
+/* Iterates over the set entries in the order of their ids */
+#define rtable_foreach(t, idvar, vvar, ...)                                     \
+    do{                                                                         \
+        rmask_t __mask = (t)->set;                                              \
+        while(__mask) {                                                         \
+            (idvar) = rmask_pop(&__mask);                                       \
+            (vvar) = (t)->vals[(idvar)];                                        \
+            __VA_ARGS__;                                                        \
+        }                                                                       \
+    }while(0)
+
+#endif
+
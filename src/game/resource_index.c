@@ -0,0 +1,393 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "resource_index.h"
+#include "resource_id.h"
+#include "position.h"
+#include "game_private.h"
+#include "public/game.h"
+#include "../main.h"
+#include "../perf.h"
+#include "../lib/public/khash.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define CELL_SIZE       (8.0f * X_COORDS_PER_TILE)
+#define MAX_CANDIDATES  (4096)
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
+
+struct entry{
+    int    key;
+    vec2_t pos;
+};
+
+/* The grids are only allocated when the first entity with the key is added */
+struct typed_index{
+    bool     init;
+    sg_ent_t grid;
+};
+
+struct candidate{
+    float    dist;
+    uint32_t uid;
+};
+
+KHASH_MAP_INIT_INT(entry, struct entry)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static bool                 s_initialized = false;
+static float                s_xmin, s_xmax, s_zmin, s_zmax;
+
+static struct typed_index   s_resources[MAX_RESOURCE_IDS];
+static struct typed_index   s_storage_sites[MAX_FACTIONS];
+static khash_t(entry)      *s_resource_ents;
+static khash_t(entry)      *s_storage_site_ents;
+
+static uint32_t             s_cand_ids[MAX_CANDIDATES];
+static struct candidate     s_cands[MAX_CANDIDATES];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool uids_equal(const uint32_t *a, const uint32_t *b)
+{
+    return (*a == *b);
+}
+
+static int compare_candidates(const void *a, const void *b)
+{
+    float da = ((const struct candidate*)a)->dist;
+    float db = ((const struct candidate*)b)->dist;
+    if(da < db)
+        return -1;
+    if(da > db)
+        return 1;
+    return 0;
+}
+
+static sg_ent_t *typed_grid(struct typed_index *index)
+{
+    if(index->init)
+        return &index->grid;
+    if(!sg_ent_init(&index->grid, s_xmin, s_xmax, s_zmin, s_zmax, CELL_SIZE, uids_equal))
+        return NULL;
+    index->init = true;
+    return &index->grid;
+}
+
+static void entry_remove(khash_t(entry) *table, struct typed_index *indices, uint32_t uid)
+{
+    khiter_t k = kh_get(entry, table, uid);
+    if(k == kh_end(table))
+        return;
+
+    struct entry ent = kh_val(table, k);
+    sg_ent_delete(&indices[ent.key].grid, ent.pos.x, ent.pos.z, uid);
+    kh_del(entry, table, k);
+}
+
+static void entry_set(khash_t(entry) *table, struct typed_index *indices, 
+                      uint32_t uid, int key)
+{
+    khiter_t k = kh_get(entry, table, uid);
+    if(k != kh_end(table) && kh_val(table, k).key == key)
+        return;
+    entry_remove(table, indices, uid);
+
+    sg_ent_t *grid = typed_grid(&indices[key]);
+    if(!grid)
+        return;
+
+    vec2_t pos = G_Pos_GetXZ(uid);
+    if(!sg_ent_insert(grid, pos.x, pos.z, uid))
+        return;
+
+    int status;
+    k = kh_put(entry, table, uid, &status);
+    if(status == -1) {
+        sg_ent_delete(grid, pos.x, pos.z, uid);
+        return;
+    }
+    kh_val(table, k) = (struct entry){key, pos};
+}
+
+static void entry_move(khash_t(entry) *table, struct typed_index *indices, 
+                       uint32_t uid, vec2_t pos)
+{
+    khiter_t k = kh_get(entry, table, uid);
+    if(k == kh_end(table))
+        return;
+
+    struct entry *ent = &kh_val(table, k);
+    if(ent->pos.x == pos.x && ent->pos.z == pos.z)
+        return;
+
+    if(!sg_ent_move(&indices[ent->key].grid, ent->pos.x, ent->pos.z, pos.x, pos.z, uid)) {
+        sg_ent_delete(&indices[ent->key].grid, ent->pos.x, ent->pos.z, uid);
+        kh_del(entry, table, k);
+        return;
+    }
+    ent->pos = pos;
+}
+
+static bool already_found(const uint32_t *out, int nout, uint32_t uid)
+{
+    for(int i = 0; i < nout; i++) {
+        if(out[i] == uid)
+            return true;
+    }
+    return false;
+}
+
+/* Searches in a circle of doubling radius, the same as G_Pos_NearestWithPred. 
+ * Within each round, the candidates are sorted by distance so that the 
+ * predicate is only evaluated until 'maxout' matches are found. Candidates 
+ * from the previous round are not tested again - all of them were already 
+ * considered.
+ */
+static int nearest_in_grid(const struct typed_index *index, vec2_t xz_point, float max_range,
+                           bool (*predicate)(uint32_t ent, void *arg), void *arg,
+                           uint32_t *out, int maxout)
+{
+    if(!index->init || index->grid.nrecs == 0 || maxout <= 0)
+        return 0;
+
+    const float map_len = MAX(s_xmax - s_xmin, s_zmax - s_zmin);
+    float len = (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / 8.0f;
+    float prev_len = -1.0f;
+    int nout = 0;
+
+    if(max_range == 0.0f) {
+        max_range = map_len;
+    }
+    max_range = MIN(map_len, max_range);
+    len = MIN(len, max_range);
+
+    while(true) {
+
+        int ncands = sg_ent_inrange_circle(&index->grid, xz_point.x, xz_point.z, len, 
+            s_cand_ids, ARR_SIZE(s_cand_ids));
+        int nsorted = 0;
+
+        for(int i = 0; i < ncands; i++) {
+
+            uint32_t curr = s_cand_ids[i];
+            vec2_t delta, pos = G_Pos_GetXZ(curr);
+            PFM_Vec2_Sub(&xz_point, &pos, &delta);
+            float dist = PFM_Vec2_Len(&delta);
+
+            if(dist <= prev_len)
+                continue;
+            s_cands[nsorted++] = (struct candidate){dist, curr};
+        }
+        qsort(s_cands, nsorted, sizeof(s_cands[0]), compare_candidates);
+
+        for(int i = 0; i < nsorted && nout < maxout; i++) {
+
+            uint32_t curr = s_cands[i].uid;
+            if(G_FlagsGet(curr) & ENTITY_FLAG_GARRISONED)
+                continue;
+            if(already_found(out, nout, curr))
+                continue;
+            if(!predicate(curr, arg))
+                continue;
+            out[nout++] = curr;
+        }
+
+        if(nout == maxout)
+            break;
+        if(len == max_range)
+            break;
+
+        prev_len = len;
+        len *= 2.0f;
+        len = MIN(max_range, len);
+    }
+    return nout;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_ResourceIndex_Init(const struct map *map)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(!s_initialized);
+
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+    vec3_t center = M_GetCenterPos(map);
+
+    s_xmin = center.x - (res.tile_w * res.chunk_w * X_COORDS_PER_TILE) / 2.0f;
+    s_xmax = center.x + (res.tile_w * res.chunk_w * X_COORDS_PER_TILE) / 2.0f;
+    s_zmin = center.z - (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
+    s_zmax = center.z + (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
+
+    if(!(s_resource_ents = kh_init(entry)))
+        goto fail_resource_ents;
+    if(!(s_storage_site_ents = kh_init(entry)))
+        goto fail_storage_site_ents;
+
+    memset(s_resources, 0, sizeof(s_resources));
+    memset(s_storage_sites, 0, sizeof(s_storage_sites));
+    s_initialized = true;
+    return true;
+
+fail_storage_site_ents:
+    kh_destroy(entry, s_resource_ents);
+fail_resource_ents:
+    return false;
+}
+
+void G_ResourceIndex_Shutdown(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_initialized)
+        return;
+
+    for(int i = 0; i < ARR_SIZE(s_resources); i++) {
+        if(s_resources[i].init)
+            sg_ent_destroy(&s_resources[i].grid);
+    }
+    for(int i = 0; i < ARR_SIZE(s_storage_sites); i++) {
+        if(s_storage_sites[i].init)
+            sg_ent_destroy(&s_storage_sites[i].grid);
+    }
+    kh_destroy(entry, s_resource_ents);
+    kh_destroy(entry, s_storage_site_ents);
+    s_initialized = false;
+}
+
+void G_ResourceIndex_SetResource(uint32_t uid, int rid)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(rid < MAX_RESOURCE_IDS);
+
+    if(!s_initialized)
+        return;
+
+    if(rid < 0) {
+        entry_remove(s_resource_ents, s_resources, uid);
+        return;
+    }
+    entry_set(s_resource_ents, s_resources, uid, rid);
+}
+
+void G_ResourceIndex_RemoveResource(uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_initialized)
+        return;
+    entry_remove(s_resource_ents, s_resources, uid);
+}
+
+void G_ResourceIndex_SetStorageSite(uint32_t uid, int faction_id)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(faction_id < MAX_FACTIONS);
+
+    if(!s_initialized)
+        return;
+
+    if(faction_id < 0) {
+        entry_remove(s_storage_site_ents, s_storage_sites, uid);
+        return;
+    }
+    entry_set(s_storage_site_ents, s_storage_sites, uid, faction_id);
+}
+
+void G_ResourceIndex_RemoveStorageSite(uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_initialized)
+        return;
+    entry_remove(s_storage_site_ents, s_storage_sites, uid);
+}
+
+void G_ResourceIndex_UpdatePos(uint32_t uid, vec2_t xz_pos)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_initialized)
+        return;
+    entry_move(s_resource_ents, s_resources, uid, xz_pos);
+    entry_move(s_storage_site_ents, s_storage_sites, uid, xz_pos);
+}
+
+int G_ResourceIndex_NearestResources(int rid, vec2_t xz_point, float max_range,
+                                     bool (*predicate)(uint32_t ent, void *arg), void *arg,
+                                     uint32_t *out, int maxout)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_initialized || rid < 0 || rid >= MAX_RESOURCE_IDS)
+        PERF_RETURN(0);
+
+    int ret = nearest_in_grid(&s_resources[rid], xz_point, max_range, 
+        predicate, arg, out, maxout);
+    PERF_RETURN(ret);
+}
+
+int G_ResourceIndex_NearestStorageSites(int faction_id, vec2_t xz_point, float max_range,
+                                        bool (*predicate)(uint32_t ent, void *arg), void *arg,
+                                        uint32_t *out, int maxout)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_initialized || faction_id < 0 || faction_id >= MAX_FACTIONS)
+        PERF_RETURN(0);
+
+    int ret = nearest_in_grid(&s_storage_sites[faction_id], xz_point, max_range, 
+        predicate, arg, out, maxout);
+    PERF_RETURN(ret);
+}
+
@@ -0,0 +1,76 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef RESOURCE_INDEX_H
+#define RESOURCE_INDEX_H
+
+#include "../pf_math.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct map;
+
+/* Spatial indices of the resources of every resource type and of the storage 
+ * sites of every faction. These are much sparser than the general position 
+ * index, so the harvester's nearest-target searches visit only entities that 
+ * can possibly match. Entities are only indexed by type, faction and position. 
+ * Transient state (exhaustion, replenishing, construction, capacity) is still 
+ * left to the query predicate.
+ */
+
+bool G_ResourceIndex_Init(const struct map *map);
+void G_ResourceIndex_Shutdown(void);
+
+/* A negative resource id removes the entity from the resource indices */
+void G_ResourceIndex_SetResource(uint32_t uid, int rid);
+void G_ResourceIndex_RemoveResource(uint32_t uid);
+void G_ResourceIndex_SetStorageSite(uint32_t uid, int faction_id);
+void G_ResourceIndex_RemoveStorageSite(uint32_t uid);
+void G_ResourceIndex_UpdatePos(uint32_t uid, vec2_t xz_pos);
+
+/* Write up to 'maxout' of the nearest entities satisfying the predicate 
+ * to 'out', ordered by increasing distance. A 'max_range' of 0 means the 
+ * search is not bounded. Returns the number of entities written.
+ */
+int  G_ResourceIndex_NearestResources(int rid, vec2_t xz_point, float max_range,
+                                      bool (*predicate)(uint32_t ent, void *arg), void *arg,
+                                      uint32_t *out, int maxout);
+int  G_ResourceIndex_NearestStorageSites(int faction_id, vec2_t xz_point, float max_range,
+                                         bool (*predicate)(uint32_t ent, void *arg), void *arg,
+                                         uint32_t *out, int maxout);
+
+#endif
+
@@ -56,6 +56,8 @@
 #define MIN(a, b)     ((a) < (b) ? (a) : (b))
 #define MAX(a, b)     ((a) > (b) ? (a) : (b))
 
+#define SEL_BATCH_SIZE (256)
+
 #define CHK_TRUE_RET(_pred)             \
     do{                                 \
         if(!(_pred))                    \
@@ -95,6 +97,15 @@ static vec_entity_t  s_selected;
 static bool     s_hovered_dirty = true;
 static uint32_t s_hovered_uid = NULL_UID;
 
+/* The visible bounding boxes are first tested in batches using the packed 
+ * collision kernels. Only the boxes which pass get the exact test and the 
+ * entity flag lookups. */
+static struct sel_batch{
+    float          soa_data[12][SEL_BATCH_SIZE];
+    struct obb_soa soa;
+    bool           mask[SEL_BATCH_SIZE];
+}s_batch;
+
 /*****************************************************************************/
 /* GLOBAL VARIABLES                                                          */
 /*****************************************************************************/
@@ -260,6 +271,25 @@ static void sel_make_frustum(struct camera *cam, vec2_t mouse_down, vec2_t mouse
     PFM_Vec3_Normal(&out->left.normal, &out->left.normal);
 }
 
+static void sel_batch_init(void)
+{
+    for(int i = 0; i < 3; i++) {
+        s_batch.soa.center[i] = s_batch.soa_data[i];
+        for(int j = 0; j < 3; j++) {
+            s_batch.soa.extent[i][j] = s_batch.soa_data[3 + i * 3 + j];
+        }
+    }
+}
+
+static size_t sel_batch_load(const vec_obb_t *obbs, size_t begin)
+{
+    size_t count = MIN(SEL_BATCH_SIZE, vec_size(obbs) - begin);
+    for(size_t i = 0; i < count; i++) {
+        C_OBBSoASet(&s_batch.soa, i, &vec_AT(obbs, begin + i));
+    }
+    return count;
+}
+
 static bool sel_shift_pressed(void)
 {
     const Uint8 *state = SDL_GetKeyboardState(NULL);
@@ -281,44 +311,61 @@ static void sel_compute_hovered(struct camera *cam, const vec_entity_t *visible,
     SDL_GetMouseState(&mouse_x, &mouse_y);
 
     vec3_t ray_origin = sel_unproject_mouse_coords(cam, (vec2_t){mouse_x, mouse_y}, -1.0f);
+    vec3_t ray_far = sel_unproject_mouse_coords(cam, (vec2_t){mouse_x, mouse_y}, 1.0f);
     vec3_t ray_dir;
 
     vec3_t cam_pos = Camera_GetPos(cam);
     PFM_Vec3_Sub(&ray_origin, &cam_pos, &ray_dir);
     PFM_Vec3_Normal(&ray_dir, &ray_dir);
 
+    /* The batched test casts the segment from 'begin' along (begin - end). 
+     * Only the part of the ray inside the view frustum can hit a visible box. */
+    vec3_t seg_delta, seg_end;
+    PFM_Vec3_Sub(&ray_far, &ray_origin, &seg_delta);
+    PFM_Vec3_Sub(&ray_origin, &seg_delta, &seg_end);
+
     float t_min = FLT_MAX;
     s_hovered_uid = NULL_UID;
     bool selectable_hovered = false;
     bool collision_hovered = false;
 
-    for(int i = 0; i < vec_size(visible_obbs); i++) {
+    for(size_t base = 0; base < vec_size(visible_obbs); base += SEL_BATCH_SIZE) {
 
-        if(G_EntityIsZombie(vec_AT(visible, i)))
-            continue;
+        size_t count = sel_batch_load(visible_obbs, base);
+        C_LineSegOBBIntersectionBatch(ray_origin, seg_end, &s_batch.soa, count, s_batch.mask);
 
-        /* Prioritize selectable entities over non-selectable ones */
-        uint32_t flags = G_FlagsGet(vec_AT(visible, i));
-        if(selectable_hovered && !(flags & ENTITY_FLAG_SELECTABLE))
-            continue;
+        for(int j = 0; j < count; j++) {
 
-        /* Prioritize entities with collision over those without */
-        if(collision_hovered && !(flags & ENTITY_FLAG_COLLISION))
-            continue;
+            if(!s_batch.mask[j])
+                continue;
 
-        float t;
-        if(C_RayIntersectsOBB(ray_origin, ray_dir, vec_AT(visible_obbs, i), &t)) {
+            int i = base + j;
+            if(G_EntityIsZombie(vec_AT(visible, i)))
+                continue;
+
+            /* Prioritize selectable entities over non-selectable ones */
+            uint32_t flags = G_FlagsGet(vec_AT(visible, i));
+            if(selectable_hovered && !(flags & ENTITY_FLAG_SELECTABLE))
+                continue;
 
-            bool first_selected = (flags & ENTITY_FLAG_SELECTABLE) && !selectable_hovered;
-            bool first_collision = (flags & ENTITY_FLAG_COLLISION) && !collision_hovered;
+            /* Prioritize entities with collision over those without */
+            if(collision_hovered && !(flags & ENTITY_FLAG_COLLISION))
+                continue;
+
+            float t;
+            if(C_RayIntersectsOBB(ray_origin, ray_dir, vec_AT(visible_obbs, i), &t)) {
 
-            if(t < t_min || (first_selected || (!selectable_hovered && first_collision))) {
-                t_min = t;
-                s_hovered_uid = vec_AT(visible, i);
-                if(flags & ENTITY_FLAG_SELECTABLE)
-                    selectable_hovered = true;
-                if(flags & ENTITY_FLAG_COLLISION)
-                    collision_hovered = true;
+                bool first_selected = (flags & ENTITY_FLAG_SELECTABLE) && !selectable_hovered;
+                bool first_collision = (flags & ENTITY_FLAG_COLLISION) && !collision_hovered;
+
+                if(t < t_min || (first_selected || (!selectable_hovered && first_collision))) {
+                    t_min = t;
+                    s_hovered_uid = vec_AT(visible, i);
+                    if(flags & ENTITY_FLAG_SELECTABLE)
+                        selectable_hovered = true;
+                    if(flags & ENTITY_FLAG_COLLISION)
+                        collision_hovered = true;
+                }
             }
         }
     }
@@ -467,6 +514,7 @@ static void sel_process_unit(uint32_t uid)
 bool G_Sel_Init(void)
 {
     vec_entity_init(&s_selected);
+    sel_batch_init();
     E_Global_Register(SDL_MOUSEMOTION, on_mousemove, NULL, G_RUNNING);
     return true;
 }
@@ -561,24 +609,35 @@ void G_Sel_Update(struct camera *cam, const vec_entity_t *visible, const vec_obb
         struct frustum frust;
         sel_make_frustum(cam, s_ctx.mouse_down_coord, s_ctx.mouse_up_coord, &frust);
 
-        for(int i = 0; i < vec_size(visible_obbs); i++) {
+        for(size_t base = 0; base < vec_size(visible_obbs); base += SEL_BATCH_SIZE) {
 
-            uint32_t flags = G_FlagsGet(vec_AT(visible, i));
-            if(!(flags & ENTITY_FLAG_SELECTABLE))
-                continue;
-            if(flags & ENTITY_FLAG_GARRISONED)
-                continue;
+            /* The batched test only rejects the boxes fully outside of the frustum */
+            size_t count = sel_batch_load(visible_obbs, base);
+            C_FrustumOBBIntersectionBatch(&frust, &s_batch.soa, count, s_batch.mask);
+
+            for(int j = 0; j < count; j++) {
 
-            if(C_FrustumOBBIntersectionExact(&frust, &vec_AT(visible_obbs, i))) {
+                if(!s_batch.mask[j])
+                    continue;
 
-                if(sel_empty) {
-                    sel_empty = false;
-                    if(!sel_shift_pressed() && !sel_ctrl_pressed()) {
-                        vec_entity_reset(&s_selected);
+                int i = base + j;
+                uint32_t flags = G_FlagsGet(vec_AT(visible, i));
+                if(!(flags & ENTITY_FLAG_SELECTABLE))
+                    continue;
+                if(flags & ENTITY_FLAG_GARRISONED)
+                    continue;
+
+                if(C_FrustumOBBIntersectionExact(&frust, &vec_AT(visible_obbs, i))) {
+
+                    if(sel_empty) {
+                        sel_empty = false;
+                        if(!sel_shift_pressed() && !sel_ctrl_pressed()) {
+                            vec_entity_reset(&s_selected);
+                        }
                     }
+                    uint32_t curr = vec_AT(visible, i);
+                    sel_process_unit(curr);
                 }
-                uint32_t curr = vec_AT(visible, i);
-                sel_process_unit(curr);
             }
         }
     }
@@ -34,7 +34,10 @@
  */
 
 #include "storage_site.h"
+#include "resource_id.h"
+#include "resource_index.h"
 #include "game_private.h"
+#include "entity_index.h"
 #include "selection.h"
 #include "../sched.h"
 #include "../ui.h"
@@ -43,28 +46,12 @@
 #include "../lib/public/pf_nuklear.h"
 #include "../lib/public/pf_string.h"
 #include "../lib/public/khash.h"
-#include "../lib/public/mpool_allocator.h"
-#include "../lib/public/string_intern.h"
 #include "../lib/public/attr.h"
 #include "../lib/public/stalloc.h"
+#include "../lib/public/slab_khash.h"
 
 #include <assert.h>
 
-static void *pmalloc(size_t size);
-static void *pcalloc(size_t n, size_t size);
-static void *prealloc(void *ptr, size_t size);
-static void  pfree(void *ptr);
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  pmalloc
-#define kcalloc  pcalloc
-#define krealloc prealloc
-#define kfree    pfree
-
 #define ARR_SIZE(a) (sizeof(a)/sizeof((a)[0]))
 #define MAX(a, b)   ((a) > (b) ? (a) : (b))
 #define MIN(a, b)   ((a) < (b) ? (a) : (b))
@@ -75,93 +62,63 @@ static void  pfree(void *ptr);
             return false;               \
     }while(0)
 
-KHASH_MAP_INIT_STR(int, int)
+#define MAX_UI_ROWS (16)
+
+struct ss_ui_row{
+    const char *name;
+    char        curr[5];
+    char        cap[5];
+    char        des[7];
+};
+
+/* The formatted contents of the site's resource window. Rebuilt
+ * only when the site's version moves past the cached one. */
+struct ss_ui_cache{
+    uint32_t         version;
+    size_t           nrows;
+    struct ss_ui_row rows[MAX_UI_ROWS];
+};
 
 struct ss_state{
-    kh_int_t              *capacity;
-    kh_int_t              *curr;
-    kh_int_t              *desired;
+    struct rtable_int      capacity;
+    struct rtable_int      curr;
+    struct rtable_int      desired;
     /* Alternative capacity/desired parameters that 
      *can be turned on/off */
     bool                   use_alt;
-    kh_int_t              *alt_capacity;
-    kh_int_t              *alt_desired;
+    struct rtable_int      alt_capacity;
+    struct rtable_int      alt_desired;
     /* Flags to inform harvesters not to take anything 
      * from this site */
     bool                   do_not_take_land;
     bool                   do_not_take_water;
+    /* Incremented on every change to the amounts */
+    uint32_t               version;
+    struct ss_ui_cache     ui;
 };
 
-typedef char buff_t[512];
-
-MPOOL_ALLOCATOR_TYPE(buff, buff_t)
-MPOOL_ALLOCATOR_PROTOTYPES(static, buff, buff_t)
-MPOOL_ALLOCATOR_IMPL(static, buff, buff_t)
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  malloc
-#define kcalloc  calloc
-#define krealloc realloc
-#define kfree    free
-
 KHASH_MAP_INIT_INT(state, struct ss_state)
-KHASH_MAP_INIT_STR(res, int)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static mpa_buff_t       s_mpool;
-static khash_t(stridx) *s_stridx;
-static mp_strbuff_t     s_stringpool;
-static struct memstack  s_eventargs;
-static khash_t(state)  *s_entity_state_table;
-static khash_t(res)    *s_global_resource_tables[MAX_FACTIONS];
-static khash_t(res)    *s_global_capacity_tables[MAX_FACTIONS];
+static struct memstack   s_eventargs;
+static khash_t(state)   *s_entity_state_table;
+static struct rtable_int s_global_resource_tables[MAX_FACTIONS];
+static struct rtable_int s_global_capacity_tables[MAX_FACTIONS];
 
 static struct nk_style_item s_bg_style = {0};
 static struct nk_color      s_border_clr = {0};
 static struct nk_color      s_font_clr = {0};
 static bool                 s_show_ui = true;
+/* Bumped whenever the set of sites desiring some resource may have changed */
+static uint32_t             s_demand_epoch = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static void *pmalloc(size_t size)
-{
-    if(size > sizeof(buff_t))
-        return NULL;
-    return mpa_buff_alloc(&s_mpool);
-}
-
-static void *pcalloc(size_t n, size_t size)
-{
-    void *ret = pmalloc(n * size);
-    if(!ret)
-        return NULL;
-    memset(ret, 0, n * size);
-    return ret;
-}
-
-static void *prealloc(void *ptr, size_t size)
-{
-    if(!ptr)
-        return pmalloc(size);
-    if(size <= sizeof(buff_t))
-        return ptr;
-    return NULL;
-}
-
-static void pfree(void *ptr)
-{
-    mpa_buff_free(&s_mpool, ptr);
-}
-
 static struct ss_state *ss_state_get(uint32_t uid)
 {
     khiter_t k = kh_get(state, s_entity_state_table, uid);
@@ -188,37 +145,29 @@ static void ss_state_remove(uint32_t uid)
         kh_del(state, s_entity_state_table, k);
 }
 
-static void ss_state_destroy(struct ss_state *hs)
-{
-    kh_destroy(int, hs->capacity);
-    kh_destroy(int, hs->curr);
-    kh_destroy(int, hs->desired);
-
-    kh_destroy(int, hs->alt_capacity);
-    kh_destroy(int, hs->alt_desired);
-}
-
 static bool ss_state_init(struct ss_state *hs)
 {
-    hs->capacity = kh_init(int);
-    hs->curr = kh_init(int);
-    hs->desired = kh_init(int);
-    hs->alt_capacity = kh_init(int);
-    hs->alt_desired = kh_init(int);
-
-    if(!hs->capacity || !hs->curr || !hs->desired
-    || !hs->alt_capacity || !hs->alt_desired) {
-
-        ss_state_destroy(hs);
-        return false;
-    }
+    rtable_clear(&hs->capacity);
+    rtable_clear(&hs->curr);
+    rtable_clear(&hs->desired);
+    rtable_clear(&hs->alt_capacity);
+    rtable_clear(&hs->alt_desired);
 
     hs->use_alt = false;
     hs->do_not_take_land = false;
     hs->do_not_take_water = false;
+    hs->version = 1;
+    hs->ui.version = 0;
+    hs->ui.nrows = 0;
     return true;
 }
 
+static void ss_changed(struct ss_state *ss)
+{
+    ss->version++;
+    s_demand_epoch++;
+}
+
 static int compare_keys(const void *a, const void *b)
 {
     char *stra = *(char**)a;
@@ -230,114 +179,80 @@ static size_t ss_get_keys(struct ss_state *hs, const char **out, size_t maxout)
 {
     size_t ret = 0;
 
-    const char *key;
-    int amount;
-    khash_t(int) *table = (hs->use_alt) ? hs->alt_capacity : hs->capacity;
+    int id, amount;
+    struct rtable_int *table = (hs->use_alt) ? &hs->alt_capacity : &hs->capacity;
 
-    kh_foreach(table, key, amount, {
+    rtable_foreach(table, id, amount, {
         if(ret == maxout)
             break;
         if(amount == 0)
             continue;
-        out[ret++] = key;
+        out[ret++] = G_ResourceId_Name(id);
     });
 
     qsort(out, ret, sizeof(char*), compare_keys);
     return ret;
 }
 
-static bool ss_state_set_key(khash_t(int) *table, const char *name, int val)
+static bool ss_state_get_id(const struct rtable_int *table, int id, int *out)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    if(!rtable_has(table, id))
         return false;
-
-    khiter_t k = kh_get(int, table, key);
-    if(k != kh_end(table)) {
-        kh_value(table, k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(int, table, key, &status);
-    if(status == -1)
-        return false;
-
-    assert(status == 1);
-    kh_value(table, k) = val;
+    *out = table->vals[id];
     return true;
 }
 
-static bool ss_state_get_key(khash_t(int) *table, const char *name, int *out)
+static void update_delta(struct rtable_int *table, int id, int delta)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(int, table, key);
-    if(k == kh_end(table))
-        return false;
-    *out = kh_value(table, k);
-    return true;
+    int val = 0;
+    ss_state_get_id(table, id, &val);
+    rtable_put(table, id, val + delta);
 }
 
-static bool update_res_delta(const char *rname, int delta, int faction_id)
+static void update_res_delta(int id, int delta, int faction_id)
 {
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(res, s_global_resource_tables[faction_id], key);
-    if(k != kh_end(s_global_resource_tables[faction_id])) {
-        int val = kh_value(s_global_resource_tables[faction_id], k);
-        val += delta;
-        kh_value(s_global_resource_tables[faction_id], k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(res, s_global_resource_tables[faction_id], key, &status);
-    if(status == -1)
-        return false;
-
-    assert(status == 1);
-    kh_value(s_global_resource_tables[faction_id], k) = delta;
-    return true;
+    update_delta(&s_global_resource_tables[faction_id], id, delta);
 }
 
-static bool update_cap_delta(const char *rname, int delta, int faction_id)
+static void update_cap_delta(int id, int delta, int faction_id)
 {
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(res, s_global_capacity_tables[faction_id], key);
-    if(k != kh_end(s_global_capacity_tables[faction_id])) {
-        int val = kh_value(s_global_capacity_tables[faction_id], k);
-        val += delta;
-        kh_value(s_global_capacity_tables[faction_id], k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(res, s_global_capacity_tables[faction_id], key, &status);
-    if(status == -1)
-        return false;
-
-    assert(status == 1);
-    kh_value(s_global_capacity_tables[faction_id], k) = delta;
-    return true;
+    update_delta(&s_global_capacity_tables[faction_id], id, delta);
 }
 
-static void constrain_desired(struct ss_state *ss, const char *rname)
+static void constrain_desired(struct ss_state *ss, int id)
 {
     int cap = 0, desired = 0;
-    ss_state_get_key(ss->capacity, rname, &cap);
-    ss_state_get_key(ss->desired, rname, &desired);
+    ss_state_get_id(&ss->capacity, id, &cap);
+    ss_state_get_id(&ss->desired, id, &desired);
 
     desired = MIN(desired, cap);
     desired = MAX(desired, 0);
-    ss_state_set_key(ss->desired, rname, desired);
+    rtable_put(&ss->desired, id, desired);
+}
+
+static void ss_ui_refresh(uint32_t uid, struct ss_state *ss)
+{
+    if(ss->ui.version == ss->version)
+        return;
+
+    const char *names[MAX_UI_ROWS];
+    size_t nnames = ss_get_keys(ss, names, ARR_SIZE(names));
+
+    for(int i = 0; i < nnames; i++) {
+
+        int capacity = ss->use_alt ? G_StorageSite_GetAltCapacity(uid, names[i]) 
+                                   : G_StorageSite_GetCapacity(uid, names[i]);
+        int desired = ss->use_alt ? G_StorageSite_GetAltDesired(uid, names[i]) 
+                                  : G_StorageSite_GetDesired(uid, names[i]);
+
+        struct ss_ui_row *row = &ss->ui.rows[i];
+        row->name = names[i];
+        pf_snprintf(row->curr, sizeof(row->curr), "%4d", G_StorageSite_GetCurr(uid, names[i]));
+        pf_snprintf(row->cap, sizeof(row->cap), "%4d", capacity);
+        pf_snprintf(row->des, sizeof(row->des), "(%4d)", desired);
+    }
+    ss->ui.nrows = nnames;
+    ss->ui.version = ss->version;
 }
 
 static void on_update_ui(void *user, void *event)
@@ -352,30 +267,37 @@ static void on_update_ui(void *user, void *event)
     if(ui_setting.as_int == SS_UI_SHOW_NEVER)
         return;
 
-    uint32_t key;
-    struct ss_state curr;
     struct nk_context *ctx = UI_GetContext();
+    const vec_entity_t *visible = G_GetVisibleEnts();
 
     nk_style_push_style_item(ctx, &ctx->style.window.fixed_background, s_bg_style);
     nk_style_push_color(ctx, &ctx->style.window.border_color, s_border_clr);
     nk_style_push_vec2(ctx, &ctx->style.window.padding, nk_vec2(8.0f, 16.0f));
 
-    kh_foreach(s_entity_state_table, key, curr, {
+    const vec2_t vres = (vec2_t){1920, 1080};
+    const vec2_t adj_vres = UI_ArAdjustedVRes(vres);
+
+    /* Only the sites that made it through the visibility culling this
+     * frame get a window - the ones off-screen, under the fog or behind
+     * occluders don't get laid out at all.
+     */
+    for(int i = 0; i < vec_size(visible); i++) {
+
+        uint32_t key = vec_AT(visible, i);
+        struct ss_state *curr = ss_state_get(key);
+        if(!curr)
+            continue;
 
         if(ui_setting.as_int == SS_UI_SHOW_SELECTED && !G_Sel_IsSelected(key))
             continue;
 
-        struct obb obb;
-        Entity_CurrentOBB(key, &obb, true);
-        if(!G_Fog_ObjExplored(G_GetPlayerControlledFactions(), key, &obb))
+        ss_ui_refresh(key, curr);
+        if(curr->ui.nrows == 0)
             continue;
 
         char name[256];
         pf_snprintf(name, sizeof(name), "__storage_site__.%x", key);
 
-        const vec2_t vres = (vec2_t){1920, 1080};
-        const vec2_t adj_vres = UI_ArAdjustedVRes(vres);
-
         vec2_t ss_pos = Entity_TopScreenPos(key, adj_vres.x, adj_vres.y);
         const int width = 198;
         const int height = G_StorageSite_GetWindowHeight(key);
@@ -387,31 +309,17 @@ static void on_update_ui(void *user, void *event)
             vres, adj_vres, ANCHOR_DEFAULT
         );
 
-        const char *names[16];
-        size_t nnames = ss_get_keys(&curr, names, ARR_SIZE(names));
-
-        if(nnames == 0)
-            continue;
-
         if(nk_begin_with_vres(ctx, name, 
             (struct nk_rect){adj_bounds.x, adj_bounds.y, adj_bounds.w, adj_bounds.h}, 
             flags, (struct nk_vec2i){adj_vres.x, adj_vres.y})) {
 
-            for(int i = 0; i < nnames; i++) {
-
-                int capacity = curr.use_alt ? G_StorageSite_GetAltCapacity(key, names[i]) 
-                                            : G_StorageSite_GetCapacity(key, names[i]);
-                int desired = curr.use_alt ? G_StorageSite_GetAltDesired(key, names[i]) 
-                                           : G_StorageSite_GetDesired(key, names[i]);
+            for(int j = 0; j < curr->ui.nrows; j++) {
 
-                char curr[5], cap[5], des[7];
-                pf_snprintf(curr, sizeof(curr), "%4d", G_StorageSite_GetCurr(key, names[i]));
-                pf_snprintf(cap, sizeof(cap), "%4d", capacity);
-                pf_snprintf(des, sizeof(des), "(%4d)", desired);
+                const struct ss_ui_row *row = &curr->ui.rows[j];
 
                 nk_layout_row_begin(ctx, NK_STATIC, 16, 5);
                 nk_layout_row_push(ctx, 16);
-                const char *icon = G_Resource_GetIcon(names[i]);
+                const char *icon = G_Resource_GetIcon(row->name);
                 if(icon) {
                     nk_image_texpath(ctx, icon);
                 }else{
@@ -419,20 +327,20 @@ static void on_update_ui(void *user, void *event)
                 }
 
                 nk_layout_row_push(ctx, 40);
-                nk_label_colored(ctx, curr, NK_TEXT_ALIGN_LEFT | NK_TEXT_ALIGN_MIDDLE, s_font_clr);
+                nk_label_colored(ctx, row->curr, NK_TEXT_ALIGN_LEFT | NK_TEXT_ALIGN_MIDDLE, s_font_clr);
 
                 nk_layout_row_push(ctx, 10);
                 nk_label_colored(ctx, "/", NK_TEXT_ALIGN_LEFT | NK_TEXT_ALIGN_MIDDLE, s_font_clr);
 
                 nk_layout_row_push(ctx, 40);
-                nk_label_colored(ctx, cap, NK_TEXT_ALIGN_LEFT | NK_TEXT_ALIGN_MIDDLE, s_font_clr);
+                nk_label_colored(ctx, row->cap, NK_TEXT_ALIGN_LEFT | NK_TEXT_ALIGN_MIDDLE, s_font_clr);
 
                 nk_layout_row_push(ctx, 68);
-                nk_label_colored(ctx, des, NK_TEXT_ALIGN_LEFT | NK_TEXT_ALIGN_MIDDLE, s_font_clr);
+                nk_label_colored(ctx, row->des, NK_TEXT_ALIGN_LEFT | NK_TEXT_ALIGN_MIDDLE, s_font_clr);
             }
         }
         nk_end(ctx);
-    });
+    }
 
     nk_style_pop_vec2(ctx);
     nk_style_pop_style_item(ctx);
@@ -500,17 +408,18 @@ static bool save_global_resources(int i, SDL_RWops *stream)
 {
     struct attr num_global_resources = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = kh_size(s_global_resource_tables[i])
+        .val.as_int = rtable_size(&s_global_resource_tables[i])
     };
     CHK_TRUE_RET(Attr_Write(stream, &num_global_resources, "num_global_resources"));
 
-    const char *resource_key;
+    int resource_id;
     int resource_amount;
 
-    kh_foreach(s_global_resource_tables[i], resource_key, resource_amount, {
+    rtable_foreach(&s_global_resource_tables[i], resource_id, resource_amount, {
     
         struct attr resource_key_attr = (struct attr){ .type = TYPE_STRING, };
-        pf_strlcpy(resource_key_attr.val.as_string, resource_key, sizeof(resource_key_attr.val.as_string));
+        pf_strlcpy(resource_key_attr.val.as_string, G_ResourceId_Name(resource_id), 
+            sizeof(resource_key_attr.val.as_string));
         CHK_TRUE_RET(Attr_Write(stream, &resource_key_attr, "resource_key"));
 
         struct attr resource_amount_attr = (struct attr){
@@ -535,17 +444,14 @@ static bool load_global_resources(int i, SDL_RWops *stream)
         struct attr keyattr;
         CHK_TRUE_RET(Attr_Parse(stream, &keyattr, true));
         CHK_TRUE_RET(keyattr.type == TYPE_STRING);
-        const char *key = si_intern(keyattr.val.as_string, &s_stringpool, s_stridx);
+        int id = G_ResourceId_Get(keyattr.val.as_string);
+        CHK_TRUE_RET(id >= 0);
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
         int val = attr.val.as_int;
 
-        khiter_t k = kh_get(res, s_global_resource_tables[i], key);
-        if(k == kh_end(s_global_resource_tables[i])) {
-            k = kh_put(res, s_global_resource_tables[i], key, &(int){0});
-        }
-        kh_value(s_global_resource_tables[i], k) = val;
+        rtable_put(&s_global_resource_tables[i], id, val);
     }
     return true;
 }
@@ -554,17 +460,18 @@ static bool save_global_capacities(int i, SDL_RWops *stream)
 {
     struct attr num_global_capacities = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = kh_size(s_global_capacity_tables[i])
+        .val.as_int = rtable_size(&s_global_capacity_tables[i])
     };
     CHK_TRUE_RET(Attr_Write(stream, &num_global_capacities, "num_global_capacities"));
 
-    const char *capacity_key;
+    int capacity_id;
     int capacity_amount;
 
-    kh_foreach(s_global_capacity_tables[i], capacity_key, capacity_amount, {
+    rtable_foreach(&s_global_capacity_tables[i], capacity_id, capacity_amount, {
     
         struct attr capacity_key_attr = (struct attr){ .type = TYPE_STRING, };
-        pf_strlcpy(capacity_key_attr.val.as_string, capacity_key, sizeof(capacity_key_attr.val.as_string));
+        pf_strlcpy(capacity_key_attr.val.as_string, G_ResourceId_Name(capacity_id), 
+            sizeof(capacity_key_attr.val.as_string));
         CHK_TRUE_RET(Attr_Write(stream, &capacity_key_attr, "capacity_key"));
 
         struct attr capacity_amount_attr = (struct attr){
@@ -589,17 +496,14 @@ static bool load_global_capacities(int i, SDL_RWops *stream)
         struct attr keyattr;
         CHK_TRUE_RET(Attr_Parse(stream, &keyattr, true));
         CHK_TRUE_RET(keyattr.type == TYPE_STRING);
-        const char *key = si_intern(keyattr.val.as_string, &s_stringpool, s_stridx);
+        int id = G_ResourceId_Get(keyattr.val.as_string);
+        CHK_TRUE_RET(id >= 0);
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
         int val = attr.val.as_int;
 
-        khiter_t k = kh_get(res, s_global_capacity_tables[i], key);
-        if(k == kh_end(s_global_capacity_tables[i])) {
-            k = kh_put(res, s_global_capacity_tables[i], key, &(int){0});
-        }
-        kh_value(s_global_capacity_tables[i], k) = val;
+        rtable_put(&s_global_capacity_tables[i], id, val);
     }
     return true;
 }
@@ -619,34 +523,16 @@ static bool storage_site_ui_mode_validate(const struct sval *val)
 
 bool G_StorageSite_Init(void)
 {
-    mpa_buff_init(&s_mpool, 1024, 0);
-
-    if(!mpa_buff_reserve(&s_mpool, 1024))
-        goto fail_mpool; 
     if(!(s_entity_state_table = kh_init(state)))
         goto fail_table;
+    if(!stalloc_init(&s_eventargs))
+        goto fail_eventargs;
 
     for(int i = 0; i < MAX_FACTIONS; i++) {
-        if(!(s_global_resource_tables[i] = kh_init(res))) {
-            for(--i; i; i--)
-                kh_destroy(res, s_global_resource_tables[i]);
-            goto fail_res;
-        }
+        rtable_clear(&s_global_resource_tables[i]);
+        rtable_clear(&s_global_capacity_tables[i]);
     }
-
-    for(int i = 0; i < MAX_FACTIONS; i++) {
-        if(!(s_global_capacity_tables[i] = kh_init(res))) {
-            for(--i; i; i--)
-                kh_destroy(res, s_global_capacity_tables[i]);
-            goto fail_cap;
-        }
-    }
-
-    if(!si_init(&s_stringpool, &s_stridx, 512))
-        goto fail_strintern;
-
-    if(!stalloc_init(&s_eventargs))
-        goto fail_eventargs;
+    s_demand_epoch++;
 
     struct nk_context ctx;
     nk_style_default(&ctx);
@@ -674,18 +560,8 @@ bool G_StorageSite_Init(void)
     return true;
 
 fail_eventargs:
-    si_shutdown(&s_stringpool, s_stridx);
-fail_strintern:
-    for(int i = 0; i < MAX_FACTIONS; i++)
-        kh_destroy(res, s_global_capacity_tables[i]);
-fail_cap:
-    for(int i = 0; i < MAX_FACTIONS; i++)
-        kh_destroy(res, s_global_resource_tables[i]);
-fail_res:
     kh_destroy(state, s_entity_state_table);
 fail_table:
-    mpa_buff_destroy(&s_mpool);
-fail_mpool:
     return false;
 }
 
@@ -694,15 +570,8 @@ void G_StorageSite_Shutdown(void)
     E_Global_Unregister(EVENT_UPDATE_START, on_update);
     E_Global_Unregister(EVENT_UPDATE_UI, on_update_ui);
 
-    for(int i = 0; i < MAX_FACTIONS; i++)
-        kh_destroy(res, s_global_capacity_tables[i]);
-    for(int i = 0; i < MAX_FACTIONS; i++)
-        kh_destroy(res, s_global_resource_tables[i]);
-
     stalloc_destroy(&s_eventargs);
-    si_shutdown(&s_stringpool, s_stridx);
     kh_destroy(state, s_entity_state_table);
-    mpa_buff_destroy(&s_mpool);
 }
 
 void G_StorageSite_ClearState(void)
@@ -718,7 +587,9 @@ bool G_StorageSite_AddEntity(uint32_t uid)
         return false;
     if(!ss_state_set(uid, ss))
         return false;
-    return true;
+    s_demand_epoch++;
+    G_ResourceIndex_SetStorageSite(uid, G_GetFactionID(uid));
+    return G_EntIndex_AddComponent(uid, ENT_COMP_STORAGE_SITE);
 }
 
 void G_StorageSite_RemoveEntity(uint32_t uid)
@@ -727,20 +598,21 @@ void G_StorageSite_RemoveEntity(uint32_t uid)
     if(!ss)
         return;
 
-    const char *key;
-    int amount;
+    int id, amount;
 
-    kh_foreach(ss->curr, key, amount, {
-        update_res_delta(key, -amount, G_GetFactionID(uid));
+    rtable_foreach(&ss->curr, id, amount, {
+        update_res_delta(id, -amount, G_GetFactionID(uid));
     });
 
-    khash_t(int) *cap = ss->use_alt ? ss->alt_capacity : ss->capacity;
-    kh_foreach(cap, key, amount, {
-        update_cap_delta(key, -amount, G_GetFactionID(uid));
+    struct rtable_int *cap = ss->use_alt ? &ss->alt_capacity : &ss->capacity;
+    rtable_foreach(cap, id, amount, {
+        update_cap_delta(id, -amount, G_GetFactionID(uid));
     });
 
-    ss_state_destroy(ss);
+    G_ResourceIndex_RemoveStorageSite(uid);
     ss_state_remove(uid);
+    s_demand_epoch++;
+    G_EntIndex_RemoveComponent(uid, ENT_COMP_STORAGE_SITE);
 }
 
 bool G_StorageSite_IsSaturated(uint32_t uid)
@@ -748,12 +620,12 @@ bool G_StorageSite_IsSaturated(uint32_t uid)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    const char *key;
-    int amount;
-    khash_t(int) *table = ss->use_alt ? ss->alt_capacity : ss->capacity;
+    int id, amount;
+    struct rtable_int *table = ss->use_alt ? &ss->alt_capacity : &ss->capacity;
 
-    kh_foreach(table, key, amount, {
-        int curr = G_StorageSite_GetCurr(uid, key);
+    rtable_foreach(table, id, amount, {
+        int curr = 0;
+        ss_state_get_id(&ss->curr, id, &curr);
         if(curr < amount)
             return false;
     });
@@ -765,17 +637,22 @@ bool G_StorageSite_SetCapacity(uint32_t uid, const char *rname, int max)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
+    int id = G_ResourceId_Get(rname);
+    if(id < 0)
+        return false;
+
     int prev = 0;
-    ss_state_get_key(ss->curr, rname, &prev);
+    ss_state_get_id(&ss->curr, id, &prev);
     int delta = max - prev;
 
     if(!ss->use_alt) {
-        update_cap_delta(rname, delta, G_GetFactionID(uid));
+        update_cap_delta(id, delta, G_GetFactionID(uid));
     }
 
-    bool ret = ss_state_set_key(ss->capacity, rname, max);
-    constrain_desired(ss, rname);
-    return ret;
+    rtable_put(&ss->capacity, id, max);
+    constrain_desired(ss, id);
+    ss_changed(ss);
+    return true;
 }
 
 int G_StorageSite_GetCapacity(uint32_t uid, const char *rname)
@@ -784,8 +661,8 @@ int G_StorageSite_GetCapacity(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    khash_t(int) *table = (ss->use_alt) ? ss->alt_capacity : ss->capacity;
-    ss_state_get_key(table, rname, &ret);
+    struct rtable_int *table = (ss->use_alt) ? &ss->alt_capacity : &ss->capacity;
+    ss_state_get_id(table, G_ResourceId_Find(rname), &ret);
     return ret;
 }
 
@@ -794,9 +671,13 @@ bool G_StorageSite_SetCurr(uint32_t uid, const char *rname, int curr)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
+    int id = G_ResourceId_Get(rname);
+    if(id < 0)
+        return false;
+
     int cap = 0;
-    khash_t(int) *table = (ss->use_alt) ? ss->alt_capacity : ss->capacity;
-    ss_state_get_key(table, rname, &cap);
+    struct rtable_int *table = (ss->use_alt) ? &ss->alt_capacity : &ss->capacity;
+    ss_state_get_id(table, id, &cap);
 
     if(curr > cap)
         return false;
@@ -804,20 +685,22 @@ bool G_StorageSite_SetCurr(uint32_t uid, const char *rname, int curr)
         return false;
 
     int prev = 0;
-    ss_state_get_key(ss->curr, rname, &prev);
+    ss_state_get_id(&ss->curr, id, &prev);
     int delta = curr - prev;
-    update_res_delta(rname, delta, G_GetFactionID(uid));
+    update_res_delta(id, delta, G_GetFactionID(uid));
 
     if(delta) {
         struct ss_delta_event *event = stalloc(&s_eventargs, sizeof(struct ss_delta_event));
         *event = (struct ss_delta_event){
-            .name = si_intern(rname, &s_stringpool, s_stridx),
+            .name = G_ResourceId_Name(id),
             .delta = delta
         };
         E_Entity_Notify(EVENT_STORAGE_SITE_AMOUNT_CHANGED, uid, event, ES_ENGINE);
+        ss_changed(ss);
     }
 
-    return ss_state_set_key(ss->curr, rname, curr);
+    rtable_put(&ss->curr, id, curr);
+    return true;
 }
 
 int G_StorageSite_GetCurr(uint32_t uid, const char *rname)
@@ -826,7 +709,7 @@ int G_StorageSite_GetCurr(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    ss_state_get_key(ss->curr, rname, &ret);
+    ss_state_get_id(&ss->curr, G_ResourceId_Find(rname), &ret);
     return ret;
 }
 
@@ -834,9 +717,15 @@ bool G_StorageSite_SetDesired(uint32_t uid, const char *rname, int des)
 {
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
-    bool ret = ss_state_set_key(ss->desired, rname, des);
-    constrain_desired(ss, rname);
-    return ret;
+
+    int id = G_ResourceId_Get(rname);
+    if(id < 0)
+        return false;
+
+    rtable_put(&ss->desired, id, des);
+    constrain_desired(ss, id);
+    ss_changed(ss);
+    return true;
 }
 
 int G_StorageSite_GetDesired(uint32_t uid, const char *rname)
@@ -845,22 +734,22 @@ int G_StorageSite_GetDesired(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    ss_state_get_key(ss->desired, rname, &ret);
+    ss_state_get_id(&ss->desired, G_ResourceId_Find(rname), &ret);
     return ret;
 }
 
 int G_StorageSite_GetPlayerStored(const char *rname)
 {
     int ret = 0;
+    int id = G_ResourceId_Find(rname);
     uint16_t pfacs = G_GetPlayerControlledFactions();
 
     for(int i = 0; i < MAX_FACTIONS; i++) {
         if(!(pfacs & (0x1 << i)))
             continue;
-        khiter_t k = kh_get(res, s_global_resource_tables[i], rname);
-        if(k == kh_end(s_global_resource_tables[i]))
-            continue;
-        ret += kh_value(s_global_resource_tables[i], k);
+        int val = 0;
+        ss_state_get_id(&s_global_resource_tables[i], id, &val);
+        ret += val;
     }
     return ret;
 }
@@ -868,15 +757,15 @@ int G_StorageSite_GetPlayerStored(const char *rname)
 int G_StorageSite_GetPlayerCapacity(const char *rname)
 {
     int ret = 0;
+    int id = G_ResourceId_Find(rname);
     uint16_t pfacs = G_GetPlayerControlledFactions();
 
     for(int i = 0; i < MAX_FACTIONS; i++) {
         if(!(pfacs & (0x1 << i)))
             continue;
-        khiter_t k = kh_get(res, s_global_capacity_tables[i], rname);
-        if(k == kh_end(s_global_capacity_tables[i]))
-            continue;
-        ret += kh_value(s_global_capacity_tables[i], k);
+        int val = 0;
+        ss_state_get_id(&s_global_capacity_tables[i], id, &val);
+        ret += val;
     }
     return ret;
 }
@@ -966,25 +855,25 @@ void G_StorageSite_SetUseAlt(uint32_t uid, bool use)
     if(use == ss->use_alt)
         return;
 
-    const char *key;
-    int amount;
+    int id, amount;
 
     if(use) {
-        kh_foreach(ss->capacity, key, amount, {
-            update_cap_delta(key, -amount, G_GetFactionID(uid));
+        rtable_foreach(&ss->capacity, id, amount, {
+            update_cap_delta(id, -amount, G_GetFactionID(uid));
         });
-        kh_foreach(ss->alt_capacity, key, amount, {
-            update_cap_delta(key, amount, G_GetFactionID(uid));
+        rtable_foreach(&ss->alt_capacity, id, amount, {
+            update_cap_delta(id, amount, G_GetFactionID(uid));
         });
     }else{
-        kh_foreach(ss->alt_capacity, key, amount, {
-            update_cap_delta(key, -amount, G_GetFactionID(uid));
+        rtable_foreach(&ss->alt_capacity, id, amount, {
+            update_cap_delta(id, -amount, G_GetFactionID(uid));
         });
-        kh_foreach(ss->capacity, key, amount, {
-            update_cap_delta(key, amount, G_GetFactionID(uid));
+        rtable_foreach(&ss->capacity, id, amount, {
+            update_cap_delta(id, amount, G_GetFactionID(uid));
         });
     }
     ss->use_alt = use;
+    ss_changed(ss);
 }
 
 bool G_StorageSite_GetUseAlt(uint32_t uid)
@@ -1000,16 +889,16 @@ void G_StorageSite_ClearAlt(uint32_t uid)
     assert(ss);
 
     if(ss->use_alt) {
-        const char *key;
-        int amount;
+        int id, amount;
 
-        kh_foreach(ss->alt_capacity, key, amount, {
-            update_cap_delta(key, -amount, G_GetFactionID(uid));
+        rtable_foreach(&ss->alt_capacity, id, amount, {
+            update_cap_delta(id, -amount, G_GetFactionID(uid));
         });
     }
 
-    kh_clear(int, ss->alt_capacity);
-    kh_clear(int, ss->alt_desired);
+    rtable_clear(&ss->alt_capacity);
+    rtable_clear(&ss->alt_desired);
+    ss_changed(ss);
 }
 
 void G_StorageSite_ClearCurr(uint32_t uid)
@@ -1017,14 +906,14 @@ void G_StorageSite_ClearCurr(uint32_t uid)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    const char *key;
-    int amount;
+    int id, amount;
 
-    kh_foreach(ss->alt_capacity, key, amount, {
-        update_cap_delta(key, -amount, G_GetFactionID(uid));
+    rtable_foreach(&ss->alt_capacity, id, amount, {
+        update_cap_delta(id, -amount, G_GetFactionID(uid));
     });
 
-    kh_clear(int, ss->curr);
+    rtable_clear(&ss->curr);
+    ss_changed(ss);
 }
 
 bool G_StorageSite_SetAltCapacity(uint32_t uid, const char *rname, int max)
@@ -1032,17 +921,22 @@ bool G_StorageSite_SetAltCapacity(uint32_t uid, const char *rname, int max)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
+    int id = G_ResourceId_Get(rname);
+    if(id < 0)
+        return false;
+
     int prev = 0;
-    ss_state_get_key(ss->curr, rname, &prev);
+    ss_state_get_id(&ss->curr, id, &prev);
     int delta = max - prev;
 
     if(ss->use_alt) {
-        update_cap_delta(rname, delta, G_GetFactionID(uid));
+        update_cap_delta(id, delta, G_GetFactionID(uid));
     }
 
-    bool ret = ss_state_set_key(ss->alt_capacity, rname, max);
-    constrain_desired(ss, rname);
-    return ret;
+    rtable_put(&ss->alt_capacity, id, max);
+    constrain_desired(ss, id);
+    ss_changed(ss);
+    return true;
 }
 
 int G_StorageSite_GetAltCapacity(uint32_t uid, const char *rname)
@@ -1051,7 +945,7 @@ int G_StorageSite_GetAltCapacity(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    ss_state_get_key(ss->alt_capacity, rname, &ret);
+    ss_state_get_id(&ss->alt_capacity, G_ResourceId_Find(rname), &ret);
     return ret;
 }
 
@@ -1059,9 +953,15 @@ bool G_StorageSite_SetAltDesired(uint32_t uid, const char *rname, int des)
 {
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
-    bool ret = ss_state_set_key(ss->alt_desired, rname, des);
-    constrain_desired(ss, rname);
-    return ret;
+
+    int id = G_ResourceId_Get(rname);
+    if(id < 0)
+        return false;
+
+    rtable_put(&ss->alt_desired, id, des);
+    constrain_desired(ss, id);
+    ss_changed(ss);
+    return true;
 }
 
 int G_StorageSite_GetAltDesired(uint32_t uid, const char *rname)
@@ -1070,7 +970,7 @@ int G_StorageSite_GetAltDesired(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    ss_state_get_key(ss->alt_desired, rname, &ret);
+    ss_state_get_id(&ss->alt_desired, G_ResourceId_Find(rname), &ret);
     return ret;
 }
 
@@ -1080,41 +980,65 @@ void G_StorageSite_UpdateFaction(uint32_t uid, int oldfac, int newfac)
     if(!ss)
         return;
 
-    const char *key;
-    int amount;
+    int id, amount;
 
-    khash_t(int) *cap = ss->use_alt ? ss->alt_capacity : ss->capacity;
-    kh_foreach(cap, key, amount, {
-        update_cap_delta(key, -amount, oldfac);
-        update_cap_delta(key,  amount, newfac);
+    struct rtable_int *cap = ss->use_alt ? &ss->alt_capacity : &ss->capacity;
+    rtable_foreach(cap, id, amount, {
+        update_cap_delta(id, -amount, oldfac);
+        update_cap_delta(id,  amount, newfac);
     });
 
-    kh_foreach(ss->curr, key, amount, {
-        update_res_delta(key, -amount, oldfac);
-        update_res_delta(key,  amount, newfac);
+    rtable_foreach(&ss->curr, id, amount, {
+        update_res_delta(id, -amount, oldfac);
+        update_res_delta(id,  amount, newfac);
     });
+
+    G_ResourceIndex_SetStorageSite(uid, newfac);
 }
 
 bool G_StorageSite_Desires(uint32_t uid, const char *rname)
 {
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
-    khash_t(int) *des = ss->use_alt ? ss->alt_desired  : ss->desired;
+    struct rtable_int *des = ss->use_alt ? &ss->alt_desired : &ss->desired;
 
+    int id = G_ResourceId_Find(rname);
     int rdes, rcurr = 0;
-    if(!ss_state_get_key(des, rname, &rdes))
+    if(!ss_state_get_id(des, id, &rdes))
         return false;
 
-    ss_state_get_key(ss->curr, rname, &rcurr);
+    ss_state_get_id(&ss->curr, id, &rcurr);
     return (rdes > rcurr);
 }
 
+rmask_t G_StorageSite_DesiredMask(uint32_t uid)
+{
+    struct ss_state *ss = ss_state_get(uid);
+    assert(ss);
+    struct rtable_int *des = ss->use_alt ? &ss->alt_desired : &ss->desired;
+
+    rmask_t ret = 0;
+    int id, amount;
+    rtable_foreach(des, id, amount, {
+        int curr = 0;
+        ss_state_get_id(&ss->curr, id, &curr);
+        if(amount > curr)
+            ret |= ((rmask_t)1 << id);
+    });
+    return ret;
+}
+
+uint32_t G_StorageSite_DemandEpoch(void)
+{
+    return s_demand_epoch;
+}
+
 float G_StorageSite_GetWindowHeight(uint32_t uid)
 {
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
-    khash_t(int) *table = (ss->use_alt) ? ss->alt_capacity : ss->capacity;
-    return MIN(kh_size(table), 16) * 20 + 32;
+    struct rtable_int *table = (ss->use_alt) ? &ss->alt_capacity : &ss->capacity;
+    return MIN(rtable_size(table), 16) * 20 + 32;
 }
 
 bool G_StorageSite_SaveState(struct SDL_RWops *stream)
@@ -1127,9 +1051,9 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
     Sched_TryYield();
 
     uint32_t key;
-    struct ss_state curr;
+    struct ss_state *curr;
 
-    kh_foreach(s_entity_state_table, key, curr, {
+    kh_foreach_val_ptr(s_entity_state_table, key, curr, {
 
         struct attr uid = (struct attr){
             .type = TYPE_INT,
@@ -1139,22 +1063,23 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr use_alt = (struct attr){
             .type = TYPE_BOOL,
-            .val.as_bool = curr.use_alt
+            .val.as_bool = curr->use_alt
         };
         CHK_TRUE_RET(Attr_Write(stream, &use_alt, "use_alt"));
 
         struct attr num_capacity = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.capacity)
+            .val.as_int = rtable_size(&curr->capacity)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_capacity, "num_capacity"));
 
-        const char *cap_key;
+        int cap_id;
         int cap_amount;
-        kh_foreach(curr.capacity, cap_key, cap_amount, {
+        rtable_foreach(&curr->capacity, cap_id, cap_amount, {
         
             struct attr cap_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(cap_key_attr.val.as_string, cap_key, sizeof(cap_key_attr.val.as_string));
+            pf_strlcpy(cap_key_attr.val.as_string, G_ResourceId_Name(cap_id), 
+                sizeof(cap_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &cap_key_attr, "cap_key"));
 
             struct attr cap_amount_attr = (struct attr){
@@ -1166,16 +1091,17 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr num_curr = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.curr)
+            .val.as_int = rtable_size(&curr->curr)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_curr, "num_curr"));
 
-        const char *curr_key;
+        int curr_id;
         int curr_amount;
-        kh_foreach(curr.curr, curr_key, curr_amount, {
+        rtable_foreach(&curr->curr, curr_id, curr_amount, {
         
             struct attr curr_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(curr_key_attr.val.as_string, curr_key, sizeof(curr_key_attr.val.as_string));
+            pf_strlcpy(curr_key_attr.val.as_string, G_ResourceId_Name(curr_id), 
+                sizeof(curr_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &curr_key_attr, "curr_key"));
 
             struct attr curr_amount_attr = (struct attr){
@@ -1187,16 +1113,17 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr num_desired = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.desired)
+            .val.as_int = rtable_size(&curr->desired)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_desired, "num_desired"));
 
-        const char *desired_key;
+        int desired_id;
         int desired_amount;
-        kh_foreach(curr.desired, desired_key, desired_amount, {
+        rtable_foreach(&curr->desired, desired_id, desired_amount, {
         
             struct attr desired_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(desired_key_attr.val.as_string, desired_key, sizeof(desired_key_attr.val.as_string));
+            pf_strlcpy(desired_key_attr.val.as_string, G_ResourceId_Name(desired_id), 
+                sizeof(desired_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &desired_key_attr, "desired_key"));
 
             struct attr desired_amount_attr = (struct attr){
@@ -1208,16 +1135,17 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr num_alt_cap = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.alt_capacity)
+            .val.as_int = rtable_size(&curr->alt_capacity)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_alt_cap, "num_alt_cap"));
 
-        const char *alt_cap_key;
+        int alt_cap_id;
         int alt_cap_amount;
-        kh_foreach(curr.alt_capacity, alt_cap_key, alt_cap_amount, {
+        rtable_foreach(&curr->alt_capacity, alt_cap_id, alt_cap_amount, {
         
             struct attr alt_cap_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(alt_cap_key_attr.val.as_string, alt_cap_key, sizeof(alt_cap_key_attr.val.as_string));
+            pf_strlcpy(alt_cap_key_attr.val.as_string, G_ResourceId_Name(alt_cap_id), 
+                sizeof(alt_cap_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &alt_cap_key_attr, "alt_cap_key"));
 
             struct attr alt_cap_amount_attr = (struct attr){
@@ -1229,16 +1157,17 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr num_alt_desired = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.alt_desired)
+            .val.as_int = rtable_size(&curr->alt_desired)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_alt_desired, "num_alt_desired"));
 
-        const char *alt_desired_key;
+        int alt_desired_id;
         int alt_desired_amount;
-        kh_foreach(curr.alt_desired, alt_desired_key, alt_desired_amount, {
+        rtable_foreach(&curr->alt_desired, alt_desired_id, alt_desired_amount, {
         
             struct attr alt_desired_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(alt_desired_key_attr.val.as_string, alt_desired_key, sizeof(alt_desired_key_attr.val.as_string));
+            pf_strlcpy(alt_desired_key_attr.val.as_string, G_ResourceId_Name(alt_desired_id), 
+                sizeof(alt_desired_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &alt_desired_key_attr, "alt_desired_key"));
 
             struct attr alt_desired_amount_attr = (struct attr){
@@ -1250,13 +1179,13 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr do_not_take_land = (struct attr){
             .type = TYPE_BOOL,
-            .val.as_bool = curr.do_not_take_land
+            .val.as_bool = curr->do_not_take_land
         };
         CHK_TRUE_RET(Attr_Write(stream, &do_not_take_land, "do_not_take_land"));
 
         struct attr do_not_take_water = (struct attr){
             .type = TYPE_BOOL,
-            .val.as_bool = curr.do_not_take_water
+            .val.as_bool = curr->do_not_take_water
         };
         CHK_TRUE_RET(Attr_Write(stream, &do_not_take_water, "do_not_take_water"));
         Sched_TryYield();
@@ -1318,6 +1247,7 @@ bool G_StorageSite_LoadState(struct SDL_RWops *stream)
     CHK_TRUE_RET(attr.type == TYPE_INT);
     const size_t num_ents = attr.val.as_int;
     Sched_TryYield();
+    s_demand_epoch++;
 
     for(int i = 0; i < num_ents; i++) {
 
@@ -1348,6 +1278,7 @@ bool G_StorageSite_LoadState(struct SDL_RWops *stream)
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_BOOL);
         ss->use_alt = attr.val.as_bool;
+        ss_changed(ss);
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
@@ -40,6 +40,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "public/game.h"
+#include "resource_id.h"
 
 #define DEFAULT_CAPACITY (0)
 
@@ -52,6 +53,10 @@ void G_StorageSite_RemoveEntity(uint32_t uid);
 bool G_StorageSite_IsSaturated(uint32_t uid);
 void G_StorageSite_UpdateFaction(uint32_t uid, int oldfac, int newfac);
 bool G_StorageSite_Desires(uint32_t uid, const char *rname);
+/* Bitmask of the resource ids which the site desires more of */
+rmask_t  G_StorageSite_DesiredMask(uint32_t uid);
+/* Changes whenever any site's desires may have changed */
+uint32_t G_StorageSite_DemandEpoch(void);
 
 bool G_StorageSite_SaveState(struct SDL_RWops *stream);
 bool G_StorageSite_LoadState(struct SDL_RWops *stream);
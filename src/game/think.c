@@ -0,0 +1,229 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "think.h"
+#include "../perf.h"
+#include "../main.h"
+
+#include <assert.h>
+#include <string.h>
+#include <SDL.h>
+
+
+VEC_IMPL(static inline, think_ent, struct think_ent)
+VEC_IMPL(static inline, think_uid, uint32_t)
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void set_index(struct think_sched *ts, size_t idx)
+{
+    khiter_t k = kh_get(id, ts->index, vec_AT(&ts->ents, idx).uid);
+    assert(k != kh_end(ts->index));
+    kh_val(ts->index, k) = idx;
+}
+
+static void run_ent(struct think_sched *ts, size_t idx)
+{
+    struct think_ent *ent = &vec_AT(&ts->ents, idx);
+    if(ent->stamp == ts->stamp)
+        return;
+
+    ent->stamp = ts->stamp;
+    ent->bumped = false;
+    /* The think function may add or remove entities */
+    ts->func(ent->uid, ts->user);
+}
+
+static bool budget_exceeded(const struct think_sched *ts, uint64_t begin)
+{
+    if(ts->budget_us == 0)
+        return false;
+    uint64_t elapsed = SDL_GetPerformanceCounter() - begin;
+    return (elapsed * 1000000 / SDL_GetPerformanceFrequency() >= ts->budget_us);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Think_Init(struct think_sched *ts, think_func_t func, void *user, 
+                  int period, uint64_t budget_us)
+{
+    assert(period > 0);
+
+    if(!(ts->index = kh_init(id)))
+        return false;
+
+    vec_think_ent_init(&ts->ents);
+    vec_think_uid_init(&ts->bumped);
+    ts->func = func;
+    ts->user = user;
+    ts->period = period;
+    ts->budget_us = budget_us;
+    ts->stamp = 0;
+    ts->cursor = 0;
+    return true;
+}
+
+void G_Think_Destroy(struct think_sched *ts)
+{
+    vec_think_ent_destroy(&ts->ents);
+    vec_think_uid_destroy(&ts->bumped);
+    kh_destroy(id, ts->index);
+}
+
+void G_Think_Clear(struct think_sched *ts)
+{
+    vec_think_ent_reset(&ts->ents);
+    vec_think_uid_reset(&ts->bumped);
+    kh_clear(id, ts->index);
+    ts->cursor = 0;
+}
+
+bool G_Think_AddEntity(struct think_sched *ts, uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    khiter_t k = kh_get(id, ts->index, uid);
+    if(k != kh_end(ts->index))
+        return true;
+
+    /* New entities go to the end of the ring and get 
+     * their first turn before the current cycle ends */
+    struct think_ent ent = (struct think_ent){uid, ts->stamp, false};
+    if(!vec_think_ent_push(&ts->ents, ent))
+        return false;
+
+    int status;
+    k = kh_put(id, ts->index, uid, &status);
+    if(status == -1) {
+        vec_think_ent_pop(&ts->ents);
+        return false;
+    }
+    kh_val(ts->index, k) = vec_size(&ts->ents) - 1;
+    return true;
+}
+
+void G_Think_RemoveEntity(struct think_sched *ts, uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    khiter_t k = kh_get(id, ts->index, uid);
+    if(k == kh_end(ts->index))
+        return;
+
+    size_t idx = kh_val(ts->index, k);
+    kh_del(id, ts->index, k);
+
+    /* Keep the entities that already ran this cycle contiguous: 
+     * fill the hole with the last of them, and move the hole 
+     * to the start of the entities that have not run yet. */
+    if(idx < ts->cursor) {
+        size_t last_ran = ts->cursor - 1;
+        if(idx != last_ran) {
+            vec_AT(&ts->ents, idx) = vec_AT(&ts->ents, last_ran);
+            set_index(ts, idx);
+        }
+        idx = last_ran;
+        ts->cursor--;
+    }
+
+    size_t last = vec_size(&ts->ents) - 1;
+    if(idx != last) {
+        vec_AT(&ts->ents, idx) = vec_AT(&ts->ents, last);
+        set_index(ts, idx);
+    }
+    vec_think_ent_pop(&ts->ents);
+}
+
+void G_Think_Bump(struct think_sched *ts, uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    khiter_t k = kh_get(id, ts->index, uid);
+    if(k == kh_end(ts->index))
+        return;
+
+    struct think_ent *ent = &vec_AT(&ts->ents, kh_val(ts->index, k));
+    if(ent->bumped)
+        return;
+    if(!vec_think_uid_push(&ts->bumped, uid))
+        return;
+    ent->bumped = true;
+}
+
+void G_Think_Run(struct think_sched *ts)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    ts->stamp++;
+
+    /* Bumped entities always get to run - the budget only limits 
+     * the regular turns. Anything bumped from inside a think 
+     * function is left for the next run. */
+    size_t nbumped = vec_size(&ts->bumped);
+    for(int i = 0; i < nbumped; i++) {
+
+        uint32_t uid = vec_AT(&ts->bumped, i);
+        khiter_t k = kh_get(id, ts->index, uid);
+        if(k == kh_end(ts->index))
+            continue;
+        run_ent(ts, kh_val(ts->index, k));
+    }
+    size_t nleft = vec_size(&ts->bumped) - nbumped;
+    memmove(ts->bumped.array, ts->bumped.array + nbumped, nleft * sizeof(uint32_t));
+    ts->bumped.size = nleft;
+
+    size_t nents = vec_size(&ts->ents);
+    size_t quota = (nents + ts->period - 1) / ts->period;
+
+    for(size_t i = 0; i < quota; i++) {
+
+        if(vec_size(&ts->ents) == 0)
+            break;
+        if(ts->cursor >= vec_size(&ts->ents))
+            ts->cursor = 0;
+
+        run_ent(ts, ts->cursor++);
+        if(budget_exceeded(ts, begin))
+            break;
+    }
+    PERF_RETURN_VOID();
+}
+
@@ -0,0 +1,92 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef THINK_H
+#define THINK_H
+
+#include "gamestate.h"
+#include "../lib/public/vec.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* A budgeted, time-sliced scheduler for per-entity updates. Instead of 
+ * re-evaluating the state of every entity on every tick, a module adds its 
+ * entities to a scheduler and runs it from its own tick handler. Every run 
+ * visits the next slice of entities, sized so that all of them are visited 
+ * once every 'period' runs. A run also stops early once it has used up its 
+ * time budget, and the next run resumes where it stopped. Bumping an entity 
+ * makes it run at the start of the next run, ahead of everyone else. An 
+ * entity is never run more than once in a single run.
+ */
+
+typedef void (*think_func_t)(uint32_t uid, void *user);
+
+struct think_ent{
+    uint32_t uid;
+    uint32_t stamp;
+    bool     bumped;
+};
+
+VEC_TYPE(think_ent, struct think_ent)
+VEC_TYPE(think_uid, uint32_t)
+
+struct think_sched{
+    think_func_t       func;
+    void              *user;
+    int                period;
+    uint64_t           budget_us;
+    uint32_t           stamp;
+    size_t             cursor;
+    /* The entities in [0, cursor) have already had their turn this cycle */
+    vec(think_ent)     ents;
+    vec(think_uid)     bumped;
+    khash_t(id)       *index;
+};
+
+/* A 'budget_us' of 0 means there is no time limit on a run */
+bool G_Think_Init(struct think_sched *ts, think_func_t func, void *user, 
+                  int period, uint64_t budget_us);
+void G_Think_Destroy(struct think_sched *ts);
+void G_Think_Clear(struct think_sched *ts);
+
+bool G_Think_AddEntity(struct think_sched *ts, uint32_t uid);
+void G_Think_RemoveEntity(struct think_sched *ts, uint32_t uid);
+void G_Think_Bump(struct think_sched *ts, uint32_t uid);
+void G_Think_Run(struct think_sched *ts);
+
+#endif
+
@@ -36,12 +36,22 @@
 #include "public/game.h"
 #include "timer_events.h"
 #include "../event.h"
+#include "../config.h"
+#include "../camera.h"
 
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 #include <SDL.h>
 
-#define TIMER_INTERVAL  (1000.0f/60.0f)
+#define TIMER_INTERVAL      (1000.0f/60.0f)
+/* Above 1x speed, at most this many real ticks' worth of simulation ticks 
+ * may be waiting to run. Any ticks beyond that are dropped, so that a 
+ * simulation which can't keep up runs slower instead of falling behind. 
+ */
+#define MAX_BACKLOG         (2)
+#define PRESENT_INTERVAL_MS (1000/60)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -50,6 +60,35 @@
 static unsigned long long s_num_60hz_ticks;
 static SDL_TimerID        s_60hz_timer;
 
+/* At speeds above 1x, every real tick queues up 'speed' simulation ticks. 
+ * One of them runs per frame and only those frames which catch up with 
+ * the queue (or which are due for display) are rendered. The rest only 
+ * advance the simulation. 
+ */
+static int                s_speed = 1;
+static int                s_backlog = 0;
+static bool               s_present = true;
+static uint32_t           s_last_present = 0;
+
+/* A frame on which nothing visible can have changed since the last drawn 
+ * one is neither drawn nor swapped, which leaves the last image on the 
+ * screen. The simulation running on a map, a change of the simulation 
+ * state, the active camera moving or a call to 'G_Timer_MarkDirty' (i.e. 
+ * for input) make a frame dirty. A frame is still drawn at least every 
+ * 's_idle_max_latency' milliseconds, which bounds how stale anything 
+ * else (such as the water or script-driven UI changes while paused) may 
+ * get. Zero turns the idle frame skipping off.
+ */
+static int                s_idle_max_latency = CONFIG_IDLE_MAX_LATENCY_MS;
+static bool               s_idle = false;
+static bool               s_dirty = true;
+static enum simstate      s_last_ss;
+static struct{
+    const struct camera  *cam;
+    vec3_t                pos;
+    float                 yaw, pitch;
+}s_last_view;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -104,6 +143,48 @@ static void timer_60hz_handler(void *unused1, void *unused2)
         E_Global_Notify(EVENT_1HZ_TICK, NULL, ES_ENGINE);
 }
 
+static bool timer_view_changed(void)
+{
+    const struct camera *cam = G_GetActiveCamera();
+    if(cam != s_last_view.cam)
+        return true;
+    if(!cam)
+        return false;
+
+    vec3_t pos = Camera_GetPos(cam);
+    return memcmp(&pos, &s_last_view.pos, sizeof(pos))
+        || Camera_GetYaw(cam) != s_last_view.yaw
+        || Camera_GetPitch(cam) != s_last_view.pitch;
+}
+
+static void timer_save_view(void)
+{
+    const struct camera *cam = G_GetActiveCamera();
+    s_last_view.cam = cam;
+    if(!cam)
+        return;
+
+    s_last_view.pos = Camera_GetPos(cam);
+    s_last_view.yaw = Camera_GetYaw(cam);
+    s_last_view.pitch = Camera_GetPitch(cam);
+}
+
+static bool timer_frame_idle(uint32_t now)
+{
+    if(s_idle_max_latency == 0 || s_dirty)
+        return false;
+    if(now - s_last_present >= (uint32_t)s_idle_max_latency)
+        return false;
+
+    enum simstate ss = G_GetSimState();
+    if(ss != s_last_ss)
+        return false;
+    if(ss == G_RUNNING && G_MapLoaded())
+        return false;
+
+    return !timer_view_changed();
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -127,3 +208,83 @@ void G_Timer_Shutdown(void)
     SDL_RemoveTimer(s_60hz_timer);
 }
 
+void G_Timer_Tick(void)
+{
+    if(s_speed == 1) {
+        E_Global_Notify(EVENT_60HZ_TICK, NULL, ES_ENGINE);
+        return;
+    }
+
+    /* Timer events don't get delivered while the simulation is paused */
+    if(G_GetSimState() != G_RUNNING)
+        return;
+
+    s_backlog = MIN(s_backlog + s_speed, s_speed * MAX_BACKLOG);
+}
+
+bool G_Timer_BeginFrame(void)
+{
+    if(s_backlog > 0) {
+        E_Global_Notify(EVENT_60HZ_TICK, NULL, ES_ENGINE);
+        s_backlog--;
+    }
+
+    uint32_t now = SDL_GetTicks();
+    s_present = (s_backlog == 0) || (now - s_last_present >= PRESENT_INTERVAL_MS);
+    s_idle = s_present && timer_frame_idle(now);
+
+    if(s_idle) {
+        s_present = false;
+    }
+    if(s_present) {
+        s_last_present = now;
+        s_last_ss = G_GetSimState();
+        s_dirty = false;
+        timer_save_view();
+    }
+    return s_present;
+}
+
+bool G_Timer_FramePresented(void)
+{
+    return s_present;
+}
+
+bool G_Timer_FrameIdle(void)
+{
+    return s_idle;
+}
+
+void G_Timer_MarkDirty(void)
+{
+    s_dirty = true;
+}
+
+bool G_Timer_SetIdleMaxLatency(int ms)
+{
+    if(ms < 0 || ms > CONFIG_IDLE_MAX_LATENCY_MAX_MS)
+        return false;
+
+    s_idle_max_latency = ms;
+    s_dirty = true;
+    return true;
+}
+
+bool G_Timer_SetSpeed(int speed)
+{
+    if(speed < 1 || speed > CONFIG_MAX_SIM_SPEED)
+        return false;
+
+    s_speed = speed;
+    s_backlog = MIN(s_backlog, s_speed * MAX_BACKLOG);
+    if(s_speed == 1) {
+        s_backlog = 0;
+    }
+    return true;
+}
+
+int G_Timer_GetSpeed(void)
+{
+    return s_speed;
+}
+
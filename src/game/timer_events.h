@@ -41,6 +41,8 @@
 
 bool G_Timer_Init(void);
 void G_Timer_Shutdown(void);
+/* Whether the current frame gets rendered (see 'G_Timer_BeginFrame') */
+bool G_Timer_FramePresented(void);
 
 #endif
 
@@ -0,0 +1,625 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/SDL_lz_rwops.h"
+#include "public/vec.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+
+#define LZ_MAGIC            "PFLZ"
+#define LZ_VERSION          (1)
+#define LZ_CODEC_LZ4_BLOCK  (1)
+#define LZ_HEADER_SIZE      (8)
+#define LZ_FRAME_HEADER_SIZE (8)
+
+#define LZ_FRAME_SIZE       (64 * 1024)
+#define LZ_FRAME_BOUND      (LZ_FRAME_SIZE + LZ_FRAME_SIZE / 255 + 16)
+#define LZ_HASH_BITS        (14)
+#define LZ_MIN_MATCH        (4)
+#define LZ_LAST_LITERALS    (5)
+#define LZ_MF_LIMIT         (12)
+#define LZ_MAX_OFFSET       (65535)
+
+#define SDL_RWOPS_LZ        (0xfffe)
+#define STATE(rwops)        ((struct lz_state*)((rwops)->hidden.unknown.data1))
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+
+/* The stream is a sequence of independently compressed frames, each 
+ * holding up to LZ_FRAME_SIZE bytes of the original data. Every frame 
+ * is prefixed with its' raw and stored sizes. A frame whose stored size 
+ * is equal to its' raw size is stored uncompressed. The frames are
+ * indexed as they are encountered, so that the reading side can
+ * seek by only decompressing the frame holding the target offset.
+ */
+struct lz_frame{
+    Sint64   src_off;
+    Sint64   raw_off;
+    uint32_t raw_size;
+    uint32_t stored_size;
+};
+
+VEC_TYPE(lzframe, struct lz_frame)
+VEC_IMPL(static inline, lzframe, struct lz_frame)
+
+struct lz_state{
+    SDL_RWops    *inner;
+    bool          writing;
+    Sint64        pos;
+    /* Writing */
+    size_t        nbuffered;
+    /* Reading */
+    Sint64        data_start;
+    vec_lzframe_t frames;
+    int           curr;
+    bool          scanned;
+    uint8_t       raw[LZ_FRAME_SIZE];
+    uint8_t       stored[LZ_FRAME_BOUND];
+    uint32_t      table[1 << LZ_HASH_BITS];
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t read32(const uint8_t *ptr)
+{
+    uint32_t ret;
+    memcpy(&ret, ptr, sizeof(ret));
+    return ret;
+}
+
+static void write_le32(uint8_t *out, uint32_t val)
+{
+    out[0] = (val >>  0) & 0xff;
+    out[1] = (val >>  8) & 0xff;
+    out[2] = (val >> 16) & 0xff;
+    out[3] = (val >> 24) & 0xff;
+}
+
+static uint32_t read_le32(const uint8_t *in)
+{
+    return ((uint32_t)in[0] <<  0)
+         | ((uint32_t)in[1] <<  8)
+         | ((uint32_t)in[2] << 16)
+         | ((uint32_t)in[3] << 24);
+}
+
+static uint32_t lz_hash(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static bool lz_emit_len(uint8_t **op, const uint8_t *oend, size_t len)
+{
+    while(len >= 255) {
+        if(*op >= oend)
+            return false;
+        *(*op)++ = 255;
+        len -= 255;
+    }
+    if(*op >= oend)
+        return false;
+    *(*op)++ = len;
+    return true;
+}
+
+static bool lz_emit_sequence(uint8_t **op, const uint8_t *oend, const uint8_t *lit, 
+                             size_t nlit, size_t offset, size_t mlen, bool last)
+{
+    if(*op >= oend)
+        return false;
+
+    uint8_t *token = (*op)++;
+    *token = (MIN(nlit, 15) << 4);
+    if(nlit >= 15 && !lz_emit_len(op, oend, nlit - 15))
+        return false;
+
+    if(oend - *op < nlit)
+        return false;
+    memcpy(*op, lit, nlit);
+    *op += nlit;
+
+    if(last)
+        return true;
+
+    if(oend - *op < 2)
+        return false;
+    *(*op)++ = (offset >> 0) & 0xff;
+    *(*op)++ = (offset >> 8) & 0xff;
+
+    mlen -= LZ_MIN_MATCH;
+    *token |= MIN(mlen, 15);
+    if(mlen >= 15 && !lz_emit_len(op, oend, mlen - 15))
+        return false;
+    return true;
+}
+
+/* Compresses into the LZ4 block format. Returns 0 if the output does 
+ * not fit into 'dstcap' bytes. 
+ */
+static size_t lz_compress(struct lz_state *state, const uint8_t *src, size_t srclen, 
+                          uint8_t *dst, size_t dstcap)
+{
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + srclen;
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + dstcap;
+
+    memset(state->table, 0, sizeof(state->table));
+
+    if(srclen > LZ_MF_LIMIT) {
+
+        const uint8_t *mflimit = end - LZ_MF_LIMIT;
+        const uint8_t *matchlimit = end - LZ_LAST_LITERALS;
+
+        while(ip < mflimit) {
+
+            uint32_t seq = read32(ip);
+            uint32_t hash = lz_hash(seq);
+            const uint8_t *ref = src + state->table[hash];
+            state->table[hash] = ip - src;
+
+            if(ref >= ip || (ip - ref) > LZ_MAX_OFFSET || read32(ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            size_t offset = ip - ref;
+            const uint8_t *mstart = ip;
+            ip += LZ_MIN_MATCH;
+            ref += LZ_MIN_MATCH;
+            while(ip < matchlimit && *ip == *ref) {
+                ip++;
+                ref++;
+            }
+
+            if(!lz_emit_sequence(&op, oend, anchor, mstart - anchor, offset, ip - mstart, false))
+                return 0;
+            anchor = ip;
+        }
+    }
+
+    if(!lz_emit_sequence(&op, oend, anchor, end - anchor, 0, 0, true))
+        return 0;
+    return op - dst;
+}
+
+static bool lz_read_len(const uint8_t **ip, const uint8_t *iend, size_t *inout)
+{
+    uint8_t byte;
+    do{
+        if(*ip >= iend)
+            return false;
+        byte = *(*ip)++;
+        *inout += byte;
+    }while(byte == 255);
+    return true;
+}
+
+static bool lz_decompress(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstlen)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + srclen;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstlen;
+
+    while(ip < iend) {
+
+        uint8_t token = *ip++;
+        size_t nlit = token >> 4;
+        if(nlit == 15 && !lz_read_len(&ip, iend, &nlit))
+            return false;
+
+        if(nlit > iend - ip || nlit > oend - op)
+            return false;
+        memcpy(op, ip, nlit);
+        op += nlit;
+        ip += nlit;
+
+        /* The last sequence only has literals */
+        if(ip == iend)
+            break;
+
+        if(iend - ip < 2)
+            return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if(offset == 0 || offset > op - dst)
+            return false;
+
+        size_t mlen = token & 0xf;
+        if(mlen == 15 && !lz_read_len(&ip, iend, &mlen))
+            return false;
+        mlen += LZ_MIN_MATCH;
+        if(mlen > oend - op)
+            return false;
+
+        /* The match may overlap the output */
+        const uint8_t *ref = op - offset;
+        while(mlen--) {
+            *op++ = *ref++;
+        }
+    }
+    return (op == oend);
+}
+
+static bool lz_flush(struct lz_state *state)
+{
+    if(state->nbuffered == 0)
+        return true;
+
+    uint32_t raw_size = state->nbuffered;
+    uint32_t stored_size = lz_compress(state, state->raw, raw_size, 
+        state->stored, MIN(raw_size - 1, sizeof(state->stored)));
+
+    const uint8_t *data = state->stored;
+    if(stored_size == 0) {
+        stored_size = raw_size;
+        data = state->raw;
+    }
+
+    uint8_t header[LZ_FRAME_HEADER_SIZE];
+    write_le32(header + 0, raw_size);
+    write_le32(header + 4, stored_size);
+
+    state->nbuffered = 0;
+    if(SDL_RWwrite(state->inner, header, sizeof(header), 1) != 1)
+        return false;
+    if(SDL_RWwrite(state->inner, data, stored_size, 1) != 1)
+        return false;
+    return true;
+}
+
+/* Adds the next frame of the stream to the index. Returns false at 
+ * the end of the stream.
+ */
+static bool lz_index_next(struct lz_state *state)
+{
+    if(state->scanned)
+        return false;
+
+    struct lz_frame next = (struct lz_frame){
+        .src_off = state->data_start,
+        .raw_off = 0
+    };
+    if(vec_size(&state->frames) > 0) {
+        struct lz_frame last = vec_AT(&state->frames, vec_size(&state->frames) - 1);
+        next.src_off = last.src_off + LZ_FRAME_HEADER_SIZE + last.stored_size;
+        next.raw_off = last.raw_off + last.raw_size;
+    }
+
+    uint8_t header[LZ_FRAME_HEADER_SIZE];
+    if(SDL_RWseek(state->inner, next.src_off, RW_SEEK_SET) < 0
+    || SDL_RWread(state->inner, header, sizeof(header), 1) != 1) {
+        state->scanned = true;
+        return false;
+    }
+
+    next.raw_size = read_le32(header + 0);
+    next.stored_size = read_le32(header + 4);
+    if(next.raw_size == 0 || next.raw_size > LZ_FRAME_SIZE || next.stored_size > next.raw_size) {
+        state->scanned = true;
+        return false;
+    }
+
+    if(!vec_lzframe_push(&state->frames, next)) {
+        state->scanned = true;
+        return false;
+    }
+    return true;
+}
+
+static bool frame_contains(const struct lz_frame *frame, Sint64 pos)
+{
+    return (pos >= frame->raw_off) && (pos < frame->raw_off + frame->raw_size);
+}
+
+/* Returns the index of the frame holding the specified offset, or -1 
+ */
+static int lz_find_frame(struct lz_state *state, Sint64 pos)
+{
+    /* Fast path for sequential reads */
+    int curr = state->curr;
+    if(curr >= 0 && frame_contains(&vec_AT(&state->frames, curr), pos))
+        return curr;
+    if(curr + 1 < vec_size(&state->frames) 
+    && frame_contains(&vec_AT(&state->frames, curr + 1), pos))
+        return curr + 1;
+
+    int lo = 0, hi = vec_size(&state->frames) - 1;
+    while(lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        const struct lz_frame *frame = &vec_AT(&state->frames, mid);
+        if(frame_contains(frame, pos))
+            return mid;
+        if(pos < frame->raw_off) {
+            hi = mid - 1;
+        }else{
+            lo = mid + 1;
+        }
+    }
+
+    while(lz_index_next(state)) {
+        int last = vec_size(&state->frames) - 1;
+        if(frame_contains(&vec_AT(&state->frames, last), pos))
+            return last;
+    }
+    return -1;
+}
+
+static bool lz_load_frame(struct lz_state *state, int idx)
+{
+    if(state->curr == idx)
+        return true;
+
+    state->curr = -1;
+    const struct lz_frame *frame = &vec_AT(&state->frames, idx);
+    if(SDL_RWseek(state->inner, frame->src_off + LZ_FRAME_HEADER_SIZE, RW_SEEK_SET) < 0)
+        return false;
+
+    if(frame->stored_size == frame->raw_size) {
+        if(SDL_RWread(state->inner, state->raw, frame->raw_size, 1) != 1)
+            return false;
+    }else{
+        if(SDL_RWread(state->inner, state->stored, frame->stored_size, 1) != 1)
+            return false;
+        if(!lz_decompress(state->stored, frame->stored_size, state->raw, frame->raw_size))
+            return false;
+    }
+
+    state->curr = idx;
+    return true;
+}
+
+static Sint64 rw_lz_size(SDL_RWops *ctx)
+{
+    assert(ctx->type == SDL_RWOPS_LZ);
+    struct lz_state *state = STATE(ctx);
+
+    if(state->writing)
+        return state->pos;
+
+    while(lz_index_next(state))
+        ;
+    if(vec_size(&state->frames) == 0)
+        return 0;
+
+    struct lz_frame last = vec_AT(&state->frames, vec_size(&state->frames) - 1);
+    return last.raw_off + last.raw_size;
+}
+
+static Sint64 rw_lz_seek(SDL_RWops *ctx, Sint64 offset, int whence)
+{
+    assert(ctx->type == SDL_RWOPS_LZ);
+    struct lz_state *state = STATE(ctx);
+
+    if(state->writing) {
+        if(whence != RW_SEEK_CUR || offset != 0)
+            return SDL_SetError("rw_lz_seek: Compressed output streams cannot seek");
+        return state->pos;
+    }
+
+    Sint64 target;
+    switch(whence) {
+    case RW_SEEK_SET:
+        target = offset;
+        break;
+    case RW_SEEK_CUR:
+        target = state->pos + offset;
+        break;
+    case RW_SEEK_END:
+        target = rw_lz_size(ctx) + offset;
+        break;
+    default:
+        return SDL_SetError("rw_lz_seek: Unknown value for 'whence'");
+    }
+
+    if(target < 0)
+        return SDL_SetError("rw_lz_seek: Seeking before the start of the stream");
+
+    state->pos = target;
+    return target;
+}
+
+static size_t rw_lz_write(SDL_RWops *ctx, const void *ptr, size_t size, size_t num)
+{
+    assert(ctx->type == SDL_RWOPS_LZ);
+    struct lz_state *state = STATE(ctx);
+    assert(state->writing);
+
+    const uint8_t *src = ptr;
+    size_t left = size * num;
+
+    while(left > 0) {
+        size_t chunk = MIN(left, LZ_FRAME_SIZE - state->nbuffered);
+        memcpy(state->raw + state->nbuffered, src, chunk);
+        state->nbuffered += chunk;
+        state->pos += chunk;
+        src += chunk;
+        left -= chunk;
+
+        if(state->nbuffered == LZ_FRAME_SIZE && !lz_flush(state)) {
+            SDL_Error(SDL_EFWRITE);
+            return 0;
+        }
+    }
+    return num;
+}
+
+static size_t rw_lz_read(SDL_RWops *ctx, void *ptr, size_t size, size_t num)
+{
+    assert(ctx->type == SDL_RWOPS_LZ);
+    struct lz_state *state = STATE(ctx);
+    assert(!state->writing);
+
+    if(size == 0)
+        return 0;
+
+    uint8_t *dst = ptr;
+    size_t total = size * num;
+    size_t nread = 0;
+
+    while(nread < total) {
+
+        int idx = lz_find_frame(state, state->pos);
+        if(idx < 0 || !lz_load_frame(state, idx))
+            break;
+
+        const struct lz_frame *frame = &vec_AT(&state->frames, idx);
+        size_t begin = state->pos - frame->raw_off;
+        size_t chunk = MIN(total - nread, frame->raw_size - begin);
+
+        memcpy(dst + nread, state->raw + begin, chunk);
+        nread += chunk;
+        state->pos += chunk;
+    }
+
+    /* Like the stdio streams, only whole objects are reported as read */
+    return nread / size;
+}
+
+static int rw_lz_close(SDL_RWops *ctx)
+{
+    assert(ctx->type == SDL_RWOPS_LZ);
+    struct lz_state *state = STATE(ctx);
+    int ret = 0;
+
+    if(state->writing && !lz_flush(state))
+        ret = -1;
+    if(SDL_RWclose(state->inner) < 0)
+        ret = -1;
+
+    vec_lzframe_destroy(&state->frames);
+    free(state);
+    SDL_FreeRW(ctx);
+    return ret;
+}
+
+static SDL_RWops *lz_rwops(SDL_RWops *inner, bool writing)
+{
+    SDL_RWops *ret = SDL_AllocRW();
+    if(!ret)
+        goto fail_alloc;
+
+    struct lz_state *state = malloc(sizeof(struct lz_state));
+    if(!state)
+        goto fail_state;
+
+    state->inner = inner;
+    state->writing = writing;
+    state->pos = 0;
+    state->nbuffered = 0;
+    state->data_start = 0;
+    state->curr = -1;
+    state->scanned = false;
+    vec_lzframe_init(&state->frames);
+
+    ret->size = rw_lz_size;
+    ret->seek = rw_lz_seek;
+    ret->read = rw_lz_read;
+    ret->write = rw_lz_write;
+    ret->close = rw_lz_close;
+    ret->type = SDL_RWOPS_LZ;
+    ret->hidden.unknown.data1 = state;
+    return ret;
+
+fail_state:
+    SDL_FreeRW(ret);
+fail_alloc:
+    return NULL;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+SDL_RWops *PFSDL_LZCompressRWOps(SDL_RWops *dst)
+{
+    const uint8_t header[LZ_HEADER_SIZE] = {
+        LZ_MAGIC[0], LZ_MAGIC[1], LZ_MAGIC[2], LZ_MAGIC[3], 
+        LZ_VERSION, LZ_CODEC_LZ4_BLOCK, 0, 0
+    };
+    if(SDL_RWwrite(dst, header, sizeof(header), 1) != 1)
+        return NULL;
+    return lz_rwops(dst, true);
+}
+
+SDL_RWops *PFSDL_LZDecompressRWOps(SDL_RWops *src)
+{
+    uint8_t header[LZ_HEADER_SIZE];
+    Sint64 start = SDL_RWtell(src);
+
+    if(SDL_RWread(src, header, sizeof(header), 1) != 1)
+        return NULL;
+    if(0 != memcmp(header, LZ_MAGIC, 4))
+        return NULL;
+    if(header[4] != LZ_VERSION || header[5] != LZ_CODEC_LZ4_BLOCK)
+        return NULL;
+
+    SDL_RWops *ret = lz_rwops(src, false);
+    if(!ret)
+        return NULL;
+
+    STATE(ret)->data_start = start + LZ_HEADER_SIZE;
+    return ret;
+}
+
+bool PFSDL_LZIsCompressed(SDL_RWops *stream)
+{
+    char magic[4];
+    Sint64 pos = SDL_RWtell(stream);
+    bool ret = (SDL_RWread(stream, magic, sizeof(magic), 1) == 1)
+            && (0 == memcmp(magic, LZ_MAGIC, sizeof(magic)));
+    SDL_RWseek(stream, pos, RW_SEEK_SET);
+    return ret;
+}
+
+bool PFSDL_LZFinish(SDL_RWops *stream)
+{
+    assert(stream->type == SDL_RWOPS_LZ);
+    struct lz_state *state = STATE(stream);
+    bool ret = !state->writing || lz_flush(state);
+
+    vec_lzframe_destroy(&state->frames);
+    free(state);
+    SDL_FreeRW(stream);
+    return ret;
+}
+
@@ -35,21 +35,76 @@
 
 #include "public/SDL_vec_rwops.h"
 #include "public/vec.h"
+#include "../perf.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
-VEC_TYPE(uchar, unsigned char)
-VEC_IMPL(static inline, uchar, unsigned char)
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
 
 #define VEC(rwops)          ((vec_uchar_t*)((rwops)->hidden.unknown.data1))
 #define SEEK_IDX(rwops)     ((uintptr_t)((rwops)->hidden.unknown.data2))
+#define VMEM(rwops)         ((struct vmem*)((rwops)->hidden.unknown.data1))
 #define SDL_RWOPS_VEC       (0xffff)
+#define SDL_RWOPS_VMEM      (0xfffd)
+
+/* Pages are committed in chunks of at least this size */
+#define VMEM_COMMIT_GRAN    (64 * 1024)
+#define ALIGNED(val, align) (((val) + ((align) - 1)) & ~((align) - 1))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+
+struct vmem_ref{
+    size_t       at;     /* offset into the inline data that the reference follows */
+    const void  *ptr;
+    size_t       size;
+    void       (*release)(void*);
+    void        *arg;
+};
+
+VEC_TYPE(uchar, unsigned char)
+VEC_IMPL(static inline, uchar, unsigned char)
+
+VEC_TYPE(ref, struct vmem_ref)
+VEC_IMPL(static inline, ref, struct vmem_ref)
+
+/* A stream backed by a reserved range of virtual address space. Pages are 
+ * committed as the stream grows, so the data never moves and growing it
+ * never copies. In gather mode, buffers owned by the caller may be appended 
+ * by reference - they are interleaved with the inline data lazily, the first
+ * time that the stream contents are needed contiguously.
+ */
+struct vmem{
+    char        *base;
+    size_t       reserved;
+    size_t       committed;
+    size_t       size;       /* bytes of inline data */
+    size_t       seek;
+    bool         gather;
+    vec_ref_t    refs;
+    size_t       ref_bytes;
+};
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static void rw_vec_account(SDL_RWops *ctx, size_t old_capacity)
+{
+    if(VEC(ctx)->capacity != old_capacity)
+        Perf_MemRealloc(PERF_MEM_PICKLE_STREAMS, old_capacity, VEC(ctx)->capacity);
+}
+
 static Sint64 rw_vec_size(SDL_RWops *ctx)
 {
     assert(ctx->type == SDL_RWOPS_VEC);
@@ -78,18 +133,19 @@ static Sint64 rw_vec_seek(SDL_RWops *ctx, Sint64 offset, int whence)
 static size_t rw_vec_write(SDL_RWops *ctx, const void *ptr, size_t size, size_t num)
 {
     assert(ctx->type == SDL_RWOPS_VEC);
+    size_t old_capacity = VEC(ctx)->capacity;
+    size_t need = vec_size(VEC(ctx)) + size * num;
 
-    if(rw_vec_size(ctx) <= SEEK_IDX(ctx) + size * num
-    && !vec_uchar_resize(VEC(ctx), SEEK_IDX(ctx) + size * num)) {
+    if(old_capacity < need
+    && !vec_uchar_resize(VEC(ctx), MAX(need, old_capacity * 2))) {
     
         SDL_Error(SDL_EFWRITE);
         return 0;
     }
 
-    for(int i = 0; i < size * num; i++) {
-        vec_uchar_push(VEC(ctx), *((unsigned char*)ptr));
-        ptr = ((unsigned char*)ptr) + 1;
-    }
+    memcpy(VEC(ctx)->array + vec_size(VEC(ctx)), ptr, size * num);
+    VEC(ctx)->size += size * num;
+    rw_vec_account(ctx, old_capacity);
 
     ctx->hidden.unknown.data2 = (void*)(SEEK_IDX(ctx) + size * num);
     return num;
@@ -113,11 +169,228 @@ static size_t rw_vec_read(SDL_RWops *ctx, void *ptr, size_t size, size_t num)
 static int rw_vec_close(SDL_RWops *ctx)
 {
     assert(ctx->type == SDL_RWOPS_VEC);
+    Perf_MemFree(PERF_MEM_PICKLE_STREAMS, VEC(ctx)->capacity);
     vec_uchar_destroy(ctx->hidden.unknown.data1);
     free(ctx);
     return 0;
 }
 
+static size_t vm_page_size(void)
+{
+    static size_t s_page_size = 0;
+    if(s_page_size)
+        return s_page_size;
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    s_page_size = info.dwPageSize;
+#else
+    s_page_size = sysconf(_SC_PAGESIZE);
+#endif
+    return s_page_size;
+}
+
+static void *vm_reserve(size_t size)
+{
+#if defined(_WIN32)
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void *ret = mmap(NULL, size, PROT_NONE, 
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return (ret == MAP_FAILED) ? NULL : ret;
+#endif
+}
+
+static bool vm_commit(void *addr, size_t size)
+{
+#if defined(_WIN32)
+    return (NULL != VirtualAlloc(addr, size, MEM_COMMIT, PAGE_READWRITE));
+#else
+    return (0 == mprotect(addr, size, PROT_READ | PROT_WRITE));
+#endif
+}
+
+static void vm_release(void *addr, size_t size)
+{
+#if defined(_WIN32)
+    VirtualFree(addr, 0, MEM_RELEASE);
+#else
+    munmap(addr, size);
+#endif
+}
+
+static size_t rw_vmem_logical_size(const struct vmem *vm)
+{
+    return vm->size + vm->ref_bytes;
+}
+
+/* Make sure that at least 'need' bytes are backed by committed pages. 
+ * Exhausting the reserved range is the only case that moves the data.
+ */
+static bool rw_vmem_commit(struct vmem *vm, size_t need)
+{
+    if(need <= vm->committed)
+        return true;
+
+    size_t gran = MAX(VMEM_COMMIT_GRAN, vm_page_size());
+    size_t target = ALIGNED(need, gran);
+
+    if(target > vm->reserved) {
+
+        size_t reserve = MAX(vm->reserved * 2, target);
+        char *base = vm_reserve(reserve);
+        if(!base)
+            return false;
+        if(!vm_commit(base, target)) {
+            vm_release(base, reserve);
+            return false;
+        }
+        if(vm->base) {
+            memcpy(base, vm->base, vm->size);
+            vm_release(vm->base, vm->reserved);
+        }
+        Perf_MemRealloc(PERF_MEM_PICKLE_STREAMS, vm->committed, target);
+        vm->base = base;
+        vm->reserved = reserve;
+        vm->committed = target;
+        return true;
+    }
+
+    if(!vm_commit(vm->base + vm->committed, target - vm->committed))
+        return false;
+    Perf_MemRealloc(PERF_MEM_PICKLE_STREAMS, vm->committed, target);
+    vm->committed = target;
+    return true;
+}
+
+/* Copy the referenced buffers in between the inline data, in place. Every 
+ * inline chunk only ever moves towards the end, so working backwards from 
+ * the last reference never clobbers data that is yet to be moved.
+ */
+static bool rw_vmem_flatten(struct vmem *vm)
+{
+    if(vec_size(&vm->refs) == 0)
+        return true;
+
+    size_t total = rw_vmem_logical_size(vm);
+    if(!rw_vmem_commit(vm, total))
+        return false;
+
+    size_t end = total;
+    size_t inline_end = vm->size;
+
+    for(int i = vec_size(&vm->refs) - 1; i >= 0; i--) {
+
+        struct vmem_ref *ref = &vec_AT(&vm->refs, i);
+        size_t len = inline_end - ref->at;
+
+        memmove(vm->base + end - len, vm->base + ref->at, len);
+        end -= len;
+        memcpy(vm->base + end - ref->size, ref->ptr, ref->size);
+        end -= ref->size;
+
+        if(ref->release)
+            ref->release(ref->arg);
+        inline_end = ref->at;
+    }
+    assert(end == inline_end);
+
+    vec_ref_reset(&vm->refs);
+    vm->size = total;
+    vm->ref_bytes = 0;
+    return true;
+}
+
+static Sint64 rw_vmem_size(SDL_RWops *ctx)
+{
+    assert(ctx->type == SDL_RWOPS_VMEM);
+    return rw_vmem_logical_size(VMEM(ctx));
+}
+
+static Sint64 rw_vmem_seek(SDL_RWops *ctx, Sint64 offset, int whence)
+{
+    assert(ctx->type == SDL_RWOPS_VMEM);
+    struct vmem *vm = VMEM(ctx);
+    Sint64 pos;
+
+    switch (whence) {
+    case RW_SEEK_SET:
+        pos = offset;
+        break;
+    case RW_SEEK_CUR:
+        pos = vm->seek + offset;
+        break;
+    case RW_SEEK_END:
+        pos = rw_vmem_logical_size(vm) + offset;
+        break;
+    default:
+        return SDL_SetError("rw_vmem_seek: Unknown value for 'whence'");
+    }
+    if(pos < 0)
+        return SDL_SetError("rw_vmem_seek: Seeking before the start of the stream");
+    vm->seek = pos;
+    return pos;
+}
+
+static size_t rw_vmem_write(SDL_RWops *ctx, const void *ptr, size_t size, size_t num)
+{
+    assert(ctx->type == SDL_RWOPS_VMEM);
+    struct vmem *vm = VMEM(ctx);
+    size_t total = size * num;
+
+    /* With pending references, only appending can be done without flattening */
+    if(vm->seek != rw_vmem_logical_size(vm) && !rw_vmem_flatten(vm))
+        goto fail;
+
+    size_t pos = vm->seek - vm->ref_bytes;
+    if(!rw_vmem_commit(vm, pos + total))
+        goto fail;
+
+    memcpy(vm->base + pos, ptr, total);
+    vm->size = MAX(vm->size, pos + total);
+    vm->seek += total;
+    return num;
+
+fail:
+    SDL_Error(SDL_EFWRITE);
+    return 0;
+}
+
+static size_t rw_vmem_read(SDL_RWops *ctx, void *ptr, size_t size, size_t num)
+{
+    assert(ctx->type == SDL_RWOPS_VMEM);
+    struct vmem *vm = VMEM(ctx);
+
+    if(!rw_vmem_flatten(vm) || vm->size < vm->seek + size * num) {
+
+        SDL_Error(SDL_EFREAD);
+        return 0;
+    }
+
+    memcpy(ptr, vm->base + vm->seek, size * num);
+    vm->seek += size * num;
+    return num;
+}
+
+static int rw_vmem_close(SDL_RWops *ctx)
+{
+    assert(ctx->type == SDL_RWOPS_VMEM);
+    struct vmem *vm = VMEM(ctx);
+
+    for(int i = 0; i < vec_size(&vm->refs); i++) {
+        struct vmem_ref *ref = &vec_AT(&vm->refs, i);
+        if(ref->release)
+            ref->release(ref->arg);
+    }
+    vec_ref_destroy(&vm->refs);
+
+    if(vm->base)
+        vm_release(vm->base, vm->reserved);
+    Perf_MemFree(PERF_MEM_PICKLE_STREAMS, vm->committed);
+    free(ctx);
+    return 0;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -138,16 +411,120 @@ SDL_RWops *PFSDL_VectorRWOps(void)
     ret->hidden.unknown.data1 = ret + 1;
     vec_uchar_init(VEC(ret));
     ret->hidden.unknown.data2 = (void*)0; /* This is the seek index */
+    Perf_MemAlloc(PERF_MEM_PICKLE_STREAMS, 0);
+
+    return ret;
+}
+
+SDL_RWops *PFSDL_VMemRWOps(size_t reserve, bool gather)
+{
+    SDL_RWops *ret = malloc(sizeof(SDL_RWops) + sizeof(struct vmem));
+    if(!ret)
+        return ret;
+
+    struct vmem *vm = (struct vmem*)(ret + 1);
+    reserve = ALIGNED(MAX(reserve, VMEM_COMMIT_GRAN), vm_page_size());
+
+    vm->base = vm_reserve(reserve);
+    if(!vm->base) {
+        free(ret);
+        return NULL;
+    }
+    vm->reserved = reserve;
+    vm->committed = 0;
+    vm->size = 0;
+    vm->seek = 0;
+    vm->gather = gather;
+    vec_ref_init(&vm->refs);
+    vm->ref_bytes = 0;
+
+    ret->size = rw_vmem_size;
+    ret->seek = rw_vmem_seek;
+    ret->read = rw_vmem_read;
+    ret->write = rw_vmem_write;
+    ret->close = rw_vmem_close;
+    ret->type = SDL_RWOPS_VMEM;
+    ret->hidden.unknown.data1 = vm;
+    Perf_MemAlloc(PERF_MEM_PICKLE_STREAMS, 0);
 
     return ret;
 }
 
+bool PFSDL_VMemRWOpsGathers(SDL_RWops *ctx)
+{
+    return (ctx->type == SDL_RWOPS_VMEM) && VMEM(ctx)->gather;
+}
+
+bool PFSDL_VMemRWOpsAppendRef(SDL_RWops *ctx, const void *ptr, size_t size,
+                              void (*release)(void*), void *arg)
+{
+    assert(PFSDL_VMemRWOpsGathers(ctx));
+    struct vmem *vm = VMEM(ctx);
+
+    if(vm->seek != rw_vmem_logical_size(vm)) {
+        SDL_SetError("PFSDL_VMemRWOpsAppendRef: References can only be appended");
+        return false;
+    }
+
+    struct vmem_ref ref = (struct vmem_ref){
+        .at = vm->size,
+        .ptr = ptr,
+        .size = size,
+        .release = release,
+        .arg = arg
+    };
+    if(!vec_ref_push(&vm->refs, ref))
+        return false;
+
+    vm->ref_bytes += size;
+    vm->seek += size;
+    return true;
+}
+
+bool PFSDL_VectorRWOpsWriteTo(SDL_RWops *ctx, SDL_RWops *dst)
+{
+    if(ctx->type == SDL_RWOPS_VEC) {
+        size_t size = vec_size(VEC(ctx));
+        return (size == 0) || (SDL_RWwrite(dst, VEC(ctx)->array, size, 1) == 1);
+    }
+
+    assert(ctx->type == SDL_RWOPS_VMEM);
+    struct vmem *vm = VMEM(ctx);
+    size_t inline_begin = 0;
+
+    for(int i = 0; i < vec_size(&vm->refs); i++) {
+
+        const struct vmem_ref *ref = &vec_AT(&vm->refs, i);
+        size_t len = ref->at - inline_begin;
+
+        if(len > 0 && SDL_RWwrite(dst, vm->base + inline_begin, len, 1) != 1)
+            return false;
+        if(ref->size > 0 && SDL_RWwrite(dst, ref->ptr, ref->size, 1) != 1)
+            return false;
+        inline_begin = ref->at;
+    }
+
+    size_t len = vm->size - inline_begin;
+    return (len == 0) || (SDL_RWwrite(dst, vm->base + inline_begin, len, 1) == 1);
+}
+
 const char *PFSDL_VectorRWOpsRaw(SDL_RWops *ctx)
 {
+    if(ctx->type == SDL_RWOPS_VMEM) {
+        if(!rw_vmem_flatten(VMEM(ctx)))
+            return NULL;
+        return VMEM(ctx)->base;
+    }
     return (const char*)VEC(ctx)->array;
 }
 
 bool PFSDL_VectorRWOpsReserve(SDL_RWops* ctx, size_t size)
 {
-    return vec_uchar_resize(VEC(ctx), size);
+    if(ctx->type == SDL_RWOPS_VMEM)
+        return rw_vmem_commit(VMEM(ctx), size);
+
+    size_t old_capacity = VEC(ctx)->capacity;
+    bool ret = vec_uchar_resize(VEC(ctx), size);
+    rw_vec_account(ctx, old_capacity);
+    return ret;
 }
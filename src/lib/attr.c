@@ -44,14 +44,175 @@
 
 #define CHK_TRUE(_pred, _label) do{ if(!(_pred)) goto _label; }while(0)
 
+/* No text attribute starts with a byte in this range */
+#define BIN_TAG_MASK    (0xf0)
+#define BIN_TAG         (0xf0)
+#define BIN_NAMED       (0x08)
+#define BIN_TYPE_MASK   (0x07)
+#define BIN_MAX_SIZE    (1 + 1 + 64 + 1 + 256)
+
 /*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
+/* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-bool Attr_Parse(struct SDL_RWops *stream, struct attr *out, bool named)
+static enum attr_format s_write_format = ATTR_FORMAT_TEXT;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t rd_u32(const unsigned char *in)
+{
+    return ((uint32_t)in[0])
+         | ((uint32_t)in[1] << 8)
+         | ((uint32_t)in[2] << 16)
+         | ((uint32_t)in[3] << 24);
+}
+
+static float rd_float(const unsigned char *in)
+{
+    uint32_t bits = rd_u32(in);
+    float ret;
+    memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
+
+static unsigned char *wr_u32(unsigned char *out, uint32_t val)
+{
+    out[0] = val & 0xff;
+    out[1] = (val >> 8) & 0xff;
+    out[2] = (val >> 16) & 0xff;
+    out[3] = (val >> 24) & 0xff;
+    return out + 4;
+}
+
+static unsigned char *wr_float(unsigned char *out, float val)
+{
+    uint32_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return wr_u32(out, bits);
+}
+
+static unsigned char *wr_floats(unsigned char *out, const float *vals, int count)
+{
+    for(int i = 0; i < count; i++) {
+        out = wr_float(out, vals[i]);
+    }
+    return out;
+}
+
+static float *attr_floats(struct attr *attr, int *out_count)
+{
+    switch(attr->type) {
+    case TYPE_FLOAT:    *out_count = 1; return &attr->val.as_float;
+    case TYPE_VEC2:     *out_count = 2; return attr->val.as_vec2.raw;
+    case TYPE_VEC3:     *out_count = 3; return attr->val.as_vec3.raw;
+    case TYPE_QUAT:     *out_count = 4; return attr->val.as_quat.raw;
+    default:            *out_count = 0; return NULL;
+    }
+}
+
+static bool parse_binary(SDL_RWops *stream, unsigned char tag, struct attr *out, bool named)
+{
+    unsigned char buff[256];
+    unsigned char len;
+
+    if(tag & BIN_NAMED) {
+        CHK_TRUE(SDL_RWread(stream, &len, 1, 1), fail);
+        CHK_TRUE(len < sizeof(out->key), fail);
+        CHK_TRUE(len == 0 || SDL_RWread(stream, out->key, len, 1), fail);
+        out->key[len] = '\0';
+    }else{
+        CHK_TRUE(!named, fail);
+    }
+
+    out->type = tag & BIN_TYPE_MASK;
+    switch(out->type) {
+    case TYPE_STRING:
+        CHK_TRUE(SDL_RWread(stream, &len, 1, 1), fail);
+        CHK_TRUE(len == 0 || SDL_RWread(stream, out->val.as_string, len, 1), fail);
+        out->val.as_string[len] = '\0';
+        break;
+    case TYPE_INT:
+        CHK_TRUE(SDL_RWread(stream, buff, 4, 1), fail);
+        out->val.as_int = (int32_t)rd_u32(buff);
+        break;
+    case TYPE_BOOL:
+        CHK_TRUE(SDL_RWread(stream, buff, 1, 1), fail);
+        CHK_TRUE(buff[0] == 0 || buff[0] == 1, fail);
+        out->val.as_bool = buff[0];
+        break;
+    case TYPE_FLOAT:
+    case TYPE_VEC2:
+    case TYPE_VEC3:
+    case TYPE_QUAT: {
+        int nfloats;
+        float *dst = attr_floats(out, &nfloats);
+        CHK_TRUE(SDL_RWread(stream, buff, 4 * nfloats, 1), fail);
+        for(int i = 0; i < nfloats; i++) {
+            dst[i] = rd_float(buff + 4 * i);
+        }
+        break;
+    }
+    default:
+        goto fail;
+    }
+    return true;
+
+fail:
+    return false;
+}
+
+static bool write_binary(SDL_RWops *stream, const struct attr *in, const char name[])
+{
+    unsigned char buff[BIN_MAX_SIZE];
+    unsigned char *cursor = buff;
+    assert(in->type <= BIN_TYPE_MASK);
+
+    *cursor++ = BIN_TAG | (name ? BIN_NAMED : 0) | in->type;
+    if(name) {
+        /* Names are truncated on parsing text attributes as well */
+        size_t len = strlen(name);
+        if(len > sizeof(((struct attr*)NULL)->key) - 1)
+            len = sizeof(((struct attr*)NULL)->key) - 1;
+        *cursor++ = len;
+        memcpy(cursor, name, len);
+        cursor += len;
+    }
+
+    switch(in->type) {
+    case TYPE_STRING: {
+        size_t len = strlen(in->val.as_string);
+        assert(len < sizeof(in->val.as_string));
+        *cursor++ = len;
+        memcpy(cursor, in->val.as_string, len);
+        cursor += len;
+        break;
+    }
+    case TYPE_INT:
+        cursor = wr_u32(cursor, (uint32_t)in->val.as_int);
+        break;
+    case TYPE_BOOL:
+        *cursor++ = !!in->val.as_bool;
+        break;
+    case TYPE_FLOAT:
+    case TYPE_VEC2:
+    case TYPE_VEC3:
+    case TYPE_QUAT: {
+        int nfloats;
+        const float *src = attr_floats((struct attr*)in, &nfloats);
+        cursor = wr_floats(cursor, src, nfloats);
+        break;
+    }
+    default: assert(0);
+    }
+
+    assert(cursor - buff <= sizeof(buff));
+    return (SDL_RWwrite(stream, buff, cursor - buff, 1) == 1);
+}
+
+static bool parse_text(char *line, struct attr *out, bool named)
 {
-    char line[MAX_LINE_LEN];
-    READ_LINE(stream, line, fail);
     char *saveptr;
     char *token;
 
@@ -140,8 +301,43 @@ fail:
     return false;
 }
 
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Attr_Parse(struct SDL_RWops *stream, struct attr *out, bool named)
+{
+    unsigned char first;
+    CHK_TRUE(SDL_RWread(stream, &first, 1, 1), fail);
+
+    if((first & BIN_TAG_MASK) == BIN_TAG)
+        return parse_binary(stream, first, out, named);
+
+    /* An empty line is never a valid attribute */
+    CHK_TRUE(first != '\n', fail);
+
+    char line[MAX_LINE_LEN + 1];
+    line[0] = first;
+    CHK_TRUE(AL_ReadLine(stream, line + 1), fail);
+    line[MAX_LINE_LEN - 1] = '\0';
+    return parse_text(line, out, named);
+
+fail:
+    return false;
+}
+
+enum attr_format Attr_SetWriteFormat(enum attr_format format)
+{
+    enum attr_format ret = s_write_format;
+    s_write_format = format;
+    return ret;
+}
+
 bool Attr_Write(struct SDL_RWops *stream, const struct attr *in, const char name[])
 {
+    if(s_write_format == ATTR_FORMAT_BINARY)
+        return write_binary(stream, in, name);
+
     if(name) {
         CHK_TRUE(SDL_RWwrite(stream, name, strlen(name), 1), fail);
         CHK_TRUE(SDL_RWwrite(stream, " ", 1, 1), fail);
@@ -0,0 +1,282 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/cpu_topo.h"
+#include "public/pf_string.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static int popcount(uint64_t mask)
+{
+    int ret = 0;
+    while(mask) {
+        mask &= (mask - 1);
+        ret++;
+    }
+    return ret;
+}
+
+static uint64_t lowest_bit(uint64_t mask)
+{
+    return mask & (~mask + 1);
+}
+
+#if defined(_WIN32)
+
+static bool topo_query_os(struct cpu_topo *out)
+{
+    DWORD len = 0;
+    GetLogicalProcessorInformationEx(RelationProcessorCore, NULL, &len);
+    if(GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+        return false;
+
+    char *buff = malloc(len);
+    if(!buff)
+        return false;
+
+    if(!GetLogicalProcessorInformationEx(RelationProcessorCore, 
+        (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buff, &len)) {
+        free(buff);
+        return false;
+    }
+
+    uint64_t core_masks[CPU_TOPO_MAX_CPUS];
+    int core_classes[CPU_TOPO_MAX_CPUS];
+    int ncores = 0, max_class = 0;
+
+    for(DWORD off = 0; off < len;) {
+
+        PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = 
+            (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buff + off);
+        off += info->Size;
+
+        if(info->Relationship != RelationProcessorCore)
+            continue;
+        if(info->Processor.GroupMask[0].Group != 0)
+            continue;
+        if(ncores == CPU_TOPO_MAX_CPUS)
+            break;
+
+        core_masks[ncores] = (uint64_t)info->Processor.GroupMask[0].Mask;
+        core_classes[ncores] = info->Processor.EfficiencyClass;
+        if(core_classes[ncores] > max_class)
+            max_class = core_classes[ncores];
+        ncores++;
+    }
+    free(buff);
+
+    if(ncores == 0)
+        return false;
+
+    /* A higher class means a more performant core */
+    for(int i = 0; i < ncores; i++) {
+        out->online |= core_masks[i];
+        out->primary |= lowest_bit(core_masks[i]);
+        if(core_classes[i] < max_class)
+            out->efficiency |= core_masks[i];
+    }
+    return true;
+}
+
+#else
+
+static bool read_file(const char *path, char *out, size_t maxlen)
+{
+    FILE *file = fopen(path, "r");
+    if(!file)
+        return false;
+
+    bool ret = (fgets(out, maxlen, file) != NULL);
+    fclose(file);
+    return ret;
+}
+
+static bool read_int(const char *path, int *out)
+{
+    char buff[64];
+    if(!read_file(path, buff, sizeof(buff)))
+        return false;
+    char *end;
+    *out = strtol(buff, &end, 10);
+    return (end != buff);
+}
+
+/* Parse the kernel's CPU list format (ex. "0-3,8,10-11") */
+static bool read_cpulist(const char *path, uint64_t *out)
+{
+    char buff[512];
+    if(!read_file(path, buff, sizeof(buff)))
+        return false;
+
+    *out = 0;
+    const char *curr = buff;
+    while(*curr && *curr != '\n') {
+
+        char *end;
+        long first = strtol(curr, &end, 10);
+        if(end == curr)
+            return false;
+
+        long last = first;
+        if(*end == '-') {
+            curr = end + 1;
+            last = strtol(curr, &end, 10);
+            if(end == curr)
+                return false;
+        }
+
+        for(long i = first; i <= last && i < CPU_TOPO_MAX_CPUS; i++) {
+            *out |= ((uint64_t)1) << i;
+        }
+
+        curr = end;
+        if(*curr == ',')
+            curr++;
+    }
+    return true;
+}
+
+static bool topo_query_os(struct cpu_topo *out)
+{
+    if(!read_cpulist("/sys/devices/system/cpu/online", &out->online))
+        return false;
+
+    int packages[CPU_TOPO_MAX_CPUS];
+    int cores[CPU_TOPO_MAX_CPUS];
+    int capacities[CPU_TOPO_MAX_CPUS];
+    int max_capacity = 0;
+    bool have_capacity = true;
+
+    for(int i = 0; i < CPU_TOPO_MAX_CPUS; i++) {
+
+        if(!(out->online & (((uint64_t)1) << i)))
+            continue;
+
+        char path[128];
+        pf_snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", i);
+        if(!read_int(path, &cores[i]))
+            cores[i] = i;
+        pf_snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i);
+        if(!read_int(path, &packages[i]))
+            packages[i] = 0;
+
+        /* Set on asymmetric ARM systems */
+        pf_snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", i);
+        if(read_int(path, &capacities[i])) {
+            if(capacities[i] > max_capacity)
+                max_capacity = capacities[i];
+        }else{
+            have_capacity = false;
+        }
+
+        bool primary = true;
+        for(int j = 0; j < i; j++) {
+            if(!(out->online & (((uint64_t)1) << j)))
+                continue;
+            if(packages[j] == packages[i] && cores[j] == cores[i]) {
+                primary = false;
+                break;
+            }
+        }
+        if(primary) {
+            out->primary |= ((uint64_t)1) << i;
+        }
+    }
+
+    /* Intel hybrid CPUs expose a separate PMU for the E-cores */
+    if(read_cpulist("/sys/devices/cpu_atom/cpus", &out->efficiency)) {
+        out->efficiency &= out->online;
+    }else if(have_capacity) {
+        for(int i = 0; i < CPU_TOPO_MAX_CPUS; i++) {
+            if(!(out->online & (((uint64_t)1) << i)))
+                continue;
+            if(capacities[i] < max_capacity)
+                out->efficiency |= ((uint64_t)1) << i;
+        }
+    }
+    return true;
+}
+
+#endif
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void cpu_topo_query(struct cpu_topo *out)
+{
+    *out = (struct cpu_topo){0};
+
+    if(!topo_query_os(out) || !out->online) {
+
+        /* Assume every logical CPU is a separate core */
+        int ncpus = SDL_GetCPUCount();
+        if(ncpus > CPU_TOPO_MAX_CPUS)
+            ncpus = CPU_TOPO_MAX_CPUS;
+        *out = (struct cpu_topo){0};
+        out->online = (ncpus == CPU_TOPO_MAX_CPUS) ? ~((uint64_t)0) 
+                                                    : (((uint64_t)1) << ncpus) - 1;
+        out->primary = out->online;
+    }
+
+    out->nlogical = popcount(out->online);
+    out->nphysical = popcount(out->primary);
+}
+
+bool cpu_topo_pin_current_thread(uint64_t mask)
+{
+    if(!mask)
+        return false;
+#if defined(_WIN32)
+    return (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) != 0);
+#else
+    /* A TID of 0 refers to the calling thread */
+    return (syscall(SYS_sched_setaffinity, 0, sizeof(mask), &mask) == 0);
+#endif
+}
+
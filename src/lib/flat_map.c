@@ -0,0 +1,173 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/flat_map.h"
+#include "public/khash.h"
+
+#include <SDL.h>
+
+#define BENCH_OPS   (1 << 20)
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+
+KHASH_MAP_INIT_INT(bench, uint32_t)
+FLAT_MAP_INIT_INT(bench, uint32_t)
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static double bench_ms(uint64_t begin)
+{
+    return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+/* Entity uids are handed out sequentially, so the keys are too. The tables 
+ * are queried repeatedly so that the small sizes take a measurable time.
+ */
+static void bench_khash(size_t nentries, int nrounds, struct fm_bench_result *out)
+{
+    int ret;
+    size_t nfound = 0;
+    khash_t(bench) *table = kh_init(bench);
+    if(!table)
+        return;
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(uint32_t i = 0; i < nentries; i++) {
+        khiter_t k = kh_put(bench, table, i + 1, &ret);
+        kh_val(table, k) = i;
+    }
+    out->insert_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(uint32_t i = 0; i < nentries; i++) {
+            khiter_t k = kh_get(bench, table, i + 1);
+            nfound += (k != kh_end(table)) ? (kh_val(table, k) == i) : 0;
+        }
+    }
+    out->hit_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(uint32_t i = 0; i < nentries; i++) {
+            khiter_t k = kh_get(bench, table, nentries + i + 1);
+            nfound += (k != kh_end(table));
+        }
+    }
+    out->miss_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(uint32_t i = 0; i < nentries; i += 2) {
+        khiter_t k = kh_get(bench, table, i + 1);
+        kh_del(bench, table, k);
+    }
+    out->delete_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        uint32_t val;
+        kh_foreach_value(table, val, { nfound += val & 0x1; });
+    }
+    out->iterate_ms = bench_ms(begin);
+
+    out->nfound = nfound;
+    kh_destroy(bench, table);
+}
+
+static void bench_flat_map(size_t nentries, int nrounds, struct fm_bench_result *out)
+{
+    int ret;
+    size_t nfound = 0;
+    flatmap_t(bench) *table = fm_init(bench);
+    if(!table)
+        return;
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(uint32_t i = 0; i < nentries; i++) {
+        fmint_t k = fm_put(bench, table, i + 1, &ret);
+        fm_val(table, k) = i;
+    }
+    out->insert_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(uint32_t i = 0; i < nentries; i++) {
+            fmint_t k = fm_get(bench, table, i + 1);
+            nfound += (k != fm_end(table)) ? (fm_val(table, k) == i) : 0;
+        }
+    }
+    out->hit_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(uint32_t i = 0; i < nentries; i++) {
+            fmint_t k = fm_get(bench, table, nentries + i + 1);
+            nfound += (k != fm_end(table));
+        }
+    }
+    out->miss_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(uint32_t i = 0; i < nentries; i += 2) {
+        fmint_t k = fm_get(bench, table, i + 1);
+        fm_del(bench, table, k);
+    }
+    out->delete_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        uint32_t val;
+        fm_foreach_value(table, val, { nfound += val & 0x1; });
+    }
+    out->iterate_ms = bench_ms(begin);
+
+    out->nfound = nfound;
+    fm_destroy(bench, table);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void fm_benchmark(size_t nentries, struct fm_bench_result out[2])
+{
+    int nrounds = MAX(1, BENCH_OPS / (int)MAX(nentries, 1));
+    memset(out, 0, 2 * sizeof(struct fm_bench_result));
+
+    bench_khash(nentries, nrounds, &out[FM_BENCH_KHASH]);
+    bench_flat_map(nentries, nrounds, &out[FM_BENCH_FLAT_MAP]);
+}
+
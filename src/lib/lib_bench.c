@@ -0,0 +1,390 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/lib_bench.h"
+#include "public/vec.h"
+#include "public/queue.h"
+#include "public/pqueue.h"
+#include "public/khash.h"
+#include "public/lru_cache.h"
+#include "public/mpool.h"
+
+#include <SDL.h>
+
+#define BENCH_OPS   (1 << 20)
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+
+VEC_TYPE(bench, uint32_t)
+VEC_IMPL(static inline, bench, uint32_t)
+
+QUEUE_TYPE(bench, uint32_t)
+QUEUE_IMPL(static inline, bench, uint32_t)
+
+PQUEUE_TYPE(bench, uint32_t)
+PQUEUE_IMPL(static inline, bench, uint32_t)
+
+KHASH_MAP_INIT_INT(lbench, uint32_t)
+
+LRU_CACHE_TYPE(bench, uint64_t)
+LRU_CACHE_PROTOTYPES(static inline, bench, uint64_t)
+LRU_CACHE_IMPL(static inline, bench, uint64_t)
+
+MPOOL_TYPE(lbench, uint64_t)
+MPOOL_PROTOTYPES(static inline, lbench, uint64_t)
+MPOOL_IMPL(static inline, lbench, uint64_t)
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static double bench_ms(uint64_t begin)
+{
+    return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+/* The same seed is used for every container, so that all of them see the 
+ * same sequence of keys */
+static uint32_t bench_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return (*state = x);
+}
+
+/* Entity uids are handed out sequentially, but the entities which have died 
+ * by the time leave gaps in the live set */
+static void bench_uid_keys(size_t n, uint32_t *out)
+{
+    uint32_t seed = 0x9e3779b9;
+    uint32_t next = 1;
+    for(size_t i = 0; i < n; i++) {
+        next += 1 + (bench_rand(&seed) % 4);
+        out[i] = next;
+    }
+}
+
+/* The path searches push the nodes with mostly increasing costs */
+static float bench_search_prio(size_t i, uint32_t *seed)
+{
+    return i * 0.01f + (bench_rand(seed) % 400) / 100.0f;
+}
+
+/* Most of the field cache's lookups are for the few fields leading to the 
+ * most common destinations: 80% of the requests go to 20% of the keys */
+static uint64_t bench_skewed_key(size_t n, uint32_t *seed)
+{
+    size_t hot = MAX(n / 5, 1);
+    if(bench_rand(seed) % 100 < 80)
+        return bench_rand(seed) % hot;
+    return bench_rand(seed) % n;
+}
+
+static void bench_vec(size_t n, int nrounds, const uint32_t *keys, struct lib_bench_result *out)
+{
+    size_t sum = 0;
+    uint32_t seed = 0x1234567;
+    vec_bench_t vec;
+    vec_bench_init(&vec);
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(size_t i = 0; i < n; i++) {
+        vec_bench_push(&vec, keys[i]);
+    }
+    out->insert_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            sum += vec_AT(&vec, bench_rand(&seed) % vec_size(&vec));
+        }
+    }
+    out->lookup_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(int i = 0; i < vec_size(&vec); i++) {
+            sum += vec_AT(&vec, i);
+        }
+    }
+    out->iterate_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    while(vec_size(&vec) > n / 2) {
+        vec_bench_del(&vec, bench_rand(&seed) % vec_size(&vec));
+    }
+    out->delete_ms = bench_ms(begin);
+
+    out->checksum = sum + vec_size(&vec);
+    vec_bench_destroy(&vec);
+}
+
+static void bench_queue(size_t n, int nrounds, const uint32_t *keys, struct lib_bench_result *out)
+{
+    size_t sum = 0;
+    uint32_t seed = 0x1234567;
+    queue_bench_t queue;
+    if(!queue_bench_init(&queue, 32))
+        return;
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(size_t i = 0; i < n; i++) {
+        queue_bench_push(&queue, (uint32_t*)&keys[i]);
+    }
+    out->insert_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            sum += queue_at(queue, bench_rand(&seed) % queue_size(queue));
+        }
+    }
+    out->lookup_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < queue_size(queue); i++) {
+            sum += queue_at(queue, i);
+        }
+    }
+    out->iterate_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    uint32_t val;
+    while(queue_bench_pop(&queue, &val)) {
+        sum += val;
+    }
+    out->delete_ms = bench_ms(begin);
+
+    out->checksum = sum;
+    queue_bench_destroy(&queue);
+}
+
+static void bench_pqueue(size_t n, int nrounds, const uint32_t *keys, struct lib_bench_result *out)
+{
+    size_t sum = 0;
+    uint32_t seed = 0x1234567;
+    pq_bench_t pq;
+    pq_bench_init(&pq);
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(size_t i = 0; i < n; i++) {
+        pq_bench_push(&pq, bench_search_prio(i, &seed), keys[i]);
+    }
+    out->insert_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            uint32_t val = 0;
+            pq_bench_peek(&pq, &val);
+            sum += val;
+        }
+    }
+    out->lookup_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        uint32_t val;
+        pq_foreach(&pq, val, { sum += val; });
+    }
+    out->iterate_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    uint32_t val;
+    while(pq_bench_pop(&pq, &val)) {
+        sum += val;
+    }
+    out->delete_ms = bench_ms(begin);
+
+    out->checksum = sum;
+    pq_bench_destroy(&pq);
+}
+
+static void bench_khash(size_t n, int nrounds, const uint32_t *keys, struct lib_bench_result *out)
+{
+    int ret;
+    size_t sum = 0;
+    khash_t(lbench) *table = kh_init(lbench);
+    if(!table)
+        return;
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(size_t i = 0; i < n; i++) {
+        khiter_t k = kh_put(lbench, table, keys[i], &ret);
+        kh_val(table, k) = i;
+    }
+    out->insert_ms = bench_ms(begin);
+
+    /* Every other lookup is for a uid in one of the gaps */
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            khiter_t k = kh_get(lbench, table, keys[i] + (i & 0x1));
+            sum += (k != kh_end(table));
+        }
+    }
+    out->lookup_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        uint32_t val;
+        kh_foreach_value(table, val, { sum += val & 0x1; });
+    }
+    out->iterate_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(size_t i = 0; i < n; i += 2) {
+        khiter_t k = kh_get(lbench, table, keys[i]);
+        kh_del(lbench, table, k);
+    }
+    out->delete_ms = bench_ms(begin);
+
+    out->checksum = sum + kh_size(table);
+    kh_destroy(lbench, table);
+}
+
+static void bench_lru(size_t n, int nrounds, struct lib_bench_result *out)
+{
+    size_t sum = 0;
+    uint32_t seed = 0x1234567;
+    lru(bench) cache;
+    if(!lru_bench_init(&cache, MAX(n / 4, 1), NULL))
+        return;
+
+    /* Fill in the cache the way a run of field requests would, evicting 
+     * the cold keys */
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(size_t i = 0; i < n; i++) {
+        uint64_t key = bench_skewed_key(n, &seed);
+        lru_bench_put(&cache, key, &key);
+    }
+    out->insert_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            uint64_t val;
+            sum += lru_bench_get(&cache, bench_skewed_key(n, &seed), &val);
+        }
+    }
+    out->lookup_ms = bench_ms(begin);
+    out->iterate_ms = 0.0;
+
+    begin = SDL_GetPerformanceCounter();
+    for(size_t i = 0; i < n; i++) {
+        sum += lru_bench_remove(&cache, i);
+    }
+    out->delete_ms = bench_ms(begin);
+
+    out->checksum = sum;
+    lru_bench_destroy(&cache);
+}
+
+static void bench_mpool(size_t n, int nrounds, struct lib_bench_result *out)
+{
+    size_t sum = 0;
+    uint32_t seed = 0x1234567;
+    mp(lbench) pool;
+    mp_lbench_init(&pool, true);
+
+    mp_ref_t *refs = malloc(n * sizeof(mp_ref_t));
+    if(!refs)
+        return;
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(size_t i = 0; i < n; i++) {
+        refs[i] = mp_lbench_alloc(&pool);
+        if(refs[i]) {
+            *mp_lbench_entry(&pool, refs[i]) = i;
+        }
+    }
+    out->insert_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            mp_ref_t ref = refs[bench_rand(&seed) % n];
+            sum += ref ? *mp_lbench_entry(&pool, ref) : 0;
+        }
+    }
+    out->lookup_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            sum += refs[i] ? *mp_lbench_entry(&pool, refs[i]) : 0;
+        }
+    }
+    out->iterate_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(size_t i = 0; i < n; i += 2) {
+        if(refs[i]) {
+            mp_lbench_free(&pool, refs[i]);
+        }
+    }
+    out->delete_ms = bench_ms(begin);
+
+    out->checksum = sum + pool.num_allocd;
+    free(refs);
+    mp_lbench_destroy(&pool);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void lib_benchmark(size_t nentries, struct lib_bench_result out[LIB_BENCH_COUNT])
+{
+    int nrounds = MAX(1, BENCH_OPS / (int)MAX(nentries, 1));
+    memset(out, 0, LIB_BENCH_COUNT * sizeof(struct lib_bench_result));
+
+    uint32_t *keys = malloc(nentries * sizeof(uint32_t));
+    if(!keys)
+        return;
+    bench_uid_keys(nentries, keys);
+
+    bench_vec(nentries, nrounds, keys, &out[LIB_BENCH_VEC]);
+    bench_queue(nentries, nrounds, keys, &out[LIB_BENCH_QUEUE]);
+    bench_pqueue(nentries, nrounds, keys, &out[LIB_BENCH_PQUEUE]);
+    bench_khash(nentries, nrounds, keys, &out[LIB_BENCH_KHASH]);
+    bench_lru(nentries, nrounds, &out[LIB_BENCH_LRU]);
+    bench_mpool(nentries, nrounds, &out[LIB_BENCH_MPOOL]);
+
+    free(keys);
+}
+
@@ -0,0 +1,56 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef SDL_LZ_RWOPS_H
+#define SDL_LZ_RWOPS_H
+
+#include <stdbool.h>
+#include <SDL.h>
+
+/* Streaming LZ4-style compression in independently compressed frames. 
+ * The returned streams take ownership of the wrapped stream and close 
+ * it when they are closed. The decompressing streams support seeking. 
+ */
+SDL_RWops *PFSDL_LZCompressRWOps(SDL_RWops *dst);
+SDL_RWops *PFSDL_LZDecompressRWOps(SDL_RWops *src);
+/* Checks the stream for the compression header without consuming it */
+bool       PFSDL_LZIsCompressed(SDL_RWops *stream);
+/* Closes the stream without closing the wrapped stream, such that it can 
+ * be used further (for example, compressing into an in-memory stream). 
+ * Returns false if the buffered output could not be flushed. */
+bool       PFSDL_LZFinish(SDL_RWops *stream);
+
+#endif
+
@@ -42,6 +42,21 @@
 SDL_RWops  *PFSDL_VectorRWOps(void);
 const char *PFSDL_VectorRWOpsRaw(SDL_RWops *ctx);
 bool        PFSDL_VectorRWOpsReserve(SDL_RWops* ctx, size_t size);
+/* Writes out the stream contents without first making them contiguous */
+bool        PFSDL_VectorRWOpsWriteTo(SDL_RWops *ctx, SDL_RWops *dst);
+
+/* The 'VMem' streams reserve 'reserve' bytes of address space up front and 
+ * commit pages on demand, so growing them never moves or copies the data. 
+ * The Raw, Reserve and WriteTo calls above work on both kinds of streams.
+ * Streams created with 'gather' set will additionally accept buffers appended 
+ * by reference - 'release' is invoked once the buffer is no longer needed, 
+ * which is either when the stream is closed or when its' contents are first 
+ * read back or accessed as a contiguous buffer. 
+ */
+SDL_RWops  *PFSDL_VMemRWOps(size_t reserve, bool gather);
+bool        PFSDL_VMemRWOpsGathers(SDL_RWops *ctx);
+bool        PFSDL_VMemRWOpsAppendRef(SDL_RWops *ctx, const void *ptr, size_t size,
+                                     void (*release)(void*), void *arg);
 
 #endif
 
@@ -65,9 +65,23 @@ struct attr{
     }val;
 };
 
-/* 'named' attributes start with a single token for the name */
+enum attr_format{
+    /* One attribute per line: '[name] <type> <value>' */
+    ATTR_FORMAT_TEXT,
+    /* A tag byte (with the type and whether the attribute is named), the
+     * length-prefixed name and the little-endian value. */
+    ATTR_FORMAT_BINARY,
+};
+
+/* 'named' attributes start with a single token for the name. Either 
+ * format is accepted, regardless of the current write format. */
 bool Attr_Parse(struct SDL_RWops *stream, struct attr *out, bool named);
 bool Attr_Write(struct SDL_RWops *stream, const struct attr *in, const char name[]);
 
+/* Selects the format of the subsequent Attr_Write calls and returns the 
+ * previous one. Text is the default. Should only be called from the main 
+ * thread, while no other threads are writing attributes. */
+enum attr_format Attr_SetWriteFormat(enum attr_format format);
+
 #endif
 
@@ -0,0 +1,63 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef CPU_TOPO_H
+#define CPU_TOPO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Only the first 64 logical CPUs (or, on Windows, the first processor 
+ * group) are described. */
+#define CPU_TOPO_MAX_CPUS (64)
+
+/* Every mask holds one bit per logical CPU. The 'primary' mask has a single
+ * logical CPU set for every physical core, so that SMT siblings can be told 
+ * apart. On hybrid CPUs, the 'efficiency' mask holds the logical CPUs of the
+ * efficiency (E) cores. It is empty when all cores are of the same kind. 
+ */
+struct cpu_topo{
+    int      nlogical;
+    int      nphysical;
+    uint64_t online;
+    uint64_t primary;
+    uint64_t efficiency;
+};
+
+void cpu_topo_query(struct cpu_topo *out);
+bool cpu_topo_pin_current_thread(uint64_t mask);
+
+#endif
+
@@ -0,0 +1,374 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#define FM_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* An open-addressing hash map in the style of the 'Swiss table'. Every slot 
+ * has a one-byte control word holding either the low 7 bits of the hash of 
+ * its key (h2), or one of the EMPTY/DELETED markers. The slots are probed in 
+ * aligned groups of 16: a single SSE2 compare of the control words finds all 
+ * slots of a group whose h2 matches, so most lookups touch one cache line of 
+ * control words and a single key. The groups are visited in a triangular 
+ * sequence, which reaches every group of a power-of-two sized table.
+ *
+ * The interface mirrors khash, so a 'KHASH_MAP_INIT_INT' table can be swapped
+ * out by renaming the 'kh_' prefixes to 'fm_'. Like with khash, the iterator 
+ * is a slot index and 'fm_end' is the number of slots. Iterators are stable 
+ * until the next insertion. Keys and values are stored in separate arrays, 
+ * so they must be trivially copyable.
+ */
+
+/***********************************************************************************************/
+
+typedef uint32_t fmint_t;
+
+#define FM_GROUP_WIDTH  (16)
+#define FM_CTRL_EMPTY   ((int8_t)-128)
+#define FM_CTRL_DELETED ((int8_t)-2)
+
+static inline uint32_t fm_ctz(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long ret;
+    _BitScanForward(&ret, mask);
+    return ret;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+/* Bit i of the returned mask is set when the i-th control word is equal to 'h2' */
+static inline uint32_t fm_group_match(const int8_t *ctrl, int8_t h2)
+{
+#if FM_SSE2
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), group));
+#else
+    uint32_t ret = 0;
+    for(int i = 0; i < FM_GROUP_WIDTH; i++) {
+        ret |= (uint32_t)(ctrl[i] == h2) << i;
+    }
+    return ret;
+#endif
+}
+
+static inline uint32_t fm_group_match_empty(const int8_t *ctrl)
+{
+    return fm_group_match(ctrl, FM_CTRL_EMPTY);
+}
+
+/* Matches both the EMPTY and DELETED slots - all markers are less than -1 */
+static inline uint32_t fm_group_match_free(const int8_t *ctrl)
+{
+#if FM_SSE2
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), group));
+#else
+    uint32_t ret = 0;
+    for(int i = 0; i < FM_GROUP_WIDTH; i++) {
+        ret |= (uint32_t)(ctrl[i] < -1) << i;
+    }
+    return ret;
+#endif
+}
+
+/* The identity hash used by khash for integer keys would give all small uids 
+ * the same h2. A multiplicative hash spreads sequential uids over both the 
+ * groups and the h2 values, and stays cheap.
+ */
+static inline uint32_t fm_int_hash_func(uint32_t key)
+{
+    key *= 0x9e3779b1u;
+    return key ^ (key >> 16);
+}
+
+static inline uint32_t fm_int64_hash_func(uint64_t key)
+{
+    return fm_int_hash_func((uint32_t)(key >> 32) ^ fm_int_hash_func((uint32_t)key));
+}
+
+#define fm_int_hash_equal(a, b) ((a) == (b))
+
+/***********************************************************************************************/
+
+#define FLAT_MAP_TYPE(name, key_t, val_t)                                                       \
+                                                                                                \
+    typedef struct fm_##name##_s {                                                              \
+        fmint_t  n_buckets;                                                                     \
+        fmint_t  size;                                                                          \
+        fmint_t  n_occupied;                                                                    \
+        int8_t  *ctrl;                                                                          \
+        key_t   *keys;                                                                          \
+        val_t   *vals;                                                                          \
+    } fm_##name##_t;
+
+#define FLAT_MAP_PROTOTYPES(scope, name, key_t, val_t)                                          \
+                                                                                                \
+    scope fm_##name##_t *fm_init_##name(void);                                                  \
+    scope void           fm_destroy_##name(fm_##name##_t *h);                                   \
+    scope void           fm_clear_##name(fm_##name##_t *h);                                     \
+    scope fmint_t        fm_get_##name(const fm_##name##_t *h, key_t key);                      \
+    scope int            fm_resize_##name(fm_##name##_t *h, fmint_t new_n_buckets);             \
+    scope fmint_t        fm_put_##name(fm_##name##_t *h, key_t key, int *ret);                  \
+    scope void           fm_del_##name(fm_##name##_t *h, fmint_t x);
+
+#define FLAT_MAP_IMPL(scope, name, key_t, val_t, hash_func, equal_func)                         \
+                                                                                                \
+    scope fm_##name##_t *fm_init_##name(void)                                                   \
+    {                                                                                           \
+        return (fm_##name##_t*)calloc(1, sizeof(fm_##name##_t));                                \
+    }                                                                                           \
+                                                                                                \
+    scope void fm_destroy_##name(fm_##name##_t *h)                                              \
+    {                                                                                           \
+        if(!h)                                                                                  \
+            return;                                                                             \
+        free(h->ctrl);                                                                          \
+        free((void*)h->keys);                                                                   \
+        free((void*)h->vals);                                                                   \
+        free(h);                                                                                \
+    }                                                                                           \
+                                                                                                \
+    scope void fm_clear_##name(fm_##name##_t *h)                                                \
+    {                                                                                           \
+        if(!h || !h->ctrl)                                                                      \
+            return;                                                                             \
+        memset(h->ctrl, FM_CTRL_EMPTY, h->n_buckets);                                           \
+        h->size = h->n_occupied = 0;                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope fmint_t fm_get_##name(const fm_##name##_t *h, key_t key)                              \
+    {                                                                                           \
+        if(!h->n_buckets)                                                                       \
+            return 0;                                                                           \
+        uint32_t hash = (uint32_t)hash_func(key);                                               \
+        int8_t h2 = (int8_t)(hash & 0x7f);                                                      \
+        fmint_t mask = (h->n_buckets / FM_GROUP_WIDTH) - 1;                                     \
+        fmint_t group = (hash >> 7) & mask;                                                     \
+        for(fmint_t step = 1;; step++) {                                                        \
+            const int8_t *ctrl = h->ctrl + group * FM_GROUP_WIDTH;                              \
+            uint32_t match = fm_group_match(ctrl, h2);                                          \
+            while(match) {                                                                      \
+                fmint_t x = group * FM_GROUP_WIDTH + fm_ctz(match);                             \
+                if(equal_func(h->keys[x], key))                                                 \
+                    return x;                                                                   \
+                match &= match - 1;                                                             \
+            }                                                                                   \
+            if(fm_group_match_empty(ctrl) || step > mask)                                       \
+                return h->n_buckets;                                                            \
+            group = (group + step) & mask;                                                      \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    /* Returns the index of a free slot for the key, which must not be in the table */          \
+    static inline fmint_t fm_find_free_##name(const fm_##name##_t *h, uint32_t hash)            \
+    {                                                                                           \
+        fmint_t mask = (h->n_buckets / FM_GROUP_WIDTH) - 1;                                     \
+        fmint_t group = (hash >> 7) & mask;                                                     \
+        for(fmint_t step = 1;; step++) {                                                        \
+            uint32_t avail = fm_group_match_free(h->ctrl + group * FM_GROUP_WIDTH);             \
+            if(avail)                                                                           \
+                return group * FM_GROUP_WIDTH + fm_ctz(avail);                                  \
+            group = (group + step) & mask;                                                      \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    scope int fm_resize_##name(fm_##name##_t *h, fmint_t new_n_buckets)                         \
+    {                                                                                           \
+        fmint_t n = FM_GROUP_WIDTH;                                                             \
+        while(n < new_n_buckets || h->size + 1 > n / 8 * 7)                                     \
+            n <<= 1;                                                                            \
+                                                                                                \
+        int8_t *new_ctrl = (int8_t*)malloc(n);                                                  \
+        key_t *new_keys = (key_t*)malloc(n * sizeof(key_t));                                    \
+        val_t *new_vals = (val_t*)malloc(n * sizeof(val_t));                                    \
+        if(!new_ctrl || !new_keys || !new_vals) {                                               \
+            free(new_ctrl);                                                                     \
+            free((void*)new_keys);                                                              \
+            free((void*)new_vals);                                                              \
+            return -1;                                                                          \
+        }                                                                                       \
+        memset(new_ctrl, FM_CTRL_EMPTY, n);                                                     \
+                                                                                                \
+        fm_##name##_t old = *h;                                                                 \
+        h->n_buckets = n;                                                                       \
+        h->n_occupied = h->size;                                                                \
+        h->ctrl = new_ctrl;                                                                     \
+        h->keys = new_keys;                                                                     \
+        h->vals = new_vals;                                                                     \
+                                                                                                \
+        for(fmint_t i = 0; i < old.n_buckets; i++) {                                            \
+            if(old.ctrl[i] < 0)                                                                 \
+                continue;                                                                       \
+            uint32_t hash = (uint32_t)hash_func(old.keys[i]);                                   \
+            fmint_t x = fm_find_free_##name(h, hash);                                           \
+            h->ctrl[x] = (int8_t)(hash & 0x7f);                                                 \
+            h->keys[x] = old.keys[i];                                                           \
+            h->vals[x] = old.vals[i];                                                           \
+        }                                                                                       \
+        free(old.ctrl);                                                                         \
+        free((void*)old.keys);                                                                  \
+        free((void*)old.vals);                                                                  \
+        return 0;                                                                               \
+    }                                                                                           \
+                                                                                                \
+    /* 'ret' is set to 0 if the key is already present, 1 if it was inserted, -1 on            \
+     * allocation failure.                                                                      \
+     */                                                                                         \
+    scope fmint_t fm_put_##name(fm_##name##_t *h, key_t key, int *ret)                          \
+    {                                                                                           \
+        fmint_t x = fm_get_##name(h, key);                                                      \
+        if(x != h->n_buckets) {                                                                 \
+            *ret = 0;                                                                           \
+            return x;                                                                           \
+        }                                                                                       \
+        if(h->n_occupied + 1 > h->n_buckets / 8 * 7) {                                          \
+            /* Rehash in place when most of the occupied slots are tombstones */                \
+            fmint_t n = (h->size + 1 > h->n_buckets / 16 * 7) ? h->n_buckets * 2 : h->n_buckets;\
+            if(fm_resize_##name(h, n) < 0) {                                                    \
+                *ret = -1;                                                                      \
+                return h->n_buckets;                                                            \
+            }                                                                                   \
+        }                                                                                       \
+        uint32_t hash = (uint32_t)hash_func(key);                                               \
+        x = fm_find_free_##name(h, hash);                                                       \
+        if(h->ctrl[x] == FM_CTRL_EMPTY)                                                         \
+            h->n_occupied++;                                                                    \
+        h->ctrl[x] = (int8_t)(hash & 0x7f);                                                     \
+        h->keys[x] = key;                                                                       \
+        h->size++;                                                                              \
+        *ret = 1;                                                                               \
+        return x;                                                                               \
+    }                                                                                           \
+                                                                                                \
+    /* A probe sequence only passes a group that was full. If the group of the slot             \
+     * still has an empty slot, no probe has gone past it, so the slot can be freed             \
+     * outright instead of leaving behind a tombstone.                                          \
+     */                                                                                         \
+    scope void fm_del_##name(fm_##name##_t *h, fmint_t x)                                       \
+    {                                                                                           \
+        if(x == h->n_buckets || h->ctrl[x] < 0)                                                 \
+            return;                                                                             \
+        const int8_t *group = h->ctrl + (x & ~(fmint_t)(FM_GROUP_WIDTH - 1));                   \
+        if(fm_group_match_empty(group)) {                                                       \
+            h->ctrl[x] = FM_CTRL_EMPTY;                                                         \
+            h->n_occupied--;                                                                    \
+        }else{                                                                                  \
+            h->ctrl[x] = FM_CTRL_DELETED;                                                       \
+        }                                                                                       \
+        h->size--;                                                                              \
+    }
+
+#define FLAT_MAP_INIT(name, key_t, val_t, hash_func, equal_func)                                \
+    FLAT_MAP_TYPE(name, key_t, val_t)                                                           \
+    FLAT_MAP_IMPL(static inline, name, key_t, val_t, hash_func, equal_func)
+
+#define FLAT_MAP_INIT_INT(name, val_t)                                                          \
+    FLAT_MAP_INIT(name, uint32_t, val_t, fm_int_hash_func, fm_int_hash_equal)
+
+#define FLAT_MAP_INIT_INT64(name, val_t)                                                        \
+    FLAT_MAP_INIT(name, uint64_t, val_t, fm_int64_hash_func, fm_int_hash_equal)
+
+/***********************************************************************************************/
+
+#define flatmap_t(name)         fm_##name##_t
+#define fm_init(name)           fm_init_##name()
+#define fm_destroy(name, h)     fm_destroy_##name(h)
+#define fm_clear(name, h)       fm_clear_##name(h)
+#define fm_resize(name, h, s)   fm_resize_##name(h, s)
+#define fm_put(name, h, k, r)   fm_put_##name(h, k, r)
+#define fm_get(name, h, k)      fm_get_##name(h, k)
+#define fm_del(name, h, k)      fm_del_##name(h, k)
+
+#define fm_exist(h, x)          ((h)->ctrl[x] >= 0)
+#define fm_key(h, x)            ((h)->keys[x])
+#define fm_val(h, x)            ((h)->vals[x])
+#define fm_value(h, x)          ((h)->vals[x])
+#define fm_begin(h)             ((fmint_t)0)
+#define fm_end(h)               ((h)->n_buckets)
+#define fm_size(h)              ((h)->size)
+#define fm_n_buckets(h)         ((h)->n_buckets)
+
+#define fm_foreach(h, kvar, vvar, ...) { fmint_t __i;       \
+    for (__i = fm_begin(h); __i != fm_end(h); ++__i) {      \
+        if (!fm_exist(h,__i)) continue;                     \
+        (kvar) = fm_key(h,__i);                             \
+        (vvar) = fm_val(h,__i);                             \
+        __VA_ARGS__;                                        \
+    } }
+
+#define fm_foreach_value(h, vvar, ...) { fmint_t __i;       \
+    for (__i = fm_begin(h); __i != fm_end(h); ++__i) {      \
+        if (!fm_exist(h,__i)) continue;                     \
+        (vvar) = fm_val(h,__i);                             \
+        __VA_ARGS__;                                        \
+    } }
+
+/***********************************************************************************************/
+
+struct fm_bench_result{
+    double insert_ms;
+    double hit_ms;
+    double miss_ms;
+    double delete_ms;
+    double iterate_ms;
+    size_t nfound;
+};
+
+enum{
+    FM_BENCH_KHASH,
+    FM_BENCH_FLAT_MAP,
+};
+
+/* Times the same workload of uid-keyed operations on a khash table and a flat map */
+void fm_benchmark(size_t nentries, struct fm_bench_result out[2]);
+
+#endif
+
@@ -0,0 +1,73 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef LIB_BENCH_H
+#define LIB_BENCH_H
+
+#include <stddef.h>
+
+/* What each phase times depends on the container:
+ *
+ *   vec    - insert: push   lookup: random index   delete: del            iterate: in order
+ *   queue  - insert: push   lookup: queue_at       delete: pop            iterate: queue_at
+ *   pqueue - insert: push   lookup: peek           delete: pop            iterate: pq_foreach
+ *   khash  - insert: put    lookup: get            delete: del            iterate: foreach
+ *   lru    - insert: put    lookup: get            delete: remove         iterate: -
+ *   mpool  - insert: alloc  lookup: random entry   delete: free           iterate: in order
+ */
+struct lib_bench_result{
+    double insert_ms;
+    double lookup_ms;
+    double delete_ms;
+    double iterate_ms;
+    size_t checksum;
+};
+
+enum{
+    LIB_BENCH_VEC,
+    LIB_BENCH_QUEUE,
+    LIB_BENCH_PQUEUE,
+    LIB_BENCH_KHASH,
+    LIB_BENCH_LRU,
+    LIB_BENCH_MPOOL,
+    LIB_BENCH_COUNT
+};
+
+/* Times a workload of 'nentries' elements shaped after the engine's use of each 
+ * of the library containers. The checksums only keep the work from being elided. */
+void lib_benchmark(size_t nentries, struct lib_bench_result out[LIB_BENCH_COUNT]);
+
+#endif
+
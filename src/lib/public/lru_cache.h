@@ -41,8 +41,37 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <assert.h>
 
+/* The replacement policy of a cache. It can be changed at any point with 
+ * lru_*_set_policy. 
+ *
+ * LRU_POLICY_LRU   - Evicts the least recently used entry. Every hit moves 
+ *                    the entry to the head of the recency list.
+ * LRU_POLICY_CLOCK - Second chance: a hit only sets the entry's reference 
+ *                    bit. Referenced entries are moved back to the head of 
+ *                    the list (clearing the bit) when they come up for eviction, 
+ *                    so hits don't write to the neighbouring nodes.
+ * LRU_POLICY_2Q    - New entries are held in a FIFO (A1in) sized to a quarter 
+ *                    of the capacity, and only the keys of the entries evicted 
+ *                    from it are remembered (A1out). Entries are only admitted to 
+ *                    the LRU list (Am) when they're put again while their key is 
+ *                    remembered, so one-off requests don't flush it.
+ */
+enum lru_policy{
+    LRU_POLICY_LRU,
+    LRU_POLICY_CLOCK,
+    LRU_POLICY_2Q,
+    LRU_POLICY_COUNT,
+};
+
+enum{
+    _LRU_QUEUE_MAIN,
+    _LRU_QUEUE_PROBATION,
+    _LRU_NQUEUES,
+};
+
 /***********************************************************************************************/
 
 #define LRU_CACHE_TYPE(name, type)                                                              \
@@ -51,19 +80,31 @@
         mp_ref_t next;                                                                          \
         mp_ref_t prev;                                                                          \
         khint64_t key;                                                                          \
+        uint8_t queue;                                                                          \
+        uint8_t referenced;                                                                     \
         type entry;                                                                             \
     } lru_##name##_node_t;                                                                      \
                                                                                                 \
     MPOOL_TYPE(name, lru_##name##_node_t)                                                       \
-	__KHASH_TYPE(name, khint64_t, mp_ref_t) 								                    \
+	__KHASH_TYPE(name, khint64_t, mp_ref_t)                                                        \
+	__KHASH_TYPE(name##_ghost, khint64_t, khint32_t)                                               \
                                                                                                 \
     typedef struct lru_##name##_s {                                                             \
         size_t         capacity;                                                                \
         size_t         used;                                                                    \
-        mp_ref_t       ilru_head;                                                               \
-        mp_ref_t       ilru_tail;                                                               \
+        enum lru_policy policy;                                                                 \
+        /* The recency list and the 2Q probation FIFO. Heads are the most recent */             \
+        mp_ref_t       ihead[_LRU_NQUEUES];                                                     \
+        mp_ref_t       itail[_LRU_NQUEUES];                                                     \
+        size_t         nprobation;                                                              \
         khash_t(name) *key_node_table;                                                          \
         mp(name)       node_pool;                                                               \
+        /* Ring of the keys most recently evicted from the 2Q probation FIFO, */                \
+        /* and a table of their slots in the ring                            */                 \
+        uint64_t      *ghost_keys;                                                              \
+        size_t         ghost_capacity;                                                          \
+        size_t         ghost_next;                                                              \
+        khash_t(name##_ghost) *ghost_table;                                                     \
         /* Optional hook to clean up entries' resources before eviction */                      \
         void           (*on_evict)(type *victim);                                               \
     } lru_##name##_t;
@@ -80,7 +121,8 @@
     do{                                                                                         \
         mp_ref_t curr, next_curr;                                                               \
         lru_node(name) *curr_node;                                                              \
-        for(curr = (_lru)->ilru_head; curr; curr = next_curr) {                                 \
+        for(int _q = 0; _q < _LRU_NQUEUES; _q++) {                                              \
+        for(curr = (_lru)->ihead[_q]; curr; curr = next_curr) {                                 \
             curr_node = mp_##name##_entry(&((_lru)->node_pool), curr);                          \
             next_curr = curr_node->next;                                                        \
                                                                                                 \
@@ -88,7 +130,7 @@
             _val = curr_node->entry;                                                            \
                                                                                                 \
             __VA_ARGS__                                                                         \
-        }                                                                                       \
+        }}                                                                                      \
     }while(0)
 
 /***********************************************************************************************/
@@ -96,7 +138,8 @@
 #define LRU_CACHE_PROTOTYPES(scope, name, type)                                                 \
                                                                                                 \
     MPOOL_PROTOTYPES(scope, name, lru_node(name))                                               \
-	__KHASH_PROTOTYPES(name, khint64_t, mp_ref_t)                                               \
+	__KHASH_PROTOTYPES(name, khint64_t, mp_ref_t)                                                  \
+	__KHASH_PROTOTYPES(name##_ghost, khint64_t, khint32_t)                                         \
                                                                                                 \
     static void _lru_##name##_reference(lru(name) *lru, mp_ref_t ref);                          \
     scope  bool  lru_##name##_init     (lru(name) *lru, size_t capacity,                        \
@@ -109,6 +152,10 @@
     scope  bool  lru_##name##_contains (lru(name) *lru, uint64_t key);                          \
     scope  void  lru_##name##_put      (lru(name) *lru, uint64_t key, const type *in);          \
     scope  bool  lru_##name##_remove   (lru(name) *lru, uint64_t key);                          \
+    scope  bool  lru_##name##_resize   (lru(name) *lru, size_t capacity);                       \
+    /* Evicts the entry chosen by the policy. Returns false if the cache is empty */            \
+    scope  bool  lru_##name##_evict_one(lru(name) *lru);                                        \
+    scope  bool  lru_##name##_set_policy(lru(name) *lru, enum lru_policy policy);               \
 
 /***********************************************************************************************/
 
@@ -116,39 +163,183 @@
                                                                                                 \
     MPOOL_IMPL(static, name, lru_node(name))                                                    \
     __KHASH_IMPL(name, extern, khint64_t, mp_ref_t, 1, kh_int_hash_func, kh_int_hash_equal)     \
+    __KHASH_IMPL(name##_ghost, extern, khint64_t, khint32_t, 1, kh_int_hash_func, kh_int_hash_equal) \
                                                                                                 \
-    static void _lru_##name##_reference(lru(name) *lru, mp_ref_t ref)                           \
+    static void _lru_##name##_unlink(lru(name) *lru, mp_ref_t ref)                              \
     {                                                                                           \
-        if(ref == lru->ilru_head)                                                               \
-            return;                                                                             \
+        lru_node(name) *node = mp_##name##_entry(&lru->node_pool, ref);                         \
+        if(node->prev)                                                                          \
+            mp_##name##_entry(&lru->node_pool, node->prev)->next = node->next;                  \
+        if(node->next)                                                                          \
+            mp_##name##_entry(&lru->node_pool, node->next)->prev = node->prev;                  \
+                                                                                                \
+        if(lru->ihead[node->queue] == ref)                                                      \
+            lru->ihead[node->queue] = node->next;                                               \
+        if(lru->itail[node->queue] == ref)                                                      \
+            lru->itail[node->queue] = node->prev;                                               \
+        if(node->queue == _LRU_QUEUE_PROBATION)                                                 \
+            --(lru->nprobation);                                                                \
+        node->prev = node->next = 0;                                                            \
+    }                                                                                           \
                                                                                                 \
+    static void _lru_##name##_push_head(lru(name) *lru, mp_ref_t ref, int queue)                \
+    {                                                                                           \
         lru_node(name) *node = mp_##name##_entry(&lru->node_pool, ref);                         \
-        lru_node(name) *prev = node->prev ? mp_##name##_entry(&lru->node_pool, node->prev)      \
-                                          : NULL;                                               \
-        lru_node(name) *next = node->next ? mp_##name##_entry(&lru->node_pool, node->next)      \
-                                          : NULL;                                               \
-        lru_node(name) *old_head = mp_##name##_entry(&lru->node_pool, lru->ilru_head);          \
-        mp_ref_t old_tail_prev = mp_##name##_entry(&lru->node_pool, lru->ilru_tail)->prev;      \
-                                                                                                \
-        /* Remove the node from the list */                                                     \
-        if(prev)                                                                                \
-            prev->next = node->next;                                                            \
-        if(next)                                                                                \
-            next->prev = node->prev;                                                            \
-                                                                                                \
-        /* Then make it the new head */                                                         \
-        old_head->prev = ref;                                                                   \
-        node->next = lru->ilru_head;                                                            \
+        node->queue = queue;                                                                    \
         node->prev = 0;                                                                         \
-        lru->ilru_head = ref;                                                                   \
+        node->next = lru->ihead[queue];                                                         \
+        if(lru->ihead[queue])                                                                   \
+            mp_##name##_entry(&lru->node_pool, lru->ihead[queue])->prev = ref;                  \
+        else                                                                                    \
+            lru->itail[queue] = ref;                                                            \
+        lru->ihead[queue] = ref;                                                                \
+        if(queue == _LRU_QUEUE_PROBATION)                                                       \
+            ++(lru->nprobation);                                                                \
+    }                                                                                           \
+                                                                                                \
+    static void _lru_##name##_push_tail(lru(name) *lru, mp_ref_t ref, int queue)                \
+    {                                                                                           \
+        lru_node(name) *node = mp_##name##_entry(&lru->node_pool, ref);                         \
+        node->queue = queue;                                                                    \
+        node->next = 0;                                                                         \
+        node->prev = lru->itail[queue];                                                         \
+        if(lru->itail[queue])                                                                   \
+            mp_##name##_entry(&lru->node_pool, lru->itail[queue])->next = ref;                  \
+        else                                                                                    \
+            lru->ihead[queue] = ref;                                                            \
+        lru->itail[queue] = ref;                                                                \
+        if(queue == _LRU_QUEUE_PROBATION)                                                       \
+            ++(lru->nprobation);                                                                \
+    }                                                                                           \
+                                                                                                \
+    static void _lru_##name##_reference(lru(name) *lru, mp_ref_t ref)                           \
+    {                                                                                           \
+        lru_node(name) *node = mp_##name##_entry(&lru->node_pool, ref);                         \
+        switch(lru->policy) {                                                                   \
+        case LRU_POLICY_CLOCK:                                                                  \
+            /* Don't dirty the node if the bit is already set */                                \
+            if(!node->referenced)                                                               \
+                node->referenced = 1;                                                           \
+            break;                                                                              \
+        case LRU_POLICY_2Q:                                                                     \
+            /* Hits on probationary entries are considered correlated */                        \
+            /* references and don't change their position in the FIFO */                        \
+            if(node->queue == _LRU_QUEUE_PROBATION)                                             \
+                break;                                                                          \
+            /* fallthrough */                                                                   \
+        default:                                                                                \
+            if(ref == lru->ihead[_LRU_QUEUE_MAIN])                                              \
+                break;                                                                          \
+            _lru_##name##_unlink(lru, ref);                                                     \
+            _lru_##name##_push_head(lru, ref, _LRU_QUEUE_MAIN);                                 \
+            break;                                                                              \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    static void _lru_##name##_ghost_push(lru(name) *lru, uint64_t key)                          \
+    {                                                                                           \
+        if(lru->ghost_capacity == 0)                                                            \
+            return;                                                                             \
+                                                                                                \
+        khiter_t k;                                                                             \
+        size_t slot = lru->ghost_next % lru->ghost_capacity;                                    \
+        if(lru->ghost_next >= lru->ghost_capacity) {                                            \
+            /* The key may have since been taken out or pushed again */                         \
+            uint64_t old = lru->ghost_keys[slot];                                               \
+            k = kh_get(name##_ghost, lru->ghost_table, old);                                    \
+            if(k != kh_end(lru->ghost_table) && kh_val(lru->ghost_table, k) == slot)            \
+                kh_del(name##_ghost, lru->ghost_table, k);                                      \
+        }                                                                                       \
+                                                                                                \
+        int status;                                                                             \
+        k = kh_put(name##_ghost, lru->ghost_table, key, &status);                               \
+        if(status == -1)                                                                        \
+            return;                                                                             \
+        kh_val(lru->ghost_table, k) = slot;                                                     \
+        lru->ghost_keys[slot] = key;                                                            \
+        ++(lru->ghost_next);                                                                    \
+    }                                                                                           \
+                                                                                                \
+    static bool _lru_##name##_ghost_take(lru(name) *lru, uint64_t key)                          \
+    {                                                                                           \
+        if(lru->ghost_capacity == 0)                                                            \
+            return false;                                                                       \
+                                                                                                \
+        khiter_t k = kh_get(name##_ghost, lru->ghost_table, key);                               \
+        if(k == kh_end(lru->ghost_table))                                                       \
+            return false;                                                                       \
+        kh_del(name##_ghost, lru->ghost_table, k);                                              \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    /* The 2Q history is only a hint, so it's dropped whenever the */                           \
+    /* capacity or the policy changes.                            */                            \
+    static bool _lru_##name##_ghost_reset(lru(name) *lru)                                       \
+    {                                                                                           \
+        free(lru->ghost_keys);                                                                  \
+        lru->ghost_keys = NULL;                                                                 \
+        lru->ghost_capacity = 0;                                                                \
+        lru->ghost_next = 0;                                                                    \
+        if(lru->ghost_table)                                                                    \
+            kh_clear(name##_ghost, lru->ghost_table);                                           \
+                                                                                                \
+        if(lru->policy != LRU_POLICY_2Q)                                                        \
+            return true;                                                                        \
+                                                                                                \
+        size_t capacity = lru->capacity / 2 > 0 ? lru->capacity / 2 : 1;                        \
+        if(!lru->ghost_table && !(lru->ghost_table = kh_init(name##_ghost)))                    \
+            return false;                                                                       \
+        if(kh_resize(name##_ghost, lru->ghost_table, capacity) < 0)                             \
+            return false;                                                                       \
+        if(!(lru->ghost_keys = malloc(capacity * sizeof(uint64_t))))                            \
+            return false;                                                                       \
+        lru->ghost_capacity = capacity;                                                         \
+        return true;                                                                            \
+    }                                                                                           \
                                                                                                 \
-        /* In the case where we removed the tail, set a new one */                              \
-        if(ref == lru->ilru_tail) {                                                             \
-            lru->ilru_tail = old_tail_prev;                                                     \
-            mp_##name##_entry(&lru->node_pool, old_tail_prev)->next = 0;                        \
+    static mp_ref_t _lru_##name##_victim(lru(name) *lru)                                        \
+    {                                                                                           \
+        switch(lru->policy) {                                                                   \
+        case LRU_POLICY_CLOCK:                                                                  \
+            for(;;) {                                                                           \
+                mp_ref_t ref = lru->itail[_LRU_QUEUE_MAIN];                                     \
+                lru_node(name) *node = mp_##name##_entry(&lru->node_pool, ref);                 \
+                if(!node->referenced)                                                           \
+                    return ref;                                                                 \
+                node->referenced = 0;                                                           \
+                _lru_##name##_unlink(lru, ref);                                                 \
+                _lru_##name##_push_head(lru, ref, _LRU_QUEUE_MAIN);                             \
+            }                                                                                   \
+        case LRU_POLICY_2Q: {                                                                   \
+            size_t max_probation = lru->capacity / 4 > 0 ? lru->capacity / 4 : 1;               \
+            if(lru->nprobation > max_probation || !lru->ihead[_LRU_QUEUE_MAIN])                 \
+                return lru->itail[_LRU_QUEUE_PROBATION];                                        \
+            return lru->itail[_LRU_QUEUE_MAIN];                                                 \
+        }                                                                                       \
+        default:                                                                                \
+            return lru->itail[_LRU_QUEUE_MAIN];                                                 \
         }                                                                                       \
     }                                                                                           \
                                                                                                 \
+    /* Unlinks the victim and drops its' key, but keeps the node allocated */                   \
+    static mp_ref_t _lru_##name##_evict(lru(name) *lru)                                         \
+    {                                                                                           \
+        mp_ref_t ref = _lru_##name##_victim(lru);                                               \
+        lru_node(name) *vict = mp_##name##_entry(&lru->node_pool, ref);                         \
+        if(lru->on_evict) {                                                                     \
+            lru->on_evict(&vict->entry);                                                        \
+        }                                                                                       \
+                                                                                                \
+        khiter_t k = kh_get(name, lru->key_node_table, vict->key);                              \
+        kh_del(name, lru->key_node_table, k);                                                   \
+                                                                                                \
+        if(vict->queue == _LRU_QUEUE_PROBATION)                                                 \
+            _lru_##name##_ghost_push(lru, vict->key);                                           \
+        _lru_##name##_unlink(lru, ref);                                                         \
+        --(lru->used);                                                                          \
+        return ref;                                                                             \
+    }                                                                                           \
+                                                                                                \
     scope bool lru_##name##_init(lru(name) *lru, size_t capacity,                               \
                                      void (*on_evict)(type *victim))                            \
     {                                                                                           \
@@ -164,6 +355,7 @@
             return false;                                                                       \
         }                                                                                       \
         lru->capacity = capacity;                                                               \
+        lru->policy = LRU_POLICY_LRU;                                                           \
         lru->on_evict = on_evict;                                                               \
         return true;                                                                            \
     }                                                                                           \
@@ -172,6 +364,8 @@
     {                                                                                           \
         lru_##name##_clear(lru);                                                                \
         kh_destroy(name, lru->key_node_table);                                                  \
+        kh_destroy(name##_ghost, lru->ghost_table);                                             \
+        free(lru->ghost_keys);                                                                  \
         mp_##name##_destroy(&lru->node_pool);                                                   \
         memset(lru, 0, sizeof(*lru));                                                           \
     }                                                                                           \
@@ -191,9 +385,15 @@
                                                                                                 \
         kh_clear(name, lru->key_node_table);                                                    \
         mp_##name##_clear(&lru->node_pool);                                                     \
-        lru->ilru_head = 0;                                                                     \
-        lru->ilru_tail = 0;                                                                     \
+        for(int i = 0; i < _LRU_NQUEUES; i++) {                                                 \
+            lru->ihead[i] = 0;                                                                  \
+            lru->itail[i] = 0;                                                                  \
+        }                                                                                       \
+        lru->nprobation = 0;                                                                    \
         lru->used = 0;                                                                          \
+        lru->ghost_next = 0;                                                                    \
+        if(lru->ghost_table)                                                                    \
+            kh_clear(name##_ghost, lru->ghost_table);                                           \
     }                                                                                           \
                                                                                                 \
     scope bool lru_##name##_get(lru(name) *lru, uint64_t key, type *out)                        \
@@ -234,48 +434,20 @@
         if((k = kh_get(name, lru->key_node_table, key)) == kh_end(lru->key_node_table)) {       \
             /* There is no existing entry for this key */                                       \
                                                                                                 \
-            mp_ref_t new_ref = 0;                                                               \
-            lru_node(name) *new_node = NULL;                                                    \
-            if(lru->used == 0) {                                                                \
-                                                                                                \
-                new_ref = mp_##name##_alloc(&lru->node_pool);                                   \
-                new_node = mp_##name##_entry(&lru->node_pool, new_ref);                         \
-                new_node->prev = 0;                                                             \
-                new_node->next = 0;                                                             \
-                lru->ilru_head = lru->ilru_tail = new_ref;                                      \
-                ++(lru->used);                                                                  \
-                                                                                                \
-            }else if(lru->used == lru->capacity) {                                              \
-                                                                                                \
-                lru_node(name) *vict = mp_##name##_entry(&lru->node_pool, lru->ilru_tail);      \
-                if(lru->on_evict) {                                                             \
-                    lru->on_evict(&vict->entry);                                                \
-                }                                                                               \
-                                                                                                \
-                /* Remember to delete the victim's key */                                       \
-                k = kh_get(name, lru->key_node_table, vict->key);                               \
-                kh_del(name, lru->key_node_table, k);                                           \
-                                                                                                \
-                new_ref = lru->ilru_tail;                                                       \
-                new_node = vict;                                                                \
-                _lru_##name##_reference(lru, new_ref);                                          \
-                                                                                                \
-            }else {                                                                             \
-                                                                                                \
-                new_ref = mp_##name##_alloc(&lru->node_pool);                                   \
-                new_node = mp_##name##_entry(&lru->node_pool, new_ref);                         \
-                lru_node(name) *old_head = mp_##name##_entry(&lru->node_pool, lru->ilru_head);  \
-                                                                                                \
-                new_node->prev = 0;                                                             \
-                new_node->next = lru->ilru_head;                                                \
-                lru->ilru_head = new_ref;                                                       \
-                old_head->prev = new_ref;                                                       \
-                ++(lru->used);                                                                  \
-            }                                                                                   \
-                                                                                                \
+            mp_ref_t new_ref = (lru->used == lru->capacity)                                     \
+                             ? _lru_##name##_evict(lru)                                         \
+                             : mp_##name##_alloc(&lru->node_pool);                              \
             assert(new_ref > 0);                                                                \
+            lru_node(name) *new_node = mp_##name##_entry(&lru->node_pool, new_ref);             \
             new_node->entry = *in;                                                              \
             new_node->key = key;                                                                \
+            new_node->referenced = 0;                                                           \
+                                                                                                \
+            /* Under 2Q, only the keys which were seen recently skip probation */               \
+            int queue = (lru->policy == LRU_POLICY_2Q && !_lru_##name##_ghost_take(lru, key))   \
+                      ? _LRU_QUEUE_PROBATION : _LRU_QUEUE_MAIN;                                 \
+            _lru_##name##_push_head(lru, new_ref, queue);                                       \
+            ++(lru->used);                                                                      \
                                                                                                 \
             int ret;                                                                            \
             k = kh_put(name, lru->key_node_table, key, &ret);                                   \
@@ -303,22 +475,49 @@
             return false;                                                                       \
                                                                                                 \
         mp_ref_t ref = kh_val(lru->key_node_table, k);                                          \
-        lru_node(name) *mpn = mp_##name##_entry(&lru->node_pool, ref);                          \
-        if(mpn->prev)                                                                           \
-            mp_##name##_entry(&lru->node_pool, mpn->prev)->next = mpn->next;                    \
-        if(mpn->next)                                                                           \
-            mp_##name##_entry(&lru->node_pool, mpn->next)->prev = mpn->prev;                    \
-                                                                                                \
-        if(lru->ilru_head == ref)                                                               \
-            lru->ilru_head = mpn->next;                                                         \
-        if(lru->ilru_tail == ref)                                                               \
-            lru->ilru_tail = mpn->prev;                                                         \
+        _lru_##name##_unlink(lru, ref);                                                         \
                                                                                                 \
         --(lru->used);                                                                          \
         kh_del(name, lru->key_node_table, k);                                                   \
         mp_##name##_free(&lru->node_pool, ref);                                                 \
         return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    /* Shrinking evicts the entries chosen by the policy. Growing keeps all */                  \
+    /* the entries, but may move them in memory.                           */                   \
+    scope bool lru_##name##_resize(lru(name) *lru, size_t capacity)                             \
+    {                                                                                           \
+        assert(capacity > 0);                                                                   \
+        while(lru->used > capacity) {                                                           \
+            mp_##name##_free(&lru->node_pool, _lru_##name##_evict(lru));                        \
+        }                                                                                       \
+                                                                                                \
+        if(!mp_##name##_reserve(&lru->node_pool, capacity))                                     \
+            return false;                                                                       \
+        kh_resize(name, lru->key_node_table, capacity);                                         \
+        lru->capacity = capacity;                                                               \
+        return _lru_##name##_ghost_reset(lru);                                                  \
+    }                                                                                           \
+                                                                                                \
+    scope bool lru_##name##_evict_one(lru(name) *lru)                                           \
+    {                                                                                           \
+        if(lru->used == 0)                                                                      \
+            return false;                                                                       \
+        mp_##name##_free(&lru->node_pool, _lru_##name##_evict(lru));                            \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    /* The entries are kept. Under 2Q, they all start out in the LRU list */                    \
+    scope bool lru_##name##_set_policy(lru(name) *lru, enum lru_policy policy)                  \
+    {                                                                                           \
+        assert((unsigned)policy < LRU_POLICY_COUNT);                                            \
+        while(lru->ihead[_LRU_QUEUE_PROBATION]) {                                               \
+            mp_ref_t ref = lru->ihead[_LRU_QUEUE_PROBATION];                                    \
+            _lru_##name##_unlink(lru, ref);                                                     \
+            _lru_##name##_push_tail(lru, ref, _LRU_QUEUE_MAIN);                                 \
+        }                                                                                       \
+        lru->policy = policy;                                                                   \
+        return _lru_##name##_ghost_reset(lru);                                                  \
     }                                                                                           \
 
 #endif
-
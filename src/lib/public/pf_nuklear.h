@@ -48,6 +48,8 @@
 #define NK_INCLUDE_COMMAND_USERDATA
 #define NK_INCLUDE_DEFAULT_FONT
 #define NK_UINT_DRAW_INDEX
+/* Keep command padding deterministic so that frames can be compared bytewise */
+#define NK_ZERO_COMMAND_MEMORY
 
 #include "nuklear.h"
 
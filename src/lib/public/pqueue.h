@@ -38,6 +38,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -146,7 +147,8 @@
                                                                                                 \
     scope void pq_##name##_destroy(pq(name) *pqueue)                                            \
     {                                                                                           \
-        free(pqueue->nodes);                                                                    \
+        if(pqueue->pfree)                                                                       \
+            pqueue->pfree(pqueue->nodes);                                                       \
         memset(pqueue, 0, sizeof(*pqueue));                                                     \
     }                                                                                           \
                                                                                                 \
@@ -303,5 +305,400 @@
         return true;                                                                            \
     }                                                                                           \
 
+/***********************************************************************************************/
+
+/* An indexed 4-ary min-heap. Every entry is identified by an integer key in the range 
+ * [0, nkeys), and a map from the keys to the heap positions allows lowering the priority 
+ * of an already queued entry in place (decrease-key), instead of pushing a duplicate and
+ * searching the queue for it. The wider nodes make for a shallower tree, with fewer cache 
+ * misses per sift.
+ */
+
+#define IPQUEUE_ARITY (4)
+
+#define IPQUEUE_TYPE(name, type)                                                                \
+                                                                                                \
+    typedef struct ipq_##name##_node_s {                                                        \
+        float    priority;                                                                      \
+        uint32_t key;                                                                           \
+        type     data;                                                                          \
+    } ipq_##name##_node_t;                                                                      \
+                                                                                                \
+    typedef struct ipq_##name##_s {                                                             \
+        ipq_##name##_node_t *nodes;                                                             \
+        uint32_t *pos; /* The heap index + 1 of every key, or 0 if it's not queued */           \
+        size_t nkeys;                                                                           \
+        size_t capacity;                                                                        \
+        size_t size;                                                                            \
+        void *(*prealloc)(void *ptr, size_t size);                                              \
+        void  (*pfree)(void *ptr);                                                              \
+    } ipq_##name##_t;
+
+/***********************************************************************************************/
+
+#define ipq(name)                                                                               \
+    ipq_##name##_t
+
+#define ipq_size(ipqueue)                                                                       \
+    ((ipqueue)->size)
+
+/***********************************************************************************************/
+
+#define IPQUEUE_PROTOTYPES(scope, name, type)                                                   \
+                                                                                                \
+    static void _ipq_##name##_sift_up  (ipq(name) *ipqueue, size_t idx);                        \
+    static void _ipq_##name##_sift_down(ipq(name) *ipqueue, size_t idx);                        \
+    scope  bool  ipq_##name##_init     (ipq(name) *ipqueue, size_t nkeys);                      \
+    scope  bool  ipq_##name##_init_alloc(ipq(name) *ipqueue, size_t nkeys,                      \
+                                        void *(*prealloc)(void *ptr, size_t size),              \
+                                        void (*pfree)(void *ptr));                              \
+    scope  void  ipq_##name##_destroy  (ipq(name) *ipqueue);                                    \
+    scope  bool  ipq_##name##_push     (ipq(name) *ipqueue, uint32_t key, float prio, type in); \
+    scope  bool  ipq_##name##_pop      (ipq(name) *ipqueue, type *out);                         \
+    scope  bool  ipq_##name##_top_prio (ipq(name) *ipqueue, float *out);                        \
+    scope  bool  ipq_##name##_contains (ipq(name) *ipqueue, uint32_t key);                      \
+    scope  bool  ipq_##name##_reserve  (ipq(name) *ipqueue, size_t cap);                        \
+    scope  void  ipq_##name##_clear    (ipq(name) *ipqueue);                                    \
+                                                                                                \
+
+/***********************************************************************************************/
+
+#define IPQUEUE_IMPL(scope, name, type)                                                         \
+                                                                                                \
+    static void _ipq_##name##_sift_up(ipq(name) *ipqueue, size_t idx)                           \
+    {                                                                                           \
+        ipq_##name##_node_t node = ipqueue->nodes[idx];                                         \
+        while(idx > 0) {                                                                        \
+                                                                                                \
+            size_t parent_idx = (idx - 1) / IPQUEUE_ARITY;                                      \
+            if(ipqueue->nodes[parent_idx].priority <= node.priority)                            \
+                break;                                                                          \
+                                                                                                \
+            ipqueue->nodes[idx] = ipqueue->nodes[parent_idx];                                   \
+            ipqueue->pos[ipqueue->nodes[idx].key] = idx + 1;                                    \
+            idx = parent_idx;                                                                   \
+        }                                                                                       \
+        ipqueue->nodes[idx] = node;                                                             \
+        ipqueue->pos[node.key] = idx + 1;                                                       \
+    }                                                                                           \
+                                                                                                \
+    static void _ipq_##name##_sift_down(ipq(name) *ipqueue, size_t idx)                         \
+    {                                                                                           \
+        ipq_##name##_node_t node = ipqueue->nodes[idx];                                         \
+        while(true) {                                                                           \
+                                                                                                \
+            size_t first_child_idx = idx * IPQUEUE_ARITY + 1;                                   \
+            if(first_child_idx >= ipqueue->size)                                                \
+                break;                                                                          \
+                                                                                                \
+            size_t last_child_idx = first_child_idx + IPQUEUE_ARITY;                            \
+            if(last_child_idx > ipqueue->size)                                                  \
+                last_child_idx = ipqueue->size;                                                 \
+                                                                                                \
+            size_t min_idx = first_child_idx;                                                   \
+            for(size_t i = first_child_idx + 1; i < last_child_idx; i++) {                      \
+                if(ipqueue->nodes[i].priority < ipqueue->nodes[min_idx].priority)               \
+                    min_idx = i;                                                                \
+            }                                                                                   \
+            if(ipqueue->nodes[min_idx].priority >= node.priority)                               \
+                break;                                                                          \
+                                                                                                \
+            ipqueue->nodes[idx] = ipqueue->nodes[min_idx];                                      \
+            ipqueue->pos[ipqueue->nodes[idx].key] = idx + 1;                                    \
+            idx = min_idx;                                                                      \
+        }                                                                                       \
+        ipqueue->nodes[idx] = node;                                                             \
+        ipqueue->pos[node.key] = idx + 1;                                                       \
+    }                                                                                           \
+                                                                                                \
+    scope bool ipq_##name##_init_alloc(ipq(name) *ipqueue, size_t nkeys,                        \
+                                       void *(*prealloc)(void *ptr, size_t size),               \
+                                       void (*pfree)(void *ptr))                                \
+    {                                                                                           \
+        ipqueue->nodes = NULL;                                                                  \
+        ipqueue->nkeys = nkeys;                                                                 \
+        ipqueue->capacity = 0;                                                                  \
+        ipqueue->size = 0;                                                                      \
+        ipqueue->prealloc = prealloc;                                                           \
+        ipqueue->pfree = pfree;                                                                 \
+                                                                                                \
+        ipqueue->pos = prealloc(NULL, (nkeys ? nkeys : 1) * sizeof(uint32_t));                  \
+        if(!ipqueue->pos) {                                                                     \
+            ipqueue->nkeys = 0; /* Make every push fail */                                      \
+            return false;                                                                       \
+        }                                                                                       \
+        memset(ipqueue->pos, 0, nkeys * sizeof(uint32_t));                                      \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool ipq_##name##_init(ipq(name) *ipqueue, size_t nkeys)                              \
+    {                                                                                           \
+        return ipq_##name##_init_alloc(ipqueue, nkeys, realloc, free);                          \
+    }                                                                                           \
+                                                                                                \
+    scope void ipq_##name##_destroy(ipq(name) *ipqueue)                                         \
+    {                                                                                           \
+        if(ipqueue->pfree) {                                                                    \
+            ipqueue->pfree(ipqueue->nodes);                                                     \
+            ipqueue->pfree(ipqueue->pos);                                                       \
+        }                                                                                       \
+        memset(ipqueue, 0, sizeof(*ipqueue));                                                   \
+    }                                                                                           \
+                                                                                                \
+    scope bool ipq_##name##_push(ipq(name) *ipqueue, uint32_t key, float in_prio, type in)      \
+    {                                                                                           \
+        if(key >= ipqueue->nkeys)                                                               \
+            return false;                                                                       \
+                                                                                                \
+        if(ipqueue->pos[key]) {                                                                 \
+                                                                                                \
+            size_t idx = ipqueue->pos[key] - 1;                                                 \
+            if(in_prio >= ipqueue->nodes[idx].priority)                                         \
+                return true;                                                                    \
+            ipqueue->nodes[idx].priority = in_prio;                                             \
+            ipqueue->nodes[idx].data = in;                                                      \
+            _ipq_##name##_sift_up(ipqueue, idx);                                                \
+            return true;                                                                        \
+        }                                                                                       \
+                                                                                                \
+        if(ipqueue->size == ipqueue->capacity) {                                                \
+                                                                                                \
+            size_t new_cap = ipqueue->capacity ? ipqueue->capacity * 2 : 32;                    \
+            void *nodes = ipqueue->prealloc(ipqueue->nodes,                                     \
+                new_cap * sizeof(ipq_##name##_node_t));                                         \
+            if(!nodes)                                                                          \
+                return false;                                                                   \
+            ipqueue->nodes = nodes;                                                             \
+            ipqueue->capacity = new_cap;                                                        \
+        }                                                                                       \
+                                                                                                \
+        size_t idx = ipqueue->size++;                                                           \
+        ipqueue->nodes[idx] = (ipq_##name##_node_t){in_prio, key, in};                          \
+        _ipq_##name##_sift_up(ipqueue, idx);                                                    \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool ipq_##name##_pop(ipq(name) *ipqueue, type *out)                                  \
+    {                                                                                           \
+        if(ipqueue->size == 0)                                                                  \
+            return false;                                                                       \
+                                                                                                \
+        *out = ipqueue->nodes[0].data;                                                          \
+        ipqueue->pos[ipqueue->nodes[0].key] = 0;                                                \
+        if(--ipqueue->size > 0) {                                                               \
+            ipqueue->nodes[0] = ipqueue->nodes[ipqueue->size];                                  \
+            _ipq_##name##_sift_down(ipqueue, 0);                                                \
+        }                                                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool ipq_##name##_top_prio(ipq(name) *ipqueue, float *out)                            \
+    {                                                                                           \
+        if(ipqueue->size == 0)                                                                  \
+            return false;                                                                       \
+        *out = ipqueue->nodes[0].priority;                                                      \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool ipq_##name##_contains(ipq(name) *ipqueue, uint32_t key)                          \
+    {                                                                                           \
+        return (key < ipqueue->nkeys) && (ipqueue->pos[key] != 0);                              \
+    }                                                                                           \
+                                                                                                \
+    scope bool ipq_##name##_reserve(ipq(name) *ipqueue, size_t cap)                             \
+    {                                                                                           \
+        if(ipqueue->capacity < cap) {                                                           \
+                                                                                                \
+            void *nodes = ipqueue->prealloc(ipqueue->nodes,                                     \
+                cap * sizeof(ipq_##name##_node_t));                                             \
+            if(!nodes)                                                                          \
+                return false;                                                                   \
+            ipqueue->nodes = nodes;                                                             \
+            ipqueue->capacity = cap;                                                            \
+        }                                                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope void ipq_##name##_clear(ipq(name) *ipqueue)                                           \
+    {                                                                                           \
+        for(size_t i = 0; i < ipqueue->size; i++) {                                             \
+            ipqueue->pos[ipqueue->nodes[i].key] = 0;                                            \
+        }                                                                                       \
+        ipqueue->size = 0;                                                                      \
+    }                                                                                           \
+                                                                                                \
+
+/***********************************************************************************************/
+
+/* A monotone bucket queue (Dial's algorithm) for non-negative integer priorities. It relies
+ * on no entry being pushed with a priority smaller than that of the last popped entry (or 0,
+ * initially), or larger than it by 'nbuckets' or more, which holds for a Dijkstra search over
+ * integer edge costs smaller than 'nbuckets'. Pushes and pops are then O(1), save for skipping over the
+ * empty buckets. There is no decrease-key: stale duplicates are to be skipped by the caller
+ * on pop. The entries of all the buckets are chained through a single pool, such that the 
+ * queue only ever holds two allocations.
+ */
+
+#define BQUEUE_TYPE(name, type)                                                                 \
+                                                                                                \
+    typedef struct bq_##name##_node_s {                                                         \
+        int      priority;                                                                      \
+        uint32_t next;                                                                          \
+        type     data;                                                                          \
+    } bq_##name##_node_t;                                                                       \
+                                                                                                \
+    typedef struct bq_##name##_s {                                                              \
+        bq_##name##_node_t *nodes; /* 1-based, 0 terminates the bucket chains */                \
+        uint32_t *heads;                                                                        \
+        size_t nbuckets;                                                                        \
+        size_t capacity;                                                                        \
+        size_t used;                                                                            \
+        size_t size;                                                                            \
+        uint32_t free_head;                                                                     \
+        int base; /* No queued entry has a smaller priority */                                  \
+        void *(*prealloc)(void *ptr, size_t size);                                              \
+        void  (*pfree)(void *ptr);                                                              \
+    } bq_##name##_t;
+
+/***********************************************************************************************/
+
+#define bq(name)                                                                                \
+    bq_##name##_t
+
+#define bq_size(bqueue)                                                                         \
+    ((bqueue)->size)
+
+/***********************************************************************************************/
+
+#define BQUEUE_PROTOTYPES(scope, name, type)                                                    \
+                                                                                                \
+    static uint32_t _bq_##name##_min_bucket(bq(name) *bqueue);                                  \
+    scope  bool  bq_##name##_init      (bq(name) *bqueue, size_t nbuckets);                     \
+    scope  bool  bq_##name##_init_alloc(bq(name) *bqueue, size_t nbuckets,                      \
+                                       void *(*prealloc)(void *ptr, size_t size),               \
+                                       void (*pfree)(void *ptr));                               \
+    scope  void  bq_##name##_destroy   (bq(name) *bqueue);                                      \
+    scope  bool  bq_##name##_push      (bq(name) *bqueue, int in_prio, type in);                \
+    scope  bool  bq_##name##_pop       (bq(name) *bqueue, type *out);                           \
+    scope  bool  bq_##name##_top_prio  (bq(name) *bqueue, int *out);                            \
+    scope  void  bq_##name##_clear     (bq(name) *bqueue);                                      \
+                                                                                                \
+
+/***********************************************************************************************/
+
+#define BQUEUE_IMPL(scope, name, type)                                                          \
+                                                                                                \
+    static uint32_t _bq_##name##_min_bucket(bq(name) *bqueue)                                   \
+    {                                                                                           \
+        uint32_t bucket = bqueue->base % bqueue->nbuckets;                                      \
+        while(!bqueue->heads[bucket]) {                                                         \
+            bqueue->base++;                                                                     \
+            bucket = (bucket + 1 == bqueue->nbuckets) ? 0 : bucket + 1;                         \
+        }                                                                                       \
+        return bucket;                                                                          \
+    }                                                                                           \
+                                                                                                \
+    scope bool bq_##name##_init_alloc(bq(name) *bqueue, size_t nbuckets,                        \
+                                      void *(*prealloc)(void *ptr, size_t size),                \
+                                      void (*pfree)(void *ptr))                                 \
+    {                                                                                           \
+        bqueue->nodes = NULL;                                                                   \
+        bqueue->nbuckets = nbuckets;                                                            \
+        bqueue->capacity = 0;                                                                   \
+        bqueue->used = 0;                                                                       \
+        bqueue->size = 0;                                                                       \
+        bqueue->free_head = 0;                                                                  \
+        bqueue->base = 0;                                                                       \
+        bqueue->prealloc = prealloc;                                                            \
+        bqueue->pfree = pfree;                                                                  \
+                                                                                                \
+        bqueue->heads = prealloc(NULL, nbuckets * sizeof(uint32_t));                            \
+        if(!bqueue->heads) {                                                                    \
+            bqueue->nbuckets = 0; /* Make every push fail */                                    \
+            return false;                                                                       \
+        }                                                                                       \
+        memset(bqueue->heads, 0, nbuckets * sizeof(uint32_t));                                  \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool bq_##name##_init(bq(name) *bqueue, size_t nbuckets)                              \
+    {                                                                                           \
+        return bq_##name##_init_alloc(bqueue, nbuckets, realloc, free);                         \
+    }                                                                                           \
+                                                                                                \
+    scope void bq_##name##_destroy(bq(name) *bqueue)                                            \
+    {                                                                                           \
+        if(bqueue->pfree) {                                                                     \
+            bqueue->pfree(bqueue->nodes);                                                       \
+            bqueue->pfree(bqueue->heads);                                                       \
+        }                                                                                       \
+        memset(bqueue, 0, sizeof(*bqueue));                                                     \
+    }                                                                                           \
+                                                                                                \
+    scope bool bq_##name##_push(bq(name) *bqueue, int in_prio, type in)                         \
+    {                                                                                           \
+        if(in_prio < bqueue->base || (size_t)(in_prio - bqueue->base) >= bqueue->nbuckets)      \
+            return false;                                                                       \
+                                                                                                \
+        uint32_t ref = bqueue->free_head;                                                       \
+        if(ref) {                                                                               \
+            bqueue->free_head = bqueue->nodes[ref].next;                                        \
+        }else{                                                                                  \
+                                                                                                \
+            if(bqueue->used + 1 >= bqueue->capacity) {                                          \
+                                                                                                \
+                size_t new_cap = bqueue->capacity ? bqueue->capacity * 2 : 64;                  \
+                void *nodes = bqueue->prealloc(bqueue->nodes,                                   \
+                    new_cap * sizeof(bq_##name##_node_t));                                      \
+                if(!nodes)                                                                      \
+                    return false;                                                               \
+                bqueue->nodes = nodes;                                                          \
+                bqueue->capacity = new_cap;                                                     \
+            }                                                                                   \
+            ref = ++bqueue->used;                                                               \
+        }                                                                                       \
+                                                                                                \
+        uint32_t bucket = in_prio % bqueue->nbuckets;                                           \
+        bqueue->nodes[ref] = (bq_##name##_node_t){in_prio, bqueue->heads[bucket], in};          \
+        bqueue->heads[bucket] = ref;                                                            \
+        bqueue->size++;                                                                         \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool bq_##name##_pop(bq(name) *bqueue, type *out)                                     \
+    {                                                                                           \
+        if(bqueue->size == 0)                                                                   \
+            return false;                                                                       \
+                                                                                                \
+        uint32_t bucket = _bq_##name##_min_bucket(bqueue);                                      \
+        uint32_t ref = bqueue->heads[bucket];                                                   \
+        *out = bqueue->nodes[ref].data;                                                         \
+                                                                                                \
+        bqueue->heads[bucket] = bqueue->nodes[ref].next;                                        \
+        bqueue->nodes[ref].next = bqueue->free_head;                                            \
+        bqueue->free_head = ref;                                                                \
+        bqueue->size--;                                                                         \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool bq_##name##_top_prio(bq(name) *bqueue, int *out)                                 \
+    {                                                                                           \
+        if(bqueue->size == 0)                                                                   \
+            return false;                                                                       \
+        _bq_##name##_min_bucket(bqueue);                                                        \
+        *out = bqueue->base;                                                                    \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope void bq_##name##_clear(bq(name) *bqueue)                                              \
+    {                                                                                           \
+        memset(bqueue->heads, 0, bqueue->nbuckets * sizeof(uint32_t));                          \
+        bqueue->used = 0;                                                                       \
+        bqueue->size = 0;                                                                       \
+        bqueue->free_head = 0;                                                                  \
+        bqueue->base = 0;                                                                       \
+    }                                                                                           \
+                                                                                                \
+
 #endif
 
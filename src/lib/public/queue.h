@@ -44,6 +44,8 @@
 #include <assert.h>
 #include <string.h>
 
+#include <SDL_atomic.h>
+
 /***********************************************************************************************/
 
 #define QUEUE_TYPE(name, type)                                                                  \
@@ -54,6 +56,8 @@
         int ihead;                                                                              \
         int itail;                                                                              \
         type *mem;                                                                              \
+        void *(*qrealloc)(void *ptr, size_t size);                                              \
+        void  (*qfree)(void *ptr);                                                              \
     } queue_##name##_t;                                                                         \
 
 /***********************************************************************************************/
@@ -64,12 +68,19 @@
 #define queue_size(queue)                                                                       \
     ((queue).size)
 
+/* The n-th entry counting from the head (oldest) of the queue */
+#define queue_at(queue, n)                                                                      \
+    ((queue).mem[((queue).ihead + (n)) % (queue).capacity])
+
 /***********************************************************************************************/
 
 #define QUEUE_PROTOTYPES(scope, name, type)                                                     \
                                                                                                 \
     static bool _queue_##name##_resize  (queue(name) *queue, size_t new_cap);                   \
     scope  bool  queue_##name##_init    (queue(name) *queue, size_t init_cap);                  \
+    scope  bool  queue_##name##_init_alloc(queue(name) *queue, size_t init_cap,                 \
+                                         void *(*qrealloc)(void *ptr, size_t size),             \
+                                         void (*qfree)(void *ptr));                             \
     scope  void  queue_##name##_destroy (queue(name) *queue);                                   \
     scope  bool  queue_##name##_push    (queue(name) *queue, type *entry);                      \
     scope  bool  queue_##name##_pop     (queue(name) *queue, type *out);                        \
@@ -82,7 +93,11 @@
     static bool _queue_##name##_resize(queue(name) *queue, size_t new_cap)                      \
     {                                                                                           \
         PERF_ENTER();                                                                           \
-        type *new_mem = realloc((void*)queue->mem, sizeof(type) * new_cap);                     \
+        if(!queue->qrealloc) {                                                                  \
+            queue->qrealloc = realloc;                                                          \
+            queue->qfree = free;                                                                \
+        }                                                                                       \
+        type *new_mem = queue->qrealloc((void*)queue->mem, sizeof(type) * new_cap);             \
         if(!new_mem)                                                                            \
             PERF_RETURN(false);                                                                 \
                                                                                                 \
@@ -105,11 +120,11 @@
             size_t bot = queue->capacity - queue->ihead;                                        \
             assert(top + bot == queue->size);                                                   \
                                                                                                 \
-            type *tmp = malloc(sizeof(type) * top);                                             \
+            type *tmp = queue->qrealloc(NULL, sizeof(type) * top);                              \
             memcpy(tmp, new_mem, sizeof(type) * top);                                           \
             memmove(new_mem, new_mem + queue->ihead, sizeof(type) * bot);                       \
             memcpy(new_mem + bot, tmp, sizeof(type) * top);                                     \
-            free(tmp);                                                                          \
+            queue->qfree(tmp);                                                                  \
                                                                                                 \
             queue->ihead = 0;                                                                   \
             queue->itail = top + bot - 1;                                                       \
@@ -124,12 +139,26 @@
     {                                                                                           \
         memset(queue, 0, sizeof(*queue));                                                       \
         queue->itail = -1;                                                                      \
+        queue->qrealloc = realloc;                                                              \
+        queue->qfree = free;                                                                    \
+        return _queue_##name##_resize(queue, init_cap);                                         \
+    }                                                                                           \
+                                                                                                \
+    scope bool queue_##name##_init_alloc(queue(name) *queue, size_t init_cap,                   \
+                                         void *(*qrealloc)(void *ptr, size_t size),             \
+                                         void (*qfree)(void *ptr))                              \
+    {                                                                                           \
+        memset(queue, 0, sizeof(*queue));                                                       \
+        queue->itail = -1;                                                                      \
+        queue->qrealloc = qrealloc;                                                             \
+        queue->qfree = qfree;                                                                   \
         return _queue_##name##_resize(queue, init_cap);                                         \
     }                                                                                           \
                                                                                                 \
     scope void queue_##name##_destroy(queue(name) *queue)                                       \
     {                                                                                           \
-        free((void*)queue->mem);                                                                \
+        if(queue->qfree)                                                                        \
+            queue->qfree((void*)queue->mem);                                                    \
         memset(queue, 0, sizeof(*queue));                                                       \
     }                                                                                           \
                                                                                                 \
@@ -172,5 +201,113 @@
         queue->size = 0;                                                                        \
     }
 
+/***********************************************************************************************/
+/* Lock-free multiple-producer, single-consumer queue. Any thread may push, but only one       */
+/* thread at a time may pop. Pushing never blocks: each entry is held in its own heap node     */
+/* and linked in with a single atomic exchange. A pop racing an in-flight push may not see     */
+/* the new entry yet; it becomes visible to the next pop.                                      */
+/***********************************************************************************************/
+
+#define MPSC_QUEUE_TYPE(name, type)                                                             \
+                                                                                                \
+    struct mpsc_##name##_node {                                                                 \
+        void *next;                                                                             \
+        type  entry;                                                                            \
+    };                                                                                          \
+                                                                                                \
+    typedef struct mpsc_##name##_s {                                                            \
+        void                      *head;                                                        \
+        struct mpsc_##name##_node *tail;                                                        \
+        struct mpsc_##name##_node  stub;                                                        \
+        SDL_atomic_t               size;                                                        \
+    } mpsc_##name##_t;                                                                          \
+
+/***********************************************************************************************/
+
+#define mpsc(name)                                                                              \
+    mpsc_##name##_t
+
+#define mpsc_size(mpsc)                                                                         \
+    ((size_t)SDL_AtomicGet(&(mpsc).size))
+
+/***********************************************************************************************/
+
+#define MPSC_QUEUE_PROTOTYPES(scope, name, type)                                                \
+                                                                                                \
+    scope  void  mpsc_##name##_init     (mpsc(name) *mpsc);                                     \
+    scope  void  mpsc_##name##_destroy  (mpsc(name) *mpsc);                                     \
+    scope  bool  mpsc_##name##_push     (mpsc(name) *mpsc, type *entry);                        \
+    scope  bool  mpsc_##name##_pop      (mpsc(name) *mpsc, type *out);
+
+/***********************************************************************************************/
+
+#define MPSC_QUEUE_IMPL(scope, name, type)                                                      \
+                                                                                                \
+    static void _mpsc_##name##_link(mpsc(name) *mpsc, struct mpsc_##name##_node *node)          \
+    {                                                                                           \
+        node->next = NULL;                                                                      \
+        struct mpsc_##name##_node *prev = SDL_AtomicSetPtr(&mpsc->head, node);                  \
+        /* Between the exchange and this store the chain is broken and */                       \
+        /* the consumer will see the new node only on its next pop.    */                       \
+        SDL_AtomicSetPtr(&prev->next, node);                                                    \
+    }                                                                                           \
+                                                                                                \
+    scope void mpsc_##name##_init(mpsc(name) *mpsc)                                             \
+    {                                                                                           \
+        memset(mpsc, 0, sizeof(*mpsc));                                                         \
+        mpsc->head = &mpsc->stub;                                                               \
+        mpsc->tail = &mpsc->stub;                                                               \
+    }                                                                                           \
+                                                                                                \
+    scope bool mpsc_##name##_push(mpsc(name) *mpsc, type *entry)                                \
+    {                                                                                           \
+        struct mpsc_##name##_node *node = malloc(sizeof(struct mpsc_##name##_node));            \
+        if(!node)                                                                               \
+            return false;                                                                       \
+        node->entry = *entry;                                                                   \
+        SDL_AtomicAdd(&mpsc->size, 1);                                                          \
+        _mpsc_##name##_link(mpsc, node);                                                        \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool mpsc_##name##_pop(mpsc(name) *mpsc, type *out)                                   \
+    {                                                                                           \
+        struct mpsc_##name##_node *tail = mpsc->tail;                                           \
+        struct mpsc_##name##_node *next = SDL_AtomicGetPtr(&tail->next);                        \
+                                                                                                \
+        if(tail == &mpsc->stub) {                                                               \
+            if(!next)                                                                           \
+                return false;                                                                   \
+            mpsc->tail = next;                                                                  \
+            tail = next;                                                                        \
+            next = SDL_AtomicGetPtr(&next->next);                                               \
+        }                                                                                       \
+                                                                                                \
+        if(!next) {                                                                             \
+            /* The tail is the last linked node. Re-insert the stub behind */                   \
+            /* it so that it can be unlinked without racing the producers. */                   \
+            if(tail != SDL_AtomicGetPtr(&mpsc->head))                                           \
+                return false;                                                                   \
+            _mpsc_##name##_link(mpsc, &mpsc->stub);                                             \
+            next = SDL_AtomicGetPtr(&tail->next);                                               \
+            if(!next)                                                                           \
+                return false;                                                                   \
+        }                                                                                       \
+                                                                                                \
+        mpsc->tail = next;                                                                      \
+        *out = tail->entry;                                                                     \
+        free(tail);                                                                             \
+        SDL_AtomicAdd(&mpsc->size, -1);                                                         \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope void mpsc_##name##_destroy(mpsc(name) *mpsc)                                          \
+    {                                                                                           \
+        type tmp;                                                                               \
+        while(mpsc_##name##_pop(mpsc, &tmp))                                                    \
+            ;                                                                                   \
+        memset(mpsc, 0, sizeof(*mpsc));                                                         \
+    }
+
 #endif
 
@@ -0,0 +1,86 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* A general-purpose allocator for small, frequently allocated and freed 
+ * objects. Requests are rounded up to one of a handful of power-of-two 
+ * size classes and carved out of 64KB slabs, so that objects of similar 
+ * sizes are packed together instead of fragmenting the heap. A slab that 
+ * becomes completely free is handed back to the OS, unless it's the only
+ * free slab of its' class. Requests larger than the largest class go
+ * straight to 'malloc'.
+ *
+ * Every thread keeps a small cache of free blocks for each class, which
+ * is refilled from (and flushed to) the shared slabs in batches. Hence,
+ * the shared lock is only taken once per batch. Any thread may free a 
+ * block allocated by any other thread.
+ *
+ * The allocator needs no initialization. The signatures of 'slab_realloc'
+ * and 'slab_free' match the allocator hooks of the 'vec', 'queue' and 'pq'
+ * containers.
+ */
+
+#define SLAB_NUM_CLASSES   (9)
+#define SLAB_MIN_SIZE      (16)
+#define SLAB_MAX_SIZE      (SLAB_MIN_SIZE << (SLAB_NUM_CLASSES - 1))
+
+struct slab_stats{
+    size_t block_size;
+    size_t nslabs;     /* number of slabs currently held by the class */
+    size_t nlive;      /* blocks handed out to the application */
+    size_t ncached;    /* free blocks held in thread caches */
+    size_t high_water; /* highest number of blocks out of the slabs (live or cached) */
+    size_t nallocs;    /* total number of allocations */
+};
+
+void  *slab_malloc(size_t size);
+void  *slab_calloc(size_t num, size_t size);
+void  *slab_realloc(void *ptr, size_t size);
+void   slab_free(void *ptr);
+
+/* Return the cached blocks of the calling thread to the shared slabs. Threads
+ * created via SDL do this automatically upon exiting. */
+void   slab_flush_thread(void);
+/* One entry for every size class, and another (with a 'block_size' of 0) 
+ * for the requests that were forwarded to 'malloc'. */
+size_t slab_get_stats(size_t maxout, struct slab_stats *out);
+
+#endif
+
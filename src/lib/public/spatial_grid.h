@@ -0,0 +1,380 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+/* A uniform grid of buckets holding (x, y, record) tuples. Compared to the 
+ * quadtree, there is no rebalancing and no pointer chasing - every cell is 
+ * a flat array, and a record moving within the same cell is updated in place. 
+ * Positions outside the grid bounds are clamped to the border cells, so 
+ * insertion never fails due to the position.
+ *
+ * The cell arrays are reference-counted and copy-on-write: copying a grid
+ * only copies the array of cell descriptors, and a shared cell array is 
+ * cloned the first time it is modified. The reference counts are not 
+ * atomic, so copying, modifying and destroying grids that share cells must 
+ * all happen on the same thread. Querying is safe from any thread.
+ */
+
+/***********************************************************************************************/
+
+#define SPATIAL_GRID_TYPE(name, type)                                                           \
+                                                                                                \
+    typedef struct sg_##name##_rec_s {                                                          \
+        float x, y;                                                                             \
+        type  record;                                                                           \
+    } sg_##name##_rec_t;                                                                        \
+                                                                                                \
+    typedef struct sg_##name##_buf_s {                                                          \
+        int                refcount;                                                            \
+        uint32_t           capacity;                                                            \
+        sg_##name##_rec_t  recs[];                                                              \
+    } sg_##name##_buf_t;                                                                        \
+                                                                                                \
+    typedef struct sg_##name##_cell_s {                                                         \
+        uint32_t           size;                                                                \
+        sg_##name##_buf_t *buf;                                                                 \
+    } sg_##name##_cell_t;                                                                       \
+                                                                                                \
+    typedef struct sg_##name##_s {                                                              \
+        float               xmin, xmax;                                                         \
+        float               ymin, ymax;                                                         \
+        float               cell_size;                                                          \
+        float               inv_cell_size;                                                      \
+        int                 ncols, nrows;                                                       \
+        size_t              nrecs;                                                              \
+        sg_##name##_cell_t *cells;                                                              \
+        bool                (*comparator)(const type *a, const type *b);                        \
+    } sg_##name##_t;
+
+/***********************************************************************************************/
+
+#define sg(name)                                                                                \
+    sg_##name##_t
+
+#define sg_cell(name)                                                                           \
+    sg_##name##_cell_t
+
+#define sg_rec(name)                                                                            \
+    sg_##name##_rec_t
+
+#define sg_buf(name)                                                                            \
+    sg_##name##_buf_t
+
+/***********************************************************************************************/
+
+#define SPATIAL_GRID_PROTOTYPES(scope, name, type)                                              \
+                                                                                                \
+    scope bool sg_##name##_init(sg(name) *sg,                                                   \
+                                float xmin, float xmax,                                         \
+                                float ymin, float ymax,                                         \
+                                float cell_size,                                                \
+                                bool (*comparator)(const type*, const type*));                  \
+    scope void sg_##name##_destroy(sg(name) *sg);                                               \
+    scope void sg_##name##_clear(sg(name) *sg);                                                 \
+    scope bool sg_##name##_insert(sg(name) *sg, float x, float y, type record);                 \
+    scope bool sg_##name##_delete(sg(name) *sg, float x, float y, type record);                 \
+    /* If the record is not found at the old position, it is just inserted */                   \
+    scope bool sg_##name##_move(sg(name) *sg, float oldx, float oldy,                           \
+                                float newx, float newy, type record);                           \
+    scope int  sg_##name##_inrange_circle(const sg(name) *sg,                                   \
+                                          float x, float y, float range,                        \
+                                          type *out, int maxout);                               \
+    scope int  sg_##name##_inrange_rect(const sg(name) *sg,                                     \
+                                        float minx, float maxx,                                 \
+                                        float miny, float maxy,                                 \
+                                        type *out, int maxout);                                 \
+    scope bool sg_##name##_copy(const sg(name) *from, sg(name) *to);
+
+/***********************************************************************************************/
+
+#define SPATIAL_GRID_IMPL(scope, name, type)                                                    \
+                                                                                                \
+    static inline int _sg_##name##_col(const sg(name) *sg, float x)                             \
+    {                                                                                           \
+        int ret = (int)((x - sg->xmin) * sg->inv_cell_size);                                    \
+        return (ret < 0) ? 0 : (ret >= sg->ncols) ? sg->ncols - 1 : ret;                        \
+    }                                                                                           \
+                                                                                                \
+    static inline int _sg_##name##_row(const sg(name) *sg, float y)                             \
+    {                                                                                           \
+        int ret = (int)((y - sg->ymin) * sg->inv_cell_size);                                    \
+        return (ret < 0) ? 0 : (ret >= sg->nrows) ? sg->nrows - 1 : ret;                        \
+    }                                                                                           \
+                                                                                                \
+    static inline sg_cell(name) *_sg_##name##_cell_at(const sg(name) *sg, float x, float y)     \
+    {                                                                                           \
+        int r = _sg_##name##_row(sg, y);                                                        \
+        int c = _sg_##name##_col(sg, x);                                                        \
+        return &sg->cells[r * sg->ncols + c];                                                   \
+    }                                                                                           \
+                                                                                                \
+    static void _sg_##name##_buf_release(sg_buf(name) *buf)                                     \
+    {                                                                                           \
+        if(buf && --buf->refcount == 0)                                                         \
+            free(buf);                                                                          \
+    }                                                                                           \
+                                                                                                \
+    /* Make sure the cell owns its' array exclusively, and that it can hold */                  \
+    /* at least 'need' records. */                                                              \
+    static bool _sg_##name##_cell_reserve(sg_cell(name) *cell, uint32_t need)                   \
+    {                                                                                           \
+        sg_buf(name) *buf = cell->buf;                                                          \
+        bool shared = buf && (buf->refcount > 1);                                               \
+        uint32_t cap = buf ? buf->capacity : 0;                                                 \
+                                                                                                \
+        if(buf && !shared && cap >= need)                                                       \
+            return true;                                                                        \
+                                                                                                \
+        uint32_t new_cap = cap ? cap : 8;                                                       \
+        while(new_cap < need)                                                                   \
+            new_cap *= 2;                                                                       \
+                                                                                                \
+        size_t new_size = sizeof(sg_buf(name)) + new_cap * sizeof(sg_rec(name));                \
+        sg_buf(name) *new_buf;                                                                  \
+                                                                                                \
+        if(shared || !buf) {                                                                    \
+            new_buf = malloc(new_size);                                                         \
+            if(!new_buf)                                                                        \
+                return false;                                                                   \
+            if(buf) {                                                                           \
+                memcpy(new_buf->recs, buf->recs, cell->size * sizeof(sg_rec(name)));            \
+                buf->refcount--;                                                                \
+            }                                                                                   \
+        }else{                                                                                  \
+            new_buf = realloc(buf, new_size);                                                   \
+            if(!new_buf)                                                                        \
+                return false;                                                                   \
+        }                                                                                       \
+        new_buf->refcount = 1;                                                                  \
+        new_buf->capacity = new_cap;                                                            \
+        cell->buf = new_buf;                                                                    \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    static bool _sg_##name##_cell_push(sg_cell(name) *cell, float x, float y, type record)      \
+    {                                                                                           \
+        if(!_sg_##name##_cell_reserve(cell, cell->size + 1))                                    \
+            return false;                                                                       \
+        cell->buf->recs[cell->size++] = (sg_rec(name)){x, y, record};                           \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    static bool _sg_##name##_cell_remove(sg_cell(name) *cell, int idx)                          \
+    {                                                                                           \
+        if(!_sg_##name##_cell_reserve(cell, cell->size))                                        \
+            return false;                                                                       \
+        cell->buf->recs[idx] = cell->buf->recs[--cell->size];                                   \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    static int _sg_##name##_cell_find(sg(name) *sg, sg_cell(name) *cell, type record)           \
+    {                                                                                           \
+        for(int i = 0; i < cell->size; i++) {                                                   \
+            if(sg->comparator(&cell->buf->recs[i].record, &record))                             \
+                return i;                                                                       \
+        }                                                                                       \
+        return -1;                                                                              \
+    }                                                                                           \
+                                                                                                \
+    scope bool sg_##name##_init(sg(name) *sg,                                                   \
+                                float xmin, float xmax,                                         \
+                                float ymin, float ymax,                                         \
+                                float cell_size,                                                \
+                                bool (*comparator)(const type*, const type*))                   \
+    {                                                                                           \
+        assert(xmax > xmin && ymax > ymin && cell_size > 0.0f);                                 \
+                                                                                                \
+        sg->xmin = xmin;                                                                        \
+        sg->xmax = xmax;                                                                        \
+        sg->ymin = ymin;                                                                        \
+        sg->ymax = ymax;                                                                        \
+        sg->cell_size = cell_size;                                                              \
+        sg->inv_cell_size = 1.0f / cell_size;                                                   \
+        sg->ncols = (int)ceilf((xmax - xmin) / cell_size);                                      \
+        sg->nrows = (int)ceilf((ymax - ymin) / cell_size);                                      \
+        sg->nrecs = 0;                                                                          \
+        sg->comparator = comparator;                                                            \
+                                                                                                \
+        sg->cells = calloc(sg->ncols * sg->nrows, sizeof(sg_cell(name)));                       \
+        return (sg->cells != NULL);                                                             \
+    }                                                                                           \
+                                                                                                \
+    scope void sg_##name##_destroy(sg(name) *sg)                                                \
+    {                                                                                           \
+        for(int i = 0; i < sg->ncols * sg->nrows; i++) {                                        \
+            _sg_##name##_buf_release(sg->cells[i].buf);                                         \
+        }                                                                                       \
+        free(sg->cells);                                                                        \
+        sg->cells = NULL;                                                                       \
+        sg->nrecs = 0;                                                                          \
+    }                                                                                           \
+                                                                                                \
+    scope void sg_##name##_clear(sg(name) *sg)                                                  \
+    {                                                                                           \
+        for(int i = 0; i < sg->ncols * sg->nrows; i++) {                                        \
+            sg->cells[i].size = 0;                                                              \
+        }                                                                                       \
+        sg->nrecs = 0;                                                                          \
+    }                                                                                           \
+                                                                                                \
+    scope bool sg_##name##_insert(sg(name) *sg, float x, float y, type record)                  \
+    {                                                                                           \
+        sg_cell(name) *cell = _sg_##name##_cell_at(sg, x, y);                                   \
+        if(!_sg_##name##_cell_push(cell, x, y, record))                                         \
+            return false;                                                                       \
+        sg->nrecs++;                                                                            \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool sg_##name##_delete(sg(name) *sg, float x, float y, type record)                  \
+    {                                                                                           \
+        sg_cell(name) *cell = _sg_##name##_cell_at(sg, x, y);                                   \
+        int idx = _sg_##name##_cell_find(sg, cell, record);                                     \
+        if(idx < 0)                                                                             \
+            return false;                                                                       \
+        if(!_sg_##name##_cell_remove(cell, idx))                                                \
+            return false;                                                                       \
+        sg->nrecs--;                                                                            \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool sg_##name##_move(sg(name) *sg, float oldx, float oldy,                           \
+                                float newx, float newy, type record)                            \
+    {                                                                                           \
+        sg_cell(name) *old_cell = _sg_##name##_cell_at(sg, oldx, oldy);                         \
+        sg_cell(name) *new_cell = _sg_##name##_cell_at(sg, newx, newy);                         \
+        int idx = _sg_##name##_cell_find(sg, old_cell, record);                                 \
+        if(idx < 0)                                                                             \
+            return sg_##name##_insert(sg, newx, newy, record);                                  \
+                                                                                                \
+        if(old_cell == new_cell) {                                                              \
+            if(!_sg_##name##_cell_reserve(old_cell, old_cell->size))                            \
+                return false;                                                                   \
+            old_cell->buf->recs[idx].x = newx;                                                  \
+            old_cell->buf->recs[idx].y = newy;                                                  \
+            return true;                                                                        \
+        }                                                                                       \
+                                                                                                \
+        if(!_sg_##name##_cell_push(new_cell, newx, newy, record))                               \
+            return false;                                                                       \
+        if(!_sg_##name##_cell_remove(old_cell, idx)) {                                          \
+            new_cell->size--;                                                                   \
+            return false;                                                                       \
+        }                                                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope int sg_##name##_inrange_circle(const sg(name) *sg,                                    \
+                                         float x, float y, float range,                         \
+                                         type *out, int maxout)                                 \
+    {                                                                                           \
+        int rmin = _sg_##name##_row(sg, y - range), rmax = _sg_##name##_row(sg, y + range);     \
+        int cmin = _sg_##name##_col(sg, x - range), cmax = _sg_##name##_col(sg, x + range);     \
+        const float range_sq = range * range;                                                   \
+        int ret = 0;                                                                            \
+                                                                                                \
+        for(int r = rmin; r <= rmax; r++) {                                                     \
+        for(int c = cmin; c <= cmax; c++) {                                                     \
+                                                                                                \
+            const sg_cell(name) *cell = &sg->cells[r * sg->ncols + c];                          \
+            for(int i = 0; i < cell->size; i++) {                                               \
+                                                                                                \
+                const sg_rec(name) *rec = &cell->buf->recs[i];                                  \
+                float dx = rec->x - x;                                                          \
+                float dy = rec->y - y;                                                          \
+                if(dx * dx + dy * dy > range_sq)                                                \
+                    continue;                                                                   \
+                if(ret == maxout)                                                               \
+                    return ret;                                                                 \
+                out[ret++] = rec->record;                                                       \
+            }                                                                                   \
+        }}                                                                                      \
+        return ret;                                                                             \
+    }                                                                                           \
+                                                                                                \
+    scope int sg_##name##_inrange_rect(const sg(name) *sg,                                      \
+                                       float minx, float maxx,                                  \
+                                       float miny, float maxy,                                  \
+                                       type *out, int maxout)                                   \
+    {                                                                                           \
+        int rmin = _sg_##name##_row(sg, miny), rmax = _sg_##name##_row(sg, maxy);               \
+        int cmin = _sg_##name##_col(sg, minx), cmax = _sg_##name##_col(sg, maxx);               \
+        int ret = 0;                                                                            \
+                                                                                                \
+        for(int r = rmin; r <= rmax; r++) {                                                     \
+        for(int c = cmin; c <= cmax; c++) {                                                     \
+                                                                                                \
+            const sg_cell(name) *cell = &sg->cells[r * sg->ncols + c];                          \
+            for(int i = 0; i < cell->size; i++) {                                               \
+                                                                                                \
+                const sg_rec(name) *rec = &cell->buf->recs[i];                                  \
+                if(rec->x < minx || rec->x > maxx || rec->y < miny || rec->y > maxy)            \
+                    continue;                                                                   \
+                if(ret == maxout)                                                               \
+                    return ret;                                                                 \
+                out[ret++] = rec->record;                                                       \
+            }                                                                                   \
+        }}                                                                                      \
+        return ret;                                                                             \
+    }                                                                                           \
+                                                                                                \
+    scope bool sg_##name##_copy(const sg(name) *from, sg(name) *to)                             \
+    {                                                                                           \
+        *to = *from;                                                                            \
+        const int ncells = from->ncols * from->nrows;                                           \
+        to->cells = malloc(ncells * sizeof(sg_cell(name)));                                     \
+        if(!to->cells)                                                                          \
+            return false;                                                                       \
+                                                                                                \
+        memcpy(to->cells, from->cells, ncells * sizeof(sg_cell(name)));                         \
+        for(int i = 0; i < ncells; i++) {                                                       \
+            if(to->cells[i].buf)                                                                \
+                to->cells[i].buf->refcount++;                                                   \
+        }                                                                                       \
+        return true;                                                                            \
+    }
+
+#endif
+
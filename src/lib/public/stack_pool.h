@@ -0,0 +1,86 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef STACK_POOL_H
+#define STACK_POOL_H
+
+#include "vec.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+
+VEC_TYPE(stack, void*)
+VEC_IMPL(static inline, stack, void*)
+
+/* A recycling pool of fixed-size stacks for fibers. Every stack is 
+ * mapped directly from the OS with an inaccessible guard page below 
+ * its' lowest address, so that an overflow faults immediately instead 
+ * of silently corrupting the adjacent memory. The pages are committed 
+ * lazily, on first touch. Stacks that are returned to the pool are 
+ * kept mapped for reuse, up to 'max_cached' of them. 
+ */
+struct stack_pool{
+    size_t      stack_size;
+    size_t      page_size;
+    size_t      max_cached;
+    size_t      max_resident;
+    vec_stack_t cached;
+    size_t      nlive;
+    size_t      high_water;
+    size_t      nmapped;
+};
+
+struct stack_pool_stats{
+    size_t stack_size;
+    size_t nlive;
+    size_t ncached;
+    size_t high_water;
+    size_t nmapped;
+};
+
+/* Once more than 'max_resident' stacks are cached, the physical pages of 
+ * any further stacks returned to the pool are handed back to the OS, while 
+ * the address range is kept mapped. 
+ */
+bool  stack_pool_init(struct stack_pool *pool, size_t stack_size, 
+                      size_t max_cached, size_t max_resident);
+void  stack_pool_destroy(struct stack_pool *pool);
+/* Returns the lowest usable address of the stack */
+void *stack_pool_alloc(struct stack_pool *pool);
+void  stack_pool_free(struct stack_pool *pool, void *stack);
+void  stack_pool_get_stats(const struct stack_pool *pool, struct stack_pool_stats *out);
+
+#endif
+
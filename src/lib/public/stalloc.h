@@ -73,6 +73,16 @@ bool  stalloc_init(struct memstack *st);
 void  stalloc_destroy(struct memstack *st);
 
 void *stalloc(struct memstack *st, size_t size);
+/* Grow an allocation made from the memstack. When 'ptr' is the most recent 
+ * allocation and there is still room in the current memblock, it is extended
+ * in place. Otherwise, a new allocation is made and the first 'old_size' bytes
+ * are copied to it. 
+ */
+void *stalloc_realloc(struct memstack *st, void *ptr, size_t old_size, size_t new_size);
+/* Give back the memory of an allocation if it is the most recent one. 
+ * Otherwise, this is a no-op and the memory is held until the next clear.
+ */
+void  stalloc_release(struct memstack *st, void *ptr, size_t size);
 void  stalloc_clear(struct memstack *st);
 
 /* The smemstack is just like the memstack, except that the first 'STATIC_BUFF_SZ' 
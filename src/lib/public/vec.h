@@ -43,8 +43,17 @@
 
 #include "../../perf.h"
 
+/* The capacity of a vector on its' first allocation and the factor 
+ * by which it grows when it is full, unless 'VEC_IMPL_GROWTH' is used.
+ */
+#define VEC_INIT_CAP        (256)
+#define VEC_GROWTH_FACTOR   (2)
+
 /***********************************************************************************************/
 
+/* 'buff' is the storage which the vector was initialized with, if any. It is not 
+ * owned by the vector and is left behind once the vector outgrows it.
+ */
 #define VEC_TYPE(name, type)                                                                    \
                                                                                                 \
     typedef struct vec_##name##_s {                                                             \
@@ -53,10 +62,26 @@
         type *array;                                                                            \
         void *(*vrealloc)(void *ptr, size_t size);                                              \
         void  (*vfree)(void *ptr);                                                              \
+        type *buff;                                                                             \
     } vec_##name##_t;
 
 /***********************************************************************************************/
 
+/* A vector with inline storage for its' first N elements, so that small 
+ * vectors never touch the allocator. The vector of a previously declared 
+ * VEC_TYPE(name, type) is the 'vec' member, which can be passed wherever 
+ * a 'vec(name)' is expected. As it points into itself, it must not be 
+ * copied by value.
+ */
+#define VEC_TYPE_SBO(name, type, N)                                                             \
+                                                                                                \
+    typedef struct vec_##name##_sbo_s {                                                         \
+        vec_##name##_t vec;                                                                     \
+        type buff[N];                                                                           \
+    } vec_##name##_sbo_t;
+
+/***********************************************************************************************/
+
 #define vec(name)                                                                               \
     vec_##name##_t
 
@@ -68,6 +93,9 @@
 #define vec_AT(vec, i)                                                                          \
     ((vec)->array[i])
 
+#define vec_sbo_init(name, sbo)                                                                 \
+    vec_##name##_init_buff(&(sbo)->vec, (sbo)->buff, sizeof((sbo)->buff) / sizeof((sbo)->buff[0]))
+
 /***********************************************************************************************/
 
 #define VEC_PROTOTYPES(scope, name, type)                                                       \
@@ -76,6 +104,7 @@
     scope void vec_##name##_init_alloc(vec(name) *vec,                                          \
                                        void *(*vrealloc)(void *ptr, size_t size),               \
                                        void (*vfree)(void *ptr));                               \
+    scope void vec_##name##_init_buff(vec(name) *vec, type *buff, size_t cap);                  \
     scope bool vec_##name##_resize  (vec(name) *vec, size_t new_cap);                           \
     scope void vec_##name##_destroy (vec(name) *vec);                                           \
     scope bool vec_##name##_push    (vec(name) *vec, type in);                                  \
@@ -90,6 +119,12 @@
 /***********************************************************************************************/
 
 #define VEC_IMPL(scope, name, type)                                                             \
+    VEC_IMPL_GROWTH(scope, name, type, VEC_INIT_CAP, VEC_GROWTH_FACTOR)
+
+/* Same as VEC_IMPL, but the vector starts out with room for 'init_cap' elements 
+ * and is grown by 'factor' (which may be fractional) whenever it is full.
+ */
+#define VEC_IMPL_GROWTH(scope, name, type, init_cap, factor)                                    \
                                                                                                 \
     scope void vec_##name##_init(vec(name) *vec)                                                \
     {                                                                                           \
@@ -98,6 +133,7 @@
         vec->array = NULL;                                                                      \
         vec->vrealloc = realloc;                                                                \
         vec->vfree = free;                                                                      \
+        vec->buff = NULL;                                                                       \
     }                                                                                           \
                                                                                                 \
     scope void vec_##name##_init_alloc(vec(name) *vec,                                          \
@@ -109,6 +145,17 @@
         vec->array = NULL;                                                                      \
         vec->vrealloc = vrealloc;                                                               \
         vec->vfree = vfree;                                                                     \
+        vec->buff = NULL;                                                                       \
+    }                                                                                           \
+                                                                                                \
+    scope void vec_##name##_init_buff(vec(name) *vec, type *buff, size_t cap)                   \
+    {                                                                                           \
+        vec->size = 0;                                                                          \
+        vec->capacity = cap;                                                                    \
+        vec->array = buff;                                                                      \
+        vec->vrealloc = realloc;                                                                \
+        vec->vfree = free;                                                                      \
+        vec->buff = buff;                                                                       \
     }                                                                                           \
                                                                                                 \
     scope bool vec_##name##_resize(vec(name) *vec, size_t new_cap)                              \
@@ -117,10 +164,15 @@
         if(vec->capacity >= new_cap)                                                            \
             PERF_RETURN(true);                                                                  \
                                                                                                 \
-        type *new_array = (type*)vec->vrealloc(vec->array, new_cap * sizeof(type));             \
+        bool inline_storage = vec->buff && (vec->array == vec->buff);                           \
+        type *new_array = (type*)vec->vrealloc(inline_storage ? NULL : vec->array,              \
+            new_cap * sizeof(type));                                                            \
         if(!new_array)                                                                          \
             PERF_RETURN(false);                                                                 \
                                                                                                 \
+        if(inline_storage) {                                                                    \
+            memcpy(new_array, vec->buff, vec->size * sizeof(type));                             \
+        }                                                                                       \
         vec->array = new_array;                                                                 \
         vec->capacity = new_cap;                                                                \
         PERF_RETURN(true);                                                                      \
@@ -128,14 +180,23 @@
                                                                                                 \
     scope void vec_##name##_destroy(vec(name) *vec)                                             \
     {                                                                                           \
-        vec->vfree(vec->array);                                                                 \
+        if(!vec->buff || (vec->array != vec->buff))                                             \
+            vec->vfree(vec->array);                                                             \
         memset(vec, 0, sizeof(*vec));                                                           \
     }                                                                                           \
                                                                                                 \
+    static inline size_t vec_##name##_next_cap(vec(name) *vec)                                  \
+    {                                                                                           \
+        if(vec->capacity == 0)                                                                  \
+            return (init_cap);                                                                  \
+        size_t ret = (size_t)(vec->capacity * (factor));                                        \
+        return (ret > vec->capacity) ? ret : vec->capacity + 1;                                 \
+    }                                                                                           \
+                                                                                                \
     scope bool vec_##name##_push(vec(name) *vec, type in)                                       \
     {                                                                                           \
         if(vec->size == vec->capacity                                                           \
-        && !vec_##name##_resize(vec, (vec->size == 0 ? 256 : vec->size * 2) * sizeof(type)))    \
+        && !vec_##name##_resize(vec, vec_##name##_next_cap(vec)))                               \
             return false;                                                                       \
                                                                                                 \
         vec->array[vec->size++] = in;                                                           \
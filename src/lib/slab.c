@@ -0,0 +1,593 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/slab.h"
+
+#include <SDL_atomic.h>
+#include <SDL_thread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#define SLAB_SZ             (64 * 1024)
+#define BATCH_BYTES         (8 * 1024)
+#define MIN_BATCH           (4)
+#define MAX_BATCH           (64)
+#define ALIGNED(val, align) (((val) + ((align) - 1)) & ~((align) - 1))
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define CLAMP(a, lo, hi)    (MAX(MIN((a), (hi)), (lo)))
+#define SLAB_CLASS(i)                                                               \
+    {                                                                               \
+        .block_size = (SLAB_MIN_SIZE << (i)),                                       \
+        .stride = sizeof(union block_hdr) + (SLAB_MIN_SIZE << (i)),                 \
+        .batch = CLAMP(BATCH_BYTES / (SLAB_MIN_SIZE << (i)), MIN_BATCH, MAX_BATCH)  \
+    }
+
+struct slab;
+
+/* Every block is prefixed with a header. Blocks which are forwarded 
+ * to 'malloc' have a NULL slab pointer. */
+union block_hdr{
+    struct{
+        struct slab *slab;
+        size_t       size;
+    }info;
+    intmax_t align;
+};
+
+/* A free block stores the link in its' payload */
+struct free_block{
+    struct free_block *next;
+};
+
+struct slab_class{
+    SDL_SpinLock  lock;
+    size_t        block_size;
+    size_t        stride;
+    size_t        batch;
+    struct slab  *partial; /* slabs with at least one free block */
+    size_t        nempty;
+    size_t        nslabs;
+    size_t        nout;    /* blocks taken out of the slabs (live or cached) */
+    size_t        high_water;
+    size_t        nallocs; /* allocations not accounted for by a live thread cache */
+};
+
+struct slab{
+    struct slab       *prev;
+    struct slab       *next;
+    struct slab_class *cls;
+    struct free_block *free;
+    size_t             nfree;
+    size_t             nblocks;
+    int                in_partial;
+};
+
+struct tcache{
+    struct tcache     *prev;
+    struct tcache     *next;
+    struct free_block *head[SLAB_NUM_CLASSES];
+    size_t             count[SLAB_NUM_CLASSES];
+    size_t             nallocs[SLAB_NUM_CLASSES];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct slab_class s_classes[SLAB_NUM_CLASSES] = {
+    SLAB_CLASS(0), SLAB_CLASS(1), SLAB_CLASS(2),
+    SLAB_CLASS(3), SLAB_CLASS(4), SLAB_CLASS(5),
+    SLAB_CLASS(6), SLAB_CLASS(7), SLAB_CLASS(8),
+};
+
+static SDL_atomic_t      s_tls_id;
+static SDL_SpinLock      s_tls_lock;
+
+/* All the live thread caches, so that they can be visited for statistics */
+static SDL_SpinLock      s_tcache_lock;
+static struct tcache    *s_tcaches;
+
+static SDL_SpinLock      s_large_lock;
+static size_t            s_large_live;
+static size_t            s_large_high_water;
+static size_t            s_large_allocs;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static int size_class(size_t size)
+{
+    for(int i = 0; i < SLAB_NUM_CLASSES; i++) {
+        if(size <= s_classes[i].block_size)
+            return i;
+    }
+    return -1;
+}
+
+static void partial_push(struct slab_class *cls, struct slab *slab)
+{
+    assert(!slab->in_partial);
+    slab->prev = NULL;
+    slab->next = cls->partial;
+    if(cls->partial) {
+        cls->partial->prev = slab;
+    }
+    cls->partial = slab;
+    slab->in_partial = 1;
+}
+
+static void partial_remove(struct slab_class *cls, struct slab *slab)
+{
+    assert(slab->in_partial);
+    if(slab->prev) {
+        slab->prev->next = slab->next;
+    }else{
+        cls->partial = slab->next;
+    }
+    if(slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = slab->next = NULL;
+    slab->in_partial = 0;
+}
+
+static struct slab *slab_create(struct slab_class *cls)
+{
+    struct slab *ret = malloc(SLAB_SZ);
+    if(!ret)
+        return NULL;
+
+    const size_t offset = ALIGNED(sizeof(struct slab), sizeof(union block_hdr));
+    unsigned char *base = ((unsigned char*)ret) + offset;
+
+    ret->prev = NULL;
+    ret->next = NULL;
+    ret->cls = cls;
+    ret->free = NULL;
+    ret->nblocks = (SLAB_SZ - offset) / cls->stride;
+    ret->nfree = ret->nblocks;
+    ret->in_partial = 0;
+
+    for(int i = ret->nblocks - 1; i >= 0; i--) {
+        union block_hdr *hdr = (union block_hdr*)(base + i * cls->stride);
+        hdr->info.slab = ret;
+        struct free_block *block = (struct free_block*)(hdr + 1);
+        block->next = ret->free;
+        ret->free = block;
+    }
+    return ret;
+}
+
+/* Take up to 'n' free blocks out of the slabs of the class and prepend 
+ * them to the 'inout' list. Returns the number of blocks taken.
+ */
+static size_t central_take(struct slab_class *cls, size_t n, struct free_block **inout)
+{
+    size_t ret = 0;
+    SDL_AtomicLock(&cls->lock);
+
+    while(ret < n) {
+
+        if(!cls->partial) {
+
+            SDL_AtomicUnlock(&cls->lock);
+            struct slab *slab = slab_create(cls);
+            SDL_AtomicLock(&cls->lock);
+
+            if(!slab)
+                break;
+            partial_push(cls, slab);
+            cls->nslabs++;
+            cls->nempty++;
+        }
+
+        struct slab *slab = cls->partial;
+        if(slab->nfree == slab->nblocks) {
+            assert(cls->nempty > 0);
+            cls->nempty--;
+        }
+
+        while(ret < n && slab->free) {
+            struct free_block *block = slab->free;
+            slab->free = block->next;
+            slab->nfree--;
+            block->next = *inout;
+            *inout = block;
+            ret++;
+        }
+
+        if(!slab->free) {
+            partial_remove(cls, slab);
+        }
+    }
+
+    cls->nout += ret;
+    cls->high_water = MAX(cls->high_water, cls->nout);
+    SDL_AtomicUnlock(&cls->lock);
+    return ret;
+}
+
+/* Return a list of blocks to their' slabs. All but one of the slabs that 
+ * become completely free are released. 
+ */
+static void central_give(struct slab_class *cls, struct free_block *list)
+{
+    struct slab *torelease = NULL;
+    SDL_AtomicLock(&cls->lock);
+
+    while(list) {
+
+        struct free_block *next = list->next;
+        union block_hdr *hdr = ((union block_hdr*)list) - 1;
+        struct slab *slab = hdr->info.slab;
+        assert(slab->cls == cls);
+
+        list->next = slab->free;
+        slab->free = list;
+        slab->nfree++;
+        assert(cls->nout > 0);
+        cls->nout--;
+
+        if(!slab->in_partial) {
+            partial_push(cls, slab);
+        }
+
+        if(slab->nfree == slab->nblocks) {
+            if(cls->nempty > 0) {
+                partial_remove(cls, slab);
+                cls->nslabs--;
+                slab->next = torelease;
+                torelease = slab;
+            }else{
+                cls->nempty++;
+            }
+        }
+        list = next;
+    }
+
+    SDL_AtomicUnlock(&cls->lock);
+
+    while(torelease) {
+        struct slab *next = torelease->next;
+        free(torelease);
+        torelease = next;
+    }
+}
+
+static void tcache_flush_class(struct tcache *tc, int idx, size_t keep)
+{
+    struct free_block *list = NULL;
+    while(tc->count[idx] > keep) {
+        struct free_block *block = tc->head[idx];
+        tc->head[idx] = block->next;
+        block->next = list;
+        list = block;
+        tc->count[idx]--;
+    }
+    if(list) {
+        central_give(&s_classes[idx], list);
+    }
+}
+
+static void tcache_flush(struct tcache *tc)
+{
+    for(int i = 0; i < SLAB_NUM_CLASSES; i++) {
+        tcache_flush_class(tc, i, 0);
+    }
+}
+
+static void tcache_destroy(void *arg)
+{
+    struct tcache *tc = arg;
+    tcache_flush(tc);
+
+    SDL_AtomicLock(&s_tcache_lock);
+    if(tc->prev) {
+        tc->prev->next = tc->next;
+    }else{
+        s_tcaches = tc->next;
+    }
+    if(tc->next) {
+        tc->next->prev = tc->prev;
+    }
+    SDL_AtomicUnlock(&s_tcache_lock);
+
+    /* Keep the counts of the thread around */
+    for(int i = 0; i < SLAB_NUM_CLASSES; i++) {
+        SDL_AtomicLock(&s_classes[i].lock);
+        s_classes[i].nallocs += tc->nallocs[i];
+        SDL_AtomicUnlock(&s_classes[i].lock);
+    }
+    free(tc);
+}
+
+static SDL_TLSID tls_id(void)
+{
+    SDL_TLSID ret = SDL_AtomicGet(&s_tls_id);
+    if(ret)
+        return ret;
+
+    SDL_AtomicLock(&s_tls_lock);
+    ret = SDL_AtomicGet(&s_tls_id);
+    if(!ret) {
+        ret = SDL_TLSCreate();
+        SDL_AtomicSet(&s_tls_id, ret);
+    }
+    SDL_AtomicUnlock(&s_tls_lock);
+    return ret;
+}
+
+static struct tcache *tcache_get(void)
+{
+    SDL_TLSID id = tls_id();
+    if(!id)
+        return NULL;
+
+    struct tcache *ret = SDL_TLSGet(id);
+    if(ret)
+        return ret;
+
+    ret = calloc(1, sizeof(struct tcache));
+    if(!ret)
+        return NULL;
+
+    if(0 != SDL_TLSSet(id, ret, tcache_destroy)) {
+        free(ret);
+        return NULL;
+    }
+
+    SDL_AtomicLock(&s_tcache_lock);
+    ret->next = s_tcaches;
+    if(s_tcaches) {
+        s_tcaches->prev = ret;
+    }
+    s_tcaches = ret;
+    SDL_AtomicUnlock(&s_tcache_lock);
+    return ret;
+}
+
+static struct free_block *block_alloc(int idx)
+{
+    struct slab_class *cls = &s_classes[idx];
+    struct tcache *tc = tcache_get();
+    struct free_block *ret = NULL;
+
+    if(!tc) {
+        if(!central_take(cls, 1, &ret))
+            return NULL;
+        SDL_AtomicLock(&cls->lock);
+        cls->nallocs++;
+        SDL_AtomicUnlock(&cls->lock);
+        return ret;
+    }
+
+    if(!tc->head[idx]) {
+        tc->count[idx] += central_take(cls, cls->batch, &tc->head[idx]);
+        if(!tc->head[idx])
+            return NULL;
+    }
+
+    ret = tc->head[idx];
+    tc->head[idx] = ret->next;
+    tc->count[idx]--;
+    tc->nallocs[idx]++;
+    return ret;
+}
+
+static void block_free(int idx, struct free_block *block)
+{
+    struct slab_class *cls = &s_classes[idx];
+    struct tcache *tc = tcache_get();
+
+    if(!tc) {
+        block->next = NULL;
+        central_give(cls, block);
+        return;
+    }
+
+    block->next = tc->head[idx];
+    tc->head[idx] = block;
+    tc->count[idx]++;
+
+    if(tc->count[idx] > cls->batch * 2) {
+        tcache_flush_class(tc, idx, cls->batch);
+    }
+}
+
+static void *large_alloc(size_t size)
+{
+    union block_hdr *hdr = malloc(sizeof(union block_hdr) + size);
+    if(!hdr)
+        return NULL;
+
+    hdr->info.slab = NULL;
+    hdr->info.size = size;
+
+    SDL_AtomicLock(&s_large_lock);
+    s_large_live++;
+    s_large_allocs++;
+    s_large_high_water = MAX(s_large_high_water, s_large_live);
+    SDL_AtomicUnlock(&s_large_lock);
+    return hdr + 1;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void *slab_malloc(size_t size)
+{
+    int idx = size_class(size);
+    if(idx < 0)
+        return large_alloc(size);
+
+    struct free_block *block = block_alloc(idx);
+    if(!block)
+        return NULL;
+
+    union block_hdr *hdr = ((union block_hdr*)block) - 1;
+    hdr->info.size = size;
+    return block;
+}
+
+void *slab_calloc(size_t num, size_t size)
+{
+    if(size && num > SIZE_MAX / size)
+        return NULL;
+
+    void *ret = slab_malloc(num * size);
+    if(!ret)
+        return NULL;
+    memset(ret, 0, num * size);
+    return ret;
+}
+
+void *slab_realloc(void *ptr, size_t size)
+{
+    if(!ptr)
+        return slab_malloc(size);
+
+    union block_hdr *hdr = ((union block_hdr*)ptr) - 1;
+    struct slab *slab = hdr->info.slab;
+    int idx = size_class(size);
+
+    if(slab && size <= slab->cls->block_size) {
+        hdr->info.size = size;
+        return ptr;
+    }
+
+    if(!slab && idx < 0) {
+        union block_hdr *newhdr = realloc(hdr, sizeof(union block_hdr) + size);
+        if(!newhdr)
+            return NULL;
+        newhdr->info.size = size;
+        return newhdr + 1;
+    }
+
+    void *ret = slab_malloc(size);
+    if(!ret)
+        return NULL;
+    memcpy(ret, ptr, MIN(hdr->info.size, size));
+    slab_free(ptr);
+    return ret;
+}
+
+void slab_free(void *ptr)
+{
+    if(!ptr)
+        return;
+
+    union block_hdr *hdr = ((union block_hdr*)ptr) - 1;
+    struct slab *slab = hdr->info.slab;
+
+    if(!slab) {
+        SDL_AtomicLock(&s_large_lock);
+        assert(s_large_live > 0);
+        s_large_live--;
+        SDL_AtomicUnlock(&s_large_lock);
+        free(hdr);
+        return;
+    }
+
+    int idx = slab->cls - s_classes;
+    block_free(idx, ptr);
+}
+
+void slab_flush_thread(void)
+{
+    SDL_TLSID id = tls_id();
+    if(!id)
+        return;
+
+    struct tcache *tc = SDL_TLSGet(id);
+    if(!tc)
+        return;
+
+    tcache_flush(tc);
+}
+
+size_t slab_get_stats(size_t maxout, struct slab_stats *out)
+{
+    size_t ret = 0;
+
+    for(int i = 0; i < SLAB_NUM_CLASSES && ret < maxout; i++, ret++) {
+
+        struct slab_class *cls = &s_classes[i];
+        SDL_AtomicLock(&cls->lock);
+        out[ret] = (struct slab_stats){
+            .block_size = cls->block_size,
+            .nslabs = cls->nslabs,
+            .nlive = cls->nout,
+            .ncached = 0,
+            .high_water = cls->high_water,
+            .nallocs = cls->nallocs
+        };
+        SDL_AtomicUnlock(&cls->lock);
+    }
+
+    /* The counts of the thread caches are read without synchronizing with 
+     * their' owners, so these are only approximate. */
+    SDL_AtomicLock(&s_tcache_lock);
+    for(struct tcache *tc = s_tcaches; tc; tc = tc->next) {
+        for(int i = 0; i < ret; i++) {
+            out[i].ncached += tc->count[i];
+            out[i].nallocs += tc->nallocs[i];
+        }
+    }
+    SDL_AtomicUnlock(&s_tcache_lock);
+
+    for(int i = 0; i < ret; i++) {
+        out[i].nlive -= MIN(out[i].nlive, out[i].ncached);
+    }
+
+    if(ret < maxout) {
+        SDL_AtomicLock(&s_large_lock);
+        out[ret++] = (struct slab_stats){
+            .block_size = 0,
+            .nslabs = 0,
+            .nlive = s_large_live,
+            .ncached = 0,
+            .high_water = s_large_high_water,
+            .nallocs = s_large_allocs
+        };
+        SDL_AtomicUnlock(&s_large_lock);
+    }
+    return ret;
+}
+
@@ -0,0 +1,185 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/stack_pool.h"
+
+#include <assert.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+#define ALIGNED(val, align) (((val) + ((align) - 1)) & ~((align) - 1))
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static size_t page_size(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static void *stack_map(size_t stack_size, size_t guard_size)
+{
+    size_t total = stack_size + guard_size;
+#if defined(_WIN32)
+    char *base = VirtualAlloc(NULL, total, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if(!base)
+        return NULL;
+    DWORD old;
+    if(!VirtualProtect(base, guard_size, PAGE_NOACCESS, &old)) {
+        VirtualFree(base, 0, MEM_RELEASE);
+        return NULL;
+    }
+#else
+    char *base = mmap(NULL, total, PROT_READ | PROT_WRITE, 
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(base == MAP_FAILED)
+        return NULL;
+    if(0 != mprotect(base, guard_size, PROT_NONE)) {
+        munmap(base, total);
+        return NULL;
+    }
+#endif
+    return base + guard_size;
+}
+
+static void stack_unmap(void *stack, size_t stack_size, size_t guard_size)
+{
+    char *base = ((char*)stack) - guard_size;
+#if defined(_WIN32)
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, stack_size + guard_size);
+#endif
+}
+
+static void stack_decommit(void *stack, size_t stack_size)
+{
+#if defined(_WIN32)
+    VirtualAlloc(stack, stack_size, MEM_RESET, PAGE_READWRITE);
+#else
+    madvise(stack, stack_size, MADV_DONTNEED);
+#endif
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool stack_pool_init(struct stack_pool *pool, size_t stack_size, 
+                     size_t max_cached, size_t max_resident)
+{
+    pool->page_size = page_size();
+    pool->stack_size = ALIGNED(stack_size, pool->page_size);
+    pool->max_cached = max_cached;
+    pool->max_resident = max_resident;
+    pool->nlive = 0;
+    pool->high_water = 0;
+    pool->nmapped = 0;
+
+    vec_stack_init(&pool->cached);
+    if(!vec_stack_resize(&pool->cached, max_cached))
+        return false;
+    return true;
+}
+
+void stack_pool_destroy(struct stack_pool *pool)
+{
+    for(int i = 0; i < vec_size(&pool->cached); i++) {
+        stack_unmap(vec_AT(&pool->cached, i), pool->stack_size, pool->page_size);
+    }
+    vec_stack_destroy(&pool->cached);
+}
+
+void *stack_pool_alloc(struct stack_pool *pool)
+{
+    void *ret;
+    if(vec_size(&pool->cached) > 0) {
+        ret = vec_stack_pop(&pool->cached);
+    }else{
+        ret = stack_map(pool->stack_size, pool->page_size);
+        if(!ret)
+            return NULL;
+        pool->nmapped++;
+    }
+
+    pool->nlive++;
+    if(pool->nlive > pool->high_water) {
+        pool->high_water = pool->nlive;
+    }
+    return ret;
+}
+
+void stack_pool_free(struct stack_pool *pool, void *stack)
+{
+    assert(pool->nlive > 0);
+    pool->nlive--;
+
+    if(vec_size(&pool->cached) < pool->max_cached) {
+        if(vec_size(&pool->cached) >= pool->max_resident) {
+            stack_decommit(stack, pool->stack_size);
+        }
+        vec_stack_push(&pool->cached, stack);
+        return;
+    }
+
+    stack_unmap(stack, pool->stack_size, pool->page_size);
+    pool->nmapped--;
+}
+
+void stack_pool_get_stats(const struct stack_pool *pool, struct stack_pool_stats *out)
+{
+    out->stack_size = pool->stack_size;
+    out->nlive = pool->nlive;
+    out->ncached = vec_size(&pool->cached);
+    out->high_water = pool->high_water;
+    out->nmapped = pool->nmapped;
+}
+
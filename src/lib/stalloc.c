@@ -105,6 +105,46 @@ void *stalloc(struct memstack *st, size_t size)
     return ret;
 }
 
+void *stalloc_realloc(struct memstack *st, void *ptr, size_t old_size, size_t new_size)
+{
+    if(!ptr)
+        return stalloc(st, new_size);
+
+    const size_t old_aligned = (old_size + (sizeof(intmax_t) - 1)) & ~(sizeof(intmax_t) - 1);
+    const size_t new_aligned = (new_size + (sizeof(intmax_t) - 1)) & ~(sizeof(intmax_t) - 1);
+
+    unsigned char *begin = st->tail->raw;
+    unsigned char *end = st->tail->raw + MEMBLOCK_SZ;
+    unsigned char *curr = ptr;
+
+    if(curr >= begin && curr < end
+    && curr + old_aligned == st->top
+    && end - curr >= new_aligned) {
+
+        memset(curr + new_size, 0, new_aligned - new_size);
+        st->top = curr + new_aligned;
+        return ptr;
+    }
+
+    void *ret = stalloc(st, new_size);
+    if(!ret)
+        return NULL;
+    memcpy(ret, ptr, old_size < new_size ? old_size : new_size);
+    return ret;
+}
+
+void stalloc_release(struct memstack *st, void *ptr, size_t size)
+{
+    const size_t aligned_size = (size + (sizeof(intmax_t) - 1)) & ~(sizeof(intmax_t) - 1);
+    unsigned char *begin = st->tail->raw;
+    unsigned char *end = st->tail->raw + MEMBLOCK_SZ;
+    unsigned char *curr = ptr;
+
+    if(curr >= begin && curr < end && curr + aligned_size == st->top) {
+        st->top = curr;
+    }
+}
+
 void stalloc_clear(struct memstack *st)
 {
     /* Don't free the very first memblock */
@@ -55,6 +55,7 @@
 #include "session.h"
 #include "perf.h"
 #include "sched.h"
+#include "replay.h"
 
 #include <stdbool.h>
 #include <assert.h>
@@ -71,6 +72,9 @@
 #define PF_VER_MINOR 0
 #define PF_VER_PATCH 0
 
+#define DEFAULT_PERF_CAPTURE_FRAMES (300)
+#define DEFAULT_PERF_SPIKE_FACTOR   (2.0f)
+
 /* In the WAITING state the engine only pumps events and re-draws the window,
  * giving all the remaining cycles to the scheduler. The purpose of this state 
  * is to allow the engine to remain responsive (i.e. the latency of handling 
@@ -114,26 +118,79 @@ static vec_event_t               s_prev_tick_events;
 
 static SDL_Thread               *s_render_thread;
 static struct render_sync_state  s_rstate;
+/* How many frames the simulation may run ahead of the render thread. The 
+ * requested value is applied at the start of the next frame. */
+static int                       s_frame_latency = 1;
+static int                       s_frame_latency_req = 1;
 
 static int                       s_argc;
 static char                    **s_argv;
+/* Run the simulation without a GL context, audio output or UI drawing. When 
+ * fast-forwarding, every frame advances the simulation by one 60Hz tick 
+ * instead of waiting for the timer, so it runs as fast as the CPU allows. 
+ */
+static bool                      s_dedicated = false;
+static bool                      s_fast_forward = false;
+/* Whether the last recorded frame was rendered. When running above 1x speed, 
+ * the frames in between the displayed ones only advance the simulation. 
+ */
+static bool                      s_frame_presented = true;
+/* The replay to play back once the startup script has run. The engine 
+ * quits when the playback of such a replay finishes. 
+ */
+static char                      s_replay_path[512];
+static bool                      s_quit_after_replay = false;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+/* During the playback of a replay, the input comes from the recording. 
+ * The window events are still handled, so that the window stays responsive.
+ */
+static bool next_event(SDL_Event *out, bool playback)
+{
+    if(!playback)
+        return SDL_PollEvent(out);
+
+    while(SDL_PollEvent(out)) {
+        if(out->type == SDL_QUIT || out->type == SDL_WINDOWEVENT)
+            return true;
+    }
+    if(!Replay_NextEvent(out))
+        return false;
+
+    /* Make direct queries of the mouse state see the recorded position */
+    if(out->type == SDL_MOUSEMOTION) {
+        SDL_WarpMouseInWindow(s_window, out->motion.x, out->motion.y);
+    }
+    return true;
+}
+
 static void process_sdl_events(void)
 {
     PERF_ENTER();
-    UI_InputBegin();
+    /* Keep accumulating input until the UI gets to consume it */
+    if(s_frame_presented) {
+        UI_InputBegin();
+    }
+
+    bool running = (s_state != ENGINE_STATE_WAITING);
+    if(running && !Replay_BeginFrame() && s_quit_after_replay) {
+        s_quit = true;
+    }
+    bool playback = running && Replay_Playing();
 
     vec_event_reset(&s_prev_tick_events);
     SDL_Event event;    
    
-    while(SDL_PollEvent(&event)) {
+    while(next_event(&event, playback)) {
 
         UI_HandleEvent(&event);
         vec_event_push(&s_prev_tick_events, event);
+        if(running) {
+            Replay_RecordEvent(&event);
+        }
 
         switch(event.type) {
 
@@ -144,13 +201,22 @@ static void process_sdl_events(void)
             break;
 
         case SDL_USEREVENT:
-            if(event.user.code == 0) {
-                E_Global_Notify(EVENT_60HZ_TICK, NULL, ES_ENGINE); 
+            if(event.user.code == 0 && !s_fast_forward) {
+                G_Timer_Tick();
             }
             break;
         default: 
             break;
         }
+
+        /* Anything but the timer may change what's on the screen */
+        if(event.type != SDL_USEREVENT) {
+            G_Timer_MarkDirty();
+        }
+    }
+
+    if(s_fast_forward) {
+        E_Global_Notify(EVENT_60HZ_TICK, NULL, ES_ENGINE); 
     }
 
     if(s_state != ENGINE_STATE_WAITING) {
@@ -171,7 +237,8 @@ static void on_user_quit(void *user, void *event)
 
 static bool rstate_init(struct render_sync_state *rstate)
 {
-    rstate->start = false;
+    rstate->nsubmitted = 0;
+    rstate->quit = false;
 
     rstate->sq_lock = SDL_CreateMutex();
     if(!rstate->sq_lock)
@@ -181,7 +248,7 @@ static bool rstate_init(struct render_sync_state *rstate)
     if(!rstate->sq_cond)
         goto fail_sq_cond;
 
-    rstate->done = false;
+    rstate->ncompleted = 0;
 
     rstate->done_lock = SDL_CreateMutex();
     if(!rstate->done_lock)
@@ -224,31 +291,39 @@ static int render_thread_quit(void)
     return ret;
 }
 
+/* Hand over the render workspace to the render thread */
 static void render_thread_start_work(void)
 {
-    SDL_LockMutex(s_rstate.done_lock);
-    s_rstate.done = false;
-    SDL_UnlockMutex(s_rstate.done_lock);
-
     SDL_LockMutex(s_rstate.sq_lock);
-    s_rstate.start = true;
+    assert(s_rstate.nsubmitted - s_rstate.ncompleted < RENDER_MAX_QUEUED_WS);
+    s_rstate.queued[s_rstate.nsubmitted % RENDER_MAX_QUEUED_WS] = G_GetRenderWS();
+    s_rstate.nsubmitted++;
     SDL_CondSignal(s_rstate.sq_cond);
     SDL_UnlockMutex(s_rstate.sq_lock);
 }
 
-void render_thread_wait_done(void)
+/* Wait until at most 'max_pending' of the workspaces handed over to the 
+ * render thread have not been fully processed. */
+static void render_thread_wait(uint64_t max_pending)
 {
     PERF_ENTER();
 
+    /* Only the main thread writes 'nsubmitted' */
+    uint64_t target = (s_rstate.nsubmitted > max_pending) ? s_rstate.nsubmitted - max_pending : 0;
+
     SDL_LockMutex(s_rstate.done_lock);
-    while(!s_rstate.done)
+    while(s_rstate.ncompleted < target)
         SDL_CondWait(s_rstate.done_cond, s_rstate.done_lock);
-    s_rstate.done = false;
     SDL_UnlockMutex(s_rstate.done_lock);
 
     PERF_RETURN_VOID();
 }
 
+void render_thread_wait_done(void)
+{
+    render_thread_wait(0);
+}
+
 static void render_maybe_enable(void)
 {
     /* Simulate a single frame after a session change without rendering 
@@ -256,7 +331,7 @@ static void render_maybe_enable(void)
      * noticing. */
     if(((uint64_t)g_frame_idx) - Session_ChangeTick() <= 1)
         return;
-    s_rstate.swap_buffers = true;
+    s_rstate.swap_buffers = s_frame_presented;
 }
 
 static void fs_on_key_press(void *user, void *event)
@@ -282,6 +357,30 @@ static void frame_step_commit(const struct sval *new_val)
     }
 }
 
+static bool frame_latency_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    return (new_val->as_int >= 1 && new_val->as_int <= CONFIG_MAX_FRAME_LATENCY);
+}
+
+static void frame_latency_commit(const struct sval *new_val)
+{
+    s_frame_latency_req = new_val->as_int;
+}
+
+static bool idle_latency_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    return (new_val->as_int >= 0 && new_val->as_int <= CONFIG_IDLE_MAX_LATENCY_MAX_MS);
+}
+
+static void idle_latency_commit(const struct sval *new_val)
+{
+    G_Timer_SetIdleMaxLatency(new_val->as_int);
+}
+
 static void engine_create_settings(void)
 {
     ss_e status = Settings_Create((struct setting){
@@ -295,6 +394,36 @@ static void engine_create_settings(void)
         .commit = frame_step_commit,
     });
     assert(status == SS_OKAY);
+
+    /* Letting the simulation run further ahead keeps spikes in render time 
+     * from stalling it, at the cost of displaying input one frame later. */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.frame_latency",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 1
+        },
+        .prio = 0,
+        .validate = frame_latency_validate,
+        .commit = frame_latency_commit,
+    });
+    assert(status == SS_OKAY);
+
+    /* Frames on which nothing visible changed (i.e. in menus or while 
+     * paused) are not rendered, but at least one is rendered every this 
+     * many milliseconds. Zero renders every frame. */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.idle_max_latency",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = CONFIG_IDLE_MAX_LATENCY_MS
+        },
+        .prio = 0,
+        .validate = idle_latency_validate,
+        .commit = idle_latency_commit,
+    });
+    assert(status == SS_OKAY);
+    (void)status;
 }
 
 static SDL_Surface *engine_create_loading_screen(void)
@@ -360,6 +489,71 @@ fail_surface:
     free(image);
 }
 
+static void engine_maybe_begin_capture(void)
+{
+    char path[512];
+    if(!Engine_GetArg("perf_capture", sizeof(path), path))
+        return;
+
+    char frames[16];
+    int nframes = DEFAULT_PERF_CAPTURE_FRAMES;
+    if(Engine_GetArg("perf_capture_frames", sizeof(frames), frames)) {
+        nframes = strtol(frames, NULL, 10);
+    }
+
+    if(!Perf_CaptureBegin(path, nframes)) {
+        fprintf(stderr, "Failed to begin performance capture to file: %s\n", path);
+    }
+}
+
+static void engine_maybe_enable_spike_capture(void)
+{
+    char prefix[512];
+    if(!Engine_GetArg("perf_spike_capture", sizeof(prefix), prefix))
+        return;
+
+    char factor[16];
+    float spike_factor = DEFAULT_PERF_SPIKE_FACTOR;
+    if(Engine_GetArg("perf_spike_factor", sizeof(factor), factor)) {
+        spike_factor = strtof(factor, NULL);
+    }
+    if(spike_factor <= 1.0f) {
+        fprintf(stderr, "Invalid performance spike factor: %s\n", factor);
+        return;
+    }
+    Perf_SpikeCaptureEnable(prefix, spike_factor);
+}
+
+static void engine_maybe_queue_replay(void)
+{
+    if(!Engine_GetArg("replay", sizeof(s_replay_path), s_replay_path))
+        return;
+    s_quit_after_replay = true;
+}
+
+/* Called when the startup script or a session request completes */
+static void engine_on_request_done(void)
+{
+    const struct result *res = &s_request_done.res;
+    Replay_OnSessionChange(res->type != RESULT_BOOL || res->val.as_bool);
+    G_Timer_MarkDirty();
+
+    if(s_replay_path[0]) {
+        if(!Replay_BeginPlayback(s_replay_path)) {
+            fprintf(stderr, "Failed to begin playback of replay: %s\n", s_replay_path);
+            s_quit = true;
+        }
+        s_replay_path[0] = '\0';
+    }
+}
+
+static bool engine_flag_arg(const char *name)
+{
+    char val[8] = "0";
+    Engine_GetArg(name, sizeof(val), val);
+    return (0 == strcmp(val, "1"));
+}
+
 static bool engine_init(void)
 {
     g_main_thread_id = SDL_ThreadID();
@@ -386,7 +580,15 @@ static bool engine_init(void)
             Settings_GetFile(), status);
     }
 
-    if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) < 0) {
+    /* The dummy video driver still provides windows, display modes and 
+     * cursors, but requires no display. */
+    Uint32 subsystems = SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER;
+    if(s_dedicated) {
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+        subsystems = SDL_INIT_VIDEO | SDL_INIT_TIMER;
+    }
+
+    if(SDL_Init(subsystems) < 0) {
         fprintf(stderr, "Failed to initialize SDL: %s\n", SDL_GetError());
         goto fail_sdl;
     }
@@ -414,13 +616,20 @@ static bool engine_init(void)
 
     char appname[64] = "Permafrost Engine";
     Engine_GetArg("appname", sizeof(appname), appname);
+
+    /* Headless runs (i.e. benchmarks) still render to a GL
+     * context, but never show the window. */
+    bool headless = engine_flag_arg("headless") || s_dedicated;
+    Uint32 visibility = headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN;
+    Uint32 gl_flag = s_dedicated ? 0 : SDL_WINDOW_OPENGL;
+
     s_window = SDL_CreateWindow(
         appname,
         SDL_WINDOWPOS_UNDEFINED, 
         SDL_WINDOWPOS_UNDEFINED,
         res[0], 
         res[1], 
-        SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | wf | extra_flags);
+        gl_flag | visibility | wf | extra_flags);
 
     s_loading_screen = engine_create_loading_screen();
     engine_set_icon();
@@ -437,6 +646,7 @@ static bool engine_init(void)
         .in_window = s_window,
         .in_width = res[0],
         .in_height = res[1],
+        .in_dedicated = s_dedicated,
     };
 
     s_rstate.arg = &rarg;
@@ -520,7 +730,7 @@ static bool engine_init(void)
         goto fail_nav;
     }
 
-    if(!Audio_Init()) {
+    if(!Audio_Init(s_dedicated)) {
         fprintf(stderr, "Failed to intialize audio subsystem\n");
         goto fail_audio;
     }
@@ -581,6 +791,7 @@ fail_resize:
 
 static void engine_shutdown(void)
 {
+    Replay_Shutdown();
     P_Projectile_Shutdown();
     Audio_Shutdown();
     S_Shutdown();
@@ -634,6 +845,9 @@ void Engine_LoadingScreen(void)
     ASSERT_IN_MAIN_THREAD();
     assert(s_window);
 
+    if(s_dedicated)
+        return;
+
     /* Make sure the render therad doesn't overwrite the screen... */
     if(g_render_thread_id) {
         Engine_WaitRenderWorkDone();
@@ -719,13 +933,8 @@ void Engine_WaitRenderWorkDone(void)
         PERF_RETURN_VOID();
     }
 
-    /* Wait for the render thread to finish, but don't yet clear/ack the 'done' flag */
-    SDL_LockMutex(s_rstate.done_lock);
-    while(!s_rstate.done) {
-        SDL_CondWait(s_rstate.done_cond, s_rstate.done_lock);
-    }
-    SDL_UnlockMutex(s_rstate.done_lock);
-
+    /* Wait for the render thread to finish all the handed over workspaces */
+    render_thread_wait(0);
     PERF_RETURN_VOID();
 }
 
@@ -735,6 +944,11 @@ void Engine_ClearPendingEvents(void)
     E_ClearPendingEvents();
 }
 
+bool Engine_IsDedicated(void)
+{
+    return s_dedicated;
+}
+
 bool Engine_GetArg(const char *name, size_t maxout, char out[])
 {
     size_t namelen = strlen(name);
@@ -777,6 +991,8 @@ int main(int argc, char **argv)
     g_basepath = argv[1];
     s_argc = argc;
     s_argv = argv;
+    s_dedicated = engine_flag_arg("dedicated");
+    s_fast_forward = engine_flag_arg("fast_forward");
 
     if(!engine_init()) {
         ret = EXIT_FAILURE; 
@@ -790,14 +1006,23 @@ int main(int argc, char **argv)
     /* Run the first frame of the simulation, and prepare the buffers for rendering. */
     E_ServiceQueue();
     G_Update();
-    G_Render();
+    if(!s_dedicated) {
+        G_Render();
+    }
     G_SwapBuffers();
     Perf_FinishTick();
     SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+    engine_maybe_begin_capture();
+    engine_maybe_enable_spike_capture();
+    engine_maybe_queue_replay();
 
     while(!s_quit) {
 
         Perf_BeginTick();
+        if(s_frame_latency != s_frame_latency_req) {
+            G_SetFrameLatency(s_frame_latency_req);
+            s_frame_latency = s_frame_latency_req;
+        }
         enum simstate curr_ss = G_GetSimState();
         bool prev_step_frame = s_step_frame;
 
@@ -817,6 +1042,7 @@ int main(int argc, char **argv)
         render_thread_start_work();
         Sched_StartBackgroundTasks();
         process_sdl_events();
+        bool present = G_Timer_BeginFrame();
 
         bool request = Session_ServiceRequests(&s_request_done);
         if(request) {
@@ -828,9 +1054,15 @@ int main(int argc, char **argv)
 
             E_ServiceQueue();
             G_Update();
-            G_Render();
+            if(present && !s_dedicated) {
+                G_Render();
+            }
+            s_frame_presented = present;
             Sched_Tick();
-            render_thread_wait_done();
+            S_GC_CollectIdle();
+            /* The render thread may keep working on the older frames 
+             * while we simulate the next one. */
+            render_thread_wait(s_frame_latency - 1);
             G_SwapBuffers();
 
             break;
@@ -839,10 +1071,13 @@ int main(int argc, char **argv)
 
             Sched_Tick();
             if(Sched_FutureIsReady(&s_request_done)) {
+                S_GC_CollectFull();
                 SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
                 s_state = ENGINE_STATE_RUNNING;
+                engine_on_request_done();
             }
             render_thread_wait_done();
+            s_frame_presented = true;
             break;
 
         default: assert(0); break;
@@ -850,6 +1085,13 @@ int main(int argc, char **argv)
 
         Perf_FinishTick();
 
+        /* Nothing is presented, so there is no vsync to pace a dedicated 
+         * simulation or the idle frames. Sleep until the next event instead. */
+        bool idle = (s_state == ENGINE_STATE_RUNNING) && G_Timer_FrameIdle();
+        if((s_dedicated || idle) && !s_fast_forward) {
+            SDL_WaitEventTimeout(NULL, 1000 / 60);
+        }
+
         if(prev_step_frame) {
             G_SetSimState(curr_ss);
             s_step_frame = false;
@@ -80,6 +80,9 @@ void Engine_FlushRenderWorkQueue(void);
 void Engine_WaitRenderWorkDone(void);
 void Engine_ClearPendingEvents(void);
 bool Engine_GetArg(const char *name, size_t maxout, char out[]);
+/* True when running as a dedicated simulation ('--dedicated=1'), with 
+ * no GL context, no audio output and no UI drawing. */
+bool Engine_IsDedicated(void);
 
 #endif
 
@@ -0,0 +1,189 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "map_private.h"
+#include "public/map.h"
+#include "public/tile.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define CLAMP(a, min, max)  (MIN(MAX((a), (min)), (max)))
+
+/* How the top face of a tile is interpolated between its' corners. Corner 
+ * tiles are made up of two triangles which share one of the diagonals.
+ */
+enum hf_split{
+    HF_BILINEAR,
+    HF_SPLIT_NW_SE,
+    HF_SPLIT_NE_SW,
+};
+
+struct hf_cell{
+    /* Worldspace heights of the tile's top face corners */
+    float   nw, ne, sw, se;
+    uint8_t split;
+};
+
+struct heightfield{
+    /* Dimensions in tiles */
+    size_t         nrows, ncols;
+    struct hf_cell cells[];
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static struct hf_cell hf_cell_for_tile(const struct tile *tile)
+{
+    struct hf_cell ret = (struct hf_cell){
+        .nw = M_Tile_NWHeight(tile) * Y_COORDS_PER_TILE,
+        .ne = M_Tile_NEHeight(tile) * Y_COORDS_PER_TILE,
+        .sw = M_Tile_SWHeight(tile) * Y_COORDS_PER_TILE,
+        .se = M_Tile_SEHeight(tile) * Y_COORDS_PER_TILE,
+        .split = HF_BILINEAR
+    };
+
+    switch(tile->type) {
+    case TILETYPE_CORNER_CONVEX_NE:
+    case TILETYPE_CORNER_CONCAVE_NE:
+    case TILETYPE_CORNER_CONVEX_SW:
+    case TILETYPE_CORNER_CONCAVE_SW: 
+        ret.split = HF_SPLIT_NW_SE;
+        break;
+    case TILETYPE_CORNER_CONVEX_NW:
+    case TILETYPE_CORNER_CONCAVE_NW:
+    case TILETYPE_CORNER_CONVEX_SE:
+    case TILETYPE_CORNER_CONCAVE_SE:
+        ret.split = HF_SPLIT_NE_SW;
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
+/* 'u' and 'v' are the fractional offsets within the tile along the X and Z 
+ * axes, with (0, 0) being the NW corner. This gives the same result as 
+ * M_Tile_HeightAtPos, without the plane intersection for corner tiles.
+ */
+static float hf_cell_height(const struct hf_cell *cell, float u, float v)
+{
+    switch(cell->split) {
+    case HF_SPLIT_NW_SE:
+        if(u >= v)
+            return cell->nw + u * (cell->ne - cell->nw) + v * (cell->se - cell->ne);
+        return cell->nw + v * (cell->sw - cell->nw) + u * (cell->se - cell->sw);
+    case HF_SPLIT_NE_SW:
+        if(u + v <= 1.0f)
+            return cell->nw + u * (cell->ne - cell->nw) + v * (cell->sw - cell->nw);
+        return cell->se + (1.0f - u) * (cell->sw - cell->se) + (1.0f - v) * (cell->ne - cell->se);
+    default:
+        return cell->nw * (1.0f - u) * (1.0f - v)
+             + cell->ne * u * (1.0f - v)
+             + cell->sw * (1.0f - u) * v
+             + cell->se * u * v;
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool M_Height_Init(struct map *map)
+{
+    size_t nrows = map->height * TILES_PER_CHUNK_HEIGHT;
+    size_t ncols = map->width * TILES_PER_CHUNK_WIDTH;
+
+    struct heightfield *hf = malloc(sizeof(struct heightfield) + nrows * ncols * sizeof(struct hf_cell));
+    if(!hf)
+        return false;
+
+    hf->nrows = nrows;
+    hf->ncols = ncols;
+    map->heights = hf;
+
+    for(int chunk_r = 0; chunk_r < map->height; chunk_r++) {
+    for(int chunk_c = 0; chunk_c < map->width;  chunk_c++) {
+        for(int tile_r = 0; tile_r < TILES_PER_CHUNK_HEIGHT; tile_r++) {
+        for(int tile_c = 0; tile_c < TILES_PER_CHUNK_WIDTH;  tile_c++) {
+            M_Height_UpdateTile(map, &(struct tile_desc){chunk_r, chunk_c, tile_r, tile_c});
+        }}
+    }}
+    return true;
+}
+
+void M_Height_Free(struct map *map)
+{
+    free(map->heights);
+    map->heights = NULL;
+}
+
+void M_Height_UpdateTile(struct map *map, const struct tile_desc *desc)
+{
+    struct heightfield *hf = map->heights;
+    if(!hf)
+        return;
+
+    const struct pfchunk *chunk = &map->chunks[desc->chunk_r * map->width + desc->chunk_c];
+    const struct tile *tile = &chunk->tiles[desc->tile_r * TILES_PER_CHUNK_WIDTH + desc->tile_c];
+
+    size_t r = desc->chunk_r * TILES_PER_CHUNK_HEIGHT + desc->tile_r;
+    size_t c = desc->chunk_c * TILES_PER_CHUNK_WIDTH + desc->tile_c;
+    hf->cells[r * hf->ncols + c] = hf_cell_for_tile(tile);
+}
+
+float M_Height_Sample(const struct map *map, vec2_t xz)
+{
+    const struct heightfield *hf = map->heights;
+    assert(hf);
+
+    float r = (xz.z - map->pos.z) / Z_COORDS_PER_TILE;
+    float c = -(xz.x - map->pos.x) / X_COORDS_PER_TILE;
+
+    int tile_r = CLAMP((int)r, 0, (int)hf->nrows - 1);
+    int tile_c = CLAMP((int)c, 0, (int)hf->ncols - 1);
+
+    float u = CLAMP(c - tile_c, 0.0f, 1.0f);
+    float v = CLAMP(r - tile_r, 0.0f, 1.0f);
+
+    return hf_cell_height(&hf->cells[tile_r * hf->ncols + tile_c], u, v);
+}
+
@@ -37,6 +37,7 @@
 #include "pfchunk.h"
 #include "public/map.h"
 #include "../sched.h"
+#include "../main.h"
 #include "../perf.h"
 #include "../camera.h"
 #include "../settings.h"
@@ -45,7 +46,9 @@
 #include "../render/public/render_ctrl.h"
 #include "../navigation/public/nav.h"
 #include "../game/public/game.h"
+#include "../lib/public/mem.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -56,6 +59,26 @@
 #define CLAMP(a, min, max)  (MIN(MAX((a), (min)), (max)))
 #define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
 
+/* Chunks further than this (horizontally) from the camera use the lossy level of detail */
+#define LOD_FAR_DIST        (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE)
+
+
+struct vis_cache{
+    bool             valid;
+    size_t           width, height;
+    vec3_t           map_pos;
+    struct frustum   frustum;
+    size_t           nchunks;
+    size_t           capacity;
+    struct chunkpos *chunks;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* Indexed by whether the caller is the render thread */
+static struct vis_cache s_vis_caches[2];
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -84,6 +107,76 @@ static void m_aabb_for_chunk(const struct map *map, struct chunkpos p, struct aa
     assert(out->z_max >= out->z_min);
 }
 
+static int m_lod_for_chunk(const struct aabb *chunk_aabb, vec3_t cam_pos)
+{
+    /* The first reduced level is visually identical to the full mesh */
+    float dx = MAX(MAX(chunk_aabb->x_min - cam_pos.x, cam_pos.x - chunk_aabb->x_max), 0.0f);
+    float dz = MAX(MAX(chunk_aabb->z_min - cam_pos.z, cam_pos.z - chunk_aabb->z_max), 0.0f);
+
+    if(dx * dx + dz * dz > LOD_FAR_DIST * LOD_FAR_DIST)
+        return 2;
+    return 1;
+}
+
+/* Due to the nature of the the map (perfect grid), the fast and greedy frustrum 
+ * intersection test will yield too many false positives. As each chunk mesh has 
+ * a high vertex count, this is undesirable. It is absolutely worth it to do the 
+ * precise frustrum intersection test. With it, the map rendering performance
+ * scales great for large maps. 
+ *
+ * All the passes of a frame are culled against the same camera, so the result 
+ * of the tests is kept until the camera or the map geometry changes. The main 
+ * and render threads (which draws the water's refraction and reflection) each 
+ * have their own cache.
+ */
+static const struct vis_cache *m_visible_chunks(const struct map *map, const struct camera *cam)
+{
+    struct frustum frustum;
+    Camera_MakeFrustum(cam, &frustum);
+
+    struct vis_cache *vis = &s_vis_caches[SDL_ThreadID() == g_render_thread_id];
+    if(vis->valid
+    && vis->width == map->width
+    && vis->height == map->height
+    && memcmp(&vis->map_pos, &map->pos, sizeof(map->pos)) == 0
+    && memcmp(&vis->frustum, &frustum, sizeof(frustum)) == 0) {
+        PERF_COUNTER_ADD("map.vis_cache_hits", 1);
+        return vis;
+    }
+
+    size_t nchunks = map->width * map->height;
+    if(vis->capacity < nchunks) {
+        struct chunkpos *chunks = realloc(vis->chunks, nchunks * sizeof(struct chunkpos));
+        if(!chunks) {
+            /* Nothing is drawn, and the allocation is retried on the next call */
+            vis->valid = false;
+            vis->nchunks = 0;
+            return vis;
+        }
+        vis->chunks = chunks;
+        vis->capacity = nchunks;
+    }
+
+    vis->nchunks = 0;
+    for(int r = 0; r < map->height; r++) {
+    for(int c = 0; c < map->width;  c++) {
+
+        struct aabb chunk_aabb;
+        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+
+        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
+            continue;
+        vis->chunks[vis->nchunks++] = (struct chunkpos){r, c};
+    }}
+
+    vis->valid = true;
+    vis->width = map->width;
+    vis->height = map->height;
+    vis->map_pos = map->pos;
+    vis->frustum = frustum;
+    return vis;
+}
+
 static bool m_chunk_has_water(const struct pfchunk *chunk)
 {
     for(int i = 0; i < TILES_PER_CHUNK_HEIGHT * TILES_PER_CHUNK_WIDTH; i++) {
@@ -183,12 +276,17 @@ void M_RenderEntireMap(const struct map *map, bool shadows, enum render_pass pas
 }
 
 void M_RenderVisibleMap(const struct map *map, const struct camera *cam, 
-                        bool shadows, enum render_pass pass)
+                        bool shadows, bool lod, enum render_pass pass)
+{
+    M_RenderVisibleMapClipped(map, cam, NULL, shadows, lod, pass);
+}
+
+void M_RenderVisibleMapClipped(const struct map *map, const struct camera *cam, 
+                               const struct frustum *clip, bool shadows, 
+                               bool lod, enum render_pass pass)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
     vec2_t pos = (vec2_t){map->pos.x, map->pos.z};
-    const bool fval = false;
+    vec3_t cam_pos = Camera_GetPos(cam);
 
     R_PushCmd((struct rcmd){ 
         .func = R_GL_MapBegin, 
@@ -199,18 +297,15 @@ void M_RenderVisibleMap(const struct map *map, const struct camera *cam,
         },
     });
 
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
         struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+        m_aabb_for_chunk(map, vis->chunks[i], &chunk_aabb);
 
-        /* Due to the nature of the the map (perfect grid), the fast and greedy frustrum 
-         * intersection test will yield too many false positives. As each chunk mesh has 
-         * a high vertex count, this is undesirable. It is absolutely worth it to do the 
-         * precise frustrum intersection test. With it, the map rendering performance
-         * scales great for large maps. */
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
+        if(clip && !C_FrustumAABBIntersectionExact(clip, &chunk_aabb))
             continue;
 
         mat4x4_t chunk_model;
@@ -228,56 +323,51 @@ void M_RenderVisibleMap(const struct map *map, const struct camera *cam,
                 },
             });
             break;
-        case RENDER_PASS_REGULAR:
+        case RENDER_PASS_REGULAR: {
+            int level = lod ? m_lod_for_chunk(&chunk_aabb, cam_pos) : 0;
             R_PushCmd((struct rcmd){
-                .func = R_GL_Draw,
+                .func = R_GL_DrawTerrainLOD,
                 .nargs = 3,
                 .args = {
                     chunk->render_private,
                     R_PushArg(&chunk_model, sizeof(chunk_model)),
-                    R_PushArg(&fval, sizeof(fval)),
+                    R_PushArg(&level, sizeof(level)),
                 },
             });
             break;
+        }
         default: assert(0);
         }
-    }}
+    }
     R_PushCmd((struct rcmd){ R_GL_MapEnd, 0 });
 }
 
 void M_RenderVisiblePathableLayer(const struct map *map, const struct camera *cam, enum nav_layer layer)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
+    N_RenderOverlayBegin();
 
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
-
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         N_RenderPathableChunk(map->nav_private, &chunk_model, map, r, c, layer); 
-    }}
+    }
+    N_RenderOverlayEnd();
 }
 
 void M_RenderChunkBoundaries(const struct map *map, const struct camera *cam)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
-
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
         struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
-
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        m_aabb_for_chunk(map, vis->chunks[i], &chunk_aabb);
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
@@ -301,27 +391,21 @@ void M_RenderChunkBoundaries(const struct map *map, const struct camera *cam)
                 (void*)G_GetPrevTickMap(),
             },
         });
-    }}
+    }
 }
 
 void M_RenderChunkVisibility(const struct map *map, const struct camera *cam, int faction_id)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
-
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
-
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         G_Fog_RenderChunkVisibility(faction_id, r, c, &chunk_model); 
-    }}
+    }
 }
 
 void M_CenterAtOrigin(struct map *map)
@@ -397,6 +481,9 @@ float M_HeightAtPoint(const struct map *map, vec2_t xz)
 {
     assert(M_PointInsideMap(map, xz));
 
+    if(map->heights)
+        return M_Height_Sample(map, xz);
+
     float x = xz.raw[0];
     float z = xz.raw[1];
 
@@ -422,6 +509,20 @@ float M_HeightAtPoint(const struct map *map, vec2_t xz)
     return M_Tile_HeightAtPos(tile, tile_frac_width, tile_frac_height);
 }
 
+void M_HeightAtPoints(const struct map *map, size_t n, const vec2_t *xz, float *out)
+{
+    if(!map->heights) {
+        for(size_t i = 0; i < n; i++)
+            out[i] = M_HeightAtPoint(map, xz[i]);
+        return;
+    }
+
+    for(size_t i = 0; i < n; i++) {
+        assert(M_PointInsideMap(map, xz[i]));
+        out[i] = M_Height_Sample(map, xz[i]);
+    }
+}
+
 bool M_DescForPoint2D(const struct map *map, vec2_t point_xz, struct tile_desc *out)
 {
     struct map_resolution res;
@@ -434,6 +535,11 @@ void M_NavCutoutStaticObject(const struct map *map, const struct obb *obb)
     N_CutoutStaticObject(map->nav_private, map->pos, obb);
 }
 
+bool M_NavEnsureLayer(const struct map *map, enum nav_layer layer)
+{
+    return N_EnsureLayer(map->nav_private, layer);
+}
+
 void M_NavUpdatePortals(const struct map *map)
 {
     N_UpdatePortals(map->nav_private);
@@ -444,178 +550,185 @@ void M_NavUpdateIslandsField(const struct map *map)
     N_UpdateIslandsField(map->nav_private);
 }
 
+void M_NavUpdateBakedData(const struct map *map)
+{
+    N_UpdateBakedData(map->nav_private);
+}
+
 bool M_NavRequestPath(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
                       enum nav_layer layer, dest_id_t *out_dest_id)
 {
     return N_RequestPath(map->nav_private, xz_src, xz_dest, map->pos, layer, out_dest_id);
 }
 
+bool M_NavRequestPathBatch(const struct map *map, size_t nsrcs, const vec2_t xz_srcs[], 
+                           vec2_t xz_dest, enum nav_layer layer, bool out_found[], 
+                           dest_id_t *out_dest_id)
+{
+    return N_RequestPathBatch(map->nav_private, nsrcs, xz_srcs, xz_dest, map->pos, 
+                              layer, out_found, out_dest_id);
+}
+
+bool M_NavRequestPathBatchAttacking(const struct map *map, size_t nsrcs, const vec2_t xz_srcs[], 
+                                    vec2_t xz_dest, int faction_id, enum nav_layer layer, 
+                                    bool out_found[], dest_id_t *out_dest_id)
+{
+    return N_RequestPathBatchAttacking(map->nav_private, nsrcs, xz_srcs, xz_dest, faction_id,
+                                       map->pos, layer, out_found, out_dest_id);
+}
+
+void M_NavRenderOverlayBegin(void)
+{
+    N_RenderOverlayBegin();
+}
+
+void M_NavRenderOverlayEnd(void)
+{
+    N_RenderOverlayEnd();
+}
+
 void M_NavRenderVisiblePathFlowField(const struct map *map, const struct camera *cam, 
                                      dest_id_t id)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
-
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    N_RenderOverlayBegin();
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         N_RenderPathFlowField(map->nav_private, map, &chunk_model, r, c, id);
         N_RenderLOSField(map->nav_private, map, &chunk_model, r, c, id);
-    }}
+    }
+    N_RenderOverlayEnd();
 }
 
 void M_NavRenderVisibleEnemySeekField(const struct map *map, const struct camera *cam, 
                                      enum nav_layer layer, int faction_id)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
+    N_RenderOverlayBegin();
 
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
-
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         N_RenderEnemySeekField(map->nav_private, map, &chunk_model, r, c, layer, faction_id);
-    }}
+    }
+    N_RenderOverlayEnd();
 }
 
 void M_NavRenderVisibleSurroundField(const struct map *map, const struct camera *cam, 
                                      enum nav_layer layer, const uint32_t uid)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
-
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    N_RenderOverlayBegin();
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         N_RenderSurroundField(map->nav_private, map, &chunk_model, r, c, layer, uid);
-    }}
+    }
+    N_RenderOverlayEnd();
 }
 
 void M_NavRenderNavigationBlockers(const struct map *map, const struct camera *cam, enum nav_layer layer)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
+    N_RenderOverlayBegin();
 
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
-
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         N_RenderNavigationBlockers(map->nav_private, map, &chunk_model, r, c, layer);
-    }}
+    }
+    N_RenderOverlayEnd();
 }
 
 void M_NavRenderBuildableTiles(const struct map *map, const struct camera *cam, 
                                const struct obb *obb, enum nav_layer layer, bool blocked, 
                                bool allow_shore)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
+    N_RenderOverlayBegin();
 
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
-
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         N_RenderBuildableTiles(map->nav_private, map, &chunk_model, r, c, obb, layer, blocked, allow_shore);
-    }}
+    }
+    N_RenderOverlayEnd();
 }
 
 void M_NavRenderNavigationPortals(const struct map *map, const struct camera *cam, enum nav_layer layer)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
-
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    N_RenderOverlayBegin();
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         N_RenderNavigationPortals(map->nav_private, map, &chunk_model, r, c, layer);
-    }}
+    }
+    N_RenderOverlayEnd();
 }
 
 void M_NavRenderNavigationIslandIDs(const struct map *map, const struct camera *cam,
                                     enum nav_layer layer)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
+    N_RenderOverlayBegin();
 
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
-
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         N_RenderIslandIDs(map->nav_private, map, cam, &chunk_model, r, c, layer);
-    }}
+    }
+    N_RenderOverlayEnd();
 }
 
 void M_NavRenderNavigationLocalIslandIDs(const struct map *map, const struct camera *cam,
                                          enum nav_layer layer)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
+    N_RenderOverlayBegin();
 
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
-
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         mat4x4_t chunk_model;
         M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
         N_RenderLocalIslandIDs(map->nav_private, map, cam, &chunk_model, r, c, layer);
-    }}
+    }
+    N_RenderOverlayEnd();
 }
 
 vec2_t M_NavDesiredPointSeekVelocity(const struct map *map, dest_id_t id, vec2_t curr_pos, vec2_t xz_dest)
@@ -623,6 +736,13 @@ vec2_t M_NavDesiredPointSeekVelocity(const struct map *map, dest_id_t id, vec2_t
     return N_DesiredPointSeekVelocity(id, curr_pos, xz_dest, map->nav_private, map->pos);
 }
 
+vec2_t M_NavFlockDesiredPointSeekVelocity(const struct map *map, struct nav_flock_fields *fields,
+                                          dest_id_t id, vec2_t curr_pos, vec2_t xz_dest)
+{
+    return N_FlockDesiredPointSeekVelocity(fields, id, curr_pos, xz_dest, 
+        map->nav_private, map->pos);
+}
+
 vec2_t M_NavDesiredEnemySeekVelocity(const struct map *map, enum nav_layer layer, 
                                      vec2_t curr_pos, int faction_id)
 {
@@ -640,6 +760,12 @@ bool M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos)
     return N_HasDestLOS(id, curr_pos, map->nav_private, map->pos);
 }
 
+bool M_NavFlockHasDestLOS(const struct map *map, struct nav_flock_fields *fields,
+                          dest_id_t id, vec2_t curr_pos)
+{
+    return N_FlockHasDestLOS(fields, id, curr_pos, map->nav_private, map->pos);
+}
+
 bool M_NavPositionPathable(const struct map *map, enum nav_layer layer, vec2_t xz_pos)
 {
     struct box map_box = (struct  box){
@@ -728,6 +854,11 @@ void M_NavBlockersDecrefOBB(const struct map *map, int faction_id,
     N_BlockersDecrefOBB(map->nav_private, faction_id, flags, map->pos, obb);
 }
 
+void M_NavBlockersUpdateBatch(const struct map *map, size_t nops, struct nav_blocker_op *ops)
+{
+    N_BlockersUpdateBatch(map->nav_private, map->pos, nops, ops);
+}
+
 bool M_TileForDesc(const struct map *map, struct tile_desc desc, struct tile **out)
 {
     if(desc.chunk_r < 0 || desc.chunk_r >= map->height)
@@ -787,26 +918,59 @@ vec3_t M_GetPos(const struct map *map)
     return map->pos;
 }
 
-bool M_WaterMaybeVisible(const struct map *map, const struct camera *cam)
+void M_ClearVisibleChunks(void)
+{
+    for(int i = 0; i < ARR_SIZE(s_vis_caches); i++) {
+        free(s_vis_caches[i].chunks);
+        s_vis_caches[i] = (struct vis_cache){0};
+    }
+}
+
+void M_UpdateResidency(struct map *map, const struct camera *cam)
 {
     PERF_ENTER();
 
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
+    /* The neighbours of the visible chunks are required as well, so that 
+     * they are already resident when they scroll into view. The visible 
+     * chunks come first, to be the first to be built. */
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    size_t nrequired = 0;
+    STALLOC(struct chunkpos, required, vis->nchunks * 9);
 
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
+    for(size_t i = 0; i < vis->nchunks; i++) {
+        required[nrequired++] = vis->chunks[i];
+    }
+    for(size_t i = 0; i < vis->nchunks; i++) {
+        for(int dr = -1; dr <= 1; dr++) {
+        for(int dc = -1; dc <= 1; dc++) {
+
+            int r = vis->chunks[i].r + dr;
+            int c = vis->chunks[i].c + dc;
+            if((dr == 0 && dc == 0) || r < 0 || c < 0 || r >= map->height || c >= map->width)
+                continue;
+            required[nrequired++] = (struct chunkpos){r, c};
+        }}
+    }
 
-        struct aabb chunk_aabb;
-        m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+    M_AL_RequireChunks(map, nrequired, required);
+    STFREE(required);
+    PERF_RETURN_VOID();
+}
 
-        if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-            continue;
+bool M_WaterMaybeVisible(const struct map *map, const struct camera *cam)
+{
+    PERF_ENTER();
+
+    const struct vis_cache *vis = m_visible_chunks(map, cam);
+    for(size_t i = 0; i < vis->nchunks; i++) {
+
+        const int r = vis->chunks[i].r;
+        const int c = vis->chunks[i].c;
 
         const struct pfchunk *chunk = &map->chunks[r * map->width + c];
         if(m_chunk_has_water(chunk))
             PERF_RETURN(true);
-    }}
+    }
     PERF_RETURN(false);
 }
 
@@ -894,6 +1058,18 @@ void M_NavRequestAsyncSurroundField(const struct map *map, enum nav_layer layer,
     N_RequestAsyncSurroundField(curr_pos, map->nav_private, layer, map->pos, ent, faction_id);
 }
 
+bool M_NavEnemySeekFieldPending(const struct map *map, enum nav_layer layer, 
+                                vec2_t curr_pos, int faction_id)
+{
+    return N_AsyncEnemySeekFieldPending(curr_pos, map->nav_private, layer, map->pos, faction_id);
+}
+
+bool M_NavSurroundFieldPending(const struct map *map, enum nav_layer layer, 
+                               vec2_t curr_pos, uint32_t ent)
+{
+    return N_AsyncSurroundFieldPending(curr_pos, map->nav_private, layer, map->pos, ent);
+}
+
 void M_NavCopyIslandsFieldView(const struct map *map, vec2_t center,
                                int nrows, int ncols, enum nav_layer layer, uint16_t *out_field)
 {
@@ -920,6 +1096,13 @@ void M_NavCellArrivalFieldUpdateToNearestPathable(const struct map *map,
         start, center, inout, workspace, workspace_size);
 }
 
+void M_NavBenchmarkQueues(const struct map *map, enum nav_layer layer, int nruns,
+                          struct nav_queue_bench_result out[NAV_BENCH_NQUEUES])
+{
+    assert(map->nav_private);
+    N_BenchmarkQueues(map->nav_private, layer, nruns, out);
+}
+
 bool M_PointOverWater(const struct map *map, vec2_t pos)
 {
     struct tile *tile = NULL;
@@ -47,6 +47,8 @@
 #include "../lib/public/block_allocator.h"
 #include "../ui.h"
 #include "../perf.h"
+#include "../main.h"
+#include "../settings.h"
 
 #include <stdlib.h>
 #include <assert.h>
@@ -57,6 +59,8 @@
 #define MINIMAP_DFLT_SZ (256)
 #define PFMAP_VER       (1.0f)
 #define CHK_TRUE(_pred, _label) do{ if(!(_pred)) goto _label; }while(0)
+/* Bounds the cost of building chunk meshes when the camera jumps */
+#define MAX_PAGE_INS_PER_FRAME  (8)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -64,10 +68,183 @@
 
 static struct block_allocator s_block_alloc;
 
+/* While a tile edit transaction is open, the tiles whose vertices have to be 
+ * rebuilt are only marked in the per-chunk masks. Every marked tile is rebuilt 
+ * exactly once when the outermost transaction is closed. */
+static struct{
+    int     depth;
+    size_t  nchunks;
+    bool   *dirty;
+    size_t *ndirty;
+}s_tile_edits;
+
+/* The terrain meshes of maps with more chunks than the budget are only kept 
+ * resident around the camera. A chunk's mesh is built from its' tiles when it 
+ * is first required and the least recently required meshes are released once 
+ * the budget is exceeded. The tiles themselves are always resident. */
+static struct{
+    bool      sparse;
+    size_t    budget;
+    size_t    nresident;
+    uint32_t  frame;
+    /* The frame on which the chunk was last required. 0 if not resident */
+    uint32_t *last_used;
+    /* The chunk has been drawn to the minimap at least once */
+    bool     *baked;
+}s_residency;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static void m_al_mark_tile_dirty(const struct map *map, struct tile_desc td)
+{
+    size_t chunk_idx = td.chunk_r * map->width + td.chunk_c;
+    size_t tile_idx = td.tile_r * TILES_PER_CHUNK_WIDTH + td.tile_c;
+    bool *dirty = &s_tile_edits.dirty[chunk_idx * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT 
+                                      + tile_idx];
+    if(!*dirty) {
+        *dirty = true;
+        s_tile_edits.ndirty[chunk_idx]++;
+    }
+}
+
+static void m_al_free_tile_edits(void)
+{
+    free(s_tile_edits.dirty);
+    free(s_tile_edits.ndirty);
+    memset(&s_tile_edits, 0, sizeof(s_tile_edits));
+}
+
+static void m_al_free_residency(void)
+{
+    free(s_residency.last_used);
+    free(s_residency.baked);
+    memset(&s_residency, 0, sizeof(s_residency));
+}
+
+static bool m_al_init_residency(size_t nchunks, size_t budget)
+{
+    m_al_free_residency();
+    if(nchunks <= budget)
+        return true;
+
+    s_residency.last_used = calloc(nchunks, sizeof(uint32_t));
+    s_residency.baked = calloc(nchunks, sizeof(bool));
+    if(!s_residency.last_used || !s_residency.baked) {
+        m_al_free_residency();
+        return false;
+    }
+    s_residency.sparse = true;
+    s_residency.budget = budget;
+    return true;
+}
+
+static bool m_al_page_in(struct map *map, size_t idx)
+{
+    struct pfchunk *chunk = &map->chunks[idx];
+    int r = idx / map->width;
+    int c = idx % map->width;
+
+    if(!R_AL_InitPrivFromTiles(map, r, c, chunk->tiles, TILES_PER_CHUNK_WIDTH, 
+        TILES_PER_CHUNK_HEIGHT, chunk->render_private, g_basepath))
+        return false;
+
+    /* The minimap is filled in as the chunks are first seen */
+    if(!s_residency.baked[idx]) {
+        s_residency.baked[idx] = M_UpdateMinimapChunk(map, r, c);
+    }
+    s_residency.nresident++;
+    return true;
+}
+
+static bool m_al_evict_lru(struct map *map)
+{
+    size_t nchunks = map->width * map->height;
+    size_t lru = nchunks;
+    uint32_t oldest = s_residency.frame;
+
+    for(size_t i = 0; i < nchunks; i++) {
+        uint32_t last = s_residency.last_used[i];
+        if(last > 0 && last < oldest) {
+            oldest = last;
+            lru = i;
+        }
+    }
+    if(lru == nchunks)
+        return false;
+
+    R_AL_FreePrivChunk(map->chunks[lru].render_private);
+    s_residency.last_used[lru] = 0;
+    s_residency.nresident--;
+    return true;
+}
+
+static void m_al_flush_tile_edits(struct map *map)
+{
+    PERF_ENTER();
+
+    size_t nchunks = 0, ntiles = 0;
+    for(size_t i = 0; i < s_tile_edits.nchunks; i++) {
+        if(s_tile_edits.ndirty[i] == 0)
+            continue;
+        nchunks++;
+        ntiles += s_tile_edits.ndirty[i];
+    }
+
+    if(nchunks == 0)
+        PERF_RETURN_VOID();
+
+    struct tile_desc *descs = malloc(ntiles * sizeof(struct tile_desc));
+    void **rprivates = malloc(nchunks * sizeof(void*));
+    size_t *counts = malloc(nchunks * sizeof(size_t));
+    const struct tile_desc **tiles = malloc(nchunks * sizeof(struct tile_desc*));
+
+    if(!descs || !rprivates || !counts || !tiles)
+        goto out;
+
+    size_t n = 0;
+    struct tile_desc *next = descs;
+
+    for(int r = 0; r < map->height; r++) {
+    for(int c = 0; c < map->width;  c++) {
+
+        size_t chunk_idx = r * map->width + c;
+        if(s_tile_edits.ndirty[chunk_idx] == 0)
+            continue;
+
+        struct pfchunk *chunk = &map->chunks[chunk_idx];
+        M_Raycast_UpdateChunkHeight(chunk);
+
+        const bool *dirty = &s_tile_edits.dirty[chunk_idx 
+                          * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT];
+        rprivates[n] = chunk->render_private;
+        counts[n] = 0;
+        tiles[n] = next;
+
+        for(int tile_r = 0; tile_r < TILES_PER_CHUNK_HEIGHT; tile_r++) {
+        for(int tile_c = 0; tile_c < TILES_PER_CHUNK_WIDTH;  tile_c++) {
+
+            if(!dirty[tile_r * TILES_PER_CHUNK_WIDTH + tile_c])
+                continue;
+            *next++ = (struct tile_desc){r, c, tile_r, tile_c};
+            counts[n]++;
+        }}
+        assert(counts[n] == s_tile_edits.ndirty[chunk_idx]);
+        n++;
+    }}
+    assert(n == nchunks);
+
+    R_AL_UpdateTiles(map, nchunks, rprivates, counts, tiles);
+
+out:
+    free(descs);
+    free(rprivates);
+    free(counts);
+    free(tiles);
+    PERF_RETURN_VOID();
+}
+
 static bool m_al_parse_tile(const char *str, struct tile *out)
 {
     if(strlen(str) != 24)
@@ -165,44 +342,6 @@ fail:
     return false;
 }
 
-static void m_al_patch_adjacency_info(struct map *map)
-{
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width;  c++) {
-
-        void *chunk_rprivate = map->chunks[r * map->width + c].render_private;
-        for(int tile_r = 0; tile_r < TILES_PER_CHUNK_HEIGHT; tile_r++) {
-        for(int tile_c = 0; tile_c < TILES_PER_CHUNK_HEIGHT; tile_c++) {
-        
-            struct tile_desc desc = (struct tile_desc){r, c, tile_r, tile_c};
-            const struct tile *tile = &map->chunks[r * map->width + c].tiles[tile_r * TILES_PER_CHUNK_WIDTH + tile_c];
-
-            R_PushCmd((struct rcmd){
-                .func = R_GL_TilePatchVertsBlend,
-                .nargs = 3,
-                .args = {
-                    chunk_rprivate,
-                    (void*)G_GetPrevTickMap(),
-                    R_PushArg(&desc, sizeof(desc)),
-                },
-            });
-
-            if(!tile->blend_normals)
-                continue;
-
-            R_PushCmd((struct rcmd){
-                .func = R_GL_TilePatchVertsSmooth,
-                .nargs = 3,
-                .args = {
-                    chunk_rprivate,
-                    (void*)G_GetPrevTickMap(),
-                    R_PushArg(&desc, sizeof(desc)),
-                },
-            });
-        }}
-    }}
-}
-
 static void set_minimap_defaults(struct map *map)
 {
     map->minimap_vres = (vec2_t){1920, 1080};
@@ -225,6 +364,7 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
     map->width = header->num_cols;
     map->height = header->num_rows;
     map->pos = (vec3_t) {0.0f, 0.0f, 0.0f};
+    map->heights = NULL;
     set_minimap_defaults(map);
 
     /* Read materials */
@@ -247,15 +387,7 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
 		TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE
     };
 
-    R_PushCmd((struct rcmd){
-        .func = R_GL_MapInit,
-        .nargs = 3,
-        .args = {
-            R_PushArg(texnames, header->num_materials * 256),
-            R_PushArg(&header->num_materials, sizeof(header->num_materials)),
-            R_PushArg(&res, sizeof(res)),
-        },
-    });
+    R_AL_MapInit((const char (*)[256])texnames, header->num_materials, &res);
     STFREE(texnames);
 
     /* Read chunks */
@@ -263,10 +395,19 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
     char *unused_base = (char*)(map + 1);
     unused_base += num_chunks * sizeof(struct pfchunk);
 
+    struct sval budget;
+    ss_e status = Settings_Get("pf.video.terrain_budget_chunks", &budget);
+    assert(status == SS_OKAY);
+    (void)status;
+
+    if(!m_al_init_residency(num_chunks, budget.as_int))
+        return false;
+
     for(int i = 0; i < num_chunks; i++) {
 
         if(!m_al_read_pfchunk(stream, map->chunks + i))
             return false;
+        M_Raycast_UpdateChunkHeight(map->chunks + i);
     }
 
     for(int i = 0; i < num_chunks; i++) {
@@ -276,6 +417,12 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
                                TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 0);
         unused_base += renderbuff_sz;
 
+        /* The meshes are built once the chunks are first required */
+        if(s_residency.sparse) {
+            memset(map->chunks[i].render_private, 0, renderbuff_sz);
+            continue;
+        }
+
         if(!R_AL_InitPrivFromTiles(map, i / header->num_cols, i % header->num_cols,
                                    map->chunks[i].tiles, TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT,
                                    map->chunks[i].render_private, basedir)) {
@@ -283,8 +430,6 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
         }
     }
 
-    m_al_patch_adjacency_info(map);
-
     /* Build navigation grid */
     STALLOC(const struct tile*, chunk_tiles, map->width * map->height);
 
@@ -300,6 +445,11 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
     if(!map->nav_private)
         return false;
 
+    if(!M_Height_Init(map)) {
+        N_FreePrivate(map->nav_private);
+        return false;
+    }
+
     return true;
 }
 
@@ -319,6 +469,13 @@ bool M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, const struct
 
     struct pfchunk *chunk = &map->chunks[desc->chunk_r * map->width + desc->chunk_c];
     chunk->tiles[desc->tile_r * TILES_PER_CHUNK_WIDTH + desc->tile_c] = *tile;
+    M_Height_UpdateTile(map, desc);
+
+    /* The tile and all its neighbours get new adjacency data */
+    const bool deferred = (s_tile_edits.dirty != NULL);
+    if(!deferred) {
+        M_Raycast_UpdateChunkHeight(chunk);
+    }
 
     struct map_resolution res;
     M_GetResolution(map, &res);
@@ -328,7 +485,9 @@ bool M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, const struct
     
         struct tile_desc curr = *desc;
         int ret = M_Tile_RelativeDesc(res, &curr, dc, dr);
-        if(ret) {
+        if(ret && deferred) {
+            m_al_mark_tile_dirty(map, curr);
+        }else if(ret) {
         
             struct pfchunk *chunk = &map->chunks[curr.chunk_r * map->width + curr.chunk_c];
             R_PushCmd((struct rcmd){
@@ -346,11 +505,83 @@ bool M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, const struct
     return true;
 }
 
+void M_AL_BeginTileEdits(struct map *map)
+{
+    if(s_tile_edits.depth++ > 0)
+        return;
+
+    size_t nchunks = map->width * map->height;
+    s_tile_edits.nchunks = nchunks;
+    s_tile_edits.dirty = calloc(nchunks * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT, 
+        sizeof(bool));
+    s_tile_edits.ndirty = calloc(nchunks, sizeof(size_t));
+
+    /* Fall back to updating the tiles eagerly */
+    if(!s_tile_edits.dirty || !s_tile_edits.ndirty) {
+        free(s_tile_edits.dirty);
+        free(s_tile_edits.ndirty);
+        s_tile_edits.dirty = NULL;
+        s_tile_edits.ndirty = NULL;
+    }
+}
+
+void M_AL_EndTileEdits(struct map *map)
+{
+    /* The transaction is dropped when the map is freed */
+    if(s_tile_edits.depth == 0)
+        return;
+    if(--s_tile_edits.depth > 0)
+        return;
+
+    if(s_tile_edits.dirty) {
+        m_al_flush_tile_edits(map);
+    }
+    m_al_free_tile_edits();
+}
+
+void M_AL_RequireChunks(struct map *map, size_t nchunks, const struct chunkpos *chunks)
+{
+    if(!s_residency.sparse)
+        return;
+
+    PERF_ENTER();
+    uint32_t frame = ++s_residency.frame;
+    int npaged = 0;
+
+    for(size_t i = 0; i < nchunks; i++) {
+
+        size_t idx = chunks[i].r * map->width + chunks[i].c;
+        uint32_t *last = &s_residency.last_used[idx];
+        if(*last == frame)
+            continue;
+
+        if(*last == 0) {
+            if(npaged == MAX_PAGE_INS_PER_FRAME)
+                continue;
+            if(!m_al_page_in(map, idx))
+                continue;
+            npaged++;
+        }
+        *last = frame;
+    }
+
+    /* None of the chunks required during this frame are evicted, so the 
+     * budget may be exceeded for as long as they don't fit within it */
+    while(s_residency.nresident > s_residency.budget) {
+        if(!m_al_evict_lru(map))
+            break;
+    }
+    PERF_RETURN_VOID();
+}
+
 void M_AL_FreePrivate(struct map *map)
 {
+    m_al_free_tile_edits();
+    m_al_free_residency();
     R_PushCmd((struct rcmd){ .func = R_GL_MapShutdown });
     assert(map->nav_private);
     N_FreePrivate(map->nav_private);
+    M_Height_Free(map);
 }
 
 size_t M_AL_ShallowCopySize(size_t nrows, size_t ncols)
@@ -362,6 +593,7 @@ size_t M_AL_ShallowCopySize(size_t nrows, size_t ncols)
 void M_AL_ShallowCopy(struct map *dst, const struct map *src)
 {
     memcpy(dst, src, M_AL_ShallowCopySize(src->width, src->height));
+    dst->heights = NULL;
 }
 
 struct map *M_AL_CopyWithFields(const struct map *src)
@@ -37,8 +37,11 @@
 #define MAP_PRIVATE_H
 
 #include "pfchunk.h"
+#include "public/tile.h"
 #include "../pf_math.h"
 
+#include <stdbool.h>
+
 #define MAX_NUM_MATS (256)
 
 
@@ -80,6 +83,13 @@ struct map{
      * ------------------------------------------------------------------------
      */
     void *nav_private;
+    /* ------------------------------------------------------------------------
+     * The surface height of every tile, precomputed from the tile data. Only
+     * the live map has one - it is NULL in copies of the map, which read the 
+     * height from their own tiles.
+     * ------------------------------------------------------------------------
+     */
+    struct heightfield *heights;
     /* ------------------------------------------------------------------------
      * Save the materials information read from the source PFMap file. This is 
      * used when saving to a new PFMAp file.
@@ -95,4 +105,15 @@ struct map{
     struct pfchunk chunks[];
 };
 
+/* Recompute the 'max_height' of a chunk after any of its' tiles change */
+void M_Raycast_UpdateChunkHeight(struct pfchunk *chunk);
+
+/* Build the heightfield from the map's tiles. */
+bool  M_Height_Init(struct map *map);
+void  M_Height_Free(struct map *map);
+/* Refresh the heightfield after the specified tile changes */
+void  M_Height_UpdateTile(struct map *map, const struct tile_desc *desc);
+/* The map must have a heightfield. */
+float M_Height_Sample(const struct map *map, vec2_t xz);
+
 #endif
@@ -47,6 +47,7 @@
 #include <SDL.h>
 
 #include <assert.h>
+#include <stdlib.h>
 
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -63,6 +64,9 @@ struct quad{
 
 static bool   s_mouse_down_in_minimap = false;
 static vec4_t s_border_clr = DEFAULT_BORDER_CLR;
+/* Chunks whose minimap region is redrawn at the next M_RenderMinimap call */
+static bool  *s_dirty_chunks = NULL;
+static size_t s_ndirty = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -198,6 +202,48 @@ static vec2_t m_minimap_mouse_coords_to_world(const struct map *map, vec2_t virt
     };
 }
 
+static void m_flush_dirty_chunks(const struct map *map)
+{
+    if(s_ndirty == 0)
+        return;
+
+    struct render_workspace *ws = G_GetSimWS();
+    void **rprivates = stalloc(&ws->args, s_ndirty * sizeof(void*));
+    mat4x4_t *models = stalloc(&ws->args, s_ndirty * sizeof(mat4x4_t));
+    int *rows = stalloc(&ws->args, s_ndirty * sizeof(int));
+    int *cols = stalloc(&ws->args, s_ndirty * sizeof(int));
+
+    size_t n = 0;
+    for(int r = 0; r < map->height; r++) {
+    for(int c = 0; c < map->width;  c++) {
+
+        if(!s_dirty_chunks[r * map->width + c])
+            continue;
+        s_dirty_chunks[r * map->width + c] = false;
+
+        rprivates[n] = map->chunks[r * map->width + c].render_private;
+        M_ModelMatrixForChunk(map, (struct chunkpos){r, c}, &models[n]);
+        rows[n] = r;
+        cols[n] = c;
+        n++;
+    }}
+    assert(n == s_ndirty);
+    s_ndirty = 0;
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_MinimapUpdateChunks,
+        .nargs = 6,
+        .args = {
+            (void*)G_GetPrevTickMap(),
+            R_PushArg(&n, sizeof(n)),
+            rprivates,
+            models,
+            rows,
+            cols,
+        }
+    });
+}
+
 bool m_mouse_over_screen_rect(const struct map *map, struct quad quad)
 {
     int x, y;
@@ -278,6 +324,12 @@ bool M_InitMinimap(struct map *map, vec2_t center_pos)
     assert(map);
     map->minimap_center_pos = center_pos;
 
+    free(s_dirty_chunks);
+    s_dirty_chunks = calloc(map->width * map->height, sizeof(bool));
+    s_ndirty = 0;
+    if(!s_dirty_chunks)
+        return false;
+
     STALLOC(void*, chunk_rprivates, map->width * map->height);
     STALLOC(mat4x4_t, chunk_model_mats, map->width * map->height);
 
@@ -312,21 +364,16 @@ bool M_UpdateMinimapChunk(const struct map *map, int chunk_r, int chunk_c)
 {
     if(chunk_r >= map->height || chunk_c >= map->width)
         return false;
+    if(!s_dirty_chunks)
+        return false;
 
-    mat4x4_t model;
-    M_ModelMatrixForChunk(map, (struct chunkpos){chunk_r, chunk_c}, &model);
-
-    R_PushCmd((struct rcmd){
-        .func = R_GL_MinimapUpdateChunk,
-        .nargs = 5,
-        .args = {
-            (void*)G_GetPrevTickMap(),
-            map->chunks[chunk_r * map->width + chunk_c].render_private,
-            R_PushArg(&model, sizeof(model)),
-            R_PushArg(&chunk_r, sizeof(chunk_r)),
-            R_PushArg(&chunk_c, sizeof(chunk_c)),
-        }
-    });
+    /* Any number of updates to the same chunk within a frame are batched 
+     * into a single redraw (see m_flush_dirty_chunks) */
+    bool *dirty = &s_dirty_chunks[chunk_r * map->width + chunk_c];
+    if(!*dirty) {
+        *dirty = true;
+        s_ndirty++;
+    }
     return true;
 }
 
@@ -337,6 +384,10 @@ void M_FreeMinimap(struct map *map)
 
     R_PushCmd((struct rcmd){ R_GL_MinimapFree, 0 });
     s_mouse_down_in_minimap = false;
+
+    free(s_dirty_chunks);
+    s_dirty_chunks = NULL;
+    s_ndirty = 0;
 }
 
 void M_GetMinimapAdjVres(const struct map *map, vec2_t *out_vres)
@@ -378,6 +429,8 @@ void M_SetMinimapSize(struct map *map, int side_len)
 void M_RenderMinimap(const struct map *map, const struct camera *cam)
 {
     assert(map);
+    m_flush_dirty_chunks(map);
+
     if(map->minimap_sz == 0)
         return;
 
@@ -60,6 +60,12 @@ struct pfchunk{
      * ------------------------------------------------------------------------
      */
     struct tile     tiles[TILES_PER_CHUNK_HEIGHT * TILES_PER_CHUNK_WIDTH];
+    /* ------------------------------------------------------------------------
+     * The height of the highest tile top in the chunk, in tile units. Rays 
+     * passing above it can skip testing any of the chunk's tiles.
+     * ------------------------------------------------------------------------
+     */
+    int             max_height;
 };
 
 #endif
@@ -51,11 +51,13 @@ struct pfchunk;
 struct pfmap_hdr;
 struct map;
 struct camera;
+struct frustum;
 struct tile;
 struct tile_desc;
 struct obb;
 enum render_pass;
 struct map_resolution;
+struct nav_flock_fields;
 
 struct chunkpos{
     int r, c;
@@ -88,11 +90,22 @@ void   M_ModelMatrixForChunk(const struct map *map, struct chunkpos p, mat4x4_t
 /* ------------------------------------------------------------------------
  * Renders the chunks of the map that are currently visible by the specified
  * camera using a frustrum-chunk intersection test. Depending on the 'pass'
- * type, this will perform a different action.
+ * type, this will perform a different action. When 'lod' is set, the 
+ * distant chunks are drawn with their reduced-detail meshes in the regular
+ * pass. May be called from the render thread.
  * ------------------------------------------------------------------------
  */
 void   M_RenderVisibleMap(const struct map *map, const struct camera *cam, 
-                          bool shadows, enum render_pass pass);
+                          bool shadows, bool lod, enum render_pass pass);
+
+/* ------------------------------------------------------------------------
+ * Like 'M_RenderVisibleMap', but additionally skips the chunks which fall 
+ * outside of the 'clip' frustum.
+ * ------------------------------------------------------------------------
+ */
+void   M_RenderVisibleMapClipped(const struct map *map, const struct camera *cam, 
+                                 const struct frustum *clip, bool shadows, 
+                                 bool lod, enum render_pass pass);
 
 /* ------------------------------------------------------------------------
  * Render a layer over the visible map surface showing which regions are 
@@ -109,6 +122,14 @@ void   M_RenderVisiblePathableLayer(const struct map *map, const struct camera *
  */
 void   M_RenderChunkBoundaries(const struct map *map, const struct camera *cam);
 
+/* ------------------------------------------------------------------------
+ * Navigation overlays rendered between these calls are submitted as one
+ * draw per overlay type, rather than one per visible chunk. May be nested.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavRenderOverlayBegin(void);
+void   M_NavRenderOverlayEnd(void);
+
 /* ------------------------------------------------------------------------
  * Render a layer over the visible map surface showing fields which guide
  * units of a particular factions towards their enemies. These fields are
@@ -216,6 +237,24 @@ bool   M_Raycast_MouseIntersecCoord(vec3_t *out);
  */
 bool   M_Raycast_CameraIntersecCoord(const struct camera *cam, vec3_t *out);
 
+struct map_ray_hit{
+    bool   hit;
+    /* Distance along the ray, in units of its' direction vector */
+    float  t;
+    vec3_t pos;
+};
+
+/* ------------------------------------------------------------------------
+ * Intersect each of the rays with the map surface. A ray can only hit the
+ * surface within 'max_dists[i]' (in units of 'dirs[i]') of its' origin, 
+ * or anywhere along it if 'max_dists' is NULL, so that a hit of a ray 
+ * between two points means that the line between them is obstructed. 
+ * Returns the number of rays that hit the surface.
+ * ------------------------------------------------------------------------
+ */
+size_t M_RaycastBatch(const struct map *map, size_t nrays, const vec3_t origins[], 
+                      const vec3_t dirs[], const float max_dists[], struct map_ray_hit out[]);
+
 /* ------------------------------------------------------------------------
  * Utility function to convert an XZ worldspace coordinate to one in the 
  * range (-1, -1) in the 'top left' corner to (1, 1) in the 'bottom right' 
@@ -279,6 +318,12 @@ vec2_t M_ClampedMapCoordinate(const struct map *map, vec2_t xz);
  */
 float  M_HeightAtPoint(const struct map *map, vec2_t xz);
 
+/* ------------------------------------------------------------------------
+ * Writes the Y coordinates for 'n' XZ points on the map's surface to 'out'.
+ * ------------------------------------------------------------------------
+ */
+void   M_HeightAtPoints(const struct map *map, size_t n, const vec2_t *xz, float *out);
+
 /* ------------------------------------------------------------------------
  * Sets 'out to a tile descriptor for an XZ point on a the map. 'out' is valid
  * if the function returns true.
@@ -293,6 +338,14 @@ bool   M_DescForPoint2D(const struct map *map, vec2_t point_xz, struct tile_desc
  */
 void   M_NavCutoutStaticObject(const struct map *map, const struct obb *obb);
 
+/* ------------------------------------------------------------------------
+ * Build the family of navigation layers (ground, water or air) that the
+ * specified layer belongs to, if it has not been built yet. Only the 
+ * ground layers are built when the map is loaded.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavEnsureLayer(const struct map *map, enum nav_layer layer);
+
 /* ------------------------------------------------------------------------
  * Update navigation private data after changes to the cost field.
  * (ex. to remove a path in case it was blocked off by a placed object)
@@ -307,6 +360,14 @@ void   M_NavUpdatePortals(const struct map *map);
  */
 void   M_NavUpdateIslandsField(const struct map *map);
 
+/* ------------------------------------------------------------------------
+ * Rebuild all navigation data derived from the cost field (portals and 
+ * islands), reusing the cached result of a previous bake of the same 
+ * cost field when one exists on disk.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavUpdateBakedData(const struct map *map);
+
 /* ------------------------------------------------------------------------
  * Makes a path request to the navigation subsystem, causing the required
  * flowfields to be generated and cached. Returns true if a successful path
@@ -316,6 +377,26 @@ void   M_NavUpdateIslandsField(const struct map *map);
 bool   M_NavRequestPath(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
                         enum nav_layer layer, dest_id_t *out_dest_id);
 
+/* ------------------------------------------------------------------------
+ * Makes the path requests for many sources heading to the same destination
+ * at once, sharing the work that is common between them. 'out_found' (may 
+ * be NULL) is set for each source. Returns true if any path was made.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavRequestPathBatch(const struct map *map, size_t nsrcs, const vec2_t xz_srcs[], 
+                             vec2_t xz_dest, enum nav_layer layer, bool out_found[], 
+                             dest_id_t *out_dest_id);
+
+/* ------------------------------------------------------------------------
+ * Like M_NavRequestPathBatch, but the paths do not consider enemies of 
+ * the specified faction as blockers.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavRequestPathBatchAttacking(const struct map *map, size_t nsrcs, 
+                                      const vec2_t xz_srcs[], vec2_t xz_dest, 
+                                      int faction_id, enum nav_layer layer, 
+                                      bool out_found[], dest_id_t *out_dest_id);
+
 /* ------------------------------------------------------------------------
  * Render the flow field that will steer entities towards a particular 
  * destination over the map surface.
@@ -341,6 +422,14 @@ void   M_RenderChunkVisibility(const struct map *map, const struct camera *cam,
 vec2_t M_NavDesiredPointSeekVelocity(const struct map *map, dest_id_t id, 
                                      vec2_t curr_pos, vec2_t xz_dest);
 
+/* ------------------------------------------------------------------------
+ * The same as M_NavDesiredPointSeekVelocity, but going through a flock's
+ * copies of the fields (see N_FlockFieldsNew).
+ * ------------------------------------------------------------------------
+ */
+vec2_t M_NavFlockDesiredPointSeekVelocity(const struct map *map, struct nav_flock_fields *fields,
+                                          dest_id_t id, vec2_t curr_pos, vec2_t xz_dest);
+
 /* ------------------------------------------------------------------------
  * Returns the desired velocity vector for moving with the flow field 
  * for approaching enemies of a particular faction.
@@ -365,6 +454,14 @@ vec2_t M_NavDesiredSurroundVelocity(const struct map *map, enum nav_layer layer,
  */
 bool   M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos);
 
+/* ------------------------------------------------------------------------
+ * The same as M_NavHasDestLOS, but going through a flock's copies of the 
+ * fields.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavFlockHasDestLOS(const struct map *map, struct nav_flock_fields *fields,
+                            dest_id_t id, vec2_t curr_pos);
+
 /* ------------------------------------------------------------------------
  * Returns true if the particular entity is in direct line of sight of the 
  * specified position.
@@ -464,6 +561,14 @@ void   M_NavBlockersIncrefOBB(const struct map *map, int faction_id,
 void   M_NavBlockersDecrefOBB(const struct map *map, int faction_id, 
                               uint32_t flags, const struct obb *obb);
 
+/* ------------------------------------------------------------------------
+ * Applies a batch of reference count changes for circular blockers in one 
+ * go. Changes to the same footprint are coalesced. The ops are reordered.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavBlockersUpdateBatch(const struct map *map, size_t nops, 
+                                struct nav_blocker_op *ops);
+
 /* ------------------------------------------------------------------------
  * Wrapper around navigation APIs.
  * ------------------------------------------------------------------------
@@ -491,6 +596,8 @@ bool     M_NavIsAdjacentToIsland(const struct map *map, enum nav_layer layer, ve
                                  float radius, vec2_t island_pos);
 bool     M_NavIsAdjacentToIslandOBB(const struct map *map, enum nav_layer layer, 
                                     const struct obb *obb, vec2_t island_pos);
+void     M_NavBenchmarkQueues(const struct map *map, enum nav_layer layer, int nruns,
+                              struct nav_queue_bench_result out[NAV_BENCH_NQUEUES]);
 
 /* ------------------------------------------------------------------------
  * Request an asynchronous computation of a field.
@@ -502,6 +609,15 @@ void M_NavRequestAsyncEnemySeekField(const struct map *map, enum nav_layer layer
 void M_NavRequestAsyncSurroundField(const struct map *map, enum nav_layer layer, 
                                     vec2_t curr_pos, uint32_t ent, int faction_id);
 
+/* ------------------------------------------------------------------------
+ * Returns true if the field is still being built by deferred async work.
+ * ------------------------------------------------------------------------
+ */
+bool M_NavEnemySeekFieldPending(const struct map *map, enum nav_layer layer, 
+                                vec2_t curr_pos, int faction_id);
+bool M_NavSurroundFieldPending(const struct map *map, enum nav_layer layer, 
+                               vec2_t curr_pos, uint32_t ent);
+
 /* ------------------------------------------------------------------------
  * Returns true if the tiles under the entity selection cirlce overlap or 
  * share an edge with any of the tiles under the target entity.
@@ -565,7 +681,9 @@ bool   M_InitMinimap     (struct map *map, vec2_t center_pos);
 
 /* ------------------------------------------------------------------------
  * Update a chunk-sized region of the minimap texture with the most 
- * up-to-date vertex data.
+ * up-to-date vertex data. The update is deferred to the next 
+ * 'M_RenderMinimap' call, where all the chunks updated during the frame 
+ * are redrawn together.
  * ------------------------------------------------------------------------
  */
 bool   M_UpdateMinimapChunk(const struct map *map, int chunk_r, int chunk_c);
@@ -636,6 +754,22 @@ bool   M_MouseOverMinimap(const struct map *map);
  */
 bool   M_WaterMaybeVisible(const struct map *map, const struct camera *cam);
 
+/* ------------------------------------------------------------------------
+ * The chunks which intersect the camera frustum are cached between passes 
+ * and frames. Frees the cached sets - must only be called when the render 
+ * thread is idle.
+ * ------------------------------------------------------------------------
+ */
+void   M_ClearVisibleChunks(void);
+
+/* ------------------------------------------------------------------------
+ * Keep the terrain meshes of the chunks around the camera resident (see 
+ * 'M_AL_RequireChunks'). Must be called once per frame, before the map is 
+ * rendered.
+ * ------------------------------------------------------------------------
+ */
+void   M_UpdateResidency(struct map *map, const struct camera *cam);
+
 /* ------------------------------------------------------------------------
  * Returns true if the mouse is over a valid map location on the minimap.
  * In this case, 'out' is set to the worldspace coordinate of the position
@@ -695,6 +829,25 @@ bool   M_AL_UpdateChunkMats(const struct map *map, int chunk_r, int chunk_c,
 bool   M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, 
                        const struct tile *tile);
 
+/* ------------------------------------------------------------------------
+ * Open and close a tile edit transaction. Transactions may be nested. The
+ * vertex data of the tiles updated inside a transaction (and that of their
+ * neighbours) is rebuilt once, when the outermost transaction is closed.
+ * ------------------------------------------------------------------------
+ */
+void   M_AL_BeginTileEdits(struct map *map);
+void   M_AL_EndTileEdits(struct map *map);
+
+/* ------------------------------------------------------------------------
+ * Mark the chunks as required for the current frame. When the map has more
+ * chunks than 'pf.video.terrain_budget_chunks', the terrain meshes are only
+ * built for the required chunks, a few per frame, and the meshes of the 
+ * least recently required chunks are released to stay within the budget.
+ * Should be called at most once per frame.
+ * ------------------------------------------------------------------------
+ */
+void   M_AL_RequireChunks(struct map *map, size_t nchunks, const struct chunkpos *chunks);
+
 /* ------------------------------------------------------------------------
  * The size (in bytes) needed to store a shallow copy of the map.
  * ------------------------------------------------------------------------
@@ -711,7 +864,9 @@ void   M_AL_ShallowCopy(struct map *dst, const struct map *src);
 
 /* ------------------------------------------------------------------------
  * Makes a copy of the map, also copying cost field, blocked fields and
- * faction refcounts from the navigation data.
+ * faction refcounts from the navigation data. The copies are recycled 
+ * from a pool, so this only copies the navigation chunks which changed 
+ * since the recycled copy was made.
  * ------------------------------------------------------------------------
  */
 struct map *M_AL_CopyWithFields(const struct map *src);
@@ -41,6 +41,7 @@
 #include "../camera.h"
 #include "../config.h"
 #include "../main.h"
+#include "../perf.h"
 
 #include "../phys/public/collision.h"
 #include "../render/public/render.h"
@@ -50,10 +51,14 @@
 #include <SDL.h>
 #include <assert.h>
 #include <string.h>
+#include <float.h>
 
 
 #define MAX_CANDIDATE_TILES 1024
 #define EPSILON             (1.0f/1024)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define CLAMP(a, min, max)  (MIN(MAX((a), (min)), (max)))
 
 struct ray{
     vec3_t origin;
@@ -133,54 +138,177 @@ static vec3_t rc_unproject_mouse_coords(void)
     return (vec3_t){ret_homo.x/ret_homo.w, ret_homo.y/ret_homo.w, ret_homo.z/ret_homo.w};
 }
 
-static bool rc_find_intersection(vec3_t ray_origin, vec3_t ray_dir,
-                                 struct tile_desc *out_intersec, vec3_t *out_pos)
+static int tile_top_height(const struct tile *tile)
 {
-    struct map_resolution res;
-	M_GetResolution(s_ctx.map, &res);
-
-    /* Project the ray on the Y=(-TILE_DEPTH*Y_COORDS_PER_TILE) plane between the ray origin and where the 
-     * ray intersects the Y=(-TILE_DEPTH*Y_COORDS_PER_TILE) plane. */
-    float t = fabs((ray_origin.y + TILE_DEPTH*Y_COORDS_PER_TILE) / ray_dir.y);
-    struct line_seg_2d y_eq_0_seg = {
-        ray_origin.x, 
-        ray_origin.z,
-        ray_origin.x + t * ray_dir.x, 
-        ray_origin.z + t * ray_dir.z,
+    if(tile->type == TILETYPE_FLAT)
+        return tile->base_height;
+    return MAX(tile->base_height, tile->base_height + tile->ramp_height);
+}
+
+static float rc_map_top(const struct map *map)
+{
+    int ret = -TILE_DEPTH;
+    for(int i = 0; i < map->width * map->height; i++) {
+        ret = MAX(ret, map->chunks[i].max_height);
+    }
+    return ret * Y_COORDS_PER_TILE;
+}
+
+/* Clip the [t_min, t_max] interval of the ray to the box spanned by 
+ * the map area, the bottom of the tiles and the highest tile top.
+ */
+static bool rc_clip_ray(const struct map *map, struct map_resolution res, float top, 
+                        vec3_t ray_origin, vec3_t ray_dir, float *t_min, float *t_max)
+{
+    const float bot = -TILE_DEPTH * Y_COORDS_PER_TILE;
+    const float mins[3] = {
+        map->pos.x - res.chunk_w * res.field_w, 
+        bot, 
+        map->pos.z
+    };
+    const float maxs[3] = {
+        map->pos.x, 
+        top, 
+        map->pos.z + res.chunk_h * res.field_h
+    };
+
+    for(int i = 0; i < 3; i++) {
+        if(fabs(ray_dir.raw[i]) < EPSILON) {
+            if(ray_origin.raw[i] < mins[i] || ray_origin.raw[i] > maxs[i])
+                return false;
+            continue;
+        }
+        float ta = (mins[i] - ray_origin.raw[i]) / ray_dir.raw[i];
+        float tb = (maxs[i] - ray_origin.raw[i]) / ray_dir.raw[i];
+        *t_min = MAX(*t_min, MIN(ta, tb));
+        *t_max = MIN(*t_max, MAX(ta, tb));
+    }
+    return (*t_min <= *t_max);
+}
+
+/* Test the tiles under the [t0, t1] segment of the ray, front to back. 
+ */
+static bool rc_intersect_tiles(const struct map *map, struct map_resolution res, 
+                               vec3_t ray_origin, vec3_t ray_dir, float t0, float t1,
+                               struct tile_desc *out_intersec, float *out_t)
+{
+    struct line_seg_2d seg = {
+        ray_origin.x + t0 * ray_dir.x, 
+        ray_origin.z + t0 * ray_dir.z,
+        ray_origin.x + t1 * ray_dir.x, 
+        ray_origin.z + t1 * ray_dir.z,
     };
 
     struct tile_desc cts[MAX_CANDIDATE_TILES];
-    int len = M_Tile_LineSupercoverTilesSorted(res, s_ctx.map->pos, y_eq_0_seg, cts, MAX_CANDIDATE_TILES);
+    int len = M_Tile_LineSupercoverTilesSorted(res, map->pos, seg, cts, MAX_CANDIDATE_TILES);
 
     for(int i = 0; i < len; i++) {
     
-        struct aabb tile_aabb = aabb_for_tile(cts[i], s_ctx.map);
+        struct aabb tile_aabb = aabb_for_tile(cts[i], map);
         float t;
 
         /* The first level check is to see if the ray intersects the AABB */
-        if(C_RayIntersectsAABB(ray_origin, ray_dir, tile_aabb, &t)) {
+        if(!C_RayIntersectsAABB(ray_origin, ray_dir, tile_aabb, &t))
+            continue;
 
-            /* If the ray hits the AABB, perform the second level check:
-             * Check if it intersects the exact triangle mesh of the tile. */
-            vec3_t tile_mesh[VERTS_PER_TILE];
-            mat4x4_t model;
+        /* If the ray hits the AABB, perform the second level check:
+         * Check if it intersects the exact triangle mesh of the tile. */
+        vec3_t tile_mesh[VERTS_PER_TILE];
+        mat4x4_t model;
 
-            M_ModelMatrixForChunk(s_ctx.map, (struct chunkpos){cts[i].chunk_r, cts[i].chunk_c}, &model);
-            int num_verts = R_TileGetTriMesh(s_ctx.map, &cts[i], &model, tile_mesh);
+        M_ModelMatrixForChunk(map, (struct chunkpos){cts[i].chunk_r, cts[i].chunk_c}, &model);
+        int num_verts = R_TileGetTriMesh(map, &cts[i], &model, tile_mesh);
 
-            if(C_RayIntersectsTriMesh(ray_origin, ray_dir, tile_mesh, num_verts, &t)) {
+        if(C_RayIntersectsTriMesh(ray_origin, ray_dir, tile_mesh, num_verts, &t)) {
+            *out_intersec = cts[i]; 
+            *out_t = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Walk the chunks under the ray front to back (2D DDA over the chunk grid) 
+ * and only test the tiles of the chunks which the ray passes through below 
+ * their' highest tile. This typically leaves a handful of chunks out of 
+ * the the whole map.
+ */
+static bool rc_raycast(const struct map *map, float top, vec3_t ray_origin, vec3_t ray_dir, 
+                       float max_t, struct tile_desc *out_intersec, float *out_t)
+{
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+
+    float t_min = 0.0f, t_max = max_t;
+    if(!rc_clip_ray(map, res, top, ray_origin, ray_dir, &t_min, &t_max))
+        return false;
 
-                PFM_Vec3_Scale(&ray_dir, t, &ray_dir);
-                PFM_Vec3_Add(&ray_origin, &ray_dir, out_pos);
+    /* Chunk grid coordinates. Recall X increases to the left in our engine */
+    const float u0 = (map->pos.x - (ray_origin.x + t_min * ray_dir.x)) / res.field_w;
+    const float v0 = ((ray_origin.z + t_min * ray_dir.z) - map->pos.z) / res.field_h;
+    const float du = -ray_dir.x / res.field_w;
+    const float dv =  ray_dir.z / res.field_h;
 
-                *out_intersec = cts[i]; 
-                return true;
-            }
+    int c = CLAMP((int)floorf(u0), 0, res.chunk_w - 1);
+    int r = CLAMP((int)floorf(v0), 0, res.chunk_h - 1);
+
+    const int step_c = (du > 0.0f) ? 1 : -1;
+    const int step_r = (dv > 0.0f) ? 1 : -1;
+    const float delta_c = (du != 0.0f) ? fabs(1.0f / du) : FLT_MAX;
+    const float delta_r = (dv != 0.0f) ? fabs(1.0f / dv) : FLT_MAX;
+
+    float next_c = FLT_MAX, next_r = FLT_MAX;
+    if(du != 0.0f)
+        next_c = t_min + ((c + (du > 0.0f)) - u0) / du;
+    if(dv != 0.0f)
+        next_r = t_min + ((r + (dv > 0.0f)) - v0) / dv;
+
+    float t = t_min;
+    while(true) {
+
+        float t_exit = MIN(MIN(next_c, next_r), t_max);
+        const struct pfchunk *chunk = &map->chunks[r * map->width + c];
+
+        float y_begin = ray_origin.y + t * ray_dir.y;
+        float y_end = ray_origin.y + t_exit * ray_dir.y;
+        float chunk_top = chunk->max_height * Y_COORDS_PER_TILE;
+
+        if(MIN(y_begin, y_end) <= chunk_top
+        && rc_intersect_tiles(map, res, ray_origin, ray_dir, t, t_exit, out_intersec, out_t)) {
+            return (*out_t <= max_t);
+        }
+
+        if(t_exit >= t_max)
+            break;
+
+        if(next_c < next_r) {
+            c += step_c;
+            t = next_c;
+            next_c += delta_c;
+        }else{
+            r += step_r;
+            t = next_r;
+            next_r += delta_r;
         }
+        if(c < 0 || c >= res.chunk_w || r < 0 || r >= res.chunk_h)
+            break;
     }
     return false;
 }
 
+static bool rc_find_intersection(vec3_t ray_origin, vec3_t ray_dir,
+                                 struct tile_desc *out_intersec, vec3_t *out_pos)
+{
+    float t;
+    float top = rc_map_top(s_ctx.map);
+    if(!rc_raycast(s_ctx.map, top, ray_origin, ray_dir, FLT_MAX, out_intersec, &t))
+        return false;
+
+    PFM_Vec3_Scale(&ray_dir, t, &ray_dir);
+    PFM_Vec3_Add(&ray_origin, &ray_dir, out_pos);
+    return true;
+}
+
 static void rc_compute(void)
 {
     vec3_t ray_origin = rc_unproject_mouse_coords();
@@ -321,3 +449,40 @@ bool M_Raycast_CameraIntersecCoord(const struct camera *cam, vec3_t *out)
     return rc_find_intersection(ray_origin, ray_dir, &(struct tile_desc){0}, out);
 }
 
+void M_Raycast_UpdateChunkHeight(struct pfchunk *chunk)
+{
+    int ret = -TILE_DEPTH;
+    for(int i = 0; i < TILES_PER_CHUNK_HEIGHT * TILES_PER_CHUNK_WIDTH; i++) {
+        ret = MAX(ret, tile_top_height(&chunk->tiles[i]));
+    }
+    chunk->max_height = ret;
+}
+
+size_t M_RaycastBatch(const struct map *map, size_t nrays, const vec3_t origins[], 
+                      const vec3_t dirs[], const float max_dists[], struct map_ray_hit out[])
+{
+    PERF_ENTER();
+
+    size_t ret = 0;
+    float top = rc_map_top(map);
+
+    for(size_t i = 0; i < nrays; i++) {
+
+        float max_t = max_dists ? max_dists[i] : FLT_MAX;
+        struct tile_desc td;
+        float t;
+
+        out[i].hit = rc_raycast(map, top, origins[i], dirs[i], max_t, &td, &t);
+        if(!out[i].hit)
+            continue;
+
+        vec3_t delta;
+        vec3_t dir = dirs[i];
+        PFM_Vec3_Scale(&dir, t, &delta);
+        PFM_Vec3_Add((vec3_t*)&origins[i], &delta, &out[i].pos);
+        out[i].t = t;
+        ret++;
+    }
+    PERF_RETURN(ret);
+}
+
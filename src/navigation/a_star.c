@@ -39,6 +39,8 @@
 #include "../lib/public/pqueue.h"
 #include "../lib/public/khash.h"
 #include "fieldcache.h"
+#include "../lib/public/mem.h"
+#include "../sched.h"
 
 #include <assert.h>
 #include <string.h>
@@ -53,13 +55,52 @@ PQUEUE_IMPL(static, coord, struct coord)
 PQUEUE_TYPE(portal, struct portal_hop)
 PQUEUE_IMPL(static, portal, struct portal_hop)
 
+IPQUEUE_TYPE(int, int)
+IPQUEUE_IMPL(static, int, int)
+
 KHASH_MAP_INIT_INT64(key_coord, struct coord)
 KHASH_MAP_INIT_INT64(key_portal, struct portal_hop)
 KHASH_MAP_INIT_INT64(key_float, float)
+KHASH_MAP_INIT_INT64(key_int, int)
 
 #define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
 #define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
 #define MAX_PORTAL_NEIGHBS  (256)
+/* The width and height of a super-region, in chunks */
+#define REGION_CHUNKS       (4)
+#define REGION_NPORTALS     (REGION_CHUNKS * REGION_CHUNKS * MAX_PORTALS_PER_CHUNK)
+/* Searches between regions closer than this are done on the flat graph only */
+#define REGION_MIN_DIST     (2)
+
+/* A node of the coarse graph: a portal which leads to another region */
+struct hier_node{
+    const struct portal *portal;
+    int                  region;
+    /* Index of the node for 'portal->connected' */
+    int                  cross;
+};
+
+struct hier_region{
+    /* The region's nodes are contiguous, starting at 'first'  */
+    size_t  first;
+    size_t  nnodes;
+    /* A 'nnodes x nnodes' matrix of the costs of travelling between the 
+     * region's nodes without leaving the region. Unreachable pairs have 
+     * a cost of FLT_MAX. Blockers are not taken into account. 
+     */
+    float  *dists;
+};
+
+static enum grid_search s_grid_search = GRID_SEARCH_JPS;
+
+struct portal_hier{
+    size_t              width, height;
+    size_t              nnodes;
+    struct hier_node   *nodes;
+    struct hier_region *regions;
+    khash_t(key_int)   *node_for_portal;
+};
 
 #define kh_put_val(name, table, key, val)               \
     do{                                                 \
@@ -260,6 +301,15 @@ static bool portal_path_found(const struct nav_private *priv, enum nav_layer lay
     return false;
 }
 
+static void reverse_path(vec_coord_t *path)
+{
+    for(int i = 0, j = vec_size(path) - 1; i < j; i++, j--) {
+        struct coord tmp = vec_AT(path, i);
+        vec_AT(path, i) = vec_AT(path, j);
+        vec_AT(path, j) = tmp;
+    }
+}
+
 static float heuristic(struct coord a, struct coord b)
 {
     /* Octile Distance:
@@ -288,133 +338,218 @@ static float portal_node_penalty(void)
     return sqrt(pow(FIELD_RES_R, 2.0f) + pow(FIELD_RES_C, 2.0f));
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
+static int hier_region_idx(const struct portal_hier *hier, struct coord chunk)
+{
+    return (chunk.r / REGION_CHUNKS) * hier->width + (chunk.c / REGION_CHUNKS);
+}
 
-bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
-                    const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
-                    enum nav_layer layer, vec_coord_t *out_path, float *out_cost)
+static int hier_region_dist(struct coord a, struct coord b)
 {
-    PERF_ENTER();
+    int dr = abs(a.r / REGION_CHUNKS - b.r / REGION_CHUNKS);
+    int dc = abs(a.c / REGION_CHUNKS - b.c / REGION_CHUNKS);
+    return dr + dc;
+}
 
-    struct grid_path_desc gp = {0};
-    vec_coord_init(&gp.path);
-    vec_coord_resize(&gp.path, 512);
+static uint64_t portal_key(const struct portal *port)
+{
+    return (uint64_t)(uintptr_t)port;
+}
 
-    if(N_FC_GetGridPath(start, finish, chunk, layer, &gp)) {
+static bool hier_is_boundary(const struct portal *port)
+{
+    return (port->chunk.r / REGION_CHUNKS != port->connected->chunk.r / REGION_CHUNKS)
+        || (port->chunk.c / REGION_CHUNKS != port->connected->chunk.c / REGION_CHUNKS);
+}
 
-        if(!gp.exists)
-            PERF_RETURN(false);
+/* Index of the portal among all the portals of the region with the 
+ * specified top-left chunk, or -1 if it is not in the region.
+ */
+static int hier_local_idx(const struct nav_private *priv, enum nav_layer layer, 
+                          struct coord base, const struct portal *port)
+{
+    int lr = port->chunk.r - base.r;
+    int lc = port->chunk.c - base.c;
+    if(lr < 0 || lr >= REGION_CHUNKS || lc < 0 || lc >= REGION_CHUNKS)
+        return -1;
 
-        *out_cost = gp.cost;
-        vec_coord_copy(out_path, &gp.path);
-        PERF_RETURN(true);
-    }
+    const struct nav_chunk *chunk = &priv->chunks[layer][port->chunk.r * priv->width + port->chunk.c];
+    return (lr * REGION_CHUNKS + lc) * MAX_PORTALS_PER_CHUNK + (port - chunk->portals);
+}
 
-    pq_coord_t          frontier;
-    khash_t(key_coord) *came_from;
-    khash_t(key_float) *running_cost;
-    
-    pq_coord_init(&frontier);
-    if(NULL == (came_from = kh_init(key_coord)))
-        goto fail_came_from;
-    if(NULL == (running_cost = kh_init(key_float)))
-        goto fail_running_cost;
+static void hier_relax(ipq_int_t *frontier, float *costs, const struct portal **ports,
+                       int idx, const struct portal *port, float cost)
+{
+    if(idx < 0 || cost >= costs[idx])
+        return;
+    costs[idx] = cost;
+    ports[idx] = port;
+    ipq_int_push(frontier, idx, cost, idx);
+}
 
-    kh_resize(key_coord, came_from, 1024);
-    kh_resize(key_float, running_cost, 1024);
+/* Run Dijkstra's algorithm from every node of the region over the portals 
+ * inside of it, filling in the travel cost matrix. 
+ */
+static bool hier_region_dists(const struct nav_private *priv, enum nav_layer layer,
+                              struct portal_hier *hier, int region_idx)
+{
+    struct hier_region *region = &hier->regions[region_idx];
+    const size_t n = region->nnodes;
+    struct coord base = (struct coord){
+        (region_idx / hier->width) * REGION_CHUNKS,
+        (region_idx % hier->width) * REGION_CHUNKS
+    };
 
-    kh_put_val(key_float, running_cost, coord_to_key(start), 0.0f);
-    pq_coord_push(&frontier, 0.0f, start);
+    region->dists = malloc(MAX(n * n, 1) * sizeof(float));
+    if(!region->dists)
+        return false;
 
-    while(pq_size(&frontier) > 0) {
+    float *costs = malloc(REGION_NPORTALS * sizeof(float));
+    const struct portal **ports = malloc(REGION_NPORTALS * sizeof(struct portal*));
+    if(!costs || !ports) {
+        free(costs);
+        free(ports);
+        return false;
+    }
 
-        struct coord curr;
-        pq_coord_pop(&frontier, &curr);
+    ipq_int_t frontier;
+    if(!ipq_int_init(&frontier, REGION_NPORTALS)) {
+        free(costs);
+        free(ports);
+        return false;
+    }
 
-        if(0 == memcmp(&curr, &finish, sizeof(struct coord)))
-            break;
+    for(int i = 0; i < n; i++) {
 
-        struct coord neighbours[8];
-        float neighbour_costs[8];
-        int num_neighbours = neighbours_grid(cost_field, curr, neighbours, neighbour_costs);
+        for(int j = 0; j < REGION_NPORTALS; j++)
+            costs[j] = FLT_MAX;
 
-        for(int i = 0; i < num_neighbours; i++) {
+        const struct portal *src = hier->nodes[region->first + i].portal;
+        hier_relax(&frontier, costs, ports, 
+            hier_local_idx(priv, layer, base, src), src, 0.0f);
 
-            struct coord *next = &neighbours[i];
-            khiter_t k = kh_get(key_float, running_cost, coord_to_key(curr));
-            assert(k != kh_end(running_cost));
-            float new_cost = kh_value(running_cost, k) + neighbour_costs[i];
+        while(ipq_size(&frontier) > 0) {
 
-            if((k = kh_get(key_float, running_cost, coord_to_key(*next))) == kh_end(running_cost)
-            || new_cost < kh_value(running_cost, k)) {
+            int curr;
+            ipq_int_pop(&frontier, &curr);
 
-                kh_put_val(key_float, running_cost, coord_to_key(*next), new_cost);
-                float priority = new_cost + heuristic(finish, *next);
-                pq_coord_push(&frontier, priority, *next);
-                kh_put_val(key_coord, came_from, coord_to_key(*next), curr);
+            const struct portal *port = ports[curr];
+            for(int j = 0; j < port->num_neighbours; j++) {
+
+                const struct portal *next = port->edges[j].neighbour;
+                float cost = costs[curr] + port->edges[j].cost + portal_node_penalty();
+                hier_relax(&frontier, costs, ports, 
+                    hier_local_idx(priv, layer, base, next), next, cost);
             }
+
+            const struct portal *conn = port->connected;
+            hier_relax(&frontier, costs, ports, hier_local_idx(priv, layer, base, conn), 
+                conn, costs[curr] + 1.0f + portal_node_penalty());
+        }
+
+        for(int j = 0; j < n; j++) {
+            const struct portal *dst = hier->nodes[region->first + j].portal;
+            region->dists[i * n + j] = costs[hier_local_idx(priv, layer, base, dst)];
         }
     }
-    
-    if(kh_get(key_coord, came_from, coord_to_key(finish)) == kh_end(came_from))
-        goto fail_find_path;
 
-    vec_coord_reset(out_path);
+    ipq_int_destroy(&frontier);
+    free(costs);
+    free(ports);
+    return true;
+}
 
-    /* We have our path at this point. Walk backwards along the path to build a 
-     * vector of the nodes along the path. */
-    struct coord curr = finish;
-    while(0 != memcmp(&curr, &start, sizeof(struct coord))) {
+static void hier_relax_node(ipq_int_t *frontier, float *costs, int *came_from,
+                            int node, int from, float cost)
+{
+    if(cost >= costs[node])
+        return;
+    costs[node] = cost;
+    came_from[node] = from;
+    ipq_int_push(frontier, node, cost, node);
+}
 
-        vec_coord_push(out_path, curr);
-        khiter_t k = kh_get(key_coord, came_from, coord_to_key(curr));
-        assert(k != kh_end(came_from));
-        curr = kh_value(came_from, k);
+/* Search the coarse graph for a path from the region holding 'src' to the 
+ * region holding 'dst', and mark every region along it in 'out_mask'. The 
+ * travel cost from the source tile to the boundary of its' region is not 
+ * known at this level, so all of the source region's nodes start out with 
+ * a zero cost.
+ */
+static bool hier_corridor(const struct portal_hier *hier, struct coord src, 
+                          struct coord dst, uint8_t *out_mask)
+{
+    const int src_region = hier_region_idx(hier, src);
+    const int dst_region = hier_region_idx(hier, dst);
+    memset(out_mask, 0, hier->width * hier->height);
+
+    float *costs = malloc(MAX(hier->nnodes, 1) * sizeof(float));
+    int *came_from = malloc(MAX(hier->nnodes, 1) * sizeof(int));
+    if(!costs || !came_from) {
+        free(costs);
+        free(came_from);
+        return false;
     }
-    vec_coord_push(out_path, start);
 
-    /* Reverse the path vector */
-    for(int i = 0, j = vec_size(out_path) - 1; i < j; i++, j--) {
-        struct coord tmp = vec_AT(out_path, i);
-        vec_AT(out_path, i) = vec_AT(out_path, j);
-        vec_AT(out_path, j) = tmp;
+    for(int i = 0; i < hier->nnodes; i++) {
+        costs[i] = FLT_MAX;
+        came_from[i] = -1;
     }
 
-    khiter_t k = kh_get(key_float, running_cost, coord_to_key(finish));
-    assert(k != kh_end(running_cost));
-    *out_cost = kh_value(running_cost, k);
+    ipq_int_t frontier;
+    if(!ipq_int_init(&frontier, hier->nnodes)) {
+        free(costs);
+        free(came_from);
+        return false;
+    }
 
-    pq_coord_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-    kh_destroy(key_coord, came_from);
+    const struct hier_region *sreg = &hier->regions[src_region];
+    for(int i = 0; i < sreg->nnodes; i++) {
+        hier_relax_node(&frontier, costs, came_from, sreg->first + i, -1, 0.0f);
+    }
 
-    /* Cache the result */
-    gp.exists = true;
-    vec_coord_copy(&gp.path, out_path);
-    gp.cost = *out_cost;
-    N_FC_PutGridPath(start, finish, chunk, layer, &gp);
-    PERF_RETURN(true);
+    int found = -1;
+    while(ipq_size(&frontier) > 0) {
 
-fail_find_path:
-    gp.exists = false;
-    N_FC_PutGridPath(start, finish, chunk, layer, &gp);
+        int curr;
+        ipq_int_pop(&frontier, &curr);
 
-    pq_coord_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-fail_running_cost:
-    kh_destroy(key_coord, came_from);
-fail_came_from:
-    PERF_RETURN(false);
+        const struct hier_node *node = &hier->nodes[curr];
+        if(node->region == dst_region) {
+            found = curr;
+            break;
+        }
+
+        hier_relax_node(&frontier, costs, came_from, node->cross, curr, 
+            costs[curr] + 1.0f + portal_node_penalty());
+
+        const struct hier_region *region = &hier->regions[node->region];
+        const size_t local = curr - region->first;
+
+        for(int j = 0; j < region->nnodes; j++) {
+
+            float dist = region->dists[local * region->nnodes + j];
+            if(dist == FLT_MAX)
+                continue;
+            hier_relax_node(&frontier, costs, came_from, region->first + j, curr, 
+                costs[curr] + dist);
+        }
+    }
+
+    for(int curr = found; curr != -1; curr = came_from[curr]) {
+        out_mask[hier->nodes[curr].region] = 1;
+    }
+
+    ipq_int_destroy(&frontier);
+    free(costs);
+    free(came_from);
+    return (found != -1);
 }
 
-bool AStar_PortalGraphPath(struct tile_desc start_tile, struct tile_desc end_tile, 
-                           const struct portal *finish, const struct nav_private *priv, 
-                           enum nav_layer layer, vec_portal_t *out_path, float *out_cost)
+static bool portal_graph_path(struct tile_desc start_tile, struct tile_desc end_tile, 
+                              const struct portal *finish, const struct nav_private *priv, 
+                              enum nav_layer layer, const uint8_t *region_mask,
+                              vec_portal_t *out_path, float *out_cost)
 {
-    PERF_ENTER();
-
+    const struct portal_hier *hier = priv->hier[layer];
     pq_portal_t          frontier;
     khash_t(key_portal) *came_from;
     khash_t(key_float)  *running_cost;
@@ -474,6 +609,9 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, struct tile_desc end_til
             const struct portal *next = neighbours[i];
             struct portal_hop next_hop = (struct portal_hop){next, neighb_enter_liids[i]};
 
+            if(region_mask && !region_mask[hier_region_idx(hier, next->chunk)])
+                continue;
+
             khiter_t k = kh_get(key_float, running_cost, phop_to_key(&curr));
             assert(k != kh_end(running_cost));
             float new_cost = kh_value(running_cost, k) + neighbour_costs[i] + portal_node_penalty();
@@ -523,7 +661,7 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, struct tile_desc end_til
     kh_destroy(key_float, running_cost);
     kh_destroy(key_portal, came_from);
 
-    PERF_RETURN(true);
+    return true;
 
 fail_find_path:
     pq_portal_destroy(&frontier);
@@ -531,6 +669,507 @@ fail_find_path:
 fail_running_cost:
     kh_destroy(key_portal, came_from);
 fail_came_from:
-    PERF_RETURN(false);
+    return false;
+}
+
+static bool grid_path_a_star(struct coord start, struct coord finish, 
+                             const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                             vec_coord_t *out_path, float *out_cost)
+{
+    pq_coord_t          frontier;
+    khash_t(key_coord) *came_from;
+    khash_t(key_float) *running_cost;
+    
+    pq_coord_init(&frontier);
+    if(NULL == (came_from = kh_init(key_coord)))
+        goto fail_came_from;
+    if(NULL == (running_cost = kh_init(key_float)))
+        goto fail_running_cost;
+
+    kh_resize(key_coord, came_from, 1024);
+    kh_resize(key_float, running_cost, 1024);
+
+    kh_put_val(key_float, running_cost, coord_to_key(start), 0.0f);
+    pq_coord_push(&frontier, 0.0f, start);
+
+    while(pq_size(&frontier) > 0) {
+
+        struct coord curr;
+        pq_coord_pop(&frontier, &curr);
+
+        if(0 == memcmp(&curr, &finish, sizeof(struct coord)))
+            break;
+
+        struct coord neighbours[8];
+        float neighbour_costs[8];
+        int num_neighbours = neighbours_grid(cost_field, curr, neighbours, neighbour_costs);
+
+        for(int i = 0; i < num_neighbours; i++) {
+
+            struct coord *next = &neighbours[i];
+            khiter_t k = kh_get(key_float, running_cost, coord_to_key(curr));
+            assert(k != kh_end(running_cost));
+            float new_cost = kh_value(running_cost, k) + neighbour_costs[i];
+
+            if((k = kh_get(key_float, running_cost, coord_to_key(*next))) == kh_end(running_cost)
+            || new_cost < kh_value(running_cost, k)) {
+
+                kh_put_val(key_float, running_cost, coord_to_key(*next), new_cost);
+                float priority = new_cost + heuristic(finish, *next);
+                pq_coord_push(&frontier, priority, *next);
+                kh_put_val(key_coord, came_from, coord_to_key(*next), curr);
+            }
+        }
+    }
+    
+    if(kh_get(key_coord, came_from, coord_to_key(finish)) == kh_end(came_from))
+        goto fail_find_path;
+
+    vec_coord_reset(out_path);
+
+    /* We have our path at this point. Walk backwards along the path to build a 
+     * vector of the nodes along the path. */
+    struct coord curr = finish;
+    while(0 != memcmp(&curr, &start, sizeof(struct coord))) {
+
+        vec_coord_push(out_path, curr);
+        khiter_t k = kh_get(key_coord, came_from, coord_to_key(curr));
+        assert(k != kh_end(came_from));
+        curr = kh_value(came_from, k);
+    }
+    vec_coord_push(out_path, start);
+    reverse_path(out_path);
+
+    khiter_t k = kh_get(key_float, running_cost, coord_to_key(finish));
+    assert(k != kh_end(running_cost));
+    *out_cost = kh_value(running_cost, k);
+
+    pq_coord_destroy(&frontier);
+    kh_destroy(key_float, running_cost);
+    kh_destroy(key_coord, came_from);
+    return true;
+
+fail_find_path:
+    pq_coord_destroy(&frontier);
+    kh_destroy(key_float, running_cost);
+fail_running_cost:
+    kh_destroy(key_coord, came_from);
+fail_came_from:
+    return false;
+}
+
+static bool jps_walkable(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], int r, int c)
+{
+    if(r < 0 || r >= FIELD_RES_R)
+        return false;
+    if(c < 0 || c >= FIELD_RES_C)
+        return false;
+    return (cost_field[r][c] != COST_IMPASSABLE);
+}
+
+static int sign(int val)
+{
+    return (val > 0) - (val < 0);
+}
+
+/* Jump point search prunes the nodes which are reached by an optimal path 
+ * not going through the current node, which relies on every step having 
+ * the same cost. It can only be used for fields with a single cost.
+ */
+static bool jps_applicable(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C])
+{
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+        if(cost_field[r][c] != COST_IMPASSABLE && cost_field[r][c] != 1)
+            return false;
+    }}
+    return true;
+}
+
+static bool jps_step_legal(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                           struct coord from, int dr, int dc)
+{
+    if(!jps_walkable(cost_field, from.r + dr, from.c + dc))
+        return false;
+    /* Same as 'neighbours_grid': diagonal steps may cut one blocked corner, 
+     * but not squeeze between two */
+    if(dr && dc 
+    && !jps_walkable(cost_field, from.r + dr, from.c) 
+    && !jps_walkable(cost_field, from.r, from.c + dc))
+        return false;
+    return true;
+}
+
+static bool jps_has_forced(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                           struct coord curr, int dr, int dc)
+{
+    int r = curr.r, c = curr.c;
+
+    if(dr && dc) {
+        return (jps_walkable(cost_field, r + dr, c - dc) 
+             && !jps_walkable(cost_field, r, c - dc) 
+             && jps_walkable(cost_field, r + dr, c))
+            || (jps_walkable(cost_field, r - dr, c + dc) 
+             && !jps_walkable(cost_field, r - dr, c) 
+             && jps_walkable(cost_field, r, c + dc));
+    }
+    if(dr) {
+        return jps_walkable(cost_field, r + dr, c)
+            && ((jps_walkable(cost_field, r + dr, c + 1) && !jps_walkable(cost_field, r, c + 1))
+             || (jps_walkable(cost_field, r + dr, c - 1) && !jps_walkable(cost_field, r, c - 1)));
+    }
+    return jps_walkable(cost_field, r, c + dc)
+        && ((jps_walkable(cost_field, r + 1, c + dc) && !jps_walkable(cost_field, r + 1, c))
+         || (jps_walkable(cost_field, r - 1, c + dc) && !jps_walkable(cost_field, r - 1, c)));
+}
+
+/* Step from 'from' in the direction (dr, dc) until reaching a tile that has 
+ * to be expanded (the finish, or one with a forced neighbour). Diagonal
+ * jumps stop at tiles from which either of the straight jumps succeeds. 
+ */
+static bool jps_jump(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord from, 
+                     int dr, int dc, struct coord finish, struct coord *out)
+{
+    struct coord curr = from;
+    while(jps_step_legal(cost_field, curr, dr, dc)) {
+
+        curr.r += dr;
+        curr.c += dc;
+
+        if(0 == memcmp(&curr, &finish, sizeof(struct coord))
+        || jps_has_forced(cost_field, curr, dr, dc)) {
+            *out = curr;
+            return true;
+        }
+
+        struct coord dummy;
+        if(dr && dc 
+        && (jps_jump(cost_field, curr, dr, 0, finish, &dummy) 
+        ||  jps_jump(cost_field, curr, 0, dc, finish, &dummy))) {
+            *out = curr;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int jps_directions(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord curr, 
+                          int dr, int dc, struct coord out_dirs[static 8])
+{
+    int ret = 0;
+    int r = curr.r, c = curr.c;
+
+    if(!dr && !dc) {
+        for(int i = -1; i <= 1; i++) {
+        for(int j = -1; j <= 1; j++) {
+            if(i || j)
+                out_dirs[ret++] = (struct coord){i, j};
+        }}
+        return ret;
+    }
+
+    if(dr && dc) {
+        out_dirs[ret++] = (struct coord){dr, dc};
+        out_dirs[ret++] = (struct coord){dr, 0};
+        out_dirs[ret++] = (struct coord){0, dc};
+        if(!jps_walkable(cost_field, r, c - dc))
+            out_dirs[ret++] = (struct coord){dr, -dc};
+        if(!jps_walkable(cost_field, r - dr, c))
+            out_dirs[ret++] = (struct coord){-dr, dc};
+    }else if(dr) {
+        out_dirs[ret++] = (struct coord){dr, 0};
+        if(!jps_walkable(cost_field, r, c + 1))
+            out_dirs[ret++] = (struct coord){dr, 1};
+        if(!jps_walkable(cost_field, r, c - 1))
+            out_dirs[ret++] = (struct coord){dr, -1};
+    }else{
+        out_dirs[ret++] = (struct coord){0, dc};
+        if(!jps_walkable(cost_field, r + 1, c))
+            out_dirs[ret++] = (struct coord){1, dc};
+        if(!jps_walkable(cost_field, r - 1, c))
+            out_dirs[ret++] = (struct coord){-1, dc};
+    }
+    return ret;
+}
+
+/* Same as 'grid_path_a_star', except only the jump points are added to the
+ * frontier. The tiles between consecutive jump points are filled in when 
+ * walking back along the path. 
+ */
+static bool grid_path_jps(struct coord start, struct coord finish, 
+                          const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                          vec_coord_t *out_path, float *out_cost)
+{
+    pq_coord_t          frontier;
+    khash_t(key_coord) *came_from;
+    khash_t(key_float) *running_cost;
+    
+    pq_coord_init(&frontier);
+    if(NULL == (came_from = kh_init(key_coord)))
+        goto fail_came_from;
+    if(NULL == (running_cost = kh_init(key_float)))
+        goto fail_running_cost;
+
+    kh_resize(key_coord, came_from, 256);
+    kh_resize(key_float, running_cost, 256);
+
+    kh_put_val(key_float, running_cost, coord_to_key(start), 0.0f);
+    pq_coord_push(&frontier, 0.0f, start);
+
+    while(pq_size(&frontier) > 0) {
+
+        struct coord curr;
+        pq_coord_pop(&frontier, &curr);
+
+        if(0 == memcmp(&curr, &finish, sizeof(struct coord)))
+            break;
+
+        int dr = 0, dc = 0;
+        khiter_t k = kh_get(key_coord, came_from, coord_to_key(curr));
+        if(k != kh_end(came_from)) {
+            struct coord parent = kh_value(came_from, k);
+            dr = sign(curr.r - parent.r);
+            dc = sign(curr.c - parent.c);
+        }
+
+        k = kh_get(key_float, running_cost, coord_to_key(curr));
+        assert(k != kh_end(running_cost));
+        float curr_cost = kh_value(running_cost, k);
+
+        struct coord dirs[8];
+        int ndirs = jps_directions(cost_field, curr, dr, dc, dirs);
+
+        for(int i = 0; i < ndirs; i++) {
+
+            struct coord next;
+            if(!jps_jump(cost_field, curr, dirs[i].r, dirs[i].c, finish, &next))
+                continue;
+
+            float new_cost = curr_cost + heuristic(curr, next);
+            if((k = kh_get(key_float, running_cost, coord_to_key(next))) == kh_end(running_cost)
+            || new_cost < kh_value(running_cost, k)) {
+
+                kh_put_val(key_float, running_cost, coord_to_key(next), new_cost);
+                float priority = new_cost + heuristic(finish, next);
+                pq_coord_push(&frontier, priority, next);
+                kh_put_val(key_coord, came_from, coord_to_key(next), curr);
+            }
+        }
+    }
+    
+    if(kh_get(key_coord, came_from, coord_to_key(finish)) == kh_end(came_from))
+        goto fail_find_path;
+
+    vec_coord_reset(out_path);
+
+    /* Every pair of consecutive jump points is joined by a straight or a 
+     * diagonal line. Add all the tiles on the lines, accumulating the cost 
+     * in the same way as 'grid_path_a_star'. */
+    float cost = 0.0f;
+    struct coord curr = finish;
+    while(0 != memcmp(&curr, &start, sizeof(struct coord))) {
+
+        khiter_t k = kh_get(key_coord, came_from, coord_to_key(curr));
+        assert(k != kh_end(came_from));
+        struct coord parent = kh_value(came_from, k);
+
+        int dr = sign(parent.r - curr.r);
+        int dc = sign(parent.c - curr.c);
+        float cost_mult = (dr && dc) ? sqrt(2) : 1.0f;
+
+        while(0 != memcmp(&curr, &parent, sizeof(struct coord))) {
+            vec_coord_push(out_path, curr);
+            cost += cost_field[curr.r][curr.c] * cost_mult;
+            curr.r += dr;
+            curr.c += dc;
+        }
+    }
+    vec_coord_push(out_path, start);
+    reverse_path(out_path);
+    *out_cost = cost;
+
+    pq_coord_destroy(&frontier);
+    kh_destroy(key_float, running_cost);
+    kh_destroy(key_coord, came_from);
+    return true;
+
+fail_find_path:
+    pq_coord_destroy(&frontier);
+    kh_destroy(key_float, running_cost);
+fail_running_cost:
+    kh_destroy(key_coord, came_from);
+fail_came_from:
+    return false;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
+                    const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                    enum nav_layer layer, vec_coord_t *out_path, float *out_cost)
+{
+    PERF_ENTER();
+
+    struct grid_path_desc gp = {0};
+    vec_coord_init(&gp.path);
+    vec_coord_resize(&gp.path, 512);
+
+    if(N_FC_GetGridPath(start, finish, chunk, layer, &gp)) {
+
+        if(!gp.exists)
+            PERF_RETURN(false);
+
+        *out_cost = gp.cost;
+        vec_coord_copy(out_path, &gp.path);
+        PERF_RETURN(true);
+    }
+
+    bool found;
+    if(s_grid_search == GRID_SEARCH_JPS && jps_applicable(cost_field)) {
+        found = grid_path_jps(start, finish, cost_field, out_path, out_cost);
+    }else{
+        found = grid_path_a_star(start, finish, cost_field, out_path, out_cost);
+    }
+
+    /* Cache the result */
+    gp.exists = found;
+    if(found) {
+        vec_coord_copy(&gp.path, out_path);
+        gp.cost = *out_cost;
+    }
+    N_FC_PutGridPath(start, finish, chunk, layer, &gp);
+    PERF_RETURN(found);
+}
+
+void AStar_SetGridSearch(enum grid_search search)
+{
+    s_grid_search = search;
+}
+
+bool AStar_PortalGraphPath(struct tile_desc start_tile, struct tile_desc end_tile, 
+                           const struct portal *finish, const struct nav_private *priv, 
+                           enum nav_layer layer, vec_portal_t *out_path, float *out_cost)
+{
+    PERF_ENTER();
+
+    const struct portal_hier *hier = priv->hier[layer];
+    struct coord src_chunk = (struct coord){start_tile.chunk_r, start_tile.chunk_c};
+
+    /* Search coarse-to-fine: if the refined search restricted to the regions 
+     * along the coarse path fails (due to blockers, which the coarse graph 
+     * does not know about), fall back to searching the whole portal graph. 
+     */
+    if(hier && hier_region_dist(src_chunk, finish->chunk) >= REGION_MIN_DIST) {
+
+        STALLOC(uint8_t, mask, hier->width * hier->height);
+        bool found = hier_corridor(hier, src_chunk, finish->chunk, mask)
+                  && portal_graph_path(start_tile, end_tile, finish, priv, layer, mask, 
+                                       out_path, out_cost);
+        STFREE(mask);
+
+        if(found) {
+            PERF_COUNTER_ADD("nav.hier_paths", 1);
+            PERF_RETURN(true);
+        }
+    }
+
+    bool ret = portal_graph_path(start_tile, end_tile, finish, priv, layer, NULL, 
+        out_path, out_cost);
+    PERF_RETURN(ret);
+}
+
+struct portal_hier *AStar_HierBuild(const struct nav_private *priv, enum nav_layer layer)
+{
+    struct portal_hier *ret = calloc(1, sizeof(struct portal_hier));
+    if(!ret)
+        goto fail;
+
+    ret->width = (priv->width + REGION_CHUNKS - 1) / REGION_CHUNKS;
+    ret->height = (priv->height + REGION_CHUNKS - 1) / REGION_CHUNKS;
+
+    ret->regions = calloc(ret->width * ret->height, sizeof(struct hier_region));
+    if(!ret->regions)
+        goto fail;
+
+    ret->node_for_portal = kh_init(key_int);
+    if(!ret->node_for_portal)
+        goto fail;
+
+    size_t maxnodes = priv->width * priv->height * MAX_PORTALS_PER_CHUNK;
+    ret->nodes = malloc(maxnodes * sizeof(struct hier_node));
+    if(!ret->nodes)
+        goto fail;
+
+    /* Gather the nodes, region by region */
+    for(int region = 0; region < ret->width * ret->height; region++) {
+
+        int base_r = (region / ret->width) * REGION_CHUNKS;
+        int base_c = (region % ret->width) * REGION_CHUNKS;
+        ret->regions[region].first = ret->nnodes;
+
+        for(int r = base_r; r < MIN(base_r + REGION_CHUNKS, priv->height); r++) {
+        for(int c = base_c; c < MIN(base_c + REGION_CHUNKS, priv->width); c++) {
+
+            const struct nav_chunk *chunk = &priv->chunks[layer][r * priv->width + c];
+            for(int i = 0; i < chunk->num_portals; i++) {
+
+                const struct portal *port = &chunk->portals[i];
+                if(!hier_is_boundary(port))
+                    continue;
+
+                int status;
+                khiter_t k = kh_put(key_int, ret->node_for_portal, portal_key(port), &status);
+                if(status == -1)
+                    goto fail;
+                kh_value(ret->node_for_portal, k) = ret->nnodes;
+
+                ret->nodes[ret->nnodes++] = (struct hier_node){
+                    .portal = port,
+                    .region = region,
+                    .cross = -1
+                };
+            }
+        }}
+        ret->regions[region].nnodes = ret->nnodes - ret->regions[region].first;
+    }
+
+    for(int i = 0; i < ret->nnodes; i++) {
+
+        khiter_t k = kh_get(key_int, ret->node_for_portal, portal_key(ret->nodes[i].portal->connected));
+        assert(k != kh_end(ret->node_for_portal));
+        ret->nodes[i].cross = kh_value(ret->node_for_portal, k);
+    }
+
+    for(int region = 0; region < ret->width * ret->height; region++) {
+        if(!hier_region_dists(priv, layer, ret, region))
+            goto fail;
+        Sched_TryYield();
+    }
+
+    return ret;
+
+fail:
+    AStar_HierFree(ret);
+    return NULL;
+}
+
+void AStar_HierFree(struct portal_hier *hier)
+{
+    if(!hier)
+        return;
+
+    if(hier->regions) {
+        for(int i = 0; i < hier->width * hier->height; i++) {
+            free(hier->regions[i].dists);
+        }
+    }
+    if(hier->node_for_portal) {
+        kh_destroy(key_int, hier->node_for_portal);
+    }
+    free(hier->regions);
+    free(hier->nodes);
+    free(hier);
 }
 
@@ -45,6 +45,7 @@
 
 
 struct nav_private;
+struct portal_hier;
 
 /* 
  * Say we have the following scenario: there are 3 chunks in a column
@@ -99,6 +100,16 @@ struct portal_hop{
     uint16_t liid;
 };
 
+enum grid_search{
+    /* Plain 8-connected A* */
+    GRID_SEARCH_ASTAR,
+    /* Jump point search, which only expands the tiles where the optimal path 
+     * may change direction. It is used for chunks where all pathable tiles 
+     * have the same cost, with the other chunks falling back to A*. Both 
+     * find paths of the same cost. */
+    GRID_SEARCH_JPS,
+};
+
 VEC_TYPE(coord, struct coord)
 VEC_IMPL(static inline, coord, struct coord)
 
@@ -116,6 +127,13 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
                     const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
                     enum nav_layer layer, vec_coord_t *out_path, float *out_cost);
 
+/* ------------------------------------------------------------------------
+ * Set the algorithm used by 'AStar_GridPath' for the paths which are not
+ * already cached.
+ * ------------------------------------------------------------------------
+ */
+void AStar_SetGridSearch(enum grid_search search);
+
 /* ------------------------------------------------------------------------
  * Finds the shortest path between a tile and a node in a portal graph. Returns 
  * true if a path is found, false otherwise. If returning true, 'out_path' holds 
@@ -126,5 +144,18 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, struct tile_desc end_til
                            const struct portal *finish, const struct nav_private *priv, 
                            enum nav_layer layer, vec_portal_t *out_path, float *out_cost);
 
+/* ------------------------------------------------------------------------
+ * Build the second level of the portal graph abstraction for the specified
+ * layer. Chunks are clustered into square super-regions, and the costs of 
+ * travelling between every pair of a region's boundary portals (i.e. those
+ * leading to another region) are precomputed. Long-distance portal graph 
+ * searches are first done on this coarse graph, and then refined over only 
+ * the regions it passes through. Returns NULL on failure, in which case all 
+ * searches are done on the flat portal graph.
+ * ------------------------------------------------------------------------
+ */
+struct portal_hier *AStar_HierBuild(const struct nav_private *priv, enum nav_layer layer);
+void                AStar_HierFree(struct portal_hier *hier);
+
 #endif
 
@@ -38,15 +38,23 @@
 #include "../entity.h"
 #include "../sched.h"
 #include "../perf.h"
+#include "../main.h"
 #include "../map/public/tile.h"
 #include "../game/public/game.h"
 #include "../lib/public/pqueue.h"
 #include "../lib/public/mem.h"
+#include "../config.h"
 
+#include <SDL.h>
 #include <string.h>
 #include <assert.h>
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define FIELD_SSE2
+#include <emmintrin.h>
+#endif
+
 
 #define MIN(a, b)           ((a) < (b) ? (a) : (b))
 #define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
@@ -54,11 +62,23 @@
 #define SEARCH_BUFFER       (16.0f)
 #define IDX(r, width, c)    ((r) * (width) + (c))
 
+/* The integration fields are built with bucket queues, as all the tile costs
+ * are integers and the largest of them is COST_IMPASSABLE - 1. The binary and
+ * indexed heaps are only kept around for comparison in N_BenchmarkQueues.
+ */
+#define FIELD_NBUCKETS      (256)
+
 PQUEUE_TYPE(coord, struct coord)
 PQUEUE_IMPL(static, coord, struct coord)
 
-PQUEUE_TYPE(td, struct tile_desc)
-PQUEUE_IMPL(static, td, struct tile_desc)
+IPQUEUE_TYPE(coord, struct coord)
+IPQUEUE_IMPL(static, coord, struct coord)
+
+BQUEUE_TYPE(coord, struct coord)
+BQUEUE_IMPL(static, coord, struct coord)
+
+BQUEUE_TYPE(td, struct tile_desc)
+BQUEUE_IMPL(static, td, struct tile_desc)
 
 struct box_xz{
     float x_min, x_max;
@@ -89,16 +109,6 @@ static int field_compare_tiles(void *a, void *b)
     return !((bc->r == ac->r) && (bc->c == ac->c));
 }
 
-static int field_compare_tds(void *a, void *b)
-{
-    struct tile_desc *ac = a;
-    struct tile_desc *bc = b;
-    return !((bc->chunk_r == ac->chunk_r) 
-          && (bc->chunk_c == ac->chunk_c)
-          && (bc->tile_r  == ac->tile_r)
-          && (bc->tile_c  == ac->tile_c));
-}
-
 static bool field_tile_passable(const struct nav_chunk *chunk, struct coord tile)
 {
     if(chunk->cost_base[tile.r][tile.c] == COST_IMPASSABLE)
@@ -487,16 +497,139 @@ static void field_pad_wavefront(struct LOS_field *out_los)
     }}
 }
 
+/* Compute the cost of entering each tile of the chunk for the sweeping 
+ * integrator. Tiles which may not be entered have an infinite cost. When 
+ * 'nonpass' is set, only the impassable tiles may be entered.
+ */
+static void field_sweep_costs(
+    const struct nav_chunk *chunk, 
+    bool                    nonpass,
+    int                     faction_id, 
+    float                   out[FIELD_RES_R][FIELD_RES_C])
+{
+    uint16_t enemies = enemies_for_faction(faction_id);
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        struct coord tile = (struct coord){r, c};
+        bool enter;
+        if(nonpass) {
+            enter = !field_tile_passable(chunk, tile);
+        }else if(faction_id == FACTION_ID_NONE) {
+            enter = field_tile_passable(chunk, tile);
+        }else{
+            enter = field_tile_passable_no_enemies(chunk, tile, enemies);
+        }
+        out[r][c] = enter ? chunk->cost_base[r][c] : INFINITY;
+    }}
+}
+
+/* Relax every tile of the row 'dst' from the vertically adjacent row 'src'. 
+ * Returns true if any of the costs were lowered.
+ */
+static bool field_relax_row(float *dst, const float *src, const float *cost)
+{
+    int changed = 0;
+#if defined(FIELD_SSE2)
+    assert(FIELD_RES_C % 4 == 0);
+    for(int c = 0; c < FIELD_RES_C; c += 4) {
+
+        __m128 curr = _mm_loadu_ps(dst + c);
+        __m128 cand = _mm_add_ps(_mm_loadu_ps(src + c), _mm_loadu_ps(cost + c));
+        changed |= _mm_movemask_ps(_mm_cmplt_ps(cand, curr));
+        _mm_storeu_ps(dst + c, _mm_min_ps(curr, cand));
+    }
+#else
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        float cand = src[c] + cost[c];
+        if(cand < dst[c]) {
+            dst[c] = cand;
+            changed = 1;
+        }
+    }
+#endif
+    return changed;
+}
+
+/* Relax the tiles of a row from their horizontal neighbours, in both 
+ * directions. Returns true if any of the costs were lowered.
+ */
+static bool field_scan_row(float *row, const float *cost)
+{
+    bool changed = false;
+    for(int c = 1; c < FIELD_RES_C; c++) {
+
+        float cand = row[c - 1] + cost[c];
+        if(cand < row[c]) {
+            row[c] = cand;
+            changed = true;
+        }
+    }
+    for(int c = FIELD_RES_C - 2; c >= 0; c--) {
+
+        float cand = row[c + 1] + cost[c];
+        if(cand < row[c]) {
+            row[c] = cand;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/* An alternative to the priority queue-based integrators. The field is 
+ * repeatedly swept down and up, relaxing each row from the previous one
+ * and then along itself, until a fixed point is reached. Since the costs 
+ * are integral, the result is identical to that of the 'field_build_integration'
+ * family of functions, but the work is done in dense row-wise passes with 
+ * no queue maintenance. The seeds are the tiles with a finite cost in 'inout'.
+ */
+static void field_sweep_integration(
+    const float cost[FIELD_RES_R][FIELD_RES_C],
+    float       inout[FIELD_RES_R][FIELD_RES_C])
+{
+    bool changed;
+    do{
+        changed = field_scan_row(inout[0], cost[0]);
+
+        for(int r = 1; r < FIELD_RES_R; r++) {
+            changed |= field_relax_row(inout[r], inout[r - 1], cost[r]);
+            changed |= field_scan_row(inout[r], cost[r]);
+        }
+
+        for(int r = FIELD_RES_R - 2; r >= 0; r--) {
+            changed |= field_relax_row(inout[r], inout[r + 1], cost[r]);
+            changed |= field_scan_row(inout[r], cost[r]);
+        }
+
+    }while(changed);
+}
+
 static void field_build_integration(
-    pq_coord_t             *frontier, 
+    bq_coord_t             *frontier, 
     const struct nav_chunk *chunk, 
     int                     faction_id, 
     float                   inout[FIELD_RES_R][FIELD_RES_C])
 {
-    while(pq_size(frontier) > 0) {
+    if(CONFIG_FIELD_SWEEP_INTEGRATION) {
+
+        float cost[FIELD_RES_R][FIELD_RES_C];
+        field_sweep_costs(chunk, false, faction_id, cost);
+        field_sweep_integration(cost, inout);
+        return;
+    }
 
+    while(bq_size(frontier) > 0) {
+
+        int prio;
         struct coord curr;
-        pq_coord_pop(frontier, &curr);
+        bq_coord_top_prio(frontier, &prio);
+        bq_coord_pop(frontier, &curr);
+
+        /* A stale entry of a tile which has since been reached at a lower cost */
+        if(prio > inout[curr.r][curr.c])
+            continue;
 
         struct coord neighbours[8];
         uint8_t neighbour_costs[8];
@@ -509,8 +642,7 @@ static void field_build_integration(
             if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
 
                 inout[neighbours[i].r][neighbours[i].c] = total_cost;
-                if(!pq_coord_contains(frontier, field_compare_tiles, neighbours[i]))
-                    pq_coord_push(frontier, total_cost, neighbours[i]);
+                bq_coord_push(frontier, total_cost, neighbours[i]);
             }
         }
     }
@@ -520,7 +652,7 @@ static void field_build_integration(
  * which may straddle chunk boundaries.
  */
 static void field_build_integration_region(
-    pq_td_t                  *frontier,
+    bq_td_t                  *frontier,
     const struct nav_private *priv,
     enum nav_layer            layer,
     uint16_t                  enemies,
@@ -530,10 +662,12 @@ static void field_build_integration_region(
     struct map_resolution res;
     N_GetResolution(priv, &res);
 
-    while(pq_size(frontier) > 0) {
+    while(bq_size(frontier) > 0) {
 
+        int prio;
         struct tile_desc curr;
-        pq_td_pop(frontier, &curr);
+        bq_td_top_prio(frontier, &prio);
+        bq_td_pop(frontier, &curr);
 
         struct tile_desc neighbours[8];
         uint8_t neighbour_costs[8];
@@ -545,6 +679,9 @@ static void field_build_integration_region(
         assert(dr >= 0 && dr < region.r);
         assert(dc >= 0 && dc < region.c);
 
+        if(prio > inout[dr * region.r + dc])
+            continue;
+
         for(int i = 0; i < num_neighbours; i++) {
 
             if(tile_outside_region(res, region, neighbours[i]))
@@ -562,8 +699,7 @@ static void field_build_integration_region(
             if(total_cost < inout[neighb_dr * region.r + neighb_dc]) {
 
                 inout[neighb_dr * region.r + neighb_dc] = total_cost;
-                if(!pq_td_contains(frontier, field_compare_tds, neighbours[i]))
-                    pq_td_push(frontier, total_cost, neighbours[i]);
+                bq_td_push(frontier, total_cost, neighbours[i]);
             }
         }
     }
@@ -573,15 +709,29 @@ static void field_build_integration_region(
  * will be added to the frontier 
  */
 static void field_build_integration_nonpass(
-    pq_coord_t             *frontier, 
+    bq_coord_t             *frontier, 
     const struct nav_chunk *chunk, 
     int                     faction_id, 
     float                   inout[FIELD_RES_R][FIELD_RES_C])
 {
-    while(pq_size(frontier) > 0) {
+    if(CONFIG_FIELD_SWEEP_INTEGRATION) {
+
+        float cost[FIELD_RES_R][FIELD_RES_C];
+        field_sweep_costs(chunk, true, faction_id, cost);
+        field_sweep_integration(cost, inout);
+        return;
+    }
+
+    while(bq_size(frontier) > 0) {
 
+        int prio;
         struct coord curr;
-        pq_coord_pop(frontier, &curr);
+        bq_coord_top_prio(frontier, &prio);
+        bq_coord_pop(frontier, &curr);
+
+        /* A stale entry of a tile which has since been reached at a lower cost */
+        if(prio > inout[curr.r][curr.c])
+            continue;
 
         struct coord neighbours[8];
         uint8_t neighbour_costs[8];
@@ -597,8 +747,7 @@ static void field_build_integration_nonpass(
             if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
 
                 inout[neighbours[i].r][neighbours[i].c] = total_cost;
-                if(!pq_coord_contains(frontier, field_compare_tiles, neighbours[i]))
-                    pq_coord_push(frontier, total_cost, neighbours[i]);
+                bq_coord_push(frontier, total_cost, neighbours[i]);
             }
         }
     }
@@ -608,7 +757,7 @@ static void field_build_integration_nonpass(
  * which may straddle chunk boundaries.
  */
 static void field_build_integration_nonpass_region(
-    pq_td_t                  *frontier,
+    bq_td_t                  *frontier,
     const struct nav_private *priv,
     enum nav_layer            layer,
     uint16_t                  enemies,
@@ -618,10 +767,12 @@ static void field_build_integration_nonpass_region(
     struct map_resolution res;
     N_GetResolution(priv, &res);
 
-    while(pq_size(frontier) > 0) {
+    while(bq_size(frontier) > 0) {
 
+        int prio;
         struct tile_desc curr;
-        pq_td_pop(frontier, &curr);
+        bq_td_top_prio(frontier, &prio);
+        bq_td_pop(frontier, &curr);
 
         struct tile_desc neighbours[8];
         uint8_t neighbour_costs[8];
@@ -633,6 +784,9 @@ static void field_build_integration_nonpass_region(
         assert(dr >= 0 && dr < region.r);
         assert(dc >= 0 && dc < region.c);
 
+        if(prio > inout[dr * region.r + dc])
+            continue;
+
         for(int i = 0; i < num_neighbours; i++) {
 
             struct tile_desc neighb = neighbours[i];
@@ -654,20 +808,113 @@ static void field_build_integration_nonpass_region(
             if(total_cost < inout[neighb_dr * region.r + neighb_dc]) {
 
                 inout[neighb_dr * region.r + neighb_dc] = total_cost;
-                if(!pq_td_contains(frontier, field_compare_tds, neighb))
-                    pq_td_push(frontier, total_cost, neighb);
+                bq_td_push(frontier, total_cost, neighb);
             }
         }
     }
 }
 
-static void field_build_flow(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_field *inout_flow)
+#if defined(FIELD_SSE2)
+
+static __m128 field_select_ps(__m128 mask, __m128 a, __m128 b)
 {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static __m128i field_select_epi32(__m128 mask, __m128i a, __m128i b)
+{
+    __m128i imask = _mm_castps_si128(mask);
+    return _mm_or_si128(_mm_and_si128(imask, a), _mm_andnot_si128(imask, b));
+}
+
+/* Vectorized equivalent of calling 'field_flow_dir' for every tile. The 
+ * integration field is padded with a border of impassable tiles so that 
+ * the neighbours of 4 adjacent tiles can be loaded at once.
+ */
+static void field_build_flow_simd(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_field *inout_flow)
+{
+    enum{ PAD_C = FIELD_RES_C + 4 };
+    float padded[FIELD_RES_R + 2][PAD_C];
+
+    for(int c = 0; c < PAD_C; c++) {
+        padded[0][c] = INFINITY;
+        padded[FIELD_RES_R + 1][c] = INFINITY;
+    }
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        padded[r + 1][0] = INFINITY;
+        memcpy(&padded[r + 1][1], intf[r], sizeof(intf[r]));
+        for(int c = FIELD_RES_C + 1; c < PAD_C; c++) {
+            padded[r + 1][c] = INFINITY;
+        }
+    }
+
+    const __m128 inf = _mm_set1_ps(INFINITY);
+    for(int r = 0; r < FIELD_RES_R; r++) {
+
+        const float *up = padded[r];
+        const float *mid = padded[r + 1];
+        const float *down = padded[r + 2];
+
+        for(int c = 0; c < FIELD_RES_C; c += 4) {
+
+            __m128 n  = _mm_loadu_ps(up + c + 1);
+            __m128 s  = _mm_loadu_ps(down + c + 1);
+            __m128 w  = _mm_loadu_ps(mid + c);
+            __m128 e  = _mm_loadu_ps(mid + c + 2);
+            __m128 nw = _mm_loadu_ps(up + c);
+            __m128 ne = _mm_loadu_ps(up + c + 2);
+            __m128 sw = _mm_loadu_ps(down + c);
+            __m128 se = _mm_loadu_ps(down + c + 2);
+
+            __m128 min = _mm_min_ps(_mm_min_ps(n, s), _mm_min_ps(w, e));
+
+            /* Diagonal directions are allowed only when both of the side tiles are passable */
+            __m128 n_ok = _mm_cmplt_ps(n, inf);
+            __m128 s_ok = _mm_cmplt_ps(s, inf);
+            __m128 w_ok = _mm_cmplt_ps(w, inf);
+            __m128 e_ok = _mm_cmplt_ps(e, inf);
+
+            min = _mm_min_ps(min, field_select_ps(_mm_and_ps(n_ok, w_ok), nw, inf));
+            min = _mm_min_ps(min, field_select_ps(_mm_and_ps(n_ok, e_ok), ne, inf));
+            min = _mm_min_ps(min, field_select_ps(_mm_and_ps(s_ok, w_ok), sw, inf));
+            min = _mm_min_ps(min, field_select_ps(_mm_and_ps(s_ok, e_ok), se, inf));
+
+            /* Apply the same priorities as 'field_flow_dir', lowest first */
+            __m128i dir = _mm_set1_epi32(FD_SE);
+            dir = field_select_epi32(_mm_cmpeq_ps(sw, min), _mm_set1_epi32(FD_SW), dir);
+            dir = field_select_epi32(_mm_cmpeq_ps(ne, min), _mm_set1_epi32(FD_NE), dir);
+            dir = field_select_epi32(_mm_cmpeq_ps(nw, min), _mm_set1_epi32(FD_NW), dir);
+            dir = field_select_epi32(_mm_cmpeq_ps(w, min),  _mm_set1_epi32(FD_W), dir);
+            dir = field_select_epi32(_mm_cmpeq_ps(e, min),  _mm_set1_epi32(FD_E), dir);
+            dir = field_select_epi32(_mm_cmpeq_ps(s, min),  _mm_set1_epi32(FD_S), dir);
+            dir = field_select_epi32(_mm_cmpeq_ps(n, min),  _mm_set1_epi32(FD_N), dir);
+
+            int32_t dirs[4];
+            _mm_storeu_si128((__m128i*)dirs, dir);
+
+            for(int i = 0; i < 4; i++) {
+
+                float curr = intf[r][c + i];
+                if(curr == INFINITY)
+                    continue;
+
+                inout_flow->field[r][c + i].dir_idx = (curr == 0.0f) ? FD_NONE : dirs[i];
+            }
+        }
+    }
+}
 
+#endif
+
+static void field_build_flow(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_field *inout_flow)
+{
     /* Build the flow field from the integration field. Don't touch any impassable tiles
      * as they may have already been set in the case that a single chunk is divided into
      * multiple passable 'islands', but a computed path takes us through more than one of
      * these 'islands'. */
+#if defined(FIELD_SSE2)
+    field_build_flow_simd(intf, inout_flow);
+#else
     for(int r = 0; r < FIELD_RES_R; r++) {
     for(int c = 0; c < FIELD_RES_C; c++) {
 
@@ -683,6 +930,7 @@ static void field_build_flow(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_f
         inout_flow->field[r][c].dir_idx = field_flow_dir(FIELD_RES_R, FIELD_RES_C, 
             (const float*)intf, (struct coord){r, c});
     }}
+#endif
 }
 
 /* Like 'field_build_flow', but potentially having an integration field that is a different
@@ -802,20 +1050,13 @@ static void field_chunk_bounds(vec3_t map_pos, struct coord chunk_coord, struct
     out->z_max = out->z_min + chunk_z_dim;
 }
 
-static bool field_enemy_ent(int faction_id, uint32_t ent)
+static bool field_enemy_ent(uint16_t enemies, uint32_t ent)
 {
-    if(G_GetFactionID(ent) == faction_id)
+    if(!(enemies & (0x1 << G_GetFactionID(ent))))
         return false;
     if(!(G_FlagsGet(ent) & ENTITY_FLAG_COMBATABLE))
         return false;
 
-    enum diplomacy_state ds;
-    bool result = G_GetDiplomacyState(faction_id, G_GetFactionID(ent), &ds);
-    assert(result);
-
-    if(ds != DIPLOMACY_STATE_WAR)
-        return false;
-
     struct obb obb;
     Entity_CurrentOBB(ent, &obb, false);
     uint16_t pmask = G_GetPlayerControlledFactions();
@@ -1081,7 +1322,7 @@ static size_t field_enemies_initial_frontier(
     for(int i = 0; i < num_ents; i++) {
     
         uint32_t curr_enemy = ents[i];
-        if(!field_enemy_ent(enemies->faction_id, curr_enemy))
+        if(!field_enemy_ent(enemies->enemies, curr_enemy))
             continue;
         if(G_Combat_IsDying(curr_enemy))
             continue;
@@ -1353,98 +1594,70 @@ static size_t field_passable_frontier(
     return ret;
 }
 
-/* Update the field to guide towards the nearest possible enemy of the 
- * specified faction.
+/* The fields guiding towards enemies or entities have a padding of half a chunk 
+ * width/length on every side of them. Initially, we will build a flow field with 
+ * this 'padding' around it, but then we will cut out the center FIELD_RES_R * 
+ * FIELD_RES_C region and use that as the final field. The purpose of this is to 
+ * consider targets which are immediately outside the chunk bounds and also guide 
+ * towards them if they are optimal. 
  */
-static void field_update_enemies(
-    struct coord              chunk_coord, 
-    const struct nav_private *priv, 
-    enum nav_layer            layer, 
-    struct enemies_desc       target, 
-    struct flow_field        *inout_flow)
+static struct region field_padded_region(const struct nav_private *priv, struct coord chunk_coord)
 {
-    struct map_resolution res;
-    N_GetResolution(priv, &res);
-
-    pq_td_t frontier;
-    pq_td_init(&frontier);
-
-    /* Make the integration field have a padding of of half a chunk width/length 
-     * on every side of it. Initially, we will build a flow field with this 'padding'
-     * around it, but then we will cut out the center FIELD_RES_R * FIELD_RES_C 
-     * region and use that as the final field. The purpose of this is to consider 
-     * enemies which are immediately outside the chunk bounds and also guide towards
-     * them if they are optimal targets. 
-     */
     const int rdim = (priv->height > 1) ? FIELD_RES_R * 2 + (FIELD_RES_R % 2) : FIELD_RES_R;
     const int cdim = (priv->width  > 1) ? FIELD_RES_C * 2 + (FIELD_RES_C % 2) : FIELD_RES_C;
 
-    STALLOC(float, integration_field, rdim * cdim);
-    for(int r = 0; r < rdim; r++) {
-    for(int c = 0; c < cdim; c++) {
-        integration_field[r * rdim + c] = INFINITY;
-    }}
-
     struct tile_desc base = (struct tile_desc){
         .chunk_r = (chunk_coord.r > 0) ? chunk_coord.r - 1 : chunk_coord.r,
         .chunk_c = (chunk_coord.c > 0) ? chunk_coord.c - 1 : chunk_coord.c,
         .tile_r  = (chunk_coord.r > 0) ? FIELD_RES_R / 2 + (FIELD_RES_R % 2) : 0,
         .tile_c  = (chunk_coord.c > 0) ? FIELD_RES_C / 2 + (FIELD_RES_C % 2) : 0,
     };
+    return (struct region){base, rdim, cdim};
+}
 
-    STALLOC(struct tile_desc, init_frontier, rdim * cdim);
-    size_t ninit = field_enemies_initial_frontier(&target, priv, base, rdim, cdim,
-        layer, init_frontier, rdim * cdim);
-
-    for(int i = 0; i < ninit; i++) {
-
-        struct tile_desc curr = init_frontier[i];
-
-        int dr, dc;
-        M_Tile_Distance(res, &base, &curr, &dr, &dc);
-        assert(dr >= 0 && dr < rdim);
-        assert(dc >= 0 && dc < cdim);
+static size_t field_padded_target_tiles(
+    struct coord              chunk_coord, 
+    const struct nav_private *priv, 
+    enum nav_layer            layer, 
+    struct field_target       target, 
+    struct tile_desc         *out,
+    size_t                    maxout)
+{
+    struct region region = field_padded_region(priv, chunk_coord);
 
-        pq_td_push(&frontier, 0.0f, curr); 
-        integration_field[dr * rdim + dc] = 0.0f;
+    switch(target.type) {
+    case TARGET_ENEMIES:
+        return field_enemies_initial_frontier(&target.enemies, priv, region.base, 
+            region.r, region.c, layer, out, maxout);
+    case TARGET_ENTITY:
+        return field_entity_initial_frontier(&target.ent, priv, region.base, 
+            region.r, region.c, layer, out, maxout);
+    default: assert(0);
     }
-
-    inout_flow->target = (struct field_target){
-        .type = TARGET_ENEMIES,
-        .enemies = target
-    };
-
-    const int roff = (chunk_coord.r > 0) ? FIELD_RES_R / 2 + (FIELD_RES_R % 2) : 0;
-    const int coff = (chunk_coord.c > 0) ? FIELD_RES_C / 2 + (FIELD_RES_C % 2) : 0;
-
-    struct region region = (struct region){base, rdim, cdim};
-    field_build_integration_region(&frontier, priv, layer, 0, 
-        region, integration_field);
-    field_build_flow_region(rdim, cdim, roff, coff, integration_field, inout_flow);
-
-    STFREE(integration_field);
-    STFREE(init_frontier);
-    pq_td_destroy(&frontier);
+    return 0;
 }
 
-/* Update the field to guide towards the nearest possible tile which is 
- * adjacent to one of the tiles occupied by the specified entity.
+/* Update the field to guide towards the nearest of the previously found 
+ * target tiles. This only reads the cost and blockers fields of 'priv'.
  */
-static void field_update_entity(
+static void field_update_padded(
     struct coord              chunk_coord, 
     const struct nav_private *priv, 
     enum nav_layer            layer, 
-    struct entity_desc        target, 
+    struct field_target       target, 
+    size_t                    ntiles,
+    const struct tile_desc   *tiles,
     struct flow_field        *inout_flow)
 {
     struct map_resolution res;
     N_GetResolution(priv, &res);
 
-    pq_td_t frontier;
-    pq_td_init(&frontier);
+    bq_td_t frontier;
+    bq_td_init_alloc(&frontier, FIELD_NBUCKETS, Sched_FrameRealloc, Sched_FrameFree);
 
-    const int rdim = (priv->height > 1) ? FIELD_RES_R * 2 + (FIELD_RES_R % 2) : FIELD_RES_R;
-    const int cdim = (priv->width  > 1) ? FIELD_RES_C * 2 + (FIELD_RES_C % 2) : FIELD_RES_C;
+    struct region region = field_padded_region(priv, chunk_coord);
+    const int rdim = region.r;
+    const int cdim = region.c;
 
     STALLOC(float, integration_field, rdim * cdim);
     for(int r = 0; r < rdim; r++) {
@@ -1452,45 +1665,29 @@ static void field_update_entity(
         integration_field[r * rdim + c] = INFINITY;
     }}
 
-    struct tile_desc base = (struct tile_desc){
-        .chunk_r = (chunk_coord.r > 0) ? chunk_coord.r - 1 : chunk_coord.r,
-        .chunk_c = (chunk_coord.c > 0) ? chunk_coord.c - 1 : chunk_coord.c,
-        .tile_r  = (chunk_coord.r > 0) ? FIELD_RES_R / 2 + (FIELD_RES_R % 2) : 0,
-        .tile_c  = (chunk_coord.c > 0) ? FIELD_RES_C / 2 + (FIELD_RES_C % 2) : 0,
-    };
+    for(int i = 0; i < ntiles; i++) {
 
-    STALLOC(struct tile_desc, init_frontier, rdim * cdim);
-    size_t ninit = field_entity_initial_frontier(&target, priv, base, rdim, cdim,
-        layer, init_frontier, rdim * cdim);
-
-    for(int i = 0; i < ninit; i++) {
-
-        struct tile_desc curr = init_frontier[i];
+        struct tile_desc curr = tiles[i];
 
         int dr, dc;
-        M_Tile_Distance(res, &base, &curr, &dr, &dc);
+        M_Tile_Distance(res, &region.base, &curr, &dr, &dc);
         assert(dr >= 0 && dr < rdim);
         assert(dc >= 0 && dc < cdim);
 
-        pq_td_push(&frontier, 0.0f, curr); 
+        bq_td_push(&frontier, 0, curr); 
         integration_field[dr * rdim + dc] = 0.0f;
     }
 
-    inout_flow->target = (struct field_target){
-        .type = TARGET_ENTITY,
-        .ent = target
-    };
+    inout_flow->target = target;
 
     const int roff = (chunk_coord.r > 0) ? FIELD_RES_R / 2 + (FIELD_RES_R % 2) : 0;
     const int coff = (chunk_coord.c > 0) ? FIELD_RES_C / 2 + (FIELD_RES_C % 2) : 0;
 
-    struct region region = (struct region){base, rdim, cdim};
     field_build_integration_region(&frontier, priv, layer, 0, region, integration_field);
     field_build_flow_region(rdim, cdim, roff, coff, integration_field, inout_flow);
 
     STFREE(integration_field);
-    STFREE(init_frontier);
-    pq_td_destroy(&frontier);
+    bq_td_destroy(&frontier);
 }
 
 static struct region clamped_region(struct nav_private *priv, size_t rdim, size_t cdim,
@@ -1549,6 +1746,178 @@ static struct region clamped_region(struct nav_private *priv, size_t rdim, size_
     };
 }
 
+static double field_bench_ms(uint64_t begin)
+{
+    return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+/* The integration as it was done prior to the bucket queues: a binary heap
+ * which is linearly searched before every push, and which never has its' 
+ * priorities lowered. 
+ */
+static void field_bench_binary_heap(const struct nav_chunk *chunk, 
+                                    float inout[FIELD_RES_R][FIELD_RES_C])
+{
+    pq_coord_t frontier;
+    pq_coord_init(&frontier);
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+        if(inout[r][c] == 0.0f)
+            pq_coord_push(&frontier, 0.0f, (struct coord){r, c});
+    }}
+
+    while(pq_size(&frontier) > 0) {
+
+        struct coord curr;
+        pq_coord_pop(&frontier, &curr);
+
+        struct coord neighbours[8];
+        uint8_t neighbour_costs[8];
+        int num_neighbours = field_neighbours_grid(chunk, curr, true, FACTION_ID_NONE, 
+            neighbours, neighbour_costs);
+
+        for(int i = 0; i < num_neighbours; i++) {
+
+            float total_cost = inout[curr.r][curr.c] + neighbour_costs[i];
+            if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
+
+                inout[neighbours[i].r][neighbours[i].c] = total_cost;
+                if(!pq_coord_contains(&frontier, field_compare_tiles, neighbours[i]))
+                    pq_coord_push(&frontier, total_cost, neighbours[i]);
+            }
+        }
+    }
+    pq_coord_destroy(&frontier);
+}
+
+static void field_bench_indexed_heap(const struct nav_chunk *chunk, 
+                                     float inout[FIELD_RES_R][FIELD_RES_C])
+{
+    ipq_coord_t frontier;
+    ipq_coord_init(&frontier, FIELD_RES_R * FIELD_RES_C);
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+        if(inout[r][c] == 0.0f)
+            ipq_coord_push(&frontier, IDX(r, FIELD_RES_C, c), 0.0f, (struct coord){r, c});
+    }}
+
+    while(ipq_size(&frontier) > 0) {
+
+        struct coord curr;
+        ipq_coord_pop(&frontier, &curr);
+
+        struct coord neighbours[8];
+        uint8_t neighbour_costs[8];
+        int num_neighbours = field_neighbours_grid(chunk, curr, true, FACTION_ID_NONE, 
+            neighbours, neighbour_costs);
+
+        for(int i = 0; i < num_neighbours; i++) {
+
+            float total_cost = inout[curr.r][curr.c] + neighbour_costs[i];
+            if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
+
+                inout[neighbours[i].r][neighbours[i].c] = total_cost;
+                ipq_coord_push(&frontier, IDX(neighbours[i].r, FIELD_RES_C, neighbours[i].c), 
+                    total_cost, neighbours[i]);
+            }
+        }
+    }
+    ipq_coord_destroy(&frontier);
+}
+
+static void field_bench_bucket_queue(const struct nav_chunk *chunk, 
+                                     float inout[FIELD_RES_R][FIELD_RES_C])
+{
+    bq_coord_t frontier;
+    bq_coord_init(&frontier, FIELD_NBUCKETS);
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+        if(inout[r][c] == 0.0f)
+            bq_coord_push(&frontier, 0, (struct coord){r, c});
+    }}
+
+    while(bq_size(&frontier) > 0) {
+
+        int prio;
+        struct coord curr;
+        bq_coord_top_prio(&frontier, &prio);
+        bq_coord_pop(&frontier, &curr);
+
+        if(prio > inout[curr.r][curr.c])
+            continue;
+
+        struct coord neighbours[8];
+        uint8_t neighbour_costs[8];
+        int num_neighbours = field_neighbours_grid(chunk, curr, true, FACTION_ID_NONE, 
+            neighbours, neighbour_costs);
+
+        for(int i = 0; i < num_neighbours; i++) {
+
+            float total_cost = inout[curr.r][curr.c] + neighbour_costs[i];
+            if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
+
+                inout[neighbours[i].r][neighbours[i].c] = total_cost;
+                bq_coord_push(&frontier, total_cost, neighbours[i]);
+            }
+        }
+    }
+    bq_coord_destroy(&frontier);
+}
+
+/* Seed the integration field with the passable tiles of the portal, like 
+ * for the fields leading to the next portal of a path.
+ */
+static bool field_bench_seed(const struct nav_chunk *chunk, const struct portal *port,
+                             float out[FIELD_RES_R][FIELD_RES_C])
+{
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+        out[r][c] = INFINITY;
+    }}
+
+    bool ret = false;
+    for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
+    for(int c = port->endpoints[0].c; c <= port->endpoints[1].c; c++) {
+        if(!field_tile_passable(chunk, (struct coord){r, c}))
+            continue;
+        out[r][c] = 0.0f;
+        ret = true;
+    }}
+    return ret;
+}
+
+static void field_bench_queue(const struct nav_private *priv, enum nav_layer layer, int nruns,
+                              void (*integrate)(const struct nav_chunk*, float[FIELD_RES_R][FIELD_RES_C]),
+                              struct nav_queue_bench_result *out)
+{
+    float integration_field[FIELD_RES_R][FIELD_RES_C];
+
+    for(int i = 0; i < nruns; i++) {
+    for(int j = 0; j < priv->width * priv->height; j++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[layer][j];
+        for(int k = 0; k < chunk->num_portals; k++) {
+
+            if(!field_bench_seed(chunk, &chunk->portals[k], integration_field))
+                continue;
+
+            uint64_t begin = SDL_GetPerformanceCounter();
+            integrate(chunk, integration_field);
+            out->integrate_ms += field_bench_ms(begin);
+            out->nfields++;
+
+            for(int r = 0; r < FIELD_RES_R; r++) {
+            for(int c = 0; c < FIELD_RES_C; c++) {
+                if(integration_field[r][c] != INFINITY)
+                    out->checksum += integration_field[r][c];
+            }}
+        }
+    }}
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -1579,9 +1948,15 @@ ff_id_t N_FlowFieldID(struct coord chunk, struct field_target target, enum nav_l
 
     }else if(target.type == TARGET_ENEMIES) {
 
+        /* Keyed by the set of enemies rather than by the faction, so that
+         * allied factions converging on the same targets share the field. 
+         * Units without a faction treat blockers differently when fixing 
+         * up the field, so they must not share it. */
+        bool no_faction = (target.enemies.faction_id == FACTION_ID_NONE);
         return (((uint64_t)layer)                          << 60)
              | (((uint64_t)target.type)                    << 56)
-             | (((uint64_t)target.enemies.faction_id)      << 24)
+             | (((uint64_t)no_faction)                     << 40)
+             | (((uint64_t)target.enemies.enemies)         << 24)
              | (((uint64_t)chunk.r)                        <<  8)
              | (((uint64_t)chunk.c)                        <<  0);
 
@@ -1628,19 +2003,22 @@ void N_FlowFieldUpdate(
     struct flow_field        *inout_flow)
 {
     PERF_ENTER();
-    if(target.type == TARGET_ENEMIES) {
-        field_update_enemies(chunk_coord, priv, layer, target.enemies, inout_flow);
-        PERF_RETURN_VOID();
-    }
+    PERF_COUNTER_ADD("nav.flow_fields_built", 1);
+
+    if(target.type == TARGET_ENEMIES || target.type == TARGET_ENTITY) {
+
+        STALLOC(struct tile_desc, tiles, FIELD_MAX_TARGET_TILES);
+        size_t ntiles = field_padded_target_tiles(chunk_coord, priv, layer, target, 
+            tiles, FIELD_MAX_TARGET_TILES);
+        field_update_padded(chunk_coord, priv, layer, target, ntiles, tiles, inout_flow);
 
-    if(target.type == TARGET_ENTITY) {
-        field_update_entity(chunk_coord, priv, layer, target.ent, inout_flow);
+        STFREE(tiles);
         PERF_RETURN_VOID();
     }
 
     const struct nav_chunk *chunk = &priv->chunks[layer][IDX(chunk_coord.r, priv->width, chunk_coord.c)];
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    bq_coord_t frontier;
+    bq_coord_init_alloc(&frontier, FIELD_NBUCKETS, Sched_FrameRealloc, Sched_FrameFree);
 
     float integration_field[FIELD_RES_R][FIELD_RES_C];
     for(int r = 0; r < FIELD_RES_R; r++) {
@@ -1655,7 +2033,7 @@ void N_FlowFieldUpdate(
     for(int i = 0; i < ninit; i++) {
 
         struct coord curr = init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
+        bq_coord_push(&frontier, 0, curr); 
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
@@ -1664,7 +2042,36 @@ void N_FlowFieldUpdate(
     field_build_flow(integration_field, inout_flow);
     field_fixup(target, integration_field, inout_flow, chunk);
 
-    pq_coord_destroy(&frontier);
+    bq_coord_destroy(&frontier);
+    PERF_RETURN_VOID();
+}
+
+size_t N_FlowFieldTargetTiles(
+    struct coord              chunk_coord, 
+    const struct nav_private *priv, 
+    enum nav_layer            layer, 
+    struct field_target       target, 
+    struct tile_desc         *out,
+    size_t                    maxout)
+{
+    ASSERT_IN_MAIN_THREAD();
+    return field_padded_target_tiles(chunk_coord, priv, layer, target, out, maxout);
+}
+
+void N_FlowFieldUpdateFromTiles(
+    struct coord              chunk_coord, 
+    const struct nav_private *priv, 
+    enum nav_layer            layer, 
+    struct field_target       target, 
+    size_t                    ntiles,
+    const struct tile_desc   *tiles,
+    struct flow_field        *inout_flow)
+{
+    PERF_ENTER();
+    PERF_COUNTER_ADD("nav.flow_fields_built", 1);
+
+    assert(target.type == TARGET_ENEMIES || target.type == TARGET_ENTITY);
+    field_update_padded(chunk_coord, priv, layer, target, ntiles, tiles, inout_flow);
     PERF_RETURN_VOID();
 }
 
@@ -1681,8 +2088,8 @@ void N_LOSFieldCreate(
     out_los->chunk = chunk_coord;
     memset(out_los->field, 0x00, sizeof(out_los->field));
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    bq_coord_t frontier;
+    bq_coord_init_alloc(&frontier, FIELD_NBUCKETS, Sched_FrameRealloc, Sched_FrameFree);
     const struct nav_chunk *chunk = &priv->chunks[N_DestLayer(id)]
                                                  [chunk_coord.r * priv->width + chunk_coord.c];
 
@@ -1695,7 +2102,7 @@ void N_LOSFieldCreate(
     /* Case 1: LOS for the destination chunk */
     if(chunk_coord.r == target.chunk_r && chunk_coord.c == target.chunk_c) {
 
-        pq_coord_push(&frontier, 0.0f, (struct coord){target.tile_r, target.tile_c});
+        bq_coord_push(&frontier, 0, (struct coord){target.tile_r, target.tile_c});
         integration_field[target.tile_r][target.tile_c] = 0.0f;
         assert(NULL == prev_los);
 
@@ -1754,7 +2161,7 @@ void N_LOSFieldCreate(
                 }
                 if(out_los->field[r][curr_edge_idx].visible) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){r, curr_edge_idx});
+                    bq_coord_push(&frontier, 0, (struct coord){r, curr_edge_idx});
                     integration_field[r][curr_edge_idx] = 0.0f;
                 }
             }
@@ -1773,17 +2180,22 @@ void N_LOSFieldCreate(
                 }
                 if(out_los->field[curr_edge_idx][c].visible) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){curr_edge_idx, c});
+                    bq_coord_push(&frontier, 0, (struct coord){curr_edge_idx, c});
                     integration_field[curr_edge_idx][c] = 0.0f; 
                 }
             }
         }
     }
 
-    while(pq_size(&frontier) > 0) {
+    while(bq_size(&frontier) > 0) {
 
+        int prio;
         struct coord curr;
-        pq_coord_pop(&frontier, &curr);
+        bq_coord_top_prio(&frontier, &prio);
+        bq_coord_pop(&frontier, &curr);
+
+        if(prio > integration_field[curr.r][curr.c])
+            continue;
 
         struct coord neighbours[8];
         uint8_t neighbour_costs[8];
@@ -1813,13 +2225,12 @@ void N_LOSFieldCreate(
                 if(new_cost < integration_field[neighbours[i].r][neighbours[i].c]) {
 
                     integration_field[nr][nc] = new_cost;
-                    if(!pq_coord_contains(&frontier, field_compare_tiles, neighbours[i]))
-                        pq_coord_push(&frontier, new_cost, neighbours[i]);
+                    bq_coord_push(&frontier, new_cost, neighbours[i]);
                 }
             }
         }
     }
-    pq_coord_destroy(&frontier);
+    bq_coord_destroy(&frontier);
 
     /* Add a single tile-wide padding of invisible tiles around the wavefront. This is 
      * because we want to be conservative and not mark any tiles visible from which we
@@ -1850,8 +2261,8 @@ void N_FlowFieldUpdateToNearestPathable(
     size_t ninit = field_passable_frontier(priv, layer, start_coord, 
         chunk_region, init_frontier, ARR_SIZE(init_frontier), NULL, 0);
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    bq_coord_t frontier;
+    bq_coord_init_alloc(&frontier, FIELD_NBUCKETS, Sched_FrameRealloc, Sched_FrameFree);
 
     float integration_field[FIELD_RES_R][FIELD_RES_C];
     for(int r = 0; r < FIELD_RES_R; r++) {
@@ -1865,7 +2276,7 @@ void N_FlowFieldUpdateToNearestPathable(
             init_frontier[i].tile_r,
             init_frontier[i].tile_c
         };
-        pq_coord_push(&frontier, 0.0f, curr); 
+        bq_coord_push(&frontier, 0, curr); 
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
@@ -1883,7 +2294,7 @@ void N_FlowFieldUpdateToNearestPathable(
             (const float*)integration_field, (struct coord){r, c});
     }}
 
-    pq_coord_destroy(&frontier);
+    bq_coord_destroy(&frontier);
 }
 
 void N_FlowFieldUpdateIslandToNearest(
@@ -1903,8 +2314,8 @@ void N_FlowFieldUpdateIslandToNearest(
         .tile_c  = 0,
     };
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    bq_coord_t frontier;
+    bq_coord_init_alloc(&frontier, FIELD_NBUCKETS, Sched_FrameRealloc, Sched_FrameFree);
 
     struct coord init_frontier[FIELD_RES_R * FIELD_RES_C];
     size_t ninit = 0;
@@ -1996,7 +2407,7 @@ void N_FlowFieldUpdateIslandToNearest(
     for(int i = 0; i < new_ninit; i++) {
 
         struct coord curr = new_init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
+        bq_coord_push(&frontier, 0, curr); 
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
@@ -2004,7 +2415,7 @@ void N_FlowFieldUpdateIslandToNearest(
     field_build_flow(integration_field, inout_flow);
     field_fixup(inout_flow->target, integration_field, inout_flow, chunk);
 
-    pq_coord_destroy(&frontier);
+    bq_coord_destroy(&frontier);
 }
 
 vec2_t N_FlowDir(enum flow_dir dir)
@@ -2039,8 +2450,8 @@ void N_CellArrivalFieldCreate(void *nav_private, size_t rdim, size_t cdim,
     struct map_resolution res;
     N_GetResolution(priv, &res);
 
-    pq_td_t frontier;
-    pq_td_init(&frontier);
+    bq_td_t frontier;
+    bq_td_init_alloc(&frontier, FIELD_NBUCKETS, Sched_FrameRealloc, Sched_FrameFree);
 
     size_t integration_field_size = sizeof(float) * rdim * cdim;
     assert(workspace_size >= integration_field_size);
@@ -2082,14 +2493,14 @@ void N_CellArrivalFieldCreate(void *nav_private, size_t rdim, size_t cdim,
     assert(dr >= 0 && dr < rdim);
     assert(dc >= 0 && dc < cdim);
 
-    pq_td_push(&frontier, 0.0f, target); 
+    bq_td_push(&frontier, 0, target); 
     integration_field[dr * rdim + dc] = 0.0f;
 
     struct region region = (struct region){base, rdim, cdim};
     field_build_integration_region(&frontier, priv, layer, enemies, region, integration_field);
     field_build_flow_unaligned(rdim, cdim, integration_field, out);
 
-    pq_td_destroy(&frontier);
+    bq_td_destroy(&frontier);
     PERF_RETURN_VOID();
 }
 
@@ -2127,8 +2538,8 @@ void N_CellArrivalFieldUpdateToNearestPathable(void *nav_private, size_t rdim, s
     size_t ninit = field_passable_frontier(priv, layer, start, 
         clamped, init_frontier, rdim * cdim, workspace, workspace_size);
 
-    pq_td_t frontier;
-    pq_td_init(&frontier);
+    bq_td_t frontier;
+    bq_td_init_alloc(&frontier, FIELD_NBUCKETS, Sched_FrameRealloc, Sched_FrameFree);
 
     for(int r = 0; r < rdim; r++) {
     for(int c = 0; c < cdim; c++) {
@@ -2162,7 +2573,7 @@ void N_CellArrivalFieldUpdateToNearestPathable(void *nav_private, size_t rdim, s
         assert(dr >= 0 && dr < rdim);
         assert(dc >= 0 && dc < cdim);
 
-        pq_td_push(&frontier, 0.0f, init_frontier[i]);
+        bq_td_push(&frontier, 0, init_frontier[i]);
         integration_field[dr * rdim + dc] = 0.0f;
     }
 
@@ -2188,6 +2599,16 @@ void N_CellArrivalFieldUpdateToNearestPathable(void *nav_private, size_t rdim, s
         set_flow_cell(dir, r, c, rdim, cdim, inout);
     }}
 
-    pq_td_destroy(&frontier);
+    bq_td_destroy(&frontier);
 }
 
+void N_BenchmarkQueues(void *nav_private, enum nav_layer layer, int nruns, 
+                       struct nav_queue_bench_result out[NAV_BENCH_NQUEUES])
+{
+    const struct nav_private *priv = nav_private;
+    memset(out, 0, NAV_BENCH_NQUEUES * sizeof(struct nav_queue_bench_result));
+
+    field_bench_queue(priv, layer, nruns, field_bench_binary_heap, &out[NAV_BENCH_BINARY_HEAP]);
+    field_bench_queue(priv, layer, nruns, field_bench_indexed_heap, &out[NAV_BENCH_INDEXED_HEAP]);
+    field_bench_queue(priv, layer, nruns, field_bench_bucket_queue, &out[NAV_BENCH_BUCKET_QUEUE]);
+}
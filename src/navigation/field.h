@@ -42,6 +42,11 @@
 #include "../map/public/tile.h"
 #include <stdbool.h>
 
+/* Upper bound on the number of target tiles of a TARGET_ENEMIES or 
+ * TARGET_ENTITY field, which spans its chunk and half of each neighbour. */
+#define FIELD_MAX_TARGET_TILES \
+    ((FIELD_RES_R * 2 + (FIELD_RES_R % 2)) * (FIELD_RES_C * 2 + (FIELD_RES_C % 2)))
+
 typedef uint64_t ff_id_t;
 struct nav_private;
 
@@ -55,6 +60,9 @@ struct LOS_field{
 
 struct enemies_desc{
     int          faction_id;
+    /* The factions at war with 'faction_id'. The field only depends on
+     * this set, so it is shared by all factions with the same enemies. */
+    uint16_t     enemies;
     vec3_t       map_pos;
     struct coord chunk;
 };
@@ -140,6 +148,34 @@ void    N_FlowFieldUpdate(struct coord              chunk_coord,
                           struct field_target       target, 
                           struct flow_field        *inout_flow);
 
+/* ------------------------------------------------------------------------
+ * Find the tiles that a TARGET_ENEMIES or TARGET_ENTITY field will guide 
+ * towards. These depend on the current entity positions, so this must be 
+ * called from the main thread. Returns the number of tiles written to 'out'.
+ * ------------------------------------------------------------------------
+ */
+size_t  N_FlowFieldTargetTiles(struct coord              chunk_coord, 
+                               const struct nav_private *priv, 
+                               enum nav_layer            layer, 
+                               struct field_target       target, 
+                               struct tile_desc         *out,
+                               size_t                    maxout);
+
+/* ------------------------------------------------------------------------
+ * Populate a TARGET_ENEMIES or TARGET_ENTITY field from the target tiles 
+ * previously returned by 'N_FlowFieldTargetTiles'. Only the navigation 
+ * data is read, so this is safe to run in a task against a copy of it 
+ * while the simulation continues.
+ * ------------------------------------------------------------------------
+ */
+void    N_FlowFieldUpdateFromTiles(struct coord              chunk_coord, 
+                                   const struct nav_private *priv, 
+                                   enum nav_layer            layer, 
+                                   struct field_target       target, 
+                                   size_t                    ntiles,
+                                   const struct tile_desc   *tiles,
+                                   struct flow_field        *inout_flow);
+
 /* ------------------------------------------------------------------------
  * Update all tiles with a specific local island ID from the
  * 'local_islands' field for the chunk. The new directions will guide to
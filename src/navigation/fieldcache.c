@@ -38,13 +38,45 @@
 #include "../lib/public/lru_cache.h"
 #include "../lib/public/khash.h"
 #include "../lib/public/vec.h"
+#include "../lib/public/mem.h"
+#include "../lib/public/pf_string.h"
 #include "../event.h"
 #include "../sched.h"
+#include "../perf.h"
 #include "../config.h"
+#include "../settings.h"
+#include "../main.h"
 
+#include <SDL.h>
 #include <assert.h>
+#include <string.h>
 
 
+/* Every cache is split into shards, selected by a hash of the key. Each 
+ * shard is an independent LRU guarded by its' own spinlock so that lookups 
+ * from different threads only contend when they hit the same shard. 
+ */
+#define FC_SHARD_BITS           (3)
+#define FC_NSHARDS              (1 << FC_SHARD_BITS)
+#define FC_MIN_SHARD_SZ         (16)
+#define FC_MAX_CACHE_SZ         (1 << 20)
+
+/* Auto-sizing is re-evaluated after every window of queries. A cache that 
+ * is full and missing too often is grown (up to a multiple of its' base 
+ * size), and a mostly empty cache is shrunk back towards its' base size. 
+ */
+#define FC_AUTOSIZE_WINDOW      (4096)
+#define FC_AUTOSIZE_LOW_HITRATE (0.8f)
+#define FC_AUTOSIZE_MAX_SCALE   (4)
+
+/* Number of the most recent lookups which are recorded per shard, when 
+ * tracing is enabled, for replaying against the different policies. */
+#define FC_TRACE_LEN            (2048)
+
+#define ARR_SIZE(a)             (sizeof(a)/sizeof(a[0]))
+#define MIN(a, b)               ((a) < (b) ? (a) : (b))
+#define MAX(a, b)               ((a) > (b) ? (a) : (b))
+
 LRU_CACHE_TYPE(los, struct LOS_field)
 LRU_CACHE_PROTOTYPES(static, los, struct LOS_field)
 LRU_CACHE_IMPL(static, los, struct LOS_field)
@@ -61,46 +93,264 @@ LRU_CACHE_TYPE(grid_path, struct grid_path_desc)
 LRU_CACHE_PROTOTYPES(static, grid_path, struct grid_path_desc)
 LRU_CACHE_IMPL(static, grid_path, struct grid_path_desc)
 
+LRU_CACHE_TYPE(route, struct portal_route_desc)
+LRU_CACHE_PROTOTYPES(static, route, struct portal_route_desc)
+LRU_CACHE_IMPL(static, route, struct portal_route_desc)
+
+/* Only the keys are needed to replay the recorded lookups */
+LRU_CACHE_TYPE(trace, char)
+LRU_CACHE_PROTOTYPES(static, trace, char)
+LRU_CACHE_IMPL(static, trace, char)
+
 VEC_TYPE(id, uint64_t)
 VEC_PROTOTYPES(static, id, uint64_t)
 VEC_IMPL(static, id, uint64_t)
 
 KHASH_MAP_INIT_INT64(idvec, vec_id_t)
 
+struct fc_sizing{
+    const char *setting;
+    /* The capacity set through the settings */
+    size_t      base;
+    /* The current capacity, summed over all shards */
+    size_t      capacity;
+    unsigned    last_query;
+    unsigned    last_hit;
+};
+
+struct fc_totals{
+    size_t   used;
+    size_t   capacity;
+    unsigned query;
+    unsigned hit;
+    unsigned invalidated;
+};
+
+struct fc_replay{
+    unsigned query;
+    unsigned hit;
+};
+
+/* Read from the lookup paths of all the threads, only written on the main thread */
+static bool s_trace;
+
+#define FC_SHARDED_CACHE(name, type)                                                            \
+                                                                                                \
+    struct name##_shard{                                                                        \
+        SDL_SpinLock lock;                                                                      \
+        lru(name)    cache;                                                                     \
+        unsigned     query;                                                                     \
+        unsigned     hit;                                                                       \
+        unsigned     invalidated;                                                               \
+        unsigned     ntraced;                                                                   \
+        uint64_t     trace[FC_TRACE_LEN];                                                       \
+    };                                                                                          \
+                                                                                                \
+    static struct name##_shard s_##name##_shards[FC_NSHARDS];                                   \
+                                                                                                \
+    static struct name##_shard *fc_##name##_shard(uint64_t key)                                 \
+    {                                                                                           \
+        return &s_##name##_shards[fc_shard_idx(key)];                                           \
+    }                                                                                           \
+                                                                                                \
+    static void fc_##name##_count(struct name##_shard *shard, uint64_t key, bool hit)           \
+    {                                                                                           \
+        shard->query++;                                                                         \
+        shard->hit += !!hit;                                                                    \
+        if(s_trace) {                                                                           \
+            shard->trace[shard->ntraced++ % FC_TRACE_LEN] = key;                                \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    static size_t fc_##name##_pool_bytes(const struct name##_shard *shard)                      \
+    {                                                                                           \
+        return shard->cache.capacity * sizeof(lru_node(name));                                  \
+    }                                                                                           \
+                                                                                                \
+    static bool fc_##name##_init(size_t capacity, void (*on_evict)(type *victim))               \
+    {                                                                                           \
+        for(int i = 0; i < FC_NSHARDS; i++) {                                                   \
+            struct name##_shard *shard = &s_##name##_shards[i];                                 \
+            memset(shard, 0, sizeof(*shard));                                                   \
+            if(!lru_##name##_init(&shard->cache, fc_shard_capacity(capacity), on_evict)) {      \
+                for(--i; i >= 0; i--)                                                           \
+                    lru_##name##_destroy(&s_##name##_shards[i].cache);                          \
+                return false;                                                                   \
+            }                                                                                   \
+            Perf_MemAlloc(PERF_MEM_NAV_FIELDCACHE, fc_##name##_pool_bytes(shard));              \
+        }                                                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    static void fc_##name##_destroy(void)                                                       \
+    {                                                                                           \
+        for(int i = 0; i < FC_NSHARDS; i++) {                                                   \
+            struct name##_shard *shard = &s_##name##_shards[i];                                 \
+            Perf_MemFree(PERF_MEM_NAV_FIELDCACHE, fc_##name##_pool_bytes(shard));               \
+            lru_##name##_destroy(&shard->cache);                                                \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    static void fc_##name##_clear(void)                                                         \
+    {                                                                                           \
+        for(int i = 0; i < FC_NSHARDS; i++) {                                                   \
+            struct name##_shard *shard = &s_##name##_shards[i];                                 \
+            SDL_AtomicLock(&shard->lock);                                                       \
+            lru_##name##_clear(&shard->cache);                                                  \
+            SDL_AtomicUnlock(&shard->lock);                                                     \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    static void fc_##name##_clear_stats(void)                                                   \
+    {                                                                                           \
+        for(int i = 0; i < FC_NSHARDS; i++) {                                                   \
+            struct name##_shard *shard = &s_##name##_shards[i];                                 \
+            SDL_AtomicLock(&shard->lock);                                                       \
+            shard->query = shard->hit = shard->invalidated = 0;                                 \
+            shard->ntraced = 0;                                                                 \
+            SDL_AtomicUnlock(&shard->lock);                                                     \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    static bool fc_##name##_resize(size_t capacity)                                             \
+    {                                                                                           \
+        bool ret = true;                                                                        \
+        for(int i = 0; i < FC_NSHARDS; i++) {                                                   \
+            struct name##_shard *shard = &s_##name##_shards[i];                                 \
+            SDL_AtomicLock(&shard->lock);                                                       \
+            size_t old_bytes = fc_##name##_pool_bytes(shard);                                   \
+            ret &= lru_##name##_resize(&shard->cache, fc_shard_capacity(capacity));             \
+            Perf_MemRealloc(PERF_MEM_NAV_FIELDCACHE, old_bytes, fc_##name##_pool_bytes(shard)); \
+            SDL_AtomicUnlock(&shard->lock);                                                     \
+        }                                                                                       \
+        return ret;                                                                             \
+    }                                                                                           \
+                                                                                                \
+    static struct fc_totals fc_##name##_totals(void)                                            \
+    {                                                                                           \
+        struct fc_totals ret = {0};                                                             \
+        for(int i = 0; i < FC_NSHARDS; i++) {                                                   \
+            struct name##_shard *shard = &s_##name##_shards[i];                                 \
+            SDL_AtomicLock(&shard->lock);                                                       \
+            ret.used += shard->cache.used;                                                      \
+            ret.capacity += shard->cache.capacity;                                              \
+            ret.query += shard->query;                                                          \
+            ret.hit += shard->hit;                                                              \
+            ret.invalidated += shard->invalidated;                                              \
+            SDL_AtomicUnlock(&shard->lock);                                                     \
+        }                                                                                       \
+        return ret;                                                                             \
+    }                                                                                           \
+                                                                                                \
+    static bool fc_##name##_set_policy(enum lru_policy policy)                                  \
+    {                                                                                           \
+        bool ret = true;                                                                        \
+        for(int i = 0; i < FC_NSHARDS; i++) {                                                   \
+            struct name##_shard *shard = &s_##name##_shards[i];                                 \
+            SDL_AtomicLock(&shard->lock);                                                       \
+            ret &= lru_##name##_set_policy(&shard->cache, policy);                              \
+            SDL_AtomicUnlock(&shard->lock);                                                     \
+        }                                                                                       \
+        return ret;                                                                             \
+    }                                                                                           \
+                                                                                                \
+    /* Replay every shard's recorded lookups against an empty cache of the same */              \
+    /* capacity, putting the entry after every miss.                            */              \
+    static struct fc_replay fc_##name##_replay(enum lru_policy policy)                          \
+    {                                                                                           \
+        struct fc_replay ret = {0};                                                             \
+        for(int i = 0; i < FC_NSHARDS; i++) {                                                   \
+            struct name##_shard *shard = &s_##name##_shards[i];                                 \
+            SDL_AtomicLock(&shard->lock);                                                       \
+            fc_replay_trace(shard->trace, shard->ntraced, shard->cache.capacity, policy, &ret); \
+            SDL_AtomicUnlock(&shard->lock);                                                     \
+        }                                                                                       \
+        return ret;                                                                             \
+    }
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static unsigned fc_shard_idx(uint64_t key)
+{
+    return (key * 0x9e3779b97f4a7c15ull) >> (64 - FC_SHARD_BITS);
+}
+
+static void fc_replay_trace(const uint64_t *trace, unsigned ntraced, size_t capacity, 
+                            enum lru_policy policy, struct fc_replay *inout)
+{
+    lru(trace) cache;
+    if(!lru_trace_init(&cache, capacity, NULL))
+        return;
+    if(!lru_trace_set_policy(&cache, policy))
+        goto out;
+
+    unsigned nrecs = MIN(ntraced, FC_TRACE_LEN);
+    unsigned begin = ntraced - nrecs;
+    const char dummy = 0;
+
+    for(unsigned i = begin; i < ntraced; i++) {
+        uint64_t key = trace[i % FC_TRACE_LEN];
+        inout->query++;
+        if(lru_trace_contains(&cache, key)) {
+            inout->hit++;
+        }else{
+            lru_trace_put(&cache, key, &dummy);
+        }
+    }
+out:
+    lru_trace_destroy(&cache);
+}
+
+static size_t fc_shard_capacity(size_t capacity)
+{
+    size_t ret = (capacity + FC_NSHARDS - 1) / FC_NSHARDS;
+    return ret < FC_MIN_SHARD_SZ ? FC_MIN_SHARD_SZ : ret;
+}
+
+FC_SHARDED_CACHE(los, struct LOS_field)
+FC_SHARDED_CACHE(flow, struct flow_field)
+FC_SHARDED_CACHE(ffid, ff_id_t)
+FC_SHARDED_CACHE(grid_path, struct grid_path_desc)
+FC_SHARDED_CACHE(route, struct portal_route_desc)
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static lru(los)          s_los_cache;       /* key: (dest_id, chunk coord) */
-static lru(flow)         s_flow_cache;      /* key: (ffid) */
-/* The ffid cache maps a (dest_id, chunk coordinate) tuple to a flow field ID,
+/* los:       key: (dest_id, chunk coord) 
+ * flow:      key: (ffid) 
+ * ffid:      key: (dest_id, chunk_coord) 
+ * grid_path: key: (chunk coord, tile start coord, tile dest coord)
+ * route:     key: (dest_id, source chunk coord, source local island)
+ *
+ * The ffid cache maps a (dest_id, chunk coordinate) tuple to a flow field ID,
  * which could be used to retreive the relevant field from the flow cache. 
  * The reason for this is that the same flow field chunk can be shared between
- * many different paths. */
-static lru(ffid)         s_ffid_cache;      /* key: (dest_id, chunk_coord) */
-static lru(grid_path)    s_grid_path_cache; /* key: (chunk coord, tile start coord, tile dest coord) */
+ * many different paths. 
+ */
+static struct fc_sizing  s_los_sizing       = {"pf.game.fieldcache_los_size",       CONFIG_LOS_CACHE_SZ};
+static struct fc_sizing  s_flow_sizing      = {"pf.game.fieldcache_flow_size",      CONFIG_FLOW_CACHE_SZ};
+static struct fc_sizing  s_ffid_sizing      = {"pf.game.fieldcache_mapping_size",   CONFIG_MAPPING_CACHE_SZ};
+static struct fc_sizing  s_grid_path_sizing = {"pf.game.fieldcache_grid_path_size", CONFIG_GRID_PATH_CACHE_SZ};
+static struct fc_sizing  s_route_sizing     = {"pf.game.fieldcache_route_size",     CONFIG_ROUTE_CACHE_SZ};
+static unsigned          s_nresizes;
+/* Enemy seek and surround fields referenced by moving entities, and the
+ * number of requests which referenced them */
+static unsigned          s_nvolatile_fields;
+static unsigned          s_nvolatile_refs;
+/* Bumped whenever the contents of a flow or LOS field which may already have
+ * been handed out by copy can change: on changing overwrites, removals and 
+ * invalidations. Fresh insertions and evictions leave it untouched, since 
+ * neither makes an existing copy stale. */
+static SDL_atomic_t      s_epoch;
 
 /* The following structures are maintained for efficient invalidation of entries:*/
+static SDL_SpinLock      s_map_lock;
 static khash_t(idvec)   *s_chunk_ffield_map; /* key: (chunk coord) */
 static khash_t(idvec)   *s_chunk_lfield_map; /* key: (chunk coord) */
 
-static struct priv_fc_stats{
-    unsigned los_query;
-    unsigned los_hit;
-    unsigned los_invalidated;
-    unsigned flow_query;
-    unsigned flow_hit;
-    unsigned flow_invalidated;
-    unsigned ffid_query;
-    unsigned ffid_hit;
-    unsigned grid_path_query;
-    unsigned grid_path_hit;
-}s_perfstats = {0};
-
-/*****************************************************************************/
-/* STATIC FUNCTIONS                                                          */
-/*****************************************************************************/
-
 uint32_t key_for_chunk(struct coord chunk)
 {
     return (((uint64_t)chunk.r & 0xffff) << 16) | ((uint64_t)chunk.c & 0xffff);
@@ -136,11 +386,24 @@ uint64_t grid_path_key(struct coord local_start, struct coord local_dest,
          |  (( ((uint64_t)layer)         & 0xf   ) << 60));
 }
 
+static uint64_t route_key(dest_id_t id, struct coord src_chunk, uint16_t src_liid)
+{
+    return ((( ((uint64_t)src_liid)    & 0xffff) <<  0)
+         |  (( ((uint64_t)src_chunk.r) & 0xff  ) << 16)
+         |  (( ((uint64_t)src_chunk.c) & 0xff  ) << 24)
+         |  (( ((uint64_t)id)                  ) << 32));
+}
+
 static void on_grid_path_evict(struct grid_path_desc *victim)
 {
     vec_coord_destroy(&victim->path);
 }
 
+static void on_route_evict(struct portal_route_desc *victim)
+{
+    vec_portal_destroy(&victim->path);
+}
+
 static void destroy_all_entries(khash_t(idvec) *hash)
 {
     uint32_t key;
@@ -181,11 +444,24 @@ static bool dest_array_contains(dest_id_t *array, size_t size, dest_id_t item)
     return false;
 }
 
+
+/* Enemy seek and surround fields are rebuilt all the time and are never 
+ * copied out by path followers, so changing them does not move the epoch. */
+static void fc_flow_changed(ff_id_t ffid)
+{
+    int type = N_FlowFieldTargetType(ffid);
+    if(type == TARGET_ENEMIES || type == TARGET_ENTITY)
+        return;
+    SDL_AtomicIncRef(&s_epoch);
+}
+
 static void clear_chunk_los_map(uint64_t key, enum nav_layer layer)
 {
+    SDL_AtomicLock(&s_map_lock);
+
     khiter_t k = kh_get(idvec, s_chunk_lfield_map, key);
     if(k == kh_end(s_chunk_lfield_map))
-        return;
+        goto out;
 
     vec_id_t *keys = &kh_val(s_chunk_lfield_map, k);
     for(int i = vec_size(keys)-1; i >= 0; i--) {
@@ -194,21 +470,29 @@ static void clear_chunk_los_map(uint64_t key, enum nav_layer layer)
         if(N_DestLayer(key_dest(key)) != layer)
             continue;
 
-        bool found = lru_los_remove(&s_los_cache, key);
-        s_perfstats.los_invalidated += !!found;
+        struct los_shard *shard = fc_los_shard(key);
+        SDL_AtomicLock(&shard->lock);
+        bool found = lru_los_remove(&shard->cache, key);
+        shard->invalidated += !!found;
+        SDL_AtomicUnlock(&shard->lock);
+        SDL_AtomicIncRef(&s_epoch);
         vec_id_del(keys, i);
     }
     if(vec_size(keys) == 0) {
         vec_id_destroy(keys);
         kh_del(idvec, s_chunk_lfield_map, k);
     }
+out:
+    SDL_AtomicUnlock(&s_map_lock);
 }
 
 static void clear_chunk_flow_map(uint64_t key, enum nav_layer layer, bool enemies_only)
 {
+    SDL_AtomicLock(&s_map_lock);
+
     khiter_t k = kh_get(idvec, s_chunk_ffield_map, key);
     if(k == kh_end(s_chunk_ffield_map))
-        return;
+        goto out;
 
     vec_id_t *keys = &kh_val(s_chunk_ffield_map, k);
     for(int i = vec_size(keys)-1; i >= 0; i--) {
@@ -220,14 +504,243 @@ static void clear_chunk_flow_map(uint64_t key, enum nav_layer layer, bool enemie
         if(enemies_only && (N_FlowFieldTargetType(key) != TARGET_ENEMIES))
             continue;
 
-        bool found = lru_flow_remove(&s_flow_cache, key);
-        s_perfstats.flow_invalidated += !!found;
+        struct flow_shard *shard = fc_flow_shard(key);
+        SDL_AtomicLock(&shard->lock);
+        bool found = lru_flow_remove(&shard->cache, key);
+        shard->invalidated += !!found;
+        SDL_AtomicUnlock(&shard->lock);
+        fc_flow_changed(key);
         vec_id_del(keys, i);
     }
     if(vec_size(keys) == 0) {
         vec_id_destroy(keys);
         kh_del(idvec, s_chunk_ffield_map, k);
     }
+out:
+    SDL_AtomicUnlock(&s_map_lock);
+}
+
+static bool fc_resize(struct fc_sizing *sizing, size_t capacity)
+{
+    bool ret;
+    if(sizing == &s_los_sizing)
+        ret = fc_los_resize(capacity);
+    else if(sizing == &s_flow_sizing)
+        ret = fc_flow_resize(capacity);
+    else if(sizing == &s_ffid_sizing)
+        ret = fc_ffid_resize(capacity);
+    else if(sizing == &s_grid_path_sizing)
+        ret = fc_grid_path_resize(capacity);
+    else
+        ret = fc_route_resize(capacity);
+
+    sizing->capacity = capacity;
+    s_nresizes++;
+    return ret;
+}
+
+static struct fc_sizing *fc_sizing_for_setting(const char *name)
+{
+    struct fc_sizing *all[] = {
+        &s_los_sizing, 
+        &s_flow_sizing, 
+        &s_ffid_sizing, 
+        &s_grid_path_sizing,
+        &s_route_sizing
+    };
+    for(int i = 0; i < ARR_SIZE(all); i++) {
+        if(0 == strcmp(all[i]->setting, name))
+            return all[i];
+    }
+    return NULL;
+}
+
+static void fc_autosize(struct fc_sizing *sizing, struct fc_totals totals)
+{
+    /* The counters were reset */
+    if(totals.query < sizing->last_query) {
+        sizing->last_query = totals.query;
+        sizing->last_hit = totals.hit;
+        return;
+    }
+
+    unsigned nqueries = totals.query - sizing->last_query;
+    unsigned nhits = totals.hit - sizing->last_hit;
+    if(nqueries < FC_AUTOSIZE_WINDOW)
+        return;
+
+    sizing->last_query = totals.query;
+    sizing->last_hit = totals.hit;
+
+    float hit_rate = ((float)nhits) / nqueries;
+    bool full = (totals.used >= totals.capacity - totals.capacity / 8);
+    size_t max = MIN(sizing->base * FC_AUTOSIZE_MAX_SCALE, FC_MAX_CACHE_SZ);
+
+    if(full && hit_rate < FC_AUTOSIZE_LOW_HITRATE && sizing->capacity < max) {
+        fc_resize(sizing, MIN(sizing->capacity * 2, max));
+    }else if(totals.used < totals.capacity / 4 && sizing->capacity > sizing->base) {
+        fc_resize(sizing, MAX(sizing->capacity / 2, sizing->base));
+    }
+}
+
+static bool cache_size_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    return (new_val->as_int >= FC_NSHARDS * FC_MIN_SHARD_SZ)
+        && (new_val->as_int <= FC_MAX_CACHE_SZ);
+}
+
+static bool bool_val_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool policy_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    return (new_val->as_int >= 0) && (new_val->as_int < LRU_POLICY_COUNT);
+}
+
+static void policy_commit(const struct sval *new_val)
+{
+    enum lru_policy policy = new_val->as_int;
+    bool result = true;
+    result &= fc_los_set_policy(policy);
+    result &= fc_flow_set_policy(policy);
+    result &= fc_ffid_set_policy(policy);
+    result &= fc_grid_path_set_policy(policy);
+    result &= fc_route_set_policy(policy);
+    assert(result);
+    (void)result;
+}
+
+static void trace_commit(const struct sval *new_val)
+{
+    s_trace = new_val->as_bool;
+}
+
+static void cache_size_commit(const char *name, const struct sval *new_val)
+{
+    struct fc_sizing *sizing = fc_sizing_for_setting(name);
+    assert(sizing);
+    sizing->base = new_val->as_int;
+    fc_resize(sizing, sizing->base);
+}
+
+static void los_size_commit(const struct sval *new_val)
+{
+    cache_size_commit(s_los_sizing.setting, new_val);
+}
+
+static void flow_size_commit(const struct sval *new_val)
+{
+    cache_size_commit(s_flow_sizing.setting, new_val);
+}
+
+static void mapping_size_commit(const struct sval *new_val)
+{
+    cache_size_commit(s_ffid_sizing.setting, new_val);
+}
+
+static void grid_path_size_commit(const struct sval *new_val)
+{
+    cache_size_commit(s_grid_path_sizing.setting, new_val);
+}
+
+static void route_size_commit(const struct sval *new_val)
+{
+    cache_size_commit(s_route_sizing.setting, new_val);
+}
+
+static void fc_create_settings(void)
+{
+    ss_e status;
+    (void)status;
+
+    struct{
+        struct fc_sizing *sizing;
+        void (*commit)(const struct sval*);
+    }sizes[] = {
+        {&s_los_sizing,       los_size_commit},
+        {&s_flow_sizing,      flow_size_commit},
+        {&s_ffid_sizing,      mapping_size_commit},
+        {&s_grid_path_sizing, grid_path_size_commit},
+        {&s_route_sizing,     route_size_commit},
+    };
+
+    for(int i = 0; i < ARR_SIZE(sizes); i++) {
+        struct setting sett = (struct setting){
+            .val = (struct sval) {
+                .type = ST_TYPE_INT,
+                .as_int = sizes[i].sizing->base
+            },
+            .prio = 0,
+            .validate = cache_size_validate,
+            .commit = sizes[i].commit,
+        };
+        pf_strlcpy(sett.name, sizes[i].sizing->setting, sizeof(sett.name));
+        status = Settings_Create(sett);
+        assert(status == SS_OKAY);
+    }
+
+    /* Grow the caches which are missing too often and shrink
+     * the ones which are mostly unused back to their set size. */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.fieldcache_autosize",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* One of 'enum lru_policy' - LRU, CLOCK or 2Q */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.fieldcache_policy",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = LRU_POLICY_LRU
+        },
+        .prio = 0,
+        .validate = policy_validate,
+        .commit = policy_commit,
+    });
+    assert(status == SS_OKAY);
+
+    /* Record the most recent lookups of every cache for N_FC_BenchmarkPolicies */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.fieldcache_trace",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = trace_commit,
+    });
+    assert(status == SS_OKAY);
+}
+
+static bool fc_autosize_enabled(void)
+{
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.fieldcache_autosize", &setting);
+    return (status != SS_OKAY) || setting.as_bool;
+}
+
+static float hit_rate(struct fc_totals totals)
+{
+    return !totals.query ? 0 : ((float)totals.hit) / totals.query;
+}
+
+static float replay_hit_rate(struct fc_replay replay)
+{
+    return !replay.query ? 0 : ((float)replay.hit) / replay.query;
 }
 
 /*****************************************************************************/
@@ -236,46 +749,62 @@ static void clear_chunk_flow_map(uint64_t key, enum nav_layer layer, bool enemie
 
 bool N_FC_Init(void)
 {
-    if(!lru_los_init(&s_los_cache, CONFIG_LOS_CACHE_SZ, NULL))
+    if(!fc_los_init(CONFIG_LOS_CACHE_SZ, NULL))
         goto fail_los;
 
-    if(!lru_flow_init(&s_flow_cache, CONFIG_FLOW_CACHE_SZ, NULL))
+    if(!fc_flow_init(CONFIG_FLOW_CACHE_SZ, NULL))
         goto fail_flow;
 
-    if(!lru_ffid_init(&s_ffid_cache, CONFIG_MAPPING_CACHE_SZ, NULL))
+    if(!fc_ffid_init(CONFIG_MAPPING_CACHE_SZ, NULL))
         goto fail_ffid;
 
-    if(!lru_grid_path_init(&s_grid_path_cache, CONFIG_GRID_PATH_CACHE_SZ, on_grid_path_evict))
+    if(!fc_grid_path_init(CONFIG_GRID_PATH_CACHE_SZ, on_grid_path_evict))
         goto fail_grid_path;
 
+    if(!fc_route_init(CONFIG_ROUTE_CACHE_SZ, on_route_evict))
+        goto fail_route;
+
     if(NULL == (s_chunk_ffield_map = kh_init(idvec)))
         goto fail_chunk_ffield;
 
     if(NULL == (s_chunk_lfield_map = kh_init(idvec)))
         goto fail_chunk_lfield;
 
+    s_los_sizing.capacity = CONFIG_LOS_CACHE_SZ;
+    s_flow_sizing.capacity = CONFIG_FLOW_CACHE_SZ;
+    s_ffid_sizing.capacity = CONFIG_MAPPING_CACHE_SZ;
+    s_grid_path_sizing.capacity = CONFIG_GRID_PATH_CACHE_SZ;
+    s_route_sizing.capacity = CONFIG_ROUTE_CACHE_SZ;
+
+    fc_create_settings();
+    s_nresizes = 0;
+    s_nvolatile_fields = 0;
+    s_nvolatile_refs = 0;
     return true;
 
 fail_chunk_lfield:
     kh_destroy(idvec, s_chunk_ffield_map);
 fail_chunk_ffield:
-    lru_grid_path_destroy(&s_grid_path_cache);
+    fc_route_destroy();
+fail_route:
+    fc_grid_path_destroy();
 fail_grid_path:
-    lru_ffid_destroy(&s_ffid_cache);
+    fc_ffid_destroy();
 fail_ffid:
-    lru_flow_destroy(&s_flow_cache);
+    fc_flow_destroy();
 fail_flow:
-    lru_los_destroy(&s_los_cache);
+    fc_los_destroy();
 fail_los:
     return false;
 }
 
 void N_FC_Shutdown(void)
 {
-    lru_los_destroy(&s_los_cache);
-    lru_flow_destroy(&s_flow_cache);
-    lru_ffid_destroy(&s_ffid_cache);
-    lru_grid_path_destroy(&s_grid_path_cache);
+    fc_los_destroy();
+    fc_flow_destroy();
+    fc_ffid_destroy();
+    fc_grid_path_destroy();
+    fc_route_destroy();
 
     destroy_all_entries(s_chunk_ffield_map);
     kh_destroy(idvec, s_chunk_ffield_map);
@@ -284,119 +813,306 @@ void N_FC_Shutdown(void)
     kh_destroy(idvec, s_chunk_lfield_map);
 }
 
+void N_FC_Update(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!fc_autosize_enabled())
+        return;
+
+    fc_autosize(&s_los_sizing, fc_los_totals());
+    fc_autosize(&s_flow_sizing, fc_flow_totals());
+    fc_autosize(&s_ffid_sizing, fc_ffid_totals());
+    fc_autosize(&s_grid_path_sizing, fc_grid_path_totals());
+    fc_autosize(&s_route_sizing, fc_route_totals());
+}
+
 void N_FC_ClearAll(void)
 {
-    lru_los_clear(&s_los_cache);
-    lru_flow_clear(&s_flow_cache);
-    lru_ffid_clear(&s_ffid_cache);
-    lru_grid_path_clear(&s_grid_path_cache);
+    fc_los_clear();
+    fc_flow_clear();
+    fc_ffid_clear();
+    fc_grid_path_clear();
+    fc_route_clear();
+    SDL_AtomicIncRef(&s_epoch);
+
+    SDL_AtomicLock(&s_map_lock);
 
     destroy_all_entries(s_chunk_ffield_map);
     kh_clear(idvec, s_chunk_ffield_map);
 
     destroy_all_entries(s_chunk_lfield_map);
     kh_clear(idvec, s_chunk_lfield_map);
+
+    SDL_AtomicUnlock(&s_map_lock);
 }
 
 void N_FC_ClearStats(void)
 {
-    memset(&s_perfstats, 0, sizeof(s_perfstats));
+    fc_los_clear_stats();
+    fc_flow_clear_stats();
+    fc_ffid_clear_stats();
+    fc_grid_path_clear_stats();
+    fc_route_clear_stats();
+    s_nresizes = 0;
+    s_nvolatile_fields = 0;
+    s_nvolatile_refs = 0;
 }
 
-void N_FC_GetStats(struct fc_stats *out_stats)
+void N_FC_BenchmarkPolicies(struct fc_policy_bench_result out[FC_BENCH_NPOLICIES])
 {
-    out_stats->los_used = s_los_cache.used;
-    out_stats->los_max = s_los_cache.capacity;
-    out_stats->los_hit_rate = !s_perfstats.los_query ? 0
-        : ((float)s_perfstats.los_hit) / s_perfstats.los_query;
-    out_stats->los_invalidated = s_perfstats.los_invalidated;
+    _Static_assert((int)FC_BENCH_LRU == (int)LRU_POLICY_LRU, "");
+    _Static_assert((int)FC_BENCH_CLOCK == (int)LRU_POLICY_CLOCK, "");
+    _Static_assert((int)FC_BENCH_2Q == (int)LRU_POLICY_2Q, "");
+    _Static_assert((int)FC_BENCH_NPOLICIES == (int)LRU_POLICY_COUNT, "");
+
+    for(int i = 0; i < LRU_POLICY_COUNT; i++) {
+
+        struct fc_replay los = fc_los_replay(i);
+        struct fc_replay flow = fc_flow_replay(i);
+        struct fc_replay ffid = fc_ffid_replay(i);
+        struct fc_replay grid_path = fc_grid_path_replay(i);
+
+        out[i] = (struct fc_policy_bench_result){
+            .los_queries = los.query,
+            .los_hit_rate = replay_hit_rate(los),
+            .flow_queries = flow.query,
+            .flow_hit_rate = replay_hit_rate(flow),
+            .ffid_queries = ffid.query,
+            .ffid_hit_rate = replay_hit_rate(ffid),
+            .grid_path_queries = grid_path.query,
+            .grid_path_hit_rate = replay_hit_rate(grid_path),
+        };
+    }
+}
 
-    out_stats->flow_used = s_flow_cache.used;
-    out_stats->flow_max = s_flow_cache.capacity;
-    out_stats->flow_hit_rate = !s_perfstats.flow_query ? 0
-        : ((float)s_perfstats.flow_hit) / s_perfstats.flow_query;
-    out_stats->flow_invalidated = s_perfstats.flow_invalidated;
+void N_FC_AddVolatileFieldRefs(unsigned nfields, unsigned nrefs)
+{
+    s_nvolatile_fields += nfields;
+    s_nvolatile_refs += nrefs;
+}
 
-    out_stats->ffid_used = s_ffid_cache.used;
-    out_stats->ffid_max = s_ffid_cache.capacity;
-    out_stats->ffid_hit_rate = !s_perfstats.ffid_hit ? 0
-        : ((float)s_perfstats.ffid_hit) / s_perfstats.ffid_query;
+void N_FC_GetStats(struct fc_stats *out_stats)
+{
+    struct fc_totals los = fc_los_totals();
+    out_stats->los_used = los.used;
+    out_stats->los_max = los.capacity;
+    out_stats->los_hit_rate = hit_rate(los);
+    out_stats->los_invalidated = los.invalidated;
+
+    struct fc_totals flow = fc_flow_totals();
+    out_stats->flow_used = flow.used;
+    out_stats->flow_max = flow.capacity;
+    out_stats->flow_hit_rate = hit_rate(flow);
+    out_stats->flow_invalidated = flow.invalidated;
+
+    struct fc_totals ffid = fc_ffid_totals();
+    out_stats->ffid_used = ffid.used;
+    out_stats->ffid_max = ffid.capacity;
+    out_stats->ffid_hit_rate = hit_rate(ffid);
+
+    struct fc_totals grid_path = fc_grid_path_totals();
+    out_stats->grid_path_used = grid_path.used;
+    out_stats->grid_path_max = grid_path.capacity;
+    out_stats->grid_path_hit_rate = hit_rate(grid_path);
+
+    struct fc_totals route = fc_route_totals();
+    out_stats->route_used = route.used;
+    out_stats->route_max = route.capacity;
+    out_stats->route_hit_rate = hit_rate(route);
+    out_stats->route_invalidated = route.invalidated;
+
+    out_stats->shards = FC_NSHARDS;
+    out_stats->resizes = s_nresizes;
+    out_stats->volatile_fields = s_nvolatile_fields;
+    out_stats->volatile_refs = s_nvolatile_refs;
+}
 
-    out_stats->grid_path_used = s_grid_path_cache.used;
-    out_stats->grid_path_max = s_grid_path_cache.capacity;
-    out_stats->grid_path_hit_rate = !s_perfstats.grid_path_hit ? 0
-        : ((float)s_perfstats.grid_path_hit) / s_perfstats.grid_path_query;
+uint32_t N_FC_Epoch(void)
+{
+    return SDL_AtomicGet(&s_epoch);
 }
 
 bool N_FC_ContainsLOSField(dest_id_t id, struct coord chunk_coord)
 {
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    bool ret = lru_los_contains(&s_los_cache, key);
+    struct los_shard *shard = fc_los_shard(key);
+
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_los_contains(&shard->cache, key);
+    fc_los_count(shard, key, ret);
+    SDL_AtomicUnlock(&shard->lock);
 
-    s_perfstats.los_query++;
-    s_perfstats.los_hit += !!ret;
+    if(ret) {
+        PERF_COUNTER_ADD("fieldcache.los.hit", 1);
+    }else{
+        PERF_COUNTER_ADD("fieldcache.los.miss", 1);
+    }
     return ret;
 }
 
 const struct LOS_field *N_FC_LOSFieldAt(dest_id_t id, struct coord chunk_coord)
 {
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    return lru_los_at(&s_los_cache, key);
+    struct los_shard *shard = fc_los_shard(key);
+
+    SDL_AtomicLock(&shard->lock);
+    const struct LOS_field *ret = lru_los_at(&shard->cache, key);
+    SDL_AtomicUnlock(&shard->lock);
+    return ret;
+}
+
+bool N_FC_GetLOSField(dest_id_t id, struct coord chunk_coord, struct LOS_field *out)
+{
+    uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
+    struct los_shard *shard = fc_los_shard(key);
+
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_los_get(&shard->cache, key, out);
+    fc_los_count(shard, key, ret);
+    SDL_AtomicUnlock(&shard->lock);
+    return ret;
 }
 
 void N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_field *lf)
 {
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    lru_los_put(&s_los_cache, key, lf);
+    struct los_shard *shard = fc_los_shard(key);
+
+    SDL_AtomicLock(&shard->lock);
+    const struct LOS_field *prev = lru_los_at(&shard->cache, key);
+    bool changed = prev && memcmp(prev, lf, sizeof(*lf));
+    lru_los_put(&shard->cache, key, lf);
+    SDL_AtomicUnlock(&shard->lock);
+
+    if(changed) {
+        SDL_AtomicIncRef(&s_epoch);
+    }
+
+    SDL_AtomicLock(&s_map_lock);
     field_map_add(s_chunk_lfield_map, key_for_chunk(chunk_coord), key);
+    SDL_AtomicUnlock(&s_map_lock);
 }
 
 bool N_FC_ContainsFlowField(ff_id_t ffid)
 {
-    bool ret = lru_flow_contains(&s_flow_cache, ffid);
+    struct flow_shard *shard = fc_flow_shard(ffid);
 
-    s_perfstats.flow_query++;
-    s_perfstats.flow_hit += !!ret;
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_flow_contains(&shard->cache, ffid);
+    fc_flow_count(shard, ffid, ret);
+    SDL_AtomicUnlock(&shard->lock);
+
+    if(ret) {
+        PERF_COUNTER_ADD("fieldcache.flow.hit", 1);
+    }else{
+        PERF_COUNTER_ADD("fieldcache.flow.miss", 1);
+    }
     return ret;
 }
 
 const struct flow_field *N_FC_FlowFieldAt(ff_id_t ffid)
 {
-    return lru_flow_at(&s_flow_cache, ffid);
+    struct flow_shard *shard = fc_flow_shard(ffid);
+
+    SDL_AtomicLock(&shard->lock);
+    const struct flow_field *ret = lru_flow_at(&shard->cache, ffid);
+    SDL_AtomicUnlock(&shard->lock);
+    return ret;
+}
+
+bool N_FC_GetFlowField(ff_id_t ffid, struct flow_field *out)
+{
+    struct flow_shard *shard = fc_flow_shard(ffid);
+
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_flow_get(&shard->cache, ffid, out);
+    fc_flow_count(shard, ffid, ret);
+    SDL_AtomicUnlock(&shard->lock);
+    return ret;
 }
 
 void N_FC_PutFlowField(ff_id_t ffid, const struct flow_field *ff)
 {
-    lru_flow_put(&s_flow_cache, ffid, ff);
+    struct flow_shard *shard = fc_flow_shard(ffid);
+
+    SDL_AtomicLock(&shard->lock);
+    const struct flow_field *prev = lru_flow_at(&shard->cache, ffid);
+    bool changed = prev && memcmp(prev, ff, sizeof(*ff));
+    lru_flow_put(&shard->cache, ffid, ff);
+    SDL_AtomicUnlock(&shard->lock);
+
+    if(changed) {
+        fc_flow_changed(ffid);
+    }
 
     struct coord chunk = (struct coord){(ffid >> 8) & 0xff, ffid & 0xff};
+    SDL_AtomicLock(&s_map_lock);
     field_map_add(s_chunk_ffield_map, key_for_chunk(chunk), ffid);
+    SDL_AtomicUnlock(&s_map_lock);
+}
+
+void N_FC_RemoveFlowField(ff_id_t ffid)
+{
+    struct flow_shard *shard = fc_flow_shard(ffid);
+
+    SDL_AtomicLock(&shard->lock);
+    bool found = lru_flow_remove(&shard->cache, ffid);
+    shard->invalidated += !!found;
+    SDL_AtomicUnlock(&shard->lock);
+    fc_flow_changed(ffid);
 }
 
 bool N_FC_GetDestFFMapping(dest_id_t id, struct coord chunk_coord, ff_id_t *out_ff)
 {
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    bool ret = lru_ffid_get(&s_ffid_cache, key, out_ff);
+    struct ffid_shard *shard = fc_ffid_shard(key);
 
-    s_perfstats.ffid_query++;
-    s_perfstats.ffid_hit += !!ret;
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_ffid_get(&shard->cache, key, out_ff);
+    fc_ffid_count(shard, key, ret);
+    SDL_AtomicUnlock(&shard->lock);
+
+    if(ret) {
+        PERF_COUNTER_ADD("fieldcache.ffid.hit", 1);
+    }else{
+        PERF_COUNTER_ADD("fieldcache.ffid.miss", 1);
+    }
     return ret;
 }
 
 void N_FC_PutDestFFMapping(dest_id_t dest_id, struct coord chunk_coord, ff_id_t ffid)
 {
     uint64_t key = key_for_dest_and_chunk(dest_id, chunk_coord);
-    lru_ffid_put(&s_ffid_cache, key, &ffid);
+    struct ffid_shard *shard = fc_ffid_shard(key);
+
+    SDL_AtomicLock(&shard->lock);
+    const ff_id_t *prev = lru_ffid_at(&shard->cache, key);
+    bool remapped = prev && (*prev != ffid);
+    lru_ffid_put(&shard->cache, key, &ffid);
+    SDL_AtomicUnlock(&shard->lock);
+
+    if(remapped) {
+        SDL_AtomicIncRef(&s_epoch);
+    }
 }
 
 bool N_FC_GetGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, enum nav_layer layer, struct grid_path_desc *out)
 {
     uint64_t key = grid_path_key(local_start, local_dest, chunk, layer);
-    bool ret = lru_grid_path_get(&s_grid_path_cache, key, out);
+    struct grid_path_shard *shard = fc_grid_path_shard(key);
+
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_grid_path_get(&shard->cache, key, out);
+    fc_grid_path_count(shard, key, ret);
+    SDL_AtomicUnlock(&shard->lock);
 
-    s_perfstats.grid_path_query++;
-    s_perfstats.grid_path_hit += !!ret;
+    if(ret) {
+        PERF_COUNTER_ADD("fieldcache.grid_path.hit", 1);
+    }else{
+        PERF_COUNTER_ADD("fieldcache.grid_path.miss", 1);
+    }
     return ret;
 }
 
@@ -404,7 +1120,66 @@ void N_FC_PutGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, enum nav_layer layer, const struct grid_path_desc *in)
 {
     uint64_t key = grid_path_key(local_start, local_dest, chunk, layer);
-    lru_grid_path_put(&s_grid_path_cache, key, in);
+    struct grid_path_shard *shard = fc_grid_path_shard(key);
+
+    SDL_AtomicLock(&shard->lock);
+    lru_grid_path_put(&shard->cache, key, in);
+    SDL_AtomicUnlock(&shard->lock);
+}
+
+bool N_FC_GetPortalRoute(dest_id_t id, struct coord src_chunk, uint16_t src_liid,
+                         struct portal_route_desc *out)
+{
+    uint64_t key = route_key(id, src_chunk, src_liid);
+    struct route_shard *shard = fc_route_shard(key);
+
+    /* The hops must be copied out before the entry can be evicted */
+    vec_portal_t path = out->path;
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_route_get(&shard->cache, key, out);
+    if(ret) {
+        vec_portal_t cached = out->path;
+        out->path = path;
+        ret = vec_portal_copy(&out->path, &cached);
+    }else{
+        out->path = path;
+    }
+    fc_route_count(shard, key, ret);
+    SDL_AtomicUnlock(&shard->lock);
+
+    if(ret) {
+        PERF_COUNTER_ADD("fieldcache.route.hit", 1);
+    }else{
+        PERF_COUNTER_ADD("fieldcache.route.miss", 1);
+    }
+    return ret;
+}
+
+void N_FC_PutPortalRoute(dest_id_t id, struct coord src_chunk, uint16_t src_liid,
+                         const struct portal_route_desc *in)
+{
+    uint64_t key = route_key(id, src_chunk, src_liid);
+    struct route_shard *shard = fc_route_shard(key);
+
+    SDL_AtomicLock(&shard->lock);
+    lru_route_put(&shard->cache, key, in);
+    SDL_AtomicUnlock(&shard->lock);
+}
+
+void N_FC_InvalidatePortalRoute(dest_id_t id, struct coord src_chunk, uint16_t src_liid)
+{
+    uint64_t key = route_key(id, src_chunk, src_liid);
+    struct route_shard *shard = fc_route_shard(key);
+
+    SDL_AtomicLock(&shard->lock);
+    const struct portal_route_desc *entry = lru_route_at(&shard->cache, key);
+    if(entry) {
+        vec_portal_t path = entry->path;
+        vec_portal_destroy(&path);
+        lru_route_remove(&shard->cache, key);
+        shard->invalidated++;
+    }
+    SDL_AtomicUnlock(&shard->lock);
 }
 
 void N_FC_InvalidateAllAtChunk(struct coord chunk, enum nav_layer layer)
@@ -424,7 +1199,7 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk, enum nav_layer layer)
 {
     assert(Sched_UsingBigStack());
 
-    dest_id_t paths[CONFIG_FLOW_CACHE_SZ];
+    STALLOC(dest_id_t, paths, fc_ffid_totals().capacity);
     size_t npaths = 0;
 
     uint64_t key;
@@ -432,50 +1207,77 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk, enum nav_layer layer)
 
     /* Make sure not to actually query the caches, in order to not mess up the age history */
     /* First find all the paths going through the chunk. */
-    LRU_FOREACH_SAFE_REMOVE(ffid, &s_ffid_cache, key, ffid_val, {
+    for(int i = 0; i < FC_NSHARDS; i++) {
 
-        (void)ffid_val;
-        dest_id_t curr_dest = key_dest(key);
-        struct coord curr_chunk = key_chunk(key);
+        struct ffid_shard *shard = &s_ffid_shards[i];
+        SDL_AtomicLock(&shard->lock);
 
-        if(N_DestLayer(curr_dest) != layer)
-            continue;
+        LRU_FOREACH_SAFE_REMOVE(ffid, &shard->cache, key, ffid_val, {
 
-        if(0 == memcmp(&curr_chunk, &chunk, sizeof(chunk))
-        && !dest_array_contains(paths, npaths, curr_dest)) {
+            (void)ffid_val;
+            dest_id_t curr_dest = key_dest(key);
+            struct coord curr_chunk = key_chunk(key);
 
-            paths[npaths++] = curr_dest;
-        }
-    });
+            if(N_DestLayer(curr_dest) != layer)
+                continue;
+
+            if(0 == memcmp(&curr_chunk, &chunk, sizeof(chunk))
+            && !dest_array_contains(paths, npaths, curr_dest)) {
+
+                paths[npaths++] = curr_dest;
+            }
+        });
+
+        SDL_AtomicUnlock(&shard->lock);
+    }
 
     /* Now that we know all the paths, find and remove all the flow 
      * fields belonging to them */
     struct flow_field ff_val;
-    LRU_FOREACH_SAFE_REMOVE(flow, &s_flow_cache, key, ff_val, {
-    
-        (void)ff_val;
-        dest_id_t curr_dest = key_dest(key);
+    for(int i = 0; i < FC_NSHARDS; i++) {
+
+        struct flow_shard *shard = &s_flow_shards[i];
+        SDL_AtomicLock(&shard->lock);
 
-        if(dest_array_contains(paths, npaths, curr_dest)) {
+        LRU_FOREACH_SAFE_REMOVE(flow, &shard->cache, key, ff_val, {
         
-            bool found = lru_flow_remove(&s_flow_cache, key);
-            s_perfstats.flow_invalidated += !!found;
-        }
-    });
+            (void)ff_val;
+            dest_id_t curr_dest = key_dest(key);
+
+            if(dest_array_contains(paths, npaths, curr_dest)) {
+            
+                bool found = lru_flow_remove(&shard->cache, key);
+                shard->invalidated += !!found;
+            }
+        });
+
+        SDL_AtomicUnlock(&shard->lock);
+    }
 
     /* And remove all the LOS fields as well */
     struct LOS_field los_val;
-    LRU_FOREACH_SAFE_REMOVE(los, &s_los_cache, key, los_val, {
+    for(int i = 0; i < FC_NSHARDS; i++) {
 
-        (void)los_val;
-        dest_id_t curr_dest = key_dest(key);
+        struct los_shard *shard = &s_los_shards[i];
+        SDL_AtomicLock(&shard->lock);
 
-        if(dest_array_contains(paths, npaths, curr_dest)) {
-        
-            bool found = lru_los_remove(&s_los_cache, key);
-            s_perfstats.los_invalidated += !!found;
-        }
-    });
+        LRU_FOREACH_SAFE_REMOVE(los, &shard->cache, key, los_val, {
+
+            (void)los_val;
+            dest_id_t curr_dest = key_dest(key);
+
+            if(dest_array_contains(paths, npaths, curr_dest)) {
+            
+                bool found = lru_los_remove(&shard->cache, key);
+                shard->invalidated += !!found;
+            }
+        });
+
+        SDL_AtomicUnlock(&shard->lock);
+    }
+
+    SDL_AtomicIncRef(&s_epoch);
+    STFREE(paths);
 }
 
 void N_FC_InvalidateNeighbourEnemySeekFields(int width, int height, 
@@ -506,17 +1308,25 @@ void N_FC_InvalidateDynamicSurroundFields(void)
     uint64_t key;
     struct flow_field ff_val;
 
-    LRU_FOREACH_SAFE_REMOVE(flow, &s_flow_cache, key, ff_val, {
-    
-        int type = N_FlowFieldTargetType(key);
-        if(type != TARGET_ENTITY)
-            continue;
+    for(int i = 0; i < FC_NSHARDS; i++) {
 
-        uint32_t ent = ff_val.target.ent.target;
-        if(!(G_FlagsGet(ent) & ENTITY_FLAG_MOVABLE))
-            continue;
+        struct flow_shard *shard = &s_flow_shards[i];
+        SDL_AtomicLock(&shard->lock);
 
-        lru_flow_remove(&s_flow_cache, key);
-    });
+        LRU_FOREACH_SAFE_REMOVE(flow, &shard->cache, key, ff_val, {
+        
+            int type = N_FlowFieldTargetType(key);
+            if(type != TARGET_ENTITY)
+                continue;
+
+            uint32_t ent = ff_val.target.ent.target;
+            if(!(G_FlagsGet(ent) & ENTITY_FLAG_MOVABLE))
+                continue;
+
+            lru_flow_remove(&shard->cache, key);
+        });
+
+        SDL_AtomicUnlock(&shard->lock);
+    }
 }
 
@@ -51,6 +51,11 @@
 bool N_FC_Init(void);
 void N_FC_Shutdown(void);
 
+/* Re-evaluate the capacities of the caches based on their recent hit rates
+ * and occupancy, when auto-sizing is enabled. Main thread only.
+ */
+void N_FC_Update(void);
+
 /* Invalidate all LOS and Flow fields for a particular chunk 
  */
 void N_FC_InvalidateAllAtChunk(struct coord chunk, enum nav_layer layer);
@@ -69,14 +74,26 @@ void N_FC_InvalidateNeighbourEnemySeekFields(int width, int height,
 
 void N_FC_InvalidateDynamicSurroundFields(void);
 
+/* Changes whenever a flow or LOS field, or a path's mapping to its' flow fields, 
+ * may have been overwritten or dropped. Copies of fields taken at one epoch are 
+ * still valid so long as it has not moved on.
+ */
+uint32_t N_FC_Epoch(void);
+
 /*###########################################################################*/
 /* LOS FIELD CACHING                                                         */
 /*###########################################################################*/
 
 /* Returned pointer should not be cached, as it may become invalid after eviction. 
+ * It may only be used while no other thread is adding to the cache.
  */
 const struct LOS_field  *N_FC_LOSFieldAt(dest_id_t id, struct coord chunk_coord);
 
+/* Copying lookup, safe to use concurrently with other accesses of the cache.
+ */
+bool                     N_FC_GetLOSField(dest_id_t id, struct coord chunk_coord, 
+                                          struct LOS_field *out);
+
 bool                     N_FC_ContainsLOSField(dest_id_t id, struct coord chunk_coord);
 void                     N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, 
                                           const struct LOS_field *lf);
@@ -86,11 +103,22 @@ void                     N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord
 /*###########################################################################*/
 
 /* Returned pointer should not be cached, as it may become invalid after eviction. 
+ * It may only be used while no other thread is adding to the cache.
  */
 const struct flow_field *N_FC_FlowFieldAt(ff_id_t ffid);
 
+/* Copying lookup, safe to use concurrently with other accesses of the cache.
+ */
+bool                     N_FC_GetFlowField(ff_id_t ffid, struct flow_field *out);
+
 bool                     N_FC_ContainsFlowField(ff_id_t ffid);
 void                     N_FC_PutFlowField(ff_id_t ffid, const struct flow_field *ff);
+void                     N_FC_RemoveFlowField(ff_id_t ffid);
+
+/* Account for 'nrefs' requests for the enemy seek and surround fields of a 
+ * movement tick, which were canonicalized to 'nfields' distinct fields.
+ */
+void                     N_FC_AddVolatileFieldRefs(unsigned nfields, unsigned nrefs);
 
 bool                     N_FC_GetDestFFMapping(dest_id_t id, struct coord chunk_coord, 
                                                ff_id_t *out_ff);
@@ -112,5 +140,35 @@ bool N_FC_GetGridPath(struct coord local_start, struct coord local_dest,
 void N_FC_PutGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, enum nav_layer layer, const struct grid_path_desc *in);
 
+/*###########################################################################*/
+/* PORTAL ROUTE CACHING                                                      */
+/*###########################################################################*/
+
+/* A portal graph path from a local island of the source chunk towards a 
+ * destination, along with the state it was found in. The navigation code 
+ * decides whether the route is still usable. */
+struct portal_route_desc{
+    /* The navigation data and portal graph revision the route was found on */
+    uint64_t             nav_uid;
+    uint32_t             portal_gen;
+    /* The greatest version of all the chunks the route depends on */
+    uint64_t             max_version;
+    /* The destination may have been moved to a reachable tile */
+    struct tile_desc     dst_desc;
+    const struct portal *dst_port;
+    float                cost;
+    vec_portal_t         path;
+};
+
+/* On success, the hops are copied into the caller-initialized 'out->path'.
+ */
+bool N_FC_GetPortalRoute(dest_id_t id, struct coord src_chunk, uint16_t src_liid,
+                         struct portal_route_desc *out);
+/* The cache takes ownership of the 'in->path' vector.
+ */
+void N_FC_PutPortalRoute(dest_id_t id, struct coord src_chunk, uint16_t src_liid,
+                         const struct portal_route_desc *in);
+void N_FC_InvalidatePortalRoute(dest_id_t id, struct coord src_chunk, uint16_t src_liid);
+
 #endif
 
@@ -0,0 +1,593 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "loscompute.h"
+#include "nav_private.h"
+#include "field.h"
+#include "fieldcache.h"
+#include "../game/public/game.h"
+#include "../render/public/render.h"
+#include "../render/public/render_ctrl.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/vec.h"
+#include "../lib/public/mem.h"
+#include "../settings.h"
+#include "../perf.h"
+#include "../main.h"
+
+#include <SDL.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
+#define IDX(r, width, c)    ((r) * (width) + (c))
+#define WORD_BITS           (32)
+#define WORDS_PER_ROW       (FIELD_RES_C / WORD_BITS)
+#define WORDS_PER_JOB       (FIELD_RES_R * WORDS_PER_ROW)
+#define MAX_JOBS            (256)
+#define MAX_BATCHES         (3)
+
+_Static_assert(FIELD_RES_C % WORD_BITS == 0, 
+    "The visibility of a row of a chunk must pack into whole words");
+
+struct lc_job{
+    dest_id_t        id;
+    struct coord     chunk;
+    struct tile_desc target;
+};
+
+VEC_TYPE(job, struct lc_job)
+VEC_IMPL(static inline, job, struct lc_job)
+
+struct lc_batch{
+    uint32_t       id;
+    uint32_t       epoch;
+    /* The chunks read by the dispatch, inclusive */
+    enum nav_layer layer;
+    int            minr, minc;
+    int            maxr, maxc;
+    /* Set when any of the chunks has been written to since the dispatch */
+    bool           stale;
+    vec_job_t      jobs;
+};
+
+VEC_TYPE(batch, struct lc_batch)
+VEC_IMPL(static inline, batch, struct lc_batch)
+
+/* Host-side destination for the visibility masks read back from the GPU. 
+ * The render thread sets 'nread' once the (non-blocking) read has been 
+ * performed. 
+ */
+struct lc_readback{
+    SDL_atomic_t   nread; /* -1 while the read is in flight */
+    uint32_t       batch;
+    uint32_t      *words;
+};
+
+KHASH_SET_INIT_INT64(key)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static SDL_SpinLock       s_lock;
+/* The requests which have not yet been dispatched */
+static vec_job_t          s_queue;
+/* The keys of all the queued and in-flight requests */
+static khash_t(key)      *s_requested;
+
+static vec_batch_t        s_batches;
+static struct lc_readback s_readback[2];
+static uint32_t           s_next_batch;
+static uint32_t           s_epoch;
+static SDL_atomic_t       s_invalidate_all;
+static bool               s_enabled;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint64_t lc_key(dest_id_t id, struct coord chunk)
+{
+    return (((uint64_t)id) << 32)
+         | (((uint64_t)chunk.r & 0xffff) << 16)
+         | (((uint64_t)chunk.c & 0xffff) <<  0);
+}
+
+static void lc_release_jobs(const vec_job_t *jobs)
+{
+    SDL_AtomicLock(&s_lock);
+    for(int i = 0; i < vec_size(jobs); i++) {
+        const struct lc_job *job = &vec_AT(jobs, i);
+        khiter_t k = kh_get(key, s_requested, lc_key(job->id, job->chunk));
+        if(k != kh_end(s_requested))
+            kh_del(key, s_requested, k);
+    }
+    SDL_AtomicUnlock(&s_lock);
+}
+
+/* The jobs are still in 's_requested', so they are just put back at the 
+ * end of the queue to be dispatched again.
+ */
+static void lc_requeue_jobs(const vec_job_t *jobs)
+{
+    SDL_AtomicLock(&s_lock);
+    for(int i = 0; i < vec_size(jobs); i++) {
+        vec_job_push(&s_queue, vec_AT(jobs, i));
+    }
+    SDL_AtomicUnlock(&s_lock);
+}
+
+static void lc_batch_destroy(struct lc_batch *batch)
+{
+    lc_release_jobs(&batch->jobs);
+    vec_job_destroy(&batch->jobs);
+}
+
+static void lc_batch_requeue(struct lc_batch *batch)
+{
+    lc_requeue_jobs(&batch->jobs);
+    vec_job_destroy(&batch->jobs);
+}
+
+static uint16_t lc_enemies(int faction_id)
+{
+    if(faction_id == FACTION_ID_NONE)
+        return 0;
+    return G_GetEnemyFactions(faction_id);
+}
+
+/* Matches the passability test of the wavefront in 'N_LOSFieldCreate': 
+ * the blockers of a faction's enemies do not obstruct its' line of sight.
+ */
+static bool lc_tile_blocked(const struct nav_chunk *chunk, int faction_id, 
+                            uint16_t enemies, int r, int c)
+{
+    if(chunk->cost_base[r][c] == COST_IMPASSABLE)
+        return true;
+    if(chunk->blockers[r][c] == 0)
+        return false;
+    if(faction_id == FACTION_ID_NONE)
+        return true;
+
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(chunk->factions[i][r][c] && !(enemies & (0x1 << i)))
+            return true;
+    }
+    return false;
+}
+
+static bool lc_visible(const uint32_t *words, int r, int c)
+{
+    if(r < 0 || r >= FIELD_RES_R || c < 0 || c >= FIELD_RES_C)
+        return false;
+    uint32_t word = words[r * WORDS_PER_ROW + c / WORD_BITS];
+    return (word >> (c % WORD_BITS)) & 0x1;
+}
+
+/* The edges of the visible region are marked with the 'wavefront blocked' 
+ * flag so that a LOS field for the neighbouring chunk may still be built 
+ * from this one by 'N_LOSFieldCreate'. Like the fields built on the CPU, 
+ * the visible region is then shrunk by a tile around these edges.
+ */
+static void lc_make_field(const struct nav_private *priv, const struct lc_job *job, 
+                          const uint32_t *words, struct LOS_field *out)
+{
+    const struct nav_chunk *chunk = &priv->chunks[N_DestLayer(job->id)]
+                                                 [IDX(job->chunk.r, priv->width, job->chunk.c)];
+    const int faction_id = N_DestFactionID(job->id);
+    const uint16_t enemies = lc_enemies(faction_id);
+    out->chunk = job->chunk;
+    memset(out->field, 0, sizeof(out->field));
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        if(lc_visible(words, r, c)) {
+            out->field[r][c].visible = 1;
+            continue;
+        }
+        if(lc_tile_blocked(chunk, faction_id, enemies, r, c))
+            continue;
+        if(lc_visible(words, r - 1, c) || lc_visible(words, r + 1, c)
+        || lc_visible(words, r, c - 1) || lc_visible(words, r, c + 1)) {
+            out->field[r][c].wavefront_blocked = 1;
+        }
+    }}
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        if(!out->field[r][c].wavefront_blocked)
+            continue;
+
+        for(int rr = MAX(r - 1, 0); rr <= MIN(r + 1, FIELD_RES_R - 1); rr++) {
+        for(int cc = MAX(c - 1, 0); cc <= MIN(c + 1, FIELD_RES_C - 1); cc++) {
+            out->field[rr][cc].visible = 0;
+        }}
+    }}
+}
+
+static void lc_collect(const struct nav_private *priv)
+{
+    for(int i = 0; i < ARR_SIZE(s_readback); i++) {
+
+        struct lc_readback *rb = &s_readback[i];
+        int nread = SDL_AtomicGet(&rb->nread);
+        if(nread <= 0)
+            continue;
+
+        size_t nfields = 0;
+        for(int j = vec_size(&s_batches) - 1; j >= 0; j--) {
+
+            struct lc_batch *batch = &vec_AT(&s_batches, j);
+            if(batch->id > rb->batch)
+                continue;
+
+            /* Older batches which have not been read back have been 
+             * dropped by the render thread, and the results of stale 
+             * batches can't be used. The jobs are dispatched again. */
+            if(batch->id < rb->batch || batch->stale) {
+                lc_batch_requeue(batch);
+                vec_batch_del(&s_batches, j);
+                continue;
+            }
+
+            if(batch->epoch == s_epoch) {
+
+                assert(nread == vec_size(&batch->jobs) * WORDS_PER_JOB);
+                for(int k = 0; k < vec_size(&batch->jobs); k++) {
+
+                    const struct lc_job *job = &vec_AT(&batch->jobs, k);
+                    if(N_FC_ContainsLOSField(job->id, job->chunk))
+                        continue;
+
+                    struct LOS_field lf;
+                    lc_make_field(priv, job, rb->words + k * WORDS_PER_JOB, &lf);
+                    N_FC_PutLOSField(job->id, job->chunk, &lf);
+                    nfields++;
+                }
+            }
+            lc_batch_destroy(batch);
+            vec_batch_del(&s_batches, j);
+        }
+
+        PERF_COUNTER_ADD("nav.gpu_los_fields", nfields);
+        (void)nfields;
+        SDL_AtomicSet(&rb->nread, 0);
+    }
+}
+
+static void lc_take_jobs(vec_job_t *out)
+{
+    SDL_AtomicLock(&s_lock);
+
+    if(vec_size(&s_queue) == 0) {
+        SDL_AtomicUnlock(&s_lock);
+        return;
+    }
+
+    /* A dispatch only handles the chunks of a single layer and faction, 
+     * since the blocked tiles depend on both */
+    enum nav_layer layer = N_DestLayer(vec_AT(&s_queue, 0).id);
+    int faction_id = N_DestFactionID(vec_AT(&s_queue, 0).id);
+    size_t left = 0;
+
+    for(int i = 0; i < vec_size(&s_queue); i++) {
+
+        struct lc_job job = vec_AT(&s_queue, i);
+        if(N_DestLayer(job.id) == layer 
+        && N_DestFactionID(job.id) == faction_id
+        && vec_size(out) < MAX_JOBS) {
+            vec_job_push(out, job);
+        }else{
+            vec_AT(&s_queue, left++) = job;
+        }
+    }
+    s_queue.size = left;
+
+    SDL_AtomicUnlock(&s_lock);
+}
+
+static void lc_submit(const struct nav_private *priv)
+{
+    if(vec_size(&s_batches) == MAX_BATCHES)
+        return;
+
+    struct lc_batch batch = (struct lc_batch){
+        .id = s_next_batch,
+        .epoch = s_epoch,
+    };
+    vec_job_init(&batch.jobs);
+    lc_take_jobs(&batch.jobs);
+
+    if(vec_size(&batch.jobs) == 0) {
+        vec_job_destroy(&batch.jobs);
+        return;
+    }
+
+    /* The lines of sight never leave the bounding box of the chunks and 
+     * their targets, so only the blocked tiles within it are uploaded. */
+    enum nav_layer layer = N_DestLayer(vec_AT(&batch.jobs, 0).id);
+    const int faction_id = N_DestFactionID(vec_AT(&batch.jobs, 0).id);
+    const uint16_t enemies = lc_enemies(faction_id);
+    int minr = INT_MAX, minc = INT_MAX, maxr = 0, maxc = 0;
+
+    for(int i = 0; i < vec_size(&batch.jobs); i++) {
+        const struct lc_job *job = &vec_AT(&batch.jobs, i);
+        minr = MIN(minr, MIN(job->chunk.r, job->target.chunk_r));
+        minc = MIN(minc, MIN(job->chunk.c, job->target.chunk_c));
+        maxr = MAX(maxr, MAX(job->chunk.r, job->target.chunk_r));
+        maxc = MAX(maxc, MAX(job->chunk.c, job->target.chunk_c));
+    }
+
+    const int rows = (maxr - minr + 1) * FIELD_RES_R;
+    const int cols = (maxc - minc + 1) * FIELD_RES_C;
+    const int words_per_row = cols / WORD_BITS;
+    const size_t njobs = vec_size(&batch.jobs);
+    const size_t mask_size = rows * words_per_row * sizeof(uint32_t);
+    const size_t jobs_size = (njobs + 1) * sizeof(int32_t[4]);
+
+    struct render_workspace *ws = G_GetSimWS();
+    uint32_t *mask = stalloc(&ws->args, mask_size);
+    int32_t *jobs = stalloc(&ws->args, jobs_size);
+    if(!mask || !jobs) {
+        lc_batch_requeue(&batch);
+        return;
+    }
+    memset(mask, 0, mask_size);
+
+    for(int cr = minr; cr <= maxr; cr++) {
+    for(int cc = minc; cc <= maxc; cc++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[layer][IDX(cr, priv->width, cc)];
+        for(int r = 0; r < FIELD_RES_R; r++) {
+
+            uint32_t *row = mask + ((cr - minr) * FIELD_RES_R + r) * words_per_row
+                                 + (cc - minc) * WORDS_PER_ROW;
+            for(int c = 0; c < FIELD_RES_C; c++) {
+                if(lc_tile_blocked(chunk, faction_id, enemies, r, c))
+                    row[c / WORD_BITS] |= (0x1u << (c % WORD_BITS));
+            }
+        }
+    }}
+
+    batch.layer = layer;
+    batch.minr = minr;
+    batch.minc = minc;
+    batch.maxr = maxr;
+    batch.maxc = maxc;
+    batch.stale = false;
+
+    int32_t *cursor = jobs;
+    *cursor++ = rows;
+    *cursor++ = cols;
+    *cursor++ = words_per_row;
+    *cursor++ = 0;
+
+    for(int i = 0; i < njobs; i++) {
+        const struct lc_job *job = &vec_AT(&batch.jobs, i);
+        *cursor++ = job->chunk.r - minr;
+        *cursor++ = job->chunk.c - minc;
+        *cursor++ = (job->target.chunk_r - minr) * FIELD_RES_R + job->target.tile_r;
+        *cursor++ = (job->target.chunk_c - minc) * FIELD_RES_C + job->target.tile_c;
+    }
+    assert(cursor == jobs + (njobs + 1) * 4);
+
+    const int chunk_res[2] = {FIELD_RES_R, FIELD_RES_C};
+    R_PushCmd((struct rcmd){
+        .func = R_GL_LOSDispatch,
+        .nargs = 6,
+        .args = {
+            jobs,
+            R_PushArg(&njobs, sizeof(njobs)),
+            mask,
+            R_PushArg(&mask_size, sizeof(mask_size)),
+            R_PushArg(chunk_res, sizeof(chunk_res)),
+            R_PushArg(&batch.id, sizeof(batch.id)),
+        },
+    });
+
+    vec_batch_push(&s_batches, batch);
+    s_next_batch++;
+    PERF_COUNTER_ADD("nav.gpu_los_jobs", njobs);
+}
+
+static void lc_read(void)
+{
+    if(vec_size(&s_batches) == 0)
+        return;
+
+    for(int i = 0; i < ARR_SIZE(s_readback); i++) {
+
+        struct lc_readback *rb = &s_readback[i];
+        if(SDL_AtomicGet(&rb->nread) != 0)
+            continue;
+
+        const size_t maxout = MAX_JOBS * WORDS_PER_JOB * sizeof(uint32_t);
+        SDL_AtomicSet(&rb->nread, -1);
+
+        R_PushCmd((struct rcmd){
+            .func = R_GL_LOSRead,
+            .nargs = 4,
+            .args = {
+                rb->words,
+                R_PushArg(&maxout, sizeof(maxout)),
+                &rb->batch,
+                &rb->nread
+            },
+        });
+        return;
+    }
+}
+
+static bool lc_setting_enabled(void)
+{
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.gpu_los", &setting);
+    if(status != SS_OKAY || !setting.as_bool)
+        return false;
+    return R_ComputeShaderSupported();
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool N_LC_Init(void)
+{
+    if(NULL == (s_requested = kh_init(key)))
+        goto fail_requested;
+
+    for(int i = 0; i < ARR_SIZE(s_readback); i++) {
+        s_readback[i].words = malloc(MAX_JOBS * WORDS_PER_JOB * sizeof(uint32_t));
+        if(!s_readback[i].words)
+            goto fail_readback;
+        SDL_AtomicSet(&s_readback[i].nread, 0);
+    }
+
+    vec_job_init(&s_queue);
+    vec_batch_init(&s_batches);
+    s_enabled = false;
+    return true;
+
+fail_readback:
+    for(int i = 0; i < ARR_SIZE(s_readback); i++) {
+        free(s_readback[i].words);
+        s_readback[i].words = NULL;
+    }
+    kh_destroy(key, s_requested);
+    s_requested = NULL;
+fail_requested:
+    return false;
+}
+
+void N_LC_Shutdown(void)
+{
+    if(!s_requested)
+        return;
+
+    N_LC_Clear();
+    vec_job_destroy(&s_queue);
+    vec_batch_destroy(&s_batches);
+    for(int i = 0; i < ARR_SIZE(s_readback); i++) {
+        free(s_readback[i].words);
+        s_readback[i].words = NULL;
+    }
+    kh_destroy(key, s_requested);
+    s_requested = NULL;
+}
+
+void N_LC_Clear(void)
+{
+    for(int i = 0; i < vec_size(&s_batches); i++) {
+        vec_job_destroy(&vec_AT(&s_batches, i).jobs);
+    }
+    vec_batch_reset(&s_batches);
+
+    SDL_AtomicLock(&s_lock);
+    vec_job_reset(&s_queue);
+    kh_clear(key, s_requested);
+    SDL_AtomicUnlock(&s_lock);
+
+    s_epoch++;
+}
+
+bool N_LC_Enabled(void)
+{
+    return s_enabled;
+}
+
+void N_LC_Request(dest_id_t id, struct coord chunk, struct tile_desc target)
+{
+    SDL_AtomicLock(&s_lock);
+
+    int ret;
+    kh_put(key, s_requested, lc_key(id, chunk), &ret);
+    if(ret > 0) {
+        vec_job_push(&s_queue, (struct lc_job){id, chunk, target});
+    }
+
+    SDL_AtomicUnlock(&s_lock);
+}
+
+void N_LC_Invalidate(void)
+{
+    SDL_AtomicSet(&s_invalidate_all, 1);
+}
+
+void N_LC_InvalidateChunk(enum nav_layer layer, struct coord chunk)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    for(int i = 0; i < vec_size(&s_batches); i++) {
+
+        struct lc_batch *batch = &vec_AT(&s_batches, i);
+        if(batch->layer != layer)
+            continue;
+        if(chunk.r < batch->minr || chunk.r > batch->maxr)
+            continue;
+        if(chunk.c < batch->minc || chunk.c > batch->maxc)
+            continue;
+        batch->stale = true;
+    }
+}
+
+void N_LC_Update(const struct nav_private *priv)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    if(SDL_AtomicSet(&s_invalidate_all, 0)) {
+        for(int i = 0; i < vec_size(&s_batches); i++) {
+            vec_AT(&s_batches, i).stale = true;
+        }
+    }
+
+    s_enabled = lc_setting_enabled();
+    lc_collect(priv);
+    if(s_enabled) {
+        lc_submit(priv);
+    }
+    lc_read();
+
+    PERF_RETURN_VOID();
+}
+
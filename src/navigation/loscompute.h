@@ -0,0 +1,91 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef LOSCOMPUTE_H
+#define LOSCOMPUTE_H
+
+#include "nav_data.h"
+#include "public/nav.h"
+#include "../map/public/tile.h"
+
+#include <stdbool.h>
+
+struct nav_private;
+
+/* When compute shaders are available, LOS fields can be generated on the 
+ * GPU instead of by the wavefront in 'N_LOSFieldCreate'. Requests are 
+ * queued up, and all the queued chunks of a layer are handled by a single
+ * dispatch once per tick. The results are read back asynchronously by a 
+ * later tick and inserted into the field cache, until which point there 
+ * is no LOS field for the chunk. A tile is marked visible when unobstructed 
+ * lines can be drawn from its' center and its' corners to the target tile.
+ */
+
+bool N_LC_Init(void);
+void N_LC_Shutdown(void);
+
+/* Drop all the queued and in-flight requests. 
+ */
+void N_LC_Clear(void);
+
+/* Returns true if LOS fields should be requested via 'N_LC_Request' rather 
+ * than being created on the CPU. 
+ */
+bool N_LC_Enabled(void);
+
+/* Queue up the creation of the LOS field for 'chunk'. Duplicate requests are
+ * ignored. Safe to call from any thread.
+ */
+void N_LC_Request(dest_id_t id, struct coord chunk, struct tile_desc target);
+
+/* Discard the results of all the work that is currently in flight, as it 
+ * was computed with stale cost or blocker data. The discarded requests are 
+ * dispatched again. Safe to call from any thread.
+ */
+void N_LC_Invalidate(void);
+
+/* Same as 'N_LC_Invalidate', but only for the work which read from 'chunk'.
+ * Must be called from the main thread.
+ */
+void N_LC_InvalidateChunk(enum nav_layer layer, struct coord chunk);
+
+/* Insert the results which have been read back into the field cache, and
+ * kick off the work for the queued requests. Must be called from the main 
+ * thread.
+ */
+void N_LC_Update(const struct nav_private *priv);
+
+#endif
+
@@ -38,6 +38,8 @@
 #include "a_star.h"
 #include "field.h"
 #include "fieldcache.h"
+#include "navcache.h"
+#include "loscompute.h"
 #include "../map/public/tile.h"
 #include "../game/public/game.h"
 #include "../render/public/render.h"
@@ -54,6 +56,8 @@
 #include "../sched.h"
 #include "../ui.h"
 #include "../camera.h"
+#include "../config.h"
+#include "../settings.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -74,6 +78,10 @@ bool M_TileAdjacentToLand(const struct map *map, const struct tile_desc *td);
 
 #define EPSILON                  (1.0f / 1024)
 #define MAX_FIELD_TASKS          (256)
+#define FLOCK_FIELDS_MAX_CHUNKS  (16)
+#define BUILDABLE_MAX_TILES      (2048)
+#define BUILDABLE_MAX_CHUNKS     (16)
+#define OVERLAY_TEXT_LEN         (64)
 
 #define FOREACH_PORTAL(_priv, _layer, _local, ...)                                              \
     do{                                                                                         \
@@ -115,6 +123,14 @@ struct field_work_in{
     int                 faction_id;
     enum nav_layer      layer;
     ff_id_t             id;
+    /* For deferred work, the target tiles are found on the main thread 
+     * when the field is requested and the task builds the field against
+     * a copy of the navigation data, never touching the live gamestate. */
+    size_t              ntiles;
+    struct tile_desc   *tiles;
+    /* Set when a chunk spanned by the field got invalidated while the 
+     * field was being built */
+    bool                stale;
 };
 
 struct field_work_out{
@@ -127,14 +143,129 @@ VEC_IMPL(static inline, in, struct field_work_in)
 VEC_TYPE(out, struct field_work_out)
 VEC_IMPL(static inline, out, struct field_work_out)
 
+/* Maps the fields referenced by the current batch to the index of the 
+ * work building them, or -1 if they were already in the cache */
+KHASH_MAP_INIT_INT64(ffid, int)
+
 struct field_work{
     struct memstack mem;
     vec_in_t        in;
     vec_out_t       out;
+    khash_t(ffid)  *ids;
+    /* The number of requests made in the current batch */
+    size_t          nrefs;
+    /* When set, the work may stay outstanding across ticks */
+    bool            deferred;
     size_t          nwork;
-    size_t          ntasks;
-    uint32_t        tids[MAX_FIELD_TASKS];
-    struct future   futures[MAX_FIELD_TASKS];
+    /* The tick graph node building the batch, or -1 */
+    int             node;
+    bool            submitted;
+    /* Stale fields from the last deferred batch. They are used for the
+     * tick in which they were collected and evicted on the next update. */
+    size_t          nevict;
+    ff_id_t         evict[MAX_FIELD_TASKS];
+};
+
+/* A flow field build deferred by a batched path request */
+struct batch_field{
+    ff_id_t             id;
+    struct coord        chunk;
+    struct field_target target;
+    /* When set, the field is built by updating a copy of the 
+     * (earlier) field with the 'base' ID, rather than from scratch */
+    bool                has_base;
+    ff_id_t             base;
+    struct flow_field   field;
+};
+
+VEC_TYPE(bfield, struct batch_field)
+VEC_IMPL(static inline, bfield, struct batch_field)
+
+struct path_batch{
+    struct nav_private *priv;
+    int                 faction_id;
+    enum nav_layer      layer;
+    vec_bfield_t        fields;
+};
+
+struct batch_src{
+    size_t           idx;
+    float            dist;
+    struct tile_desc td;
+};
+
+/* Per-chunk construction steps over all the chunks of a layer */
+struct layer_work{
+    struct nav_private *priv;
+    enum nav_layer      layer;
+};
+
+struct build_family_arg{
+    struct nav_private *priv;
+    enum nav_layer      base;
+};
+
+struct flock_chunk_fields{
+    struct coord      chunk;
+    /* The field cache epoch that the copies were taken at */
+    uint32_t          epoch;
+    bool              has_flow;
+    bool              has_los;
+    struct flow_field flow;
+    struct LOS_field  los;
+};
+
+struct nav_flock_fields{
+    dest_id_t                  id;
+    int                        nchunks;
+    int                        next_victim;
+    /* Allocated on first use and kept around when the slot is recycled */
+    struct flock_chunk_fields *chunks[FLOCK_FIELDS_MAX_CHUNKS];
+};
+
+/* The per-tile buildability of the tiles under an object. Placing a building 
+ * queries the same footprint several times per frame (once for the check, and 
+ * once for every visible chunk when rendering the overlay), so the result of 
+ * the last query made from the main thread is kept around. It stays valid 
+ * for the rest of the frame, so long as none of the chunks it covers are 
+ * modified. */
+struct buildable_query{
+    bool              valid;
+    uint64_t          nav_uid;
+    unsigned long     frame_idx;
+    enum nav_layer    layer;
+    bool              allow_shore;
+    vec3_t            map_pos;
+    struct obb        obb;
+    size_t            nchunks;
+    struct coord      chunks[BUILDABLE_MAX_CHUNKS];
+    uint64_t          versions[BUILDABLE_MAX_CHUNKS];
+    size_t            ntiles;
+    struct tile_desc  tds[BUILDABLE_MAX_TILES];
+    /* One bit per tile, set when the tile can't be built on */
+    uint64_t          blocked[BUILDABLE_MAX_TILES / 64];
+    bool              any_blocked;
+};
+
+/* Debug overlays emitted between N_RenderOverlayBegin and N_RenderOverlayEnd 
+ * are accumulated here in world space and submitted as a single draw per 
+ * overlay type instead of one per chunk. */
+struct overlay_batch{
+    int               depth;
+    vec2_t            adj_vres;
+    /* Quads are indexed by their 'on_water_surface' flag */
+    size_t            nquads[2];
+    size_t            capquads[2];
+    vec2_t           *corners[2];
+    vec3_t           *colors[2];
+    size_t            nflow;
+    size_t            capflow;
+    vec2_t           *positions;
+    vec2_t           *dirs;
+    size_t            ntexts;
+    size_t            captexts;
+    char            (*texts)[OVERLAY_TEXT_LEN];
+    struct rect      *text_bounds;
 };
 
 KHASH_SET_INIT_INT(coord)
@@ -146,12 +277,33 @@ KHASH_SET_INIT_INT64(td)
 
 static khash_t(coord)   *s_dirty_chunks[NAV_LAYER_MAX];
 static bool              s_local_islands_dirty[NAV_LAYER_MAX] = {0};
+/* Chunks whose cost field has changed since the islands field was last built */
+static khash_t(coord)   *s_cost_dirty_chunks[NAV_LAYER_MAX];
 static struct field_work s_field_work;
+static struct buildable_query s_buildable;
+static struct overlay_batch s_overlay;
+/* Source of the chunk versions and navigation data IDs. Never reset, so 
+ * that every version is unique accross all chunks, copies and maps. */
+static uint64_t          s_next_version = 0;
+/* Bumped whenever the portal graph of any layer is rebuilt, which leaves
+ * all the cached portal routes dangling */
+static uint32_t          s_portal_gen = 0;
+/* Bumped whenever the map's tiles may have changed */
+static uint64_t          s_terrain_gen = 0;
+/* Guards building the closest tile transforms, which are built lazily */
+static SDL_SpinLock      s_closest_lock;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+/* Must be called after writing to any of the fields which are copied 
+ * by 'N_CopyFields' */
+static void n_chunk_modified(struct nav_chunk *chunk)
+{
+    chunk->version = ++s_next_version;
+}
+
 static void *vec_realloc(void *ptr, size_t size)
 {
     if(!ptr)
@@ -395,49 +547,47 @@ static bool n_cliff_edge(const struct tile *a, const struct tile *b)
     return (a->base_height != b->base_height);
 }
 
-static void n_make_cliff_edges(struct nav_private *priv, const struct tile **tiles,
-                               enum nav_layer layer, size_t chunk_w, size_t chunk_h)
+/* Only the chunk at (r, c) is written, so that chunks can be done in parallel */
+static void n_make_chunk_cliff_edges(struct nav_private *priv, const struct tile **tiles,
+                                     enum nav_layer layer, size_t chunk_w, size_t chunk_h,
+                                     int r, int c)
 {
-    for(int r = 0; r < priv->height; r++) {
-    for(int c = 0; c < priv->width; c++) {
-            
-        struct nav_chunk *curr_chunk = &priv->chunks[layer]
-                                                    [IDX(r, priv->width, c)];
-
-        const struct tile *bot_tiles = (r < priv->height-1)  ? tiles[IDX(r+1, priv->width, c)] : NULL;
-        const struct tile *top_tiles = (r > 0)               ? tiles[IDX(r-1, priv->width, c)] : NULL;
-        const struct tile *right_tiles = (c < priv->width-1) ? tiles[IDX(r, priv->width, c+1)] : NULL;
-        const struct tile *left_tiles = (c > 0)              ? tiles[IDX(r, priv->width, c-1)] : NULL;
-
-        for(int chr = 0; chr < chunk_h; chr++) {
-        for(int chc = 0; chc < chunk_w; chc++) {
-
-            const struct tile *curr_tile = &tiles[IDX(r, priv->width, c)][IDX(chr, chunk_w, chc)];
-            const struct tile *bot_tile   = (chr < chunk_h-1) ? curr_tile + chunk_w 
-                                          : bot_tiles         ? &bot_tiles[IDX(0, chunk_w, chc)]
-                                          : NULL;
-            const struct tile *top_tile   = (chr > 0)         ? curr_tile - chunk_w
-                                          : top_tiles         ? &top_tiles[IDX(chunk_h-1, chunk_w, chc)]
-                                          : NULL;
-            const struct tile *left_tile  = (chc > 0)         ? curr_tile - 1 
-                                          : left_tiles        ? &left_tiles[IDX(chr, chunk_w, chunk_w-1)]
-                                          : NULL;
-            const struct tile *right_tile = (chc < chunk_w-1) ? curr_tile + 1 
-                                          : right_tiles       ? &right_tiles[IDX(chr, chunk_w, 0)]
-                                          : NULL;
-
-            if(n_cliff_edge(curr_tile, bot_tile))
-                n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_BOT);
-
-            if(n_cliff_edge(curr_tile, top_tile))
-                n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_TOP);
-
-            if(n_cliff_edge(curr_tile, left_tile))
-                n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_LEFT);
-
-            if(n_cliff_edge(curr_tile, right_tile))
-                n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_RIGHT);
-        }}
+    struct nav_chunk *curr_chunk = &priv->chunks[layer]
+                                                [IDX(r, priv->width, c)];
+
+    const struct tile *bot_tiles = (r < priv->height-1)  ? tiles[IDX(r+1, priv->width, c)] : NULL;
+    const struct tile *top_tiles = (r > 0)               ? tiles[IDX(r-1, priv->width, c)] : NULL;
+    const struct tile *right_tiles = (c < priv->width-1) ? tiles[IDX(r, priv->width, c+1)] : NULL;
+    const struct tile *left_tiles = (c > 0)              ? tiles[IDX(r, priv->width, c-1)] : NULL;
+
+    for(int chr = 0; chr < chunk_h; chr++) {
+    for(int chc = 0; chc < chunk_w; chc++) {
+
+        const struct tile *curr_tile = &tiles[IDX(r, priv->width, c)][IDX(chr, chunk_w, chc)];
+        const struct tile *bot_tile   = (chr < chunk_h-1) ? curr_tile + chunk_w 
+                                      : bot_tiles         ? &bot_tiles[IDX(0, chunk_w, chc)]
+                                      : NULL;
+        const struct tile *top_tile   = (chr > 0)         ? curr_tile - chunk_w
+                                      : top_tiles         ? &top_tiles[IDX(chunk_h-1, chunk_w, chc)]
+                                      : NULL;
+        const struct tile *left_tile  = (chc > 0)         ? curr_tile - 1 
+                                      : left_tiles        ? &left_tiles[IDX(chr, chunk_w, chunk_w-1)]
+                                      : NULL;
+        const struct tile *right_tile = (chc < chunk_w-1) ? curr_tile + 1 
+                                      : right_tiles       ? &right_tiles[IDX(chr, chunk_w, 0)]
+                                      : NULL;
+
+        if(n_cliff_edge(curr_tile, bot_tile))
+            n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_BOT);
+
+        if(n_cliff_edge(curr_tile, top_tile))
+            n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_TOP);
+
+        if(n_cliff_edge(curr_tile, left_tile))
+            n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_LEFT);
+
+        if(n_cliff_edge(curr_tile, right_tile))
+            n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_RIGHT);
     }}
 }
 
@@ -685,14 +835,242 @@ static void n_update_all_edge_states(struct nav_private *priv, enum nav_layer la
     }
 }
 
+static vec2_t n_overlay_to_world(mat4x4_t *chunk_model, vec2_t xz, float w)
+{
+    vec4_t homo = (vec4_t){xz.raw[0], 0.0f, xz.raw[1], w};
+    vec4_t ws_homo;
+    PFM_Mat4x4_Mult4x1(chunk_model, &homo, &ws_homo);
+    if(w == 0.0f)
+        return (vec2_t){ws_homo.x, ws_homo.z};
+    return (vec2_t){ws_homo.x / ws_homo.w, ws_homo.z / ws_homo.w};
+}
+
+/* Get the buffers to write up to 'max' overlay quads to. Outside of a batch, 
+ * these are render arguments of a per-chunk draw. */
+static bool n_overlay_quads_reserve(size_t max, bool on_water_surface, 
+                                    vec2_t **out_corners, vec3_t **out_colors)
+{
+    if(s_overlay.depth == 0) {
+        *out_corners = R_AllocArg(sizeof(vec2_t) * 4 * max);
+        *out_colors = R_AllocArg(sizeof(vec3_t) * max);
+        return (*out_corners && *out_colors);
+    }
+
+    const int w = on_water_surface;
+    size_t need = s_overlay.nquads[w] + max;
+    if(need > s_overlay.capquads[w]) {
+
+        size_t newcap = MAX(need, s_overlay.capquads[w] * 2);
+        vec2_t *corners = realloc(s_overlay.corners[w], sizeof(vec2_t) * 4 * newcap);
+        if(!corners)
+            return false;
+        s_overlay.corners[w] = corners;
+
+        vec3_t *colors = realloc(s_overlay.colors[w], sizeof(vec3_t) * newcap);
+        if(!colors)
+            return false;
+        s_overlay.colors[w] = colors;
+        s_overlay.capquads[w] = newcap;
+    }
+
+    *out_corners = s_overlay.corners[w] + 4 * s_overlay.nquads[w];
+    *out_colors = s_overlay.colors[w] + s_overlay.nquads[w];
+    return true;
+}
+
+static void n_overlay_quads_commit(vec2_t *corners, vec3_t *colors, size_t count,
+                                   mat4x4_t *chunk_model, bool on_water_surface)
+{
+    if(count == 0)
+        return;
+
+    if(s_overlay.depth == 0) {
+        R_PushCmd((struct rcmd){
+            .func = R_GL_DrawMapOverlayQuads,
+            .nargs = 6,
+            .args = {
+                corners,
+                colors,
+                R_PushArg(&count, sizeof(count)),
+                R_PushArg(chunk_model, sizeof(*chunk_model)),
+                R_PushArg(&on_water_surface, sizeof(bool)),
+                (void*)G_GetPrevTickMap(),
+            },
+        });
+        return;
+    }
+
+    const int w = on_water_surface;
+    assert(corners == s_overlay.corners[w] + 4 * s_overlay.nquads[w]);
+    assert(count + s_overlay.nquads[w] <= s_overlay.capquads[w]);
+
+    for(size_t i = 0; i < 4 * count; i++) {
+        corners[i] = n_overlay_to_world(chunk_model, corners[i], 1.0f);
+    }
+    s_overlay.nquads[w] += count;
+}
+
+static bool n_overlay_flow_reserve(size_t max, vec2_t **out_positions, vec2_t **out_dirs)
+{
+    if(s_overlay.depth == 0) {
+        *out_positions = R_AllocArg(sizeof(vec2_t) * max);
+        *out_dirs = R_AllocArg(sizeof(vec2_t) * max);
+        return (*out_positions && *out_dirs);
+    }
+
+    size_t need = s_overlay.nflow + max;
+    if(need > s_overlay.capflow) {
+
+        size_t newcap = MAX(need, s_overlay.capflow * 2);
+        vec2_t *positions = realloc(s_overlay.positions, sizeof(vec2_t) * newcap);
+        if(!positions)
+            return false;
+        s_overlay.positions = positions;
+
+        vec2_t *dirs = realloc(s_overlay.dirs, sizeof(vec2_t) * newcap);
+        if(!dirs)
+            return false;
+        s_overlay.dirs = dirs;
+        s_overlay.capflow = newcap;
+    }
+
+    *out_positions = s_overlay.positions + s_overlay.nflow;
+    *out_dirs = s_overlay.dirs + s_overlay.nflow;
+    return true;
+}
+
+static void n_overlay_flow_commit(vec2_t *positions, vec2_t *dirs, size_t count,
+                                  mat4x4_t *chunk_model)
+{
+    if(count == 0)
+        return;
+
+    if(s_overlay.depth == 0) {
+        R_PushCmd((struct rcmd){
+            .func = R_GL_DrawFlowField,
+            .nargs = 5,
+            .args = {
+                positions,
+                dirs,
+                R_PushArg(&count, sizeof(count)),
+                R_PushArg(chunk_model, sizeof(*chunk_model)),
+                (void*)G_GetPrevTickMap(),
+            },
+        });
+        return;
+    }
+
+    assert(positions == s_overlay.positions + s_overlay.nflow);
+    assert(count + s_overlay.nflow <= s_overlay.capflow);
+
+    for(size_t i = 0; i < count; i++) {
+        positions[i] = n_overlay_to_world(chunk_model, positions[i], 1.0f);
+        dirs[i] = n_overlay_to_world(chunk_model, dirs[i], 0.0f);
+    }
+    s_overlay.nflow += count;
+}
+
+static bool n_overlay_text_push(const char *text, struct rect bounds)
+{
+    if(s_overlay.ntexts == s_overlay.captexts) {
+
+        size_t newcap = MAX(256, s_overlay.captexts * 2);
+        char (*texts)[OVERLAY_TEXT_LEN] = realloc(s_overlay.texts, 
+            sizeof(*texts) * newcap);
+        if(!texts)
+            return false;
+        s_overlay.texts = texts;
+
+        struct rect *text_bounds = realloc(s_overlay.text_bounds, 
+            sizeof(struct rect) * newcap);
+        if(!text_bounds)
+            return false;
+        s_overlay.text_bounds = text_bounds;
+        s_overlay.captexts = newcap;
+    }
+
+    pf_strlcpy(s_overlay.texts[s_overlay.ntexts], text, OVERLAY_TEXT_LEN);
+    s_overlay.text_bounds[s_overlay.ntexts] = bounds;
+    s_overlay.ntexts++;
+    return true;
+}
+
+static void n_overlay_flush(void)
+{
+    /* The batched vertices are already in world space */
+    mat4x4_t identity;
+    PFM_Mat4x4_Identity(&identity);
+
+    if(s_overlay.nflow > 0) {
+        size_t count = s_overlay.nflow;
+        R_PushCmd((struct rcmd){
+            .func = R_GL_DrawFlowField,
+            .nargs = 5,
+            .args = {
+                R_PushArg(s_overlay.positions, sizeof(vec2_t) * count),
+                R_PushArg(s_overlay.dirs, sizeof(vec2_t) * count),
+                R_PushArg(&count, sizeof(count)),
+                R_PushArg(&identity, sizeof(identity)),
+                (void*)G_GetPrevTickMap(),
+            },
+        });
+    }
+
+    for(int w = 0; w < 2; w++) {
+
+        if(s_overlay.nquads[w] == 0)
+            continue;
+
+        size_t count = s_overlay.nquads[w];
+        bool on_water_surface = w;
+        R_PushCmd((struct rcmd){
+            .func = R_GL_DrawMapOverlayQuads,
+            .nargs = 6,
+            .args = {
+                R_PushArg(s_overlay.corners[w], sizeof(vec2_t) * 4 * count),
+                R_PushArg(s_overlay.colors[w], sizeof(vec3_t) * count),
+                R_PushArg(&count, sizeof(count)),
+                R_PushArg(&identity, sizeof(identity)),
+                R_PushArg(&on_water_surface, sizeof(bool)),
+                (void*)G_GetPrevTickMap(),
+            },
+        });
+    }
+
+    if(s_overlay.ntexts > 0) {
+
+        const char **texts = malloc(sizeof(const char*) * s_overlay.ntexts);
+        if(texts) {
+            for(size_t i = 0; i < s_overlay.ntexts; i++) {
+                texts[i] = s_overlay.texts[i];
+            }
+            UI_DrawTextBatch(s_overlay.ntexts, texts, s_overlay.text_bounds, 
+                (struct rgba){255, 0, 0, 255});
+            PF_FREE(texts);
+        }else{
+            for(size_t i = 0; i < s_overlay.ntexts; i++) {
+                UI_DrawText(s_overlay.texts[i], s_overlay.text_bounds[i], 
+                    (struct rgba){255, 0, 0, 255});
+            }
+        }
+    }
+
+    s_overlay.nquads[0] = 0;
+    s_overlay.nquads[1] = 0;
+    s_overlay.nflow = 0;
+    s_overlay.ntexts = 0;
+}
+
 static void n_render_grid_path(struct nav_chunk *chunk, mat4x4_t *chunk_model,
                                const struct map *map, vec_coord_t *path, vec3_t color)
 {
     const float chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
     const float chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
 
-    STALLOC(vec2_t, corners_buff, 4 * vec_size(path));
-    STALLOC(vec3_t, colors_buff, vec_size(path));
+    vec2_t *corners_buff;
+    vec3_t *colors_buff;
+    if(!n_overlay_quads_reserve(vec_size(path), false, &corners_buff, &colors_buff))
+        return;
 
     vec2_t *corners_base = corners_buff;
     vec3_t *colors_base = colors_buff; 
@@ -719,23 +1097,7 @@ static void n_render_grid_path(struct nav_chunk *chunk, mat4x4_t *chunk_model,
     assert(colors_base == colors_buff + vec_size(path));
     assert(corners_base == corners_buff + 4 * vec_size(path));
 
-    size_t count = vec_size(path);
-    bool on_water_surface = false;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawMapOverlayQuads,
-        .nargs = 6,
-        .args = {
-            R_PushArg(corners_buff, sizeof(vec2_t) * 4 * vec_size(path)),
-            R_PushArg(colors_buff, sizeof(vec3_t) * vec_size(path)),
-            R_PushArg(&count, sizeof(count)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            R_PushArg(&on_water_surface, sizeof(bool)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
-
-    STFREE(corners_buff);
-    STFREE(colors_buff);
+    n_overlay_quads_commit(corners_buff, colors_buff, vec_size(path), chunk_model, false);
 }
 
 static void n_render_portals(const struct nav_chunk *chunk, mat4x4_t *chunk_model,
@@ -744,8 +1106,11 @@ static void n_render_portals(const struct nav_chunk *chunk, mat4x4_t *chunk_mode
     const float chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
     const float chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
 
-    vec2_t corners_buff[4 * (2 * FIELD_RES_C + 2 * FIELD_RES_R)];
-    vec3_t colors_buff[2 * FIELD_RES_C + 2 * FIELD_RES_R];
+    vec2_t *corners_buff;
+    vec3_t *colors_buff;
+    if(!n_overlay_quads_reserve(2 * FIELD_RES_C + 2 * FIELD_RES_R, false, 
+        &corners_buff, &colors_buff))
+        return;
     size_t num_tiles = 0;
 
     vec2_t *corners_base = corners_buff;
@@ -781,19 +1146,7 @@ static void n_render_portals(const struct nav_chunk *chunk, mat4x4_t *chunk_mode
         }
     }
 
-    bool on_water_surface = false;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawMapOverlayQuads,
-        .nargs = 6,
-        .args = {
-            R_PushArg(corners_buff, sizeof(corners_buff)),
-            R_PushArg(colors_buff, sizeof(colors_buff)),
-            R_PushArg(&num_tiles, sizeof(num_tiles)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            R_PushArg(&on_water_surface, sizeof(bool)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
+    n_overlay_quads_commit(corners_buff, colors_buff, num_tiles, chunk_model, false);
 }
 
 static dest_id_t n_dest_id(struct tile_desc dst_desc, enum nav_layer layer, int faction_id)
@@ -822,6 +1175,7 @@ static void n_visit_island(struct nav_private *priv, uint16_t id,
     struct nav_chunk *chunk 
         = &priv->chunks[layer][IDX(start.chunk_r, priv->width, start.chunk_c)];
     chunk->islands[start.tile_r][start.tile_c] = id;
+    n_chunk_modified(chunk);
 
     queue_td_t frontier;
     queue_td_init(&frontier, 1024);
@@ -852,6 +1206,7 @@ static void n_visit_island(struct nav_private *priv, uint16_t id,
             && chunk->cost_base[neighb.tile_r][neighb.tile_c] != COST_IMPASSABLE) {
             
                 chunk->islands[neighb.tile_r][neighb.tile_c] = id;
+                n_chunk_modified(chunk);
                 queue_td_push(&frontier, &neighb);
             }
         }
@@ -943,14 +1298,23 @@ static void n_update_local_islands(struct nav_private *priv, struct coord chunk_
     }}
 }
 
-static void n_update_local_island_field(struct nav_private *priv, enum nav_layer layer)
+static void n_local_islands_range(size_t begin, size_t end, void *arg)
 {
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
-    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+    struct layer_work *work = arg;
+    struct nav_private *priv = work->priv;
 
-        struct nav_chunk *curr_chunk = &priv->chunks[layer][IDX(chunk_r, priv->width, chunk_c)];
-        n_update_local_islands(priv, (struct coord){chunk_r, chunk_c}, curr_chunk);
-    }}
+    for(size_t i = begin; i < end; i++) {
+
+        struct nav_chunk *curr_chunk = &priv->chunks[work->layer][i];
+        struct coord coord = (struct coord){i / priv->width, i % priv->width};
+        n_update_local_islands(priv, coord, curr_chunk);
+    }
+}
+
+static void n_update_local_island_field(struct nav_private *priv, enum nav_layer layer)
+{
+    struct layer_work work = (struct layer_work){priv, layer};
+    Sched_ParallelFor(0, priv->width * priv->height, 1, n_local_islands_range, &work);
 }
 
 static void n_update_dirty_local_islands(void *nav_private, enum nav_layer layer)
@@ -977,6 +1341,10 @@ static void n_update_dirty_local_islands(void *nav_private, enum nav_layer layer
 static void n_update_blockers(struct nav_private *priv, enum nav_layer layer, int faction_id,
                               struct tile_desc *tds, size_t ntds, int ref_delta)
 {
+    /* The placeholder is shared and never written */
+    if(!priv->built[layer])
+        return;
+
     for(int i = 0; i < ntds; i++) {
     
         volatile struct tile_desc curr = tds[i];
@@ -990,6 +1358,7 @@ static void n_update_blockers(struct nav_private *priv, enum nav_layer layer, in
         int prev_val = chunk->blockers[curr.tile_r][curr.tile_c];
         chunk->blockers[curr.tile_r][curr.tile_c] += ref_delta;
         chunk->factions[faction_id][curr.tile_r][curr.tile_c] += ref_delta;
+        n_chunk_modified(chunk);
         assert(chunk->blockers[curr.tile_r][curr.tile_c] < 16383);
 
         int val = chunk->blockers[curr.tile_r][curr.tile_c];
@@ -1039,6 +1408,9 @@ static void n_update_blockers_circle_ground(struct nav_private *priv, vec2_t xz_
 static void n_update_blockers_circle_water(struct nav_private *priv, vec2_t xz_pos, float range, 
                                            int faction_id, vec3_t map_pos, int ref_delta)
 {
+    if(!priv->built[NAV_LAYER_WATER_1X1])
+        return;
+
     struct tile_desc tds[1024];
     int ntds = M_Tile_AllUnderCircle(n_res(priv), xz_pos, range, map_pos, tds, ARR_SIZE(tds));
     n_update_blockers(priv, NAV_LAYER_WATER_1X1, faction_id, tds, ntds, ref_delta);
@@ -1067,6 +1439,9 @@ static void n_update_blockers_circle_water(struct nav_private *priv, vec2_t xz_p
 static void n_update_blockers_circle_air(struct nav_private *priv, vec2_t xz_pos, float range, 
                                          int faction_id, vec3_t map_pos, int ref_delta)
 {
+    if(!priv->built[NAV_LAYER_AIR_1X1])
+        return;
+
     struct tile_desc tds[1024];
     int ntds = M_Tile_AllUnderCircle(n_res(priv), xz_pos, range, map_pos, tds, ARR_SIZE(tds));
     n_update_blockers(priv, NAV_LAYER_AIR_1X1, faction_id, tds, ntds, ref_delta);
@@ -1121,6 +1496,9 @@ static void n_update_blockers_obb_ground(struct nav_private *priv, const struct
 static void n_update_blockers_obb_water(struct nav_private *priv, const struct obb *obb, 
                                         int faction_id, vec3_t map_pos, int ref_delta)
 {
+    if(!priv->built[NAV_LAYER_WATER_1X1])
+        return;
+
     struct tile_desc tds[1024];
     int ntds = M_Tile_AllUnderObj(map_pos, n_res(priv), obb, tds, ARR_SIZE(tds));
     n_update_blockers(priv, NAV_LAYER_WATER_1X1, faction_id, tds, ntds, ref_delta);
@@ -1147,6 +1525,9 @@ static void n_update_blockers_obb_water(struct nav_private *priv, const struct o
 static void n_update_blockers_obb_air(struct nav_private *priv, const struct obb *obb, 
                                       int faction_id, vec3_t map_pos, int ref_delta)
 {
+    if(!priv->built[NAV_LAYER_AIR_1X1])
+        return;
+
     struct tile_desc tds[1024];
     int ntds = M_Tile_AllUnderObj(map_pos, n_res(priv), obb, tds, ARR_SIZE(tds));
     n_update_blockers(priv, NAV_LAYER_AIR_1X1, faction_id, tds, ntds, ref_delta);
@@ -1170,6 +1551,76 @@ static void n_update_blockers_obb_air(struct nav_private *priv, const struct obb
     n_update_blockers(priv, NAV_LAYER_AIR_7X7, faction_id, outline7x7, noutline7x7, ref_delta);
 }
 
+/* Applies the same footprint to the 1x1 layer starting at 'base' and the 3x3, 5x5 
+ * and 7x7 layers that follow it. The contours are computed only once and shared 
+ * between all the layer families that are passed in.
+ */
+static void n_update_blockers_footprint(struct nav_private *priv, const enum nav_layer *bases, 
+                                        size_t nbases, int faction_id, struct tile_desc *tds, 
+                                        size_t ntds, int ref_delta)
+{
+    bool built = false;
+    for(int i = 0; i < nbases; i++) {
+        built = built || priv->built[bases[i]];
+    }
+    if(!built)
+        return;
+
+    struct tile_desc outline3x3[1024];
+    int noutline3x3 = M_Tile_Contour(ntds, tds, n_res(priv), outline3x3, ARR_SIZE(outline3x3));
+
+    struct tile_desc outline5x5[1024];
+    int noutline5x5 = M_Tile_Contour(noutline3x3, outline3x3, n_res(priv), outline5x5, 
+        ARR_SIZE(outline5x5));
+
+    struct tile_desc outline7x7[1024];
+    int noutline7x7 = M_Tile_Contour(noutline5x5, outline5x5, n_res(priv), outline7x7, 
+        ARR_SIZE(outline7x7));
+
+    struct{
+        struct tile_desc *tds;
+        size_t            ntds;
+    }rings[] = {
+        {tds,        ntds},
+        {outline3x3, noutline3x3},
+        {outline5x5, noutline5x5},
+        {outline7x7, noutline7x7},
+    };
+
+    for(int i = 0; i < nbases; i++) {
+        if(!priv->built[bases[i]])
+            continue;
+        for(int j = 0; j < ARR_SIZE(rings); j++) {
+        for(int k = 0; k <= j; k++) {
+            n_update_blockers(priv, bases[i] + j, faction_id, 
+                rings[k].tds, rings[k].ntds, ref_delta);
+        }}
+    }
+}
+
+static int compare_blocker_ops(const void *a, const void *b)
+{
+    const struct nav_blocker_op *oa = a, *ob = b;
+    if(oa->faction_id != ob->faction_id)
+        return (oa->faction_id > ob->faction_id) - (oa->faction_id < ob->faction_id);
+    if(oa->flags != ob->flags)
+        return (oa->flags > ob->flags) - (oa->flags < ob->flags);
+    if(oa->range != ob->range)
+        return (oa->range > ob->range) - (oa->range < ob->range);
+    if(oa->xz_pos.x != ob->xz_pos.x)
+        return (oa->xz_pos.x > ob->xz_pos.x) - (oa->xz_pos.x < ob->xz_pos.x);
+    return (oa->xz_pos.z > ob->xz_pos.z) - (oa->xz_pos.z < ob->xz_pos.z);
+}
+
+static bool blocker_ops_equal(const struct nav_blocker_op *a, const struct nav_blocker_op *b)
+{
+    return (a->faction_id == b->faction_id)
+        && (a->flags == b->flags)
+        && (a->range == b->range)
+        && (a->xz_pos.x == b->xz_pos.x)
+        && (a->xz_pos.z == b->xz_pos.z);
+}
+
 static int manhattan_dist(struct tile_desc a, struct tile_desc b)
 {
     int dr = abs(
@@ -1183,6 +1634,130 @@ static int manhattan_dist(struct tile_desc a, struct tile_desc b)
     return dr + dc;
 }
 
+/* The nearest tile of the same chunk satisfying some predicate, for 
+ * every tile of the chunk, as (tile_r << 8 | tile_c). */
+struct closest_tiles{
+    bool     valid;
+    uint64_t version;
+    uint16_t nearest[FIELD_RES_R][FIELD_RES_C];
+};
+
+#define CLOSEST_NONE (0xffff)
+
+static bool n_tile_unblocked(struct nav_private *priv, enum nav_layer layer, 
+                             const void *arg, struct tile_desc td)
+{
+    return !n_tile_blocked(priv, layer, td);
+}
+
+static bool n_tile_adjacent_to_land(struct nav_private *priv, enum nav_layer layer, 
+                                    const void *arg, struct tile_desc td)
+{
+    return M_TileAdjacentToLand(arg, &td);
+}
+
+static void closest_relax(uint16_t dist[FIELD_RES_R][FIELD_RES_C], struct closest_tiles *ct,
+                          int r, int c, int nr, int nc)
+{
+    if(nr < 0 || nr >= FIELD_RES_R || nc < 0 || nc >= FIELD_RES_C)
+        return;
+    if(dist[nr][nc] == UINT16_MAX || dist[nr][nc] + 1 >= dist[r][c])
+        return;
+    dist[r][c] = dist[nr][nc] + 1;
+    ct->nearest[r][c] = ct->nearest[nr][nc];
+}
+
+static void n_closest_tiles_build(struct nav_private *priv, enum nav_layer layer, 
+                                  struct coord chunk, const void *arg,
+                                  bool (*satisfies)(struct nav_private*, enum nav_layer, 
+                                                    const void*, struct tile_desc),
+                                  struct closest_tiles *out)
+{
+    uint16_t dist[FIELD_RES_R][FIELD_RES_C];
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        struct tile_desc td = (struct tile_desc){chunk.r, chunk.c, r, c};
+        bool sat = satisfies(priv, layer, arg, td);
+        dist[r][c] = sat ? 0 : UINT16_MAX;
+        out->nearest[r][c] = sat ? ((r << 8) | c) : CLOSEST_NONE;
+    }}
+
+    /* A forward and a backward sweep give the exact manhattan distances */
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+        closest_relax(dist, out, r, c, r - 1, c);
+        closest_relax(dist, out, r, c, r, c - 1);
+    }}
+
+    for(int r = FIELD_RES_R - 1; r >= 0; r--) {
+    for(int c = FIELD_RES_C - 1; c >= 0; c--) {
+        closest_relax(dist, out, r, c, r + 1, c);
+        closest_relax(dist, out, r, c, r, c + 1);
+    }}
+}
+
+/* Look up the closest tile satisfying the predicate in the transform of the 
+ * source tile's chunk, (re-)building it if it is older than 'version'. Fails 
+ * when a tile of another chunk could be closer, in which case the caller 
+ * should fall back to searching outwards. 
+ */
+static bool n_closest_tiles_lookup(struct nav_private *priv, struct closest_tiles **table,
+                                   uint64_t version, enum nav_layer layer, const void *arg,
+                                   bool (*satisfies)(struct nav_private*, enum nav_layer, 
+                                                     const void*, struct tile_desc),
+                                   struct tile_desc td, struct tile_desc *out)
+{
+    if(!table)
+        return false;
+
+    SDL_AtomicLock(&s_closest_lock);
+
+    struct closest_tiles **entry = &table[IDX(td.chunk_r, priv->width, td.chunk_c)];
+    if(!*entry) {
+        *entry = malloc(sizeof(struct closest_tiles));
+        if(!*entry) {
+            SDL_AtomicUnlock(&s_closest_lock);
+            return false;
+        }
+        (*entry)->valid = false;
+    }
+
+    if(!(*entry)->valid || (*entry)->version != version) {
+        n_closest_tiles_build(priv, layer, (struct coord){td.chunk_r, td.chunk_c}, 
+            arg, satisfies, *entry);
+        (*entry)->valid = true;
+        (*entry)->version = version;
+        PERF_COUNTER_ADD("nav.closest_tiles_builds", 1);
+    }
+    uint16_t nearest = (*entry)->nearest[td.tile_r][td.tile_c];
+
+    SDL_AtomicUnlock(&s_closest_lock);
+
+    if(nearest == CLOSEST_NONE)
+        return false;
+
+    struct tile_desc ret = (struct tile_desc){td.chunk_r, td.chunk_c, nearest >> 8, nearest & 0xff};
+    int border = MIN(MIN(td.tile_r, td.tile_c), 
+                     MIN(FIELD_RES_R - 1 - td.tile_r, FIELD_RES_C - 1 - td.tile_c));
+    if(manhattan_dist(td, ret) > border + 1)
+        return false;
+
+    *out = ret;
+    return true;
+}
+
+static void n_closest_tiles_free(struct nav_private *priv, struct closest_tiles **table)
+{
+    if(!table)
+        return;
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        free(table[i]);
+    }
+    free(table);
+}
+
 static int n_closest_island_tiles(const struct nav_private *priv, 
                                   enum nav_layer layer, struct tile_desc target, 
                                   uint16_t global_iid, bool ignore_blockers,
@@ -1536,7 +2111,7 @@ static khash_t(td) *n_moving_entities_tileset(struct nav_private *priv, vec3_t m
     float radius = MAX(area->half_lengths[0] * 1.5f, area->half_lengths[2] * 1.5f);
 
     uint32_t ents[1024];
-    size_t nents = G_Pos_EntsInCircleWithPred(center_xz, radius, ents, 
+    size_t nents = G_Pos_DynamicEntsInCircleWithPred(center_xz, radius, ents, 
         ARR_SIZE(ents), n_moving_entity, NULL);
 
     khash_t(td) *ret = kh_init(td);
@@ -1570,7 +2145,7 @@ static khash_t(td) *n_non_collidable_buildings_tileset(struct nav_private *priv,
     float radius = MAX(area->half_lengths[0] + 50.0f, area->half_lengths[2] + 50.0f);
 
     uint32_t ents[1024];
-    size_t nents = G_Pos_EntsInCircleWithPred(center_xz, radius, ents, 
+    size_t nents = G_Pos_StaticEntsInCircleWithPred(center_xz, radius, ents, 
         ARR_SIZE(ents), n_non_collidable_building, NULL);
 
     khash_t(td) *ret = kh_init(td);
@@ -1593,31 +2168,160 @@ static khash_t(td) *n_non_collidable_buildings_tileset(struct nav_private *priv,
     return ret;
 }
 
-bool n_closest_adjacent_pos(void *nav_private, enum nav_layer layer, vec3_t map_pos, vec2_t xz_src, 
-                            size_t ntiles, const struct tile_desc tds[], vec2_t *out)
+static bool n_buildable_query_valid(const struct buildable_query *query, 
+                                    const struct nav_private *priv, enum nav_layer layer, 
+                                    bool allow_shore, vec3_t map_pos, const struct obb *obb)
 {
-    struct nav_private *priv = nav_private;
-    struct map_resolution res;
-    N_GetResolution(priv, &res);
+    if(!query->valid)
+        return false;
+    if(query->nav_uid != priv->uid || query->frame_idx != g_frame_idx)
+        return false;
+    if(query->layer != layer || query->allow_shore != allow_shore)
+        return false;
+    if(0 != memcmp(&query->map_pos, &map_pos, sizeof(map_pos)))
+        return false;
+    if(0 != memcmp(&query->obb, obb, sizeof(*obb)))
+        return false;
 
-    struct tile_desc src_desc;
-    bool result = M_Tile_DescForPoint2D(res, map_pos, xz_src, &src_desc);
-    assert(result);
+    for(int i = 0; i < query->nchunks; i++) {
+        struct coord chunk = query->chunks[i];
+        if(priv->chunks[layer][IDX(chunk.r, priv->width, chunk.c)].version != query->versions[i])
+            return false;
+    }
+    return true;
+}
 
-    const struct nav_chunk *src_chunk 
-        = &priv->chunks[layer][src_desc.chunk_r * priv->width + src_desc.chunk_c];
-    const uint16_t src_iid = src_chunk->islands[src_desc.tile_r][src_desc.tile_c];
+static bool n_buildable_query_add_chunk(struct buildable_query *query, 
+                                        const struct nav_private *priv, struct coord chunk)
+{
+    for(int i = 0; i < query->nchunks; i++) {
+        if(query->chunks[i].r == chunk.r && query->chunks[i].c == chunk.c)
+            return true;
+    }
+    if(query->nchunks == BUILDABLE_MAX_CHUNKS)
+        return false;
 
-    vec2_t tile_dims = N_TileDims();
-    float min_dist = INFINITY;
-    vec2_t min_pos = {0};
+    query->chunks[query->nchunks] = chunk;
+    query->versions[query->nchunks] = 
+        priv->chunks[query->layer][IDX(chunk.r, priv->width, chunk.c)].version;
+    query->nchunks++;
+    return true;
+}
 
-    for(int i = 0; i < ntiles; i++) {
+/* Returns the buildability of every tile under the object. The result is 
+ * written to 'scratch', unless this is the main thread, where it's taken 
+ * from the cache of the last query when possible. */
+static const struct buildable_query *n_buildable_tiles(struct nav_private *priv, 
+                                                       const struct map *map, enum nav_layer layer, 
+                                                       bool allow_shore, vec3_t map_pos, 
+                                                       const struct obb *obb, 
+                                                       struct buildable_query *scratch)
+{
+    assert(Sched_UsingBigStack());
 
-        struct tile_desc td;
-        int ntd = n_closest_island_tiles(priv, layer, tds[i], src_iid, false, &td, 1);
-        if(!ntd)
-            continue;
+    bool main_thread = (SDL_ThreadID() == g_main_thread_id);
+    if(main_thread && n_buildable_query_valid(&s_buildable, priv, layer, allow_shore, map_pos, obb))
+        return &s_buildable;
+
+    struct buildable_query *ret = main_thread ? &s_buildable : scratch;
+    ret->valid = false;
+    ret->nav_uid = priv->uid;
+    ret->frame_idx = g_frame_idx;
+    ret->layer = layer;
+    ret->allow_shore = allow_shore;
+    ret->map_pos = map_pos;
+    ret->obb = *obb;
+    ret->nchunks = 0;
+    ret->any_blocked = false;
+    memset(ret->blocked, 0, sizeof(ret->blocked));
+
+    struct map_resolution res;
+    N_GetResolution(priv, &res);
+
+    struct map_resolution tile_res;
+    M_GetResolution(map, &tile_res);
+
+    ret->ntiles = M_Tile_AllUnderObj(map_pos, res, obb, ret->tds, ARR_SIZE(ret->tds));
+
+    khash_t(td) *tileset = n_moving_entities_tileset(priv, map_pos, obb);
+    assert(tileset);
+
+    khash_t(td) *building_tileset = n_non_collidable_buildings_tileset(priv, map_pos, obb);
+    assert(building_tileset);
+
+    bool cacheable = main_thread;
+    for(int i = 0; i < ret->ntiles; i++) {
+
+        const struct tile_desc *td = &ret->tds[i];
+        const struct nav_chunk *chunk = 
+            &priv->chunks[layer][IDX(td->chunk_r, priv->width, td->chunk_c)];
+        cacheable = cacheable 
+                 && n_buildable_query_add_chunk(ret, priv, (struct coord){td->chunk_r, td->chunk_c});
+
+        struct box bounds = M_Tile_Bounds(res, map_pos, *td);
+        vec2_t center = (vec2_t){
+            bounds.x - bounds.width / 2.0f,
+            bounds.z + bounds.height / 2.0f
+        };
+
+        struct tile_desc map_td = (struct tile_desc){
+            td->chunk_r,
+            td->chunk_c,
+            td->tile_r / ((float)res.tile_h) * tile_res.tile_h,
+            td->tile_c / ((float)res.tile_w) * tile_res.tile_w
+        };
+        struct tile *tile = NULL;
+        M_TileForDesc(map, map_td, &tile);
+        assert(tile);
+        bool shore = (tile->ramp_height > 1) && (tile->base_height < 0);
+
+        if(chunk->blockers [td->tile_r][td->tile_c]
+        || ((allow_shore ? !shore : true) && chunk->cost_base[td->tile_r][td->tile_c] == COST_IMPASSABLE)
+        || !G_Fog_PlayerExplored((vec2_t){center.x, center.z})
+        || (kh_get(td, tileset, td_key(td)) != kh_end(tileset))
+        || (kh_get(td, building_tileset, td_key(td)) != kh_end(building_tileset))) {
+
+            ret->blocked[i / 64] |= (((uint64_t)1) << (i % 64));
+            ret->any_blocked = true;
+        }
+    }
+    free(tileset);
+    free(building_tileset);
+
+    ret->valid = cacheable;
+    return ret;
+}
+
+static bool n_buildable_tile_blocked(const struct buildable_query *query, int i)
+{
+    return (query->blocked[i / 64] >> (i % 64)) & 0x1;
+}
+
+bool n_closest_adjacent_pos(void *nav_private, enum nav_layer layer, vec3_t map_pos, vec2_t xz_src, 
+                            size_t ntiles, const struct tile_desc tds[], vec2_t *out)
+{
+    struct nav_private *priv = nav_private;
+    struct map_resolution res;
+    N_GetResolution(priv, &res);
+
+    struct tile_desc src_desc;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, xz_src, &src_desc);
+    assert(result);
+
+    const struct nav_chunk *src_chunk 
+        = &priv->chunks[layer][src_desc.chunk_r * priv->width + src_desc.chunk_c];
+    const uint16_t src_iid = src_chunk->islands[src_desc.tile_r][src_desc.tile_c];
+
+    vec2_t tile_dims = N_TileDims();
+    float min_dist = INFINITY;
+    vec2_t min_pos = {0};
+
+    for(int i = 0; i < ntiles; i++) {
+
+        struct tile_desc td;
+        int ntd = n_closest_island_tiles(priv, layer, tds[i], src_iid, false, &td, 1);
+        if(!ntd)
+            continue;
 
         vec2_t tile_center = (vec2_t){
             map_pos.x - (td.chunk_c * FIELD_RES_C + td.tile_c) * tile_dims.x,
@@ -1667,6 +2371,20 @@ static bool n_objects_adjacent(void *nav_private, vec3_t map_pos, vec2_t xz_pos,
     return false;
 }
 
+static void n_link_portals_range(size_t begin, size_t end, void *arg)
+{
+    struct layer_work *work = arg;
+    struct nav_private *priv = work->priv;
+
+    for(size_t i = begin; i < end; i++) {
+
+        struct nav_chunk *curr_chunk = &priv->chunks[work->layer][i];
+        struct coord coord = (struct coord){i / priv->width, i % priv->width};
+        n_link_chunk_portals(curr_chunk, coord, work->layer);
+        n_build_portal_travel_index(curr_chunk);
+    }
+}
+
 static void n_update_portals(struct nav_private *priv, enum nav_layer layer)
 {
     for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
@@ -1678,17 +2396,16 @@ static void n_update_portals(struct nav_private *priv, enum nav_layer layer)
     
     n_create_portals(priv, layer);
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
-    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
-            
-        struct nav_chunk *curr_chunk = &priv->chunks[layer]
-                                                    [IDX(chunk_r, priv->width, chunk_c)];
-        n_link_chunk_portals(curr_chunk, (struct coord){chunk_r, chunk_c}, layer);
-        n_build_portal_travel_index(curr_chunk);
-    }}
+    /* Linking only looks at the portals of the same chunk */
+    struct layer_work work = (struct layer_work){priv, layer};
+    Sched_ParallelFor(0, priv->width * priv->height, 1, n_link_portals_range, &work);
+
+    AStar_HierFree(priv->hier[layer]);
+    priv->hier[layer] = AStar_HierBuild(priv, layer);
+    s_portal_gen++;
 }
 
-static void n_update_island_field(struct nav_private *priv, enum nav_layer layer)
+static void n_flood_island_field(struct nav_private *priv, enum nav_layer layer)
 {
     /* We assign a unique ID to each set of tiles that are mutually connected
      * (i.e. are on the same 'island'). The tile's 'island ID' can then be 
@@ -1707,6 +2424,7 @@ static void n_update_island_field(struct nav_private *priv, enum nav_layer layer
         struct nav_chunk *curr_chunk = &priv->chunks[layer]
                                                     [IDX(chunk_r, priv->width, chunk_c)];
         memset(curr_chunk->islands, 0xff, sizeof(curr_chunk->islands));
+        n_chunk_modified(curr_chunk);
     }}
 
     for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
@@ -1729,10 +2447,674 @@ static void n_update_island_field(struct nav_private *priv, enum nav_layer layer
             island_id++;
         }}
     }}
+    kh_clear(coord, s_cost_dirty_chunks[layer]);
+}
+
+static uint32_t n_uf_find(uint32_t *parent, uint32_t node)
+{
+    while(parent[node] != node) {
+        parent[node] = parent[parent[node]];
+        node = parent[node];
+    }
+    return node;
+}
+
+static void n_uf_union(uint32_t *parent, uint32_t a, uint32_t b)
+{
+    a = n_uf_find(parent, a);
+    b = n_uf_find(parent, b);
+    if(a < b)
+        parent[b] = a;
+    else if(b < a)
+        parent[a] = b;
+}
+
+static bool n_island_affected(const struct nav_chunk *chunk, bool dirty, 
+                              const uint8_t *old_ids, int r, int c)
+{
+    uint16_t id = chunk->islands[r][c];
+    if(chunk->cost_base[r][c] == COST_IMPASSABLE)
+        return false;
+    if(dirty)
+        return true;
+    return (id != ISLAND_NONE) && (old_ids[id >> 3] & (1 << (id & 7)));
+}
+
+/* Label the connected components of the affected tiles of a single chunk,
+ * without considering the tiles of any other chunk. Returns the number of
+ * components.
+ */
+static int n_label_island_components(const struct nav_chunk *chunk, bool dirty, 
+                                     const uint8_t *old_ids, 
+                                     uint16_t labels[FIELD_RES_R][FIELD_RES_C])
+{
+    int ret = 0;
+    struct coord stack[FIELD_RES_R * FIELD_RES_C];
+    memset(labels, 0xff, sizeof(uint16_t[FIELD_RES_R][FIELD_RES_C]));
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        if(labels[r][c] != ISLAND_NONE)
+            continue;
+        if(!n_island_affected(chunk, dirty, old_ids, r, c))
+            continue;
+
+        size_t top = 0;
+        labels[r][c] = ret;
+        stack[top++] = (struct coord){r, c};
+
+        while(top > 0) {
+
+            struct coord curr = stack[--top];
+            const struct coord deltas[] = {
+                { 0, -1},
+                { 0, +1},
+                {-1,  0},
+                {+1,  0},
+            };
+            for(int i = 0; i < ARR_SIZE(deltas); i++) {
+
+                int nr = curr.r + deltas[i].r;
+                int nc = curr.c + deltas[i].c;
+                if(nr < 0 || nr >= FIELD_RES_R || nc < 0 || nc >= FIELD_RES_C)
+                    continue;
+                if(labels[nr][nc] != ISLAND_NONE)
+                    continue;
+                if(!n_island_affected(chunk, dirty, old_ids, nr, nc))
+                    continue;
+                labels[nr][nc] = ret;
+                stack[top++] = (struct coord){nr, nc};
+            }
+        }
+        ret++;
+    }}
+    return ret;
 }
 
+static void n_mark_old_ids(const struct nav_chunk *chunk, int r0, int r1, int c0, int c1,
+                           uint8_t *old_ids)
+{
+    for(int r = r0; r < r1; r++) {
+    for(int c = c0; c < c1; c++) {
+        uint16_t id = chunk->islands[r][c];
+        if(id != ISLAND_NONE)
+            old_ids[id >> 3] |= (1 << (id & 7));
+    }}
+}
+
+struct label_islands_work{
+    const struct nav_chunk *chunks;
+    const bool             *dirty;
+    const int              *slots;
+    const uint8_t          *old_ids;
+    uint16_t              (*labels)[FIELD_RES_R][FIELD_RES_C];
+    uint32_t               *counts;
+};
+
+static void n_label_islands_range(size_t begin, size_t end, void *arg)
+{
+    struct label_islands_work *work = arg;
+    for(size_t i = begin; i < end; i++) {
+        if(work->slots[i] < 0)
+            continue;
+        work->counts[i] = n_label_island_components(&work->chunks[i], work->dirty[i], 
+            work->old_ids, work->labels[work->slots[i]]);
+    }
+}
+
+/* Relabel only the islands touched by cost field changes. Removing tiles  
+ * can split an island and adding tiles can join several together, so the 
+ * affected tiles are all tiles of the dirty chunks, along with every tile 
+ * of the (old) islands which had any tile in or bordering a dirty chunk. 
+ * No other tile can become connected to an affected tile. The components 
+ * of the affected tiles are labelled chunk by chunk and then merged across 
+ * the chunk borders. Returns false if the update could not be performed 
+ * incrementally.
+ */
+static bool n_update_dirty_islands(struct nav_private *priv, enum nav_layer layer)
+{
+    bool ret = false;
+    khash_t(coord) *set = s_cost_dirty_chunks[layer];
+    size_t nchunks = priv->width * priv->height;
+    struct nav_chunk *chunks = priv->chunks[layer];
+
+    uint8_t old_ids[(ISLAND_NONE + 1) / 8] = {0};
+    bool *dirty = calloc(nchunks, sizeof(bool));
+    int *slots = malloc(nchunks * sizeof(int));
+    uint32_t *offsets = malloc(nchunks * sizeof(uint32_t));
+    if(!dirty || !slots || !offsets)
+        goto fail_alloc;
+
+    for(int i = kh_begin(set); i != kh_end(set); i++) {
+
+        if(!kh_exist(set, i))
+            continue;
+
+        uint32_t key = kh_key(set, i);
+        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
+        dirty[IDX(curr.r, priv->width, curr.c)] = true;
+
+        n_mark_old_ids(&chunks[IDX(curr.r, priv->width, curr.c)], 
+            0, FIELD_RES_R, 0, FIELD_RES_C, old_ids);
+        if(curr.r > 0)
+            n_mark_old_ids(&chunks[IDX(curr.r - 1, priv->width, curr.c)], 
+                FIELD_RES_R - 1, FIELD_RES_R, 0, FIELD_RES_C, old_ids);
+        if(curr.r < priv->height - 1)
+            n_mark_old_ids(&chunks[IDX(curr.r + 1, priv->width, curr.c)], 
+                0, 1, 0, FIELD_RES_C, old_ids);
+        if(curr.c > 0)
+            n_mark_old_ids(&chunks[IDX(curr.r, priv->width, curr.c - 1)], 
+                0, FIELD_RES_R, FIELD_RES_C - 1, FIELD_RES_C, old_ids);
+        if(curr.c < priv->width - 1)
+            n_mark_old_ids(&chunks[IDX(curr.r, priv->width, curr.c + 1)], 
+                0, FIELD_RES_R, 0, 1, old_ids);
+    }
+
+    /* Find the affected chunks and the first ID not in use by any island */
+    size_t naffected = 0;
+    uint32_t next_id = 0;
+
+    for(int i = 0; i < nchunks; i++) {
+
+        bool affected = dirty[i];
+        for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            uint16_t id = chunks[i].islands[r][c];
+            if(id == ISLAND_NONE)
+                continue;
+            next_id = MAX(next_id, id + 1u);
+            affected = affected || (old_ids[id >> 3] & (1 << (id & 7)));
+        }}
+        slots[i] = affected ? naffected++ : -1;
+    }
+
+    uint16_t (*labels)[FIELD_RES_R][FIELD_RES_C] = malloc(naffected * sizeof(*labels));
+    if(!labels)
+        goto fail_alloc;
+
+    /* The chunks are labelled independently. Their counts are turned into 
+     * offsets in place. */
+    struct label_islands_work work = (struct label_islands_work){
+        chunks, dirty, slots, old_ids, labels, offsets
+    };
+    Sched_ParallelFor(0, nchunks, 1, n_label_islands_range, &work);
+
+    uint32_t nnodes = 0;
+    for(int i = 0; i < nchunks; i++) {
+        if(slots[i] < 0)
+            continue;
+        uint32_t count = offsets[i];
+        offsets[i] = nnodes;
+        nnodes += count;
+    }
+
+    uint32_t *parent = malloc(nnodes * sizeof(uint32_t));
+    uint16_t *new_ids = malloc(nnodes * sizeof(uint16_t));
+    if(nnodes && (!parent || !new_ids))
+        goto fail_nodes;
+
+    for(uint32_t i = 0; i < nnodes; i++) {
+        parent[i] = i;
+        new_ids[i] = ISLAND_NONE;
+    }
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
+    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+
+        int idx = IDX(chunk_r, priv->width, chunk_c);
+        if(slots[idx] < 0)
+            continue;
+        uint16_t (*curr)[FIELD_RES_C] = labels[slots[idx]];
+
+        int right = IDX(chunk_r, priv->width, chunk_c + 1);
+        if(chunk_c < priv->width - 1 && slots[right] >= 0) {
+            uint16_t (*other)[FIELD_RES_C] = labels[slots[right]];
+            for(int r = 0; r < FIELD_RES_R; r++) {
+                if(curr[r][FIELD_RES_C - 1] == ISLAND_NONE || other[r][0] == ISLAND_NONE)
+                    continue;
+                n_uf_union(parent, offsets[idx] + curr[r][FIELD_RES_C - 1], 
+                    offsets[right] + other[r][0]);
+            }
+        }
+
+        int down = IDX(chunk_r + 1, priv->width, chunk_c);
+        if(chunk_r < priv->height - 1 && slots[down] >= 0) {
+            uint16_t (*other)[FIELD_RES_C] = labels[slots[down]];
+            for(int c = 0; c < FIELD_RES_C; c++) {
+                if(curr[FIELD_RES_R - 1][c] == ISLAND_NONE || other[0][c] == ISLAND_NONE)
+                    continue;
+                n_uf_union(parent, offsets[idx] + curr[FIELD_RES_R - 1][c], 
+                    offsets[down] + other[0][c]);
+            }
+        }
+    }}
+
+    /* Hand out the IDs of the old affected islands before any new ones */
+    uint32_t reuse = 0;
+    for(uint32_t i = 0; i < nnodes; i++) {
+
+        uint32_t root = n_uf_find(parent, i);
+        if(new_ids[root] != ISLAND_NONE)
+            continue;
+
+        while(reuse < next_id && !(old_ids[reuse >> 3] & (1 << (reuse & 7))))
+            reuse++;
+        uint32_t id = (reuse < next_id) ? reuse++ : next_id++;
+        if(id >= ISLAND_NONE)
+            goto fail_nodes;
+        new_ids[root] = id;
+        PERF_COUNTER_ADD("nav.islands_relabelled", 1);
+    }
+
+    for(int i = 0; i < nchunks; i++) {
+
+        if(slots[i] < 0)
+            continue;
+        uint16_t (*curr)[FIELD_RES_C] = labels[slots[i]];
+
+        for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            if(curr[r][c] != ISLAND_NONE)
+                chunks[i].islands[r][c] = new_ids[n_uf_find(parent, offsets[i] + curr[r][c])];
+            else if(dirty[i])
+                chunks[i].islands[r][c] = ISLAND_NONE;
+        }}
+        n_chunk_modified(&chunks[i]);
+    }
+
+    kh_clear(coord, set);
+    ret = true;
+
+fail_nodes:
+    free(parent);
+    free(new_ids);
+    free(labels);
+fail_alloc:
+    free(dirty);
+    free(slots);
+    free(offsets);
+    return ret;
+}
+
+static void n_update_dirty_island_field(struct nav_private *priv, enum nav_layer layer)
+{
+    if(kh_size(s_cost_dirty_chunks[layer]) == 0)
+        return;
+    if(!n_update_dirty_islands(priv, layer))
+        n_flood_island_field(priv, layer);
+}
+
+/* Relabelling every chunk as dirty lets the chunks be labelled in parallel
+ * and then merged with a union-find. With no old islands, the IDs are handed 
+ * out in the same order as the flood fill would. 
+ */
+static void n_update_island_field(struct nav_private *priv, enum nav_layer layer)
+{
+    khash_t(coord) *set = s_cost_dirty_chunks[layer];
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
+    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+
+        struct nav_chunk *curr_chunk = &priv->chunks[layer]
+                                                    [IDX(chunk_r, priv->width, chunk_c)];
+        memset(curr_chunk->islands, 0xff, sizeof(curr_chunk->islands));
+
+        int ret;
+        uint32_t key = ((((uint32_t)chunk_r) & 0xffff) << 16) 
+                      | (((uint32_t)chunk_c) & 0xffff);
+        kh_put(coord, set, key, &ret);
+        if(ret == -1)
+            goto flood;
+    }}
+
+    if(n_update_dirty_islands(priv, layer))
+        return;
+flood:
+    n_flood_island_field(priv, layer);
+}
+
+static struct nav_chunk *n_placeholder_layer(size_t width, size_t height)
+{
+    /* Only the touched parts of the zeroed allocation end up being committed */
+    struct nav_chunk *ret = calloc(width * height, sizeof(struct nav_chunk));
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < width * height; i++) {
+        memset(ret[i].cost_base, COST_IMPASSABLE, sizeof(ret[i].cost_base));
+        memset(ret[i].islands, 0xff, sizeof(ret[i].islands));
+        memset(ret[i].local_islands, 0xff, sizeof(ret[i].local_islands));
+        n_chunk_modified(&ret[i]);
+    }
+    return ret;
+}
+
+static void n_cutout_tiles(struct nav_private *priv, enum nav_layer layer,
+                           const struct tile_desc *tds, size_t ntiles)
+{
+    for(int i = 0; i < ntiles; i++) {
+
+        priv->chunks[layer][IDX(tds[i].chunk_r, priv->width, tds[i].chunk_c)]
+            .cost_base[tds[i].tile_r][tds[i].tile_c] = COST_IMPASSABLE;
+
+        int ret;
+        uint32_t key = ((((uint32_t)tds[i].chunk_r) & 0xffff) << 16) 
+                      | (((uint32_t)tds[i].chunk_c) & 0xffff);
+        kh_put(coord, s_cost_dirty_chunks[layer], key, &ret);
+        assert(ret != -1);
+    }
+}
+
+/* Only writes the chunks in the range */
+static void n_build_cost_range(size_t begin, size_t end, void *arg)
+{
+    struct layer_work *work = arg;
+    struct nav_private *priv = work->priv;
+    enum nav_layer layer = work->layer;
+
+    const bool water = (layer >= NAV_LAYER_WATER_1X1 && layer <= NAV_LAYER_WATER_7X7);
+    const size_t chunk_w = priv->chunk_w, chunk_h = priv->chunk_h;
+
+    for(size_t i = begin; i < end; i++) {
+
+        int chunk_r = i / priv->width;
+        int chunk_c = i % priv->width;
+        struct nav_chunk *curr_chunk = &priv->chunks[layer][i];
+        const struct tile *curr_tiles = priv->tiles[i];
+        curr_chunk->num_portals = 0;
+
+        for(int tile_r = 0; tile_r < chunk_h; tile_r++) {
+        for(int tile_c = 0; tile_c < chunk_w; tile_c++) {
+
+            if(priv->update) {
+                const struct tile *curr_tile = &curr_tiles[tile_r * chunk_w + tile_c];
+                n_set_cost_for_tile(layer, curr_chunk, chunk_w, chunk_h, 
+                    tile_r, tile_c, curr_tile);
+            }else{
+                n_clear_cost_for_tile(curr_chunk, chunk_w, chunk_h, tile_r, tile_c);
+            }
+        }}
+
+        if(water) {
+            const struct nav_chunk *ground = &priv->chunks[layer - NAV_LAYER_WATER_1X1][i];
+            memcpy(curr_chunk->blockers, ground->blockers, sizeof(curr_chunk->blockers));
+            memcpy(curr_chunk->factions, ground->factions, sizeof(curr_chunk->factions));
+        }else{
+            memset(curr_chunk->blockers, 0, sizeof(curr_chunk->blockers));
+            memset(curr_chunk->factions, 0, sizeof(curr_chunk->factions));
+        }
+
+        n_make_chunk_cliff_edges(priv, priv->tiles, layer, chunk_w, chunk_h, chunk_r, chunk_c);
+    }
+}
+
+/* Allocates the layer and fills in its' cost field from the terrain and 
+ * the static cutouts. The blockers of water layers are taken from the 
+ * ground layer of the same size: every blocker that is ever applied to 
+ * one is also applied to the other. The portals and the islands are 
+ * left to the caller.
+ */
+static bool n_build_layer_base(struct nav_private *priv, enum nav_layer layer)
+{
+    assert(!priv->built[layer]);
+
+    struct nav_chunk *chunks = malloc(priv->width * priv->height * sizeof(struct nav_chunk));
+    if(!chunks)
+        return false;
+    priv->chunks[layer] = chunks;
+    priv->built[layer] = true;
+
+    const bool air = (layer >= NAV_LAYER_AIR_1X1 && layer <= NAV_LAYER_AIR_7X7);
+    assert(layer < NAV_LAYER_WATER_1X1 || layer > NAV_LAYER_WATER_7X7
+        || priv->built[layer - NAV_LAYER_WATER_1X1]);
+
+    /* First build the base cost field based on terrain. The versions 
+     * are handed out afterwards, since they come from a single counter. */
+    struct layer_work work = (struct layer_work){priv, layer};
+    Sched_ParallelFor(0, priv->width * priv->height, 1, n_build_cost_range, &work);
+
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        n_chunk_modified(&chunks[i]);
+    }
+
+    if(air)
+        return true;
+
+    struct map_resolution res;
+    N_GetResolution(priv, &res);
+
+    for(int i = 0; i < priv->ncutouts; i++) {
+
+        struct tile_desc tds[2048];
+        size_t ntiles = M_Tile_AllUnderObj(priv->cutouts[i].map_pos, res, 
+            &priv->cutouts[i].obb, tds, ARR_SIZE(tds));
+        n_cutout_tiles(priv, layer, tds, ntiles);
+    }
+    return true;
+}
+
+static void n_update_baked_data(struct nav_private *priv, bool incremental)
+{
+    char path[512];
+    uint64_t key = 0;
+    bool cache = false;
+
+    s_terrain_gen++;
+
+    if(CONFIG_NAV_CACHE) {
+        key = N_NC_Key(priv);
+        cache = N_NC_Path(key, path, sizeof(path));
+    }
+
+    if(cache && N_NC_Load(priv, key, path)) {
+        /* The loaded portals take the place of the existing ones */
+        s_portal_gen++;
+        for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
+            if(!priv->built[layer])
+                continue;
+            AStar_HierFree(priv->hier[layer]);
+            priv->hier[layer] = AStar_HierBuild(priv, layer);
+            kh_clear(coord, s_cost_dirty_chunks[layer]);
+        }
+        return;
+    }
+
+    for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
+        if(!priv->built[layer])
+            continue;
+        n_update_portals(priv, layer);
+        if(incremental)
+            n_update_dirty_island_field(priv, layer);
+        else
+            n_update_island_field(priv, layer);
+    }
+
+    if(cache) {
+        N_NC_Save(priv, key, path);
+    }
+}
+
+static struct batch_field *n_batch_field(struct path_batch *batch, ff_id_t id)
+{
+    if(!batch)
+        return NULL;
+    for(int i = 0; i < vec_size(&batch->fields); i++) {
+        if(vec_AT(&batch->fields, i).id == id)
+            return &vec_AT(&batch->fields, i);
+    }
+    return NULL;
+}
+
+/* A field is available if it is cached or its' build is already pending 
+ * in the current batch. 
+ */
+static bool n_field_available(struct path_batch *batch, ff_id_t id)
+{
+    return N_FC_ContainsFlowField(id) || n_batch_field(batch, id);
+}
+
+static void n_build_field(struct path_batch *batch, struct nav_private *priv, int faction_id,
+                          enum nav_layer layer, struct coord chunk, struct field_target target,
+                          ff_id_t id)
+{
+    if(batch) {
+        if(n_batch_field(batch, id))
+            return;
+        vec_bfield_push(&batch->fields, (struct batch_field){
+            .id = id,
+            .chunk = chunk,
+            .target = target,
+            .has_base = false,
+        });
+        return;
+    }
+
+    struct flow_field ff;
+    N_FlowFieldInit(chunk, &ff);
+    N_FlowFieldUpdate(chunk, priv, faction_id, layer, target, &ff);
+    N_FC_PutFlowField(id, &ff);
+}
+
+static void n_batch_build_range(size_t begin, size_t end, void *arg)
+{
+    struct path_batch *batch = arg;
+    for(size_t i = begin; i < end; i++) {
+
+        struct batch_field *curr = &vec_AT(&batch->fields, i);
+        if(curr->has_base)
+            continue;
+
+        N_FlowFieldInit(curr->chunk, &curr->field);
+        N_FlowFieldUpdate(curr->chunk, batch->priv, batch->faction_id, batch->layer, 
+            curr->target, &curr->field);
+    }
+}
+
+static void n_batch_flush(struct path_batch *batch)
+{
+    /* Fields built from scratch are independent of one another */
+    Sched_ParallelFor(0, vec_size(&batch->fields), 1, n_batch_build_range, batch);
+
+    /* The rest are built on top of fields which precede them */
+    for(int i = 0; i < vec_size(&batch->fields); i++) {
+
+        struct batch_field *curr = &vec_AT(&batch->fields, i);
+        if(!curr->has_base)
+            continue;
+
+        const struct batch_field *base = n_batch_field(batch, curr->base);
+        assert(base && base < curr);
+        curr->field = base->field;
+        N_FlowFieldUpdate(curr->chunk, batch->priv, batch->faction_id, batch->layer, 
+            curr->target, &curr->field);
+    }
+
+    for(int i = 0; i < vec_size(&batch->fields); i++) {
+        struct batch_field *curr = &vec_AT(&batch->fields, i);
+        N_FC_PutFlowField(curr->id, &curr->field);
+    }
+    PERF_COUNTER_ADD("nav.batch_fields", vec_size(&batch->fields));
+}
+
+static int compare_batch_srcs(const void *a, const void *b)
+{
+    const struct batch_src *sa = a, *sb = b;
+    if(sa->dist > sb->dist)
+        return -1;
+    if(sa->dist < sb->dist)
+        return 1;
+    return (sa->idx > sb->idx) - (sa->idx < sb->idx);
+}
+
+/* A route only depends on the chunks it goes through: the portal edge 
+ * states and local islands of a chunk are derived from that chunk's own 
+ * data. Since versions are unique and only ever grow, any write to one
+ * of these chunks makes the greatest of their versions change. 
+ */
+static uint64_t n_route_max_version(const struct nav_private *priv, enum nav_layer layer,
+                                    struct tile_desc src_desc, struct tile_desc dst_desc,
+                                    const vec_portal_t *path)
+{
+    const struct nav_chunk *chunks = priv->chunks[layer];
+    uint64_t ret = MAX(chunks[IDX(src_desc.chunk_r, priv->width, src_desc.chunk_c)].version,
+                       chunks[IDX(dst_desc.chunk_r, priv->width, dst_desc.chunk_c)].version);
+
+    for(int i = 0; i < vec_size(path); i++) {
+        const struct portal *port = vec_AT(path, i).portal;
+        ret = MAX(ret, chunks[IDX(port->chunk.r, priv->width, port->chunk.c)].version);
+        if(port->connected) {
+            const struct portal *conn = port->connected;
+            ret = MAX(ret, chunks[IDX(conn->chunk.r, priv->width, conn->chunk.c)].version);
+        }
+    }
+    return ret;
+}
+
+/* Long-distance requests for the same destination are usually made again 
+ * and again from the same area. Skip the portal graph search when the 
+ * route found last time is still usable. 
+ */
+static bool n_cached_route(const struct nav_private *priv, enum nav_layer layer, 
+                           dest_id_t id, struct tile_desc src_desc, uint16_t src_liid,
+                           struct tile_desc *inout_dst, const struct portal **out_port,
+                           vec_portal_t *inout_path)
+{
+    struct coord src_chunk = (struct coord){src_desc.chunk_r, src_desc.chunk_c};
+    struct portal_route_desc route = (struct portal_route_desc){ .path = *inout_path };
+
+    bool found = N_FC_GetPortalRoute(id, src_chunk, src_liid, &route);
+    *inout_path = route.path;
+    if(!found) {
+        PERF_COUNTER_ADD("nav.route_cache_misses", 1);
+        return false;
+    }
+
+    if(route.nav_uid != priv->uid
+    || route.portal_gen != s_portal_gen
+    || route.max_version != n_route_max_version(priv, layer, src_desc, route.dst_desc, inout_path)) {
+
+        N_FC_InvalidatePortalRoute(id, src_chunk, src_liid);
+        vec_portal_reset(inout_path);
+        PERF_COUNTER_ADD("nav.route_cache_misses", 1);
+        return false;
+    }
+
+    *inout_dst = route.dst_desc;
+    *out_port = route.dst_port;
+    PERF_COUNTER_ADD("nav.route_cache_hits", 1);
+    return true;
+}
+
+static void n_cache_route(const struct nav_private *priv, enum nav_layer layer, 
+                          dest_id_t id, struct tile_desc src_desc, uint16_t src_liid,
+                          struct tile_desc dst_desc, const struct portal *dst_port,
+                          float cost, const vec_portal_t *path)
+{
+    struct portal_route_desc route = (struct portal_route_desc){
+        .nav_uid = priv->uid,
+        .portal_gen = s_portal_gen,
+        .max_version = n_route_max_version(priv, layer, src_desc, dst_desc, path),
+        .dst_desc = dst_desc,
+        .dst_port = dst_port,
+        .cost = cost,
+    };
+    vec_portal_init(&route.path);
+    if(!vec_portal_copy(&route.path, (vec_portal_t*)path)) {
+        vec_portal_destroy(&route.path);
+        return;
+    }
+    N_FC_PutPortalRoute(id, (struct coord){src_desc.chunk_r, src_desc.chunk_c}, 
+        src_liid, &route);
+}
+
+/* When a batch is specified, the flow fields are not built right away. 
+ * Instead, their builds are added to the batch, to be made once all the 
+ * paths of the batch are known. 
+ */
 static bool n_request_path(void *nav_private, vec2_t xz_src, vec2_t xz_dest, int faction_id,
-                           vec3_t map_pos, enum nav_layer layer, dest_id_t *out_dest_id)
+                           vec3_t map_pos, enum nav_layer layer, dest_id_t *out_dest_id,
+                           struct path_batch *batch)
 {
     PERF_ENTER();
 
@@ -1743,8 +3125,11 @@ static bool n_request_path(void *nav_private, vec2_t xz_src, vec2_t xz_dest, int
     bool result;
     (void)result;
 
-    n_update_dirty_local_islands(nav_private, layer);
-    n_update_all_edge_states(nav_private, layer);
+    /* A batch brings the navigation state up-to-date once for all the requests */
+    if(!batch) {
+        n_update_dirty_local_islands(nav_private, layer);
+        n_update_all_edge_states(nav_private, layer);
+    }
 
     /* Convert source and destination positions to tile coordinates */
     struct tile_desc src_desc, dst_desc;
@@ -1774,29 +3159,31 @@ static bool n_request_path(void *nav_private, vec2_t xz_src, vec2_t xz_dest, int
      * the cache, due to space constraints or invalidation. */
     ff_id_t id;
     if(!N_FC_GetDestFFMapping(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, &id)
-    || !N_FC_ContainsFlowField(id)) {
+    || !n_field_available(batch, id)) {
 
         struct field_target target = (struct field_target){
             .type = TARGET_TILE,
             .tile = (struct coord){dst_desc.tile_r, dst_desc.tile_c}
         };
 
-        struct flow_field ff;
         id = N_FlowFieldID((struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, target, layer);
 
-        if(!N_FC_ContainsFlowField(id)) {
+        if(!n_field_available(batch, id)) {
         
             struct coord chunk = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
-            N_FlowFieldInit(chunk, &ff);
-            N_FlowFieldUpdate(chunk, priv, faction_id, layer, target, &ff);
-            N_FC_PutFlowField(id, &ff);
+            n_build_field(batch, priv, faction_id, layer, chunk, target, id);
         }
 
         N_FC_PutDestFFMapping(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, id);
     }
 
     /* Create the LOS field for the destination chunk, if necessary */
-    if(!N_FC_ContainsLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c})) {
+    if(!N_FC_ContainsLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c})
+    && N_LC_Enabled()) {
+
+        N_LC_Request(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, dst_desc);
+
+    }else if(!N_FC_ContainsLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c})) {
 
         struct LOS_field lf;
         N_LOSFieldCreate(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, 
@@ -1835,7 +3222,16 @@ static bool n_request_path(void *nav_private, vec2_t xz_src, vec2_t xz_dest, int
         }
     }
 
-    const struct portal *dst_port = n_closest_reachable_portal(dst_chunk, 
+    float cost;
+    vec_portal_t path;
+    vec_portal_init(&path);
+
+    const struct portal *dst_port;
+    uint16_t src_liid = N_ClosestPathableLocalIsland(priv, src_chunk, src_desc);
+    if(n_cached_route(priv, layer, ret, src_desc, src_liid, &dst_desc, &dst_port, &path))
+        goto route_found;
+
+    dst_port = n_closest_reachable_portal(dst_chunk, 
         (struct coord){dst_desc.tile_r, dst_desc.tile_c}, true);
     if(!dst_port) {
         dst_port = n_closest_reachable_portal(dst_chunk, 
@@ -1843,13 +3239,10 @@ static bool n_request_path(void *nav_private, vec2_t xz_src, vec2_t xz_dest, int
     }
 
     if(!dst_port) {
+        vec_portal_destroy(&path);
         PERF_RETURN(false); 
     }
 
-    float cost;
-    vec_portal_t path;
-    vec_portal_init(&path);
-
     bool path_exists = AStar_PortalGraphPath(src_desc, dst_desc, dst_port, 
         priv, layer, &path, &cost);
     if(!path_exists) {
@@ -1891,7 +3284,9 @@ static bool n_request_path(void *nav_private, vec2_t xz_src, vec2_t xz_dest, int
             PERF_RETURN(false); 
         }
     }
+    n_cache_route(priv, layer, ret, src_desc, src_liid, dst_desc, dst_port, cost, &path);
 
+route_found:;
     struct coord prev_los_coord = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
 
     /* Traverse the portal path _backwards_ and generate the required fields, 
@@ -1943,12 +3338,30 @@ static bool n_request_path(void *nav_private, vec2_t xz_src, vec2_t xz_dest, int
         struct flow_field ff;
 
         if(N_FC_GetDestFFMapping(ret, chunk_coord, &exist_id)
-        && N_FC_ContainsFlowField(exist_id)) {
+        && n_field_available(batch, exist_id)) {
 
             /* The exact flow field we need has already been made */
             if(new_id == exist_id)
                 goto ff_exists;
 
+            /* The existing field is only going to be built with the rest 
+             * of the batch, so the update has to be deferred as well. */
+            if(!N_FC_ContainsFlowField(exist_id)) {
+
+                assert(n_batch_field(batch, exist_id));
+                N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
+                if(!n_batch_field(batch, new_id)) {
+                    vec_bfield_push(&batch->fields, (struct batch_field){
+                        .id = new_id,
+                        .chunk = chunk_coord,
+                        .target = target,
+                        .has_base = true,
+                        .base = exist_id,
+                    });
+                }
+                goto ff_exists;
+            }
+
             /* This is the edge case when a path to a particular target takes us through
              * the same chunk more than once. This can happen if a chunk is divided into
              * 'islands' by unpathable barriers. 
@@ -1956,73 +3369,303 @@ static bool n_request_path(void *nav_private, vec2_t xz_src, vec2_t xz_dest, int
             const struct flow_field *exist_ff  = N_FC_FlowFieldAt(exist_id);
             memcpy(&ff, exist_ff, sizeof(struct flow_field));
 
-            N_FlowFieldUpdate(chunk_coord, priv, faction_id, layer, target, &ff);
-            /* We set the updated flow field for the new (least recently used) key. Since in 
-             * this case more than one flowfield ID maps to the same field but we only keep 
-             * one of the IDs, it may be possible that the same flowfield will be redundantly 
-             * updated at a later time. However, this is largely inconsequential. 
-             */
-            N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
-            N_FC_PutFlowField(new_id, &ff);
+            N_FlowFieldUpdate(chunk_coord, priv, faction_id, layer, target, &ff);
+            /* We set the updated flow field for the new (least recently used) key. Since in 
+             * this case more than one flowfield ID maps to the same field but we only keep 
+             * one of the IDs, it may be possible that the same flowfield will be redundantly 
+             * updated at a later time. However, this is largely inconsequential. 
+             */
+            N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
+            N_FC_PutFlowField(new_id, &ff);
+
+            goto ff_exists;
+        }
+
+        N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
+        if(!n_field_available(batch, new_id)) {
+            n_build_field(batch, priv, faction_id, layer, chunk_coord, target, new_id);
+        }
+
+    ff_exists:
+        assert(n_field_available(batch, new_id));
+        /* Reference field in the cache */
+        (void)N_FC_FlowFieldAt(new_id);
+
+        if(!N_FC_ContainsLOSField(ret, chunk_coord) && N_LC_Enabled()) {
+
+            N_LC_Request(ret, chunk_coord, dst_desc);
+
+        /* The previous chunk's field may still be being computed on the GPU, 
+         * if that was only just turned off. */
+        }else if(!N_FC_ContainsLOSField(ret, chunk_coord)
+              && N_FC_ContainsLOSField(ret, prev_los_coord)) {
+
+            assert((abs(prev_los_coord.r - chunk_coord.r) 
+                  + abs(prev_los_coord.c - chunk_coord.c)) == 1);
+
+            const struct LOS_field *prev_los = N_FC_LOSFieldAt(ret, prev_los_coord);
+            assert(prev_los);
+            assert(prev_los->chunk.r == prev_los_coord.r && prev_los->chunk.c == prev_los_coord.c);
+
+            struct LOS_field lf;
+            N_LOSFieldCreate(ret, chunk_coord, dst_desc, priv, map_pos, &lf, prev_los);
+            N_FC_PutLOSField(ret, chunk_coord, &lf);
+        }
+
+        prev_los_coord = chunk_coord;
+    }
+    vec_portal_destroy(&path);
+
+    *out_dest_id = ret; 
+    PERF_RETURN(true);
+}
+
+static bool n_request_path_batch(void *nav_private, size_t nsrcs, const vec2_t xz_srcs[], 
+                                 vec2_t xz_dest, int faction_id, vec3_t map_pos, 
+                                 enum nav_layer layer, bool out_found[], dest_id_t *out_dest_id)
+{
+    PERF_ENTER();
+
+    struct nav_private *priv = nav_private;
+    struct map_resolution res;
+    N_GetResolution(priv, &res);
+
+    n_update_dirty_local_islands(nav_private, layer);
+    n_update_all_edge_states(nav_private, layer);
+
+    struct tile_desc dst_desc;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dst_desc);
+    assert(result);
+
+    (void)result;
+
+    dest_id_t dest_id = n_dest_id(dst_desc, layer, faction_id);
+    *out_dest_id = dest_id;
+
+    const struct nav_chunk *dst_chunk = 
+        &priv->chunks[layer][IDX(dst_desc.chunk_r, priv->width, dst_desc.chunk_c)];
+    uint16_t dst_iid = dst_chunk->islands[dst_desc.tile_r][dst_desc.tile_c];
+
+    struct batch_src *srcs = malloc(nsrcs * sizeof(struct batch_src));
+    if(nsrcs && !srcs)
+        PERF_RETURN(false);
+
+    for(int i = 0; i < nsrcs; i++) {
+
+        vec2_t delta;
+        PFM_Vec2_Sub((vec2_t*)&xz_srcs[i], &xz_dest, &delta);
+        srcs[i].idx = i;
+        srcs[i].dist = PFM_Vec2_Dot(&delta, &delta);
+        result = M_Tile_DescForPoint2D(res, map_pos, xz_srcs[i], &srcs[i].td);
+        assert(result);
+    }
+
+    /* The paths of the farthest sources are made first. The paths of closer 
+     * sources tend to go through the same chunks, and already have their 
+     * fields by the time they are considered.
+     */
+    qsort(srcs, nsrcs, sizeof(struct batch_src), compare_batch_srcs);
+
+    struct path_batch batch = (struct path_batch){
+        .priv = priv,
+        .faction_id = faction_id,
+        .layer = layer,
+    };
+    vec_bfield_init(&batch.fields);
+
+    bool ret = false;
+    size_t nrequests = 0;
+
+    for(int i = 0; i < nsrcs; i++) {
+
+        const struct tile_desc *td = &srcs[i].td;
+        struct coord chunk = (struct coord){td->chunk_r, td->chunk_c};
+        const struct nav_chunk *src_chunk = &priv->chunks[layer][IDX(td->chunk_r, priv->width, td->chunk_c)];
+        bool found = false;
+
+        ff_id_t ffid;
+        if(src_chunk->islands[td->tile_r][td->tile_c] != dst_iid) {
+            found = false;
+        }else if(N_FC_GetDestFFMapping(dest_id, chunk, &ffid) && n_field_available(&batch, ffid)) {
+            /* The chunk is already on the path of another source */
+            const struct flow_field *ff = N_FC_FlowFieldAt(ffid);
+            found = true;
+            if(ff && ff->field[td->tile_r][td->tile_c].dir_idx == FD_NONE) {
+                dest_id_t id;
+                found = n_request_path(nav_private, xz_srcs[srcs[i].idx], xz_dest, 
+                    faction_id, map_pos, layer, &id, &batch);
+                nrequests++;
+            }
+        }else{
+            dest_id_t id;
+            found = n_request_path(nav_private, xz_srcs[srcs[i].idx], xz_dest, 
+                faction_id, map_pos, layer, &id, &batch);
+            assert(!found || id == dest_id);
+            nrequests++;
+        }
+
+        if(out_found) {
+            out_found[srcs[i].idx] = found;
+        }
+        ret = ret || found;
+    }
+
+    n_batch_flush(&batch);
+    vec_bfield_destroy(&batch.fields);
+    free(srcs);
+
+    PERF_COUNTER_ADD("nav.batch_requests", nrequests);
+    PERF_RETURN(ret);
+}
+
+static void field_range(size_t begin, size_t end, void *arg)
+{
+    for(size_t i = begin; i < end; i++) {
+
+        struct field_work_in *in = &vec_AT(&s_field_work.in, i);
+        struct field_work_out *out = &vec_AT(&s_field_work.out, i);
+
+        N_FlowFieldInit(in->chunk, &out->field);
+        if(s_field_work.deferred) {
+            N_FlowFieldUpdateFromTiles(in->chunk, in->priv, in->layer, in->target, 
+                in->ntiles, in->tiles, &out->field);
+        }else{
+            N_FlowFieldUpdate(in->chunk, in->priv, in->faction_id, in->layer, in->target, 
+                &out->field);
+        }
+    }
+}
+
+static struct result field_task(void *arg)
+{
+    Sched_ParallelFor(0, s_field_work.nwork, 1, field_range, NULL);
+    return NULL_RESULT;
+}
+
+static void field_join_work(void)
+{
+    if(s_field_work.node < 0)
+        return;
+    Sched_GraphJoinNode(Sched_TickGraph(), s_field_work.node);
+    s_field_work.node = -1;
+}
+
+static bool field_work_pending(ff_id_t ffid)
+{
+    khiter_t k = kh_get(ffid, s_field_work.ids, ffid);
+    if(k == kh_end(s_field_work.ids))
+        return false;
+    return (kh_val(s_field_work.ids, k) >= 0);
+}
+
+static void field_mark_stale_work(struct coord chunk, enum nav_layer layer)
+{
+    if(!s_field_work.deferred)
+        return;
 
-            goto ff_exists;
-        }
+    for(int i = 0; i < s_field_work.nwork; i++) {
 
-        N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
-        if(!N_FC_ContainsFlowField(new_id)) {
+        struct field_work_in *in = &vec_AT(&s_field_work.in, i);
+        if(in->layer != layer)
+            continue;
+        /* The fields are padded by half a chunk on every side */
+        if(abs(in->chunk.r - chunk.r) > 1 || abs(in->chunk.c - chunk.c) > 1)
+            continue;
+        in->stale = true;
+    }
+}
 
-            N_FlowFieldInit(chunk_coord, &ff);
-            N_FlowFieldUpdate(chunk_coord, priv, faction_id, layer, target, &ff);
-            N_FC_PutFlowField(new_id, &ff);
-        }
+static void field_request_work(struct nav_private *priv, struct coord chunk, 
+                               struct field_target target, int faction_id, 
+                               enum nav_layer layer)
+{
+    ff_id_t ffid = N_FlowFieldID(chunk, target, layer);
+    s_field_work.nrefs++;
 
-    ff_exists:
-        assert(N_FC_ContainsFlowField(new_id));
-        /* Reference field in the cache */
-        (void)N_FC_FlowFieldAt(new_id);
+    /* Many entities converging on the same targets will reference the 
+     * same field. It only needs to be looked up and built once. */
+    int status;
+    khiter_t k = kh_put(ffid, s_field_work.ids, ffid, &status);
+    if(status == -1 || status == 0)
+        return;
+    kh_val(s_field_work.ids, k) = -1;
 
-        if(!N_FC_ContainsLOSField(ret, chunk_coord)) {
+    if(N_FC_ContainsFlowField(ffid))
+       return;
 
-            assert((abs(prev_los_coord.r - chunk_coord.r) 
-                  + abs(prev_los_coord.c - chunk_coord.c)) == 1);
-            assert(N_FC_ContainsLOSField(ret, prev_los_coord));
+    /* We'll compute the missing field on-demand later */
+    if(s_field_work.nwork == MAX_FIELD_TASKS || s_field_work.submitted)
+        return;
 
-            const struct LOS_field *prev_los = N_FC_LOSFieldAt(ret, prev_los_coord);
-            assert(prev_los);
-            assert(prev_los->chunk.r == prev_los_coord.r && prev_los->chunk.c == prev_los_coord.c);
+    size_t ntiles = 0;
+    struct tile_desc *tiles = NULL;
 
-            struct LOS_field lf;
-            N_LOSFieldCreate(ret, chunk_coord, dst_desc, priv, map_pos, &lf, prev_los);
-            N_FC_PutLOSField(ret, chunk_coord, &lf);
-        }
+    if(s_field_work.deferred) {
 
-        prev_los_coord = chunk_coord;
+        STALLOC(struct tile_desc, found, FIELD_MAX_TARGET_TILES);
+        ntiles = N_FlowFieldTargetTiles(chunk, priv, layer, target, 
+            found, FIELD_MAX_TARGET_TILES);
+        tiles = stalloc(&s_field_work.mem, sizeof(struct tile_desc) * MAX(ntiles, 1));
+        if(tiles) {
+            memcpy(tiles, found, sizeof(struct tile_desc) * ntiles);
+        }
+        STFREE(found);
+        if(!tiles)
+            return;
     }
-    vec_portal_destroy(&path);
 
-    *out_dest_id = ret; 
-    PERF_RETURN(true);
+    size_t idx = s_field_work.nwork;
+    vec_in_push(&s_field_work.in, (struct field_work_in){
+        .priv = priv,
+        .chunk = chunk,
+        .target = target,
+        .faction_id = faction_id,
+        .layer = layer,
+        .id = ffid,
+        .ntiles = ntiles,
+        .tiles = tiles,
+        .stale = false
+    });
+    kh_val(s_field_work.ids, k) = idx;
+    s_field_work.nwork++;
 }
 
-static struct result field_task(void *arg)
+static struct coord field_chunk_at(struct nav_private *priv, vec3_t map_pos, vec2_t pos)
 {
-    size_t *index = arg;
-    struct field_work_in *in = &vec_AT(&s_field_work.in, *index);
-    struct field_work_out *out = &vec_AT(&s_field_work.out, *index);
+    struct map_resolution res;
+    N_GetResolution(priv, &res);
 
-    N_FlowFieldInit(in->chunk, &out->field);
-    N_FlowFieldUpdate(in->chunk, in->priv, in->faction_id, in->layer, in->target, &out->field);
+    struct tile_desc curr_tile;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, pos, &curr_tile);
+    assert(result);
 
-    return NULL_RESULT;
+    return (struct coord){curr_tile.chunk_r, curr_tile.chunk_c};
 }
 
-static void field_join_work(void)
+static struct field_target field_enemies_target(struct coord chunk, vec3_t map_pos, 
+                                                int faction_id)
+{
+    uint16_t enemies = 0;
+    if(faction_id != FACTION_ID_NONE) {
+        enemies = G_GetEnemyFactions(faction_id);
+    }
+
+    return (struct field_target){
+        .type = TARGET_ENEMIES,
+        .enemies.faction_id = faction_id,
+        .enemies.enemies = enemies,
+        .enemies.map_pos = map_pos,
+        .enemies.chunk = chunk
+    };
+}
+
+static struct field_target field_entity_target(uint32_t ent, vec3_t map_pos)
 {
-    for(int i = 0; i < s_field_work.ntasks; i++) {
-		while(!Sched_FutureIsReady(&s_field_work.futures[i])) {
-			Sched_RunSync(s_field_work.tids[i]);
-		}
-	}
+    return (struct field_target){
+        .type = TARGET_ENTITY,
+        .ent.target = ent,
+        .ent.map_pos = map_pos,
+    };
 }
 
 vec2_t tile_center_location(struct nav_private *priv, vec3_t map_pos, struct tile_desc td)
@@ -2037,23 +3680,166 @@ vec2_t tile_center_location(struct nav_private *priv, vec3_t map_pos, struct til
     };
 }
 
+static void n_flock_fields_bind(struct nav_flock_fields *fields, dest_id_t id)
+{
+    if(fields->id == id)
+        return;
+    fields->id = id;
+    fields->nchunks = 0;
+    fields->next_victim = 0;
+}
+
+static struct flock_chunk_fields *n_flock_chunk_find(struct nav_flock_fields *fields, 
+                                                     struct coord chunk)
+{
+    for(int i = 0; i < fields->nchunks; i++) {
+        struct flock_chunk_fields *curr = fields->chunks[i];
+        if(curr->chunk.r == chunk.r && curr->chunk.c == chunk.c)
+            return curr;
+    }
+    return NULL;
+}
+
+static bool n_flock_chunk_current(const struct flock_chunk_fields *cf)
+{
+    return cf && (cf->epoch == N_FC_Epoch());
+}
+
+/* Once every slot is taken, chunks are recycled round-robin. The flock 
+ * members are clustered, so this only happens for very spread out flocks. 
+ */
+static struct flock_chunk_fields *n_flock_chunk_slot(struct nav_flock_fields *fields, 
+                                                     struct coord chunk)
+{
+    struct flock_chunk_fields *ret = n_flock_chunk_find(fields, chunk);
+    if(ret)
+        return ret;
+
+    int idx;
+    if(fields->nchunks < FLOCK_FIELDS_MAX_CHUNKS) {
+        idx = fields->nchunks;
+    }else{
+        idx = fields->next_victim;
+        fields->next_victim = (fields->next_victim + 1) % FLOCK_FIELDS_MAX_CHUNKS;
+    }
+
+    if(!fields->chunks[idx]) {
+        fields->chunks[idx] = malloc(sizeof(struct flock_chunk_fields));
+        if(!fields->chunks[idx])
+            return NULL;
+    }
+    if(idx == fields->nchunks) {
+        fields->nchunks++;
+    }
+
+    ret = fields->chunks[idx];
+    ret->chunk = chunk;
+    ret->epoch = N_FC_Epoch() - 1;
+    ret->has_flow = false;
+    ret->has_los = false;
+    return ret;
+}
+
+static void n_flock_chunk_refresh(struct flock_chunk_fields *cf, dest_id_t id)
+{
+    /* Sample the epoch before copying, so that any concurrent change 
+     * leaves the copies looking stale rather than current */
+    cf->epoch = N_FC_Epoch();
+
+    ff_id_t ffid;
+    cf->has_flow = N_FC_GetDestFFMapping(id, cf->chunk, &ffid)
+                && N_FC_GetFlowField(ffid, &cf->flow);
+    cf->has_los = N_FC_GetLOSField(id, cf->chunk, &cf->los);
+    PERF_COUNTER_ADD("nav.flock_fields_refreshed", 1);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static bool n_build_family(struct nav_private *priv, enum nav_layer base)
+{
+    PERF_ENTER();
+
+    /* The asynchronous field tasks read the navigation data directly */
+    field_join_work();
+
+    for(int i = 0; i < NAV_LAYERS_PER_FAMILY; i++) {
+        if(!n_build_layer_base(priv, base + i))
+            PERF_RETURN(false);
+    }
+
+    for(int i = 0; i < NAV_LAYERS_PER_FAMILY; i++) {
+
+        enum nav_layer layer = base + i;
+        n_update_portals(priv, layer);
+        n_update_island_field(priv, layer);
+        n_update_local_island_field(priv, layer);
+
+        /* Anything that was computed against the placeholder is now stale */
+        for(int r = 0; r < priv->height; r++) {
+        for(int c = 0; c < priv->width;  c++) {
+            N_FC_InvalidateAllAtChunk((struct coord){r, c}, layer);
+        }}
+    }
+    N_LC_Invalidate();
+
+    PERF_RETURN(true);
+}
+
+static struct result n_build_family_task(void *arg)
+{
+    struct build_family_arg *bfarg = arg;
+    return (struct result) {
+        .type = RESULT_BOOL,
+        .val.as_bool = n_build_family(bfarg->priv, bfarg->base)
+    };
+}
+
+static bool n_bool_val_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static void n_jps_commit(const struct sval *new_val)
+{
+    AStar_SetGridSearch(new_val->as_bool ? GRID_SEARCH_JPS : GRID_SEARCH_ASTAR);
+}
+
 bool N_Init(void)
 {
     if(!N_FC_Init())
         return false;
 
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.game.nav_jump_point_search",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = n_bool_val_validate,
+        .commit = n_jps_commit,
+    });
+    assert(status == SS_OKAY);
+    (void)status;
+
     for(int i = 0; i < NAV_LAYER_MAX; i++) {
         if((s_dirty_chunks[i] = kh_init(coord)) == NULL)
             goto fail_alloc;
+        if((s_cost_dirty_chunks[i] = kh_init(coord)) == NULL)
+            goto fail_alloc;
     }
 
     memset(&s_field_work, 0, sizeof(s_field_work));
+    s_field_work.node = -1;
     if(!stalloc_init(&s_field_work.mem))
         goto fail_alloc;
+    if((s_field_work.ids = kh_init(ffid)) == NULL)
+        goto fail_alloc;
+
+    if(!N_LC_Init())
+        goto fail_alloc;
 
     return true;
 
@@ -2067,8 +3853,14 @@ void N_Update(void *nav_private)
     PERF_ENTER();
 
     struct nav_private *priv = nav_private;
+    N_FC_Update();
     N_FC_InvalidateDynamicSurroundFields();
 
+    for(int i = 0; i < s_field_work.nevict; i++) {
+        N_FC_RemoveFlowField(s_field_work.evict[i]);
+    }
+    s_field_work.nevict = 0;
+
     for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
     
         n_update_dirty_local_islands(priv, layer);
@@ -2086,6 +3878,8 @@ void N_Update(void *nav_private)
 
             N_FC_InvalidateAllAtChunk(curr, layer);
             N_FC_InvalidateNeighbourEnemySeekFields(priv->width, priv->height, curr, layer);
+            field_mark_stale_work(curr, layer);
+            N_LC_InvalidateChunk(layer, curr);
 
             struct nav_chunk *chunk = &priv->chunks[layer]
                                                    [IDX(curr.r, priv->width, curr.c)];
@@ -2104,26 +3898,49 @@ void N_Update(void *nav_private)
         kh_clear(coord, set);
     }
 
+    N_LC_Update(priv);
     PERF_RETURN_VOID();
 }
 
 void N_Shutdown(void)
 {
+    N_LC_Shutdown();
     field_join_work();
+    s_field_work.nwork = 0;
+    s_field_work.nevict = 0;
+    kh_destroy(ffid, s_field_work.ids);
     stalloc_destroy(&s_field_work.mem);
     for(int i = 0; i < NAV_LAYER_MAX; i++) {
         kh_destroy(coord, s_dirty_chunks[i]);
+        kh_destroy(coord, s_cost_dirty_chunks[i]);
+    }
+    for(int i = 0; i < 2; i++) {
+        free(s_overlay.corners[i]);
+        free(s_overlay.colors[i]);
     }
+    free(s_overlay.positions);
+    free(s_overlay.dirs);
+    free(s_overlay.texts);
+    free(s_overlay.text_bounds);
+    memset(&s_overlay, 0, sizeof(s_overlay));
     N_FC_Shutdown();
 }
 
 void N_ClearState(void)
 {
     field_join_work();
+    kh_clear(ffid, s_field_work.ids);
+    s_field_work.nrefs = 0;
+    s_field_work.nwork = 0;
+    s_field_work.nevict = 0;
+    s_field_work.deferred = false;
+    s_field_work.submitted = false;
     for(int i = 0; i < NAV_LAYER_MAX; i++) {
         s_local_islands_dirty[i] = false;
         kh_clear(coord, s_dirty_chunks[i]);
+        kh_clear(coord, s_cost_dirty_chunks[i]);
     }
+    N_LC_Clear();
     N_FC_ClearAll();
     N_FC_ClearStats();
 }
@@ -2132,51 +3949,54 @@ void *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
                         const struct tile **chunk_tiles, bool update)
 {
     struct nav_private *ret;
-    ret = malloc(sizeof(struct nav_private));
+    ret = calloc(1, sizeof(struct nav_private));
     if(!ret)
         goto fail_alloc;
 
-    memset(ret->chunks, 0, sizeof(ret->chunks));
-    for(int i = 0; i < NAV_LAYER_MAX; i++) {
-        ret->chunks[i] = malloc(w * h * sizeof(struct nav_chunk));
-        if(!ret->chunks[i])
-            goto fail_alloc_chunks;
-    }
-
     ret->width = w;
     ret->height = h;
+    ret->chunk_w = chunk_w;
+    ret->chunk_h = chunk_h;
+    ret->update = update;
+    /* Scrambled, so that stale memory is never mistaken for a copy */
+    ret->uid = (++s_next_version) * 0x9e3779b97f4a7c15ull;
 
     assert(FIELD_RES_R >= chunk_h && FIELD_RES_R % chunk_h == 0);
     assert(FIELD_RES_C >= chunk_w && FIELD_RES_C % chunk_w == 0);
 
-    for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
-    
-        /* First build the base cost field based on terrain */
-        for(int chunk_r = 0; chunk_r < ret->height; chunk_r++){
-        for(int chunk_c = 0; chunk_c < ret->width;  chunk_c++){
-
-            struct nav_chunk *curr_chunk = &ret->chunks[layer][IDX(chunk_r, ret->width, chunk_c)];
-            const struct tile *curr_tiles = chunk_tiles[IDX(chunk_r, ret->width, chunk_c)];
-            curr_chunk->num_portals = 0;
-
-            for(int tile_r = 0; tile_r < chunk_h; tile_r++) {
-            for(int tile_c = 0; tile_c < chunk_w; tile_c++) {
-
-                if(update) {
-                    const struct tile *curr_tile = &curr_tiles[tile_r * chunk_w + tile_c];
-                    n_set_cost_for_tile(layer, curr_chunk, chunk_w, chunk_h, 
-                        tile_r, tile_c, curr_tile);
-                }else{
-                    n_clear_cost_for_tile(curr_chunk, chunk_w, chunk_h, tile_r, tile_c);
-                }
-            }}
-            memset(curr_chunk->blockers, 0, sizeof(curr_chunk->blockers));
-            memset(curr_chunk->factions, 0, sizeof(curr_chunk->factions));
-        }}
+    ret->tiles = malloc(w * h * sizeof(const struct tile*));
+    if(!ret->tiles)
+        goto fail_alloc_chunks;
+    memcpy(ret->tiles, chunk_tiles, w * h * sizeof(const struct tile*));
+
+    ret->placeholder = n_placeholder_layer(w, h);
+    if(!ret->placeholder)
+        goto fail_alloc_chunks;
+
+    for(int i = 0; i < NAV_LAYER_MAX; i++) {
+        ret->chunks[i] = ret->placeholder;
+    }
+
+    for(int i = 0; i < NAV_LAYER_MAX; i++) {
+        ret->closest_pathable[i] = calloc(w * h, sizeof(struct closest_tiles*));
+        if(!ret->closest_pathable[i])
+            goto fail_alloc_chunks;
+    }
+    ret->closest_land = calloc(w * h, sizeof(struct closest_tiles*));
+    if(!ret->closest_land)
+        goto fail_alloc_chunks;
+
+    /* The ground layers are always needed */
+    for(int i = 0; i < NAV_LAYERS_PER_FAMILY; i++) {
+        if(!n_build_layer_base(ret, NAV_LAYER_GROUND_1X1 + i))
+            goto fail_alloc_chunks;
+    }
 
-        n_make_cliff_edges(ret, chunk_tiles, layer, chunk_w, chunk_h);
-        n_update_portals(ret, layer);
-        n_update_island_field(ret, layer);
+    n_update_baked_data(ret, false);
+
+    for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
+        if(!ret->built[layer])
+            continue;
         n_update_local_island_field(ret, layer);
     }
 
@@ -2194,16 +4014,73 @@ void N_FreePrivate(void *nav_private)
     struct nav_private *priv = nav_private;
 
     for(int i = 0; i < NAV_LAYER_MAX; i++) {
-        free(priv->chunks[i]);
+        AStar_HierFree(priv->hier[i]);
+        if(priv->built[i])
+            free(priv->chunks[i]);
+        n_closest_tiles_free(priv, priv->closest_pathable[i]);
     }
+    n_closest_tiles_free(priv, priv->closest_land);
+    free(priv->placeholder);
+    free(priv->tiles);
+    free(priv->cutouts);
     free(nav_private);
 }
 
+bool N_LayerBuilt(const void *nav_private, enum nav_layer layer)
+{
+    const struct nav_private *priv = nav_private;
+    return priv->built[layer];
+}
+
+bool N_EnsureLayer(void *nav_private, enum nav_layer layer)
+{
+    ASSERT_IN_MAIN_THREAD();
+    struct nav_private *priv = nav_private;
+
+    if(priv->built[layer])
+        return true;
+
+    struct build_family_arg arg = (struct build_family_arg){
+        .priv = priv,
+        .base = layer - (layer % NAV_LAYERS_PER_FAMILY)
+    };
+
+    if(Sched_UsingBigStack())
+        return n_build_family(arg.priv, arg.base);
+
+    struct future result;
+    uint32_t tid = Sched_Create(1, n_build_family_task, &arg, &result, 
+        TASK_MAIN_THREAD_PINNED | TASK_BIG_STACK);
+    Sched_RunSync(tid);
+    return result.res.val.as_bool;
+}
+
+void N_RenderOverlayBegin(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(s_overlay.depth++ > 0)
+        return;
+    s_overlay.adj_vres = UI_ArAdjustedVRes(UI_GetTextVres());
+}
+
+void N_RenderOverlayEnd(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(s_overlay.depth > 0);
+
+    if(--s_overlay.depth > 0)
+        return;
+    PERF_ENTER();
+    n_overlay_flush();
+    PERF_RETURN_VOID();
+}
+
 void N_RenderOverlayText(const char *text, vec4_t map_pos, 
                          mat4x4_t *model, mat4x4_t *view, mat4x4_t *proj)
 {
-    vec2_t vres = UI_GetTextVres();
-    vec2_t adj_vres = UI_ArAdjustedVRes(vres);
+    vec2_t adj_vres = (s_overlay.depth > 0) ? s_overlay.adj_vres 
+                                            : UI_ArAdjustedVRes(UI_GetTextVres());
 
     vec4_t ws_pos_homo;
     PFM_Mat4x4_Mult4x1(model, &map_pos, &ws_pos_homo);
@@ -2213,6 +4090,11 @@ void N_RenderOverlayText(const char *text, vec4_t map_pos,
     vec4_t clip, tmp;
     PFM_Mat4x4_Mult4x1(view, &ws_pos_homo, &tmp);
     PFM_Mat4x4_Mult4x1(proj, &tmp, &clip);
+
+    /* Behind the camera */
+    if(clip.w <= 0.0f)
+        return;
+
     vec3_t ndc = (vec3_t){ 
         clip.x / clip.w, 
         clip.y / clip.w, 
@@ -2222,8 +4104,18 @@ void N_RenderOverlayText(const char *text, vec4_t map_pos,
     float screen_x = (ndc.x + 1.0f) * adj_vres.x/2.0f;
     float screen_y = adj_vres.y - ((ndc.y + 1.0f) * adj_vres.y/2.0f);
 
-    float len = strlen(text) * 8.0f;
+    size_t textlen = strlen(text);
+    float len = textlen * 8.0f;
     struct rect bounds = (struct rect){screen_x - len/2.0f, screen_y, len, 25};
+
+    if(bounds.x + bounds.w < 0 || bounds.x > adj_vres.x
+    || bounds.y + bounds.h < 0 || bounds.y > adj_vres.y)
+        return;
+
+    if(s_overlay.depth > 0 && textlen < OVERLAY_TEXT_LEN 
+    && n_overlay_text_push(text, bounds))
+        return;
+
     UI_DrawText(text, bounds, (struct rgba){255, 0, 0, 255});
 }
 
@@ -2238,14 +4130,17 @@ void N_RenderPathableChunk(void *nav_private, mat4x4_t *chunk_model,
     assert(chunk_r < priv->height);
     assert(chunk_c < priv->width);
 
-    vec2_t corners_buff[4 * FIELD_RES_R * FIELD_RES_C];
-    vec3_t colors_buff[FIELD_RES_R * FIELD_RES_C];
-
     const struct nav_chunk *chunk = &priv->chunks[layer]
                                                  [IDX(chunk_r, priv->width, chunk_c)];
 
+    /* Before reserving our own quads, as the portals are batched with them */
     n_render_portals(chunk, chunk_model, map, (vec3_t){1.0f, 1.0f, 0.0f});
 
+    vec2_t *corners_buff;
+    vec3_t *colors_buff;
+    if(!n_overlay_quads_reserve(FIELD_RES_R * FIELD_RES_C, false, &corners_buff, &colors_buff))
+        return;
+
     vec2_t *corners_base = corners_buff;
     vec3_t *colors_base = colors_buff; 
 
@@ -2268,23 +4163,11 @@ void N_RenderPathableChunk(void *nav_private, mat4x4_t *chunk_model,
                                                                    : (vec3_t){0.0f, 1.0f, 0.0f};
     }}
 
-    assert(colors_base == colors_buff + ARR_SIZE(colors_buff));
-    assert(corners_base == corners_buff + ARR_SIZE(corners_buff));
-
-    size_t count = FIELD_RES_R * FIELD_RES_C;
-    bool on_water_surface = false;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawMapOverlayQuads,
-        .nargs = 6,
-        .args = {
-            R_PushArg(corners_buff, sizeof(corners_buff)),
-            R_PushArg(colors_buff, sizeof(colors_buff)),
-            R_PushArg(&count, sizeof(count)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            R_PushArg(&on_water_surface, sizeof(bool)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
+    assert(colors_base == colors_buff + FIELD_RES_R * FIELD_RES_C);
+    assert(corners_base == corners_buff + 4 * FIELD_RES_R * FIELD_RES_C);
+
+    n_overlay_quads_commit(corners_buff, colors_buff, FIELD_RES_R * FIELD_RES_C, 
+        chunk_model, false);
 }
 
 void N_RenderPathFlowField(void *nav_private, const struct map *map, 
@@ -2298,8 +4181,9 @@ void N_RenderPathFlowField(void *nav_private, const struct map *map,
     assert(chunk_r < priv->height);
     assert(chunk_c < priv->width);
 
-    vec2_t positions_buff[FIELD_RES_R * FIELD_RES_C];
-    vec2_t dirs_buff[FIELD_RES_R * FIELD_RES_C];
+    vec2_t *positions_buff, *dirs_buff;
+    if(!n_overlay_flow_reserve(FIELD_RES_R * FIELD_RES_C, &positions_buff, &dirs_buff))
+        return;
 
     ff_id_t field_id;
     if(!N_FC_GetDestFFMapping(id, (struct coord){chunk_r, chunk_c}, &field_id))
@@ -2325,18 +4209,7 @@ void N_RenderPathFlowField(void *nav_private, const struct map *map,
         dirs_buff[r * FIELD_RES_C + c] = N_FlowDir(ff->field[r][c].dir_idx);
     }}
 
-    size_t count = FIELD_RES_R * FIELD_RES_C;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawFlowField,
-        .nargs = 5,
-        .args = {
-            R_PushArg(positions_buff, sizeof(positions_buff)),
-            R_PushArg(dirs_buff, sizeof(dirs_buff)),
-            R_PushArg(&count, sizeof(count)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
+    n_overlay_flow_commit(positions_buff, dirs_buff, FIELD_RES_R * FIELD_RES_C, chunk_model);
 }
 
 void N_RenderLOSField(void *nav_private, const struct map *map, mat4x4_t *chunk_model, 
@@ -2349,8 +4222,10 @@ void N_RenderLOSField(void *nav_private, const struct map *map, mat4x4_t *chunk_
     assert(chunk_r < priv->height);
     assert(chunk_c < priv->width);
 
-    vec2_t corners_buff[4 * FIELD_RES_R * FIELD_RES_C];
-    vec3_t colors_buff[FIELD_RES_R * FIELD_RES_C];
+    vec2_t *corners_buff;
+    vec3_t *colors_buff;
+    if(!n_overlay_quads_reserve(FIELD_RES_R * FIELD_RES_C, false, &corners_buff, &colors_buff))
+        return;
 
     if(!N_FC_ContainsLOSField(id, (struct coord){chunk_r, chunk_c}))
         return;
@@ -2381,23 +4256,11 @@ void N_RenderLOSField(void *nav_private, const struct map *map, mat4x4_t *chunk_
                                                  : (vec3_t){0.0f, 0.0f, 0.0f};
     }}
 
-    assert(colors_base == colors_buff + ARR_SIZE(colors_buff));
-    assert(corners_base == corners_buff + ARR_SIZE(corners_buff));
-
-    size_t count = FIELD_RES_R * FIELD_RES_C;
-    bool on_water_surface = false;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawMapOverlayQuads,
-        .nargs = 6,
-        .args = {
-            R_PushArg(corners_buff, sizeof(corners_buff)),
-            R_PushArg(colors_buff, sizeof(colors_buff)),
-            R_PushArg(&count, sizeof(count)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            R_PushArg(&on_water_surface, sizeof(bool)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
+    assert(colors_base == colors_buff + FIELD_RES_R * FIELD_RES_C);
+    assert(corners_base == corners_buff + 4 * FIELD_RES_R * FIELD_RES_C);
+
+    n_overlay_quads_commit(corners_buff, colors_buff, FIELD_RES_R * FIELD_RES_C, 
+        chunk_model, false);
 }
 
 void N_RenderEnemySeekField(void *nav_private, const struct map *map, mat4x4_t *chunk_model, 
@@ -2410,21 +4273,22 @@ void N_RenderEnemySeekField(void *nav_private, const struct map *map, mat4x4_t *
     assert(chunk_r < priv->height);
     assert(chunk_c < priv->width);
 
-    vec2_t positions_buff[FIELD_RES_R * FIELD_RES_C];
-    vec2_t dirs_buff[FIELD_RES_R * FIELD_RES_C];
+    vec2_t *positions_buff, *dirs_buff;
+    if(!n_overlay_flow_reserve(FIELD_RES_R * FIELD_RES_C, &positions_buff, &dirs_buff))
+        return;
 
-    vec2_t corners_buff[4 * FIELD_RES_R * FIELD_RES_C];
-    vec3_t colors_buff[FIELD_RES_R * FIELD_RES_C];
+    vec2_t *corners_buff;
+    vec3_t *colors_buff;
+    if(!n_overlay_quads_reserve(FIELD_RES_R * FIELD_RES_C, false, &corners_buff, &colors_buff))
+        return;
 
     vec2_t *corners_base = corners_buff;
     vec3_t *colors_base = colors_buff; 
 
-    struct field_target target = (struct field_target){
-        .type = TARGET_ENEMIES,
-        .enemies.faction_id = faction_id,
-        /* rest of the fields are unused */
-    };
-    ff_id_t ffid = N_FlowFieldID((struct coord){chunk_r, chunk_c}, target, layer);
+    struct coord chunk = (struct coord){chunk_r, chunk_c};
+    /* The map position is not part of the field ID */
+    struct field_target target = field_enemies_target(chunk, (vec3_t){0.0f}, faction_id);
+    ff_id_t ffid = N_FlowFieldID(chunk, target, layer);
     if(!N_FC_ContainsFlowField(ffid))
         return;
 
@@ -2457,34 +4321,12 @@ void N_RenderEnemySeekField(void *nav_private, const struct map *map, mat4x4_t *
                                                             : (vec3_t){0.0f, 1.0f, 0.0f};
     }}
 
-    assert(colors_base == colors_buff + ARR_SIZE(colors_buff));
-    assert(corners_base == corners_buff + ARR_SIZE(corners_buff));
-
-    size_t count = FIELD_RES_R * FIELD_RES_C;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawFlowField,
-        .nargs = 5,
-        .args = {
-            R_PushArg(positions_buff, sizeof(positions_buff)),
-            R_PushArg(dirs_buff, sizeof(dirs_buff)),
-            R_PushArg(&count, sizeof(count)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
-    bool on_water_surface = false;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawMapOverlayQuads,
-        .nargs = 6,
-        .args = {
-            R_PushArg(corners_buff, sizeof(corners_buff)),
-            R_PushArg(colors_buff, sizeof(colors_buff)),
-            R_PushArg(&count, sizeof(count)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            R_PushArg(&on_water_surface, sizeof(bool)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
+    assert(colors_base == colors_buff + FIELD_RES_R * FIELD_RES_C);
+    assert(corners_base == corners_buff + 4 * FIELD_RES_R * FIELD_RES_C);
+
+    n_overlay_flow_commit(positions_buff, dirs_buff, FIELD_RES_R * FIELD_RES_C, chunk_model);
+    n_overlay_quads_commit(corners_buff, colors_buff, FIELD_RES_R * FIELD_RES_C, 
+        chunk_model, false);
 }
 
 void N_RenderSurroundField(void *nav_private, const struct map *map, mat4x4_t *chunk_model, 
@@ -2497,8 +4339,9 @@ void N_RenderSurroundField(void *nav_private, const struct map *map, mat4x4_t *c
     assert(chunk_r < priv->height);
     assert(chunk_c < priv->width);
 
-    vec2_t positions_buff[FIELD_RES_R * FIELD_RES_C];
-    vec2_t dirs_buff[FIELD_RES_R * FIELD_RES_C];
+    vec2_t *positions_buff, *dirs_buff;
+    if(!n_overlay_flow_reserve(FIELD_RES_R * FIELD_RES_C, &positions_buff, &dirs_buff))
+        return;
 
     struct field_target target = (struct field_target){
         .type = TARGET_ENTITY,
@@ -2527,18 +4370,7 @@ void N_RenderSurroundField(void *nav_private, const struct map *map, mat4x4_t *c
         dirs_buff[r * FIELD_RES_C + c] = N_FlowDir(ff->field[r][c].dir_idx);
     }}
 
-    size_t count = FIELD_RES_R * FIELD_RES_C;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawFlowField,
-        .nargs = 5,
-        .args = {
-            R_PushArg(positions_buff, sizeof(positions_buff)),
-            R_PushArg(dirs_buff, sizeof(dirs_buff)),
-            R_PushArg(&count, sizeof(count)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
+    n_overlay_flow_commit(positions_buff, dirs_buff, FIELD_RES_R * FIELD_RES_C, chunk_model);
 }
 
 void N_RenderNavigationBlockers(void *nav_private, const struct map *map, 
@@ -2552,8 +4384,10 @@ void N_RenderNavigationBlockers(void *nav_private, const struct map *map,
     assert(chunk_r < priv->height);
     assert(chunk_c < priv->width);
 
-    vec2_t corners_buff[4 * FIELD_RES_R * FIELD_RES_C];
-    vec3_t colors_buff[FIELD_RES_R * FIELD_RES_C];
+    vec2_t *corners_buff;
+    vec3_t *colors_buff;
+    if(!n_overlay_quads_reserve(FIELD_RES_R * FIELD_RES_C, false, &corners_buff, &colors_buff))
+        return;
 
     const struct nav_chunk *chunk = &priv->chunks[layer]
                                                  [IDX(chunk_r, priv->width, chunk_c)];
@@ -2580,23 +4414,11 @@ void N_RenderNavigationBlockers(void *nav_private, const struct map *map,
                                                : (vec3_t){0.0f, 1.0f, 0.0f};
     }}
 
-    assert(colors_base == colors_buff + ARR_SIZE(colors_buff));
-    assert(corners_base == corners_buff + ARR_SIZE(corners_buff));
-
-    size_t count = FIELD_RES_R * FIELD_RES_C;
-    bool on_water_surface = false;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawMapOverlayQuads,
-        .nargs = 6,
-        .args = {
-            R_PushArg(corners_buff, sizeof(corners_buff)),
-            R_PushArg(colors_buff, sizeof(colors_buff)),
-            R_PushArg(&count, sizeof(count)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            R_PushArg(&on_water_surface, sizeof(bool)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
+    assert(colors_base == colors_buff + FIELD_RES_R * FIELD_RES_C);
+    assert(corners_base == corners_buff + 4 * FIELD_RES_R * FIELD_RES_C);
+
+    n_overlay_quads_commit(corners_buff, colors_buff, FIELD_RES_R * FIELD_RES_C, 
+        chunk_model, false);
 }
 
 void N_RenderBuildableTiles(void *nav_private, const struct map *map, 
@@ -2607,30 +4429,28 @@ void N_RenderBuildableTiles(void *nav_private, const struct map *map,
     assert(Sched_UsingBigStack());
 
     struct nav_private *priv = nav_private;
-    const struct nav_chunk *chunk = &priv->chunks[layer]
-                                                 [IDX(chunk_r, priv->width, chunk_c)];
-
     const float chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
     const float chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
-
-    struct map_resolution res;
-    N_GetResolution(priv, &res);
     vec3_t map_pos = M_GetPos(map);
 
-    struct map_resolution tile_res;
-    M_GetResolution(map, &tile_res);
-
-    struct tile_desc tds[2048];
-    size_t ntiles = M_Tile_AllUnderObj(map_pos, res, obb, tds, ARR_SIZE(tds));
-
-    khash_t(td) *tileset = n_moving_entities_tileset(priv, map_pos, obb);
-    assert(tileset);
+    struct buildable_query scratch;
+    const struct buildable_query *query = n_buildable_tiles(priv, map, layer, allow_shore, 
+        map_pos, obb, &scratch);
+    const struct tile_desc *tds = query->tds;
+    size_t ntiles = query->ntiles;
 
-    khash_t(td) *building_tileset = n_non_collidable_buildings_tileset(priv, map_pos, obb);
-    assert(building_tileset);
+    /* Don't push an empty overlay for every visible chunk */
+    bool any = false;
+    for(int i = 0; i < ntiles && !any; i++) {
+        any = (tds[i].chunk_r == chunk_r && tds[i].chunk_c == chunk_c);
+    }
+    if(!any)
+        return;
 
-    vec2_t corners_buff[4 * FIELD_RES_R * FIELD_RES_C];
-    vec3_t colors_buff[FIELD_RES_R * FIELD_RES_C];
+    vec2_t *corners_buff;
+    vec3_t *colors_buff;
+    if(!n_overlay_quads_reserve(FIELD_RES_R * FIELD_RES_C, true, &corners_buff, &colors_buff))
+        return;
 
     size_t count = 0;
     vec2_t *corners_base = corners_buff;
@@ -2653,56 +4473,15 @@ void N_RenderBuildableTiles(void *nav_private, const struct map *map,
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z + square_z_len};
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z};
 
-        vec4_t center_homo = (vec4_t) {
-            square_x - square_x_len / 2.0,
-            0.0,
-            square_z + square_z_len / 2.0,
-            1.0
-        };
-        vec4_t ws_center_homo;
-        PFM_Mat4x4_Mult4x1(chunk_model, &center_homo, &ws_center_homo);
-        ws_center_homo.x /= ws_center_homo.w;
-        ws_center_homo.z /= ws_center_homo.w;
-
-        struct tile_desc map_td = (struct tile_desc){
-            tds[i].chunk_r,
-            tds[i].chunk_c,
-            tds[i].tile_r / ((float)res.tile_h) * tile_res.tile_h,
-            tds[i].tile_c / ((float)res.tile_w) * tile_res.tile_w
-        };
-        struct tile *tile = NULL;
-        M_TileForDesc(map, map_td, &tile);
-        assert(tile);
-        bool shore = (tile->ramp_height > 1) && (tile->base_height < 0);
-
-        if((chunk->blockers [tds[i].tile_r][tds[i].tile_c]
-        || ((allow_shore ? !shore : true) && chunk->cost_base[tds[i].tile_r][tds[i].tile_c] == COST_IMPASSABLE)
-        || !G_Fog_PlayerExplored((vec2_t){ws_center_homo.x, ws_center_homo.z})
-        || (kh_get(td, tileset, td_key(tds + i)) != kh_end(tileset))
-        || (kh_get(td, building_tileset, td_key(tds + i)) != kh_end(building_tileset))) 
-        || blocked) {
+        if(blocked || n_buildable_tile_blocked(query, i)) {
             *colors_base++ = (vec3_t){1.0f, 0.0f, 0.0f};
         }else{
             *colors_base++ = (vec3_t){0.0f, 1.0f, 0.0f};
         }
         count++;
     }
-    free(tileset);
-    free(building_tileset);
 
-    bool on_water_surface = true;
-    R_PushCmd((struct rcmd){
-        .func = R_GL_DrawMapOverlayQuads,
-        .nargs = 6,
-        .args = {
-            R_PushArg(corners_buff, sizeof(corners_buff)),
-            R_PushArg(colors_buff, sizeof(colors_buff)),
-            R_PushArg(&count, sizeof(count)),
-            R_PushArg(chunk_model, sizeof(*chunk_model)),
-            R_PushArg(&on_water_surface, sizeof(bool)),
-            (void*)G_GetPrevTickMap(),
-        },
-    });
+    n_overlay_quads_commit(corners_buff, colors_buff, count, chunk_model, true);
 }
 
 void N_RenderIslandIDs(void *nav_private, const struct map *map, 
@@ -2844,34 +4623,51 @@ void N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *o
     struct tile_desc tds[2048];
     size_t ntiles = M_Tile_AllUnderObj(map_pos, res, obb, tds, ARR_SIZE(tds));
 
+    /* Kept around for cutting out the layers that are built later */
+    struct nav_cutout *cutouts = realloc(priv->cutouts, 
+        (priv->ncutouts + 1) * sizeof(struct nav_cutout));
+    if(cutouts) {
+        priv->cutouts = cutouts;
+        priv->cutouts[priv->ncutouts++] = (struct nav_cutout){map_pos, *obb};
+    }
+
     for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
         /* Do not cut out from air layers */
         if(layer >= NAV_LAYER_AIR_1X1 && layer <= NAV_LAYER_AIR_7X7)
             continue;
+        if(!priv->built[layer])
+            continue;
         /* In the current implementation, we are content to block 
          * the exact same tiles for all the existing layers */
-        for(int i = 0; i < ntiles; i++) {
-
-            priv->chunks[layer][IDX(tds[i].chunk_r, priv->width, tds[i].chunk_c)]
-                .cost_base[tds[i].tile_r][tds[i].tile_c] = COST_IMPASSABLE;
-        }
+        n_cutout_tiles(priv, layer, tds, ntiles);
     }
 }
 
 void N_UpdatePortals(void *nav_private)
 {
+    struct nav_private *priv = nav_private;
     for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
-        n_update_portals(nav_private, layer);
+        if(!priv->built[layer])
+            continue;
+        n_update_portals(priv, layer);
     }
 }
 
 void N_UpdateIslandsField(void *nav_private)
 {
+    struct nav_private *priv = nav_private;
     for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
-        n_update_island_field(nav_private, layer);
+        if(!priv->built[layer])
+            continue;
+        n_update_dirty_island_field(priv, layer);
     }
 }
 
+void N_UpdateBakedData(void *nav_private)
+{
+    n_update_baked_data(nav_private, true);
+}
+
 dest_id_t N_DestIDForPos(void *nav_private, vec3_t map_pos, vec2_t xz_pos, enum nav_layer layer)
 {
     struct tile_desc td;
@@ -2895,7 +4691,7 @@ bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
                    vec3_t map_pos, enum nav_layer layer, dest_id_t *out_dest_id)
 {
     return n_request_path(nav_private, xz_src, xz_dest, FACTION_ID_NONE, 
-                          map_pos, layer, out_dest_id);
+                          map_pos, layer, out_dest_id, NULL);
 }
 
 bool N_RequestPathAttacking(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
@@ -2903,7 +4699,24 @@ bool N_RequestPathAttacking(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
                             dest_id_t *out_dest_id)
 {
     return n_request_path(nav_private, xz_src, xz_dest, faction_id, 
-                          map_pos, layer, out_dest_id);
+                          map_pos, layer, out_dest_id, NULL);
+}
+
+bool N_RequestPathBatch(void *nav_private, size_t nsrcs, const vec2_t xz_srcs[], 
+                        vec2_t xz_dest, vec3_t map_pos, enum nav_layer layer, 
+                        bool out_found[], dest_id_t *out_dest_id)
+{
+    return n_request_path_batch(nav_private, nsrcs, xz_srcs, xz_dest, FACTION_ID_NONE,
+                                map_pos, layer, out_found, out_dest_id);
+}
+
+bool N_RequestPathBatchAttacking(void *nav_private, size_t nsrcs, const vec2_t xz_srcs[], 
+                                 vec2_t xz_dest, int faction_id, vec3_t map_pos, 
+                                 enum nav_layer layer, bool out_found[], 
+                                 dest_id_t *out_dest_id)
+{
+    return n_request_path_batch(nav_private, nsrcs, xz_srcs, xz_dest, faction_id,
+                                map_pos, layer, out_found, out_dest_id);
 }
 
 vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
@@ -2926,7 +4739,7 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
 
         dest_id_t ret;
         bool result = n_request_path(nav_private, curr_pos, xz_dest, 
-            faction_id, map_pos, layer, &ret);
+            faction_id, map_pos, layer, &ret, NULL);
         if(!result)
             return (vec2_t){0.0f};
         assert(ret == id);
@@ -2938,7 +4751,7 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
 
         dest_id_t ret;
         bool result = n_request_path(nav_private, curr_pos, xz_dest, 
-            faction_id, map_pos, layer, &ret);
+            faction_id, map_pos, layer, &ret, NULL);
         if(!result)
             return (vec2_t){0.0f};
         assert(ret == id);
@@ -3015,13 +4828,7 @@ vec2_t N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, enum nav_l
     assert(result);
 
     struct coord chunk = (struct coord){curr_tile.chunk_r, curr_tile.chunk_c};
-
-    struct field_target target = (struct field_target){
-        .type = TARGET_ENEMIES,
-        .enemies.faction_id = faction_id,
-        .enemies.map_pos = map_pos,
-        .enemies.chunk = chunk
-    };
+    struct field_target target = field_enemies_target(chunk, map_pos, faction_id);
 
     ff_id_t ffid = N_FlowFieldID(chunk, target, layer);
     struct flow_field ff;
@@ -3164,8 +4971,12 @@ ff_found:
     PERF_RETURN(N_FlowDir(dir_idx));
 }
 
-void N_PrepareAsyncWork(void)
+void N_PrepareAsyncWork(bool deferred)
 {
+    assert(s_field_work.nwork == 0);
+    stalloc_clear(&s_field_work.mem);
+    s_field_work.deferred = deferred;
+
     vec_in_init_alloc(&s_field_work.in, vec_realloc, vec_free);
     vec_in_resize(&s_field_work.in, MAX_FIELD_TASKS);
 
@@ -3173,126 +4984,103 @@ void N_PrepareAsyncWork(void)
     vec_out_resize(&s_field_work.out, MAX_FIELD_TASKS);
 }
 
-void N_RequestAsyncEnemySeekField(vec2_t curr_pos, void *nav_private, enum nav_layer layer,
-                                  vec3_t map_pos, int faction_id)
+void N_SubmitAsyncFields(void)
 {
-    struct nav_private *priv = nav_private;
-    struct map_resolution res;
-    N_GetResolution(priv, &res);
-
-    n_update_dirty_local_islands(nav_private, layer);
-
-    struct tile_desc curr_tile;
-    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &curr_tile);
-    assert(result);
-
-    struct coord chunk = (struct coord){curr_tile.chunk_r, curr_tile.chunk_c};
-
-    struct field_target target = (struct field_target){
-        .type = TARGET_ENEMIES,
-        .enemies.faction_id = faction_id,
-        .enemies.map_pos = map_pos,
-        .enemies.chunk = chunk
-    };
+    assert(!s_field_work.submitted);
+    s_field_work.submitted = true;
+    if(s_field_work.nwork == 0)
+        return;
 
-    ff_id_t ffid = N_FlowFieldID(chunk, target, layer);
-    if(N_FC_ContainsFlowField(ffid))
-       return;
+    /* Deferred work only reads the copy of the navigation data and the 
+     * target tiles found at the time of the request */
+    uint32_t reads = s_field_work.deferred ? 0 : (SCHED_RES_POSITIONS | SCHED_RES_MAP);
+    struct task_graph *graph = Sched_TickGraph();
 
-    /* We'll compute the missing field on-demand later */
-    if(s_field_work.nwork == MAX_FIELD_TASKS)
+    s_field_work.node = Sched_GraphAdd(graph, 1, field_task, NULL, 
+        reads, SCHED_RES_NAV_FIELDS, TASK_BIG_STACK);
+    if(s_field_work.node < 0) {
+        field_task(NULL);
         return;
-
-    for(int i = 0; i < s_field_work.nwork; i++) {
-        /* We already have a job for this field */
-        if(vec_AT(&s_field_work.in, i).id == ffid)
-            return;
     }
+    Sched_GraphSubmit(graph);
+}
 
-    vec_in_push(&s_field_work.in, (struct field_work_in){
-        .priv = priv,
-        .chunk = chunk,
-        .target = target,
-        .faction_id = faction_id,
-        .layer = layer,
-        .id = ffid
-    });
-    size_t *arg = stalloc(&s_field_work.mem, sizeof(size_t));
-    *arg = s_field_work.nwork++;
+void N_RequestAsyncEnemySeekField(vec2_t curr_pos, void *nav_private, enum nav_layer layer,
+                                  vec3_t map_pos, int faction_id)
+{
+    struct nav_private *priv = nav_private;
 
-    SDL_AtomicSet(&s_field_work.futures[s_field_work.ntasks].status, FUTURE_INCOMPLETE);
-    s_field_work.tids[s_field_work.ntasks] = Sched_Create(1, field_task, arg, 
-        &s_field_work.futures[s_field_work.ntasks], TASK_BIG_STACK);
-    if(s_field_work.tids[s_field_work.ntasks] != NULL_TID) {
-        s_field_work.ntasks++;
+    /* Deferred work is requested against a copy of the navigation data */
+    if(!s_field_work.deferred) {
+        n_update_dirty_local_islands(nav_private, layer);
     }
+
+    struct coord chunk = field_chunk_at(priv, map_pos, curr_pos);
+    struct field_target target = field_enemies_target(chunk, map_pos, faction_id);
+    field_request_work(priv, chunk, target, faction_id, layer);
 }
 
 void N_RequestAsyncSurroundField(vec2_t curr_pos, void *nav_private, enum nav_layer layer,
                                  vec3_t map_pos, uint32_t ent, int faction_id)
 {
     struct nav_private *priv = nav_private;
-    struct map_resolution res;
-    N_GetResolution(priv, &res);
-
-    n_update_dirty_local_islands(nav_private, layer);
-
-    struct tile_desc curr_tile;
-    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &curr_tile);
-    assert(result);
-
-    struct coord chunk = (struct coord){curr_tile.chunk_r, curr_tile.chunk_c};
 
-    struct field_target target = (struct field_target){
-        .type = TARGET_ENTITY,
-        .ent.target = ent,
-        .ent.map_pos = map_pos,
-    };
+    if(!s_field_work.deferred) {
+        n_update_dirty_local_islands(nav_private, layer);
+    }
 
-    ff_id_t ffid = N_FlowFieldID(chunk, target, layer);
-    if(N_FC_ContainsFlowField(ffid))
-       return;
+    struct coord chunk = field_chunk_at(priv, map_pos, curr_pos);
+    struct field_target target = field_entity_target(ent, map_pos);
+    field_request_work(priv, chunk, target, faction_id, layer);
+}
 
-    /* We'll compute the missing field on-demand later */
-    if(s_field_work.nwork == MAX_FIELD_TASKS)
-        return;
+bool N_AsyncEnemySeekFieldPending(vec2_t curr_pos, void *nav_private, enum nav_layer layer,
+                                  vec3_t map_pos, int faction_id)
+{
+    if(!s_field_work.deferred)
+        return false;
 
-    for(int i = 0; i < s_field_work.nwork; i++) {
-        /* We already have a job for this field */
-        if(vec_AT(&s_field_work.in, i).id == ffid)
-            return;
-    }
+    struct coord chunk = field_chunk_at(nav_private, map_pos, curr_pos);
+    struct field_target target = field_enemies_target(chunk, map_pos, faction_id);
+    return field_work_pending(N_FlowFieldID(chunk, target, layer));
+}
 
-    vec_in_push(&s_field_work.in, (struct field_work_in){
-        .priv = priv,
-        .chunk = chunk,
-        .target = target,
-        .faction_id = faction_id,
-        .layer = layer,
-        .id = ffid
-    });
-    size_t *arg = stalloc(&s_field_work.mem, sizeof(size_t));
-    *arg = s_field_work.nwork++;
+bool N_AsyncSurroundFieldPending(vec2_t curr_pos, void *nav_private, enum nav_layer layer,
+                                 vec3_t map_pos, uint32_t ent)
+{
+    if(!s_field_work.deferred)
+        return false;
 
-    SDL_AtomicSet(&s_field_work.futures[s_field_work.ntasks].status, FUTURE_INCOMPLETE);
-    s_field_work.tids[s_field_work.ntasks] = Sched_Create(1, field_task, arg, 
-        &s_field_work.futures[s_field_work.ntasks], TASK_BIG_STACK);
-    if(s_field_work.tids[s_field_work.ntasks] != NULL_TID) {
-        s_field_work.ntasks++;
-    }
+    struct coord chunk = field_chunk_at(nav_private, map_pos, curr_pos);
+    struct field_target target = field_entity_target(ent, map_pos);
+    return field_work_pending(N_FlowFieldID(chunk, target, layer));
 }
 
 void N_AwaitAsyncFields(void)
 {
+    if(!s_field_work.submitted) {
+        N_SubmitAsyncFields();
+    }
     field_join_work();
-    for(int i = 0; i < s_field_work.ntasks; i++) {
+    for(int i = 0; i < s_field_work.nwork; i++) {
+
         struct field_work_in *in = &vec_AT(&s_field_work.in, i);
         struct field_work_out *out = &vec_AT(&s_field_work.out, i);
+
+        if(in->stale) {
+            if(s_field_work.nevict == MAX_FIELD_TASKS)
+                continue;
+            s_field_work.evict[s_field_work.nevict++] = in->id;
+        }
         N_FC_PutFlowField(in->id, &out->field);
     }
-    stalloc_clear(&s_field_work.mem);
+    N_FC_AddVolatileFieldRefs(kh_size(s_field_work.ids), s_field_work.nrefs);
+    kh_clear(ffid, s_field_work.ids);
+
+    s_field_work.nrefs = 0;
     s_field_work.nwork = 0;
-    s_field_work.ntasks = 0;
+    s_field_work.deferred = false;
+    s_field_work.submitted = false;
 }
 
 bool N_HasEntityLOS(vec2_t curr_pos, uint32_t ent, void *nav_private, 
@@ -3343,6 +5131,96 @@ bool N_HasDestLOS(dest_id_t id, vec2_t curr_pos, void *nav_private, vec3_t map_p
     return lf->field[tile.tile_r][tile.tile_c].visible;
 }
 
+struct nav_flock_fields *N_FlockFieldsNew(void)
+{
+    return calloc(1, sizeof(struct nav_flock_fields));
+}
+
+void N_FlockFieldsFree(struct nav_flock_fields *fields)
+{
+    if(!fields)
+        return;
+    for(int i = 0; i < FLOCK_FIELDS_MAX_CHUNKS; i++) {
+        free(fields->chunks[i]);
+    }
+    free(fields);
+}
+
+vec2_t N_FlockDesiredPointSeekVelocity(struct nav_flock_fields *fields, dest_id_t id, 
+                                       vec2_t curr_pos, vec2_t xz_dest, 
+                                       void *nav_private, vec3_t map_pos)
+{
+    if(!fields)
+        return N_DesiredPointSeekVelocity(id, curr_pos, xz_dest, nav_private, map_pos);
+
+    struct nav_private *priv = nav_private;
+    struct map_resolution res;
+    N_GetResolution(priv, &res);
+
+    struct tile_desc tile;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &tile);
+    assert(result);
+
+    struct coord chunk = (struct coord){tile.chunk_r, tile.chunk_c};
+    n_flock_fields_bind(fields, id);
+
+    struct flock_chunk_fields *cf = n_flock_chunk_find(fields, chunk);
+    bool current = n_flock_chunk_current(cf) && cf->has_flow;
+
+    if(current) {
+        unsigned dir_idx = cf->flow.field[tile.tile_r][tile.tile_c].dir_idx;
+        if(dir_idx != FD_NONE) {
+            PERF_COUNTER_ADD("nav.flock_fields_hit", 1);
+            return N_FlowDir(dir_idx);
+        }
+    }
+
+    /* Take the slow path, which will make or patch up the field as needed. 
+     * Should that change the field, the epoch will have moved on and the 
+     * copy will be taken again. 
+     */
+    PERF_COUNTER_ADD("nav.flock_fields_miss", 1);
+    vec2_t ret = N_DesiredPointSeekVelocity(id, curr_pos, xz_dest, nav_private, map_pos);
+
+    if(!current || !n_flock_chunk_current(cf)) {
+        cf = n_flock_chunk_slot(fields, chunk);
+        if(cf) {
+            n_flock_chunk_refresh(cf, id);
+        }
+    }
+    return ret;
+}
+
+bool N_FlockHasDestLOS(struct nav_flock_fields *fields, dest_id_t id, vec2_t curr_pos, 
+                       void *nav_private, vec3_t map_pos)
+{
+    if(!fields)
+        return N_HasDestLOS(id, curr_pos, nav_private, map_pos);
+
+    struct nav_private *priv = nav_private;
+    struct map_resolution res;
+    N_GetResolution(priv, &res);
+
+    struct tile_desc tile;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &tile);
+    assert(result);
+
+    struct coord chunk = (struct coord){tile.chunk_r, tile.chunk_c};
+    n_flock_fields_bind(fields, id);
+
+    struct flock_chunk_fields *cf = n_flock_chunk_find(fields, chunk);
+    if(!n_flock_chunk_current(cf))
+        return N_HasDestLOS(id, curr_pos, nav_private, map_pos);
+
+    /* The LOS field may have been inserted since the copies were taken */
+    if(!cf->has_los) {
+        cf->has_los = N_FC_GetLOSField(id, chunk, &cf->los);
+        if(!cf->has_los)
+            return false;
+    }
+    return cf->los.field[tile.tile_r][tile.tile_c].visible;
+}
+
 bool N_PositionPathable(vec2_t xz_pos, enum nav_layer layer, void *nav_private, vec3_t map_pos)
 {
     struct nav_private *priv = nav_private;
@@ -3434,6 +5312,18 @@ bool N_ClosestPathable(void *nav_private, enum nav_layer layer,
         return true;
     }
 
+    const struct nav_chunk *src_chunk = 
+        &priv->chunks[layer][IDX(src_desc.chunk_r, priv->width, src_desc.chunk_c)];
+    struct tile_desc closest;
+
+    if(n_closest_tiles_lookup(priv, priv->closest_pathable[layer], src_chunk->version, 
+        layer, NULL, n_tile_unblocked, src_desc, &closest)) {
+
+        struct box bounds = M_Tile_Bounds(res, map_pos, closest);
+        *out = (vec2_t) { bounds.x, bounds.z };
+        return true;
+    }
+
     bool ret = false;
     queue_td_t frontier;
     queue_td_init(&frontier, 1024);
@@ -3497,6 +5387,12 @@ vec2_t N_ClosestPointAdjacentToLand(const struct map *map, void *nav_private,
     if(M_TileAdjacentToLand(map, &src_desc))
         return tile_center_location(priv, map_pos, src_desc);
 
+    struct tile_desc closest;
+    if(n_closest_tiles_lookup(priv, priv->closest_land, s_terrain_gen, 
+        NAV_LAYER_GROUND_1X1, map, n_tile_adjacent_to_land, src_desc, &closest)) {
+        return tile_center_location(priv, map_pos, closest);
+    }
+
     vec2_t ret = pos;
     queue_td_t frontier;
     queue_td_init(&frontier, 1024);
@@ -3725,6 +5621,50 @@ void N_BlockersDecrefOBB(void *nav_private, int faction_id, uint32_t flags,
     }
 }
 
+void N_BlockersUpdateBatch(void *nav_private, vec3_t map_pos, 
+                           size_t nops, struct nav_blocker_op *ops)
+{
+    PERF_ENTER();
+    struct nav_private *priv = nav_private;
+
+    /* Bring matching footprints next to each other, so that every distinct 
+     * footprint is only rasterized once with its net reference count change. 
+     * An entity that gets unblocked and blocked again at the same position 
+     * within the batch does not touch the blockers at all. 
+     */
+    qsort(ops, nops, sizeof(struct nav_blocker_op), compare_blocker_ops);
+
+    size_t napplied = 0;
+    for(size_t i = 0; i < nops;) {
+
+        int ref_delta = 0;
+        size_t j = i;
+        for(; j < nops && blocker_ops_equal(&ops[i], &ops[j]); j++) {
+            ref_delta += ops[j].ref_delta;
+        }
+
+        if(ref_delta != 0) {
+
+            static const enum nav_layer s_air[] = {NAV_LAYER_AIR_1X1};
+            static const enum nav_layer s_surface[] = {NAV_LAYER_WATER_1X1, NAV_LAYER_GROUND_1X1};
+            const bool air = !!(ops[i].flags & ENTITY_FLAG_AIR);
+
+            struct tile_desc tds[1024];
+            int ntds = M_Tile_AllUnderCircle(n_res(priv), ops[i].xz_pos, ops[i].range, 
+                map_pos, tds, ARR_SIZE(tds));
+            n_update_blockers_footprint(priv, air ? s_air : s_surface, 
+                air ? ARR_SIZE(s_air) : ARR_SIZE(s_surface), 
+                ops[i].faction_id, tds, ntds, ref_delta);
+            napplied++;
+        }
+        i = j;
+    }
+
+    PERF_COUNTER_ADD("nav.blocker_ops", nops);
+    PERF_COUNTER_ADD("nav.blocker_ops_applied", napplied);
+    PERF_RETURN_VOID();
+}
+
 bool N_IsMaximallyClose(void *nav_private, enum nav_layer layer, vec3_t map_pos, 
                         vec2_t xz_pos, vec2_t xz_dest, float tolerance)
 {
@@ -4018,56 +5958,10 @@ bool N_ObjectBuildable(void *nav_private, const struct map *map, enum nav_layer
     assert(Sched_UsingBigStack());
 
     struct nav_private *priv = nav_private;
-    struct map_resolution res;
-    N_GetResolution(priv, &res);
-
-    struct map_resolution tile_res;
-    M_GetResolution(map, &tile_res);
-
-    struct tile_desc tds[2048];
-    size_t ntiles = M_Tile_AllUnderObj(map_pos, res, obb, tds, ARR_SIZE(tds));
-
-    khash_t(td) *tileset = n_moving_entities_tileset(priv, map_pos, obb);
-    assert(tileset);
-
-    khash_t(td) *building_tileset = n_non_collidable_buildings_tileset(priv, map_pos, obb);
-    assert(building_tileset);
-
-    bool ret = false;
-    for(int i = 0; i < ntiles; i++) {
-
-        const struct nav_chunk *chunk = 
-            &priv->chunks[layer][IDX(tds[i].chunk_r, priv->width, tds[i].chunk_c)];
-        struct box bounds = M_Tile_Bounds(res, map_pos, tds[i]);
-        vec2_t center = (vec2_t){
-            bounds.x - bounds.width / 2.0f,
-            bounds.z + bounds.height / 2.0f
-        };
-
-        struct tile_desc map_td = (struct tile_desc){
-            tds[i].chunk_r,
-            tds[i].chunk_c,
-            tds[i].tile_r / ((float)res.tile_h) * tile_res.tile_h,
-            tds[i].tile_c / ((float)res.tile_w) * tile_res.tile_w
-        };
-        struct tile *tile = NULL;
-        M_TileForDesc(map, map_td, &tile);
-        assert(tile);
-        bool shore = (tile->ramp_height > 1) && (tile->base_height < 0);
-    
-        if(chunk->blockers [tds[i].tile_r][tds[i].tile_c]
-        || ((allow_shore ? !shore : true) && chunk->cost_base[tds[i].tile_r][tds[i].tile_c] == COST_IMPASSABLE)
-        || !G_Fog_PlayerExplored((vec2_t){center.x, center.z})
-        || (kh_get(td, tileset, td_key(tds + i)) != kh_end(tileset))
-        || (kh_get(td, building_tileset, td_key(tds + i)) != kh_end(building_tileset))) {
-            goto out;
-        }
-    }
-    ret = true;
-out:
-    free(tileset);
-    free(building_tileset);
-    return ret;
+    struct buildable_query scratch;
+    const struct buildable_query *query = n_buildable_tiles(priv, map, layer, allow_shore, 
+        map_pos, obb, &scratch);
+    return !query->any_blocked;
 }
 
 enum nav_layer N_DestLayer(dest_id_t id)
@@ -4250,10 +6144,25 @@ size_t N_DeepCopySize(void *nav_private)
 
 void N_CopyFields(void *nav_private, void *out)
 {
+    PERF_ENTER();
     struct nav_private *from = (struct nav_private*)nav_private;
     struct nav_private *to = (struct nav_private*)out;
 
+    /* Copy buffers are recycled. When the buffer already holds an earlier
+     * copy of the same data, only the chunks modified since then need to 
+     * be copied. */
+    bool refresh = (to->uid == from->uid);
+    size_t ncopied = 0, nkept = 0;
+
+    /* A layer that has been built since the last copy has nothing to refresh */
+    bool was_built[NAV_LAYER_MAX];
+    memcpy(was_built, to->built, sizeof(was_built));
+
     *to = *from;
+    /* The portal graphs and closest tile transforms are not copied */
+    memset(to->hier, 0, sizeof(to->hier));
+    memset(to->closest_pathable, 0, sizeof(to->closest_pathable));
+    to->closest_land = NULL;
     unsigned char *cursor = (unsigned char*)(to + 1);
     size_t chunks_per_layer = from->width * from->height;
     size_t layer_size = chunks_per_layer * sizeof(struct nav_chunk);
@@ -4264,15 +6173,32 @@ void N_CopyFields(void *nav_private, void *out)
         size_t blockers_size = sizeof(((struct nav_chunk*)0)->blockers);
         size_t factions_size = sizeof(((struct nav_chunk*)0)->factions);
         size_t islands_size = sizeof(((struct nav_chunk*)0)->islands);
+
+        if(!from->built[i]) {
+            to->chunks[i] = from->placeholder;
+            cursor += layer_size;
+            continue;
+        }
         to->chunks[i] = (struct nav_chunk*)cursor;
 
         for(int j = 0; j < chunks_per_layer; j++) {
+
+            if(refresh && was_built[i] && to->chunks[i][j].version == from->chunks[i][j].version) {
+                nkept++;
+                continue;
+            }
             memcpy(to->chunks[i][j].cost_base, from->chunks[i][j].cost_base, cost_size);
             memcpy(to->chunks[i][j].blockers, from->chunks[i][j].blockers, blockers_size);
             memcpy(to->chunks[i][j].factions, from->chunks[i][j].factions, factions_size);
             memcpy(to->chunks[i][j].islands, from->chunks[i][j].islands, islands_size);
+            to->chunks[i][j].version = from->chunks[i][j].version;
+            ncopied++;
         }
         cursor += layer_size;
     }
+
+    PERF_COUNTER_ADD("nav.copy_chunks_copied", ncopied);
+    PERF_COUNTER_ADD("nav.copy_chunks_kept", nkept);
+    PERF_RETURN_VOID();
 }
 
@@ -117,6 +117,11 @@ struct nav_chunk{
      * stationary entities, for example.
      */
     uint16_t        local_islands[FIELD_RES_R][FIELD_RES_C];
+    /* Changes whenever any of the 'cost_base', 'blockers', 'factions'
+     * or 'islands' fields are written. The versions are unique, so a
+     * copy of the chunk with the same version holds the same data.
+     */
+    uint64_t        version;
 };
 
 #endif
@@ -39,14 +39,45 @@
 #include "public/nav.h"
 #include "nav_data.h"
 #include "../map/public/tile.h"
+#include "../phys/public/collision.h"
 
 #include <stddef.h>
 
+/* The ground, water and air layers each come in the 1x1, 3x3, 5x5 and 7x7 sizes */
+#define NAV_LAYERS_PER_FAMILY   (4)
+
 struct portal;
+struct portal_hier;
+struct closest_tiles;
+
+struct nav_cutout{
+    vec3_t              map_pos;
+    struct obb          obb;
+};
 
 struct nav_private{
-    size_t            width, height;
-    struct nav_chunk *chunks[NAV_LAYER_MAX];
+    size_t              width, height;
+    /* Identifies the navigation data that a copy was made from */
+    uint64_t            uid;
+    struct nav_chunk   *chunks[NAV_LAYER_MAX];
+    /* The coarse (super-region) level of the portal graph */
+    struct portal_hier *hier[NAV_LAYER_MAX];
+    /* The water and air layer families are only built once they are first 
+     * needed. Until then, their 'chunks' all point to the placeholder, 
+     * which is impassable everywhere and is never written to. */
+    bool                built[NAV_LAYER_MAX];
+    struct nav_chunk   *placeholder;
+    /* Everything needed to build the remaining layers later on */
+    const struct tile **tiles;
+    size_t              chunk_w, chunk_h;
+    bool                update;
+    size_t              ncutouts;
+    struct nav_cutout  *cutouts;
+    /* Per-chunk transforms holding the nearest unblocked tile and the 
+     * nearest tile adjacent to land of every tile. The entries are built 
+     * on first use. Copies do not have them. */
+    struct closest_tiles **closest_pathable[NAV_LAYER_MAX];
+    struct closest_tiles **closest_land;
 };
 
 enum nav_layer N_DestLayer(dest_id_t id);
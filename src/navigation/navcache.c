@@ -0,0 +1,527 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "navcache.h"
+#include "nav_private.h"
+#include "nav_data.h"
+#include "../lib/public/pf_string.h"
+
+#include <SDL.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define NC_MAGIC        (0x564e4650) /* 'PFNV' */
+#define NC_VERSION      (2)
+#define NC_NONE         (~((uint32_t)0))
+#define NC_FNV_BASIS    (0xcbf29ce484222325ull)
+#define NC_FNV_PRIME    (0x100000001b3ull)
+#define NC_ORG          "PermafrostEngine"
+#define NC_APP          "navcache"
+#define IDX(r, width, c)   ((r) * (width) + (c))
+
+struct nc_header{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t nlayers;
+    uint32_t max_portals;
+    uint32_t field_res_r, field_res_c;
+    uint64_t key;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+/* Portals are referenced by their 'global' index within their layer: 
+ * (chunk index * MAX_PORTALS_PER_CHUNK) + (index within the chunk) 
+ */
+struct nc_portal{
+    int32_t  chunk_r, chunk_c;
+    int32_t  endpoints[2][2];
+    uint32_t connected;
+    uint32_t num_neighbours;
+};
+
+struct nc_edge{
+    uint32_t neighbour;
+    float    cost;
+};
+
+struct nc_mapping{
+    const unsigned char *base;
+    size_t               size;
+#if defined(_WIN32)
+    HANDLE               file;
+    HANDLE               map;
+#endif
+};
+
+struct nc_reader{
+    const unsigned char *base;
+    size_t               size;
+    size_t               pos;
+    uint64_t             hash;
+};
+
+struct nc_writer{
+    SDL_RWops           *stream;
+    uint64_t             size;
+    uint64_t             hash;
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint64_t nc_hash(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *curr = data;
+    while(size >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, curr, sizeof(word));
+        hash = (hash ^ word) * NC_FNV_PRIME;
+        hash ^= hash >> 29;
+        curr += sizeof(word);
+        size -= sizeof(word);
+    }
+    while(size--) {
+        hash = (hash ^ *curr++) * NC_FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool nc_map(const char *path, struct nc_mapping *out)
+{
+#if defined(_WIN32)
+    out->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, 
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(out->file == INVALID_HANDLE_VALUE)
+        goto fail_open;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(out->file, &size) || size.QuadPart == 0)
+        goto fail_size;
+
+    out->map = CreateFileMappingA(out->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!out->map)
+        goto fail_size;
+
+    out->base = MapViewOfFile(out->map, FILE_MAP_READ, 0, 0, 0);
+    if(!out->base)
+        goto fail_view;
+
+    out->size = size.QuadPart;
+    return true;
+
+fail_view:
+    CloseHandle(out->map);
+fail_size:
+    CloseHandle(out->file);
+fail_open:
+    return false;
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        goto fail_open;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+        goto fail_map;
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(base == MAP_FAILED)
+        goto fail_map;
+
+    close(fd);
+    out->base = base;
+    out->size = st.st_size;
+    return true;
+
+fail_map:
+    close(fd);
+fail_open:
+    return false;
+#endif
+}
+
+static void nc_unmap(struct nc_mapping *mapping)
+{
+#if defined(_WIN32)
+    UnmapViewOfFile((void*)mapping->base);
+    CloseHandle(mapping->map);
+    CloseHandle(mapping->file);
+#else
+    munmap((void*)mapping->base, mapping->size);
+#endif
+}
+
+static bool nc_read(struct nc_reader *reader, void *out, size_t size)
+{
+    if(reader->size - reader->pos < size)
+        return false;
+    memcpy(out, reader->base + reader->pos, size);
+    reader->hash = nc_hash(reader->hash, out, size);
+    reader->pos += size;
+    return true;
+}
+
+static bool nc_write(struct nc_writer *writer, const void *data, size_t size)
+{
+    if(size == 0)
+        return true;
+    if(SDL_RWwrite(writer->stream, data, size, 1) != 1)
+        return false;
+    writer->hash = nc_hash(writer->hash, data, size);
+    writer->size += size;
+    return true;
+}
+
+static struct nc_header nc_header(const struct nav_private *priv, uint64_t key)
+{
+    return (struct nc_header){
+        .magic = NC_MAGIC,
+        .version = NC_VERSION,
+        .width = priv->width,
+        .height = priv->height,
+        .nlayers = NAV_LAYER_MAX,
+        .max_portals = MAX_PORTALS_PER_CHUNK,
+        .field_res_r = FIELD_RES_R,
+        .field_res_c = FIELD_RES_C,
+        .key = key,
+    };
+}
+
+static uint32_t nc_portal_idx(const struct nav_private *priv, enum nav_layer layer,
+                              const struct portal *port)
+{
+    if(!port)
+        return NC_NONE;
+    size_t chunk_idx = IDX(port->chunk.r, priv->width, port->chunk.c);
+    const struct nav_chunk *chunk = &priv->chunks[layer][chunk_idx];
+    return chunk_idx * MAX_PORTALS_PER_CHUNK + (port - chunk->portals);
+}
+
+static struct portal *nc_portal_ptr(struct nav_private *priv, enum nav_layer layer, uint32_t idx)
+{
+    if(idx == NC_NONE)
+        return NULL;
+    struct nav_chunk *chunk = &priv->chunks[layer][idx / MAX_PORTALS_PER_CHUNK];
+    return &chunk->portals[idx % MAX_PORTALS_PER_CHUNK];
+}
+
+static bool nc_idx_valid(const struct nav_private *priv, enum nav_layer layer, 
+                         uint32_t idx, bool allow_none)
+{
+    if(idx == NC_NONE)
+        return allow_none;
+    size_t nchunks = priv->width * priv->height;
+    if(idx / MAX_PORTALS_PER_CHUNK >= nchunks)
+        return false;
+    const struct nav_chunk *chunk = &priv->chunks[layer][idx / MAX_PORTALS_PER_CHUNK];
+    return (idx % MAX_PORTALS_PER_CHUNK) < chunk->num_portals;
+}
+
+static bool nc_write_chunk(struct nc_writer *writer, const struct nav_private *priv,
+                           enum nav_layer layer, const struct nav_chunk *chunk)
+{
+    uint32_t nportals = chunk->num_portals;
+    if(!nc_write(writer, &nportals, sizeof(nportals)))
+        return false;
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *port = &chunk->portals[i];
+        struct nc_portal desc = {
+            .chunk_r = port->chunk.r,
+            .chunk_c = port->chunk.c,
+            .endpoints = {
+                {port->endpoints[0].r, port->endpoints[0].c},
+                {port->endpoints[1].r, port->endpoints[1].c},
+            },
+            .connected = nc_portal_idx(priv, layer, port->connected),
+            .num_neighbours = port->num_neighbours,
+        };
+        if(!nc_write(writer, &desc, sizeof(desc)))
+            return false;
+
+        struct nc_edge edges[MAX_PORTALS_PER_CHUNK-1];
+        for(int j = 0; j < port->num_neighbours; j++) {
+            edges[j] = (struct nc_edge){
+                .neighbour = nc_portal_idx(priv, layer, port->edges[j].neighbour),
+                .cost = port->edges[j].cost,
+            };
+        }
+        if(!nc_write(writer, edges, port->num_neighbours * sizeof(edges[0])))
+            return false;
+    }
+
+    if(!nc_write(writer, chunk->portal_travel_costs, 
+        chunk->num_portals * sizeof(chunk->portal_travel_costs[0])))
+        return false;
+    if(!nc_write(writer, chunk->islands, sizeof(chunk->islands)))
+        return false;
+    return true;
+}
+
+static bool nc_read_chunk(struct nc_reader *reader, struct nav_private *priv,
+                          enum nav_layer layer, struct nav_chunk *chunk)
+{
+    uint32_t nportals;
+    if(!nc_read(reader, &nportals, sizeof(nportals)))
+        return false;
+    if(nportals > MAX_PORTALS_PER_CHUNK)
+        return false;
+    chunk->num_portals = nportals;
+
+    for(int i = 0; i < nportals; i++) {
+
+        struct portal *port = &chunk->portals[i];
+        struct nc_portal desc;
+        if(!nc_read(reader, &desc, sizeof(desc)))
+            return false;
+        if(desc.num_neighbours > MAX_PORTALS_PER_CHUNK-1)
+            return false;
+
+        /* The connected and neighbour portals are validated once all 
+         * chunks have been read. Dynamic state (components and edge 
+         * states) is reset to how freshly created portals start out. 
+         */
+        port->component_id = 0;
+        port->chunk = (struct coord){desc.chunk_r, desc.chunk_c};
+        port->endpoints[0] = (struct coord){desc.endpoints[0][0], desc.endpoints[0][1]};
+        port->endpoints[1] = (struct coord){desc.endpoints[1][0], desc.endpoints[1][1]};
+        port->num_neighbours = desc.num_neighbours;
+        port->connected = (struct portal*)(uintptr_t)desc.connected;
+
+        struct nc_edge edges[MAX_PORTALS_PER_CHUNK-1];
+        if(!nc_read(reader, edges, desc.num_neighbours * sizeof(edges[0])))
+            return false;
+
+        for(int j = 0; j < desc.num_neighbours; j++) {
+            port->edges[j] = (struct edge){
+                .es = EDGE_STATE_ACTIVE,
+                .neighbour = (struct portal*)(uintptr_t)edges[j].neighbour,
+                .cost = edges[j].cost,
+            };
+        }
+    }
+
+    if(!nc_read(reader, chunk->portal_travel_costs, 
+        nportals * sizeof(chunk->portal_travel_costs[0])))
+        return false;
+    if(!nc_read(reader, chunk->islands, sizeof(chunk->islands)))
+        return false;
+    return true;
+}
+
+static bool nc_link_layer(struct nav_private *priv, enum nav_layer layer)
+{
+    size_t nchunks = priv->width * priv->height;
+    for(int i = 0; i < nchunks; i++) {
+
+        struct nav_chunk *chunk = &priv->chunks[layer][i];
+        for(int j = 0; j < chunk->num_portals; j++) {
+
+            struct portal *port = &chunk->portals[j];
+            if(port->chunk.r != i / priv->width || port->chunk.c != i % priv->width)
+                return false;
+
+            uint32_t conn = (uintptr_t)port->connected;
+            if(!nc_idx_valid(priv, layer, conn, true))
+                return false;
+            port->connected = nc_portal_ptr(priv, layer, conn);
+
+            for(int k = 0; k < port->num_neighbours; k++) {
+                uint32_t neighb = (uintptr_t)port->edges[k].neighbour;
+                if(!nc_idx_valid(priv, layer, neighb, false))
+                    return false;
+                port->edges[k].neighbour = nc_portal_ptr(priv, layer, neighb);
+            }
+        }
+    }
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+uint64_t N_NC_Key(const struct nav_private *priv)
+{
+    struct nc_header hdr = nc_header(priv, 0);
+    uint64_t ret = nc_hash(NC_FNV_BASIS, &hdr, sizeof(hdr));
+
+    /* Only the layers that have been built are cached */
+    ret = nc_hash(ret, priv->built, sizeof(priv->built));
+
+    size_t nchunks = priv->width * priv->height;
+    for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
+        if(!priv->built[layer])
+            continue;
+        for(int i = 0; i < nchunks; i++) {
+            const struct nav_chunk *chunk = &priv->chunks[layer][i];
+            ret = nc_hash(ret, chunk->cost_base, sizeof(chunk->cost_base));
+        }
+    }
+    return ret;
+}
+
+bool N_NC_Path(uint64_t key, char *out, size_t maxout)
+{
+    char *dir = SDL_GetPrefPath(NC_ORG, NC_APP);
+    if(!dir)
+        return false;
+
+    int len = pf_snprintf(out, maxout, "%s%016llx.pfnav", dir, (unsigned long long)key);
+    SDL_free(dir);
+    return (len > 0 && len < maxout);
+}
+
+bool N_NC_Load(struct nav_private *priv, uint64_t key, const char *path)
+{
+    struct nc_mapping mapping;
+    if(!nc_map(path, &mapping))
+        goto fail_map;
+
+    struct nc_header hdr, expected = nc_header(priv, key);
+    if(mapping.size < sizeof(hdr))
+        goto fail_header;
+    memcpy(&hdr, mapping.base, sizeof(hdr));
+
+    expected.payload_size = hdr.payload_size;
+    expected.checksum = hdr.checksum;
+    if(0 != memcmp(&hdr, &expected, sizeof(hdr)))
+        goto fail_header;
+    if(hdr.payload_size != mapping.size - sizeof(hdr))
+        goto fail_header;
+
+    struct nc_reader reader = {
+        .base = mapping.base + sizeof(hdr),
+        .size = hdr.payload_size,
+        .pos = 0,
+        .hash = NC_FNV_BASIS,
+    };
+
+    size_t nchunks = priv->width * priv->height;
+    for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
+        if(!priv->built[layer])
+            continue;
+        for(int i = 0; i < nchunks; i++) {
+            if(!nc_read_chunk(&reader, priv, layer, &priv->chunks[layer][i]))
+                goto fail_payload;
+        }
+        if(!nc_link_layer(priv, layer))
+            goto fail_payload;
+    }
+
+    if(reader.pos != reader.size || reader.hash != hdr.checksum)
+        goto fail_payload;
+
+    nc_unmap(&mapping);
+    return true;
+
+fail_payload:
+fail_header:
+    nc_unmap(&mapping);
+fail_map:
+    return false;
+}
+
+bool N_NC_Save(const struct nav_private *priv, uint64_t key, const char *path)
+{
+    char tmp_path[512];
+    if(pf_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path))
+        goto fail_path;
+
+    SDL_RWops *stream = SDL_RWFromFile(tmp_path, "wb");
+    if(!stream)
+        goto fail_path;
+
+    /* Write a placeholder header, to be patched up once the 
+     * size and checksum of the payload are known. 
+     */
+    struct nc_header hdr = nc_header(priv, key);
+    if(SDL_RWwrite(stream, &hdr, sizeof(hdr), 1) != 1)
+        goto fail_write;
+
+    struct nc_writer writer = {
+        .stream = stream,
+        .size = 0,
+        .hash = NC_FNV_BASIS,
+    };
+
+    size_t nchunks = priv->width * priv->height;
+    for(int layer = 0; layer < NAV_LAYER_MAX; layer++) {
+        if(!priv->built[layer])
+            continue;
+        for(int i = 0; i < nchunks; i++) {
+            if(!nc_write_chunk(&writer, priv, layer, &priv->chunks[layer][i]))
+                goto fail_write;
+        }
+    }
+
+    hdr.payload_size = writer.size;
+    hdr.checksum = writer.hash;
+    if(SDL_RWseek(stream, 0, RW_SEEK_SET) != 0)
+        goto fail_write;
+    if(SDL_RWwrite(stream, &hdr, sizeof(hdr), 1) != 1)
+        goto fail_write;
+    if(SDL_RWclose(stream) != 0)
+        goto fail_close;
+
+    /* Only ever expose a complete file under the final name */
+    remove(path);
+    if(rename(tmp_path, path) != 0)
+        goto fail_close;
+    return true;
+
+fail_write:
+    SDL_RWclose(stream);
+fail_close:
+    remove(tmp_path);
+fail_path:
+    return false;
+}
+
@@ -0,0 +1,72 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef NAVCACHE_H
+#define NAVCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct nav_private;
+
+/* The 'nav cache' persists the baked (i.e. derived purely from the cost 
+ * fields) navigation data - portals, the links between them, the portal 
+ * travel costs and the island fields - of all layers to disk. A blob is 
+ * keyed by a hash of the cost fields, which already reflect the map's 
+ * terrain and any static object cutouts. 
+ */
+
+/* Compute the key of the baked data for the current cost fields. 
+ */
+uint64_t N_NC_Key(const struct nav_private *priv);
+
+/* Write the path of the cache file for 'key' into 'out'. Returns false
+ * if there is no writable location for the cache.
+ */
+bool     N_NC_Path(uint64_t key, char *out, size_t maxout);
+
+/* Populate the baked data of all layers from the cache file. Returns 
+ * false if the file is missing or stale, in which case the baked data 
+ * may have been partially overwritten and must be rebuilt.
+ */
+bool     N_NC_Load(struct nav_private *priv, uint64_t key, const char *path);
+
+/* Write the baked data of all layers to the cache file.
+ */
+bool     N_NC_Save(const struct nav_private *priv, uint64_t key, const char *path);
+
+#endif
+
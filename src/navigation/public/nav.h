@@ -47,6 +47,7 @@ struct obb;
 struct map_resolution;
 struct camera;
 struct tile_desc;
+struct nav_flock_fields;
 
 typedef uint32_t dest_id_t;
 
@@ -65,6 +66,64 @@ struct fc_stats{
     unsigned grid_path_used;
     unsigned grid_path_max;
     float    grid_path_hit_rate;
+    unsigned route_used;
+    unsigned route_max;
+    float    route_hit_rate;
+    unsigned route_invalidated;
+    /* Number of independently locked shards of every cache */
+    unsigned shards;
+    /* Number of capacity changes since the stats were last cleared */
+    unsigned resizes;
+    /* Distinct enemy seek and surround fields requested by moving entities 
+     * since the stats were last cleared, and the number of references to 
+     * them. Their ratio is how many entities share each field. */
+    unsigned volatile_fields;
+    unsigned volatile_refs;
+};
+
+/* Hit rates of the recorded lookups when replayed against each 
+ * replacement policy */
+struct fc_policy_bench_result{
+    unsigned los_queries;
+    float    los_hit_rate;
+    unsigned flow_queries;
+    float    flow_hit_rate;
+    unsigned ffid_queries;
+    float    ffid_hit_rate;
+    unsigned grid_path_queries;
+    float    grid_path_hit_rate;
+};
+
+/* In the same order as the 'pf.game.fieldcache_policy' values */
+enum{
+    FC_BENCH_LRU,
+    FC_BENCH_CLOCK,
+    FC_BENCH_2Q,
+    FC_BENCH_NPOLICIES
+};
+
+struct nav_queue_bench_result{
+    double integrate_ms;
+    size_t nfields;
+    /* The sum of all the reachable integration field costs, which 
+     * must be the same for every queue */
+    double checksum;
+};
+
+/* A single circular blocker reference count change */
+struct nav_blocker_op{
+    vec2_t   xz_pos;
+    float    range;
+    int      faction_id;
+    uint32_t flags;
+    int      ref_delta;
+};
+
+enum{
+    NAV_BENCH_BINARY_HEAP,
+    NAV_BENCH_INDEXED_HEAP,
+    NAV_BENCH_BUCKET_QUEUE,
+    NAV_BENCH_NQUEUES
 };
 
 /* Pathfinding happens on a per-layer basis. Each layer has 
@@ -148,7 +207,27 @@ void     *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
 void      N_FreePrivate(void *nav_private);
 
 /* ------------------------------------------------------------------------
- * Render text above a particular map position.
+ * Only the ground layers are built up front. The water and air layers 
+ * are built the first time any layer of their family is required, and 
+ * until then every query treats them as impassable everywhere. Returns 
+ * false if the layers could not be allocated.
+ * ------------------------------------------------------------------------
+ */
+bool      N_EnsureLayer(void *nav_private, enum nav_layer layer);
+bool      N_LayerBuilt(const void *nav_private, enum nav_layer layer);
+
+/* ------------------------------------------------------------------------
+ * The overlays and texts rendered between these calls are collected and 
+ * submitted as a single draw per overlay type at the outermost 'End'. 
+ * Calls may be nested. Must be invoked from the main thread.
+ * ------------------------------------------------------------------------
+ */
+void      N_RenderOverlayBegin(void);
+void      N_RenderOverlayEnd(void);
+
+/* ------------------------------------------------------------------------
+ * Render text above a particular map position. Text that is not on the
+ * screen is culled.
  * ------------------------------------------------------------------------
  */
 void      N_RenderOverlayText(const char *text, vec4_t map_pos, 
@@ -268,6 +347,15 @@ void      N_UpdatePortals(void *nav_private);
  */
 void      N_UpdateIslandsField(void *nav_private);
 
+/* ------------------------------------------------------------------------
+ * Rebuild all the data derived from the cost fields (portals, the links 
+ * between them and the islands field) for all layers, as by calling both 
+ * 'N_UpdatePortals' and 'N_UpdateIslandsField'. When the same cost fields 
+ * have been baked before, the data is loaded from the on-disk cache.
+ * ------------------------------------------------------------------------
+ */
+void      N_UpdateBakedData(void *nav_private);
+
 /* ------------------------------------------------------------------------
  * Returns a unique ID that is used to associated all flow fields guiding 
  * to this (at tile granularity) position.
@@ -313,6 +401,29 @@ bool      N_RequestPathAttacking(void *nav_private, vec2_t xz_src,
                                  vec3_t map_pos, enum nav_layer layer, 
                                  dest_id_t *out_dest_id);
 
+/* ------------------------------------------------------------------------
+ * Generate the fields for moving many sources towards one destination.
+ * This is equivalent to calling N_RequestPath for every source, but the 
+ * sources whose chunks are already on the path of another source do not 
+ * make their own request, and all the missing flow fields are built in 
+ * parallel. 'out_found' (which may be NULL) is set to whether a path 
+ * exists for the source with the same index. Returns true if a path 
+ * exists for any of the sources.
+ * ------------------------------------------------------------------------
+ */
+bool      N_RequestPathBatch(void *nav_private, size_t nsrcs, const vec2_t xz_srcs[], 
+                             vec2_t xz_dest, vec3_t map_pos, enum nav_layer layer, 
+                             bool out_found[], dest_id_t *out_dest_id);
+
+/* ------------------------------------------------------------------------
+ * The batched equivalent of N_RequestPathAttacking.
+ * ------------------------------------------------------------------------
+ */
+bool      N_RequestPathBatchAttacking(void *nav_private, size_t nsrcs, const vec2_t xz_srcs[], 
+                                      vec2_t xz_dest, int faction_id, vec3_t map_pos, 
+                                      enum nav_layer layer, bool out_found[], 
+                                      dest_id_t *out_dest_id);
+
 /* ------------------------------------------------------------------------
  * Returns the desired velocity for an entity at 'curr_pos' for it to flow
  * towards a particular destination.
@@ -357,6 +468,28 @@ bool      N_HasEntityLOS(vec2_t curr_pos, const uint32_t ent,
 bool      N_HasDestLOS(dest_id_t id, vec2_t curr_pos, void *nav_private, 
                        vec3_t map_pos);
 
+/* ------------------------------------------------------------------------
+ * Private copies of the flow and LOS fields of a single destination, for 
+ * the chunks occupied by the members of a flock. Lookups through the copies 
+ * skip the field cache, which is only consulted again when a member moves 
+ * into a chunk without a copy or after the cached fields have changed. 
+ * Main thread only. A NULL set falls back to the uncached lookups.
+ * ------------------------------------------------------------------------
+ */
+struct nav_flock_fields *N_FlockFieldsNew(void);
+void      N_FlockFieldsFree(struct nav_flock_fields *fields);
+
+/* ------------------------------------------------------------------------
+ * Equivalents of N_DesiredPointSeekVelocity and N_HasDestLOS reading from 
+ * (and refreshing) the copies of a flock's fields.
+ * ------------------------------------------------------------------------
+ */
+vec2_t    N_FlockDesiredPointSeekVelocity(struct nav_flock_fields *fields, dest_id_t id, 
+                                          vec2_t curr_pos, vec2_t xz_dest, 
+                                          void *nav_private, vec3_t map_pos);
+bool      N_FlockHasDestLOS(struct nav_flock_fields *fields, dest_id_t id, 
+                            vec2_t curr_pos, void *nav_private, vec3_t map_pos);
+
 /* ------------------------------------------------------------------------
  * Returns true if the specified XZ position is pathable.
  * ------------------------------------------------------------------------
@@ -457,6 +590,16 @@ void      N_BlockersIncrefOBB(void *nav_private, int faction_id, uint32_t flags,
 void      N_BlockersDecrefOBB(void *nav_private, int faction_id, uint32_t flags,
                               vec3_t map_pos, const struct obb *obb);
 
+/* ------------------------------------------------------------------------
+ * Applies a batch of circular blocker reference count changes at once.
+ * Operations on an identical footprint are coalesced, so that each one is 
+ * only rasterized a single time with the net change. The ops array is
+ * reordered in the process.
+ * ------------------------------------------------------------------------
+ */
+void      N_BlockersUpdateBatch(void *nav_private, vec3_t map_pos, 
+                                size_t nops, struct nav_blocker_op *ops);
+
 /* ------------------------------------------------------------------------
  * Returns true if the entity position (xz_pos) is within a 'tolerance' 
  * range of the closest non-blocked tile that is reachable from the
@@ -541,11 +684,22 @@ size_t N_DeepCopySize(void *nav_private);
 
 /* ------------------------------------------------------------------------
  * Makes a copy of the traversal cost, blocked tile data, and per-tile
- * faction refcounts.
+ * faction refcounts. If 'out' already holds an earlier copy of the same
+ * navigation data, only the chunks which were modified since (either in
+ * the source or in the copy) are copied again.
  * ------------------------------------------------------------------------
  */
 void N_CopyFields(void *nav_private, void *out);
 
+/* ------------------------------------------------------------------------
+ * Build the integration field leading to every portal of every chunk of 
+ * the layer 'nruns' times over, with each of the priority queue variants.
+ * out[] is indexed by the NAV_BENCH_ constants.
+ * ------------------------------------------------------------------------
+ */
+void N_BenchmarkQueues(void *nav_private, enum nav_layer layer, int nruns, 
+                       struct nav_queue_bench_result out[NAV_BENCH_NQUEUES]);
+
 /* ------------------------------------------------------------------------
  * Creates an arbitrary-resolution flow field guiding to a set of tiles.
  * The 'out' array holds a (rdim * cdim) 2-dimensional row-major 
@@ -580,33 +734,57 @@ vec2_t N_FlowDir(enum flow_dir dir);
 
 /* ------------------------------------------------------------------------
  * Prepare the async workspace for following async field computation jobs.
+ * When 'deferred' is set, the jobs are allowed to remain outstanding until
+ * a later tick. The target tiles are then found at the time of the request
+ * and the 'nav_private' passed to the requests must be a copy of the 
+ * navigation data which is kept alive until the jobs are awaited.
+ * ------------------------------------------------------------------------
+ */
+void N_PrepareAsyncWork(bool deferred);
+
+/* ------------------------------------------------------------------------
+ * Kick off the building of all the fields requested since the last call
+ * to 'N_PrepareAsyncWork' as a single node of the scheduler's tick graph.
+ * Requests made after this point are not started.
  * ------------------------------------------------------------------------
  */
-void N_PrepareAsyncWork(void);
+void N_SubmitAsyncFields(void);
 
 /* ------------------------------------------------------------------------
  * Await all the outstanding flow field computation jobs and place the
- * result in the fieldcache.
+ * result in the fieldcache. The jobs are submitted first, if they have
+ * not been already.
  * ------------------------------------------------------------------------
  */
 void N_AwaitAsyncFields(void);
 
 /* ------------------------------------------------------------------------
- * Start an async job computing the required TARGET_ENEMIES field, if it
- * is not in the cache and has not been started already.
+ * Queue an async job computing the required TARGET_ENEMIES field, if it
+ * is not in the cache and has not been queued already.
  * ------------------------------------------------------------------------
  */
 void N_RequestAsyncEnemySeekField(vec2_t curr_pos, void *nav_private, enum nav_layer layer,
                                   vec3_t map_pos, int faction_id);
 
 /* ------------------------------------------------------------------------
- * Start an async job computing the required TARGET_ENTITY field, if it
- * is not in the cache and has not been started already.
+ * Queue an async job computing the required TARGET_ENTITY field, if it
+ * is not in the cache and has not been queued already.
  * ------------------------------------------------------------------------
  */
 void N_RequestAsyncSurroundField(vec2_t curr_pos, void *nav_private, enum nav_layer layer,
                                  vec3_t map_pos, uint32_t ent, int faction_id);
 
+/* ------------------------------------------------------------------------
+ * Returns true if the matching field is being built by an outstanding 
+ * deferred job. Until it is awaited, the previous steering can be kept 
+ * rather than building the field on-demand.
+ * ------------------------------------------------------------------------
+ */
+bool N_AsyncEnemySeekFieldPending(vec2_t curr_pos, void *nav_private, enum nav_layer layer,
+                                  vec3_t map_pos, int faction_id);
+bool N_AsyncSurroundFieldPending(vec2_t curr_pos, void *nav_private, enum nav_layer layer,
+                                 vec3_t map_pos, uint32_t ent);
+
 /*###########################################################################*/
 /* NAV FIELD CACHE                                                           */
 /*###########################################################################*/
@@ -629,5 +807,13 @@ void      N_FC_GetStats(struct fc_stats *out_stats);
  */
 void      N_FC_ClearAll(void);
 
+/* ------------------------------------------------------------------------
+ * Replay the lookups recorded while 'pf.game.fieldcache_trace' was set 
+ * against each replacement policy, at the current cache capacities. 
+ * out[] is indexed by the FC_BENCH_ constants.
+ * ------------------------------------------------------------------------
+ */
+void      N_FC_BenchmarkPolicies(struct fc_policy_bench_result out[FC_BENCH_NPOLICIES]);
+
 #endif
 
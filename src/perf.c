@@ -35,6 +35,7 @@
 
 #include "perf.h"
 #include "main.h"
+#include "event.h"
 #include "lib/public/khash.h"
 #include "lib/public/vec.h"
 #include "lib/public/pf_string.h"
@@ -45,6 +46,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <inttypes.h>
+
+#include <SDL_atomic.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define THREAD_LOCAL __declspec(thread)
+#else
+#include <x86intrin.h>
+#define THREAD_LOCAL __thread
+#endif
 
 
 #define PARENT_NONE     ~((uint32_t)0)
@@ -52,6 +64,19 @@
 #define GPU_STATE_KEY   UINT64_MAX
 #define GPU_TIMER_HZ    (1 * 1000 * 1000 * 1000)
 
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+
+#define FAST_RING_SIZE  (65536) /* Must be a power of 2 */
+#define FAST_MAX_NAMES  (4096)
+
+#define HISTORY_FRAMES      (60)
+#define SPIKE_POST_FRAMES   (15)
+#define SPIKE_MIN_MS        (20)
+
+#define MAX_BUDGETS         (32)
+#define MAX_COUNTERS        (512)
+
 struct perf_entry{
     union{
         uint64_t pc_delta;
@@ -62,6 +87,10 @@ struct perf_entry{
             }begin, end;
         };
     };
+    /* Absolute counter value at the time of the push. Only used for
+     * building traces, as the union above gets overwritten with a delta. 
+     */
+    uint64_t pc_begin;
     uint32_t parent_idx;
     uint32_t name_id;
 };
@@ -75,6 +104,7 @@ struct perf_entry{
 
 KHASH_MAP_INIT_STR(name_id, uint32_t)
 KHASH_MAP_INIT_INT(id_name, const char *)
+KHASH_MAP_INIT_INT64(sample, uint32_t)
 
 VEC_TYPE(perf, struct perf_entry)
 VEC_IMPL(static inline, perf, struct perf_entry)
@@ -82,8 +112,14 @@ VEC_IMPL(static inline, perf, struct perf_entry)
 VEC_TYPE(idx, uint32_t)
 VEC_IMPL(static inline, idx, uint32_t)
 
+VEC_TYPE(counter, struct perf_counter)
+VEC_IMPL(static inline, counter, struct perf_counter)
+
 struct perf_state{
     char              name[64];
+    /* Unique small integer to identify the thread in exported traces 
+     */
+    int               trace_tid;
     /* The next name ID to hand out 
      */
     uint32_t          next_id;
@@ -96,15 +132,57 @@ struct perf_state{
      * entries for the corresponding index are updated in the perf tree. 
      */
     vec_idx_t         perf_stack;
+    /* Maps a (parent index, name ID) pair to the perf tree entry for 
+     * the sampled (rather than instrumented) scopes of the current frame. 
+     */
+    khash_t(sample)  *sample_nodes;
     /* The perf tree gets a new entry for each profiled function call.
      * As such, the function calls are added in depth-first fashion.
      */
     int               perf_tree_idx;
     vec_perf_t        perf_trees[NFRAMES_LOGGED];
+    /* Copies of the trees as they fall out of the NFRAMES_LOGGED window.
+     * Only kept while spike capture is enabled. Indexed like 's_hist'.
+     */
+    vec_perf_t        history[HISTORY_FRAMES];
 };
 
 KHASH_MAP_INIT_INT64(pstate, struct perf_state)
 
+/* Counter values of a single thread, indexed by the global counter ID. 
+ * Only the owning thread adds to 'values'. A thread which publishes its' 
+ * counters itself (see Perf_CounterPublish) has only its' 'staged' values
+ * merged, so that the work it has not finished yet is not split across
+ * frames. Otherwise, 'values' are merged directly.
+ */
+struct counter_block{
+    SDL_SpinLock          lock;
+    bool                  self_publish;
+    int64_t               values[MAX_COUNTERS];
+    int64_t               staged[MAX_COUNTERS];
+    struct counter_block *next;
+};
+
+/* A complete scope, written once it has been exited */
+struct fast_event{
+    uint64_t begin_tsc;
+    uint64_t end_tsc;
+    uint32_t id;
+    uint32_t pad;
+};
+
+/* Single-producer ring of scope events. The owning thread is the
+ * only writer. The main thread reads it from 'tail' up to 'head' when 
+ * a capture is active, dropping anything that the writer has lapped.
+ */
+struct fast_ring{
+    SDL_atomic_t      head;
+    uint32_t          tail;
+    SDL_threadID      tid;
+    struct fast_ring *next;
+    struct fast_event events[FAST_RING_SIZE];
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -113,6 +191,95 @@ static khash_t(pstate) *s_thread_state_table;
 
 static int              s_last_idx = 0;
 static unsigned         s_last_frames_ms[NFRAMES_LOGGED];
+static uint64_t         s_frame_begin_pc[NFRAMES_LOGGED];
+static vec_counter_t    s_frame_counters[NFRAMES_LOGGED];
+static int              s_next_trace_tid = 0;
+
+/* Trace capture state. The timing trees are written out as they 
+ * fall out of the NFRAMES_LOGGED window, meaning the data will lag 
+ * the simulation by a couple of frames, same as with Perf_Report.
+ */
+static FILE            *s_capture_file = NULL;
+static int              s_capture_frames_left = 0;
+static bool             s_capture_first_event = true;
+static uint64_t         s_capture_base_pc;
+static bool             s_capture_have_gpu_base;
+static uint64_t         s_capture_gpu_base_ts;
+static double           s_capture_gpu_base_us;
+static uint64_t         s_capture_base_tsc;
+static uint64_t         s_capture_last_tsc;
+static uint64_t         s_capture_last_pc;
+
+/* Rolling history of the last HISTORY_FRAMES frames that have left the
+ * NFRAMES_LOGGED window. When a frame takes 'factor' times longer than 
+ * the average of the history, the history is written out as a trace, 
+ * once SPIKE_POST_FRAMES more frames have been recorded after it.
+ */
+static struct{
+    bool          enabled;
+    char          prefix[512];
+    float         factor;
+    int           next;
+    int           count;
+    int           post_left;
+    int           cooldown;
+    int           spike_slot;
+    int           seq;
+    uint64_t      begin_pc[HISTORY_FRAMES];
+    unsigned      ms[HISTORY_FRAMES];
+    vec_counter_t counters[HISTORY_FRAMES];
+}s_hist;
+
+/* Per-frame time budgets of the subsystems. The event args are handed 
+ * out from 'events', which is stable until the next Perf_FinishTick, by 
+ * which time the queued events have been serviced.
+ */
+static struct{
+    int                nbudgets;
+    char               prefix[MAX_BUDGETS][64];
+    double             budget_ms[MAX_BUDGETS];
+    double             measured_ms[MAX_BUDGETS];
+    struct perf_budget events[MAX_BUDGETS];
+}s_budgets;
+
+/* Release instrumentation state. The rings are only ever prepended to
+ * the list, and only freed at shutdown. 
+ */
+static THREAD_LOCAL struct fast_ring *t_fast_ring;
+static struct fast_ring *volatile     s_fast_rings;
+static SDL_SpinLock                   s_fast_lock;
+static int                            s_fast_nnames = 1;
+static const char                    *s_fast_names[FAST_MAX_NAMES] = {"(other)"};
+
+/* Counter state. The IDs are global and get assigned once per call site. 
+ * The names are owned by 's_counter_ids'. Like the rings, the blocks are 
+ * only ever prepended to the list, and only freed at shutdown.
+ */
+static THREAD_LOCAL struct counter_block *t_counters;
+static struct counter_block *volatile     s_counter_blocks;
+static SDL_SpinLock                       s_counter_lock;
+static khash_t(name_id)                  *s_counter_ids;
+static int                                s_counter_nnames = 1;
+static const char                        *s_counter_names[MAX_COUNTERS] = {"(other)"};
+
+/* Memory accounting state. This is statically initialized so that 
+ * allocations made before Perf_Init are not lost.
+ */
+static const char *s_mem_names[PERF_MEM_TAG_COUNT] = {
+    [PERF_MEM_NAV_FIELDCACHE]     = "nav.fieldcache",
+    [PERF_MEM_PICKLE_STREAMS]     = "script.pickle_streams",
+    [PERF_MEM_GPU_TEXTURES]       = "gpu.textures",
+    [PERF_MEM_GPU_TEXTURE_ARRAYS] = "gpu.texture_arrays",
+    [PERF_MEM_GPU_BATCH_BUFFERS]  = "gpu.batch_buffers",
+    [PERF_MEM_GPU_RINGBUFFERS]    = "gpu.ringbuffers",
+};
+
+static struct{
+    SDL_SpinLock lock;
+    int64_t      bytes;
+    int64_t      count;
+    int64_t      high_water;
+}s_mem[PERF_MEM_TAG_COUNT];
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -169,6 +336,9 @@ static bool pstate_init(struct perf_state *out, const char *name)
     out->id_name_table = kh_init(id_name);
     if(!out->id_name_table)
         goto fail_id_name;
+    out->sample_nodes = kh_init(sample);
+    if(!out->sample_nodes)
+        goto fail_sample_nodes;
     vec_idx_init(&out->perf_stack);
     if(!vec_idx_resize(&out->perf_stack, 4096))
         goto fail_perf_stack;
@@ -179,9 +349,13 @@ static bool pstate_init(struct perf_state *out, const char *name)
         if(!vec_perf_resize(&out->perf_trees[i], 32768))
             goto fail_perf_trees;
     }
+    for(int i = 0; i < HISTORY_FRAMES; i++) {
+        vec_perf_init(&out->history[i]);
+    }
 
     pf_strlcpy(out->name, name, sizeof(out->name));
     out->perf_tree_idx = 0;
+    out->trace_tid = s_next_trace_tid++;
     return true;
 
 fail_perf_trees:
@@ -193,6 +367,8 @@ fail_perf_trees:
     }
     vec_idx_destroy(&out->perf_stack);
 fail_perf_stack:
+    kh_destroy(sample, out->sample_nodes);
+fail_sample_nodes:
     kh_destroy(id_name, out->id_name_table);
 fail_id_name:
     kh_destroy(name_id, out->name_id_table);
@@ -205,7 +381,11 @@ static void pstate_destroy(struct perf_state *in)
     for(int i = 0; i < NFRAMES_LOGGED; i++) {
         vec_perf_destroy(&in->perf_trees[i]);
     }
+    for(int i = 0; i < HISTORY_FRAMES; i++) {
+        vec_perf_destroy(&in->history[i]);
+    }
     vec_idx_destroy(&in->perf_stack);
+    kh_destroy(sample, in->sample_nodes);
 
     uint32_t key;
     const char *curr;
@@ -219,6 +399,125 @@ static void pstate_destroy(struct perf_state *in)
     kh_destroy(name_id, in->name_id_table);
 }
 
+static int compare_counters(const void *a, const void *b)
+{
+    const struct perf_counter *ca = a, *cb = b;
+    return strcmp(ca->name, cb->name);
+}
+
+static void merge_counters(vec_counter_t *out)
+{
+    vec_counter_reset(out);
+
+    SDL_AtomicLock(&s_counter_lock);
+    const int nnames = s_counter_nnames;
+    SDL_AtomicUnlock(&s_counter_lock);
+
+    int64_t totals[MAX_COUNTERS] = {0};
+    for(struct counter_block *curr = s_counter_blocks; curr; curr = curr->next) {
+
+        SDL_AtomicLock(&curr->lock);
+        int64_t *src = curr->self_publish ? curr->staged : curr->values;
+        for(int i = 0; i < nnames; i++) {
+            totals[i] += src[i];
+            src[i] = 0;
+        }
+        SDL_AtomicUnlock(&curr->lock);
+    }
+
+    for(int i = 0; i < nnames; i++) {
+        if(totals[i] == 0)
+            continue;
+        vec_counter_push(out, (struct perf_counter){s_counter_names[i], totals[i]});
+    }
+    qsort(out->array, vec_size(out), sizeof(struct perf_counter), compare_counters);
+}
+
+static struct counter_block *counter_block_create(void)
+{
+    struct counter_block *ret = calloc(1, sizeof(struct counter_block));
+    if(!ret)
+        return NULL;
+
+    SDL_AtomicLock(&s_counter_lock);
+    ret->next = s_counter_blocks;
+    s_counter_blocks = ret;
+    SDL_AtomicUnlock(&s_counter_lock);
+    return ret;
+}
+
+static void counter_blocks_free(void)
+{
+    struct counter_block *curr = s_counter_blocks;
+    while(curr) {
+        struct counter_block *next = curr->next;
+        free(curr);
+        curr = next;
+    }
+    s_counter_blocks = NULL;
+}
+
+/* Must be called with 's_counter_lock' held */
+static int counter_id_for_name(const char *name)
+{
+    if(!s_counter_ids)
+        return -1;
+
+    khiter_t k = kh_get(name_id, s_counter_ids, name);
+    if(k != kh_end(s_counter_ids))
+        return kh_val(s_counter_ids, k);
+
+    /* Once we run out of slots, all the remaining counters 
+     * get lumped together under the first name. */
+    if(s_counter_nnames == MAX_COUNTERS)
+        return 0;
+
+    const char *copy = pf_strdup(name);
+    if(!copy)
+        return 0;
+
+    int status;
+    k = kh_put(name_id, s_counter_ids, copy, &status);
+    if(status == -1) {
+        free((char*)copy);
+        return 0;
+    }
+    kh_val(s_counter_ids, k) = s_counter_nnames;
+    s_counter_names[s_counter_nnames] = copy;
+    return s_counter_nnames++;
+}
+
+static int counter_register(int *id, const char *name)
+{
+    SDL_AtomicLock(&s_counter_lock);
+    int ret = *id;
+    if(ret < 0) {
+        ret = counter_id_for_name(name);
+        SDL_CompilerBarrier();
+        *id = ret;
+    }
+    SDL_AtomicUnlock(&s_counter_lock);
+    return ret;
+}
+
+static void counter_add(int id, int64_t delta)
+{
+    assert(id < MAX_COUNTERS);
+    if(id < 0)
+        return;
+
+    struct counter_block *block = t_counters;
+    if(!block) {
+        block = t_counters = counter_block_create();
+        if(!block)
+            return;
+    }
+
+    SDL_AtomicLock(&block->lock);
+    block->values[id] += delta;
+    SDL_AtomicUnlock(&block->lock);
+}
+
 static bool register_gpu_state(void)
 {
     khiter_t k = kh_get(pstate, s_thread_state_table, GPU_STATE_KEY);
@@ -233,6 +532,444 @@ static bool register_gpu_state(void)
     return true;
 }
 
+static void capture_write_str(const char *str)
+{
+    fputc('"', s_capture_file);
+    for(const char *c = str; *c; c++) {
+        if(*c == '"' || *c == '\\')
+            fputc('\\', s_capture_file);
+        if((unsigned char)*c < 0x20)
+            continue;
+        fputc(*c, s_capture_file);
+    }
+    fputc('"', s_capture_file);
+}
+
+static void capture_begin_event(void)
+{
+    if(!s_capture_first_event)
+        fputs(",\n", s_capture_file);
+    s_capture_first_event = false;
+}
+
+static double capture_pc_to_us(uint64_t pc)
+{
+    uint64_t hz = SDL_GetPerformanceFrequency();
+    int64_t delta = (int64_t)(pc - s_capture_base_pc);
+    return delta * 1000000.0 / hz;
+}
+
+static void capture_write_thread_names(void)
+{
+    for(khiter_t k = kh_begin(s_thread_state_table); k != kh_end(s_thread_state_table); k++) {
+
+        if(!kh_exist(s_thread_state_table, k))
+            continue;
+
+        struct perf_state *ps = &kh_val(s_thread_state_table, k);
+        capture_begin_event();
+        fprintf(s_capture_file, 
+            "{\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":", 
+            ps->trace_tid);
+        capture_write_str(ps->name);
+        fputs("}}", s_capture_file);
+
+        capture_begin_event();
+        fprintf(s_capture_file, 
+            "{\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":%d}}", 
+            ps->trace_tid, ps->trace_tid);
+    }
+}
+
+static void capture_write_cpu_tree(struct perf_state *ps, const vec_perf_t *tree)
+{
+    uint64_t hz = SDL_GetPerformanceFrequency();
+
+    for(int i = 0; i < vec_size(tree); i++) {
+
+        const struct perf_entry *entry = &vec_AT(tree, i);
+        if(entry->pc_begin < s_capture_base_pc)
+            continue;
+
+        capture_begin_event();
+        fprintf(s_capture_file, "{\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"name\":", ps->trace_tid);
+        capture_write_str(name_for_id(ps, entry->name_id));
+        fprintf(s_capture_file, ",\"ts\":%.3f,\"dur\":%.3f}", 
+            capture_pc_to_us(entry->pc_begin), entry->pc_delta * 1000000.0 / hz);
+    }
+}
+
+static void capture_write_gpu_tree(struct perf_state *ps, const vec_perf_t *tree, 
+                                   uint64_t frame_begin_pc)
+{
+    for(int i = 0; i < vec_size(tree); i++) {
+
+        const struct perf_entry *entry = &vec_AT(tree, i);
+        if(entry->begin.gpu_ts == 0 || entry->end.gpu_ts < entry->begin.gpu_ts)
+            continue;
+
+        /* The GPU timestamps come from a different clock. Align the first 
+         * GPU event of the capture with the start of its' frame, and keep
+         * the GPU's own relative timing from there.
+         */
+        if(!s_capture_have_gpu_base) {
+            s_capture_gpu_base_ts = entry->begin.gpu_ts;
+            s_capture_gpu_base_us = capture_pc_to_us(frame_begin_pc);
+            s_capture_have_gpu_base = true;
+        }
+        if(entry->begin.gpu_ts < s_capture_gpu_base_ts)
+            continue;
+
+        double ts = s_capture_gpu_base_us
+                  + (entry->begin.gpu_ts - s_capture_gpu_base_ts) * 1000000.0 / GPU_TIMER_HZ;
+        double dur = (entry->end.gpu_ts - entry->begin.gpu_ts) * 1000000.0 / GPU_TIMER_HZ;
+
+        capture_begin_event();
+        fprintf(s_capture_file, "{\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"name\":", ps->trace_tid);
+        capture_write_str(name_for_id(ps, entry->name_id));
+        fprintf(s_capture_file, ",\"ts\":%.3f,\"dur\":%.3f}", ts, dur);
+    }
+}
+
+static struct fast_ring *fast_ring_create(void)
+{
+    struct fast_ring *ret = malloc(sizeof(struct fast_ring));
+    if(!ret)
+        return NULL;
+
+    SDL_AtomicSet(&ret->head, 0);
+    ret->tail = 0;
+    ret->tid = SDL_ThreadID();
+
+    SDL_AtomicLock(&s_fast_lock);
+    ret->next = s_fast_rings;
+    s_fast_rings = ret;
+    SDL_AtomicUnlock(&s_fast_lock);
+    return ret;
+}
+
+static int fast_name_register(int *id, const char *name)
+{
+    SDL_AtomicLock(&s_fast_lock);
+    int ret = *id;
+    if(ret < 0) {
+        /* Once we run out of slots, all the remaining call sites 
+         * get lumped together under the first name. */
+        if(s_fast_nnames < FAST_MAX_NAMES) {
+            ret = s_fast_nnames;
+            s_fast_names[s_fast_nnames++] = name;
+        }else{
+            ret = 0;
+        }
+        SDL_CompilerBarrier();
+        *id = ret;
+    }
+    SDL_AtomicUnlock(&s_fast_lock);
+    return ret;
+}
+
+static inline void fast_ring_push(uint32_t id, uint64_t begin_tsc)
+{
+    struct fast_ring *ring = t_fast_ring;
+    if(!ring) {
+        ring = t_fast_ring = fast_ring_create();
+        if(!ring)
+            return;
+    }
+    /* Only the owning thread writes 'head', so there is no need 
+     * for an atomic increment. Make sure the event contents are
+     * visible before the new head. 
+     */
+    int head = ring->head.value;
+    ring->events[head & (FAST_RING_SIZE-1)] = (struct fast_event){
+        .begin_tsc = begin_tsc,
+        .end_tsc = __rdtsc(),
+        .id = id
+    };
+    SDL_CompilerBarrier();
+    ring->head.value = head + 1;
+}
+
+static double capture_tsc_to_us(uint64_t tsc)
+{
+    if(s_capture_last_tsc == s_capture_base_tsc)
+        return 0.0;
+
+    uint64_t hz = SDL_GetPerformanceFrequency();
+    double pc_per_tsc = (double)(s_capture_last_pc - s_capture_base_pc) 
+                      / (s_capture_last_tsc - s_capture_base_tsc);
+    int64_t delta = (int64_t)(tsc - s_capture_base_tsc);
+    return delta * pc_per_tsc * 1000000.0 / hz;
+}
+
+static int capture_trace_tid(SDL_threadID tid)
+{
+    khiter_t k = kh_get(pstate, s_thread_state_table, tid_to_key(tid));
+    if(k != kh_end(s_thread_state_table))
+        return kh_val(s_thread_state_table, k).trace_tid;
+    return s_next_trace_tid + (int)(tid % 1024);
+}
+
+static void capture_write_fast_events(void)
+{
+    /* Re-calibrate the TSC against the performance counter every 
+     * frame. The more time has passed since the start of the capture,
+     * the more accurate the conversion gets. 
+     */
+    s_capture_last_tsc = __rdtsc();
+    s_capture_last_pc = SDL_GetPerformanceCounter();
+
+    for(struct fast_ring *ring = s_fast_rings; ring; ring = ring->next) {
+
+        uint32_t head = SDL_AtomicGet(&ring->head);
+        uint32_t tail = ring->tail;
+        if(head - tail > FAST_RING_SIZE)
+            tail = head - FAST_RING_SIZE;
+
+        int trace_tid = capture_trace_tid(ring->tid);
+        for(; tail != head; tail++) {
+
+            struct fast_event event = ring->events[tail & (FAST_RING_SIZE-1)];
+            SDL_CompilerBarrier();
+
+            /* The writer may have lapped us while we were reading */
+            if(SDL_AtomicGet(&ring->head) - tail > FAST_RING_SIZE)
+                continue;
+            if(event.begin_tsc < s_capture_base_tsc)
+                continue;
+
+            double begin_us = capture_tsc_to_us(event.begin_tsc);
+            double end_us = capture_tsc_to_us(event.end_tsc);
+
+            capture_begin_event();
+            fprintf(s_capture_file, "{\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"name\":", trace_tid);
+            capture_write_str(s_fast_names[event.id]);
+            fprintf(s_capture_file, ",\"ts\":%.3f,\"dur\":%.3f}", 
+                capture_pc_to_us(s_capture_base_pc) + begin_us, MAX(end_us - begin_us, 0.0));
+        }
+        ring->tail = head;
+    }
+}
+
+static void fast_rings_free(void)
+{
+    struct fast_ring *curr = s_fast_rings;
+    while(curr) {
+        struct fast_ring *next = curr->next;
+        free(curr);
+        curr = next;
+    }
+    s_fast_rings = NULL;
+}
+
+static void capture_write_frame_marker(const char *name, uint64_t frame_begin_pc, 
+                                       const vec_counter_t *counters)
+{
+    if(frame_begin_pc < s_capture_base_pc)
+        return;
+
+    capture_begin_event();
+    fputs("{\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"name\":", s_capture_file);
+    capture_write_str(name);
+    fprintf(s_capture_file, ",\"ts\":%.3f}", capture_pc_to_us(frame_begin_pc));
+
+    for(int i = 0; i < vec_size(counters); i++) {
+
+        capture_begin_event();
+        fputs("{\"ph\":\"C\",\"pid\":0,\"name\":", s_capture_file);
+        capture_write_str(vec_AT(counters, i).name);
+        fprintf(s_capture_file, ",\"ts\":%.3f,\"args\":{\"value\":%" PRId64 "}}",
+            capture_pc_to_us(frame_begin_pc), vec_AT(counters, i).value);
+    }
+}
+
+static void capture_write_oldest_frame(void)
+{
+    int frame_idx = (s_last_idx + 1) % NFRAMES_LOGGED;
+    uint64_t frame_begin_pc = s_frame_begin_pc[frame_idx];
+    capture_write_frame_marker("Frame", frame_begin_pc, &s_frame_counters[frame_idx]);
+
+    for(khiter_t k = kh_begin(s_thread_state_table); k != kh_end(s_thread_state_table); k++) {
+
+        if(!kh_exist(s_thread_state_table, k))
+            continue;
+
+        struct perf_state *ps = &kh_val(s_thread_state_table, k);
+        int read_idx = (ps->perf_tree_idx + 1) % NFRAMES_LOGGED;
+
+        if(kh_key(s_thread_state_table, k) == GPU_STATE_KEY) {
+            capture_write_gpu_tree(ps, &ps->perf_trees[read_idx], frame_begin_pc);
+        }else{
+            capture_write_cpu_tree(ps, &ps->perf_trees[read_idx]);
+        }
+    }
+}
+
+static void history_write_capture(void)
+{
+    char path[600];
+    pf_snprintf(path, sizeof(path), "%s_%d.json", s_hist.prefix, s_hist.seq++);
+
+    s_capture_file = fopen(path, "w");
+    if(!s_capture_file) {
+        fprintf(stderr, "Failed to write frame spike capture to file: %s\n", path);
+        return;
+    }
+    setvbuf(s_capture_file, NULL, _IOFBF, 1024 * 1024);
+
+    int first = (s_hist.next + HISTORY_FRAMES - s_hist.count) % HISTORY_FRAMES;
+    s_capture_first_event = true;
+    s_capture_base_pc = s_hist.begin_pc[first];
+    s_capture_have_gpu_base = false;
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", s_capture_file);
+    capture_write_thread_names();
+
+    for(int i = 0; i < s_hist.count; i++) {
+
+        int slot = (first + i) % HISTORY_FRAMES;
+        capture_write_frame_marker((slot == s_hist.spike_slot) ? "Spike" : "Frame", 
+            s_hist.begin_pc[slot], &s_hist.counters[slot]);
+
+        for(khiter_t k = kh_begin(s_thread_state_table); k != kh_end(s_thread_state_table); k++) {
+
+            if(!kh_exist(s_thread_state_table, k))
+                continue;
+
+            struct perf_state *ps = &kh_val(s_thread_state_table, k);
+            if(kh_key(s_thread_state_table, k) == GPU_STATE_KEY) {
+                capture_write_gpu_tree(ps, &ps->history[slot], s_hist.begin_pc[slot]);
+            }else{
+                capture_write_cpu_tree(ps, &ps->history[slot]);
+            }
+        }
+    }
+
+    fputs("\n]}\n", s_capture_file);
+    fclose(s_capture_file);
+    s_capture_file = NULL;
+}
+
+static void history_record_oldest(void)
+{
+    int frame_idx = (s_last_idx + 1) % NFRAMES_LOGGED;
+    unsigned ms = s_last_frames_ms[frame_idx];
+
+    unsigned total = 0;
+    for(int i = 0; i < s_hist.count; i++) {
+        total += s_hist.ms[i];
+    }
+    float avg = s_hist.count ? ((float)total) / s_hist.count : 0.0f;
+
+    int slot = s_hist.next;
+    s_hist.begin_pc[slot] = s_frame_begin_pc[frame_idx];
+    s_hist.ms[slot] = ms;
+    vec_counter_copy(&s_hist.counters[slot], &s_frame_counters[frame_idx]);
+
+    for(khiter_t k = kh_begin(s_thread_state_table); k != kh_end(s_thread_state_table); k++) {
+
+        if(!kh_exist(s_thread_state_table, k))
+            continue;
+
+        struct perf_state *ps = &kh_val(s_thread_state_table, k);
+        int read_idx = (ps->perf_tree_idx + 1) % NFRAMES_LOGGED;
+        vec_perf_copy(&ps->history[slot], &ps->perf_trees[read_idx]);
+    }
+
+    s_hist.next = (s_hist.next + 1) % HISTORY_FRAMES;
+    s_hist.count = MIN(s_hist.count + 1, HISTORY_FRAMES);
+    if(s_hist.cooldown > 0)
+        s_hist.cooldown--;
+
+    /* Only compare against a reasonably full history */
+    if(s_hist.post_left == 0 
+    && s_hist.cooldown == 0
+    && s_hist.count > HISTORY_FRAMES / 2
+    && ms >= SPIKE_MIN_MS
+    && ms > avg * s_hist.factor) {
+        s_hist.post_left = SPIKE_POST_FRAMES;
+        s_hist.spike_slot = slot;
+    }
+
+    if(s_hist.post_left > 0 && --s_hist.post_left == 0) {
+        /* Don't clobber a capture that is in progress */
+        if(!s_capture_file) {
+            history_write_capture();
+        }
+        s_hist.cooldown = HISTORY_FRAMES;
+    }
+}
+
+static bool budget_matches(int budget, struct perf_state *ps, uint32_t name_id)
+{
+    const char *name = name_for_id(ps, name_id);
+    if(!name)
+        return false;
+    return (0 == strncmp(name, s_budgets.prefix[budget], strlen(s_budgets.prefix[budget])));
+}
+
+/* Only the outermost matching scopes are counted, so that recursive or
+ * nested calls into the same subsystem are not double-counted.
+ */
+static double budget_tree_ms(int budget, struct perf_state *ps, const vec_perf_t *tree)
+{
+    uint64_t total = 0;
+    for(int i = 0; i < vec_size(tree); i++) {
+
+        const struct perf_entry *entry = &vec_AT(tree, i);
+        if(!budget_matches(budget, ps, entry->name_id))
+            continue;
+
+        bool nested = false;
+        uint32_t parent = entry->parent_idx;
+        while(parent != PARENT_NONE) {
+            const struct perf_entry *pentry = &vec_AT(tree, parent);
+            if(budget_matches(budget, ps, pentry->name_id)) {
+                nested = true;
+                break;
+            }
+            parent = pentry->parent_idx;
+        }
+        if(!nested) {
+            total += entry->pc_delta;
+        }
+    }
+    return total * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void budgets_measure_oldest(void)
+{
+    memset(s_budgets.measured_ms, 0, sizeof(s_budgets.measured_ms));
+
+    for(khiter_t k = kh_begin(s_thread_state_table); k != kh_end(s_thread_state_table); k++) {
+
+        if(!kh_exist(s_thread_state_table, k))
+            continue;
+        if(kh_key(s_thread_state_table, k) == GPU_STATE_KEY)
+            continue;
+
+        struct perf_state *ps = &kh_val(s_thread_state_table, k);
+        int read_idx = (ps->perf_tree_idx + 1) % NFRAMES_LOGGED;
+
+        for(int i = 0; i < s_budgets.nbudgets; i++) {
+            s_budgets.measured_ms[i] += budget_tree_ms(i, ps, &ps->perf_trees[read_idx]);
+        }
+    }
+
+    for(int i = 0; i < s_budgets.nbudgets; i++) {
+
+        if(s_budgets.measured_ms[i] <= s_budgets.budget_ms[i])
+            continue;
+
+        s_budgets.events[i] = (struct perf_budget){
+            .name = s_budgets.prefix[i],
+            .budget_ms = s_budgets.budget_ms[i],
+            .measured_ms = s_budgets.measured_ms[i]
+        };
+        E_Global_Notify(EVENT_PERF_BUDGET_EXCEEDED, &s_budgets.events[i], ES_ENGINE);
+    }
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -242,7 +979,19 @@ bool Perf_Init(void)
     s_thread_state_table = kh_init(pstate);
     if(!s_thread_state_table)
         return false;
+    s_counter_ids = kh_init(name_id);
+    if(!s_counter_ids) {
+        kh_destroy(pstate, s_thread_state_table);
+        return false;
+    }
+    for(int i = 0; i < NFRAMES_LOGGED; i++) {
+        vec_counter_init(&s_frame_counters[i]);
+    }
+    for(int i = 0; i < HISTORY_FRAMES; i++) {
+        vec_counter_init(&s_hist.counters[i]);
+    }
     if(!register_gpu_state()) {
+        kh_destroy(name_id, s_counter_ids);
         kh_destroy(pstate, s_thread_state_table);
         return false;
     }
@@ -256,10 +1005,28 @@ void Perf_Shutdown(void)
     struct perf_state curr;
     (void)key;
 
+    Perf_CaptureEnd();
+
     kh_foreach(s_thread_state_table, key, curr, {
         pstate_destroy(&curr);
     });
     kh_destroy(pstate, s_thread_state_table);
+    fast_rings_free();
+
+    counter_blocks_free();
+    for(int i = 1; i < s_counter_nnames; i++) {
+        free((char*)s_counter_names[i]);
+    }
+    kh_destroy(name_id, s_counter_ids);
+    s_counter_ids = NULL;
+    s_counter_nnames = 1;
+
+    for(int i = 0; i < NFRAMES_LOGGED; i++) {
+        vec_counter_destroy(&s_frame_counters[i]);
+    }
+    for(int i = 0; i < HISTORY_FRAMES; i++) {
+        vec_counter_destroy(&s_hist.counters[i]);
+    }
 }
 
 bool Perf_RegisterThread(SDL_threadID tid, const char *name)
@@ -293,8 +1060,10 @@ void Perf_Push(const char *name)
     const size_t ssize = vec_size(&ps->perf_stack);
     uint32_t parent_idx = ssize > 0 ? vec_AT(&ps->perf_stack, ssize-1) : PARENT_NONE;
 
+    uint64_t now = SDL_GetPerformanceCounter();
     vec_perf_push(&ps->perf_trees[ps->perf_tree_idx], (struct perf_entry){
-        .pc_delta = SDL_GetPerformanceCounter(),
+        .pc_delta = now,
+        .pc_begin = now,
         .parent_idx = parent_idx,
         .name_id = name_id_get(name, ps)
     });
@@ -357,6 +1126,150 @@ bool Perf_IsRoot(void)
     return false;
 }
 
+uint64_t Perf_EnterFast(int *id, const char *name)
+{
+    if(*id < 0) {
+        fast_name_register(id, name);
+    }
+    return __rdtsc();
+}
+
+void Perf_ExitFast(int id, uint64_t begin)
+{
+    fast_ring_push(id, begin);
+}
+
+void Perf_CounterAdd(const char *name, int64_t delta)
+{
+    SDL_AtomicLock(&s_counter_lock);
+    int id = counter_id_for_name(name);
+    SDL_AtomicUnlock(&s_counter_lock);
+    counter_add(id, delta);
+}
+
+void Perf_CounterAddFast(int *id, const char *name, int64_t delta)
+{
+    int curr = *id;
+    if(curr < 0) {
+        curr = counter_register(id, name);
+    }
+    counter_add(curr, delta);
+}
+
+void Perf_CounterPublish(void)
+{
+    struct counter_block *block = t_counters;
+    if(!block)
+        return;
+
+    SDL_AtomicLock(&block->lock);
+    block->self_publish = true;
+    for(int i = 0; i < MAX_COUNTERS; i++) {
+        block->staged[i] += block->values[i];
+        block->values[i] = 0;
+    }
+    SDL_AtomicUnlock(&block->lock);
+}
+
+void Perf_CounterAddElapsed(const char *name, uint64_t begin_pc)
+{
+    uint64_t delta = SDL_GetPerformanceCounter() - begin_pc;
+    Perf_CounterAdd(name, delta * 1000000 / SDL_GetPerformanceFrequency());
+}
+
+void Perf_RenderStall(const char *name, uint64_t begin_pc)
+{
+    uint64_t delta = SDL_GetPerformanceCounter() - begin_pc;
+    int64_t us = delta * 1000000 / SDL_GetPerformanceFrequency();
+    static int total_id = -1;
+    Perf_CounterAdd(name, us);
+    Perf_CounterAddFast(&total_id, "render.stall_us", us);
+}
+
+static void mem_adjust(enum perf_mem_tag tag, int64_t dbytes, int64_t dcount)
+{
+    assert(tag >= 0 && tag < PERF_MEM_TAG_COUNT);
+    SDL_AtomicLock(&s_mem[tag].lock);
+    s_mem[tag].bytes += dbytes;
+    s_mem[tag].count += dcount;
+    s_mem[tag].high_water = MAX(s_mem[tag].high_water, s_mem[tag].bytes);
+    SDL_AtomicUnlock(&s_mem[tag].lock);
+}
+
+void Perf_MemAlloc(enum perf_mem_tag tag, size_t bytes)
+{
+    mem_adjust(tag, (int64_t)bytes, 1);
+}
+
+void Perf_MemRealloc(enum perf_mem_tag tag, size_t old_bytes, size_t new_bytes)
+{
+    mem_adjust(tag, (int64_t)new_bytes - (int64_t)old_bytes, 0);
+}
+
+void Perf_MemFree(enum perf_mem_tag tag, size_t bytes)
+{
+    mem_adjust(tag, -(int64_t)bytes, -1);
+}
+
+void Perf_AddSample(size_t depth, const char **names, uint64_t pc_weight)
+{
+    SDL_threadID tid = SDL_ThreadID();
+    khiter_t k = kh_get(pstate, s_thread_state_table, tid_to_key(tid));
+    if(k == kh_end(s_thread_state_table))
+        return;
+
+    struct perf_state *ps = &kh_val(s_thread_state_table, k);
+    vec_perf_t *tree = &ps->perf_trees[ps->perf_tree_idx];
+    const size_t ssize = vec_size(&ps->perf_stack);
+    uint32_t parent_idx = ssize > 0 ? vec_AT(&ps->perf_stack, ssize-1) : PARENT_NONE;
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    for(int i = 0; i < depth; i++) {
+
+        uint32_t name_id = name_id_get(names[i], ps);
+        uint64_t key = (((uint64_t)parent_idx) << 32) | name_id;
+        uint32_t idx;
+
+        k = kh_get(sample, ps->sample_nodes, key);
+        if(k != kh_end(ps->sample_nodes)) {
+            idx = kh_val(ps->sample_nodes, k);
+        }else{
+            int status;
+            k = kh_put(sample, ps->sample_nodes, key, &status);
+            if(status == -1)
+                return;
+            vec_perf_push(tree, (struct perf_entry){
+                .pc_delta = 0,
+                .pc_begin = now,
+                .parent_idx = parent_idx,
+                .name_id = name_id
+            });
+            idx = vec_size(tree) - 1;
+            kh_val(ps->sample_nodes, k) = idx;
+        }
+
+        vec_AT(tree, idx).pc_delta += pc_weight;
+        parent_idx = idx;
+    }
+}
+
+size_t Perf_CurrentStack(size_t maxout, const char **out)
+{
+    SDL_threadID tid = SDL_ThreadID();
+    khiter_t k = kh_get(pstate, s_thread_state_table, tid_to_key(tid));
+    if(k == kh_end(s_thread_state_table))
+        return 0;
+
+    struct perf_state *ps = &kh_val(s_thread_state_table, k);
+    size_t ret = MIN(maxout, vec_size(&ps->perf_stack));
+    for(int i = 0; i < ret; i++) {
+        uint32_t idx = vec_AT(&ps->perf_stack, i);
+        const struct perf_entry *pe = &vec_AT(&ps->perf_trees[ps->perf_tree_idx], idx);
+        out[i] = name_for_id(ps, pe->name_id);
+    }
+    return ret;
+}
+
 void Perf_PushGPU(const char *name, uint32_t cookie)
 {
     khiter_t k = kh_get(pstate, s_thread_state_table, GPU_STATE_KEY);
@@ -394,6 +1307,7 @@ void Perf_BeginTick(void)
 {
     ASSERT_IN_MAIN_THREAD();
     s_last_frames_ms[s_last_idx] = SDL_GetTicks();
+    s_frame_begin_pc[s_last_idx] = SDL_GetPerformanceCounter();
 
     khiter_t k = kh_get(pstate, s_thread_state_table, GPU_STATE_KEY);
     if(k != kh_end(s_thread_state_table));
@@ -429,6 +1343,20 @@ void Perf_BeginTick(void)
 void Perf_FinishTick(void)
 {
     ASSERT_IN_MAIN_THREAD();
+    merge_counters(&s_frame_counters[s_last_idx]);
+
+    if(s_capture_file) {
+        capture_write_fast_events();
+        capture_write_oldest_frame();
+        if(--s_capture_frames_left == 0)
+            Perf_CaptureEnd();
+    }
+    if(s_hist.enabled) {
+        history_record_oldest();
+    }
+    if(s_budgets.nbudgets > 0) {
+        budgets_measure_oldest();
+    }
 
     for(khiter_t k = kh_begin(s_thread_state_table); k != kh_end(s_thread_state_table); k++) {
 
@@ -440,6 +1368,7 @@ void Perf_FinishTick(void)
 
         curr->perf_tree_idx = (curr->perf_tree_idx + 1) % NFRAMES_LOGGED;
         vec_perf_reset(&curr->perf_trees[curr->perf_tree_idx]);
+        kh_clear(sample, curr->sample_nodes);
     }
 
     uint32_t curr_time = SDL_GetTicks();
@@ -490,6 +1419,91 @@ size_t Perf_Report(size_t maxout, struct perf_info **out)
     return ret;
 }
 
+size_t Perf_ReportCounters(size_t maxout, struct perf_counter *out)
+{
+    int read_idx = (s_last_idx + 1) % NFRAMES_LOGGED;
+    const vec_counter_t *counters = &s_frame_counters[read_idx];
+
+    size_t ret = MIN(maxout, vec_size(counters));
+    memcpy(out, counters->array, ret * sizeof(struct perf_counter));
+    return ret;
+}
+
+size_t Perf_ReportMemory(size_t maxout, struct perf_mem_stats *out)
+{
+    size_t ret = MIN(maxout, PERF_MEM_TAG_COUNT);
+    for(int i = 0; i < ret; i++) {
+        SDL_AtomicLock(&s_mem[i].lock);
+        out[i] = (struct perf_mem_stats){
+            .name = s_mem_names[i],
+            .bytes = s_mem[i].bytes,
+            .count = s_mem[i].count,
+            .high_water = s_mem[i].high_water,
+        };
+        SDL_AtomicUnlock(&s_mem[i].lock);
+    }
+    return ret;
+}
+
+static double counter_ms(const vec_counter_t *counters, const char *name)
+{
+    for(int i = 0; i < vec_size(counters); i++) {
+        if(0 == strcmp(vec_AT(counters, i).name, name))
+            return vec_AT(counters, i).value / 1000.0;
+    }
+    return 0.0;
+}
+
+void Perf_ReportFrame(struct perf_frame_stats *out)
+{
+    int read_idx = (s_last_idx + 1) % NFRAMES_LOGGED;
+    const vec_counter_t *counters = &s_frame_counters[read_idx];
+
+    *out = (struct perf_frame_stats){
+        .frame_ms = s_last_frames_ms[read_idx],
+        .render_busy_ms = counter_ms(counters, "render.busy_us"),
+        .render_idle_ms = counter_ms(counters, "render.idle_us"),
+        .render_stall_ms = counter_ms(counters, "render.stall_us"),
+        .render_swap_ms = counter_ms(counters, "render.swap_us"),
+        .bound = PERF_BOUND_UNKNOWN
+    };
+
+    khiter_t k = kh_get(pstate, s_thread_state_table, GPU_STATE_KEY);
+    if(k != kh_end(s_thread_state_table)) {
+
+        struct perf_state *ps = &kh_val(s_thread_state_table, k);
+        const vec_perf_t *tree = &ps->perf_trees[(ps->perf_tree_idx + 1) % NFRAMES_LOGGED];
+        for(int i = 0; i < vec_size(tree); i++) {
+            const struct perf_entry *entry = &vec_AT(tree, i);
+            if(entry->parent_idx != PARENT_NONE || entry->end.gpu_ts < entry->begin.gpu_ts)
+                continue;
+            out->gpu_ms += (entry->end.gpu_ts - entry->begin.gpu_ts) * 1000.0 / GPU_TIMER_HZ;
+        }
+    }
+
+    double total = out->render_busy_ms + out->render_idle_ms + out->render_swap_ms;
+    double working = MAX(out->render_busy_ms - out->render_stall_ms, 0.0);
+    double blocked = out->render_stall_ms + out->render_swap_ms;
+
+    if(total <= 0.0 || out->frame_ms <= 0.0)
+        return;
+    out->render_utilization = working / total;
+
+    /* A render thread that spends a good part of the frame blocked on the
+     * GPU (including in the swap) is waiting on the GPU. One that is mostly
+     * never idle holds back the main thread, which has to wait for it to 
+     * finish. Otherwise, the render thread ends up waiting for the main 
+     * thread to submit the next frame. */
+    if((blocked > 0.25 * out->frame_ms && blocked >= working)
+    || out->gpu_ms > 0.9 * out->frame_ms) {
+        out->bound = PERF_BOUND_GPU;
+    }else if(out->render_idle_ms < 0.1 * out->frame_ms) {
+        out->bound = PERF_BOUND_RENDER;
+    }else{
+        out->bound = PERF_BOUND_MAIN;
+    }
+}
+
 uint32_t Perf_LastFrameMS(void)
 {
     int read_idx = (s_last_idx + 1) % NFRAMES_LOGGED;
@@ -503,3 +1517,123 @@ uint32_t Perf_CurrFrameMS(void)
     return curr_time - last_ts;
 }
 
+
+bool Perf_CaptureBegin(const char *path, int nframes)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(s_capture_file || nframes <= 0)
+        return false;
+
+    s_capture_file = fopen(path, "w");
+    if(!s_capture_file)
+        return false;
+
+    /* The trace is written out during Perf_FinishTick - make sure that 
+     * is not dominated by lots of tiny writes. */
+    setvbuf(s_capture_file, NULL, _IOFBF, 1024 * 1024);
+
+    /* Account for the frames that are still buffered and were begun 
+     * before the capture (they are skipped), so that we get 'nframes'
+     * full frames in the trace. */
+    s_capture_frames_left = nframes + NFRAMES_LOGGED;
+    s_capture_first_event = true;
+    s_capture_base_pc = SDL_GetPerformanceCounter();
+    s_capture_have_gpu_base = false;
+    s_capture_base_tsc = __rdtsc();
+    s_capture_last_tsc = s_capture_base_tsc;
+    s_capture_last_pc = s_capture_base_pc;
+
+    /* Skip anything that was recorded before the capture */
+    for(struct fast_ring *ring = s_fast_rings; ring; ring = ring->next) {
+        ring->tail = SDL_AtomicGet(&ring->head);
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", s_capture_file);
+    capture_write_thread_names();
+    return true;
+}
+
+void Perf_CaptureEnd(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_capture_file)
+        return;
+
+    fputs("\n]}\n", s_capture_file);
+    fclose(s_capture_file);
+    s_capture_file = NULL;
+    s_capture_frames_left = 0;
+}
+
+bool Perf_CaptureActive(void)
+{
+    return (s_capture_file != NULL);
+}
+
+void Perf_SpikeCaptureEnable(const char *prefix, float factor)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    pf_strlcpy(s_hist.prefix, prefix, sizeof(s_hist.prefix));
+    s_hist.factor = factor;
+    s_hist.enabled = true;
+    s_hist.next = 0;
+    s_hist.count = 0;
+    s_hist.post_left = 0;
+    s_hist.cooldown = 0;
+}
+
+void Perf_SpikeCaptureDisable(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+    s_hist.enabled = false;
+}
+
+bool Perf_SetBudget(const char *prefix, double ms)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    int idx = 0;
+    for(; idx < s_budgets.nbudgets; idx++) {
+        if(0 == strcmp(s_budgets.prefix[idx], prefix))
+            break;
+    }
+
+    if(ms <= 0.0) {
+        if(idx == s_budgets.nbudgets)
+            return true;
+        int nmove = s_budgets.nbudgets - idx - 1;
+        memmove(s_budgets.prefix[idx], s_budgets.prefix[idx + 1], nmove * sizeof(s_budgets.prefix[0]));
+        memmove(&s_budgets.budget_ms[idx], &s_budgets.budget_ms[idx + 1], nmove * sizeof(double));
+        memmove(&s_budgets.measured_ms[idx], &s_budgets.measured_ms[idx + 1], nmove * sizeof(double));
+        s_budgets.nbudgets--;
+        return true;
+    }
+
+    if(idx == s_budgets.nbudgets) {
+        if(s_budgets.nbudgets == MAX_BUDGETS)
+            return false;
+        if(strlen(prefix) >= sizeof(s_budgets.prefix[0]))
+            return false;
+        pf_strlcpy(s_budgets.prefix[idx], prefix, sizeof(s_budgets.prefix[0]));
+        s_budgets.measured_ms[idx] = 0.0;
+        s_budgets.nbudgets++;
+    }
+    s_budgets.budget_ms[idx] = ms;
+    return true;
+}
+
+size_t Perf_ReportBudgets(size_t maxout, struct perf_budget *out)
+{
+    size_t ret = MIN(maxout, s_budgets.nbudgets);
+    for(int i = 0; i < ret; i++) {
+        out[i] = (struct perf_budget){
+            .name = s_budgets.prefix[i],
+            .budget_ms = s_budgets.budget_ms[i],
+            .measured_ms = s_budgets.measured_ms[i]
+        };
+    }
+    return ret;
+}
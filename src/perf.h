@@ -38,6 +38,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <SDL_thread.h>
 
 #ifndef NDEBUG
@@ -68,6 +69,56 @@
 #define PERF_POP_NAME(_ptr)     \
     Perf_Pop(_ptr)
 
+#define PERF_COUNTER_ADD(name, delta)                   \
+    do{                                                 \
+        static int _perf_cid = -1;                      \
+        Perf_CounterAddFast(&_perf_cid, name, delta);   \
+    }while(0)
+
+#define PERF_COUNTER_ADD_ID(id, name, delta) \
+    Perf_CounterAddFast(id, name, delta)
+
+#elif defined(PERF_RELEASE)
+
+/* Low-overhead instrumentation for release builds. Only the function-level
+ * scopes are recorded. The entry timestamp is kept in a local of the 
+ * instrumented function, and a single event holding both timestamps is 
+ * written to the ring buffer of the thread that the scope exits on. This
+ * way, the scopes of a task which migrates between the workers (or gets
+ * suspended) mid-scope are still recorded whole. The name is resolved to an 
+ * ID once per call site. The PERF_PUSH/PERF_POP scopes (which may have 
+ * dynamic names) are compiled out.
+ */
+
+#define PERF_ENTER()                                                \
+    static int _perf_id = -1;                                       \
+    const uint64_t _perf_begin = Perf_EnterFast(&_perf_id, __func__)
+
+#define PERF_RETURN(...)                        \
+    do{                                         \
+        Perf_ExitFast(_perf_id, _perf_begin);   \
+        return (__VA_ARGS__);                   \
+    }while(0)
+
+#define PERF_RETURN_VOID()                      \
+    do{                                         \
+        Perf_ExitFast(_perf_id, _perf_begin);   \
+        return;                                 \
+    }while(0)
+
+#define PERF_PUSH(name)
+#define PERF_POP()
+#define PERF_POP_NAME(_ptr)
+
+#define PERF_COUNTER_ADD(name, delta)                   \
+    do{                                                 \
+        static int _perf_cid = -1;                      \
+        Perf_CounterAddFast(&_perf_cid, name, delta);   \
+    }while(0)
+
+#define PERF_COUNTER_ADD_ID(id, name, delta) \
+    Perf_CounterAddFast(id, name, delta)
+
 #else
 
 #define PERF_ENTER()
@@ -76,6 +127,8 @@
 #define PERF_PUSH(name)
 #define PERF_POP()
 #define PERF_POP_NAME(_ptr)
+#define PERF_COUNTER_ADD(name, delta)
+#define PERF_COUNTER_ADD_ID(id, name, delta)
 
 #endif
 
@@ -94,9 +147,111 @@ struct perf_info{
     }entries[];
 };
 
+struct perf_counter{
+    const char *name; /* borrowed */
+    int64_t     value;
+};
+
+/* Subsystems whose long-lived memory is accounted for. The GPU tags 
+ * track the (estimated) size of the storage backing the GL objects.
+ */
+enum perf_mem_tag{
+    PERF_MEM_NAV_FIELDCACHE,
+    PERF_MEM_PICKLE_STREAMS,
+    PERF_MEM_GPU_TEXTURES,
+    PERF_MEM_GPU_TEXTURE_ARRAYS,
+    PERF_MEM_GPU_BATCH_BUFFERS,
+    PERF_MEM_GPU_RINGBUFFERS,
+    PERF_MEM_TAG_COUNT
+};
+
+enum perf_bound{
+    PERF_BOUND_UNKNOWN,
+    PERF_BOUND_MAIN,    /* the simulation on the main thread and workers */
+    PERF_BOUND_RENDER,  /* the CPU-side work of the render thread */
+    PERF_BOUND_GPU,     /* the render thread was blocked on the GPU */
+};
+
+/* Breakdown of where the render thread spent its' time during a frame, 
+ * derived from the 'render.*_us' counters. The GPU time is only known 
+ * when GPU tracing is enabled. */
+struct perf_frame_stats{
+    double          frame_ms;
+    double          render_busy_ms;
+    double          render_idle_ms;
+    double          render_stall_ms;
+    double          render_swap_ms;
+    double          gpu_ms;
+    float           render_utilization;
+    enum perf_bound bound;
+};
+
+/* The argument of EVENT_PERF_BUDGET_EXCEEDED */
+struct perf_budget{
+    const char *name; /* borrowed */
+    double      budget_ms;
+    double      measured_ms;
+};
+
+struct perf_mem_stats{
+    const char *name; /* borrowed */
+    int64_t     bytes;
+    int64_t     count;
+    int64_t     high_water;
+};
+
 void     Perf_Push(const char *name);
 void     Perf_Pop(const char **out);
 
+/* Release instrumentation entry points. These don't take any locks and 
+ * don't do any hashing once the call site's ID has been assigned. The
+ * returned timestamp must be passed to the matching exit call.
+ */
+uint64_t Perf_EnterFast(int *id, const char *name);
+void     Perf_ExitFast(int id, uint64_t begin);
+
+/* Add 'delta' to the named counter for the current frame. The counters 
+ * are accumulated per-thread and summed up at the end of the frame. This
+ * looks up the name on every call. The PERF_COUNTER_ADD macro instead 
+ * resolves it to an ID once per call site, so its' name must be the same 
+ * for every call made from that site.
+ */
+void     Perf_CounterAdd(const char *name, int64_t delta);
+void     Perf_CounterAddFast(int *id, const char *name, int64_t delta);
+/* Hand the counters accumulated by the calling thread over to the next
+ * Perf_FinishTick. Once a thread calls this, only the published values
+ * are merged. The render thread does so after finishing every workspace,
+ * so that a frame's counters are not merged while it is still running.
+ */
+void     Perf_CounterPublish(void);
+/* Add the microseconds elapsed since 'begin_pc' (a SDL performance counter
+ * value) to the named counter. The stall variant is for time that the render
+ * thread spends blocked on the GPU (waiting on a fence, a readback or a 
+ * mapping) and additionally adds it to the 'render.stall_us' total. 
+ */
+void     Perf_CounterAddElapsed(const char *name, uint64_t begin_pc);
+void     Perf_RenderStall(const char *name, uint64_t begin_pc);
+
+/* Record the allocation, resizing or freeing of a block of memory owned by
+ * the subsystem with the specified tag. Unlike the rest of the profiling 
+ * facilities, the memory accounting is always enabled. These may be called
+ * from any thread and at any time.
+ */
+void     Perf_MemAlloc(enum perf_mem_tag tag, size_t bytes);
+void     Perf_MemRealloc(enum perf_mem_tag tag, size_t old_bytes, size_t new_bytes);
+void     Perf_MemFree(enum perf_mem_tag tag, size_t bytes);
+
+/* Merge a sampled callstack (ordered from the outermost to the innermost 
+ * scope) into the current frame's tree, under the innermost scope that 
+ * is currently pushed. Repeated samples of the same stack accumulate 
+ * 'pc_weight' into the same entries. 
+ */
+void     Perf_AddSample(size_t depth, const char **names, uint64_t pc_weight);
+/* Get the names of the scopes currently pushed on the calling thread, 
+ * starting from the outermost one. 
+ */
+size_t   Perf_CurrentStack(size_t maxout, const char **out);
+
 void     Perf_PushGPU(const char *name, uint32_t cookie);
 void     Perf_PopGPU(uint32_t cookie);
 
@@ -113,6 +268,17 @@ bool     Perf_IsRoot(void);
 /* This returns an array of perf_info structs (one for each thread). They
  * must be 'free'd by the caller. */
 size_t   Perf_Report(size_t maxout, struct perf_info **out);
+/* Returns the counters for the same frame as Perf_Report, sorted by name. 
+ */
+size_t   Perf_ReportCounters(size_t maxout, struct perf_counter *out);
+/* Returns the current number of bytes and blocks, as well as the high-water
+ * mark of the bytes, for every memory tag. 
+ */
+size_t   Perf_ReportMemory(size_t maxout, struct perf_mem_stats *out);
+/* Returns the render thread's time breakdown for the same frame as 
+ * Perf_Report, along with what the frame was most likely bound by. 
+ */
+void     Perf_ReportFrame(struct perf_frame_stats *out);
 uint32_t Perf_LastFrameMS(void);
 uint32_t Perf_CurrFrameMS(void);
 
@@ -124,5 +290,38 @@ bool     Perf_RegisterThread(SDL_threadID tid, const char *name);
 void     Perf_BeginTick(void);
 void     Perf_FinishTick(void);
 
+/* Stream the timing trees of the next 'nframes' frames to a file in the 
+ * Chrome trace event format (viewable in chrome://tracing or Perfetto).
+ * Every profiled scope (including the 'Task' scopes pushed by the 
+ * scheduler on every task switch) becomes a complete event on its' 
+ * thread's track, with the GPU timings on a separate track. In builds 
+ * with PERF_RELEASE instrumentation, the contents of the per-thread ring 
+ * buffers are written out every frame as well. The capture ends by itself 
+ * after 'nframes' or when Perf_CaptureEnd is called.
+ */
+bool     Perf_CaptureBegin(const char *path, int nframes);
+void     Perf_CaptureEnd(void);
+bool     Perf_CaptureActive(void);
+
+/* Keep the timing trees and counters of the last couple of seconds of
+ * frames around. Whenever a frame takes more than 'factor' times the
+ * average frame time of that history, the frames leading up to and 
+ * following it are written out in the same format as Perf_CaptureBegin,
+ * to files named '<prefix>_<N>.json'. 
+ */
+void     Perf_SpikeCaptureEnable(const char *prefix, float factor);
+void     Perf_SpikeCaptureDisable(void);
+
+/* Give the subsystem whose profiled scopes have names starting with 
+ * 'prefix' a per-frame time budget. The time spent in the outermost such
+ * scopes is summed over all the CPU threads for the same (buffered) frame 
+ * as Perf_Report. Whenever it goes over the budget, EVENT_PERF_BUDGET_EXCEEDED
+ * is posted, so that the subsystems and scripts can scale back their work.
+ * A budget of 0 removes the existing one. Like the rest of the timing trees,
+ * the measurements are only available in debug builds.
+ */
+bool     Perf_SetBudget(const char *prefix, double ms);
+size_t   Perf_ReportBudgets(size_t maxout, struct perf_budget *out);
+
 #endif
 
@@ -34,9 +34,498 @@
  */
 
 #include "pf_math.h"
+#include <SDL.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
+#if defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define PFM_SSE 1
+#endif
+
+#define BENCH_OPS   (1 << 20)
+
+/* A minimal set of 4-wide operations that the linear algebra routines are 
+ * written in terms of. Loads and stores are always unaligned, since many 
+ * callers pass in plain GLfloat arrays. With aligned types, these are as 
+ * fast as aligned accesses on any hardware we target.
+ */
+#if PFM_SSE
+typedef __m128 v4f_t;
+#define V4_LOAD(_p)         _mm_loadu_ps(_p)
+#define V4_STORE(_p, _v)    _mm_storeu_ps((_p), (_v))
+#define V4_SPLAT(_f)        _mm_set1_ps(_f)
+#define V4_LANE(_v, _i)     _mm_shuffle_ps((_v), (_v), _MM_SHUFFLE((_i), (_i), (_i), (_i)))
+#define V4_ADD(_a, _b)      _mm_add_ps((_a), (_b))
+#define V4_MUL(_a, _b)      _mm_mul_ps((_a), (_b))
+#endif
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void scalar_mat4x4_mult4x4(const mat4x4_t *op1, const mat4x4_t *op2, mat4x4_t *out)
+{
+    mat4x4_t ret;
+    for(int r = 0; r < 4; r++) {
+        for(int c = 0; c < 4; c++) {
+            ret.cols[c][r] = 0.0f;
+            for(int k = 0; k < 4; k++)
+                ret.cols[c][r] += op1->cols[k][r] * op2->cols[c][k]; 
+        }
+    }
+    *out = ret;
+}
+
+static void scalar_mat4x4_mult4x1(const mat4x4_t *op1, const vec4_t *op2, vec4_t *out)
+{
+    vec4_t ret;
+    for(int r = 0; r < 4; r++) {
+        ret.raw[r] = 0.0f;
+        for(int c = 0; c < 4; c++)
+            ret.raw[r] += op1->cols[c][r] * op2->raw[c];
+    }
+    *out = ret;
+}
+
+static void scalar_mat4x4_inverse(const mat4x4_t *in, mat4x4_t *out)
+{
+    double inv[16], det;
+    int i;
+
+    inv[0] = 
+        in->raw[5]  * in->raw[10] * in->raw[15] - 
+        in->raw[5]  * in->raw[11] * in->raw[14] - 
+        in->raw[9]  * in->raw[6]  * in->raw[15] + 
+        in->raw[9]  * in->raw[7]  * in->raw[14] +
+        in->raw[13] * in->raw[6]  * in->raw[11] - 
+        in->raw[13] * in->raw[7]  * in->raw[10];
+    
+    inv[4] = 
+       -in->raw[4]  * in->raw[10] * in->raw[15] + 
+        in->raw[4]  * in->raw[11] * in->raw[14] + 
+        in->raw[8]  * in->raw[6]  * in->raw[15] - 
+        in->raw[8]  * in->raw[7]  * in->raw[14] - 
+        in->raw[12] * in->raw[6]  * in->raw[11] + 
+        in->raw[12] * in->raw[7]  * in->raw[10];
+
+    inv[8] = 
+        in->raw[4]  * in->raw[9] * in->raw[15] - 
+        in->raw[4]  * in->raw[11] * in->raw[13] - 
+        in->raw[8]  * in->raw[5] * in->raw[15] + 
+        in->raw[8]  * in->raw[7] * in->raw[13] + 
+        in->raw[12] * in->raw[5] * in->raw[11] - 
+        in->raw[12] * in->raw[7] * in->raw[9];
+    
+    inv[12] = 
+       -in->raw[4]  * in->raw[9] * in->raw[14] + 
+        in->raw[4]  * in->raw[10] * in->raw[13] +
+        in->raw[8]  * in->raw[5] * in->raw[14] - 
+        in->raw[8]  * in->raw[6] * in->raw[13] - 
+        in->raw[12] * in->raw[5] * in->raw[10] + 
+        in->raw[12] * in->raw[6] * in->raw[9];
+    
+    inv[1] = 
+       -in->raw[1]  * in->raw[10] * in->raw[15] + 
+        in->raw[1]  * in->raw[11] * in->raw[14] + 
+        in->raw[9]  * in->raw[2] * in->raw[15] - 
+        in->raw[9]  * in->raw[3] * in->raw[14] - 
+        in->raw[13] * in->raw[2] * in->raw[11] + 
+        in->raw[13] * in->raw[3] * in->raw[10];
+    
+    inv[5] = 
+        in->raw[0]  * in->raw[10] * in->raw[15] - 
+        in->raw[0]  * in->raw[11] * in->raw[14] - 
+        in->raw[8]  * in->raw[2] * in->raw[15] + 
+        in->raw[8]  * in->raw[3] * in->raw[14] + 
+        in->raw[12] * in->raw[2] * in->raw[11] - 
+        in->raw[12] * in->raw[3] * in->raw[10];
+    
+    inv[9] = 
+       -in->raw[0]  * in->raw[9] * in->raw[15] + 
+        in->raw[0]  * in->raw[11] * in->raw[13] + 
+        in->raw[8]  * in->raw[1] * in->raw[15] - 
+        in->raw[8]  * in->raw[3] * in->raw[13] - 
+        in->raw[12] * in->raw[1] * in->raw[11] + 
+        in->raw[12] * in->raw[3] * in->raw[9];
+    
+    inv[13] = 
+        in->raw[0]  * in->raw[9] * in->raw[14] - 
+        in->raw[0]  * in->raw[10] * in->raw[13] - 
+        in->raw[8]  * in->raw[1] * in->raw[14] + 
+        in->raw[8]  * in->raw[2] * in->raw[13] + 
+        in->raw[12] * in->raw[1] * in->raw[10] - 
+        in->raw[12] * in->raw[2] * in->raw[9];
+    
+    inv[2] = 
+        in->raw[1]  * in->raw[6] * in->raw[15] - 
+        in->raw[1]  * in->raw[7] * in->raw[14] - 
+        in->raw[5]  * in->raw[2] * in->raw[15] + 
+        in->raw[5]  * in->raw[3] * in->raw[14] + 
+        in->raw[13] * in->raw[2] * in->raw[7] - 
+        in->raw[13] * in->raw[3] * in->raw[6];
+    
+    inv[6] = 
+       -in->raw[0]  * in->raw[6] * in->raw[15] + 
+        in->raw[0]  * in->raw[7] * in->raw[14] + 
+        in->raw[4]  * in->raw[2] * in->raw[15] - 
+        in->raw[4]  * in->raw[3] * in->raw[14] - 
+        in->raw[12] * in->raw[2] * in->raw[7] + 
+        in->raw[12] * in->raw[3] * in->raw[6];
+    
+    inv[10] = 
+        in->raw[0]  * in->raw[5] * in->raw[15] - 
+        in->raw[0]  * in->raw[7] * in->raw[13] - 
+        in->raw[4]  * in->raw[1] * in->raw[15] + 
+        in->raw[4]  * in->raw[3] * in->raw[13] + 
+        in->raw[12] * in->raw[1] * in->raw[7] - 
+        in->raw[12] * in->raw[3] * in->raw[5];
+    
+    inv[14] = 
+       -in->raw[0]  * in->raw[5] * in->raw[14] + 
+        in->raw[0]  * in->raw[6] * in->raw[13] + 
+        in->raw[4]  * in->raw[1] * in->raw[14] - 
+        in->raw[4]  * in->raw[2] * in->raw[13] - 
+        in->raw[12] * in->raw[1] * in->raw[6] + 
+        in->raw[12] * in->raw[2] * in->raw[5];
+    
+    inv[3] = 
+       -in->raw[1] * in->raw[6] * in->raw[11] + 
+        in->raw[1] * in->raw[7] * in->raw[10] + 
+        in->raw[5] * in->raw[2] * in->raw[11] - 
+        in->raw[5] * in->raw[3] * in->raw[10] - 
+        in->raw[9] * in->raw[2] * in->raw[7] + 
+        in->raw[9] * in->raw[3] * in->raw[6];
+    
+    inv[7] = 
+        in->raw[0] * in->raw[6] * in->raw[11] - 
+        in->raw[0] * in->raw[7] * in->raw[10] - 
+        in->raw[4] * in->raw[2] * in->raw[11] + 
+        in->raw[4] * in->raw[3] * in->raw[10] + 
+        in->raw[8] * in->raw[2] * in->raw[7] - 
+        in->raw[8] * in->raw[3] * in->raw[6];
+    
+    inv[11] = 
+       -in->raw[0] * in->raw[5] * in->raw[11] + 
+        in->raw[0] * in->raw[7] * in->raw[9] + 
+        in->raw[4] * in->raw[1] * in->raw[11] - 
+        in->raw[4] * in->raw[3] * in->raw[9] - 
+        in->raw[8] * in->raw[1] * in->raw[7] + 
+        in->raw[8] * in->raw[3] * in->raw[5];
+    
+    inv[15] = 
+        in->raw[0] * in->raw[5] * in->raw[10] - 
+        in->raw[0] * in->raw[6] * in->raw[9] - 
+        in->raw[4] * in->raw[1] * in->raw[10] + 
+        in->raw[4] * in->raw[2] * in->raw[9] + 
+        in->raw[8] * in->raw[1] * in->raw[6] - 
+        in->raw[8] * in->raw[2] * in->raw[5];
+    
+    det = in->raw[0] * inv[0] + in->raw[1] * inv[4] + in->raw[2] * inv[8] + in->raw[3] * inv[12];
+    assert(det != 0);
+    
+    det = 1.0 / det;
+    
+    for (i = 0; i < 16; i++)
+        out->raw[i] = inv[i] * det;
+}
+
+static void scalar_quat_mult_quat(const quat_t *op1, const quat_t *op2, quat_t *out)
+{
+    quat_t ret;
+    ret.x = ( op1->x * op2->w) + (op1->y * op2->z) - (op1->z * op2->y) + (op1->w * op2->x);
+    ret.y = (-op1->x * op2->z) + (op1->y * op2->w) + (op1->z * op2->x) + (op1->w * op2->y);
+    ret.z = ( op1->x * op2->y) - (op1->y * op2->x) + (op1->z * op2->w) + (op1->w * op2->z);
+    ret.w = (-op1->x * op2->x) - (op1->y * op2->y) - (op1->z * op2->z) + (op1->w * op2->w);
+    *out = ret;
+}
+
+#if PFM_SSE
+
+/* The vector formed by weighting columns c0-c3 by the 4 components of w */
+static inline v4f_t v4_lincomb(v4f_t c0, v4f_t c1, v4f_t c2, v4f_t c3, const GLfloat w[4])
+{
+    v4f_t weights = V4_LOAD(w);
+    v4f_t ret = V4_MUL(c0, V4_LANE(weights, 0));
+    ret = V4_ADD(ret, V4_MUL(c1, V4_LANE(weights, 1)));
+    ret = V4_ADD(ret, V4_MUL(c2, V4_LANE(weights, 2)));
+    ret = V4_ADD(ret, V4_MUL(c3, V4_LANE(weights, 3)));
+    return ret;
+}
+
+static void simd_mat4x4_mult4x4(const mat4x4_t *op1, const mat4x4_t *op2, mat4x4_t *out)
+{
+    v4f_t a0 = V4_LOAD(op1->cols[0]);
+    v4f_t a1 = V4_LOAD(op1->cols[1]);
+    v4f_t a2 = V4_LOAD(op1->cols[2]);
+    v4f_t a3 = V4_LOAD(op1->cols[3]);
+
+    /* Every result column must be computed before the first store, 
+     * as 'out' may alias either operand */
+    v4f_t r0 = v4_lincomb(a0, a1, a2, a3, op2->cols[0]);
+    v4f_t r1 = v4_lincomb(a0, a1, a2, a3, op2->cols[1]);
+    v4f_t r2 = v4_lincomb(a0, a1, a2, a3, op2->cols[2]);
+    v4f_t r3 = v4_lincomb(a0, a1, a2, a3, op2->cols[3]);
+
+    V4_STORE(out->cols[0], r0);
+    V4_STORE(out->cols[1], r1);
+    V4_STORE(out->cols[2], r2);
+    V4_STORE(out->cols[3], r3);
+}
+
+static void simd_mat4x4_mult4x1(const mat4x4_t *op1, const vec4_t *op2, vec4_t *out)
+{
+    v4f_t a0 = V4_LOAD(op1->cols[0]);
+    v4f_t a1 = V4_LOAD(op1->cols[1]);
+    v4f_t a2 = V4_LOAD(op1->cols[2]);
+    v4f_t a3 = V4_LOAD(op1->cols[3]);
+    V4_STORE(out->raw, v4_lincomb(a0, a1, a2, a3, op2->raw));
+}
+
+#define SHUFFLE(_a, _b, _x, _y, _z, _w) \
+    _mm_shuffle_ps((_a), (_b), _MM_SHUFFLE((_w), (_z), (_y), (_x)))
+#define SWIZZLE(_v, _x, _y, _z, _w) \
+    SHUFFLE((_v), (_v), (_x), (_y), (_z), (_w))
+
+/* 2x2 matrices are packed as (m00, m01, m10, m11) */
+
+/* A * B */
+static inline __m128 mat2_mul(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, SWIZZLE(b, 0, 3, 0, 3)),
+                      _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+/* adj(A) * B */
+static inline __m128 mat2_adj_mul(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(SWIZZLE(a, 3, 3, 0, 0), b),
+                      _mm_mul_ps(SWIZZLE(a, 1, 1, 2, 2), SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+/* A * adj(B) */
+static inline __m128 mat2_mul_adj(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 3, 0, 3, 0)),
+                      _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+/* Blockwise inversion, treating the matrix as a 2x2 matrix of 2x2 blocks:
+ *
+ *     M = | A B |    inv(M) = 1/|M| * | X Y |
+ *         | C D |                     | Z W |
+ *
+ * The columns are treated as rows, which is fine since the inverse of 
+ * the transpose is the transpose of the inverse.
+ */
+static void sse_mat4x4_inverse(const mat4x4_t *in, mat4x4_t *out)
+{
+    __m128 c0 = _mm_loadu_ps(in->cols[0]);
+    __m128 c1 = _mm_loadu_ps(in->cols[1]);
+    __m128 c2 = _mm_loadu_ps(in->cols[2]);
+    __m128 c3 = _mm_loadu_ps(in->cols[3]);
+
+    __m128 A = _mm_movelh_ps(c0, c1);
+    __m128 B = _mm_movehl_ps(c1, c0);
+    __m128 C = _mm_movelh_ps(c2, c3);
+    __m128 D = _mm_movehl_ps(c3, c2);
+
+    /* (|A|, |B|, |C|, |D|) */
+    __m128 det_sub = _mm_sub_ps(
+        _mm_mul_ps(SHUFFLE(c0, c2, 0, 2, 0, 2), SHUFFLE(c1, c3, 1, 3, 1, 3)),
+        _mm_mul_ps(SHUFFLE(c0, c2, 1, 3, 1, 3), SHUFFLE(c1, c3, 0, 2, 0, 2)));
+    __m128 det_a = SWIZZLE(det_sub, 0, 0, 0, 0);
+    __m128 det_b = SWIZZLE(det_sub, 1, 1, 1, 1);
+    __m128 det_c = SWIZZLE(det_sub, 2, 2, 2, 2);
+    __m128 det_d = SWIZZLE(det_sub, 3, 3, 3, 3);
+
+    __m128 d_c = mat2_adj_mul(D, C);
+    __m128 a_b = mat2_adj_mul(A, B);
+
+    /* adj(X) = |D|A - B(adj(D)C), adj(W) = |A|D - C(adj(A)B) */
+    __m128 x = _mm_sub_ps(_mm_mul_ps(det_d, A), mat2_mul(B, d_c));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(det_a, D), mat2_mul(C, a_b));
+    /* adj(Y) = |B|C - D(adj(adj(A)B)), adj(Z) = |C|B - A(adj(adj(D)C)) */
+    __m128 y = _mm_sub_ps(_mm_mul_ps(det_b, C), mat2_mul_adj(D, a_b));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(det_c, B), mat2_mul_adj(A, d_c));
+
+    /* |M| = |A||D| + |B||C| - tr((adj(A)B)(adj(D)C)) */
+    __m128 tr = _mm_mul_ps(a_b, SWIZZLE(d_c, 0, 2, 1, 3));
+    tr = _mm_add_ps(tr, SWIZZLE(tr, 2, 3, 0, 1));
+    tr = _mm_add_ps(tr, SWIZZLE(tr, 1, 0, 3, 2));
+    __m128 det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+    det = _mm_sub_ps(det, tr);
+    assert(_mm_cvtss_f32(det) != 0);
+
+    __m128 rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    x = _mm_mul_ps(x, rdet);
+    y = _mm_mul_ps(y, rdet);
+    z = _mm_mul_ps(z, rdet);
+    w = _mm_mul_ps(w, rdet);
+
+    /* Undo the adjugates while re-assembling the columns */
+    _mm_storeu_ps(out->cols[0], SHUFFLE(x, y, 3, 1, 3, 1));
+    _mm_storeu_ps(out->cols[1], SHUFFLE(x, y, 2, 0, 2, 0));
+    _mm_storeu_ps(out->cols[2], SHUFFLE(z, w, 3, 1, 3, 1));
+    _mm_storeu_ps(out->cols[3], SHUFFLE(z, w, 2, 0, 2, 0));
+}
+
+static void sse_quat_mult_quat(const quat_t *op1, const quat_t *op2, quat_t *out)
+{
+    __m128 b = _mm_loadu_ps(op2->raw);
+
+    __m128 ret = _mm_mul_ps(_mm_set1_ps(op1->w), b);
+    ret = _mm_add_ps(ret, _mm_mul_ps(_mm_set1_ps(op1->x), 
+        _mm_mul_ps(SWIZZLE(b, 3, 2, 1, 0), _mm_setr_ps(1.0f, -1.0f, 1.0f, -1.0f))));
+    ret = _mm_add_ps(ret, _mm_mul_ps(_mm_set1_ps(op1->y), 
+        _mm_mul_ps(SWIZZLE(b, 2, 3, 0, 1), _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f))));
+    ret = _mm_add_ps(ret, _mm_mul_ps(_mm_set1_ps(op1->z), 
+        _mm_mul_ps(SWIZZLE(b, 1, 0, 3, 2), _mm_setr_ps(-1.0f, 1.0f, 1.0f, -1.0f))));
+
+    _mm_storeu_ps(out->raw, ret);
+}
+
+static void sse_quat_normal(const quat_t *op1, quat_t *out)
+{
+    __m128 q = _mm_loadu_ps(op1->raw);
+    __m128 sq = _mm_mul_ps(q, q);
+    sq = _mm_add_ps(sq, SWIZZLE(sq, 2, 3, 0, 1));
+    sq = _mm_add_ps(sq, SWIZZLE(sq, 1, 0, 3, 2));
+    _mm_storeu_ps(out->raw, _mm_div_ps(q, _mm_sqrt_ps(sq)));
+}
+
+#endif
+
+static void scalar_mat4x4_mult4x4_batch(const mat4x4_t *op1, const mat4x4_t *op2, 
+                                        size_t n, mat4x4_t *out)
+{
+    for(size_t i = 0; i < n; i++) {
+        scalar_mat4x4_mult4x4(op1, op2 + i, out + i);
+    }
+}
+
+static void scalar_mat4x4_mult4x1_batch(const mat4x4_t *op1, const vec4_t *op2, 
+                                        size_t n, vec4_t *out)
+{
+    for(size_t i = 0; i < n; i++) {
+        scalar_mat4x4_mult4x1(op1, op2 + i, out + i);
+    }
+}
+
+static void bench_mult4x4(const mat4x4_t *op1, const mat4x4_t *op2, mat4x4_t *out)
+{
+    PFM_Mat4x4_Mult4x4((mat4x4_t*)op1, (mat4x4_t*)op2, out);
+}
+
+static void bench_mult4x1(const mat4x4_t *op1, const vec4_t *op2, vec4_t *out)
+{
+    PFM_Mat4x4_Mult4x1((mat4x4_t*)op1, (vec4_t*)op2, out);
+}
+
+static void bench_inverse(const mat4x4_t *in, mat4x4_t *out)
+{
+    PFM_Mat4x4_Inverse((mat4x4_t*)in, out);
+}
+
+static void bench_quat_mult(const quat_t *op1, const quat_t *op2, quat_t *out)
+{
+    PFM_Quat_MultQuat((quat_t*)op1, (quat_t*)op2, out);
+}
+
+struct bench_ops{
+    void (*mult4x4)(const mat4x4_t*, const mat4x4_t*, mat4x4_t*);
+    void (*mult4x1)(const mat4x4_t*, const vec4_t*, vec4_t*);
+    void (*inverse)(const mat4x4_t*, mat4x4_t*);
+    void (*quat_mult)(const quat_t*, const quat_t*, quat_t*);
+    void (*mult4x4_batch)(const mat4x4_t*, const mat4x4_t*, size_t, mat4x4_t*);
+    void (*mult4x1_batch)(const mat4x4_t*, const vec4_t*, size_t, vec4_t*);
+};
+
+static double bench_ms(uint64_t begin)
+{
+    return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+/* The inputs are model matrices, points and rotations like the ones we 
+ * deal with every frame. All of the matrices are invertible.
+ */
+static void bench_fill(size_t n, mat4x4_t *mats, vec4_t *points, quat_t *quats)
+{
+    for(size_t i = 0; i < n; i++) {
+        mat4x4_t scale, rot, trans, tmp;
+        float angle = (float)i / n * 2.0f * M_PI;
+        PFM_Mat4x4_MakeScale(1.0f + (i % 3), 1.0f + (i % 5), 1.0f + (i % 7), &scale);
+        PFM_Mat4x4_RotFromEuler(RAD_TO_DEG(angle), RAD_TO_DEG(angle / 2.0f), 0.0f, &rot);
+        PFM_Mat4x4_MakeTrans(i % 101, i % 13, i % 37, &trans);
+        scalar_mat4x4_mult4x4(&rot, &scale, &tmp);
+        scalar_mat4x4_mult4x4(&trans, &tmp, &mats[i]);
+
+        points[i] = (vec4_t){cosf(angle) * 64.0f, i % 17, sinf(angle) * 64.0f, 1.0f};
+        quats[i] = (quat_t){sinf(angle / 2.0f), 0.0f, 0.0f, cosf(angle / 2.0f)};
+    }
+}
+
+static void bench_run(const struct bench_ops *ops, size_t n, int nrounds, 
+                      const mat4x4_t *mats, const vec4_t *points, const quat_t *quats,
+                      mat4x4_t *out_mats, vec4_t *out_points, quat_t *out_quats,
+                      struct pfm_bench_result *out)
+{
+    float checksum = 0.0f;
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            ops->mult4x4(&mats[i], &mats[n - 1 - i], &out_mats[i]);
+        }
+        checksum += out_mats[r % n].m0;
+    }
+    out->mult4x4_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            ops->mult4x1(&mats[n - 1 - i], &points[i], &out_points[i]);
+        }
+        checksum += out_points[r % n].x;
+    }
+    out->mult4x1_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            ops->inverse(&mats[i], &out_mats[i]);
+        }
+        checksum += out_mats[r % n].m0;
+    }
+    out->inverse_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        for(size_t i = 0; i < n; i++) {
+            ops->quat_mult(&quats[n - 1 - i], &quats[i], &out_quats[i]);
+        }
+        checksum += out_quats[r % n].w;
+    }
+    out->quat_mult_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        ops->mult4x4_batch(&mats[r % n], mats, n, out_mats);
+        checksum += out_mats[r % n].m0;
+    }
+    out->mult4x4_batch_ms = bench_ms(begin);
+
+    begin = SDL_GetPerformanceCounter();
+    for(int r = 0; r < nrounds; r++) {
+        ops->mult4x1_batch(&mats[r % n], points, n, out_points);
+        checksum += out_points[r % n].x;
+    }
+    out->mult4x1_batch_ms = bench_ms(begin);
+
+    out->checksum = checksum;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -227,22 +716,65 @@ void PFM_Mat4x4_Scale(mat4x4_t *op1, GLfloat scale, mat4x4_t *out)
 
 void PFM_Mat4x4_Mult4x4 (mat4x4_t *op1, mat4x4_t *op2, mat4x4_t *out)
 {
-    for(int r = 0; r < 4; r++) {
-        for(int c = 0; c < 4; c++) {
-            out->cols[c][r] = 0.0f;
-            for(int k = 0; k < 4; k++)
-                out->cols[c][r] += op1->cols[k][r] * op2->cols[c][k]; 
-        }
-    }
+#if PFM_SSE
+    simd_mat4x4_mult4x4(op1, op2, out);
+#else
+    scalar_mat4x4_mult4x4(op1, op2, out);
+#endif
 }
 
 void PFM_Mat4x4_Mult4x1(mat4x4_t *op1, vec4_t *op2, vec4_t *out)
 {
-    for(int r = 0; r < 4; r++) {
-        out->raw[r] = 0.0f;
-        for(int c = 0; c < 4; c++)
-            out->raw[r] += op1->cols[c][r] * op2->raw[c];
+#if PFM_SSE
+    simd_mat4x4_mult4x1(op1, op2, out);
+#else
+    scalar_mat4x4_mult4x1(op1, op2, out);
+#endif
+}
+
+void PFM_Mat4x4_Mult4x4Batch(const mat4x4_t *op1, const mat4x4_t *op2, size_t n, mat4x4_t *out)
+{
+#if PFM_SSE
+    v4f_t a0 = V4_LOAD(op1->cols[0]);
+    v4f_t a1 = V4_LOAD(op1->cols[1]);
+    v4f_t a2 = V4_LOAD(op1->cols[2]);
+    v4f_t a3 = V4_LOAD(op1->cols[3]);
+
+    for(size_t i = 0; i < n; i++) {
+        v4f_t r0 = v4_lincomb(a0, a1, a2, a3, op2[i].cols[0]);
+        v4f_t r1 = v4_lincomb(a0, a1, a2, a3, op2[i].cols[1]);
+        v4f_t r2 = v4_lincomb(a0, a1, a2, a3, op2[i].cols[2]);
+        v4f_t r3 = v4_lincomb(a0, a1, a2, a3, op2[i].cols[3]);
+        V4_STORE(out[i].cols[0], r0);
+        V4_STORE(out[i].cols[1], r1);
+        V4_STORE(out[i].cols[2], r2);
+        V4_STORE(out[i].cols[3], r3);
     }
+#else
+    mat4x4_t lhs = *op1;
+    for(size_t i = 0; i < n; i++) {
+        scalar_mat4x4_mult4x4(&lhs, op2 + i, out + i);
+    }
+#endif
+}
+
+void PFM_Mat4x4_Mult4x1Batch(const mat4x4_t *op1, const vec4_t *op2, size_t n, vec4_t *out)
+{
+#if PFM_SSE
+    v4f_t a0 = V4_LOAD(op1->cols[0]);
+    v4f_t a1 = V4_LOAD(op1->cols[1]);
+    v4f_t a2 = V4_LOAD(op1->cols[2]);
+    v4f_t a3 = V4_LOAD(op1->cols[3]);
+
+    for(size_t i = 0; i < n; i++) {
+        V4_STORE(out[i].raw, v4_lincomb(a0, a1, a2, a3, op2[i].raw));
+    }
+#else
+    mat4x4_t lhs = *op1;
+    for(size_t i = 0; i < n; i++) {
+        scalar_mat4x4_mult4x1(&lhs, op2 + i, out + i);
+    }
+#endif
 }
 
 void PFM_Mat4x4_Identity(mat4x4_t *out)
@@ -400,144 +932,11 @@ void PFM_Mat4x4_MakeLookAt(vec3_t *camera_pos, vec3_t *target_pos,
 /* Implementation derived from Mesa 3D implementation */
 void PFM_Mat4x4_Inverse(mat4x4_t *in, mat4x4_t *out)
 {
-    double inv[16], det;
-    int i;
-
-    inv[0] = 
-        in->raw[5]  * in->raw[10] * in->raw[15] - 
-        in->raw[5]  * in->raw[11] * in->raw[14] - 
-        in->raw[9]  * in->raw[6]  * in->raw[15] + 
-        in->raw[9]  * in->raw[7]  * in->raw[14] +
-        in->raw[13] * in->raw[6]  * in->raw[11] - 
-        in->raw[13] * in->raw[7]  * in->raw[10];
-    
-    inv[4] = 
-       -in->raw[4]  * in->raw[10] * in->raw[15] + 
-        in->raw[4]  * in->raw[11] * in->raw[14] + 
-        in->raw[8]  * in->raw[6]  * in->raw[15] - 
-        in->raw[8]  * in->raw[7]  * in->raw[14] - 
-        in->raw[12] * in->raw[6]  * in->raw[11] + 
-        in->raw[12] * in->raw[7]  * in->raw[10];
-
-    inv[8] = 
-        in->raw[4]  * in->raw[9] * in->raw[15] - 
-        in->raw[4]  * in->raw[11] * in->raw[13] - 
-        in->raw[8]  * in->raw[5] * in->raw[15] + 
-        in->raw[8]  * in->raw[7] * in->raw[13] + 
-        in->raw[12] * in->raw[5] * in->raw[11] - 
-        in->raw[12] * in->raw[7] * in->raw[9];
-    
-    inv[12] = 
-       -in->raw[4]  * in->raw[9] * in->raw[14] + 
-        in->raw[4]  * in->raw[10] * in->raw[13] +
-        in->raw[8]  * in->raw[5] * in->raw[14] - 
-        in->raw[8]  * in->raw[6] * in->raw[13] - 
-        in->raw[12] * in->raw[5] * in->raw[10] + 
-        in->raw[12] * in->raw[6] * in->raw[9];
-    
-    inv[1] = 
-       -in->raw[1]  * in->raw[10] * in->raw[15] + 
-        in->raw[1]  * in->raw[11] * in->raw[14] + 
-        in->raw[9]  * in->raw[2] * in->raw[15] - 
-        in->raw[9]  * in->raw[3] * in->raw[14] - 
-        in->raw[13] * in->raw[2] * in->raw[11] + 
-        in->raw[13] * in->raw[3] * in->raw[10];
-    
-    inv[5] = 
-        in->raw[0]  * in->raw[10] * in->raw[15] - 
-        in->raw[0]  * in->raw[11] * in->raw[14] - 
-        in->raw[8]  * in->raw[2] * in->raw[15] + 
-        in->raw[8]  * in->raw[3] * in->raw[14] + 
-        in->raw[12] * in->raw[2] * in->raw[11] - 
-        in->raw[12] * in->raw[3] * in->raw[10];
-    
-    inv[9] = 
-       -in->raw[0]  * in->raw[9] * in->raw[15] + 
-        in->raw[0]  * in->raw[11] * in->raw[13] + 
-        in->raw[8]  * in->raw[1] * in->raw[15] - 
-        in->raw[8]  * in->raw[3] * in->raw[13] - 
-        in->raw[12] * in->raw[1] * in->raw[11] + 
-        in->raw[12] * in->raw[3] * in->raw[9];
-    
-    inv[13] = 
-        in->raw[0]  * in->raw[9] * in->raw[14] - 
-        in->raw[0]  * in->raw[10] * in->raw[13] - 
-        in->raw[8]  * in->raw[1] * in->raw[14] + 
-        in->raw[8]  * in->raw[2] * in->raw[13] + 
-        in->raw[12] * in->raw[1] * in->raw[10] - 
-        in->raw[12] * in->raw[2] * in->raw[9];
-    
-    inv[2] = 
-        in->raw[1]  * in->raw[6] * in->raw[15] - 
-        in->raw[1]  * in->raw[7] * in->raw[14] - 
-        in->raw[5]  * in->raw[2] * in->raw[15] + 
-        in->raw[5]  * in->raw[3] * in->raw[14] + 
-        in->raw[13] * in->raw[2] * in->raw[7] - 
-        in->raw[13] * in->raw[3] * in->raw[6];
-    
-    inv[6] = 
-       -in->raw[0]  * in->raw[6] * in->raw[15] + 
-        in->raw[0]  * in->raw[7] * in->raw[14] + 
-        in->raw[4]  * in->raw[2] * in->raw[15] - 
-        in->raw[4]  * in->raw[3] * in->raw[14] - 
-        in->raw[12] * in->raw[2] * in->raw[7] + 
-        in->raw[12] * in->raw[3] * in->raw[6];
-    
-    inv[10] = 
-        in->raw[0]  * in->raw[5] * in->raw[15] - 
-        in->raw[0]  * in->raw[7] * in->raw[13] - 
-        in->raw[4]  * in->raw[1] * in->raw[15] + 
-        in->raw[4]  * in->raw[3] * in->raw[13] + 
-        in->raw[12] * in->raw[1] * in->raw[7] - 
-        in->raw[12] * in->raw[3] * in->raw[5];
-    
-    inv[14] = 
-       -in->raw[0]  * in->raw[5] * in->raw[14] + 
-        in->raw[0]  * in->raw[6] * in->raw[13] + 
-        in->raw[4]  * in->raw[1] * in->raw[14] - 
-        in->raw[4]  * in->raw[2] * in->raw[13] - 
-        in->raw[12] * in->raw[1] * in->raw[6] + 
-        in->raw[12] * in->raw[2] * in->raw[5];
-    
-    inv[3] = 
-       -in->raw[1] * in->raw[6] * in->raw[11] + 
-        in->raw[1] * in->raw[7] * in->raw[10] + 
-        in->raw[5] * in->raw[2] * in->raw[11] - 
-        in->raw[5] * in->raw[3] * in->raw[10] - 
-        in->raw[9] * in->raw[2] * in->raw[7] + 
-        in->raw[9] * in->raw[3] * in->raw[6];
-    
-    inv[7] = 
-        in->raw[0] * in->raw[6] * in->raw[11] - 
-        in->raw[0] * in->raw[7] * in->raw[10] - 
-        in->raw[4] * in->raw[2] * in->raw[11] + 
-        in->raw[4] * in->raw[3] * in->raw[10] + 
-        in->raw[8] * in->raw[2] * in->raw[7] - 
-        in->raw[8] * in->raw[3] * in->raw[6];
-    
-    inv[11] = 
-       -in->raw[0] * in->raw[5] * in->raw[11] + 
-        in->raw[0] * in->raw[7] * in->raw[9] + 
-        in->raw[4] * in->raw[1] * in->raw[11] - 
-        in->raw[4] * in->raw[3] * in->raw[9] - 
-        in->raw[8] * in->raw[1] * in->raw[7] + 
-        in->raw[8] * in->raw[3] * in->raw[5];
-    
-    inv[15] = 
-        in->raw[0] * in->raw[5] * in->raw[10] - 
-        in->raw[0] * in->raw[6] * in->raw[9] - 
-        in->raw[4] * in->raw[1] * in->raw[10] + 
-        in->raw[4] * in->raw[2] * in->raw[9] + 
-        in->raw[8] * in->raw[1] * in->raw[6] - 
-        in->raw[8] * in->raw[2] * in->raw[5];
-    
-    det = in->raw[0] * inv[0] + in->raw[1] * inv[4] + in->raw[2] * inv[8] + in->raw[3] * inv[12];
-    assert(det != 0);
-    
-    det = 1.0 / det;
-    
-    for (i = 0; i < 16; i++)
-        out->raw[i] = inv[i] * det;
+#if PFM_SSE
+    sse_mat4x4_inverse(in, out);
+#else
+    scalar_mat4x4_inverse(in, out);
+#endif
 }
 
 void PFM_Mat4x4_Transpose(mat4x4_t *in, mat4x4_t *out)
@@ -624,14 +1023,18 @@ void PFM_Quat_ToEuler(quat_t *q, float *out_roll, float *out_pitch, float *out_y
 
 void PFM_Quat_MultQuat(quat_t *op1, quat_t *op2, quat_t *out)
 {
-    out->x = ( op1->x * op2->w) + (op1->y * op2->z) - (op1->z * op2->y) + (op1->w * op2->x);
-    out->y = (-op1->x * op2->z) + (op1->y * op2->w) + (op1->z * op2->x) + (op1->w * op2->y);
-    out->z = ( op1->x * op2->y) - (op1->y * op2->x) + (op1->z * op2->w) + (op1->w * op2->z);
-    out->w = (-op1->x * op2->x) - (op1->y * op2->y) - (op1->z * op2->z) + (op1->w * op2->w);
+#if PFM_SSE
+    sse_quat_mult_quat(op1, op2, out);
+#else
+    scalar_quat_mult_quat(op1, op2, out);
+#endif
 }
 
 void PFM_Quat_Normal(quat_t *op1, quat_t *out)
 {
+#if PFM_SSE
+    sse_quat_normal(op1, out);
+#else
     GLfloat len = sqrt(
          op1->x * op1->x 
        + op1->y * op1->y
@@ -642,6 +1045,7 @@ void PFM_Quat_Normal(quat_t *op1, quat_t *out)
     out->y = op1->y / len;
     out->z = op1->z / len;
     out->w = op1->w / len;
+#endif
 }
 
 void PFM_Quat_Inverse(quat_t *op1, quat_t *out)
@@ -700,3 +1104,49 @@ GLfloat PFM_BilinearInterp(GLfloat q11, GLfloat q12, GLfloat q21, GLfloat q22,
     );
 }
 
+
+void PFM_Benchmark(size_t n, struct pfm_bench_result out[2])
+{
+    memset(out, 0, 2 * sizeof(struct pfm_bench_result));
+    if(n == 0)
+        return;
+
+    mat4x4_t *mats = malloc(2 * n * sizeof(mat4x4_t));
+    vec4_t *points = malloc(2 * n * sizeof(vec4_t));
+    quat_t *quats = malloc(2 * n * sizeof(quat_t));
+    if(!mats || !points || !quats)
+        goto out;
+
+    int nrounds = BENCH_OPS / n;
+    if(nrounds == 0)
+        nrounds = 1;
+    bench_fill(n, mats, points, quats);
+
+    const struct bench_ops scalar_ops = {
+        .mult4x4 = scalar_mat4x4_mult4x4,
+        .mult4x1 = scalar_mat4x4_mult4x1,
+        .inverse = scalar_mat4x4_inverse,
+        .quat_mult = scalar_quat_mult_quat,
+        .mult4x4_batch = scalar_mat4x4_mult4x4_batch,
+        .mult4x1_batch = scalar_mat4x4_mult4x1_batch,
+    };
+    const struct bench_ops simd_ops = {
+        .mult4x4 = bench_mult4x4,
+        .mult4x1 = bench_mult4x1,
+        .inverse = bench_inverse,
+        .quat_mult = bench_quat_mult,
+        .mult4x4_batch = PFM_Mat4x4_Mult4x4Batch,
+        .mult4x1_batch = PFM_Mat4x4_Mult4x1Batch,
+    };
+
+    bench_run(&scalar_ops, n, nrounds, mats, points, quats, 
+        mats + n, points + n, quats + n, &out[PFM_BENCH_SCALAR]);
+    bench_run(&simd_ops, n, nrounds, mats, points, quats, 
+        mats + n, points + n, quats + n, &out[PFM_BENCH_SIMD]);
+
+out:
+    free(mats);
+    free(points);
+    free(quats);
+}
+
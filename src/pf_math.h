@@ -38,6 +38,7 @@
 
 #include <GL/glew.h> /* GLfloat definition */
 #include <stdio.h>   /* FILE definition    */
+#include <stddef.h>  /* size_t definition  */
 #ifndef _USE_MATH_DEFINES
     #define _USE_MATH_DEFINES
 #endif
@@ -49,6 +50,21 @@
 #define DEG_TO_RAD(_deg) ((_deg)*(M_PI/180.0f))
 #define RAD_TO_DEG(_rad) ((_rad)*(180.0f/M_PI))
 
+/* Building with PFM_ALIGNED defined aligns the 4-component vector and the 
+ * matrix types to 16 bytes, so that the SIMD routines never have to load 
+ * across a cache line boundary. This changes the layout of any structure 
+ * embedding them.
+ */
+#if defined(PFM_ALIGNED)
+    #if defined(_MSC_VER)
+        #define PFM_ALIGN16 __declspec(align(16))
+    #else
+        #define PFM_ALIGN16 __attribute__((aligned(16)))
+    #endif
+#else
+    #define PFM_ALIGN16
+#endif
+
 typedef union vec2{
     GLfloat raw[2];
     struct{
@@ -67,7 +83,7 @@ typedef union vec3{
 }vec3_t;
 
 typedef union vec4{
-    GLfloat raw[4];
+    PFM_ALIGN16 GLfloat raw[4];
     struct{
         GLfloat x, y, z, w; 
     };
@@ -86,7 +102,7 @@ typedef union mat3x3{
 }mat3x3_t;
 
 typedef union mat4x4{
-    GLfloat raw[16];
+    PFM_ALIGN16 GLfloat raw[16];
     GLfloat cols[4][4];
     struct{
         GLfloat m0, m1, m2, m3,
@@ -150,6 +166,11 @@ void    PFM_Mat3x3_Identity(mat3x3_t *out);
 void    PFM_Mat4x4_Scale   (mat4x4_t *op1, GLfloat scale, mat4x4_t *out);
 void    PFM_Mat4x4_Mult4x4 (mat4x4_t *op1, mat4x4_t *op2, mat4x4_t *out);
 void    PFM_Mat4x4_Mult4x1 (mat4x4_t *op1, vec4_t   *op2, vec4_t   *out);
+/* out[i] = op1 * op2[i] for each of the n operands */
+void    PFM_Mat4x4_Mult4x4Batch(const mat4x4_t *op1, const mat4x4_t *op2, 
+                                size_t n, mat4x4_t *out);
+void    PFM_Mat4x4_Mult4x1Batch(const mat4x4_t *op1, const vec4_t *op2, 
+                                size_t n, vec4_t *out);
 void    PFM_Mat4x4_Identity(mat4x4_t *out);
 
 void    PFM_Mat4x4_MakeScale   (GLfloat s1, GLfloat s2, GLfloat s3, mat4x4_t *out);
@@ -190,4 +211,23 @@ GLfloat PFM_BilinearInterp(GLfloat q11, GLfloat q12, GLfloat q21, GLfloat q22,
                            GLfloat x1,  GLfloat x2,  GLfloat y1,  GLfloat y2,
                            GLfloat x,   GLfloat y);
 
+struct pfm_bench_result{
+    double mult4x4_ms;
+    double mult4x1_ms;
+    double inverse_ms;
+    double quat_mult_ms;
+    double mult4x4_batch_ms;
+    double mult4x1_batch_ms;
+    float  checksum;
+};
+
+enum{
+    PFM_BENCH_SCALAR,
+    PFM_BENCH_SIMD,
+};
+
+/* Times the same workload of matrix and quaternion operations with the 
+ * reference scalar routines and with the ones the API dispatches to */
+void    PFM_Benchmark(size_t n, struct pfm_bench_result out[2]);
+
 #endif
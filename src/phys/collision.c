@@ -36,6 +36,20 @@
 #include "public/collision.h"
 #include <assert.h>
 #include <float.h>
+#include <math.h>
+#include <SDL.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) \
+ || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLLISION_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
 
 #define MIN(a, b)     ((a) < (b) ? (a) : (b))
 #define MAX(a, b)     ((a) > (b) ? (a) : (b))
@@ -56,6 +70,23 @@ struct range{
     float begin, end;
 };
 
+/* The frustum planes in (nx, ny, nz, d) form, where d = -dot(n, point) */
+typedef float plane_eqs_t[6][4];
+
+/* A line segment as an origin and an unnormalized direction, such that the 
+ * segment spans ray parameters [0, 1] */
+struct seg_eq{
+    float origin[3];
+    float dir[3];
+    float parallel_eps2; /* squared slab parallel threshold, scaled by |dir|^2 */
+};
+
+typedef void (*obb_batch_kernel_t)(const plane_eqs_t, const struct obb_soa*, size_t, size_t, bool*);
+typedef void (*seg_batch_kernel_t)(const struct seg_eq*, const struct obb_soa*, size_t, size_t, bool*);
+
+static obb_batch_kernel_t s_obb_batch_kernel;
+static seg_batch_kernel_t s_seg_batch_kernel;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -206,6 +237,297 @@ static bool separating_axis_exists(vec3_t axis, const struct frustum *frustum, c
     return !ranges_overlap(&frust_range, &cuboid_range);
 }
 
+static void frustum_plane_eqs(const struct frustum *frustum, plane_eqs_t out)
+{
+    const struct plane *planes[] = {&frustum->top, &frustum->bot, &frustum->left, 
+                                    &frustum->right, &frustum->nearp, &frustum->farp};
+
+    for(int i = 0; i < ARR_SIZE(planes); i++) {
+        out[i][0] = planes[i]->normal.x;
+        out[i][1] = planes[i]->normal.y;
+        out[i][2] = planes[i]->normal.z;
+        out[i][3] = -PFM_Vec3_Dot((vec3_t*)&planes[i]->normal, (vec3_t*)&planes[i]->point);
+    }
+}
+
+/* A box is fully behind a plane exactly when all its corners are, i.e. when the
+ * signed distance of its center plus its projected radius is negative. Unlike
+ * C_FrustumOBBIntersectionFast, all six planes are always tested, so boxes which 
+ * straddle one plane but are behind another are also rejected.
+ */
+static void obb_batch_scalar(const plane_eqs_t planes, const struct obb_soa *obbs, 
+                             size_t begin, size_t count, bool *out_mask)
+{
+    for(size_t i = begin; i < count; i++) {
+
+        bool visible = true;
+        for(int p = 0; p < 6 && visible; p++) {
+
+            const float *eq = planes[p];
+            float dist = eq[0] * obbs->center[0][i] 
+                       + eq[1] * obbs->center[1][i] 
+                       + eq[2] * obbs->center[2][i] + eq[3];
+            float radius = 0.0f;
+            for(int a = 0; a < 3; a++) {
+                radius += fabsf(eq[0] * obbs->extent[a][0][i] 
+                              + eq[1] * obbs->extent[a][1][i] 
+                              + eq[2] * obbs->extent[a][2][i]);
+            }
+            if(dist + radius < 0.0f)
+                visible = false;
+        }
+        out_mask[i] = visible;
+    }
+}
+
+#if COLLISION_X86
+
+static void obb_batch_sse(const plane_eqs_t planes, const struct obb_soa *obbs, 
+                          size_t begin, size_t count, bool *out_mask)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = begin;
+
+    for(; i + 4 <= count; i += 4) {
+
+        __m128 cx = _mm_loadu_ps(obbs->center[0] + i);
+        __m128 cy = _mm_loadu_ps(obbs->center[1] + i);
+        __m128 cz = _mm_loadu_ps(obbs->center[2] + i);
+        __m128 outside = _mm_setzero_ps();
+
+        for(int p = 0; p < 6; p++) {
+
+            __m128 nx = _mm_set1_ps(planes[p][0]);
+            __m128 ny = _mm_set1_ps(planes[p][1]);
+            __m128 nz = _mm_set1_ps(planes[p][2]);
+
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                     _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(planes[p][3])));
+            for(int a = 0; a < 3; a++) {
+                __m128 ex = _mm_loadu_ps(obbs->extent[a][0] + i);
+                __m128 ey = _mm_loadu_ps(obbs->extent[a][1] + i);
+                __m128 ez = _mm_loadu_ps(obbs->extent[a][2] + i);
+                __m128 proj = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ex), _mm_mul_ps(ny, ey)),
+                                         _mm_mul_ps(nz, ez));
+                dist = _mm_add_ps(dist, _mm_andnot_ps(sign, proj));
+            }
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, zero));
+        }
+
+        int bits = _mm_movemask_ps(outside);
+        for(int k = 0; k < 4; k++) {
+            out_mask[i + k] = !(bits & (1 << k));
+        }
+    }
+    obb_batch_scalar(planes, obbs, i, count, out_mask);
+}
+
+TARGET_AVX2
+static void obb_batch_avx2(const plane_eqs_t planes, const struct obb_soa *obbs, 
+                           size_t begin, size_t count, bool *out_mask)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    size_t i = begin;
+
+    for(; i + 8 <= count; i += 8) {
+
+        __m256 cx = _mm256_loadu_ps(obbs->center[0] + i);
+        __m256 cy = _mm256_loadu_ps(obbs->center[1] + i);
+        __m256 cz = _mm256_loadu_ps(obbs->center[2] + i);
+        __m256 outside = _mm256_setzero_ps();
+
+        for(int p = 0; p < 6; p++) {
+
+            __m256 nx = _mm256_set1_ps(planes[p][0]);
+            __m256 ny = _mm256_set1_ps(planes[p][1]);
+            __m256 nz = _mm256_set1_ps(planes[p][2]);
+
+            __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+                                        _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(planes[p][3])));
+            for(int a = 0; a < 3; a++) {
+                __m256 ex = _mm256_loadu_ps(obbs->extent[a][0] + i);
+                __m256 ey = _mm256_loadu_ps(obbs->extent[a][1] + i);
+                __m256 ez = _mm256_loadu_ps(obbs->extent[a][2] + i);
+                __m256 proj = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, ex), _mm256_mul_ps(ny, ey)),
+                                            _mm256_mul_ps(nz, ez));
+                dist = _mm256_add_ps(dist, _mm256_andnot_ps(sign, proj));
+            }
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, zero, _CMP_LT_OQ));
+        }
+
+        int bits = _mm256_movemask_ps(outside);
+        for(int k = 0; k < 8; k++) {
+            out_mask[i + k] = !(bits & (1 << k));
+        }
+    }
+    obb_batch_sse(planes, obbs, i, count, out_mask);
+}
+
+#endif
+
+/* The slab test of C_RayIntersectsOBB, expressed in terms of the (unnormalized)
+ * extent vectors of the boxes, so that no square roots are necessary. Projecting 
+ * onto an extent 'e' instead of the unit axis scales all distances by |e|, so the 
+ * slab half-width becomes |e|^2.
+ */
+static void seg_batch_scalar(const struct seg_eq *seg, const struct obb_soa *obbs, 
+                             size_t begin, size_t count, bool *out_mask)
+{
+    for(size_t i = begin; i < count; i++) {
+
+        const float d[3] = {
+            obbs->center[0][i] - seg->origin[0],
+            obbs->center[1][i] - seg->origin[1],
+            obbs->center[2][i] - seg->origin[2],
+        };
+        float tmin = 0.0f, tmax = 1.0f;
+        bool hit = true;
+
+        for(int a = 0; a < 3; a++) {
+
+            const float ex = obbs->extent[a][0][i];
+            const float ey = obbs->extent[a][1][i];
+            const float ez = obbs->extent[a][2][i];
+
+            float hh = ex * ex + ey * ey + ez * ez;
+            float dA = d[0] * ex + d[1] * ey + d[2] * ez;
+            float DA = seg->dir[0] * ex + seg->dir[1] * ey + seg->dir[2] * ez;
+
+            if(DA * DA <= seg->parallel_eps2 * hh) {
+                /* Segment is parallel to the slabs - check that it's inside */
+                if(fabsf(dA) > hh)
+                    hit = false;
+            }else{
+                float t1 = (dA - hh) / DA;
+                float t2 = (dA + hh) / DA;
+                tmin = MAX(tmin, MIN(t1, t2));
+                tmax = MIN(tmax, MAX(t1, t2));
+            }
+        }
+        out_mask[i] = hit && (tmin <= tmax);
+    }
+}
+
+#if COLLISION_X86
+
+static inline __m128 select_sse(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static void seg_batch_sse(const struct seg_eq *seg, const struct obb_soa *obbs, 
+                          size_t begin, size_t count, bool *out_mask)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 ox = _mm_set1_ps(seg->origin[0]);
+    const __m128 oy = _mm_set1_ps(seg->origin[1]);
+    const __m128 oz = _mm_set1_ps(seg->origin[2]);
+    const __m128 Dx = _mm_set1_ps(seg->dir[0]);
+    const __m128 Dy = _mm_set1_ps(seg->dir[1]);
+    const __m128 Dz = _mm_set1_ps(seg->dir[2]);
+    const __m128 eps2 = _mm_set1_ps(seg->parallel_eps2);
+    size_t i = begin;
+
+    for(; i + 4 <= count; i += 4) {
+
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(obbs->center[0] + i), ox);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(obbs->center[1] + i), oy);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(obbs->center[2] + i), oz);
+        __m128 tmin = _mm_setzero_ps();
+        __m128 tmax = _mm_set1_ps(1.0f);
+        __m128 miss = _mm_setzero_ps();
+
+        for(int a = 0; a < 3; a++) {
+
+            __m128 ex = _mm_loadu_ps(obbs->extent[a][0] + i);
+            __m128 ey = _mm_loadu_ps(obbs->extent[a][1] + i);
+            __m128 ez = _mm_loadu_ps(obbs->extent[a][2] + i);
+
+            __m128 hh = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), 
+                                   _mm_mul_ps(ez, ez));
+            __m128 dA = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ex), _mm_mul_ps(dy, ey)), 
+                                   _mm_mul_ps(dz, ez));
+            __m128 DA = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Dx, ex), _mm_mul_ps(Dy, ey)), 
+                                   _mm_mul_ps(Dz, ez));
+
+            __m128 parallel = _mm_cmple_ps(_mm_mul_ps(DA, DA), _mm_mul_ps(eps2, hh));
+            __m128 outside = _mm_cmpgt_ps(_mm_andnot_ps(sign, dA), hh);
+            miss = _mm_or_ps(miss, _mm_and_ps(parallel, outside));
+
+            __m128 t1 = _mm_div_ps(_mm_sub_ps(dA, hh), DA);
+            __m128 t2 = _mm_div_ps(_mm_add_ps(dA, hh), DA);
+            tmin = select_sse(parallel, tmin, _mm_max_ps(tmin, _mm_min_ps(t1, t2)));
+            tmax = select_sse(parallel, tmax, _mm_min_ps(tmax, _mm_max_ps(t1, t2)));
+        }
+        miss = _mm_or_ps(miss, _mm_cmpgt_ps(tmin, tmax));
+
+        int bits = _mm_movemask_ps(miss);
+        for(int k = 0; k < 4; k++) {
+            out_mask[i + k] = !(bits & (1 << k));
+        }
+    }
+    seg_batch_scalar(seg, obbs, i, count, out_mask);
+}
+
+TARGET_AVX2
+static void seg_batch_avx2(const struct seg_eq *seg, const struct obb_soa *obbs, 
+                           size_t begin, size_t count, bool *out_mask)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 ox = _mm256_set1_ps(seg->origin[0]);
+    const __m256 oy = _mm256_set1_ps(seg->origin[1]);
+    const __m256 oz = _mm256_set1_ps(seg->origin[2]);
+    const __m256 Dx = _mm256_set1_ps(seg->dir[0]);
+    const __m256 Dy = _mm256_set1_ps(seg->dir[1]);
+    const __m256 Dz = _mm256_set1_ps(seg->dir[2]);
+    const __m256 eps2 = _mm256_set1_ps(seg->parallel_eps2);
+    size_t i = begin;
+
+    for(; i + 8 <= count; i += 8) {
+
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(obbs->center[0] + i), ox);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(obbs->center[1] + i), oy);
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(obbs->center[2] + i), oz);
+        __m256 tmin = _mm256_setzero_ps();
+        __m256 tmax = _mm256_set1_ps(1.0f);
+        __m256 miss = _mm256_setzero_ps();
+
+        for(int a = 0; a < 3; a++) {
+
+            __m256 ex = _mm256_loadu_ps(obbs->extent[a][0] + i);
+            __m256 ey = _mm256_loadu_ps(obbs->extent[a][1] + i);
+            __m256 ez = _mm256_loadu_ps(obbs->extent[a][2] + i);
+
+            __m256 hh = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey)), 
+                                      _mm256_mul_ps(ez, ez));
+            __m256 dA = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, ex), _mm256_mul_ps(dy, ey)), 
+                                      _mm256_mul_ps(dz, ez));
+            __m256 DA = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Dx, ex), _mm256_mul_ps(Dy, ey)), 
+                                      _mm256_mul_ps(Dz, ez));
+
+            __m256 parallel = _mm256_cmp_ps(_mm256_mul_ps(DA, DA), _mm256_mul_ps(eps2, hh), _CMP_LE_OQ);
+            __m256 outside = _mm256_cmp_ps(_mm256_andnot_ps(sign, dA), hh, _CMP_GT_OQ);
+            miss = _mm256_or_ps(miss, _mm256_and_ps(parallel, outside));
+
+            __m256 t1 = _mm256_div_ps(_mm256_sub_ps(dA, hh), DA);
+            __m256 t2 = _mm256_div_ps(_mm256_add_ps(dA, hh), DA);
+            tmin = _mm256_blendv_ps(_mm256_max_ps(tmin, _mm256_min_ps(t1, t2)), tmin, parallel);
+            tmax = _mm256_blendv_ps(_mm256_min_ps(tmax, _mm256_max_ps(t1, t2)), tmax, parallel);
+        }
+        miss = _mm256_or_ps(miss, _mm256_cmp_ps(tmin, tmax, _CMP_GT_OQ));
+
+        int bits = _mm256_movemask_ps(miss);
+        for(int k = 0; k < 8; k++) {
+            out_mask[i + k] = !(bits & (1 << k));
+        }
+    }
+    seg_batch_sse(seg, obbs, i, count, out_mask);
+}
+
+#endif
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -476,7 +798,7 @@ bool C_LineSegIntersectsOBB(vec3_t begin, vec3_t end, struct obb obb)
     return (t >= 0 && t <= PFM_Vec3_Len(&delta));
 }
 
-enum volume_intersec_type C_FrustrumPointIntersectionFast(const struct frustum *frustum, vec3_t point)
+enum volume_intersec_type C_FrustumPointIntersectionFast(const struct frustum *frustum, vec3_t point)
 {
     const struct plane *planes[] = {&frustum->top, &frustum->bot, &frustum->left, 
                                     &frustum->right, &frustum->nearp, &frustum->farp};
@@ -562,6 +884,62 @@ enum volume_intersec_type C_FrustumOBBIntersectionFast(const struct frustum *fru
     return VOLUME_INTERSEC_INSIDE;
 }
 
+void C_SelectKernels(void)
+{
+    s_obb_batch_kernel = obb_batch_scalar;
+    s_seg_batch_kernel = seg_batch_scalar;
+#if COLLISION_X86
+    if(SDL_HasSSE2()) {
+        s_obb_batch_kernel = obb_batch_sse;
+        s_seg_batch_kernel = seg_batch_sse;
+    }
+    if(SDL_HasAVX2()) {
+        s_obb_batch_kernel = obb_batch_avx2;
+        s_seg_batch_kernel = seg_batch_avx2;
+    }
+#endif
+}
+
+void C_OBBSoASet(const struct obb_soa *soa, size_t idx, const struct obb *obb)
+{
+    soa->center[0][idx] = obb->center.x;
+    soa->center[1][idx] = obb->center.y;
+    soa->center[2][idx] = obb->center.z;
+
+    for(int a = 0; a < 3; a++) {
+        soa->extent[a][0][idx] = obb->axes[a].x * obb->half_lengths[a];
+        soa->extent[a][1][idx] = obb->axes[a].y * obb->half_lengths[a];
+        soa->extent[a][2][idx] = obb->axes[a].z * obb->half_lengths[a];
+    }
+}
+
+void C_FrustumOBBIntersectionBatch(const struct frustum *frustum, const struct obb_soa *obbs, 
+                                   size_t count, bool *out_mask)
+{
+    plane_eqs_t planes;
+    frustum_plane_eqs(frustum, planes);
+
+    obb_batch_kernel_t kernel = s_obb_batch_kernel ? s_obb_batch_kernel : obb_batch_scalar;
+    kernel(planes, obbs, 0, count, out_mask);
+}
+
+void C_LineSegOBBIntersectionBatch(vec3_t begin, vec3_t end, const struct obb_soa *obbs, 
+                                   size_t count, bool *out_mask)
+{
+    /* Follows the conventions of C_LineSegIntersectsOBB: the segment is cast 
+     * from 'begin' along (begin - end) */
+    vec3_t delta;
+    PFM_Vec3_Sub(&begin, &end, &delta);
+
+    struct seg_eq seg = (struct seg_eq){
+        .origin = {begin.x, begin.y, begin.z},
+        .dir = {delta.x, delta.y, delta.z},
+        .parallel_eps2 = EPSILON * EPSILON * PFM_Vec3_Dot(&delta, &delta),
+    };
+    seg_batch_kernel_t kernel = s_seg_batch_kernel ? s_seg_batch_kernel : seg_batch_scalar;
+    kernel(&seg, obbs, 0, count, out_mask);
+}
+
 bool C_FrustumAABBIntersectionExact(const struct frustum *frustum, const struct aabb *aabb)
 {
     vec3_t aabb_axes[3] = {
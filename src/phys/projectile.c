@@ -53,6 +53,9 @@
 
 #include <math.h>
 #include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL.h>
 
 
@@ -62,9 +65,18 @@
 #define GRAVITY         (1.62f * UNITS_PER_METER / (PHYS_HZ * PHYS_HZ))
 #define EPSILON         (1.0f/1024)
 #define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
 #define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
-#define MAX_PROJ_TASKS  (64)
+#define PROJ_GRAIN      (64)
 #define NEAR_TOLERANCE  (100.0f)
+/* Projectiles are hit-tested in batches sharing a single position query 
+ * per square cell of this size */
+#define SWEEP_CELL_SIZE (NEAR_TOLERANCE)
+#define MAX_CANDIDATES  (1024)
+/* The maximum number of distinct projectile models drawn in a frame */
+#define MAX_RGROUPS     (64)
+/* The launch velocities are solved for this many shots at a time */
+#define SOLVE_BLOCK     (64)
 
 #define CHK_TRUE_RET(_pred)             \
     do{                                 \
@@ -82,35 +94,85 @@ struct projectile{
     vec3_t   pos;
     vec3_t   vel;
     vec3_t   scale;
-    mat4x4_t model;
 };
 
-struct proj_task_arg{
-    size_t begin_idx;
-    size_t end_idx;
+/* The simulated state is kept in structure-of-arrays form so that the 
+ * integration and the hit tests can stream over the individual components.
+ * 'struct projectile' is only used to move individual records in and out.
+ */
+struct proj_soa{
+    size_t     size;
+    size_t     capacity;
+    uint32_t  *uid;
+    uint32_t  *ent_parent;
+    uint32_t  *cookie;
+    uint32_t  *flags;
+    int       *faction_id;
+    void     **render_private;
+    float     *px, *py, *pz;
+    float     *vx, *vy, *vz;
+    float     *sx, *sy, *sz;
+    bool      *dead;
+};
+
+struct proj_field{
+    size_t offset;
+    size_t elem_size;
 };
 
-struct proj_work{
-    struct memstack mem;
-    size_t          ntasks;
-    struct future   futures[MAX_PROJ_TASKS];
-    uint32_t        tids[MAX_PROJ_TASKS];
+struct sweep_key{
+    int32_t  cell_x, cell_z;
+    uint32_t idx;
 };
 
-VEC_TYPE(proj, struct projectile)
-VEC_IMPL(static inline, proj, struct projectile)
+#define FIELD(_name, _type) {offsetof(struct proj_soa, _name), sizeof(_type)}
+
+static const struct proj_field s_fields[] = {
+    FIELD(uid,            uint32_t),
+    FIELD(ent_parent,     uint32_t),
+    FIELD(cookie,         uint32_t),
+    FIELD(flags,          uint32_t),
+    FIELD(faction_id,     int),
+    FIELD(render_private, void*),
+    FIELD(px,             float),
+    FIELD(py,             float),
+    FIELD(pz,             float),
+    FIELD(vx,             float),
+    FIELD(vy,             float),
+    FIELD(vz,             float),
+    FIELD(sx,             float),
+    FIELD(sy,             float),
+    FIELD(sz,             float),
+    FIELD(dead,           bool),
+};
+
+#undef FIELD
+
+VEC_TYPE(key, struct sweep_key)
+VEC_IMPL(static inline, key, struct sweep_key)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static uint32_t         s_next_uid = 0;
-static vec_proj_t       s_front; /* the processed projectiles currently being rendered */
-static vec_proj_t       s_back;  /* the last tick projectiles currently being processed */
-static vec_proj_t       s_added;
-static vec_proj_t       s_deleted;
-struct proj_work        s_work;
+static struct proj_soa  s_front; /* the processed projectiles currently being rendered */
+static struct proj_soa  s_back;  /* the last tick projectiles currently being processed */
+static struct proj_soa  s_added;
+/* The tick graph node stepping the back buffer, or -1 */
+static int              s_work_node = -1;
+static size_t           s_nwork;
+static bool             s_work_pending = false;
 static struct memstack  s_eventargs;
+static vec_key_t        s_sweep_keys;
+
+/* Per-cell cache of the hit candidates */
+static uint32_t         s_cand_uid[MAX_CANDIDATES];
+static uint32_t         s_cand_flags[MAX_CANDIDATES];
+static int              s_cand_faction[MAX_CANDIDATES];
+static float            s_cand_pos[3][MAX_CANDIDATES];
+static float            s_cand_obb[12][MAX_CANDIDATES];
+static bool             s_cand_mask[MAX_CANDIDATES];
 
 static unsigned long    s_last_tick = ULONG_MAX;
 static unsigned         s_simticks = 0;
@@ -119,124 +181,269 @@ static unsigned         s_simticks = 0;
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static quat_t phys_velocity_dir(vec3_t vel)
+static void **proj_field_ptr(struct proj_soa *soa, size_t field)
 {
-    float yrot = atan2(vel.x, vel.z);
-    float zrot = atan2(vel.y, sqrt(pow(vel.x, 2) + pow(vel.z, 2)));
-
-    mat4x4_t yrotmat;
-    PFM_Mat4x4_MakeRotY(yrot, &yrotmat);
+    return (void**)((char*)soa + s_fields[field].offset);
+}
 
-    mat4x4_t zrotmat;
-    PFM_Mat4x4_MakeRotZ(zrot, &zrotmat);
+static void proj_soa_init(struct proj_soa *soa)
+{
+    memset(soa, 0, sizeof(*soa));
+}
 
-    mat4x4_t rotmat;
-    PFM_Mat4x4_Mult4x4(&yrotmat, &zrotmat, &rotmat);
+static void proj_soa_destroy(struct proj_soa *soa)
+{
+    for(int i = 0; i < ARR_SIZE(s_fields); i++) {
+        free(*proj_field_ptr(soa, i));
+    }
+    proj_soa_init(soa);
+}
 
-    quat_t rot;
-    PFM_Quat_FromRotMat(&rotmat, &rot);
-    return rot;
+static bool proj_soa_reserve(struct proj_soa *soa, size_t capacity)
+{
+    if(soa->capacity >= capacity)
+        return true;
+
+    for(int i = 0; i < ARR_SIZE(s_fields); i++) {
+        void **field = proj_field_ptr(soa, i);
+        void *arr = realloc(*field, capacity * s_fields[i].elem_size);
+        if(!arr)
+            return false;
+        *field = arr;
+    }
+    soa->capacity = capacity;
+    return true;
 }
 
-static bool phys_proj_equal(const struct projectile *a, const struct projectile *b)
+static bool proj_soa_grow(struct proj_soa *soa, size_t extra)
 {
-    return (a->uid == b->uid);
+    if(soa->size + extra <= soa->capacity)
+        return true;
+    return proj_soa_reserve(soa, MAX(soa->capacity * 2, soa->size + extra));
 }
 
-static void assert_no_zero(vec_proj_t *vec)
+static void proj_soa_reset(struct proj_soa *soa)
 {
-    struct projectile proj = (struct projectile){ .uid = 0 };
-    int idx = vec_proj_indexof(vec, proj, phys_proj_equal);
-    assert(idx == -1);
+    soa->size = 0;
 }
 
-static void phys_proj_update(struct projectile *proj)
+static bool proj_soa_concat(struct proj_soa *dst, struct proj_soa *src)
 {
-    vec3_t accel = (vec3_t){0.0f, -GRAVITY, 0.0f};
-    PFM_Vec3_Add(&proj->vel, &accel, &proj->vel);
-    PFM_Vec3_Add(&proj->pos, &proj->vel, &proj->pos);
+    if(!proj_soa_grow(dst, src->size))
+        return false;
+
+    for(int i = 0; i < ARR_SIZE(s_fields); i++) {
+        size_t sz = s_fields[i].elem_size;
+        memcpy((char*)*proj_field_ptr(dst, i) + dst->size * sz, *proj_field_ptr(src, i), src->size * sz);
+    }
+    dst->size += src->size;
+    return true;
+}
 
-    mat4x4_t trans, scale, rot, tmp;
-    quat_t qrot = phys_velocity_dir(proj->vel);
+static bool proj_soa_copy(struct proj_soa *dst, struct proj_soa *src)
+{
+    proj_soa_reset(dst);
+    return proj_soa_concat(dst, src);
+}
 
-    PFM_Mat4x4_MakeTrans(proj->pos.x, proj->pos.y, proj->pos.z, &trans);
-    PFM_Mat4x4_MakeScale(proj->scale.x, proj->scale.y, proj->scale.z, &scale);
-    PFM_Mat4x4_RotFromQuat(&qrot, &rot);
+/* Stable removal of all the projectiles flagged as dead */
+static void proj_soa_compact(struct proj_soa *soa)
+{
+    size_t nlive = 0;
+    for(size_t i = 0; i < soa->size; i++) {
 
-    PFM_Mat4x4_Mult4x4(&scale, &rot, &tmp);
-    PFM_Mat4x4_Mult4x4(&trans, &tmp, &proj->model);
+        if(soa->dead[i])
+            continue;
+        if(nlive != i) {
+            for(int f = 0; f < ARR_SIZE(s_fields); f++) {
+                size_t sz = s_fields[f].elem_size;
+                char *base = *proj_field_ptr(soa, f);
+                memcpy(base + nlive * sz, base + i * sz, sz);
+            }
+        }
+        nlive++;
+    }
+    soa->size = nlive;
 }
 
-static struct result phys_proj_task(void *arg)
+static bool proj_soa_push(struct proj_soa *soa, const struct projectile *proj)
 {
-    struct proj_task_arg *proj_arg = arg;
-    size_t ncomputed = 0;
+    if(!proj_soa_grow(soa, 1))
+        return false;
 
-    for(int i = proj_arg->begin_idx; i <= proj_arg->end_idx; i++) {
+    size_t i = soa->size++;
+    soa->uid[i] = proj->uid;
+    soa->ent_parent[i] = proj->ent_parent;
+    soa->cookie[i] = proj->cookie;
+    soa->flags[i] = proj->flags;
+    soa->faction_id[i] = proj->faction_id;
+    soa->render_private[i] = proj->render_private;
+    soa->px[i] = proj->pos.x;
+    soa->py[i] = proj->pos.y;
+    soa->pz[i] = proj->pos.z;
+    soa->vx[i] = proj->vel.x;
+    soa->vy[i] = proj->vel.y;
+    soa->vz[i] = proj->vel.z;
+    soa->sx[i] = proj->scale.x;
+    soa->sy[i] = proj->scale.y;
+    soa->sz[i] = proj->scale.z;
+    soa->dead[i] = false;
+    return true;
+}
 
-        phys_proj_update(&vec_AT(&s_back, i));
+static void proj_soa_get(const struct proj_soa *soa, size_t i, struct projectile *out)
+{
+    *out = (struct projectile){
+        .uid = soa->uid[i],
+        .ent_parent = soa->ent_parent[i],
+        .cookie = soa->cookie[i],
+        .flags = soa->flags[i],
+        .faction_id = soa->faction_id[i],
+        .render_private = soa->render_private[i],
+        .pos = (vec3_t){soa->px[i], soa->py[i], soa->pz[i]},
+        .vel = (vec3_t){soa->vx[i], soa->vy[i], soa->vz[i]},
+        .scale = (vec3_t){soa->sx[i], soa->sy[i], soa->sz[i]},
+    };
+}
 
-        ncomputed++;
-        if(ncomputed % 64 == 0)
-            Task_Yield();
+static void phys_proj_task(size_t begin, size_t end, void *arg)
+{
+    float *restrict px = s_back.px, *restrict py = s_back.py, *restrict pz = s_back.pz;
+    float *restrict vx = s_back.vx, *restrict vy = s_back.vy, *restrict vz = s_back.vz;
+
+    /* Dead projectiles are integrated too, keeping the loop branch-free so 
+     * that it is vectorized. The orientation is derived from the velocity
+     * when rendering. */
+    for(size_t i = begin; i < end; i++) {
+        vy[i] -= GRAVITY;
+        px[i] += vx[i];
+        py[i] += vy[i];
+        pz[i] += vz[i];
     }
-    return NULL_RESULT;
 }
 
 static void phys_filter_out_of_bounds(void)
 {
-    for(int i = vec_size(&s_front)-1; i >= 0; i--) {
+    for(size_t i = 0; i < s_front.size; i++) {
 
-        const struct projectile *curr = &vec_AT(&s_front, i);
-        if(curr->pos.y < -Z_COORDS_PER_TILE) {
-            E_Global_Notify(EVENT_PROJECTILE_DISAPPEAR, (void*)((uintptr_t)curr->uid), ES_ENGINE);
-            vec_proj_push(&s_deleted, *curr);
-            vec_proj_del(&s_front, i);
+        if(s_front.dead[i])
+            continue;
+        if(s_front.py[i] < -Z_COORDS_PER_TILE) {
+            E_Global_Notify(EVENT_PROJECTILE_DISAPPEAR, (void*)((uintptr_t)s_front.uid[i]), ES_ENGINE);
+            s_front.dead[i] = true;
         }
     }
 }
 
+static struct result phys_proj_step_task(void *arg)
+{
+    Sched_ParallelFor(0, s_nwork, PROJ_GRAIN, phys_proj_task, NULL);
+    return NULL_RESULT;
+}
+
 static void phys_proj_join_work(void)
 {
-    for(int i = 0; i < s_work.ntasks; i++) {
-        while(!Sched_FutureIsReady(&s_work.futures[i])) {
-            Sched_RunSync(s_work.tids[i]);
-        }
-    }
+    if(s_work_node < 0)
+        return;
+    Sched_GraphJoinNode(Sched_TickGraph(), s_work_node);
+    s_work_node = -1;
 }
 
 static void phys_proj_finish_work(void)
 {
     phys_proj_join_work();
-    stalloc_clear(&s_work.mem);
-    s_work.ntasks = 0;
-
-    vec_proj_subtract(&s_back, &s_deleted, phys_proj_equal);
-    vec_proj_reset(&s_deleted);
+    if(!s_work_pending)
+        return;
+
+    /* The leading part of the back buffer is an in-order copy of the front 
+     * buffer. Carry over the projectiles that were hit or went out of bounds 
+     * since, then drop them. */
+    assert(s_back.size >= s_front.size);
+    for(size_t i = 0; i < s_front.size; i++) {
+        s_back.dead[i] |= s_front.dead[i];
+    }
+    proj_soa_compact(&s_back);
 
     /* swap front & back buffers */
-    vec_proj_t tmp = s_back;
+    struct proj_soa tmp = s_back;
     s_back = s_front;
     s_front = tmp;
+    s_work_pending = false;
 }
 
-static bool phys_enemies(int faction_id, uint32_t ent)
+static bool phys_enemies(int faction_id, int ent_faction_id)
 {
-    if(faction_id == G_GetFactionID(ent))
+    if(faction_id == ent_faction_id)
         return false;
 
     enum diplomacy_state ds;
-    bool result = G_GetDiplomacyState(faction_id, G_GetFactionID(ent), &ds);
+    bool result = G_GetDiplomacyState(faction_id, ent_faction_id, &ds);
 
     assert(result);
     return (ds == DIPLOMACY_STATE_WAR);
 }
 
-static void phys_sweep_test(int front_idx)
+static int compare_sweep_keys(const void *a, const void *b)
 {
-    const struct projectile *proj = &vec_AT(&s_front, front_idx);
-    uint32_t nearp[256];
-    size_t nents = G_Pos_EntsInCircle((vec2_t){proj->pos.x, proj->pos.z}, NEAR_TOLERANCE, nearp, ARR_SIZE(nearp));
+    const struct sweep_key *ka = a, *kb = b;
+    if(ka->cell_z != kb->cell_z)
+        return (ka->cell_z < kb->cell_z) ? -1 : 1;
+    if(ka->cell_x != kb->cell_x)
+        return (ka->cell_x < kb->cell_x) ? -1 : 1;
+    return (ka->idx < kb->idx) ? -1 : (ka->idx > kb->idx);
+}
+
+static void phys_candidates_obb_soa(struct obb_soa *out)
+{
+    for(int i = 0; i < 3; i++) {
+        out->center[i] = s_cand_obb[i];
+        for(int j = 0; j < 3; j++) {
+            out->extent[i][j] = s_cand_obb[3 + i * 3 + j];
+        }
+    }
+}
+
+/* Gather all the entities which may be within NEAR_TOLERANCE of any 
+ * projectile in the cell, together with everything the hit test needs 
+ * to know about them.
+ */
+static size_t phys_load_candidates(int32_t cell_x, int32_t cell_z, const struct obb_soa *obbs)
+{
+    vec2_t xz_min = (vec2_t){
+        cell_x * SWEEP_CELL_SIZE - NEAR_TOLERANCE, 
+        cell_z * SWEEP_CELL_SIZE - NEAR_TOLERANCE
+    };
+    vec2_t xz_max = (vec2_t){
+        (cell_x + 1) * SWEEP_CELL_SIZE + NEAR_TOLERANCE, 
+        (cell_z + 1) * SWEEP_CELL_SIZE + NEAR_TOLERANCE
+    };
+    size_t ncands = G_Pos_EntsInRect(xz_min, xz_max, s_cand_uid, MAX_CANDIDATES);
+
+    for(size_t i = 0; i < ncands; i++) {
+
+        uint32_t ent = s_cand_uid[i];
+        s_cand_flags[i] = G_FlagsGet(ent);
+        s_cand_faction[i] = G_GetFactionID(ent);
+
+        vec3_t pos = G_Pos_Get(ent);
+        s_cand_pos[0][i] = pos.x;
+        s_cand_pos[1][i] = pos.y;
+        s_cand_pos[2][i] = pos.z;
+
+        struct obb obb;
+        Entity_CurrentOBB(ent, &obb, false);
+        C_OBBSoASet(obbs, i, &obb);
+    }
+    return ncands;
+}
+
+static void phys_sweep_test(size_t front_idx, const struct obb_soa *obbs, size_t ncands)
+{
+    const uint32_t parent = s_front.ent_parent[front_idx];
+    const uint32_t flags = s_front.flags[front_idx];
+    const int faction_id = s_front.faction_id[front_idx];
+    const vec3_t pos = (vec3_t){s_front.px[front_idx], s_front.py[front_idx], s_front.pz[front_idx]};
+    const vec3_t vel = (vec3_t){s_front.vx[front_idx], s_front.vy[front_idx], s_front.vz[front_idx]};
 
     /* The collision test gets performed every frame (variable FPS) while, 
      * actual projectile motion is performed at fixed frequency of PHYS_HZ. 
@@ -250,40 +457,44 @@ static void phys_sweep_test(int front_idx)
      * from the projent location of the projectile to the location it would
      * have been in 's_simticks' ago had its' velocity been constant.
      */
-    vec3_t begin = proj->pos;
-    vec3_t end, delta = proj->vel;
+    vec3_t begin = pos;
+    vec3_t end, delta = vel;
     PFM_Vec3_Scale(&delta, -1.0f * s_simticks, &delta);
     PFM_Vec3_Add(&begin, &delta, &end);
 
+    C_LineSegOBBIntersectionBatch(begin, end, obbs, ncands, s_cand_mask);
+
     float min_dist = INFINITY;
     uint32_t hit_ent = NULL_UID;
 
-    for(int i = 0; i < nents; i++) {
+    for(size_t i = 0; i < ncands; i++) {
+
+        if(!s_cand_mask[i])
+            continue;
+
+        float dx = pos.x - s_cand_pos[0][i];
+        float dy = pos.y - s_cand_pos[1][i];
+        float dz = pos.z - s_cand_pos[2][i];
+
+        /* The candidates are gathered for the whole cell */
+        if(dx * dx + dz * dz > NEAR_TOLERANCE * NEAR_TOLERANCE)
+            continue;
 
-        uint32_t ent = nearp[i];
+        uint32_t ent = s_cand_uid[i];
         /* A projectile does not collide with its' 'parent' */
-        if(proj->ent_parent == ent)
+        if(parent == ent)
             continue;
-        if(G_FlagsGet(ent) & ENTITY_FLAG_ZOMBIE)
+        if(s_cand_flags[i] & ENTITY_FLAG_ZOMBIE)
             continue;
-        if((proj->flags & PROJ_ONLY_HIT_COMBATABLE) && !(G_FlagsGet(ent) & ENTITY_FLAG_COMBATABLE))
+        if((flags & PROJ_ONLY_HIT_COMBATABLE) && !(s_cand_flags[i] & ENTITY_FLAG_COMBATABLE))
             continue;
-        if((proj->flags & PROJ_ONLY_HIT_ENEMIES) && !phys_enemies(proj->faction_id, ent))
+        if((flags & PROJ_ONLY_HIT_ENEMIES) && !phys_enemies(faction_id, s_cand_faction[i]))
             continue;
 
-        struct obb obb;
-        Entity_CurrentOBB(ent, &obb, false);
-
-        if(C_LineSegIntersectsOBB(begin, end, obb)) {
-
-            vec3_t diff;
-            vec3_t ent_pos = G_Pos_Get(ent);
-            PFM_Vec3_Sub((vec3_t*)&proj->pos, &ent_pos, &diff);
-
-            if(PFM_Vec3_Len(&diff) < min_dist) {
-                min_dist = PFM_Vec3_Len(&diff);
-                hit_ent = ent;
-            }
+        float dist = sqrtf(dx * dx + dy * dy + dz * dz);
+        if(dist < min_dist) {
+            min_dist = dist;
+            hit_ent = ent;
         }
     }
 
@@ -291,55 +502,85 @@ static void phys_sweep_test(int front_idx)
 
         struct proj_hit *hit = stalloc(&s_eventargs, sizeof(struct proj_hit));
         hit->ent_uid = hit_ent;
-        hit->proj_uid = proj->uid;
-        hit->parent_uid = proj->ent_parent;
-        hit->cookie = proj->cookie;
+        hit->proj_uid = s_front.uid[front_idx];
+        hit->parent_uid = parent;
+        hit->cookie = s_front.cookie[front_idx];
         E_Global_Notify(EVENT_PROJECTILE_HIT, hit, ES_ENGINE);
 
-        vec_proj_push(&s_deleted, *proj);
-        vec_proj_del(&s_front, front_idx);
+        s_front.dead[front_idx] = true;
     }
 }
 
-static void on_30hz_tick(void *user, void *event)
+/* Bin the live projectiles by cell and hit-test each bin against a single 
+ * shared set of candidates, instead of querying the position grid for 
+ * every projectile.
+ */
+static void phys_sweep_all(void)
 {
-    PERF_PUSH("projectile::on_30hz_tick");
+    vec_key_reset(&s_sweep_keys);
+    for(size_t i = 0; i < s_front.size; i++) {
 
-    phys_proj_finish_work();
+        if(s_front.dead[i])
+            continue;
+        struct sweep_key key = (struct sweep_key){
+            .cell_x = (int32_t)floorf(s_front.px[i] / SWEEP_CELL_SIZE),
+            .cell_z = (int32_t)floorf(s_front.pz[i] / SWEEP_CELL_SIZE),
+            .idx = i,
+        };
+        if(!vec_key_push(&s_sweep_keys, key))
+            return;
+    }
+    qsort(s_sweep_keys.array, vec_size(&s_sweep_keys), sizeof(struct sweep_key), compare_sweep_keys);
 
-    vec_proj_copy(&s_back, &s_front);
-    vec_proj_concat(&s_back, &s_added);
-    vec_proj_reset(&s_added);
+    struct obb_soa obbs;
+    phys_candidates_obb_soa(&obbs);
 
-    size_t nwork = vec_size(&s_back);
-    if(nwork == 0)
-        goto done;
+    size_t i = 0;
+    while(i < vec_size(&s_sweep_keys)) {
 
-    size_t ntasks = SDL_GetCPUCount();
-    if(nwork < 64)
-        ntasks = 1;
-    ntasks = MIN(ntasks, MAX_PROJ_TASKS);
+        const struct sweep_key *first = &vec_AT(&s_sweep_keys, i);
+        size_t ncands = phys_load_candidates(first->cell_x, first->cell_z, &obbs);
 
-    for(int i = 0; i < ntasks; i++) {
+        size_t j = i;
+        for(; j < vec_size(&s_sweep_keys); j++) {
 
-        struct proj_task_arg *arg = stalloc(&s_work.mem, sizeof(struct proj_task_arg));
-        size_t nitems = ceil((float)nwork / ntasks);
+            const struct sweep_key *curr = &vec_AT(&s_sweep_keys, j);
+            if(curr->cell_x != first->cell_x || curr->cell_z != first->cell_z)
+                break;
+            if(ncands > 0)
+                phys_sweep_test(curr->idx, &obbs, ncands);
+        }
+        i = j;
+    }
+}
+
+static void on_30hz_tick(void *user, void *event)
+{
+    PERF_PUSH("projectile::on_30hz_tick");
 
-        arg->begin_idx = nitems * i;
-        arg->end_idx = MIN(nitems * (i + 1) - 1, nwork-1);
+    phys_proj_finish_work();
 
-        SDL_AtomicSet(&s_work.futures[s_work.ntasks].status, FUTURE_INCOMPLETE);
-        s_work.tids[s_work.ntasks] = Sched_Create(4, phys_proj_task, arg, 
-            &s_work.futures[s_work.ntasks], 0);
+    /* On allocation failure, the projectiles will hold still for this tick */
+    if(!proj_soa_copy(&s_back, &s_front)
+    || !proj_soa_concat(&s_back, &s_added))
+        goto done;
+    proj_soa_reset(&s_added);
 
-        if(s_work.tids[s_work.ntasks] == NULL_TID) {
-            for(int j = arg->begin_idx; j <= arg->end_idx; j++) {
-                phys_proj_update(&vec_AT(&s_back, j));
-            }
-        }else{
-            s_work.ntasks++;
-        }
+    s_nwork = s_back.size;
+    s_work_pending = true;
+    if(s_nwork == 0)
+        goto done;
+
+    /* The step only touches the back buffer, so it is free to overlap 
+     * with the stages of the other subsystems until the next tick */
+    struct task_graph *graph = Sched_TickGraph();
+    s_work_node = Sched_GraphAdd(graph, 4, phys_proj_step_task, NULL, 
+        0, SCHED_RES_PROJECTILES, 0);
+    if(s_work_node < 0) {
+        Sched_ParallelFor(0, s_nwork, PROJ_GRAIN, phys_proj_task, NULL);
+        goto done;
     }
+    Sched_GraphSubmit(graph);
 
 done:
     s_last_tick = g_frame_idx;
@@ -347,92 +588,158 @@ done:
     PERF_POP();
 }
 
-static void phys_create_render_input(struct render_input *out)
+/* Group the projectiles by model and write the instances of every group 
+ * contiguously, straight into the render workspace */
+static void on_render_3d(void *user, void *arg)
 {
-    out->cam = G_GetActiveCamera();
-    out->map = G_GetPrevTickMap();
-    out->shadows = false;
-    out->light_pos = G_GetLightPos();
+    struct proj_rgroup groups[MAX_RGROUPS];
+    size_t ngroups = 0;
+    size_t ninsts = 0;
 
-    vec_rstat_init(&out->cam_vis_stat);
-    vec_ranim_init(&out->cam_vis_anim);
+    for(size_t i = 0; i < s_front.size; i++) {
 
-    vec_rstat_init(&out->light_vis_stat);
-    vec_ranim_init(&out->light_vis_anim);
+        if(s_front.dead[i] || !s_front.render_private[i])
+            continue;
 
-    for(int i = 0; i < vec_size(&s_front); i++) {
+        int g = 0;
+        for(; g < ngroups; g++) {
+            if(groups[g].render_private == s_front.render_private[i])
+                break;
+        }
+        if(g == ngroups) {
+            if(ngroups == ARR_SIZE(groups))
+                continue;
+            groups[ngroups++] = (struct proj_rgroup){s_front.render_private[i], 0, 0};
+        }
+        groups[g].count++;
+        ninsts++;
+    }
 
-        const struct projectile *curr = &vec_AT(&s_front, i);
-        if(!curr->render_private)
+    if(ninsts == 0)
+        return;
+
+    size_t cursor[MAX_RGROUPS];
+    size_t base = 0;
+    for(int g = 0; g < ngroups; g++) {
+        groups[g].first = cursor[g] = base;
+        base += groups[g].count;
+    }
+
+    struct proj_rstate *insts = R_AllocArg(ninsts * sizeof(struct proj_rstate));
+    int last = 0;
+
+    for(size_t i = 0; i < s_front.size; i++) {
+
+        if(s_front.dead[i] || !s_front.render_private[i])
             continue;
-        struct ent_stat_rstate rstate = (struct ent_stat_rstate){
-            .render_private = curr->render_private,
-            .model = curr->model,
-            .translucent = false,
-            .td = {0},
+
+        /* Projectiles of the same model tend to be adjacent */
+        int g = last;
+        if(groups[g].render_private != s_front.render_private[i]) {
+            for(g = 0; g < ngroups; g++) {
+                if(groups[g].render_private == s_front.render_private[i])
+                    break;
+            }
+            if(g == ngroups)
+                continue;
+            last = g;
+        }
+        insts[cursor[g]++] = (struct proj_rstate){
+            .pos = (vec3_t){s_front.px[i], s_front.py[i], s_front.pz[i]},
+            .vel = (vec3_t){s_front.vx[i], s_front.vy[i], s_front.vz[i]},
+            .scale = (vec3_t){s_front.sx[i], s_front.sy[i], s_front.sz[i]},
         };
-        vec_rstat_push(&out->cam_vis_stat, rstate);
     }
-}
 
-static void phys_destroy_render_input(struct render_input *in)
-{
-    vec_rstat_destroy(&in->cam_vis_stat);
-    vec_ranim_destroy(&in->cam_vis_anim);
-
-    vec_rstat_destroy(&in->light_vis_stat);
-    vec_ranim_destroy(&in->light_vis_anim);
+    R_PushCmd((struct rcmd){
+        .func = R_GL_ProjectilesDraw,
+        .nargs = 4,
+        .args = {
+            insts,
+            R_PushArg(&ninsts, sizeof(ninsts)),
+            R_PushArg(groups, ngroups * sizeof(struct proj_rgroup)),
+            R_PushArg(&ngroups, sizeof(ngroups)),
+        },
+    });
 }
 
-static void *phys_push_render_input(struct render_input *in)
+/* Solve the launch velocities of up to SOLVE_BLOCK shots. The work is split 
+ * into straight-line passes over the arrays of the intermediate values, 
+ * which can be vectorized. Only the final pass, which rejects the shots 
+ * without a solution, branches. 
+ */
+static size_t proj_solve_block(size_t count, const vec3_t *src, const vec3_t *dst, 
+                               const float *speeds, vec3_t *out, bool *out_ok)
 {
-    struct render_input *ret = R_PushArg(in, sizeof(*in));
+    assert(count <= SOLVE_BLOCK);
 
-    if(in->cam_vis_stat.size) {
-        ret->cam_vis_stat.array = R_PushArg(
-            in->cam_vis_stat.array, 
-            in->cam_vis_stat.size * sizeof(struct ent_stat_rstate)
-        );
-    }
-    if(in->cam_vis_anim.size) {
-        ret->cam_vis_anim.array = R_PushArg(
-            in->cam_vis_anim.array, 
-            in->cam_vis_anim.size * sizeof(struct ent_anim_rstate)
-        );
-    }
-    if(in->light_vis_stat.size) {
-        ret->light_vis_stat.array = R_PushArg(
-            in->light_vis_stat.array, 
-            in->light_vis_stat.size * sizeof(struct ent_stat_rstate)
-        );
+    float dx[SOLVE_BLOCK], dy[SOLVE_BLOCK], dz[SOLVE_BLOCK];
+    float x[SOLVE_BLOCK], v[SOLVE_BLOCK];
+    float descriminant[SOLVE_BLOCK], tan_theta[SOLVE_BLOCK];
+    const float g = GRAVITY;
+
+    for(size_t i = 0; i < count; i++) {
+        dx[i] = dst[i].x - src[i].x;
+        dy[i] = dst[i].y - src[i].y;
+        dz[i] = dst[i].z - src[i].z;
+        v[i] = speeds[i] / PHYS_HZ;
     }
-    if(in->light_vis_anim.size) {
-        ret->light_vis_anim.array = R_PushArg(
-            in->light_vis_anim.array, 
-            in->light_vis_anim.size * sizeof(struct ent_anim_rstate)
-        );
+
+    /* Use a coordinate system such that the y-axis is up and 
+     * the x-axis is along the direction of motion (src -> dst). 
+     * To hit a target at range x and altitude y when fired from (0,0) 
+     * and with initial speed v the required angle of launch THETA is: 
+     *
+     *              (v^2 +/- sqrt(v^4 - g(gx^2 + 2yv^2))
+     * tan(THETA) = (----------------------------------)
+     *              (              gx                  )
+     *
+     * The two roots of the equation correspond to the two possible 
+     * launch angles, so long as they aren't imaginary, in which case 
+     * the initial speed is not great enough to reach the point (x,y) 
+     * selected.
+     */
+    for(size_t i = 0; i < count; i++) {
+        double v2 = (double)v[i] * v[i];
+        x[i] = sqrt((double)dx[i] * dx[i] + (double)dz[i] * dz[i]);
+        descriminant[i] = v2 * v2 - g * (g * ((double)x[i] * x[i]) + 2 * dy[i] * v2);
     }
-    return ret;
-}
 
-static void on_render_3d(void *user, void *arg)
-{
-    struct render_input rinput;
-    phys_create_render_input(&rinput);
+    /* Take the lower of the two launch angles. When the roots (nearly) 
+     * coincide, there is just the one. */
+    for(size_t i = 0; i < count; i++) {
+        double v2 = (double)v[i] * v[i];
+        double root = sqrt(MAX(descriminant[i], 0.0f));
+        float t1 = v2 + root;
+        float t2 = v2 - root;
+        float t = (fabs(descriminant[i]) > EPSILON) ? MIN(t1, t2) : t1;
+        tan_theta[i] = t / (g * x[i]);
+    }
 
-    enum batch_id id = BATCH_ID_PROJECTILE;
-    struct render_input *pushed = phys_push_render_input(&rinput);
+    size_t ret = 0;
+    for(size_t i = 0; i < count; i++) {
 
-    R_PushCmd((struct rcmd){
-        .func = R_GL_Batch_DrawWithID,
-        .nargs = 2,
-        .args = {
-            pushed,
-            R_PushArg(&id, sizeof(id)),
-        },
-    });
+        out_ok[i] = false;
+        vec3_t delta = (vec3_t){dx[i], dy[i], dz[i]};
+        if(PFM_Vec3_Len(&delta) < EPSILON)
+            continue;
+        if(descriminant[i] < -EPSILON)
+            continue; /* No real solutions */
+
+        /* Theta is the angle of motion up from the ground along the angle of motion.
+         * Convert this to a velocity vector. 
+         */
+        vec3_t velocity = (vec3_t){ dx[i], x[i] * tan_theta[i], dz[i] };
+        if(PFM_Vec3_Len(&velocity) <= EPSILON)
+            continue;
 
-    phys_destroy_render_input(&rinput);
+        PFM_Vec3_Normal(&velocity, &velocity);
+        PFM_Vec3_Scale(&velocity, v[i], &velocity);
+        out[i] = velocity;
+        out_ok[i] = true;
+        ret++;
+    }
+    return ret;
 }
 
 /*****************************************************************************/
@@ -454,7 +761,7 @@ uint32_t P_Projectile_Add(vec3_t origin, vec3_t velocity, uint32_t ent_parent, i
         .vel = velocity,
         .scale = pd.scale,
     };
-    vec_proj_push(&s_added, proj);
+    proj_soa_push(&s_added, &proj);
     return ret;
 }
 
@@ -463,9 +770,7 @@ void P_Projectile_Update(void)
     PERF_ENTER();
     stalloc_clear(&s_eventargs);
 
-    for(int i = vec_size(&s_front)-1; i >= 0; i--) {
-        phys_sweep_test(i);
-    }
+    phys_sweep_all();
     phys_filter_out_of_bounds();
     s_simticks = 0;
 
@@ -474,20 +779,18 @@ void P_Projectile_Update(void)
 
 bool P_Projectile_Init(void)
 {
-    vec_proj_init(&s_front);
-    if(!vec_proj_resize(&s_front, 1024))
+    proj_soa_init(&s_front);
+    if(!proj_soa_reserve(&s_front, 1024))
         goto fail_front;
-    vec_proj_init(&s_back);
-    if(!vec_proj_resize(&s_back, 1024))
+    proj_soa_init(&s_back);
+    if(!proj_soa_reserve(&s_back, 1024))
         goto fail_back;
-    vec_proj_init(&s_added);
-    if(!vec_proj_resize(&s_added, 256))
+    proj_soa_init(&s_added);
+    if(!proj_soa_reserve(&s_added, 256))
         goto fail_added;
-    vec_proj_init(&s_deleted);
-    if(!vec_proj_resize(&s_deleted, 256))
-        goto fail_deleted;
-    if(!stalloc_init(&s_work.mem))
-        goto fail_mem;
+    vec_key_init(&s_sweep_keys);
+    if(!vec_key_resize(&s_sweep_keys, 1024))
+        goto fail_keys;
     if(!stalloc_init(&s_eventargs))
         goto fail_eventargs;
 
@@ -496,15 +799,13 @@ bool P_Projectile_Init(void)
     return true;
 
 fail_eventargs:
-    stalloc_destroy(&s_work.mem);
-fail_mem:
-    vec_proj_destroy(&s_deleted);
-fail_deleted:
-    vec_proj_destroy(&s_added);
+    vec_key_destroy(&s_sweep_keys);
+fail_keys:
+    proj_soa_destroy(&s_added);
 fail_added:
-    vec_proj_destroy(&s_back);
+    proj_soa_destroy(&s_back);
 fail_back:
-    vec_proj_destroy(&s_front);
+    proj_soa_destroy(&s_front);
 fail_front:
     return false;
 }
@@ -515,97 +816,58 @@ void P_Projectile_Shutdown(void)
     E_Global_Unregister(EVENT_30HZ_TICK, on_30hz_tick);
     E_Global_Unregister(EVENT_RENDER_3D_POST, on_render_3d);
     stalloc_destroy(&s_eventargs);
-    stalloc_destroy(&s_work.mem);
-    vec_proj_destroy(&s_front);
-    vec_proj_destroy(&s_back);
-    vec_proj_destroy(&s_added);
-    vec_proj_destroy(&s_deleted);
+    vec_key_destroy(&s_sweep_keys);
+    proj_soa_destroy(&s_front);
+    proj_soa_destroy(&s_back);
+    proj_soa_destroy(&s_added);
 }
 
 bool P_Projectile_VelocityForTarget(vec3_t src, vec3_t dst, float init_speed, vec3_t *out)
 {
-    vec3_t delta;
-    PFM_Vec3_Sub(&dst, &src, &delta);
-
-    if(PFM_Vec3_Len(&delta) < EPSILON)
-        return false;
-
-    /* Use a coordinate system such that the y-axis is up and 
-     * the x-axis is along the direction of motion (src -> dst). 
-     */
-    const float x = sqrt(pow(delta.x, 2) + pow(delta.z, 2));
-    const float y = delta.y;
-    const float v = init_speed / PHYS_HZ;
-    const float g = GRAVITY;
-
-    /* To hit a target at range x and altitude y when fired from (0,0) 
-     * and with initial speed v the required angle of launch THETA is: 
-     *
-     *              (v^2 +/- sqrt(v^4 - g(gx^2 + 2yv^2))
-     * tan(THETA) = (----------------------------------)
-     *              (              gx                  )
-     *
-     * The two roots of the equation correspond to the two possible 
-     * launch angles, so long as they aren't imaginary, in which case 
-     * the initial speed is not great enough to reach the point (x,y) 
-     * selected.
-     */
-
-    float descriminant = pow(v, 4) - g * (g * pow(x, 2) + 2 * y * pow(v, 2));
-    if(descriminant < -EPSILON) {
-        /* No real solutions */
-        return false;
-    }
-
-    size_t nsolutions = 1;
-    if(fabs(descriminant) > EPSILON) {
-        nsolutions = 2;
-    }
-
-    float t1, t2, tan_theta;
-    t1 = pow(v, 2) + sqrt(descriminant);
-    if(nsolutions > 1) {
-        t2 = pow(v, 2) - sqrt(descriminant);
-        tan_theta = MIN(t1, t2) / (g * x);
-    }else{
-        tan_theta = t1 / (g * x);
-    }
-
-    /* Theta is the angle of motion up from the ground along the angle of motion.
-     * Convert this to a velocity vector. 
-     */
-    float xlen = sqrt(pow(delta.x, 2) + pow(delta.z, 2));
-    float ylen = xlen * tan_theta;
+    bool ret;
+    P_Projectile_VelocitiesForTargets(1, &src, &dst, &init_speed, out, &ret);
+    return ret;
+}
 
-    vec3_t velocity = (vec3_t){ delta.x, ylen, delta.z };
-    if(PFM_Vec3_Len(&velocity) <= EPSILON) {
-        return false;
+size_t P_Projectile_VelocitiesForTargets(size_t count, const vec3_t *src, const vec3_t *dst, 
+                                         const float *speeds, vec3_t *out, bool *out_ok)
+{
+    size_t ret = 0;
+    for(size_t base = 0; base < count; base += SOLVE_BLOCK) {
+        size_t nshots = MIN(SOLVE_BLOCK, count - base);
+        ret += proj_solve_block(nshots, src + base, dst + base, speeds + base, 
+            out + base, out_ok + base);
     }
-    assert(PFM_Vec3_Len(&velocity) > EPSILON);
-    PFM_Vec3_Normal(&velocity, &velocity);
-    PFM_Vec3_Scale(&velocity, v, &velocity);
-
-    *out = velocity;
-    return true;
+    return ret;
 }
 
 bool P_Projectile_SaveState(struct SDL_RWops *stream)
 {
     phys_proj_finish_work();
-    vec_proj_concat(&s_front, &s_added);
-    vec_proj_reset(&s_added);
+    CHK_TRUE_RET(proj_soa_concat(&s_front, &s_added));
+    proj_soa_reset(&s_added);
     /* 's_front' now has the most up-to-date projectile state */
 
+    int nlive = 0;
+    for(size_t i = 0; i < s_front.size; i++) {
+        nlive += !s_front.dead[i];
+    }
+
     struct attr num_proj = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = vec_size(&s_front)
+        .val.as_int = nlive
     };
     CHK_TRUE_RET(Attr_Write(stream, &num_proj, "num_proj"));
     Sched_TryYield();
 
-    for(int i = 0; i < vec_size(&s_front); i++) {
+    for(size_t i = 0; i < s_front.size; i++) {
    
-        const struct projectile *curr = &vec_AT(&s_front, i);
+        if(s_front.dead[i])
+            continue;
+
+        struct projectile proj;
+        proj_soa_get(&s_front, i, &proj);
+        const struct projectile *curr = &proj;
 
         struct attr uid = (struct attr){
             .type = TYPE_INT,
@@ -740,20 +1002,8 @@ bool P_Projectile_LoadState(struct SDL_RWops *stream)
         CHK_TRUE_RET(attr.type == TYPE_VEC3);
         proj.scale = attr.val.as_vec3;
 
-        /* Lastly, derive the most up-to-date model matrix */
-        mat4x4_t trans, scale, rot, tmp;
-        quat_t qrot = phys_velocity_dir(proj.vel);
-
-        PFM_Mat4x4_MakeTrans(proj.pos.x, proj.pos.y, proj.pos.z, &trans);
-        PFM_Mat4x4_MakeScale(proj.scale.x, proj.scale.y, proj.scale.z, &scale);
-        PFM_Mat4x4_RotFromQuat(&qrot, &rot);
-
-        PFM_Mat4x4_Mult4x4(&scale, &rot, &tmp);
-        PFM_Mat4x4_Mult4x4(&trans, &tmp, &proj.model);
-
         /* Add it to the list of projectiles */
-        vec_proj_push(&s_front, proj);
-        vec_proj_push(&s_back, proj);
+        CHK_TRUE_RET(proj_soa_push(&s_front, &proj));
         Sched_TryYield();
     }
 
@@ -766,12 +1016,13 @@ bool P_Projectile_LoadState(struct SDL_RWops *stream)
 
 void P_Projectile_ClearState(void)
 {
-    s_work.ntasks = 0;
+    s_work_node = -1;
+    s_nwork = 0;
+    s_work_pending = false;
     stalloc_clear(&s_eventargs);
-    stalloc_clear(&s_work.mem);
-    vec_proj_reset(&s_front);
-    vec_proj_reset(&s_back);
-    vec_proj_reset(&s_added);
-    vec_proj_reset(&s_deleted);
+    vec_key_reset(&s_sweep_keys);
+    proj_soa_reset(&s_front);
+    proj_soa_reset(&s_back);
+    proj_soa_reset(&s_added);
 }
 
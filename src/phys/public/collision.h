@@ -38,6 +38,7 @@
 
 #include "../../pf_math.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 struct aabb{
     float x_min, x_max;
@@ -67,6 +68,14 @@ struct obb{
     vec3_t corners[8];
 };
 
+/* Structure-of-arrays view of a set of OBBs for batched culling. The 'extent'
+ * arrays hold the box axes each scaled by the matching half length, indexed
+ * by [axis][component]. */
+struct obb_soa{
+    float *center[3];
+    float *extent[3][3];
+};
+
 enum volume_intersec_type{
     VOLUME_INTERSEC_INSIDE,
     VOLUME_INTERSEC_OUTSIDE,
@@ -92,6 +101,19 @@ enum volume_intersec_type C_FrustumPointIntersectionFast(const struct frustum *f
 enum volume_intersec_type C_FrustumAABBIntersectionFast (const struct frustum *frustum, const struct aabb *aabb);
 enum volume_intersec_type C_FrustumOBBIntersectionFast  (const struct frustum *frustum, const struct obb *obb);
 
+/* Batched outside test for 'count' boxes against all 6 frustum planes. 'out_mask[i]' is 
+ * set to false when the i-th box is fully behind some plane and to true otherwise.
+ * An SSE2 or AVX2 implementation is selected at runtime by C_SelectKernels, with
+ * a scalar fallback. */
+void C_SelectKernels(void);
+void C_OBBSoASet(const struct obb_soa *soa, size_t idx, const struct obb *obb);
+void C_FrustumOBBIntersectionBatch(const struct frustum *frustum, const struct obb_soa *obbs, 
+                                   size_t count, bool *out_mask);
+/* Batched equivalent of C_LineSegIntersectsOBB for one segment against 'count' boxes. 
+ * 'out_mask[i]' is set to true when the segment intersects the i-th box. */
+void C_LineSegOBBIntersectionBatch(vec3_t begin, vec3_t end, const struct obb_soa *obbs, 
+                                   size_t count, bool *out_mask);
+
 bool C_FrustumAABBIntersectionExact(const struct frustum *frustum, const struct aabb *aabb);
 bool C_FrustumOBBIntersectionExact(const struct frustum *frustum, const struct obb *obb);
 
@@ -43,6 +43,7 @@ struct SDL_RWops;
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 
 #define PROJ_ONLY_HIT_COMBATABLE   (1 << 0)
@@ -69,6 +70,11 @@ uint32_t P_Projectile_Add(vec3_t origin, vec3_t velocity, uint32_t ent_parent, i
                           uint32_t cookie, int flags, struct proj_desc pd);
 void     P_Projectile_Update(void);
 bool     P_Projectile_VelocityForTarget(vec3_t src, vec3_t dst, float init_speed, vec3_t *out);
+/* Solves the launch velocities of 'count' shots in one batch. 'out_ok[i]' 
+ * is set to whether shot 'i' can reach its target at all, in which case 
+ * 'out[i]' holds its velocity. Returns the number of such shots. */
+size_t   P_Projectile_VelocitiesForTargets(size_t count, const vec3_t *src, const vec3_t *dst, 
+                                           const float *speeds, vec3_t *out, bool *out_ok);
 
 bool     P_Projectile_SaveState(struct SDL_RWops *stream);
 bool     P_Projectile_LoadState(struct SDL_RWops *stream);
@@ -35,6 +35,7 @@
 
 #include "gl_batch.h"
 #include "gl_ringbuffer.h"
+#include "gl_meshpool.h"
 #include "gl_texture.h"
 #include "gl_mesh.h"
 #include "gl_assert.h"
@@ -43,10 +44,12 @@
 #include "gl_perf.h"
 #include "gl_vertex.h"
 #include "gl_state.h"
+#include "gl_render.h"
 #include "render_private.h"
 #include "public/render.h"
+#include "public/render_ctrl.h"
 #include "../entity.h"
-#include "../lib/public/pf_malloc.h"
+#include "../perf.h"
 #include "../lib/public/khash.h"
 #include "../lib/public/mem.h"
 #include "../map/public/tile.h"
@@ -56,22 +59,28 @@
 #include <assert.h>
 
 
-#define MESH_BUFF_SZ        (8*1024*1024)
+#define MESH_POOL_SZ        (32*1024*1024)
+#define COMPACT_BYTES       (1024*1024)
 #define TEX_ARR_SZ          (64)
 
 #define MAX_TEX_ARRS        (4)
-#define MAX_MESH_BUFFS      (16)
 
 #define CMD_RING_SZ         (4 * 1024 * sizeof(struct GL_DAI_Cmd))
 #define STAT_ATTR_RING_SZ   (4*1024*1024)
-#define ANIM_ATTR_RING_SZ   (32*1024*1024)
+#define ANIM_ATTR_RING_SZ   (4*1024*1024)
 
 #define MAX_BATCHES         (256)
 #define MAX_INSTS           (16384)
+/* The texture mapping and the properties of MAX_MATERIALS materials */
+#define MATS_BLOCK_FLOATS   (MAX_MATERIALS * 2 + MAX_MATERIALS * 8)
 #define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+
+#define CULL_WORKGROUP_SZ   (64)
 
 #define CMD_RING_TUNIT      (GL_TEXTURE5)
 #define ATTR_RING_TUNIT     (GL_TEXTURE6)
+#define TEX_HANDLES_TUNIT   (GL_TEXTURE4)
 #define BATCH_ID_NULL       (0)
 
 #define GL_PERF_CALL(name, ...)     \
@@ -82,11 +91,6 @@
     }while(0)
 
 
-struct mesh_desc{
-    int    vbo_idx;
-    size_t offset;
-};
-
 struct tex_desc{
     int arr_idx;
     int tex_idx;
@@ -95,13 +99,7 @@ struct tex_desc{
 struct tex_arr_desc{
     struct texture_arr arr;
     /* bitfield of free slots */
-    uint32_t           free;
-};
-
-struct vbo_desc{
-    void   *heap_meta;
-    GLuint  VBO;
-    GLuint  VAO;
+    uint64_t           free;
 };
 
 struct chunk_batch_desc{
@@ -112,17 +110,17 @@ struct chunk_batch_desc{
 
 struct inst_group_desc{
     void *render_private;
+    int   lod;
     int   start_idx;
     int   end_idx;
 };
 
 struct draw_call_desc{
-    int vbo_idx; 
     int start_idx;
     int end_idx;
 };
 
-KHASH_MAP_INIT_INT(mdesc, struct mesh_desc)
+KHASH_SET_INIT_INT(mesh)
 KHASH_MAP_INIT_INT(tdesc, struct tex_desc)
 
 struct GL_DAI_Cmd{
@@ -144,30 +142,33 @@ struct gl_batch{
     /* Ringbuffer for for per-instance attributes associated
      * with the draw commands */
     struct gl_ring     *attr_ring;
-    /* A mapping of the mesh's VBO to its' position 
-     * within the batch buffer list. */
-    khash_t(mdesc)     *vbo_desc_map;
+    /* The source VBOs of the meshes in this batch. The 
+     * vertices themselves are held in the mesh pool shared 
+     * by all the batches of the same type. */
+    khash_t(mesh)      *meshes;
     /* A mapping of onne of the mesh's texture IDs to its
      * position within the texture array list. */
     khash_t(tdesc)     *tid_desc_map;
     /* The number of texture arrays in this batch */
     size_t              ntexarrs;
-    /* The number of buffers storing all the meshes for
-     * this batch. Meshes are packed together in a buffer 
-     * of MESH_BUFF_SZ, until it is full, in which case 
-     * an extra buffer is allocated. */
-    size_t              nvbos;
     /* The textues for all the meshes in this batch. All 
      * the textures are packed into a single texture array 
      * with a fixed number of entries. If the array fills 
      * up, the textures overflow into the next array. */
     struct tex_arr_desc textures[MAX_TEX_ARRS];
-    /* The VBOs holding the combiend meshes for this batch. */
-    struct vbo_desc     vbos[MAX_MESH_BUFFS];
 };
 
 KHASH_MAP_INIT_INT(batch, struct gl_batch*)
 
+/* The header of the input buffer of the culling compute shader.
+ * It is followed by the draw commands. */
+struct cull_header{
+    GLuint  ncmds;
+    GLuint  ninsts;
+    GLuint  pad[2];
+    GLfloat planes[6][4];
+};
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -176,6 +177,40 @@ static struct gl_batch *s_anim_batch;
 static khash_t(batch)  *s_chunk_batches;
 static khash_t(batch)  *s_id_batches;
 static GLuint           s_draw_id_vbo;
+/* The vertices of all the batched meshes, one pool per vertex format, 
+ * and a VAO for sourcing from each. The VAO is recreated whenever the 
+ * pool replaces its' buffer. */
+static struct gl_mesh_pool *s_pools[2];
+static GLuint           s_pool_vaos[2];
+static uint32_t         s_pool_vao_gens[2];
+/* The buffers of the GPU culling stage. The culled draw commands and
+ * the compacted draw IDs are written by the compute shader and consumed
+ * by the multidraw directly. */
+static GLuint           s_cull_cmds_ssbo;
+static GLuint           s_cull_bounds_ssbo;
+static GLuint           s_cull_out_cmds;
+static GLuint           s_cull_ids;
+/* The current sizes of the above buffers, for memory accounting */
+static size_t           s_cull_cmds_sz;
+static size_t           s_cull_bounds_sz;
+static size_t           s_cull_out_cmds_sz;
+static size_t           s_cull_ids_sz;
+/* The frustum the instances are culled against on the GPU, or NULL if
+ * the current draws are not culled. */
+static const struct frustum *s_cull_frustum;
+/* When set, the textures are not copied into the per-batch arrays. Instead, 
+ * the material lookup table holds the bindless handle slot of each entity's 
+ * own texture array, so that batches are not limited by array slices. */
+static bool             s_bindless;
+/* When set, the opaque instance groups and chunk batches are drawn nearest 
+ * to 's_view_pos' first, so that the depth test rejects more of what they 
+ * hide before it is shaded. */
+static bool             s_front_to_back;
+static vec3_t           s_view_pos;
+/* When set, the regular pass only lays down the depth of the opaque 
+ * instances. The regular vertex shaders are kept for this, so that the 
+ * alpha-tested texels are rejected the same way in both passes. */
+static bool             s_prepass;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -193,7 +228,7 @@ uint32_t batch_chunk_key(int chunk_r, int chunk_c)
          |  (( ((uint32_t)chunk_c) & 0xffff) <<  0));
 }
 
-static int batch_first_free_idx(uint32_t mask)
+static int batch_first_free_idx(uint64_t mask)
 {
     int ret = 0;
     while(mask) {
@@ -210,7 +245,7 @@ static bool batch_alloc_texarray(struct gl_batch *batch)
         return false;
 
     R_GL_Texture_ArrayAlloc(TEX_ARR_SZ, &batch->textures[batch->ntexarrs].arr, GL_TEXTURE0 + batch->ntexarrs);
-    batch->textures[batch->ntexarrs].free = ~((uint32_t)0);
+    batch->textures[batch->ntexarrs].free = ~((uint64_t)0);
     batch->ntexarrs++;
     return true;
 }
@@ -291,90 +326,47 @@ static void batch_init_vao(enum batch_type type, GLuint *out, GLuint src_vbo)
     glBindVertexArray(0);
 }
 
-static bool batch_alloc_vbo(struct gl_batch *batch)
+static GLuint batch_pool_vao(enum batch_type type)
 {
-    if(batch->nvbos == MAX_MESH_BUFFS)
-        return false;
-
-    void *heap_meta = pf_metamalloc_init(MESH_BUFF_SZ);
-    if(!heap_meta)
-        return false;
-
-    GLuint VBO;
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, MESH_BUFF_SZ, NULL, GL_DYNAMIC_DRAW);
-
-    GLuint VAO;
-    batch_init_vao(batch->type, &VAO, VBO);
+    uint32_t gen = R_GL_MeshPoolGeneration(s_pools[type]);
+    if(s_pool_vaos[type] && s_pool_vao_gens[type] == gen)
+        return s_pool_vaos[type];
 
-    batch->vbos[batch->nvbos] = (struct vbo_desc){heap_meta, VBO, VAO};
-    batch->nvbos++;
-    return true;
+    if(s_pool_vaos[type]) {
+        glDeleteVertexArrays(1, &s_pool_vaos[type]);
+    }
+    batch_init_vao(type, &s_pool_vaos[type], R_GL_MeshPoolGetVBO(s_pools[type]));
+    s_pool_vao_gens[type] = gen;
+    return s_pool_vaos[type];
 }
 
 static bool batch_append_mesh(struct gl_batch *batch, GLuint VBO)
 {
-    khiter_t k = kh_get(mdesc, batch->vbo_desc_map, VBO);
-    if(k != kh_end(batch->vbo_desc_map))
+    khiter_t k = kh_get(mesh, batch->meshes, VBO);
+    if(k != kh_end(batch->meshes))
         return true; /* VBO already in the batch */
 
-    size_t alignment = batch_vert_alignment(batch->type);
-
-    GLint size;
-    glBindBuffer(GL_COPY_READ_BUFFER, VBO);
-    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
-
-    if(size > MESH_BUFF_SZ)
+    if(!R_GL_MeshPoolAcquire(s_pools[batch->type], VBO))
         return false;
 
-    int curr_vbo_idx = 0;
-    int vbo_offset = -1;
-    do{
-        vbo_offset = pf_metamemalign(batch->vbos[curr_vbo_idx].heap_meta, alignment, size);
-        if(vbo_offset >= 0)
-            break;
-    }while(++curr_vbo_idx < batch->nvbos);
-
-    if(vbo_offset < 0) {
-        if(batch->nvbos == MAX_MESH_BUFFS)
-            return false;
-        if(!batch_alloc_vbo(batch))
-            return false;
-        curr_vbo_idx = batch->nvbos-1;
-        vbo_offset = pf_metamemalign(batch->vbos[curr_vbo_idx].heap_meta, alignment, size);
-    }
-    assert(curr_vbo_idx >= 0 && curr_vbo_idx < batch->nvbos);
-    assert(vbo_offset >= 0);
-
-    /* Perform VBO-to-VBO copy. The data should be copied without having 
-     * to do a round-trip to the CPU.
-     */
-    glBindBuffer(GL_COPY_WRITE_BUFFER, batch->vbos[curr_vbo_idx].VBO);
-    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, vbo_offset, size);
-
     int status;
-    k = kh_put(mdesc, batch->vbo_desc_map, VBO, &status);
+    kh_put(mesh, batch->meshes, VBO, &status);
     if(status == -1) {
-        pf_metafree(batch->vbos[curr_vbo_idx].heap_meta, vbo_offset);
+        R_GL_MeshPoolRelease(s_pools[batch->type], VBO);
         return false;
     }
 
-    kh_value(batch->vbo_desc_map, k) = (struct mesh_desc){curr_vbo_idx, vbo_offset};
-
     GL_ASSERT_OK();
     return true;
 }
 
 static void batch_free_mesh(struct gl_batch *batch, GLuint VBO)
 {
-    khiter_t k = kh_get(mdesc, batch->vbo_desc_map, VBO);
-    assert(k != kh_end(batch->vbo_desc_map));
+    khiter_t k = kh_get(mesh, batch->meshes, VBO);
+    assert(k != kh_end(batch->meshes));
 
-    struct mesh_desc md = kh_value(batch->vbo_desc_map, k);
-    pf_metafree(batch->vbos[md.vbo_idx].heap_meta, md.offset);
-
-    kh_del(mdesc, batch->vbo_desc_map, k);
+    R_GL_MeshPoolRelease(s_pools[batch->type], VBO);
+    kh_del(mesh, batch->meshes, k);
 }
 
 static bool batch_append_tex(struct gl_batch *batch, GLuint tid, int idx, struct texture_arr *arr)
@@ -401,7 +393,7 @@ static bool batch_append_tex(struct gl_batch *batch, GLuint tid, int idx, struct
         slice_idx = batch_first_free_idx(batch->textures[curr_arr_idx].free);
     }
     assert(curr_arr_idx >= 0 && curr_arr_idx < batch->ntexarrs);
-    assert(slice_idx >= 0 && slice_idx < 32);
+    assert(slice_idx >= 0 && slice_idx < TEX_ARR_SZ);
 
     R_GL_Texture_BindArray(&batch->textures[curr_arr_idx].arr, R_GL_Shader_GetCurrActive());
     assert(glIsTexture(batch->textures[curr_arr_idx].arr.id));
@@ -415,7 +407,7 @@ static bool batch_append_tex(struct gl_batch *batch, GLuint tid, int idx, struct
     }
 
     kh_value(batch->tid_desc_map, k) = (struct tex_desc){curr_arr_idx, slice_idx};
-    batch->textures[curr_arr_idx].free &= ~(((uint32_t)0x1) << slice_idx);
+    batch->textures[curr_arr_idx].free &= ~(((uint64_t)0x1) << slice_idx);
 
     GL_ASSERT_OK();
     return true;
@@ -427,7 +419,7 @@ static void batch_free_tex(struct gl_batch *batch, GLuint id)
     assert(k != kh_end(batch->tid_desc_map));
 
     struct tex_desc td = kh_value(batch->tid_desc_map, k);
-    batch->textures[td.arr_idx].free |= (0x1 << td.tex_idx);
+    batch->textures[td.arr_idx].free |= (((uint64_t)0x1) << td.tex_idx);
 
     kh_del(tdesc, batch->tid_desc_map, k);
 }
@@ -437,6 +429,13 @@ static bool batch_append(struct gl_batch *batch, struct render_private *priv)
     if(!batch_append_mesh(batch, priv->mesh.VBO))
         goto fail_append_mesh;
 
+    if(s_bindless) {
+        int slot;
+        if(!R_GL_Texture_BindlessSlot(priv->material_arr.id, &slot))
+            goto fail_append_bindless;
+        return true;
+    }
+
     int tex_idx = 0;
     for(; tex_idx < priv->num_materials; tex_idx++) {
         if(!batch_append_tex(batch, priv->materials[tex_idx].texture.id, tex_idx, &priv->material_arr))
@@ -451,6 +450,7 @@ fail_append_tex:
         --tex_idx;
         batch_free_tex(batch, priv->materials[tex_idx].texture.id);
     }while(tex_idx > 0);
+fail_append_bindless:
     batch_free_mesh(batch, priv->mesh.VBO);
 fail_append_mesh:
     GL_ASSERT_OK();
@@ -481,9 +481,9 @@ static struct gl_batch *batch_init(enum batch_type type)
     if(!batch->attr_ring)
         goto fail_attr_ring;
 
-    batch->vbo_desc_map = kh_init(mdesc);
-    if(!batch->vbo_desc_map)
-        goto fail_vbo_desc_map;
+    batch->meshes = kh_init(mesh);
+    if(!batch->meshes)
+        goto fail_meshes;
         
     batch->tid_desc_map = kh_init(tdesc);
     if(!batch->tid_desc_map)
@@ -493,20 +493,14 @@ static struct gl_batch *batch_init(enum batch_type type)
     if(!batch_alloc_texarray(batch))
         goto fail_tex_array;
 
-    batch->nvbos = 0;
-    if(!batch_alloc_vbo(batch))
-        goto fail_vbo;
-
     GL_ASSERT_OK();
     return batch;
 
-fail_vbo:
-    R_GL_Texture_ArrayFree(batch->textures[0].arr);
 fail_tex_array:
     kh_destroy(tdesc, batch->tid_desc_map);
 fail_tid_desc_map:
-    kh_destroy(mdesc, batch->vbo_desc_map);
-fail_vbo_desc_map:
+    kh_destroy(mesh, batch->meshes);
+fail_meshes:
     R_GL_RingbufferDestroy(batch->attr_ring);
 fail_attr_ring:
     R_GL_RingbufferDestroy(batch->cmd_ring);
@@ -521,12 +515,13 @@ static void batch_destroy(struct gl_batch *batch)
     for(int i = 0; i < batch->ntexarrs; i++) {
         R_GL_Texture_ArrayFree(batch->textures[i].arr);
     }
-    for(int i = 0; i < batch->nvbos; i++) {
-        glDeleteBuffers(1, &batch->vbos[i].VBO);
-    }
+    GLuint VBO;
+    kh_foreach_key(batch->meshes, VBO, {
+        R_GL_MeshPoolRelease(s_pools[batch->type], VBO);
+    });
 
     kh_destroy(tdesc, batch->tid_desc_map);
-    kh_destroy(mdesc, batch->vbo_desc_map);
+    kh_destroy(mesh, batch->meshes);
 
     R_GL_RingbufferDestroy(batch->attr_ring);
     R_GL_RingbufferDestroy(batch->cmd_ring);
@@ -534,11 +529,27 @@ static void batch_destroy(struct gl_batch *batch)
 	PF_FREE(batch);
 }
 
-static struct mesh_desc batch_mdesc_for_vbo(struct gl_batch *batch, GLuint VBO)
+/* The range of the mesh's vertices for the level of detail. Models without 
+ * reduced-detail meshes are always drawn at full detail. */
+static void batch_lod_range(const struct render_private *priv, int lod, 
+                            GLuint *out_first, GLuint *out_count)
 {
-    khiter_t k = kh_get(mdesc, batch->vbo_desc_map, VBO);
-    assert(k != kh_end(batch->vbo_desc_map));
-    return kh_value(batch->vbo_desc_map, k);
+    if(!priv->lods_valid || lod == 0) {
+        *out_first = 0;
+        *out_count = priv->mesh.num_verts;
+        return;
+    }
+    lod = MIN(lod, priv->num_lods - 1);
+    *out_first = priv->lod_first[lod];
+    *out_count = priv->lod_count[lod];
+}
+
+static GLuint batch_first_vert(struct gl_batch *batch, GLuint VBO)
+{
+    assert(kh_get(mesh, batch->meshes, VBO) != kh_end(batch->meshes));
+    size_t offset = R_GL_MeshPoolOffset(s_pools[batch->type], VBO);
+    assert(offset % batch_vert_alignment(batch->type) == 0);
+    return offset / batch_vert_alignment(batch->type);
 }
 
 static struct tex_desc batch_tdesc_for_tid(struct gl_batch *batch, GLuint tid)
@@ -659,13 +670,20 @@ static size_t batch_anim_sort_by_transparency(vec_ranim_t *ents, size_t nents)
     return ret;
 }
 
+static bool batch_stat_inst_less(const struct ent_stat_rstate *a, const struct ent_stat_rstate *b)
+{
+    if(a->render_private != b->render_private)
+        return ((uintptr_t)a->render_private) < ((uintptr_t)b->render_private);
+    return a->lod < b->lod;
+}
+
 static size_t batch_sort_by_inst_stat(struct ent_stat_rstate *ents, size_t nents, 
                                       struct inst_group_desc *out, size_t maxout)
 {
     int i = 1;
     while(i < nents) {
         int j = i;
-        while(j > 0 && ((uintptr_t)ents[j - 1].render_private) > ((uintptr_t)ents[j].render_private)) {
+        while(j > 0 && batch_stat_inst_less(&ents[j], &ents[j - 1])) {
 
             struct ent_stat_rstate tmp = ents[j - 1];
             ents[j - 1] = ents[j];
@@ -679,16 +697,19 @@ static size_t batch_sort_by_inst_stat(struct ent_stat_rstate *ents, size_t nents
 
     struct inst_group_desc curr = (struct inst_group_desc){
         .render_private = ents[0].render_private,
+        .lod = ents[0].lod,
         .start_idx = 0,
     };
     for(int i = 1; i < nents; i++) {
     
-        if(((uintptr_t)ents[i - 1].render_private) != ((uintptr_t)ents[i].render_private)) {
+        if(ents[i - 1].render_private != ents[i].render_private
+        || ents[i - 1].lod != ents[i].lod) {
 
             curr.end_idx = i - 1;
             out[ret++] = curr;
             curr = (struct inst_group_desc){
                 .render_private = ents[i].render_private,
+                .lod = ents[i].lod,
                 .start_idx = i,
             };
         }
@@ -702,13 +723,24 @@ static size_t batch_sort_by_inst_stat(struct ent_stat_rstate *ents, size_t nents
     return ret;
 }
 
+static bool batch_anim_inst_less(const struct ent_anim_rstate *a, const struct ent_anim_rstate *b)
+{
+    /* Instances showing the same pose are kept next to each other so that 
+     * they read the same part of the pose buffer */
+    if(a->render_private != b->render_private)
+        return ((uintptr_t)a->render_private) < ((uintptr_t)b->render_private);
+    if(a->lod != b->lod)
+        return a->lod < b->lod;
+    return a->pose_base < b->pose_base;
+}
+
 static size_t batch_sort_by_inst_anim(struct ent_anim_rstate *ents, size_t nents, 
                                       struct inst_group_desc *out, size_t maxout)
 {
     int i = 1;
     while(i < nents) {
         int j = i;
-        while(j > 0 && ((uintptr_t)ents[j - 1].render_private) > ((uintptr_t)ents[j].render_private)) {
+        while(j > 0 && batch_anim_inst_less(&ents[j], &ents[j - 1])) {
 
             struct ent_anim_rstate tmp = ents[j - 1];
             ents[j - 1] = ents[j];
@@ -722,16 +754,19 @@ static size_t batch_sort_by_inst_anim(struct ent_anim_rstate *ents, size_t nents
 
     struct inst_group_desc curr = (struct inst_group_desc){
         .render_private = ents[0].render_private,
+        .lod = ents[0].lod,
         .start_idx = 0,
     };
     for(int i = 1; i < nents; i++) {
     
-        if(((uintptr_t)ents[i - 1].render_private) != ((uintptr_t)ents[i].render_private)) {
+        if(ents[i - 1].render_private != ents[i].render_private
+        || ents[i - 1].lod != ents[i].lod) {
 
             curr.end_idx = i - 1;
             out[ret++] = curr;
             curr = (struct inst_group_desc){
                 .render_private = ents[i].render_private,
+                .lod = ents[i].lod,
                 .start_idx = i,
             };
         }
@@ -745,94 +780,148 @@ static size_t batch_sort_by_inst_anim(struct ent_anim_rstate *ents, size_t nents
     return ret;
 }
 
-static size_t batch_sort_by_vbo(struct gl_batch *batch, struct inst_group_desc *descs, 
-                                size_t ndescs, struct draw_call_desc *out, size_t maxout)
+static float batch_view_dist2(const mat4x4_t *model)
 {
-    int i = 1;
-    while(i < ndescs) {
-        int j = i;
-
-        GLuint VBO1 = ((struct render_private*)descs[j - 1].render_private)->mesh.VBO;
-        GLuint VBO2 = ((struct render_private*)descs[j].render_private)->mesh.VBO;
-        struct mesh_desc md1 = batch_mdesc_for_vbo(batch, VBO1);
-        struct mesh_desc md2 = batch_mdesc_for_vbo(batch, VBO2);
+    vec3_t delta = (vec3_t){
+        model->cols[3][0] - s_view_pos.x,
+        model->cols[3][1] - s_view_pos.y,
+        model->cols[3][2] - s_view_pos.z,
+    };
+    return PFM_Vec3_Dot(&delta, &delta);
+}
 
-        while(j > 0 && md1.vbo_idx > md2.vbo_idx) {
+/* Order the instance groups by the distance of their nearest instance. Each 
+ * group keeps its' range of instances, so the attributes and the commands, 
+ * which are both pushed in group order, stay consistent. */
+static void batch_order_groups(struct inst_group_desc *descs, float *dist, size_t ngroups)
+{
+    for(int i = 1; i < ngroups; i++) {
+        int j = i;
+        while(j > 0 && dist[j] < dist[j - 1]) {
 
             struct inst_group_desc tmp = descs[j - 1];
             descs[j - 1] = descs[j];
             descs[j] = tmp;
+
+            float tmpd = dist[j - 1];
+            dist[j - 1] = dist[j];
+            dist[j] = tmpd;
             j--;
         }
-        i++;
     }
+}
 
-    size_t ret = 0;
-
-    GLuint VBO = ((struct render_private*)descs[0].render_private)->mesh.VBO;
-    struct mesh_desc md = batch_mdesc_for_vbo(batch, VBO);
-
-    struct draw_call_desc curr = (struct draw_call_desc){
-        .vbo_idx = md.vbo_idx,
-        .start_idx = 0,
-    };
-    for(int i = 1; i < ndescs; i++) {
-    
-        GLuint VBO1 = ((struct render_private*)descs[i - 1].render_private)->mesh.VBO;
-        GLuint VBO2 = ((struct render_private*)descs[i].render_private)->mesh.VBO;
-        struct mesh_desc md1 = batch_mdesc_for_vbo(batch, VBO1);
-        struct mesh_desc md2 = batch_mdesc_for_vbo(batch, VBO2);
+static void batch_order_groups_stat(const struct ent_stat_rstate *ents, 
+                                    struct inst_group_desc *descs, size_t ngroups)
+{
+    STALLOC(float, dist, ngroups);
+    for(int i = 0; i < ngroups; i++) {
+        dist[i] = INFINITY;
+        for(int j = descs[i].start_idx; j <= descs[i].end_idx; j++) {
+            dist[i] = MIN(dist[i], batch_view_dist2(&ents[j].model));
+        }
+    }
+    batch_order_groups(descs, dist, ngroups);
+    STFREE(dist);
+}
 
-        if(md1.vbo_idx != md2.vbo_idx) {
+static void batch_order_groups_anim(const struct ent_anim_rstate *ents, 
+                                    struct inst_group_desc *descs, size_t ngroups)
+{
+    STALLOC(float, dist, ngroups);
+    for(int i = 0; i < ngroups; i++) {
+        dist[i] = INFINITY;
+        for(int j = descs[i].start_idx; j <= descs[i].end_idx; j++) {
+            dist[i] = MIN(dist[i], batch_view_dist2(&ents[j].model));
+        }
+    }
+    batch_order_groups(descs, dist, ngroups);
+    STFREE(dist);
+}
 
-            curr.end_idx = i - 1;
-            out[ret++] = curr;
-            curr = (struct draw_call_desc){
-                .vbo_idx = md2.vbo_idx,
-                .start_idx = i,
-            };
+/* Same as 'batch_order_groups', for the per-chunk batches */
+static void batch_order_chunks(const vec_rstat_t *ents, struct chunk_batch_desc *descs, size_t nbatches)
+{
+    STALLOC(float, dist, nbatches);
+    for(int i = 0; i < nbatches; i++) {
+        dist[i] = INFINITY;
+        for(int j = descs[i].start_idx; j <= descs[i].end_idx; j++) {
+            dist[i] = MIN(dist[i], batch_view_dist2(&vec_AT(ents, j).model));
         }
-        if(ret == maxout)
-            break;
     }
 
-    curr.end_idx = i - 1;
-    out[ret++] = curr;
+    for(int i = 1; i < nbatches; i++) {
+        int j = i;
+        while(j > 0 && dist[j] < dist[j - 1]) {
 
-    return ret;
+            struct chunk_batch_desc tmp = descs[j - 1];
+            descs[j - 1] = descs[j];
+            descs[j] = tmp;
+
+            float tmpd = dist[j - 1];
+            dist[j - 1] = dist[j];
+            dist[j] = tmpd;
+            j--;
+        }
+    }
+    STFREE(dist);
 }
 
-static void batch_ring_append_mats(struct gl_batch *batch, struct render_private *priv)
+static void batch_make_mats_block(struct gl_batch *batch, struct render_private *priv,
+                                  float out[static MATS_BLOCK_FLOATS])
 {
-    /* Push a lookup table mapping the per-vertex material index to 
+    /* A lookup table mapping the per-vertex material index to 
      * a texture slot inside the list of texture arrays */
+    float *tex_coords = out;
+    int slot = 0;
+    if(s_bindless) {
+        R_GL_Texture_BindlessSlot(priv->material_arr.id, &slot);
+    }
+
     for(int k = 0; k < MAX_MATERIALS; k++) {
-        if(k < priv->num_materials) {
+        if(k < priv->num_materials && s_bindless) {
+            tex_coords[k * 2 + 0] = slot;
+            tex_coords[k * 2 + 1] = k;
+        }else if(k < priv->num_materials) {
             struct tex_desc td = batch_tdesc_for_tid(batch, priv->materials[k].texture.id);
-            vec2_t tex_arr_coord = (vec2_t){td.arr_idx, td.tex_idx};
-            R_GL_RingbufferAppendLast(batch->attr_ring, &tex_arr_coord, sizeof(vec2_t));
+            tex_coords[k * 2 + 0] = td.arr_idx;
+            tex_coords[k * 2 + 1] = td.tex_idx;
         }else{
-            vec2_t tex_arr_coord = (vec2_t){0.0f, 0.0f};
-            R_GL_RingbufferAppendLast(batch->attr_ring, &tex_arr_coord, sizeof(vec2_t));
+            tex_coords[k * 2 + 0] = 0.0f;
+            tex_coords[k * 2 + 1] = 0.0f;
         }
     }
 
-    /* Push the material attributes */
+    /* The material attributes */
+    float *props = out + MAX_MATERIALS * 2;
     for(int k = 0; k < MAX_MATERIALS; k++) {
+        float *curr = props + k * 8;
         if(k < priv->num_materials) {
             struct material *mat = &priv->materials[k];
-            float zero = 0.0f;
-            R_GL_RingbufferAppendLast(batch->attr_ring, &mat->ambient_intensity, sizeof(float));
-            R_GL_RingbufferAppendLast(batch->attr_ring, &zero, sizeof(float));
-            R_GL_RingbufferAppendLast(batch->attr_ring, &mat->diffuse_clr, sizeof(vec3_t));
-            R_GL_RingbufferAppendLast(batch->attr_ring, &mat->specular_clr, sizeof(vec3_t));
+            curr[0] = mat->ambient_intensity;
+            curr[1] = 0.0f;
+            memcpy(curr + 2, &mat->diffuse_clr, sizeof(vec3_t));
+            memcpy(curr + 5, &mat->specular_clr, sizeof(vec3_t));
         }else{
-            float zero[8] = {0};
-            R_GL_RingbufferAppendLast(batch->attr_ring, &zero, sizeof(zero));
+            memset(curr, 0, 8 * sizeof(float));
         }
     }
 }
 
+/* Each instance's attributes are assembled on the stack and written to the 
+ * ring with a single call. This way they are copied straight into the 
+ * persistently mapped buffer, and the fallback path maps the buffer once per 
+ * instance rather than once per attribute.
+ */
+static void batch_ring_write(struct gl_batch *batch, bool first, const void *data, size_t size)
+{
+    if(first) {
+        R_GL_RingbufferPush(batch->attr_ring, data, size);
+    }else{
+        R_GL_RingbufferAppendLast(batch->attr_ring, data, size);
+    }
+}
+
 static void batch_push_stat_attrs(struct gl_batch *batch, const struct ent_stat_rstate *ents,
                                   struct draw_call_desc dcall, struct inst_group_desc *descs)
 {
@@ -854,14 +943,14 @@ static void batch_push_stat_attrs(struct gl_batch *batch, const struct ent_stat_
         const struct inst_group_desc *curr = descs + i;
         struct render_private *priv = curr->render_private;
 
+        float attrs[16 + MATS_BLOCK_FLOATS];
+        batch_make_mats_block(batch, priv, attrs + 16);
+
         for(int j = curr->start_idx; j <= curr->end_idx; j++) {
         
-            if(i == dcall.start_idx && j == curr->start_idx) {
-                R_GL_RingbufferPush(batch->attr_ring, &ents[j].model, sizeof(mat4x4_t));
-            }else{
-                R_GL_RingbufferAppendLast(batch->attr_ring, &ents[j].model, sizeof(mat4x4_t));
-            }
-            batch_ring_append_mats(batch, priv);
+            memcpy(attrs, &ents[j].model, sizeof(mat4x4_t));
+            batch_ring_write(batch, i == dcall.start_idx && j == curr->start_idx, 
+                attrs, sizeof(attrs));
         }
         ninsts += curr->end_idx - curr->start_idx + 1;
     }
@@ -893,15 +982,10 @@ static void batch_push_stat_attrs_depth(struct gl_batch *batch, const struct ent
     for(int i = dcall.start_idx; i <= dcall.end_idx; i++) {
 
         const struct inst_group_desc *curr = descs + i;
-        struct render_private *priv = curr->render_private;
 
         for(int j = curr->start_idx; j <= curr->end_idx; j++) {
-     
-            if(i == dcall.start_idx && j == curr->start_idx) {
-                R_GL_RingbufferPush(batch->attr_ring, &ents[j].model, sizeof(mat4x4_t));
-            }else{
-                R_GL_RingbufferAppendLast(batch->attr_ring, &ents[j].model, sizeof(mat4x4_t));
-            }
+            batch_ring_write(batch, i == dcall.start_idx && j == curr->start_idx, 
+                &ents[j].model, sizeof(mat4x4_t));
         }
 
         ninsts += curr->end_idx - curr->start_idx + 1;
@@ -932,12 +1016,11 @@ static void batch_push_anim_attrs(struct gl_batch *batch, const struct ent_anim_
      *  +--------------------------------------------------+
      *  | mat4x4_t (16 floats)                             | (normal matrix)
      *  +--------------------------------------------------+
-     *  | MAX_JOINTS * mat4x4_t (1536 floats)              | (curr pose matrices)
-     *  +--------------------------------------------------+
-     *  | MAX_JOINTS * mat4x4_t (1536 floats)              | (inverse bind pose matrices)
+     *  | vec4_t (4 floats)                                | (pose base, num joints)
      *  +--------------------------------------------------+
      *
-     * In total, 3264 floats (13056 bytes) are pushed per instance.
+     * In total, 196 floats (784 bytes) are pushed per instance. The skinning
+     * matrices themselves are read from the shared pose buffer.
      */
     size_t ninsts = 0;
     for(int i = dcall.start_idx; i <= dcall.end_idx; i++) {
@@ -945,41 +1028,33 @@ static void batch_push_anim_attrs(struct gl_batch *batch, const struct ent_anim_
         const struct inst_group_desc *curr = descs + i;
         struct render_private *priv = curr->render_private;
 
+        float attrs[16 + MATS_BLOCK_FLOATS + 16 + 4];
+        batch_make_mats_block(batch, priv, attrs + 16);
+
         for(int j = curr->start_idx; j <= curr->end_idx; j++) {
         
-            if(i == dcall.start_idx && j == curr->start_idx) {
-                R_GL_RingbufferPush(batch->attr_ring, &ents[j].model, sizeof(mat4x4_t));
-            }else{
-                R_GL_RingbufferAppendLast(batch->attr_ring, &ents[j].model, sizeof(mat4x4_t));
-            }
-            batch_ring_append_mats(batch, priv);
-
-            mat4x4_t model, normal;
-            PFM_Mat4x4_Inverse((mat4x4_t*)&ents[j].model, &model);
-            PFM_Mat4x4_Transpose(&model, &normal);
+            float *pose = attrs + 16 + MATS_BLOCK_FLOATS + 16;
+            memcpy(attrs, &ents[j].model, sizeof(mat4x4_t));
+            memcpy(attrs + 16 + MATS_BLOCK_FLOATS, &ents[j].model, sizeof(mat4x4_t));
 
-            R_GL_RingbufferAppendLast(batch->attr_ring, &ents[j].model, sizeof(mat4x4_t));
+            pose[0] = ents[j].pose_base;
+            pose[1] = ents[j].njoints;
+            pose[2] = 0.0f;
+            pose[3] = 0.0f;
 
-            const size_t njoints = ents[j].njoints;
-            const size_t matsize = njoints * sizeof(mat4x4_t);
-            const size_t pad = (MAX_JOINTS - njoints) * sizeof(mat4x4_t);
-
-            R_GL_RingbufferAppendLast(batch->attr_ring, ents[j].curr_pose, matsize);
-            R_GL_RingbufferExtendLast(batch->attr_ring, pad);
-
-            R_GL_RingbufferAppendLast(batch->attr_ring, ents[j].inv_bind_pose, matsize);
-            R_GL_RingbufferExtendLast(batch->attr_ring, pad);
+            batch_ring_write(batch, i == dcall.start_idx && j == curr->start_idx, 
+                attrs, sizeof(attrs));
         }
         ninsts += curr->end_idx - curr->start_idx + 1;
     }
     size_t begin, end;
     R_GL_RingbufferGetLastRange(batch->attr_ring, &begin, &end);
-    assert(end > begin ? (end - begin == 13056 * ninsts)
-                       : ((ANIM_ATTR_RING_SZ - begin) + end == 13056 * ninsts));
+    assert(end > begin ? (end - begin == 784 * ninsts)
+                       : ((ANIM_ATTR_RING_SZ - begin) + end == 784 * ninsts));
 
     R_GL_StateSet(GL_U_ATTR_STRIDE, (struct uval){ 
         .type = UTYPE_INT, 
-        .val.as_int = 3264
+        .val.as_int = 196
     });
     R_GL_StateInstall(GL_U_ATTR_STRIDE, R_GL_Shader_GetCurrActive());
 }
@@ -991,13 +1066,13 @@ static void batch_push_cmds(struct gl_batch *batch, struct draw_call_desc dcall,
     for(int i = dcall.start_idx; i <= dcall.end_idx; i++) {
 
         struct render_private *priv = descs[i].render_private;
-        struct mesh_desc mdesc = batch_mdesc_for_vbo(batch, priv->mesh.VBO);
-        assert(mdesc.offset % batch_vert_alignment(batch->type) == 0);
+        GLuint first, count;
+        batch_lod_range(priv, descs[i].lod, &first, &count);
 
         struct GL_DAI_Cmd cmd = (struct GL_DAI_Cmd){
-            .count = priv->mesh.num_verts,
+            .count = count,
             .instance_count = descs[i].end_idx - descs[i].start_idx + 1,
-            .first_index = mdesc.offset / batch_vert_alignment(batch->type),
+            .first_index = batch_first_vert(batch, priv->mesh.VBO) + first,
             .base_instance = inst_idx,
         };
 
@@ -1024,7 +1099,6 @@ static void batch_multidraw_legacy(struct gl_batch *batch, struct draw_call_desc
 
         const struct inst_group_desc *curr = descs + i;
         struct render_private *priv = curr->render_private;
-        struct mesh_desc mdesc = batch_mdesc_for_vbo(batch, priv->mesh.VBO);
 
         R_GL_StateSet(GL_U_ATTR_OFFSET, (struct uval){ 
             .type = UTYPE_INT, 
@@ -1032,8 +1106,9 @@ static void batch_multidraw_legacy(struct gl_batch *batch, struct draw_call_desc
         });
         R_GL_StateInstall(GL_U_ATTR_OFFSET, R_GL_Shader_GetCurrActive());
 
-        GLint first = mdesc.offset / batch_vert_alignment(batch->type);
-        GLint count = priv->mesh.num_verts;
+        GLuint first, count;
+        batch_lod_range(priv, curr->lod, &first, &count);
+        first += batch_first_vert(batch, priv->mesh.VBO);
         size_t instcount = curr->end_idx - curr->start_idx + 1;
 
         glDrawArraysInstanced(GL_TRIANGLES, first, count, instcount);
@@ -1067,15 +1142,154 @@ static void batch_multidraw(struct gl_batch *batch, struct draw_call_desc dcall,
         assert(cmd_end % sizeof(struct GL_DAI_Cmd) == 0);
         size_t ncmds_begin = cmd_end / sizeof(struct GL_DAI_Cmd);
         GL_PERF_CALL("multidraw", glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)0, ncmds_begin, 0));
+        PERF_COUNTER_ADD("render.multidraw_calls", 2);
     }else{
         size_t ncmds = dcall.end_idx - dcall.start_idx + 1;
         GL_PERF_CALL("multidraw", glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)cmd_begin, ncmds, 0));
+        PERF_COUNTER_ADD("render.multidraw_calls", 1);
     }
+    PERF_COUNTER_ADD("render.multidraw_cmds", dcall.end_idx - dcall.start_idx + 1);
 
     R_GL_RingbufferSyncLast(batch->cmd_ring);
     GL_ASSERT_OK();
 }
 
+static void batch_buffer_upload(GLuint *buff, size_t *buff_size, const void *data, size_t size)
+{
+    if(!*buff) {
+        glGenBuffers(1, buff);
+        Perf_MemAlloc(PERF_MEM_GPU_BATCH_BUFFERS, 0);
+    }
+    Perf_MemRealloc(PERF_MEM_GPU_BATCH_BUFFERS, *buff_size, size);
+    *buff_size = size;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buff);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+static void batch_plane_eq(const struct plane *plane, GLfloat out[4])
+{
+    out[0] = plane->normal.x;
+    out[1] = plane->normal.y;
+    out[2] = plane->normal.z;
+    out[3] = -PFM_Vec3_Dot((vec3_t*)&plane->normal, (vec3_t*)&plane->point);
+}
+
+static bool batch_cull_enabled(const struct gl_batch *batch)
+{
+    return s_cull_frustum
+        && batch->type == BATCH_TYPE_STAT
+        && GL_ARB_multi_draw_indirect
+        && R_ComputeShaderSupported();
+}
+
+/* Cull the instances of the draw call against 's_cull_frustum' on the GPU
+ * and draw the ones that remain. The compute shader reads the model matrices 
+ * from the attribute ring, which must already hold the attributes for this
+ * draw call. The surviving draw IDs are sourced from the 's_cull_ids' buffer
+ * instead of the identity draw ID buffer.
+ */
+static void batch_multidraw_culled(struct gl_batch *batch, const struct ent_stat_rstate *ents,
+                                   struct draw_call_desc dcall, struct inst_group_desc *descs)
+{
+    const size_t ncmds = dcall.end_idx - dcall.start_idx + 1;
+    const size_t cmds_size = sizeof(struct cull_header) + ncmds * sizeof(struct GL_DAI_Cmd);
+
+    STALLOC(GLuint, cmds_buff, cmds_size / sizeof(GLuint));
+    STALLOC(struct GL_DAI_Cmd, out_cmds, ncmds);
+    STALLOC(GLfloat, bounds, ncmds * 8);
+
+    struct cull_header *hdr = (struct cull_header*)cmds_buff;
+    struct GL_DAI_Cmd *cmds = (struct GL_DAI_Cmd*)(hdr + 1);
+    memset(hdr, 0, sizeof(*hdr));
+
+    const struct plane *planes[] = {
+        &s_cull_frustum->top, &s_cull_frustum->bot, &s_cull_frustum->left, 
+        &s_cull_frustum->right, &s_cull_frustum->nearp, &s_cull_frustum->farp
+    };
+    for(int i = 0; i < ARR_SIZE(planes); i++) {
+        batch_plane_eq(planes[i], hdr->planes[i]);
+    }
+
+    size_t inst_idx = 0;
+    for(int i = dcall.start_idx; i <= dcall.end_idx; i++) {
+
+        const struct inst_group_desc *curr = descs + i;
+        struct render_private *priv = curr->render_private;
+        const struct aabb *aabb = &ents[curr->start_idx].aabb;
+        const int idx = i - dcall.start_idx;
+        GLuint first, count;
+        batch_lod_range(priv, curr->lod, &first, &count);
+
+        cmds[idx] = (struct GL_DAI_Cmd){
+            .count = count,
+            .instance_count = curr->end_idx - curr->start_idx + 1,
+            .first_index = batch_first_vert(batch, priv->mesh.VBO) + first,
+            .base_instance = inst_idx,
+        };
+        out_cmds[idx] = cmds[idx];
+        out_cmds[idx].instance_count = 0;
+
+        GLfloat *box = &bounds[idx * 8];
+        box[0] = aabb->x_min; box[1] = aabb->y_min; box[2] = aabb->z_min; box[3] = 0.0f;
+        box[4] = aabb->x_max; box[5] = aabb->y_max; box[6] = aabb->z_max; box[7] = 0.0f;
+
+        inst_idx += cmds[idx].instance_count;
+    }
+    hdr->ncmds = ncmds;
+    hdr->ninsts = inst_idx;
+
+    batch_buffer_upload(&s_cull_cmds_ssbo, &s_cull_cmds_sz, cmds_buff, cmds_size);
+    batch_buffer_upload(&s_cull_bounds_ssbo, &s_cull_bounds_sz, bounds, ncmds * 8 * sizeof(GLfloat));
+    batch_buffer_upload(&s_cull_out_cmds, &s_cull_out_cmds_sz, out_cmds, ncmds * sizeof(struct GL_DAI_Cmd));
+    batch_buffer_upload(&s_cull_ids, &s_cull_ids_sz, NULL, inst_idx * sizeof(GLint));
+
+    STFREE(cmds_buff);
+    STFREE(out_cmds);
+    STFREE(bounds);
+
+    GLuint draw_prog = R_GL_Shader_GetCurrActive();
+    GLuint cull_prog = R_GL_Shader_GetProgForName("cull");
+    assert(cull_prog != -1);
+
+    R_GL_RingbufferBindLast(batch->attr_ring, ATTR_RING_TUNIT, cull_prog, "attrbuff");
+    R_GL_StateInstall(GL_U_ATTR_STRIDE, cull_prog);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, s_cull_cmds_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, s_cull_bounds_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, s_cull_out_cmds);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, s_cull_ids);
+
+    size_t ngroups = (inst_idx + CULL_WORKGROUP_SZ - 1) / CULL_WORKGROUP_SZ;
+    GL_PERF_CALL("cull", glDispatchCompute(ngroups, 1, 1));
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    R_GL_Shader_InstallProg(draw_prog);
+    R_GL_StateSet(GL_U_ATTR_OFFSET, (struct uval){ 
+        .type = UTYPE_INT, 
+        .val.as_int = 0
+    });
+    R_GL_StateInstall(GL_U_ATTR_OFFSET, draw_prog);
+
+    /* Source the draw IDs from the compacted list for the bound VAO */
+    glBindBuffer(GL_ARRAY_BUFFER, s_cull_ids);
+    glVertexAttribIPointer(4, 1, GL_INT, sizeof(GLint), 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, s_cull_out_cmds);
+    GL_PERF_CALL("multidraw", glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)0, ncmds, 0));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, s_draw_id_vbo);
+    glVertexAttribIPointer(4, 1, GL_INT, sizeof(GLint), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    PERF_COUNTER_ADD("render.multidraw_calls", 1);
+    PERF_COUNTER_ADD("render.multidraw_cmds", ncmds);
+    PERF_COUNTER_ADD("render.gpu_culled_insts", inst_idx);
+    GL_ASSERT_OK();
+}
+
 static void batch_do_drawcall_stat(struct gl_batch *batch, const struct ent_stat_rstate *ents,
                                    struct draw_call_desc dcall, struct inst_group_desc *descs,
                                    enum render_pass pass)
@@ -1092,10 +1306,12 @@ static void batch_do_drawcall_stat(struct gl_batch *batch, const struct ent_stat
 
     R_GL_RingbufferBindLast(batch->attr_ring, ATTR_RING_TUNIT, R_GL_Shader_GetCurrActive(), "attrbuff");
 
-    GLuint VAO = batch->vbos[dcall.vbo_idx].VAO;
+    GLuint VAO = batch_pool_vao(batch->type);
     glBindVertexArray(VAO);
 
-    if(!GL_ARB_multi_draw_indirect) {
+    if(batch_cull_enabled(batch)) {
+        batch_multidraw_culled(batch, ents, dcall, descs);
+    }else if(!GL_ARB_multi_draw_indirect) {
         batch_multidraw_legacy(batch, dcall, descs);
     }else{
         batch_multidraw(batch, dcall, descs);
@@ -1110,8 +1326,10 @@ static void batch_do_drawcall_anim(struct gl_batch *batch, const struct ent_anim
 {
     batch_push_anim_attrs(batch, ents, dcall, descs);
     R_GL_RingbufferBindLast(batch->attr_ring, ATTR_RING_TUNIT, R_GL_Shader_GetCurrActive(), "attrbuff");
+    R_GL_PoseBuffBind();
+    R_GL_StateInstall(GL_U_POSE_BUFF, R_GL_Shader_GetCurrActive());
 
-    GLuint VAO = batch->vbos[dcall.vbo_idx].VAO;
+    GLuint VAO = batch_pool_vao(batch->type);
     glBindVertexArray(VAO);
 
     if(!GL_ARB_multi_draw_indirect) {
@@ -1125,6 +1343,17 @@ static void batch_do_drawcall_anim(struct gl_batch *batch, const struct ent_anim
     GL_ASSERT_OK();
 }
 
+static void batch_bind_textures(struct gl_batch *batch)
+{
+    if(s_bindless) {
+        R_GL_Texture_BindlessBind(TEX_HANDLES_TUNIT, R_GL_Shader_GetCurrActive());
+        return;
+    }
+    for(int i = 0; i < batch->ntexarrs; i++) {
+        R_GL_Texture_BindArray(&batch->textures[i].arr, R_GL_Shader_GetCurrActive());
+    }
+}
+
 static void batch_render_stat(struct gl_batch *batch, struct ent_stat_rstate *ents, 
                               size_t nents, enum render_pass pass)
 {
@@ -1132,17 +1361,18 @@ static void batch_render_stat(struct gl_batch *batch, struct ent_stat_rstate *en
 
     struct inst_group_desc descs[MAX_BATCHES];
     size_t ninsts = batch_sort_by_inst_stat(ents, nents, descs, ARR_SIZE(descs));
-
-    struct draw_call_desc dcalls[MAX_BATCHES];
-    size_t ndcalls = batch_sort_by_vbo(batch, descs, ninsts, dcalls, ARR_SIZE(dcalls));
-
-    for(int i = 0; i < batch->ntexarrs; i++) {
-        R_GL_Texture_BindArray(&batch->textures[i].arr, R_GL_Shader_GetCurrActive());
+    if(s_front_to_back) {
+        batch_order_groups_stat(ents, descs, ninsts);
     }
 
-    for(int i = 0; i < ndcalls; i++) {
-        batch_do_drawcall_stat(batch, ents, dcalls[i], descs, pass);
-    }
+    /* All the meshes share the same buffer, so the whole batch is a single draw */
+    struct draw_call_desc dcall = (struct draw_call_desc){
+        .start_idx = 0,
+        .end_idx = ninsts - 1,
+    };
+
+    batch_bind_textures(batch);
+    batch_do_drawcall_stat(batch, ents, dcall, descs, pass);
 
     GL_PERF_RETURN_VOID();
 }
@@ -1153,21 +1383,28 @@ static void batch_render_anim(struct gl_batch *batch, struct ent_anim_rstate *en
 
     struct inst_group_desc descs[MAX_BATCHES];
     size_t ninsts = batch_sort_by_inst_anim(ents, nents, descs, ARR_SIZE(descs));
-
-    struct draw_call_desc dcalls[MAX_BATCHES];
-    size_t ndcalls = batch_sort_by_vbo(batch, descs, ninsts, dcalls, ARR_SIZE(dcalls));
-
-    for(int i = 0; i < batch->ntexarrs; i++) {
-        R_GL_Texture_BindArray(&batch->textures[i].arr, R_GL_Shader_GetCurrActive());
+    if(s_front_to_back) {
+        batch_order_groups_anim(ents, descs, ninsts);
     }
 
-    for(int i = 0; i < ndcalls; i++) {
-        batch_do_drawcall_anim(batch, ents, dcalls[i], descs);
-    }
+    struct draw_call_desc dcall = (struct draw_call_desc){
+        .start_idx = 0,
+        .end_idx = ninsts - 1,
+    };
+
+    batch_bind_textures(batch);
+    batch_do_drawcall_anim(batch, ents, dcall, descs);
 
     GL_PERF_RETURN_VOID();
 }
 
+/* Without shadows, the shadow map lookups are compiled out of the program 
+ * instead of being done against a stale map. */
+static uint32_t batch_features(bool shadows)
+{
+    return shadows ? SHADER_FEATURE_ALL : (SHADER_FEATURE_ALL & ~SHADER_FEATURE_SHADOWS);
+}
+
 static void batch_render_anim_all(vec_ranim_t *ents, bool shadows, enum render_pass pass)
 {
     size_t nanim = vec_size(ents);
@@ -1179,13 +1416,23 @@ static void batch_render_anim_all(vec_ranim_t *ents, bool shadows, enum render_p
         R_GL_Shader_Install("batched.mesh.animated.depth");
         break;
     case RENDER_PASS_REGULAR:
-        R_GL_Shader_Install("batched.mesh.animated.textured-phong-shadowed");
+        if(s_prepass) {
+            R_GL_Shader_Install(s_bindless ? "batched.mesh.animated.depth-prepass.bindless"
+                                           : "batched.mesh.animated.depth-prepass");
+            break;
+        }
+        R_GL_Shader_InstallPermutation(s_bindless ? "batched.mesh.animated.textured-phong-shadowed.bindless"
+                                                  : "batched.mesh.animated.textured-phong-shadowed", 
+                                       batch_features(shadows));
         break;
     default: assert(0);
     }
 
     size_t ntranslucent = batch_anim_sort_by_transparency(ents, nanim);
     size_t nopaque = nanim - ntranslucent;
+    if(s_prepass) {
+        ntranslucent = 0;
+    }
 
     for(int i = 0; i < nanim; i++) {
         batch_append(s_anim_batch, vec_AT(ents, i).render_private);
@@ -1217,12 +1464,23 @@ static void batch_render_stat_all(vec_rstat_t *ents, bool shadows,
     if(nbatches == 0)
         return;
 
+    if(s_front_to_back) {
+        batch_order_chunks(ents, descs, nbatches);
+    }
+
     switch(pass) {
     case RENDER_PASS_DEPTH:
         R_GL_Shader_Install("batched.mesh.static.depth");
         break;
     case RENDER_PASS_REGULAR:
-        R_GL_Shader_Install("batched.mesh.static.textured-phong-shadowed");
+        if(s_prepass) {
+            R_GL_Shader_Install(s_bindless ? "batched.mesh.static.depth-prepass.bindless"
+                                           : "batched.mesh.static.depth-prepass");
+            break;
+        }
+        R_GL_Shader_InstallPermutation(s_bindless ? "batched.mesh.static.textured-phong-shadowed.bindless"
+                                                  : "batched.mesh.static.textured-phong-shadowed", 
+                                       batch_features(shadows));
         break;
     default: assert(0);
     }
@@ -1267,6 +1525,9 @@ static void batch_render_stat_all(vec_rstat_t *ents, bool shadows,
         assert(batch);
         size_t ndraw = curr->end_idx - curr->start_idx + 1;
         size_t nopaque = ndraw - ntranslucent;
+        if(s_prepass) {
+            ntranslucent = 0;
+        }
 
         for(int i = 0; i < ndraw; i++) {
             batch_append(batch, vec_AT(ents, curr->start_idx + i).render_private);
@@ -1291,6 +1552,19 @@ static void batch_render_stat_all(vec_rstat_t *ents, bool shadows,
 
 bool R_GL_Batch_Init(void)
 {
+    s_pools[BATCH_TYPE_STAT] = R_GL_MeshPoolInit(MESH_POOL_SZ, batch_vert_alignment(BATCH_TYPE_STAT));
+    if(!s_pools[BATCH_TYPE_STAT])
+        goto fail_stat_pool;
+
+    s_bindless = R_BindlessTexturesSupported()
+              && R_GL_Shader_GetProgForName("batched.mesh.static.textured-phong-shadowed.bindless") > 0
+              && R_GL_Shader_GetProgForName("batched.mesh.animated.textured-phong-shadowed.bindless") > 0
+              && R_GL_Shader_GetProgForName("batched.mesh.static.depth-prepass.bindless") > 0
+              && R_GL_Shader_GetProgForName("batched.mesh.animated.depth-prepass.bindless") > 0;
+    s_pools[BATCH_TYPE_ANIM] = R_GL_MeshPoolInit(MESH_POOL_SZ, batch_vert_alignment(BATCH_TYPE_ANIM));
+    if(!s_pools[BATCH_TYPE_ANIM])
+        goto fail_anim_pool;
+
     s_anim_batch = batch_init(BATCH_TYPE_ANIM);
     if(!s_anim_batch)
         goto fail_anim_batch;
@@ -1308,6 +1582,7 @@ bool R_GL_Batch_Init(void)
     glGenBuffers(1, &s_draw_id_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, s_draw_id_vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(draw_id_buff), draw_id_buff, GL_STATIC_DRAW);
+    Perf_MemAlloc(PERF_MEM_GPU_BATCH_BUFFERS, sizeof(draw_id_buff));
 
     return true;
 
@@ -1316,6 +1591,10 @@ fail_id_batches:
 fail_chunk_batches:
     batch_destroy(s_anim_batch);
 fail_anim_batch:
+    R_GL_MeshPoolDestroy(s_pools[BATCH_TYPE_ANIM]);
+fail_anim_pool:
+    R_GL_MeshPoolDestroy(s_pools[BATCH_TYPE_STAT]);
+fail_stat_pool:
     return false;
 }
 
@@ -1338,6 +1617,27 @@ void R_GL_Batch_Shutdown(void)
     kh_destroy(batch, s_id_batches);
 
     glDeleteBuffers(1, &s_draw_id_vbo);
+    Perf_MemFree(PERF_MEM_GPU_BATCH_BUFFERS, sizeof(GLint) * MAX_INSTS);
+
+    GLuint buffs[] = {s_cull_cmds_ssbo, s_cull_bounds_ssbo, s_cull_out_cmds, s_cull_ids};
+    size_t sizes[] = {s_cull_cmds_sz, s_cull_bounds_sz, s_cull_out_cmds_sz, s_cull_ids_sz};
+    for(int i = 0; i < ARR_SIZE(buffs); i++) {
+        if(buffs[i]) {
+            glDeleteBuffers(1, &buffs[i]);
+            Perf_MemFree(PERF_MEM_GPU_BATCH_BUFFERS, sizes[i]);
+        }
+    }
+    s_cull_cmds_ssbo = s_cull_bounds_ssbo = s_cull_out_cmds = s_cull_ids = 0;
+    s_cull_cmds_sz = s_cull_bounds_sz = s_cull_out_cmds_sz = s_cull_ids_sz = 0;
+
+    for(int i = 0; i < ARR_SIZE(s_pools); i++) {
+        if(s_pool_vaos[i]) {
+            glDeleteVertexArrays(1, &s_pool_vaos[i]);
+        }
+        R_GL_MeshPoolDestroy(s_pools[i]);
+        s_pool_vaos[i] = 0;
+        s_pools[i] = NULL;
+    }
 }
 
 void R_GL_Batch_Draw(struct render_input *in)
@@ -1345,9 +1645,55 @@ void R_GL_Batch_Draw(struct render_input *in)
     GL_PERF_ENTER();
     GL_PERF_PUSH_GROUP(0, "batch::Draw");
 
+    /* Close some of the holes left by the meshes of destroyed batches */
+    for(int i = 0; i < ARR_SIZE(s_pools); i++) {
+        R_GL_MeshPoolCompact(s_pools[i], COMPACT_BYTES);
+    }
+
+    struct uval pos;
+    R_GL_StateGet(GL_U_VIEW_POS, &pos);
+    s_view_pos = pos.val.as_vec3;
+
+    s_front_to_back = true;
+    s_cull_frustum = in->gpu_culling ? &in->cam_frustum : NULL;
+    batch_render_anim_all(&in->cam_vis_anim, in->shadows, RENDER_PASS_REGULAR);
+    batch_render_stat_all(&in->cam_vis_stat, in->shadows, RENDER_PASS_REGULAR, BATCH_ID_NULL);
+    s_cull_frustum = NULL;
+    s_front_to_back = false;
+
+    GL_PERF_POP_GROUP();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_Batch_DrawDepthPrepass(struct render_input *in)
+{
+    GL_PERF_ENTER();
+    GL_PERF_PUSH_GROUP(0, "batch::DrawDepthPrepass");
+
+    struct uval pos;
+    R_GL_StateGet(GL_U_VIEW_POS, &pos);
+    s_view_pos = pos.val.as_vec3;
+
+    /* The prepass depths are pushed back slightly, so that the regular 
+     * pass passes the default depth test exactly where they were laid 
+     * down, regardless of how each program rounds the positions. */
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.0f, 1.0f);
+
+    s_prepass = true;
+    s_front_to_back = true;
+    s_cull_frustum = in->gpu_culling ? &in->cam_frustum : NULL;
     batch_render_anim_all(&in->cam_vis_anim, true, RENDER_PASS_REGULAR);
     batch_render_stat_all(&in->cam_vis_stat, true, RENDER_PASS_REGULAR, BATCH_ID_NULL);
+    s_cull_frustum = NULL;
+    s_front_to_back = false;
+    s_prepass = false;
 
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    GL_ASSERT_OK();
     GL_PERF_POP_GROUP();
     GL_PERF_RETURN_VOID();
 }
@@ -1357,8 +1703,8 @@ void R_GL_Batch_DrawWithID(struct render_input *in, enum batch_id *id)
     GL_PERF_ENTER();
     GL_PERF_PUSH_GROUP(0, "batch::DrawWithID");
 
-    batch_render_anim_all(&in->cam_vis_anim, true, RENDER_PASS_REGULAR);
-    batch_render_stat_all(&in->cam_vis_stat, true, RENDER_PASS_REGULAR, *id);
+    batch_render_anim_all(&in->cam_vis_anim, in->shadows, RENDER_PASS_REGULAR);
+    batch_render_stat_all(&in->cam_vis_stat, in->shadows, RENDER_PASS_REGULAR, *id);
 
     GL_PERF_POP_GROUP();
     GL_PERF_RETURN_VOID();
@@ -1369,8 +1715,27 @@ void R_GL_Batch_RenderDepthMap(struct render_input *in)
     GL_PERF_ENTER();
     GL_PERF_PUSH_GROUP(0, "batch::RenderDepthMap");
 
+    s_cull_frustum = in->gpu_culling ? &in->light_frustum : NULL;
     batch_render_anim_all(&in->light_vis_anim, true, RENDER_PASS_DEPTH);
     batch_render_stat_all(&in->light_vis_stat, true, RENDER_PASS_DEPTH, BATCH_ID_NULL);
+    s_cull_frustum = NULL;
+
+    GL_PERF_POP_GROUP();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_Batch_RenderStaticDepthMap(struct render_input *in)
+{
+    GL_PERF_ENTER();
+
+    if(R_GL_ShadowsStaticCached())
+        GL_PERF_RETURN_VOID();
+
+    GL_PERF_PUSH_GROUP(0, "batch::RenderStaticDepthMap");
+
+    s_cull_frustum = in->gpu_culling ? &in->light_frustum : NULL;
+    batch_render_stat_all(&in->light_vis_static, true, RENDER_PASS_DEPTH, BATCH_ID_NULL);
+    s_cull_frustum = NULL;
 
     GL_PERF_POP_GROUP();
     GL_PERF_RETURN_VOID();
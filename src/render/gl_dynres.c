@@ -0,0 +1,340 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "gl_render.h"
+#include "gl_perf.h"
+#include "gl_assert.h"
+#include "../main.h"
+#include "../perf.h"
+
+#include <math.h>
+#include <string.h>
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define CLAMP(a, min, max)  (MIN(MAX((a), (min)), (max)))
+#define NQUERY_SLOTS        (4)
+#define GPU_TIMER_HZ        (1000.0 * 1000.0 * 1000.0)
+/* The scale is not touched while the GPU time stays within this fraction 
+ * below the target, so that it does not keep hunting around it. */
+#define DEADBAND            (0.15f)
+#define MIN_STEP            (0.02f)
+#define SMOOTHING           (0.2)
+
+/* Every scene pass is bracketed by a pair of timestamp queries. They are 
+ * only ever polled, so the results come back a few frames late and no 
+ * frame waits for the GPU to catch up. The scale the scene was rendered
+ * at is kept alongside, to normalize the cost to that of a full-resolution
+ * frame.
+ */
+struct query_slot{
+    GLuint begin;
+    GLuint end;
+    float  scale;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static bool              s_enabled;
+static float             s_target_ms = 14.0f;
+static float             s_min_scale = 0.5f;
+static float             s_scale = 1.0f;
+/* Smoothed GPU time of the scene, as if it were rendered at full resolution */
+static double            s_full_cost_ms;
+
+static GLuint            s_fbo;
+static GLuint            s_color_tex;
+static GLuint            s_depth_rb;
+static int               s_fbo_dims[2];
+static int               s_scene_dims[2];
+static int               s_native_dims[2];
+static bool              s_scene_active;
+static struct query_slot *s_scene_query;
+
+static struct query_slot s_queries[NQUERY_SLOTS];
+static int               s_query_head;
+static int               s_query_tail;
+static int               s_query_pending;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void fbo_destroy(void)
+{
+    if(s_fbo) {
+        glDeleteFramebuffers(1, &s_fbo);
+    }
+    if(s_color_tex) {
+        glDeleteTextures(1, &s_color_tex);
+    }
+    if(s_depth_rb) {
+        glDeleteRenderbuffers(1, &s_depth_rb);
+    }
+    s_fbo = 0;
+    s_color_tex = 0;
+    s_depth_rb = 0;
+    s_fbo_dims[0] = s_fbo_dims[1] = 0;
+}
+
+/* The target is always allocated at the native resolution and the scene is 
+ * drawn into its' lower-left corner, so changing the scale never needs a 
+ * reallocation. 
+ */
+static bool fbo_reserve(int width, int height)
+{
+    if(s_fbo && s_fbo_dims[0] == width && s_fbo_dims[1] == height)
+        return true;
+
+    fbo_destroy();
+
+    glGenTextures(1, &s_color_tex);
+    glBindTexture(GL_TEXTURE_2D, s_color_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &s_depth_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, s_depth_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &s_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, s_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, s_color_tex, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, s_depth_rb);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if(status != GL_FRAMEBUFFER_COMPLETE) {
+        fbo_destroy();
+        return false;
+    }
+
+    s_fbo_dims[0] = width;
+    s_fbo_dims[1] = height;
+    GL_ASSERT_OK();
+    return true;
+}
+
+static void queries_destroy(void)
+{
+    for(int i = 0; i < NQUERY_SLOTS; i++) {
+        if(s_queries[i].begin) {
+            glDeleteQueries(1, &s_queries[i].begin);
+            glDeleteQueries(1, &s_queries[i].end);
+        }
+    }
+    memset(s_queries, 0, sizeof(s_queries));
+    s_query_head = s_query_tail = s_query_pending = 0;
+}
+
+static void scale_update(float sample_scale, double sample_ms)
+{
+    double full_ms = sample_ms / (sample_scale * sample_scale);
+    if(s_full_cost_ms == 0.0) {
+        s_full_cost_ms = full_ms;
+    }else{
+        s_full_cost_ms += (full_ms - s_full_cost_ms) * SMOOTHING;
+    }
+
+    /* The cost of the scene is mostly proportional to the number of pixels
+     * shaded, so pick the scale which would bring it to the target. */
+    double curr_ms = s_full_cost_ms * s_scale * s_scale;
+    if(curr_ms <= s_target_ms && curr_ms >= s_target_ms * (1.0f - DEADBAND))
+        return;
+
+    float desired = sqrt(s_target_ms / MAX(s_full_cost_ms, 0.001));
+    desired = CLAMP(desired, s_min_scale, 1.0f);
+    if(fabs(desired - s_scale) < MIN_STEP && desired != 1.0f && desired != s_min_scale)
+        return;
+
+    s_scale += (desired - s_scale) * 0.5f;
+    s_scale = CLAMP(s_scale, s_min_scale, 1.0f);
+}
+
+static void queries_poll(void)
+{
+    while(s_query_pending > 0) {
+
+        struct query_slot *slot = &s_queries[s_query_tail];
+        GLint avail = GL_FALSE;
+        glGetQueryObjectiv(slot->end, GL_QUERY_RESULT_AVAILABLE, &avail);
+        if(!avail)
+            break;
+
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(slot->begin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(slot->end, GL_QUERY_RESULT, &end);
+        if(end > begin) {
+            scale_update(slot->scale, (end - begin) * 1000.0 / GPU_TIMER_HZ);
+        }
+
+        s_query_tail = (s_query_tail + 1) % NQUERY_SLOTS;
+        s_query_pending--;
+    }
+}
+
+static struct query_slot *queries_push(void)
+{
+    /* Skip timing the frame rather than waiting on the oldest results */
+    if(s_query_pending == NQUERY_SLOTS)
+        return NULL;
+
+    struct query_slot *slot = &s_queries[s_query_head];
+    if(!slot->begin) {
+        glGenQueries(1, &slot->begin);
+        glGenQueries(1, &slot->end);
+    }
+    slot->scale = s_scale;
+
+    s_query_head = (s_query_head + 1) % NQUERY_SLOTS;
+    s_query_pending++;
+    return slot;
+}
+
+static void dynres_reset(void)
+{
+    fbo_destroy();
+    queries_destroy();
+    s_scale = 1.0f;
+    s_full_cost_ms = 0.0;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_DynresBeginScene(void)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    if(!s_enabled)
+        GL_PERF_RETURN_VOID();
+
+    Engine_WinDrawableSize(&s_native_dims[0], &s_native_dims[1]);
+    if(s_native_dims[0] <= 0 || s_native_dims[1] <= 0)
+        GL_PERF_RETURN_VOID();
+
+    if(!fbo_reserve(s_native_dims[0], s_native_dims[1])) {
+        PRINT("WARNING: Failed to create the dynamic resolution render target. "
+              "Rendering at native resolution.\n");
+        s_enabled = false;
+        GL_PERF_RETURN_VOID();
+    }
+
+    queries_poll();
+    s_scene_query = queries_push();
+    if(s_scene_query) {
+        glQueryCounter(s_scene_query->begin, GL_TIMESTAMP);
+    }
+
+    s_scene_dims[0] = MAX(1, (int)(s_native_dims[0] * s_scale + 0.5f));
+    s_scene_dims[1] = MAX(1, (int)(s_native_dims[1] * s_scale + 0.5f));
+
+    glBindFramebuffer(GL_FRAMEBUFFER, s_fbo);
+    glViewport(0, 0, s_scene_dims[0], s_scene_dims[1]);
+    s_scene_active = true;
+
+    PERF_COUNTER_ADD("render.dynres_scale_pct", (int64_t)(s_scale * 100.0f + 0.5f));
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_DynresEndScene(void)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    if(!s_scene_active)
+        GL_PERF_RETURN_VOID();
+
+    s_scene_active = false;
+    if(s_scene_query) {
+        glQueryCounter(s_scene_query->end, GL_TIMESTAMP);
+        s_scene_query = NULL;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, s_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, s_scene_dims[0], s_scene_dims[1],
+        0, 0, s_native_dims[0], s_native_dims[1], GL_COLOR_BUFFER_BIT, 
+        (s_scene_dims[0] == s_native_dims[0]) ? GL_NEAREST : GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, s_native_dims[0], s_native_dims[1]);
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_DynresSetEnabled(const bool *on)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    if(*on == s_enabled)
+        return;
+
+    s_enabled = *on;
+    if(!s_enabled) {
+        dynres_reset();
+    }
+}
+
+void R_GL_DynresSetTarget(const float *ms)
+{
+    ASSERT_IN_RENDER_THREAD();
+    s_target_ms = *ms;
+}
+
+void R_GL_DynresSetMinScale(const float *scale)
+{
+    ASSERT_IN_RENDER_THREAD();
+    s_min_scale = *scale;
+    s_scale = CLAMP(s_scale, s_min_scale, 1.0f);
+}
+
+void R_GL_DynresShutdown(void)
+{
+    dynres_reset();
+    s_enabled = false;
+}
+
@@ -0,0 +1,277 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "public/render_ctrl.h"
+#include "gl_perf.h"
+#include "gl_assert.h"
+#include "gl_shader.h"
+#include "gl_state.h"
+#include "../main.h"
+
+#include <string.h>
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define DIV_ROUND_UP(a, b)  (((a) + (b) - 1) / (b))
+#define NREADBACK_SLOTS     (2)
+#define HIZ_BLOCK           (16)
+#define HIZ_WORKGROUP_SIZE  (8)
+#define HIZ_DEPTH_TUNIT     (GL_TEXTURE7)
+
+/* Same scheme as the LOS readback: the reduced depth of every capture is 
+ * copied into a host-visible buffer and fenced, and picked up by a later 
+ * call to R_GL_HiZRead once the fence is signalled. The view-projection 
+ * matrix that the depth was rendered with is kept alongside it.
+ */
+struct readback_slot{
+    GLuint   buffer;
+    GLsync   fence;
+    size_t   capacity;
+    size_t   size;
+    int      dims[2];
+    mat4x4_t view_proj;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static GLuint               s_depth_tex;
+static int                  s_depth_dims[2];
+static GLuint               s_out_ssbo;
+
+static struct readback_slot s_readback[NREADBACK_SLOTS];
+static int                  s_readback_head;
+static int                  s_readback_tail;
+static int                  s_readback_pending;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void slot_release(struct readback_slot *slot)
+{
+    if(slot->fence) {
+        glDeleteSync(slot->fence);
+        slot->fence = 0;
+    }
+}
+
+static void slot_destroy(struct readback_slot *slot)
+{
+    slot_release(slot);
+    if(slot->buffer) {
+        glDeleteBuffers(1, &slot->buffer);
+    }
+    memset(slot, 0, sizeof(*slot));
+}
+
+static void slot_reserve(struct readback_slot *slot, size_t size)
+{
+    if(slot->buffer && slot->capacity >= size)
+        return;
+
+    size_t capacity = MAX(size, MAX(slot->capacity * 2, 4096));
+    if(!slot->buffer) {
+        glGenBuffers(1, &slot->buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot->buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    slot->capacity = capacity;
+}
+
+static void depth_reserve(int width, int height)
+{
+    if(s_depth_tex && s_depth_dims[0] == width && s_depth_dims[1] == height)
+        return;
+
+    if(!s_depth_tex) {
+        glGenTextures(1, &s_depth_tex);
+    }
+    glBindTexture(GL_TEXTURE_2D, s_depth_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, 
+        GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    s_depth_dims[0] = width;
+    s_depth_dims[1] = height;
+}
+
+static void readback_push(size_t size, const int dims[2], const mat4x4_t *view_proj)
+{
+    /* If the CPU has fallen behind by more than the number of slots, 
+     * drop the oldest results rather than waiting on them. */
+    if(s_readback_pending == NREADBACK_SLOTS) {
+        slot_release(&s_readback[s_readback_tail]);
+        s_readback_tail = (s_readback_tail + 1) % NREADBACK_SLOTS;
+        s_readback_pending--;
+    }
+
+    struct readback_slot *slot = &s_readback[s_readback_head];
+    slot_reserve(slot, size);
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, s_out_ssbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot->buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    slot->size = size;
+    slot->dims[0] = dims[0];
+    slot->dims[1] = dims[1];
+    slot->view_proj = *view_proj;
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    s_readback_head = (s_readback_head + 1) % NREADBACK_SLOTS;
+    s_readback_pending++;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_HiZCapture(const mat4x4_t *view_proj)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+    assert(R_ComputeShaderSupported());
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if(viewport[2] <= 0 || viewport[3] <= 0)
+        GL_PERF_RETURN_VOID();
+
+    /* Copying (rather than blitting) the depth buffer lets the driver do 
+     * the format conversion from whatever the default framebuffer uses. */
+    glActiveTexture(HIZ_DEPTH_TUNIT);
+    depth_reserve(viewport[2], viewport[3]);
+    glBindTexture(GL_TEXTURE_2D, s_depth_tex);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], 
+        viewport[2], viewport[3]);
+    glActiveTexture(GL_TEXTURE0);
+
+    const int dims[2] = {
+        DIV_ROUND_UP(viewport[2], HIZ_BLOCK),
+        DIV_ROUND_UP(viewport[3], HIZ_BLOCK)
+    };
+    const size_t out_size = dims[0] * dims[1] * sizeof(GLfloat);
+
+    if(!s_out_ssbo) {
+        glGenBuffers(1, &s_out_ssbo);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_out_ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, out_size, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    R_GL_Shader_Install("hiz");
+    GLuint shader_prog = R_GL_Shader_GetCurrActive();
+
+    R_GL_StateSet(GL_U_TEXTURE0, (struct uval){
+        .type = UTYPE_INT,
+        .val.as_int = HIZ_DEPTH_TUNIT - GL_TEXTURE0
+    });
+    R_GL_StateInstall(GL_U_TEXTURE0, shader_prog);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, s_out_ssbo);
+
+    glDispatchCompute(DIV_ROUND_UP(dims[0], HIZ_WORKGROUP_SIZE), 
+                      DIV_ROUND_UP(dims[1], HIZ_WORKGROUP_SIZE), 1);
+    readback_push(out_size, dims, view_proj);
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_HiZRead(void *out, const size_t *maxout, int out_dims[2], 
+                  mat4x4_t *out_view_proj, SDL_atomic_t *out_nread)
+{
+    GL_PERF_ENTER();
+
+    if(s_readback_pending == 0) {
+        SDL_AtomicSet(out_nread, 0);
+        GL_PERF_RETURN_VOID();
+    }
+
+    struct readback_slot *slot = &s_readback[s_readback_tail];
+    GLenum status = glClientWaitSync(slot->fence, 0, 0);
+
+    if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        SDL_AtomicSet(out_nread, 0);
+        GL_PERF_RETURN_VOID();
+    }
+
+    size_t read_size = MIN(slot->size, *maxout);
+    uint64_t read_begin = SDL_GetPerformanceCounter();
+    glBindBuffer(GL_COPY_READ_BUFFER, slot->buffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, read_size, out);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    Perf_RenderStall("render.stall_us.hiz_readback", read_begin);
+    out_dims[0] = slot->dims[0];
+    out_dims[1] = slot->dims[1];
+    *out_view_proj = slot->view_proj;
+
+    slot_release(slot);
+    s_readback_tail = (s_readback_tail + 1) % NREADBACK_SLOTS;
+    s_readback_pending--;
+
+    SDL_AtomicSet(out_nread, read_size / sizeof(GLfloat));
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_HiZShutdown(void)
+{
+    for(int i = 0; i < NREADBACK_SLOTS; i++) {
+        slot_destroy(&s_readback[i]);
+    }
+    s_readback_head = 0;
+    s_readback_tail = 0;
+    s_readback_pending = 0;
+
+    if(s_out_ssbo) {
+        glDeleteBuffers(1, &s_out_ssbo);
+        s_out_ssbo = 0;
+    }
+    if(s_depth_tex) {
+        glDeleteTextures(1, &s_depth_tex);
+        s_depth_tex = 0;
+    }
+    s_depth_dims[0] = s_depth_dims[1] = 0;
+}
@@ -0,0 +1,345 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "gl_vertex.h"
+#include "gl_shader.h"
+#include "gl_state.h"
+#include "gl_texture.h"
+#include "gl_assert.h"
+#include "gl_perf.h"
+#include "../camera.h"
+#include "../pf_math.h"
+#include "../main.h"
+#include "../lib/public/pf_string.h"
+#include "../lib/public/stb_image.h"
+
+#include <GL/glew.h>
+#include <assert.h>
+#include <string.h>
+
+
+#define ARR_SIZE(a)         (sizeof(a)/sizeof((a)[0]))
+#define ATLAS_DIM           (2048)
+#define CELL_DIM            (64)
+#define CELLS_PER_ROW       (ATLAS_DIM / CELL_DIM)
+/* Give up on icons that fail to load for this many frames in a row */
+#define MAX_LOAD_ATTEMPTS   (120)
+
+_Static_assert(CELLS_PER_ROW * CELLS_PER_ROW == R_ICON_ATLAS_SLOTS, 
+    "The atlas dimensions must match the number of slots");
+
+struct icon_slot{
+    bool pending;
+    int  attempts;
+    char path[256];
+};
+
+/* All the unit icons are copied into the cells of a single atlas texture 
+ * so that every icon that is on the screen can be drawn in one instanced 
+ * call. The per-instance attributes are re-specified every frame. */
+struct icon_render_ctx{
+    bool             init;
+    GLuint           VAO;
+    GLuint           quad_VBO;
+    GLuint           pos_VBO;
+    GLuint           offset_VBO;
+    GLuint           slot_VBO;
+    GLuint           atlas;
+    GLuint           fbos[2];
+    int              npending;
+    struct icon_slot slots[R_ICON_ATLAS_SLOTS];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct icon_render_ctx s_icon_ctx;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void icon_ctx_init(struct icon_render_ctx *ctx)
+{
+    const struct textured_vert corners[] = {
+        (struct textured_vert) {
+            .pos = (vec3_t) {-1.0f, -1.0f, 0.0f}, 
+            .uv =  (vec2_t) {0.0f, 0.0f},
+        },
+        (struct textured_vert) {
+            .pos = (vec3_t) {-1.0f, 1.0f, 0.0f}, 
+            .uv =  (vec2_t) {0.0f, 1.0f},
+        },
+        (struct textured_vert) {
+            .pos = (vec3_t) {1.0f, 1.0f, 0.0f}, 
+            .uv =  (vec2_t) {1.0f, 1.0f},
+        },
+        (struct textured_vert) {
+            .pos = (vec3_t) {1.0f, -1.0f, 0.0f}, 
+            .uv =  (vec2_t) {1.0f, 0.0f},
+        },
+    };
+
+    const struct textured_vert vbuff[] = {
+        corners[0], corners[1], corners[2],
+        corners[2], corners[3], corners[0],
+    };
+
+    glGenVertexArrays(1, &ctx->VAO);
+    glBindVertexArray(ctx->VAO);
+
+    glGenBuffers(1, &ctx->quad_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->quad_VBO);
+    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(vbuff) * sizeof(struct textured_vert), vbuff, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct textured_vert), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct textured_vert), 
+        (void*)offsetof(struct textured_vert, uv));
+    glEnableVertexAttribArray(1);
+
+    /* Attribute 2 - worldspace position of the entity's top */
+    glGenBuffers(1, &ctx->pos_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->pos_VBO);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    /* Attribute 3 - screenspace offset of the icon's center */
+    glGenBuffers(1, &ctx->offset_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->offset_VBO);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(vec2_t), (void*)0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    /* Attribute 4 - atlas slot */
+    glGenBuffers(1, &ctx->slot_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->slot_VBO);
+    glVertexAttribIPointer(4, 1, GL_INT, sizeof(int), (void*)0);
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenTextures(1, &ctx->atlas);
+    glBindTexture(GL_TEXTURE_2D, ctx->atlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, ATLAS_DIM, ATLAS_DIM, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    /* Cells that haven't been filled yet are fully transparent */
+    GLint old_fbo;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &old_fbo);
+
+    glGenFramebuffers(2, ctx->fbos);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, ctx->fbos[1]);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ctx->atlas, 0);
+    const GLfloat clear[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, clear);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, old_fbo);
+
+    ctx->init = true;
+    GL_ASSERT_OK();
+}
+
+static void icon_upload(GLuint VBO, size_t size, const void *data)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+}
+
+static bool icon_blit(struct icon_render_ctx *ctx, int slot)
+{
+    /* The icons are drawn top row first, same as in the UI */
+    GLuint texid;
+    stbi_set_flip_vertically_on_load(false);
+    R_GL_Texture_GetOrLoad(g_basepath, ctx->slots[slot].path, &texid);
+    stbi_set_flip_vertically_on_load(true);
+
+    /* The texture is being streamed back in */
+    if(!R_GL_Texture_GetForName(g_basepath, ctx->slots[slot].path, &texid))
+        return false;
+
+    int w, h, d;
+    R_GL_Texture_GetSize(texid, &w, &h, &d);
+    if(w == 0 || h == 0)
+        return false;
+
+    GLint old_read, old_draw;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &old_read);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &old_draw);
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_SCISSOR_TEST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, ctx->fbos[0]);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texid, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, ctx->fbos[1]);
+
+    int x = (slot % CELLS_PER_ROW) * CELL_DIM;
+    int y = (slot / CELLS_PER_ROW) * CELL_DIM;
+    glBlitFramebuffer(0, 0, w, h, x, y, x + CELL_DIM, y + CELL_DIM, 
+        GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, old_read);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, old_draw);
+    if(scissor)
+        glEnable(GL_SCISSOR_TEST);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+static void icon_flush_pending(struct icon_render_ctx *ctx)
+{
+    if(ctx->npending == 0)
+        return;
+
+    for(int i = 0; i < R_ICON_ATLAS_SLOTS; i++) {
+
+        struct icon_slot *curr = &ctx->slots[i];
+        if(!curr->pending)
+            continue;
+
+        if(icon_blit(ctx, i) || ++curr->attempts == MAX_LOAD_ATTEMPTS) {
+            curr->pending = false;
+            ctx->npending--;
+        }
+        if(ctx->npending == 0)
+            break;
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_IconAtlasSet(const int *slot, const char *path)
+{
+    ASSERT_IN_RENDER_THREAD();
+    assert(*slot >= 0 && *slot < R_ICON_ATLAS_SLOTS);
+
+    struct icon_slot *curr = &s_icon_ctx.slots[*slot];
+    if(!curr->pending)
+        s_icon_ctx.npending++;
+
+    pf_strlcpy(curr->path, path, sizeof(curr->path));
+    curr->pending = true;
+    curr->attempts = 0;
+}
+
+void R_GL_DrawIcons(const size_t *num_icons, vec3_t *pos_ws, vec2_t *offsets, 
+                    int *slots, const struct camera *cam)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    if(*num_icons == 0)
+        GL_PERF_RETURN_VOID();
+
+    if(!s_icon_ctx.init) {
+        icon_ctx_init(&s_icon_ctx);
+    }
+    icon_flush_pending(&s_icon_ctx);
+
+    icon_upload(s_icon_ctx.pos_VBO, *num_icons * sizeof(vec3_t), pos_ws);
+    icon_upload(s_icon_ctx.offset_VBO, *num_icons * sizeof(vec2_t), offsets);
+    icon_upload(s_icon_ctx.slot_VBO, *num_icons * sizeof(int), slots);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    int w, h;
+    Engine_WinDrawableSize(&w, &h);
+
+    R_GL_StateSet(GL_U_CURR_RES, (struct uval){
+        .type = UTYPE_IVEC2,
+        .val.as_ivec2[0] = w,
+        .val.as_ivec2[1] = h
+    });
+
+    mat4x4_t view, proj, view_proj;
+    Camera_MakeViewMat(cam, &view); 
+    Camera_MakeProjMat(cam, &proj);
+    PFM_Mat4x4_Mult4x4(&proj, &view, &view_proj);
+
+    R_GL_StateSet(GL_U_CAM_VIEW_PROJ, (struct uval){
+        .type = UTYPE_MAT4,
+        .val.as_mat4 = view_proj
+    });
+
+    R_GL_Shader_Install("icon");
+    GLuint shader_prog = R_GL_Shader_GetCurrActive();
+
+    struct texture tex = (struct texture){
+        .id = s_icon_ctx.atlas,
+        .tunit = GL_TEXTURE0
+    };
+    R_GL_Texture_Bind(&tex, shader_prog);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glBindVertexArray(s_icon_ctx.VAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, *num_icons);
+    glBindVertexArray(0);
+
+    glDisable(GL_BLEND);
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_IconsShutdown(void)
+{
+    if(!s_icon_ctx.init)
+        return;
+
+    glDeleteVertexArrays(1, &s_icon_ctx.VAO);
+    glDeleteBuffers(1, &s_icon_ctx.quad_VBO);
+    glDeleteBuffers(1, &s_icon_ctx.pos_VBO);
+    glDeleteBuffers(1, &s_icon_ctx.offset_VBO);
+    glDeleteBuffers(1, &s_icon_ctx.slot_VBO);
+    glDeleteFramebuffers(2, s_icon_ctx.fbos);
+    glDeleteTextures(1, &s_icon_ctx.atlas);
+    memset(&s_icon_ctx, 0, sizeof(s_icon_ctx));
+}
+
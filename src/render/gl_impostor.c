@@ -0,0 +1,663 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "gl_render.h"
+#include "gl_shader.h"
+#include "gl_state.h"
+#include "gl_texture.h"
+#include "gl_vertex.h"
+#include "gl_assert.h"
+#include "gl_perf.h"
+#include "render_private.h"
+#include "public/render.h"
+#include "../entity.h"
+#include "../camera.h"
+#include "../pf_math.h"
+#include "../main.h"
+#include "../game/public/game.h"
+#include "../lib/public/khash.h"
+
+#include <GL/glew.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#define ARR_SIZE(a)     (sizeof(a)/sizeof((a)[0]))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+
+/* Each atlas layer is a grid of square cells. A row holds the views of 
+ * one animation frame from IMPOSTOR_DIRS evenly spaced headings around 
+ * the mesh, all from the same elevation. Must match the shader. */
+#define IMPOSTOR_CELL_RES           (64)
+#define IMPOSTOR_DIRS               (8)
+#define IMPOSTOR_ROWS               (8)
+#define IMPOSTOR_LAYERS             (16)
+#define IMPOSTOR_LAYER_RES          (IMPOSTOR_CELL_RES * IMPOSTOR_DIRS)
+#define IMPOSTOR_MAX_ENTRIES        (IMPOSTOR_LAYERS * IMPOSTOR_ROWS)
+/* Baking a frame costs IMPOSTOR_DIRS draws of the full mesh. Only the 
+ * first frame of a mesh is baked past the limit - the others fall back 
+ * to a frame that's already in the atlas until their turn comes. */
+#define IMPOSTOR_BAKES_PER_FRAME    (4)
+/* Frames are re-baked when the camera elevation drifts past this */
+#define IMPOSTOR_REBAKE_PITCH       DEG_TO_RAD(10.0f)
+#define IMPOSTOR_MAX_PITCH          DEG_TO_RAD(85.0f)
+
+struct impostor_entry{
+    bool                         valid;
+    const struct render_private *priv;
+    size_t                       pose_base;
+    float                        pitch;
+    uint64_t                     last_used;
+};
+
+/* Per-instance attributes, interleaved in a single buffer */
+struct impostor_inst{
+    vec4_t  center_size;
+    GLint   cell[3];
+    GLfloat fade;
+};
+
+struct impostor_gl_state{
+    GLint     viewport[4];
+    GLint     fb;
+    GLfloat   clear_clr[4];
+    GLboolean scissor;
+    GLboolean clip;
+    mat4x4_t  u_view;
+    mat4x4_t  u_proj;
+    vec3_t    u_cam_pos;
+};
+
+KHASH_MAP_INIT_INT64(entry, int)
+
+struct impostor_ctx{
+    bool                  init;
+    GLuint                atlas;
+    GLuint                fb;
+    GLuint                depth_rb;
+    GLuint                VAO;
+    GLuint                quad_VBO;
+    GLuint                inst_VBO;
+    /* The frame counter, for picking eviction victims */
+    uint64_t              frame;
+    struct impostor_entry entries[IMPOSTOR_MAX_ENTRIES];
+    /* Maps a frame's pose buffer offset to its entry */
+    khash_t(entry)       *frame_entries;
+    /* Maps a mesh to the entry most recently baked for it */
+    khash_t(entry)       *mesh_entries;
+    size_t                ninsts;
+    size_t                insts_cap;
+    struct impostor_inst *insts;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct impostor_ctx s_ctx;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool ctx_init(struct impostor_ctx *ctx)
+{
+    const struct textured_vert corners[] = {
+        (struct textured_vert) {
+            .pos = (vec3_t) {-1.0f, -1.0f, 0.0f}, 
+            .uv =  (vec2_t) {0.0f, 0.0f},
+        },
+        (struct textured_vert) {
+            .pos = (vec3_t) {-1.0f, 1.0f, 0.0f}, 
+            .uv =  (vec2_t) {0.0f, 1.0f},
+        },
+        (struct textured_vert) {
+            .pos = (vec3_t) {1.0f, 1.0f, 0.0f}, 
+            .uv =  (vec2_t) {1.0f, 1.0f},
+        },
+        (struct textured_vert) {
+            .pos = (vec3_t) {1.0f, -1.0f, 0.0f}, 
+            .uv =  (vec2_t) {1.0f, 0.0f},
+        },
+    };
+
+    const struct textured_vert vbuff[] = {
+        corners[0], corners[1], corners[2],
+        corners[2], corners[3], corners[0],
+    };
+
+    ctx->frame_entries = kh_init(entry);
+    if(!ctx->frame_entries)
+        goto fail_frame_entries;
+
+    ctx->mesh_entries = kh_init(entry);
+    if(!ctx->mesh_entries)
+        goto fail_mesh_entries;
+
+    glGenTextures(1, &ctx->atlas);
+    glActiveTexture(IMPOSTOR_TUNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ctx->atlas);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, IMPOSTOR_LAYER_RES, 
+        IMPOSTOR_CELL_RES * IMPOSTOR_ROWS, IMPOSTOR_LAYERS, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenRenderbuffers(1, &ctx->depth_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, ctx->depth_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 
+        IMPOSTOR_LAYER_RES, IMPOSTOR_CELL_RES * IMPOSTOR_ROWS);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    GLint prev_fb;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fb);
+
+    glGenFramebuffers(1, &ctx->fb);
+    glBindFramebuffer(GL_FRAMEBUFFER, ctx->fb);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ctx->atlas, 0, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, ctx->depth_rb);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, prev_fb);
+
+    if(status != GL_FRAMEBUFFER_COMPLETE)
+        goto fail_fb;
+
+    glGenVertexArrays(1, &ctx->VAO);
+    glBindVertexArray(ctx->VAO);
+
+    glGenBuffers(1, &ctx->quad_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->quad_VBO);
+    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(vbuff) * sizeof(struct textured_vert), vbuff, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct textured_vert), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct textured_vert), 
+        (void*)offsetof(struct textured_vert, uv));
+    glEnableVertexAttribArray(1);
+
+    glGenBuffers(1, &ctx->inst_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->inst_VBO);
+
+    /* Attribute 2 - worldspace center and half extent */
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(struct impostor_inst), 
+        (void*)offsetof(struct impostor_inst, center_size));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    /* Attribute 3 - atlas layer, column and row */
+    glVertexAttribIPointer(3, 3, GL_INT, sizeof(struct impostor_inst), 
+        (void*)offsetof(struct impostor_inst, cell));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    /* Attribute 4 - fade */
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(struct impostor_inst), 
+        (void*)offsetof(struct impostor_inst, fade));
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    GL_ASSERT_OK();
+    ctx->init = true;
+    return true;
+
+fail_fb:
+    glDeleteFramebuffers(1, &ctx->fb);
+    glDeleteRenderbuffers(1, &ctx->depth_rb);
+    glDeleteTextures(1, &ctx->atlas);
+    kh_destroy(entry, ctx->mesh_entries);
+fail_mesh_entries:
+    kh_destroy(entry, ctx->frame_entries);
+fail_frame_entries:
+    return false;
+}
+
+static void save_gl_state(struct impostor_gl_state *out)
+{
+    glGetIntegerv(GL_VIEWPORT, out->viewport);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &out->fb);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, out->clear_clr);
+    out->scissor = glIsEnabled(GL_SCISSOR_TEST);
+    out->clip = glIsEnabled(GL_CLIP_DISTANCE0);
+
+    struct uval vval, pval, tval;
+    R_GL_StateGet(GL_U_VIEW, &vval);
+    R_GL_StateGet(GL_U_PROJECTION, &pval);
+    R_GL_StateGet(GL_U_VIEW_POS, &tval);
+
+    out->u_view = vval.val.as_mat4;
+    out->u_proj = pval.val.as_mat4;
+    out->u_cam_pos = tval.val.as_vec3;
+}
+
+static void restore_gl_state(const struct impostor_gl_state *in)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, in->fb);
+    glViewport(in->viewport[0], in->viewport[1], in->viewport[2], in->viewport[3]);
+    glClearColor(in->clear_clr[0], in->clear_clr[1], in->clear_clr[2], in->clear_clr[3]);
+
+    if(!in->scissor)
+        glDisable(GL_SCISSOR_TEST);
+    if(in->clip)
+        glEnable(GL_CLIP_DISTANCE0);
+
+    R_GL_SetViewMatAndPos(&in->u_view, &in->u_cam_pos);
+    R_GL_SetProj(&in->u_proj);
+}
+
+static void aabb_bounds(const struct aabb *aabb, vec3_t *out_center, float *out_radius)
+{
+    vec3_t half = (vec3_t){
+        (aabb->x_max - aabb->x_min) / 2.0f,
+        (aabb->y_max - aabb->y_min) / 2.0f,
+        (aabb->z_max - aabb->z_min) / 2.0f,
+    };
+    *out_center = (vec3_t){
+        aabb->x_min + half.x,
+        aabb->y_min + half.y,
+        aabb->z_min + half.z,
+    };
+    *out_radius = PFM_Vec3_Len(&half);
+}
+
+/* Render the views of a single frame into the entry's row of the atlas. 
+ * The mesh is drawn in its' own space, so that the views can be shared 
+ * by all entities showing the same frame. */
+static void bake_entry(int idx, const struct render_private *priv, 
+                       const struct ent_impostor_rstate *rstate, float pitch)
+{
+    GL_PERF_PUSH_GROUP(0, "impostor::bake");
+
+    int layer = idx / IMPOSTOR_ROWS;
+    int row = idx % IMPOSTOR_ROWS;
+
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, s_ctx.atlas, 0, layer);
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+    vec3_t center;
+    float radius;
+    aabb_bounds(&rstate->aabb, &center, &radius);
+    radius = MAX(radius, 0.01f);
+
+    mat4x4_t identity, proj;
+    PFM_Mat4x4_Identity(&identity);
+    PFM_Mat4x4_MakeOrthographic(-radius, radius, -radius, radius, 
+        0.1f, 4.0f * radius + 2.0f, &proj);
+    R_GL_SetProj(&proj);
+
+    R_GL_StateSet(GL_U_MODEL, (struct uval){
+        .type = UTYPE_MAT4,
+        .val.as_mat4 = identity
+    });
+    R_GL_SetAnimUniforms(&identity, &rstate->pose_base);
+
+    GLint prog = R_GL_Shader_GetProgForName("mesh.animated.textured-phong");
+    assert(prog >= 0);
+
+    for(int i = 0; i < IMPOSTOR_DIRS; i++) {
+
+        float heading = i * (2.0f * M_PI / IMPOSTOR_DIRS);
+        vec3_t dir = (vec3_t){
+            cosf(pitch) * sinf(heading),
+            sinf(pitch),
+            cosf(pitch) * cosf(heading),
+        };
+
+        vec3_t eye, front = (vec3_t){-dir.x, -dir.y, -dir.z};
+        PFM_Vec3_Scale(&dir, 2.0f * radius + 1.0f, &eye);
+        PFM_Vec3_Add(&center, &eye, &eye);
+
+        /* Find a vector that is orthogonal to 'front' in the XZ plane */
+        vec3_t up, xz = (vec3_t){front.z, 0.0f, -front.x};
+        PFM_Vec3_Cross(&front, &xz, &up);
+        PFM_Vec3_Normal(&up, &up);
+
+        mat4x4_t view;
+        PFM_Mat4x4_MakeLookAt(&eye, &center, &up, &view);
+        R_GL_SetViewMatAndPos(&view, &eye);
+
+        glViewport(i * IMPOSTOR_CELL_RES, row * IMPOSTOR_CELL_RES, 
+            IMPOSTOR_CELL_RES, IMPOSTOR_CELL_RES);
+        glScissor(i * IMPOSTOR_CELL_RES, row * IMPOSTOR_CELL_RES, 
+            IMPOSTOR_CELL_RES, IMPOSTOR_CELL_RES);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        R_GL_Shader_InstallProg(prog);
+        if(priv->material_ubo) {
+            glBindBufferBase(GL_UNIFORM_BUFFER, UBLOCK_MATERIALS, priv->material_ubo);
+        }
+        if(priv->num_materials > 0) {
+            R_GL_Texture_BindArray(&priv->material_arr, prog);
+        }
+
+        glBindVertexArray(priv->mesh.VAO);
+        glDrawArrays(GL_TRIANGLES, 0, priv->mesh.num_verts);
+    }
+
+    struct impostor_entry *entry = &s_ctx.entries[idx];
+    entry->valid = true;
+    entry->priv = priv;
+    entry->pose_base = rstate->pose_base;
+    entry->pitch = pitch;
+    entry->last_used = s_ctx.frame;
+
+    GL_PERF_POP_GROUP();
+}
+
+static void entry_unlink(int idx)
+{
+    struct impostor_entry *entry = &s_ctx.entries[idx];
+    if(!entry->valid)
+        return;
+
+    khiter_t k = kh_get(entry, s_ctx.frame_entries, entry->pose_base);
+    if(k != kh_end(s_ctx.frame_entries) && kh_val(s_ctx.frame_entries, k) == idx) {
+        kh_del(entry, s_ctx.frame_entries, k);
+    }
+    k = kh_get(entry, s_ctx.mesh_entries, (uintptr_t)entry->priv);
+    if(k != kh_end(s_ctx.mesh_entries) && kh_val(s_ctx.mesh_entries, k) == idx) {
+        kh_del(entry, s_ctx.mesh_entries, k);
+    }
+    entry->valid = false;
+}
+
+static void entry_link(int idx)
+{
+    const struct impostor_entry *entry = &s_ctx.entries[idx];
+    int ret;
+
+    khiter_t k = kh_put(entry, s_ctx.frame_entries, entry->pose_base, &ret);
+    if(ret != -1) {
+        kh_val(s_ctx.frame_entries, k) = idx;
+    }
+    k = kh_put(entry, s_ctx.mesh_entries, (uintptr_t)entry->priv, &ret);
+    if(ret != -1) {
+        kh_val(s_ctx.mesh_entries, k) = idx;
+    }
+}
+
+/* The least recently used entry not referenced by the current frame */
+static int entry_victim(void)
+{
+    int ret = -1;
+    for(int i = 0; i < IMPOSTOR_MAX_ENTRIES; i++) {
+
+        const struct impostor_entry *curr = &s_ctx.entries[i];
+        if(!curr->valid)
+            return i;
+        if(curr->last_used == s_ctx.frame)
+            continue;
+        if(ret == -1 || curr->last_used < s_ctx.entries[ret].last_used)
+            ret = i;
+    }
+    return ret;
+}
+
+static int mesh_fallback(const struct render_private *priv)
+{
+    khiter_t k = kh_get(entry, s_ctx.mesh_entries, (uintptr_t)priv);
+    if(k == kh_end(s_ctx.mesh_entries))
+        return -1;
+
+    int idx = kh_val(s_ctx.mesh_entries, k);
+    s_ctx.entries[idx].last_used = s_ctx.frame;
+    return idx;
+}
+
+static int entry_for_frame(const struct ent_impostor_rstate *rstate, float pitch, 
+                           int *inout_bakes, bool *inout_baking, 
+                           struct impostor_gl_state *saved)
+{
+    const struct render_private *priv = rstate->render_private;
+    int idx = -1;
+
+    khiter_t k = kh_get(entry, s_ctx.frame_entries, rstate->pose_base);
+    if(k != kh_end(s_ctx.frame_entries)) {
+
+        idx = kh_val(s_ctx.frame_entries, k);
+        struct impostor_entry *entry = &s_ctx.entries[idx];
+        bool usable = (entry->priv == priv);
+        bool stale = fabsf(entry->pitch - pitch) > IMPOSTOR_REBAKE_PITCH;
+
+        if(usable && (!stale || *inout_bakes == IMPOSTOR_BAKES_PER_FRAME)) {
+            entry->last_used = s_ctx.frame;
+            return idx;
+        }
+        if(*inout_bakes == IMPOSTOR_BAKES_PER_FRAME)
+            return mesh_fallback(priv);
+        entry_unlink(idx);
+
+    }else{
+
+        bool first = (mesh_fallback(priv) == -1);
+        if(!first && *inout_bakes == IMPOSTOR_BAKES_PER_FRAME)
+            return mesh_fallback(priv);
+
+        idx = entry_victim();
+        if(idx == -1)
+            return mesh_fallback(priv);
+        entry_unlink(idx);
+    }
+
+    if(!*inout_baking) {
+        save_gl_state(saved);
+        glBindFramebuffer(GL_FRAMEBUFFER, s_ctx.fb);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glEnable(GL_SCISSOR_TEST);
+        glDisable(GL_CLIP_DISTANCE0);
+        *inout_baking = true;
+    }
+
+    bake_entry(idx, priv, rstate, pitch);
+    entry_link(idx);
+    (*inout_bakes)++;
+    return idx;
+}
+
+static bool insts_reserve(size_t size)
+{
+    if(s_ctx.insts_cap >= size)
+        return true;
+
+    size_t cap = MAX(size, s_ctx.insts_cap * 2);
+    void *ret = realloc(s_ctx.insts, cap * sizeof(struct impostor_inst));
+    if(!ret)
+        return false;
+
+    s_ctx.insts = ret;
+    s_ctx.insts_cap = cap;
+    return true;
+}
+
+static struct impostor_inst make_inst(const struct ent_impostor_rstate *rstate, int idx, vec3_t cam_pos)
+{
+    vec3_t center;
+    float radius;
+    aabb_bounds(&rstate->aabb, &center, &radius);
+
+    mat4x4_t model = rstate->model, inv_model;
+    vec4_t ms_center = (vec4_t){center.x, center.y, center.z, 1.0f}, ws_center;
+    PFM_Mat4x4_Mult4x1(&model, &ms_center, &ws_center);
+
+    float scale = 0.0f;
+    for(int i = 0; i < 3; i++) {
+        vec3_t col = (vec3_t){model.cols[i][0], model.cols[i][1], model.cols[i][2]};
+        scale = MAX(scale, PFM_Vec3_Len(&col));
+    }
+
+    /* Pick the view whose heading (in the entity's own space) is 
+     * the closest to that of the camera */
+    vec4_t ws_dir = (vec4_t){
+        cam_pos.x - ws_center.x,
+        cam_pos.y - ws_center.y,
+        cam_pos.z - ws_center.z,
+        0.0f
+    }, ms_dir;
+    PFM_Mat4x4_Inverse(&model, &inv_model);
+    PFM_Mat4x4_Mult4x1(&inv_model, &ws_dir, &ms_dir);
+
+    float heading = atan2f(ms_dir.x, ms_dir.z);
+    int dir = (int)roundf(heading / (2.0f * M_PI / IMPOSTOR_DIRS));
+    dir = ((dir % IMPOSTOR_DIRS) + IMPOSTOR_DIRS) % IMPOSTOR_DIRS;
+
+    return (struct impostor_inst){
+        .center_size = (vec4_t){ws_center.x, ws_center.y, ws_center.z, radius * scale},
+        .cell = {idx / IMPOSTOR_ROWS, dir, idx % IMPOSTOR_ROWS},
+        .fade = rstate->fade,
+    };
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_ImpostorDraw(struct render_input *in)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    size_t nimps = vec_size(&in->cam_vis_imp);
+    if(nimps == 0)
+        GL_PERF_RETURN_VOID();
+
+    if(!s_ctx.init && !ctx_init(&s_ctx))
+        GL_PERF_RETURN_VOID();
+
+    if(!insts_reserve(nimps))
+        GL_PERF_RETURN_VOID();
+
+    GL_PERF_PUSH_GROUP(0, "impostor::draw");
+    s_ctx.frame++;
+    s_ctx.ninsts = 0;
+
+    vec3_t cam_pos = Camera_GetPos(in->cam);
+    vec3_t cam_dir = Camera_GetDir(in->cam);
+    float pitch = asinf(MAX(MIN(-cam_dir.y, 1.0f), -1.0f));
+    pitch = MAX(MIN(pitch, IMPOSTOR_MAX_PITCH), -IMPOSTOR_MAX_PITCH);
+
+    int nbakes = 0;
+    bool baking = false;
+    struct impostor_gl_state saved;
+
+    for(int i = 0; i < nimps; i++) {
+
+        const struct ent_impostor_rstate *curr = &vec_AT(&in->cam_vis_imp, i);
+        int idx = entry_for_frame(curr, pitch, &nbakes, &baking, &saved);
+        if(idx == -1)
+            continue;
+        s_ctx.insts[s_ctx.ninsts++] = make_inst(curr, idx, cam_pos);
+    }
+
+    if(baking) {
+        restore_gl_state(&saved);
+    }
+
+    if(s_ctx.ninsts == 0) {
+        GL_PERF_POP_GROUP();
+        GL_PERF_RETURN_VOID();
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, s_ctx.inst_VBO);
+    glBufferData(GL_ARRAY_BUFFER, s_ctx.ninsts * sizeof(struct impostor_inst), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, s_ctx.ninsts * sizeof(struct impostor_inst), s_ctx.insts);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glActiveTexture(IMPOSTOR_TUNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, s_ctx.atlas);
+    R_GL_StateSet(GL_U_IMPOSTOR_ATLAS, (struct uval){
+        .type = UTYPE_INT,
+        .val.as_int = IMPOSTOR_TUNIT - GL_TEXTURE0
+    });
+    R_GL_Shader_Install("impostor");
+
+    GLboolean cull = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_CULL_FACE);
+
+    glBindVertexArray(s_ctx.VAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, s_ctx.ninsts);
+    glBindVertexArray(0);
+
+    if(cull) {
+        glEnable(GL_CULL_FACE);
+    }
+
+    GL_PERF_POP_GROUP();
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_ImpostorReset(void)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    if(!s_ctx.init)
+        GL_PERF_RETURN_VOID();
+
+    /* The pose buffer offsets are only meaningful within a session */
+    memset(s_ctx.entries, 0, sizeof(s_ctx.entries));
+    kh_clear(entry, s_ctx.frame_entries);
+    kh_clear(entry, s_ctx.mesh_entries);
+
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_ImpostorShutdown(void)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    if(!s_ctx.init)
+        return;
+
+    glDeleteVertexArrays(1, &s_ctx.VAO);
+    glDeleteBuffers(1, &s_ctx.quad_VBO);
+    glDeleteBuffers(1, &s_ctx.inst_VBO);
+    glDeleteFramebuffers(1, &s_ctx.fb);
+    glDeleteRenderbuffers(1, &s_ctx.depth_rb);
+    glDeleteTextures(1, &s_ctx.atlas);
+
+    kh_destroy(entry, s_ctx.frame_entries);
+    kh_destroy(entry, s_ctx.mesh_entries);
+    free(s_ctx.insts);
+    memset(&s_ctx, 0, sizeof(s_ctx));
+}
+
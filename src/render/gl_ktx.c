@@ -0,0 +1,629 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "gl_ktx.h"
+#include "../lib/public/stb_image_resize.h"
+
+#include <SDL.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+
+
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define ARR_SIZE(a)     (sizeof(a)/sizeof((a)[0]))
+#define ALIGNED(x, a)   (((x) + ((a) - 1)) & ~((a) - 1))
+
+#define KTX_LEVEL_ALIGN (16)
+
+/* Vulkan format enumerants, as used by the KTX2 header */
+enum{
+    VK_FORMAT_R8G8B8_UNORM           = 23,
+    VK_FORMAT_R8G8B8A8_UNORM         = 37,
+    VK_FORMAT_BC1_RGB_UNORM_BLOCK    = 131,
+    VK_FORMAT_BC1_RGBA_UNORM_BLOCK   = 133,
+    VK_FORMAT_BC3_UNORM_BLOCK        = 137,
+    VK_FORMAT_BC7_UNORM_BLOCK        = 145,
+    VK_FORMAT_ASTC_4x4_UNORM_BLOCK   = 157,
+};
+
+/* Data Format Descriptor constants */
+enum{
+    KHR_DF_MODEL_BC1A                = 128,
+    KHR_DF_MODEL_BC3                 = 130,
+    KHR_DF_PRIMARIES_BT709           = 1,
+    KHR_DF_TRANSFER_LINEAR           = 1,
+    KHR_DF_CHANNEL_COLOR             = 0,
+    KHR_DF_CHANNEL_ALPHA             = 15,
+};
+
+struct ktx_header{
+    unsigned char identifier[12];
+    uint32_t      vk_format;
+    uint32_t      type_size;
+    uint32_t      width;
+    uint32_t      height;
+    uint32_t      depth;
+    uint32_t      layer_count;
+    uint32_t      face_count;
+    uint32_t      level_count;
+    uint32_t      supercompression;
+    uint32_t      dfd_offset;
+    uint32_t      dfd_length;
+    uint32_t      kvd_offset;
+    uint32_t      kvd_length;
+    uint64_t      sgd_offset;
+    uint64_t      sgd_length;
+};
+
+struct ktx_level{
+    uint64_t offset;
+    uint64_t length;
+    uint64_t uncompressed_length;
+};
+
+struct ktx_format{
+    uint32_t vk_format;
+    GLenum   internal_format;
+    GLenum   format;
+    int      block_width;
+    int      block_height;
+    int      block_bytes;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static const unsigned char s_identifier[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+static const struct ktx_format s_formats[] = {
+    {VK_FORMAT_R8G8B8_UNORM,         GL_RGB8,                            GL_RGB,  1, 1, 3 },
+    {VK_FORMAT_R8G8B8A8_UNORM,       GL_RGBA8,                           GL_RGBA, 1, 1, 4 },
+    {VK_FORMAT_BC1_RGB_UNORM_BLOCK,  GL_COMPRESSED_RGB_S3TC_DXT1_EXT,    0,       4, 4, 8 },
+    {VK_FORMAT_BC1_RGBA_UNORM_BLOCK, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,   0,       4, 4, 8 },
+    {VK_FORMAT_BC3_UNORM_BLOCK,      GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,   0,       4, 4, 16},
+    {VK_FORMAT_BC7_UNORM_BLOCK,      GL_COMPRESSED_RGBA_BPTC_UNORM,      0,       4, 4, 16},
+    {VK_FORMAT_ASTC_4x4_UNORM_BLOCK, GL_COMPRESSED_RGBA_ASTC_4x4_KHR,    0,       4, 4, 16},
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static const struct ktx_format *ktx_format(uint32_t vk_format)
+{
+    for(int i = 0; i < ARR_SIZE(s_formats); i++) {
+        if(s_formats[i].vk_format == vk_format)
+            return &s_formats[i];
+    }
+    return NULL;
+}
+
+static bool ktx_format_supported(const struct ktx_format *fmt)
+{
+    /* The extension flags are only written when GLEW is initialized */
+    switch(fmt->vk_format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+        return GLEW_EXT_texture_compression_s3tc;
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+        return GLEW_ARB_texture_compression_bptc || GLEW_VERSION_4_2;
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+        return GLEW_KHR_texture_compression_astc_ldr;
+    default:
+        return true;
+    }
+}
+
+static size_t ktx_level_size(const struct ktx_format *fmt, int width, int height)
+{
+    size_t bw = (width + fmt->block_width - 1) / fmt->block_width;
+    size_t bh = (height + fmt->block_height - 1) / fmt->block_height;
+    return bw * bh * fmt->block_bytes;
+}
+
+static int ktx_num_levels(int width, int height)
+{
+    int ret = 1;
+    int dim = MAX(width, height);
+    while(dim > 1) {
+        dim >>= 1;
+        ret++;
+    }
+    return ret;
+}
+
+static bool ktx_orientation_ru(const unsigned char *kvd, size_t length)
+{
+    const char key[] = "KTXorientation";
+    size_t off = 0;
+
+    while(off + sizeof(uint32_t) <= length) {
+
+        uint32_t entry_len;
+        memcpy(&entry_len, kvd + off, sizeof(entry_len));
+        off += sizeof(uint32_t);
+        if(entry_len > length - off)
+            break;
+
+        const char *entry = (const char*)(kvd + off);
+        if(entry_len >= sizeof(key) + 2 && !memcmp(entry, key, sizeof(key))) {
+            const char *value = entry + sizeof(key);
+            return (value[0] == 'r' && value[1] == 'u');
+        }
+        off += ALIGNED(entry_len, 4);
+    }
+    /* The default is 'rd' - the first row is the top one */
+    return false;
+}
+
+static bool ktx_parse(struct ktx_image *img)
+{
+    const unsigned char *base = img->buff;
+    struct ktx_header hdr;
+
+    if(img->size < sizeof(hdr))
+        return false;
+    memcpy(&hdr, base, sizeof(hdr));
+
+    if(memcmp(hdr.identifier, s_identifier, sizeof(s_identifier)))
+        return false;
+    if(hdr.supercompression != 0
+    || hdr.depth != 0
+    || hdr.layer_count > 1
+    || hdr.face_count != 1
+    || hdr.width == 0 
+    || hdr.height == 0
+    || hdr.width > INT_MAX
+    || hdr.height > INT_MAX)
+        return false;
+
+    const struct ktx_format *fmt = ktx_format(hdr.vk_format);
+    if(!fmt || !ktx_format_supported(fmt))
+        return false;
+
+    /* A level count of 0 asks for the mips to be generated at load time,
+     * which is only possible for the uncompressed formats. */
+    int nlevels = MAX(hdr.level_count, 1);
+    if(hdr.level_count == 0 && fmt->format == 0)
+        return false;
+    if(nlevels > MIN(KTX_MAX_LEVELS, ktx_num_levels(hdr.width, hdr.height)))
+        return false;
+    if(img->size < sizeof(hdr) + nlevels * sizeof(struct ktx_level))
+        return false;
+
+    if((uint64_t)hdr.kvd_offset + hdr.kvd_length > img->size)
+        return false;
+    if(!ktx_orientation_ru(base + hdr.kvd_offset, hdr.kvd_length))
+        return false;
+
+    for(int i = 0; i < nlevels; i++) {
+
+        struct ktx_level level;
+        memcpy(&level, base + sizeof(hdr) + i * sizeof(level), sizeof(level));
+
+        int width = MAX(1, (int)hdr.width >> i);
+        int height = MAX(1, (int)hdr.height >> i);
+        size_t expected = ktx_level_size(fmt, width, height);
+
+        if(level.offset > img->size || level.length > img->size - level.offset)
+            return false;
+        if(level.length < expected)
+            return false;
+
+        img->levels[i].data = base + level.offset;
+        img->levels[i].size = expected;
+        img->levels[i].width = width;
+        img->levels[i].height = height;
+    }
+
+    img->vk_format = hdr.vk_format;
+    img->internal_format = fmt->internal_format;
+    img->format = fmt->format;
+    img->width = hdr.width;
+    img->height = hdr.height;
+    img->nlevels = nlevels;
+    img->gen_mips = (hdr.level_count == 0);
+    return true;
+}
+
+static uint16_t ktx_pack565(const int rgb[3])
+{
+    return ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+}
+
+static void ktx_unpack565(uint16_t color, int out[3])
+{
+    int r = (color >> 11) & 0x1f;
+    int g = (color >> 5) & 0x3f;
+    int b = color & 0x1f;
+
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+static void ktx_fetch_block(const unsigned char *rgba, int width, int height, 
+                            int bx, int by, unsigned char out[16][4])
+{
+    for(int r = 0; r < 4; r++) {
+    for(int c = 0; c < 4; c++) {
+        int x = MIN(bx * 4 + c, width - 1);
+        int y = MIN(by * 4 + r, height - 1);
+        memcpy(out[r * 4 + c], rgba + (y * width + x) * 4, 4);
+    }}
+}
+
+/* Fits the endpoints to the (slightly inset) bounding box of the block's 
+ * colors and picks the closest of the 4 interpolated colors for each texel. 
+ * The endpoints are ordered so that we're always in the 4-color mode, as 
+ * that's how BC3 interprets its' color block regardless. */
+static void ktx_encode_bc1(const unsigned char px[16][4], unsigned char out[8])
+{
+    int min[3] = {255, 255, 255};
+    int max[3] = {0, 0, 0};
+
+    for(int i = 0; i < 16; i++) {
+        for(int c = 0; c < 3; c++) {
+            min[c] = MIN(min[c], px[i][c]);
+            max[c] = MAX(max[c], px[i][c]);
+        }
+    }
+    for(int c = 0; c < 3; c++) {
+        int inset = (max[c] - min[c]) >> 4;
+        min[c] += inset;
+        max[c] -= inset;
+    }
+
+    /* Pick the diagonal of the box that follows the colors: flip the red 
+     * and blue extents if they're anti-correlated with green. */
+    int cov[3] = {0};
+    for(int i = 0; i < 16; i++) {
+        int dg = 2 * px[i][1] - (min[1] + max[1]);
+        cov[0] += (2 * px[i][0] - (min[0] + max[0])) * dg;
+        cov[2] += (2 * px[i][2] - (min[2] + max[2])) * dg;
+    }
+    for(int c = 0; c < 3; c += 2) {
+        if(cov[c] < 0) {
+            int tmp = min[c];
+            min[c] = max[c];
+            max[c] = tmp;
+        }
+    }
+
+    uint16_t c0 = ktx_pack565(max);
+    uint16_t c1 = ktx_pack565(min);
+    if(c0 < c1) {
+        uint16_t tmp = c0;
+        c0 = c1;
+        c1 = tmp;
+    }
+
+    uint32_t indices = 0;
+    if(c0 != c1) {
+
+        int pal[4][3];
+        ktx_unpack565(c0, pal[0]);
+        ktx_unpack565(c1, pal[1]);
+        for(int c = 0; c < 3; c++) {
+            pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+            pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+        }
+
+        for(int i = 0; i < 16; i++) {
+            int best = 0, best_dist = INT_MAX;
+            for(int j = 0; j < 4; j++) {
+                int dist = 0;
+                for(int c = 0; c < 3; c++) {
+                    int delta = px[i][c] - pal[j][c];
+                    dist += delta * delta;
+                }
+                if(dist < best_dist) {
+                    best = j;
+                    best_dist = dist;
+                }
+            }
+            indices |= ((uint32_t)best) << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    for(int i = 0; i < 4; i++) {
+        out[4 + i] = (indices >> (8 * i)) & 0xff;
+    }
+}
+
+static void ktx_encode_bc3_alpha(const unsigned char px[16][4], unsigned char out[8])
+{
+    int min = 255, max = 0;
+    for(int i = 0; i < 16; i++) {
+        min = MIN(min, px[i][3]);
+        max = MAX(max, px[i][3]);
+    }
+
+    uint64_t indices = 0;
+    if(min != max) {
+
+        int pal[8] = {max, min};
+        for(int j = 2; j < 8; j++) {
+            pal[j] = ((8 - j) * max + (j - 1) * min) / 7;
+        }
+
+        for(int i = 0; i < 16; i++) {
+            int best = 0, best_dist = INT_MAX;
+            for(int j = 0; j < 8; j++) {
+                int dist = abs(px[i][3] - pal[j]);
+                if(dist < best_dist) {
+                    best = j;
+                    best_dist = dist;
+                }
+            }
+            indices |= ((uint64_t)best) << (3 * i);
+        }
+    }
+
+    out[0] = max;
+    out[1] = min;
+    for(int i = 0; i < 6; i++) {
+        out[2 + i] = (indices >> (8 * i)) & 0xff;
+    }
+}
+
+static void ktx_encode_level(const unsigned char *rgba, int width, int height, 
+                             bool alpha, unsigned char *out)
+{
+    int bw = (width + 3) / 4;
+    int bh = (height + 3) / 4;
+
+    for(int by = 0; by < bh; by++) {
+    for(int bx = 0; bx < bw; bx++) {
+
+        unsigned char px[16][4];
+        ktx_fetch_block(rgba, width, height, bx, by, px);
+
+        if(alpha) {
+            ktx_encode_bc3_alpha(px, out);
+            out += 8;
+        }
+        ktx_encode_bc1(px, out);
+        out += 8;
+    }}
+}
+
+static bool ktx_has_alpha(const unsigned char *rgba, int width, int height)
+{
+    for(size_t i = 0; i < (size_t)width * height; i++) {
+        if(rgba[i * 4 + 3] != 0xff)
+            return true;
+    }
+    return false;
+}
+
+static size_t ktx_write_u32(unsigned char *out, uint32_t val)
+{
+    memcpy(out, &val, sizeof(val));
+    return sizeof(val);
+}
+
+static size_t ktx_write_dfd(unsigned char *out, bool alpha)
+{
+    int nsamples = alpha ? 2 : 1;
+    uint32_t block_size = 24 + 16 * nsamples;
+    size_t off = 0;
+
+    off += ktx_write_u32(out + off, sizeof(uint32_t) + block_size);
+    off += ktx_write_u32(out + off, 0); /* vendor: Khronos, type: basic */
+    off += ktx_write_u32(out + off, 2 | (block_size << 16));
+    off += ktx_write_u32(out + off, (alpha ? KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC1A)
+                                  | (KHR_DF_PRIMARIES_BT709 << 8)
+                                  | (KHR_DF_TRANSFER_LINEAR << 16));
+    off += ktx_write_u32(out + off, 3 | (3 << 8)); /* 4x4 texel blocks */
+    off += ktx_write_u32(out + off, alpha ? 16 : 8);
+    off += ktx_write_u32(out + off, 0);
+
+    if(alpha) {
+        off += ktx_write_u32(out + off, 0 | (63 << 16) | (KHR_DF_CHANNEL_ALPHA << 24));
+        off += ktx_write_u32(out + off, 0);
+        off += ktx_write_u32(out + off, 0);
+        off += ktx_write_u32(out + off, UINT32_MAX);
+    }
+    off += ktx_write_u32(out + off, (alpha ? 64 : 0) | (63 << 16) | (KHR_DF_CHANNEL_COLOR << 24));
+    off += ktx_write_u32(out + off, 0);
+    off += ktx_write_u32(out + off, 0);
+    off += ktx_write_u32(out + off, UINT32_MAX);
+    return off;
+}
+
+static size_t ktx_write_kv(unsigned char *out, const char *key, const char *value)
+{
+    size_t klen = strlen(key) + 1;
+    size_t vlen = strlen(value) + 1;
+    size_t off = ktx_write_u32(out, klen + vlen);
+
+    memcpy(out + off, key, klen);
+    memcpy(out + off + klen, value, vlen);
+    off += klen + vlen;
+
+    size_t padded = ALIGNED(off, 4);
+    memset(out + off, 0, padded - off);
+    return padded;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_KTX_Load(const char *path, struct ktx_image *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    SDL_RWops *stream = SDL_RWFromFile(path, "rb");
+    if(!stream)
+        goto fail;
+
+    Sint64 size = SDL_RWsize(stream);
+    if(size <= 0)
+        goto fail_read;
+
+    out->size = size;
+    out->buff = malloc(size);
+    if(!out->buff)
+        goto fail_read;
+
+    if(SDL_RWread(stream, out->buff, size, 1) != 1)
+        goto fail_parse;
+    if(!ktx_parse(out))
+        goto fail_parse;
+
+    SDL_RWclose(stream);
+    return true;
+
+fail_parse:
+    free(out->buff);
+    out->buff = NULL;
+fail_read:
+    SDL_RWclose(stream);
+fail:
+    return false;
+}
+
+void R_KTX_Free(struct ktx_image *img)
+{
+    free(img->buff);
+    img->buff = NULL;
+}
+
+bool R_KTX_Write(const char *path, const unsigned char *rgba, int width, int height)
+{
+    assert(width > 0 && height > 0);
+
+    bool alpha = ktx_has_alpha(rgba, width, height);
+    const struct ktx_format *fmt = ktx_format(alpha ? VK_FORMAT_BC3_UNORM_BLOCK 
+                                                    : VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+    int nlevels = MIN(KTX_MAX_LEVELS, ktx_num_levels(width, height));
+
+    unsigned char meta[512];
+    size_t dfd_offset = sizeof(struct ktx_header) + nlevels * sizeof(struct ktx_level);
+    size_t dfd_length = ktx_write_dfd(meta, alpha);
+    size_t kvd_length = 0;
+    kvd_length += ktx_write_kv(meta + dfd_length + kvd_length, "KTXorientation", "ru");
+    kvd_length += ktx_write_kv(meta + dfd_length + kvd_length, "KTXwriter", "Permafrost Engine");
+
+    /* The levels are laid out from the smallest to the largest */
+    struct ktx_level levels[KTX_MAX_LEVELS];
+    size_t total = ALIGNED(dfd_offset + dfd_length + kvd_length, KTX_LEVEL_ALIGN);
+    for(int i = nlevels - 1; i >= 0; i--) {
+        size_t size = ktx_level_size(fmt, MAX(1, width >> i), MAX(1, height >> i));
+        levels[i] = (struct ktx_level){total, size, size};
+        total = ALIGNED(total + size, KTX_LEVEL_ALIGN);
+    }
+
+    unsigned char *buff = calloc(total, 1);
+    unsigned char *mip = malloc((size_t)width * height * 4);
+    if(!buff || !mip)
+        goto fail;
+
+    struct ktx_header hdr = {
+        .vk_format = fmt->vk_format,
+        .type_size = 1,
+        .width = width,
+        .height = height,
+        .depth = 0,
+        .layer_count = 0,
+        .face_count = 1,
+        .level_count = nlevels,
+        .supercompression = 0,
+        .dfd_offset = dfd_offset,
+        .dfd_length = dfd_length,
+        .kvd_offset = dfd_offset + dfd_length,
+        .kvd_length = kvd_length,
+        .sgd_offset = 0,
+        .sgd_length = 0,
+    };
+    memcpy(hdr.identifier, s_identifier, sizeof(s_identifier));
+    memcpy(buff, &hdr, sizeof(hdr));
+    memcpy(buff + sizeof(hdr), levels, nlevels * sizeof(struct ktx_level));
+    memcpy(buff + dfd_offset, meta, dfd_length + kvd_length);
+
+    /* Every mip is filtered down from the previous one */
+    memcpy(mip, rgba, (size_t)width * height * 4);
+    for(int i = 0; i < nlevels; i++) {
+
+        int w = MAX(1, width >> i);
+        int h = MAX(1, height >> i);
+        if(i > 0) {
+            int pw = MAX(1, width >> (i - 1));
+            int ph = MAX(1, height >> (i - 1));
+            unsigned char *prev = malloc((size_t)pw * ph * 4);
+            if(!prev)
+                goto fail;
+            memcpy(prev, mip, (size_t)pw * ph * 4);
+            int status = stbir_resize_uint8(prev, pw, ph, 0, mip, w, h, 0, 4);
+            free(prev);
+            if(!status)
+                goto fail;
+        }
+        ktx_encode_level(mip, w, h, alpha, buff + levels[i].offset);
+    }
+
+    SDL_RWops *stream = SDL_RWFromFile(path, "wb");
+    if(!stream)
+        goto fail;
+    if(SDL_RWwrite(stream, buff, total, 1) != 1) {
+        SDL_RWclose(stream);
+        goto fail;
+    }
+    SDL_RWclose(stream);
+
+    free(mip);
+    free(buff);
+    return true;
+
+fail:
+    free(mip);
+    free(buff);
+    return false;
+}
+
@@ -0,0 +1,76 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef GL_KTX_H
+#define GL_KTX_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define KTX_MAX_LEVELS (16)
+
+/* A KTX2 container read into memory. Only non-supercompressed 2D images 
+ * with the 'ru' orientation (the first row is the bottom one, as the 
+ * engine's images are loaded) are accepted. The levels point into 'buff'. */
+struct ktx_image{
+    void     *buff;
+    size_t    size;
+    uint32_t  vk_format;
+    GLenum    internal_format;
+    GLenum    format;     /* 0 for block-compressed formats */
+    int       width, height;
+    bool      gen_mips;   /* The file holds only the base level */
+    int       nlevels;
+    struct{
+        const unsigned char *data;
+        size_t               size;
+        int                  width, height;
+    }levels[KTX_MAX_LEVELS];
+};
+
+/* Any thread: reads and validates the file. Fails if it's not a KTX2 image 
+ * that the current GL context is able to sample from. */
+bool R_KTX_Load(const char *path, struct ktx_image *out);
+void R_KTX_Free(struct ktx_image *img);
+
+/* Any thread: compresses tightly-packed RGBA data to BC1 (or BC3, if it 
+ * has any translucent texels), along with the full mip chain, and writes 
+ * it as a KTX2 file. */
+bool R_KTX_Write(const char *path, const unsigned char *rgba, int width, int height);
+
+#endif
+
@@ -0,0 +1,235 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "public/render_ctrl.h"
+#include "gl_perf.h"
+#include "gl_assert.h"
+#include "gl_shader.h"
+
+#include <string.h>
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define NREADBACK_SLOTS     (3)
+#define WORD_BITS           (32)
+
+/* Same scheme as the movement readback: the results of every dispatch are
+ * copied into a host-visible buffer and fenced, and picked up by a later
+ * call to R_GL_LOSRead once the fence is signalled. 
+ */
+struct readback_slot{
+    GLuint   buffer;
+    GLsync   fence;
+    size_t   capacity;
+    size_t   size;
+    uint32_t batch;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static GLuint               s_jobs_ssbo;
+static GLuint               s_mask_ssbo;
+static GLuint               s_out_ssbo;
+
+static struct readback_slot s_readback[NREADBACK_SLOTS];
+static int                  s_readback_head;
+static int                  s_readback_tail;
+static int                  s_readback_pending;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void slot_release(struct readback_slot *slot)
+{
+    if(slot->fence) {
+        glDeleteSync(slot->fence);
+        slot->fence = 0;
+    }
+}
+
+static void slot_destroy(struct readback_slot *slot)
+{
+    slot_release(slot);
+    if(slot->buffer) {
+        glDeleteBuffers(1, &slot->buffer);
+    }
+    memset(slot, 0, sizeof(*slot));
+}
+
+static void slot_reserve(struct readback_slot *slot, size_t size)
+{
+    if(slot->buffer && slot->capacity >= size)
+        return;
+
+    size_t capacity = MAX(size, MAX(slot->capacity * 2, 4096));
+    if(!slot->buffer) {
+        glGenBuffers(1, &slot->buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot->buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    slot->capacity = capacity;
+}
+
+static void buffer_upload(GLuint *buff, const void *data, size_t size)
+{
+    if(!*buff) {
+        glGenBuffers(1, buff);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buff);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+static void readback_push(size_t size, uint32_t batch)
+{
+    /* If the CPU has fallen behind by more than the number of slots, 
+     * drop the oldest results rather than waiting on them. */
+    if(s_readback_pending == NREADBACK_SLOTS) {
+        slot_release(&s_readback[s_readback_tail]);
+        s_readback_tail = (s_readback_tail + 1) % NREADBACK_SLOTS;
+        s_readback_pending--;
+    }
+
+    struct readback_slot *slot = &s_readback[s_readback_head];
+    slot_reserve(slot, size);
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, s_out_ssbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot->buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    slot->size = size;
+    slot->batch = batch;
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    s_readback_head = (s_readback_head + 1) % NREADBACK_SLOTS;
+    s_readback_pending++;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_LOSDispatch(void *jobs, const size_t *njobs, void *mask, const size_t *mask_size,
+                      const int chunk_res[2], const uint32_t *batch)
+{
+    GL_PERF_ENTER();
+    assert(R_ComputeShaderSupported());
+    assert(chunk_res[1] % WORD_BITS == 0);
+
+    if(*njobs == 0)
+        GL_PERF_RETURN_VOID();
+
+    const size_t jobs_size = (*njobs + 1) * sizeof(GLint[4]);
+    const size_t out_size = *njobs * chunk_res[0] * (chunk_res[1] / WORD_BITS) * sizeof(GLuint);
+
+    buffer_upload(&s_jobs_ssbo, jobs, jobs_size);
+    buffer_upload(&s_mask_ssbo, mask, *mask_size);
+    buffer_upload(&s_out_ssbo, NULL, out_size);
+
+    R_GL_Shader_Install("los");
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, s_jobs_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, s_mask_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, s_out_ssbo);
+
+    int max_size = 0;
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 2, &max_size);
+    assert(*njobs <= max_size);
+    (void)max_size;
+
+    glDispatchCompute(chunk_res[1] / WORD_BITS, chunk_res[0], *njobs);
+    readback_push(out_size, *batch);
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_LOSRead(void *out, const size_t *maxout, uint32_t *out_batch, SDL_atomic_t *out_nread)
+{
+    GL_PERF_ENTER();
+
+    if(s_readback_pending == 0) {
+        SDL_AtomicSet(out_nread, 0);
+        GL_PERF_RETURN_VOID();
+    }
+
+    struct readback_slot *slot = &s_readback[s_readback_tail];
+    GLenum status = glClientWaitSync(slot->fence, 0, 0);
+
+    if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        SDL_AtomicSet(out_nread, 0);
+        GL_PERF_RETURN_VOID();
+    }
+
+    size_t read_size = MIN(slot->size, *maxout);
+    uint64_t read_begin = SDL_GetPerformanceCounter();
+    glBindBuffer(GL_COPY_READ_BUFFER, slot->buffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, read_size, out);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    Perf_RenderStall("render.stall_us.los_readback", read_begin);
+    *out_batch = slot->batch;
+
+    slot_release(slot);
+    s_readback_tail = (s_readback_tail + 1) % NREADBACK_SLOTS;
+    s_readback_pending--;
+
+    SDL_AtomicSet(out_nread, read_size / sizeof(GLuint));
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_LOSShutdown(void)
+{
+    for(int i = 0; i < NREADBACK_SLOTS; i++) {
+        slot_destroy(&s_readback[i]);
+    }
+    s_readback_head = 0;
+    s_readback_tail = 0;
+    s_readback_pending = 0;
+
+    GLuint buffs[] = {s_jobs_ssbo, s_mask_ssbo, s_out_ssbo};
+    for(int i = 0; i < sizeof(buffs)/sizeof(buffs[0]); i++) {
+        if(buffs[i])
+            glDeleteBuffers(1, &buffs[i]);
+    }
+    s_jobs_ssbo = s_mask_ssbo = s_out_ssbo = 0;
+}
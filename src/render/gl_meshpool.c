@@ -0,0 +1,375 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "gl_meshpool.h"
+#include "gl_assert.h"
+#include "../perf.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/vec.h"
+#include "../lib/public/mem.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define ALIGN_UP(val, a)    ((((val) + (a) - 1) / (a)) * (a))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define MAX_POOL_SZ         ((size_t)1024 * 1024 * 1024)
+
+struct range{
+    size_t offset;
+    size_t size;
+};
+
+struct pool_entry{
+    size_t   offset;
+    size_t   size;
+    uint32_t refcount;
+};
+
+VEC_TYPE(range, struct range)
+VEC_IMPL(static inline, range, struct range)
+
+KHASH_MAP_INIT_INT(entry, struct pool_entry)
+
+struct gl_mesh_pool{
+    GLuint            VBO;
+    size_t            size;
+    size_t            alignment;
+    size_t            used;
+    uint32_t          generation;
+    /* Free ranges, sorted by offset. Adjacent ranges are always merged. */
+    vec_range_t       free;
+    khash_t(entry)   *entries;
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void range_remove(vec_range_t *ranges, int idx)
+{
+    memmove(&vec_AT(ranges, idx), &vec_AT(ranges, idx + 1), 
+        (vec_size(ranges) - idx - 1) * sizeof(struct range));
+    vec_size(ranges)--;
+}
+
+static bool range_insert(vec_range_t *ranges, int idx, struct range r)
+{
+    if(!vec_range_push(ranges, r))
+        return false;
+    memmove(&vec_AT(ranges, idx + 1), &vec_AT(ranges, idx), 
+        (vec_size(ranges) - idx - 1) * sizeof(struct range));
+    vec_AT(ranges, idx) = r;
+    return true;
+}
+
+/* Returns the offset of the lowest free range holding 'size' bytes, ending 
+ * no higher than 'limit'. */
+static bool pool_alloc(struct gl_mesh_pool *pool, size_t size, size_t limit, size_t *out)
+{
+    for(int i = 0; i < vec_size(&pool->free); i++) {
+
+        struct range *curr = &vec_AT(&pool->free, i);
+        if(curr->offset + size > limit)
+            return false;
+        if(curr->size < size)
+            continue;
+
+        *out = curr->offset;
+        curr->offset += size;
+        curr->size -= size;
+        if(curr->size == 0) {
+            range_remove(&pool->free, i);
+        }
+        pool->used += size;
+        return true;
+    }
+    return false;
+}
+
+static bool pool_free(struct gl_mesh_pool *pool, size_t offset, size_t size)
+{
+    int idx = 0;
+    while(idx < vec_size(&pool->free) && vec_AT(&pool->free, idx).offset < offset)
+        idx++;
+
+    bool merge_prev = (idx > 0) 
+        && (vec_AT(&pool->free, idx - 1).offset + vec_AT(&pool->free, idx - 1).size == offset);
+    bool merge_next = (idx < vec_size(&pool->free)) 
+        && (offset + size == vec_AT(&pool->free, idx).offset);
+
+    if(merge_prev && merge_next) {
+        vec_AT(&pool->free, idx - 1).size += size + vec_AT(&pool->free, idx).size;
+        range_remove(&pool->free, idx);
+    }else if(merge_prev) {
+        vec_AT(&pool->free, idx - 1).size += size;
+    }else if(merge_next) {
+        vec_AT(&pool->free, idx).offset = offset;
+        vec_AT(&pool->free, idx).size += size;
+    }else if(!range_insert(&pool->free, idx, (struct range){offset, size})) {
+        return false;
+    }
+    pool->used -= size;
+    return true;
+}
+
+static GLuint pool_new_buffer(size_t size)
+{
+    GLuint ret;
+    glGenBuffers(1, &ret);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ret);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    Perf_MemAlloc(PERF_MEM_GPU_BATCH_BUFFERS, size);
+    return ret;
+}
+
+/* Move all the live meshes to the start of a new, larger, buffer. The old
+ * buffer is deleted right away - the driver keeps it alive until the draws 
+ * that are already queued against it complete.
+ */
+static bool pool_grow(struct gl_mesh_pool *pool, size_t min_free)
+{
+    size_t new_size = MAX(pool->size * 2, ALIGN_UP(pool->used + min_free, pool->alignment));
+    if(new_size > MAX_POOL_SZ)
+        return false;
+
+    vec_range_t new_free;
+    vec_range_init(&new_free);
+    if(!vec_range_resize(&new_free, 16))
+        return false;
+
+    GLuint new_vbo = pool_new_buffer(new_size);
+    glBindBuffer(GL_COPY_READ_BUFFER, pool->VBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_vbo);
+
+    size_t cursor = 0;
+    for(khiter_t k = kh_begin(pool->entries); k != kh_end(pool->entries); k++) {
+
+        if(!kh_exist(pool->entries, k))
+            continue;
+
+        struct pool_entry *entry = &kh_val(pool->entries, k);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+            entry->offset, cursor, entry->size);
+        entry->offset = cursor;
+        cursor += entry->size;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    assert(cursor == pool->used);
+
+    glDeleteBuffers(1, &pool->VBO);
+    Perf_MemFree(PERF_MEM_GPU_BATCH_BUFFERS, pool->size);
+
+    vec_range_push(&new_free, (struct range){cursor, new_size - cursor});
+    vec_range_destroy(&pool->free);
+    pool->free = new_free;
+    pool->VBO = new_vbo;
+    pool->size = new_size;
+    pool->generation++;
+
+    PERF_COUNTER_ADD("render.mesh_pool_grows", 1);
+    GL_ASSERT_OK();
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+struct gl_mesh_pool *R_GL_MeshPoolInit(size_t size, size_t alignment)
+{
+    struct gl_mesh_pool *pool = malloc(sizeof(struct gl_mesh_pool));
+    if(!pool)
+        goto fail_alloc;
+
+    pool->entries = kh_init(entry);
+    if(!pool->entries)
+        goto fail_entries;
+
+    vec_range_init(&pool->free);
+    if(!vec_range_push(&pool->free, (struct range){0, ALIGN_UP(size, alignment)}))
+        goto fail_free;
+
+    pool->size = ALIGN_UP(size, alignment);
+    pool->alignment = alignment;
+    pool->used = 0;
+    pool->generation = 0;
+    pool->VBO = pool_new_buffer(pool->size);
+
+    GL_ASSERT_OK();
+    return pool;
+
+fail_free:
+    kh_destroy(entry, pool->entries);
+fail_entries:
+    PF_FREE(pool);
+fail_alloc:
+    return NULL;
+}
+
+void R_GL_MeshPoolDestroy(struct gl_mesh_pool *pool)
+{
+    glDeleteBuffers(1, &pool->VBO);
+    Perf_MemFree(PERF_MEM_GPU_BATCH_BUFFERS, pool->size);
+
+    vec_range_destroy(&pool->free);
+    kh_destroy(entry, pool->entries);
+    PF_FREE(pool);
+}
+
+bool R_GL_MeshPoolAcquire(struct gl_mesh_pool *pool, GLuint src_vbo)
+{
+    khiter_t k = kh_get(entry, pool->entries, src_vbo);
+    if(k != kh_end(pool->entries)) {
+        kh_val(pool->entries, k).refcount++;
+        return true;
+    }
+
+    GLint src_size;
+    glBindBuffer(GL_COPY_READ_BUFFER, src_vbo);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &src_size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    if(src_size <= 0)
+        return false;
+
+    size_t size = ALIGN_UP((size_t)src_size, pool->alignment);
+    size_t offset;
+
+    if(!pool_alloc(pool, size, pool->size, &offset)) {
+        if(!pool_grow(pool, size))
+            return false;
+        if(!pool_alloc(pool, size, pool->size, &offset))
+            return false;
+    }
+
+    int status;
+    k = kh_put(entry, pool->entries, src_vbo, &status);
+    if(status == -1) {
+        pool_free(pool, offset, size);
+        return false;
+    }
+    kh_val(pool->entries, k) = (struct pool_entry){offset, size, 1};
+
+    /* Perform VBO-to-VBO copy. The data should be copied without having 
+     * to do a round-trip to the CPU.
+     */
+    glBindBuffer(GL_COPY_READ_BUFFER, src_vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool->VBO);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, src_size);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_MeshPoolRelease(struct gl_mesh_pool *pool, GLuint src_vbo)
+{
+    khiter_t k = kh_get(entry, pool->entries, src_vbo);
+    assert(k != kh_end(pool->entries));
+
+    struct pool_entry *entry = &kh_val(pool->entries, k);
+    assert(entry->refcount > 0);
+    if(--entry->refcount > 0)
+        return;
+
+    /* If the free list cannot grow, the range is simply leaked until the
+     * next time the pool is grown. */
+    pool_free(pool, entry->offset, entry->size);
+    kh_del(entry, pool->entries, k);
+}
+
+size_t R_GL_MeshPoolOffset(const struct gl_mesh_pool *pool, GLuint src_vbo)
+{
+    khiter_t k = kh_get(entry, pool->entries, src_vbo);
+    assert(k != kh_end(pool->entries));
+    return kh_val(pool->entries, k).offset;
+}
+
+void R_GL_MeshPoolCompact(struct gl_mesh_pool *pool, size_t max_bytes)
+{
+    size_t moved = 0;
+    while(moved < max_bytes && vec_size(&pool->free) > 0) {
+
+        /* Find the highest mesh that sits above a hole */
+        struct pool_entry *top = NULL;
+        for(khiter_t k = kh_begin(pool->entries); k != kh_end(pool->entries); k++) {
+
+            if(!kh_exist(pool->entries, k))
+                continue;
+            struct pool_entry *curr = &kh_val(pool->entries, k);
+            if(!top || curr->offset > top->offset) {
+                top = curr;
+            }
+        }
+        if(!top || top->offset < vec_AT(&pool->free, 0).offset)
+            break;
+
+        /* The destination must not overlap the source for the copy */
+        size_t dst;
+        if(!pool_alloc(pool, top->size, top->offset, &dst))
+            break;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, pool->VBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool->VBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, top->offset, dst, top->size);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        pool_free(pool, top->offset, top->size);
+        top->offset = dst;
+        moved += top->size;
+    }
+
+    if(moved > 0) {
+        PERF_COUNTER_ADD("render.mesh_pool_moved_bytes", moved);
+    }
+    GL_ASSERT_OK();
+}
+
+GLuint R_GL_MeshPoolGetVBO(const struct gl_mesh_pool *pool)
+{
+    return pool->VBO;
+}
+
+uint32_t R_GL_MeshPoolGeneration(const struct gl_mesh_pool *pool)
+{
+    return pool->generation;
+}
+
@@ -0,0 +1,73 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef GL_MESHPOOL_H
+#define GL_MESHPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+/* The mesh pool holds the vertices of many meshes of the same vertex 
+ * format in a single large buffer, so that they can all be drawn with one 
+ * VAO and a single multidraw. Meshes are keyed by their source VBO and 
+ * reference counted, so a mesh that is used by many batches is only stored 
+ * once. 
+ *
+ * Space is suballocated first-fit from a list of free ranges. Releasing 
+ * meshes leaves holes, which are closed over time by moving the highest 
+ * meshes down into them, within a per-call budget. When the buffer is 
+ * full, it is reallocated at a larger size and all the live meshes are 
+ * packed at its' start.
+ *
+ * The offset of a mesh may thus change between any two calls to Acquire or
+ * Compact, and must be looked up whenever the draw commands are built. The
+ * buffer itself may be replaced, which is signalled by a change in the 
+ * generation, after which any VAOs referencing it must be recreated.
+ */
+struct gl_mesh_pool;
+
+struct gl_mesh_pool *R_GL_MeshPoolInit(size_t size, size_t alignment);
+void                 R_GL_MeshPoolDestroy(struct gl_mesh_pool *pool);
+bool                 R_GL_MeshPoolAcquire(struct gl_mesh_pool *pool, GLuint src_vbo);
+void                 R_GL_MeshPoolRelease(struct gl_mesh_pool *pool, GLuint src_vbo);
+size_t               R_GL_MeshPoolOffset(const struct gl_mesh_pool *pool, GLuint src_vbo);
+void                 R_GL_MeshPoolCompact(struct gl_mesh_pool *pool, size_t max_bytes);
+GLuint               R_GL_MeshPoolGetVBO(const struct gl_mesh_pool *pool);
+uint32_t             R_GL_MeshPoolGeneration(const struct gl_mesh_pool *pool);
+
+#endif
+
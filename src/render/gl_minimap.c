@@ -68,11 +68,15 @@ struct coord{
     int r, c;
 };
 
+/* The unit buffers are kept for the lifetime of the minimap and are only 
+ * re-allocated when the number of units exceeds their capacity. */
 struct unit_render_ctx{
     GLuint vert_vbo;
     GLuint clr_vbo;
     GLuint off_vbo;
     GLuint vao;
+    size_t capacity;
+    int    side_len_px;
 };
 
 /*****************************************************************************/
@@ -84,6 +88,7 @@ struct render_minimap_ctx{
     struct texture        minimap_texture;
     struct texture        water_texture;
     struct mesh           minimap_mesh;
+    struct unit_render_ctx units;
 }s_ctx;
 
 /*****************************************************************************/
@@ -363,7 +368,8 @@ static void create_water_texture(const struct map *map)
     };
 
     R_GL_MapUpdateFogClear();
-    R_GL_DrawWater(&in, &fval, &fval);
+    const int quality = WATER_QUALITY_HIGH;
+    R_GL_DrawWater(&in, &fval, &fval, &quality);
     R_GL_MapInvalidate();
 
     glDeleteFramebuffers(1, &fb);
@@ -448,31 +454,22 @@ static void setup_verts(void)
     GL_PERF_RETURN_VOID();
 }
 
-static void unit_render_ctx_init(struct unit_render_ctx *in, int side_len_px, 
-                                 size_t nunits, vec2_t *offsets, vec3_t *colors)
+static void unit_render_ctx_init(struct unit_render_ctx *in)
 {
-    vec3_t verts[4] = {
-        (vec3_t) {-1.0f / side_len_px * 4, -1.0f / side_len_px * 4, 0.0f}, 
-        (vec3_t) {-1.0f / side_len_px * 4,  1.0f / side_len_px * 4, 0.0f}, 
-        (vec3_t) { 1.0f / side_len_px * 4,  1.0f / side_len_px * 4, 0.0f}, 
-        (vec3_t) { 1.0f / side_len_px * 4, -1.0f / side_len_px * 4, 0.0f}, 
-    };
-
     glGenVertexArrays(1, &in->vao);
     glBindVertexArray(in->vao);
 
+    /* Attribute 0 - position */
     glGenBuffers(1, &in->vert_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, in->vert_vbo);
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(verts) * sizeof(vec3_t), verts, GL_STREAM_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(vec3_t), NULL, GL_STATIC_DRAW);
 
-    /* Attribute 0 - position */
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
     glEnableVertexAttribArray(0);
 
     /* Attribute 1 - color */
     glGenBuffers(1, &in->clr_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, in->clr_vbo);
-    glBufferData(GL_ARRAY_BUFFER, nunits * sizeof(vec3_t), colors, GL_STREAM_DRAW);
 
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
     glEnableVertexAttribArray(1);
@@ -481,11 +478,44 @@ static void unit_render_ctx_init(struct unit_render_ctx *in, int side_len_px,
     /* Attribute 2 - offset */
     glGenBuffers(1, &in->off_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, in->off_vbo);
-    glBufferData(GL_ARRAY_BUFFER, nunits * sizeof(vec2_t), offsets, GL_STREAM_DRAW);
 
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vec2_t), (void*)0);
     glEnableVertexAttribArray(2);
     glVertexAttribDivisor(2, 1);
+
+    in->capacity = 0;
+    in->side_len_px = 0;
+}
+
+static void unit_render_ctx_upload(struct unit_render_ctx *in, int side_len_px, 
+                                   size_t nunits, vec2_t *offsets, vec3_t *colors)
+{
+    if(in->side_len_px != side_len_px) {
+
+        vec3_t verts[4] = {
+            (vec3_t) {-1.0f / side_len_px * 4, -1.0f / side_len_px * 4, 0.0f}, 
+            (vec3_t) {-1.0f / side_len_px * 4,  1.0f / side_len_px * 4, 0.0f}, 
+            (vec3_t) { 1.0f / side_len_px * 4,  1.0f / side_len_px * 4, 0.0f}, 
+            (vec3_t) { 1.0f / side_len_px * 4, -1.0f / side_len_px * 4, 0.0f}, 
+        };
+        glBindBuffer(GL_ARRAY_BUFFER, in->vert_vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(verts), verts);
+        in->side_len_px = side_len_px;
+    }
+
+    /* Orphan the previous frame's storage so that the upload doesn't have to 
+     * wait on the draw still using it */
+    if(nunits > in->capacity) {
+        in->capacity = MAX(nunits, in->capacity * 2);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, in->clr_vbo);
+    glBufferData(GL_ARRAY_BUFFER, in->capacity * sizeof(vec3_t), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, nunits * sizeof(vec3_t), colors);
+
+    glBindBuffer(GL_ARRAY_BUFFER, in->off_vbo);
+    glBufferData(GL_ARRAY_BUFFER, in->capacity * sizeof(vec2_t), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, nunits * sizeof(vec2_t), offsets);
 }
 
 static void unit_render_ctx_destroy(struct unit_render_ctx *in)
@@ -530,14 +560,15 @@ void R_GL_MinimapBake(const struct map *map, void **chunk_rprivates,
     GL_PERF_RETURN_VOID();
 }
 
-void R_GL_MinimapUpdateChunk(const struct map *map, void *chunk_rprivate, 
-                             mat4x4_t *chunk_model, const int *chunk_r, const int *chunk_c)
+void R_GL_MinimapUpdateChunks(const struct map *map, const size_t *nchunks, 
+                               void **chunk_rprivates, mat4x4_t *chunk_models, 
+                               const int *chunk_rs, const int *chunk_cs)
 {
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
     setup_ortho_view_uniforms(map);
 
-    /* Render the chunk to the existing minimap texture */
+    /* Render the chunks to the existing minimap texture */
     GLuint fb;
     glGenFramebuffers(1, &fb);
     glBindFramebuffer(GL_FRAMEBUFFER, fb);
@@ -551,8 +582,10 @@ void R_GL_MinimapUpdateChunk(const struct map *map, void *chunk_rprivate,
     R_GL_MapUpdateFogClear();
 
     glViewport(0,0, MINIMAP_RES, MINIMAP_RES);
-    draw_minimap_water(map, (struct coord){*chunk_r, *chunk_c});
-    draw_minimap_terrain(chunk_rprivate, chunk_model);
+    for(int i = 0; i < *nchunks; i++) {
+        draw_minimap_water(map, (struct coord){chunk_rs[i], chunk_cs[i]});
+        draw_minimap_terrain(chunk_rprivates[i], &chunk_models[i]);
+    }
 
     R_GL_MapInvalidate();
 
@@ -667,19 +700,19 @@ void  R_GL_MinimapRenderUnits(const struct map *map, vec2_t *center_pos,
     PFM_Mat4x4_Mult4x4(&scale, &tilt, &tmp);
     PFM_Mat4x4_Mult4x4(&trans, &tmp, &model);
 
-    struct unit_render_ctx ctx;
-    unit_render_ctx_init(&ctx, *side_len_px, *nunits, posbuff, colorbuff);
+    if(!s_ctx.units.vao) {
+        unit_render_ctx_init(&s_ctx.units);
+    }
+    unit_render_ctx_upload(&s_ctx.units, *side_len_px, *nunits, posbuff, colorbuff);
 
     R_GL_StateSet(GL_U_MODEL, (struct uval){
         .type = UTYPE_MAT4,
         .val.as_mat4 = model
     });
     R_GL_Shader_Install("minimap-units");
-    glBindVertexArray(ctx.vao);
+    glBindVertexArray(s_ctx.units.vao);
     glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, *nunits);
 
-    unit_render_ctx_destroy(&ctx);
-
     GL_PERF_RETURN_VOID();
 }
 
@@ -695,6 +728,9 @@ void R_GL_MinimapFree(void)
     R_GL_Texture_Free(NULL, "__minimap_water__");
     glDeleteVertexArrays(1, &s_ctx.minimap_mesh.VAO);
     glDeleteBuffers(1, &s_ctx.minimap_mesh.VBO);
+    if(s_ctx.units.vao) {
+        unit_render_ctx_destroy(&s_ctx.units);
+    }
     memset(&s_ctx, 0, sizeof(s_ctx));
 }
 
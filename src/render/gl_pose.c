@@ -0,0 +1,174 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2023 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "public/render_ctrl.h"
+#include "gl_render.h"
+#include "gl_state.h"
+#include "gl_assert.h"
+#include "gl_perf.h"
+#include "../main.h"
+
+#include <GL/glew.h>
+
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define MIN_CAPACITY        (4096)
+
+/* The skinning matrices (pose * inverse bind pose) of every frame of every 
+ * loaded animation clip are baked once at load time and kept in a single 
+ * buffer, so that an animated instance only has to refer to the first matrix 
+ * of its' current frame. Matrices are allocated on the main thread as the 
+ * animation data is loaded and are never freed; the render thread grows the 
+ * buffer as the uploads come in. Each matrix is 4 RGBA32F texels (columns).
+ */
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* Main thread */
+static size_t s_next_base;
+
+/* Render thread */
+static GLuint s_pose_buff;
+static GLuint s_pose_tex;
+static size_t s_capacity; /* in matrices */
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void pose_reserve(size_t nmats)
+{
+    if(s_pose_buff && s_capacity >= nmats)
+        return;
+
+    size_t capacity = MAX(nmats, MAX(s_capacity * 2, MIN_CAPACITY));
+    GLuint buff;
+
+    glGenBuffers(1, &buff);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buff);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(mat4x4_t), NULL, GL_STATIC_DRAW);
+
+    if(s_pose_buff) {
+        glBindBuffer(GL_COPY_READ_BUFFER, s_pose_buff);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, 
+            s_capacity * sizeof(mat4x4_t));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &s_pose_buff);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if(!s_pose_tex) {
+        glGenTextures(1, &s_pose_tex);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, s_pose_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buff);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    s_pose_buff = buff;
+    s_capacity = capacity;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+size_t R_PoseBuffAdd(const mat4x4_t *mats, size_t count)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    size_t base = s_next_base;
+    s_next_base += count;
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_PoseBuffUpload,
+        .nargs = 3,
+        .args = {
+            R_PushArg(mats, count * sizeof(mat4x4_t)),
+            R_PushArg(&base, sizeof(base)),
+            R_PushArg(&count, sizeof(count)),
+        },
+    });
+    return base;
+}
+
+void R_GL_PoseBuffUpload(const mat4x4_t *mats, const size_t *base, const size_t *count)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    pose_reserve(*base + *count);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, s_pose_buff);
+    glBufferSubData(GL_TEXTURE_BUFFER, *base * sizeof(mat4x4_t), *count * sizeof(mat4x4_t), mats);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_PoseBuffBind(void)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    if(!s_pose_tex) {
+        pose_reserve(0);
+    }
+
+    glActiveTexture(POSE_BUFF_TUNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, s_pose_tex);
+
+    R_GL_StateSet(GL_U_POSE_BUFF, (struct uval){
+        .type = UTYPE_INT,
+        .val.as_int = POSE_BUFF_TUNIT - GL_TEXTURE0
+    });
+}
+
+void R_GL_PoseBuffShutdown(void)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    if(s_pose_tex) {
+        glDeleteTextures(1, &s_pose_tex);
+    }
+    if(s_pose_buff) {
+        glDeleteBuffers(1, &s_pose_buff);
+    }
+    s_pose_tex = 0;
+    s_pose_buff = 0;
+    s_capacity = 0;
+}
+
@@ -0,0 +1,169 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "render_private.h"
+#include "gl_render.h"
+#include "gl_vertex.h"
+#include "gl_shader.h"
+#include "gl_texture.h"
+#include "gl_state.h"
+#include "gl_assert.h"
+#include "gl_perf.h"
+#include "../main.h"
+
+#include <GL/glew.h>
+#include <stddef.h>
+
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* The mesh attributes are re-pointed at the vertex buffer of every model that 
+ * is drawn, so that no per-model state outlives the models themselves. */
+static GLuint s_vao;
+static GLuint s_inst_vbo;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void proj_ctx_init(void)
+{
+    glGenVertexArrays(1, &s_vao);
+    glBindVertexArray(s_vao);
+
+    for(int i = 0; i < 7; i++) {
+        glEnableVertexAttribArray(i);
+    }
+
+    /* Attributes 4, 5 and 6 - instance position, velocity and scale */
+    glGenBuffers(1, &s_inst_vbo);
+    glVertexAttribDivisor(4, 1);
+    glVertexAttribDivisor(5, 1);
+    glVertexAttribDivisor(6, 1);
+}
+
+static void proj_bind_mesh(const struct render_private *priv)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+
+    /* Attribute 0 - position */
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, priv->vertex_stride, (void*)0);
+
+    /* Attribute 1 - texture coordinates */
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, priv->vertex_stride, 
+        (void*)offsetof(struct vertex, uv));
+
+    /* Attribute 2 - normal */
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, priv->vertex_stride, 
+        (void*)offsetof(struct vertex, normal));
+
+    /* Attribute 3 - material index */
+    glVertexAttribIPointer(3, 1, GL_INT, priv->vertex_stride, 
+        (void*)offsetof(struct vertex, material_idx));
+}
+
+static void proj_bind_instances(size_t first)
+{
+    const size_t base = first * sizeof(struct proj_rstate);
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_vbo);
+
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(struct proj_rstate), 
+        (void*)(base + offsetof(struct proj_rstate, pos)));
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(struct proj_rstate), 
+        (void*)(base + offsetof(struct proj_rstate, vel)));
+    glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(struct proj_rstate), 
+        (void*)(base + offsetof(struct proj_rstate, scale)));
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_ProjectilesDraw(const struct proj_rstate *insts, const size_t *ninsts,
+                          const struct proj_rgroup *groups, const size_t *ngroups)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    if(*ninsts == 0)
+        GL_PERF_RETURN_VOID();
+
+    if(!s_vao) {
+        proj_ctx_init();
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_vbo);
+    glBufferData(GL_ARRAY_BUFFER, *ninsts * sizeof(struct proj_rstate), insts, GL_STREAM_DRAW);
+
+    GLuint shader_prog = R_GL_Shader_GetProgForName("mesh.static.projectile");
+    R_GL_Shader_InstallProg(shader_prog);
+    R_GL_ShadowMapBind();
+    glBindVertexArray(s_vao);
+
+    for(int i = 0; i < *ngroups; i++) {
+
+        const struct proj_rgroup *group = &groups[i];
+        const struct render_private *priv = group->render_private;
+
+        if(priv->material_ubo) {
+            glBindBufferBase(GL_UNIFORM_BUFFER, UBLOCK_MATERIALS, priv->material_ubo);
+        }
+        if(priv->num_materials > 0) {
+            R_GL_Texture_BindArray(&priv->material_arr, shader_prog);
+        }
+
+        proj_bind_mesh(priv);
+        proj_bind_instances(group->first);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, priv->mesh.num_verts, group->count);
+    }
+
+    glBindVertexArray(0);
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_ProjectilesShutdown(void)
+{
+    if(s_vao) {
+        glDeleteVertexArrays(1, &s_vao);
+        glDeleteBuffers(1, &s_inst_vbo);
+    }
+    s_vao = 0;
+    s_inst_vbo = 0;
+}
+
@@ -50,6 +50,7 @@
 #include "../anim/public/anim.h"
 #include "../map/public/map.h"
 #include "../lib/public/mem.h"
+#include "../lib/public/vec.h"
 #include "../ui.h"
 #include "../main.h"
 
@@ -66,6 +67,185 @@
 #define MAX(a, b)                   ((a) > (b) ? (a) : (b))
 #define MIN(a, b)                   ((a) < (b) ? (a) : (b))
 
+VEC_TYPE(cvert, struct colored_vert)
+VEC_IMPL(static inline, cvert, struct colored_vert)
+
+enum prim_stream{
+    PRIM_TRIS,
+    PRIM_LINES,
+    PRIM_LINES_2D,
+    PRIM_NUM_STREAMS,
+};
+
+/* The debug and selection primitives are accumulated in world (or screen) 
+ * space and drawn with a single call per stream when a command that is not 
+ * a primitive is executed, or at the end of the frame. Lines of different 
+ * widths cannot share a draw, so a width change flushes the line stream.
+ */
+struct prim_batch{
+    bool           init;
+    GLuint         VAO, VBO;
+    vec_cvert_t    verts[PRIM_NUM_STREAMS];
+    float          line_width[PRIM_NUM_STREAMS];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct prim_batch s_prims;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void prims_init(void)
+{
+    if(s_prims.init)
+        return;
+
+    glGenVertexArrays(1, &s_prims.VAO);
+    glBindVertexArray(s_prims.VAO);
+
+    glGenBuffers(1, &s_prims.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_prims.VBO);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct colored_vert), 
+        (void*)offsetof(struct colored_vert, pos));
+    glEnableVertexAttribArray(0);  
+
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(struct colored_vert), 
+        (void*)offsetof(struct colored_vert, color));
+    glEnableVertexAttribArray(1);  
+
+    glBindVertexArray(0);
+
+    for(int i = 0; i < PRIM_NUM_STREAMS; i++) {
+        vec_cvert_init(&s_prims.verts[i]);
+        s_prims.line_width[i] = 1.0f;
+    }
+    s_prims.init = true;
+}
+
+static void prims_draw_stream(enum prim_stream stream, GLenum mode)
+{
+    vec_cvert_t *verts = &s_prims.verts[stream];
+    if(vec_size(verts) == 0)
+        return;
+
+    glBufferData(GL_ARRAY_BUFFER, vec_size(verts) * sizeof(struct colored_vert), 
+        verts->array, GL_STREAM_DRAW);
+
+    GLfloat old_width;
+    glGetFloatv(GL_LINE_WIDTH, &old_width);
+    glLineWidth(s_prims.line_width[stream]);
+
+    glDrawArrays(mode, 0, vec_size(verts));
+
+    glLineWidth(old_width);
+    vec_cvert_reset(verts);
+}
+
+/* Returns a pointer to 'count' new vertices at the end of the stream, first 
+ * flushing the whole batch if the stream holds lines of a different width */
+static struct colored_vert *prims_alloc(enum prim_stream stream, size_t count, float width)
+{
+    prims_init();
+    vec_cvert_t *verts = &s_prims.verts[stream];
+    if(stream != PRIM_TRIS && width != s_prims.line_width[stream]) {
+        R_GL_PrimBatchFlush();
+        s_prims.line_width[stream] = width;
+    }
+
+    size_t needed = vec_size(verts) + count;
+    if(needed > verts->capacity
+    && !vec_cvert_resize(verts, MAX(needed, verts->capacity * 2)))
+        return NULL;
+
+    struct colored_vert *ret = verts->array + vec_size(verts);
+    verts->size += count;
+    return ret;
+}
+
+/* Appends a triangle strip as a list of independent triangles, keeping the 
+ * winding of every triangle the same as it would have been in the strip */
+static void prims_push_strip(const vec3_t *strip, size_t nverts, const vec3_t *color)
+{
+    if(nverts < 3)
+        return;
+
+    size_t ntris = nverts - 2;
+    struct colored_vert *out = prims_alloc(PRIM_TRIS, ntris * 3, 1.0f);
+    if(!out)
+        return;
+
+    vec4_t color4 = (vec4_t){color->x, color->y, color->z, 1.0f};
+    for(size_t i = 0; i < ntris; i++) {
+
+        bool odd = (i % 2);
+        *out++ = (struct colored_vert){strip[odd ? i + 1 : i], color4};
+        *out++ = (struct colored_vert){strip[odd ? i : i + 1], color4};
+        *out++ = (struct colored_vert){strip[i + 2], color4};
+    }
+}
+
+static void prims_push_lines(enum prim_stream stream, const vec3_t *verts, size_t nverts, 
+                             const mat4x4_t *model, const vec4_t *color, float width)
+{
+    struct colored_vert *out = prims_alloc(stream, nverts, width);
+    if(!out)
+        return;
+
+    for(size_t i = 0; i < nverts; i++) {
+
+        vec3_t pos = verts[i];
+        if(model) {
+            vec4_t homo = (vec4_t){pos.x, pos.y, pos.z, 1.0f};
+            vec4_t ws_homo;
+            PFM_Mat4x4_Mult4x1((mat4x4_t*)model, &homo, &ws_homo);
+            pos = (vec3_t){ws_homo.x / ws_homo.w, ws_homo.y / ws_homo.w, ws_homo.z / ws_homo.w};
+        }
+        out[i] = (struct colored_vert){pos, *color};
+    }
+}
+
+/* Indexed ranges are drawn from the reduced-detail indices of terrain chunks */
+static void draw_range(const struct render_private *priv, mat4x4_t *model, 
+                       bool translucent, bool indexed, GLint first, GLsizei count)
+{
+    if(translucent) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR);
+    }
+
+    R_GL_StateSet(GL_U_MODEL, (struct uval){
+        .type = UTYPE_MAT4,
+        .val.as_mat4 = *model
+    });
+
+    R_GL_Shader_InstallProg(priv->shader_prog);
+
+    if(priv->material_ubo) {
+        glBindBufferBase(GL_UNIFORM_BUFFER, UBLOCK_MATERIALS, priv->material_ubo);
+    }
+
+    if(priv->num_materials > 0) {
+        R_GL_Texture_BindArray(&priv->material_arr, priv->shader_prog);
+    }
+    R_GL_ShadowMapBind();
+    
+    glBindVertexArray(priv->mesh.VAO);
+    if(indexed) {
+        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(first * sizeof(GLuint)));
+    }else{
+        glDrawArrays(GL_TRIANGLES, first, count);
+    }
+
+    if(translucent) {
+        glDisable(GL_BLEND);
+    }
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -76,12 +256,17 @@ void R_GL_Init(struct render_private *priv, const char *shader, const struct ver
     ASSERT_IN_RENDER_THREAD();
     struct mesh *mesh = &priv->mesh;
 
+    size_t buff_verts = mesh->num_verts;
+    if(priv->lods_valid) {
+        buff_verts = priv->lod_first[priv->num_lods-1] + priv->lod_count[priv->num_lods-1];
+    }
+
     glGenVertexArrays(1, &mesh->VAO);
     glBindVertexArray(mesh->VAO);
 
     glGenBuffers(1, &mesh->VBO);
     glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
-    glBufferData(GL_ARRAY_BUFFER, mesh->num_verts * priv->vertex_stride, vbuff, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, buff_verts * priv->vertex_stride, vbuff, GL_STATIC_DRAW);
 
     /* Attribute 0 - position */
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, priv->vertex_stride, (void*)0);
@@ -123,37 +308,6 @@ void R_GL_Init(struct render_private *priv, const char *shader, const struct ver
             (void*)(offsetof(struct anim_vert, weights) + 3*sizeof(GLfloat)));
         glEnableVertexAttribArray(7);  
 
-    }else if(strstr(shader, "terrain")) {
-
-        /* Attribute 4 - blend mode */
-        glVertexAttribIPointer(4, 1, GL_SHORT, priv->vertex_stride, 
-            (void*)offsetof(struct terrain_vert, blend_mode));
-        glEnableVertexAttribArray(4);
-
-        /* Attribute 5 - middle material indices packed together */
-        glVertexAttribIPointer(5, 1, GL_SHORT, priv->vertex_stride, 
-          (void*)offsetof(struct terrain_vert, middle_indices));
-        glEnableVertexAttribArray(5);
-
-        /* Attribute 6 - corner 1 material indices packed together */
-        glVertexAttribIPointer(6, 2, GL_INT, priv->vertex_stride, 
-            (void*)offsetof(struct terrain_vert, c1_indices));
-        glEnableVertexAttribArray(6);
-
-        /* Attribute 7 - corner 2 material indices packed together */
-        glVertexAttribIPointer(7, 2, GL_INT, priv->vertex_stride, 
-            (void*)offsetof(struct terrain_vert, c2_indices));
-        glEnableVertexAttribArray(7);
-
-        /* Attribute 8 - tile top and bottom material indices packed together */
-        glVertexAttribIPointer(8, 1, GL_INT, priv->vertex_stride, 
-            (void*)offsetof(struct terrain_vert, tb_indices));
-        glEnableVertexAttribArray(8);
-
-        /* Attribute 9 - tile left and right material indices packed together */
-        glVertexAttribIPointer(9, 1, GL_INT, priv->vertex_stride, 
-            (void*)offsetof(struct terrain_vert, lr_indices));
-        glEnableVertexAttribArray(9);
     }
 
     priv->shader_prog = R_GL_Shader_GetProgForName(shader);
@@ -169,6 +323,29 @@ void R_GL_Init(struct render_private *priv, const char *shader, const struct ver
         R_GL_Texture_ArrayMake(priv->materials, priv->num_materials, &priv->material_arr, GL_TEXTURE0);
     }
 
+    priv->material_ubo = 0;
+    if(priv->num_materials > 0
+    && glGetUniformBlockIndex(priv->shader_prog, GL_U_MATERIAL_BLOCK) != GL_INVALID_INDEX) {
+
+        /* The material properties never change after loading, so they are 
+         * uploaded once in the std140 layout of the shaders' material block */
+        unsigned char block[MAX_MATERIALS * GL_MATERIAL_STRIDE] = {0};
+        size_t nmats = MIN(priv->num_materials, MAX_MATERIALS);
+
+        for(int i = 0; i < nmats; i++) {
+            const struct material *mat = &priv->materials[i];
+            unsigned char *base = block + i * GL_MATERIAL_STRIDE;
+            memcpy(base +  0, &mat->ambient_intensity, sizeof(mat->ambient_intensity));
+            memcpy(base + 16, &mat->diffuse_clr, sizeof(mat->diffuse_clr));
+            memcpy(base + 32, &mat->specular_clr, sizeof(mat->specular_clr));
+        }
+
+        glGenBuffers(1, &priv->material_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, priv->material_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(block), block, GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
@@ -178,36 +355,30 @@ void R_GL_Draw(const void *render_private, mat4x4_t *model, const bool *transluc
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
     const struct render_private *priv = render_private;
+    if(!priv->mesh.VAO)
+        GL_PERF_RETURN_VOID();
 
-    if(*translucent) {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR);
-    }
-
-    R_GL_StateSet(GL_U_MODEL, (struct uval){
-        .type = UTYPE_MAT4,
-        .val.as_mat4 = *model
-    });
+    draw_range(priv, model, *translucent, false, 0, priv->mesh.num_verts);
 
-    R_GL_StateSetComposite(GL_U_MATERIALS, (struct mdesc[]){
-        { "ambient_intensity",   UTYPE_FLOAT,    offsetof(struct material, ambient_intensity) },
-        { "diffuse_clr",         UTYPE_VEC3,     offsetof(struct material, diffuse_clr)       },
-        { "specular_clr",        UTYPE_VEC3,     offsetof(struct material, specular_clr)      },
-        {0}
-    }, sizeof(struct material), priv->num_materials, priv->materials);
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
 
-    R_GL_Shader_InstallProg(priv->shader_prog);
+void R_GL_DrawTerrainLOD(const void *render_private, mat4x4_t *model, const int *lod)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+    const struct render_private *priv = render_private;
+    assert(*lod >= 0 && *lod < TERRAIN_NUM_LODS);
 
-    if(priv->num_materials > 0) {
-        R_GL_Texture_BindArray(&priv->material_arr, priv->shader_prog);
-    }
-    R_GL_ShadowMapBind();
-    
-    glBindVertexArray(priv->mesh.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, priv->mesh.num_verts);
+    /* The chunk is not resident */
+    if(!priv->mesh.VAO)
+        GL_PERF_RETURN_VOID();
 
-    if(*translucent) {
-        glDisable(GL_BLEND);
+    if(!priv->lods_valid || *lod == 0) {
+        draw_range(priv, model, false, false, 0, priv->mesh.num_verts);
+    }else{
+        draw_range(priv, model, false, true, priv->lod_first[*lod], priv->lod_count[*lod]);
     }
 
     GL_ASSERT_OK();
@@ -219,6 +390,7 @@ void R_GL_BeginFrame(void)
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
 
+    R_GL_DynresBeginScene();
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
@@ -272,13 +444,15 @@ void R_GL_SetClipPlane(const vec4_t plane_eq)
     });
 }
 
-void R_GL_SetAnimUniforms(mat4x4_t *inv_bind_poses, mat4x4_t *curr_poses, 
-                          mat4x4_t *normal_mat, const size_t *count)
+void R_GL_SetAnimUniforms(mat4x4_t *normal_mat, const size_t *pose_base)
 {
     ASSERT_IN_RENDER_THREAD();
 
-    R_GL_StateSetArray(GL_U_INV_BIND_MATS, UTYPE_MAT4, *count, inv_bind_poses);
-    R_GL_StateSetArray(GL_U_CURR_POSE_MATS, UTYPE_MAT4, *count, curr_poses);
+    R_GL_PoseBuffBind();
+    R_GL_StateSet(GL_U_POSE_BASE, (struct uval){
+        .type = UTYPE_INT, 
+        .val.as_int = *pose_base
+    });
     R_GL_StateSet(GL_U_NORMAL_MAT, (struct uval){
         .type = UTYPE_MAT4, 
         .val.as_mat4 = *normal_mat
@@ -320,6 +494,8 @@ void R_GL_SetScreenspaceDrawMode(void)
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
 
+    R_GL_DynresEndScene();
+
     int width, height;
     Engine_WinDrawableSize(&width, &height);
 
@@ -583,7 +759,6 @@ void R_GL_DrawRay(const vec3_t *origin, const vec3_t *dir, mat4x4_t *model,
     ASSERT_IN_RENDER_THREAD();
 
     vec3_t vbuff[2];
-    GLuint VAO, VBO;
 
     vbuff[0] = *origin; 
     vec3_t dircopy = *dir;
@@ -591,44 +766,9 @@ void R_GL_DrawRay(const vec3_t *origin, const vec3_t *dir, mat4x4_t *model,
     PFM_Vec3_Scale(&dircopy, *t, &dircopy);
     PFM_Vec3_Add((vec3_t*)origin, &dircopy, &vbuff[1]);
 
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
-    /* Set uniforms */
-    R_GL_StateSet(GL_U_MODEL, (struct uval){
-        .type = UTYPE_MAT4,
-        .val.as_mat4 = *model
-    });
-
     vec4_t color4 = (vec4_t){color->x, color->y, color->z, 1.0f};
-    R_GL_StateSet(GL_U_COLOR, (struct uval){
-        .type = UTYPE_VEC4,
-        .val.as_vec4 = color4
-    });
-
-    R_GL_Shader_Install("mesh.static.colored");
-
-    GLfloat old_width;
-    glGetFloatv(GL_LINE_WIDTH, &old_width);
-    glLineWidth(5.0f);
-
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, 2 * sizeof(vec3_t), vbuff, GL_STREAM_DRAW);
-    glDrawArrays(GL_LINES, 0, 2);
+    prims_push_lines(PRIM_LINES, vbuff, ARR_SIZE(vbuff), model, &color4, 5.0f);
 
-    /* cleanup */
-    glLineWidth(old_width);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-
-    GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
 
@@ -637,7 +777,6 @@ void R_GL_DrawOBB(const struct aabb *aabb, const mat4x4_t *model)
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
 
-    GLuint VAO, VBO;
     vec4_t blue = (vec4_t){0.0f, 0.0f, 1.0f, 1.0f};
 
     vec3_t vbuff[24] = {
@@ -667,38 +806,8 @@ void R_GL_DrawOBB(const struct aabb *aabb, const mat4x4_t *model)
     vbuff[22] = vbuff[3];
     vbuff[23] = vbuff[7];
 
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    prims_push_lines(PRIM_LINES, vbuff, ARR_SIZE(vbuff), model, &blue, 1.0f);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
-    /* Set uniforms */
-    R_GL_StateSet(GL_U_MODEL, (struct uval){
-        .type = UTYPE_MAT4,
-        .val.as_mat4 = *model
-    });
-
-    R_GL_StateSet(GL_U_COLOR, (struct uval){
-        .type = UTYPE_VEC4,
-        .val.as_vec4 = blue
-    });
-
-    R_GL_Shader_Install("mesh.static.colored");
-
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(vbuff) * sizeof(vec3_t), vbuff, GL_STREAM_DRAW);
-    glDrawArrays(GL_LINES, 0, ARR_SIZE(vbuff));
-
-    /* cleanup */
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-
-    GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
 
@@ -708,67 +817,25 @@ void R_GL_DrawBox2D(const vec2_t *screen_pos, const vec2_t *signed_size,
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
 
-    GLuint VAO, VBO;
-
-    vec3_t vbuff[4] = {
+    vec3_t corners[4] = {
         (vec3_t){screen_pos->x,                  screen_pos->y,                  0.0f},
         (vec3_t){screen_pos->x + signed_size->x, screen_pos->y,                  0.0f},
         (vec3_t){screen_pos->x + signed_size->x, screen_pos->y + signed_size->y, 0.0f},
         (vec3_t){screen_pos->x,                  screen_pos->y + signed_size->y, 0.0f},
     };
 
-    int win_width, win_height;
-    Engine_WinDrawableSize(&win_width, &win_height);
-
-    /* Set view and projection matrices for rendering in screen coordinates */
-    mat4x4_t ortho;
-    PFM_Mat4x4_MakeOrthographic(0.0f, win_width, win_height, 0.0f, -1.0f, 1.0f, &ortho);
-    R_GL_SetProj(&ortho);
-
-    mat4x4_t identity;
-    PFM_Mat4x4_Identity(&identity);
-    vec3_t dummy_pos = (vec3_t){0.0f};
-    R_GL_SetViewMatAndPos(&identity, &dummy_pos);
-
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
-    /* Set uniforms */
-    R_GL_StateSet(GL_U_MODEL, (struct uval){
-        .type = UTYPE_MAT4,
-        .val.as_mat4 = identity
-    });
+    /* The loop is drawn as a list of segments so that it can share a draw 
+     * with other boxes */
+    vec3_t vbuff[8] = {
+        corners[0], corners[1],
+        corners[1], corners[2],
+        corners[2], corners[3],
+        corners[3], corners[0],
+    };
 
     vec4_t color4 = (vec4_t){color->x, color->y, color->z, 1.0f};
-    R_GL_StateSet(GL_U_COLOR, (struct uval){
-        .type = UTYPE_VEC4,
-        .val.as_vec4 = color4
-    });
-
-    R_GL_Shader_Install("mesh.static.colored");
-
-    float old_width;
-    glGetFloatv(GL_LINE_WIDTH, &old_width);
-    glLineWidth(*width);
+    prims_push_lines(PRIM_LINES_2D, vbuff, ARR_SIZE(vbuff), NULL, &color4, *width);
 
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(vbuff) * sizeof(vec3_t), vbuff, GL_STREAM_DRAW);
-    glDrawArrays(GL_LINE_LOOP, 0, ARR_SIZE(vbuff));
-
-    glLineWidth(old_width);
-
-    /* cleanup */
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-
-    GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
 
@@ -811,7 +878,9 @@ void R_GL_DumpFBColor_PPM(const char *filename, const int *width, const int *hei
     }
 
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    uint64_t read_begin = SDL_GetPerformanceCounter();
     glReadPixels(0, 0, *width, *height, GL_RGB, GL_UNSIGNED_BYTE, data);
+    Perf_RenderStall("render.stall_us.dump_fb", read_begin);
 
     FILE *file = fopen(filename, "wb");
     if(!file) {
@@ -847,7 +916,9 @@ void R_GL_DumpFBDepth_PPM(const char *filename, const int *width, const int *hei
         return;
     }
 
+    uint64_t read_begin = SDL_GetPerformanceCounter();
     glReadPixels(0, 0, *width, *height, GL_DEPTH_COMPONENT, GL_FLOAT, data);
+    Perf_RenderStall("render.stall_us.dump_fb", read_begin);
 
     FILE *file = fopen(filename, "wb");
     if(!file) {
@@ -889,8 +960,6 @@ void R_GL_DrawSelectionCircle(const vec2_t *xz, const float *radius, const float
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
 
-    GLuint VAO, VBO;
-
     const int NUM_SAMPLES = 48;
     const int nverts = NUM_SAMPLES * 2 + 2;
     STALLOC(vec3_t, vbuff, nverts);
@@ -914,43 +983,9 @@ void R_GL_DrawSelectionCircle(const vec2_t *xz, const float *radius, const float
     vbuff[NUM_SAMPLES * 2]     = vbuff[0];
     vbuff[NUM_SAMPLES * 2 + 1] = vbuff[1];
 
-    mat4x4_t identity;
-    PFM_Mat4x4_Identity(&identity);
-
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
-    /* Set uniforms */
-    R_GL_StateSet(GL_U_MODEL, (struct uval){
-        .type = UTYPE_MAT4,
-        .val.as_mat4 = identity
-    });
-
-    vec4_t color4 = (vec4_t){color->x, color->y, color->z, 1.0f};
-    R_GL_StateSet(GL_U_COLOR, (struct uval){
-        .type = UTYPE_VEC4,
-        .val.as_vec4 = color4
-    });
-
-    R_GL_Shader_Install("mesh.static.colored");
-
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, nverts * sizeof(vec3_t), vbuff, GL_STREAM_DRAW);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, nverts);
-
-    /* cleanup */
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    prims_push_strip(vbuff, nverts, color);
 
     STFREE(vbuff);
-    GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
 
@@ -960,7 +995,6 @@ void R_GL_DrawSelectionRectangle(const struct obb *box, const float *width,
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
 
-    GLuint VAO, VBO;
     const float PAD = 1.0f;
 
     vec2_t corners[4] = {
@@ -1027,43 +1061,9 @@ void R_GL_DrawSelectionRectangle(const struct obb *box, const float *width,
     vbuff[nsamples * 2 + 0] = vbuff[0];
     vbuff[nsamples * 2 + 1] = vbuff[1];
 
-    mat4x4_t identity;
-    PFM_Mat4x4_Identity(&identity);
-
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
-    /* Set uniforms */
-    R_GL_StateSet(GL_U_MODEL, (struct uval){
-        .type = UTYPE_MAT4,
-        .val.as_mat4 = identity
-    });
-
-    vec4_t color4 = (vec4_t){color->x, color->y, color->z, 1.0f};
-    R_GL_StateSet(GL_U_COLOR, (struct uval){
-        .type = UTYPE_VEC4,
-        .val.as_vec4 = color4
-    });
-
-    R_GL_Shader_Install("mesh.static.colored");
-
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, nverts * sizeof(vec3_t), vbuff, GL_STREAM_DRAW);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, nverts);
-
-    /* cleanup */
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    prims_push_strip(vbuff, nverts, color);
 
     STFREE(vbuff);
-    GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
 
@@ -1111,51 +1111,9 @@ void R_GL_DrawLine(vec2_t endpoints[], const float *width, const vec3_t *color,
         t += (1.0f / NUM_SAMPLES) * len;
     }
 
-    mat4x4_t identity;
-    PFM_Mat4x4_Identity(&identity);
-
-    /* OpenGL setup */
-    GLuint VAO, VBO;
-
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
-    /* Set uniforms */
-    R_GL_StateSet(GL_U_MODEL, (struct uval){
-        .type = UTYPE_MAT4,
-        .val.as_mat4 = identity
-    });
-
-    vec4_t color4 = (vec4_t){color->x, color->y, color->z, 1.0f};
-    R_GL_StateSet(GL_U_COLOR, (struct uval){
-        .type = UTYPE_VEC4,
-        .val.as_vec4 = color4
-    });
-
-    R_GL_Shader_Install("mesh.static.colored");
-
-    float old_width;
-    glGetFloatv(GL_LINE_WIDTH, &old_width);
-    glLineWidth(*width);
-
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, nverts * sizeof(vec3_t), vbuff, GL_STREAM_DRAW);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, nverts);
-
-    glLineWidth(old_width);
-
-    /* cleanup */
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    prims_push_strip(vbuff, nverts, color);
 
     STFREE(vbuff);
-    GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
 
@@ -1186,8 +1144,14 @@ void R_GL_DrawMapOverlayQuads(vec2_t *xz_corners, vec3_t *colors, const size_t *
     GLuint VAO, VBO;
     const size_t surf_verts = *count * 4 * 3;
     const size_t line_verts = *count * 4 * 2;
-    STALLOC(struct colored_vert, surf_vbuff, surf_verts);
-    STALLOC(struct colored_vert, line_vbuff, line_verts);
+    /* Batched overlays can span many chunks - keep them off the stack */
+    struct colored_vert *surf_vbuff = malloc(surf_verts * sizeof(struct colored_vert));
+    struct colored_vert *line_vbuff = malloc(line_verts * sizeof(struct colored_vert));
+    if(!surf_vbuff || !line_vbuff) {
+        PF_FREE(surf_vbuff);
+        PF_FREE(line_vbuff);
+        GL_PERF_RETURN_VOID();
+    }
 
     struct colored_vert *surf_vbuff_base = surf_vbuff;
     struct colored_vert *line_vbuff_base = line_vbuff;
@@ -1312,8 +1276,8 @@ void R_GL_DrawMapOverlayQuads(vec2_t *xz_corners, vec3_t *colors, const size_t *
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
 
-    STFREE(surf_vbuff);
-    STFREE(line_vbuff);
+    PF_FREE(surf_vbuff);
+    PF_FREE(line_vbuff);
 
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
@@ -1328,8 +1292,13 @@ void R_GL_DrawFlowField(vec2_t *xz_positions, vec2_t *xz_directions, const size_
     GLuint VAO, VBO;
     const size_t line_vbuff_size = *count * 2;
     const size_t point_vbuff_size = *count;
-    STALLOC(vec3_t, line_vbuff, *count * 2);
-    STALLOC(vec3_t, point_vbuff, *count);
+    vec3_t *line_vbuff = malloc(line_vbuff_size * sizeof(vec3_t));
+    vec3_t *point_vbuff = malloc(point_vbuff_size * sizeof(vec3_t));
+    if(!line_vbuff || !point_vbuff) {
+        PF_FREE(line_vbuff);
+        PF_FREE(point_vbuff);
+        GL_PERF_RETURN_VOID();
+    }
 
     /* Setup line_vbuff */
     for(size_t i = 0, line_vbuff_idx = 0; i < *count; i++, line_vbuff_idx += 2) {
@@ -1408,8 +1377,8 @@ void R_GL_DrawFlowField(vec2_t *xz_positions, vec2_t *xz_directions, const size_
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
 
-    STFREE(line_vbuff);
-    STFREE(point_vbuff);
+    PF_FREE(line_vbuff);
+    PF_FREE(point_vbuff);
 
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
@@ -1424,11 +1393,6 @@ void R_GL_DrawCombinedHRVO(vec2_t *apexes, vec2_t *left_rays, vec2_t *right_rays
     const float RAY_LEN = 150.0f;
     const int NUM_SAMPLES = 150;
 
-    GLuint VAO, VBO;
-
-    mat4x4_t model;
-    PFM_Mat4x4_Identity(&model); /* points are already in world space */
-
     size_t vbuff_size = *num_vos * (NUM_SAMPLES - 1) * 4;
     STALLOC(vec3_t, ray_vbuff, vbuff_size);
     int vbuff_idx = 0;
@@ -1471,48 +1435,91 @@ void R_GL_DrawCombinedHRVO(vec2_t *apexes, vec2_t *left_rays, vec2_t *right_rays
     }
     assert(vbuff_idx == vbuff_size);
 
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    /* The points are already in world space */
+    vec4_t red = (vec4_t){1.0f, 0.0f, 0.0f, 1.0f};
+    prims_push_lines(PRIM_LINES, ray_vbuff, vbuff_size, NULL, &red, 2.0f);
 
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    STFREE(ray_vbuff);
+    GL_PERF_RETURN_VOID();
+}
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);
+bool R_GL_PrimBatchOwns(void (*func)())
+{
+    return (func == (void(*)())R_GL_DrawSelectionCircle)
+        || (func == (void(*)())R_GL_DrawSelectionRectangle)
+        || (func == (void(*)())R_GL_DrawLine)
+        || (func == (void(*)())R_GL_DrawQuad)
+        || (func == (void(*)())R_GL_DrawOBB)
+        || (func == (void(*)())R_GL_DrawBox2D)
+        || (func == (void(*)())R_GL_DrawRay)
+        || (func == (void(*)())R_GL_DrawCombinedHRVO);
+}
+
+void R_GL_PrimBatchFlush(void)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    if(!s_prims.init)
+        GL_PERF_RETURN_VOID();
+
+    size_t total = 0;
+    for(int i = 0; i < PRIM_NUM_STREAMS; i++) {
+        total += vec_size(&s_prims.verts[i]);
+    }
+    if(total == 0)
+        GL_PERF_RETURN_VOID();
+
+    mat4x4_t identity;
+    PFM_Mat4x4_Identity(&identity);
 
-    /* Set uniforms */
     R_GL_StateSet(GL_U_MODEL, (struct uval){
         .type = UTYPE_MAT4,
-        .val.as_mat4 = model
+        .val.as_mat4 = identity
     });
+    R_GL_Shader_Install("mesh.static.colored-per-vert");
 
-    vec4_t red = (vec4_t){1.0f, 0.0f, 0.0f, 1.0f};
-    R_GL_StateSet(GL_U_COLOR, (struct uval){
-        .type = UTYPE_VEC4,
-        .val.as_vec4 = red
-    });
+    glBindVertexArray(s_prims.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_prims.VBO);
 
-    R_GL_Shader_Install("mesh.static.colored");
+    prims_draw_stream(PRIM_TRIS, GL_TRIANGLES);
+    prims_draw_stream(PRIM_LINES, GL_LINES);
 
-    GLfloat old_width;
-    glGetFloatv(GL_LINE_WIDTH, &old_width);
-    glLineWidth(2.0f);
+    if(vec_size(&s_prims.verts[PRIM_LINES_2D]) > 0) {
 
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, vbuff_size * sizeof(vec3_t), ray_vbuff, GL_STREAM_DRAW);
-    glDrawArrays(GL_LINES, 0, vbuff_size);
+        int win_width, win_height;
+        Engine_WinDrawableSize(&win_width, &win_height);
 
-    /* cleanup */
-    glLineWidth(old_width);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+        /* Set view and projection matrices for rendering in screen coordinates */
+        mat4x4_t ortho;
+        PFM_Mat4x4_MakeOrthographic(0.0f, win_width, win_height, 0.0f, -1.0f, 1.0f, &ortho);
+        R_GL_SetProj(&ortho);
+
+        vec3_t dummy_pos = (vec3_t){0.0f};
+        R_GL_SetViewMatAndPos(&identity, &dummy_pos);
+
+        prims_draw_stream(PRIM_LINES_2D, GL_LINES);
+    }
+    glBindVertexArray(0);
 
-    STFREE(ray_vbuff);
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
 
+void R_GL_PrimBatchShutdown(void)
+{
+    if(!s_prims.init)
+        return;
+
+    glDeleteVertexArrays(1, &s_prims.VAO);
+    glDeleteBuffers(1, &s_prims.VBO);
+
+    for(int i = 0; i < PRIM_NUM_STREAMS; i++) {
+        vec_cvert_destroy(&s_prims.verts[i]);
+    }
+    s_prims.init = false;
+}
+
 void R_GL_SetViewport(int *x, int *y, int *w, int *h)
 {
     GL_PERF_ENTER();
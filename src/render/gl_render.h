@@ -44,19 +44,33 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 
 #define SHADOW_MAP_TUNIT (GL_TEXTURE16)
+#define POSE_BUFF_TUNIT  (GL_TEXTURE17)
+#define IMPOSTOR_TUNIT   (GL_TEXTURE8)
 
 struct render_private;
 struct vertex;
 struct tile;
 struct tile_desc;
 struct map;
+struct terrain_vert_packed;
 
 /* General */
 
 void   R_GL_Init(struct render_private *priv, const char *shader, const struct vertex *vbuff);
+
+/* Terrain */
+
+/* 'ibuff' holds the indices of the reduced-detail meshes, which follow the 
+ * full-detail vertices in 'vbuff' */
+void   R_GL_TerrainInit(struct render_private *priv, const char *shader, 
+                        const struct terrain_vert_packed *vbuff, const size_t *nverts,
+                        const uint32_t *ibuff);
+/* Drawing a chunk after its' mesh has been freed is a no-op */
+void   R_GL_TerrainFree(struct render_private *priv);
 void   R_GL_GlobalConfig(void);
 void   R_GL_SetViewport(int *x, int *y, int *w, int *h);
 
@@ -67,10 +81,37 @@ vec3_t R_GL_GetLightPos(void);
 void   R_GL_SetLightSpaceTrans(const mat4x4_t *trans);
 void   R_GL_ShadowMapBind(void);
 
+/* Pose Buffer */
+
+void   R_GL_PoseBuffBind(void);
+/* True between 'R_GL_DepthPassBeginStatic' and 'R_GL_DepthPassEndStatic' 
+ * when the static shadow layer will not be redrawn this frame. */
+bool   R_GL_ShadowsStaticCached(void);
+/* Must be called when the geometry of the static casters changes */
+void   R_GL_ShadowsInvalidateStatic(void);
+
 /* Water */
 
 void   R_GL_SetClipPlane(vec4_t plane_eq);
 
+/* Dynamic resolution */
+
+/* When dynamic resolution is enabled, the 3D scene is drawn to an offscreen 
+ * target between these calls, and upscaled to the default framebuffer at the
+ * end. The viewport is set to the scaled size. */
+void   R_GL_DynresBeginScene(void);
+void   R_GL_DynresEndScene(void);
+
+/* Primitive batching */
+
+/* The selection and debug primitives (selection circles and rectangles, lines, 
+ * quads, rays, OBBs, 2D boxes and HRVOs) are accumulated and drawn once per 
+ * primitive type. The pending primitives must be flushed before any other 
+ * command is executed, so that the order of the draws is kept. */
+bool   R_GL_PrimBatchOwns(void (*func)());
+void   R_GL_PrimBatchFlush(void);
+void   R_GL_PrimBatchShutdown(void);
+
 /* Terrain */
 void   R_GL_MapFogBindLast(GLuint tunit, GLuint shader_prog, const char *uname);
 void   R_GL_MapUpdateFogClear(void);
@@ -38,11 +38,13 @@
 #include "gl_perf.h"
 #include "gl_shader.h"
 #include "gl_state.h"
+#include "../perf.h"
 #include "../lib/public/pf_string.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <SDL.h>
 
 /* How many discrete sets of data (guarded by fences) the buffer can hold */
 #define NMAXMARKERS     (256)
@@ -59,6 +61,10 @@ enum mode{
 struct marker{
     size_t begin;
     size_t end;
+    /* Set by 'R_GL_RingbufferSyncLast'. The fence guarding a synced
+     * marker is only inserted at the end of the frame, and is shared 
+     * by all the markers synced during that frame. */
+    bool   synced;
 };
 
 struct buffer_ops{
@@ -85,26 +91,73 @@ struct gl_ring{
     size_t            nmarkers;
     size_t            imark_head, imark_tail;
     struct marker     markers[NMAXMARKERS];
+    /* All the live rings, for inserting the per-frame fences */
+    struct gl_ring   *next;
 };
 
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct gl_ring *s_rings = NULL;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+/* Guard all the synced markers which are not yet covered by a fence 
+ * with a single new fence. 
+ */
+static void ring_fence_pending(struct gl_ring *ring)
+{
+    GLsync fence = 0;
+
+    for(size_t i = 0; i < ring->nmarkers; i++) {
+
+        size_t idx = (ring->imark_tail + i) % NMAXMARKERS;
+        if(!ring->markers[idx].synced || ring->fences[idx])
+            continue;
+
+        if(!fence) {
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            PERF_COUNTER_ADD("render.ringbuffer_fences", 1);
+        }
+        ring->fences[idx] = fence;
+    }
+}
+
 static bool ring_wait_one(struct gl_ring *ring)
 {
     GL_PERF_ENTER();
-    assert(ring->fences[ring->imark_tail] > 0);
 
     if(ring->nmarkers == 0)
         GL_PERF_RETURN(false);
 
-    GLenum result = glClientWaitSync(ring->fences[ring->imark_tail], 0, TIMEOUT_NSEC);
-    glDeleteSync(ring->fences[ring->imark_tail]);
+    /* The ring filled up before the end of the frame */
+    if(!ring->fences[ring->imark_tail] && ring->markers[ring->imark_tail].synced) {
+        ring_fence_pending(ring);
+    }
+    assert(ring->fences[ring->imark_tail] > 0);
+
+    GLsync fence = ring->fences[ring->imark_tail];
+    uint64_t wait_begin = SDL_GetPerformanceCounter();
+    GLenum result = glClientWaitSync(fence, 0, TIMEOUT_NSEC);
+    if(result != GL_ALREADY_SIGNALED) {
+        PERF_COUNTER_ADD("render.ringbuffer_stalls", 1);
+        Perf_RenderStall("render.stall_us.ringbuffer_sync", wait_begin);
+    }
+
     ring->fences[ring->imark_tail] = 0;
+    ring->markers[ring->imark_tail].synced = false;
     ring->imark_tail = (ring->imark_tail + 1) % NMAXMARKERS;
     ring->nmarkers--;
 
+    /* The fence is shared by the consecutive markers of a frame. Only
+     * delete it with the last of them. */
+    if(!ring->nmarkers || ring->fences[ring->imark_tail] != fence) {
+        glDeleteSync(fence);
+    }
+
     if(result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED)
         GL_PERF_RETURN(false);
 
@@ -175,7 +228,7 @@ static void unsynch_vbo_unmap(struct gl_ring *ring)
 }
 
 /*****************************************************************************/
-/* STATIC VARIABLES                                                          */
+/* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
 struct gl_ring *R_GL_RingbufferInit(size_t size, enum ring_format fmt)
@@ -193,7 +246,7 @@ struct gl_ring *R_GL_RingbufferInit(size_t size, enum ring_format fmt)
     ret->imark_tail = 0;
     ret->nmarkers = 0;
     memset(&ret->fences, 0, sizeof(ret->fences));
-    memset(&ret->markers, 0, sizeof(ret->fences));
+    memset(&ret->markers, 0, sizeof(ret->markers));
 
     if(GLEW_ARB_buffer_storage) {
         ret->mode = MODE_PERSISTENT_MAPPED_BUFFER;
@@ -219,6 +272,10 @@ struct gl_ring *R_GL_RingbufferInit(size_t size, enum ring_format fmt)
         glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, ret->VBO);
     }
     glBindTexture(GL_TEXTURE_BUFFER, 0);
+    Perf_MemAlloc(PERF_MEM_GPU_RINGBUFFERS, size);
+
+    ret->next = s_rings;
+    s_rings = ret;
 
     GL_ASSERT_OK();
     return ret;
@@ -226,11 +283,19 @@ struct gl_ring *R_GL_RingbufferInit(size_t size, enum ring_format fmt)
 
 void R_GL_RingbufferDestroy(struct gl_ring *ring)
 {
+    ring_fence_pending(ring);
     while(ring->nmarkers) {
         ring_wait_one(ring);
     }
+
+    struct gl_ring **curr = &s_rings;
+    while(*curr != ring) {
+        curr = &(*curr)->next;
+    }
+    *curr = ring->next;
     glDeleteBuffers(1, &ring->VBO);
     glDeleteTextures(1, &ring->tex_buff);
+    Perf_MemFree(PERF_MEM_GPU_RINGBUFFERS, ring->size);
     free(ring);
 }
 
@@ -268,13 +333,14 @@ bool R_GL_RingbufferPush(struct gl_ring *ring, const void *data, size_t size)
 
     ring->ops.unmap(ring);
     ring->imark_head = (ring->imark_head + 1) % NMAXMARKERS;
-    ring->markers[ring->imark_head] = (struct marker){old_pos, ring->pos};
+    ring->markers[ring->imark_head] = (struct marker){old_pos, ring->pos, false};
 
     if(!ring->nmarkers)
         ring->imark_tail = ring->imark_head;
 
     ring->nmarkers++;
 
+    PERF_COUNTER_ADD("render.ringbuffer_bytes", size);
     GL_ASSERT_OK();
     return true;
 }
@@ -283,6 +349,7 @@ bool R_GL_RingbufferAppendLast(struct gl_ring *ring, const void *data, size_t si
 {
     assert(ring->nmarkers);
     assert(ring->fences[ring->imark_head] == 0);
+    assert(!ring->markers[ring->imark_head].synced);
 
     if(size > ring->size) {
         return false;
@@ -317,6 +384,7 @@ bool R_GL_RingbufferAppendLast(struct gl_ring *ring, const void *data, size_t si
     ring->ops.unmap(ring);
     ring->markers[ring->imark_head].end = ring->pos;
 
+    PERF_COUNTER_ADD("render.ringbuffer_bytes", size);
     GL_ASSERT_OK();
     return true;
 }
@@ -325,6 +393,7 @@ bool R_GL_RingbufferExtendLast(struct gl_ring *ring, size_t size)
 {
     assert(ring->nmarkers);
     assert(ring->fences[ring->imark_head] == 0);
+    assert(!ring->markers[ring->imark_head].synced);
 
     if(size > ring->size) {
         return false;
@@ -363,6 +432,7 @@ void R_GL_RingbufferBindLast(struct gl_ring *ring, GLuint tunit, GLuint shader_p
 {
     assert(ring->nmarkers);
     assert(ring->fences[ring->imark_head] == 0);
+    assert(!ring->markers[ring->imark_head].synced);
     size_t bpos = ring->markers[ring->imark_head].begin;
 
     char uname_offset[128];
@@ -389,7 +459,15 @@ void R_GL_RingbufferSyncLast(struct gl_ring *ring)
 {
     assert(ring->nmarkers);
     assert(ring->fences[ring->imark_head] == 0);
-    ring->fences[ring->imark_head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    assert(!ring->markers[ring->imark_head].synced);
+    ring->markers[ring->imark_head].synced = true;
+}
+
+void R_GL_RingbufferEndFrame(void)
+{
+    for(struct gl_ring *curr = s_rings; curr; curr = curr->next) {
+        ring_fence_pending(curr);
+    }
 }
 
 GLuint R_GL_RingbufferGetVBO(struct gl_ring *ring)
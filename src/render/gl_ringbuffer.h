@@ -61,7 +61,11 @@
  *       R_GL_RingbufferBindLast(ring, ...);
  *       // queue the GL draw commands touching buffered data
  *       R_GL_RingbufferSyncLast(ring, ...);
+ *   R_GL_RingbufferEndFrame(); // once per frame, for all rings
  *   R_GL_RingbufferDestroy(ring);
+ *
+ * Rather than fencing every synced section, a single fence is inserted per
+ * ring at the end of the frame, guarding all of the frame's sections.
  * 
  */
 struct gl_ring;
@@ -80,6 +84,7 @@ bool            R_GL_RingbufferGetLastRange(struct gl_ring *ring, size_t *out_be
 void            R_GL_RingbufferBindLast(struct gl_ring *ring, GLuint tunit, GLuint shader_prog, const char *uname);
 void            R_GL_RingbufferSyncLast(struct gl_ring *ring);
 GLuint          R_GL_RingbufferGetVBO(struct gl_ring *ring);
+void            R_GL_RingbufferEndFrame(void);
 
 #endif
 
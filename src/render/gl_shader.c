@@ -40,6 +40,7 @@
 #include "gl_material.h"
 #include "../main.h"
 #include "../lib/public/pf_string.h"
+#include "../lib/public/khash.h"
 
 #include <SDL.h>
 
@@ -47,9 +48,18 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #define SHADER_PATH_LEN 128
 #define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
+#define NUM_STAGES      (4)
+
+#define CACHE_ORG       "PermafrostEngine"
+#define CACHE_APP       "shadercache"
+#define CACHE_MAGIC     (0x42535650) /* 'PVSB' */
+#define CACHE_VERSION   (1)
+#define FNV_BASIS       (0xcbf29ce484222325ull)
+#define FNV_PRIME       (0x100000001b3ull)
 
 struct uniform{
     int           type;
@@ -64,13 +74,58 @@ struct shader{
     const char     *frag_path;
     const char     *compute_path;
     struct uniform *uniforms;
+    /* Only built when ARB_bindless_texture is available */
+    bool            bindless;
+    /* The 'enum shader_feature' bits that can be compiled out of the 
+     * program. The program built at init has all of them enabled. */
+    uint32_t        features;
+};
+
+/* The state of a program between issuing its' compilation and checking 
+ * the result, which lets the driver compile all the programs at once. */
+struct shader_build{
+    GLint       prog;
+    uint64_t    key;
+    bool        cached;
+    bool        skipped;
+    GLuint      stages[NUM_STAGES];
+    char        paths[NUM_STAGES][512];
 };
 
+struct cache_header{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+    uint64_t checksum;
+};
+
+KHASH_MAP_INIT_INT64(perm, GLint)
+KHASH_MAP_INIT_INT(prog, int)
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static GLuint s_curr_prog = 0;
+static bool   s_binary_cache = false;
+static char   s_base_path[512];
+
+/* Bit 'i' of a feature mask adds a define for the i'th name to every 
+ * stage of the program, right after its' '#version' directive.
+ */
+static const char *s_feature_defines[] = {
+    "FEATURE_SHADOWS",
+};
+
+/* The permutations are only built the first time they are asked for. 
+ * They are keyed by the shader index in the upper and the feature mask 
+ * in the lower 32 bits and map to the program to use, which is the base 
+ * program when the permutation failed to build. */
+static khash_t(perm) *s_perms;
+/* The shader index of every permutation program */
+static khash_t(prog) *s_perm_progs;
 
 /* Shader 'prog_id' will be initialized by R_GL_Shader_InitAll */
 static struct shader s_shaders[] = {
@@ -83,8 +138,6 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/colored.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_COLOR,            },
             {0}
         },
@@ -98,10 +151,7 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/textured.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
             {0}
         },
@@ -115,15 +165,8 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/textured-phong.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_VEC3,      GL_U_AMBIENT_COLOR     },
-            { UTYPE_VEC3,      GL_U_LIGHT_COLOR       },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
-            { UTYPE_COMPOSITE, GL_U_MATERIALS,        },
             {0}
         },
     },
@@ -136,8 +179,6 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/tile-outline.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_COLOR,            },
             {0},
         },
@@ -151,18 +192,11 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/textured-phong.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_ARRAY,     GL_U_CURR_POSE_MATS    },
-            { UTYPE_ARRAY,     GL_U_INV_BIND_MATS     },
+            { UTYPE_INT,       GL_U_POSE_BUFF         },
+            { UTYPE_INT,       GL_U_POSE_BASE         },
             { UTYPE_MAT4,      GL_U_NORMAL_MAT        },
-            { UTYPE_VEC3,      GL_U_AMBIENT_COLOR     },
-            { UTYPE_VEC3,      GL_U_LIGHT_COLOR       },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
-            { UTYPE_COMPOSITE, GL_U_MATERIALS,        },
             {0}
         },
     },
@@ -175,8 +209,6 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/colored.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
             { UTYPE_VEC4,      GL_U_COLOR,            },
             {0}
@@ -191,11 +223,9 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/colored.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_ARRAY,     GL_U_CURR_POSE_MATS    },
-            { UTYPE_ARRAY,     GL_U_INV_BIND_MATS     },
+            { UTYPE_INT,       GL_U_POSE_BUFF         },
+            { UTYPE_INT,       GL_U_POSE_BASE         },
             { UTYPE_MAT4,      GL_U_NORMAL_MAT        },
             { UTYPE_VEC4,      GL_U_COLOR,            },
             {0}
@@ -210,8 +240,6 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/colored-per-vert.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             {0}
         },
     },
@@ -224,13 +252,7 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/terrain.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_VEC3,      GL_U_AMBIENT_COLOR     },
-            { UTYPE_VEC3,      GL_U_LIGHT_COLOR       },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
             { UTYPE_INT,       "visbuff",             },
             { UTYPE_INT,       "visbuff_offset",      },
@@ -248,20 +270,16 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/terrain-shadowed.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_MAT4,      GL_U_LS_TRANS          },
-            { UTYPE_VEC3,      GL_U_AMBIENT_COLOR     },
-            { UTYPE_VEC3,      GL_U_LIGHT_COLOR       },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
             { UTYPE_INT,       "visbuff",             },
             { UTYPE_INT,       "visbuff_offset",      },
             { UTYPE_IVEC4,     GL_U_MAP_RES,          },
             { UTYPE_VEC2,      GL_U_MAP_POS,          },
             { UTYPE_INT,       GL_U_SHADOW_MAP        },
+            { UTYPE_ARRAY,     GL_U_CASCADE_TRANS     },
+            { UTYPE_VEC4,      GL_U_CASCADE_SCALE     },
+            { UTYPE_INT,       GL_U_CASCADE_COUNT     },
             {0}
         },
     },
@@ -274,7 +292,19 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/passthrough.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_LS_TRANS          },
+            { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
+            {0}
+        },
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "terrain.depth",
+        .vertex_path    = "shaders/vertex/terrain-depth.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/passthrough.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_MAT4,      GL_U_MODEL             },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
             {0}
         },
@@ -287,9 +317,6 @@ static struct shader s_shaders[] = {
         .compute_path   = NULL,
         .frag_path      = "shaders/fragment/passthrough.glsl",
         .uniforms       = (struct uniform[]){
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
-            { UTYPE_MAT4,      GL_U_LS_TRANS          },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
             { UTYPE_INT,       GL_U_TEX_ARRAY1        },
@@ -312,9 +339,8 @@ static struct shader s_shaders[] = {
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_MAT4,      GL_U_LS_TRANS          },
-            { UTYPE_ARRAY,     GL_U_CURR_POSE_MATS    },
-            { UTYPE_ARRAY,     GL_U_INV_BIND_MATS     },
+            { UTYPE_INT,       GL_U_POSE_BUFF         },
+            { UTYPE_INT,       GL_U_POSE_BASE         },
             {0}
         },
     },
@@ -326,10 +352,7 @@ static struct shader s_shaders[] = {
         .compute_path   = NULL,
         .frag_path      = "shaders/fragment/passthrough.glsl",
         .uniforms       = (struct uniform[]){
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_MAT4,      GL_U_LS_TRANS          },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
             { UTYPE_INT,       GL_U_TEX_ARRAY1        },
             { UTYPE_INT,       GL_U_TEX_ARRAY2        },
@@ -338,6 +361,7 @@ static struct shader s_shaders[] = {
             { UTYPE_INT,       "attrbuff_offset"      },
             { UTYPE_INT,       GL_U_ATTR_STRIDE       },
             { UTYPE_INT,       GL_U_ATTR_OFFSET       },
+            { UTYPE_INT,       GL_U_POSE_BUFF         },
             {0}
         },
     },
@@ -350,16 +374,27 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/textured-phong-shadowed.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
-            { UTYPE_VEC3,      GL_U_AMBIENT_COLOR     },
-            { UTYPE_VEC3,      GL_U_LIGHT_COLOR       },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
-            { UTYPE_MAT4,      GL_U_LS_TRANS          },
-            { UTYPE_COMPOSITE, GL_U_MATERIALS,        },
             { UTYPE_INT,       GL_U_SHADOW_MAP        },
+            { UTYPE_ARRAY,     GL_U_CASCADE_TRANS     },
+            { UTYPE_VEC4,      GL_U_CASCADE_SCALE     },
+            { UTYPE_INT,       GL_U_CASCADE_COUNT     },
+            {0}
+        },
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "mesh.static.projectile",
+        .vertex_path    = "shaders/vertex/projectile-shadowed.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/textured-phong-shadowed.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
+            { UTYPE_INT,       GL_U_SHADOW_MAP        },
+            { UTYPE_ARRAY,     GL_U_CASCADE_TRANS     },
+            { UTYPE_VEC4,      GL_U_CASCADE_SCALE     },
+            { UTYPE_INT,       GL_U_CASCADE_COUNT     },
             {0}
         },
     },
@@ -371,15 +406,11 @@ static struct shader s_shaders[] = {
         .compute_path   = NULL,
         .frag_path      = "shaders/fragment/textured-phong-shadowed-batched.glsl",
         .uniforms       = (struct uniform[]){
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
-            { UTYPE_MAT4,      GL_U_LS_TRANS          },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_VEC3,      GL_U_AMBIENT_COLOR     },
-            { UTYPE_VEC3,      GL_U_LIGHT_COLOR       },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_INT,       GL_U_SHADOW_MAP        },
+            { UTYPE_ARRAY,     GL_U_CASCADE_TRANS     },
+            { UTYPE_VEC4,      GL_U_CASCADE_SCALE     },
+            { UTYPE_INT,       GL_U_CASCADE_COUNT     },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
             { UTYPE_INT,       GL_U_TEX_ARRAY1        },
             { UTYPE_INT,       GL_U_TEX_ARRAY2        },
@@ -390,6 +421,30 @@ static struct shader s_shaders[] = {
             { UTYPE_INT,       GL_U_ATTR_OFFSET       },
             {0}
         },
+        .features       = SHADER_FEATURE_SHADOWS,
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "batched.mesh.static.textured-phong-shadowed.bindless",
+        .vertex_path    = "shaders/vertex/static-shadowed-batched.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/textured-phong-shadowed-batched-bindless.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
+            { UTYPE_INT,       GL_U_SHADOW_MAP        },
+            { UTYPE_ARRAY,     GL_U_CASCADE_TRANS     },
+            { UTYPE_VEC4,      GL_U_CASCADE_SCALE     },
+            { UTYPE_INT,       GL_U_CASCADE_COUNT     },
+            { UTYPE_INT,       GL_U_TEX_HANDLES       },
+            { UTYPE_INT,       "attrbuff"             },
+            { UTYPE_INT,       "attrbuff_offset"      },
+            { UTYPE_INT,       GL_U_ATTR_STRIDE       },
+            { UTYPE_INT,       GL_U_ATTR_OFFSET       },
+            {0}
+        },
+        .bindless       = true,
+        .features       = SHADER_FEATURE_SHADOWS,
     },
     {
         .prog_id        = (intptr_t)NULL,
@@ -400,20 +455,15 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/textured-phong-shadowed.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_MAT4,      GL_U_LS_TRANS          },
-            { UTYPE_ARRAY,     GL_U_CURR_POSE_MATS    },
-            { UTYPE_ARRAY,     GL_U_INV_BIND_MATS     },
+            { UTYPE_INT,       GL_U_POSE_BUFF         },
+            { UTYPE_INT,       GL_U_POSE_BASE         },
             { UTYPE_MAT4,      GL_U_NORMAL_MAT        },
-            { UTYPE_VEC3,      GL_U_AMBIENT_COLOR     },
-            { UTYPE_VEC3,      GL_U_LIGHT_COLOR       },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
-            { UTYPE_COMPOSITE, GL_U_MATERIALS,        },
             { UTYPE_INT,       GL_U_SHADOW_MAP        },
+            { UTYPE_ARRAY,     GL_U_CASCADE_TRANS     },
+            { UTYPE_VEC4,      GL_U_CASCADE_SCALE     },
+            { UTYPE_INT,       GL_U_CASCADE_COUNT     },
             {0}
         },
     },
@@ -425,25 +475,125 @@ static struct shader s_shaders[] = {
         .compute_path   = NULL,
         .frag_path      = "shaders/fragment/textured-phong-shadowed-batched.glsl",
         .uniforms       = (struct uniform[]){
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_MAT4,      GL_U_LS_TRANS          },
-            { UTYPE_VEC3,      GL_U_AMBIENT_COLOR     },
-            { UTYPE_VEC3,      GL_U_LIGHT_COLOR       },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_INT,       GL_U_TEX_ARRAY0        },
             { UTYPE_INT,       GL_U_TEX_ARRAY1        },
             { UTYPE_INT,       GL_U_TEX_ARRAY2        },
             { UTYPE_INT,       GL_U_TEX_ARRAY3        },
             { UTYPE_INT,       GL_U_SHADOW_MAP        },
+            { UTYPE_ARRAY,     GL_U_CASCADE_TRANS     },
+            { UTYPE_VEC4,      GL_U_CASCADE_SCALE     },
+            { UTYPE_INT,       GL_U_CASCADE_COUNT     },
             { UTYPE_INT,       "attrbuff"             },
             { UTYPE_INT,       "attrbuff_offset"      },
             { UTYPE_INT,       GL_U_ATTR_STRIDE       },
             { UTYPE_INT,       GL_U_ATTR_OFFSET       },
+            { UTYPE_INT,       GL_U_POSE_BUFF         },
             {0}
         },
+        .features       = SHADER_FEATURE_SHADOWS,
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "batched.mesh.animated.textured-phong-shadowed.bindless",
+        .vertex_path    = "shaders/vertex/skinned-shadowed-batched.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/textured-phong-shadowed-batched-bindless.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
+            { UTYPE_INT,       GL_U_TEX_HANDLES       },
+            { UTYPE_INT,       GL_U_SHADOW_MAP        },
+            { UTYPE_ARRAY,     GL_U_CASCADE_TRANS     },
+            { UTYPE_VEC4,      GL_U_CASCADE_SCALE     },
+            { UTYPE_INT,       GL_U_CASCADE_COUNT     },
+            { UTYPE_INT,       "attrbuff"             },
+            { UTYPE_INT,       "attrbuff_offset"      },
+            { UTYPE_INT,       GL_U_ATTR_STRIDE       },
+            { UTYPE_INT,       GL_U_ATTR_OFFSET       },
+            { UTYPE_INT,       GL_U_POSE_BUFF         },
+            {0}
+        },
+        .bindless       = true,
+        .features       = SHADER_FEATURE_SHADOWS,
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "batched.mesh.static.depth-prepass",
+        .vertex_path    = "shaders/vertex/static-shadowed-batched.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/alpha-test-batched.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
+            { UTYPE_INT,       GL_U_TEX_ARRAY0        },
+            { UTYPE_INT,       GL_U_TEX_ARRAY1        },
+            { UTYPE_INT,       GL_U_TEX_ARRAY2        },
+            { UTYPE_INT,       GL_U_TEX_ARRAY3        },
+            { UTYPE_INT,       "attrbuff"             },
+            { UTYPE_INT,       "attrbuff_offset"      },
+            { UTYPE_INT,       GL_U_ATTR_STRIDE       },
+            { UTYPE_INT,       GL_U_ATTR_OFFSET       },
+            {0}
+        },
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "batched.mesh.static.depth-prepass.bindless",
+        .vertex_path    = "shaders/vertex/static-shadowed-batched.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/alpha-test-batched-bindless.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
+            { UTYPE_INT,       GL_U_TEX_HANDLES       },
+            { UTYPE_INT,       "attrbuff"             },
+            { UTYPE_INT,       "attrbuff_offset"      },
+            { UTYPE_INT,       GL_U_ATTR_STRIDE       },
+            { UTYPE_INT,       GL_U_ATTR_OFFSET       },
+            {0}
+        },
+        .bindless       = true,
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "batched.mesh.animated.depth-prepass",
+        .vertex_path    = "shaders/vertex/skinned-shadowed-batched.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/alpha-test-batched.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
+            { UTYPE_INT,       GL_U_TEX_ARRAY0        },
+            { UTYPE_INT,       GL_U_TEX_ARRAY1        },
+            { UTYPE_INT,       GL_U_TEX_ARRAY2        },
+            { UTYPE_INT,       GL_U_TEX_ARRAY3        },
+            { UTYPE_INT,       "attrbuff"             },
+            { UTYPE_INT,       "attrbuff_offset"      },
+            { UTYPE_INT,       GL_U_ATTR_STRIDE       },
+            { UTYPE_INT,       GL_U_ATTR_OFFSET       },
+            { UTYPE_INT,       GL_U_POSE_BUFF         },
+            {0}
+        },
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "batched.mesh.animated.depth-prepass.bindless",
+        .vertex_path    = "shaders/vertex/skinned-shadowed-batched.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/alpha-test-batched-bindless.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
+            { UTYPE_INT,       GL_U_TEX_HANDLES       },
+            { UTYPE_INT,       "attrbuff"             },
+            { UTYPE_INT,       "attrbuff_offset"      },
+            { UTYPE_INT,       GL_U_ATTR_STRIDE       },
+            { UTYPE_INT,       GL_U_ATTR_OFFSET       },
+            { UTYPE_INT,       GL_U_POSE_BUFF         },
+            {0}
+        },
+        .bindless       = true,
     },
     {
         .prog_id        = (intptr_t)NULL,
@@ -453,11 +603,35 @@ static struct shader s_shaders[] = {
         .compute_path   = NULL,
         .frag_path      = "shaders/fragment/statusbar.glsl",
         .uniforms       = (struct uniform[]){
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_IVEC2,     GL_U_CURR_RES          },
-            { UTYPE_ARRAY,     GL_U_ENT_TOP_OFFSETS_SS},
-            { UTYPE_ARRAY,     GL_U_ENT_HEALTH_PC     },
+            { UTYPE_MAT4,      GL_U_CAM_VIEW_PROJ     },
+            {0}
+        },
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "icon",
+        .vertex_path    = "shaders/vertex/icon.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/icon.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_IVEC2,     GL_U_CURR_RES          },
+            { UTYPE_MAT4,      GL_U_CAM_VIEW_PROJ     },
+            { UTYPE_INT,       GL_U_TEXTURE0          },
+            {0}
+        },
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "impostor",
+        .vertex_path    = "shaders/vertex/impostor.glsl",
+        .geo_path       = NULL,
+        .compute_path   = NULL,
+        .frag_path      = "shaders/fragment/impostor.glsl",
+        .uniforms       = (struct uniform[]){
+            { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
+            { UTYPE_INT,       GL_U_IMPOSTOR_ATLAS    },
             {0}
         },
     },
@@ -470,11 +644,8 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/water.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_IVEC2,     GL_U_WATER_TILING      },
+            { UTYPE_MAT4,      GL_U_REFLECT_VIEW_PROJ },
             { UTYPE_INT,       GL_U_DUDV_MAP          },
             { UTYPE_INT,       GL_U_NORMAL_MAP        },
             { UTYPE_INT,       GL_U_REFRACT_TEX       },
@@ -482,7 +653,6 @@ static struct shader s_shaders[] = {
             { UTYPE_FLOAT,     GL_U_MOVE_FACTOR       },
             { UTYPE_FLOAT,     GL_U_CAM_NEAR          },
             { UTYPE_FLOAT,     GL_U_CAM_FAR           },
-            { UTYPE_VEC3,      GL_U_LIGHT_COLOR       },
             { UTYPE_INT,       "visbuff"              },
             { UTYPE_INT,       "visbuff_offset"       },
             { UTYPE_IVEC4,     GL_U_MAP_RES,          },
@@ -498,7 +668,6 @@ static struct shader s_shaders[] = {
         .compute_path   = NULL,
         .frag_path      = "shaders/fragment/ui.glsl",
         .uniforms       = (struct uniform[]){
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_INT,       GL_U_TEXTURE0          },
             {0}
         },
@@ -512,11 +681,7 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/minimap.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             { UTYPE_VEC4,      GL_U_CLIP_PLANE0       },
-            { UTYPE_VEC3,      GL_U_LIGHT_POS         },
-            { UTYPE_VEC3,      GL_U_VIEW_POS          },
             { UTYPE_INT,       GL_U_TEXTURE0          },
             { UTYPE_INT,       "visbuff"              },
             { UTYPE_INT,       "visbuff_offset"       },
@@ -534,8 +699,6 @@ static struct shader s_shaders[] = {
         .frag_path      = "shaders/fragment/colored-per-vert.glsl",
         .uniforms       = (struct uniform[]){
             { UTYPE_MAT4,      GL_U_MODEL             },
-            { UTYPE_MAT4,      GL_U_VIEW              },
-            { UTYPE_MAT4,      GL_U_PROJECTION        },
             {0}
         },
     },
@@ -554,12 +717,38 @@ static struct shader s_shaders[] = {
     },
     {
         .prog_id        = (intptr_t)NULL,
-        .name           = "movement",
+        .name           = "los",
+        .vertex_path    = NULL,
+        .geo_path       = NULL,
+        .compute_path   = "shaders/compute/los.glsl",
+        .frag_path      = NULL,
+        .uniforms       = (struct uniform[]){
+            {0}
+        },
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "cull",
+        .vertex_path    = NULL,
+        .geo_path       = NULL,
+        .compute_path   = "shaders/compute/cull.glsl",
+        .frag_path      = NULL,
+        .uniforms       = (struct uniform[]){
+            { UTYPE_INT,       "attrbuff"             },
+            { UTYPE_INT,       "attrbuff_offset"      },
+            { UTYPE_INT,       GL_U_ATTR_STRIDE       },
+            {0}
+        },
+    },
+    {
+        .prog_id        = (intptr_t)NULL,
+        .name           = "hiz",
         .vertex_path    = NULL,
         .geo_path       = NULL,
-        .compute_path   = "shaders/compute/movement.glsl",
+        .compute_path   = "shaders/compute/hiz.glsl",
         .frag_path      = NULL,
         .uniforms       = (struct uniform[]){
+            { UTYPE_INT,       GL_U_TEXTURE0          },
             {0}
         },
     },
@@ -606,21 +795,175 @@ const char *shader_text_load(const char *path)
     return ret;
 }
 
-static bool shader_init(const char *text, GLuint *out, GLint type)
+static uint64_t shader_hash(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *curr = data;
+    while(size--) {
+        hash = (hash ^ *curr++) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool shader_cache_path(uint64_t key, char *out, size_t maxout)
+{
+    char *dir = SDL_GetPrefPath(CACHE_ORG, CACHE_APP);
+    if(!dir)
+        return false;
+
+    int len = pf_snprintf(out, maxout, "%s%016llx.pfprog", dir, (unsigned long long)key);
+    SDL_free(dir);
+    return (len > 0 && len < maxout);
+}
+
+static bool shader_cache_load(uint64_t key, GLint *out)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    char path[512];
+    if(!shader_cache_path(key, path, sizeof(path)))
+        goto fail_open;
+
+    SDL_RWops *stream = SDL_RWFromFile(path, "rb");
+    if(!stream)
+        goto fail_open;
+
+    struct cache_header hdr;
+    if(SDL_RWread(stream, &hdr, sizeof(hdr), 1) != 1)
+        goto fail_header;
+    if(hdr.magic != CACHE_MAGIC
+    || hdr.version != CACHE_VERSION
+    || hdr.key != key
+    || hdr.length == 0
+    || hdr.length != SDL_RWsize(stream) - sizeof(hdr))
+        goto fail_header;
+
+    void *binary = malloc(hdr.length);
+    if(!binary)
+        goto fail_header;
+    if(SDL_RWread(stream, binary, hdr.length, 1) != 1)
+        goto fail_read;
+    if(shader_hash(FNV_BASIS, binary, hdr.length) != hdr.checksum)
+        goto fail_read;
+
+    /* The driver is free to reject binaries, i.e. after it's been updated */
+    GLint success;
+    GLuint prog = glCreateProgram();
+    glProgramBinary(prog, hdr.format, binary, hdr.length);
+    glGetProgramiv(prog, GL_LINK_STATUS, &success);
+    if(!success) {
+        glDeleteProgram(prog);
+        goto fail_read;
+    }
+
+    free(binary);
+    SDL_RWclose(stream);
+    *out = prog;
+    return true;
+
+fail_read:
+    free(binary);
+fail_header:
+    SDL_RWclose(stream);
+fail_open:
+    return false;
+}
+
+static bool shader_cache_save(uint64_t key, GLuint prog)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    char path[512], tmp_path[512];
+    if(!shader_cache_path(key, path, sizeof(path)))
+        goto fail_path;
+    if(pf_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path))
+        goto fail_path;
+
+    GLint length = 0;
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        goto fail_path;
+
+    void *binary = malloc(length);
+    if(!binary)
+        goto fail_path;
+
+    GLenum format;
+    GLsizei written = 0;
+    glGetProgramBinary(prog, length, &written, &format, binary);
+    if(written <= 0)
+        goto fail_binary;
+
+    struct cache_header hdr = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .key = key,
+        .format = format,
+        .length = written,
+        .checksum = shader_hash(FNV_BASIS, binary, written),
+    };
+
+    SDL_RWops *stream = SDL_RWFromFile(tmp_path, "wb");
+    if(!stream)
+        goto fail_binary;
+    if(SDL_RWwrite(stream, &hdr, sizeof(hdr), 1) != 1)
+        goto fail_write;
+    if(SDL_RWwrite(stream, binary, written, 1) != 1)
+        goto fail_write;
+    if(SDL_RWclose(stream) != 0)
+        goto fail_close;
+
+    /* Only ever expose a complete file under the final name */
+    remove(path);
+    if(rename(tmp_path, path) != 0)
+        goto fail_close;
+
+    free(binary);
+    return true;
+
+fail_write:
+    SDL_RWclose(stream);
+fail_close:
+    remove(tmp_path);
+fail_binary:
+    free(binary);
+fail_path:
+    return false;
+}
+
+static bool shader_check(GLuint shader, const char *path)
 {
     ASSERT_IN_RENDER_THREAD();
 
     char info[512];
     GLint success;
 
-    *out = glCreateShader(type);
-    glShaderSource(*out, 1, &text, NULL);
-    glCompileShader(*out);
+    /* With KHR_parallel_shader_compile, this is where we wait for the result */
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if(!success) {
 
-    glGetShaderiv(*out, GL_COMPILE_STATUS, &success);
+        glGetShaderInfoLog(shader, sizeof(info), NULL, info);
+        pf_strlcat(info, "\n", sizeof(info));
+        PRINT(info);
+
+        pf_snprintf(info, sizeof(info), "Could not compile shader at: %s\n", path);
+        PRINT(info);
+        return false;
+    }
+
+    return true;
+}
+
+static bool shader_prog_check(GLuint prog)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    char info[512];
+    GLint success;
+
+    glGetProgramiv(prog, GL_LINK_STATUS, &success);
     if(!success) {
 
-        glGetShaderInfoLog(*out, sizeof(info), NULL, info);
+        glGetProgramInfoLog(prog, sizeof(info), NULL, info);
         pf_strlcat(info, "\n", sizeof(info));
         PRINT(info);
         return false;
@@ -629,65 +972,227 @@ static bool shader_init(const char *text, GLuint *out, GLint type)
     return true;
 }
 
-static bool shader_load_and_init(const char *path, GLuint *out, GLint type)
+/* The offset just past the '#version' line, since the directive must 
+ * come before anything else in the source. */
+static size_t shader_version_end(const char *text)
+{
+    const char *version = strstr(text, "#version");
+    if(!version)
+        return 0;
+
+    const char *end = strchr(version, '\n');
+    if(!end)
+        return strlen(text);
+    return (end - text) + 1;
+}
+
+static int shader_lines(const char *text, size_t len)
+{
+    int ret = 0;
+    for(size_t i = 0; i < len; i++) {
+        if(text[i] == '\n')
+            ret++;
+    }
+    return ret;
+}
+
+static bool shader_defines(uint32_t features, char *out, size_t maxout)
+{
+    size_t len = 0;
+    out[0] = '\0';
+
+    for(int i = 0; i < ARR_SIZE(s_feature_defines); i++) {
+
+        if(!(features & (1u << i)))
+            continue;
+
+        int written = pf_snprintf(out + len, maxout - len, "#define %s\n", s_feature_defines[i]);
+        if(written < 0 || written >= maxout - len)
+            return false;
+        len += written;
+    }
+    return true;
+}
+
+static void shader_build_free(struct shader_build *build)
+{
+    for(int i = 0; i < NUM_STAGES; i++) {
+        if(build->stages[i]) {
+            glDeleteShader(build->stages[i]);
+            build->stages[i] = 0;
+        }
+    }
+}
+
+/* Load the program from the binary cache, or otherwise issue the 
+ * compilation and linking of its' stages without waiting on the result. 
+ * The stages are specialized for the 'features' subset of the shader's
+ * own features.
+ */
+static bool shader_build_begin(const char *base_path, const struct shader *res, 
+                               uint32_t features, struct shader_build *build)
 {
     ASSERT_IN_RENDER_THREAD();
+
+    const char *paths[NUM_STAGES] = {
+        res->vertex_path, 
+        res->geo_path, 
+        res->frag_path, 
+        res->compute_path
+    };
+    const GLint types[NUM_STAGES] = {
+        GL_VERTEX_SHADER, 
+        GL_GEOMETRY_SHADER, 
+        GL_FRAGMENT_SHADER, 
+        GL_COMPUTE_SHADER
+    };
+    const char *texts[NUM_STAGES] = {0};
     char buff[512];
+    char defines[256];
 
-    const char *text = shader_text_load(path);
-    if(!text) {
-        pf_snprintf(buff, sizeof(buff), "Could not load shader at: %s\n", path);
+    memset(build, 0, sizeof(*build));
+    if(res->compute_path && !R_ComputeShaderSupported()) {
+        pf_snprintf(buff, sizeof(buff), "No compute shader support on the current platform. "
+            "Skipping shader '%s'.\n", res->name);
         PRINT(buff);
-        goto fail;
+        build->skipped = true;
+        return true;
     }
-    
-    if(!shader_init(text, out, type)){
-        pf_snprintf(buff, sizeof(buff), "Could not compile shader at: %s\n", path);
-        PRINT(buff);
+    if(res->bindless && !R_BindlessTexturesSupported()) {
+        build->skipped = true;
+        return true;
+    }
+
+    const char *info[] = {
+        R_GetInfo(RENDER_INFO_VENDOR),
+        R_GetInfo(RENDER_INFO_RENDERER),
+        R_GetInfo(RENDER_INFO_VERSION),
+    };
+    uint32_t version = CACHE_VERSION;
+    uint64_t key = shader_hash(FNV_BASIS, &version, sizeof(version));
+    for(int i = 0; i < ARR_SIZE(info); i++) {
+        key = shader_hash(key, info[i], strlen(info[i]) + 1);
+    }
+
+    for(int i = 0; i < NUM_STAGES; i++) {
+
+        if(!paths[i])
+            continue;
+
+        pf_snprintf(build->paths[i], sizeof(build->paths[i]), "%s/%s", base_path, paths[i]);
+        texts[i] = shader_text_load(build->paths[i]);
+        if(!texts[i]) {
+            pf_snprintf(buff, sizeof(buff), "Could not load shader at: %s\n", build->paths[i]);
+            PRINT(buff);
+            goto fail;
+        }
+
+        key = shader_hash(key, &types[i], sizeof(types[i]));
+        key = shader_hash(key, texts[i], strlen(texts[i]));
+    }
+
+    if(!shader_defines(features & res->features, defines, sizeof(defines)))
         goto fail;
+    /* Programs without any features keep their existing cache keys */
+    if(defines[0]) {
+        key = shader_hash(key, defines, strlen(defines));
+    }
+    build->key = key;
+
+    if(s_binary_cache && shader_cache_load(key, &build->prog)) {
+        build->cached = true;
+        goto done;
     }
 
-    free((char*)text);
+    build->prog = glCreateProgram();
+    for(int i = 0; i < NUM_STAGES; i++) {
+
+        if(!texts[i])
+            continue;
+
+        build->stages[i] = glCreateShader(types[i]);
+
+        if(defines[0]) {
+            /* Restore the line numbering of the source for the info log */
+            size_t split = shader_version_end(texts[i]);
+            char spliced[sizeof(defines) + 32];
+            pf_snprintf(spliced, sizeof(spliced), "%s#line %d\n", defines, 
+                shader_lines(texts[i], split) + 1);
+
+            const char *strings[3] = {texts[i], spliced, texts[i] + split};
+            const GLint lengths[3] = {split, -1, -1};
+            glShaderSource(build->stages[i], 3, strings, lengths);
+        }else{
+            glShaderSource(build->stages[i], 1, &texts[i], NULL);
+        }
+
+        glCompileShader(build->stages[i]);
+        glAttachShader(build->prog, build->stages[i]);
+    }
+
+    if(s_binary_cache) {
+        glProgramParameteri(build->prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(build->prog);
+
+done:
+    for(int i = 0; i < NUM_STAGES; i++) {
+        free((char*)texts[i]);
+    }
     return true;
 
 fail:
-    free((char*)text);
+    for(int i = 0; i < NUM_STAGES; i++) {
+        free((char*)texts[i]);
+    }
     return false;
 }
 
-static bool shader_make_prog(const GLuint vertex_shader, const GLuint geo_shader, 
-                             const GLuint compute_shader, const GLuint frag_shader, GLint *out)
+static void shader_bind_blocks(GLuint prog)
+{
+    GLuint idx = glGetUniformBlockIndex(prog, GL_U_FRAME_BLOCK);
+    if(idx != GL_INVALID_INDEX) {
+        glUniformBlockBinding(prog, idx, UBLOCK_FRAME);
+    }
+
+    idx = glGetUniformBlockIndex(prog, GL_U_MATERIAL_BLOCK);
+    if(idx != GL_INVALID_INDEX) {
+        glUniformBlockBinding(prog, idx, UBLOCK_MATERIALS);
+    }
+}
+
+static bool shader_build_finish(struct shader_build *build)
 {
     ASSERT_IN_RENDER_THREAD();
 
-    char info[512];
-    GLint success;
+    if(build->skipped)
+        return true;
 
-    *out = glCreateProgram();
-    if(vertex_shader) {
-        glAttachShader(*out, vertex_shader);
+    if(build->cached) {
+        shader_bind_blocks(build->prog);
+        return true;
     }
-    if(geo_shader) {
-        glAttachShader(*out, geo_shader); 
-    }
-    if(compute_shader) {
-        glAttachShader(*out, compute_shader);
-    }
-    if(frag_shader) {
-        glAttachShader(*out, frag_shader);
+
+    for(int i = 0; i < NUM_STAGES; i++) {
+        if(build->stages[i] && !shader_check(build->stages[i], build->paths[i]))
+            goto fail;
     }
-    glLinkProgram(*out);
 
-    glGetProgramiv(*out, GL_LINK_STATUS, &success);
-    if(!success) {
+    if(!shader_prog_check(build->prog))
+        goto fail;
 
-        glGetProgramInfoLog(*out, sizeof(info), NULL, info);
-        pf_strlcat(info, "\n", sizeof(info));
-        PRINT(info);
-        return false;
+    shader_bind_blocks(build->prog);
+    if(s_binary_cache) {
+        shader_cache_save(build->key, build->prog);
     }
-
+    shader_build_free(build);
     return true;
+
+fail:
+    shader_build_free(build);
+    glDeleteProgram(build->prog);
+    build->prog = 0;
+    return false;
 }
 
 static const struct shader *shader_for_name(const char *name)
@@ -713,21 +1218,77 @@ static const struct shader *shader_for_prog(GLuint prog)
         if(curr->prog_id == prog)
             return curr;
     }
+
+    khiter_t k = kh_get(prog, s_perm_progs, prog);
+    if(k != kh_end(s_perm_progs))
+        return &s_shaders[kh_value(s_perm_progs, k)];
     return NULL;
 }
 
-static void shader_install(const struct shader *shader)
+/* Get the program for the permutation of the shader with only the 'features' 
+ * subset of its' features enabled, building it if this is the first time 
+ * it's been asked for. This stalls on the driver unless the permutation is 
+ * in the binary cache, but each permutation is only ever built once. 
+ */
+static GLint shader_permutation(const struct shader *shader, uint32_t features)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    features &= shader->features;
+    if(features == shader->features || !shader->prog_id)
+        return shader->prog_id;
+
+    int idx = shader - s_shaders;
+    uint64_t key = (((uint64_t)idx) << 32) | features;
+
+    khiter_t k = kh_get(perm, s_perms, key);
+    if(k != kh_end(s_perms))
+        return kh_value(s_perms, k);
+
+    int status;
+    struct shader_build build;
+    GLint prog = shader->prog_id;
+
+    if(!shader_build_begin(s_base_path, shader, features, &build)
+    || !shader_build_finish(&build)) {
+
+        char buff[512];
+        pf_snprintf(buff, sizeof(buff), "Failed to make permutation 0x%x of shader '%s'. "
+            "Falling back to the full program.\n", features, shader->name);
+        PRINT(buff);
+        goto done;
+    }
+
+    k = kh_put(prog, s_perm_progs, build.prog, &status);
+    if(status == -1) {
+        glDeleteProgram(build.prog);
+        goto done;
+    }
+    kh_value(s_perm_progs, k) = idx;
+    prog = build.prog;
+
+done:
+    /* Failures are remembered too, so that they're not retried every draw */
+    k = kh_put(perm, s_perms, key, &status);
+    if(status == -1)
+        return prog;
+    kh_value(s_perms, k) = prog;
+    return prog;
+}
+
+static void shader_install(const struct shader *shader, GLint prog)
 {
     const struct uniform *curr = shader->uniforms;
 
-    if(s_curr_prog != shader->prog_id) {
-        glUseProgram(shader->prog_id);
-        s_curr_prog = shader->prog_id;
+    if(s_curr_prog != prog) {
+        glUseProgram(prog);
+        s_curr_prog = prog;
     }
 
+    R_GL_StateCommitBlocks();
     while(curr->name) {
 
-        R_GL_StateInstall(curr->name, shader->prog_id);
+        R_GL_StateInstall(curr->name, prog);
         curr++;
     }
 }
@@ -740,80 +1301,74 @@ bool R_GL_Shader_InitAll(const char *base_path)
 {
     ASSERT_IN_RENDER_THREAD();
 
-    for(int i = 0; i < ARR_SIZE(s_shaders); i++){
-
-        char path[512];
-        struct shader *res = &s_shaders[i];
-        GLuint vertex = 0, geometry = 0, fragment = 0, compute = 0;
-
-        if(res->vertex_path) {
-            pf_snprintf(path, sizeof(path), "%s/%s", base_path, res->vertex_path);
-            if(!shader_load_and_init(path, &vertex, GL_VERTEX_SHADER)) {
-                PRINT("Failed to load and init vertex shader.\n");
-                goto fail;
-            }
-        }
-        assert(!res->vertex_path || vertex > 0);
+    GLint nformats = 0;
+    if(GLEW_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nformats);
+    }
+    s_binary_cache = (nformats > 0);
 
-        if(res->geo_path) {
-            pf_snprintf(path, sizeof(path), "%s/%s", base_path, res->geo_path);
-            if(!shader_load_and_init(path, &geometry, GL_GEOMETRY_SHADER)) {
-                PRINT("Failed to load and init geometry shader.\n");
-                goto fail;
-            }
-        }
-        assert(!res->geo_path || geometry > 0);
+    if(GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xffffffff);
+    }
 
-        if(res->frag_path) {
-            pf_snprintf(path, sizeof(path), "%s/%s", base_path, res->frag_path);
-            if(!shader_load_and_init(path, &fragment, GL_FRAGMENT_SHADER)) {
-                PRINT("Failed to load and init fragment shader.\n");
-                goto fail;
-            }
-        }
-        assert(!res->frag_path || fragment > 0);
+    pf_strlcpy(s_base_path, base_path, sizeof(s_base_path));
+    s_perms = kh_init(perm);
+    if(!s_perms)
+        goto fail_perms;
+    s_perm_progs = kh_init(prog);
+    if(!s_perm_progs)
+        goto fail_perm_progs;
 
-        if(res->compute_path) {
+    struct shader_build builds[ARR_SIZE(s_shaders)];
+    memset(builds, 0, sizeof(builds));
 
-            if(!R_ComputeShaderSupported()) {
-                char buff[512];
-                pf_snprintf(buff, sizeof(buff), "No compute shader support on the current platform. "
-                    "Skipping shader '%s'.\n", res->name);
-                PRINT(buff);
-                continue;
-            }
+    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
 
-            pf_snprintf(path, sizeof(path), "%s/%s", base_path, res->compute_path);
-            if(!shader_load_and_init(path, &compute, GL_COMPUTE_SHADER)) {
-                PRINT("Failed to load and init compute shader.\n");
-                goto fail;
-            }
+        if(!shader_build_begin(base_path, &s_shaders[i], SHADER_FEATURE_ALL, &builds[i])) {
+            PRINT("Failed to load shader source.\n");
+            goto fail;
         }
-        assert(!res->compute_path || compute > 0);
+    }
 
-        if(!shader_make_prog(vertex, geometry, compute, fragment, &res->prog_id)) {
+    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
+
+        if(!shader_build_finish(&builds[i])) {
             char buff[512];
             pf_snprintf(buff, sizeof(buff), "Failed to make shader program %d of %d.\n",
                 i + 1, (int)ARR_SIZE(s_shaders));
             PRINT(buff);
-            goto fail;
+            for(int j = i + 1; j < ARR_SIZE(s_shaders); j++) {
+                shader_build_free(&builds[j]);
+            }
+            goto fail_build;
         }
-
-        if(vertex)      glDeleteShader(vertex);
-        if(geometry)    glDeleteShader(geometry);
-        if(fragment)    glDeleteShader(fragment);
-        if(compute)     glDeleteShader(compute);
-        continue;
-
-    fail:
-        if(vertex)      glDeleteShader(vertex);
-        if(geometry)    glDeleteShader(geometry);
-        if(fragment)    glDeleteShader(fragment);
-        if(compute)     glDeleteShader(compute);
-        return false;
+        s_shaders[i].prog_id = builds[i].prog;
     }
 
     return true;
+
+fail:
+    for(int j = 0; j < ARR_SIZE(s_shaders); j++) {
+        shader_build_free(&builds[j]);
+    }
+fail_build:
+    kh_destroy(prog, s_perm_progs);
+fail_perm_progs:
+    kh_destroy(perm, s_perms);
+fail_perms:
+    return false;
+}
+
+void R_GL_Shader_Shutdown(void)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    GLint prog;
+    kh_foreach_key(s_perm_progs, prog, {
+        glDeleteProgram(prog);
+    });
+    kh_destroy(prog, s_perm_progs);
+    kh_destroy(perm, s_perms);
 }
 
 GLint R_GL_Shader_GetProgForName(const char *name)
@@ -831,18 +1386,24 @@ GLint R_GL_Shader_GetProgForName(const char *name)
     return -1;
 }
 
-const char *R_GL_Shader_GetName(GLuint prog)
+GLint R_GL_Shader_GetProgForPermutation(const char *name, uint32_t features)
 {
     ASSERT_IN_RENDER_THREAD();
 
-    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
+    const struct shader *shader = shader_for_name(name);
+    if(!shader)
+        return -1;
+    return shader_permutation(shader, features);
+}
 
-        const struct shader *curr = &s_shaders[i];
-        if(curr->prog_id == prog)
-            return curr->name;
-    }
-    
-    return NULL;
+const char *R_GL_Shader_GetName(GLuint prog)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    const struct shader *shader = shader_for_prog(prog);
+    if(!shader)
+        return NULL;
+    return shader->name;
 }
     
 void R_GL_Shader_Install(const char *name)
@@ -850,7 +1411,15 @@ void R_GL_Shader_Install(const char *name)
     ASSERT_IN_RENDER_THREAD();
 
     const struct shader *shader = shader_for_name(name);
-    shader_install(shader);
+    shader_install(shader, shader->prog_id);
+}
+
+void R_GL_Shader_InstallPermutation(const char *name, uint32_t features)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    const struct shader *shader = shader_for_name(name);
+    shader_install(shader, shader_permutation(shader, features));
 }
 
 void R_GL_Shader_InstallProg(GLuint prog)
@@ -858,7 +1427,7 @@ void R_GL_Shader_InstallProg(GLuint prog)
     ASSERT_IN_RENDER_THREAD();
 
     const struct shader *shader = shader_for_prog(prog);
-    shader_install(shader);
+    shader_install(shader, prog);
 }
 
 GLuint R_GL_Shader_GetCurrActive(void)
@@ -39,11 +39,24 @@
 #include <GL/glew.h>
 
 #include <stdbool.h>
+#include <stdint.h>
+
+/* The compile-time features a program can be specialized for. A program 
+ * looked up by name alone has all of its' supported features enabled. 
+ */
+enum shader_feature{
+    SHADER_FEATURE_SHADOWS = (1 << 0),
+};
+
+#define SHADER_FEATURE_ALL (SHADER_FEATURE_SHADOWS)
 
 bool        R_GL_Shader_InitAll(const char *base_path);
+void        R_GL_Shader_Shutdown(void);
 GLint       R_GL_Shader_GetProgForName(const char *name);
+GLint       R_GL_Shader_GetProgForPermutation(const char *name, uint32_t features);
 const char *R_GL_Shader_GetName(GLuint prog);
 void        R_GL_Shader_Install(const char *name);
+void        R_GL_Shader_InstallPermutation(const char *name, uint32_t features);
 void        R_GL_Shader_InstallProg(GLuint prog);
 GLuint      R_GL_Shader_GetCurrActive(void);
 
@@ -34,6 +34,7 @@
  */
 
 #include "public/render.h"
+#include "public/render_ctrl.h"
 #include "render_private.h"
 #include "gl_render.h"
 #include "gl_state.h"
@@ -50,24 +51,64 @@
 
 #include <GL/glew.h>
 #include <assert.h>
+#include <string.h>
+#include <math.h>
 
 
+#define MIN(a, b)             ((a) < (b) ? (a) : (b))
+#define MAX(a, b)             ((a) > (b) ? (a) : (b))
+
 #define LIGHT_EXTRA_HEIGHT    (300.0f)
 #define LIGHT_VISIBILITY_ZOOM (75.0f)
+/* Blend between the logarithmic and the uniform split schemes */
+#define CASCADE_SPLIT_LAMBDA  (0.75f)
+/* The cascades past this index are drawn at half the resolution and 
+ * only updated every other frame */
+#define CASCADE_NUM_NEAR      (2)
 
 struct shadow_gl_state{
     GLint viewport[4];
     GLint fb;
 };
 
+/* The cached static layer of a single cascade */
+struct static_layer{
+    bool     valid;
+    mat4x4_t trans;
+    uint64_t hash;
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static GLuint         s_depth_map_FBO;
+/* Each cascade is a layer of the depth map array, with its' own FBO */
+static GLuint         s_depth_map_FBO[R_SHADOW_MAX_CASCADES];
 static GLuint         s_depth_map_tex;
+static int            s_nlayers = 0;
 static bool           s_depth_pass_active = false;
 static struct shadow_gl_state s_saved;
+static mat4x4_t       s_light_space_trans;
+static int            s_curr_cascade;
+static int            s_curr_res;
+
+/* The map and the entities which never move are drawn into a separate static
+ * layer, which is kept across frames. It only needs to be redrawn when the 
+ * light transform or the set of static casters changes, and is otherwise 
+ * just copied into the depth map before the dynamic casters are drawn. 
+ */
+static GLuint         s_static_FBO[R_SHADOW_MAX_CASCADES];
+static GLuint         s_static_tex;
+static struct static_layer s_static[R_SHADOW_MAX_CASCADES];
+static bool           s_static_active = false;
+static bool           s_static_redraw = false;
+
+/* Main thread state of 'R_LightCascades', holding on to the cascades which 
+ * are not refreshed every frame. */
+static struct shadow_cascade s_last_cascades[R_SHADOW_MAX_CASCADES];
+static struct frustum s_last_frusta[R_SHADOW_MAX_CASCADES];
+static int            s_last_ncascades = 0;
+static unsigned long  s_last_cascade_frame = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -110,6 +151,253 @@ static void make_light_frustum(vec3_t light_pos, vec3_t cam_pos, vec3_t cam_dir,
     }
 }
 
+static void make_depth_target(int nlayers, GLuint *out_tex, GLuint *out_fbos)
+{
+    glGenTextures(1, out_tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, *out_tex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32, 
+                 CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES, nlayers,
+                 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    /* Don't enable deptph comparisons as we will use a sampler2DArray and 
+     * manually perform comparison and filtering in the shader.
+     */
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(nlayers, out_fbos);
+    for(int i = 0; i < nlayers; i++) {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, out_fbos[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, *out_tex, 0, i);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);  
+}
+
+static void free_depth_target(int nlayers, GLuint tex, GLuint *fbos)
+{
+    glDeleteFramebuffers(nlayers, fbos);
+    glDeleteTextures(1, &tex);
+}
+
+/* The layers are only allocated for the number of cascades in use, so that 
+ * the single-cascade mode takes no more memory than a plain shadow map.
+ */
+static void reserve_layers(int nlayers)
+{
+    if(nlayers == s_nlayers)
+        return;
+
+    GLint fb;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fb);
+
+    if(s_nlayers > 0) {
+        free_depth_target(s_nlayers, s_depth_map_tex, s_depth_map_FBO);
+        free_depth_target(s_nlayers, s_static_tex, s_static_FBO);
+    }
+    make_depth_target(nlayers, &s_depth_map_tex, s_depth_map_FBO);
+    make_depth_target(nlayers, &s_static_tex, s_static_FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+
+    s_nlayers = nlayers;
+    R_GL_ShadowsInvalidateStatic();
+}
+
+static void vec3_lerp(const vec3_t *a, const vec3_t *b, float t, vec3_t *out)
+{
+    vec3_t delta;
+    PFM_Vec3_Sub((vec3_t*)b, (vec3_t*)a, &delta);
+    PFM_Vec3_Scale(&delta, t, &delta);
+    PFM_Vec3_Add((vec3_t*)a, &delta, out);
+}
+
+static void frustum_make_plane(vec3_t a, vec3_t b, vec3_t c, vec3_t inside, struct plane *out)
+{
+    vec3_t ab, cb, normal, to_inside;
+    PFM_Vec3_Sub(&a, &b, &ab);
+    PFM_Vec3_Sub(&c, &b, &cb);
+    PFM_Vec3_Cross(&ab, &cb, &normal);
+    PFM_Vec3_Normal(&normal, &normal);
+
+    PFM_Vec3_Sub(&inside, &b, &to_inside);
+    if(PFM_Vec3_Dot(&to_inside, &normal) < 0.0f) {
+        PFM_Vec3_Scale(&normal, -1.0f, &normal);
+    }
+    out->point = b;
+    out->normal = normal;
+}
+
+/* Build the world-space frustum enclosed by the clip volume of 'trans' 
+ * by un-projecting the corners of the NDC cube. 
+ */
+static void frustum_for_transform(const mat4x4_t *trans, struct frustum *out)
+{
+    mat4x4_t inv;
+    PFM_Mat4x4_Inverse((mat4x4_t*)trans, &inv);
+
+    vec3_t *corners[8] = {
+        &out->nbl, &out->nbr, &out->ntl, &out->ntr,
+        &out->fbl, &out->fbr, &out->ftl, &out->ftr,
+    };
+    vec3_t center = {0.0f, 0.0f, 0.0f};
+
+    for(int i = 0; i < 8; i++) {
+
+        vec4_t ndc = (vec4_t){
+            (i & 0x1) ? 1.0f : -1.0f,
+            (i & 0x2) ? 1.0f : -1.0f,
+            (i & 0x4) ? 1.0f : -1.0f,
+            1.0f
+        };
+        vec4_t world;
+        PFM_Mat4x4_Mult4x1(&inv, &ndc, &world);
+        *corners[i] = (vec3_t){world.x / world.w, world.y / world.w, world.z / world.w};
+        PFM_Vec3_Add(&center, corners[i], &center);
+    }
+    PFM_Vec3_Scale(&center, 1.0f / 8.0f, &center);
+
+    frustum_make_plane(out->ntl, out->ntr, out->nbr, center, &out->nearp);
+    frustum_make_plane(out->ftl, out->ftr, out->fbr, center, &out->farp);
+    frustum_make_plane(out->ntl, out->ntr, out->ftr, center, &out->top);
+    frustum_make_plane(out->nbl, out->nbr, out->fbr, center, &out->bot);
+    frustum_make_plane(out->ntl, out->nbl, out->fbl, center, &out->left);
+    frustum_make_plane(out->ntr, out->nbr, out->fbr, center, &out->right);
+}
+
+static void legacy_light_space_trans(vec3_t light_pos, vec3_t cam_pos, vec3_t cam_dir, 
+                                     mat4x4_t *out)
+{
+    mat4x4_t light_proj;
+    PFM_Mat4x4_MakeOrthographic(-CONFIG_SHADOW_FOV, CONFIG_SHADOW_FOV, 
+        CONFIG_SHADOW_FOV, -CONFIG_SHADOW_FOV, 0.1f, CONFIG_SHADOW_DRAWDIST, &light_proj);
+
+    mat4x4_t light_view;
+    make_light_frustum(light_pos, cam_pos, cam_dir, NULL, &light_view);
+
+    PFM_Mat4x4_Mult4x4(&light_proj, &light_view, out);
+}
+
+/* Fit an orthographic projection of the light to the bounding sphere of 
+ * the slice, so that its' size does not change as the camera rotates. The
+ * origin is snapped to whole texels to stop the shadow edges from crawling 
+ * as the camera pans. 
+ */
+static void cascade_light_space_trans(const mat4x4_t *light_view, vec3_t slice[static 8], 
+                                      int res, mat4x4_t *out)
+{
+    vec3_t center = {0.0f, 0.0f, 0.0f};
+    for(int i = 0; i < 8; i++) {
+        PFM_Vec3_Add(&center, &slice[i], &center);
+    }
+    PFM_Vec3_Scale(&center, 1.0f / 8.0f, &center);
+
+    float radius = 0.0f;
+    float zmin = INFINITY, zmax = -INFINITY;
+
+    for(int i = 0; i < 8; i++) {
+
+        vec3_t delta;
+        PFM_Vec3_Sub(&slice[i], &center, &delta);
+        radius = MAX(radius, PFM_Vec3_Len(&delta));
+
+        vec4_t world = (vec4_t){slice[i].x, slice[i].y, slice[i].z, 1.0f};
+        vec4_t view;
+        PFM_Mat4x4_Mult4x1((mat4x4_t*)light_view, &world, &view);
+        zmin = MIN(zmin, view.z);
+        zmax = MAX(zmax, view.z);
+    }
+    radius = ceilf(radius);
+
+    vec4_t world_center = (vec4_t){center.x, center.y, center.z, 1.0f};
+    vec4_t view_center;
+    PFM_Mat4x4_Mult4x1((mat4x4_t*)light_view, &world_center, &view_center);
+
+    const float texel = (2.0f * radius) / res;
+    const float cx = floorf(view_center.x / texel) * texel;
+    const float cy = floorf(view_center.y / texel) * texel;
+
+    /* The light looks down the -Z axis. Extend the box towards the light 
+     * to catch the casters which are above the slice. */
+    const float nearp = -(zmax + LIGHT_EXTRA_HEIGHT);
+    const float farp = -zmin;
+
+    /* Y is flipped, matching the winding of the classic shadow map */
+    mat4x4_t light_proj;
+    PFM_Mat4x4_MakeOrthographic(cx - radius, cx + radius, cy + radius, cy - radius, 
+        nearp, farp, &light_proj);
+    PFM_Mat4x4_Mult4x4(&light_proj, (mat4x4_t*)light_view, out);
+}
+
+static void make_cascades(const struct camera *cam, vec3_t light_pos, int ncascades,
+                          const bool update[], struct shadow_cascade *out)
+{
+    vec3_t cam_pos = Camera_GetPos(cam);
+    vec3_t cam_dir = Camera_GetDir(cam);
+
+    struct frustum cam_frust;
+    Camera_MakeFrustum(cam, &cam_frust);
+
+    const vec3_t *near_corners[4] = {&cam_frust.ntl, &cam_frust.ntr, &cam_frust.nbl, &cam_frust.nbr};
+    const vec3_t *far_corners[4]  = {&cam_frust.ftl, &cam_frust.ftr, &cam_frust.fbl, &cam_frust.fbr};
+
+    vec3_t delta;
+    PFM_Vec3_Sub((vec3_t*)near_corners[0], &cam_pos, &delta);
+    const float dnear = PFM_Vec3_Dot(&delta, &cam_dir);
+    PFM_Vec3_Sub((vec3_t*)far_corners[0], &cam_pos, &delta);
+    const float dfar = PFM_Vec3_Dot(&delta, &cam_dir);
+
+    /* Only the region covered by the classic shadow map (the area around the 
+     * point the camera is looking at) is split between the cascades. */
+    float dmax = dfar;
+    if(cam_dir.y < -0.01f) {
+        dmax = MIN(dfar, fabsf(cam_pos.y / cam_dir.y) + CONFIG_SHADOW_FOV);
+    }
+
+    vec3_t light_dir = light_pos;
+    PFM_Vec3_Normal(&light_dir, &light_dir);
+    PFM_Vec3_Scale(&light_dir, -1.0f, &light_dir);
+
+    vec3_t right = (vec3_t){-1.0f, 0.0f, 0.0f}, up;
+    PFM_Vec3_Cross(&light_dir, &right, &up);
+    PFM_Vec3_Normal(&up, &up);
+
+    /* A fixed light view, independent of the camera position, keeps the
+     * texel snapping stable */
+    vec3_t origin = (vec3_t){0.0f, 0.0f, 0.0f};
+    mat4x4_t light_view;
+    PFM_Mat4x4_MakeLookAt(&origin, &light_dir, &up, &light_view);
+
+    float split_begin = 0.0f;
+    for(int i = 0; i < ncascades; i++) {
+
+        const float frac = (float)(i + 1) / ncascades;
+        const float log_split = dnear * powf(dmax / dnear, frac);
+        const float uni_split = dnear + (dmax - dnear) * frac;
+        const float dist = CASCADE_SPLIT_LAMBDA * log_split 
+                         + (1.0f - CASCADE_SPLIT_LAMBDA) * uni_split;
+        const float split_end = (dist - dnear) / (dfar - dnear);
+
+        if(update[i]) {
+
+            vec3_t slice[8];
+            for(int j = 0; j < 4; j++) {
+                vec3_lerp(near_corners[j], far_corners[j], split_begin, &slice[j]);
+                vec3_lerp(near_corners[j], far_corners[j], split_end, &slice[j + 4]);
+            }
+
+            out[i].res = (i < CASCADE_NUM_NEAR) ? CONFIG_SHADOW_MAP_RES 
+                                                 : CONFIG_SHADOW_MAP_RES / 2;
+            cascade_light_space_trans(&light_view, slice, out[i].res, &out[i].light_space);
+        }
+        split_begin = split_end;
+    }
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -119,57 +407,36 @@ void R_GL_InitShadows(void)
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
 
-    glGenTextures(1, &s_depth_map_tex);
-    glBindTexture(GL_TEXTURE_2D, s_depth_map_tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, 
-                 CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES, 
-                 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    /* Don't enable deptph comparisons as we will use a sampler2D and 
-     * manually perform comparison and filtering in the shader.
-     */
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glGenFramebuffers(1, &s_depth_map_FBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, s_depth_map_FBO);
+    reserve_layers(1);
 
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, s_depth_map_tex, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);  
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
 
-void R_GL_DepthPassBegin(const vec3_t *light_pos, const vec3_t *cam_pos, const vec3_t *cam_dir)
+void R_GL_DepthPassBegin(const struct shadow_cascade *cascade, const int *idx, 
+                         const int *ncascades)
 {
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
     GL_PERF_PUSH_GROUP(0, "depth pass");
 
     assert(!s_depth_pass_active);
+    assert(*idx >= 0 && *idx < *ncascades);
+    assert(*ncascades > 0 && *ncascades <= R_SHADOW_MAX_CASCADES);
     s_depth_pass_active = true;
 
+    reserve_layers(*ncascades);
+    s_curr_cascade = *idx;
+    s_curr_res = cascade->res;
+
     glGetIntegerv(GL_VIEWPORT, s_saved.viewport);
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, &s_saved.fb);
 
-    mat4x4_t light_proj;
-    PFM_Mat4x4_MakeOrthographic(-CONFIG_SHADOW_FOV, CONFIG_SHADOW_FOV, 
-        CONFIG_SHADOW_FOV, -CONFIG_SHADOW_FOV, 0.1f, CONFIG_SHADOW_DRAWDIST, &light_proj);
-
-    mat4x4_t light_view;
-    make_light_frustum(*light_pos, *cam_pos, *cam_dir, NULL, &light_view);
-
-    mat4x4_t light_space_trans;
-    PFM_Mat4x4_Mult4x4(&light_proj, &light_view, &light_space_trans);
-    R_GL_SetLightSpaceTrans(&light_space_trans);
+    s_light_space_trans = cascade->light_space;
+    R_GL_SetLightSpaceTrans(&s_light_space_trans);
 
-    glViewport(0, 0, CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES);
-    glBindFramebuffer(GL_FRAMEBUFFER, s_depth_map_FBO);
+    glViewport(0, 0, s_curr_res, s_curr_res);
+    glBindFramebuffer(GL_FRAMEBUFFER, s_depth_map_FBO[s_curr_cascade]);
     glClear(GL_DEPTH_BUFFER_BIT);
     glCullFace(GL_FRONT);
 
@@ -177,6 +444,63 @@ void R_GL_DepthPassBegin(const vec3_t *light_pos, const vec3_t *cam_pos, const v
     GL_PERF_RETURN_VOID();
 }
 
+void R_GL_DepthPassBeginStatic(const uint64_t *static_hash)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    assert(s_depth_pass_active);
+    assert(!s_static_active);
+    s_static_active = true;
+
+    struct static_layer *layer = &s_static[s_curr_cascade];
+    s_static_redraw = !layer->valid
+                   || (layer->hash != *static_hash)
+                   || memcmp(&layer->trans, &s_light_space_trans, sizeof(mat4x4_t));
+
+    if(s_static_redraw) {
+        glBindFramebuffer(GL_FRAMEBUFFER, s_static_FBO[s_curr_cascade]);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        layer->trans = s_light_space_trans;
+        layer->hash = *static_hash;
+    }
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_DepthPassEndStatic(void)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    assert(s_static_active);
+    s_static_active = false;
+    s_static[s_curr_cascade].valid = true;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, s_static_FBO[s_curr_cascade]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, s_depth_map_FBO[s_curr_cascade]);
+    glBlitFramebuffer(0, 0, s_curr_res, s_curr_res, 
+                      0, 0, s_curr_res, s_curr_res, 
+                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, s_depth_map_FBO[s_curr_cascade]);
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+bool R_GL_ShadowsStaticCached(void)
+{
+    return s_static_active && !s_static_redraw;
+}
+
+void R_GL_ShadowsInvalidateStatic(void)
+{
+    for(int i = 0; i < R_SHADOW_MAX_CASCADES; i++) {
+        s_static[i].valid = false;
+    }
+}
+
 void R_GL_DepthPassEnd(void)
 {
     GL_PERF_ENTER();
@@ -199,18 +523,52 @@ void R_GL_DepthPassEnd(void)
     GL_PERF_RETURN_VOID();
 }
 
+void R_GL_ShadowsSetCascades(const struct shadow_cascade *cascades, const int *ncascades)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+    assert(*ncascades > 0 && *ncascades <= s_nlayers);
+
+    mat4x4_t trans[R_SHADOW_MAX_CASCADES];
+    vec4_t scale = (vec4_t){1.0f, 1.0f, 1.0f, 1.0f};
+    float *scales = (float*)&scale;
+
+    for(int i = 0; i < *ncascades; i++) {
+        trans[i] = cascades[i].light_space;
+        scales[i] = ((float)cascades[i].res) / CONFIG_SHADOW_MAP_RES;
+    }
+
+    R_GL_StateSetArray(GL_U_CASCADE_TRANS, UTYPE_MAT4, *ncascades, trans);
+    R_GL_StateSet(GL_U_CASCADE_SCALE, (struct uval){
+        .type = UTYPE_VEC4,
+        .val.as_vec4 = scale
+    });
+    R_GL_StateSet(GL_U_CASCADE_COUNT, (struct uval){
+        .type = UTYPE_INT,
+        .val.as_int = *ncascades
+    });
+
+    GL_PERF_RETURN_VOID();
+}
+
 void R_GL_RenderDepthMap(const void *render_private, mat4x4_t *model)
 {
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
     assert(s_depth_pass_active);
 
+    if(R_GL_ShadowsStaticCached())
+        GL_PERF_RETURN_VOID();
+
+    const struct render_private *priv = render_private;
+    if(!priv->mesh.VAO)
+        GL_PERF_RETURN_VOID();
+
     R_GL_StateSet(GL_U_MODEL, (struct uval){
         .type = UTYPE_MAT4,
         .val.as_mat4 = *model
     });
 
-    const struct render_private *priv = render_private;
     R_GL_Shader_InstallProg(priv->shader_prog_dp);
 
     glBindVertexArray(priv->mesh.VAO);
@@ -250,7 +608,7 @@ void R_GL_SetShadowsEnabled(void *render_private, const bool *on)
 void R_GL_ShadowMapBind(void)
 {
     glActiveTexture(SHADOW_MAP_TUNIT);
-    glBindTexture(GL_TEXTURE_2D, s_depth_map_tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, s_depth_map_tex);
 }
 
 void R_LightVisibilityFrustum(const struct camera *cam, struct frustum *out)
@@ -272,3 +630,47 @@ void R_LightVisibilityFrustum(const struct camera *cam, struct frustum *out)
     Camera_Free(zoomed_out);
 }
 
+void R_LightCascades(const struct camera *cam, vec3_t light_pos, int ncascades,
+                     struct shadow_cascade *out, struct frustum *out_frusta)
+{
+    assert(ncascades > 0 && ncascades <= R_SHADOW_MAX_CASCADES);
+
+    /* The layers get re-allocated when the number of cascades changes. If the 
+     * previous frame had no depth pass, the kept layers are stale. */
+    const bool reset = (ncascades != s_last_ncascades)
+                    || (g_frame_idx != s_last_cascade_frame + 1);
+    s_last_ncascades = ncascades;
+    s_last_cascade_frame = g_frame_idx;
+
+    if(ncascades == 1) {
+
+        out[0] = (struct shadow_cascade){
+            .res = CONFIG_SHADOW_MAP_RES,
+            .update = true
+        };
+        legacy_light_space_trans(light_pos, Camera_GetPos(cam), Camera_GetDir(cam), 
+            &out[0].light_space);
+        frustum_for_transform(&out[0].light_space, &out_frusta[0]);
+        return;
+    }
+
+    /* The far cascades are staggered so that at most one of them 
+     * is redrawn on any given frame */
+    bool update[R_SHADOW_MAX_CASCADES] = {0};
+    for(int i = 0; i < ncascades; i++) {
+        update[i] = reset 
+                 || (i < CASCADE_NUM_NEAR) 
+                 || ((g_frame_idx + i) % 2 == 0);
+    }
+
+    make_cascades(cam, light_pos, ncascades, update, s_last_cascades);
+
+    for(int i = 0; i < ncascades; i++) {
+        if(update[i]) {
+            frustum_for_transform(&s_last_cascades[i].light_space, &s_last_frusta[i]);
+        }
+        s_last_cascades[i].update = update[i];
+        out[i] = s_last_cascades[i];
+        out_frusta[i] = s_last_frusta[i];
+    }
+}
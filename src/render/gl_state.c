@@ -45,6 +45,8 @@
 
 
 #define NINSTALLED_CACHE (32)
+#define FRAME_BLOCK_SIZE (256)
+#define ARR_SIZE(a)      (sizeof(a)/sizeof((a)[0]))
 
 struct buff{
     char raw[16384];
@@ -76,9 +78,24 @@ struct puval{
     };
     size_t ninstalled;
     GLuint installed_progs[NINSTALLED_CACHE];
+    /* Index into 's_frame_members', or -1 */
+    int    block_member;
+};
+
+struct block_member{
+    const char *name;
+    enum utype  type;
+    size_t      offset;
+};
+
+struct uloc{
+    const char *name;
+    GLint       loc;
 };
 
 KHASH_MAP_INIT_STR(puval, struct puval)
+/* Keyed by the program in the upper and the name's hash in the lower bits */
+KHASH_MAP_INIT_INT64(uloc, struct uloc)
 
 MPOOL_TYPE(buff, struct buff)
 MPOOL_IMPL(static inline, buff, struct buff)
@@ -89,6 +106,26 @@ MPOOL_IMPL(static inline, buff, struct buff)
 
 static khash_t(puval) *s_state_table;
 static mp_buff_t       s_buff_pool;
+/* glGetUniformLocation is a round-trip into the driver (and a sync with 
+ * the driver's own thread, when it has one) for every installed uniform. 
+ * The programs are never re-linked, so the locations can be cached. 
+ */
+static khash_t(uloc)  *s_loc_table;
+
+/* Must match the declaration of the 'frame_data' block in the shaders */
+static const struct block_member s_frame_members[] = {
+    {GL_U_VIEW,          UTYPE_MAT4,   0},
+    {GL_U_PROJECTION,    UTYPE_MAT4,  64},
+    {GL_U_LS_TRANS,      UTYPE_MAT4, 128},
+    {GL_U_VIEW_POS,      UTYPE_VEC3, 192},
+    {GL_U_LIGHT_POS,     UTYPE_VEC3, 208},
+    {GL_U_LIGHT_COLOR,   UTYPE_VEC3, 224},
+    {GL_U_AMBIENT_COLOR, UTYPE_VEC3, 240},
+};
+
+static GLuint          s_frame_ubo;
+static unsigned char   s_frame_data[FRAME_BLOCK_SIZE];
+static bool            s_frame_dirty;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -129,9 +166,47 @@ static bool uval_equal(const struct uval *a, const struct uval *b)
     return (0 == memcmp(&a->val, &b->val, uval_size(a->type)));
 }
 
+static uint32_t hash_fnv1a(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    for(; *str; str++) {
+        hash ^= (uint8_t)*str;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static GLuint uniform_location(GLuint shader_prog, const char *uname)
+{
+    uint64_t key = (((uint64_t)shader_prog) << 32) | hash_fnv1a(uname);
+    khiter_t k = kh_get(uloc, s_loc_table, key);
+
+    if(k != kh_end(s_loc_table)) {
+        const struct uloc *entry = &kh_value(s_loc_table, k);
+        if(0 == strcmp(entry->name, uname))
+            return entry->loc;
+        /* Hash collision - don't cache the second name */
+        return glGetUniformLocation(shader_prog, uname);
+    }
+
+    GLint loc = glGetUniformLocation(shader_prog, uname);
+    const char *name = pf_strdup(uname);
+    if(!name)
+        return loc;
+
+    int status;
+    k = kh_put(uloc, s_loc_table, key, &status);
+    if(status == -1) {
+        free((void*)name);
+        return loc;
+    }
+    kh_value(s_loc_table, k) = (struct uloc){name, loc};
+    return loc;
+}
+
 static void uval_install(GLuint shader_prog, const char *uname, const struct uval *uv)
 {
-    GLuint loc = glGetUniformLocation(shader_prog, uname);
+    GLuint loc = uniform_location(shader_prog, uname);
     if(loc == ((GLuint)-1))
         return;
 
@@ -173,7 +248,7 @@ static void uval_install(GLuint shader_prog, const char *uname, const struct uva
 
 static void uval_array_install(GLuint shader_prog, const char *uname, const struct arrval *av)
 {
-    GLuint loc = glGetUniformLocation(shader_prog, uname);
+    GLuint loc = uniform_location(shader_prog, uname);
     void *data = mp_buff_entry(&s_buff_pool, av->data)->raw;
 
     if(loc == ((GLuint)-1))
@@ -227,10 +302,12 @@ static void uval_composite_install(GLuint shader_prog, const char *uname, const
 
             char uname_full[256];
             pf_snprintf(uname_full, sizeof(uname_full), "%s[%d].%s", uname, i, curr->name);
-            GLuint loc = glGetUniformLocation(shader_prog, uname_full);
+            GLuint loc = uniform_location(shader_prog, uname_full);
 
-            if(loc == ((GLuint)-1))
+            if(loc == ((GLuint)-1)) {
+                curr++;
                 continue;
+            }
 
             switch(curr->type) {
             case UTYPE_FLOAT:
@@ -286,6 +363,24 @@ static uint32_t hash_adler32(const void *data, size_t len)
      return (s2 << 16) | s1;
 }
 
+static int block_member_idx(const char *uname)
+{
+    for(int i = 0; i < ARR_SIZE(s_frame_members); i++) {
+        if(!strcmp(s_frame_members[i].name, uname))
+            return i;
+    }
+    return -1;
+}
+
+static void block_member_set(int idx, const struct uval *uv)
+{
+    const struct block_member *member = &s_frame_members[idx];
+    assert(uv->type == member->type);
+
+    memcpy(s_frame_data + member->offset, &uv->val, uval_size(member->type));
+    s_frame_dirty = true;
+}
+
 static bool uval_installed(const struct puval *p, GLuint prog)
 {
     for(int i = 0; i < p->ninstalled; i++) {
@@ -311,12 +406,24 @@ bool R_GL_StateInit(void)
     s_state_table = kh_init(puval);
     if(!s_state_table)
         goto fail_table;
+    s_loc_table = kh_init(uloc);
+    if(!s_loc_table)
+        goto fail_loc_table;
     mp_buff_init(&s_buff_pool, true);
     if(!mp_buff_reserve(&s_buff_pool, 512))
         goto fail_pool;
+
+    glGenBuffers(1, &s_frame_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, s_frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, FRAME_BLOCK_SIZE, s_frame_data, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UBLOCK_FRAME, s_frame_ubo);
+    GL_ASSERT_OK();
     return true;
 
 fail_pool:
+    kh_destroy(uloc, s_loc_table);
+fail_loc_table:
     kh_destroy(puval, s_state_table);
 fail_table:
     return false;
@@ -332,32 +439,50 @@ void R_GL_StateShutdown(void)
         free((void*)key);
     });
     kh_destroy(puval, s_state_table);
+
+    uint64_t lkey;
+    struct uloc lcurr;
+    (void)lkey;
+
+    kh_foreach(s_loc_table, lkey, lcurr, {
+        free((void*)lcurr.name);
+    });
+    kh_destroy(uloc, s_loc_table);
     mp_buff_destroy(&s_buff_pool);
+    glDeleteBuffers(1, &s_frame_ubo);
 }
 
 void R_GL_StateSet(const char *uname, struct uval val)
 {
     struct puval *p = NULL;
     khiter_t k = kh_get(puval, s_state_table, uname);
+    int member;
 
     if(k != kh_end(s_state_table)) {
     
         p = &kh_value(s_state_table, k);
         if(uval_equal(&p->v, &val))
             return;
+        member = p->block_member;
     }else{
     
         int status;
         k = kh_put(puval, s_state_table, pf_strdup(uname), &status);
         assert(status != -1 && status != 0);
         p = &kh_value(s_state_table, k);
+        member = block_member_idx(uname);
     }
 
     assert(p);
     *p = (struct puval){
         .v = val,
         .ninstalled = 0,
+        .block_member = member,
     };
+
+    if(member >= 0) {
+        block_member_set(member, &val);
+    }
 }
 
 bool R_GL_StateGet(const char *uname, struct uval *out)
@@ -384,6 +509,11 @@ void R_GL_StateInstall(const char *uname, GLuint shader_prog)
 
     struct puval *p = &kh_value(s_state_table, k);
 
+    if(p->block_member >= 0) {
+        R_GL_StateCommitBlocks();
+        return;
+    }
+
     if(p->v.type == UTYPE_ARRAY) {
         uval_array_install(shader_prog, uname, &p->av);
     }else if(p->v.type == UTYPE_COMPOSITE) {
@@ -429,7 +559,8 @@ void R_GL_StateSetArray(const char *uname, enum utype itemtype, size_t size, voi
             .nitems = size,
             .data = data_ref
         },
-        .ninstalled = true
+        .ninstalled = true,
+        .block_member = -1,
     };
 }
 
@@ -479,7 +610,21 @@ void R_GL_StateSetComposite(const char *uname, const struct mdesc *descs,
             .descs = desc_ref,
             .data = data_ref
         },
-        .ninstalled = 0
+        .ninstalled = 0,
+        .block_member = -1,
     };
 }
 
+void R_GL_StateCommitBlocks(void)
+{
+    if(!s_frame_dirty)
+        return;
+
+    /* Respecifying the whole store lets the driver hand us fresh memory 
+     * instead of waiting on the draws still reading the previous values */
+    glBindBuffer(GL_UNIFORM_BUFFER, s_frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, FRAME_BLOCK_SIZE, s_frame_data, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    s_frame_dirty = false;
+}
+
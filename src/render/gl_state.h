@@ -44,8 +44,8 @@
 #define GL_U_VIEW_POS           "view_pos"
 #define GL_U_MODEL              "model"
 #define GL_U_MATERIALS          "materials"
-#define GL_U_INV_BIND_MATS      "anim_inv_bind_mats"
-#define GL_U_CURR_POSE_MATS     "anim_curr_pose_mats"
+#define GL_U_POSE_BUFF          "posebuff"
+#define GL_U_POSE_BASE          "pose_base"
 #define GL_U_NORMAL_MAT         "anim_normal_mat"
 #define GL_U_TEXTURE0           "texture0"
 #define GL_U_TEXTURE1           "texture1"
@@ -67,14 +67,18 @@
 #define GL_U_TEX_ARRAY1         "tex_array1"
 #define GL_U_TEX_ARRAY2         "tex_array2"
 #define GL_U_TEX_ARRAY3         "tex_array3"
+#define GL_U_TEX_HANDLES        "tex_handles"
 #define GL_U_AMBIENT_COLOR      "ambient_color"
 #define GL_U_LIGHT_POS          "light_pos"
 #define GL_U_LIGHT_COLOR        "light_color"
 #define GL_U_LS_TRANS           "light_space_transform"
 #define GL_U_SHADOW_MAP         "shadow_map"
-#define GL_U_ENT_TOP_OFFSETS_SS "ent_top_offsets_ss"
-#define GL_U_ENT_HEALTH_PC      "ent_health_pc"
+#define GL_U_CASCADE_TRANS      "shadow_cascade_trans"
+#define GL_U_CASCADE_SCALE      "shadow_cascade_scale"
+#define GL_U_CASCADE_COUNT      "shadow_cascade_count"
+#define GL_U_CAM_VIEW_PROJ      "cam_view_proj"
 #define GL_U_CURR_RES           "curr_res"
+#define GL_U_IMPOSTOR_ATLAS     "impostor_atlas"
 #define GL_U_COLOR              "color"
 #define GL_U_CLIP_PLANE0        "clip_plane0"
 #define GL_U_MOVE_FACTOR        "water_move_factor"
@@ -86,11 +90,27 @@
 #define GL_U_CAM_NEAR           "cam_near"
 #define GL_U_CAM_FAR            "cam_far"
 #define GL_U_WATER_TILING       "water_tiling"
+#define GL_U_REFLECT_VIEW_PROJ  "reflect_view_proj"
 #define GL_U_MAP_RES            "map_resolution"
 #define GL_U_MAP_POS            "map_pos"
 #define GL_U_ATTR_STRIDE        "attr_stride"
 #define GL_U_ATTR_OFFSET        "attr_offset"
 
+/* std140 uniform blocks and the binding points they're bound to. The 
+ * per-frame block holds the projection, view, light_space_transform, 
+ * view_pos, light_pos, light_color and ambient_color uniforms, which are
+ * still set by name with R_GL_StateSet. */
+#define GL_U_FRAME_BLOCK        "frame_data"
+#define GL_U_MATERIAL_BLOCK     "material_data"
+
+enum ublock{
+    UBLOCK_FRAME     = 0,
+    UBLOCK_MATERIALS = 1,
+};
+
+/* std140 layout of one entry of the material block */
+#define GL_MATERIAL_STRIDE      (48)
+
 enum utype{
     UTYPE_FLOAT,
     UTYPE_VEC2,
@@ -140,6 +160,8 @@ void R_GL_StateSetComposite(const char *uname, const struct mdesc *descs,
 
 /* The shader program must have been used before installing the uniforms */
 void R_GL_StateInstall(const char *uname, GLuint shader_prog);
+/* Upload the uniform blocks that changed since the last draw */
+void R_GL_StateCommitBlocks(void);
 
 #endif
 
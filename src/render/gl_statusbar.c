@@ -50,44 +50,30 @@
 
 
 #define ARR_SIZE(a) (sizeof(a)/sizeof((a)[0]))
-#define MIN(a, b)   ((a) < (b) ? (a) : (b))
-#define MAX_HBS     (256)
+
+/* The per-instance attributes are stored in one buffer each. They are 
+ * re-specified every frame, orphaning the old storage. */
+struct hb_render_ctx{
+    bool   init;
+    GLuint VAO;
+    GLuint quad_VBO;
+    GLuint health_VBO;
+    GLuint pos_VBO;
+    GLuint yoff_VBO;
+};
 
 /*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
+/* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-void R_GL_DrawHealthbars(const size_t *num_ents, GLfloat *ent_health_pc, 
-                         vec3_t *ent_top_pos_ws, int *yoffsets, const struct camera *cam)
-{
-    GL_PERF_ENTER();
-    ASSERT_IN_RENDER_THREAD();
-
-    int width, height;
-    Engine_WinDrawableSize(&width, &height);
-
-    /* Convert the worldspace positions to SDL screenspace positions */
-    STALLOC(vec2_t, ent_top_pos_ss, *num_ents); /* Screen-space XY positions of the entity tops. */
-
-    mat4x4_t view, proj;
-    Camera_MakeViewMat(cam, &view); 
-    Camera_MakeProjMat(cam, &proj);
+static struct hb_render_ctx s_hb_ctx;
 
-    for(int i = 0; i < *num_ents; i++) {
-    
-        vec4_t ent_top_homo = (vec4_t){ent_top_pos_ws[i].x, ent_top_pos_ws[i].y, ent_top_pos_ws[i].z, 1.0f};
-
-        vec4_t clip, tmp;
-        PFM_Mat4x4_Mult4x1(&view, &ent_top_homo, &tmp);
-        PFM_Mat4x4_Mult4x1(&proj, &tmp, &clip);
-        vec3_t ndc = (vec3_t){clip.x / clip.w, clip.y / clip.w, clip.z / clip.w};
-
-        float screen_x = (ndc.x + 1.0f) * width/2.0f;
-        float screen_y = height - ((ndc.y + 1.0f) * height/2.0f);
-
-        ent_top_pos_ss[i] = (vec2_t){screen_x, screen_y + yoffsets[i]};
-    }
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
 
+static void hb_ctx_init(struct hb_render_ctx *ctx)
+{
     /* Create a buffer of mesh vertices for a healthbar centered at (0, 0).
      * Set uv attribute for each vertex - used in fragment shader to determine relative 
      * texel position within the quad. 
@@ -116,14 +102,11 @@ void R_GL_DrawHealthbars(const size_t *num_ents, GLfloat *ent_health_pc,
         corners[2], corners[3], corners[0],
     };
 
-    /* OpenGL setup */
-    GLuint VAO, VBO;
-
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    glGenVertexArrays(1, &ctx->VAO);
+    glBindVertexArray(ctx->VAO);
 
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glGenBuffers(1, &ctx->quad_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->quad_VBO);
     glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(vbuff) * sizeof(struct textured_vert), vbuff, GL_STATIC_DRAW);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct textured_vert), (void*)0);
@@ -133,6 +116,63 @@ void R_GL_DrawHealthbars(const size_t *num_ents, GLfloat *ent_health_pc,
         (void*)offsetof(struct textured_vert, uv));
     glEnableVertexAttribArray(1);
 
+    /* Attribute 2 - health percentage */
+    glGenBuffers(1, &ctx->health_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->health_VBO);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), (void*)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    /* Attribute 3 - worldspace position of the entity's top */
+    glGenBuffers(1, &ctx->pos_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->pos_VBO);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    /* Attribute 4 - screenspace Y offset */
+    glGenBuffers(1, &ctx->yoff_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->yoff_VBO);
+    glVertexAttribIPointer(4, 1, GL_INT, sizeof(int), (void*)0);
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    ctx->init = true;
+}
+
+static void hb_upload(GLuint VBO, size_t size, const void *data)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_DrawHealthbars(const size_t *num_ents, GLfloat *ent_health_pc, 
+                         vec3_t *ent_top_pos_ws, int *yoffsets, const struct camera *cam)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    if(*num_ents == 0)
+        GL_PERF_RETURN_VOID();
+
+    if(!s_hb_ctx.init) {
+        hb_ctx_init(&s_hb_ctx);
+    }
+
+    /* The worldspace positions are projected to screenspace in the 
+     * vertex shader. */
+    hb_upload(s_hb_ctx.health_VBO, *num_ents * sizeof(GLfloat), ent_health_pc);
+    hb_upload(s_hb_ctx.pos_VBO, *num_ents * sizeof(vec3_t), ent_top_pos_ws);
+    hb_upload(s_hb_ctx.yoff_VBO, *num_ents * sizeof(int), yoffsets);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
     /* set uniforms */
     int w, h;
     Engine_WinDrawableSize(&w, &h);
@@ -143,20 +183,23 @@ void R_GL_DrawHealthbars(const size_t *num_ents, GLfloat *ent_health_pc,
         .val.as_ivec2[1] = h
     });
 
-    size_t ndraw = MIN(*num_ents, MAX_HBS);
-    R_GL_StateSetArray(GL_U_ENT_TOP_OFFSETS_SS, UTYPE_VEC2, ndraw, ent_top_pos_ss);
-    R_GL_StateSetArray(GL_U_ENT_HEALTH_PC, UTYPE_FLOAT, ndraw, ent_health_pc);
+    mat4x4_t view, proj, view_proj;
+    Camera_MakeViewMat(cam, &view); 
+    Camera_MakeProjMat(cam, &proj);
+    PFM_Mat4x4_Mult4x4(&proj, &view, &view_proj);
+
+    R_GL_StateSet(GL_U_CAM_VIEW_PROJ, (struct uval){
+        .type = UTYPE_MAT4,
+        .val.as_mat4 = view_proj
+    });
 
     R_GL_Shader_Install("statusbar");
 
     /* Draw instances */
-    glDrawArraysInstanced(GL_TRIANGLES, 0, ARR_SIZE(vbuff), *num_ents);
-
-    /* cleanup */
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    glBindVertexArray(s_hb_ctx.VAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, *num_ents);
+    glBindVertexArray(0);
 
-    STFREE(ent_top_pos_ss);
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
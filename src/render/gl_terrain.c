@@ -43,9 +43,11 @@
 #include "render_private.h"
 #include "../main.h"
 #include "../map/public/tile.h"
+#include "../lib/public/pf_string.h"
 
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 
 #define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
 
@@ -55,24 +57,84 @@
 
 static struct texture_arr     s_map_textures;
 static bool                   s_map_ctx_active = false;
+/* The dirty chunks of the fog buffer are streamed through the ring 
+ * and then copied into place on the GPU. */
 static struct gl_ring        *s_fog_ring;
 static struct map_resolution  s_res;
+/* The fog state of every tile, in the same order as the tile descriptors 
+ * are indexed in the shaders. This buffer is only written to by the GPU,
+ * so the copies into it are implicitly synchronized with the draws 
+ * reading it. */
+static GLuint                 s_fog_VBO;
+static GLuint                 s_fog_tex_buff;
+/* A buffer with every tile set to 'visible', for rendering without fog */
+static GLuint                 s_clear_VBO;
+static GLuint                 s_clear_tex_buff;
+static bool                   s_fog_cleared = false;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void fog_buff_init(GLuint *out_vbo, GLuint *out_tex, const void *data, size_t size, GLenum usage)
+{
+    glGenBuffers(1, out_vbo);
+    glBindBuffer(GL_TEXTURE_BUFFER, *out_vbo);
+    glBufferData(GL_TEXTURE_BUFFER, size, data, usage);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, out_tex);
+    glBindTexture(GL_TEXTURE_BUFFER, *out_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, *out_vbo);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+/* Copy a range of the last ringbuffer section, which may wrap around 
+ * the end of the ringbuffer, into the fog buffer. */
+static void fog_copy(size_t ring_size, size_t src_offset, size_t dst_offset, size_t size)
+{
+    src_offset %= ring_size;
+    size_t left = ring_size - src_offset;
+
+    if(size <= left) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+            src_offset, dst_offset, size);
+    }else{
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+            src_offset, dst_offset, left);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+            0, dst_offset + left, size - left);
+    }
+}
 
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-void R_GL_MapInit(const char map_texfiles[][256], const size_t *num_textures, 
+void R_GL_MapInit(struct texture_load *const *loads, const size_t *num_textures, 
                   const struct map_resolution *res)
 {
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
 
+    R_GL_ShadowsInvalidateStatic();
+
     size_t nchunks = res->chunk_w * res->chunk_h;
-    s_fog_ring = R_GL_RingbufferInit(nchunks * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT * 3, RING_UBYTE);
+    size_t size = nchunks * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT;
+    s_fog_ring = R_GL_RingbufferInit(size * 3, RING_UBYTE);
     assert(s_fog_ring);
 
-    R_GL_Texture_ArrayMakeMap(map_texfiles, *num_textures, &s_map_textures, GL_TEXTURE0);
+    void *buff = malloc(size);
+    assert(buff);
+
+    memset(buff, 0x0, size);
+    fog_buff_init(&s_fog_VBO, &s_fog_tex_buff, buff, size, GL_DYNAMIC_COPY);
+    memset(buff, 0x2, size);
+    fog_buff_init(&s_clear_VBO, &s_clear_tex_buff, buff, size, GL_STATIC_DRAW);
+    free(buff);
+    s_fog_cleared = false;
+
+    R_GL_Texture_ArrayMakeMap(loads, *num_textures, &s_map_textures, GL_TEXTURE0);
 
     R_GL_StateSet(GL_U_MAP_RES, (struct uval){
         .type = UTYPE_IVEC4,
@@ -87,10 +149,41 @@ void R_GL_MapInit(const char map_texfiles[][256], const size_t *num_textures,
     GL_PERF_RETURN_VOID();
 }
 
-void R_GL_MapUpdateFog(void *buff, const size_t *size)
+void R_GL_MapUpdateFog(void *buff, const int *chunks, const size_t *nchunks)
 {
     GL_PERF_ENTER();
-    R_GL_RingbufferPush(s_fog_ring, buff, *size);
+
+    const size_t tiles_per_chunk = s_res.tile_w * s_res.tile_h;
+    const size_t size = *nchunks * tiles_per_chunk;
+
+    if(!R_GL_RingbufferPush(s_fog_ring, buff, size))
+        GL_PERF_RETURN_VOID();
+
+    size_t begin, end;
+    R_GL_RingbufferGetLastRange(s_fog_ring, &begin, &end);
+    /* When the section wraps around, its end gives the size of the ring */
+    const size_t ring_size = (end > begin) ? (begin + size) : (begin + size - end);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, R_GL_RingbufferGetVBO(s_fog_ring));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, s_fog_VBO);
+
+    /* Adjacent chunks of the same chunk row are contiguous in the 
+     * fog buffer, so they are copied together. */
+    for(int i = 0; i < *nchunks;) {
+
+        int j = i;
+        while(j + 1 < *nchunks && chunks[j + 1] == chunks[j] + 1)
+            j++;
+
+        fog_copy(ring_size, begin + i * tiles_per_chunk, chunks[i] * tiles_per_chunk, 
+            (j - i + 1) * tiles_per_chunk);
+        i = j + 1;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    R_GL_RingbufferSyncLast(s_fog_ring);
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
@@ -99,17 +192,18 @@ void R_GL_MapShutdown(void)
 {
     R_GL_Texture_ArrayFree(s_map_textures);
     R_GL_RingbufferDestroy(s_fog_ring);
+
+    glDeleteBuffers(1, &s_fog_VBO);
+    glDeleteTextures(1, &s_fog_tex_buff);
+    glDeleteBuffers(1, &s_clear_VBO);
+    glDeleteTextures(1, &s_clear_tex_buff);
 }
 
-/* Push a fully 'visible' field into the ringbuffer. Must be followed
- * with a matching R_GL_MapInvalidate to consume the fence. */
+/* Make the fog appear fully 'visible' for the subsequent draws. Must be 
+ * followed with a matching R_GL_MapInvalidate to restore the fog state. */
 void R_GL_MapUpdateFogClear(void)
 {
-    size_t size = s_res.chunk_w * s_res.chunk_h * s_res.tile_w * s_res.tile_h;
-    void *buff = malloc(size);
-    memset(buff, 0x2, size);
-    R_GL_RingbufferPush(s_fog_ring, buff, size);
-    free(buff);
+    s_fog_cleared = true;
 }
 
 void R_GL_MapBegin(const bool *shadows, const vec2_t *pos)
@@ -129,7 +223,7 @@ void R_GL_MapBegin(const bool *shadows, const vec2_t *pos)
     R_GL_Shader_InstallProg(shader_prog);
 
     R_GL_Texture_BindArray(&s_map_textures, shader_prog);
-    R_GL_RingbufferBindLast(s_fog_ring, GL_TEXTURE1, shader_prog, "visbuff");
+    R_GL_MapFogBindLast(GL_TEXTURE1, shader_prog, "visbuff");
 
     R_GL_StateSet(GL_U_MAP_POS, (struct uval){
         .type = UTYPE_VEC2,
@@ -155,12 +249,29 @@ void R_GL_MapEnd(void)
 void R_GL_MapInvalidate(void)
 {
     GL_PERF_ENTER();
-    R_GL_RingbufferSyncLast(s_fog_ring);
+    s_fog_cleared = false;
     GL_PERF_RETURN_VOID();
 }
 
 void R_GL_MapFogBindLast(GLuint tunit, GLuint shader_prog, const char *uname)
 {
-    R_GL_RingbufferBindLast(s_fog_ring, tunit, shader_prog, uname);
+    char uname_offset[128];
+    pf_snprintf(uname_offset, sizeof(uname_offset), "%s_offset", uname);
+
+    glActiveTexture(tunit);
+    glBindTexture(GL_TEXTURE_BUFFER, s_fog_cleared ? s_clear_tex_buff : s_fog_tex_buff);
+    R_GL_Shader_InstallProg(shader_prog);
+
+    R_GL_StateSet(uname, (struct uval){
+        .type = UTYPE_INT,
+        .val.as_int = tunit - GL_TEXTURE0
+    });
+    R_GL_StateInstall(uname, shader_prog);
+
+    R_GL_StateSet(uname_offset, (struct uval){
+        .type = UTYPE_INT,
+        .val.as_int = 0
+    });
+    R_GL_StateInstall(uname_offset, shader_prog);
 }
 
@@ -37,12 +37,21 @@
 #include "gl_state.h"
 #include "gl_assert.h"
 #include "gl_material.h"
+#include "gl_ktx.h"
+#include "public/render_ctrl.h"
 #include "../lib/public/stb_image.h"
 #include "../lib/public/stb_image_resize.h"
 #include "../lib/public/khash.h"
+#include "../lib/public/lru_cache.h"
 #include "../lib/public/pf_string.h"
+#include "../lib/public/mem.h"
+#include "../lib/public/vec.h"
 #include "../config.h"
 #include "../main.h"
+#include "../perf.h"
+#include "../sched.h"
+
+#include <SDL.h>
 
 #include <string.h>
 #include <assert.h>
@@ -55,39 +64,160 @@
 #define MAX(a, b)       ((a) > (b) ? (a) : (b))
 #define MAX3(a, b, c)   (MAX((a), MAX((b), (c))))
 #define ARR_SIZE(a)     (sizeof(a)/sizeof((a)[0]))
-
-KHASH_MAP_INIT_STR(tex, GLuint)
+#define TEX_LRU_CAPACITY (4096)
+
+struct tex_mem{
+    enum perf_mem_tag tag;
+    size_t            bytes;
+};
+
+/* A texture loaded by name. Textures which are not referenced are kept in 
+ * the LRU cache and stay resident until the VRAM budget is exceeded. The 
+ * textures registered with 'R_GL_Texture_AddExisting' are owned by their
+ * creator, so they're never evicted and get removed as soon as they are 
+ * freed. */
+struct tex_entry{
+    GLuint id;
+    int    refcount;
+    bool   external;
+};
+
+/* The name is the key of the texture's entry in 's_name_tex_table' */
+struct tex_lru_entry{
+    const char *qualname;
+};
+
+/* A request from the render thread for the main thread to decode a texture 
+ * which was evicted */
+struct tex_reload{
+    char basedir[256];
+    char name[256];
+};
+
+KHASH_MAP_INIT_STR(tex, struct tex_entry)
+KHASH_MAP_INIT_STR(evicted, bool)
+KHASH_SET_INIT_STR(path)
+KHASH_MAP_INIT_INT(mem, struct tex_mem)
+KHASH_MAP_INIT_INT(handle, int)
+
+VEC_TYPE(handle, GLuint64)
+VEC_IMPL(static inline, handle, GLuint64)
+VEC_TYPE(slot, int)
+VEC_IMPL(static inline, slot, int)
+VEC_TYPE(reload, struct tex_reload)
+VEC_IMPL(static inline, reload, struct tex_reload)
+
+/* Keyed by texture ID */
+LRU_CACHE_TYPE(texlru, struct tex_lru_entry)
+LRU_CACHE_PROTOTYPES(static, texlru, struct tex_lru_entry)
+LRU_CACHE_IMPL(static, texlru, struct tex_lru_entry)
+
+/* Images are not decoded by the render thread as their loads come in. 
+ * Instead, the main thread queues a 'texture_load' along with the command 
+ * that consumes it and decodes everything that got queued during the frame
+ * in parallel, right before the frame's commands are handed over. The render 
+ * thread is then left with only creating the GL objects.
+ */
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
+/* Main thread */
+static struct texture_load *s_pending_head;
+static struct texture_load *s_pending_tail;
+static size_t               s_npending;
+static uint64_t             s_ndecoded;
+static uint64_t             s_decode_bytes;
+static uint64_t             s_decode_ticks;
+static uint64_t             s_decode_cpu_ticks;
+
+/* Render thread */
 static khash_t(tex) *s_name_tex_table;
+/* The estimated sizes of the textures created here, for memory accounting */
+static khash_t(mem) *s_tex_mem_table;
 static GLuint        s_null_tex;
+static SDL_atomic_t  s_upload_us;
+
+/* The unreferenced textures, and the names of the ones which were evicted 
+ * (with a flag for whether a reload was requested already) */
+static lru(texlru)       s_tex_lru;
+static khash_t(evicted) *s_evicted_table;
+static size_t            s_resident_bytes;
+static size_t            s_budget_bytes = CONFIG_TEXTURE_BUDGET_MB * (size_t)1024 * 1024;
+
+/* Shared - the reloads are queued by the render thread and consumed by 
+ * the main thread in 'R_TextureLoadFlush' */
+static SDL_mutex        *s_reload_lock;
+static vec_reload_t      s_reload_queue;
+
+/* Resident bindless handles of texture arrays, indexed by the slot the 
+ * shaders fetch them from. The table is mirrored into a buffer texture 
+ * which is re-uploaded whenever it changes. */
+static khash_t(handle) *s_handle_slot_table;
+static vec_handle_t     s_handles;
+static vec_slot_t       s_free_slots;
+static bool             s_handles_dirty;
+static GLuint           s_handle_buff;
+static GLuint           s_handle_tex;
+static size_t           s_handle_capacity;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool texture_gl_init(const char *path, GLuint *out)
+/* Add the ~1/3 overhead of a full mip chain */
+static size_t texture_mip_bytes(size_t base_bytes)
+{
+    return base_bytes + base_bytes / 3;
+}
+
+static void texture_track(GLuint id, enum perf_mem_tag tag, size_t bytes)
 {
     ASSERT_IN_RENDER_THREAD();
 
-    GLuint ret;
-    int width, height, nr_channels;
-    unsigned char *data;
-    
-    data = stbi_load(path, &width, &height, &nr_channels, 0);
-    if(!data)
-        goto fail_load;
+    if(!s_tex_mem_table)
+        return;
+
+    int status;
+    khiter_t k = kh_put(mem, s_tex_mem_table, id, &status);
+    if(status == -1)
+        return;
+    if(status == 0)
+        Perf_MemFree(kh_val(s_tex_mem_table, k).tag, kh_val(s_tex_mem_table, k).bytes);
+
+    kh_val(s_tex_mem_table, k) = (struct tex_mem){tag, bytes};
+    Perf_MemAlloc(tag, bytes);
+}
+
+static void texture_untrack(GLuint id)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    if(!s_tex_mem_table)
+        return;
+
+    khiter_t k = kh_get(mem, s_tex_mem_table, id);
+    if(k == kh_end(s_tex_mem_table))
+        return;
 
+    Perf_MemFree(kh_val(s_tex_mem_table, k).tag, kh_val(s_tex_mem_table, k).bytes);
+    kh_del(mem, s_tex_mem_table, k);
+}
+
+static bool texture_gl_upload(const unsigned char *data, int width, int height, 
+                              int nr_channels, GLuint *out)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    if(nr_channels != 3 && nr_channels != 4)
+        return false;
+
+    GLuint ret;
     glActiveTexture(GL_TEXTURE0);
     glGenTextures(1, &ret);
     glBindTexture(GL_TEXTURE_2D, ret);
 
-    if(nr_channels != 3 && nr_channels != 4)
-        goto fail_format;
-
     GLint format = (nr_channels == 3) ? GL_RGB : GL_RGBA;
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
@@ -98,16 +228,193 @@ static bool texture_gl_init(const char *path, GLuint *out)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, LOD_BIAS);
 
-    stbi_image_free(data);
+    texture_track(ret, PERF_MEM_GPU_TEXTURES, 
+        texture_mip_bytes((size_t)width * height * nr_channels));
+
     *out = ret;
     glBindTexture(GL_TEXTURE_2D, 0);
     return true;
+}
 
-fail_format:
-    stbi_image_free(data);
-fail_load:
+static bool texture_gl_upload_ktx(const struct ktx_image *img, GLuint *out)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    GLuint ret;
+    glActiveTexture(GL_TEXTURE0);
+    glGenTextures(1, &ret);
+    glBindTexture(GL_TEXTURE_2D, ret);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    size_t bytes = 0;
+    for(int i = 0; i < img->nlevels; i++) {
+
+        bytes += img->levels[i].size;
+        if(img->format) {
+            glTexImage2D(GL_TEXTURE_2D, i, img->internal_format, img->levels[i].width, 
+                img->levels[i].height, 0, img->format, GL_UNSIGNED_BYTE, img->levels[i].data);
+        }else{
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, img->internal_format, img->levels[i].width, 
+                img->levels[i].height, 0, img->levels[i].size, img->levels[i].data);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if(img->gen_mips) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+        bytes = texture_mip_bytes(bytes);
+    }else{
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, img->nlevels - 1);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, LOD_BIAS);
+
+    texture_track(ret, PERF_MEM_GPU_TEXTURES, bytes);
+
+    *out = ret;
     glBindTexture(GL_TEXTURE_2D, 0);
-    return false;
+    return true;
+}
+
+/* A pre-compressed 'name.ktx2' next to 'name.png' takes precedence over it */
+static bool texture_ktx_path(const char *path, char *out, size_t size)
+{
+    if(!path[0])
+        return false;
+
+    pf_strlcpy(out, path, size);
+    char *ext = strrchr(out, '.');
+    char *sep = strrchr(out, '/');
+
+    if(ext && (!sep || ext > sep)) {
+        *ext = '\0';
+    }
+    if(strlen(out) + sizeof(".ktx2") > size)
+        return false;
+    pf_strlcat(out, ".ktx2", size);
+    return true;
+}
+
+static bool texture_load_ktx(const char *path, struct ktx_image *out)
+{
+    char ktx_path[512];
+    if(!texture_ktx_path(path, ktx_path, sizeof(ktx_path)))
+        return false;
+    return R_KTX_Load(ktx_path, out);
+}
+
+static bool texture_gl_init(const char *path, GLuint *out)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    struct ktx_image img;
+    if(texture_load_ktx(path, &img)) {
+        bool ret = texture_gl_upload_ktx(&img, out);
+        R_KTX_Free(&img);
+        return ret;
+    }
+
+    int width, height, nr_channels;
+    unsigned char *data = stbi_load(path, &width, &height, &nr_channels, 0);
+    if(!data)
+        return false;
+
+    bool ret = texture_gl_upload(data, width, height, nr_channels, out);
+    stbi_image_free(data);
+    return ret;
+}
+
+static unsigned char *texture_load_prefetched(struct texture_load *load, int req_comp)
+{
+    while(!Sched_FutureIsReady(&load->read)) {
+        Sched_TryYield();
+    }
+    unsigned char *buff = load->read.res.val.as_ptr;
+    if(!buff)
+        return NULL;
+
+    unsigned char *ret = stbi_load_from_memory(buff, (int)load->read_size, 
+        &load->width, &load->height, &load->nr_channels, req_comp);
+    free(buff);
+    return ret;
+}
+
+static unsigned char *texture_load_image(struct texture_load *load, const char *path)
+{
+    /* The images packed into the map's texture array all have to be in 
+     * the same format, so those are always decoded to RGB. */
+    if(!load->resize && texture_load_ktx(path, &load->ktx)) {
+        load->width = load->ktx.width;
+        load->height = load->ktx.height;
+        return NULL;
+    }
+
+    int req_comp = load->resize ? 3 : 0;
+    if(load->prefetched && path == load->path)
+        return texture_load_prefetched(load, req_comp);
+    return stbi_load(path, &load->width, &load->height, &load->nr_channels, req_comp);
+}
+
+static void texture_load_decode(struct texture_load *load)
+{
+    uint64_t begin = SDL_GetPerformanceCounter();
+
+    unsigned char *data = texture_load_image(load, load->path);
+    if(!data && !load->ktx.buff && load->fallback_path[0]) {
+        data = texture_load_image(load, load->fallback_path);
+    }
+
+    if(data && load->resize) {
+
+        unsigned char *resized = malloc(load->resize * load->resize * 3);
+        if(resized && !stbir_resize_uint8(data, load->width, load->height, 0, 
+                                          resized, load->resize, load->resize, 0, 3)) {
+            free(resized);
+            resized = NULL;
+        }
+        stbi_image_free(data);
+
+        data = resized;
+        load->width = load->resize;
+        load->height = load->resize;
+        load->nr_channels = 3;
+    }
+
+    load->data = data;
+    load->decode_ticks = SDL_GetPerformanceCounter() - begin;
+}
+
+static void texture_load_free(struct texture_load *load)
+{
+    if(load->ktx.buff) {
+        R_KTX_Free(&load->ktx);
+    }
+    if(!load->data)
+        return;
+    if(load->resize) {
+        free(load->data);
+    }else{
+        stbi_image_free(load->data);
+    }
+    load->data = NULL;
+}
+
+static void texture_decode_range(size_t begin, size_t end, void *arg)
+{
+    struct texture_load **loads = arg;
+    for(size_t i = begin; i < end; i++) {
+        texture_load_decode(loads[i]);
+    }
+}
+
+static void texture_upload_time(uint64_t begin)
+{
+    uint64_t delta = SDL_GetPerformanceCounter() - begin;
+    SDL_AtomicAdd(&s_upload_us, delta * 1000000 / SDL_GetPerformanceFrequency());
 }
 
 static void texture_make_null(GLuint *out)
@@ -132,6 +439,281 @@ static void texture_make_null(GLuint *out)
     GL_ASSERT_OK();
 }
 
+static void texture_handles_upload(void)
+{
+    size_t nhandles = vec_size(&s_handles);
+    if(nhandles > s_handle_capacity) {
+
+        size_t capacity = s_handle_capacity ? s_handle_capacity : 256;
+        while(capacity < nhandles)
+            capacity *= 2;
+
+        if(!s_handle_buff)
+            glGenBuffers(1, &s_handle_buff);
+        glBindBuffer(GL_TEXTURE_BUFFER, s_handle_buff);
+        glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(GLuint64), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        if(!s_handle_tex)
+            glGenTextures(1, &s_handle_tex);
+        glBindTexture(GL_TEXTURE_BUFFER, s_handle_tex);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, s_handle_buff);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        s_handle_capacity = capacity;
+    }
+
+    if(nhandles) {
+        glBindBuffer(GL_TEXTURE_BUFFER, s_handle_buff);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, nhandles * sizeof(GLuint64), s_handles.array);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+    s_handles_dirty = false;
+    GL_ASSERT_OK();
+}
+
+static void texture_handle_release(GLuint texid)
+{
+    if(!s_handle_slot_table)
+        return;
+
+    khiter_t k = kh_get(handle, s_handle_slot_table, texid);
+    if(k == kh_end(s_handle_slot_table))
+        return;
+
+    int slot = kh_val(s_handle_slot_table, k);
+    glMakeTextureHandleNonResidentARB(vec_AT(&s_handles, slot));
+    vec_AT(&s_handles, slot) = 0;
+    vec_slot_push(&s_free_slots, slot);
+    kh_del(handle, s_handle_slot_table, k);
+    s_handles_dirty = true;
+}
+
+static size_t texture_bytes(GLuint id)
+{
+    if(!s_tex_mem_table)
+        return 0;
+
+    khiter_t k = kh_get(mem, s_tex_mem_table, id);
+    if(k == kh_end(s_tex_mem_table))
+        return 0;
+    return kh_val(s_tex_mem_table, k).bytes;
+}
+
+static void texture_qualname(const char *basedir, const char *name, char *out, size_t size)
+{
+    if(basedir) {
+        pf_snprintf(out, size, "%s/%s", basedir, name);
+    }else{
+        pf_strlcpy(out, name, size);
+    }
+}
+
+static void texture_insert(const char *qualname, GLuint id, int refcount, bool external)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    int put_ret;
+    khiter_t k = kh_put(tex, s_name_tex_table, pf_strdup(qualname), &put_ret);
+    assert(put_ret != -1 && put_ret != 0);
+    kh_value(s_name_tex_table, k) = (struct tex_entry){id, refcount, external};
+    s_resident_bytes += texture_bytes(id);
+
+    if(refcount == 0) {
+        struct tex_lru_entry lru_entry = {kh_key(s_name_tex_table, k)};
+        lru_texlru_put(&s_tex_lru, id, &lru_entry);
+    }
+
+    khiter_t ek = kh_get(evicted, s_evicted_table, qualname);
+    if(ek != kh_end(s_evicted_table)) {
+        free((void*)kh_key(s_evicted_table, ek));
+        kh_del(evicted, s_evicted_table, ek);
+    }
+}
+
+static void texture_remove(khiter_t k)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    GLuint id = kh_val(s_name_tex_table, k).id;
+    s_resident_bytes -= texture_bytes(id);
+    texture_untrack(id);
+    glDeleteTextures(1, &id);
+    free((void*)kh_key(s_name_tex_table, k));
+    kh_del(tex, s_name_tex_table, k);
+}
+
+static void texture_ref(khiter_t k)
+{
+    struct tex_entry *entry = &kh_val(s_name_tex_table, k);
+    if(entry->refcount++ == 0 && !entry->external) {
+        lru_texlru_remove(&s_tex_lru, entry->id);
+    }
+}
+
+static void texture_unref(khiter_t k)
+{
+    struct tex_entry *entry = &kh_val(s_name_tex_table, k);
+    assert(entry->refcount > 0);
+    if(--entry->refcount > 0)
+        return;
+
+    if(entry->external) {
+        texture_remove(k);
+        return;
+    }
+    struct tex_lru_entry lru_entry = {kh_key(s_name_tex_table, k)};
+    lru_texlru_put(&s_tex_lru, entry->id, &lru_entry);
+}
+
+/* Called by the LRU cache on the least recently used texture when the 
+ * budget is exceeded. The name is remembered so that the texture can be 
+ * decoded again asynchronously when it is next requested. */
+static void texture_on_evict(struct tex_lru_entry *victim)
+{
+    khiter_t k = kh_get(tex, s_name_tex_table, victim->qualname);
+    assert(k != kh_end(s_name_tex_table));
+    assert(kh_val(s_name_tex_table, k).refcount == 0);
+
+    int put_ret;
+    char *name = pf_strdup(victim->qualname);
+    if(name) {
+        khiter_t ek = kh_put(evicted, s_evicted_table, name, &put_ret);
+        if(put_ret == -1 || put_ret == 0)
+            free(name);
+        if(put_ret != -1)
+            kh_val(s_evicted_table, ek) = false;
+    }
+    texture_remove(k);
+}
+
+/* Returns true if the texture was evicted, in which case the main thread is 
+ * asked to decode it again (once) */
+static bool texture_request_reload(const char *basedir, const char *name)
+{
+    char qualname[512];
+    texture_qualname(basedir, name, qualname, sizeof(qualname));
+
+    khiter_t k = kh_get(evicted, s_evicted_table, qualname);
+    if(k == kh_end(s_evicted_table))
+        return false;
+
+    if(kh_val(s_evicted_table, k))
+        return true;
+
+    struct tex_reload reload;
+    pf_strlcpy(reload.basedir, basedir ? basedir : "", sizeof(reload.basedir));
+    pf_strlcpy(reload.name, name, sizeof(reload.name));
+
+    SDL_LockMutex(s_reload_lock);
+    bool pushed = vec_reload_push(&s_reload_queue, reload);
+    SDL_UnlockMutex(s_reload_lock);
+
+    kh_val(s_evicted_table, k) = pushed;
+    return true;
+}
+
+static bool texture_load_named(const char *basedir, const char *name, int refcount, GLuint *out)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    GLuint ret;
+    char texture_path[512], texture_path_maps[512];
+    texture_qualname(basedir, name, texture_path, sizeof(texture_path));
+
+    khiter_t k;
+    if((k = kh_get(tex, s_name_tex_table, texture_path)) != kh_end(s_name_tex_table)) {
+        if(refcount > 0) {
+            texture_ref(k);
+        }
+        *out = kh_val(s_name_tex_table, k).id;
+        return true;
+    }
+
+    pf_snprintf(texture_path_maps, sizeof(texture_path_maps), "%s/assets/map_textures/%s", g_basepath, name);
+
+    if(!(basedir && texture_gl_init(texture_path, &ret))
+    && !texture_gl_init(texture_path_maps, &ret))
+        return false;
+
+    texture_insert(texture_path, ret, refcount, false);
+    *out = ret;
+    GL_ASSERT_OK();
+    return true;
+}
+
+static void texture_load_decoded(const char *basedir, const char *name, 
+                                 struct texture_load *load, int refcount, GLuint *out)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    char qualname[512];
+    texture_qualname(basedir, name, qualname, sizeof(qualname));
+
+    khiter_t k;
+    if((k = kh_get(tex, s_name_tex_table, qualname)) != kh_end(s_name_tex_table)) {
+        if(refcount > 0) {
+            texture_ref(k);
+        }
+        *out = kh_val(s_name_tex_table, k).id;
+        texture_load_free(load);
+        return;
+    }
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    GLuint ret;
+
+    bool uploaded = load->ktx.buff 
+        ? texture_gl_upload_ktx(&load->ktx, &ret)
+        : (load->data && texture_gl_upload(load->data, load->width, load->height, 
+                                           load->nr_channels, &ret));
+    texture_load_free(load);
+    if(!uploaded)
+        return;
+
+    texture_insert(qualname, ret, refcount, false);
+    *out = ret;
+    GL_ASSERT_OK();
+    texture_upload_time(begin);
+}
+
+static void texture_reload(const char *basedir, const char *name, struct texture_load *load)
+{
+    GLuint unused;
+    texture_load_decoded(basedir[0] ? basedir : NULL, name, load, 0, &unused);
+}
+
+/* Main thread: queue the decoding of the textures requested since the last frame */
+static void texture_queue_reloads(void)
+{
+    if(!s_reload_lock)
+        return;
+
+    SDL_LockMutex(s_reload_lock);
+    vec_reload_t reloads = s_reload_queue;
+    vec_reload_init(&s_reload_queue);
+    SDL_UnlockMutex(s_reload_lock);
+
+    for(int i = 0; i < vec_size(&reloads); i++) {
+
+        const struct tex_reload *curr = &vec_AT(&reloads, i);
+        char path[512], maps_path[512];
+        texture_qualname(curr->basedir[0] ? curr->basedir : NULL, curr->name, path, sizeof(path));
+        pf_snprintf(maps_path, sizeof(maps_path), "%s/assets/map_textures/%s", g_basepath, curr->name);
+
+        R_PushCmd((struct rcmd){
+            .func = texture_reload,
+            .nargs = 3,
+            .args = {
+                R_PushArg(curr->basedir, strlen(curr->basedir) + 1),
+                R_PushArg(curr->name, strlen(curr->name) + 1),
+                R_TextureLoadQueue(path, maps_path, 0),
+            },
+        });
+    }
+    vec_reload_destroy(&reloads);
+}
+
 static size_t texture_arr_num_mip_levels(GLuint tex)
 {
     int max_lvl;
@@ -180,24 +762,85 @@ bool R_GL_Texture_Init(void)
     ASSERT_IN_RENDER_THREAD();
 
     s_name_tex_table = kh_init(tex);
+    s_tex_mem_table = kh_init(mem);
+    s_handle_slot_table = kh_init(handle);
+    s_evicted_table = kh_init(evicted);
+    vec_handle_init(&s_handles);
+    vec_slot_init(&s_free_slots);
+    vec_reload_init(&s_reload_queue);
     texture_make_null(&s_null_tex);
 
-    return (s_name_tex_table != NULL);
+    if(!lru_texlru_init(&s_tex_lru, TEX_LRU_CAPACITY, texture_on_evict))
+        return false;
+    s_resident_bytes = 0;
+    s_reload_lock = SDL_CreateMutex();
+
+    return (s_name_tex_table != NULL) && (s_tex_mem_table != NULL)
+        && (s_handle_slot_table != NULL) && (s_evicted_table != NULL)
+        && (s_reload_lock != NULL);
 }
 
 void R_GL_Texture_Shutdown(void)
 {
     ASSERT_IN_RENDER_THREAD();
 
+    GLuint texid;
+    int slot;
+    kh_foreach(s_handle_slot_table, texid, slot, {
+        (void)texid;
+        glMakeTextureHandleNonResidentARB(vec_AT(&s_handles, slot));
+    });
+    kh_destroy(handle, s_handle_slot_table);
+    s_handle_slot_table = NULL;
+    vec_handle_destroy(&s_handles);
+    vec_slot_destroy(&s_free_slots);
+    if(s_handle_tex)
+        glDeleteTextures(1, &s_handle_tex);
+    if(s_handle_buff)
+        glDeleteBuffers(1, &s_handle_buff);
+    s_handle_tex = 0;
+    s_handle_buff = 0;
+    s_handle_capacity = 0;
+
+    /* Everything that is still in the cache is deleted along with the 
+     * referenced textures below */
+    s_tex_lru.on_evict = NULL;
+    lru_texlru_destroy(&s_tex_lru);
+
     const char *key;
-    GLuint curr;
+    struct tex_entry curr;
 
     kh_foreach(s_name_tex_table, key, curr, {
-        glDeleteTextures(1, &curr); 
+        texture_untrack(curr.id);
+        glDeleteTextures(1, &curr.id); 
         free((void*)key);
     });
     kh_destroy(tex, s_name_tex_table);
     glDeleteTextures(1, &s_null_tex); 
+
+    bool requested;
+    kh_foreach(s_evicted_table, key, requested, {
+        (void)requested;
+        free((void*)key);
+    });
+    kh_destroy(evicted, s_evicted_table);
+    s_evicted_table = NULL;
+    s_resident_bytes = 0;
+
+    SDL_LockMutex(s_reload_lock);
+    vec_reload_destroy(&s_reload_queue);
+    SDL_UnlockMutex(s_reload_lock);
+    SDL_DestroyMutex(s_reload_lock);
+    s_reload_lock = NULL;
+
+    GLuint id;
+    struct tex_mem mem;
+    kh_foreach(s_tex_mem_table, id, mem, {
+        (void)id;
+        Perf_MemFree(mem.tag, mem.bytes);
+    });
+    kh_destroy(mem, s_tex_mem_table);
+    s_tex_mem_table = NULL;
 }
 
 bool R_GL_Texture_GetForName(const char *basedir, const char *name, GLuint *out)
@@ -213,43 +856,20 @@ bool R_GL_Texture_GetForName(const char *basedir, const char *name, GLuint *out)
         return false;
     }
 
-    *out = kh_val(s_name_tex_table, k);
+    const struct tex_entry *entry = &kh_val(s_name_tex_table, k);
+    if(entry->refcount == 0 && !entry->external) {
+        /* Mark it as recently used */
+        struct tex_lru_entry unused;
+        lru_texlru_get(&s_tex_lru, entry->id, &unused);
+    }
+
+    *out = entry->id;
     return true;
 }
 
 bool R_GL_Texture_Load(const char *basedir, const char *name, GLuint *out)
 {
-    ASSERT_IN_RENDER_THREAD();
-
-    GLuint ret;
-    khiter_t k;
-    char texture_path[512], texture_path_maps[512];
-
-    if((k = kh_get(tex, s_name_tex_table, name)) != kh_end(s_name_tex_table))
-        goto fail;
-
-    if(basedir) {
-        pf_snprintf(texture_path, sizeof(texture_path), "%s/%s", basedir, name);
-    }else{
-        texture_path[0] = '\0';
-    }
-    pf_snprintf(texture_path_maps, sizeof(texture_path_maps), "%s/assets/map_textures/%s", g_basepath, name);
-
-    if(!texture_gl_init(texture_path, &ret)
-    && !texture_gl_init(texture_path_maps, &ret))
-        goto fail;
-
-    int put_ret;
-    k = kh_put(tex, s_name_tex_table, pf_strdup(texture_path), &put_ret);
-    assert(put_ret != -1 && put_ret != 0);
-    kh_value(s_name_tex_table, k) = ret;
-
-    *out = ret;
-    GL_ASSERT_OK();
-    return true;
-
-fail:
-    return false;
+    return texture_load_named(basedir, name, 1, out);
 }
 
 bool R_GL_Texture_AddExisting(const char *name, GLuint id)
@@ -260,10 +880,7 @@ bool R_GL_Texture_AddExisting(const char *name, GLuint id)
     if((k = kh_get(tex, s_name_tex_table, name)) != kh_end(s_name_tex_table))
         return false;
 
-    int put_ret;
-    k = kh_put(tex, s_name_tex_table, pf_strdup(name), &put_ret);
-    assert(put_ret != -1 && put_ret != 0);
-    kh_value(s_name_tex_table, k) = id;
+    texture_insert(name, id, 1, true);
     return true;
 }
 
@@ -272,19 +889,11 @@ void R_GL_Texture_Free(const char *basedir, const char *name)
     ASSERT_IN_RENDER_THREAD();
 
     char qualname[512];
-    if(basedir) {
-        pf_snprintf(qualname, sizeof(qualname), "%s/%s", basedir, name);
-    }else{
-        pf_strlcpy(qualname, name, sizeof(qualname));
-    }
+    texture_qualname(basedir, name, qualname, sizeof(qualname));
 
     khiter_t k;
     if((k = kh_get(tex, s_name_tex_table, qualname)) != kh_end(s_name_tex_table)) {
-
-        GLuint id = kh_val(s_name_tex_table, k);
-        glDeleteTextures(1, &id);
-        free((void*)kh_key(s_name_tex_table, k));
-        kh_del(tex, s_name_tex_table, k);
+        texture_unref(k);
     }
 
     GL_ASSERT_OK();
@@ -424,6 +1033,8 @@ void R_GL_Texture_ArrayAlloc(size_t num_elems, struct texture_arr *out, GLuint t
 
     glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 
         CONFIG_ARR_TEX_RES, CONFIG_ARR_TEX_RES, num_elems, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    texture_track(out->id, PERF_MEM_GPU_TEXTURE_ARRAYS, 
+        texture_mip_bytes((size_t)CONFIG_ARR_TEX_RES * CONFIG_ARR_TEX_RES * num_elems * 4));
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
@@ -488,6 +1099,8 @@ void R_GL_Texture_ArrayMake(const struct material *mats, size_t num_mats,
 
     glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 
         CONFIG_ARR_TEX_RES, CONFIG_ARR_TEX_RES, num_mats, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    texture_track(out->id, PERF_MEM_GPU_TEXTURE_ARRAYS, 
+        texture_mip_bytes((size_t)CONFIG_ARR_TEX_RES * CONFIG_ARR_TEX_RES * num_mats * 4));
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
@@ -538,10 +1151,11 @@ void R_GL_Texture_ArrayMake(const struct material *mats, size_t num_mats,
     GL_ASSERT_OK();
 }
 
-void R_GL_Texture_ArrayMakeMap(const char texnames[][256], size_t num_textures, 
+void R_GL_Texture_ArrayMakeMap(struct texture_load *const *loads, size_t num_textures, 
                                struct texture_arr *out, GLuint tunit)
 {
     ASSERT_IN_RENDER_THREAD();
+    uint64_t begin = SDL_GetPerformanceCounter();
 
     glActiveTexture(tunit);
     out->tunit = tunit;
@@ -550,30 +1164,22 @@ void R_GL_Texture_ArrayMakeMap(const char texnames[][256], size_t num_textures,
 
     glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 
         CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, num_textures, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    texture_track(out->id, PERF_MEM_GPU_TEXTURE_ARRAYS, 
+        texture_mip_bytes((size_t)CONFIG_TILE_TEX_RES * CONFIG_TILE_TEX_RES * num_textures * 4));
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
 
     for(int i = 0; i < num_textures; i++) {
 
-        char path[512];
-        pf_snprintf(path, sizeof(path), "%s/assets/map_textures/%s", g_basepath, texnames[i]);
-
-        int width, height, nr_channels;
-        unsigned char *orig_data = stbi_load(path, &width, &height, &nr_channels, 0);
-        if(orig_data) {
-        
-            GLubyte *resized_data = malloc(CONFIG_TILE_TEX_RES * CONFIG_TILE_TEX_RES * 3);
-            if(!resized_data)
-                continue;
+        struct texture_load *load = loads[i];
+        assert(load->resize == CONFIG_TILE_TEX_RES);
 
-            int res = stbir_resize_uint8(orig_data, width, height, 0, resized_data, CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, 0, 3);
-            assert(1 == res);
+        if(load->data) {
 
             glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, CONFIG_TILE_TEX_RES, 
-                CONFIG_TILE_TEX_RES, 1, GL_RGB, GL_UNSIGNED_BYTE, resized_data);
-            stbi_image_free(orig_data);
-            free(resized_data);
+                CONFIG_TILE_TEX_RES, 1, GL_RGB, GL_UNSIGNED_BYTE, load->data);
+            texture_load_free(load);
         }else{
 
             GLubyte *data = malloc(CONFIG_TILE_TEX_RES * CONFIG_TILE_TEX_RES * 3);
@@ -596,10 +1202,13 @@ void R_GL_Texture_ArrayMakeMap(const char texnames[][256], size_t num_textures,
 
     glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     GL_ASSERT_OK();
+    texture_upload_time(begin);
 }
 
 void R_GL_Texture_ArrayFree(struct texture_arr array)
 {
+    texture_handle_release(array.id);
+    texture_untrack(array.id);
     glDeleteTextures(1, &array.id);
 }
 
@@ -628,6 +1237,66 @@ void R_GL_Texture_BindArray(const struct texture_arr *arr, GLuint shader_prog)
     GL_ASSERT_OK();
 }
 
+bool R_GL_Texture_BindlessSlot(GLuint texid, int *out)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    khiter_t k = kh_get(handle, s_handle_slot_table, texid);
+    if(k != kh_end(s_handle_slot_table)) {
+        *out = kh_val(s_handle_slot_table, k);
+        return true;
+    }
+
+    GLuint64 handle = glGetTextureHandleARB(texid);
+    if(!handle)
+        return false;
+
+    int slot;
+    if(vec_size(&s_free_slots)) {
+        slot = vec_slot_pop(&s_free_slots);
+    }else{
+        if(!vec_handle_push(&s_handles, 0))
+            return false;
+        slot = vec_size(&s_handles) - 1;
+    }
+
+    int status;
+    k = kh_put(handle, s_handle_slot_table, texid, &status);
+    if(status == -1) {
+        vec_slot_push(&s_free_slots, slot);
+        return false;
+    }
+
+    glMakeTextureHandleResidentARB(handle);
+    kh_val(s_handle_slot_table, k) = slot;
+    vec_AT(&s_handles, slot) = handle;
+    s_handles_dirty = true;
+
+    GL_ASSERT_OK();
+    *out = slot;
+    return true;
+}
+
+void R_GL_Texture_BindlessBind(GLuint tunit, GLuint shader_prog)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    if(s_handles_dirty || !s_handle_tex) {
+        texture_handles_upload();
+    }
+
+    glActiveTexture(tunit);
+    glBindTexture(GL_TEXTURE_BUFFER, s_handle_tex);
+
+    R_GL_StateSet(GL_U_TEX_HANDLES, (struct uval){
+        .type = UTYPE_INT,
+        .val.as_int = tunit - GL_TEXTURE0
+    });
+    R_GL_StateInstall(GL_U_TEX_HANDLES, shader_prog);
+
+    GL_ASSERT_OK();
+}
+
 void R_GL_Texture_GetSize(GLuint texid, int *out_w, int *out_h, int *out_d)
 {
     ASSERT_IN_RENDER_THREAD();
@@ -648,6 +1317,164 @@ void R_GL_Texture_GetOrLoad(const char *basedir, const char *name, GLuint *out)
     if(R_GL_Texture_GetForName(basedir, name, out))
         return;
 
-    R_GL_Texture_Load(basedir, name, out);
+    /* The null texture is used until an evicted texture is reloaded */
+    if(texture_request_reload(basedir, name))
+        return;
+
+    /* The texture is not referenced - it's only kept resident for as 
+     * long as it's used often enough */
+    texture_load_named(basedir, name, 0, out);
+}
+
+void R_GL_Texture_LoadDecoded(const char *basedir, const char *name, 
+                              struct texture_load *load, GLuint *out)
+{
+    texture_load_decoded(basedir, name, load, 1, out);
+}
+
+void R_GL_Texture_SetBudget(const int *mb)
+{
+    ASSERT_IN_RENDER_THREAD();
+    s_budget_bytes = (size_t)(*mb) * 1024 * 1024;
+}
+
+void R_GL_Texture_EndFrame(void)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    int nevicted = 0;
+    while(s_resident_bytes > s_budget_bytes && lru_texlru_evict_one(&s_tex_lru)) {
+        nevicted++;
+    }
+
+    if(nevicted) {
+        Perf_CounterAdd("render.textures_evicted", nevicted);
+    }
+}
+
+struct texture_load *R_TextureLoadQueue(const char *path, const char *fallback_path, int resize)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    struct texture_load load = {
+        .resize = resize,
+        .data = NULL,
+        .ktx.buff = NULL,
+        .prefetched = false,
+        .next = NULL,
+    };
+    pf_strlcpy(load.path, path, sizeof(load.path));
+    pf_strlcpy(load.fallback_path, fallback_path ? fallback_path : "", sizeof(load.fallback_path));
+
+    struct texture_load *ret = R_PushArg(&load, sizeof(load));
+    if(s_pending_tail) {
+        s_pending_tail->next = ret;
+    }else{
+        s_pending_head = ret;
+    }
+    s_pending_tail = ret;
+    s_npending++;
+    return ret;
+}
+
+void R_TextureLoadFlush(void)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    texture_queue_reloads();
+    if(!s_npending)
+        PERF_RETURN_VOID();
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    STALLOC(struct texture_load*, loads, s_npending);
+    khash_t(path) *seen = kh_init(path);
+    size_t nloads = 0;
+
+    /* The same image is only decoded once per batch. Later loads of the 
+     * same texture find it by name when they are executed, since the 
+     * commands execute in the order they were queued in. 
+     */
+    for(struct texture_load *curr = s_pending_head; curr; curr = curr->next) {
+
+        int status = -1;
+        if(seen && !curr->resize) {
+            kh_put(path, seen, curr->path, &status);
+        }
+        if(status == 0)
+            continue;
+        loads[nloads++] = curr;
+    }
+
+    /* The images which are resized are never substituted with a 
+     * pre-compressed version, so their files are known up front. Read 
+     * them on the I/O threads such that the reads overlap with decoding. 
+     */
+    for(int i = 0; i < nloads; i++) {
+        if(!loads[i]->resize)
+            continue;
+        loads[i]->prefetched = Sched_ReadFileAsync(loads[i]->path, 
+            &loads[i]->read, &loads[i]->read_size);
+    }
+
+    Sched_ParallelFor(0, nloads, 1, texture_decode_range, loads);
+
+    for(int i = 0; i < nloads; i++) {
+        if(loads[i]->ktx.buff) {
+            s_ndecoded++;
+            s_decode_bytes += loads[i]->ktx.size;
+            s_decode_cpu_ticks += loads[i]->decode_ticks;
+            continue;
+        }
+        if(!loads[i]->data)
+            continue;
+        s_ndecoded++;
+        s_decode_bytes += loads[i]->width * loads[i]->height * loads[i]->nr_channels;
+        s_decode_cpu_ticks += loads[i]->decode_ticks;
+    }
+
+    if(seen) {
+        kh_destroy(path, seen);
+    }
+    STFREE(loads);
+
+    s_pending_head = NULL;
+    s_pending_tail = NULL;
+    s_npending = 0;
+    s_decode_ticks += SDL_GetPerformanceCounter() - begin;
+
+    PERF_RETURN_VOID();
 }
 
+void R_TextureLoadClear(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    s_pending_head = NULL;
+    s_pending_tail = NULL;
+    s_npending = 0;
+}
+
+bool R_TextureCook(const char *src, const char *dst)
+{
+    int width, height, nr_channels;
+    unsigned char *data = stbi_load(src, &width, &height, &nr_channels, 4);
+    if(!data)
+        return false;
+
+    bool ret = R_KTX_Write(dst, data, width, height);
+    stbi_image_free(data);
+    return ret;
+}
+
+void R_TextureLoadGetStats(struct texture_load_stats *out)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    double freq = SDL_GetPerformanceFrequency();
+    out->ndecoded = s_ndecoded;
+    out->decode_bytes = s_decode_bytes;
+    out->decode_ms = s_decode_ticks * 1000.0 / freq;
+    out->decode_cpu_ms = s_decode_cpu_ticks * 1000.0 / freq;
+    out->upload_ms = SDL_AtomicGet(&s_upload_us) / 1000.0;
+}
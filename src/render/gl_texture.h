@@ -36,6 +36,9 @@
 #ifndef GL_TEXTURE_H
 #define GL_TEXTURE_H
 
+#include "gl_ktx.h"
+#include "../sched.h"
+
 #include <GL/glew.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -52,6 +55,26 @@ struct texture_arr{
     GLuint tunit;
 };
 
+/* An image to be decoded by the main thread (see R_TextureLoadFlush) 
+ * and uploaded by the render command it is passed to. */
+struct texture_load{
+    char                 path[512];
+    char                 fallback_path[512];
+    /* When non-zero, the image is resized to 'resize' x 'resize' RGB */
+    int                  resize;
+    unsigned char       *data;
+    /* Set instead of 'data' when a pre-compressed version was found */
+    struct ktx_image     ktx;
+    int                  width, height;
+    int                  nr_channels;
+    uint64_t             decode_ticks;
+    /* Set when the file was read ahead on the scheduler's I/O threads */
+    bool                 prefetched;
+    struct future        read;
+    size_t               read_size;
+    struct texture_load *next;
+};
+
 bool R_GL_Texture_Init(void);
 void R_GL_Texture_Shutdown(void);
 
@@ -61,17 +84,40 @@ void R_GL_Texture_ArrayCopyElem(struct texture_arr *dst, int dst_idx, struct tex
 
 void R_GL_Texture_ArrayMake(const struct material *mats, size_t num_mats, 
                             struct texture_arr *out, GLuint tunit);
-void R_GL_Texture_ArrayMakeMap(const char texnames[][256], size_t num_textures, 
+void R_GL_Texture_ArrayMakeMap(struct texture_load *const *loads, size_t num_textures, 
                                struct texture_arr *out, GLuint tunit);
 
 void R_GL_Texture_Bind(const struct texture *text, GLuint shader_prog);
 void R_GL_Texture_BindArray(const struct texture_arr *arr, GLuint shader_prog);
 
+/* Make the array texture's bindless handle resident and return the slot of the 
+ * handle table it can be fetched from. The handle is released when the array 
+ * is freed. Requires ARB_bindless_texture. */
+bool R_GL_Texture_BindlessSlot(GLuint texid, int *out);
+/* Bind the table of resident handles as a buffer texture on 'tunit' */
+void R_GL_Texture_BindlessBind(GLuint tunit, GLuint shader_prog);
+
+/* 'Load' and 'LoadDecoded' take a reference to the named texture, which is 
+ * dropped by 'Free'. The textures which are only looked up with 'GetOrLoad' 
+ * are not referenced. Unreferenced textures stay resident until the VRAM 
+ * budget is exceeded, at which point the least recently used ones are evicted 
+ * and reloaded asynchronously on their next lookup. */
 bool R_GL_Texture_Load(const char *basedir, const char *name, GLuint *out);
 void R_GL_Texture_Free(const char *basedir, const char *name);
 void R_GL_Texture_GetOrLoad(const char *basedir, const char *name, GLuint *out);
 bool R_GL_Texture_GetForName(const char *basedir, const char *name, GLuint *out);
 void R_GL_Texture_GetSize(GLuint texid, int *out_w, int *out_h, int *out_d);
 bool R_GL_Texture_AddExisting(const char *name, GLuint id);
+void R_GL_Texture_LoadDecoded(const char *basedir, const char *name, 
+                              struct texture_load *load, GLuint *out);
+void R_GL_Texture_SetBudget(const int *mb);
+/* Evicts the least recently used unreferenced textures while over budget */
+void R_GL_Texture_EndFrame(void);
+
+/* Main thread: queue an image to be decoded before the current frame's 
+ * commands are handed over. The returned load lives in the frame's command 
+ * arguments and must be passed to exactly one command which frees its' data. 
+ * 'fallback_path' may be NULL. */
+struct texture_load *R_TextureLoadQueue(const char *path, const char *fallback_path, int resize);
 
 #endif
@@ -62,6 +62,12 @@
 #define ARR_SIZE(a)                 (sizeof(a)/sizeof(a[0]))
 #define MAG(x, y)                   sqrt(pow(x,2) + pow(y,2))
 #define VEC3_EQUAL(a, b)            (0 == memcmp((a).raw, (b).raw, sizeof((a).raw)))
+#define LOD_EPSILON                 (1.0f/1024)
+#define MIN(a, b)                   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)                   ((a) > (b) ? (a) : (b))
+/* The origin of the packed vertex positions. The terrain shaders use the same. */
+#define CHUNK_CENTER_X              (-(TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE) / 2.0f)
+#define CHUNK_CENTER_Z              ( (TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE) / 2.0f)
 
 #define CPY2(dst, src)      \
     do{                     \
@@ -540,6 +546,256 @@ static float tile_min_visible_height(const struct map *map, struct tile_desc til
     return arr_min(heights, ARR_SIZE(heights)) * Y_COORDS_PER_TILE;
 }
 
+static bool tri_degenerate(const struct terrain_vert *tri)
+{
+    vec3_t a, b, cross;
+    PFM_Vec3_Sub((vec3_t*)&tri[1].pos, (vec3_t*)&tri[0].pos, &a);
+    PFM_Vec3_Sub((vec3_t*)&tri[2].pos, (vec3_t*)&tri[0].pos, &b);
+    PFM_Vec3_Cross(&a, &b, &cross);
+    return (PFM_Vec3_Len(&cross) < LOD_EPSILON);
+}
+
+static bool same_flat_attrs(const struct terrain_vert *a, const struct terrain_vert *b)
+{
+    return (a->material_idx   == b->material_idx)
+        && (a->blend_mode     == b->blend_mode)
+        && (a->middle_indices == b->middle_indices)
+        && (a->c1_indices[0]  == b->c1_indices[0])
+        && (a->c1_indices[1]  == b->c1_indices[1])
+        && (a->c2_indices[0]  == b->c2_indices[0])
+        && (a->c2_indices[1]  == b->c2_indices[1])
+        && (a->tb_indices     == b->tb_indices)
+        && (a->lr_indices     == b->lr_indices);
+}
+
+/* The top face can be drawn as a single quad without any visible difference 
+ * when it is planar, has a single normal and all the triangles share the same 
+ * flat attributes. The positions, UVs and normals then interpolate the same. 
+ */
+static bool top_face_mergeable(const union top_face_vbuff *tfvb)
+{
+    const struct terrain_vert *first = &tfvb->verts[0];
+
+    vec3_t a, b, plane_normal;
+    PFM_Vec3_Sub((vec3_t*)&tfvb->sw0.pos, (vec3_t*)&tfvb->se0.pos, &a);
+    PFM_Vec3_Sub((vec3_t*)&tfvb->nw0.pos, (vec3_t*)&tfvb->se0.pos, &b);
+    PFM_Vec3_Cross(&a, &b, &plane_normal);
+    PFM_Vec3_Normal(&plane_normal, &plane_normal);
+
+    for(int i = 0; i < VERTS_PER_TOP_FACE; i++) {
+
+        const struct terrain_vert *curr = &tfvb->verts[i];
+        if(!VEC3_EQUAL(curr->normal, first->normal))
+            return false;
+
+        vec3_t delta;
+        PFM_Vec3_Sub((vec3_t*)&curr->pos, (vec3_t*)&first->pos, &delta);
+        if(fabsf(PFM_Vec3_Dot(&delta, &plane_normal)) > LOD_EPSILON)
+            return false;
+    }
+
+    /* Only the provoking (first) vertex of each triangle supplies the flat attributes */
+    for(int i = 1; i < VERTS_PER_TOP_FACE/3; i++) {
+        if(!same_flat_attrs(&tfvb->tris[i].verts[0], first))
+            return false;
+    }
+    return true;
+}
+
+static int16_t quantize(float val, float step)
+{
+    float q = roundf(val / step);
+    return (int16_t)MAX(MIN(q, INT16_MAX), INT16_MIN);
+}
+
+static float dequantize_snorm(int16_t val)
+{
+    return MAX(val / (float)INT16_MAX, -1.0f);
+}
+
+static float sign_not_zero(float val)
+{
+    return (val >= 0.0f) ? 1.0f : -1.0f;
+}
+
+/* The normal is projected onto the octahedron and the lower half is folded 
+ * over the upper one, giving 2 coordinates in the [-1, 1] range. */
+static void oct_encode(vec3_t normal, int16_t out[2])
+{
+    float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+    if(l1 == 0.0f) {
+        out[0] = out[1] = 0;
+        return;
+    }
+
+    float x = normal.x / l1;
+    float y = normal.y / l1;
+    if(normal.z < 0.0f) {
+        float ox = x;
+        x = (1.0f - fabsf(y)) * sign_not_zero(ox);
+        y = (1.0f - fabsf(ox)) * sign_not_zero(y);
+    }
+    out[0] = (int16_t)roundf(x * INT16_MAX);
+    out[1] = (int16_t)roundf(y * INT16_MAX);
+}
+
+static vec3_t oct_decode(const int16_t in[2])
+{
+    vec3_t ret;
+    ret.x = dequantize_snorm(in[0]);
+    ret.y = dequantize_snorm(in[1]);
+    ret.z = 1.0f - fabsf(ret.x) - fabsf(ret.y);
+
+    if(ret.z < 0.0f) {
+        float ox = ret.x;
+        ret.x = (1.0f - fabsf(ret.y)) * sign_not_zero(ox);
+        ret.y = (1.0f - fabsf(ox)) * sign_not_zero(ret.y);
+    }
+    PFM_Vec3_Normal(&ret, &ret);
+    return ret;
+}
+
+static bool packed_same_interp_attrs(const struct terrain_vert_packed *a, 
+                                     const struct terrain_vert_packed *b)
+{
+    return (0 == memcmp(a->pos, b->pos, sizeof(a->pos)))
+        && (0 == memcmp(a->uv, b->uv, sizeof(a->uv)))
+        && (0 == memcmp(a->normal, b->normal, sizeof(a->normal)));
+}
+
+static bool packed_same_flat_attrs(const struct terrain_vert_packed *a, 
+                                   const struct terrain_vert_packed *b)
+{
+    return (a->material_idx   == b->material_idx)
+        && (a->blend_mode     == b->blend_mode)
+        && (a->middle_indices == b->middle_indices)
+        && (a->c1_indices[0]  == b->c1_indices[0])
+        && (a->c1_indices[1]  == b->c1_indices[1])
+        && (a->c2_indices[0]  == b->c2_indices[0])
+        && (a->c2_indices[1]  == b->c2_indices[1])
+        && (a->tb_indices     == b->tb_indices)
+        && (a->lr_indices     == b->lr_indices);
+}
+
+/* Corners of different triangles can share a vertex when they interpolate the 
+ * same values. As the flat attributes are read from the provoking (first) 
+ * vertex of each triangle only, a vertex can be provoking for any number of 
+ * triangles, as long as they all agree on them. 
+ */
+static size_t tile_index_tris(const struct terrain_vert_packed *tris, size_t count, 
+                              uint32_t base, struct terrain_vert_packed *out_verts, 
+                              size_t *out_nverts, uint32_t *out_indices)
+{
+    bool provoking[VERTS_PER_TILE];
+    size_t nverts = 0;
+    assert(count <= VERTS_PER_TILE);
+
+    for(size_t i = 0; i < count; i++) {
+
+        const struct terrain_vert_packed *curr = &tris[i];
+        bool curr_provoking = (i % 3 == 0);
+        size_t j = 0;
+
+        for(; j < nverts; j++) {
+
+            if(!packed_same_interp_attrs(curr, &out_verts[j]))
+                continue;
+            if(!curr_provoking)
+                break;
+            if(provoking[j] && packed_same_flat_attrs(curr, &out_verts[j]))
+                break;
+            if(!provoking[j]) {
+                /* The vertex takes on the flat attributes of this triangle */
+                out_verts[j] = *curr;
+                provoking[j] = true;
+                break;
+            }
+        }
+
+        if(j == nverts) {
+            out_verts[nverts] = *curr;
+            provoking[nverts] = curr_provoking;
+            nverts++;
+        }
+        out_indices[i] = base + j;
+    }
+
+    *out_nverts = nverts;
+    return count;
+}
+
+static void tile_build_verts(const struct map *map, const struct tile_desc *desc, 
+                             struct terrain_vert_packed *out)
+{
+    struct terrain_vert verts[VERTS_PER_TILE];
+    struct tile *tile;
+    int ret = M_TileForDesc(map, *desc, &tile);
+    assert(ret);
+    (void)ret;
+
+    R_TileGetVertices(map, *desc, verts);
+    R_TilePatchVertsBlend(map, desc, verts);
+    if(tile->blend_normals) {
+        R_TilePatchVertsSmooth(map, desc, verts);
+    }
+    R_TilePackVertices(verts, VERTS_PER_TILE, out);
+}
+
+static void terrain_setup_attribs(void)
+{
+    const GLsizei stride = sizeof(struct terrain_vert_packed);
+
+    /* Attribute 0 - quantized position */
+    glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, stride, 
+        (void*)offsetof(struct terrain_vert_packed, pos));
+    glEnableVertexAttribArray(0);
+
+    /* Attribute 1 - quantized texture coordinates */
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, stride, 
+        (void*)offsetof(struct terrain_vert_packed, uv));
+    glEnableVertexAttribArray(1);
+
+    /* Attribute 2 - octahedron-encoded normal */
+    glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, 
+        (void*)offsetof(struct terrain_vert_packed, normal));
+    glEnableVertexAttribArray(2);
+
+    /* Attribute 3 - material index */
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, stride, 
+        (void*)offsetof(struct terrain_vert_packed, material_idx));
+    glEnableVertexAttribArray(3);
+
+    /* Attribute 4 - blend mode */
+    glVertexAttribIPointer(4, 1, GL_UNSIGNED_BYTE, stride, 
+        (void*)offsetof(struct terrain_vert_packed, blend_mode));
+    glEnableVertexAttribArray(4);
+
+    /* Attribute 5 - middle material indices packed together */
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_SHORT, stride, 
+        (void*)offsetof(struct terrain_vert_packed, middle_indices));
+    glEnableVertexAttribArray(5);
+
+    /* Attribute 6 - corner 1 material indices packed together */
+    glVertexAttribIPointer(6, 2, GL_INT, stride, 
+        (void*)offsetof(struct terrain_vert_packed, c1_indices));
+    glEnableVertexAttribArray(6);
+
+    /* Attribute 7 - corner 2 material indices packed together */
+    glVertexAttribIPointer(7, 2, GL_INT, stride, 
+        (void*)offsetof(struct terrain_vert_packed, c2_indices));
+    glEnableVertexAttribArray(7);
+
+    /* Attribute 8 - tile top and bottom material indices packed together */
+    glVertexAttribIPointer(8, 1, GL_INT, stride, 
+        (void*)offsetof(struct terrain_vert_packed, tb_indices));
+    glEnableVertexAttribArray(8);
+
+    /* Attribute 9 - tile left and right material indices packed together */
+    glVertexAttribIPointer(9, 1, GL_INT, stride, 
+        (void*)offsetof(struct terrain_vert_packed, lr_indices));
+    glEnableVertexAttribArray(9);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -555,13 +811,18 @@ void R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rprivat
     GLuint VAO, VBO;
 
     const struct render_private *priv = chunk_rprivate;
-    size_t offset = (in->tile_r * (*tiles_per_chunk_x) + in->tile_c) * VERTS_PER_TILE * sizeof(struct terrain_vert);
-    size_t length = VERTS_PER_TILE * sizeof(struct terrain_vert);
+    if(!priv->mesh.VAO)
+        GL_PERF_RETURN_VOID();
+
+    size_t offset = (in->tile_r * (*tiles_per_chunk_x) + in->tile_c) * VERTS_PER_TILE * sizeof(struct terrain_vert_packed);
+    size_t length = VERTS_PER_TILE * sizeof(struct terrain_vert_packed);
 
     glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
-    const struct terrain_vert *vert_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_READ_BIT);
+    uint64_t map_begin = SDL_GetPerformanceCounter();
+    const struct terrain_vert_packed *vert_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_READ_BIT);
+    Perf_RenderStall("render.stall_us.tile_map", map_begin);
     assert(vert_base);
-    memcpy(vbuff, vert_base, sizeof(vbuff));
+    R_TileUnpackVertices(vert_base, VERTS_PER_TILE, vbuff);
     glUnmapBuffer(GL_ARRAY_BUFFER);
 
     /* Additionally, scale the tile selection mesh slightly around its' center. This is so that 
@@ -630,13 +891,9 @@ void R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rprivat
     GL_PERF_RETURN_VOID();
 }
 
-void R_GL_TilePatchVertsBlend(void *chunk_rprivate, const struct map *map, const struct tile_desc *tile)
+void R_TilePatchVertsBlend(const struct map *map, const struct tile_desc *tile, 
+                           struct terrain_vert *tile_verts_base)
 {
-    ASSERT_IN_RENDER_THREAD();
-
-    const struct render_private *priv = chunk_rprivate;
-    GLuint VBO = priv->mesh.VBO;
-
     struct map_resolution res;
     M_GetResolution(map, &res);
 
@@ -790,14 +1047,6 @@ void R_GL_TilePatchVertsBlend(void *chunk_rprivate, const struct map *map, const
      * 'tb_indices' and 'lr_indices' hold the materials at the midpoints of the edges of this 
      * tile and 'middle_indices' hold the materials for the center of the tile.
      */
-    size_t offset = VERTS_PER_TILE * (tile->tile_r * TILES_PER_CHUNK_WIDTH + tile->tile_c) * sizeof(struct terrain_vert);
-    size_t length = VERTS_PER_TILE * sizeof(struct terrain_vert);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    struct terrain_vert *tile_verts_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_WRITE_BIT);
-    GL_ASSERT_OK();
-    assert(tile_verts_base);
-
     struct terrain_vert *south_provoking[2] = {tile_verts_base + (4 * VERTS_PER_SIDE_FACE) + 0*3,
                                                tile_verts_base + (4 * VERTS_PER_SIDE_FACE) + 1*3};
     struct terrain_vert *west_provoking[2]  = {tile_verts_base + (4 * VERTS_PER_SIDE_FACE) + 2*3,
@@ -851,26 +1100,37 @@ void R_GL_TilePatchVertsBlend(void *chunk_rprivate, const struct map *map, const
         provoking[i]->middle_indices = curr.middle_mask;
         provoking[i]->blend_mode = optimal_blendmode(provoking[i]);
     }
-
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-    GL_ASSERT_OK();
 }
 
-void R_GL_TilePatchVertsSmooth(void *chunk_rprivate, const struct map *map, const struct tile_desc *tile)
+void R_GL_TilePatchVertsBlend(void *chunk_rprivate, const struct map *map, const struct tile_desc *tile)
 {
     ASSERT_IN_RENDER_THREAD();
 
-    const struct render_private *priv = chunk_rprivate;
-    GLuint VBO = priv->mesh.VBO;
+    struct render_private *priv = chunk_rprivate;
+    size_t offset = VERTS_PER_TILE * (tile->tile_r * TILES_PER_CHUNK_WIDTH + tile->tile_c) * sizeof(struct terrain_vert_packed);
+    size_t length = VERTS_PER_TILE * sizeof(struct terrain_vert_packed);
+
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    struct terrain_vert_packed *tile_verts_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, 
+        GL_MAP_READ_BIT | GL_MAP_WRITE_BIT);
+    GL_ASSERT_OK();
+    assert(tile_verts_base);
 
-    size_t offset = VERTS_PER_TILE * (tile->tile_r * TILES_PER_CHUNK_WIDTH + tile->tile_c) * sizeof(struct terrain_vert);
-    size_t length = VERTS_PER_TILE * sizeof(struct terrain_vert);
+    /* The patch is applied to the full-precision vertices */
+    struct terrain_vert verts[VERTS_PER_TILE];
+    R_TileUnpackVertices(tile_verts_base, VERTS_PER_TILE, verts);
+    R_TilePatchVertsBlend(map, tile, verts);
+    R_TilePackVertices(verts, VERTS_PER_TILE, tile_verts_base);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    union top_face_vbuff *tfvb = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_WRITE_BIT);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    priv->lods_valid = false;
     GL_ASSERT_OK();
-    assert(tfvb);
-    tfvb = (union top_face_vbuff*)(((struct terrain_vert*)tfvb) + (4 * VERTS_PER_SIDE_FACE));
+}
+
+void R_TilePatchVertsSmooth(const struct map *map, const struct tile_desc *tile, 
+                            struct terrain_vert *tile_verts_base)
+{
+    union top_face_vbuff *tfvb = (union top_face_vbuff*)(tile_verts_base + (4 * VERTS_PER_SIDE_FACE));
 
     struct map_resolution res;
     M_GetResolution(map, &res);
@@ -964,9 +1224,211 @@ void R_GL_TilePatchVertsSmooth(void *chunk_rprivate, const struct map *map, cons
     tfvb->center5.normal = center_norm;
     tfvb->center6.normal = center_norm;
     tfvb->center7.normal = center_norm;
+}
+
+void R_GL_TilePatchVertsSmooth(void *chunk_rprivate, const struct map *map, const struct tile_desc *tile)
+{
+    ASSERT_IN_RENDER_THREAD();
+
+    struct render_private *priv = chunk_rprivate;
+    size_t offset = VERTS_PER_TILE * (tile->tile_r * TILES_PER_CHUNK_WIDTH + tile->tile_c) * sizeof(struct terrain_vert_packed);
+    size_t length = VERTS_PER_TILE * sizeof(struct terrain_vert_packed);
+
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    struct terrain_vert_packed *tile_verts_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, 
+        GL_MAP_READ_BIT | GL_MAP_WRITE_BIT);
+    GL_ASSERT_OK();
+    assert(tile_verts_base);
+
+    /* The patch is applied to the full-precision vertices */
+    struct terrain_vert verts[VERTS_PER_TILE];
+    R_TileUnpackVertices(tile_verts_base, VERTS_PER_TILE, verts);
+    R_TilePatchVertsSmooth(map, tile, verts);
+    R_TilePackVertices(verts, VERTS_PER_TILE, tile_verts_base);
 
     glUnmapBuffer(GL_ARRAY_BUFFER);
+    priv->lods_valid = false;
+    GL_ASSERT_OK();
+}
+
+static size_t tile_lod_tris(const struct terrain_vert *tile_verts_base, int lod, 
+                            struct terrain_vert *out)
+{
+    assert(lod > 0 && lod < TERRAIN_NUM_LODS);
+    size_t ret = 0;
+
+    /* Side faces which are not visible are collapsed to zero height */
+    for(int i = 0; i < 4 * VERTS_PER_SIDE_FACE; i += 3) {
+
+        const struct terrain_vert *tri = tile_verts_base + i;
+        if(tri_degenerate(tri))
+            continue;
+        memcpy(out + ret, tri, 3 * sizeof(struct terrain_vert));
+        ret += 3;
+    }
+
+    const union top_face_vbuff *tfvb = 
+        (const union top_face_vbuff*)(tile_verts_base + (4 * VERTS_PER_SIDE_FACE));
+
+    if(lod == 1 && !top_face_mergeable(tfvb)) {
+        memcpy(out + ret, tfvb->verts, sizeof(tfvb->verts));
+        return ret + VERTS_PER_TOP_FACE;
+    }
+
+    /* Split the quad along the diagonal joining the closest heights so that 
+     * corner tiles keep their shape. The provoking vertices are taken from 
+     * the major triangles covering the same corners, which preserves the 
+     * winding order of the original triangles. */
+    float se_nw = fabsf(tfvb->se0.pos.y - tfvb->nw0.pos.y);
+    float sw_ne = fabsf(tfvb->sw0.pos.y - tfvb->ne0.pos.y);
+
+    if(se_nw <= sw_ne) {
+        out[ret++] = tfvb->se0;
+        out[ret++] = tfvb->sw0;
+        out[ret++] = tfvb->nw0;
+
+        out[ret++] = tfvb->nw1;
+        out[ret++] = tfvb->ne0;
+        out[ret++] = tfvb->se1;
+    }else{
+        out[ret++] = tfvb->sw1;
+        out[ret++] = tfvb->ne0;
+        out[ret++] = tfvb->se1;
+
+        out[ret++] = tfvb->ne1;
+        out[ret++] = tfvb->sw0;
+        out[ret++] = tfvb->nw0;
+    }
+    return ret;
+}
+
+size_t R_TileLODVertices(const struct terrain_vert *tile_verts_base, int lod, uint32_t base,
+                         struct terrain_vert_packed *out_verts, size_t *out_nverts,
+                         uint32_t *out_indices)
+{
+    struct terrain_vert tris[VERTS_PER_TILE];
+    struct terrain_vert_packed packed[VERTS_PER_TILE];
+
+    size_t count = tile_lod_tris(tile_verts_base, lod, tris);
+    R_TilePackVertices(tris, count, packed);
+    return tile_index_tris(packed, count, base, out_verts, out_nverts, out_indices);
+}
+
+void R_TilePackVertices(const struct terrain_vert *in, size_t count, 
+                        struct terrain_vert_packed *out)
+{
+    for(size_t i = 0; i < count; i++) {
+
+        const struct terrain_vert *src = &in[i];
+        struct terrain_vert_packed *dst = &out[i];
+        memset(dst, 0, sizeof(*dst));
+
+        dst->pos[0] = quantize(src->pos.x - CHUNK_CENTER_X, TERRAIN_POS_STEP_XZ);
+        dst->pos[1] = quantize(src->pos.y, TERRAIN_POS_STEP_Y);
+        dst->pos[2] = quantize(src->pos.z - CHUNK_CENTER_Z, TERRAIN_POS_STEP_XZ);
+        dst->uv[0] = quantize(src->uv.x, TERRAIN_UV_STEP);
+        dst->uv[1] = quantize(src->uv.y, TERRAIN_UV_STEP);
+        oct_encode(src->normal, dst->normal);
+
+        assert(src->material_idx >= 0 && src->material_idx <= UINT8_MAX);
+        dst->material_idx = src->material_idx;
+        dst->blend_mode = src->blend_mode;
+        dst->middle_indices = src->middle_indices;
+        CPY2(dst->c1_indices, src->c1_indices);
+        CPY2(dst->c2_indices, src->c2_indices);
+        dst->tb_indices = src->tb_indices;
+        dst->lr_indices = src->lr_indices;
+    }
+}
+
+void R_TileUnpackVertices(const struct terrain_vert_packed *in, size_t count, 
+                          struct terrain_vert *out)
+{
+    for(size_t i = 0; i < count; i++) {
+
+        const struct terrain_vert_packed *src = &in[i];
+        struct terrain_vert *dst = &out[i];
+
+        dst->pos = (vec3_t){
+            src->pos[0] * TERRAIN_POS_STEP_XZ + CHUNK_CENTER_X,
+            src->pos[1] * TERRAIN_POS_STEP_Y,
+            src->pos[2] * TERRAIN_POS_STEP_XZ + CHUNK_CENTER_Z,
+        };
+        dst->uv = (vec2_t){
+            src->uv[0] * TERRAIN_UV_STEP,
+            src->uv[1] * TERRAIN_UV_STEP,
+        };
+        dst->normal = oct_decode(src->normal);
+
+        dst->material_idx = src->material_idx;
+        dst->blend_mode = src->blend_mode;
+        dst->middle_indices = src->middle_indices;
+        CPY2(dst->c1_indices, src->c1_indices);
+        CPY2(dst->c2_indices, src->c2_indices);
+        dst->tb_indices = src->tb_indices;
+        dst->lr_indices = src->lr_indices;
+    }
+}
+
+void R_GL_TerrainInit(struct render_private *priv, const char *shader, 
+                      const struct terrain_vert_packed *vbuff, const size_t *nverts,
+                      const uint32_t *ibuff)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+    struct mesh *mesh = &priv->mesh;
+
+    size_t nindices = 0;
+    if(priv->lods_valid) {
+        nindices = priv->lod_first[priv->num_lods-1] + priv->lod_count[priv->num_lods-1];
+    }
+
+    glGenVertexArrays(1, &mesh->VAO);
+    glBindVertexArray(mesh->VAO);
+
+    glGenBuffers(1, &mesh->VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+    glBufferData(GL_ARRAY_BUFFER, *nverts * sizeof(struct terrain_vert_packed), vbuff, GL_STATIC_DRAW);
+    terrain_setup_attribs();
+
+    /* The element buffer binding is part of the VAO state */
+    priv->lod_indices = 0;
+    if(nindices > 0) {
+        glGenBuffers(1, &priv->lod_indices);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv->lod_indices);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, nindices * sizeof(uint32_t), ibuff, GL_STATIC_DRAW);
+    }
+    glBindVertexArray(0);
+
+    priv->material_ubo = 0;
+    priv->shader_prog = R_GL_Shader_GetProgForName(shader);
+    priv->shader_prog_dp = R_GL_Shader_GetProgForName("terrain.depth");
+    assert(priv->shader_prog != -1 && priv->shader_prog_dp != -1);
+
+    R_GL_ShadowsInvalidateStatic();
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_TerrainFree(struct render_private *priv)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    glDeleteVertexArrays(1, &priv->mesh.VAO);
+    glDeleteBuffers(1, &priv->mesh.VBO);
+    if(priv->lod_indices) {
+        glDeleteBuffers(1, &priv->lod_indices);
+    }
+
+    priv->mesh.VAO = 0;
+    priv->mesh.VBO = 0;
+    priv->lod_indices = 0;
+    R_GL_ShadowsInvalidateStatic();
+
     GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
 }
 
 void R_GL_TileUpdate(void *chunk_rprivate, const struct map *map, const struct tile_desc *desc)
@@ -976,24 +1438,50 @@ void R_GL_TileUpdate(void *chunk_rprivate, const struct map *map, const struct t
 
     struct render_private *priv = chunk_rprivate;
 
-    struct tile *tile;
-    int ret = M_TileForDesc(map, *desc, &tile);
-    assert(ret);
+    /* The chunk's mesh will be built from the up-to-date tiles when it 
+     * is made resident again */
+    if(!priv->mesh.VAO)
+        GL_PERF_RETURN_VOID();
+
+    /* The vertices are built and patched in client memory, so that the 
+     * buffer range only needs to be written once */
+    struct terrain_vert_packed verts[VERTS_PER_TILE];
+    tile_build_verts(map, desc, verts);
 
-    size_t offset = (desc->tile_r * TILES_PER_CHUNK_WIDTH + desc->tile_c) * VERTS_PER_TILE * sizeof(struct terrain_vert);
-    size_t length = VERTS_PER_TILE * sizeof(struct terrain_vert);
+    size_t offset = (desc->tile_r * TILES_PER_CHUNK_WIDTH + desc->tile_c) * sizeof(verts);
     glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
-    struct terrain_vert *vert_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_WRITE_BIT);
-    assert(vert_base);
-    
-    R_TileGetVertices(map, *desc, vert_base);
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(verts), verts);
 
-    R_GL_TilePatchVertsBlend(chunk_rprivate, map, desc);
-    if(tile->blend_normals) {
-        R_GL_TilePatchVertsSmooth(chunk_rprivate, map, desc);
+    priv->lods_valid = false;
+    R_GL_ShadowsInvalidateStatic();
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_TileUpdateBatch(void *chunk_rprivate, const size_t *ntiles, 
+                          const struct tile_desc *descs, const struct terrain_vert_packed *verts)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    struct render_private *priv = chunk_rprivate;
+    if(!priv->mesh.VAO)
+        GL_PERF_RETURN_VOID();
+
+    size_t length = VERTS_PER_TILE * sizeof(struct terrain_vert_packed);
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+
+    for(size_t i = 0; i < *ntiles; i++) {
+
+        const struct tile_desc *desc = &descs[i];
+        size_t offset = (desc->tile_r * TILES_PER_CHUNK_WIDTH + desc->tile_c) * length;
+        glBufferSubData(GL_ARRAY_BUFFER, offset, length, verts + i * VERTS_PER_TILE);
     }
 
+    priv->lods_valid = false;
+    R_GL_ShadowsInvalidateStatic();
+
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
@@ -46,6 +46,8 @@
 #include "../lib/public/mem.h"
 
 #include <assert.h>
+#include <string.h>
+#include <stdlib.h>
 
 #include <GL/glew.h>
 
@@ -60,6 +62,17 @@ static struct render_ui_ctx{
     GLuint VAO;
 }s_ctx;
 
+/* The draw commands of the last uploaded frame. Its vertex and element data 
+ * stays in the VBO and EBO until the next upload. The cache owns the userdata 
+ * attached to the commands.
+ */
+static struct render_ui_cache{
+    bool                valid;
+    struct nk_draw_list dl;
+    struct nk_buffer    cmds;
+    size_t              capacity;
+}s_cache;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -102,8 +115,6 @@ static void exec_draw_commands(const struct nk_draw_list *dl, GLuint shader_prog
                     .val.as_mat4 = ortho
                 });
                 R_GL_StateInstall(GL_U_PROJECTION, R_GL_Shader_GetCurrActive());
-
-                PF_FREE(ud);
                 continue;
             }
             case NK_COMMAND_IMAGE_TEXPATH: {
@@ -115,8 +126,6 @@ static void exec_draw_commands(const struct nk_draw_list *dl, GLuint shader_prog
             }
             default: assert(0);
             }
-
-            PF_FREE(ud);
         }
 
         if(!cmd->elem_count) 
@@ -137,6 +146,78 @@ static void exec_draw_commands(const struct nk_draw_list *dl, GLuint shader_prog
     GL_PERF_RETURN_VOID();
 }
 
+static void free_userdata(const struct nk_draw_list *dl)
+{
+    const struct nk_draw_command *cmd;
+    for(cmd = nk__draw_list_begin(dl, dl->buffer); cmd; 
+        cmd = nk__draw_list_next(cmd, dl->buffer, dl)) {
+        free(cmd->userdata.ptr);
+    }
+}
+
+static void cache_clear(void)
+{
+    if(s_cache.valid) {
+        free_userdata(&s_cache.dl);
+    }
+    s_cache.valid = false;
+}
+
+/* Take a copy of the draw commands, which are stored at the back of the 
+ * command buffer, and take ownership of their userdata. The first command
+ * is 'cmd_offset' bytes from the end of the buffer and the following ones
+ * are allocated towards the front, so the whole back region is copied. 
+ */
+static void cache_store(const struct nk_draw_list *dl)
+{
+    cache_clear();
+    size_t size = dl->buffer->memory.size - dl->buffer->size;
+
+    if(size > s_cache.capacity) {
+        void *mem = realloc(s_cache.cmds.memory.ptr, size);
+        if(!mem) {
+            free_userdata(dl);
+            return;
+        }
+        s_cache.cmds.memory.ptr = mem;
+        s_cache.capacity = size;
+    }
+
+    const nk_byte *src = dl->buffer->memory.ptr;
+    memcpy(s_cache.cmds.memory.ptr, src + dl->buffer->size, size);
+    s_cache.cmds.memory.size = size;
+    /* The back region starts at 0 in the copy, but nuklear won't iterate
+     * the commands of a buffer with a zero 'size' */
+    s_cache.cmds.size = size;
+
+    s_cache.dl = *dl;
+    s_cache.dl.buffer = &s_cache.cmds;
+    s_cache.valid = true;
+}
+
+static void setup_render_state(void)
+{
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_SCISSOR_TEST);
+
+    int w, h, x = 0, y = 0;
+    Engine_WinDrawableSize(&w, &h);
+    R_GL_SetViewport(&x, &y, &w, &h);
+}
+
+static void cleanup_render_state(void)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -193,6 +274,10 @@ void R_GL_UI_Shutdown(void)
     glDeleteBuffers(1, &s_ctx.EBO);
     glDeleteVertexArrays(1, &s_ctx.VAO);
 
+    cache_clear();
+    PF_FREE(s_cache.cmds.memory.ptr);
+    memset(&s_cache, 0, sizeof(s_cache));
+
     GL_ASSERT_OK();
 }
 
@@ -202,16 +287,7 @@ void R_GL_UI_Render(const struct nk_draw_list *dl)
     ASSERT_IN_RENDER_THREAD();
 
     /* setup global state */
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_SCISSOR_TEST);
-
-    int w, h, x = 0, y = 0;
-    Engine_WinDrawableSize(&w, &h);
-    R_GL_SetViewport(&x, &y, &w, &h);
+    setup_render_state();
 
     /* setup program */
     GLuint shader_prog = R_GL_Shader_GetProgForName("ui");
@@ -228,13 +304,35 @@ void R_GL_UI_Render(const struct nk_draw_list *dl)
 
     /* iterate over and execute each draw command */
     exec_draw_commands(dl, shader_prog);
+    cache_store(dl);
 
     /* cleanup state */
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glDisable(GL_BLEND);
-    glDisable(GL_SCISSOR_TEST);
+    cleanup_render_state();
+
+    GL_ASSERT_OK();
+    GL_PERF_RETURN_VOID();
+}
+
+void R_GL_UI_RenderCached(void)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    if(!s_cache.valid)
+        GL_PERF_RETURN_VOID();
+
+    setup_render_state();
+
+    GLuint shader_prog = R_GL_Shader_GetProgForName("ui");
+    assert(shader_prog);
+    R_GL_Shader_InstallProg(shader_prog);
+
+    glBindVertexArray(s_ctx.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_ctx.VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, s_ctx.EBO);
+
+    exec_draw_commands(&s_cache.dl, shader_prog);
+    cleanup_render_state();
 
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
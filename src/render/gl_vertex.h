@@ -77,6 +77,29 @@ struct terrain_vert{
     uint32_t  lr_indices;
 };
 
+/* The layout of the terrain vertices in video memory. The positions are 
+ * quantized relative to the center of the chunk, the normals are octahedron-
+ * encoded and the material indices are narrowed to 8 bits, which all the 
+ * blending masks already assume. The steps are in world units and must 
+ * match the ones used by the terrain shaders. */
+#define TERRAIN_POS_STEP_XZ     (1.0f/128)
+#define TERRAIN_POS_STEP_Y      (1.0f/32)
+#define TERRAIN_UV_STEP         (1.0f/256)
+
+struct terrain_vert_packed{
+    int16_t   pos[3];
+    uint8_t   material_idx;
+    uint8_t   blend_mode;
+    int16_t   uv[2];
+    int16_t   normal[2];
+    uint16_t  middle_indices;
+    uint16_t  padding;
+    uint32_t  c1_indices[2];
+    uint32_t  c2_indices[2];
+    uint32_t  tb_indices;
+    uint32_t  lr_indices;
+};
+
 struct colored_vert{
     vec3_t pos;
     vec4_t color;
@@ -63,6 +63,12 @@ struct render_water_ctx{
     struct texture normal;
     GLfloat        move_factor;
     uint32_t       prev_frame_tick;
+    /* The reflection texture is kept between frames so that it doesn't 
+     * need to be redrawn on every frame at the lowest quality. */
+    GLuint         reflect_tex;
+    int            reflect_w, reflect_h;
+    int            reflect_age;
+    mat4x4_t       reflect_view_proj;
 };
 
 struct water_gl_state{
@@ -87,6 +93,9 @@ struct water_gl_state{
 #define REFRACT_DEPTH_TUNIT GL_TEXTURE4
 #define VISBUFF_TUNIT       GL_TEXTURE5
 
+/* In frames, for WATER_QUALITY_LOW */
+#define REFLECT_UPDATE_INTERVAL (2)
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -129,12 +138,19 @@ static void restore_gl_state(const struct water_gl_state *in)
     GL_PERF_RETURN_VOID();
 }
 
-static int wbuff_width(void)
+static int wbuff_width(enum water_quality quality)
 {
     ASSERT_IN_RENDER_THREAD();
 
     int viewport[4];
     glGetIntegerv(GL_VIEWPORT, viewport);
+
+    switch(quality) {
+    case WATER_QUALITY_HIGH:    return viewport[2] / 2.5f;
+    case WATER_QUALITY_MEDIUM:  return viewport[2] / 5.0f;
+    case WATER_QUALITY_LOW:     return viewport[2] / 10.0f;
+    default: assert(0);
+    }
     return viewport[2] / 2.5f;
 }
 
@@ -212,6 +228,8 @@ static void render_refraction_tex(GLuint clr_tex, GLuint depth_tex, bool on, str
 
     if(on) {
         GL_PERF_PUSH_GROUP(0, "water::RenderMapAndEntities");
+        in.occlusion_capture = false;
+        in.depth_prepass = false;
         G_RenderMapAndEntities(&in);
         GL_PERF_POP_GROUP();
     }
@@ -225,7 +243,7 @@ static void render_refraction_tex(GLuint clr_tex, GLuint depth_tex, bool on, str
     GL_PERF_RETURN_VOID();
 }
 
-static void render_reflection_tex(GLuint tex, bool on, struct render_input in)
+static void render_reflection_tex(GLuint tex, bool on, bool static_only, struct render_input in)
 {
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
@@ -289,6 +307,17 @@ static void render_reflection_tex(GLuint tex, bool on, struct render_input in)
     /* Render to the texture */
     GL_PERF_PUSH_GROUP(0, "water::RenderMapAndEntities");
     in.shadows = false;
+    /* The culling frustum is that of the unflipped camera */
+    in.gpu_culling = false;
+    in.occlusion_capture = false;
+    in.depth_prepass = false;
+    if(static_only) {
+        vec_ranim_init(&in.cam_vis_anim);
+        vec_ranim_init(&in.light_vis_anim);
+    }
+    /* The impostors are baked for the elevation of the regular camera. The 
+     * flipped one would have them re-baked on every pass. */
+    vec_rimp_init(&in.cam_vis_imp);
     G_RenderMapAndEntities(&in);
     GL_PERF_POP_GROUP();
 
@@ -462,6 +491,62 @@ static void setup_model_mat(GLuint shader_prog, const struct map *map)
     GL_PERF_RETURN_VOID();
 }
 
+static void setup_reflect_uniforms(GLuint shader_prog, const mat4x4_t *view_proj)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    R_GL_StateSet(GL_U_REFLECT_VIEW_PROJ, (struct uval){
+        .type = UTYPE_MAT4,
+        .val.as_mat4 = *view_proj
+    });
+    R_GL_StateInstall(GL_U_REFLECT_VIEW_PROJ, shader_prog);
+
+    GL_PERF_RETURN_VOID();
+}
+
+static void curr_view_proj(mat4x4_t *out)
+{
+    struct uval view, proj;
+    R_GL_StateGet(GL_U_VIEW, &view);
+    R_GL_StateGet(GL_U_PROJECTION, &proj);
+    PFM_Mat4x4_Mult4x4(&proj.val.as_mat4, &view.val.as_mat4, out);
+}
+
+/* Returns the reflection texture to use for this frame. At the lowest quality, 
+ * the texture is only redrawn every REFLECT_UPDATE_INTERVAL frames and the 
+ * water shader reprojects into it using the transform it was drawn with. */
+static GLuint cached_reflection_tex(int w, int h, enum water_quality quality, 
+                                    const struct render_input *in, mat4x4_t *out_view_proj)
+{
+    GL_PERF_ENTER();
+    ASSERT_IN_RENDER_THREAD();
+
+    bool stale = (quality != WATER_QUALITY_LOW)
+              || (++s_ctx.reflect_age >= REFLECT_UPDATE_INTERVAL);
+
+    if(!s_ctx.reflect_tex || s_ctx.reflect_w != w || s_ctx.reflect_h != h) {
+
+        if(s_ctx.reflect_tex) {
+            glDeleteTextures(1, &s_ctx.reflect_tex);
+        }
+        s_ctx.reflect_tex = make_new_tex(w, h);
+        s_ctx.reflect_w = w;
+        s_ctx.reflect_h = h;
+        stale = true;
+    }
+    assert(s_ctx.reflect_tex > 0);
+
+    if(stale) {
+        curr_view_proj(&s_ctx.reflect_view_proj);
+        render_reflection_tex(s_ctx.reflect_tex, true, quality != WATER_QUALITY_HIGH, *in);
+        s_ctx.reflect_age = 0;
+    }
+
+    *out_view_proj = s_ctx.reflect_view_proj;
+    GL_PERF_RETURN(s_ctx.reflect_tex);
+}
+
 static void setup_move_factor(GLuint shader_prog)
 {
     GL_PERF_ENTER();
@@ -551,12 +636,16 @@ void R_GL_WaterShutdown(void)
 
     glDeleteVertexArrays(1, &s_ctx.surface.VAO);
     glDeleteBuffers(1, &s_ctx.surface.VBO);
+    if(s_ctx.reflect_tex) {
+        glDeleteTextures(1, &s_ctx.reflect_tex);
+    }
     memset(&s_ctx, 0, sizeof(s_ctx));
 
     GL_PERF_RETURN_VOID();
 }
 
-void R_GL_DrawWater(const struct render_input *in, const bool *refraction, const bool *reflection)
+void R_GL_DrawWater(const struct render_input *in, const bool *refraction, 
+                    const bool *reflection, const int *quality)
 {
     GL_PERF_ENTER();
     ASSERT_IN_RENDER_THREAD();
@@ -565,7 +654,7 @@ void R_GL_DrawWater(const struct render_input *in, const bool *refraction, const
     struct water_gl_state state;
     save_gl_state(&state);
 
-    int w = wbuff_width();
+    int w = wbuff_width(*quality);
     int h = wbuff_height(w);
 
     GLuint refract_tex = make_new_tex(w, h);
@@ -576,9 +665,17 @@ void R_GL_DrawWater(const struct render_input *in, const bool *refraction, const
 
     render_refraction_tex(refract_tex, refract_depth, *refraction, *in);
 
-    GLuint reflect_tex = make_new_tex(w, h);
-    assert(reflect_tex > 0);
-    render_reflection_tex(reflect_tex, *reflection, *in);
+    GLuint reflect_tex;
+    mat4x4_t reflect_view_proj;
+
+    if(*reflection) {
+        reflect_tex = cached_reflection_tex(w, h, *quality, in, &reflect_view_proj);
+    }else{
+        reflect_tex = make_new_tex(w, h);
+        assert(reflect_tex > 0);
+        curr_view_proj(&reflect_view_proj);
+        render_reflection_tex(reflect_tex, false, false, *in);
+    }
 
     restore_gl_state(&state);
 
@@ -592,6 +689,7 @@ void R_GL_DrawWater(const struct render_input *in, const bool *refraction, const
     setup_model_mat(shader_prog, in->map);
     setup_move_factor(shader_prog);
     setup_tiling_uniforms(shader_prog, in->map);
+    setup_reflect_uniforms(shader_prog, &reflect_view_proj);
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -605,7 +703,9 @@ void R_GL_DrawWater(const struct render_input *in, const bool *refraction, const
 
     glDeleteTextures(1, &refract_tex);
     glDeleteTextures(1, &refract_depth);
-    glDeleteTextures(1, &reflect_tex);
+    if(!*reflection) {
+        glDeleteTextures(1, &reflect_tex);
+    }
 
     GL_PERF_POP_GROUP();
     GL_ASSERT_OK();
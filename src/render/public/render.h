@@ -41,6 +41,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <SDL.h> /* for SDL_RWops */
 
@@ -57,6 +58,8 @@ struct nk_draw_list;
 struct map_resolution;
 struct obb;
 struct aabb;
+struct texture_load;
+struct terrain_vert_packed;
 
 enum render_pass{
     RENDER_PASS_DEPTH,
@@ -73,7 +76,36 @@ struct ui_vert{
 #define VERTS_PER_TOP_FACE  (24)
 #define VERTS_PER_TILE      (4 * VERTS_PER_SIDE_FACE + VERTS_PER_TOP_FACE)
 #define TILE_DEPTH          (3)
+/* Level 0 is the full-detail chunk mesh */
+#define TERRAIN_NUM_LODS    (3)
 #define MAX_MATERIALS       (16)
+#define R_SHADOW_MAX_CASCADES (4)
+
+/* One slice of the shadow map. With a single cascade, it covers the same 
+ * fixed region around the camera as the classic shadow map. */
+struct shadow_cascade{
+    /* The projection * view matrix of the light for this slice */
+    mat4x4_t light_space;
+    /* The side length (in texels) of the part of the layer that is drawn */
+    int      res;
+    /* When not set, the layer drawn on a previous frame is reused as-is */
+    bool     update;
+};
+
+/* The per-instance state of a projectile. Its' orientation is derived from 
+ * the velocity on the GPU. */
+struct proj_rstate{
+    vec3_t pos;
+    vec3_t vel;
+    vec3_t scale;
+};
+
+/* A range of instances sharing the same model */
+struct proj_rgroup{
+    const void *render_private;
+    size_t      first;
+    size_t      count;
+};
 
 
 /*###########################################################################*/
@@ -87,6 +119,14 @@ struct ui_vert{
  */
 void   R_GL_Draw(const void *render_private, mat4x4_t *model, const bool *translucent);
 
+/* ---------------------------------------------------------------------------
+ * Draw a terrain chunk using one of its' reduced-detail meshes. Level 0 is the 
+ * full mesh. Chunks which have been modified since they were loaded fall back 
+ * to the full mesh.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_DrawTerrainLOD(const void *render_private, mat4x4_t *model, const int *lod);
+
 /* ---------------------------------------------------------------------------
  * Clear the draw buffer and set up the global OpenGL state at the beginning 
  * of the frame.
@@ -107,11 +147,11 @@ void   R_GL_SetViewMatAndPos(const mat4x4_t *view, const vec3_t *pos);
 void   R_GL_SetProj(const mat4x4_t *proj);
 
 /* ---------------------------------------------------------------------------
- * Set OpenGL uniforms for animation-related shader programs.
+ * Set OpenGL uniforms for animation-related shader programs. 'pose_base' is
+ * the index of the entity's first skinning matrix in the shared pose buffer.
  * ---------------------------------------------------------------------------
  */
-void   R_GL_SetAnimUniforms(mat4x4_t *inv_bind_poses, mat4x4_t *curr_poses, 
-                            mat4x4_t *normal_mat, const size_t *count);
+void   R_GL_SetAnimUniforms(mat4x4_t *normal_mat, const size_t *pose_base);
 
 /* ---------------------------------------------------------------------------
  * Set the global ambient color that will impact all models based on their 
@@ -260,12 +300,31 @@ void   R_GL_DrawLoadingScreen(void);
  * Draws the healthbars for the following 'num_ents'. 'ent_health_pc' must be
  * initialized to a buffer of 'num_ents' floats (health percentages) and 
  * 'ent_top_pos_ws' must be initialized to a buffer of 'num_ents' worldspace
- * positions (the top center of the entity's OBB).
+ * positions (the top center of the entity's OBB). The positions are projected
+ * to screenspace in the shader and all the bars are drawn in a single call.
  * ---------------------------------------------------------------------------
  */
 void   R_GL_DrawHealthbars(const size_t *num_ents, GLfloat *ent_health_pc, 
                            vec3_t *ent_top_pos_ws, int *yoffsets, const struct camera *cam);
 
+#define R_ICON_ATLAS_SLOTS (1024)
+
+/* ---------------------------------------------------------------------------
+ * Copy the icon image at 'path' into the 'slot'-th cell of the icon atlas.
+ * If the image isn't resident yet, the copy is retried on later frames.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_IconAtlasSet(const int *slot, const char *path);
+
+/* ---------------------------------------------------------------------------
+ * Draws 'num_icons' icons from the atlas in a single instanced call. Each icon
+ * is centered 'offsets' pixels (at a 1080p vertical resolution) away from the
+ * screenspace projection of its' worldspace position.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_DrawIcons(const size_t *num_icons, vec3_t *pos_ws, vec2_t *offsets, 
+                      int *slots, const struct camera *cam);
+
 /* ---------------------------------------------------------------------------
  * Render an entity's combined hybrid reciprocal velocity obstacle. (the union
  * of all dynamic neighbours' HRVOs and static neighbours' VOs). There should
@@ -302,6 +361,14 @@ void   R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rpriv
  */
 void   R_GL_TileUpdate(void *chunk_rprivate, const struct map *map, const struct tile_desc *desc);
 
+/* ---------------------------------------------------------------------------
+ * Upload the already-built and packed vertex data (VERTS_PER_TILE vertices 
+ * each) of 'ntiles' tiles of a single chunk, in the order of 'descs'.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_TileUpdateBatch(void *chunk_rprivate, const size_t *ntiles, 
+                            const struct tile_desc *descs, const struct terrain_vert_packed *verts);
+
 /*###########################################################################*/
 /* RENDER MINIMAP                                                            */
 /*###########################################################################*/
@@ -315,12 +382,13 @@ void  R_GL_MinimapBake(const struct map *map, void **chunk_rprivates,
                        mat4x4_t *chunk_model_mats);
 
 /* ---------------------------------------------------------------------------
- * Update a chunk-sized region of the minimap texture with up-to-date mesh 
- * data.
+ * Update the chunk-sized regions of the minimap texture for 'nchunks' chunks 
+ * with up-to-date mesh data, in a single pass.
  * ---------------------------------------------------------------------------
  */
-void  R_GL_MinimapUpdateChunk(const struct map *map, void *chunk_rprivate, 
-                              mat4x4_t *chunk_model, const int *chunk_r, const int *chunk_c);
+void  R_GL_MinimapUpdateChunks(const struct map *map, const size_t *nchunks, 
+                               void **chunk_rprivates, mat4x4_t *chunk_models, 
+                               const int *chunk_rs, const int *chunk_cs);
 
 /* ---------------------------------------------------------------------------
  * Render the minimap centered at the specified (virtual) screenscape coordinate.
@@ -367,10 +435,10 @@ void  R_GL_TilePatchVertsSmooth(void *chunk_rprivate, const struct map *map, con
 /*###########################################################################*/
 
 /* ---------------------------------------------------------------------------
- * Initialize map texture array with the specified list of textures.
+ * Initialize map texture array with the specified list of decoded textures.
  * ---------------------------------------------------------------------------
  */
-void  R_GL_MapInit(const char map_texfiles[][256], const size_t *num_textures, 
+void  R_GL_MapInit(struct texture_load *const *loads, const size_t *num_textures, 
                    const struct map_resolution *res);
 
 /* ---------------------------------------------------------------------------
@@ -393,10 +461,12 @@ void  R_GL_MapBegin(const bool *shadows, const vec2_t *pos);
 void  R_GL_MapEnd(void);
 
 /* ---------------------------------------------------------------------------
- * Send the current-frame fog-of-war information to the rendering susbsystem.
+ * Update the fog-of-war state of the specified chunks. 'chunks' holds the 
+ * ascending indices (chunk_r * chunk_w + chunk_c) of the changed chunks and
+ * 'buff' holds the per-tile states of each of them in turn.
  * ---------------------------------------------------------------------------
  */
-void  R_GL_MapUpdateFog(void *buff, const size_t *size);
+void  R_GL_MapUpdateFog(void *buff, const int *chunks, const size_t *nchunks);
 
 /* ---------------------------------------------------------------------------
  * Must be Called once per frame when we are sure there will be no more draw 
@@ -410,12 +480,26 @@ void  R_GL_MapInvalidate(void);
 /*###########################################################################*/
 
 /* ---------------------------------------------------------------------------
- * Set up the rendering context for the depth pass. This _must_ be called
- * before any calls to 'R_GL_RenderDepthMap'. Afterwards, there _must_ be 
- * a matching call to 'R_GL_DepthPassEnd'.
+ * Set up the rendering context for the depth pass of the cascade 'idx' (out 
+ * of 'ncascades'). This _must_ be called before any calls to 
+ * 'R_GL_RenderDepthMap'. Afterwards, there _must_ be a matching call to 
+ * 'R_GL_DepthPassEnd'.
  * ---------------------------------------------------------------------------
  */
-void R_GL_DepthPassBegin(const vec3_t *light_pos, const vec3_t *cam_pos, const vec3_t *cam_dir);
+void R_GL_DepthPassBegin(const struct shadow_cascade *cascade, const int *idx, 
+                         const int *ncascades);
+
+/* ---------------------------------------------------------------------------
+ * Bracket the rendering of the casters which do not move (the map and the 
+ * static entities). They are drawn into a static layer that is cached across 
+ * frames, and the 'R_GL_RenderDepthMap' calls in between become no-ops for 
+ * as long as the light transform and 'static_hash' (a hash of the set of 
+ * static casters) remain the same. 'R_GL_DepthPassEndStatic' copies the static 
+ * layer into the depth map, after which the dynamic casters are drawn on top.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_DepthPassBeginStatic(const uint64_t *static_hash);
+void R_GL_DepthPassEndStatic(void);
 
 /* ---------------------------------------------------------------------------
  * Set up the rendering context for normal rendering. This _must_ be called
@@ -424,6 +508,14 @@ void R_GL_DepthPassBegin(const vec3_t *light_pos, const vec3_t *cam_pos, const v
  */
 void R_GL_DepthPassEnd(void);
 
+/* ---------------------------------------------------------------------------
+ * Set the cascades that the shadowed shaders will sample from. This must be
+ * called after the depth passes of the frame, with all the cascades (including
+ * the ones which were not updated).
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_ShadowsSetCascades(const struct shadow_cascade *cascades, const int *ncascades);
+
 /* ---------------------------------------------------------------------------
  * Update the depth map for the mesh. The depth map will then be used for 
  * rendering shadows on the 'regular' render pass.
@@ -460,11 +552,22 @@ void R_GL_WaterInit(void);
  */
 void R_GL_WaterShutdown(void);
 
+enum water_quality{
+    /* Reflection and refraction are drawn at the full water buffer resolution */
+    WATER_QUALITY_HIGH = 0,
+    /* Half resolution - only the terrain and the static meshes are reflected */
+    WATER_QUALITY_MEDIUM,
+    /* Quarter resolution, as above, and the reflection is only redrawn every 
+     * other frame */
+    WATER_QUALITY_LOW,
+};
+
 /* ---------------------------------------------------------------------------
- * Renders the water layer for the given map.
+ * Renders the water layer for the given map. 'quality' is one of 'enum water_quality'.
  * ---------------------------------------------------------------------------
  */
-void R_GL_DrawWater(const struct render_input *in, const bool *refraction, const bool *reflection);
+void R_GL_DrawWater(const struct render_input *in, const bool *refraction, 
+                    const bool *reflection, const int *quality);
 
 
 /*###########################################################################*/
@@ -490,6 +593,13 @@ void R_GL_UI_Shutdown(void);
  */
 void R_GL_UI_Render(const struct nk_draw_list *dl);
 
+/* ---------------------------------------------------------------------------
+ * Render the UI again using the draw commands and vertex data of the last 
+ * call to 'R_GL_UI_Render'. For frames where the UI has not changed.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_UI_RenderCached(void);
+
 /* ---------------------------------------------------------------------------
  * Upload the specified font atlas texture
  * ---------------------------------------------------------------------------
@@ -515,6 +625,14 @@ enum batch_id{
  */
 void R_GL_Batch_Draw(struct render_input *in);
 
+/* ---------------------------------------------------------------------------
+ * Write only the depth of the opaque camera-visible entities, so that the 
+ * subsequent 'R_GL_Batch_Draw' and the terrain shade just the fragments 
+ * which end up visible. The depths are biased slightly away from the camera.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_Batch_DrawDepthPrepass(struct render_input *in);
+
 /* ---------------------------------------------------------------------------
  * Like 'R_GL_Batch_Draw' but using the specified batch instead of per-chunk batches.
  * ---------------------------------------------------------------------------
@@ -529,6 +647,14 @@ void R_GL_Batch_DrawWithID(struct render_input *in, enum batch_id *id);
  */
 void R_GL_Batch_RenderDepthMap(struct render_input *in);
 
+/* ---------------------------------------------------------------------------
+ * Like 'R_GL_Batch_RenderDepthMap', but for the static light-visible entities
+ * only. Must be called in the static section of the depth pass, and does 
+ * nothing when the static shadow layer is cached.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_Batch_RenderStaticDepthMap(struct render_input *in);
+
 /* ---------------------------------------------------------------------------
  * Free all the resources used by live batches. Free all the per-chunk batches,
  * resetting the state of the module to that at initialization time.
@@ -571,35 +697,169 @@ void R_GL_PositionsInvalidateData(void);
 
 
 /*###########################################################################*/
-/* RENDER MOVEMENT                                                           */
+/* RENDER LOS                                                                */
+/*###########################################################################*/
+
+/* ---------------------------------------------------------------------------
+ * Compute the line of sight masks for a batch of chunks. 'jobs' holds an 
+ * ivec4 header (mask rows, mask columns, words per mask row, 0) followed by 
+ * an ivec4 (chunk row, chunk column, target row, target column) for every
+ * job, all in tiles relative to the mask origin. 'mask' is a bitmask of the 
+ * blocked tiles, in row-major order. 'chunk_res' holds the number of tile 
+ * rows and columns of a chunk. The results are tagged with 'batch'.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_LOSDispatch(void *jobs, const size_t *njobs, void *mask, const size_t *mask_size,
+                      const int chunk_res[2], const uint32_t *batch);
+
+/* ---------------------------------------------------------------------------
+ * Read back the results of the oldest dispatch that has not yet been read,
+ * without blocking. For every job, the visibility of the chunk's tiles is 
+ * written as a row-major bitmask. 'out_nread' is set to the number of 32-bit 
+ * words read (possibly 0) once the call is complete, and 'out_batch' to the 
+ * tag of the dispatch.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_LOSRead(void *out, const size_t *maxout, uint32_t *out_batch, SDL_atomic_t *out_nread);
+
+/* ---------------------------------------------------------------------------
+ * Free the buffers used by the LOS compute work.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_LOSShutdown(void);
+
+
+/*###########################################################################*/
+/* RENDER HI-Z                                                               */
 /*###########################################################################*/
 
 /* ---------------------------------------------------------------------------
- * Upload the movement input state to a shader storage buffer object.
+ * Reduce the current contents of the depth buffer to a grid holding the 
+ * farthest depth of every 16x16 pixel block, and queue it for readback.
+ * 'view_proj' is the matrix the depth was rendered with, and is returned
+ * along with the results.
  * ---------------------------------------------------------------------------
  */
-void R_GL_MoveUploadData(void *buff, size_t *nents, size_t *buffsize);
+void R_GL_HiZCapture(const mat4x4_t *view_proj);
+
+/* ---------------------------------------------------------------------------
+ * Read back the oldest capture that has not yet been read, without blocking.
+ * The depth grid is written to 'out' in row-major order, starting from the
+ * bottom row of the screen, and its dimensions to 'out_dims'. 'out_nread' 
+ * is set to the number of floats read (possibly 0) once the call is complete.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_HiZRead(void *out, const size_t *maxout, int out_dims[2], 
+                  mat4x4_t *out_view_proj, SDL_atomic_t *out_nread);
+
+/* ---------------------------------------------------------------------------
+ * Free the resources used for the depth captures.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_HiZShutdown(void);
+
+
+/*###########################################################################*/
+/* RENDER DYNAMIC RESOLUTION                                                 */
+/*###########################################################################*/
+
+/* ---------------------------------------------------------------------------
+ * Toggle rendering the 3D scene at a variable scale of the native resolution.
+ * The scale follows the GPU time of the scene, measured with timestamp 
+ * queries, to keep it under the target. The UI is always drawn at the native
+ * resolution.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_DynresSetEnabled(const bool *on);
+
+/* ---------------------------------------------------------------------------
+ * Set the GPU time budget for the 3D scene, in milliseconds.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_DynresSetTarget(const float *ms);
+
+/* ---------------------------------------------------------------------------
+ * Set the lowest scale (in the range of (0, 1]) the scene may be rendered at.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_DynresSetMinScale(const float *scale);
+
+/* ---------------------------------------------------------------------------
+ * Free the offscreen target and the timer queries.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_DynresShutdown(void);
+
+
+/*###########################################################################*/
+/* RENDER POSE BUFFER                                                        */
+/*###########################################################################*/
+
+/* ---------------------------------------------------------------------------
+ * Write 'count' skinning matrices to the shared pose buffer, starting at the
+ * 'base'-th matrix. The buffer is grown as needed.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_PoseBuffUpload(const mat4x4_t *mats, const size_t *base, const size_t *count);
+
+/* ---------------------------------------------------------------------------
+ * Free the shared pose buffer.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_PoseBuffShutdown(void);
+
+
+/*###########################################################################*/
+/* RENDER IMPOSTORS                                                          */
+/*###########################################################################*/
+
+/* ---------------------------------------------------------------------------
+ * Draw the camera-visible impostors of the render input as instanced, 
+ * camera-facing quads. The views of an animated mesh's frame are rendered
+ * on first use, from 8 directions around it, and kept in a shared atlas
+ * from which the least recently drawn frames are evicted.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_ImpostorDraw(struct render_input *in);
+
+/* ---------------------------------------------------------------------------
+ * Forget all the rendered views, for when the meshes they were made from 
+ * may have been freed.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_ImpostorReset(void);
+
+/* ---------------------------------------------------------------------------
+ * Free the atlas and the other GPU resources.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_ImpostorShutdown(void);
+
+
+/*###########################################################################*/
+/* RENDER PROJECTILES                                                        */
+/*###########################################################################*/
 
 /* ---------------------------------------------------------------------------
- * Free resources previously allocated by R_GL_MoveUploadData. This must be 
- * done after the compute work has finished running and the results have been
- * read back by the CPU.
+ * Draw all the projectiles with a single upload of the instance state. 'insts'
+ * must hold the instances of every group contiguously. Each group is drawn 
+ * with one instanced draw call.
  * ---------------------------------------------------------------------------
  */
-void R_GL_MoveInvalidateData(void);
+void R_GL_ProjectilesDraw(const struct proj_rstate *insts, const size_t *ninsts,
+                          const struct proj_rgroup *groups, const size_t *ngroups);
 
 /* ---------------------------------------------------------------------------
- * Dispatch the compute work for deriving the new velocities of the entities.
+ * Free the buffers used for drawing the projectiles.
  * ---------------------------------------------------------------------------
  */
-void R_GL_MoveDispatchWork(const size_t *nents);
+void R_GL_ProjectilesShutdown(void);
 
 /* ---------------------------------------------------------------------------
- * Read back the results of the previously dispatched compute work. This will
- * block until the work is finished and the results are read back.
+ * Free the icon atlas and the buffers used for drawing the icons.
  * ---------------------------------------------------------------------------
  */
-void R_GL_MoveReadNewVelocities(void *out, const size_t *nents, const size_t *maxout);
+void R_GL_IconsShutdown(void);
 
 
 #endif
@@ -42,13 +42,42 @@
 struct pfobj_hdr;
 struct map;
 struct tile;
+struct map_resolution;
+struct tile_desc;
 
 /* ---------------------------------------------------------------------------
  * Consumes lines of the stream and uses them to populate a new private context
- * for the model. The context is returned in a malloc'd buffer.
+ * for the model. The context is returned in a malloc'd buffer. If 'cooked' is
+ * not NULL, the cooked form of the data (R_AL_CookedSize bytes) is written to 
+ * it as well.
  * ---------------------------------------------------------------------------
  */
-void  *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream);
+void  *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, 
+                           SDL_RWops *stream, void *cooked);
+
+/* ---------------------------------------------------------------------------
+ * Gives the size (in bytes) of the cooked render data of a model: its
+ * materials followed by its vertices, laid out exactly as the GL vertex 
+ * buffer expects them.
+ * ---------------------------------------------------------------------------
+ */
+size_t R_AL_CookedSize(const struct pfobj_hdr *header);
+
+/* ---------------------------------------------------------------------------
+ * Creates the private render context from cooked data. The vertices are 
+ * read in-place, so the cooked buffer must stay valid until shutdown.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_AL_PrivFromCooked(const char *base_path, const struct pfobj_hdr *header, 
+                           const void *cooked);
+
+/* ---------------------------------------------------------------------------
+ * Gives the name of the texture of the model's 'idx'-th material, or NULL 
+ * when the model has fewer materials. The texture is loaded relative to the 
+ * model's base directory.
+ * ---------------------------------------------------------------------------
+ */
+const char *R_AL_TexName(const void *priv_data, size_t idx);
 
 /* ---------------------------------------------------------------------------
  * Dumps private render data in PF Object format.
@@ -56,6 +85,14 @@ void  *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header
  */
 void   R_AL_DumpPrivate(FILE *stream, void *priv_data);
 
+/* ---------------------------------------------------------------------------
+ * Queue the loading of the map's material textures and the initialization
+ * of the map's render state (see R_GL_MapInit).
+ * ---------------------------------------------------------------------------
+ */
+void   R_AL_MapInit(const char texnames[][256], size_t num_textures, 
+                    const struct map_resolution *res);
+
 /* ---------------------------------------------------------------------------
  * Gives size (in bytes) of buffer size required for the render private 
  * buffer for a renderable PFChunk.
@@ -74,5 +111,23 @@ bool   R_AL_InitPrivFromTiles(const struct map *map, int chunk_r, int chunk_c,
                               const struct tile *tiles, size_t width, size_t height,
                               void *priv_buff, const char *basedir);
 
+/* ---------------------------------------------------------------------------
+ * Release the GPU buffers of a chunk initialized with 'R_AL_InitPrivFromTiles'.
+ * The buffer may be initialized again afterwards. Until then, drawing the 
+ * chunk and updating its' tiles are no-ops.
+ * ---------------------------------------------------------------------------
+ */
+void   R_AL_FreePrivChunk(void *priv_buff);
+
+/* ---------------------------------------------------------------------------
+ * Rebuild the vertices of the listed tiles of 'nchunks' chunks from the 
+ * current tile data of the map and queue their upload. The vertices of the 
+ * different chunks are built in parallel. 'tiles[i]' holds the 'ntiles[i]' 
+ * tiles to update for the chunk with the render private 'chunk_rprivates[i]'.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_AL_UpdateTiles(const struct map *map, size_t nchunks, void **chunk_rprivates, 
+                        const size_t *ntiles, const struct tile_desc *const *tiles);
+
 #endif
 
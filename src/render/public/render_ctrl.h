@@ -41,6 +41,7 @@
 #include "../../pf_math.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <SDL_video.h>
 #include <SDL_mutex.h>
@@ -48,6 +49,7 @@
 
 
 struct frustum;
+struct shadow_cascade;
 struct tile_desc;
 struct map;
 struct camera;
@@ -63,24 +65,33 @@ struct render_init_arg{
     SDL_Window *in_window;
     int         in_width; 
     int         in_height;
+    /* No GL context is created. The render thread retires the 
+     * workspaces handed to it without executing their commands. */
+    bool        in_dedicated;
     bool        out_success;
 };
 
+#define RENDER_MAX_QUEUED_WS (4)
+
+struct render_workspace;
+
 struct render_sync_state{
     /* The render thread owns the data pointed to by 'arg' until
      * signalling the first 'done'. */
     struct render_init_arg *arg;
-    /* The start flag is set by the main thread when the render
-     * thread is allowed to start processing commands.
+    /* The main thread hands over workspaces by appending them to the
+     * 'queued' ring and incrementing 'nsubmitted'. The render thread
+     * processes them in order.
      * The quit flag is set by the main thread when the render 
      * thread should exit. */
-    bool       start;
+    struct render_workspace *queued[RENDER_MAX_QUEUED_WS];
+    uint64_t   nsubmitted;
     bool       quit;
     SDL_mutex *sq_lock;
     SDL_cond  *sq_cond;
-    /* The done flag is set by the render thread when it is done 
-     * procesing commands for the current frame. */
-    bool       done;
+    /* Incremented by the render thread every time it is done 
+     * procesing the commands of a workspace. */
+    uint64_t   ncompleted;
     SDL_mutex *done_lock;
     SDL_cond  *done_cond;
     /* Flag to specify if the framebuffer should be presented on
@@ -96,14 +107,42 @@ struct rcmd{
     void *args[MAX_ARGS];
 };
 
-QUEUE_TYPE(rcmd, struct rcmd)
-QUEUE_IMPL(static inline, rcmd, struct rcmd)
+/* The form in which a command is recorded in the workspace. Only the 
+ * arguments which are used are stored, right after the header. */
+struct rcmd_rec{
+    struct rcmd_rec *next;
+    void           (*func)();
+    size_t           nargs;
+    void            *args[];
+};
+
+struct rcmd_stats{
+    uint64_t ncmds;
+    /* Bytes taken up by the command records */
+    uint64_t cmd_bytes;
+    /* Bytes of argument data allocated for the commands */
+    uint64_t arg_bytes;
+};
+
+struct texture_load_stats{
+    uint64_t ndecoded;
+    uint64_t decode_bytes;
+    /* Wall time spent decoding on the main thread */
+    double   decode_ms;
+    /* Sum of the decoding times of the individual images */
+    double   decode_cpu_ms;
+    /* Time spent creating the GL textures on the render thread */
+    double   upload_ms;
+};
 
 struct render_workspace{
     /* Stack allocator for storing all the data/arguments associated
-     * with the commands */
+     * with the commands, as well as the commands themselves */
     struct memstack   args;
-    queue_rcmd_t      commands;
+    /* Commands in the order they are to be executed */
+    struct rcmd_rec  *head;
+    struct rcmd_rec  *tail;
+    struct rcmd_stats stats;
 };
 
 
@@ -112,7 +151,12 @@ SDL_Thread *R_Run(struct render_sync_state *rstate);
 /* Must be set up before creating the window */
 void 		R_InitAttributes(void);
 bool        R_ComputeShaderSupported(void);
+bool        R_BindlessTexturesSupported(void);
 
+/* Reserve space for an argument in the current workspace, to be written
+ * in place by the caller before the command is pushed. The memory stays 
+ * valid until the commands of the frame have been executed. */
+void       *R_AllocArg(size_t size);
 void       *R_PushArg(const void *src, size_t size);
 void        R_PushCmd(struct rcmd cmd);
 /* Pushes the command to the render queue directly. May only 
@@ -122,11 +166,35 @@ void        R_PushCmdImmediate(struct rcmd cmd);
 bool        R_InitWS(struct render_workspace *ws);
 void        R_DestroyWS(struct render_workspace *ws);
 void        R_ClearWS(struct render_workspace *ws);
+/* The totals of the last frame that was handed over to the render thread */
+void        R_GetCmdStats(struct rcmd_stats *out);
 
 const char *R_GetInfo(enum render_info attr);
 
+/* Decode all the images queued for loading by the commands of the current 
+ * frame, in parallel. Must be called before these commands are handed over 
+ * to the render thread, while it is not executing any commands. */
+void        R_TextureLoadFlush(void);
+/* Drop the queued loads along with the commands that reference them */
+void        R_TextureLoadClear(void);
+/* Totals since startup */
+void        R_TextureLoadGetStats(struct texture_load_stats *out);
+/* Write a block-compressed KTX2 version of an image. When a 'name.ktx2' is 
+ * present next to a model's 'name.png', it is loaded in its' place. */
+bool        R_TextureCook(const char *src, const char *dst);
+
+/* Append 'count' baked skinning matrices to the shared pose buffer and 
+ * return the index of the first one. */
+size_t      R_PoseBuffAdd(const mat4x4_t *mats, size_t count);
+
 void        R_LightFrustum(vec3_t light_pos, vec3_t cam_pos, vec3_t cam_dir, struct frustum *out);
 void        R_LightVisibilityFrustum(const struct camera *cam, struct frustum *out);
+/* Fit 'ncascades' light-space boxes to consecutive depth slices of the camera
+ * frustum. 'out_frusta' receives the matching world-space boxes for culling 
+ * the casters of each cascade. Far cascades are only refreshed every other 
+ * call, keeping the previously returned transform in-between. */
+void        R_LightCascades(const struct camera *cam, vec3_t light_pos, int ncascades,
+                            struct shadow_cascade *out, struct frustum *out_frusta);
 
 /* Tile */
 int         R_TileGetTriMesh(const struct map *map, struct tile_desc *td, mat4x4_t *model, vec3_t out[]);
@@ -41,13 +41,17 @@
 #include "gl_assert.h"
 #include "gl_state.h"
 #include "gl_batch.h"
+#include "gl_ringbuffer.h"
 #include "../settings.h"
+#include "../config.h"
 #include "../main.h"
+#include "../perf.h"
 #include "../ui.h"
 #include "../game/public/game.h"
 
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include <SDL.h>
 #include <GL/glew.h>
@@ -68,12 +72,19 @@ bool g_trace_gpu;
 /*****************************************************************************/
 
 static SDL_GLContext s_context;
+/* Written by the main thread when it reclaims a workspace */
+static struct rcmd_stats s_cmd_stats;
+/* The workspace being processed by the render thread */
+static struct render_workspace *s_render_ws;
+static bool s_dedicated = false;
 
 /* write-once strings. Set by render thread at initialization */
 char                 s_info_vendor[128];
 char                 s_info_renderer[128];
 char                 s_info_version[128];
 char                 s_info_sl_version[128];
+/* Set by render thread at initialization */
+static bool          s_bindless_supported = false;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -181,6 +192,16 @@ static void dm_commit(const struct sval *new_val)
     Engine_SetDispMode(new_val->as_int);
 }
 
+static bool water_quality_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+
+    return new_val->as_int == WATER_QUALITY_HIGH
+        || new_val->as_int == WATER_QUALITY_MEDIUM
+        || new_val->as_int == WATER_QUALITY_LOW;
+}
+
 static bool bool_val_validate(const struct sval *new_val)
 {
     return (new_val->type == ST_TYPE_BOOL);
@@ -243,10 +264,79 @@ static void trace_gpu_commit(const struct sval *new_val)
     });
 }
 
-static bool render_wait_cmd(struct render_sync_state *rstate)
+static void dynres_commit(const struct sval *new_val)
+{
+    R_PushCmd((struct rcmd){
+        .func = R_GL_DynresSetEnabled,
+        .nargs = 1,
+        .args = { R_PushArg(&new_val->as_bool, sizeof(bool)) }
+    });
+}
+
+static bool dynres_target_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_FLOAT)
+        return false;
+
+    return new_val->as_float >= 1.0f && new_val->as_float <= 100.0f;
+}
+
+static void dynres_target_commit(const struct sval *new_val)
+{
+    R_PushCmd((struct rcmd){
+        .func = R_GL_DynresSetTarget,
+        .nargs = 1,
+        .args = { R_PushArg(&new_val->as_float, sizeof(float)) }
+    });
+}
+
+static bool dynres_min_scale_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_FLOAT)
+        return false;
+
+    return new_val->as_float >= 0.25f && new_val->as_float <= 1.0f;
+}
+
+static void dynres_min_scale_commit(const struct sval *new_val)
+{
+    R_PushCmd((struct rcmd){
+        .func = R_GL_DynresSetMinScale,
+        .nargs = 1,
+        .args = { R_PushArg(&new_val->as_float, sizeof(float)) }
+    });
+}
+
+static bool texture_budget_validate(const struct sval *new_val)
 {
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+
+    return new_val->as_int >= 16;
+}
+
+static bool terrain_budget_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+
+    return new_val->as_int >= 256;
+}
+
+static void texture_budget_commit(const struct sval *new_val)
+{
+    R_PushCmd((struct rcmd){
+        .func = R_GL_Texture_SetBudget,
+        .nargs = 1,
+        .args = { R_PushArg(&new_val->as_int, sizeof(int)) }
+    });
+}
+
+static bool render_wait_cmd(struct render_sync_state *rstate, struct render_workspace **out)
+{
+    /* Only the render thread writes 'ncompleted' */
     SDL_LockMutex(rstate->sq_lock);
-    while(!rstate->start && !rstate->quit)
+    while(rstate->nsubmitted == rstate->ncompleted && !rstate->quit)
         SDL_CondWait(rstate->sq_cond, rstate->sq_lock);
 
     if(rstate->quit) {
@@ -256,8 +346,8 @@ static bool render_wait_cmd(struct render_sync_state *rstate)
         return true;
     }
     
-    assert(rstate->start == true);
-    rstate->start = false;
+    assert(rstate->nsubmitted > rstate->ncompleted);
+    *out = rstate->queued[rstate->ncompleted % RENDER_MAX_QUEUED_WS];
     SDL_UnlockMutex(rstate->sq_lock);
     return false;
 }
@@ -265,7 +355,7 @@ static bool render_wait_cmd(struct render_sync_state *rstate)
 static void render_signal_done(struct render_sync_state *rstate)
 {
     SDL_LockMutex(rstate->done_lock);
-    rstate->done = true;
+    rstate->ncompleted++;
     SDL_CondSignal(rstate->done_cond);
     SDL_UnlockMutex(rstate->done_lock);
 }
@@ -325,6 +415,22 @@ void debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
 #endif
 }
 
+/* With 'glewExperimental' set, GLEW reports an extension as supported 
+ * whenever its' entry points resolve, which some drivers do for any name. 
+ * Consult the driver's list of extensions instead.
+ */
+static bool render_has_extension(const char *name)
+{
+    GLint next = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &next);
+    for(int i = 0; i < next; i++) {
+        const char *curr = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if(curr && !strcmp(curr, name))
+            return true;
+    }
+    return false;
+}
+
 static void render_init_ctx(struct render_init_arg *arg)
 {
     SDL_GL_MakeCurrent(arg->in_window, s_context);
@@ -348,6 +454,14 @@ static void render_init_ctx(struct render_init_arg *arg)
         glDebugMessageCallback(debug_callback, NULL);
     }
 
+    /* The shader binary cache is keyed on the driver's strings */
+    strncpy(s_info_vendor,     (const char*)glGetString(GL_VENDOR),   ARR_SIZE(s_info_vendor)-1);
+    strncpy(s_info_renderer,   (const char*)glGetString(GL_RENDERER), ARR_SIZE(s_info_renderer)-1);
+    strncpy(s_info_version,    (const char*)glGetString(GL_VERSION),  ARR_SIZE(s_info_version)-1);
+    strncpy(s_info_sl_version, (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION), ARR_SIZE(s_info_sl_version)-1);
+    s_bindless_supported = GLEW_ARB_bindless_texture 
+                        && render_has_extension("GL_ARB_bindless_texture");
+
     int vp[4] = {0 ,0, arg->in_width, arg->in_height};
     R_GL_SetViewport(&vp[0], &vp[1], &vp[2], &vp[3]);
     R_GL_GlobalConfig();
@@ -363,17 +477,21 @@ static void render_init_ctx(struct render_init_arg *arg)
 
     R_GL_InitShadows();
 
-    strncpy(s_info_vendor,     (const char*)glGetString(GL_VENDOR),   ARR_SIZE(s_info_vendor)-1);
-    strncpy(s_info_renderer,   (const char*)glGetString(GL_RENDERER), ARR_SIZE(s_info_renderer)-1);
-    strncpy(s_info_version,    (const char*)glGetString(GL_VERSION),  ARR_SIZE(s_info_version)-1);
-    strncpy(s_info_sl_version, (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION), ARR_SIZE(s_info_sl_version)-1);
-
     arg->out_success = true;
 }
 
 static void render_destroy_ctx(void)
 {
+    R_GL_PrimBatchShutdown();
     R_GL_Batch_Shutdown();
+    R_GL_ImpostorShutdown();
+    R_GL_ProjectilesShutdown();
+    R_GL_IconsShutdown();
+    R_GL_LOSShutdown();
+    R_GL_HiZShutdown();
+    R_GL_DynresShutdown();
+    R_GL_PoseBuffShutdown();
+    R_GL_Shader_Shutdown();
     R_GL_StateShutdown();
     R_GL_Texture_Shutdown();
     SDL_GL_DeleteContext(s_context);
@@ -469,15 +587,50 @@ static void render_dispatch_cmd(struct rcmd cmd)
     }
 }
 
-static void render_process_cmds(queue_rcmd_t *cmds)
+static void render_process_cmds(struct render_workspace *ws)
 {
-    while(queue_size(*cmds) > 0) {
+    for(struct rcmd_rec *curr = ws->head; curr; curr = curr->next) {
 
-        struct rcmd curr;
-        queue_rcmd_pop(cmds, &curr);
-        render_dispatch_cmd(curr);
+        struct rcmd cmd = (struct rcmd){
+            .func = curr->func,
+            .nargs = curr->nargs,
+        };
+        memcpy(cmd.args, curr->args, curr->nargs * sizeof(void*));
+
+        if(!R_GL_PrimBatchOwns(cmd.func)) {
+            R_GL_PrimBatchFlush();
+        }
+        render_dispatch_cmd(cmd);
         GL_ASSERT_OK();
     }
+    R_GL_PrimBatchFlush();
+    ws->head = NULL;
+    ws->tail = NULL;
+}
+
+static void render_record_cmd(struct render_workspace *ws, const struct rcmd *cmd)
+{
+    assert(cmd->nargs <= MAX_ARGS);
+    const size_t size = sizeof(struct rcmd_rec) + cmd->nargs * sizeof(void*);
+
+    struct rcmd_rec *rec = stalloc(&ws->args, size);
+    if(!rec)
+        return;
+
+    rec->next = NULL;
+    rec->func = cmd->func;
+    rec->nargs = cmd->nargs;
+    memcpy(rec->args, cmd->args, cmd->nargs * sizeof(void*));
+
+    if(ws->tail) {
+        ws->tail->next = rec;
+    }else{
+        ws->head = rec;
+    }
+    ws->tail = rec;
+
+    ws->stats.ncmds++;
+    ws->stats.cmd_bytes += size;
 }
 
 static int render(void *data)
@@ -486,26 +639,52 @@ static int render(void *data)
     SDL_Window *window = rstate->arg->in_window; /* cache window ptr */
 
     Engine_SetRenderThreadID(SDL_ThreadID());
-    SDL_GL_MakeCurrent(window, s_context);
+    if(!s_dedicated) {
+        SDL_GL_MakeCurrent(window, s_context);
+    }
 
-    bool quit = render_wait_cmd(rstate);
+    bool quit = render_wait_cmd(rstate, &s_render_ws);
     assert(!quit);
-    render_init_ctx(rstate->arg);
-    bool initialized = rstate->arg->out_success;
+
+    bool initialized = false;
+    if(s_dedicated) {
+        rstate->arg->out_success = true;
+    }else{
+        render_init_ctx(rstate->arg);
+        initialized = rstate->arg->out_success;
+    }
 
     rstate->arg = NULL; /* arg is stale after signalling main thread */
     render_signal_done(rstate);
 
     while(true) {
     
-        quit = render_wait_cmd(rstate);
+        uint64_t idle_begin = SDL_GetPerformanceCounter();
+        quit = render_wait_cmd(rstate, &s_render_ws);
         if(quit)
             break;
 
-        render_process_cmds(&G_GetRenderWS()->commands);
-        if(rstate->swap_buffers)
+        if(s_dedicated) {
+            s_render_ws->head = NULL;
+            s_render_ws->tail = NULL;
+            render_signal_done(rstate);
+            continue;
+        }
+        Perf_CounterAddElapsed("render.idle_us", idle_begin);
+
+        uint64_t busy_begin = SDL_GetPerformanceCounter();
+        render_process_cmds(s_render_ws);
+        R_GL_RingbufferEndFrame();
+        R_GL_Texture_EndFrame();
+        Perf_CounterAddElapsed("render.busy_us", busy_begin);
+
+        if(rstate->swap_buffers) {
+            uint64_t swap_begin = SDL_GetPerformanceCounter();
             SDL_GL_SwapWindow(window);
+            Perf_CounterAddElapsed("render.swap_us", swap_begin);
+        }
 
+        Perf_CounterPublish();
         render_signal_done(rstate);
     }
 
@@ -623,6 +802,137 @@ bool R_Init(const char *base_path)
     });
     assert(status == SS_OKAY);
 
+    status = Settings_Create((struct setting){
+        .name = "pf.video.water_quality",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = WATER_QUALITY_HIGH,
+        },
+        .prio = 0,
+        .validate = water_quality_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.terrain_lod",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true,
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Draw the reduced-detail meshes of models which cover a small part 
+     * of the screen, for the models which provide them */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.mesh_lod",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true,
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Lay down the depth of the opaque entities before shading anything, 
+     * so that hidden fragments of the terrain and other entities are 
+     * rejected early */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.depth_prepass",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false,
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Draw the animated entities which cover a tiny part of the screen as
+     * sprites of their pre-rendered views */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.impostors",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true,
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.dynamic_resolution",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false,
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = dynres_commit,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.dynamic_resolution_target_ms",
+        .val = (struct sval) {
+            .type = ST_TYPE_FLOAT,
+            .as_float = 14.0f,
+        },
+        .prio = 0,
+        .validate = dynres_target_validate,
+        .commit = dynres_target_commit,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.dynamic_resolution_min_scale",
+        .val = (struct sval) {
+            .type = ST_TYPE_FLOAT,
+            .as_float = 0.5f,
+        },
+        .prio = 0,
+        .validate = dynres_min_scale_validate,
+        .commit = dynres_min_scale_commit,
+    });
+    assert(status == SS_OKAY);
+
+    /* The textures which are not referenced by any loaded asset are evicted, 
+     * least recently used first, when their total size exceeds this */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.texture_budget_mb",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = CONFIG_TEXTURE_BUDGET_MB,
+        },
+        .prio = 0,
+        .validate = texture_budget_validate,
+        .commit = texture_budget_commit,
+    });
+    assert(status == SS_OKAY);
+
+    /* The maximum number of terrain chunk meshes kept resident. Takes 
+     * effect on the next map load */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.terrain_budget_chunks",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = CONFIG_TERRAIN_BUDGET_CHUNKS,
+        },
+        .prio = 0,
+        .validate = terrain_budget_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
     status = Settings_Create((struct setting){
         .name = "pf.debug.render_log_mask",
         .val = (struct sval) {
@@ -654,6 +964,10 @@ SDL_Thread *R_Run(struct render_sync_state *rstate)
 {
     ASSERT_IN_MAIN_THREAD();
 
+    s_dedicated = rstate->arg->in_dedicated;
+    if(s_dedicated)
+        return SDL_CreateThread(render, "render", rstate);
+
     /* Create the GL context in the main thread and then hand it off to the render thread. 
      * Certain drivers crap out when trying to make the context in the render thread directly. 
      */
@@ -663,14 +977,24 @@ SDL_Thread *R_Run(struct render_sync_state *rstate)
     return SDL_CreateThread(render, "render", rstate);
 }
 
-void *R_PushArg(const void *src, size_t size)
+void *R_AllocArg(size_t size)
 {
-    struct render_workspace *ws = (SDL_ThreadID() == g_render_thread_id) ? G_GetRenderWS() 
+    struct render_workspace *ws = (SDL_ThreadID() == g_render_thread_id) ? s_render_ws 
                                                                          : G_GetSimWS();
     void *ret = stalloc(&ws->args, size);
     if(!ret)
         return ret;
 
+    ws->stats.arg_bytes += size;
+    return ret;
+}
+
+void *R_PushArg(const void *src, size_t size)
+{
+    void *ret = R_AllocArg(size);
+    if(!ret)
+        return ret;
+
     memcpy(ret, src, size);
     return ret;
 }
@@ -685,8 +1009,7 @@ void R_PushCmd(struct rcmd cmd)
         return;
     }
 
-    struct render_workspace *ws = G_GetSimWS();
-    queue_rcmd_push(&ws->commands, &cmd);
+    render_record_cmd(G_GetSimWS(), &cmd);
 }
 
 void R_PushCmdImmediate(struct rcmd cmd)
@@ -697,38 +1020,39 @@ void R_PushCmdImmediate(struct rcmd cmd)
         return;
     }
 
-    struct render_workspace *ws = G_GetRenderWS();
-    queue_rcmd_push(&ws->commands, &cmd);
+    render_record_cmd(G_GetRenderWS(), &cmd);
 }
 
 bool R_InitWS(struct render_workspace *ws)
 {
     if(!stalloc_init(&ws->args)) 
-        goto fail_args;
-
-    if(!queue_rcmd_init(&ws->commands, 2048))
-        goto fail_queue;
+        return false;
 
+    ws->head = NULL;
+    ws->tail = NULL;
+    ws->stats = (struct rcmd_stats){0};
     return true;
-
-fail_queue:
-    stalloc_destroy(&ws->args);
-fail_args:
-    return false;
 }
 
 void R_DestroyWS(struct render_workspace *ws)
 {
-    queue_rcmd_destroy(&ws->commands);
     stalloc_destroy(&ws->args);
 }
 
 void R_ClearWS(struct render_workspace *ws)
 {
-    queue_rcmd_clear(&ws->commands);
+    s_cmd_stats = ws->stats;
+    ws->head = NULL;
+    ws->tail = NULL;
+    ws->stats = (struct rcmd_stats){0};
     stalloc_clear(&ws->args);
 }
 
+void R_GetCmdStats(struct rcmd_stats *out)
+{
+    *out = s_cmd_stats;
+}
+
 const char *R_GetInfo(enum render_info attr)
 {
     switch(attr) {
@@ -766,3 +1090,8 @@ bool R_ComputeShaderSupported(void)
         || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object));
 }
 
+bool R_BindlessTexturesSupported(void)
+{
+    return s_bindless_supported;
+}
+
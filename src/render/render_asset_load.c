@@ -44,10 +44,14 @@
 
 #include "../main.h"
 #include "../perf.h"
+#include "../sched.h"
 #include "../asset_load.h"
 #include "../map/public/tile.h"
+#include "../map/public/map.h"
 #include "../settings.h"
+#include "../config.h"
 #include "../lib/public/pf_string.h"
+#include "../lib/public/mem.h"
 
 #include <assert.h>
 #include <ctype.h>
@@ -58,11 +62,75 @@
 
 #define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
 
+_Static_assert(MAX_MESH_LODS <= TERRAIN_NUM_LODS, 
+    "The model LODs share the terrain chunk LOD ranges of 'struct render_private'");
+
+
+struct tile_update_work{
+    const struct map              *map;
+    const size_t                  *ntiles;
+    const struct tile_desc *const *tiles;
+    struct terrain_vert_packed   **verts;
+};
+
+struct chunk_build_work{
+    const struct map            *map;
+    int                          chunk_r, chunk_c;
+    const struct tile           *tiles;
+    size_t                       width;
+    struct terrain_vert         *verts;
+    struct terrain_vert_packed  *packed;
+};
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static void al_build_tile_verts_range(size_t begin, size_t end, void *arg)
+{
+    const struct tile_update_work *work = arg;
+
+    for(size_t i = begin; i < end; i++) {
+        for(size_t j = 0; j < work->ntiles[i]; j++) {
+
+            const struct tile_desc *td = &work->tiles[i][j];
+            struct terrain_vert vert_base[VERTS_PER_TILE];
+
+            struct tile *tile;
+            int ret = M_TileForDesc(work->map, *td, &tile);
+            assert(ret);
+
+            R_TileGetVertices(work->map, *td, vert_base);
+            R_TilePatchVertsBlend(work->map, td, vert_base);
+            if(tile->blend_normals) {
+                R_TilePatchVertsSmooth(work->map, td, vert_base);
+            }
+            R_TilePackVertices(vert_base, VERTS_PER_TILE, work->verts[i] + j * VERTS_PER_TILE);
+        }
+    }
+}
+
+static void al_build_chunk_rows_range(size_t begin, size_t end, void *arg)
+{
+    const struct chunk_build_work *work = arg;
+
+    for(size_t r = begin; r < end; r++) {
+    for(size_t c = 0; c < work->width; c++) {
+
+        size_t idx = (r * work->width + c) * VERTS_PER_TILE;
+        struct terrain_vert *vert_base = &work->verts[idx];
+        struct tile_desc td = (struct tile_desc){work->chunk_r, work->chunk_c, r, c};
+        const struct tile *tile = &work->tiles[r * work->width + c];
+
+        R_TileGetVertices(work->map, td, vert_base);
+        R_TilePatchVertsBlend(work->map, &td, vert_base);
+        if(tile->blend_normals) {
+            R_TilePatchVertsSmooth(work->map, &td, vert_base);
+        }
+        R_TilePackVertices(vert_base, VERTS_PER_TILE, &work->packed[idx]);
+    }}
+}
+
 static bool al_read_vertex(SDL_RWops *stream, struct vertex *out, 
                            char out_weights_line[])
 {
@@ -132,6 +200,81 @@ fail:
     return false;
 }
 
+size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
+{
+    size_t ret = 0;
+
+    ret += sizeof(struct render_private);
+    ret += header->num_materials * sizeof(struct material);
+
+    return ret;
+}
+
+/* The vertices of the full mesh followed by those of the reduced-detail levels */
+static size_t al_total_verts(const struct pfobj_hdr *header)
+{
+    size_t ret = header->num_verts;
+    for(int i = 0; i < header->num_lods; i++)
+        ret += header->lod_verts[i];
+    return ret;
+}
+
+static void al_init_lods(struct render_private *priv, const struct pfobj_hdr *header)
+{
+    priv->num_lods = header->num_lods + 1;
+    priv->lods_valid = (header->num_lods > 0);
+    priv->lod_first[0] = 0;
+    priv->lod_count[0] = header->num_verts;
+
+    for(int i = 1; i < priv->num_lods; i++) {
+        priv->lod_first[i] = priv->lod_first[i - 1] + priv->lod_count[i - 1];
+        priv->lod_count[i] = header->lod_verts[i - 1];
+    }
+}
+
+static size_t al_vbuff_offset(const struct pfobj_hdr *header)
+{
+    return AL_COOKED_ROUNDUP(header->num_materials * sizeof(struct material));
+}
+
+static size_t al_vertex_stride(const struct pfobj_hdr *header)
+{
+    return (header->num_as > 0) ? sizeof(struct anim_vert) : sizeof(struct vertex);
+}
+
+static const char *al_shader_name(bool anim)
+{
+    struct sval sh_setting;
+    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
+    assert(status == SS_OKAY);
+
+    if(sh_setting.as_bool) {
+        return anim ? "mesh.animated.textured-phong-shadowed" 
+                    : "mesh.static.textured-phong-shadowed";
+    }else{
+        return anim ? "mesh.animated.textured-phong" 
+                    : "mesh.static.textured-phong";
+    }
+}
+
+static void al_load_texture(const char *basedir, struct material *mat)
+{
+    char path[512], maps_path[512];
+    pf_snprintf(path, sizeof(path), "%s/%s", basedir, mat->texname);
+    pf_snprintf(maps_path, sizeof(maps_path), "%s/assets/map_textures/%s", g_basepath, mat->texname);
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_Texture_LoadDecoded,
+        .nargs = 4,
+        .args = {
+            R_PushArg(basedir, strlen(basedir) + 1),
+            R_PushArg(mat->texname, strlen(mat->texname) + 1),
+            R_TextureLoadQueue(path, maps_path, 0),
+            &mat->texture.id,
+        },
+    });
+}
+
 static bool al_read_material(SDL_RWops *stream, const char *basedir, struct material *out, bool *out_null)
 {
     char line[MAX_LINE_LEN];
@@ -164,16 +307,7 @@ static bool al_read_material(SDL_RWops *stream, const char *basedir, struct mate
         goto fail;
     out->texname[sizeof(out->texname)-1] = '\0';
 
-    R_PushCmd((struct rcmd){
-        .func = R_GL_Texture_GetOrLoad,
-        .nargs = 3,
-        .args = {
-            R_PushArg(basedir, strlen(basedir) + 1),
-            R_PushArg(out->texname, strlen(out->texname) + 1),
-            &out->texture.id,
-        },
-    });
-
+    al_load_texture(basedir, out);
     *out_null = false;
     return true;
 
@@ -181,16 +315,6 @@ fail:
     return false;
 }
 
-size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
-{
-    size_t ret = 0;
-
-    ret += sizeof(struct render_private);
-    ret += header->num_materials * sizeof(struct material);
-
-    return ret;
-}
-
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -206,7 +330,8 @@ size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
  *
  */
 
-void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream)
+void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, 
+                          SDL_RWops *stream, void *cooked)
 {
     PERF_ENTER();
     struct render_private *priv = malloc(al_priv_buffsize_from_header(header));
@@ -214,18 +339,20 @@ void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header,
         goto fail_alloc_priv;
 
     bool anim = (header->num_as > 0);
-    priv->vertex_stride = anim ? sizeof(struct anim_vert) : sizeof(struct vertex);
+    priv->vertex_stride = al_vertex_stride(header);
 
-    size_t vbuff_sz = header->num_verts * priv->vertex_stride;
-    void *vbuff = malloc(vbuff_sz);
+    size_t nverts = al_total_verts(header);
+    size_t vbuff_sz = nverts * priv->vertex_stride;
+    void *vbuff = cooked ? (char*)cooked + al_vbuff_offset(header) : malloc(vbuff_sz);
     if(!vbuff)
         goto fail_alloc_vbuff;
 
     priv->mesh.num_verts = header->num_verts;
+    al_init_lods(priv, header);
     priv->num_materials = header->num_materials;
     priv->materials = (void*)(priv + 1);
 
-    for(int i = 0; i < header->num_verts; i++) {
+    for(int i = 0; i < nverts; i++) {
 
         bool status;
         char ignoreline[MAX_LINE_LEN];
@@ -249,17 +376,8 @@ void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header,
         assert(!null);
     }
 
-    struct sval sh_setting;
-    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
-    assert(status == SS_OKAY);
-
-    const char *shader;
-    if(sh_setting.as_bool) {
-        shader = anim ? "mesh.animated.textured-phong-shadowed" 
-                      : "mesh.static.textured-phong-shadowed";
-    }else{
-        shader = anim ? "mesh.animated.textured-phong" 
-                      : "mesh.static.textured-phong";
+    if(cooked) {
+        memcpy(cooked, priv->materials, header->num_materials * sizeof(struct material));
     }
 
     R_PushCmd((struct rcmd){
@@ -267,22 +385,92 @@ void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header,
         .nargs = 3,
         .args = {
             priv,
-            (void*)shader,
+            (void*)al_shader_name(anim),
             R_PushArg(vbuff, vbuff_sz),
         },
     });
 
-    free(vbuff);
+    if(!cooked) {
+        free(vbuff);
+    }
     PERF_RETURN(priv);
 
 fail_parse:
-    free(vbuff);
+    if(!cooked) {
+        free(vbuff);
+    }
 fail_alloc_vbuff:
     free(priv);
 fail_alloc_priv:
     PERF_RETURN(NULL);
 }
 
+/*
+ * Cooked render data layout:
+ *
+ *  +---------------------------------+ <-- base
+ *  | struct material[num_materials]  |
+ *  +---------------------------------+ <-- aligned to AL_COOKED_ALIGN
+ *  | struct vertex[nverts] or        |
+ *  | struct anim_vert[nverts]        |
+ *  | (the full mesh, then each LOD)  |
+ *  +---------------------------------+
+ *
+ */
+
+size_t R_AL_CookedSize(const struct pfobj_hdr *header)
+{
+    return al_vbuff_offset(header) + al_total_verts(header) * al_vertex_stride(header);
+}
+
+void *R_AL_PrivFromCooked(const char *base_path, const struct pfobj_hdr *header, const void *cooked)
+{
+    PERF_ENTER();
+    struct render_private *priv = malloc(al_priv_buffsize_from_header(header));
+    if(!priv)
+        PERF_RETURN(NULL);
+
+    bool anim = (header->num_as > 0);
+    priv->vertex_stride = al_vertex_stride(header);
+    priv->mesh.num_verts = header->num_verts;
+    al_init_lods(priv, header);
+    priv->num_materials = header->num_materials;
+    priv->materials = (void*)(priv + 1);
+    memcpy(priv->materials, cooked, header->num_materials * sizeof(struct material));
+
+    for(int i = 0; i < header->num_materials; i++) {
+
+        priv->materials[i].texture.tunit = GL_TEXTURE0 + i;
+        priv->materials[i].texture.id = -1;
+        priv->materials[i].texname[sizeof(priv->materials[i].texname)-1] = '\0';
+        al_load_texture(base_path, &priv->materials[i]);
+    }
+
+    /* The cooked vertices are already in the layout of the GL vertex buffer 
+     * and the caller keeps them alive until shutdown, so they are handed to 
+     * the render thread as-is instead of being copied into the command queue.
+     */
+    R_PushCmd((struct rcmd){
+        .func = R_GL_Init,
+        .nargs = 3,
+        .args = {
+            priv,
+            (void*)al_shader_name(anim),
+            (void*)((const char*)cooked + al_vbuff_offset(header)),
+        },
+    });
+
+    PERF_RETURN(priv);
+}
+
+const char *R_AL_TexName(const void *priv_data, size_t idx)
+{
+    const struct render_private *priv = priv_data;
+    if(idx >= priv->num_materials)
+        return NULL;
+    return priv->materials[idx].texname;
+}
+
 void R_AL_DumpPrivate(FILE *stream, void *priv_data)
 {
     struct render_private *priv = priv_data;
@@ -335,6 +523,30 @@ void R_AL_DumpPrivate(FILE *stream, void *priv_data)
     }
 }
 
+void R_AL_MapInit(const char texnames[][256], size_t num_textures, const struct map_resolution *res)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    STALLOC(struct texture_load*, loads, num_textures);
+    for(int i = 0; i < num_textures; i++) {
+
+        char path[512];
+        pf_snprintf(path, sizeof(path), "%s/assets/map_textures/%s", g_basepath, texnames[i]);
+        loads[i] = R_TextureLoadQueue(path, NULL, CONFIG_TILE_TEX_RES);
+    }
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_MapInit,
+        .nargs = 3,
+        .args = {
+            R_PushArg(loads, num_textures * sizeof(struct texture_load*)),
+            R_PushArg(&num_textures, sizeof(num_textures)),
+            R_PushArg(res, sizeof(*res)),
+        },
+    });
+    STFREE(loads);
+}
+
 size_t R_AL_PrivBuffSizeForChunk(size_t tiles_width, size_t tiles_height, size_t num_mats)
 {
     size_t ret = 0;
@@ -356,24 +568,64 @@ bool R_AL_InitPrivFromTiles(const struct map *map, int chunk_r, int chunk_c,
 
     struct render_private *priv = priv_buff;
     char *unused_base = (char*)priv_buff + sizeof(struct render_private);
-    size_t vbuff_sz = num_verts * sizeof(struct terrain_vert);
 
-    struct terrain_vert *vbuff = malloc(vbuff_sz);
+    struct terrain_vert *vbuff = malloc(num_verts * sizeof(struct terrain_vert));
     if(!vbuff)
         goto fail_alloc;
 
-    priv->vertex_stride = sizeof(struct terrain_vert);
+    /* No level of detail has more vertices or indices than the full mesh */
+    struct terrain_vert_packed *packed = malloc(TERRAIN_NUM_LODS * num_verts * sizeof(struct terrain_vert_packed));
+    if(!packed)
+        goto fail_packed;
+
+    uint32_t *indices = malloc((TERRAIN_NUM_LODS - 1) * num_verts * sizeof(uint32_t));
+    if(!indices)
+        goto fail_indices;
+
+    priv->vertex_stride = sizeof(struct terrain_vert_packed);
     priv->mesh.num_verts = num_verts;
     priv->materials = (void*)unused_base;
     priv->num_materials = 0;
 
-    for(int r = 0; r < height; r++) {
-    for(int c = 0; c < width;  c++) {
-
-        struct terrain_vert *vert_base = &vbuff[ (r * width + c) * VERTS_PER_TILE ];
-        struct tile_desc td = (struct tile_desc){chunk_r, chunk_c, r, c};
-        R_TileGetVertices(map, td, vert_base);
-    }}
+    /* The adjacency patches read the neighbouring tiles only and never the 
+     * vertices, so every tile can be built, patched and packed on its own. 
+     * This lets the rows of the chunk be spread across the workers. Doing the 
+     * patches before the upload saves mapping the buffer range of every tile 
+     * twice on the render thread. 
+     */
+    struct chunk_build_work work = (struct chunk_build_work){
+        .map = map,
+        .chunk_r = chunk_r,
+        .chunk_c = chunk_c,
+        .tiles = tiles,
+        .width = width,
+        .verts = vbuff,
+        .packed = packed
+    };
+    Sched_ParallelFor(0, height, 1, al_build_chunk_rows_range, &work);
+
+    /* The reduced-detail meshes are built from the patched vertices and 
+     * appended after the full mesh in the same vertex buffer. They are 
+     * indexed, with the vertex ranges ordered like the index ranges.
+     */
+    size_t next = num_verts;
+    size_t next_index = 0;
+    priv->lod_first[0] = 0;
+    priv->lod_count[0] = num_verts;
+
+    for(int lod = 1; lod < TERRAIN_NUM_LODS; lod++) {
+
+        priv->lod_first[lod] = next_index;
+        for(int i = 0; i < width * height; i++) {
+            size_t nverts;
+            next_index += R_TileLODVertices(&vbuff[i * VERTS_PER_TILE], lod, next, 
+                &packed[next], &nverts, &indices[next_index]);
+            next += nverts;
+        }
+        priv->lod_count[lod] = next_index - priv->lod_first[lod];
+    }
+    priv->num_lods = TERRAIN_NUM_LODS;
+    priv->lods_valid = true;
 
     struct sval sh_setting;
     ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
@@ -381,19 +633,96 @@ bool R_AL_InitPrivFromTiles(const struct map *map, int chunk_r, int chunk_c,
 
     const char *shader = sh_setting.as_bool ? "terrain-shadowed" : "terrain";
     R_PushCmd((struct rcmd){
-        .func = R_GL_Init,
-        .nargs = 3,
+        .func = R_GL_TerrainInit,
+        .nargs = 5,
         .args = {
             priv,
             (void*)shader,
-            R_PushArg(vbuff, vbuff_sz),
+            R_PushArg(packed, next * sizeof(struct terrain_vert_packed)),
+            R_PushArg(&next, sizeof(next)),
+            R_PushArg(indices, next_index * sizeof(uint32_t)),
         },
     });
 
+    free(indices);
+    free(packed);
     free(vbuff);
     PERF_RETURN(true);
 
+fail_indices:
+    free(packed);
+fail_packed:
+    free(vbuff);
 fail_alloc:
     PERF_RETURN(false);
 }
 
+void R_AL_FreePrivChunk(void *priv_buff)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_TerrainFree,
+        .nargs = 1,
+        .args = { priv_buff },
+    });
+}
+
+bool R_AL_UpdateTiles(const struct map *map, size_t nchunks, void **chunk_rprivates, 
+                      const size_t *ntiles, const struct tile_desc *const *tiles)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    size_t total = 0;
+    for(size_t i = 0; i < nchunks; i++) {
+        total += ntiles[i];
+    }
+    if(total == 0)
+        PERF_RETURN(true);
+
+    struct terrain_vert_packed *vbuff = malloc(total * VERTS_PER_TILE * sizeof(struct terrain_vert_packed));
+    if(!vbuff)
+        PERF_RETURN(false);
+
+    STALLOC(struct terrain_vert_packed*, verts, nchunks);
+    struct terrain_vert_packed *next = vbuff;
+    for(size_t i = 0; i < nchunks; i++) {
+        verts[i] = next;
+        next += ntiles[i] * VERTS_PER_TILE;
+    }
+
+    /* Every tile's vertices only depend on the tile data of the map, so the 
+     * chunks can be built concurrently. Only the uploads are serialized by 
+     * the render thread. 
+     */
+    struct tile_update_work work = (struct tile_update_work){
+        .map = map,
+        .ntiles = ntiles,
+        .tiles = tiles,
+        .verts = verts
+    };
+    Sched_ParallelFor(0, nchunks, 1, al_build_tile_verts_range, &work);
+
+    for(size_t i = 0; i < nchunks; i++) {
+
+        if(ntiles[i] == 0)
+            continue;
+
+        R_PushCmd((struct rcmd){
+            .func = R_GL_TileUpdateBatch,
+            .nargs = 4,
+            .args = {
+                chunk_rprivates[i],
+                R_PushArg(&ntiles[i], sizeof(ntiles[i])),
+                R_PushArg(tiles[i], ntiles[i] * sizeof(struct tile_desc)),
+                R_PushArg(verts[i], ntiles[i] * VERTS_PER_TILE * sizeof(struct terrain_vert_packed)),
+            },
+        });
+    }
+
+    STFREE(verts);
+    free(vbuff);
+    PERF_RETURN(true);
+}
+
@@ -38,9 +38,11 @@
 
 #include "gl_mesh.h"
 #include "gl_texture.h"
+#include "public/render.h"
 #include "../map/public/tile.h"
 
 struct terrain_vert;
+struct terrain_vert_packed;
 struct map;
 
 struct render_private{
@@ -48,12 +50,42 @@ struct render_private{
     size_t              num_materials;
     struct material    *materials;
     struct texture_arr  material_arr;
+    GLuint              material_ubo; /* 0 if the shader takes no materials */
     GLuint              shader_prog;
     GLuint              shader_prog_dp; /* for the depth pass */
     GLuint              vertex_stride;
+    /* The reduced-detail meshes are stored in the same buffer, after the 
+     * full-detail vertices. Level 0 is the full mesh. For terrain chunks, 
+     * they are invalidated when any of the chunk's tiles is updated, and 
+     * are drawn from 'lod_indices', so their ranges count indices. */
+    bool                lods_valid;
+    unsigned            num_lods;
+    unsigned            lod_first[TERRAIN_NUM_LODS];
+    unsigned            lod_count[TERRAIN_NUM_LODS];
+    GLuint              lod_indices;
 };
 
 /* Tile */
 void R_TileGetVertices(const struct map *map, struct tile_desc td, struct terrain_vert *out);
+/* Apply the adjacency patches (see R_GL_TilePatchVertsBlend and R_GL_TilePatchVertsSmooth) 
+ * to the tile's vertices in client memory. */
+void R_TilePatchVertsBlend(const struct map *map, const struct tile_desc *tile, 
+                           struct terrain_vert *tile_verts_base);
+void R_TilePatchVertsSmooth(const struct map *map, const struct tile_desc *tile, 
+                            struct terrain_vert *tile_verts_base);
+/* Convert the vertices to and from the layout in which they are stored in video memory */
+void R_TilePackVertices(const struct terrain_vert *in, size_t count, 
+                        struct terrain_vert_packed *out);
+void R_TileUnpackVertices(const struct terrain_vert_packed *in, size_t count, 
+                          struct terrain_vert *out);
+/* Write the reduced-detail version of the tile's (patched) vertices to 'out_verts' and 
+ * the indices of its' triangles, offset by 'base', to 'out_indices'. Both must have 
+ * space for VERTS_PER_TILE entries. Corners shared by the triangles are written only
+ * once. Returns the number of indices written and the number of vertices in 
+ * 'out_nverts'. Level 1 only merges triangles where the result is identical, level 2 
+ * always reduces the top face to a single quad. */
+size_t R_TileLODVertices(const struct terrain_vert *tile_verts_base, int lod, uint32_t base,
+                         struct terrain_vert_packed *out_verts, size_t *out_nverts,
+                         uint32_t *out_indices);
 
 #endif
@@ -0,0 +1,501 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "replay.h"
+#include "main.h"
+#include "perf.h"
+#include "session.h"
+#include "lib/public/pf_string.h"
+#include "lib/public/mem.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+
+#define REPLAY_MAGIC    (0x50524650) /* "PFRP" */
+#define REPLAY_VERSION  (1)
+
+enum replay_state{
+    REPLAY_NONE,
+    REPLAY_RECORD_PENDING,
+    REPLAY_RECORDING,
+    REPLAY_PLAYBACK_PENDING,
+    REPLAY_PLAYING,
+};
+
+/* Every record is a type byte followed by a fixed-size payload. A frame 
+ * is made up of all the records following its' marker. 
+ */
+enum record_type{
+    RECORD_FRAME = 1,
+    RECORD_EVENT,
+    RECORD_RAND,
+    RECORD_ORDER,
+};
+
+struct replay_header{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t event_size;
+    uint32_t seed;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static enum replay_state s_state = REPLAY_NONE;
+static char              s_path[512];
+static uint32_t          s_seed;
+
+/* Recording state */
+static SDL_RWops        *s_out;
+static uint32_t          s_nrecorded;
+
+/* Playback state. The whole replay is read into memory up-front. Every 
+ * kind of record has its' own cursor into the current frame, so that 
+ * the random numbers and orders are matched up in the same order that
+ * they were recorded in, regardless of when the events are consumed.
+ */
+static char             *s_data;
+static size_t            s_size;
+static size_t            s_frame_end;
+static size_t            s_event_cursor;
+static size_t            s_rand_cursor;
+static size_t            s_order_cursor;
+static uint32_t          s_nframes;
+static uint32_t          s_frame_idx;
+static uint32_t          s_ndiverged;
+static uint32_t          s_first_diverged;
+static bool              s_own_capture;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static int record_size(uint8_t type)
+{
+    switch(type) {
+    case RECORD_FRAME:  return 0;
+    case RECORD_EVENT:  return sizeof(SDL_Event);
+    case RECORD_RAND:   return sizeof(int32_t);
+    case RECORD_ORDER:  return sizeof(uint32_t);
+    default:            return -1;
+    }
+}
+
+static void session_path(char *out, size_t maxout)
+{
+    pf_snprintf(out, maxout, "%s.pfsave", s_path);
+}
+
+static void write_record(uint8_t type, const void *payload)
+{
+    assert(s_state == REPLAY_RECORDING);
+    size_t size = record_size(type);
+
+    if(1 != SDL_RWwrite(s_out, &type, 1, 1))
+        goto fail;
+    if(size > 0 && 1 != SDL_RWwrite(s_out, payload, size, 1))
+        goto fail;
+    return;
+
+fail:
+    fprintf(stderr, "Failed to write to replay file: %s\n", s_path);
+    Replay_EndRecord();
+}
+
+/* Find the next record of the specified type in the current frame */
+static bool next_record(size_t *cursor, uint8_t type, void *out)
+{
+    size_t pos = *cursor;
+    while(pos < s_frame_end) {
+
+        uint8_t curr = s_data[pos];
+        size_t size = record_size(curr);
+        if(curr == type) {
+            memcpy(out, s_data + pos + 1, size);
+            *cursor = pos + 1 + size;
+            return true;
+        }
+        pos += 1 + size;
+    }
+    *cursor = s_frame_end;
+    return false;
+}
+
+static void diverged(void)
+{
+    if(s_ndiverged++ == 0) {
+        s_first_diverged = s_frame_idx;
+        fprintf(stderr, "Replay diverged from the recording at frame %u\n", s_frame_idx);
+    }
+}
+
+static bool read_replay(const char *path)
+{
+    SDL_RWops *stream = SDL_RWFromFile(path, "rb");
+    if(!stream)
+        goto fail_open;
+
+    Sint64 size = SDL_RWsize(stream);
+    if(size < (Sint64)sizeof(struct replay_header))
+        goto fail_read;
+
+    s_data = malloc(size);
+    if(!s_data)
+        goto fail_read;
+    if(1 != SDL_RWread(stream, s_data, size, 1))
+        goto fail_data;
+    s_size = size;
+
+    struct replay_header header;
+    memcpy(&header, s_data, sizeof(header));
+    if(header.magic != REPLAY_MAGIC
+    || header.version != REPLAY_VERSION
+    || header.event_size != sizeof(SDL_Event)) {
+        fprintf(stderr, "Replay file %s was recorded by an incompatible build\n", path);
+        goto fail_data;
+    }
+    s_seed = header.seed;
+
+    s_nframes = 0;
+    size_t pos = sizeof(header);
+    while(pos < s_size) {
+
+        int rsize = record_size(s_data[pos]);
+        if(rsize < 0 || pos + 1 + rsize > s_size)
+            goto fail_corrupt;
+        if(pos == sizeof(header) && s_data[pos] != RECORD_FRAME)
+            goto fail_corrupt;
+        if(s_data[pos] == RECORD_FRAME)
+            s_nframes++;
+        pos += 1 + rsize;
+    }
+
+    /* The first frame starts right after the header */
+    s_frame_end = sizeof(header);
+    s_frame_idx = 0;
+    s_ndiverged = 0;
+    SDL_RWclose(stream);
+    return true;
+
+fail_corrupt:
+    fprintf(stderr, "Replay file %s is corrupt\n", path);
+fail_data:
+    PF_FREE(s_data);
+    s_data = NULL;
+fail_read:
+    SDL_RWclose(stream);
+fail_open:
+    return false;
+}
+
+static void begin_recording(void)
+{
+    s_out = SDL_RWFromFile(s_path, "wb");
+    if(!s_out)
+        goto fail;
+
+    s_seed = (uint32_t)time(NULL) ^ (uint32_t)SDL_GetPerformanceCounter();
+    struct replay_header header = (struct replay_header){
+        .magic = REPLAY_MAGIC,
+        .version = REPLAY_VERSION,
+        .event_size = sizeof(SDL_Event),
+        .seed = s_seed
+    };
+    if(1 != SDL_RWwrite(s_out, &header, sizeof(header), 1)) {
+        SDL_RWclose(s_out);
+        goto fail;
+    }
+
+    srand(s_seed);
+    s_nrecorded = 0;
+    s_state = REPLAY_RECORDING;
+    return;
+
+fail:
+    fprintf(stderr, "Failed to open replay file for writing: %s\n", s_path);
+    s_state = REPLAY_NONE;
+}
+
+static void begin_playback(void)
+{
+    srand(s_seed);
+    s_state = REPLAY_PLAYING;
+
+    /* The trees of the last frames are only written out once they fall 
+     * out of the NFRAMES_LOGGED window */
+    s_own_capture = false;
+    if(!Perf_CaptureActive()) {
+
+        char path[sizeof(s_path) + 8];
+        pf_snprintf(path, sizeof(path), "%s.json", s_path);
+        s_own_capture = Perf_CaptureBegin(path, s_nframes + NFRAMES_LOGGED);
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void Replay_Shutdown(void)
+{
+    Replay_EndRecord();
+    Replay_EndPlayback();
+}
+
+bool Replay_BeginRecord(const char *path)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(s_state != REPLAY_NONE)
+        return false;
+
+    pf_strlcpy(s_path, path, sizeof(s_path));
+    char save[sizeof(s_path) + 8];
+    session_path(save, sizeof(save));
+
+    Session_RequestSave(save);
+    s_state = REPLAY_RECORD_PENDING;
+    return true;
+}
+
+void Replay_EndRecord(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(s_state == REPLAY_RECORD_PENDING) {
+        s_state = REPLAY_NONE;
+    }
+    if(s_state != REPLAY_RECORDING)
+        return;
+
+    SDL_RWclose(s_out);
+    s_out = NULL;
+    s_state = REPLAY_NONE;
+    printf("Recorded %u frames to replay file: %s\n", s_nrecorded, s_path);
+}
+
+bool Replay_BeginPlayback(const char *path)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(s_state != REPLAY_NONE)
+        return false;
+
+    pf_strlcpy(s_path, path, sizeof(s_path));
+    if(!read_replay(s_path))
+        return false;
+
+    char save[sizeof(s_path) + 8];
+    session_path(save, sizeof(save));
+
+    Session_RequestLoad(save);
+    s_state = REPLAY_PLAYBACK_PENDING;
+    return true;
+}
+
+void Replay_EndPlayback(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(s_state != REPLAY_PLAYING && s_state != REPLAY_PLAYBACK_PENDING)
+        return;
+
+    if(s_state == REPLAY_PLAYING) {
+        if(s_own_capture) {
+            Perf_CaptureEnd();
+        }
+        if(s_ndiverged) {
+            printf("Played back %u of %u frames of replay: %s (%u divergences, first at frame %u)\n", 
+                s_frame_idx, s_nframes, s_path, s_ndiverged, s_first_diverged);
+        }else{
+            printf("Played back %u of %u frames of replay: %s\n", s_frame_idx, s_nframes, s_path);
+        }
+    }
+
+    PF_FREE(s_data);
+    s_data = NULL;
+    s_state = REPLAY_NONE;
+}
+
+bool Replay_Recording(void)
+{
+    return (s_state == REPLAY_RECORDING);
+}
+
+bool Replay_Playing(void)
+{
+    return (s_state == REPLAY_PLAYING);
+}
+
+void Replay_OnSessionChange(bool success)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    switch(s_state) {
+    case REPLAY_RECORD_PENDING:
+        if(success) {
+            begin_recording();
+        }else{
+            fprintf(stderr, "Failed to save the session for replay: %s\n", s_path);
+            s_state = REPLAY_NONE;
+        }
+        break;
+    case REPLAY_PLAYBACK_PENDING:
+        if(success) {
+            begin_playback();
+        }else{
+            fprintf(stderr, "Failed to load the session for replay: %s\n", s_path);
+            Replay_EndPlayback();
+        }
+        break;
+    /* The recorded input is only meaningful for the session it started in */
+    case REPLAY_RECORDING:
+        Replay_EndRecord();
+        break;
+    case REPLAY_PLAYING:
+        Replay_EndPlayback();
+        break;
+    default:
+        break;
+    }
+}
+
+bool Replay_BeginFrame(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(s_state == REPLAY_RECORDING) {
+        write_record(RECORD_FRAME, NULL);
+        s_nrecorded++;
+        return true;
+    }
+    if(s_state != REPLAY_PLAYING)
+        return true;
+
+    if(s_frame_end == s_size) {
+        Replay_EndPlayback();
+        return false;
+    }
+
+    assert(s_data[s_frame_end] == RECORD_FRAME);
+    size_t begin = s_frame_end + 1;
+    size_t end = begin;
+    while(end < s_size && s_data[end] != RECORD_FRAME) {
+        end += 1 + record_size(s_data[end]);
+    }
+
+    s_frame_end = end;
+    s_event_cursor = begin;
+    s_rand_cursor = begin;
+    s_order_cursor = begin;
+    s_frame_idx++;
+    return true;
+}
+
+void Replay_RecordEvent(const union SDL_Event *event)
+{
+    if(s_state != REPLAY_RECORDING)
+        return;
+
+    /* Leave out the events that are tied to the window or that hold 
+     * pointers, as they can't be meaningfully fed back */
+    switch(event->type) {
+    case SDL_QUIT:
+    case SDL_WINDOWEVENT:
+    case SDL_SYSWMEVENT:
+    case SDL_DROPFILE:
+    case SDL_DROPTEXT:
+    case SDL_DROPBEGIN:
+    case SDL_DROPCOMPLETE:
+        return;
+    default:
+        break;
+    }
+    write_record(RECORD_EVENT, event);
+}
+
+bool Replay_NextEvent(union SDL_Event *out)
+{
+    if(s_state != REPLAY_PLAYING)
+        return false;
+    return next_record(&s_event_cursor, RECORD_EVENT, out);
+}
+
+int Replay_Rand(int value)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    int32_t ret = value;
+    switch(s_state) {
+    case REPLAY_RECORDING:
+        write_record(RECORD_RAND, &ret);
+        break;
+    case REPLAY_PLAYING:
+        if(!next_record(&s_rand_cursor, RECORD_RAND, &ret)) {
+            diverged();
+        }
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
+void Replay_RecordOrder(uint32_t uid)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    uint32_t recorded;
+    switch(s_state) {
+    case REPLAY_RECORDING:
+        write_record(RECORD_ORDER, &uid);
+        break;
+    case REPLAY_PLAYING:
+        if(!next_record(&s_order_cursor, RECORD_ORDER, &recorded) || recorded != uid) {
+            diverged();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
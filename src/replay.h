@@ -0,0 +1,79 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+union SDL_Event;
+
+/* A replay is the input of every frame following a session save: the SDL 
+ * events polled by the main loop, and the random numbers handed out to the
+ * scripts. The orders issued to the entities are recorded alongside them, 
+ * in order to detect when the playback diverges from the recording. The 
+ * session is saved next to the replay, as '<path>.pfsave'.
+ */
+
+void Replay_Shutdown(void);
+
+/* Saves the current session and starts recording once it is written out. 
+ * The recording ends with Replay_EndRecord or the next session change. */
+bool Replay_BeginRecord(const char *path);
+void Replay_EndRecord(void);
+/* Loads the session saved with the replay and feeds back the recorded 
+ * input, one frame at a time. The frames of the playback are written out 
+ * as a performance capture to '<path>.json'. */
+bool Replay_BeginPlayback(const char *path);
+void Replay_EndPlayback(void);
+
+bool Replay_Recording(void);
+bool Replay_Playing(void);
+
+/* The following are called by the main loop. Replay_OnSessionChange is 
+ * called when a session request (or the startup script) completes. It 
+ * returns false once the playback has run out of frames. */
+void Replay_OnSessionChange(bool success);
+bool Replay_BeginFrame(void);
+void Replay_RecordEvent(const union SDL_Event *event);
+bool Replay_NextEvent(union SDL_Event *out);
+
+/* Returns the value to use in place of a freshly generated random number */
+int  Replay_Rand(int value);
+void Replay_RecordOrder(uint32_t uid);
+
+#endif
+
@@ -39,18 +39,23 @@
 #include "main.h"
 #include "task.h"
 #include "event.h"
+#include "settings.h"
 #include "game/public/game.h"
 #include "phys/public/phys.h"
 #include "script/public/script.h"
-#include "lib/public/pqueue.h"
 #include "lib/public/queue.h"
 #include "lib/public/khash.h"
 #include "lib/public/pf_string.h"
 #include "lib/public/mem.h"
-#include "lib/public/block_allocator.h"
+#include "lib/public/stack_pool.h"
+#include "lib/public/stalloc.h"
+#include "lib/public/cpu_topo.h"
 
 #include <SDL.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 #ifdef _MSC_VER
 #include <windows.h>
 #endif
@@ -63,6 +68,8 @@ enum taskstate{
     TASK_STATE_RECV_BLOCKED,
     TASK_STATE_REPLY_BLOCKED,
     TASK_STATE_EVENT_BLOCKED,
+    TASK_STATE_SLEEP_BLOCKED,
+    TASK_STATE_FRAME_BLOCKED,
     TASK_STATE_ZOMBIE,
 };
 
@@ -157,29 +164,124 @@ struct task{
     struct task   *prev, *next;
     void          *earg;
     void         (*erelease)(void*);
-    char          __pad[8];
+    SDL_atomic_t   queued;
+    char          __pad[4];
+    /* Links of the ready queue bucket, valid while 'rq' is set */
+    struct ready_queue *rq;
+    struct task   *rq_prev, *rq_next;
+    uint64_t       rq_seq;
 };
 
 #ifdef _MSC_VER
 __pragma(pack(pop));
 #endif
 
+struct io_req{
+    char           path[512];
+    struct future *future;
+    size_t        *out_size;
+};
+
+/* A message passed by pointer with Task_Post. The receiver takes 
+ * ownership of the buffer and the sender doesn't block. */
+struct posted_msg{
+    uint32_t from;
+    void    *msg;
+    size_t   msglen;
+};
+
 #define MAX_TASKS               (8192)
 #define MAX_WORKER_THREADS      (64)
 #define STACK_SZ                (16 * 1024)
+#define MEDIUM_STACK_SZ         (256 * 1024)
 #define BIG_STACK_SZ            (4 * 1024 * 1024)
 #define SCHED_TICK_MS           (1.0f / CONFIG_SCHED_TARGET_FPS * 1000.0f)
 #define ALIGNED(val, align)     (((val) + ((align) - 1)) & ~((align) - 1))
+#define MIN(a, b)               ((a) < (b) ? (a) : (b))
+#define MAX(a, b)               ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)             (sizeof(a)/sizeof(a[0]))
+#define IO_THREADS              (2)
+/* Priorities outside of [0, SCHED_NUM_PRIOS) are clamped to it */
+#define SCHED_NUM_PRIOS         (32)
+#define WSDEQUE_SZ              (MAX_TASKS)
+#define WSDEQUE_MASK            (WSDEQUE_SZ - 1)
+#define FRAME_ARENA_GENERATIONS (2)
+#define WHEEL_ROOT_BITS         (8)
+#define WHEEL_ROOT_SLOTS        (1 << WHEEL_ROOT_BITS)
+#define WHEEL_ROOT_MASK         (WHEEL_ROOT_SLOTS - 1)
+#define WHEEL_OUTER_BITS        (6)
+#define WHEEL_OUTER_SLOTS       (1 << WHEEL_OUTER_BITS)
+#define WHEEL_OUTER_MASK        (WHEEL_OUTER_SLOTS - 1)
+#define WHEEL_OUTER_LEVELS      (3)
+
+/* Chase-Lev work-stealing deque. Only the owning worker pushes and pops at the 
+ * bottom end. Any other thread may steal from the top end. The 'top' and 'bottom' 
+ * indices are kept on separate cache lines to avoid false sharing between the 
+ * owner and the thieves. Note that we rely on the x86 memory model here: the 
+ * SDL_AtomicSet (xchg) calls act as full barriers.
+ */
+union frame_hdr{
+    size_t   size;
+    intmax_t align;
+};
 
-PQUEUE_TYPE(task, struct task*)
-PQUEUE_IMPL(static, task, struct task*)
+struct wsdeque{
+    SDL_atomic_t top;
+    char         __pad0[60];
+    SDL_atomic_t bottom;
+    char         __pad1[60];
+    struct task *buff[WSDEQUE_SZ];
+};
+
+/* A FIFO bucket of ready tasks for every priority, with the bit of each 
+ * non-empty bucket set in a mask so that the highest-priority task is 
+ * found with a single bit scan. The tasks which may run during a pause are 
+ * kept in a separate set of buckets, so they are found just as quickly. 
+ * Tasks are linked through their own 'rq_*' fields, so no operation 
+ * allocates and any task can be unlinked in constant time. 
+ */
+enum{
+    RQ_CLASS_DEFAULT,
+    RQ_CLASS_PAUSE,
+    RQ_NUM_CLASSES
+};
+
+struct ready_queue{
+    uint32_t     mask[RQ_NUM_CLASSES];
+    struct task *head[RQ_NUM_CLASSES][SCHED_NUM_PRIOS];
+    struct task *tail[RQ_NUM_CLASSES][SCHED_NUM_PRIOS];
+    /* Orders the tasks of the same priority across the classes */
+    uint64_t     seq;
+    size_t       size;
+};
 
 QUEUE_TYPE(tid, uint32_t)
 QUEUE_IMPL(static, tid, uint32_t)
 
+QUEUE_TYPE(msg, struct posted_msg)
+QUEUE_IMPL(static, msg, struct posted_msg)
+
+QUEUE_TYPE(io, struct io_req)
+QUEUE_IMPL(static, io, struct io_req)
+
 KHASH_MAP_INIT_INT64(tid, uint32_t)
 KHASH_MAP_INIT_INT(tqueue, queue_tid_t)
 
+/* Sleeping tasks are kept in a hierarchical timer wheel keyed by their wake 
+ * time in milliseconds. The root level has a slot for every millisecond of 
+ * the next 256, and each slot of an outer level spans a full revolution of 
+ * the level below it. A sleeping task is only touched when it is due, or when 
+ * the slot holding it is cascaded down a level, which happens at most once 
+ * per level. Sleeps beyond the range of the outermost level get re-filed 
+ * into it until they are in range. 
+ */
+struct timer_wheel{
+    uint32_t    now;
+    size_t      nsleeping;
+    queue_tid_t root[WHEEL_ROOT_SLOTS];
+    queue_tid_t outer[WHEEL_OUTER_LEVELS][WHEEL_OUTER_SLOTS];
+};
+
 
 uint64_t    sched_switch_ctx(struct context *save, struct context *restore, uint64_t retval, void *arg);
 void        sched_task_exit_trampoline(void);
@@ -200,11 +302,16 @@ static struct task            *s_freehead;
 static unsigned                s_nfree = MAX_TASKS;
 
 static struct task             s_tasks[MAX_TASKS];
-static char                    s_stacks[MAX_TASKS][STACK_SZ];
-static struct block_allocator  s_bigstacks;
+/* Protected by the request lock */
+static struct stack_pool       s_stack_pools[SCHED_STACK_CLASS_COUNT];
 static queue_tid_t             s_msg_queues[MAX_TASKS];
+static queue_msg_t             s_mailboxes[MAX_TASKS];
 static bool                    s_parent_waiting[MAX_TASKS];
 static khash_t(tqueue)        *s_event_queues;
+static struct timer_wheel      s_wheel;
+static uint32_t                s_wake_tick[MAX_TASKS];
+/* The tasks to make ready at the start of the next tick */
+static queue_tid_t             s_frame_yielded;
 
 /* Lock used to serialzie the scheduler requests */
 static SDL_mutex              *s_request_lock;
@@ -218,21 +325,38 @@ static SDL_mutex              *s_request_lock;
  * 
  * We have 2 diff. queues to allow only de-queuing tasks based
  * on the thread. The worker threads will not dequeue from the 
- * 'main' queues.
+ * 'main' queues. Selecting the next task from either is constant-
+ * time, regardless of the number of ready tasks (see 'ready_queue').
  *
  * All the queues are protected by the ready lock.
  */
-static pq_task_t        s_ready_queue;
-static pq_task_t        s_ready_queue_main;
+static struct ready_queue s_ready_queue;
+static struct ready_queue s_ready_queue_main;
+
+/* In addition to the shared queues, every worker owns a work-stealing deque.
+ * Tasks created from the context of a worker thread are pushed onto that 
+ * worker's own deque without taking the ready lock. Workers will first pop
+ * from their own deque, then from the shared ready queue, and finally try 
+ * to steal from the deques of other workers, starting at a random victim. 
+ * 
+ * Since arbitrary entries can't be removed from a deque, a task which is 
+ * in a deque has its 'queued' flag set. Whoever wants to run the task must
+ * first atomically clear the flag. Entries for which the flag is already
+ * cleared are stale and get skipped.
+ */
+static struct wsdeque   s_deques[MAX_WORKER_THREADS];
+static uint32_t         s_steal_seeds[MAX_WORKER_THREADS];
 
 static SDL_mutex       *s_ready_lock;
 static SDL_cond        *s_ready_cond;
-static int              s_nwaiters;     /* protected by ready lock */
+static SDL_atomic_t     s_nwaiters;     /* written under ready lock */
 static bool             s_quiesce;      /* protected by ready lock */
 static int              s_idle_workers; /* protected by ready lock */
 
 static size_t           s_nworkers;
 static SDL_Thread      *s_worker_threads[MAX_WORKER_THREADS];
+/* The set of logical CPUs each worker is restricted to, 0 if unrestricted */
+static uint64_t         s_worker_affinity[MAX_WORKER_THREADS];
 static struct context   s_worker_contexts[MAX_WORKER_THREADS];
 
 /* At the start of each frame, the workers wait on either the
@@ -245,13 +369,50 @@ static SDL_cond        *s_worker_conds[MAX_WORKER_THREADS];
 
 bool                    s_flushing = false;
 
+/* File reads are serviced by a few dedicated threads, so that they 
+ * don't block the workers. Everything is protected by the lock. */
+static struct{
+    SDL_Thread *threads[IO_THREADS];
+    SDL_mutex  *lock;
+    SDL_cond   *cond;
+    SDL_cond   *idle_cond;
+    queue_io_t  queue;
+    int         inflight;
+    bool        quit;
+}s_io;
+
+/* The frame arenas are double-buffered: the arenas of the current generation
+ * are allocated from during a tick, and the ones of the previous generation 
+ * are only cleared at the end of the next tick. The last slot is used by the
+ * main thread. The arenas are only ever touched by their owning thread, 
+ * except for when the workers are quiesced.
+ */
+static struct memstack  s_frame_arenas[FRAME_ARENA_GENERATIONS][MAX_WORKER_THREADS + 1];
+static int              s_frame_gen;
+
+static struct task_graph s_tick_graph;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static int sched_stack_class(uint32_t flags)
+{
+    if(flags & TASK_BIG_STACK)
+        return SCHED_STACK_BIG;
+    if(flags & TASK_MEDIUM_STACK)
+        return SCHED_STACK_MEDIUM;
+    return SCHED_STACK_SMALL;
+}
+
+static size_t sched_stack_size(uint32_t flags)
+{
+    return s_stack_pools[sched_stack_class(flags)].stack_size;
+}
+
 static void sched_init_ctx(struct task *task, void *code)
 {
-    const size_t stack_size = (task->flags & TASK_BIG_STACK) ? BIG_STACK_SZ : STACK_SZ;
+    const size_t stack_size = sched_stack_size(task->flags);
     char *stack_end = task->stackmem;
     char *stack_base = stack_end + stack_size;
     stack_base = (char*)ALIGNED((uintptr_t)stack_base, 32);
@@ -388,7 +549,7 @@ static bool stack_pointer_valid(const struct task *task)
     if(((uint64_t)sp) & 0x7)
         return false; /* violated alignment */
 
-    size_t size = (task->flags & TASK_BIG_STACK) ? BIG_STACK_SZ : STACK_SZ;
+    size_t size = sched_stack_size(task->flags);
     if(sp < (uintptr_t)task->stackmem)
         return false; /* overflow */
 
@@ -458,21 +619,305 @@ static void sched_task_free(struct task *task)
     s_nfree++;
 }
 
+static void wsdeque_reset(struct wsdeque *deque)
+{
+    SDL_AtomicSet(&deque->top, 0);
+    SDL_AtomicSet(&deque->bottom, 0);
+}
+
+static int wsdeque_size(struct wsdeque *deque)
+{
+    int top = SDL_AtomicGet(&deque->top);
+    int bottom = SDL_AtomicGet(&deque->bottom);
+    return (bottom > top) ? bottom - top : 0;
+}
+
+static bool wsdeque_push(struct wsdeque *deque, struct task *task)
+{
+    int bottom = SDL_AtomicGet(&deque->bottom);
+    int top = SDL_AtomicGet(&deque->top);
+    if(bottom - top >= WSDEQUE_SZ)
+        return false;
+
+    deque->buff[bottom & WSDEQUE_MASK] = task;
+    SDL_CompilerBarrier();
+    SDL_AtomicSet(&deque->bottom, bottom + 1);
+    return true;
+}
+
+static struct task *wsdeque_pop(struct wsdeque *deque)
+{
+    int bottom = SDL_AtomicGet(&deque->bottom) - 1;
+    SDL_AtomicSet(&deque->bottom, bottom);
+    int top = SDL_AtomicGet(&deque->top);
+
+    if(top > bottom) {
+        SDL_AtomicSet(&deque->bottom, bottom + 1);
+        return NULL;
+    }
+
+    struct task *ret = deque->buff[bottom & WSDEQUE_MASK];
+    if(top == bottom) {
+        /* Last element - race against the thieves for it */
+        if(!SDL_AtomicCAS(&deque->top, top, top + 1))
+            ret = NULL;
+        SDL_AtomicSet(&deque->bottom, bottom + 1);
+    }
+    return ret;
+}
+
+static struct task *wsdeque_steal(struct wsdeque *deque)
+{
+    int top = SDL_AtomicGet(&deque->top);
+    SDL_CompilerBarrier();
+    int bottom = SDL_AtomicGet(&deque->bottom);
+
+    if(top >= bottom)
+        return NULL;
+
+    struct task *ret = deque->buff[top & WSDEQUE_MASK];
+    if(!SDL_AtomicCAS(&deque->top, top, top + 1))
+        return NULL;
+    return ret;
+}
+
+static bool sched_claim(struct task *task)
+{
+    return SDL_AtomicCAS(&task->queued, 1, 0);
+}
+
+static struct task *sched_deque_pop_task(int id)
+{
+    struct task *ret;
+    while((ret = wsdeque_pop(&s_deques[id]))) {
+        if(sched_claim(ret))
+            return ret;
+    }
+    return NULL;
+}
+
+static struct task *sched_deque_steal_task(int id)
+{
+    struct task *ret;
+    while((ret = wsdeque_steal(&s_deques[id]))) {
+        if(sched_claim(ret))
+            return ret;
+    }
+    return NULL;
+}
+
+/* Pass a negative 'thief' for threads which don't own a deque */
+static struct task *sched_steal_any(int thief)
+{
+    if(s_nworkers == 0)
+        return NULL;
+
+    uint32_t victim = 0;
+    if(thief >= 0) {
+        uint32_t x = s_steal_seeds[thief];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        s_steal_seeds[thief] = x;
+        victim = x % s_nworkers;
+    }
+
+    for(int i = 0; i < s_nworkers; i++) {
+        int curr = (victim + i) % s_nworkers;
+        if(curr == thief)
+            continue;
+        struct task *ret = sched_deque_steal_task(curr);
+        if(ret)
+            return ret;
+    }
+    return NULL;
+}
+
+static bool sched_deques_empty(void)
+{
+    for(int i = 0; i < s_nworkers; i++) {
+        if(wsdeque_size(&s_deques[i]) > 0)
+            return false;
+    }
+    return true;
+}
+
+static int rq_class(const struct task *task)
+{
+    return (task->flags & TASK_RUN_DURING_PAUSE) ? RQ_CLASS_PAUSE : RQ_CLASS_DEFAULT;
+}
+
+static int rq_prio(const struct task *task)
+{
+    return MIN(MAX(task->prio, 0), SCHED_NUM_PRIOS - 1);
+}
+
+static int rq_highest(uint32_t mask)
+{
+    assert(mask);
+#if defined(_MSC_VER)
+    unsigned long ret;
+    _BitScanReverse(&ret, mask);
+    return ret;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+static void rq_init(struct ready_queue *rq)
+{
+    memset(rq, 0, sizeof(*rq));
+}
+
+static size_t rq_size(const struct ready_queue *rq)
+{
+    return rq->size;
+}
+
+static void rq_push(struct ready_queue *rq, struct task *task)
+{
+    int cls = rq_class(task);
+    int prio = rq_prio(task);
+    assert(!task->rq);
+
+    task->rq = rq;
+    task->rq_seq = rq->seq++;
+    task->rq_next = NULL;
+    task->rq_prev = rq->tail[cls][prio];
+
+    if(task->rq_prev) {
+        task->rq_prev->rq_next = task;
+    }else{
+        rq->head[cls][prio] = task;
+        rq->mask[cls] |= (((uint32_t)1) << prio);
+    }
+    rq->tail[cls][prio] = task;
+    rq->size++;
+}
+
+static void rq_unlink(struct ready_queue *rq, struct task *task)
+{
+    int cls = rq_class(task);
+    int prio = rq_prio(task);
+    assert(task->rq == rq);
+
+    if(task->rq_prev) {
+        task->rq_prev->rq_next = task->rq_next;
+    }else{
+        rq->head[cls][prio] = task->rq_next;
+    }
+
+    if(task->rq_next) {
+        task->rq_next->rq_prev = task->rq_prev;
+    }else{
+        rq->tail[cls][prio] = task->rq_prev;
+    }
+
+    if(!rq->head[cls][prio]) {
+        rq->mask[cls] &= ~(((uint32_t)1) << prio);
+    }
+    task->rq = NULL;
+    rq->size--;
+}
+
+static bool rq_remove(struct ready_queue *rq, struct task *task)
+{
+    if(task->rq != rq)
+        return false;
+    rq_unlink(rq, task);
+    return true;
+}
+
+/* The first task of the highest-priority bucket of the allowed classes, 
+ * or NULL if there is none. */
+static struct task *rq_top(const struct ready_queue *rq, bool paused)
+{
+    struct task *ret = NULL;
+    for(int cls = paused ? RQ_CLASS_PAUSE : 0; cls < RQ_NUM_CLASSES; cls++) {
+
+        if(!rq->mask[cls])
+            continue;
+
+        struct task *curr = rq->head[cls][rq_highest(rq->mask[cls])];
+        if(!ret 
+        || rq_prio(curr) > rq_prio(ret)
+        || (rq_prio(curr) == rq_prio(ret) && curr->rq_seq < ret->rq_seq)) {
+            ret = curr;
+        }
+    }
+    return ret;
+}
+
+static bool rq_pop(struct ready_queue *rq, struct task **out, bool paused)
+{
+    struct task *task = rq_top(rq, paused);
+    if(!task)
+        return false;
+    rq_unlink(rq, task);
+    *out = task;
+    return true;
+}
+
 static void sched_reactivate(struct task *task)
 {
     SDL_LockMutex(s_ready_lock); 
     task->state = TASK_STATE_READY;
 
     if(task->flags & TASK_MAIN_THREAD_PINNED) {
-        pq_task_push(&s_ready_queue_main, task->prio, task);
+        rq_push(&s_ready_queue_main, task);
     }else{
-        pq_task_push(&s_ready_queue, task->prio, task);
+        rq_push(&s_ready_queue, task);
     }
 
     SDL_CondSignal(s_ready_cond);
     SDL_UnlockMutex(s_ready_lock);
 }
 
+static int sched_curr_thread_deque_idx(void)
+{
+    if(SDL_ThreadID() == g_main_thread_id)
+        return -1;
+
+    uint64_t key = thread_id_to_key(SDL_ThreadID());
+    khiter_t k = kh_get(tid, s_thread_worker_id_map, key);
+    if(k == kh_end(s_thread_worker_id_map))
+        return -1;
+    return kh_val(s_thread_worker_id_map, k);
+}
+
+/* Like sched_reactivate, but a task made ready from a worker thread gets 
+ * pushed onto that worker's own deque without contending for the ready lock.
+ */
+static void sched_reactivate_local(struct task *task)
+{
+    int id;
+    if((task->flags & TASK_MAIN_THREAD_PINNED)
+    || (id = sched_curr_thread_deque_idx()) < 0) {
+        sched_reactivate(task);
+        return;
+    }
+
+    task->state = TASK_STATE_READY;
+    SDL_AtomicSet(&task->queued, 1);
+
+    if(!wsdeque_push(&s_deques[id], task)) {
+        SDL_AtomicSet(&task->queued, 0);
+        sched_reactivate(task);
+        return;
+    }
+
+    /* The count is read with a read-modify-write, which is a full barrier 
+     * on every platform, same as the increment done by a worker before it 
+     * checks the deques. So either this sees the worker counted as a 
+     * waiter, or the worker sees the new deque entry before going to sleep. 
+     */
+    if(SDL_AtomicAdd(&s_nwaiters, 0) > 0) {
+        SDL_LockMutex(s_ready_lock); 
+        SDL_CondBroadcast(s_ready_cond);
+        SDL_UnlockMutex(s_ready_lock);
+    }
+}
+
 #ifndef _MSC_VER
 __attribute__((used)) 
 #endif
@@ -521,29 +966,46 @@ static void sched_task_init(struct task *task, int prio, uint32_t flags,
     task->future = future;
     task->earg = NULL;
     task->erelease = NULL;
+    task->rq = NULL;
+    /* Drop anything that was posted to the previous owner of the TID */
+    queue_msg_clear(&s_mailboxes[task->tid - 1]);
 
     if(task->future) {
         SDL_AtomicSet(&task->future->status, FUTURE_INCOMPLETE);    
     }
 
-    PERF_PUSH("stack alloc");
-    if(flags & TASK_BIG_STACK) {
-        task->stackmem = block_alloc(&s_bigstacks);
-    }else{
-        task->stackmem = s_stacks[task->tid - 1];
-    }
-    PERF_POP();
-
     sched_init_ctx(task, code);
-    sched_reactivate(task);
+    sched_reactivate_local(task);
+}
+
+static struct task_msg sched_sender_msg(struct task *send_task)
+{
+    /* The message is read in-place from the sender's buffer, which stays 
+     * valid for as long as the sender is reply-blocked. */
+    send_task->state = TASK_STATE_REPLY_BLOCKED;
+    return (struct task_msg){
+        .tid = send_task->tid,
+        .msg = (void*)send_task->req.argv[1],
+        .msglen = (size_t)send_task->req.argv[2],
+        .reply = true,
+    };
 }
 
 static void sched_send(struct task *task, uint32_t tid, void *msg, size_t msglen)
 {
     struct task *recv_task = &s_tasks[tid - 1];
 
+    /* hand the sender's buffer to a task blocked on a batched receive */
+    if(recv_task->state == TASK_STATE_SEND_BLOCKED
+    && recv_task->req.type == SCHED_REQ_RECEIVE_BATCH) {
+
+        struct task_msg *out = (struct task_msg*)recv_task->req.argv[0];
+        *out = sched_sender_msg(task);
+        recv_task->retval = 1;
+        sched_reactivate(recv_task);
+
     /* write data to blocked send-blocked task to unblock it */
-    if(recv_task->state == TASK_STATE_SEND_BLOCKED) {
+    }else if(recv_task->state == TASK_STATE_SEND_BLOCKED) {
 
         uint32_t *out_send = (uint32_t*)recv_task->req.argv[0];
         void *dst = (void*)recv_task->req.argv[1];
@@ -592,6 +1054,73 @@ static void sched_receive(struct task *task, uint32_t *out_tid, void *msg, size_
     }
 }
 
+static void sched_post(struct task *task, uint32_t tid, void *msg, size_t msglen)
+{
+    struct task *recv_task = &s_tasks[tid - 1];
+
+    if(recv_task->state == TASK_STATE_SEND_BLOCKED
+    && recv_task->req.type == SCHED_REQ_RECEIVE_BATCH
+    && recv_task->req.argv[2]) {
+
+        struct task_msg *out = (struct task_msg*)recv_task->req.argv[0];
+        *out = (struct task_msg){
+            .tid = task->tid,
+            .msg = msg,
+            .msglen = msglen,
+            .reply = false
+        };
+        recv_task->retval = 1;
+        sched_reactivate(recv_task);
+        task->retval = true;
+
+    }else{
+
+        struct posted_msg posted = (struct posted_msg){task->tid, msg, msglen};
+        task->retval = queue_msg_push(&s_mailboxes[tid - 1], &posted);
+    }
+    sched_reactivate(task);
+}
+
+static void sched_receive_batch(struct task *task, struct task_msg *out, size_t maxmsgs, bool posted)
+{
+    size_t nmsgs = 0;
+    queue_msg_t *mailbox = &s_mailboxes[task->tid - 1];
+    queue_tid_t *senders = &s_msg_queues[task->tid - 1];
+
+    while(posted && nmsgs < maxmsgs && queue_size(*mailbox) > 0) {
+
+        struct posted_msg curr;
+        queue_msg_pop(mailbox, &curr);
+        out[nmsgs++] = (struct task_msg){
+            .tid = curr.from,
+            .msg = curr.msg,
+            .msglen = curr.msglen,
+            .reply = false
+        };
+    }
+
+    while(nmsgs < maxmsgs && queue_size(*senders) > 0) {
+
+        uint32_t send_tid = 0;
+        queue_tid_pop(senders, &send_tid);
+        assert(send_tid > 0);
+
+        struct task *send_task = &s_tasks[send_tid - 1];
+        assert(send_task->state == TASK_STATE_RECV_BLOCKED);
+        out[nmsgs++] = sched_sender_msg(send_task);
+    }
+
+    if(nmsgs == 0 && maxmsgs > 0) {
+        task->state = TASK_STATE_SEND_BLOCKED;
+        return;
+    }
+
+    PERF_COUNTER_ADD("sched.msgs_batched", nmsgs);
+    task->retval = nmsgs;
+    assert(task->state != TASK_STATE_EVENT_BLOCKED);
+    sched_reactivate(task);
+}
+
 static void sched_reply(struct task *task, uint32_t tid, void *reply, size_t replylen)
 {
     struct task *send_task = &s_tasks[tid - 1];
@@ -653,6 +1182,148 @@ static void sched_task_cleanup(const struct task *task)
     }
 }
 
+static bool sched_wheel_init(void)
+{
+    int nroot = 0, nouter = 0;
+    for(; nroot < WHEEL_ROOT_SLOTS; nroot++) {
+        if(!queue_tid_init(&s_wheel.root[nroot], 8))
+            goto fail;
+    }
+    for(; nouter < WHEEL_OUTER_LEVELS * WHEEL_OUTER_SLOTS; nouter++) {
+        if(!queue_tid_init(&s_wheel.outer[0][0] + nouter, 8))
+            goto fail;
+    }
+    s_wheel.now = SDL_GetTicks();
+    s_wheel.nsleeping = 0;
+    return true;
+
+fail:
+    for(int i = 0; i < nroot; i++)
+        queue_tid_destroy(&s_wheel.root[i]);
+    for(int i = 0; i < nouter; i++)
+        queue_tid_destroy(&s_wheel.outer[0][0] + i);
+    return false;
+}
+
+static void sched_wheel_destroy(void)
+{
+    for(int i = 0; i < WHEEL_ROOT_SLOTS; i++)
+        queue_tid_destroy(&s_wheel.root[i]);
+    for(int i = 0; i < WHEEL_OUTER_LEVELS * WHEEL_OUTER_SLOTS; i++)
+        queue_tid_destroy(&s_wheel.outer[0][0] + i);
+}
+
+static queue_tid_t *sched_wheel_slot(uint32_t wake_tick)
+{
+    uint32_t delta = wake_tick - s_wheel.now;
+    if(delta < WHEEL_ROOT_SLOTS)
+        return &s_wheel.root[wake_tick & WHEEL_ROOT_MASK];
+
+    int level = 0;
+    int shift = WHEEL_ROOT_BITS;
+    while(level < WHEEL_OUTER_LEVELS - 1 
+       && delta >= (((uint32_t)1) << (shift + WHEEL_OUTER_BITS))) {
+        level++;
+        shift += WHEEL_OUTER_BITS;
+    }
+    return &s_wheel.outer[level][(wake_tick >> shift) & WHEEL_OUTER_MASK];
+}
+
+static bool sched_wheel_insert(uint32_t tid)
+{
+    queue_tid_t *slot = sched_wheel_slot(s_wake_tick[tid - 1]);
+    return queue_tid_push(slot, &tid);
+}
+
+static void sched_wheel_wake(struct task *task)
+{
+    assert(task->state == TASK_STATE_SLEEP_BLOCKED);
+    s_wheel.nsleeping--;
+    task->retval = 0;
+    sched_reactivate(task);
+}
+
+/* Re-file the current entries of the slot relative to the current time. 
+ * Entries which are due are woken up right away. 
+ */
+static void sched_wheel_refile(queue_tid_t *slot)
+{
+    size_t n = queue_size(*slot);
+    for(size_t i = 0; i < n; i++) {
+
+        uint32_t tid;
+        if(!queue_tid_pop(slot, &tid))
+            break;
+        struct task *task = &s_tasks[tid - 1];
+
+        if((int32_t)(s_wake_tick[tid - 1] - s_wheel.now) <= 0 
+        || !sched_wheel_insert(tid)) {
+            sched_wheel_wake(task);
+        }
+    }
+}
+
+static void sched_wheel_advance(uint32_t to)
+{
+    if(s_wheel.nsleeping == 0) {
+        s_wheel.now = to;
+        return;
+    }
+
+    while((int32_t)(to - s_wheel.now) > 0) {
+
+        uint32_t now = ++s_wheel.now;
+        if((now & WHEEL_ROOT_MASK) == 0) {
+
+            int shift = WHEEL_ROOT_BITS;
+            for(int i = 0; i < WHEEL_OUTER_LEVELS; i++, shift += WHEEL_OUTER_BITS) {
+                uint32_t idx = (now >> shift) & WHEEL_OUTER_MASK;
+                sched_wheel_refile(&s_wheel.outer[i][idx]);
+                if(idx != 0)
+                    break;
+            }
+        }
+        sched_wheel_refile(&s_wheel.root[now & WHEEL_ROOT_MASK]);
+
+        if(s_wheel.nsleeping == 0) {
+            s_wheel.now = to;
+            break;
+        }
+    }
+}
+
+static void sched_sleep(struct task *task, uint32_t ms)
+{
+    uint32_t wake_tick = SDL_GetTicks() + ms;
+    s_wake_tick[task->tid - 1] = wake_tick;
+    task->state = TASK_STATE_SLEEP_BLOCKED;
+    s_wheel.nsleeping++;
+
+    /* The slot for the current time has already been processed */
+    if((int32_t)(wake_tick - s_wheel.now) <= 0 
+    || !sched_wheel_insert(task->tid)) {
+        sched_wheel_wake(task);
+    }
+}
+
+static void sched_yield_frame(struct task *task)
+{
+    task->state = TASK_STATE_FRAME_BLOCKED;
+    if(!queue_tid_push(&s_frame_yielded, &task->tid)) {
+        sched_reactivate(task);
+    }
+}
+
+static void sched_wake_frame_yielded(void)
+{
+    uint32_t tid;
+    while(queue_tid_pop(&s_frame_yielded, &tid)) {
+        struct task *task = &s_tasks[tid - 1];
+        assert(task->state == TASK_STATE_FRAME_BLOCKED);
+        sched_reactivate(task);
+    }
+}
+
 static void sched_await_event(struct task *task, int event)
 {
     task->state = TASK_STATE_EVENT_BLOCKED;
@@ -676,7 +1347,17 @@ static uint32_t sched_create(int prio, task_func_t code, void *arg, struct futur
     if(!task)
         return NULL_TID;
 
+    PERF_PUSH("stack alloc");
+    task->stackmem = stack_pool_alloc(&s_stack_pools[sched_stack_class(flags)]);
+    PERF_POP();
+
+    if(!task->stackmem) {
+        sched_task_free(task);
+        return NULL_TID;
+    }
+
     sched_task_init(task, prio, flags, code, arg, result, parent);
+    PERF_COUNTER_ADD("sched.tasks_spawned", 1);
     return task->tid;
 }
 
@@ -711,6 +1392,7 @@ static void sched_task_run(struct task *task)
     char name[64];
     pf_snprintf(name, sizeof(name), "Task %03u", task->tid);
     PERF_PUSH(name);
+    PERF_COUNTER_ADD("sched.task_switches", 1);
 
     if(SDL_ThreadID() == g_main_thread_id) {
         sched_switch_ctx(&s_main_ctx, &task->ctx, task->retval, task->arg);
@@ -752,6 +1434,9 @@ static void sched_task_service_request(struct task *task)
     case SCHED_REQ_YIELD:
         sched_reactivate(task);
         break;
+    case SCHED_REQ_YIELD_FRAME:
+        sched_yield_frame(task);
+        break;
     case SCHED_REQ_SEND:
         sched_send(
             task, 
@@ -768,6 +1453,22 @@ static void sched_task_service_request(struct task *task)
             (size_t)    task->req.argv[2]
         );
         break;
+    case SCHED_REQ_POST:
+        sched_post(
+            task, 
+            (uint32_t)  task->req.argv[0], 
+            (void*)     task->req.argv[1], 
+            (size_t)    task->req.argv[2]
+        );
+        break;
+    case SCHED_REQ_RECEIVE_BATCH:
+        sched_receive_batch(
+            task, 
+            (struct task_msg*)task->req.argv[0], 
+            (size_t)          task->req.argv[1], 
+            (bool)            task->req.argv[2]
+        );
+        break;
     case SCHED_REQ_REPLY:
         sched_reply(
             task, 
@@ -782,6 +1483,12 @@ static void sched_task_service_request(struct task *task)
             (int)       task->req.argv[0]
         );
         break;
+    case SCHED_REQ_SLEEP:
+        sched_sleep(
+            task, 
+            (uint32_t)  task->req.argv[0]
+        );
+        break;
     case SCHED_REQ_SET_DESTRUCTOR:
 
         task->destructor = (void (*)(void*))task->req.argv[0];
@@ -793,9 +1500,8 @@ static void sched_task_service_request(struct task *task)
         break;
     case _SCHED_REQ_FREE:
 
-        if(task->flags & TASK_BIG_STACK) {
-            block_free(&s_bigstacks, task->stackmem);
-        }
+        stack_pool_free(&s_stack_pools[sched_stack_class(task->flags)], task->stackmem);
+        task->stackmem = NULL;
         if(task->flags & TASK_DETACHED) {
             sched_task_free(task);
         }else if(s_parent_waiting[task->tid - 1]) {
@@ -878,7 +1584,7 @@ static void sched_wait_workers_done(void)
     SDL_UnlockMutex(s_ready_lock);
 
     assert(s_idle_workers == s_nworkers);
-    assert(s_nwaiters == 0);
+    assert(SDL_AtomicGet(&s_nwaiters) == 0);
 }
 
 static void sched_wait_workers_idle(int count)
@@ -905,6 +1611,33 @@ static void sched_quiesce_workers(void)
     PERF_RETURN_VOID();
 }
 
+static struct memstack *sched_curr_frame_arena(void)
+{
+    int idx = sched_curr_thread_deque_idx();
+    if(idx < 0) {
+        assert(SDL_ThreadID() == g_main_thread_id);
+        idx = s_nworkers;
+    }
+
+    struct memstack *ret = &s_frame_arenas[s_frame_gen][idx];
+    if(!ret->head && !stalloc_init(ret))
+        return NULL;
+    return ret;
+}
+
+static void sched_flip_frame_arenas(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    s_frame_gen = (s_frame_gen + 1) % FRAME_ARENA_GENERATIONS;
+    for(int i = 0; i <= s_nworkers; i++) {
+        struct memstack *curr = &s_frame_arenas[s_frame_gen][i];
+        if(curr->head) {
+            stalloc_clear(curr);
+        }
+    }
+}
+
 static void worker_wait_on_cmd(int id)
 {
     SDL_LockMutex(s_worker_locks[id]);
@@ -922,173 +1655,553 @@ static void worker_notify_done(int id)
     SDL_UnlockMutex(s_ready_lock);
 }
 
-static struct task *worker_wait_task_or_quiesce(void)
+static struct task *worker_wait_task_or_quiesce(int id)
 {
     struct task *task = NULL;
 
     SDL_LockMutex(s_ready_lock);
-    s_nwaiters++;
+    int nwaiters = SDL_AtomicAdd(&s_nwaiters, 1) + 1;
 
-    if(s_nwaiters == s_nworkers) {
+    if(nwaiters == s_nworkers) {
         SDL_CondBroadcast(s_ready_cond);
     }
 
-    while(!s_quiesce && !pq_task_pop(&s_ready_queue, &task)) {
+    while(!s_quiesce 
+       && !rq_pop(&s_ready_queue, &task, false)
+       && !(task = sched_steal_any(id))) {
         SDL_CondWait(s_ready_cond, s_ready_lock);
     }
 
-    s_nwaiters--;
+    SDL_AtomicAdd(&s_nwaiters, -1);
     SDL_UnlockMutex(s_ready_lock);
     return task;
 }
 
-static void worker_do_work(int id)
+static void worker_do_work(int id)
+{
+    while(true) {
+
+        struct task *task = NULL;
+        if(!s_quiesce) {
+            task = sched_deque_pop_task(id);
+        }
+        if(!task) {
+            task = worker_wait_task_or_quiesce(id);
+        }
+        if(!task)
+            return;
+
+        assert(task);
+        sched_task_run(task);
+        sched_task_service_request(task);
+    }
+}
+
+static int worker_threadfn(void *arg)
+{
+    int id = (uintptr_t)arg;
+    if(s_worker_affinity[id]) {
+        cpu_topo_pin_current_thread(s_worker_affinity[id]);
+    }
+    worker_notify_done(id);
+
+    while(true) {
+
+        worker_wait_on_cmd(id);
+        if(s_worker_quit[id])
+            break;
+        worker_do_work(id);
+        worker_notify_done(id);
+    }
+    return 0;
+}
+
+static bool do_run_sync(uint32_t tid, bool dequeue)
+{
+    SDL_LockMutex(s_request_lock);
+    bool ret = false;
+
+    struct task *task = &s_tasks[tid - 1];
+    if(dequeue && !(task->flags & TASK_DETACHED)) {
+        goto out;
+    }
+    if(dequeue && task->state != TASK_STATE_READY) {
+        goto out;
+    }
+
+    bool found = false;
+    if(dequeue) {
+        SDL_LockMutex(s_ready_lock);
+        found = rq_remove(&s_ready_queue, task) 
+             || rq_remove(&s_ready_queue_main, task);
+        SDL_UnlockMutex(s_ready_lock);
+        /* The task may be sitting in a worker's deque */
+        if(!found) {
+            found = sched_claim(task);
+        }
+    }
+
+    if(dequeue && !found)
+        goto out;
+
+    if(sched_curr_thread_tid() == NULL_TID) {
+
+        sched_task_run(task);
+        sched_task_service_request(task);
+
+    }else{
+        SDL_UnlockMutex(s_request_lock);
+        S_Task_MaybeExit();
+
+        Sched_Request((struct request){
+            .type = _SCHED_REQ_RUN_SYNC,
+            .argv[0] = (uint64_t)tid
+        });
+
+        S_Task_MaybeEnter();
+        SDL_LockMutex(s_request_lock);
+    }
+    ret = true;
+
+out:
+    SDL_UnlockMutex(s_request_lock);
+    return ret;
+}
+
+static bool work_exists(void)
+{
+    bool ret;
+    SDL_LockMutex(s_ready_lock);
+    ret = rq_size(&s_ready_queue_main) || rq_size(&s_ready_queue);
+    SDL_UnlockMutex(s_ready_lock);
+    return ret || !sched_deques_empty();
+}
+
+static struct task *next_main_thread_task(void)
+{
+    /* During a pause, only the tasks with the TASK_RUN_DURING_PAUSE
+     * flag can run. */
+    bool paused = (G_GetSimState() != G_RUNNING);
+    struct task *ret = NULL;
+
+    SDL_LockMutex(s_ready_lock);
+    struct task *main = rq_top(&s_ready_queue_main, paused);
+    struct task *gen = rq_top(&s_ready_queue, paused);
+
+    if(gen && (!main || rq_prio(gen) > rq_prio(main))) {
+        rq_unlink(&s_ready_queue, gen);
+        ret = gen;
+    }else if(main) {
+        rq_unlink(&s_ready_queue_main, main);
+        ret = main;
+    }
+    SDL_UnlockMutex(s_ready_lock);
+
+    /* Help the workers out when there's nothing else to do */
+    if(!ret && !paused) {
+        ret = sched_steal_any(-1);
+    }
+    return ret;
+}
+
+static bool pfor_claim(struct pfor_work *work, size_t *out_begin, size_t *out_end)
+{
+    const int total = work->end - work->begin;
+    while(true) {
+
+        int curr = SDL_AtomicGet(&work->next);
+        if(curr >= total)
+            return false;
+
+        /* Guided self-scheduling: hand out large chunks while there's a lot
+         * of work left and progressively smaller ones towards the end, so 
+         * that all the participants finish at roughly the same time. */
+        int left = total - curr;
+        int chunk = MAX(work->grain, left / (2 * work->nparts));
+        chunk = MIN(chunk, left);
+
+        if(SDL_AtomicCAS(&work->next, curr, curr + chunk)) {
+            *out_begin = work->begin + curr;
+            *out_end = work->begin + curr + chunk;
+            return true;
+        }
+    }
+}
+
+static struct result pfor_task(void *arg)
+{
+    struct pfor_work *work = arg;
+    size_t begin, end;
+
+    while(pfor_claim(work, &begin, &end)) {
+        work->fn(begin, end, work->arg);
+        Sched_TryYield();
+    }
+    return NULL_RESULT;
+}
+
+static uint32_t sched_create_any_ctx(int prio, task_func_t code, void *arg, 
+                                     struct future *future, int flags)
+{
+    if(Sched_ActiveTID() == NULL_TID) {
+        ASSERT_IN_MAIN_THREAD();
+        return Sched_Create(prio, code, arg, future, flags);
+    }
+
+    return Sched_Request((struct request){
+        .type = SCHED_REQ_CREATE,
+        .argv[0] = prio,
+        .argv[1] = (uint64_t)code,
+        .argv[2] = (uint64_t)arg,
+        .argv[3] = (uint64_t)future,
+        .argv[4] = flags | TASK_DETACHED,
+    });
+}
+
+static uint32_t pfor_spawn(struct pfor_work *work, struct future *future)
+{
+    SDL_AtomicSet(&future->status, FUTURE_INCOMPLETE);
+    return sched_create_any_ctx(4, pfor_task, work, future, TASK_BIG_STACK);
+}
+
+static bool graph_node_done(const struct task_graph *graph, int idx)
+{
+    return graph->nodes[idx].started 
+        && Sched_FutureIsReady(&graph->nodes[idx].future);
+}
+
+static bool graph_node_runnable(const struct task_graph *graph, int idx)
+{
+    uint32_t deps = graph->nodes[idx].deps;
+    for(int i = 0; i < graph->nnodes; i++) {
+        if((deps & (1u << i)) && !graph_node_done(graph, i))
+            return false;
+    }
+    return true;
+}
+
+/* Kick off every node that has all of its' dependencies satisfied. 
+ * Returns the number of nodes that are not yet complete.
+ */
+static size_t graph_pump(struct task_graph *graph)
+{
+    size_t nleft = 0;
+    for(int i = 0; i < graph->nnodes; i++) {
+
+        if(!graph->nodes[i].used || graph_node_done(graph, i))
+            continue;
+        nleft++;
+
+        if(graph->nodes[i].started)
+            continue;
+        if(!graph_node_runnable(graph, i))
+            continue;
+
+        uint32_t tid = sched_create_any_ctx(graph->nodes[i].prio, graph->nodes[i].code, 
+            graph->nodes[i].arg, &graph->nodes[i].future, graph->nodes[i].flags);
+        /* We'll try again on the next pump */
+        if(tid == NULL_TID)
+            continue;
+
+        graph->nodes[i].tid = tid;
+        graph->nodes[i].started = true;
+    }
+    return nleft;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void io_complete(struct io_req *req, void *data, size_t size)
+{
+    if(req->out_size) {
+        *req->out_size = size;
+    }
+    req->future->res = (struct result){
+        .type = RESULT_PTR,
+        .val.as_ptr = data
+    };
+    SDL_AtomicSet(&req->future->status, FUTURE_COMPLETE);
+}
+
+static void io_read(struct io_req *req)
 {
-    while(true) {
+    void *data = NULL;
+    size_t size = 0;
 
-        struct task *task = worker_wait_task_or_quiesce();
-        if(!task)
-            return;
+    SDL_RWops *stream = SDL_RWFromFile(req->path, "rb");
+    if(!stream)
+        goto out;
 
-        assert(task);
-        sched_task_run(task);
-        sched_task_service_request(task);
+    Sint64 len = SDL_RWsize(stream);
+    if(len < 0)
+        goto out_close;
+
+    /* Keep a NULL terminator past the end for text files */
+    data = malloc(len + 1);
+    if(!data)
+        goto out_close;
+
+    if(len > 0 && SDL_RWread(stream, data, len, 1) != 1) {
+        free(data);
+        data = NULL;
+        goto out_close;
     }
+    ((char*)data)[len] = '\0';
+    size = len;
+
+out_close:
+    SDL_RWclose(stream);
+out:
+    io_complete(req, data, size);
 }
 
-static int worker_threadfn(void *arg)
+static int io_threadfn(void *arg)
 {
-    int id = (uintptr_t)arg;
-    worker_notify_done(id);
-
+    SDL_LockMutex(s_io.lock);
     while(true) {
 
-        worker_wait_on_cmd(id);
-        if(s_worker_quit[id])
+        while(queue_size(s_io.queue) == 0 && !s_io.quit) {
+            SDL_CondWait(s_io.cond, s_io.lock);
+        }
+        if(queue_size(s_io.queue) == 0)
             break;
-        worker_do_work(id);
-        worker_notify_done(id);
+
+        struct io_req req;
+        queue_io_pop(&s_io.queue, &req);
+        s_io.inflight++;
+        SDL_UnlockMutex(s_io.lock);
+
+        io_read(&req);
+
+        SDL_LockMutex(s_io.lock);
+        s_io.inflight--;
+        if(queue_size(s_io.queue) == 0 && s_io.inflight == 0) {
+            SDL_CondBroadcast(s_io.idle_cond);
+        }
     }
+    SDL_UnlockMutex(s_io.lock);
     return 0;
 }
 
-static int tasks_compare(void *a, void *b)
+static void sched_io_shutdown(void)
 {
-    struct task *ta = *(struct task**)a;
-    struct task *tb = *(struct task**)b;
-    return ((uintptr_t)(ta) - (uintptr_t)(tb));
+    SDL_LockMutex(s_io.lock);
+    s_io.quit = true;
+    SDL_CondBroadcast(s_io.cond);
+    SDL_UnlockMutex(s_io.lock);
+
+    for(int i = 0; i < IO_THREADS; i++) {
+        if(s_io.threads[i])
+            SDL_WaitThread(s_io.threads[i], NULL);
+    }
+    queue_io_destroy(&s_io.queue);
+    SDL_DestroyCond(s_io.idle_cond);
+    SDL_DestroyCond(s_io.cond);
+    SDL_DestroyMutex(s_io.lock);
+    memset(&s_io, 0, sizeof(s_io));
 }
 
-static bool do_run_sync(uint32_t tid, bool dequeue)
+static bool sched_io_init(void)
 {
-    SDL_LockMutex(s_request_lock);
-    bool ret = false;
-
-    struct task *task = &s_tasks[tid - 1];
-    if(dequeue && !(task->flags & TASK_DETACHED)) {
-        goto out;
-    }
-    if(dequeue && task->state != TASK_STATE_READY) {
-        goto out;
-    }
-
-    bool found = false;
-    if(dequeue) {
-        SDL_LockMutex(s_ready_lock);
-        found = pq_task_remove(&s_ready_queue, tasks_compare, task) 
-             || pq_task_remove(&s_ready_queue_main, tasks_compare, task);
-        SDL_UnlockMutex(s_ready_lock);
-    }
-
-    if(dequeue && !found)
-        goto out;
+    memset(&s_io, 0, sizeof(s_io));
 
-    if(sched_curr_thread_tid() == NULL_TID) {
+    if(!queue_io_init(&s_io.queue, 64))
+        goto fail_queue;
+    if(!(s_io.lock = SDL_CreateMutex()))
+        goto fail_lock;
+    if(!(s_io.cond = SDL_CreateCond()))
+        goto fail_cond;
+    if(!(s_io.idle_cond = SDL_CreateCond()))
+        goto fail_idle_cond;
 
-        sched_task_run(task);
-        sched_task_service_request(task);
+    for(int i = 0; i < IO_THREADS; i++) {
 
-    }else{
-        SDL_UnlockMutex(s_request_lock);
-        S_Task_MaybeExit();
+        char threadname[128];
+        pf_snprintf(threadname, sizeof(threadname), "io-%d", i);
+        s_io.threads[i] = SDL_CreateThread(io_threadfn, threadname, NULL);
+        if(!s_io.threads[i]) {
+            sched_io_shutdown();
+            return false;
+        }
+    }
+    return true;
 
-        Sched_Request((struct request){
-            .type = _SCHED_REQ_RUN_SYNC,
-            .argv[0] = (uint64_t)tid
-        });
+fail_idle_cond:
+    SDL_DestroyCond(s_io.cond);
+fail_cond:
+    SDL_DestroyMutex(s_io.lock);
+fail_lock:
+    queue_io_destroy(&s_io.queue);
+fail_queue:
+    return false;
+}
 
-        S_Task_MaybeEnter();
-        SDL_LockMutex(s_request_lock);
+/* Wait for all the outstanding reads, since their futures may 
+ * live on the stacks of tasks that are about to be dropped. */
+static void sched_io_drain(void)
+{
+    SDL_LockMutex(s_io.lock);
+    while(queue_size(s_io.queue) > 0 || s_io.inflight > 0) {
+        SDL_CondWait(s_io.idle_cond, s_io.lock);
     }
-    ret = true;
-
-out:
-    SDL_UnlockMutex(s_request_lock);
-    return ret;
+    SDL_UnlockMutex(s_io.lock);
 }
 
-static bool work_exists(void)
+static bool worker_count_validate(const struct sval *new_val)
 {
-    bool ret;
-    SDL_LockMutex(s_ready_lock);
-    ret = pq_size(&s_ready_queue_main) || pq_size(&s_ready_queue);
-    SDL_UnlockMutex(s_ready_lock);
-    return ret;
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    return (new_val->as_int >= 0 && new_val->as_int <= MAX_WORKER_THREADS);
 }
 
-static bool can_run_during_pause(void *arg)
+static bool bool_val_validate(const struct sval *new_val)
 {
-    struct task *task = *(struct task**)arg;
-    return (task->flags & TASK_RUN_DURING_PAUSE);
+    return (new_val->type == ST_TYPE_BOOL);
 }
 
-static struct task *next_main_thread_task(void)
+static bool parse_affinity(const char *str, uint64_t *out)
 {
-    struct task *ret = NULL;
-    if(G_GetSimState() == G_RUNNING) {
+    if(!strcmp(str, "auto")) {
+        *out = 0;
+        return true;
+    }
+    char *end;
+    *out = strtoull(str, &end, 0);
+    return (end != str && *end == '\0' && *out != 0);
+}
 
-        SDL_LockMutex(s_ready_lock);
-        if(pq_size(&s_ready_queue_main) || pq_size(&s_ready_queue)) {
+static bool affinity_validate(const struct sval *new_val)
+{
+    uint64_t mask;
+    if(new_val->type != ST_TYPE_STRING)
+        return false;
+    return parse_affinity(new_val->as_string, &mask);
+}
 
-            float prio_main = -1.0, prio_gen = -1.0;
-            pq_task_top_prio(&s_ready_queue_main, &prio_main);
-            pq_task_top_prio(&s_ready_queue, &prio_gen);
+static void sched_create_settings(void)
+{
+    /* The worker settings only take effect on the next startup */
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.sched.worker_threads",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 0 /* one per physical core */
+        },
+        .prio = 0,
+        .validate = worker_count_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* A mask of logical CPUs (ex. "0xfc") or "auto" */
+    status = Settings_Create((struct setting){
+        .name = "pf.sched.worker_affinity",
+        .val = (struct sval) {
+            .type = ST_TYPE_STRING,
+            .as_string = "auto"
+        },
+        .prio = 0,
+        .validate = affinity_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Bind every worker to a single logical CPU */
+    status = Settings_Create((struct setting){
+        .name = "pf.sched.pin_workers",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Keep the workers off a core so that the render thread 
+     * doesn't have to compete with them */
+    status = Settings_Create((struct setting){
+        .name = "pf.sched.reserve_render_core",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+    (void)status;
+}
 
-            if(prio_gen > prio_main) {
-                pq_task_pop(&s_ready_queue, &ret);
-            }else {
-                pq_task_pop(&s_ready_queue_main, &ret);
-            }
+static void sched_config_workers(void)
+{
+    struct cpu_topo topo;
+    cpu_topo_query(&topo);
+
+    struct sval count, affinity, pin, reserve;
+    Settings_Get("pf.sched.worker_threads", &count);
+    Settings_Get("pf.sched.worker_affinity", &affinity);
+    Settings_Get("pf.sched.pin_workers", &pin);
+    Settings_Get("pf.sched.reserve_render_core", &reserve);
+
+    uint64_t mask = 0;
+    parse_affinity(affinity.as_string, &mask);
+
+    /* Order the logical CPUs so that the workers are spread over the P-cores
+     * first, then over the E-cores, and only then over the SMT siblings. */
+    const uint64_t passes[] = {
+        topo.primary & ~topo.efficiency,
+        topo.primary & topo.efficiency,
+        topo.online & ~topo.primary & ~topo.efficiency,
+        topo.online & ~topo.primary & topo.efficiency,
+    };
+    int cpus[CPU_TOPO_MAX_CPUS];
+    int ncpus = 0;
+
+    for(int i = 0; i < ARR_SIZE(passes); i++) {
+        for(int j = 0; j < CPU_TOPO_MAX_CPUS; j++) {
+            uint64_t bit = ((uint64_t)1) << j;
+            if(!(passes[i] & bit))
+                continue;
+            if(mask && !(mask & bit))
+                continue;
+            cpus[ncpus++] = j;
         }
-        SDL_UnlockMutex(s_ready_lock);
-        return ret;
-
-    }else{
-        /* During a pause, only the tasks with the TASK_RUN_DURING_PAUSE
-         * flag can run. */
-        SDL_LockMutex(s_ready_lock);
+    }
 
-        if(pq_size(&s_ready_queue_main) || pq_size(&s_ready_queue)) {
+    /* Unless they are given an explicit mask, the workers don't use the 
+     * first core (left to the main thread) and, optionally, the second 
+     * core (left to the render thread). */
+    int nworkers = ncpus;
+    int first = 0;
+    if(!mask) {
+        int nreserved = reserve.as_bool ? 2 : 1;
+        nworkers = MAX(topo.nphysical - nreserved, 0);
+        first = MIN(nreserved, ncpus);
+    }
+    if(count.as_int > 0) {
+        nworkers = count.as_int;
+    }
+    s_nworkers = MIN(nworkers, MAX_WORKER_THREADS);
 
-            float prio_main = -1.0, prio_gen = -1.0;
-            pq_task_top_prio_of(&s_ready_queue_main, &prio_main, can_run_during_pause);
-            pq_task_top_prio_of(&s_ready_queue, &prio_gen, can_run_during_pause);
+    uint64_t allowed = 0;
+    for(int i = first; i < ncpus; i++) {
+        allowed |= ((uint64_t)1) << cpus[i];
+    }
 
-            if(prio_gen > prio_main) {
-                pq_task_pop_matching(&s_ready_queue, &ret, can_run_during_pause);
-            }else {
-                pq_task_pop_matching(&s_ready_queue_main, &ret, can_run_during_pause);
-            }
+    for(int i = 0; i < s_nworkers; i++) {
+        if(pin.as_bool && ncpus > first) {
+            s_worker_affinity[i] = ((uint64_t)1) << cpus[first + (i % (ncpus - first))];
+        }else{
+            s_worker_affinity[i] = mask ? allowed : 0;
         }
-        SDL_UnlockMutex(s_ready_lock);
-        return ret;
     }
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
-
 bool Sched_Init(void)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -1117,13 +2230,8 @@ bool Sched_Init(void)
     if(!s_ready_cond)
         goto fail_ready_cond;
 
-    pq_task_init(&s_ready_queue);
-    if(!pq_task_reserve(&s_ready_queue, MAX_TASKS))
-        goto fail_ready_queue;
-
-    pq_task_init(&s_ready_queue_main);
-    if(!pq_task_reserve(&s_ready_queue_main, MAX_TASKS))
-        goto fail_ready_queue_main;
+    rq_init(&s_ready_queue);
+    rq_init(&s_ready_queue_main);
 
     assert(MAX_TASKS >= 2);
     s_tasks[0].prev = NULL;
@@ -1136,7 +2244,12 @@ bool Sched_Init(void)
         s_tasks[i].prev = &s_tasks[i - 1];
     }
     s_freehead = s_tasks;
-    block_alloc_init(&s_bigstacks, BIG_STACK_SZ, 8);
+    if(!stack_pool_init(&s_stack_pools[SCHED_STACK_SMALL], STACK_SZ, MAX_TASKS, MAX_TASKS))
+        goto fail_small_stacks;
+    if(!stack_pool_init(&s_stack_pools[SCHED_STACK_MEDIUM], MEDIUM_STACK_SZ, 64, 16))
+        goto fail_medium_stacks;
+    if(!stack_pool_init(&s_stack_pools[SCHED_STACK_BIG], BIG_STACK_SZ, 32, 8))
+        goto fail_big_stacks;
 
     for(int i = 0; i < MAX_TASKS; i++) {
 
@@ -1144,10 +2257,23 @@ bool Sched_Init(void)
         s_tasks[i].state = TASK_STATE_ACTIVE;
         if(!queue_tid_init(&s_msg_queues[i], MAX_TASKS))
             goto fail_msg_queue;
+        if(!queue_msg_init(&s_mailboxes[i], 4))
+            goto fail_msg_queue;
     }
 
+    if(!sched_wheel_init())
+        goto fail_msg_queue;
+    if(!queue_tid_init(&s_frame_yielded, 32))
+        goto fail_frame_yielded;
+
     /* On a single-core system, all the tasks will just be run on the main thread */
-    s_nworkers = SDL_GetCPUCount() - 1;
+    sched_create_settings();
+    sched_config_workers();
+
+    for(int i = 0; i < s_nworkers; i++) {
+        wsdeque_reset(&s_deques[i]);
+        s_steal_seeds[i] = 2654435761u * (i + 1);
+    }
 
     for(int i = 0; i < s_nworkers; i++) {
 
@@ -1176,6 +2302,9 @@ bool Sched_Init(void)
         Perf_RegisterThread(SDL_GetThreadID(s_worker_threads[i]), threadname);
     }
 
+    if(!sched_io_init())
+        goto fail_workers;
+
     sched_init_thread_tid_map();
     sched_init_thread_worker_id_map();
     Task_CreateServices();
@@ -1195,14 +2324,20 @@ fail_worker_sync:
         if(s_worker_conds[i])
             SDL_DestroyCond(s_worker_conds[i]);
     }
+    queue_tid_destroy(&s_frame_yielded);
+fail_frame_yielded:
+    sched_wheel_destroy();
 fail_msg_queue:
     for(int i = 0; i < MAX_TASKS; i++) {
         queue_tid_destroy(s_msg_queues + i);
+        queue_msg_destroy(s_mailboxes + i);
     }
-    pq_task_destroy(&s_ready_queue_main);
-fail_ready_queue_main:
-    pq_task_destroy(&s_ready_queue);
-fail_ready_queue:
+    stack_pool_destroy(&s_stack_pools[SCHED_STACK_BIG]);
+fail_big_stacks:
+    stack_pool_destroy(&s_stack_pools[SCHED_STACK_MEDIUM]);
+fail_medium_stacks:
+    stack_pool_destroy(&s_stack_pools[SCHED_STACK_SMALL]);
+fail_small_stacks:
     SDL_DestroyCond(s_ready_cond);
 fail_ready_cond:
     SDL_DestroyMutex(s_ready_lock);
@@ -1231,25 +2366,36 @@ void Sched_Shutdown(void)
     });
     kh_destroy(tqueue, s_event_queues);
 
-    block_alloc_destroy(&s_bigstacks);
+    for(int i = 0; i < SCHED_STACK_CLASS_COUNT; i++) {
+        stack_pool_destroy(&s_stack_pools[i]);
+    }
     SDL_DestroyCond(s_ready_cond);
     SDL_DestroyMutex(s_ready_lock);
     kh_destroy(tid, s_thread_tid_map);
     kh_destroy(tid, s_thread_worker_id_map);
     SDL_DestroyMutex(s_request_lock);
-    pq_task_destroy(&s_ready_queue);
-    pq_task_destroy(&s_ready_queue_main);
 
     for(int i = 0; i < s_nworkers; i++) {
         sched_signal_worker_quit(i);
         SDL_WaitThread(s_worker_threads[i], NULL);
     }
+    sched_io_shutdown();
     for(int i = 0; i < s_nworkers; i++) {
         SDL_DestroyMutex(s_worker_locks[i]);
         SDL_DestroyCond(s_worker_conds[i]);
     }
     for(int i = 0; i < MAX_TASKS; i++) {
         queue_tid_destroy(s_msg_queues + i);
+        queue_msg_destroy(s_mailboxes + i);
+    }
+    queue_tid_destroy(&s_frame_yielded);
+    sched_wheel_destroy();
+    for(int i = 0; i < FRAME_ARENA_GENERATIONS; i++) {
+        for(int j = 0; j <= s_nworkers; j++) {
+            if(s_frame_arenas[i][j].head) {
+                stalloc_destroy(&s_frame_arenas[i][j]);
+            }
+        }
     }
 }
 
@@ -1258,13 +2404,17 @@ void Sched_HandleEvent(int event, void *arg, int event_source, bool immediate)
     ASSERT_IN_MAIN_THREAD();
     SDL_LockMutex(s_request_lock);
 
+    /* Most events (including all the timer ticks) have no tasks waiting 
+     * on them. Don't do any more work than the lookup for those. */
+    khiter_t k = kh_get(tqueue, s_event_queues, event);
+    if(k == kh_end(s_event_queues) || queue_size(kh_val(s_event_queues, k)) == 0) {
+        SDL_UnlockMutex(s_request_lock);
+        return;
+    }
+
     queue_tid_t torun;
     queue_tid_init(&torun, 32);
 
-    khiter_t k = kh_get(tqueue, s_event_queues, event);
-    if(k == kh_end(s_event_queues))
-        goto out;
-
     queue_tid_t *waiters = &kh_val(s_event_queues, k);
     while(queue_size(*waiters) > 0) {
 
@@ -1300,7 +2450,6 @@ void Sched_HandleEvent(int event, void *arg, int event_source, bool immediate)
         do_run_sync(tid, false);
     }
 
-out:
     queue_tid_destroy(&torun);
     SDL_UnlockMutex(s_request_lock);
 }    
@@ -1327,13 +2476,18 @@ void Sched_Tick(void)
     ASSERT_IN_MAIN_THREAD();
     PERF_ENTER();
 
+    SDL_LockMutex(s_request_lock);
+    sched_wheel_advance(SDL_GetTicks());
+    sched_wake_frame_yielded();
+    SDL_UnlockMutex(s_request_lock);
+
     /* Use a do-while to ensure we're always making at least _some_ forward progress */
     do{
         int nwaiters = 0;
         struct task *curr = NULL;
 
         while(!work_exists()
-           && ((nwaiters = s_nwaiters) < s_nworkers)
+           && ((nwaiters = SDL_AtomicGet(&s_nwaiters)) < s_nworkers)
            && (s_idle_workers < s_nworkers)
            && !s_flushing) {
 
@@ -1365,6 +2519,7 @@ void Sched_Tick(void)
     }while(Perf_CurrFrameMS() < SCHED_TICK_MS);
 
     sched_quiesce_workers();
+    sched_flip_frame_arenas();
     PERF_RETURN_VOID();
 }
 
@@ -1386,21 +2541,30 @@ void Sched_ClearState(void)
 {
     ASSERT_IN_MAIN_THREAD();
 
+    sched_io_drain();
     sched_quiesce_workers();
     SDL_LockMutex(s_ready_lock);
 
-    while(pq_size(&s_ready_queue)) {
+    while(rq_size(&s_ready_queue)) {
         struct task *curr = NULL;
-        pq_task_pop(&s_ready_queue, &curr);
+        rq_pop(&s_ready_queue, &curr, false);
         sched_task_cleanup(curr);
     }
 
-    while(pq_size(&s_ready_queue_main)) {
+    while(rq_size(&s_ready_queue_main)) {
         struct task *curr = NULL;
-        pq_task_pop(&s_ready_queue_main, &curr);
+        rq_pop(&s_ready_queue_main, &curr, false);
         sched_task_cleanup(curr);
     }
 
+    for(int i = 0; i < s_nworkers; i++) {
+        struct task *curr;
+        while((curr = sched_deque_steal_task(i))) {
+            sched_task_cleanup(curr);
+        }
+        wsdeque_reset(&s_deques[i]);
+    }
+
     SDL_UnlockMutex(s_ready_lock);
 
     for(khiter_t k = kh_begin(s_event_queues); k != kh_end(s_event_queues); k++) {
@@ -1415,6 +2579,26 @@ void Sched_ClearState(void)
         queue_tid_clear(queue);
     }
 
+    for(int i = 0; i < WHEEL_ROOT_SLOTS + WHEEL_OUTER_LEVELS * WHEEL_OUTER_SLOTS; i++) {
+
+        queue_tid_t *queue = (i < WHEEL_ROOT_SLOTS) ? &s_wheel.root[i]
+                           : &s_wheel.outer[0][0] + (i - WHEEL_ROOT_SLOTS);
+        for(int j = 0; j < queue_size(*queue); j++) {
+            struct task *curr = &s_tasks[queue_at(*queue, j) - 1];
+            sched_task_cleanup(curr);
+        }
+        queue_tid_clear(queue);
+    }
+    s_wheel.nsleeping = 0;
+
+    for(int i = 0; i < queue_size(s_frame_yielded); i++) {
+        struct task *curr = &s_tasks[queue_at(s_frame_yielded, i) - 1];
+        sched_task_cleanup(curr);
+    }
+    queue_tid_clear(&s_frame_yielded);
+    /* The tasks of any outstanding nodes have been dropped along with the rest */
+    Sched_GraphInit(&s_tick_graph);
+
     for(int i = 0; i < MAX_TASKS; i++) {
 
         queue_tid_t *queue = &s_msg_queues[i];
@@ -1423,6 +2607,7 @@ void Sched_ClearState(void)
             sched_task_cleanup(curr);
         }
         queue_tid_clear(queue);
+        queue_msg_clear(&s_mailboxes[i]);
 
         if(s_tasks[i].state == TASK_STATE_SEND_BLOCKED) {
             struct task *curr = &s_tasks[i];
@@ -1432,6 +2617,16 @@ void Sched_ClearState(void)
         s_tasks[i].state = TASK_STATE_ACTIVE;
     }
 
+    /* Return the stacks of all the dropped tasks to the pools */
+    uint32_t active = Sched_ActiveTID();
+    for(int i = 0; i < MAX_TASKS; i++) {
+        struct task *curr = &s_tasks[i];
+        if(curr->tid == active || !curr->stackmem)
+            continue;
+        stack_pool_free(&s_stack_pools[sched_stack_class(curr->flags)], curr->stackmem);
+        curr->stackmem = NULL;
+    }
+
     /* Reset the free list */
     s_tasks[0].prev = NULL;
     s_tasks[0].next = &s_tasks[1];
@@ -1479,6 +2674,28 @@ uint32_t Sched_ActiveTID(void)
     return sched_curr_thread_tid();
 }
 
+bool Sched_ReadFileAsync(const char *path, struct future *result, size_t *out_size)
+{
+    struct io_req req = (struct io_req){
+        .future = result,
+        .out_size = out_size
+    };
+    if(pf_strlcpy(req.path, path, sizeof(req.path)) >= sizeof(req.path))
+        return false;
+
+    SDL_AtomicSet(&result->status, FUTURE_INCOMPLETE);
+
+    SDL_LockMutex(s_io.lock);
+    bool ret = queue_io_push(&s_io.queue, &req);
+    if(ret) {
+        SDL_CondSignal(s_io.cond);
+    }
+    SDL_UnlockMutex(s_io.lock);
+
+    PERF_COUNTER_ADD("sched.async_reads", 1);
+    return ret;
+}
+
 bool Sched_FutureIsReady(const struct future *future)
 {
     return (SDL_AtomicGet((SDL_atomic_t*)&future->status) == FUTURE_COMPLETE);
@@ -1520,9 +2737,14 @@ uint32_t Sched_CreateBlocking(int prio, task_func_t code, void *arg,
         if(ret == NULL_TID) {
 
             SDL_LockMutex(s_ready_lock); 
-            status = pq_task_pop(&s_ready_queue_main, &task) || pq_task_pop(&s_ready_queue, &task);
+            status = rq_pop(&s_ready_queue_main, &task, false) 
+                  || rq_pop(&s_ready_queue, &task, false);
             SDL_UnlockMutex(s_ready_lock);
 
+            if(!status) {
+                status = ((task = sched_steal_any(-1)) != NULL);
+            }
+
             if(status) {
                 sched_task_run(task);
                 sched_task_service_request(task);
@@ -1553,10 +2775,13 @@ void Sched_Flush(void)
     sched_quiesce_workers();
     struct task *curr;
 
-    while(pq_task_pop(&s_ready_queue, &curr)) {
+    while(rq_pop(&s_ready_queue, &curr, false)) {
+        do_run_sync(curr->tid, false);
+    }
+    while(rq_pop(&s_ready_queue_main, &curr, false)) {
         do_run_sync(curr->tid, false);
     }
-    while(pq_task_pop(&s_ready_queue_main, &curr)) {
+    while((curr = sched_steal_any(-1))) {
         do_run_sync(curr->tid, false);
     }
     s_flushing = false;
@@ -1567,10 +2792,19 @@ bool Sched_HasBlocked(void)
     ASSERT_IN_MAIN_THREAD();
 
     SDL_LockMutex(s_ready_lock); 
-    bool ret = (pq_size(&s_ready_queue) > 0)
-            || (pq_size(&s_ready_queue_main) > 0);
+    bool ret = (rq_size(&s_ready_queue) > 0)
+            || (rq_size(&s_ready_queue_main) > 0);
     SDL_UnlockMutex(s_ready_lock);
-    return ret;
+    return ret || !sched_deques_empty();
+}
+
+void Sched_WakeFrameYielded(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    SDL_LockMutex(s_request_lock);
+    sched_wake_frame_yielded();
+    SDL_UnlockMutex(s_request_lock);
 }
 
 bool Sched_IsReady(uint32_t tid)
@@ -1582,3 +2816,217 @@ bool Sched_IsReady(uint32_t tid)
     return ret;
 }
 
+void Sched_ParallelForAsync(struct pfor_work *work, size_t begin, size_t end, 
+                            size_t grain, pfor_func_t fn, void *arg)
+{
+    assert(end >= begin);
+    assert(end - begin <= INT_MAX);
+
+    grain = MAX(grain, 1);
+    size_t nchunks = (end - begin + grain - 1) / grain;
+    size_t nhelpers = (nchunks > 0) ? MIN(s_nworkers, nchunks - 1) : 0;
+    nhelpers = MIN(nhelpers, SCHED_MAX_PFOR_HELPERS);
+
+    work->begin = begin;
+    work->end = end;
+    work->grain = grain;
+    work->nparts = nhelpers + 1;
+    work->fn = fn;
+    work->arg = arg;
+    work->nhelpers = 0;
+    SDL_AtomicSet(&work->next, 0);
+
+    for(int i = 0; i < nhelpers; i++) {
+
+        uint32_t tid = pfor_spawn(work, &work->futures[work->nhelpers]);
+        if(tid == NULL_TID)
+            break;
+        work->tids[work->nhelpers++] = tid;
+    }
+}
+
+void Sched_ParallelForJoin(struct pfor_work *work)
+{
+    size_t begin, end;
+
+    /* Rather than blocking, help out with the remaining chunks */
+    while(pfor_claim(work, &begin, &end)) {
+        work->fn(begin, end, work->arg);
+    }
+
+    for(int i = 0; i < work->nhelpers; i++) {
+        while(!Sched_FutureIsReady(&work->futures[i])) {
+            Sched_RunSync(work->tids[i]);
+        }
+    }
+    work->nhelpers = 0;
+}
+
+size_t Sched_Concurrency(void)
+{
+    return s_nworkers + 1;
+}
+
+void Sched_ParallelFor(size_t begin, size_t end, size_t grain, pfor_func_t fn, void *arg)
+{
+    struct pfor_work work;
+    Sched_ParallelForAsync(&work, begin, end, grain, fn, arg);
+    Sched_ParallelForJoin(&work);
+}
+
+void Sched_GraphInit(struct task_graph *graph)
+{
+    graph->nnodes = 0;
+}
+
+int Sched_GraphAdd(struct task_graph *graph, int prio, task_func_t code, void *arg, 
+                   uint32_t reads, uint32_t writes, int flags)
+{
+    int idx = 0;
+    while(idx < graph->nnodes && graph->nodes[idx].used)
+        idx++;
+
+    if(idx == SCHED_MAX_GRAPH_NODES)
+        return -1;
+    if(idx == graph->nnodes)
+        graph->nnodes++;
+
+    uint32_t deps = 0;
+    for(int i = 0; i < graph->nnodes; i++) {
+
+        if(i == idx || !graph->nodes[i].used)
+            continue;
+        /* The previous occupant of the slot has completed */
+        graph->nodes[i].deps &= ~(1u << idx);
+
+        if(graph_node_done(graph, i))
+            continue;
+        uint32_t prev_reads = graph->nodes[i].reads;
+        uint32_t prev_writes = graph->nodes[i].writes;
+        if((prev_writes & (reads | writes)) || (prev_reads & writes)) {
+            deps |= (1u << i);
+        }
+    }
+
+    graph->nodes[idx].code = code;
+    graph->nodes[idx].arg = arg;
+    graph->nodes[idx].prio = prio;
+    graph->nodes[idx].flags = flags;
+    graph->nodes[idx].reads = reads;
+    graph->nodes[idx].writes = writes;
+    graph->nodes[idx].deps = deps;
+    graph->nodes[idx].tid = NULL_TID;
+    graph->nodes[idx].used = true;
+    graph->nodes[idx].started = false;
+    SDL_AtomicSet(&graph->nodes[idx].future.status, FUTURE_INCOMPLETE);
+    return idx;
+}
+
+void Sched_GraphSubmit(struct task_graph *graph)
+{
+    graph_pump(graph);
+}
+
+bool Sched_GraphDone(struct task_graph *graph)
+{
+    return (graph_pump(graph) == 0);
+}
+
+void Sched_GraphJoin(struct task_graph *graph)
+{
+    while(graph_pump(graph) > 0) {
+
+        for(int i = 0; i < graph->nnodes; i++) {
+            if(!graph->nodes[i].started || graph_node_done(graph, i))
+                continue;
+            Sched_RunSync(graph->nodes[i].tid);
+        }
+    }
+    for(int i = 0; i < graph->nnodes; i++) {
+        graph->nodes[i].used = false;
+    }
+    graph->nnodes = 0;
+}
+
+void Sched_GraphJoinNode(struct task_graph *graph, int idx)
+{
+    assert(idx >= 0);
+    /* The node has been dropped along with the graph (ex. by Sched_ClearState) */
+    if(idx >= graph->nnodes || !graph->nodes[idx].used)
+        return;
+
+    while(!graph_node_done(graph, idx)) {
+
+        graph_pump(graph);
+        /* The node may be waiting on dependencies which are not started 
+         * yet, so help out with anything that is in flight */
+        for(int i = 0; i < graph->nnodes; i++) {
+            if(!graph->nodes[i].used || !graph->nodes[i].started || graph_node_done(graph, i))
+                continue;
+            Sched_RunSync(graph->nodes[i].tid);
+        }
+    }
+
+    graph->nodes[idx].used = false;
+    while(graph->nnodes > 0 && !graph->nodes[graph->nnodes - 1].used)
+        graph->nnodes--;
+    /* Dependents of the node may now be started */
+    graph_pump(graph);
+}
+
+struct task_graph *Sched_TickGraph(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+    return &s_tick_graph;
+}
+
+void *Sched_FrameAlloc(size_t size)
+{
+    return Sched_FrameRealloc(NULL, size);
+}
+
+void *Sched_FrameRealloc(void *ptr, size_t size)
+{
+    struct memstack *arena = sched_curr_frame_arena();
+    if(!arena)
+        return NULL;
+
+    /* Every allocation is prefixed with its' size, so that it can be copied
+     * when it can't be grown in place. */
+    union frame_hdr *hdr = ptr ? ((union frame_hdr*)ptr) - 1 : NULL;
+    size_t old_size = hdr ? hdr->size : 0;
+    if(hdr && size <= old_size)
+        return ptr;
+
+    hdr = stalloc_realloc(arena, hdr, sizeof(*hdr) + old_size, sizeof(*hdr) + size);
+    if(!hdr)
+        return NULL;
+    hdr->size = size;
+    return hdr + 1;
+}
+
+void Sched_FrameFree(void *ptr)
+{
+    if(!ptr)
+        return;
+
+    /* Only the most recent allocation of this thread's arena can be given 
+     * back. Everything else is released when the arena is cleared. */
+    struct memstack *arena = sched_curr_frame_arena();
+    if(!arena)
+        return;
+
+    union frame_hdr *hdr = ((union frame_hdr*)ptr) - 1;
+    stalloc_release(arena, hdr, sizeof(*hdr) + hdr->size);
+}
+
+size_t Sched_GetStackStats(size_t maxout, struct stack_pool_stats *out)
+{
+    size_t ret = MIN(maxout, SCHED_STACK_CLASS_COUNT);
+    SDL_LockMutex(s_request_lock);
+    for(int i = 0; i < ret; i++) {
+        stack_pool_get_stats(&s_stack_pools[i], &out[i]);
+    }
+    SDL_UnlockMutex(s_request_lock);
+    return ret;
+}
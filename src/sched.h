@@ -83,14 +83,90 @@ enum{
     TASK_MAIN_THREAD_PINNED = (1 << 0),
     TASK_DETACHED           = (1 << 1),
     TASK_BIG_STACK          = (1 << 2),
-    TASK_RUN_DURING_PAUSE   = (1 << 3)
+    TASK_RUN_DURING_PAUSE   = (1 << 3),
+    TASK_MEDIUM_STACK       = (1 << 4),
 };
 
+enum{
+    SCHED_STACK_SMALL,
+    SCHED_STACK_MEDIUM,
+    SCHED_STACK_BIG,
+    SCHED_STACK_CLASS_COUNT
+};
+
+struct stack_pool_stats;
+
 typedef struct result (*task_func_t)(void *);
+typedef void (*pfor_func_t)(size_t begin, size_t end, void *arg);
+
+#define SCHED_MAX_PFOR_HELPERS (64)
+
+/* State of a parallel-for loop. The range [begin, end) is split into 
+ * chunks that are claimed by the helper tasks and the joining thread. 
+ * The chunk size adapts to the amount of remaining work, but never 
+ * goes below 'grain'. 
+ */
+struct pfor_work{
+    size_t        begin;
+    size_t        end;
+    size_t        grain;
+    size_t        nparts;
+    pfor_func_t   fn;
+    void         *arg;
+    SDL_atomic_t  next;
+    size_t        nhelpers;
+    uint32_t      tids[SCHED_MAX_PFOR_HELPERS];
+    struct future futures[SCHED_MAX_PFOR_HELPERS];
+};
+
+#define SCHED_MAX_GRAPH_NODES (32)
+
+/* Shared simulation state that task graph nodes may declare as 
+ * being read or written. Two nodes conflict when one of them writes
+ * a resource that the other one reads or writes. */
+enum{
+    SCHED_RES_POSITIONS     = (1 << 0),
+    SCHED_RES_NAV_FIELDS    = (1 << 1),
+    SCHED_RES_FOG           = (1 << 2),
+    SCHED_RES_MOVESTATE     = (1 << 3),
+    SCHED_RES_COMBATSTATE   = (1 << 4),
+    SCHED_RES_PROJECTILES   = (1 << 5),
+    SCHED_RES_MAP           = (1 << 6),
+};
+
+/* A small dependency graph of tasks. Nodes are added in program order.
+ * A node depends on every earlier node it conflicts with that has not 
+ * completed yet, and is only started once all of its' dependencies have 
+ * completed. Nodes that don't conflict are free to run concurrently. 
+ * The slot of a node is reused once the node has been joined, so that 
+ * a graph may be fed continuously by joining nodes individually.
+ */
+struct task_graph{
+    size_t nnodes;
+    struct{
+        task_func_t   code;
+        void         *arg;
+        int           prio;
+        int           flags;
+        uint32_t      reads;
+        uint32_t      writes;
+        uint32_t      deps;     /* bitmask of node indices */
+        uint32_t      tid;
+        bool          used;
+        bool          started;
+        struct future future;
+    }nodes[SCHED_MAX_GRAPH_NODES];
+};
 
 /* The following may only be called from any context */
 
 bool     Sched_FutureIsReady(const struct future *future);
+/* Read the whole file on a dedicated I/O thread. Once 'result' is ready, it
+ * holds a NULL-terminated buffer (RESULT_PTR) that must be freed by the
+ * caller, or NULL if the file could not be read. The size, if requested, 
+ * is written to 'out_size' before the result is made ready. 
+ */
+bool     Sched_ReadFileAsync(const char *path, struct future *result, size_t *out_size);
 void     Sched_TryYield(void);
 
 /* The following may only be called from main thread context */
@@ -107,6 +183,47 @@ void     Sched_ClearState(void);
 void     Sched_Flush(void);
 bool     Sched_HasBlocked(void);
 bool     Sched_IsReady(uint32_t tid);
+/* Make the tasks which yielded until the next tick (Task_YieldFrame) ready 
+ * right away. */
+void     Sched_WakeFrameYielded(void);
+size_t   Sched_GetStackStats(size_t maxout, struct stack_pool_stats *out);
+/* The graph shared by the simulation tick handlers. Each handler adds its' 
+ * asynchronous stage as a node and joins it with Sched_GraphJoinNode at the
+ * point where it consumes the results, so that the stages of different 
+ * subsystems which don't conflict overlap across their' tick barriers. */
+struct task_graph *Sched_TickGraph(void);
+
+/* The following may be called from main thread or task context */
+
+/* The number of threads (the workers and the main thread) that tasks can run
+ * on. Work should be split into this many parts rather than by CPU count. */
+size_t   Sched_Concurrency(void);
+void     Sched_ParallelFor(size_t begin, size_t end, size_t grain, pfor_func_t fn, void *arg);
+void     Sched_ParallelForAsync(struct pfor_work *work, size_t begin, size_t end, 
+                                size_t grain, pfor_func_t fn, void *arg);
+void     Sched_ParallelForJoin(struct pfor_work *work);
+
+void     Sched_GraphInit(struct task_graph *graph);
+int      Sched_GraphAdd(struct task_graph *graph, int prio, task_func_t code, void *arg, 
+                        uint32_t reads, uint32_t writes, int flags);
+void     Sched_GraphSubmit(struct task_graph *graph);
+bool     Sched_GraphDone(struct task_graph *graph);
+void     Sched_GraphJoin(struct task_graph *graph);
+/* Wait for a single node (and so, its' dependencies) and release its' slot */
+void     Sched_GraphJoinNode(struct task_graph *graph, int idx);
+
+/* Every worker thread (and the main thread) owns a frame arena. Allocations 
+ * are served from the arena of the calling thread without any locking and 
+ * are all released at once at the end of the tick following the one in which
+ * they were made. Hence, they may be held across a single tick boundary (ex.
+ * by a task that gets suspended at the end of the frame), but not longer.
+ * The realloc and free functions match the allocator hooks of the 'vec', 
+ * 'queue' and 'pq' containers. Freeing only gives back memory when it is 
+ * the most recent allocation of the calling thread.
+ */
+void    *Sched_FrameAlloc(size_t size);
+void    *Sched_FrameRealloc(void *ptr, size_t size);
+void     Sched_FrameFree(void *ptr);
 
 /* The following may only be called from task context 
  * (i.e. from the body of a task function) */
@@ -119,9 +236,13 @@ enum reqtype{
     SCHED_REQ_SEND,
     SCHED_REQ_RECEIVE,
     SCHED_REQ_REPLY,
+    SCHED_REQ_POST,
+    SCHED_REQ_RECEIVE_BATCH,
     SCHED_REQ_AWAIT_EVENT,
     SCHED_REQ_SET_DESTRUCTOR,
     SCHED_REQ_WAIT,
+    SCHED_REQ_SLEEP,
+    SCHED_REQ_YIELD_FRAME,
     _SCHED_REQ_COUNT,
 };
 
@@ -70,6 +70,10 @@ void            S_Retain(script_opaque_t obj);
  * No-op in the case of a NULL-pointer passed in */
 void            S_Release(script_opaque_t obj);
 script_opaque_t S_WrapEngineEventArg(int eventnum, void *arg);
+/* Returns a new list of (uid, arg) tuples for a batched event handler. The 
+ * references to the args are not stolen. */
+script_opaque_t S_PackEventBatch(size_t nevents, const uint32_t *uids, 
+                                 const script_opaque_t *args);
 /* Returns 'arg' if this is not a weakref object. Otherwise, return a borrowed
  * reference extracted from the weakref. */
 script_opaque_t S_UnwrapIfWeakref(script_opaque_t arg);
@@ -86,6 +90,13 @@ bool            S_LoadState(SDL_RWops *stream);
 void            S_Task_MaybeExit(void);
 void            S_Task_MaybeEnter(void);
 
+/* Collect the young generations of Python objects if they're due and 
+ * there's enough time left before the end of the frame. */
+void            S_GC_CollectIdle(void);
+/* Collect all the generations. This can take tens of milliseconds, so it 
+ * should only be done when a hitch is not noticeable. */
+void            S_GC_CollectFull(void);
+
 /*###########################################################################*/
 /* SCRIPT UI                                                                 */
 /*###########################################################################*/
@@ -0,0 +1,385 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include <Python.h> /* Must be included first */
+
+#include "py_bench.h"
+#include "../game/public/game.h"
+#include "../navigation/public/nav.h"
+#include "../lib/public/flat_map.h"
+#include "../lib/public/lib_bench.h"
+#include "../pf_math.h"
+
+
+#define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
+
+static PyObject *PyBench_position_index(PyObject *self, PyObject *args);
+static PyObject *PyBench_hash_maps(PyObject *self, PyObject *args);
+static PyObject *PyBench_containers(PyObject *self, PyObject *args);
+static PyObject *PyBench_math(PyObject *self, PyObject *args);
+static PyObject *PyBench_nav_queues(PyObject *self, PyObject *args);
+static PyObject *PyBench_fieldcache_policies(PyObject *self);
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static PyMethodDef s_bench_methods[] = {
+
+    {"position_index", 
+    (PyCFunction)PyBench_position_index, METH_VARARGS,
+    "Time the same sequence of inserts, moves, radius queries and copies of N random positions "
+    "over M ticks against both the quadtree and the grid position index backends."},
+
+    {"hash_maps", 
+    (PyCFunction)PyBench_hash_maps, METH_VARARGS,
+    "Time the same sequence of inserts, lookups, deletions and iterations of N uid keys "
+    "against both the khash table and the flat hash map."},
+
+    {"containers", 
+    (PyCFunction)PyBench_containers, METH_VARARGS,
+    "Time inserts, lookups, deletions and iterations of N elements in each of the library "
+    "containers (vec, queue, pqueue, khash, lru, mpool), with key distributions modeled on the "
+    "engine's use of them."},
+
+    {"math", 
+    (PyCFunction)PyBench_math, METH_VARARGS,
+    "Time the same sequence of matrix and quaternion operations on N operands with both the "
+    "reference scalar routines and the (SIMD) ones used by the engine."},
+
+    {"nav_queues", 
+    (PyCFunction)PyBench_nav_queues, METH_VARARGS,
+    "Build the integration fields leading to every portal of the current map N times over with "
+    "the binary heap, the indexed 4-ary heap and the bucket queue, optionally on the specified "
+    "navigation layer."},
+
+    {"fieldcache_policies", 
+    (PyCFunction)PyBench_fieldcache_policies, METH_NOARGS,
+    "Replay the field cache lookups recorded while the 'pf.game.fieldcache_trace' setting was "
+    "enabled against the LRU, CLOCK and 2Q replacement policies and return the hit rates."},
+
+    {NULL}  /* Sentinel */
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static PyObject *PyBench_position_index(PyObject *self, PyObject *args)
+{
+    int nents, nticks;
+    if(!PyArg_ParseTuple(args, "ii", &nents, &nticks)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting two arguments: number of entities (integer) and ticks (integer).");
+        return NULL;
+    }
+    if(nents <= 0 || nticks <= 0) {
+        PyErr_SetString(PyExc_ValueError, "The number of entities and ticks must be positive.");
+        return NULL;
+    }
+
+    struct pos_bench_result results[2];
+    G_Pos_BenchmarkIndices(nents, nticks, results);
+
+    const char *names[] = {
+        [POS_INDEX_QUADTREE] = "quadtree",
+        [POS_INDEX_GRID] = "grid"
+    };
+
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < ARR_SIZE(results); i++) {
+        PyObject *dict = Py_BuildValue("{s:d, s:d, s:d, s:d, s:n}",
+            "insert_ms", results[i].insert_ms,
+            "move_ms", results[i].move_ms,
+            "query_ms", results[i].query_ms,
+            "copy_ms", results[i].copy_ms,
+            "found", (Py_ssize_t)results[i].nfound);
+        if(!dict)
+            goto fail;
+        int status = PyDict_SetItemString(ret, names[i], dict);
+        Py_DECREF(dict);
+        if(0 != status)
+            goto fail;
+    }
+    return ret;
+
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+static PyObject *PyBench_hash_maps(PyObject *self, PyObject *args)
+{
+    int nentries;
+    if(!PyArg_ParseTuple(args, "i", &nentries)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one argument: number of entries (integer).");
+        return NULL;
+    }
+    if(nentries <= 0) {
+        PyErr_SetString(PyExc_ValueError, "The number of entries must be positive.");
+        return NULL;
+    }
+
+    struct fm_bench_result results[2];
+    fm_benchmark(nentries, results);
+
+    const char *names[] = {
+        [FM_BENCH_KHASH] = "khash",
+        [FM_BENCH_FLAT_MAP] = "flat_map"
+    };
+
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < ARR_SIZE(results); i++) {
+        PyObject *dict = Py_BuildValue("{s:d, s:d, s:d, s:d, s:d, s:n}",
+            "insert_ms", results[i].insert_ms,
+            "hit_ms", results[i].hit_ms,
+            "miss_ms", results[i].miss_ms,
+            "delete_ms", results[i].delete_ms,
+            "iterate_ms", results[i].iterate_ms,
+            "found", (Py_ssize_t)results[i].nfound);
+        if(!dict)
+            goto fail;
+        int status = PyDict_SetItemString(ret, names[i], dict);
+        Py_DECREF(dict);
+        if(0 != status)
+            goto fail;
+    }
+    return ret;
+
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+static PyObject *PyBench_containers(PyObject *self, PyObject *args)
+{
+    int nentries;
+    if(!PyArg_ParseTuple(args, "i", &nentries)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one argument: number of entries (integer).");
+        return NULL;
+    }
+    if(nentries <= 0) {
+        PyErr_SetString(PyExc_ValueError, "The number of entries must be positive.");
+        return NULL;
+    }
+
+    struct lib_bench_result results[LIB_BENCH_COUNT];
+    lib_benchmark(nentries, results);
+
+    const char *names[] = {
+        [LIB_BENCH_VEC] = "vec",
+        [LIB_BENCH_QUEUE] = "queue",
+        [LIB_BENCH_PQUEUE] = "pqueue",
+        [LIB_BENCH_KHASH] = "khash",
+        [LIB_BENCH_LRU] = "lru",
+        [LIB_BENCH_MPOOL] = "mpool"
+    };
+
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < ARR_SIZE(results); i++) {
+        PyObject *dict = Py_BuildValue("{s:d, s:d, s:d, s:d, s:n}",
+            "insert_ms", results[i].insert_ms,
+            "lookup_ms", results[i].lookup_ms,
+            "delete_ms", results[i].delete_ms,
+            "iterate_ms", results[i].iterate_ms,
+            "checksum", (Py_ssize_t)results[i].checksum);
+        if(!dict)
+            goto fail;
+        int status = PyDict_SetItemString(ret, names[i], dict);
+        Py_DECREF(dict);
+        if(0 != status)
+            goto fail;
+    }
+    return ret;
+
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+static PyObject *PyBench_math(PyObject *self, PyObject *args)
+{
+    int noperands;
+    if(!PyArg_ParseTuple(args, "i", &noperands)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one argument: number of operands (integer).");
+        return NULL;
+    }
+    if(noperands <= 0) {
+        PyErr_SetString(PyExc_ValueError, "The number of operands must be positive.");
+        return NULL;
+    }
+
+    struct pfm_bench_result results[2];
+    PFM_Benchmark(noperands, results);
+
+    const char *names[] = {
+        [PFM_BENCH_SCALAR] = "scalar",
+        [PFM_BENCH_SIMD] = "simd"
+    };
+
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < ARR_SIZE(results); i++) {
+        PyObject *dict = Py_BuildValue("{s:d, s:d, s:d, s:d, s:d, s:d, s:f}",
+            "mult4x4_ms", results[i].mult4x4_ms,
+            "mult4x1_ms", results[i].mult4x1_ms,
+            "inverse_ms", results[i].inverse_ms,
+            "quat_mult_ms", results[i].quat_mult_ms,
+            "mult4x4_batch_ms", results[i].mult4x4_batch_ms,
+            "mult4x1_batch_ms", results[i].mult4x1_batch_ms,
+            "checksum", results[i].checksum);
+        if(!dict)
+            goto fail;
+        int status = PyDict_SetItemString(ret, names[i], dict);
+        Py_DECREF(dict);
+        if(0 != status)
+            goto fail;
+    }
+    return ret;
+
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+static PyObject *PyBench_nav_queues(PyObject *self, PyObject *args)
+{
+    int nruns, layer = NAV_LAYER_GROUND_1X1;
+    if(!PyArg_ParseTuple(args, "i|i", &nruns, &layer)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one or two arguments: number of runs (integer) "
+            "and optionally the navigation layer (integer).");
+        return NULL;
+    }
+    if(nruns <= 0) {
+        PyErr_SetString(PyExc_ValueError, "The number of runs must be positive.");
+        return NULL;
+    }
+    if(layer < 0 || layer >= NAV_LAYER_MAX) {
+        PyErr_SetString(PyExc_ValueError, "Invalid navigation layer.");
+        return NULL;
+    }
+
+    struct nav_queue_bench_result results[NAV_BENCH_NQUEUES];
+    if(!G_MapBenchmarkNavQueues(layer, nruns, results)) {
+        PyErr_SetString(PyExc_RuntimeError, "No map is loaded.");
+        return NULL;
+    }
+
+    const char *names[] = {
+        [NAV_BENCH_BINARY_HEAP] = "binary_heap",
+        [NAV_BENCH_INDEXED_HEAP] = "indexed_heap",
+        [NAV_BENCH_BUCKET_QUEUE] = "bucket_queue"
+    };
+
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < ARR_SIZE(results); i++) {
+        PyObject *dict = Py_BuildValue("{s:d, s:n, s:d}",
+            "integrate_ms", results[i].integrate_ms,
+            "fields", (Py_ssize_t)results[i].nfields,
+            "checksum", results[i].checksum);
+        if(!dict)
+            goto fail;
+        int status = PyDict_SetItemString(ret, names[i], dict);
+        Py_DECREF(dict);
+        if(0 != status)
+            goto fail;
+    }
+    return ret;
+
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+static PyObject *PyBench_fieldcache_policies(PyObject *self)
+{
+    struct fc_policy_bench_result results[FC_BENCH_NPOLICIES];
+    N_FC_BenchmarkPolicies(results);
+
+    const char *names[] = {
+        [FC_BENCH_LRU] = "lru",
+        [FC_BENCH_CLOCK] = "clock",
+        [FC_BENCH_2Q] = "2q"
+    };
+
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < ARR_SIZE(results); i++) {
+        PyObject *dict = Py_BuildValue("{s:I, s:f, s:I, s:f, s:I, s:f, s:I, s:f}",
+            "los_queries", results[i].los_queries,
+            "los_hit_rate", results[i].los_hit_rate,
+            "flow_queries", results[i].flow_queries,
+            "flow_hit_rate", results[i].flow_hit_rate,
+            "ffid_queries", results[i].ffid_queries,
+            "ffid_hit_rate", results[i].ffid_hit_rate,
+            "grid_path_queries", results[i].grid_path_queries,
+            "grid_path_hit_rate", results[i].grid_path_hit_rate);
+        if(!dict)
+            goto fail;
+        int status = PyDict_SetItemString(ret, names[i], dict);
+        Py_DECREF(dict);
+        if(0 != status)
+            goto fail;
+    }
+    return ret;
+
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void S_Bench_PyRegister(void)
+{
+    Py_InitModule("pf_bench", s_bench_methods);
+}
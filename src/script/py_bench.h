@@ -1,6 +1,6 @@
 /*
  *  This file is part of Permafrost Engine. 
- *  Copyright (C) 2022-2023 Eduard Permyakov 
+ *  Copyright (C) 2024 Eduard Permyakov 
  *
  *  Permafrost Engine is free software: you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -33,30 +33,15 @@
  *
  */
 
-#version 430 core
+#ifndef PY_BENCH_H
+#define PY_BENCH_H
 
-struct move_input{
-    uint  flock_id;
-    uint  movestate;
-    uint  has_dest_los;
-    float dest_x;
-    float dest_z;
-};
+#include <Python.h> /* must be first */
 
-layout(local_size_x = 1) in;
-layout(std430, binding = 0) readonly buffer in_data
-{
-    move_input moveattrs[];
-};
-layout(r32ui, binding = 1) uniform readonly uimage2D in_pos_id_map;
-layout(std430, binding = 2) writeonly buffer o_data
-{
-    float vpref[];
-};
-
-void main()
-{
-    uint idx = gl_GlobalInvocationID.x;
-    vpref[idx] = 0.0f;
-}
+/* Registers the 'pf_bench' module, which exposes the engine's internal
+ * micro-benchmarks to the driver in 'scripts/microbench.py'. These are 
+ * development tools and not a part of the 'pf' scripting API.
+ */
+void S_Bench_PyRegister(void);
 
+#endif
@@ -794,6 +794,7 @@ static void s_expose_event_constants(PyObject *module)
     PY_EXPOSE_ENUM(module, EVENT_RALLY_POINT_SET);
     PY_EXPOSE_ENUM(module, EVENT_UNIT_BECAME_IDLE);
     PY_EXPOSE_ENUM(module, EVENT_UNIT_BECAME_ACTIVE);
+    PY_EXPOSE_ENUM(module, EVENT_PERF_BUDGET_EXCEEDED);
     PY_EXPOSE_ENUM(module, EVENT_ENGINE_LAST);
 }
 
@@ -862,6 +863,10 @@ static void s_expose_game_constants(PyObject *module)
     PY_EXPOSE_ENUM(module, FORMATION_COLUMN);
     PY_EXPOSE_ENUM(module, FORMATION_MAX);
 
+    PY_EXPOSE_ENUM(module, ORDER_MOVE);
+    PY_EXPOSE_ENUM(module, ORDER_ATTACK);
+    PY_EXPOSE_ENUM(module, ORDER_STOP);
+
     PY_EXPOSE_ENUM(module, AIR_UNIT_HEIGHT);
 }
 
@@ -869,6 +874,7 @@ static void s_expose_anim_constants(PyObject *module)
 {
     PY_EXPOSE_ENUM(module, ANIM_MODE_LOOP);
     PY_EXPOSE_ENUM(module, ANIM_MODE_ONCE);
+    PY_EXPOSE_ENUM(module, ANIM_MODE_AMBIENT);
 }
 
 static void s_expose_engine_constants(PyObject *module)
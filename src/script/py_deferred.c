@@ -0,0 +1,290 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "py_deferred.h"
+#include "py_pickle.h"
+#include "../perf.h"
+#include "../lib/public/SDL_vec_rwops.h"
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <assert.h>
+
+
+#define CHK_TRUE(_pred, _label) do{ if(!(_pred)) goto _label; }while(0)
+
+/* A pf.Deferred holds either the live object, or the pickled string 
+ * that it was loaded from. Loading a session only restores the string - 
+ * the object is unpickled when it is first accessed. A deferred object
+ * that is never accessed is saved again without being unpickled at all. 
+ */
+typedef struct {
+    PyObject_HEAD
+    PyObject *obj;
+    PyObject *pickled;
+}PyDeferredObject;
+
+static PyObject *PyDeferred_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+static void      PyDeferred_dealloc(PyDeferredObject *self);
+static int       PyDeferred_traverse(PyDeferredObject *self, visitproc visit, void *arg);
+static int       PyDeferred_clear(PyDeferredObject *self);
+
+static PyObject *PyDeferred_get(PyDeferredObject *self);
+static PyObject *PyDeferred_pickle(PyDeferredObject *self, PyObject *args, PyObject *kwargs);
+static PyObject *PyDeferred_unpickle(PyObject *cls, PyObject *args, PyObject *kwargs);
+
+static PyObject *PyDeferred_get_loaded(PyDeferredObject *self, void *closure);
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static PyMethodDef PyDeferred_methods[] = {
+    {"get", 
+    (PyCFunction)PyDeferred_get, METH_NOARGS,
+    "Get the wrapped object, unpickling it first if it has not been accessed since being "
+    "loaded from a session."},
+
+    {"__pickle__", 
+    (PyCFunction)PyDeferred_pickle, METH_KEYWORDS,
+    "Serialize a Permafrost Engine deferred object to a string."},
+
+    {"__unpickle__", 
+    (PyCFunction)PyDeferred_unpickle, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+    "Create a new pf.Deferred instance from a string earlier returned from a __pickle__ method. "
+    "The wrapped object is not unpickled until it is accessed. Returns a tuple of the new "
+    "instance and the number of bytes consumed from the stream."},
+
+    {NULL}  /* Sentinel */
+};
+
+static PyGetSetDef PyDeferred_getset[] = {
+    {"loaded",
+    (getter)PyDeferred_get_loaded, NULL,
+    "Whether the wrapped object has already been unpickled.",
+    NULL},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject PyDeferred_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "pf.Deferred",
+    .tp_basicsize   = sizeof(PyDeferredObject),
+    .tp_dealloc     = (destructor)PyDeferred_dealloc,
+    .tp_flags       = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_doc         = "Wrapper for rarely accessed script state. When a session is loaded, the "
+                      "wrapped object is only unpickled on the first call to 'get'. The wrapped "
+                      "object is pickled as a separate object graph: any objects it shares with "
+                      "the rest of the session will no longer be shared after a load. As such, "
+                      "it should only hold plain data and not entities, tasks or other engine "
+                      "objects.",
+    .tp_traverse    = (traverseproc)PyDeferred_traverse,
+    .tp_clear       = (inquiry)PyDeferred_clear,
+    .tp_methods     = PyDeferred_methods,
+    .tp_getset      = PyDeferred_getset,
+    .tp_new         = PyDeferred_new,
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static PyObject *PyDeferred_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *obj;
+    if(!PyArg_ParseTuple(args, "O", &obj)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a single object.");
+        return NULL;
+    }
+
+    PyDeferredObject *self = (PyDeferredObject*)type->tp_alloc(type, 0);
+    if(!self)
+        return NULL;
+
+    Py_INCREF(obj);
+    self->obj = obj;
+    self->pickled = NULL;
+    return (PyObject*)self;
+}
+
+static void PyDeferred_dealloc(PyDeferredObject *self)
+{
+    PyObject_GC_UnTrack(self);
+    PyDeferred_clear(self);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int PyDeferred_traverse(PyDeferredObject *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->obj);
+    return 0;
+}
+
+static int PyDeferred_clear(PyDeferredObject *self)
+{
+    Py_CLEAR(self->obj);
+    Py_CLEAR(self->pickled);
+    return 0;
+}
+
+static PyObject *PyDeferred_get(PyDeferredObject *self)
+{
+    if(self->obj) {
+        Py_INCREF(self->obj);
+        return self->obj;
+    }
+    assert(self->pickled);
+
+    SDL_RWops *stream = SDL_RWFromConstMem(PyString_AS_STRING(self->pickled), 
+        PyString_GET_SIZE(self->pickled));
+    if(!stream)
+        return NULL;
+
+    PyObject *obj = S_UnpickleObjgraph(stream);
+    SDL_RWclose(stream);
+    if(!obj) {
+        assert(PyErr_Occurred());
+        return NULL;
+    }
+
+    PERF_COUNTER_ADD("script.deferred_unpickled", 1);
+    self->obj = obj;
+    Py_CLEAR(self->pickled);
+
+    Py_INCREF(self->obj);
+    return self->obj;
+}
+
+static PyObject *PyDeferred_get_loaded(PyDeferredObject *self, void *closure)
+{
+    return PyBool_FromLong(self->obj != NULL);
+}
+
+/* Returns a new reference to the string holding the separately 
+ * pickled object graph. */
+static PyObject *deferred_pickled(PyDeferredObject *self)
+{
+    if(self->pickled) {
+        Py_INCREF(self->pickled);
+        return self->pickled;
+    }
+
+    PyObject *ret = NULL;
+    SDL_RWops *stream = PFSDL_VectorRWOps();
+    if(!stream)
+        return NULL;
+
+    if(S_PickleObjgraph(self->obj, stream)) {
+        ret = PyString_FromStringAndSize(PFSDL_VectorRWOpsRaw(stream), SDL_RWsize(stream));
+    }
+    SDL_RWclose(stream);
+    return ret;
+}
+
+static PyObject *PyDeferred_pickle(PyDeferredObject *self, PyObject *args, PyObject *kwargs)
+{
+    bool status;
+    PyObject *ret = NULL;
+
+    SDL_RWops *stream = PFSDL_VectorRWOps();
+    CHK_TRUE(stream, fail_alloc);
+
+    PyObject *pickled = deferred_pickled(self);
+    CHK_TRUE(pickled, fail_pickle);
+    status = S_PickleObjgraph(pickled, stream);
+    Py_DECREF(pickled);
+    CHK_TRUE(status, fail_pickle);
+    ret = PyString_FromStringAndSize(PFSDL_VectorRWOpsRaw(stream), SDL_RWsize(stream));
+
+fail_pickle:
+    SDL_RWclose(stream);
+fail_alloc:
+    return ret;
+}
+
+static PyObject *PyDeferred_unpickle(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    PyObject *ret = NULL;
+    const char *str;
+    Py_ssize_t len;
+    char tmp;
+
+    if(!PyArg_ParseTuple(args, "s#", &str, &len)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a single string.");
+        goto fail_args;
+    }
+
+    SDL_RWops *stream = SDL_RWFromConstMem(str, len);
+    CHK_TRUE(stream, fail_args);
+
+    PyObject *pickled = S_UnpickleObjgraph(stream);
+    SDL_RWread(stream, &tmp, 1, 1); /* consume NULL byte */
+    CHK_TRUE(pickled, fail_unpickle);
+
+    if(!PyString_Check(pickled)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unexpected deferred object contents in the pickle stream.");
+        goto fail_deferred;
+    }
+
+    PyDeferredObject *deferred = (PyDeferredObject*)((PyTypeObject*)cls)->tp_alloc((PyTypeObject*)cls, 0);
+    CHK_TRUE(deferred, fail_deferred);
+
+    Py_INCREF(pickled);
+    deferred->obj = NULL;
+    deferred->pickled = pickled;
+
+    Py_ssize_t nread = SDL_RWseek(stream, 0, RW_SEEK_CUR);
+    ret = Py_BuildValue("(Oi)", deferred, (int)nread);
+    Py_DECREF(deferred);
+
+fail_deferred:
+    Py_DECREF(pickled);
+fail_unpickle:
+    SDL_RWclose(stream);
+fail_args:
+    return ret;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void S_Deferred_PyRegister(PyObject *module)
+{
+    if(PyType_Ready(&PyDeferred_type) < 0)
+        return;
+    Py_INCREF(&PyDeferred_type);
+    PyModule_AddObject(module, "Deferred", (PyObject*)&PyDeferred_type);
+}
@@ -36,6 +36,7 @@
 #include <Python.h> /* must be first */
 #include "py_entity.h" 
 #include "py_pickle.h"
+#include "py_math.h"
 #include "../main.h"
 #include "../entity.h"
 #include "../event.h"
@@ -62,7 +63,11 @@ KHASH_MAP_INIT_INT(PyObject, PyObject*)
 
 typedef struct {
     PyObject_HEAD
-    uint32_t ent;
+    uint32_t  ent;
+    /* Weak reference support lives in the base so that script-defined
+     * subclasses declaring '__slots__' (and hence having no per-instance
+     * '__dict__' or '__weakref__') can still be weakly referenced. */
+    PyObject *weakreflist;
 }PyEntityObject;
 
 static PyObject *PyEntity_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
@@ -285,11 +290,12 @@ static PyTypeObject PyEntity_type = {
     0,                         /* tp_setattro */
     0,                         /* tp_as_buffer */
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-    "Permafrost Engine generic game entity.", /* tp_doc */
+    "Permafrost Engine generic game entity. Entities support weak references, "
+    "including when a subclass declares '__slots__'.", /* tp_doc */
     0,                         /* tp_traverse */
     0,                         /* tp_clear */
     0,                         /* tp_richcompare */
-    0,                         /* tp_weaklistoffset */
+    offsetof(PyEntityObject, weakreflist), /* tp_weaklistoffset */
     0,                         /* tp_iter */
     0,                         /* tp_iternext */
     PyEntity_methods,          /* tp_methods */
@@ -353,7 +359,8 @@ static PyTypeObject PyAnimEntity_type = {
     .tp_flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
     .tp_doc       = "Permafrost Engine animated entity. This type requires the "
                     "'idle_clip' keyword argument to be passed to __init__. "
-                    "This is a subclass of pf.Entity.",
+                    "If the 'ambient' keyword argument is True, the idle clip is "
+                    "played in ANIM_MODE_AMBIENT. This is a subclass of pf.Entity.",
     .tp_methods   = PyAnimEntity_methods,
     .tp_base      = &PyEntity_type,
     .tp_init      = (initproc)PyAnimEntity_init,
@@ -1384,8 +1391,8 @@ static PyObject *PyEntity_new(PyTypeObject *type, PyObject *args, PyObject *kwds
     if(kwds) {
         PyObject *posobj = PyDict_GetItemString(kwds, "pos");
         if(posobj) {
-            if(!PyTuple_Check(posobj) || !PyArg_ParseTuple(posobj, "fff", &pos.x, &pos.y, &pos.z)) {
-                PyErr_SetString(PyExc_TypeError, "'pos' keyword argument must be a tuple of 3 floats.");
+            if(!S_Math_Vec3FromObj(posobj, &pos)) {
+                PyErr_SetString(PyExc_TypeError, "'pos' keyword argument must be a tuple of 3 floats or a pf.Vec3.");
                 return NULL; 
             }
         }
@@ -1415,6 +1422,9 @@ static void PyEntity_dealloc(PyEntityObject *self)
      * skip handling this edge case elsewhere. 
      */
     G_DeferredRemove(self->ent);
+
+    if(self->weakreflist)
+        PyObject_ClearWeakRefs((PyObject*)self);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -1476,14 +1486,9 @@ static PyObject *PyEntity_get_pos(PyEntityObject *self, void *closure)
 
 static int PyEntity_set_pos(PyEntityObject *self, PyObject *value, void *closure)
 {
-    if(!PyTuple_Check(value)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple.");
-        return -1;
-    }
-    
     vec3_t newpos;
-    if(!PyArg_ParseTuple(value, "fff", 
-        &newpos.raw[0], &newpos.raw[1], &newpos.raw[2])) {
+    if(!S_Math_Vec3FromObj(value, &newpos)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple of 3 floats or a pf.Vec3.");
         return -1;
     }
 
@@ -1499,14 +1504,11 @@ static PyObject *PyEntity_get_scale(PyEntityObject *self, void *closure)
 
 static int PyEntity_set_scale(PyEntityObject *self, PyObject *value, void *closure)
 {
-    if(!PyTuple_Check(value)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple.");
-        return -1;
-    }
-
     vec3_t scale;
-    if(!PyArg_ParseTuple(value, "fff", &scale.x, &scale.y, &scale.z))
+    if(!S_Math_Vec3FromObj(value, &scale)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple of 3 floats or a pf.Vec3.");
         return -1;
+    }
 
     Entity_SetScale(self->ent, scale);
     return 0;
@@ -1520,14 +1522,11 @@ static PyObject *PyEntity_get_rotation(PyEntityObject *self, void *closure)
 
 static int PyEntity_set_rotation(PyEntityObject *self, PyObject *value, void *closure)
 {
-    if(!PyTuple_Check(value)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple.");
-        return -1;
-    }
-   
     quat_t rot;
-    if(!PyArg_ParseTuple(value, "ffff", &rot.x, &rot.y, &rot.z, &rot.w))
+    if(!S_Math_QuatFromObj(value, &rot)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple of 4 floats or a pf.Quat.");
         return -1;
+    }
 
     Entity_SetRot(self->ent, rot);
     return 0;
@@ -1799,6 +1798,7 @@ static PyObject *PyEntity_set_model(PyEntityObject *self, PyObject *args)
         PyErr_SetString(PyExc_RuntimeError, "Could not set the model to the specified PFOBJ file.");
         return NULL;
     }
+    G_UpdateBounds(self->ent);
     Py_RETURN_NONE;
 }
 
@@ -2377,6 +2377,11 @@ static int PyAnimEntity_init(PyAnimEntityObject *self, PyObject *args, PyObject
 
     A_SetIdleClip(self->super.ent, PyString_AS_STRING(idle_clip), 24);
 
+    PyObject *ambient = PyDict_GetItemString(kwds, "ambient");
+    if(ambient && PyObject_IsTrue(ambient)) {
+        A_SetActiveClip(self->super.ent, PyString_AS_STRING(idle_clip), ANIM_MODE_AMBIENT, 24);
+    }
+
     /* Call the next __init__ method in the MRO. This is required for all __init__ calls in the 
      * MRO to complete in cases when this class is one of multiple base classes of another type. 
      * This allows this type to be used as one of many mix-in bases. */
@@ -2406,7 +2411,7 @@ static PyObject *PyAnimEntity_play_anim(PyAnimEntityObject *self, PyObject *args
     if(kwds && (mode_obj = PyDict_GetItemString(kwds, "mode"))) {
     
         if(!PyInt_Check(mode_obj)
-        || (mode = PyInt_AS_LONG(mode_obj)) > ANIM_MODE_ONCE) {
+        || (mode = PyInt_AS_LONG(mode_obj)) > ANIM_MODE_AMBIENT) {
         
             PyErr_SetString(PyExc_TypeError, "Mode kwarg must be a valid animation mode (int).");
             return NULL;
@@ -2874,14 +2879,9 @@ static PyObject *PyBuildableEntity_get_pos(PyBuildableEntityObject *self, void *
 
 static int PyBuildableEntity_set_pos(PyBuildableEntityObject *self, PyObject *value, void *closure)
 {
-    if(!PyTuple_Check(value)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple.");
-        return -1;
-    }
-    
     vec3_t newpos;
-    if(!PyArg_ParseTuple(value, "fff", 
-        &newpos.raw[0], &newpos.raw[1], &newpos.raw[2])) {
+    if(!S_Math_Vec3FromObj(value, &newpos)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple of 3 floats or a pf.Vec3.");
         return -1;
     }
 
@@ -2971,14 +2971,9 @@ static int PyBuildableEntity_set_rally_point(PyBuildableEntityObject *self,
         return -1;
     }
 
-    if(!PyTuple_Check(value)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple.");
-        return -1;
-    }
-
     vec2_t rally;
-    if(!PyArg_ParseTuple(value, "ff", &rally.x, &rally.z)) {
-        PyErr_SetString(PyExc_TypeError, "Value must be a tuple of 2 floats.");
+    if(!S_Math_Vec2FromObj(value, &rally)) {
+        PyErr_SetString(PyExc_TypeError, "Value must be a tuple of 2 floats or a pf.Vec2.");
         return -1;
     }
 
@@ -4552,6 +4547,16 @@ bool S_Entity_Check(PyObject *obj)
     return PyObject_IsInstance(obj, (PyObject*)&PyEntity_type);
 }
 
+bool S_Entity_Reserve(size_t count)
+{
+    size_t nents = kh_size(s_uid_pyobj_table) + count;
+    if(kh_resize(PyObject, s_uid_pyobj_table, nents + nents / 3 + 1) < 0)
+        return false;
+    if(!AL_ReserveEntities(count))
+        return false;
+    return G_ReserveEntities(count);
+}
+
 bool S_Entity_UIDForObj(script_opaque_t obj, uint32_t *out)
 {
     if(!PyObject_IsInstance(obj, (PyObject*)&PyEntity_type))
@@ -45,6 +45,8 @@ void      S_Entity_Shutdown(void);
 void      S_Entity_Clear(void);
 void      S_Entity_PyRegister(PyObject *module);
 bool      S_Entity_Check(PyObject *obj);
+/* Grow the entity tables of all subsystems to fit 'count' more entities */
+bool      S_Entity_Reserve(size_t count);
 /* Returned list has a stolen reference to each object */
 PyObject *S_Entity_GetLoaded(void);
 
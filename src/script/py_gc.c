@@ -0,0 +1,256 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include <Python.h> /* Must be first */
+
+#include "py_gc.h"
+#include "public/script.h"
+#include "../config.h"
+#include "../perf.h"
+#include "../lib/public/pf_string.h"
+
+#include <SDL.h>
+#include <assert.h>
+#include <stdint.h>
+
+
+#define GC_NUM_GENS         (3)
+#define GC_FRAME_MS         (1000.0 / CONFIG_SCHED_TARGET_FPS)
+/* A young generation which is this many times over its threshold is
+ * collected even when there's no time left in the frame, to bound the
+ * memory held by garbage when the frames are consistently over budget. 
+ * The oldest one only gets collected this way if no transitions happen 
+ * for a long time. */
+#define GC_OVERDUE_FACTOR   (8)
+/* Weight of the last collection in the estimated collection time */
+#define GC_EST_WEIGHT       (0.25)
+
+struct gc_gen_stats{
+    uint64_t ncollections;
+    uint64_t nunreachable;
+    double   total_ms;
+    double   max_ms;
+    double   est_ms;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* Only the functions are kept, as the pickler expects the 'gc' module to be 
+ * referenced by nothing but sys.modules (see py_pickle.c:pre_build_index). 
+ * Being builtins, they don't hold a reference to the module. */
+static PyObject            *s_gc_collect;
+static PyObject            *s_gc_get_count;
+static long                 s_thresholds[GC_NUM_GENS];
+static struct gc_gen_stats  s_stats[GC_NUM_GENS];
+/* The idle collections which were due but did not fit in the frame */
+static uint64_t             s_ndeferred;
+static uint64_t             s_nforced;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool gc_get_triple(PyObject *func, long out[GC_NUM_GENS])
+{
+    PyObject *ret = PyObject_CallObject(func, NULL);
+    if(!ret)
+        goto fail;
+
+    bool success = PyArg_ParseTuple(ret, "lll", &out[0], &out[1], &out[2]);
+    Py_DECREF(ret);
+    if(!success)
+        goto fail;
+    return true;
+
+fail:
+    PyErr_Clear();
+    return false;
+}
+
+static void gc_collect(int gen)
+{
+    uint64_t begin = SDL_GetPerformanceCounter();
+
+    PyObject *ret = PyObject_CallFunction(s_gc_collect, "i", gen);
+    if(!ret) {
+        S_ShowLastError();
+        return;
+    }
+
+    struct gc_gen_stats *stats = &s_stats[gen];
+    stats->nunreachable += PyInt_AsLong(ret);
+    Py_DECREF(ret);
+
+    uint64_t elapsed = SDL_GetPerformanceCounter() - begin;
+    double ms = elapsed * 1000.0 / SDL_GetPerformanceFrequency();
+
+    stats->ncollections++;
+    stats->total_ms += ms;
+    if(ms > stats->max_ms) {
+        stats->max_ms = ms;
+    }
+    stats->est_ms = (stats->ncollections == 1) ? ms
+                  : stats->est_ms + (ms - stats->est_ms) * GC_EST_WEIGHT;
+
+    PERF_COUNTER_ADD("script.gc_collections", 1);
+    PERF_COUNTER_ADD("script.gc_us", elapsed * 1000000 / SDL_GetPerformanceFrequency());
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool S_GC_Init(void)
+{
+    PyObject *gc_module = PyImport_ImportModule("gc");
+    if(!gc_module)
+        goto fail_import;
+
+    PyObject *ret = PyObject_CallMethod(gc_module, "disable", NULL);
+    if(!ret)
+        goto fail_disable;
+    Py_DECREF(ret);
+
+    /* Scripts are not expected to change the thresholds, which only 
+     * determine when the generations are due now. */
+    PyObject *get_threshold = PyObject_GetAttrString(gc_module, "get_threshold");
+    if(!get_threshold)
+        goto fail_disable;
+
+    bool success = gc_get_triple(get_threshold, s_thresholds);
+    Py_DECREF(get_threshold);
+    if(!success)
+        goto fail_disable;
+
+    s_gc_collect = PyObject_GetAttrString(gc_module, "collect");
+    s_gc_get_count = PyObject_GetAttrString(gc_module, "get_count");
+    if(!s_gc_collect || !s_gc_get_count)
+        goto fail_funcs;
+
+    Py_DECREF(gc_module);
+    return true;
+
+fail_funcs:
+    Py_CLEAR(s_gc_collect);
+    Py_CLEAR(s_gc_get_count);
+fail_disable:
+    Py_DECREF(gc_module);
+fail_import:
+    PyErr_Clear();
+    return false;
+}
+
+void S_GC_Shutdown(void)
+{
+    Py_CLEAR(s_gc_collect);
+    Py_CLEAR(s_gc_get_count);
+}
+
+void S_GC_CollectIdle(void)
+{
+    if(!s_gc_collect)
+        return;
+
+    long counts[GC_NUM_GENS];
+    if(!gc_get_triple(s_gc_get_count, counts))
+        return;
+
+    /* Collecting a generation also collects all the younger ones */
+    double slack = GC_FRAME_MS - Perf_CurrFrameMS();
+    bool due = false;
+
+    for(int gen = GC_NUM_GENS - 1; gen >= 0; gen--) {
+
+        if(counts[gen] < s_thresholds[gen])
+            continue;
+        due = true;
+
+        if(gen < GC_NUM_GENS - 1 && s_stats[gen].est_ms <= slack) {
+            gc_collect(gen);
+            return;
+        }
+    }
+
+    for(int gen = GC_NUM_GENS - 1; gen >= 0; gen--) {
+        if(counts[gen] >= s_thresholds[gen] * GC_OVERDUE_FACTOR) {
+            s_nforced++;
+            gc_collect(gen);
+            return;
+        }
+    }
+
+    if(due) {
+        s_ndeferred++;
+    }
+}
+
+void S_GC_CollectFull(void)
+{
+    if(!s_gc_collect)
+        return;
+    gc_collect(GC_NUM_GENS - 1);
+}
+
+PyObject *S_GC_GetStats(void)
+{
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    int rval = 0;
+    for(int gen = 0; gen < GC_NUM_GENS; gen++) {
+
+        char key[64];
+        const struct gc_gen_stats *stats = &s_stats[gen];
+
+        pf_snprintf(key, sizeof(key), "gen%d_collections", gen);
+        rval |= PyDict_SetItemString(ret, key, Py_BuildValue("K", (unsigned long long)stats->ncollections));
+        pf_snprintf(key, sizeof(key), "gen%d_unreachable", gen);
+        rval |= PyDict_SetItemString(ret, key, Py_BuildValue("K", (unsigned long long)stats->nunreachable));
+        pf_snprintf(key, sizeof(key), "gen%d_total_ms", gen);
+        rval |= PyDict_SetItemString(ret, key, Py_BuildValue("d", stats->total_ms));
+        pf_snprintf(key, sizeof(key), "gen%d_max_ms", gen);
+        rval |= PyDict_SetItemString(ret, key, Py_BuildValue("d", stats->max_ms));
+        pf_snprintf(key, sizeof(key), "gen%d_est_ms", gen);
+        rval |= PyDict_SetItemString(ret, key, Py_BuildValue("d", stats->est_ms));
+    }
+    rval |= PyDict_SetItemString(ret, "deferred", Py_BuildValue("K", (unsigned long long)s_ndeferred));
+    rval |= PyDict_SetItemString(ret, "forced", Py_BuildValue("K", (unsigned long long)s_nforced));
+    assert(0 == rval);
+
+    return ret;
+}
@@ -0,0 +1,57 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef PY_GC_H
+#define PY_GC_H
+
+#include <Python.h> /* must be first */
+#include <stdbool.h>
+
+/* Engine-managed cyclic garbage collection. The interpreter's automatic 
+ * collection runs whenever enough objects have been allocated, at any 
+ * point in the frame, and a collection of the oldest generation of a big 
+ * object graph takes tens of milliseconds. Hence, it is disabled. Instead, 
+ * the young generations are collected in the time that is left over at 
+ * the end of a frame (S_GC_CollectIdle), and the full collections are 
+ * done where a hitch goes unnoticed: while loading and on session 
+ * transitions (S_GC_CollectFull).
+ */
+
+bool      S_GC_Init(void);
+void      S_GC_Shutdown(void);
+/* Returns a new dictionary with the collection counts and timings */
+PyObject *S_GC_GetStats(void);
+
+#endif
@@ -0,0 +1,1028 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "py_math.h"
+#include "py_pickle.h"
+#include "../lib/public/SDL_vec_rwops.h"
+
+#include <structmember.h>
+#include <string.h>
+
+
+#define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
+#define CHK_TRUE(_pred, _label) do{ if(!(_pred)) goto _label; }while(0)
+
+/* pf.Vec2, pf.Vec3 and pf.Quat share a layout and most of the implementation.
+ * They are immutable so that they can be hashed and compared just like the
+ * tuples that they stand in for. A pf.Vec2 holds the (X, Z) coordinates of a 
+ * point on the map plane, like vec2_t does. 
+ */
+typedef struct {
+    PyObject_HEAD
+    float raw[4];
+}PyVecObject;
+
+static PyObject *PyVec_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+static PyObject *PyVec_repr(PyVecObject *self);
+static long      PyVec_hash(PyVecObject *self);
+static PyObject *PyVec_richcompare(PyVecObject *self, PyObject *other, int op);
+static Py_ssize_t PyVec_length(PyVecObject *self);
+static PyObject *PyVec_item(PyVecObject *self, Py_ssize_t i);
+
+static PyObject *PyVec_add(PyObject *a, PyObject *b);
+static PyObject *PyVec_subtract(PyObject *a, PyObject *b);
+static PyObject *PyVec_multiply(PyObject *a, PyObject *b);
+static PyObject *PyVec_divide(PyObject *a, PyObject *b);
+static PyObject *PyVec_negative(PyVecObject *self);
+static PyObject *PyQuat_multiply(PyObject *a, PyObject *b);
+
+static PyObject *PyVec_dot(PyVecObject *self, PyObject *args);
+static PyObject *PyVec_length_method(PyVecObject *self);
+static PyObject *PyVec_normalized(PyVecObject *self);
+static PyObject *PyVec_distance(PyVecObject *self, PyObject *args);
+static PyObject *PyVec3_cross(PyVecObject *self, PyObject *args);
+static PyObject *PyQuat_normalized(PyVecObject *self);
+static PyObject *PyQuat_inverse(PyVecObject *self);
+static PyObject *PyQuat_rotate(PyVecObject *self, PyObject *args);
+
+static PyObject *PyVec_pickle(PyVecObject *self, PyObject *args, PyObject *kwargs);
+static PyObject *PyVec_unpickle(PyObject *cls, PyObject *args, PyObject *kwargs);
+
+static PyObject *PyPf_vec2_batch_distance(PyObject *self, PyObject *args);
+static PyObject *PyPf_vec3_batch_distance(PyObject *self, PyObject *args);
+static PyObject *PyPf_vec2_batch_within(PyObject *self, PyObject *args);
+static PyObject *PyPf_vec3_batch_within(PyObject *self, PyObject *args);
+static PyObject *PyPf_vec3_batch_add(PyObject *self, PyObject *args);
+static PyObject *PyPf_quat_batch_rotate(PyObject *self, PyObject *args);
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+#define MEMBER(_name, _idx, _doc) \
+    {_name, T_FLOAT, offsetof(PyVecObject, raw) + (_idx) * sizeof(float), READONLY, _doc}
+
+static PyMemberDef PyVec2_members[] = {
+    MEMBER("x", 0, "The X component."),
+    MEMBER("z", 1, "The Z component."),
+    {NULL}  /* Sentinel */
+};
+
+static PyMemberDef PyVec3_members[] = {
+    MEMBER("x", 0, "The X component."),
+    MEMBER("y", 1, "The Y component."),
+    MEMBER("z", 2, "The Z component."),
+    {NULL}  /* Sentinel */
+};
+
+static PyMemberDef PyQuat_members[] = {
+    MEMBER("x", 0, "The X component."),
+    MEMBER("y", 1, "The Y component."),
+    MEMBER("z", 2, "The Z component."),
+    MEMBER("w", 3, "The W (scalar) component."),
+    {NULL}  /* Sentinel */
+};
+
+#undef MEMBER
+
+#define PICKLE_METHODS(_name)                                                               \
+    {"__pickle__",                                                                          \
+    (PyCFunction)PyVec_pickle, METH_KEYWORDS,                                               \
+    "Serialize a Permafrost Engine " _name " to a string."},                                \
+                                                                                            \
+    {"__unpickle__",                                                                        \
+    (PyCFunction)PyVec_unpickle, METH_VARARGS | METH_KEYWORDS | METH_CLASS,                 \
+    "Create a new pf." _name " instance from a string earlier returned from a __pickle__ "  \
+    "method. Returns a tuple of the new instance and the number of bytes consumed from "    \
+    "the stream."}
+
+static PyMethodDef PyVec2_methods[] = {
+    {"dot", 
+    (PyCFunction)PyVec_dot, METH_VARARGS,
+    "Returns the dot product with another pf.Vec2 or (X, Z) tuple."},
+
+    {"length", 
+    (PyCFunction)PyVec_length_method, METH_NOARGS,
+    "Returns the length of the vector."},
+
+    {"normalized", 
+    (PyCFunction)PyVec_normalized, METH_NOARGS,
+    "Returns a unit-length pf.Vec2 in the same direction. A zero vector is returned unchanged."},
+
+    {"distance", 
+    (PyCFunction)PyVec_distance, METH_VARARGS,
+    "Returns the distance to another pf.Vec2 or (X, Z) tuple."},
+
+    PICKLE_METHODS("Vec2"),
+    {NULL}  /* Sentinel */
+};
+
+static PyMethodDef PyVec3_methods[] = {
+    {"dot", 
+    (PyCFunction)PyVec_dot, METH_VARARGS,
+    "Returns the dot product with another pf.Vec3 or (X, Y, Z) tuple."},
+
+    {"cross", 
+    (PyCFunction)PyVec3_cross, METH_VARARGS,
+    "Returns the cross product with another pf.Vec3 or (X, Y, Z) tuple as a pf.Vec3."},
+
+    {"length", 
+    (PyCFunction)PyVec_length_method, METH_NOARGS,
+    "Returns the length of the vector."},
+
+    {"normalized", 
+    (PyCFunction)PyVec_normalized, METH_NOARGS,
+    "Returns a unit-length pf.Vec3 in the same direction. A zero vector is returned unchanged."},
+
+    {"distance", 
+    (PyCFunction)PyVec_distance, METH_VARARGS,
+    "Returns the distance to another pf.Vec3 or (X, Y, Z) tuple."},
+
+    PICKLE_METHODS("Vec3"),
+    {NULL}  /* Sentinel */
+};
+
+static PyMethodDef PyQuat_methods[] = {
+    {"normalized", 
+    (PyCFunction)PyQuat_normalized, METH_NOARGS,
+    "Returns a unit-length copy of the quaternion."},
+
+    {"inverse", 
+    (PyCFunction)PyQuat_inverse, METH_NOARGS,
+    "Returns the inverse rotation."},
+
+    {"rotate", 
+    (PyCFunction)PyQuat_rotate, METH_VARARGS,
+    "Returns a pf.Vec3 or (X, Y, Z) tuple rotated by this quaternion, as a pf.Vec3."},
+
+    PICKLE_METHODS("Quat"),
+    {NULL}  /* Sentinel */
+};
+
+#undef PICKLE_METHODS
+
+static PySequenceMethods PyVec_as_sequence = {
+    .sq_length      = (lenfunc)PyVec_length,
+    .sq_item        = (ssizeargfunc)PyVec_item,
+};
+
+static PyNumberMethods PyVec_as_number = {
+    .nb_add         = PyVec_add,
+    .nb_subtract    = PyVec_subtract,
+    .nb_multiply    = PyVec_multiply,
+    .nb_divide      = PyVec_divide,
+    .nb_true_divide = PyVec_divide,
+    .nb_negative    = (unaryfunc)PyVec_negative,
+};
+
+static PyNumberMethods PyQuat_as_number = {
+    .nb_multiply    = PyQuat_multiply,
+};
+
+static PyTypeObject PyVec2_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "pf.Vec2",
+    .tp_basicsize   = sizeof(PyVecObject),
+    .tp_flags       = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_CHECKTYPES,
+    .tp_doc         = "Immutable 2D vector of native floats, holding (X, Z) coordinates on the map "
+                      "plane. Can be constructed from 2 floats or from a sequence of 2 floats. "
+                      "Supports addition, subtraction, negation, scaling and indexing, and compares "
+                      "equal to the (X, Z) tuple with the same values. Engine functions taking an "
+                      "(X, Z) tuple also accept a pf.Vec2.",
+    .tp_repr        = (reprfunc)PyVec_repr,
+    .tp_hash        = (hashfunc)PyVec_hash,
+    .tp_richcompare = (richcmpfunc)PyVec_richcompare,
+    .tp_as_number   = &PyVec_as_number,
+    .tp_as_sequence = &PyVec_as_sequence,
+    .tp_members     = PyVec2_members,
+    .tp_methods     = PyVec2_methods,
+    .tp_new         = PyVec_new,
+};
+
+static PyTypeObject PyVec3_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "pf.Vec3",
+    .tp_basicsize   = sizeof(PyVecObject),
+    .tp_flags       = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_CHECKTYPES,
+    .tp_doc         = "Immutable 3D vector of native floats. Can be constructed from 3 floats or from "
+                      "a sequence of 3 floats. Supports addition, subtraction, negation, scaling and "
+                      "indexing, and compares equal to the (X, Y, Z) tuple with the same values. "
+                      "Engine functions taking an (X, Y, Z) tuple also accept a pf.Vec3.",
+    .tp_repr        = (reprfunc)PyVec_repr,
+    .tp_hash        = (hashfunc)PyVec_hash,
+    .tp_richcompare = (richcmpfunc)PyVec_richcompare,
+    .tp_as_number   = &PyVec_as_number,
+    .tp_as_sequence = &PyVec_as_sequence,
+    .tp_members     = PyVec3_members,
+    .tp_methods     = PyVec3_methods,
+    .tp_new         = PyVec_new,
+};
+
+static PyTypeObject PyQuat_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "pf.Quat",
+    .tp_basicsize   = sizeof(PyVecObject),
+    .tp_flags       = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_CHECKTYPES,
+    .tp_doc         = "Immutable (X, Y, Z, W) quaternion of native floats. Can be constructed from 4 "
+                      "floats or from a sequence of 4 floats, and defaults to the identity rotation. "
+                      "Multiplying two quaternions composes the rotations. Compares equal to the "
+                      "(X, Y, Z, W) tuple with the same values. Engine functions taking an (X, Y, Z, "
+                      "W) tuple also accept a pf.Quat.",
+    .tp_repr        = (reprfunc)PyVec_repr,
+    .tp_hash        = (hashfunc)PyVec_hash,
+    .tp_richcompare = (richcmpfunc)PyVec_richcompare,
+    .tp_as_number   = &PyQuat_as_number,
+    .tp_as_sequence = &PyVec_as_sequence,
+    .tp_members     = PyQuat_members,
+    .tp_methods     = PyQuat_methods,
+    .tp_new         = PyVec_new,
+};
+
+static PyMethodDef s_math_funcs[] = {
+    {"vec2_batch_distance", 
+    (PyCFunction)PyPf_vec2_batch_distance, METH_VARARGS,
+    "Takes a buffer of packed native-endian (X, Z) float pairs and an (X, Z) origin. Returns a "
+    "bytearray of native-endian floats holding the distance of each point to the origin."},
+
+    {"vec3_batch_distance", 
+    (PyCFunction)PyPf_vec3_batch_distance, METH_VARARGS,
+    "Takes a buffer of packed native-endian (X, Y, Z) float triples (such as the 'positions' "
+    "buffer of 'pack_entity_attributes') and an (X, Y, Z) origin. Returns a bytearray of "
+    "native-endian floats holding the distance of each point to the origin."},
+
+    {"vec2_batch_within", 
+    (PyCFunction)PyPf_vec2_batch_within, METH_VARARGS,
+    "Takes a buffer of packed native-endian (X, Z) float pairs, an (X, Z) origin and a radius. "
+    "Returns a list of the indices of the points which are within the radius of the origin."},
+
+    {"vec3_batch_within", 
+    (PyCFunction)PyPf_vec3_batch_within, METH_VARARGS,
+    "Takes a buffer of packed native-endian (X, Y, Z) float triples, an (X, Y, Z) origin and "
+    "a radius. Returns a list of the indices of the points which are within the radius of the "
+    "origin."},
+
+    {"vec3_batch_add", 
+    (PyCFunction)PyPf_vec3_batch_add, METH_VARARGS,
+    "Takes a buffer of packed native-endian (X, Y, Z) float triples and an (X, Y, Z) offset. "
+    "Returns a bytearray of the translated points in the same format."},
+
+    {"quat_batch_rotate", 
+    (PyCFunction)PyPf_quat_batch_rotate, METH_VARARGS,
+    "Takes a buffer of packed native-endian (X, Y, Z) float triples and an (X, Y, Z, W) "
+    "quaternion. Returns a bytearray of the rotated points in the same format. Useful for "
+    "orienting a set of formation offsets."},
+
+    {NULL}  /* Sentinel */
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool pyvec_check(PyObject *obj)
+{
+    return (Py_TYPE(obj) == &PyVec2_type)
+        || (Py_TYPE(obj) == &PyVec3_type)
+        || (Py_TYPE(obj) == &PyQuat_type);
+}
+
+static int pyvec_dim(PyTypeObject *type)
+{
+    if(type == &PyVec2_type)
+        return 2;
+    if(type == &PyVec3_type)
+        return 3;
+    assert(type == &PyQuat_type);
+    return 4;
+}
+
+static PyObject *pyvec_make(PyTypeObject *type, const float *raw)
+{
+    PyVecObject *ret = (PyVecObject*)type->tp_alloc(type, 0);
+    if(!ret)
+        return NULL;
+    memcpy(ret->raw, raw, pyvec_dim(type) * sizeof(float));
+    return (PyObject*)ret;
+}
+
+static bool pyvec_from_seq(PyObject *seq, int dim, float *out)
+{
+    PyObject *fast = PySequence_Fast(seq, "Expecting a sequence of floats.");
+    if(!fast)
+        return false;
+
+    bool ret = false;
+    if(PySequence_Fast_GET_SIZE(fast) != dim)
+        goto out;
+
+    for(int i = 0; i < dim; i++) {
+        double val = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(fast, i));
+        if(val == -1.0 && PyErr_Occurred())
+            goto out;
+        out[i] = val;
+    }
+    ret = true;
+
+out:
+    Py_DECREF(fast);
+    return ret;
+}
+
+/* Only the exact type or a tuple of the right size are accepted, so that 
+ * the other types that support the sequence protocol (strings, for example) 
+ * don't get silently converted. */
+static bool pyvec_from_obj(PyObject *obj, PyTypeObject *type, float *out)
+{
+    int dim = pyvec_dim(type);
+    if(Py_TYPE(obj) == type) {
+        memcpy(out, ((PyVecObject*)obj)->raw, dim * sizeof(float));
+        return true;
+    }
+    if(!PyTuple_Check(obj) || PyTuple_GET_SIZE(obj) != dim)
+        return false;
+    if(!pyvec_from_seq(obj, dim, out)) {
+        PyErr_Clear();
+        return false;
+    }
+    return true;
+}
+
+static PyObject *pyvec_to_tuple(PyVecObject *self)
+{
+    int dim = pyvec_dim(Py_TYPE(self));
+    PyObject *ret = PyTuple_New(dim);
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < dim; i++) {
+        PyObject *val = PyFloat_FromDouble(self->raw[i]);
+        if(!val) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(ret, i, val);
+    }
+    return ret;
+}
+
+static PyObject *not_implemented(void)
+{
+    Py_INCREF(Py_NotImplemented);
+    return Py_NotImplemented;
+}
+
+static float pyvec_distance(int dim, const float *a, const float *b)
+{
+    if(dim == 2) {
+        vec2_t delta = (vec2_t){a[0] - b[0], a[1] - b[1]};
+        return PFM_Vec2_Len(&delta);
+    }
+    vec3_t delta = (vec3_t){a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    return PFM_Vec3_Len(&delta);
+}
+
+static PyObject *PyVec_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    int dim = pyvec_dim(type);
+    float raw[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+    if(kwds && PyDict_Size(kwds) > 0) {
+        PyErr_Format(PyExc_TypeError, "%s takes no keyword arguments.", type->tp_name);
+        return NULL;
+    }
+
+    Py_ssize_t nargs = PyTuple_GET_SIZE(args);
+    bool status = true;
+
+    if(nargs == 1 && Py_TYPE(PyTuple_GET_ITEM(args, 0)) == type) {
+        Py_INCREF(PyTuple_GET_ITEM(args, 0));
+        return PyTuple_GET_ITEM(args, 0);
+    }else if(nargs == 1 && PySequence_Check(PyTuple_GET_ITEM(args, 0))
+                        && !PyString_Check(PyTuple_GET_ITEM(args, 0))) {
+        status = pyvec_from_seq(PyTuple_GET_ITEM(args, 0), dim, raw);
+    }else if(nargs == dim) {
+        status = pyvec_from_seq(args, dim, raw);
+    }else if(nargs != 0) {
+        status = false;
+    }
+
+    if(!status) {
+        PyErr_Format(PyExc_TypeError, "%s takes %d floats or a sequence of %d floats.", 
+            type->tp_name, dim, dim);
+        return NULL;
+    }
+    return pyvec_make(type, raw);
+}
+
+static PyObject *PyVec_repr(PyVecObject *self)
+{
+    PyObject *tuple = pyvec_to_tuple(self);
+    if(!tuple)
+        return NULL;
+
+    PyObject *repr = PyObject_Repr(tuple);
+    Py_DECREF(tuple);
+    if(!repr)
+        return NULL;
+
+    PyObject *ret = PyString_FromFormat("%s%s", Py_TYPE(self)->tp_name, PyString_AS_STRING(repr));
+    Py_DECREF(repr);
+    return ret;
+}
+
+/* The same algorithm as for tuples (Objects/tupleobject.c), as a vector 
+ * compares equal to the tuple of its' components. */
+static long PyVec_hash(PyVecObject *self)
+{
+    int dim = pyvec_dim(Py_TYPE(self));
+    unsigned long x = 0x345678UL;
+    unsigned long mult = 1000003UL;
+    Py_ssize_t len = dim;
+
+    for(int i = 0; i < dim; i++) {
+        --len;
+        long y = _Py_HashDouble(self->raw[i]);
+        x = (x ^ (unsigned long)y) * mult;
+        mult += (unsigned long)(82520L + len + len);
+    }
+    x += 97531UL;
+
+    long ret = (long)x;
+    if(ret == -1)
+        ret = -2;
+    return ret;
+}
+
+static PyObject *PyVec_richcompare(PyVecObject *self, PyObject *other, int op)
+{
+    if(op != Py_EQ && op != Py_NE)
+        return not_implemented();
+
+    float raw[4];
+    if(!pyvec_from_obj(other, Py_TYPE(self), raw))
+        return not_implemented();
+
+    /* Compare component-wise rather than with memcmp, so that 0.0 == -0.0 */
+    bool equal = true;
+    for(int i = 0; i < pyvec_dim(Py_TYPE(self)); i++) {
+        if(raw[i] != self->raw[i]) {
+            equal = false;
+            break;
+        }
+    }
+
+    if(equal == (op == Py_EQ)) {
+        Py_RETURN_TRUE;
+    }else{
+        Py_RETURN_FALSE;
+    }
+}
+
+static Py_ssize_t PyVec_length(PyVecObject *self)
+{
+    return pyvec_dim(Py_TYPE(self));
+}
+
+static PyObject *PyVec_item(PyVecObject *self, Py_ssize_t i)
+{
+    if(i < 0 || i >= pyvec_dim(Py_TYPE(self))) {
+        PyErr_SetString(PyExc_IndexError, "Index out of range.");
+        return NULL;
+    }
+    return PyFloat_FromDouble(self->raw[i]);
+}
+
+static PyObject *PyVec_add(PyObject *a, PyObject *b)
+{
+    PyTypeObject *type = pyvec_check(a) ? Py_TYPE(a) : Py_TYPE(b);
+    float lhs[4], rhs[4];
+
+    if(!pyvec_from_obj(a, type, lhs) || !pyvec_from_obj(b, type, rhs))
+        return not_implemented();
+
+    for(int i = 0; i < pyvec_dim(type); i++)
+        lhs[i] += rhs[i];
+    return pyvec_make(type, lhs);
+}
+
+static PyObject *PyVec_subtract(PyObject *a, PyObject *b)
+{
+    PyTypeObject *type = pyvec_check(a) ? Py_TYPE(a) : Py_TYPE(b);
+    float lhs[4], rhs[4];
+
+    if(!pyvec_from_obj(a, type, lhs) || !pyvec_from_obj(b, type, rhs))
+        return not_implemented();
+
+    for(int i = 0; i < pyvec_dim(type); i++)
+        lhs[i] -= rhs[i];
+    return pyvec_make(type, lhs);
+}
+
+static PyObject *PyVec_multiply(PyObject *a, PyObject *b)
+{
+    PyObject *vec = pyvec_check(a) ? a : b;
+    PyObject *scalar = pyvec_check(a) ? b : a;
+
+    if(!PyNumber_Check(scalar) || pyvec_check(scalar))
+        return not_implemented();
+
+    double scale = PyFloat_AsDouble(scalar);
+    if(scale == -1.0 && PyErr_Occurred())
+        return NULL;
+
+    float raw[4];
+    memcpy(raw, ((PyVecObject*)vec)->raw, sizeof(raw));
+    for(int i = 0; i < pyvec_dim(Py_TYPE(vec)); i++)
+        raw[i] *= scale;
+    return pyvec_make(Py_TYPE(vec), raw);
+}
+
+static PyObject *PyVec_divide(PyObject *a, PyObject *b)
+{
+    if(!pyvec_check(a) || pyvec_check(b) || !PyNumber_Check(b))
+        return not_implemented();
+
+    double div = PyFloat_AsDouble(b);
+    if(div == -1.0 && PyErr_Occurred())
+        return NULL;
+
+    if(div == 0.0) {
+        PyErr_SetString(PyExc_ZeroDivisionError, "Vector division by zero.");
+        return NULL;
+    }
+
+    float raw[4];
+    memcpy(raw, ((PyVecObject*)a)->raw, sizeof(raw));
+    for(int i = 0; i < pyvec_dim(Py_TYPE(a)); i++)
+        raw[i] /= div;
+    return pyvec_make(Py_TYPE(a), raw);
+}
+
+static PyObject *PyVec_negative(PyVecObject *self)
+{
+    float raw[4];
+    for(int i = 0; i < pyvec_dim(Py_TYPE(self)); i++)
+        raw[i] = -self->raw[i];
+    return pyvec_make(Py_TYPE(self), raw);
+}
+
+static PyObject *PyQuat_multiply(PyObject *a, PyObject *b)
+{
+    quat_t lhs, rhs, ret;
+    if(!S_Math_QuatFromObj(a, &lhs) || !S_Math_QuatFromObj(b, &rhs))
+        return not_implemented();
+
+    PFM_Quat_MultQuat(&lhs, &rhs, &ret);
+    PFM_Quat_Normal(&ret, &ret);
+    return pyvec_make(&PyQuat_type, ret.raw);
+}
+
+static PyObject *PyVec_dot(PyVecObject *self, PyObject *args)
+{
+    PyObject *other;
+    float raw[4];
+
+    if(!PyArg_ParseTuple(args, "O", &other) || !pyvec_from_obj(other, Py_TYPE(self), raw)) {
+        PyErr_Format(PyExc_TypeError, "Argument must be a %s or a tuple of %d floats.",
+            Py_TYPE(self)->tp_name, pyvec_dim(Py_TYPE(self)));
+        return NULL;
+    }
+
+    if(Py_TYPE(self) == &PyVec2_type) {
+        vec2_t lhs = (vec2_t){self->raw[0], self->raw[1]};
+        vec2_t rhs = (vec2_t){raw[0], raw[1]};
+        return PyFloat_FromDouble(PFM_Vec2_Dot(&lhs, &rhs));
+    }
+    vec3_t lhs = (vec3_t){self->raw[0], self->raw[1], self->raw[2]};
+    vec3_t rhs = (vec3_t){raw[0], raw[1], raw[2]};
+    return PyFloat_FromDouble(PFM_Vec3_Dot(&lhs, &rhs));
+}
+
+static PyObject *PyVec_length_method(PyVecObject *self)
+{
+    const float zero[3] = {0.0f};
+    return PyFloat_FromDouble(pyvec_distance(pyvec_dim(Py_TYPE(self)), self->raw, zero));
+}
+
+static PyObject *PyVec_normalized(PyVecObject *self)
+{
+    const float zero[3] = {0.0f};
+    int dim = pyvec_dim(Py_TYPE(self));
+    float len = pyvec_distance(dim, self->raw, zero);
+
+    float raw[4];
+    memcpy(raw, self->raw, sizeof(raw));
+    if(len > 0.0f) {
+        for(int i = 0; i < dim; i++)
+            raw[i] /= len;
+    }
+    return pyvec_make(Py_TYPE(self), raw);
+}
+
+static PyObject *PyVec_distance(PyVecObject *self, PyObject *args)
+{
+    PyObject *other;
+    float raw[4];
+
+    if(!PyArg_ParseTuple(args, "O", &other) || !pyvec_from_obj(other, Py_TYPE(self), raw)) {
+        PyErr_Format(PyExc_TypeError, "Argument must be a %s or a tuple of %d floats.",
+            Py_TYPE(self)->tp_name, pyvec_dim(Py_TYPE(self)));
+        return NULL;
+    }
+    return PyFloat_FromDouble(pyvec_distance(pyvec_dim(Py_TYPE(self)), self->raw, raw));
+}
+
+static PyObject *PyVec3_cross(PyVecObject *self, PyObject *args)
+{
+    PyObject *other;
+    vec3_t rhs, ret;
+
+    if(!PyArg_ParseTuple(args, "O", &other) || !S_Math_Vec3FromObj(other, &rhs)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a pf.Vec3 or a tuple of 3 floats.");
+        return NULL;
+    }
+
+    vec3_t lhs = (vec3_t){self->raw[0], self->raw[1], self->raw[2]};
+    PFM_Vec3_Cross(&lhs, &rhs, &ret);
+    return S_Math_Vec3New(ret);
+}
+
+static PyObject *PyQuat_normalized(PyVecObject *self)
+{
+    quat_t quat, ret;
+    memcpy(quat.raw, self->raw, sizeof(quat.raw));
+    PFM_Quat_Normal(&quat, &ret);
+    return S_Math_QuatNew(ret);
+}
+
+static PyObject *PyQuat_inverse(PyVecObject *self)
+{
+    quat_t quat, ret;
+    memcpy(quat.raw, self->raw, sizeof(quat.raw));
+    PFM_Quat_Inverse(&quat, &ret);
+    return S_Math_QuatNew(ret);
+}
+
+/* Uses the same rotation matrix as the one that orients the entities. */
+static void quat_rot_mat(const float *raw, mat4x4_t *out)
+{
+    quat_t quat;
+    memcpy(quat.raw, raw, sizeof(quat.raw));
+    PFM_Mat4x4_RotFromQuat(&quat, out);
+}
+
+static vec3_t quat_rotate(mat4x4_t *rot, vec3_t vec)
+{
+    vec4_t in = (vec4_t){vec.x, vec.y, vec.z, 1.0f};
+    vec4_t out;
+    PFM_Mat4x4_Mult4x1(rot, &in, &out);
+    return (vec3_t){out.x, out.y, out.z};
+}
+
+static PyObject *PyQuat_rotate(PyVecObject *self, PyObject *args)
+{
+    PyObject *obj;
+    vec3_t vec;
+
+    if(!PyArg_ParseTuple(args, "O", &obj) || !S_Math_Vec3FromObj(obj, &vec)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a pf.Vec3 or a tuple of 3 floats.");
+        return NULL;
+    }
+
+    mat4x4_t rot;
+    quat_rot_mat(self->raw, &rot);
+    return S_Math_Vec3New(quat_rotate(&rot, vec));
+}
+
+static PyObject *PyVec_pickle(PyVecObject *self, PyObject *args, PyObject *kwargs)
+{
+    bool status;
+    PyObject *ret = NULL;
+
+    SDL_RWops *stream = PFSDL_VectorRWOps();
+    CHK_TRUE(stream, fail_alloc);
+
+    PyObject *attrs = pyvec_to_tuple(self);
+    CHK_TRUE(attrs, fail_pickle);
+    status = S_PickleObjgraph(attrs, stream);
+    Py_DECREF(attrs);
+    CHK_TRUE(status, fail_pickle);
+    ret = PyString_FromStringAndSize(PFSDL_VectorRWOpsRaw(stream), SDL_RWsize(stream));
+
+fail_pickle:
+    SDL_RWclose(stream);
+fail_alloc:
+    return ret;
+}
+
+static PyObject *PyVec_unpickle(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    PyObject *ret = NULL;
+    const char *str;
+    Py_ssize_t len;
+    char tmp;
+    float raw[4];
+
+    if(!PyArg_ParseTuple(args, "s#", &str, &len)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a single string.");
+        goto fail_args;
+    }
+
+    SDL_RWops *stream = SDL_RWFromConstMem(str, len);
+    CHK_TRUE(stream, fail_args);
+
+    PyObject *attrs = S_UnpickleObjgraph(stream);
+    SDL_RWread(stream, &tmp, 1, 1); /* consume NULL byte */
+    CHK_TRUE(attrs, fail_unpickle);
+
+    if(!pyvec_from_obj(attrs, (PyTypeObject*)cls, raw)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unexpected vector contents in the pickle stream.");
+        goto fail_vec;
+    }
+
+    PyObject *vecobj = pyvec_make((PyTypeObject*)cls, raw);
+    CHK_TRUE(vecobj, fail_vec);
+
+    Py_ssize_t nread = SDL_RWseek(stream, 0, RW_SEEK_CUR);
+    ret = Py_BuildValue("(Oi)", vecobj, (int)nread);
+    Py_DECREF(vecobj);
+
+fail_vec:
+    Py_DECREF(attrs);
+fail_unpickle:
+    SDL_RWclose(stream);
+fail_args:
+    return ret;
+}
+
+/* The points are copied out element-wise, as nothing guarantees that an 
+ * arbitrary buffer is suitably aligned for floats. */
+static bool batch_points(PyObject *obj, int dim, const char **out, size_t *out_npoints)
+{
+    const void *buff;
+    Py_ssize_t len;
+
+    if(0 != PyObject_AsReadBuffer(obj, &buff, &len)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting an object supporting the buffer protocol.");
+        return false;
+    }
+
+    size_t stride = dim * sizeof(float);
+    if(len % stride) {
+        PyErr_Format(PyExc_ValueError, "Buffer size must be a multiple of %d bytes.", (int)stride);
+        return false;
+    }
+
+    *out = buff;
+    *out_npoints = len / stride;
+    return true;
+}
+
+static PyObject *batch_distance(PyObject *args, PyTypeObject *type)
+{
+    int dim = pyvec_dim(type);
+    PyObject *points, *originobj;
+    float origin[4];
+
+    if(!PyArg_ParseTuple(args, "OO", &points, &originobj) 
+    || !pyvec_from_obj(originobj, type, origin)) {
+        PyErr_Format(PyExc_TypeError, "Arguments must be a buffer and a %s or a tuple of %d floats.",
+            type->tp_name, dim);
+        return NULL;
+    }
+
+    const char *buff;
+    size_t npoints;
+    if(!batch_points(points, dim, &buff, &npoints))
+        return NULL;
+
+    PyObject *ret = PyByteArray_FromStringAndSize(NULL, npoints * sizeof(float));
+    if(!ret)
+        return NULL;
+
+    float *out = (float*)PyByteArray_AS_STRING(ret);
+    for(size_t i = 0; i < npoints; i++) {
+        float point[4];
+        memcpy(point, buff + i * dim * sizeof(float), dim * sizeof(float));
+        out[i] = pyvec_distance(dim, point, origin);
+    }
+    return ret;
+}
+
+static PyObject *batch_within(PyObject *args, PyTypeObject *type)
+{
+    int dim = pyvec_dim(type);
+    PyObject *points, *originobj;
+    float origin[4];
+    float radius;
+
+    if(!PyArg_ParseTuple(args, "OOf", &points, &originobj, &radius) 
+    || !pyvec_from_obj(originobj, type, origin)) {
+        PyErr_Format(PyExc_TypeError, "Arguments must be a buffer, a %s or a tuple of %d floats "
+            "and a float.", type->tp_name, dim);
+        return NULL;
+    }
+
+    const char *buff;
+    size_t npoints;
+    if(!batch_points(points, dim, &buff, &npoints))
+        return NULL;
+
+    PyObject *ret = PyList_New(0);
+    if(!ret)
+        return NULL;
+
+    for(size_t i = 0; i < npoints; i++) {
+
+        float point[4];
+        memcpy(point, buff + i * dim * sizeof(float), dim * sizeof(float));
+        if(pyvec_distance(dim, point, origin) > radius)
+            continue;
+
+        PyObject *idx = PyInt_FromSsize_t(i);
+        if(!idx || 0 != PyList_Append(ret, idx)) {
+            Py_XDECREF(idx);
+            Py_DECREF(ret);
+            return NULL;
+        }
+        Py_DECREF(idx);
+    }
+    return ret;
+}
+
+static PyObject *PyPf_vec2_batch_distance(PyObject *self, PyObject *args)
+{
+    return batch_distance(args, &PyVec2_type);
+}
+
+static PyObject *PyPf_vec3_batch_distance(PyObject *self, PyObject *args)
+{
+    return batch_distance(args, &PyVec3_type);
+}
+
+static PyObject *PyPf_vec2_batch_within(PyObject *self, PyObject *args)
+{
+    return batch_within(args, &PyVec2_type);
+}
+
+static PyObject *PyPf_vec3_batch_within(PyObject *self, PyObject *args)
+{
+    return batch_within(args, &PyVec3_type);
+}
+
+static PyObject *PyPf_vec3_batch_add(PyObject *self, PyObject *args)
+{
+    PyObject *points, *offsetobj;
+    vec3_t offset;
+
+    if(!PyArg_ParseTuple(args, "OO", &points, &offsetobj) || !S_Math_Vec3FromObj(offsetobj, &offset)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a buffer and a pf.Vec3 or a tuple of 3 floats.");
+        return NULL;
+    }
+
+    const char *buff;
+    size_t npoints;
+    if(!batch_points(points, 3, &buff, &npoints))
+        return NULL;
+
+    PyObject *ret = PyByteArray_FromStringAndSize(NULL, npoints * sizeof(vec3_t));
+    if(!ret)
+        return NULL;
+
+    char *out = PyByteArray_AS_STRING(ret);
+    for(size_t i = 0; i < npoints; i++) {
+        vec3_t point;
+        memcpy(point.raw, buff + i * sizeof(vec3_t), sizeof(vec3_t));
+        PFM_Vec3_Add(&point, &offset, &point);
+        memcpy(out + i * sizeof(vec3_t), point.raw, sizeof(vec3_t));
+    }
+    return ret;
+}
+
+static PyObject *PyPf_quat_batch_rotate(PyObject *self, PyObject *args)
+{
+    PyObject *points, *quatobj;
+    quat_t quat;
+
+    if(!PyArg_ParseTuple(args, "OO", &points, &quatobj) || !S_Math_QuatFromObj(quatobj, &quat)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a buffer and a pf.Quat or a tuple of 4 floats.");
+        return NULL;
+    }
+
+    const char *buff;
+    size_t npoints;
+    if(!batch_points(points, 3, &buff, &npoints))
+        return NULL;
+
+    PyObject *ret = PyByteArray_FromStringAndSize(NULL, npoints * sizeof(vec3_t));
+    if(!ret)
+        return NULL;
+
+    mat4x4_t rot;
+    quat_rot_mat(quat.raw, &rot);
+
+    char *out = PyByteArray_AS_STRING(ret);
+    for(size_t i = 0; i < npoints; i++) {
+        vec3_t point;
+        memcpy(point.raw, buff + i * sizeof(vec3_t), sizeof(vec3_t));
+        point = quat_rotate(&rot, point);
+        memcpy(out + i * sizeof(vec3_t), point.raw, sizeof(vec3_t));
+    }
+    return ret;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void S_Math_PyRegister(PyObject *module)
+{
+    PyTypeObject *types[] = {&PyVec2_type, &PyVec3_type, &PyQuat_type};
+    const char *names[] = {"Vec2", "Vec3", "Quat"};
+
+    for(int i = 0; i < ARR_SIZE(types); i++) {
+        if(PyType_Ready(types[i]) < 0)
+            return;
+        Py_INCREF(types[i]);
+        PyModule_AddObject(module, names[i], (PyObject*)types[i]);
+    }
+
+    PyObject *modname = PyString_FromString(PyModule_GetName(module));
+    if(!modname)
+        return;
+
+    for(PyMethodDef *def = s_math_funcs; def->ml_name; def++) {
+        PyObject *func = PyCFunction_NewEx(def, NULL, modname);
+        if(!func)
+            break;
+        PyModule_AddObject(module, def->ml_name, func);
+    }
+    Py_DECREF(modname);
+}
+
+bool S_Math_Vec2FromObj(PyObject *obj, vec2_t *out)
+{
+    return pyvec_from_obj(obj, &PyVec2_type, out->raw);
+}
+
+bool S_Math_Vec3FromObj(PyObject *obj, vec3_t *out)
+{
+    return pyvec_from_obj(obj, &PyVec3_type, out->raw);
+}
+
+bool S_Math_QuatFromObj(PyObject *obj, quat_t *out)
+{
+    return pyvec_from_obj(obj, &PyQuat_type, out->raw);
+}
+
+bool S_Math_QuatCheck(PyObject *obj)
+{
+    return (Py_TYPE(obj) == &PyQuat_type);
+}
+
+PyObject *S_Math_Vec2New(vec2_t vec)
+{
+    return pyvec_make(&PyVec2_type, vec.raw);
+}
+
+PyObject *S_Math_Vec3New(vec3_t vec)
+{
+    return pyvec_make(&PyVec3_type, vec.raw);
+}
+
+PyObject *S_Math_QuatNew(quat_t quat)
+{
+    return pyvec_make(&PyQuat_type, quat.raw);
+}
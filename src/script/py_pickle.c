@@ -40,6 +40,7 @@
 #include "private_types.h"
 #include "../lib/public/pf_string.h"
 #include "../lib/public/mem.h"
+#include "../lib/public/SDL_vec_rwops.h"
 #include "../asset_load.h"
 #include "../sched.h"
 
@@ -221,6 +222,10 @@ typedef void *mod_ty; //symtable.h wants this
 #define EXC_START_MAGIC ((void*)0x1234)
 #define EXC_END_MAGIC   ((void*)0x4321)
 
+#define PICKLE_BUFF_SIZE (64 * 1024)
+/* Payloads at least this large are appended to gathering streams by reference */
+#define PICKLE_REF_SIZE  PICKLE_BUFF_SIZE
+
 struct memo_entry{
     int idx;
     PyObject *obj;
@@ -248,6 +253,15 @@ struct pickle_ctx{
     vec_pobj_t     to_free;
 };
 
+/* The opcodes are written in many small pieces - they are gathered
+ * in this buffer and handed to the destination stream in large writes. 
+ */
+struct pickle_buff{
+    SDL_RWops     *dst;
+    size_t         size;
+    char           data[PICKLE_BUFF_SIZE];
+};
+
 struct unpickle_ctx{
     vec_pobj_t     stack;
     vec_pobj_t     memo;
@@ -267,13 +281,16 @@ struct pickle_entry{
 
 static bool pickle_obj(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *stream);
 static bool pickle_attrs(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw);
-static void memoize(struct pickle_ctx *ctx, PyObject *obj);
+static int memoize(struct pickle_ctx *ctx, PyObject *obj);
 static bool memo_contains(const struct pickle_ctx *ctx, PyObject *obj);
+static bool memo_lookup(const struct pickle_ctx *ctx, PyObject *obj, int *out);
 static int memo_idx(const struct pickle_ctx *ctx, PyObject *obj);
 static bool emit_get(const struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw);
 static bool emit_put(const struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw);
 static bool emit_alloc(const struct pickle_ctx *ctx, SDL_RWops *rw);
 static void deferred_free(struct pickle_ctx *ctx, PyObject *obj);
+static bool pbuff_flush(struct pickle_buff *buff);
+static size_t pbuff_write(SDL_RWops *rw, const void *ptr, size_t size, size_t num);
 
 /* Pickling functions */
 static int type_pickle        (struct pickle_ctx *, PyObject *, SDL_RWops *);
@@ -684,6 +701,10 @@ static struct pickle_entry s_pf_dispatch_table[] = {
     {.type = NULL, /* PyGarrisonEntity_type */            .picklefunc = custom_pickle   },
     {.type = NULL, /* PyGarrisonableEntity_type */        .picklefunc = custom_pickle   },
     {.type = NULL, /* PyRegion_type*/                     .picklefunc = custom_pickle   },
+    {.type = NULL, /* PyVec2_type*/                       .picklefunc = custom_pickle   },
+    {.type = NULL, /* PyVec3_type*/                       .picklefunc = custom_pickle   },
+    {.type = NULL, /* PyQuat_type*/                       .picklefunc = custom_pickle   },
+    {.type = NULL, /* PyDeferred_type*/                   .picklefunc = custom_pickle   },
 };
 
 static unpickle_func_t s_op_dispatch_table[256] = {
@@ -1354,6 +1375,10 @@ static void load_engine_builtin_types(void)
     s_pf_dispatch_table[idx++].type = (PyTypeObject*)PyObject_GetAttrString(pfmod, "GarrisonEntity");
     s_pf_dispatch_table[idx++].type = (PyTypeObject*)PyObject_GetAttrString(pfmod, "GarrisonableEntity");
     s_pf_dispatch_table[idx++].type = (PyTypeObject*)PyObject_GetAttrString(pfmod, "Region");
+    s_pf_dispatch_table[idx++].type = (PyTypeObject*)PyObject_GetAttrString(pfmod, "Vec2");
+    s_pf_dispatch_table[idx++].type = (PyTypeObject*)PyObject_GetAttrString(pfmod, "Vec3");
+    s_pf_dispatch_table[idx++].type = (PyTypeObject*)PyObject_GetAttrString(pfmod, "Quat");
+    s_pf_dispatch_table[idx++].type = (PyTypeObject*)PyObject_GetAttrString(pfmod, "Deferred");
 
     for(int i = 0; i < ARR_SIZE(s_pf_dispatch_table); i++) {
         assert(s_pf_dispatch_table[i].type);
@@ -1960,6 +1985,36 @@ fail:
     return -1;
 }
 
+static void release_ref(void *arg)
+{
+    Py_DECREF((PyObject*)arg);
+}
+
+/* Writes the contents of a buffer owned by 'owner'. When the stream ends up 
+ * in a gathering in-memory stream, large buffers are appended by reference 
+ * (keeping 'owner' alive) instead of being copied.
+ */
+static bool write_owned(SDL_RWops *rw, PyObject *owner, const char *data, size_t len)
+{
+    SDL_RWops *dst = rw;
+    if(rw->write == pbuff_write) {
+        dst = ((struct pickle_buff*)rw->hidden.unknown.data1)->dst;
+    }
+
+    if(len < PICKLE_REF_SIZE || !PFSDL_VMemRWOpsGathers(dst))
+        return rw->write(rw, data, len, 1);
+
+    if(rw != dst && !pbuff_flush(rw->hidden.unknown.data1))
+        return false;
+
+    Py_INCREF(owner);
+    if(!PFSDL_VMemRWOpsAppendRef(dst, data, len, release_ref, owner)) {
+        Py_DECREF(owner);
+        return false;
+    }
+    return true;
+}
+
 static int string_pickle(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
 {
     TRACE_PICKLE(obj);
@@ -1976,7 +2031,7 @@ static int string_pickle(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
     repr_str = PyString_AS_STRING((PyStringObject *)repr);
 
     CHK_TRUE(rw->write(rw, &op, 1, 1), fail);
-    CHK_TRUE(rw->write(rw, repr_str, strlen(repr_str), 1), fail);
+    CHK_TRUE(write_owned(rw, repr, repr_str, strlen(repr_str)), fail);
     CHK_TRUE(rw->write(rw, "\n", 1, 1), fail);
 
     Py_XDECREF(repr);
@@ -7336,7 +7391,7 @@ static int op_ext_nullimporter(struct unpickle_ctx *ctx, SDL_RWops *rw)
     return 0;
 }
 
-static bool pickle_ctx_init(struct pickle_ctx *ctx)
+static bool pickle_ctx_init(struct pickle_ctx *ctx, size_t reserve)
 {
     if(NULL == (ctx->memo = kh_init(memo))) {
         SET_EXC(PyExc_MemoryError, "Memo table allocation");
@@ -7344,7 +7399,7 @@ static bool pickle_ctx_init(struct pickle_ctx *ctx)
     }
 
     vec_pobj_init(&ctx->to_free);
-    vec_pobj_resize(&ctx->to_free, 16 * 1024);
+    vec_pobj_resize(&ctx->to_free, reserve);
     return true;
 
 fail_memo:
@@ -7402,6 +7457,16 @@ static bool memo_contains(const struct pickle_ctx *ctx, PyObject *obj)
     return false;
 }
 
+static bool memo_lookup(const struct pickle_ctx *ctx, PyObject *obj, int *out)
+{
+    uintptr_t id = (uintptr_t)obj;
+    khiter_t k = kh_get(memo, ctx->memo, id);
+    if(k == kh_end(ctx->memo))
+        return false;
+    *out = kh_value(ctx->memo, k).idx;
+    return true;
+}
+
 static int memo_idx(const struct pickle_ctx *ctx, PyObject *obj)
 {
     uintptr_t id = (uintptr_t)obj;
@@ -7410,7 +7475,7 @@ static int memo_idx(const struct pickle_ctx *ctx, PyObject *obj)
     return kh_value(ctx->memo, k).idx;
 }
 
-static void memoize(struct pickle_ctx *ctx, PyObject *obj)
+static int memoize(struct pickle_ctx *ctx, PyObject *obj)
 {
     int ret;
     int idx = kh_size(ctx->memo);
@@ -7418,22 +7483,114 @@ static void memoize(struct pickle_ctx *ctx, PyObject *obj)
     khiter_t k = kh_put(memo, ctx->memo, (uintptr_t)obj, &ret);
     assert(ret != -1 && ret != 0);
     kh_value(ctx->memo, k) = (struct memo_entry){idx, obj};
+    return idx;
 }
 
-static bool emit_get(const struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
+static bool emit_memo_op(char op, int idx, SDL_RWops *rw)
 {
+    /* Same as "%c%d\n", without going through the formatting machinery */
+    char digits[16];
+    size_t ndigits = 0;
+    unsigned val = idx;
+    assert(idx >= 0);
+    do{
+        digits[ndigits++] = '0' + (val % 10);
+        val /= 10;
+    }while(val);
+
     char str[32];
-    pf_snprintf(str, ARR_SIZE(str), "%c%d\n", GET, memo_idx(ctx, obj));
-    str[ARR_SIZE(str)-1] = '\0';
-    return rw->write(rw, str, 1, strlen(str));
+    size_t len = 0;
+    str[len++] = op;
+    while(ndigits) {
+        str[len++] = digits[--ndigits];
+    }
+    str[len++] = '\n';
+    return rw->write(rw, str, 1, len);
+}
+
+static bool emit_get(const struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
+{
+    return emit_memo_op(GET, memo_idx(ctx, obj), rw);
 }
 
 static bool emit_put(const struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *rw)
 {
-    char str[32];
-    pf_snprintf(str, ARR_SIZE(str), "%c%d\n", PUT, memo_idx(ctx, obj));
-    str[ARR_SIZE(str)-1] = '\0';
-    return rw->write(rw, str, 1, strlen(str));
+    return emit_memo_op(PUT, memo_idx(ctx, obj), rw);
+}
+
+/* Instances of these types never have any writable attributes, so we can
+ * skip walking their attributes entirely. This is the bulk of the objects 
+ * in a typical object graph. 
+ */
+static bool attrs_trivially_empty(PyObject *obj)
+{
+    PyTypeObject *type = obj->ob_type;
+    return (type == &PyInt_Type)
+        || (type == &PyLong_Type)
+        || (type == &PyFloat_Type)
+        || (type == &PyBool_Type)
+        || (type == &PyString_Type)
+        || (type == &PyUnicode_Type)
+        || (type == &PyComplex_Type)
+        || (type == &PyTuple_Type)
+        || (type == &PyList_Type)
+        || (type == &PyDict_Type)
+        || (type == &PySet_Type)
+        || (type == &PyFrozenSet_Type)
+        || (obj == Py_None);
+}
+
+static bool pbuff_flush(struct pickle_buff *buff)
+{
+    if(buff->size == 0)
+        return true;
+    size_t size = buff->size;
+    buff->size = 0;
+    return (buff->dst->write(buff->dst, buff->data, size, 1) == 1);
+}
+
+static size_t pbuff_write(SDL_RWops *rw, const void *ptr, size_t size, size_t num)
+{
+    struct pickle_buff *buff = rw->hidden.unknown.data1;
+    size_t total = size * num;
+
+    if(buff->size + total > PICKLE_BUFF_SIZE) {
+        if(!pbuff_flush(buff))
+            return 0;
+        if(total > PICKLE_BUFF_SIZE)
+            return buff->dst->write(buff->dst, ptr, size, num);
+    }
+
+    memcpy(buff->data + buff->size, ptr, total);
+    buff->size += total;
+    return num;
+}
+
+static size_t pbuff_read(SDL_RWops *rw, void *ptr, size_t size, size_t num)
+{
+    return 0;
+}
+
+static Sint64 pbuff_size(SDL_RWops *rw)
+{
+    struct pickle_buff *buff = rw->hidden.unknown.data1;
+    if(!pbuff_flush(buff))
+        return -1;
+    return buff->dst->size(buff->dst);
+}
+
+static Sint64 pbuff_seek(SDL_RWops *rw, Sint64 offset, int whence)
+{
+    struct pickle_buff *buff = rw->hidden.unknown.data1;
+    if(!pbuff_flush(buff))
+        return -1;
+    return buff->dst->seek(buff->dst, offset, whence);
+}
+
+static int pbuff_close(SDL_RWops *rw)
+{
+    struct pickle_buff *buff = rw->hidden.unknown.data1;
+    return pbuff_flush(buff) ? 0 : -1;
 }
 
 static bool emit_alloc(const struct pickle_ctx *ctx, SDL_RWops *rw)
@@ -7505,8 +7662,9 @@ static bool pickle_obj(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *stream)
         goto fail;
     }
 
-    if(memo_contains(ctx, obj)) {
-        CHK_TRUE(emit_get(ctx, obj, stream), fail);
+    int idx;
+    if(memo_lookup(ctx, obj, &idx)) {
+        CHK_TRUE(emit_memo_op(GET, idx, stream), fail);
         goto out;
     }
 
@@ -7530,11 +7688,11 @@ static bool pickle_obj(struct pickle_ctx *ctx, PyObject *obj, SDL_RWops *stream)
 
     /* Some objects (eg. lists) may already be memoized */
     if(!memo_contains(ctx, obj)) {
-        memoize(ctx, obj);
-        CHK_TRUE(emit_put(ctx, obj, stream), fail);
+        idx = memoize(ctx, obj);
+        CHK_TRUE(emit_memo_op(PUT, idx, stream), fail);
     }
 
-    if(pickle_attrs(ctx, obj, stream)) {
+    if(!attrs_trivially_empty(obj) && pickle_attrs(ctx, obj, stream)) {
         assert(PyErr_Occurred());
         goto fail; 
     }
@@ -7627,19 +7785,45 @@ PyObject *S_Pickle_PlainHeapSubtype(PyTypeObject *type)
 
 bool S_PickleObjgraph(PyObject *obj, SDL_RWops *stream)
 {
+    /* Custom pickling routines can recursively pickle other objects 
+     * into their own streams - only the outermost call is buffered. */
+    static struct pickle_buff s_buff;
+    static int s_depth = 0;
+
     struct pickle_ctx ctx;
+    SDL_RWops buffered = (SDL_RWops){
+        .size = pbuff_size,
+        .seek = pbuff_seek,
+        .read = pbuff_read,
+        .write = pbuff_write,
+        .close = pbuff_close,
+        .type = SDL_RWOPS_UNKNOWN,
+        .hidden.unknown.data1 = &s_buff
+    };
+    SDL_RWops *out = stream;
+
+    if(s_depth++ == 0) {
+        s_buff.dst = stream;
+        s_buff.size = 0;
+        out = &buffered;
+    }
 
-    int ret = pickle_ctx_init(&ctx);
+    /* The nested calls are for small objects, don't over-allocate for them */
+    int ret = pickle_ctx_init(&ctx, (s_depth == 1) ? 16 * 1024 : 64);
     if(!ret) 
         goto err;
 
-    if(!pickle_obj(&ctx, obj, stream))
+    if(!pickle_obj(&ctx, obj, out))
         goto err;
 
     char term[] = {STOP, '\0'};
-    CHK_TRUE(stream->write(stream, term, 1, ARR_SIZE(term)), err_write);
+    CHK_TRUE(out->write(out, term, 1, ARR_SIZE(term)), err_write);
+    if(out == &buffered) {
+        CHK_TRUE(pbuff_flush(&s_buff), err_write);
+    }
 
     pickle_ctx_destroy(&ctx);
+    --s_depth;
     return true;
 
 err_write:
@@ -7647,6 +7831,7 @@ err_write:
 err:
     assert(PyErr_Occurred());
     pickle_ctx_destroy(&ctx);
+    --s_depth;
     return false;
 }
 
@@ -0,0 +1,314 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include <Python.h> /* Must be first */
+#include <frameobject.h>
+
+#include "py_prof.h"
+#include "../main.h"
+#include "../perf.h"
+#include "../event.h"
+#include "../game/public/game.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/pf_string.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+
+#define MAX_SAMPLE_DEPTH    (64)
+#define MAX_NAME_LEN        (128)
+#define MAX_STACK_LEN       (4096)
+
+KHASH_MAP_INIT_STR(stack, uint64_t)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* The timer only raises a flag. The sample itself is taken on the main 
+ * thread by the interpreter hooks, when it is safe to walk the frames.
+ */
+static SDL_TimerID      s_timer = 0;
+static SDL_atomic_t     s_sample_due;
+static uint64_t         s_due_pc;
+
+static bool             s_active = false;
+static bool             s_hook_installed = false;
+static uint64_t         s_interval_pc;
+static size_t           s_nsamples;
+/* Number of samples for each distinct callstack, keyed by the 
+ * semicolon-separated frame names ('folded' flame graph format). 
+ */
+static khash_t(stack)  *s_stacks;
+
+static char             s_names[MAX_SAMPLE_DEPTH][MAX_NAME_LEN];
+static const char      *s_name_ptrs[MAX_SAMPLE_DEPTH * 2];
+static char             s_stackbuff[MAX_STACK_LEN];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static Uint32 prof_timer_callback(Uint32 interval, void *param)
+{
+    s_due_pc = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&s_sample_due, 1);
+    return interval;
+}
+
+static void prof_frame_name(PyFrameObject *frame, char *out, size_t maxout)
+{
+    PyCodeObject *code = frame->f_code;
+    const char *file = PyString_AS_STRING(code->co_filename);
+    const char *base = file;
+
+    for(const char *c = file; *c; c++) {
+        if(*c == '/' || *c == '\\')
+            base = c + 1;
+    }
+    pf_snprintf(out, maxout, "%s (%s:%d)", PyString_AS_STRING(code->co_name), 
+        base, code->co_firstlineno);
+}
+
+static void prof_add_folded(size_t depth, const char **names)
+{
+    size_t len = 0;
+    s_stackbuff[0] = '\0';
+
+    for(int i = 0; i < depth; i++) {
+        int nwritten = pf_snprintf(s_stackbuff + len, sizeof(s_stackbuff) - len, 
+            "%s%s", (i > 0) ? ";" : "", names[i]);
+        if(nwritten < 0 || len + nwritten >= sizeof(s_stackbuff))
+            break;
+        len += nwritten;
+    }
+
+    khiter_t k = kh_get(stack, s_stacks, s_stackbuff);
+    if(k == kh_end(s_stacks)) {
+
+        char *key = pf_strdup(s_stackbuff);
+        if(!key)
+            return;
+
+        int status;
+        k = kh_put(stack, s_stacks, key, &status);
+        if(status == -1) {
+            free(key);
+            return;
+        }
+        kh_val(s_stacks, k) = 0;
+    }
+    kh_val(s_stacks, k)++;
+}
+
+static void prof_sample(PyFrameObject *frame)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    uint64_t now = SDL_GetPerformanceCounter();
+    uint64_t due = s_due_pc;
+    SDL_AtomicSet(&s_sample_due, 0);
+
+    /* If the timer fired a whole interval ago, the interpreter was not 
+     * running at that time and the engine was busy with something else. 
+     * Attributing the sample to the current Python stack would be wrong.
+     */
+    if(now - due > s_interval_pc)
+        return;
+
+    size_t npy = 0;
+    for(PyFrameObject *curr = frame; curr && npy < MAX_SAMPLE_DEPTH; curr = curr->f_back) {
+        prof_frame_name(curr, s_names[npy], sizeof(s_names[0]));
+        npy++;
+    }
+
+    /* The native scopes that are currently pushed go first, followed by 
+     * the Python frames from the outermost one to the innermost one. 
+     */
+    size_t nnative = Perf_CurrentStack(MAX_SAMPLE_DEPTH, s_name_ptrs);
+    for(int i = 0; i < npy; i++) {
+        s_name_ptrs[nnative + i] = s_names[npy - i - 1];
+    }
+
+    Perf_AddSample(npy, s_name_ptrs + nnative, s_interval_pc);
+    prof_add_folded(nnative + npy, s_name_ptrs);
+    s_nsamples++;
+}
+
+static int prof_profilefunc(PyObject *obj, PyFrameObject *frame, int what, PyObject *arg)
+{
+    S_Prof_MaybeSample(frame);
+    return 0;
+}
+
+static void prof_clear_stacks(void)
+{
+    const char *key;
+    uint64_t count;
+    (void)count;
+
+    kh_foreach(s_stacks, key, count, {
+        free((char*)key);
+    });
+    kh_clear(stack, s_stacks);
+}
+
+static bool prof_write_folded(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if(!file)
+        return false;
+
+    const char *key;
+    uint64_t count;
+
+    kh_foreach(s_stacks, key, count, {
+        fprintf(file, "%s %llu\n", key, (unsigned long long)count);
+    });
+
+    bool ret = !ferror(file);
+    fclose(file);
+    return ret;
+}
+
+/* The profile hook is installed on the main thread's interpreter state 
+ * at the start of the tick, as the sampler may be started or stopped 
+ * from within a task, which runs with its' own thread state. 
+ */
+static void on_update_start(void *user, void *event)
+{
+    PyThreadState *ts = PyThreadState_Get();
+    if(ts != PyInterpreterState_ThreadHead(ts->interp))
+        return;
+
+    if(s_active && !s_hook_installed) {
+        PyEval_SetProfile(prof_profilefunc, NULL);
+        s_hook_installed = true;
+    }else if(!s_active && s_hook_installed) {
+        PyEval_SetProfile(NULL, NULL);
+        s_hook_installed = false;
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool S_Prof_Init(void)
+{
+    s_stacks = kh_init(stack);
+    if(!s_stacks)
+        return false;
+
+    SDL_AtomicSet(&s_sample_due, 0);
+    s_active = false;
+    s_hook_installed = false;
+    E_Global_Register(EVENT_UPDATE_START, on_update_start, NULL, G_ALL);
+    return true;
+}
+
+void S_Prof_Shutdown(void)
+{
+    E_Global_Unregister(EVENT_UPDATE_START, on_update_start);
+    if(s_timer) {
+        SDL_RemoveTimer(s_timer);
+        s_timer = 0;
+    }
+    s_active = false;
+    s_hook_installed = false;
+
+    prof_clear_stacks();
+    kh_destroy(stack, s_stacks);
+}
+
+bool S_Prof_Begin(unsigned interval_ms)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(s_active || interval_ms == 0)
+        return false;
+
+    s_interval_pc = SDL_GetPerformanceFrequency() * interval_ms / 1000;
+    s_nsamples = 0;
+    prof_clear_stacks();
+    SDL_AtomicSet(&s_sample_due, 0);
+
+    s_timer = SDL_AddTimer(interval_ms, prof_timer_callback, NULL);
+    if(!s_timer)
+        return false;
+
+    s_active = true;
+    return true;
+}
+
+bool S_Prof_End(const char *path, size_t *out_nsamples)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_active)
+        return false;
+
+    SDL_RemoveTimer(s_timer);
+    s_timer = 0;
+    s_active = false;
+    SDL_AtomicSet(&s_sample_due, 0);
+
+    bool ret = true;
+    if(path) {
+        ret = prof_write_folded(path);
+    }
+    prof_clear_stacks();
+
+    *out_nsamples = s_nsamples;
+    return ret;
+}
+
+bool S_Prof_Active(void)
+{
+    return s_active;
+}
+
+void S_Prof_MaybeSample(struct _frame *frame)
+{
+    if(!s_sample_due.value)
+        return;
+    if(!s_active)
+        return;
+    prof_sample(frame);
+}
+
@@ -0,0 +1,63 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2024 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef PY_PROF_H
+#define PY_PROF_H
+
+#include <Python.h> /* must be first */
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Sampling profiler for Python code. At a fixed interval, the frames of 
+ * whichever interpreter state is running on the main thread (the main
+ * one or that of a script task) are walked. The samples are merged into 
+ * the perf tree of the current frame, under the engine scope that was 
+ * active at the time of sampling, and aggregated into stack counts that
+ * can be written out in the 'folded' flame graph format.
+ */
+
+bool S_Prof_Init(void);
+void S_Prof_Shutdown(void);
+bool S_Prof_Begin(unsigned interval_ms);
+/* If 'path' is not NULL, the aggregated samples are written to it, one
+ * 'frame;frame;frame count' line per distinct callstack. */
+bool S_Prof_End(const char *path, size_t *out_nsamples);
+bool S_Prof_Active(void);
+/* Take a sample of the specified frame's callstack if one is due. Tasks 
+ * call this from their tracing hook. */
+void S_Prof_MaybeSample(struct _frame *frame);
+
+#endif
+
@@ -45,8 +45,14 @@
 #include "py_task.h"
 #include "py_region.h"
 #include "py_error.h"
+#include "py_prof.h"
+#include "py_gc.h"
+#include "py_math.h"
+#include "py_deferred.h"
+#include "py_bench.h"
 #include "public/script.h"
 #include "../entity.h"
+#include "../asset_load.h"
 #include "../game/public/game.h"
 #include "../render/public/render.h"
 #include "../render/public/render_ctrl.h"
@@ -56,9 +62,12 @@
 #include "../map/public/tile.h"
 #include "../phys/public/phys.h"
 #include "../lib/public/SDL_vec_rwops.h"
+#include "../lib/public/SDL_lz_rwops.h"
 #include "../lib/public/pf_string.h"
 #include "../lib/public/pf_nuklear.h"
 #include "../lib/public/mem.h"
+#include "../lib/public/stack_pool.h"
+#include "../lib/public/slab.h"
 #include "../event.h"
 #include "../config.h"
 #include "../scene.h"
@@ -67,6 +76,7 @@
 #include "../ui.h"
 #include "../session.h"
 #include "../perf.h"
+#include "../replay.h"
 #include "../cursor.h"
 #include "../task.h"
 #include "../sched.h"
@@ -94,6 +104,8 @@ static PyObject *PyPf_open_url(PyObject *self, PyObject *args);
 static PyObject *PyPf_register_event_handler(PyObject *self, PyObject *args);
 static PyObject *PyPf_register_ui_event_handler(PyObject *self, PyObject *args);
 static PyObject *PyPf_unregister_event_handler(PyObject *self, PyObject *args);
+static PyObject *PyPf_register_batched_event_handler(PyObject *self, PyObject *args);
+static PyObject *PyPf_unregister_batched_event_handler(PyObject *self, PyObject *args);
 static PyObject *PyPf_global_event(PyObject *self, PyObject *args);
 static PyObject *PyPf_get_ticks(PyObject *self);
 static PyObject *PyPf_ticks_delta(PyObject *self, PyObject *args);
@@ -104,11 +116,32 @@ static PyObject *PyPf_set_active_camera(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_prev_frame_ms(PyObject *self);
 static PyObject *PyPf_prev_frame_perfstats(PyObject *self);
+static PyObject *PyPf_prev_frame_counters(PyObject *self);
+static PyObject *PyPf_prev_frame_summary(PyObject *self);
+static PyObject *PyPf_prev_frame_budgets(PyObject *self);
+static PyObject *PyPf_set_perf_budget(PyObject *self, PyObject *args);
+static PyObject *PyPf_begin_perf_capture(PyObject *self, PyObject *args);
+static PyObject *PyPf_end_perf_capture(PyObject *self);
+static PyObject *PyPf_enable_spike_capture(PyObject *self, PyObject *args);
+static PyObject *PyPf_disable_spike_capture(PyObject *self);
+static PyObject *PyPf_begin_replay_record(PyObject *self, PyObject *args);
+static PyObject *PyPf_end_replay_record(PyObject *self);
+static PyObject *PyPf_play_replay(PyObject *self, PyObject *args);
+static PyObject *PyPf_begin_script_sampling(PyObject *self, PyObject *args);
+static PyObject *PyPf_end_script_sampling(PyObject *self, PyObject *args);
 static PyObject *PyPf_get_resolution(PyObject *self);
 static PyObject *PyPf_get_native_resolution(PyObject *self);
 static PyObject *PyPf_get_basedir(PyObject *self);
+static PyObject *PyPf_get_arg(PyObject *self, PyObject *args);
 static PyObject *PyPf_get_render_info(PyObject *self);
+static PyObject *PyPf_get_render_cmd_stats(PyObject *self);
 static PyObject *PyPf_get_nav_perfstats(PyObject *self);
+static PyObject *PyPf_get_load_perfstats(PyObject *self);
+static PyObject *PyPf_get_gc_perfstats(PyObject *self);
+static PyObject *PyPf_cook_texture(PyObject *self, PyObject *args);
+static PyObject *PyPf_get_stack_perfstats(PyObject *self);
+static PyObject *PyPf_get_slab_perfstats(PyObject *self);
+static PyObject *PyPf_get_mem_perfstats(PyObject *self);
 static PyObject *PyPf_get_mouse_pos(PyObject *self);
 static PyObject *PyPf_mouse_over_ui(PyObject *self);
 static PyObject *PyPf_ui_text_edit_has_focus(PyObject *self);
@@ -130,10 +163,11 @@ static PyObject *PyPf_enable_unit_selection(PyObject *self);
 static PyObject *PyPf_disable_unit_selection(PyObject *self);
 static PyObject *PyPf_clear_unit_selection(PyObject *self);
 static PyObject *PyPf_get_unit_selection(PyObject *self);
-static PyObject *PyPf_get_idle_units(PyObject *self);
+static PyObject *PyPf_get_idle_units(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_unit_selection(PyObject *self, PyObject *args);
 static PyObject *PyPf_get_hovered_unit(PyObject *self);
 static PyObject *PyPf_entities_for_tag(PyObject *self, PyObject *args);
+static PyObject *PyPf_spawn_batch(PyObject *self, PyObject *args, PyObject *kwargs);
 
 static PyObject *PyPf_hide_healthbars(PyObject *self);
 static PyObject *PyPf_show_healthbars(PyObject *self);
@@ -155,6 +189,8 @@ static PyObject *PyPf_get_diplomacy_state(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_get_tile(PyObject *self, PyObject *args);
 static PyObject *PyPf_update_tile(PyObject *self, PyObject *args);
+static PyObject *PyPf_begin_tile_edits(PyObject *self);
+static PyObject *PyPf_end_tile_edits(PyObject *self);
 static PyObject *PyPf_set_map_highlight_size(PyObject *self, PyObject *args);
 static PyObject *PyPf_get_minimap_position(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_minimap_position(PyObject *self, PyObject *args);
@@ -170,7 +206,9 @@ static PyObject *PyPf_map_height_at_point(PyObject *self, PyObject *args);
 static PyObject *PyPf_map_nearest_pathable(PyObject *self, PyObject *args, PyObject *kwargs);
 static PyObject *PyPf_map_nearest_pathable_water(PyObject *self, PyObject *args, PyObject *kwargs);
 static PyObject *PyPf_map_nearest_pathable_air(PyObject *self, PyObject *args, PyObject *kwargs);
+static PyObject *PyPf_map_preload_nav_layers(PyObject *self, PyObject *args, PyObject *kwargs);
 static PyObject *PyPf_map_pos_under_cursor(PyObject *self);
+static PyObject *PyPf_map_raycast_batch(PyObject *self, PyObject *args);
 static PyObject *PyPf_draw_text(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_storage_site_ui_style(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_storage_site_ui_border_color(PyObject *self, PyObject *args);
@@ -200,6 +238,8 @@ static PyObject *PyPf_settings_flush(PyObject *self);
 
 static PyObject *PyPf_get_simstate(PyObject *self);
 static PyObject *PyPf_set_simstate(PyObject *self, PyObject *args);
+static PyObject *PyPf_get_sim_speed(PyObject *self);
+static PyObject *PyPf_set_sim_speed(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_set_system_cursor(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_named_cursor(PyObject *self, PyObject *args);
@@ -226,6 +266,10 @@ static PyObject *PyPf_session_stack_depth(PyObject *self, PyObject *args);
 static PyObject *PyPf_nearest_ent(PyObject *self, PyObject *args, PyObject *kwargs);
 static PyObject *PyPf_ents_in_circle(PyObject *self, PyObject *args, PyObject *kwargs);
 static PyObject *PyPf_ents_in_rect(PyObject *self, PyObject *args, PyObject *kwargs);
+static PyObject *PyPf_ents_in_circle_packed(PyObject *self, PyObject *args, PyObject *kwargs);
+static PyObject *PyPf_ents_in_rect_packed(PyObject *self, PyObject *args, PyObject *kwargs);
+static PyObject *PyPf_pack_entity_attributes(PyObject *self, PyObject *args);
+static PyObject *PyPf_issue_orders(PyObject *self, PyObject *args, PyObject *kwargs);
 
 static PyObject *PyPf_play_music(PyObject *self, PyObject *args);
 static PyObject *PyPf_curr_music(PyObject *self);
@@ -288,6 +332,15 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_unregister_event_handler, METH_VARARGS,
     "Removes a script event handler added by 'register_event_handler'."},
 
+    {"register_batched_event_handler", 
+    (PyCFunction)PyPf_register_batched_event_handler, METH_VARARGS,
+    "Adds a script event handler to be called once per tick with a list of (uid, arg) tuples "
+    "holding all the occurrences of the specified entity event during that tick."},
+
+    {"unregister_batched_event_handler", 
+    (PyCFunction)PyPf_unregister_batched_event_handler, METH_VARARGS,
+    "Removes a script event handler added by 'register_batched_event_handler'."},
+
     {"global_event", 
     (PyCFunction)PyPf_global_event, METH_VARARGS,
     "Broadcast a global event so all handlers can get invoked. Any weakref argument is "
@@ -324,6 +377,70 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_prev_frame_perfstats, METH_NOARGS,
     "Get a dictionary of the performance data for the previous frame."},
 
+    {"prev_frame_counters", 
+    (PyCFunction)PyPf_prev_frame_counters, METH_NOARGS,
+    "Get a dictionary of the named performance counters for the previous frame."},
+
+    {"prev_frame_summary", 
+    (PyCFunction)PyPf_prev_frame_summary, METH_NOARGS,
+    "Get a dictionary breaking down the render thread's time for the previous frame and what the frame was bound by."},
+
+    {"prev_frame_budgets", 
+    (PyCFunction)PyPf_prev_frame_budgets, METH_NOARGS,
+    "Get a dictionary mapping every subsystem budget set with 'set_perf_budget' to a (measured_ms, budget_ms) "
+    "tuple for the same frame as 'prev_frame_perfstats'."},
+
+    {"set_perf_budget", 
+    (PyCFunction)PyPf_set_perf_budget, METH_VARARGS,
+    "Give the profiled scopes whose names start with the specified prefix (ex. 'G_Move') a per-frame time "
+    "budget in milliseconds, summed over all threads. An EVENT_PERF_BUDGET_EXCEEDED event with a "
+    "(prefix, measured_ms, budget_ms) argument is posted for every frame that goes over it. A budget "
+    "of 0 removes it. Budgets are only measured in debug builds."},
+
+    {"begin_perf_capture", 
+    (PyCFunction)PyPf_begin_perf_capture, METH_VARARGS,
+    "Write the performance data of the next N frames to the specified file in the Chrome trace event format."},
+
+    {"end_perf_capture", 
+    (PyCFunction)PyPf_end_perf_capture, METH_NOARGS,
+    "Finish the current performance capture, if there is one."},
+
+    {"enable_spike_capture", 
+    (PyCFunction)PyPf_enable_spike_capture, METH_VARARGS,
+    "Automatically write out the performance data of the last couple of seconds whenever a frame "
+    "takes more than the specified factor (2.0 by default) times the recent average."},
+
+    {"disable_spike_capture", 
+    (PyCFunction)PyPf_disable_spike_capture, METH_NOARGS,
+    "Stop the automatic captures started by 'enable_spike_capture'."},
+
+    {"begin_replay_record", 
+    (PyCFunction)PyPf_begin_replay_record, METH_VARARGS,
+    "Save the current session to '<path>.pfsave' and record the input of every following frame, "
+    "as well as the numbers returned by 'rand', to the specified replay file. The recording ends "
+    "with 'end_replay_record' or when the session changes."},
+
+    {"end_replay_record", 
+    (PyCFunction)PyPf_end_replay_record, METH_NOARGS,
+    "Finish the current replay recording, if there is one."},
+
+    {"play_replay", 
+    (PyCFunction)PyPf_play_replay, METH_VARARGS,
+    "Load the session saved alongside the specified replay file and feed back the recorded input, "
+    "writing the performance data of every played back frame to '<path>.json'. The real input "
+    "is ignored until the playback finishes."},
+
+    {"begin_script_sampling", 
+    (PyCFunction)PyPf_begin_script_sampling, METH_VARARGS,
+    "Start sampling the Python callstacks running on the main thread (including those of tasks) "
+    "every N milliseconds (1 by default). The samples show up in the performance tree returned "
+    "by 'prev_frame_perfstats'."},
+
+    {"end_script_sampling", 
+    (PyCFunction)PyPf_end_script_sampling, METH_VARARGS,
+    "Stop sampling the Python callstacks and optionally write the aggregated samples to the "
+    "specified file in the folded flame graph format. Returns the number of samples taken."},
+
     {"get_resolution", 
     (PyCFunction)PyPf_get_resolution, METH_NOARGS,
     "Get the currently set resolution of the game window."},
@@ -336,15 +453,56 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_get_basedir, METH_NOARGS,
     "Get the path to the top-level game resource folder (parent of 'assets')."},
 
+    {"get_arg", 
+    (PyCFunction)PyPf_get_arg, METH_VARARGS,
+    "Get the value of a '--name=value' command line argument, or None if it was not specified."},
+
     {"get_render_info", 
     (PyCFunction)PyPf_get_render_info, METH_NOARGS,
     "Returns a dictionary describing the renderer context. It will have the string keys "
     "'renderer', 'version', 'shading_language_version', and 'vendor'."},
 
+    {"get_render_cmd_stats", 
+    (PyCFunction)PyPf_get_render_cmd_stats, METH_NOARGS,
+    "Returns a dictionary holding the number of render commands recorded in the last frame, along "
+    "with the bytes taken up by the commands and by their arguments."},
+
     {"get_nav_perfstats", 
     (PyCFunction)PyPf_get_nav_perfstats, METH_NOARGS,
     "Returns a dictionary holding various performance couners for the navigation subsystem."},
 
+    {"get_load_perfstats", 
+    (PyCFunction)PyPf_get_load_perfstats, METH_NOARGS,
+    "Returns a dictionary holding the model and texture loading counters, as well as the "
+    "resulting critical path of asset loading, in milliseconds."},
+
+    {"get_gc_perfstats", 
+    (PyCFunction)PyPf_get_gc_perfstats, METH_NOARGS,
+    "Returns a dictionary holding the counts and timings of the engine-scheduled garbage "
+    "collections of each generation."},
+
+    {"cook_texture", 
+    (PyCFunction)PyPf_cook_texture, METH_VARARGS,
+    "Compress the image at the first path to BC1 (or BC3, if it has an alpha channel) along with "
+    "its' mips, and write it as a KTX2 file to the second path."},
+
+    {"get_stack_perfstats", 
+    (PyCFunction)PyPf_get_stack_perfstats, METH_NOARGS,
+    "Returns a list of dictionaries (one for each task stack size class) holding the "
+    "stack size, as well as the number of live, cached and mapped stacks, and the "
+    "high-water mark of simultaneously live stacks."},
+
+    {"get_slab_perfstats", 
+    (PyCFunction)PyPf_get_slab_perfstats, METH_NOARGS,
+    "Returns a list of dictionaries (one for each size class of the slab allocator, and a final one "
+    "with a block size of 0 for larger allocations) holding the block size, the number of slabs, "
+    "live and cached blocks, the high-water mark of blocks in use and the total number of allocations."},
+
+    {"get_mem_perfstats", 
+    (PyCFunction)PyPf_get_mem_perfstats, METH_NOARGS,
+    "Returns a list of dictionaries (one for each accounted subsystem) holding the subsystem name, "
+    "the number of bytes and blocks it currently has allocated and the high-water mark of the bytes."},
+
     {"get_mouse_pos", 
     (PyCFunction)PyPf_get_mouse_pos, METH_NOARGS,
     "Get the (x, y) cursor position on the screen."},
@@ -423,8 +581,8 @@ static PyMethodDef pf_module_methods[] = {
     "Returns a list of objects currently selected by the player."},
 
     {"get_idle_units", 
-    (PyCFunction)PyPf_get_idle_units, METH_NOARGS,
-    "Returns a list of currently idle units."},
+    (PyCFunction)PyPf_get_idle_units, METH_VARARGS,
+    "Returns a list of currently idle units. An optional faction ID limits the result to the faction's units."},
 
     {"set_unit_selection", 
     (PyCFunction)PyPf_set_unit_selection, METH_VARARGS,
@@ -438,6 +596,12 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_entities_for_tag, METH_VARARGS,
     "Get a tuple of entities that have the specific tag."},
 
+    {"spawn_batch", 
+    (PyCFunction)PyPf_spawn_batch, METH_VARARGS | METH_KEYWORDS,
+    "Construct one instance of the specified entity class at each of the specified positions. "
+    "The entity tables of all subsystems are grown once for the whole batch. Returns a list of "
+    "the new entities."},
+
     {"hide_healthbars", 
     (PyCFunction)PyPf_hide_healthbars, METH_NOARGS,
     "Disable rendering of healthbars. Overrides the user-configurable dynamic setting."},
@@ -513,6 +677,15 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_update_tile, METH_VARARGS,
     "Update the map tile at the specified coordinates to the new value."},
 
+    {"begin_tile_edits", 
+    (PyCFunction)PyPf_begin_tile_edits, METH_NOARGS,
+    "Open a tile edit transaction. The meshes of the tiles updated until the matching "
+    "'end_tile_edits' call are rebuilt only once, when the outermost transaction is closed."},
+
+    {"end_tile_edits", 
+    (PyCFunction)PyPf_end_tile_edits, METH_NOARGS,
+    "Close a tile edit transaction opened with 'begin_tile_edits'."},
+
     {"set_map_highlight_size", 
     (PyCFunction)PyPf_set_map_highlight_size, METH_VARARGS,
     "Determines how many tiles around the currently hovered tile are highlighted. (0 = none, "
@@ -577,11 +750,22 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_map_nearest_pathable_air, METH_VARARGS | METH_KEYWORDS,
     "Returns the closest XZ map position that is not currently blocked by other air units."},
 
+    {"map_preload_nav_layers",
+    (PyCFunction)PyPf_map_preload_nav_layers, METH_VARARGS | METH_KEYWORDS,
+    "Build the water and/or air navigation data of the current map right away, instead of "
+    "the first time that an entity which needs it is added."},
+
     {"map_pos_under_cursor",
     (PyCFunction)PyPf_map_pos_under_cursor, METH_NOARGS,
     "Returns the XYZ coordinate of the point of the map underneath the cursor. Returns 'None' if "
     "the cursor is not over the map."},
 
+    {"map_raycast_batch",
+    (PyCFunction)PyPf_map_raycast_batch, METH_VARARGS,
+    "Takes a list of (origin, direction, max_distance) tuples and returns a list holding, for each ray, "
+    "the XYZ coordinate of its first intersection with the map surface, or 'None' if the ray does not "
+    "hit the map within 'max_distance'."},
+
     {"set_move_on_left_click",
     (PyCFunction)PyPf_set_move_on_left_click, METH_NOARGS,
     "Set the cursor to target mode. The next left click will issue a move command to the location "
@@ -701,6 +885,14 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_set_simstate, METH_VARARGS,
     "Set the current simulation state."},
 
+    {"get_sim_speed",
+    (PyCFunction)PyPf_get_sim_speed, METH_NOARGS,
+    "Returns the current simulation speed multiplier."},
+
+    {"set_sim_speed",
+    (PyCFunction)PyPf_set_sim_speed, METH_VARARGS,
+    "Set the simulation speed multiplier (1 to 8)."},
+
     {"set_system_cursor",
     (PyCFunction)PyPf_set_system_cursor, METH_VARARGS,
     "Set a BMP for one of the cursors used by the engine core."},
@@ -728,7 +920,8 @@ static PyMethodDef pf_module_methods[] = {
 
     {"multiply_quaternions",
     (PyCFunction)PyPf_multiply_quaternions, METH_VARARGS,
-    "Returns the normalized result of multiplying 2 quaternions (specified as a list of 4 floats - XYZW order)."},
+    "Returns the normalized result of multiplying 2 quaternions (specified as a list of 4 floats - XYZW order - "
+    "or as pf.Quat objects). The result is a pf.Quat when both arguments are pf.Quat objects."},
 
     {"rand",
     (PyCFunction)PyPf_rand, METH_VARARGS,
@@ -746,7 +939,9 @@ static PyMethodDef pf_module_methods[] = {
     {"save_session",
     (PyCFunction)PyPf_save_session, METH_VARARGS,
     "Save the current state of the engine to the specified file. The session can then be loaded "
-    "from the file with the 'load_session' call."},
+    "from the file with the 'load_session' call. If the optional 'background' argument is True, "
+    "the file is written out on a separate thread. If the optional 'base' path is specified, only "
+    "the differences from that earlier full save are written out (always in the background)."},
 
     {"load_session",
     (PyCFunction)PyPf_load_session, METH_VARARGS,
@@ -792,6 +987,28 @@ static PyMethodDef pf_module_methods[] = {
     "the 'minimum' and 'maximum' corners. Takes an optional 'predicate' callable argument to "
     "filter the results."},
 
+    {"ents_in_circle_packed",
+    (PyCFunction)PyPf_ents_in_circle_packed, METH_VARARGS | METH_KEYWORDS,
+    "Same as 'ents_in_circle', but returns the attributes of the matching entities packed into "
+    "buffers (see 'pack_entity_attributes') instead of a list of entities."},
+
+    {"ents_in_rect_packed",
+    (PyCFunction)PyPf_ents_in_rect_packed, METH_VARARGS | METH_KEYWORDS,
+    "Same as 'ents_in_rect', but returns the attributes of the matching entities packed into "
+    "buffers (see 'pack_entity_attributes') instead of a list of entities."},
+
+    {"pack_entity_attributes",
+    (PyCFunction)PyPf_pack_entity_attributes, METH_VARARGS,
+    "Returns a dictionary of the 'uids', 'positions', 'faction_ids', 'hp' and 'flags' of the "
+    "specified sequence of entities, each packed into a bytearray of native 32-bit values."},
+
+    {"issue_orders",
+    (PyCFunction)PyPf_issue_orders, METH_VARARGS | METH_KEYWORDS,
+    "Issues an order (one of pf.ORDER_MOVE, pf.ORDER_ATTACK or pf.ORDER_STOP) to all the "
+    "specified entities at once. The entities can be given as a sequence of pf.Entity objects "
+    "or as a bytearray of packed 32-bit UIDs. The 'target' (X, Z) position is required for "
+    "the 'move' and 'attack' orders. Returns the number of entities that received the order."},
+
     {"play_music",
     (PyCFunction)PyPf_play_music, METH_VARARGS,
     "Set the specified audio track to loop in the background. The argument must be a name of a WAV file in the "
@@ -886,7 +1103,18 @@ static PyObject *PyPf_load_map(PyObject *self, PyObject *args, PyObject *kwargs)
     }
     pf_strlcat(pfmap_path, pfmap, sizeof(pfmap_path));
 
-    SDL_RWops *stream = SDL_RWFromFile(pfmap_path, "r");
+    SDL_RWops *stream = SDL_RWFromFile(pfmap_path, "rb");
+    if(stream && PFSDL_LZIsCompressed(stream)) {
+        SDL_RWops *decompressed = PFSDL_LZDecompressRWOps(stream);
+        if(!decompressed) {
+            SDL_RWclose(stream);
+        }
+        stream = decompressed;
+    }else if(stream) {
+        SDL_RWclose(stream);
+        stream = SDL_RWFromFile(pfmap_path, "r");
+    }
+
     if(!stream) {
         char errbuff[256];
         pf_snprintf(errbuff, sizeof(errbuff), "Unable to open PFMap file %s", pfmap_path);
@@ -1095,6 +1323,57 @@ static PyObject *PyPf_unregister_event_handler(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static PyObject *PyPf_register_batched_event_handler(PyObject *self, PyObject *args)
+{
+    enum eventtype event;
+    PyObject *callable, *user_arg;
+
+    if(!PyArg_ParseTuple(args, "iOO", &event, &callable, &user_arg)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must a tuple of an integer and two objects.");
+        return NULL;
+    }
+
+    if(!PyCallable_Check(callable)) {
+        PyErr_SetString(PyExc_TypeError, "Second argument must be callable.");
+        return NULL;
+    }
+
+    Py_INCREF(callable);
+    Py_INCREF(user_arg);
+
+    bool ret = E_Global_ScriptRegisterBatched(event, callable, user_arg, G_RUNNING);
+    if(!ret) {
+        Py_DECREF(callable);
+        Py_DECREF(user_arg);
+        PyErr_SetString(PyExc_RuntimeError, "Could not register batched handler for event.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_unregister_batched_event_handler(PyObject *self, PyObject *args)
+{
+    enum eventtype event;
+    PyObject *callable;
+
+    if(!PyArg_ParseTuple(args, "iO", &event, &callable)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must a tuple of an integer and one object.");
+        return NULL;
+    }
+
+    if(!PyCallable_Check(callable)) {
+        PyErr_SetString(PyExc_TypeError, "Second argument must be callable.");
+        return NULL;
+    }
+
+    bool ret = E_Global_ScriptUnregisterBatched(event, callable);
+    if(!ret) {
+        PyErr_SetString(PyExc_RuntimeError, "Could not unregister the specified event handler.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_global_event(PyObject *self, PyObject *args)
 {
     enum eventtype event;
@@ -1160,6 +1439,252 @@ static PyObject *PyPf_prev_frame_ms(PyObject *self)
     return Py_BuildValue("i", Perf_LastFrameMS());
 }
 
+static PyObject *PyPf_prev_frame_counters(PyObject *self)
+{
+    struct perf_counter counters[512];
+    size_t ncounters = Perf_ReportCounters(ARR_SIZE(counters), counters);
+
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < ncounters; i++) {
+
+        PyObject *value = PyLong_FromLongLong(counters[i].value);
+        if(!value)
+            goto fail;
+
+        int status = PyDict_SetItemString(ret, counters[i].name, value);
+        Py_DECREF(value);
+        if(0 != status)
+            goto fail;
+    }
+    return ret;
+
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+static PyObject *PyPf_prev_frame_summary(PyObject *self)
+{
+    static const char *bound_names[] = {
+        [PERF_BOUND_UNKNOWN] = "unknown",
+        [PERF_BOUND_MAIN]    = "main",
+        [PERF_BOUND_RENDER]  = "render",
+        [PERF_BOUND_GPU]     = "gpu",
+    };
+
+    struct perf_frame_stats stats;
+    Perf_ReportFrame(&stats);
+
+    return Py_BuildValue("{s:d, s:d, s:d, s:d, s:d, s:d, s:f, s:s}",
+        "frame_ms",             stats.frame_ms,
+        "render_busy_ms",       stats.render_busy_ms,
+        "render_idle_ms",       stats.render_idle_ms,
+        "render_stall_ms",      stats.render_stall_ms,
+        "render_swap_ms",       stats.render_swap_ms,
+        "gpu_ms",               stats.gpu_ms,
+        "render_utilization",   (double)stats.render_utilization,
+        "bound",                bound_names[stats.bound]);
+}
+
+static PyObject *PyPf_prev_frame_budgets(PyObject *self)
+{
+    struct perf_budget budgets[64];
+    size_t nbudgets = Perf_ReportBudgets(ARR_SIZE(budgets), budgets);
+
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < nbudgets; i++) {
+
+        PyObject *value = Py_BuildValue("(dd)", budgets[i].measured_ms, budgets[i].budget_ms);
+        if(!value)
+            goto fail;
+
+        int status = PyDict_SetItemString(ret, budgets[i].name, value);
+        Py_DECREF(value);
+        if(0 != status)
+            goto fail;
+    }
+    return ret;
+
+fail:
+    Py_DECREF(ret);
+    return NULL;
+}
+
+static PyObject *PyPf_set_perf_budget(PyObject *self, PyObject *args)
+{
+    const char *prefix;
+    double ms;
+
+    if(!PyArg_ParseTuple(args, "sd", &prefix, &ms)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting two arguments: prefix (string) and budget in milliseconds (float).");
+        return NULL;
+    }
+
+    if(ms < 0.0) {
+        PyErr_SetString(PyExc_ValueError, "The budget must not be negative.");
+        return NULL;
+    }
+
+    if(!Perf_SetBudget(prefix, ms)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to set the budget: too many budgets or the prefix is too long.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_begin_perf_capture(PyObject *self, PyObject *args)
+{
+    const char *path;
+    int nframes;
+
+    if(!PyArg_ParseTuple(args, "si", &path, &nframes)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting two arguments: path (string) and number of frames (integer).");
+        return NULL;
+    }
+
+    if(Perf_CaptureActive()) {
+        PyErr_SetString(PyExc_RuntimeError, "A performance capture is already in progress.");
+        return NULL;
+    }
+
+    if(!Perf_CaptureBegin(path, nframes)) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to begin the performance capture.");
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_end_perf_capture(PyObject *self)
+{
+    Perf_CaptureEnd();
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_enable_spike_capture(PyObject *self, PyObject *args)
+{
+    const char *prefix;
+    float factor = 2.0f;
+
+    if(!PyArg_ParseTuple(args, "s|f", &prefix, &factor)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one or two arguments: path prefix (string) and optional factor (float).");
+        return NULL;
+    }
+
+    if(factor <= 1.0f) {
+        PyErr_SetString(PyExc_ValueError, "The factor must be greater than 1.");
+        return NULL;
+    }
+
+    Perf_SpikeCaptureEnable(prefix, factor);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_disable_spike_capture(PyObject *self)
+{
+    Perf_SpikeCaptureDisable();
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_begin_replay_record(PyObject *self, PyObject *args)
+{
+    const char *path;
+
+    if(!PyArg_ParseTuple(args, "s", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one argument: path (string).");
+        return NULL;
+    }
+
+    if(!Replay_BeginRecord(path)) {
+        PyErr_SetString(PyExc_RuntimeError, "A replay is already being recorded or played back.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_end_replay_record(PyObject *self)
+{
+    Replay_EndRecord();
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_play_replay(PyObject *self, PyObject *args)
+{
+    const char *path;
+
+    if(!PyArg_ParseTuple(args, "s", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one argument: path (string).");
+        return NULL;
+    }
+
+    if(Replay_Recording() || Replay_Playing()) {
+        PyErr_SetString(PyExc_RuntimeError, "A replay is already being recorded or played back.");
+        return NULL;
+    }
+
+    if(!Replay_BeginPlayback(path)) {
+        PyErr_Format(PyExc_RuntimeError, "Failed to read the replay file: %s.", path);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_begin_script_sampling(PyObject *self, PyObject *args)
+{
+    int interval_ms = 1;
+
+    if(!PyArg_ParseTuple(args, "|i", &interval_ms)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting an optional argument: sampling interval in milliseconds (integer).");
+        return NULL;
+    }
+
+    if(interval_ms <= 0) {
+        PyErr_SetString(PyExc_ValueError, "The sampling interval must be positive.");
+        return NULL;
+    }
+
+    if(S_Prof_Active()) {
+        PyErr_SetString(PyExc_RuntimeError, "Script sampling is already in progress.");
+        return NULL;
+    }
+
+    if(!S_Prof_Begin(interval_ms)) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to begin script sampling.");
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_end_script_sampling(PyObject *self, PyObject *args)
+{
+    const char *path = NULL;
+
+    if(!PyArg_ParseTuple(args, "|z", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting an optional argument: output path (string or None).");
+        return NULL;
+    }
+
+    if(!S_Prof_Active()) {
+        PyErr_SetString(PyExc_RuntimeError, "Script sampling is not in progress.");
+        return NULL;
+    }
+
+    size_t nsamples;
+    if(!S_Prof_End(path, &nsamples)) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to write the script samples to the specified file.");
+        return NULL;
+    }
+
+    return PyInt_FromSize_t(nsamples);
+}
+
 static PyObject *PyPf_prev_frame_perfstats(PyObject *self)
 {
     struct perf_info *infos[16];
@@ -1276,6 +1801,21 @@ static PyObject *PyPf_get_basedir(PyObject *self)
     return Py_BuildValue("s", g_basepath);
 }
 
+static PyObject *PyPf_get_arg(PyObject *self, PyObject *args)
+{
+    const char *name;
+    char value[512];
+
+    if(!PyArg_ParseTuple(args, "s", &name)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one argument: name (string).");
+        return NULL;
+    }
+
+    if(!Engine_GetArg(name, sizeof(value), value))
+        Py_RETURN_NONE;
+    return PyString_FromString(value);
+}
+
 static PyObject *PyPf_get_render_info(PyObject *self)
 {
     PyObject *ret = PyDict_New();
@@ -1318,11 +1858,172 @@ static PyObject *PyPf_get_nav_perfstats(PyObject *self)
     rval |= PyDict_SetItemString(ret, "grid_path_used",     Py_BuildValue("i", stats.grid_path_used));
     rval |= PyDict_SetItemString(ret, "grid_path_max",      Py_BuildValue("i", stats.grid_path_max));
     rval |= PyDict_SetItemString(ret, "grid_path_hit_rate", Py_BuildValue("f", stats.grid_path_hit_rate));
+    rval |= PyDict_SetItemString(ret, "route_used",         Py_BuildValue("i", stats.route_used));
+    rval |= PyDict_SetItemString(ret, "route_max",          Py_BuildValue("i", stats.route_max));
+    rval |= PyDict_SetItemString(ret, "route_hit_rate",     Py_BuildValue("f", stats.route_hit_rate));
+    rval |= PyDict_SetItemString(ret, "route_invalidated",  Py_BuildValue("i", stats.route_invalidated));
+    rval |= PyDict_SetItemString(ret, "shards",             Py_BuildValue("i", stats.shards));
+    rval |= PyDict_SetItemString(ret, "resizes",            Py_BuildValue("i", stats.resizes));
+    rval |= PyDict_SetItemString(ret, "volatile_fields",    Py_BuildValue("i", stats.volatile_fields));
+    rval |= PyDict_SetItemString(ret, "volatile_refs",      Py_BuildValue("i", stats.volatile_refs));
     assert(0 == rval);
 
     return ret;
 }
 
+static PyObject *PyPf_get_render_cmd_stats(PyObject *self)
+{
+    PyObject *ret = PyDict_New();
+    if(!ret) {
+        return NULL;
+    }
+
+    struct rcmd_stats stats;
+    R_GetCmdStats(&stats);
+
+    int rval = 0;
+    rval |= PyDict_SetItemString(ret, "commands",   Py_BuildValue("K", (unsigned long long)stats.ncmds));
+    rval |= PyDict_SetItemString(ret, "cmd_bytes",  Py_BuildValue("K", (unsigned long long)stats.cmd_bytes));
+    rval |= PyDict_SetItemString(ret, "arg_bytes",  Py_BuildValue("K", (unsigned long long)stats.arg_bytes));
+    assert(0 == rval);
+
+    return ret;
+}
+
+static PyObject *PyPf_get_load_perfstats(PyObject *self)
+{
+    PyObject *ret = PyDict_New();
+    if(!ret) {
+        return NULL;
+    }
+
+    struct al_load_stats models;
+    AL_GetLoadStats(&models);
+
+    struct texture_load_stats textures;
+    R_TextureLoadGetStats(&textures);
+
+    /* Model loading and texture uploads are serial, while the texture 
+     * decoding is spread across the workers - only its wall time counts. */
+    double critical = models.parse_ms + models.map_ms 
+                    + textures.decode_ms + textures.upload_ms;
+
+    int rval = 0;
+    rval |= PyDict_SetItemString(ret, "models_parsed",          Py_BuildValue("K", (unsigned long long)models.nparsed));
+    rval |= PyDict_SetItemString(ret, "models_mapped",          Py_BuildValue("K", (unsigned long long)models.nmapped));
+    rval |= PyDict_SetItemString(ret, "models_shared",          Py_BuildValue("K", (unsigned long long)models.nshared));
+    rval |= PyDict_SetItemString(ret, "model_parse_ms",         Py_BuildValue("d", models.parse_ms));
+    rval |= PyDict_SetItemString(ret, "model_map_ms",           Py_BuildValue("d", models.map_ms));
+    rval |= PyDict_SetItemString(ret, "textures_decoded",       Py_BuildValue("K", (unsigned long long)textures.ndecoded));
+    rval |= PyDict_SetItemString(ret, "texture_bytes",          Py_BuildValue("K", (unsigned long long)textures.decode_bytes));
+    rval |= PyDict_SetItemString(ret, "texture_decode_ms",      Py_BuildValue("d", textures.decode_ms));
+    rval |= PyDict_SetItemString(ret, "texture_decode_cpu_ms",  Py_BuildValue("d", textures.decode_cpu_ms));
+    rval |= PyDict_SetItemString(ret, "texture_upload_ms",      Py_BuildValue("d", textures.upload_ms));
+    rval |= PyDict_SetItemString(ret, "critical_path_ms",       Py_BuildValue("d", critical));
+    assert(0 == rval);
+
+    return ret;
+}
+
+static PyObject *PyPf_get_gc_perfstats(PyObject *self)
+{
+    return S_GC_GetStats();
+}
+
+static PyObject *PyPf_cook_texture(PyObject *self, PyObject *args)
+{
+    const char *src, *dst;
+
+    if(!PyArg_ParseTuple(args, "ss", &src, &dst)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting two arguments: source path (string) and destination path (string).");
+        return NULL;
+    }
+
+    if(!R_TextureCook(src, dst)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to convert the specified image.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_get_stack_perfstats(PyObject *self)
+{
+    struct stack_pool_stats stats[SCHED_STACK_CLASS_COUNT];
+    size_t nclasses = Sched_GetStackStats(ARR_SIZE(stats), stats);
+
+    PyObject *ret = PyList_New(nclasses);
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < nclasses; i++) {
+
+        PyObject *dict = Py_BuildValue("{s:n, s:n, s:n, s:n, s:n}",
+            "stack_size",   (Py_ssize_t)stats[i].stack_size,
+            "live",         (Py_ssize_t)stats[i].nlive,
+            "cached",       (Py_ssize_t)stats[i].ncached,
+            "mapped",       (Py_ssize_t)stats[i].nmapped,
+            "high_water",   (Py_ssize_t)stats[i].high_water);
+        if(!dict) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyList_SET_ITEM(ret, i, dict);
+    }
+    return ret;
+}
+
+static PyObject *PyPf_get_slab_perfstats(PyObject *self)
+{
+    struct slab_stats stats[SLAB_NUM_CLASSES + 1];
+    size_t nclasses = slab_get_stats(ARR_SIZE(stats), stats);
+
+    PyObject *ret = PyList_New(nclasses);
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < nclasses; i++) {
+
+        PyObject *dict = Py_BuildValue("{s:n, s:n, s:n, s:n, s:n, s:n}",
+            "block_size",   (Py_ssize_t)stats[i].block_size,
+            "slabs",        (Py_ssize_t)stats[i].nslabs,
+            "live",         (Py_ssize_t)stats[i].nlive,
+            "cached",       (Py_ssize_t)stats[i].ncached,
+            "high_water",   (Py_ssize_t)stats[i].high_water,
+            "allocs",       (Py_ssize_t)stats[i].nallocs);
+        if(!dict) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyList_SET_ITEM(ret, i, dict);
+    }
+    return ret;
+}
+
+static PyObject *PyPf_get_mem_perfstats(PyObject *self)
+{
+    struct perf_mem_stats stats[PERF_MEM_TAG_COUNT];
+    size_t ntags = Perf_ReportMemory(ARR_SIZE(stats), stats);
+
+    PyObject *ret = PyList_New(ntags);
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < ntags; i++) {
+
+        PyObject *dict = Py_BuildValue("{s:s, s:L, s:L, s:L}",
+            "name",         stats[i].name,
+            "bytes",        (long long)stats[i].bytes,
+            "count",        (long long)stats[i].count,
+            "high_water",   (long long)stats[i].high_water);
+        if(!dict) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyList_SET_ITEM(ret, i, dict);
+    }
+    return ret;
+}
+
 static PyObject *PyPf_get_mouse_pos(PyObject *self)
 {
     int mouse_x, mouse_y;
@@ -1502,15 +2203,25 @@ static PyObject *PyPf_get_unit_selection(PyObject *self)
     return ret;
 }
 
-static PyObject *PyPf_get_idle_units(PyObject *self)
+static PyObject *PyPf_get_idle_units(PyObject *self, PyObject *args)
 {
+    int faction_id = -1;
+    if(!PyArg_ParseTuple(args, "|i", &faction_id)
+    || (faction_id < -1 || faction_id >= MAX_FACTIONS)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must a valid faction ID (integer).");
+        return NULL;
+    }
+
     PyObject *ret = PyList_New(0);
     if(!ret)
         return NULL;
 
     vec_entity_t idle;
     vec_entity_init(&idle);
-    G_Automation_GetIdle(&idle);
+    if(faction_id == -1)
+        G_Automation_GetIdle(&idle);
+    else
+        G_Automation_GetIdleForFaction(faction_id, &idle);
 
     for(int i = 0; i < vec_size(&idle); i++) {
         uint32_t uid = vec_AT(&idle, i);
@@ -1576,17 +2287,161 @@ static PyObject *PyPf_entities_for_tag(PyObject *self, PyObject *args)
     uint32_t uids[16384];
     size_t nents = Entity_EntsForTag(tag, ARR_SIZE(uids), uids);
 
-    PyObject *ret = PyTuple_New(nents);
-    if(!ret)
-        return NULL;
+    PyObject *ret = PyTuple_New(nents);
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < nents; i++) {
+        PyObject *ent = S_Entity_ObjForUID(uids[i]);
+        assert(ent);
+        Py_INCREF(ent);
+        PyTuple_SET_ITEM(ret, i, ent);
+    }
+    return ret;
+}
+
+static PyObject *spawn_one(PyTypeObject *type, PyObject *args, PyObject *kwargs, 
+                           PyObject *faction_id, vec3_t pos)
+{
+    PyObject *ret = NULL;
+
+    /* The position is only seen by the entity's __new__, which registers the 
+     * entity with the simulation directly at the right spot. The script-defined 
+     * __init__ methods don't know about the 'pos' keyword argument. */
+    PyObject *new_kwargs = kwargs ? PyDict_Copy(kwargs) : PyDict_New();
+    if(!new_kwargs)
+        goto fail_kwargs;
+
+    PyObject *pyvec = S_Math_Vec3New(pos);
+    if(!pyvec)
+        goto fail_pos;
+
+    int status = PyDict_SetItemString(new_kwargs, "pos", pyvec);
+    Py_DECREF(pyvec);
+    if(status != 0)
+        goto fail_pos;
+
+    ret = type->tp_new(type, args, new_kwargs);
+    if(!ret)
+        goto fail_pos;
+
+    if(!S_Entity_Check(ret)) {
+        PyErr_SetString(PyExc_TypeError, "Class must construct a pf.Entity instance.");
+        goto fail_init;
+    }
+
+    if(type->tp_init && type->tp_init(ret, args, kwargs) < 0)
+        goto fail_init;
+
+    if(faction_id && 0 != PyObject_SetAttrString(ret, "faction_id", faction_id))
+        goto fail_init;
+
+    Py_DECREF(new_kwargs);
+    return ret;
+
+fail_init:
+    Py_CLEAR(ret);
+fail_pos:
+    Py_DECREF(new_kwargs);
+fail_kwargs:
+    return NULL;
+}
+
+static PyObject *PyPf_spawn_batch(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"cls", "positions", "faction_id", "args", "kwargs", NULL};
+    PyTypeObject *type;
+    PyObject *positions;
+    PyObject *faction_id = NULL;
+    PyObject *ctor_args = NULL;
+    PyObject *ctor_kwargs = NULL;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O|OO!O!", kwlist, 
+        &PyType_Type, &type, &positions, &faction_id, &PyTuple_Type, &ctor_args, 
+        &PyDict_Type, &ctor_kwargs)) {
+        return NULL;
+    }
+
+    if(faction_id == Py_None)
+        faction_id = NULL;
+
+    /* The positions are either a sequence of pf.Vec3 objects or 3-tuples, or 
+     * a buffer of packed float32 XYZ triples. */
+    PyObject *seq = NULL;
+    const char *buff = NULL;
+    size_t npos;
+
+    if(PyList_Check(positions) || PyTuple_Check(positions)) {
+
+        seq = PySequence_Fast(positions, "");
+        if(!seq)
+            return NULL;
+        npos = PySequence_Fast_GET_SIZE(seq);
+    }else{
+
+        const void *raw;
+        Py_ssize_t len;
+        if(0 != PyObject_AsReadBuffer(positions, &raw, &len)) {
+            PyErr_SetString(PyExc_TypeError, 
+                "'positions' must be a list or tuple of pf.Vec3 objects, or a buffer of float32 XYZ triples.");
+            return NULL;
+        }
+        if(len % sizeof(vec3_t)) {
+            PyErr_Format(PyExc_ValueError, "Buffer size must be a multiple of %d bytes.", 
+                (int)sizeof(vec3_t));
+            return NULL;
+        }
+        buff = raw;
+        npos = len / sizeof(vec3_t);
+    }
+
+    if(!ctor_args) {
+        ctor_args = PyTuple_New(0);
+    }else{
+        Py_INCREF(ctor_args);
+    }
+    if(!ctor_args)
+        goto fail_args;
+
+    PyObject *ret = PyList_New(npos);
+    if(!ret)
+        goto fail_list;
+
+    if(!S_Entity_Reserve(npos)) {
+        PyErr_NoMemory();
+        goto fail_reserve;
+    }
+
+    for(size_t i = 0; i < npos; i++) {
 
-    for(int i = 0; i < nents; i++) {
-        PyObject *ent = S_Entity_ObjForUID(uids[i]);
-        assert(ent);
-        Py_INCREF(ent);
-        PyTuple_SET_ITEM(ret, i, ent);
+        vec3_t pos;
+        if(seq) {
+            if(!S_Math_Vec3FromObj(PySequence_Fast_GET_ITEM(seq, i), &pos)) {
+                PyErr_Format(PyExc_TypeError, 
+                    "Position %zu must be a tuple of 3 floats or a pf.Vec3.", i);
+                goto fail_reserve;
+            }
+        }else{
+            memcpy(pos.raw, buff + i * sizeof(vec3_t), sizeof(vec3_t));
+        }
+
+        PyObject *ent = spawn_one(type, ctor_args, ctor_kwargs, faction_id, pos);
+        if(!ent)
+            goto fail_reserve;
+        PyList_SET_ITEM(ret, i, ent);
     }
+
+    Py_DECREF(ctor_args);
+    Py_XDECREF(seq);
     return ret;
+
+fail_reserve:
+    Py_DECREF(ret);
+fail_list:
+    Py_DECREF(ctor_args);
+fail_args:
+    Py_XDECREF(seq);
+    return NULL;
 }
 
 static PyObject *PyPf_hide_healthbars(PyObject *self)
@@ -1901,6 +2756,18 @@ static PyObject *PyPf_update_tile(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static PyObject *PyPf_begin_tile_edits(PyObject *self)
+{
+    G_BeginTileEdits();
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_end_tile_edits(PyObject *self)
+{
+    G_EndTileEdits();
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_set_map_highlight_size(PyObject *self, PyObject *args)
 {
     int size;
@@ -2143,6 +3010,24 @@ static PyObject *PyPf_map_nearest_pathable_air(PyObject *self, PyObject *args, P
     }
 }
 
+static PyObject *PyPf_map_preload_nav_layers(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"water", "air", NULL};
+    int water = true, air = true;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|ii", kwlist, &water, &air)) {
+        PyErr_SetString(PyExc_TypeError, "Optional (bool) 'water' and 'air' arguments are allowed.");
+        return NULL;
+    }
+
+    if(!G_MapPreloadNavLayers(water, air)) {
+        PyErr_SetString(PyExc_RuntimeError, "Could not build the navigation layers "
+            "(there may be no map loaded).");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_map_pos_under_cursor(PyObject *self)
 {
     vec3_t pos;
@@ -2153,6 +3038,66 @@ static PyObject *PyPf_map_pos_under_cursor(PyObject *self)
     }
 }
 
+static PyObject *PyPf_map_raycast_batch(PyObject *self, PyObject *args)
+{
+    PyObject *rays;
+    if(!PyArg_ParseTuple(args, "O!", &PyList_Type, &rays)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a list of (origin, direction, max_distance) tuples.");
+        return NULL;
+    }
+
+    size_t nrays = PyList_GET_SIZE(rays);
+    vec3_t *origins = malloc(nrays * sizeof(vec3_t));
+    vec3_t *dirs = malloc(nrays * sizeof(vec3_t));
+    float *max_dists = malloc(nrays * sizeof(float));
+    struct map_ray_hit *hits = malloc(nrays * sizeof(struct map_ray_hit));
+    PyObject *ret = NULL;
+
+    if(nrays && (!origins || !dirs || !max_dists || !hits)) {
+        PyErr_NoMemory();
+        goto out;
+    }
+
+    for(size_t i = 0; i < nrays; i++) {
+        PyObject *ray = PyList_GET_ITEM(rays, i);
+        if(!PyTuple_Check(ray)
+        || !PyArg_ParseTuple(ray, "(fff)(fff)f",
+            &origins[i].x, &origins[i].y, &origins[i].z,
+            &dirs[i].x, &dirs[i].y, &dirs[i].z, &max_dists[i])) {
+            PyErr_SetString(PyExc_TypeError, "Each ray must be an (origin, direction, max_distance) tuple.");
+            goto out;
+        }
+    }
+
+    G_MapRaycastBatch(nrays, origins, dirs, max_dists, hits);
+
+    ret = PyList_New(nrays);
+    if(!ret)
+        goto out;
+
+    for(size_t i = 0; i < nrays; i++) {
+        PyObject *item;
+        if(hits[i].hit) {
+            item = Py_BuildValue("(fff)", hits[i].pos.x, hits[i].pos.y, hits[i].pos.z);
+        }else{
+            Py_INCREF(Py_None);
+            item = Py_None;
+        }
+        if(!item) {
+            Py_CLEAR(ret);
+            goto out;
+        }
+        PyList_SET_ITEM(ret, i, item);
+    }
+
+out:
+    free(origins);
+    free(dirs);
+    free(max_dists);
+    free(hits);
+    return ret;
+}
+
 static PyObject *PyPf_set_move_on_left_click(PyObject *self)
 {
     G_Move_SetMoveOnLeftClick();
@@ -2612,6 +3557,27 @@ static PyObject *PyPf_set_simstate(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static PyObject *PyPf_get_sim_speed(PyObject *self)
+{
+    return Py_BuildValue("i", G_Timer_GetSpeed());
+}
+
+static PyObject *PyPf_set_sim_speed(PyObject *self, PyObject *args)
+{
+    int speed;
+
+    if(!PyArg_ParseTuple(args, "i", &speed)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be an integer.");
+        return NULL;
+    }
+
+    if(!G_Timer_SetSpeed(speed)) {
+        PyErr_SetString(PyExc_ValueError, "Simulation speed must be between 1 and 8.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_set_system_cursor(PyObject *self, PyObject *args)
 {
     int type;
@@ -2705,25 +3671,18 @@ static PyObject *PyPf_multiply_quaternions(PyObject *self, PyObject *args)
     PyObject *q1_list, *q2_list;
     quat_t q1, q2, ret;
 
-    if(!PyArg_ParseTuple(args, "O!O!", &PyTuple_Type, &q1_list, &PyTuple_Type, &q2_list)) {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be two tuples.");
-        return NULL;
-    }
-
-    if(PyTuple_GET_SIZE(q1_list) != 4
-    || PyTuple_GET_SIZE(q2_list) != 4) {
-        PyErr_SetString(PyExc_TypeError, "The argument tuples must be of size 4.");
+    if(!PyArg_ParseTuple(args, "OO", &q1_list, &q2_list)
+    || !S_Math_QuatFromObj(q1_list, &q1)
+    || !S_Math_QuatFromObj(q2_list, &q2)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two tuples of 4 floats or pf.Quat objects.");
         return NULL;
     }
 
-    if(!PyArg_ParseTuple(q1_list, "ffff", &q1.raw[0], &q1.raw[1], &q1.raw[2], &q1.raw[3]))
-        return NULL;
-    if(!PyArg_ParseTuple(q2_list, "ffff", &q2.raw[0], &q2.raw[1], &q2.raw[2], &q2.raw[3]))
-        return NULL;
-
     PFM_Quat_MultQuat(&q1, &q2, &ret);
     PFM_Quat_Normal(&ret, &ret);
 
+    if(S_Math_QuatCheck(q1_list) && S_Math_QuatCheck(q2_list))
+        return S_Math_QuatNew(ret);
     return Py_BuildValue("(ffff)", ret.x, ret.y, ret.z, ret.w);
 }
 
@@ -2734,7 +3693,7 @@ static PyObject *PyPf_rand(PyObject *self, PyObject *args)
         PyErr_SetString(PyExc_TypeError, "Argument must be a single integer.");
         return NULL;
     }
-    int raw = rand();
+    int raw = Replay_Rand(rand());
     int ret = ((float)raw) / RAND_MAX * max;
     assert(ret >= 0 && ret <= max);
     return PyInt_FromLong(ret);
@@ -2796,12 +3755,21 @@ static PyObject *PyPf_unpickle_object(PyObject *self, PyObject *args)
 static PyObject *PyPf_save_session(PyObject *self, PyObject *args)
 {
     const char *str;
-    if(!PyArg_ParseTuple(args, "s", &str)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a string (path of the file to save the session to).");
+    const char *base = NULL;
+    int background = false;
+    if(!PyArg_ParseTuple(args, "s|iz", &str, &background, &base)) {
+        PyErr_SetString(PyExc_TypeError, "Expecting one to three arguments: path of the file to save the session to (string), "
+            "(optional) background flag (bool) and (optional) path of the base session for a delta save (string or None).");
         return NULL;
     }
 
-    Session_RequestSave(str);
+    if(base) {
+        Session_RequestSaveDelta(str, base);
+    }else if(background) {
+        Session_RequestSaveAsync(str);
+    }else{
+        Session_RequestSave(str);
+    }
     Py_RETURN_NONE;
 }
 
@@ -3227,6 +4195,322 @@ static PyObject *PyPf_ents_in_rect(PyObject *self, PyObject *args, PyObject *kwa
     return ret;
 }
 
+static PyObject *s_packed_attrs(const uint32_t *uids, size_t nents)
+{
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    PyObject *uid_buff = PyByteArray_FromStringAndSize(NULL, nents * sizeof(uint32_t));
+    PyObject *pos_buff = PyByteArray_FromStringAndSize(NULL, nents * sizeof(float[3]));
+    PyObject *fac_buff = PyByteArray_FromStringAndSize(NULL, nents * sizeof(int32_t));
+    PyObject *hp_buff = PyByteArray_FromStringAndSize(NULL, nents * sizeof(int32_t));
+    PyObject *flags_buff = PyByteArray_FromStringAndSize(NULL, nents * sizeof(uint32_t));
+
+    if(!uid_buff || !pos_buff || !fac_buff || !hp_buff || !flags_buff)
+        goto fail;
+
+    uint32_t *uid_out = (uint32_t*)PyByteArray_AS_STRING(uid_buff);
+    float *pos_out = (float*)PyByteArray_AS_STRING(pos_buff);
+    int32_t *fac_out = (int32_t*)PyByteArray_AS_STRING(fac_buff);
+    int32_t *hp_out = (int32_t*)PyByteArray_AS_STRING(hp_buff);
+    uint32_t *flags_out = (uint32_t*)PyByteArray_AS_STRING(flags_buff);
+
+    for(int i = 0; i < nents; i++) {
+
+        uint32_t uid = uids[i];
+        uint32_t flags = G_FlagsGet(uid);
+        vec3_t pos = G_Pos_Get(uid);
+
+        uid_out[i] = uid;
+        pos_out[i * 3 + 0] = pos.x;
+        pos_out[i * 3 + 1] = pos.y;
+        pos_out[i * 3 + 2] = pos.z;
+        fac_out[i] = G_GetFactionID(uid);
+        hp_out[i] = ((flags & ENTITY_FLAG_COMBATABLE) && !(flags & ENTITY_FLAG_ZOMBIE)) 
+                  ? G_Combat_GetCurrentHP(uid) : 0;
+        flags_out[i] = flags;
+    }
+
+    if(0 != PyDict_SetItemString(ret, "uids", uid_buff)
+    || 0 != PyDict_SetItemString(ret, "positions", pos_buff)
+    || 0 != PyDict_SetItemString(ret, "faction_ids", fac_buff)
+    || 0 != PyDict_SetItemString(ret, "hp", hp_buff)
+    || 0 != PyDict_SetItemString(ret, "flags", flags_buff))
+        goto fail;
+
+    Py_DECREF(uid_buff);
+    Py_DECREF(pos_buff);
+    Py_DECREF(fac_buff);
+    Py_DECREF(hp_buff);
+    Py_DECREF(flags_buff);
+    return ret;
+
+fail:
+    Py_XDECREF(uid_buff);
+    Py_XDECREF(pos_buff);
+    Py_XDECREF(fac_buff);
+    Py_XDECREF(hp_buff);
+    Py_XDECREF(flags_buff);
+    Py_DECREF(ret);
+    return NULL;
+}
+
+/* Only the entities with a script object are returned by the list-based 
+ * queries, so they are filtered the same way here. */
+static size_t s_filter_scripted(uint32_t *inout, size_t nents)
+{
+    size_t ret = 0;
+    for(int i = 0; i < nents; i++) {
+        if(!S_Entity_ObjForUID(inout[i]))
+            continue;
+        inout[ret++] = inout[i];
+    }
+    return ret;
+}
+
+static PyObject *PyPf_ents_in_circle_packed(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    assert(Sched_UsingBigStack());
+
+    static char *kwlist[] = {"position", "radius", "predicate", NULL};
+    float radius;
+    vec2_t xz_pos;
+    PyObject *predicate = NULL;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "(ff)f|O", kwlist, &xz_pos.x, &xz_pos.z, &radius, &predicate)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an (X, Z) float tuple, a float and "
+            "an optional callable object.");
+        return NULL;
+    }
+
+    if(predicate && !PyCallable_Check(predicate)) {
+        PyErr_SetString(PyExc_TypeError, "'predicate' argument must be callable.");
+        return NULL;
+    }
+
+    uint32_t inside[16384];
+    size_t ninside;
+
+    if(predicate) {
+        ninside = G_Pos_EntsInCircleWithPred(xz_pos, radius, inside, ARR_SIZE(inside),
+            s_pred_callable, predicate);
+    }else{
+        ninside = G_Pos_EntsInCircleWithPred(xz_pos, radius, inside, ARR_SIZE(inside),
+            s_pred_any, NULL);
+    }
+
+    ninside = s_filter_scripted(inside, ninside);
+    return s_packed_attrs(inside, ninside);
+}
+
+static PyObject *PyPf_ents_in_rect_packed(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    assert(Sched_UsingBigStack());
+
+    static char *kwlist[] = {"minimum", "maximum", "predicate", NULL};
+    vec2_t xz_min, xz_max;
+    PyObject *predicate = NULL;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "(ff)(ff)|O", kwlist, &xz_min.x, &xz_min.z, 
+        &xz_max.x, &xz_max.z, &predicate)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two (X, Z) float tuples, and an "
+            "optional callable object.");
+        return NULL;
+    }
+
+    if(predicate && !PyCallable_Check(predicate)) {
+        PyErr_SetString(PyExc_TypeError, "'predicate' argument must be callable.");
+        return NULL;
+    }
+
+    uint32_t inside[16384];
+    size_t ninside;
+
+    if(predicate) {
+        ninside = G_Pos_EntsInRectWithPred(xz_min, xz_max, inside, ARR_SIZE(inside),
+            s_pred_callable, predicate);
+    }else{
+        ninside = G_Pos_EntsInRectWithPred(xz_min, xz_max, inside, ARR_SIZE(inside),
+            s_pred_any, NULL);
+    }
+
+    ninside = s_filter_scripted(inside, ninside);
+    return s_packed_attrs(inside, ninside);
+}
+
+static PyObject *PyPf_pack_entity_attributes(PyObject *self, PyObject *args)
+{
+    PyObject *ents;
+    if(!PyArg_ParseTuple(args, "O", &ents)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a sequence of pf.Entity objects.");
+        return NULL;
+    }
+
+    PyObject *seq = PySequence_Fast(ents, "Argument must be a sequence of pf.Entity objects.");
+    if(!seq)
+        return NULL;
+
+    PyObject *ret = NULL;
+    size_t nents = PySequence_Fast_GET_SIZE(seq);
+    uint32_t *uids = malloc((nents ? nents : 1) * sizeof(uint32_t));
+    if(!uids) {
+        PyErr_NoMemory();
+        goto fail_alloc;
+    }
+
+    for(int i = 0; i < nents; i++) {
+
+        PyObject *curr = PySequence_Fast_GET_ITEM(seq, i);
+        if(!S_Entity_UIDForObj(curr, &uids[i])) {
+            PyErr_SetString(PyExc_TypeError, "Argument must be a sequence of pf.Entity objects.");
+            goto fail_ent;
+        }
+    }
+    ret = s_packed_attrs(uids, nents);
+
+fail_ent:
+    free(uids);
+fail_alloc:
+    Py_DECREF(seq);
+    return ret;
+}
+
+/* Accepts either a sequence of entity objects or a bytearray of packed 
+ * UIDs (such as the one returned by 'pack_entity_attributes'). The 
+ * returned array must be freed by the caller. */
+static uint32_t *s_uids_from_obj(PyObject *ents, size_t *out_nents)
+{
+    if(PyByteArray_Check(ents)) {
+
+        size_t size = PyByteArray_GET_SIZE(ents);
+        if(size % sizeof(uint32_t)) {
+            PyErr_SetString(PyExc_ValueError, "Size of UID buffer must be a multiple of 4 bytes.");
+            return NULL;
+        }
+        uint32_t *ret = malloc(size ? size : 1);
+        if(!ret) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        memcpy(ret, PyByteArray_AS_STRING(ents), size);
+        *out_nents = size / sizeof(uint32_t);
+        return ret;
+    }
+
+    PyObject *seq = PySequence_Fast(ents, "Argument must be a sequence of pf.Entity objects "
+        "or a bytearray of UIDs.");
+    if(!seq)
+        return NULL;
+
+    size_t nents = PySequence_Fast_GET_SIZE(seq);
+    uint32_t *ret = malloc((nents ? nents : 1) * sizeof(uint32_t));
+    if(!ret) {
+        PyErr_NoMemory();
+        goto fail_alloc;
+    }
+
+    for(int i = 0; i < nents; i++) {
+
+        PyObject *curr = PySequence_Fast_GET_ITEM(seq, i);
+        if(!S_Entity_UIDForObj(curr, &ret[i])) {
+            PyErr_SetString(PyExc_TypeError, "Argument must be a sequence of pf.Entity objects "
+                "or a bytearray of UIDs.");
+            goto fail_ent;
+        }
+    }
+
+    Py_DECREF(seq);
+    *out_nents = nents;
+    return ret;
+
+fail_ent:
+    free(ret);
+fail_alloc:
+    Py_DECREF(seq);
+    return NULL;
+}
+
+static PyObject *PyPf_issue_orders(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"entities", "order", "target", NULL};
+    PyObject *ents;
+    int order;
+    PyObject *target = NULL;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|O", kwlist, &ents, &order, &target)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a sequence of entities, an order "
+            "constant and an optional (X, Z) target tuple.");
+        return NULL;
+    }
+
+    if(order != ORDER_MOVE && order != ORDER_ATTACK && order != ORDER_STOP) {
+        PyErr_SetString(PyExc_ValueError, "'order' argument must be one of pf.ORDER_MOVE, "
+            "pf.ORDER_ATTACK or pf.ORDER_STOP.");
+        return NULL;
+    }
+
+    vec2_t xz_pos = (vec2_t){0.0f, 0.0f};
+    if(order != ORDER_STOP) {
+
+        if(!target || !PyArg_ParseTuple(target, "ff", &xz_pos.x, &xz_pos.z)) {
+            PyErr_SetString(PyExc_TypeError, "'target' argument must be a tuple of 2 floats.");
+            return NULL;
+        }
+        if(!G_PointInsideMap(xz_pos)) {
+            PyErr_SetString(PyExc_RuntimeError, "The movement point must be within the map bounds.");
+            return NULL;
+        }
+    }
+
+    size_t nents;
+    uint32_t *uids = s_uids_from_obj(ents, &nents);
+    if(!uids)
+        return NULL;
+
+    /* Entities which are not able to carry out the order are skipped. The 
+     * movable ones are compacted to the front of the array and handed off 
+     * to the movement subsystem as a single command. */
+    size_t nissued = 0, nmove = 0;
+    for(int i = 0; i < nents; i++) {
+
+        uint32_t uid = uids[i];
+        if(!G_EntityExists(uid))
+            continue;
+
+        uint32_t flags = G_FlagsGet(uid);
+        if(flags & ENTITY_FLAG_ZOMBIE)
+            continue;
+
+        switch(order) {
+        case ORDER_MOVE:
+            if(!(flags & ENTITY_FLAG_MOVABLE))
+                continue;
+            uids[nmove++] = uid;
+            break;
+        case ORDER_ATTACK:
+            if(!(flags & ENTITY_FLAG_COMBATABLE))
+                continue;
+            G_Combat_SetStance(uid, COMBAT_STANCE_AGGRESSIVE);
+            if(flags & ENTITY_FLAG_MOVABLE) {
+                uids[nmove++] = uid;
+            }
+            break;
+        case ORDER_STOP:
+            G_StopEntity(uid, true, true);
+            break;
+        }
+        nissued++;
+    }
+
+    if(nmove) {
+        G_Move_SetDestBatch(uids, nmove, xz_pos, order == ORDER_ATTACK);
+    }
+
+    free(uids);
+    return PyInt_FromLong(nissued);
+}
+
 static PyObject *PyPf_play_music(PyObject *self, PyObject *args)
 {
     const char *name;
@@ -3505,6 +4789,8 @@ PyMODINIT_FUNC initpf(void)
     S_Camera_PyRegister(module);
     S_Task_PyRegister(module);
     S_Region_PyRegister(module);
+    S_Math_PyRegister(module);
+    S_Deferred_PyRegister(module);
     S_Constants_Expose(module); 
 }
 
@@ -3520,12 +4806,16 @@ bool S_Init(const char *progname, const char *base_path, struct nk_context *ctx)
     Py_SetPythonHome(script_dir); /* caches passed in pointer */
     Py_InitializeEx(0);
 
+    if(!S_GC_Init())
+        return false;
     if(!S_UI_Init(ctx))
         return false;
     if(!S_Entity_Init())
         return false;
     if(!S_Task_Init())
         return false;
+    if(!S_Prof_Init())
+        return false;
     if(!S_Region_Init())
         return false;
 
@@ -3537,6 +4827,7 @@ bool S_Init(const char *progname, const char *base_path, struct nk_context *ctx)
         return false;
 
     initpf();
+    S_Bench_PyRegister();
 
     if(!S_Camera_Init())
         return false;
@@ -3566,6 +4857,7 @@ void S_Shutdown(void)
     S_Region_Clear();
     S_Task_Clear();
     S_Entity_Clear();
+    S_GC_Shutdown();
 
     Py_Finalize();
 
@@ -3574,6 +4866,7 @@ void S_Shutdown(void)
     S_Pickle_Shutdown();
     S_Camera_Shutdown();
     S_Region_Shutdown();
+    S_Prof_Shutdown();
     S_Task_Shutdown();
     S_Entity_Shutdown();
     S_UI_Shutdown();
@@ -3789,11 +5082,36 @@ script_opaque_t S_WrapEngineEventArg(int eventnum, void *arg)
     case EVENT_EXITED_REGION: {
         return PyString_FromString(arg);
     }
+    case EVENT_PERF_BUDGET_EXCEEDED: {
+        struct perf_budget *budget = arg;
+        return Py_BuildValue("sdd", budget->name, budget->measured_ms, budget->budget_ms);
+    }
     default:
         Py_RETURN_NONE;
     }
 }
 
+script_opaque_t S_PackEventBatch(size_t nevents, const uint32_t *uids, 
+                                 const script_opaque_t *args)
+{
+    PyObject *ret = PyList_New(nevents);
+    if(!ret) {
+        S_ShowLastError();
+        return NULL;
+    }
+
+    for(int i = 0; i < nevents; i++) {
+        PyObject *tuple = Py_BuildValue("(IO)", uids[i], (PyObject*)args[i]);
+        if(!tuple) {
+            S_ShowLastError();
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyList_SET_ITEM(ret, i, tuple);
+    }
+    return ret;
+}
+
 script_opaque_t S_UnwrapIfWeakref(script_opaque_t arg)
 {
     assert(arg);
@@ -3820,12 +5138,12 @@ void S_ClearState(void)
 {
     S_Shutdown();
     S_Init(s_progname, g_basepath, UI_GetContext());
-    PyGC_Collect(); /* quick sanity check */
+    S_GC_CollectFull(); /* quick sanity check */
 }
 
 bool S_SaveState(SDL_RWops *stream)
 {
-    PyGC_Collect();
+    S_GC_CollectFull();
 
     PyObject *modules_dict = PySys_GetObject("modules"); /* borrowed */
     assert(modules_dict);
@@ -3842,8 +5160,9 @@ bool S_SaveState(SDL_RWops *stream)
         goto fail_tuple;
 
     for(int i = 0; i < nhandlers; i++) {
-        PyObject *val = Py_BuildValue("lllOO", handlers[i].event, handlers[i].id, 
-            handlers[i].simmask, (PyObject*)handlers[i].handler, (PyObject*)handlers[i].arg);
+        PyObject *val = Py_BuildValue("lllOOi", handlers[i].event, handlers[i].id, 
+            handlers[i].simmask, (PyObject*)handlers[i].handler, (PyObject*)handlers[i].arg,
+            handlers[i].batched);
         if(!val)
             goto fail_handlers;
         PyTuple_SET_ITEM(saved_handlers, i, val);
@@ -3852,6 +5171,7 @@ bool S_SaveState(SDL_RWops *stream)
     PyInterpreterState *interp = PyThreadState_Get()->interp;
     assert(interp);
 
+    S_Task_FinishSlices();
     PyObject *tasks = S_Task_GetAll();
     if(!tasks)
         goto fail_tasks;
@@ -3922,7 +5242,9 @@ bool S_LoadState(SDL_RWops *stream)
     for(int i = 0; i < PyTuple_GET_SIZE(handlers); i++) {
 
         PyObject *entry = PyTuple_GET_ITEM(handlers, i);
-        if(!PyTuple_Check(entry) || PyTuple_GET_SIZE(entry) != 5)
+        /* Sessions saved before batched handlers were added have no 'batched' field */
+        if(!PyTuple_Check(entry) 
+        || (PyTuple_GET_SIZE(entry) != 5 && PyTuple_GET_SIZE(entry) != 6))
             goto fail;
 
         PyObject *event = PyTuple_GET_ITEM(entry, 0);
@@ -3930,11 +5252,13 @@ bool S_LoadState(SDL_RWops *stream)
         PyObject *simmask = PyTuple_GET_ITEM(entry, 2);
         PyObject *handler = PyTuple_GET_ITEM(entry, 3);
         PyObject *arg = PyTuple_GET_ITEM(entry, 4);
+        PyObject *batched = (PyTuple_GET_SIZE(entry) == 6) ? PyTuple_GET_ITEM(entry, 5) : Py_False;
 
         if(!PyInt_Check(event)
         || !PyInt_Check(uid)
         || !PyInt_Check(simmask)
-        || !PyCallable_Check(handler))
+        || !PyCallable_Check(handler)
+        || !PyInt_Check(batched))
             goto fail;
 
         int ievent = PyInt_AS_LONG(event);
@@ -3944,7 +5268,9 @@ bool S_LoadState(SDL_RWops *stream)
         Py_INCREF(handler);
         Py_INCREF(arg);
 
-        if(iuid == ~((uint32_t)0)) {
+        if(PyInt_AS_LONG(batched)) {
+            E_Global_ScriptRegisterBatched(ievent, handler, arg, isimmask);
+        }else if(iuid == ~((uint32_t)0)) {
             E_Global_ScriptRegister(ievent, handler, arg, isimmask);
         }else{
             E_Entity_ScriptRegister(ievent, iuid, handler, arg, isimmask);
@@ -3963,6 +5289,8 @@ bool S_LoadState(SDL_RWops *stream)
 
 fail:
     Py_DECREF(state);
+    /* The previous session's objects are garbage now */
+    S_GC_CollectFull();
     return ret;
 } 
 
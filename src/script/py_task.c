@@ -39,24 +39,37 @@
 
 #include "py_task.h"
 #include "py_pickle.h"
+#include "py_prof.h"
 #include "public/script.h"
 #include "../task.h"
 #include "../sched.h"
 #include "../main.h"
 #include "../event.h"
 #include "../perf.h"
+#include "../config.h"
 #include "../game/public/game.h"
 #include "../lib/public/khash.h"
 #include "../lib/public/SDL_vec_rwops.h"
 #include "../lib/public/pf_string.h"
 #include "../lib/public/mem.h"
 
+#include <SDL.h>
+
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 #define CALL_FLAG_VAR   1
 #define CALL_FLAG_KW    2
+/* Upper bound on the number of released thread states that are kept 
+ * around to be handed out to newly created tasks. */
+#define TS_POOL_MAX     (256)
+/* The number of opcodes executed between checks of the time slice */
+#define SLICE_CHECK_OPS (128)
+
+#define STACK_FLAG_SMALL    (1 << 0)
+#define STACK_FLAG_MICRO    (1 << 1)
 
 #define CHK_TRUE(_pred, _label)         \
     do{                                 \
@@ -77,6 +90,7 @@ struct pyrequest{
         PYREQ_SLEEP,
         PYREQ_REGISTER,
         PYREQ_WHOIS,
+        PYREQ_RECEIVE_BATCH,
     }type;
 };
 
@@ -97,8 +111,25 @@ typedef struct {
     size_t stack_depth;
     PyThreadState *ts;
     const char *regname;
+    /* The running simulation time that had already elapsed of the current 
+     * sleep when the task was restored, and the 's_running_ms' value when 
+     * it last went to sleep. */
     uint32_t sleep_elapsed;
+    uint32_t sleep_start;
     bool small_stack;
+    /* Microtasks never receive messages, so they don't need a mailbox 
+     * or the deep stack of a general-purpose task. */
+    bool micro;
+    /* The running time of the task during the frame 'slice_frame', in 
+     * performance counter ticks, not counting the time since it was last 
+     * resumed at 'slice_begin'. */
+    unsigned long slice_frame;
+    uint64_t slice_used;
+    uint64_t slice_begin;
+    unsigned slice_ops;
+    /* Set while the task is suspended in the middle of its bytecode, after 
+     * having used up its time slice */
+    bool preempted;
 }PyTaskObject;
 
 KHASH_MAP_INIT_INT(task, PyTaskObject*)
@@ -121,6 +152,7 @@ static PyObject *PyTask_wait(PyTaskObject *self, PyObject *args);
 static PyObject *PyTask_yield(PyTaskObject *self);
 static PyObject *PyTask_send(PyTaskObject *self, PyObject *args);
 static PyObject *PyTask_receive(PyTaskObject *self);
+static PyObject *PyTask_receive_batch(PyTaskObject *self, PyObject *args);
 static PyObject *PyTask_reply(PyTaskObject *self, PyObject *args);
 static PyObject *PyTask_await_event(PyTaskObject *self, PyObject *args);
 static PyObject *PyTask_sleep(PyTaskObject *self, PyObject *args);
@@ -129,6 +161,9 @@ static PyObject *PyTask_who_is(PyTaskObject *self, PyObject *args, PyObject *kwa
 
 static PyObject *PyTask_get_completed(PyTaskObject *self, void *closure);
 
+static void      pytask_push_ctx(PyTaskObject *self);
+static void      pytask_pop_ctx(PyTaskObject *self);
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -173,6 +208,12 @@ static PyMethodDef PyTask_methods[] = {
     (PyCFunction)PyTask_receive, METH_NOARGS,
     "Become blocked, waiting until a message is received from the specified task."},
 
+    {"receive_batch", 
+    (PyCFunction)PyTask_receive_batch, METH_VARARGS,
+    "Become blocked until at least one message is received and then return a list of up to "
+    "the specified number (default: 64) of (sender, message) tuples, all of which must be "
+    "replied to. This takes a single context switch for the whole batch."},
+
     {"reply", 
     (PyCFunction)PyTask_reply, METH_VARARGS,
     "Respond to a sent message from another task, unblocking it."},
@@ -217,7 +258,9 @@ PyTypeObject PyTask_type = {
     0,                         /* tp_setattro */
     0,                         /* tp_as_buffer */
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-    "Permafrost Engine runnable task.", /* tp_doc */
+    "Permafrost Engine runnable task. Passing 'micro=True' to the constructor creates a "
+    "lightweight microtask which runs on a smaller stack but may not 'register', 'receive' "
+    "or 'receive_batch'.", /* tp_doc */
     0,                         /* tp_traverse */
     0,                         /* tp_clear */
     0,                         /* tp_richcompare */
@@ -239,17 +282,40 @@ PyTypeObject PyTask_type = {
 
 static PyThreadState *s_main_thread_state;
 static khash_t(task) *s_tid_task_map;
+/* Milliseconds of simulation time that have passed while it was running */
+static uint32_t       s_running_ms = 0;
 static uint32_t       s_pause_tick;
+/* Thread states of deallocated tasks, already cleared */
+static PyThreadState *s_ts_pool[TS_POOL_MAX];
+static size_t         s_ts_pool_size = 0;
+/* Sub-microsecond remainders of the timed task operations, in 
+ * performance counter ticks scaled by 1000000 */
+static uint64_t       s_create_carry = 0;
+static uint64_t       s_switch_carry = 0;
+/* Counter IDs of the timed task operations */
+static int            s_create_us_id = -1;
+static int            s_switch_us_id = -1;
+/* In performance counter ticks. Zero when the tasks are not preempted. */
+static uint64_t       s_slice_ticks = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
 /* Like PyThreadState_New, but don't add it to the circular list managed by the 
- * interpreter core. The returned pointer must be free'd with pytask_ts_delete'. */
+ * interpreter core. The returned pointer must be free'd with pytask_ts_delete'. 
+ * Thread states are recycled, as scripts can create short-lived tasks at 
+ * a high rate. */
 static PyThreadState *pytask_ts_new(PyInterpreterState *interp)
 {
-    PyThreadState *tstate = calloc(1, sizeof(PyThreadState));
+    PyThreadState *tstate;
+    if(s_ts_pool_size > 0) {
+        tstate = s_ts_pool[--s_ts_pool_size];
+        memset(tstate, 0, sizeof(PyThreadState));
+        PERF_COUNTER_ADD("script.task_ts_reused", 1);
+    }else{
+        tstate = calloc(1, sizeof(PyThreadState));
+    }
     if(tstate) {
         tstate->interp = interp;
     }
@@ -259,9 +325,45 @@ static PyThreadState *pytask_ts_new(PyInterpreterState *interp)
 static void pytask_ts_delete(PyThreadState *tstate)
 {
     PyThreadState_Clear(tstate);
+    if(s_ts_pool_size < TS_POOL_MAX) {
+        s_ts_pool[s_ts_pool_size++] = tstate;
+        return;
+    }
     free(tstate);
 }
 
+/* The per-task operations are typically well under a microsecond, so 
+ * carry the remainder over instead of truncating every sample to 0. */
+static void pytask_perf_elapsed(int *id, const char *name, uint64_t begin_pc, uint64_t *carry)
+{
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    *carry += (SDL_GetPerformanceCounter() - begin_pc) * 1000000;
+    uint64_t us = *carry / freq;
+    *carry -= us * freq;
+    if(us) {
+        PERF_COUNTER_ADD_ID(id, name, us);
+    }
+}
+
+static int pytask_sched_flags(const PyTaskObject *self)
+{
+    int flags = TASK_MAIN_THREAD_PINNED;
+    if(self->small_stack)
+        return flags;
+    if(self->micro)
+        return flags | TASK_MEDIUM_STACK;
+    return flags | TASK_BIG_STACK;
+}
+
+static bool pytask_check_not_micro(const PyTaskObject *self, const char *method)
+{
+    if(!self->micro)
+        return true;
+    PyErr_Format(PyExc_RuntimeError, 
+        "The '%s' method cannot be called from a microtask.", method);
+    return false;
+}
+
 static PyObject *pytask_call_method(void *func, PyTaskObject *self, PyObject *args, PyObject *kwargs)
 {
     if(kwargs) {
@@ -295,6 +397,9 @@ static PyObject *pytask_resume_request(PyTaskObject *self)
     case PYREQ_RECEIVE:
         ret = pytask_call_method(PyTask_receive, self, args, kwargs);
         break;
+    case PYREQ_RECEIVE_BATCH:
+        ret = pytask_call_method(PyTask_receive_batch, self, args, kwargs);
+        break;
     case PYREQ_REPLY:
         ret = pytask_call_method(PyTask_reply, self, args, kwargs);
         break;
@@ -317,20 +422,69 @@ static PyObject *pytask_resume_request(PyTaskObject *self)
     return ret;
 }
 
+/* The task can only be suspended when there are no C calls between its 
+ * frames, as C code calling back into Python (ex. an event being dispatched 
+ * to script handlers) does not expect other tasks to run in the meantime. 
+ * Direct calls between Python functions don't pass through PyObject_Call, 
+ * so each frame accounts for exactly one level of recursion.
+ */
+static bool pytask_can_preempt(const PyTaskObject *self, PyFrameObject *frame)
+{
+    if(self->state != PYTASK_STATE_RUNNING || Sched_ActiveTID() != self->tid)
+        return false;
+
+    int nframes = 0;
+    for(; frame; frame = frame->f_back) {
+        nframes++;
+    }
+    return (nframes == self->ts->recursion_depth);
+}
+
+static void pytask_preempt(PyTaskObject *self)
+{
+    PERF_COUNTER_ADD("script.task_preemptions", 1);
+    self->preempted = true;
+    pytask_pop_ctx(self);
+
+    Task_YieldFrame();
+
+    pytask_push_ctx(self);
+    self->preempted = false;
+}
+
 static int pytask_tracefunc(PyTaskObject *self, PyFrameObject *frame, int what, PyObject *arg)
 {
+    S_Prof_MaybeSample(frame);
+
     if(what == PyTrace_OPCODE) {
         assert(frame->f_stacktop);
         size_t stack_depth = (size_t)(frame->f_stacktop - frame->f_valuestack);
         self->stack_depth = stack_depth;
+
+        if(s_slice_ticks && ++self->slice_ops == SLICE_CHECK_OPS) {
+
+            self->slice_ops = 0;
+            uint64_t used = self->slice_used + SDL_GetPerformanceCounter() - self->slice_begin;
+            if(used > s_slice_ticks && pytask_can_preempt(self, frame)) {
+                pytask_preempt(self);
+            }
+        }
     }
     return 0;
 }
 
 static void pytask_push_ctx(PyTaskObject *self)
 {
+    uint64_t begin = SDL_GetPerformanceCounter();
+    PERF_COUNTER_ADD("script.task_switches", 1);
     s_main_thread_state = PyThreadState_Swap(self->ts);
 
+    if(self->slice_frame != g_frame_idx) {
+        self->slice_frame = g_frame_idx;
+        self->slice_used = 0;
+    }
+    self->slice_begin = begin;
+
     /* During frame evaluation, CPython NULLs out the current frame's
      * f_stacktop member. As such, there is no reliable way to get the 
      * size of the current evaluation stack of a frame. One exception
@@ -341,14 +495,18 @@ static void pytask_push_ctx(PyTaskObject *self)
      * restore running tasks.
      */
     PyEval_SetTrace((Py_tracefunc)pytask_tracefunc, (PyObject*)self);
+    pytask_perf_elapsed(&s_switch_us_id, "script.task_switch_us", begin, &s_switch_carry);
 }
 
 static void pytask_pop_ctx(PyTaskObject *self)
 {
+    uint64_t begin = SDL_GetPerformanceCounter();
+    self->slice_used += begin - self->slice_begin;
     PyEval_SetTrace(NULL, NULL);
     assert(s_main_thread_state);
     PyThreadState *ts = PyThreadState_Swap(s_main_thread_state);
     assert(ts == self->ts);
+    pytask_perf_elapsed(&s_switch_us_id, "script.task_switch_us", begin, &s_switch_carry);
 }
 
 static struct result py_task(void *arg)
@@ -520,6 +678,7 @@ static PyObject *PyTask_call(PyTaskObject *self, PyObject *args, PyObject *kwarg
 
 static PyObject *PyTask_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 {
+    uint64_t begin = SDL_GetPerformanceCounter();
     PyTaskObject *self = (PyTaskObject*)type->tp_alloc(type, 0);
     if(!self)
         goto fail_alloc;
@@ -542,8 +701,9 @@ static PyObject *PyTask_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     }
 
     /* Create a new PyThreadState for each task. Since we only run it in the 
-     * main thread in a fiber which cannot be pre-empted and yields control at
-     * known boundaries, there is no need to take the GIL before switching to it.
+     * main thread in a fiber which yields control at known boundaries (its 
+     * requests, or between opcodes once its time slice is used up), there is 
+     * no need to take the GIL before switching to it.
      */
     PyInterpreterState *interp = PyThreadState_Get()->interp;
     self->ts = pytask_ts_new(interp);
@@ -554,9 +714,12 @@ static PyObject *PyTask_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 
     if(kwds) {
         PyObject *smallstack = PyDict_GetItemString(kwds, "small_stack");
+        PyObject *micro = PyDict_GetItemString(kwds, "micro");
         self->small_stack = (smallstack && PyObject_IsTrue(smallstack));
+        self->micro = (micro && PyObject_IsTrue(micro));
     }else{
         self->small_stack = false;
+        self->micro = false;
     }
 
     Py_INCREF(func);
@@ -566,6 +729,14 @@ static PyObject *PyTask_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     self->stack_depth = 0;
     self->regname = NULL;
     self->sleep_elapsed = 0;
+    self->sleep_start = 0;
+    self->slice_frame = g_frame_idx;
+    self->slice_used = 0;
+    self->slice_ops = 0;
+    self->preempted = false;
+
+    PERF_COUNTER_ADD("script.tasks_created", 1);
+    pytask_perf_elapsed(&s_create_us_id, "script.task_create_us", begin, &s_create_carry);
     return (PyObject*)self;
 
 fail_run:
@@ -600,6 +771,13 @@ static PyObject *PyTask_pickle(PyTaskObject *self, PyObject *args, PyObject *kwa
     assert(self->state >= PYTASK_STATE_NOT_STARTED && self->state <= PYTASK_STATE_FINISHED);
     assert(self->ts->c_tracefunc == NULL);
 
+    /* A preempted task can only be resumed by the fiber it was suspended in */
+    if(self->preempted) {
+        PyErr_SetString(PyExc_RuntimeError, 
+            "Cannot pickle a task which is suspended in the middle of its time slice.");
+        return NULL;
+    }
+
     static char *kwlist[] = {"__ctx__", NULL};
     struct py_pickle_ctx *ctx = NULL;
     int len;
@@ -676,12 +854,19 @@ static PyObject *PyTask_pickle(PyTaskObject *self, PyObject *args, PyObject *kwa
     ctx->deferred_free(ctx->private_ctx, stack_depth);
     CHK_TRUE(status, fail_pickle);
 
-    PyObject *sleep_elapsed = PyInt_FromLong(self->sleep_elapsed);
+    uint32_t elapsed = self->sleep_elapsed;
+    if(self->req.type == PYREQ_SLEEP) {
+        elapsed += s_running_ms - self->sleep_start;
+    }
+    PyObject *sleep_elapsed = PyInt_FromLong(elapsed);
     status = ctx->pickle_obj(ctx->private_ctx, sleep_elapsed, ctx->stream);
     ctx->deferred_free(ctx->private_ctx, sleep_elapsed);
     CHK_TRUE(status, fail_pickle);
 
-    PyObject *small_stack = PyInt_FromLong(self->small_stack);
+    /* Saved as a bitfield to stay compatible with sessions which only stored the 
+     * 'small_stack' boolean */
+    PyObject *small_stack = PyInt_FromLong((self->small_stack ? STACK_FLAG_SMALL : 0)
+                                         | (self->micro ? STACK_FLAG_MICRO : 0));
     status = ctx->pickle_obj(ctx->private_ctx, small_stack, ctx->stream);
     ctx->deferred_free(ctx->private_ctx, small_stack);
     CHK_TRUE(status, fail_pickle);
@@ -807,17 +992,15 @@ static PyObject *PyTask_unpickle(PyObject *cls, PyObject *args, PyObject *kwargs
     ret->state = PyInt_AS_LONG(state);
     ret->runfunc = func == Py_None ? NULL : (Py_INCREF(func), func);
     ret->sleep_elapsed = PyInt_AS_LONG(sleep_elapsed);
-    ret->small_stack = PyInt_AS_LONG(small_stack);
+    ret->sleep_start = s_running_ms;
+    ret->small_stack = !!(PyInt_AS_LONG(small_stack) & STACK_FLAG_SMALL);
+    ret->micro = !!(PyInt_AS_LONG(small_stack) & STACK_FLAG_MICRO);
     ret->stack_depth = PyInt_AS_LONG(stack_depth);
 
     if(ret->state == PYTASK_STATE_RUNNING) {
 
-        int flags = TASK_MAIN_THREAD_PINNED;
-        if(!ret->small_stack)
-            flags |= TASK_BIG_STACK;
-    
         assert(ret->ts->frame->f_stacktop);
-        ret->tid = Sched_Create(16, py_task, ret, NULL, flags);
+        ret->tid = Sched_Create(16, py_task, ret, NULL, pytask_sched_flags(ret));
 
         if(ret->tid == NULL_TID) {
             PyErr_SetString(PyExc_RuntimeError, "Unable to start fiber for task.");
@@ -872,11 +1055,9 @@ static PyObject *PyTask_run(PyTaskObject *self)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    int flags = TASK_MAIN_THREAD_PINNED;
-    if(!self->small_stack)
-        flags |= TASK_BIG_STACK;
-
-    self->tid = Sched_Create(16, py_task, self, NULL, flags);
+    uint64_t begin = SDL_GetPerformanceCounter();
+    self->tid = Sched_Create(16, py_task, self, NULL, pytask_sched_flags(self));
+    pytask_perf_elapsed(&s_create_us_id, "script.task_create_us", begin, &s_create_carry);
 
     if(self->tid == NULL_TID) {
         PyErr_SetString(PyExc_RuntimeError, "Unable to start fiber for task.");
@@ -1007,6 +1188,9 @@ static PyObject *PyTask_receive(PyTaskObject *self)
         return NULL;
     }
 
+    if(!pytask_check_not_micro(self, "receive"))
+        return NULL;
+
     uint32_t from_tid;
     PyObject *message;
 
@@ -1034,6 +1218,67 @@ static PyObject *PyTask_receive(PyTaskObject *self)
     return ret;
 }
 
+static PyObject *PyTask_receive_batch(PyTaskObject *self, PyObject *args)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(self->state != PYTASK_STATE_RUNNING || Sched_ActiveTID() != self->tid) {
+        PyErr_SetString(PyExc_RuntimeError, 
+            "The 'receive_batch' method can only be called from the context of the __run__ method.");
+        return NULL;
+    }
+
+    if(!pytask_check_not_micro(self, "receive_batch"))
+        return NULL;
+
+    int maxmsgs = 64;
+    if(!PyArg_ParseTuple(args, "|i", &maxmsgs) || maxmsgs <= 0) {
+        PyErr_SetString(PyExc_TypeError, 
+            "Expecting an optional argument: a positive integer (maximum number of messages).");
+        return NULL;
+    }
+
+    struct task_msg *msgs = malloc(sizeof(struct task_msg) * maxmsgs);
+    if(!msgs)
+        return PyErr_NoMemory();
+
+    pytask_req_set(self, args, NULL, PYREQ_RECEIVE_BATCH);
+    pytask_pop_ctx(self);
+
+    /* Scripts only ever send PyObject pointers, so posted messages,
+     * which carry raw buffers, are not drained here. */
+    size_t nmsgs = Task_ReceiveBatch(msgs, maxmsgs, false);
+
+    pytask_push_ctx(self);
+    pytask_req_clear(self);
+
+    PyObject *ret = PyList_New(nmsgs);
+    for(size_t i = 0; i < nmsgs; i++) {
+
+        assert(msgs[i].msglen == sizeof(PyObject*));
+        PyObject *message = *(PyObject**)msgs[i].msg; /* steal message ref */
+
+        khiter_t k = kh_get(task, s_tid_task_map, msgs[i].tid);
+        assert(k != kh_end(s_tid_task_map));
+        PyTaskObject *from = kh_value(s_tid_task_map, k);
+
+        PyObject *tuple = ret ? PyTuple_New(2) : NULL;
+        if(!tuple) {
+            Py_DECREF(message);
+            Py_CLEAR(ret);
+            continue;
+        }
+
+        Py_INCREF(from);
+        PyTuple_SetItem(tuple, 0, (PyObject*)from);
+        PyTuple_SetItem(tuple, 1, message);
+        PyList_SetItem(ret, i, tuple);
+    }
+
+    free(msgs);
+    return ret;
+}
+
 static PyObject *PyTask_reply(PyTaskObject *self, PyObject *args)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -1122,6 +1367,7 @@ static PyObject *PyTask_sleep(PyTaskObject *self, PyObject *args)
     pytask_req_set(self, args, NULL, PYREQ_SLEEP);
     pytask_pop_ctx(self);
 
+    self->sleep_start = s_running_ms;
     Task_Sleep(ms - self->sleep_elapsed);
 
     self->sleep_elapsed = 0;
@@ -1141,6 +1387,9 @@ static PyObject *PyTask_register(PyTaskObject *self, PyObject *args)
         return NULL;
     }
 
+    if(!pytask_check_not_micro(self, "register"))
+        return NULL;
+
     const char *name;
     if(!PyArg_ParseTuple(args, "s", &name)) {
         PyErr_SetString(PyExc_TypeError, "Expecting one string argument (the name to register under)");
@@ -1212,15 +1461,10 @@ static PyObject *PyTask_get_completed(PyTaskObject *self, void *closure)
 
 static void on_update_start(void *user, void *event)
 {
-    uint32_t elapsed = Perf_LastFrameMS();
-    PyTaskObject *curr;
-    uint32_t key;
-    (void)key;
-
-    kh_foreach(s_tid_task_map, key, curr, {
-        if(curr->req.type == PYREQ_SLEEP)
-            curr->sleep_elapsed += elapsed;
-    });
+    /* The elapsed time of the sleeping tasks is only needed when they 
+     * get saved, so it's derived from this single clock then, instead 
+     * of being accumulated for every task on every frame. */
+    s_running_ms += Perf_LastFrameMS();
 }
 
 /*****************************************************************************/
@@ -1240,12 +1484,18 @@ bool S_Task_Init(void)
     s_tid_task_map = kh_init(task);
     if(!s_tid_task_map)
         return false;
+    s_slice_ticks = (uint64_t)CONFIG_SCRIPT_TASK_SLICE_US 
+                  * SDL_GetPerformanceFrequency() / 1000000;
     E_Global_Register(EVENT_UPDATE_START, on_update_start, NULL, G_RUNNING);
     return true;
 }
 
 void S_Task_Shutdown(void)
 {
+    for(size_t i = 0; i < s_ts_pool_size; i++) {
+        free(s_ts_pool[i]);
+    }
+    s_ts_pool_size = 0;
     kh_destroy(task, s_tid_task_map);
     E_Global_Unregister(EVENT_UPDATE_START, on_update_start);
 }
@@ -1301,6 +1551,30 @@ void S_Task_MaybeEnter(void)
     pytask_req_clear(self);
 }
 
+void S_Task_FinishSlices(void)
+{
+    uint32_t tid;
+    PyTaskObject *curr;
+    int nran = 0;
+
+    uint64_t slice_ticks = s_slice_ticks;
+    s_slice_ticks = 0;
+    Sched_WakeFrameYielded();
+
+    do{
+        nran = 0;
+        kh_foreach(s_tid_task_map, tid, curr, {
+            if(curr->preempted && Sched_IsReady(tid)) {
+                Sched_RunSync(tid);
+                nran++;
+            }
+        });
+    
+    }while(nran > 0);
+
+    s_slice_ticks = slice_ticks;
+}
+
 void S_Task_Flush(void)
 {
     uint32_t tid;
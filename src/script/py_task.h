@@ -45,6 +45,9 @@ void      S_Task_Clear(void);
 void      S_Task_PyRegister(PyObject *module);
 PyObject *S_Task_GetAll(void);
 void      S_Task_Flush(void);
+/* Run the tasks which were preempted in the middle of their bytecode up to 
+ * the point where they block on a request, so that they can be saved. */
+void      S_Task_FinishSlices(void);
 
 #endif
 
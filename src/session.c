@@ -37,6 +37,7 @@
 #include "event.h"
 #include "main.h"
 #include "ui.h"
+#include "settings.h"
 #include "sched.h"
 #include "cursor.h"
 #include "asset_load.h"
@@ -45,6 +46,7 @@
 #include "lib/public/vec.h"
 #include "lib/public/mem.h"
 #include "lib/public/SDL_vec_rwops.h"
+#include "lib/public/SDL_lz_rwops.h"
 #include "navigation/public/nav.h"
 #include "game/public/game.h"
 #include "script/public/script.h"
@@ -53,18 +55,100 @@
 #include "anim/public/anim.h"
 
 #include <SDL.h> /* for SDL_RWops */
+#include <stdio.h>
 #include <assert.h>
 
-
-#define PFSAVE_VERSION  (1.0f)
-#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#define PFSAVE_VERSION          (1.2f)
+/* Starting with this version, every subsystem's state is written as a 
+ * separate size-prefixed section */
+#define PFSAVE_CHUNKED_VERSION  (1.1f)
+/* Starting with this version, the header holds the format that the 
+ * attributes of the current subsession were written in. The format of 
+ * every attribute is also detected on parsing. */
+#define PFSAVE_FORMAT_VERSION   (1.2f)
+#define SECTION_READ_SIZE       (16 * 1024)
+#define DELTA_BLOCK_SIZE        (4 * 1024)
+/* Address space reserved up front for the in-memory streams - only the 
+ * pages that are actually written get committed */
+#define SECTION_RESERVE_SIZE    (64 * 1024 * 1024)
+#define SUBSESSION_RESERVE_SIZE (256 * 1024 * 1024)
+#define SNAPSHOT_ORG            "PermafrostEngine"
+#define SNAPSHOT_APP            "subsessions"
+#define MIN(a, b)               ((a) < (b) ? (a) : (b))
+#define ARR_SIZE(a)             (sizeof(a)/sizeof(a[0]))
 
 VEC_TYPE(stream, SDL_RWops*)
 VEC_IMPL(static, stream, SDL_RWops*)
 
+/* A contiguous range of a full session image - either the header or 
+ * a single section of one of the subsessions. */
+struct segment{
+    size_t offset;
+    size_t size;
+};
+
+VEC_TYPE(segment, struct segment)
+VEC_IMPL(static, segment, struct segment)
+
+struct snapshot_mapping{
+    const char          *base;
+    size_t               size;
+#if defined(_WIN32)
+    HANDLE               file;
+    HANDLE               map;
+#endif
+};
+
+/* The serialized state of a subsession on the stack. Depending on the 
+ * settings, it is held in memory as-is or compressed, or it is spilled 
+ * to a file. A spilled snapshot is only mapped back into memory while 
+ * it is being read. 
+ */
+struct snapshot{
+    SDL_RWops               *stream;    /* NULL when spilled */
+    bool                     compressed;
+    bool                     spilled;
+    bool                     mapped;
+    struct snapshot_mapping  mapping;
+    char                     path[512];
+};
+
+VEC_TYPE(snapshot, struct snapshot)
+VEC_IMPL(static, snapshot, struct snapshot)
+
+/* Reads the sections of a chunked session file ahead of them being loaded. 
+ * The sections can only be applied to the engine state on the main thread, 
+ * but reading them out of the file (and decompressing it, if necessary) is 
+ * done by a separate thread, overlapping with the loading of the previous 
+ * sections. 
+ */
+struct readahead{
+    SDL_Thread   *thread;
+    SDL_mutex    *lock;
+    SDL_cond     *cond;
+    SDL_RWops    *stream;
+    int           nsubsessions;
+    /* A NULL section marks a read error */
+    vec_stream_t  sections;
+    size_t        next;
+    bool          done;
+    bool          quit;
+};
+
 enum srequest{
     SESH_REQ_NONE,
     SESH_REQ_SAVE,
+    SESH_REQ_SAVE_ASYNC,
     SESH_REQ_LOAD,
     SESH_REQ_PUSH,
     SESH_REQ_POP,
@@ -80,7 +164,7 @@ enum srequest{
  * A session is a stack of subsessions.
  */
 
-static vec_stream_t    s_subsession_stack;
+static vec_snapshot_t  s_subsession_stack;
 static enum srequest   s_request = SESH_REQ_NONE;
 static enum srequest   s_current = SESH_REQ_NONE;
 static int             s_argc;
@@ -93,6 +177,29 @@ static uint64_t        s_change_tick = UINT64_MAX;
 static struct arg_desc s_saved_args;
 static char            s_saved_argv[MAX_ARGC + 1][128];
 
+/* State of the background save. The session is serialized into an 
+ * in-memory image on the main thread, and then the image is written 
+ * out to the file by a separate thread */
+static struct{
+    SDL_Thread        *thread;
+    SDL_RWops         *image;
+    bool               full;
+    bool               compress;
+    char               path[512];
+    char               errbuff[512];
+    bool               result;
+    SDL_atomic_t       done;
+}s_write;
+
+/* The most recently used full session image that deltas can be 
+ * computed against, or resolved with */
+static struct{
+    SDL_RWops         *image;
+    char               path[512];
+}s_base;
+static char            s_req_base[512];
+static uint32_t        s_snapshot_count;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -151,94 +258,630 @@ static void subsession_flush(void)
     }while(G_HasWork() || E_EventsQueued() || Sched_HasBlocked());
 }
 
-static bool subsession_save(SDL_RWops *stream)
+static bool save_next_uid(SDL_RWops *stream)
 {
-    subsession_flush();
-
-    if(!Cursor_SaveState(stream))
-        return false;
-
-    /* First save the state of the map, lighting, camera, etc. (everything that 
-     * isn't entities). Loading this state initalizes the session. */
-    if(!G_SaveGlobalState(stream))
-        return false;
-
-    /* All live entities have a scripting object associated with them. Loading the
-     * scripting state will re-create all the entities. */
-    if(!S_SaveState(stream))
-        return false;
-
     /* Roll forward the 'next_uid' so there's no collision with already loaded 
      * entities (which preserve their UIDs from the old session) */
     struct attr next_uid = (struct attr){
         .type = TYPE_INT,
         .val.as_int = Entity_NewUID()
     };
-    if(!Attr_Write(stream, &next_uid, "next_uid"))
+    return Attr_Write(stream, &next_uid, "next_uid");
+}
+
+static bool load_next_uid(SDL_RWops *stream)
+{
+    struct attr attr;
+    if(!Attr_Parse(stream, &attr, true) || attr.type != TYPE_INT)
         return false;
+    Entity_SetNextUID(attr.val.as_int);
+    return true;
+}
 
-    /* After the entities are loaded, populate all the auxiliary entity state that
-     * isn't visible via the scripting API. (animation context, pricise movement 
-     * state, etc) */
-    if(!G_SaveEntityState(stream))
+static bool subsession_save_section(SDL_RWops *stream, const char *name, 
+                                    bool (*save)(SDL_RWops*))
+{
+    bool ret = false;
+    /* Sections are gathered, so large pickled buffers get handed to the 
+     * destination directly, without being copied into the section first. */
+    SDL_RWops *section = PFSDL_VMemRWOps(SECTION_RESERVE_SIZE, true);
+    if(!section)
+        goto fail_alloc;
+
+    if(!save(section))
+        goto fail_save;
+
+    size_t size = SDL_RWsize(section);
+    struct attr attr = (struct attr){
+        .type = TYPE_INT,
+        .val.as_int = size
+    };
+    if(!Attr_Write(stream, &attr, name))
+        goto fail_save;
+
+    if(!PFSDL_VectorRWOpsWriteTo(section, stream))
+        goto fail_save;
+
+    ret = true;
+
+fail_save:
+    SDL_RWclose(section);
+fail_alloc:
+    return ret;
+}
+
+static bool session_compress(void)
+{
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.compress_saves", &setting);
+    assert(status == SS_OKAY);
+    (void)status;
+    return setting.as_bool;
+}
+
+static enum attr_format session_attr_format(void)
+{
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.binary_saves", &setting);
+    assert(status == SS_OKAY);
+    (void)status;
+    return setting.as_bool ? ATTR_FORMAT_BINARY : ATTR_FORMAT_TEXT;
+}
+
+static bool session_parse_format(SDL_RWops *stream, float version)
+{
+    if(version < PFSAVE_FORMAT_VERSION)
+        return true;
+
+    struct attr attr;
+    if(!Attr_Parse(stream, &attr, true) || attr.type != TYPE_INT)
         return false;
+    if(0 != strcmp(attr.key, "attr_format"))
+        return false;
+    return (attr.val.as_int == ATTR_FORMAT_TEXT || attr.val.as_int == ATTR_FORMAT_BINARY);
+}
+
+/* Opens a session file for writing. The files are always opened in 
+ * binary mode, as neither the compressed files nor the binary attributes 
+ * are made up of lines. 
+ */
+static SDL_RWops *session_file_write(const char *path, bool compress)
+{
+    if(!compress)
+        return SDL_RWFromFile(path, "wb");
 
-    if(!Audio_SaveState(stream))
+    SDL_RWops *file = SDL_RWFromFile(path, "wb");
+    if(!file)
+        return NULL;
+
+    SDL_RWops *ret = PFSDL_LZCompressRWOps(file);
+    if(!ret) {
+        SDL_RWclose(file);
+    }
+    return ret;
+}
+
+/* Opens a session file for reading, transparently decompressing it
+ * if necessary. 
+ */
+static SDL_RWops *session_file_read(const char *path)
+{
+    SDL_RWops *file = SDL_RWFromFile(path, "rb");
+    if(!file)
+        return NULL;
+
+    if(!PFSDL_LZIsCompressed(file)) {
+        return file;
+    }
+
+    SDL_RWops *ret = PFSDL_LZDecompressRWOps(file);
+    if(!ret) {
+        SDL_RWclose(file);
+    }
+    return ret;
+}
+
+static bool bool_val_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+/* Reads 'size' bytes from 'stream' into a new in-memory stream 
+ */
+static SDL_RWops *stream_read_mem(SDL_RWops *stream, size_t size)
+{
+    SDL_RWops *ret = PFSDL_VectorRWOps();
+    if(!ret)
+        return NULL;
+    if(!PFSDL_VectorRWOpsReserve(ret, size))
+        goto fail;
+
+    char buff[SECTION_READ_SIZE];
+    size_t left = size;
+    while(left > 0) {
+        size_t chunk = MIN(left, sizeof(buff));
+        if(SDL_RWread(stream, buff, chunk, 1) != 1)
+            goto fail;
+        if(SDL_RWwrite(ret, buff, chunk, 1) != 1)
+            goto fail;
+        left -= chunk;
+    }
+
+    SDL_RWseek(ret, 0, RW_SEEK_SET);
+    return ret;
+
+fail:
+    SDL_RWclose(ret);
+    return NULL;
+}
+
+static bool snapshot_compress(void)
+{
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.compress_subsessions", &setting);
+    assert(status == SS_OKAY);
+    (void)status;
+    return setting.as_bool;
+}
+
+static bool snapshot_spill(void)
+{
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.spill_subsessions", &setting);
+    assert(status == SS_OKAY);
+    (void)status;
+    return setting.as_bool;
+}
+
+static bool snapshot_map(const char *path, struct snapshot_mapping *out)
+{
+#if defined(_WIN32)
+    out->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, 
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(out->file == INVALID_HANDLE_VALUE)
+        goto fail_open;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(out->file, &size) || size.QuadPart == 0)
+        goto fail_size;
+
+    out->map = CreateFileMappingA(out->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!out->map)
+        goto fail_size;
+
+    out->base = MapViewOfFile(out->map, FILE_MAP_READ, 0, 0, 0);
+    if(!out->base)
+        goto fail_view;
+
+    out->size = size.QuadPart;
+    return true;
+
+fail_view:
+    CloseHandle(out->map);
+fail_size:
+    CloseHandle(out->file);
+fail_open:
+    return false;
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        goto fail_open;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+        goto fail_map;
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(base == MAP_FAILED)
+        goto fail_map;
+
+    close(fd);
+    out->base = base;
+    out->size = st.st_size;
+    return true;
+
+fail_map:
+    close(fd);
+fail_open:
+    return false;
+#endif
+}
+
+static void snapshot_unmap(struct snapshot_mapping *mapping)
+{
+#if defined(_WIN32)
+    UnmapViewOfFile((void*)mapping->base);
+    CloseHandle(mapping->map);
+    CloseHandle(mapping->file);
+#else
+    munmap((void*)mapping->base, mapping->size);
+#endif
+}
+
+static bool snapshot_path(char *out, size_t maxout)
+{
+    char *dir = SDL_GetPrefPath(SNAPSHOT_ORG, SNAPSHOT_APP);
+    if(!dir)
         return false;
 
-    if(!P_Projectile_SaveState(stream))
+    int len = pf_snprintf(out, maxout, "%s%016llx-%u.pfsub", dir, 
+        (unsigned long long)SDL_GetPerformanceCounter(), (unsigned)s_snapshot_count++);
+    SDL_free(dir);
+    return (len > 0 && len < maxout);
+}
+
+static bool snapshot_write(SDL_RWops *image, SDL_RWops *dst, bool compress)
+{
+    if(!compress)
+        return PFSDL_VectorRWOpsWriteTo(image, dst);
+
+    SDL_RWops *lz = PFSDL_LZCompressRWOps(dst);
+    if(!lz)
         return false;
 
-    return true;
+    bool ret = PFSDL_VectorRWOpsWriteTo(image, lz);
+    return PFSDL_LZFinish(lz) && ret;
 }
 
-static bool subsession_load(SDL_RWops *stream, char *errstr, size_t errlen)
+/* Takes ownership of the in-memory subsession 'image'. If it cannot be 
+ * spilled or compressed, the snapshot falls back to holding it as-is.
+ */
+static void snapshot_init(struct snapshot *out, SDL_RWops *image)
 {
-    struct attr attr;
-    subsession_clear();
+    bool compress = snapshot_compress();
+    *out = (struct snapshot){
+        .stream = image,
+    };
 
-    if(!Cursor_LoadState(stream)) {
-        pf_snprintf(errstr, errlen, 
-            "Could not de-serialize cursor state from session file");
-        goto fail;
+    if(snapshot_spill() && snapshot_path(out->path, sizeof(out->path))) {
+
+        SDL_RWops *file = SDL_RWFromFile(out->path, "wb");
+        if(file) {
+            bool result = snapshot_write(image, file, compress);
+            result = (SDL_RWclose(file) == 0) && result;
+            if(result) {
+                SDL_RWclose(image);
+                out->stream = NULL;
+                out->compressed = compress;
+                out->spilled = true;
+                return;
+            }
+        }
+        remove(out->path);
+        out->path[0] = '\0';
     }
 
-    if(!G_LoadGlobalState(stream)) {
-        pf_snprintf(errstr, errlen, 
-            "Could not de-serialize map and globals state from session file");
-        goto fail;
+    if(compress) {
+
+        SDL_RWops *stream = PFSDL_VectorRWOps();
+        if(stream && snapshot_write(image, stream, true)) {
+            SDL_RWclose(image);
+            out->stream = stream;
+            out->compressed = true;
+            return;
+        }
+        if(stream) {
+            SDL_RWclose(stream);
+        }
     }
+}
 
-    if(!S_LoadState(stream)) {
-        pf_snprintf(errstr, errlen, 
-            "Could not de-serialize script-defined state from session file");
-        goto fail;
+/* Returns a new stream for reading back the serialized subsession. It must 
+ * be closed before the snapshot is.
+ */
+static SDL_RWops *snapshot_open(struct snapshot *snap)
+{
+    const char *data;
+    size_t size;
+
+    if(snap->spilled) {
+        if(!snap->mapped && !snapshot_map(snap->path, &snap->mapping))
+            return NULL;
+        snap->mapped = true;
+        data = snap->mapping.base;
+        size = snap->mapping.size;
+    }else{
+        data = PFSDL_VectorRWOpsRaw(snap->stream);
+        size = SDL_RWsize(snap->stream);
     }
 
-    if(!Attr_Parse(stream, &attr, true) || attr.type != TYPE_INT) {
-        pf_snprintf(errstr, errlen, 
-            "Could not read 'next_uid' attribute from session file");
-        goto fail;
+    SDL_RWops *ret = SDL_RWFromConstMem(data, size);
+    if(!ret || !snap->compressed)
+        return ret;
+
+    SDL_RWops *lz = PFSDL_LZDecompressRWOps(ret);
+    if(!lz) {
+        SDL_RWclose(ret);
     }
-    Entity_SetNextUID(attr.val.as_int);
-    Sched_TryYield();
+    return lz;
+}
 
-    if(!G_LoadEntityState(stream)) {
-        pf_snprintf(errstr, errlen, 
-            "Could not de-serialize additional entity state from session file");
-        goto fail;
+/* Releases the mapping of a spilled snapshot, keeping the file. 
+ */
+static void snapshot_close(struct snapshot *snap)
+{
+    if(!snap->mapped)
+        return;
+    snapshot_unmap(&snap->mapping);
+    snap->mapped = false;
+}
+
+static void snapshot_destroy(struct snapshot *snap)
+{
+    snapshot_close(snap);
+    if(snap->stream) {
+        SDL_RWclose(snap->stream);
+    }
+    if(snap->spilled) {
+        remove(snap->path);
     }
+}
 
-    if(!Audio_LoadState(stream)) {
-        pf_snprintf(errstr, errlen, 
-            "Could not de-serialize audio state from session file");
-        goto fail;
+/* Writes out the serialized subsession, uncompressed. 
+ */
+static bool snapshot_write_to(struct snapshot *snap, SDL_RWops *dst)
+{
+    if(!snap->spilled && !snap->compressed)
+        return PFSDL_VectorRWOpsWriteTo(snap->stream, dst);
+
+    SDL_RWops *stream = snapshot_open(snap);
+    if(!stream)
+        return false;
+
+    bool ret = true;
+    char buff[SECTION_READ_SIZE];
+    size_t nread;
+
+    while(ret && (nread = SDL_RWread(stream, buff, 1, sizeof(buff))) > 0) {
+        ret = (SDL_RWwrite(dst, buff, nread, 1) == 1);
     }
 
-    if(!P_Projectile_LoadState(stream)) {
-        pf_snprintf(errstr, errlen, 
-            "Could not de-serialize physics state from session file");
-        goto fail;
+    SDL_RWclose(stream);
+    snapshot_close(snap);
+    return ret;
+}
+
+static SDL_RWops *subsession_read_section(SDL_RWops *stream, const char *name)
+{
+    struct attr attr;
+    if(!Attr_Parse(stream, &attr, true) || attr.type != TYPE_INT)
+        return NULL;
+    if(0 != strcmp(attr.key, name) || attr.val.as_int < 0)
+        return NULL;
+    return stream_read_mem(stream, attr.val.as_int);
+}
+
+static bool subsession_load_section(SDL_RWops *stream, const char *name, 
+                                    bool chunked, bool (*load)(SDL_RWops*))
+{
+    if(!chunked)
+        return load(stream);
+
+    SDL_RWops *section = subsession_read_section(stream, name);
+    if(!section)
+        return false;
+
+    bool ret = load(section);
+    SDL_RWclose(section);
+    return ret;
+}
+
+/* The order of the sections is significant. First comes the state of the map, 
+ * lighting, camera, etc. (everything that isn't entities). Loading this state 
+ * initalizes the session. All live entities have a scripting object associated 
+ * with them. Loading the scripting state will re-create all the entities. After 
+ * the entities are loaded, populate all the auxiliary entity state that isn't 
+ * visible via the scripting API. (animation context, precise movement state, etc)
+ */
+static const struct{
+    const char *name;
+    const char *desc;
+    bool      (*save)(SDL_RWops*);
+    bool      (*load)(SDL_RWops*);
+}s_sections[] = {
+    {"cursor",      "cursor state",                 Cursor_SaveState,       Cursor_LoadState        },
+    {"globals",     "map and globals state",        G_SaveGlobalState,      G_LoadGlobalState       },
+    {"script",      "script-defined state",         S_SaveState,            S_LoadState             },
+    {"next_uid",    "'next_uid' attribute",         save_next_uid,          load_next_uid           },
+    {"entities",    "additional entity state",      G_SaveEntityState,      G_LoadEntityState       },
+    {"audio",       "audio state",                  Audio_SaveState,        Audio_LoadState         },
+    {"projectiles", "physics state",                P_Projectile_SaveState, P_Projectile_LoadState  },
+};
+
+static bool subsession_save(SDL_RWops *stream)
+{
+    subsession_flush();
+
+    bool ret = true;
+    enum attr_format prev = Attr_SetWriteFormat(session_attr_format());
+
+    for(int i = 0; i < ARR_SIZE(s_sections); i++) {
+        if(!subsession_save_section(stream, s_sections[i].name, s_sections[i].save)) {
+            ret = false;
+            break;
+        }
+    }
+
+    Attr_SetWriteFormat(prev);
+    return ret;
+}
+
+static int readahead_thread(void *arg)
+{
+    struct readahead *ra = arg;
+
+    for(int i = 0; i < ra->nsubsessions; i++) {
+    for(int j = 0; j < ARR_SIZE(s_sections); j++) {
+
+        SDL_LockMutex(ra->lock);
+        bool quit = ra->quit;
+        SDL_UnlockMutex(ra->lock);
+        if(quit)
+            goto out;
+
+        SDL_RWops *section = subsession_read_section(ra->stream, s_sections[j].name);
+
+        SDL_LockMutex(ra->lock);
+        vec_stream_push(&ra->sections, section);
+        SDL_CondSignal(ra->cond);
+        SDL_UnlockMutex(ra->lock);
+
+        if(!section)
+            goto out;
+    }}
+
+out:
+    SDL_LockMutex(ra->lock);
+    ra->done = true;
+    SDL_CondSignal(ra->cond);
+    SDL_UnlockMutex(ra->lock);
+    return 0;
+}
+
+/* Start reading the sections of 'nsubsessions' subsessions from 'stream'. 
+ * The stream may not be touched by the caller until 'readahead_end'. 
+ */
+static bool readahead_begin(struct readahead *ra, SDL_RWops *stream, int nsubsessions)
+{
+    ra->stream = stream;
+    ra->nsubsessions = nsubsessions;
+    ra->next = 0;
+    ra->done = false;
+    ra->quit = false;
+    vec_stream_init(&ra->sections);
+
+    if(!vec_stream_resize(&ra->sections, nsubsessions * ARR_SIZE(s_sections)))
+        goto fail_vec;
+
+    ra->lock = SDL_CreateMutex();
+    if(!ra->lock)
+        goto fail_lock;
+
+    ra->cond = SDL_CreateCond();
+    if(!ra->cond)
+        goto fail_cond;
+
+    ra->thread = SDL_CreateThread(readahead_thread, "session_read", ra);
+    if(!ra->thread)
+        goto fail_thread;
+
+    return true;
+
+fail_thread:
+    SDL_DestroyCond(ra->cond);
+fail_cond:
+    SDL_DestroyMutex(ra->lock);
+fail_lock:
+fail_vec:
+    vec_stream_destroy(&ra->sections);
+    return false;
+}
+
+/* Returns the next section, which is then owned by the caller, or NULL
+ * if it could not be read. 
+ */
+static SDL_RWops *readahead_next(struct readahead *ra)
+{
+    SDL_RWops *ret = NULL;
+    SDL_LockMutex(ra->lock);
+
+    while(ra->next == vec_size(&ra->sections) && !ra->done) {
+        SDL_CondWait(ra->cond, ra->lock);
+    }
+    if(ra->next < vec_size(&ra->sections)) {
+        ret = vec_AT(&ra->sections, ra->next);
+        vec_AT(&ra->sections, ra->next) = NULL;
+        ra->next++;
+    }
+
+    SDL_UnlockMutex(ra->lock);
+    return ret;
+}
+
+static void readahead_end(struct readahead *ra)
+{
+    SDL_LockMutex(ra->lock);
+    ra->quit = true;
+    SDL_UnlockMutex(ra->lock);
+
+    SDL_WaitThread(ra->thread, NULL);
+
+    for(int i = ra->next; i < vec_size(&ra->sections); i++) {
+        SDL_RWops *section = vec_AT(&ra->sections, i);
+        if(section) {
+            SDL_RWclose(section);
+        }
+    }
+
+    SDL_DestroyCond(ra->cond);
+    SDL_DestroyMutex(ra->lock);
+    vec_stream_destroy(&ra->sections);
+}
+
+/* Copies the next subsession from the readahead into a new in-memory stream, 
+ * without loading it. This is the same data that 'subsession_save' would 
+ * produce after loading it. 
+ */
+static SDL_RWops *readahead_copy_subsession(struct readahead *ra)
+{
+    SDL_RWops *ret = PFSDL_VMemRWOps(SUBSESSION_RESERVE_SIZE, false);
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < ARR_SIZE(s_sections); i++) {
+
+        SDL_RWops *section = readahead_next(ra);
+        if(!section)
+            goto fail;
+
+        size_t size = SDL_RWsize(section);
+        struct attr attr = (struct attr){
+            .type = TYPE_INT,
+            .val.as_int = size
+        };
+        bool result = Attr_Write(ret, &attr, s_sections[i].name)
+                   && PFSDL_VectorRWOpsWriteTo(section, ret);
+        SDL_RWclose(section);
+        if(!result)
+            goto fail;
+    }
+
+    SDL_RWseek(ret, 0, RW_SEEK_SET);
+    return ret;
+
+fail:
+    SDL_RWclose(ret);
+    return NULL;
+}
+
+/* When 'ra' is non-NULL, the sections are taken from it rather than being 
+ * read from 'stream'. 
+ */
+static bool subsession_load(SDL_RWops *stream, bool chunked, struct readahead *ra,
+                            char *errstr, size_t errlen)
+{
+    subsession_clear();
+
+    for(int i = 0; i < ARR_SIZE(s_sections); i++) {
+
+        bool result;
+        if(ra) {
+            SDL_RWops *section = readahead_next(ra);
+            result = section && s_sections[i].load(section);
+            if(section) {
+                SDL_RWclose(section);
+            }
+        }else{
+            result = subsession_load_section(stream, s_sections[i].name, 
+                chunked, s_sections[i].load);
+        }
+
+        if(!result) {
+            pf_snprintf(errstr, errlen, 
+                "Could not de-serialize %s from session file", s_sections[i].desc);
+            goto fail;
+        }
+        Sched_TryYield();
     }
 
     /* We may have loaded some assets during the session loading 
@@ -255,6 +898,316 @@ fail:
     return false;
 }
 
+/* Splits a full session image into the header and the sections of all of 
+ * the subsessions. 
+ */
+static bool image_segments(SDL_RWops *image, vec_segment_t *out)
+{
+    size_t size = SDL_RWsize(image);
+    SDL_RWops *stream = SDL_RWFromConstMem(PFSDL_VectorRWOpsRaw(image), size);
+    if(!stream)
+        return false;
+
+    bool ret = false;
+    struct attr attr;
+
+    if(!Attr_Parse(stream, &attr, true) || attr.type != TYPE_FLOAT)
+        goto out;
+    if(attr.val.as_float < PFSAVE_CHUNKED_VERSION)
+        goto out;
+    if(!session_parse_format(stream, attr.val.as_float))
+        goto out;
+    if(!Attr_Parse(stream, &attr, true) || attr.type != TYPE_INT)
+        goto out;
+    if(0 != strcmp(attr.key, "num_subsessions"))
+        goto out;
+
+    size_t offset = SDL_RWtell(stream);
+    if(!vec_segment_push(out, (struct segment){0, offset}))
+        goto out;
+
+    while(offset < size) {
+
+        if(!Attr_Parse(stream, &attr, true) || attr.type != TYPE_INT || attr.val.as_int < 0)
+            goto out;
+
+        size_t end = SDL_RWtell(stream) + attr.val.as_int;
+        if(end > size)
+            goto out;
+        if(!vec_segment_push(out, (struct segment){offset, end - offset}))
+            goto out;
+
+        SDL_RWseek(stream, end, RW_SEEK_SET);
+        offset = end;
+    }
+    ret = true;
+
+out:
+    SDL_RWclose(stream);
+    return ret;
+}
+
+static bool block_dirty(const char *data, size_t size, const char *base, 
+                        size_t base_size, size_t idx)
+{
+    size_t begin = idx * DELTA_BLOCK_SIZE;
+    size_t len = MIN(DELTA_BLOCK_SIZE, size - begin);
+    if(begin + len > base_size)
+        return true;
+    return (0 != memcmp(data + begin, base + begin, len));
+}
+
+static bool delta_write_segment(SDL_RWops *out, const char *data, size_t size, 
+                                const char *base, size_t base_size)
+{
+    size_t nblocks = (size + DELTA_BLOCK_SIZE - 1) / DELTA_BLOCK_SIZE;
+    size_t ndirty = 0;
+    for(int i = 0; i < nblocks; i++) {
+        ndirty += block_dirty(data, size, base, base_size, i);
+    }
+
+    struct attr attr = (struct attr){
+        .type = TYPE_INT,
+        .val.as_int = size
+    };
+    if(!Attr_Write(out, &attr, "segment"))
+        return false;
+
+    attr.val.as_int = ndirty;
+    if(!Attr_Write(out, &attr, "dirty_blocks"))
+        return false;
+
+    for(int i = 0; i < nblocks; i++) {
+
+        if(!block_dirty(data, size, base, base_size, i))
+            continue;
+
+        size_t begin = i * DELTA_BLOCK_SIZE;
+        size_t len = MIN(DELTA_BLOCK_SIZE, size - begin);
+
+        attr.val.as_int = i;
+        if(!Attr_Write(out, &attr, "block"))
+            return false;
+        if(SDL_RWwrite(out, data + begin, len, 1) != 1)
+            return false;
+    }
+    return true;
+}
+
+/* Encodes the full session image as the set of blocks of each segment that 
+ * differ from the same segment of the base image. 
+ */
+static SDL_RWops *delta_encode(SDL_RWops *image, SDL_RWops *base, const char *base_path)
+{
+    SDL_RWops *ret = NULL;
+    vec_segment_t segs, base_segs;
+    vec_segment_init(&segs);
+    vec_segment_init(&base_segs);
+
+    if(!image_segments(image, &segs) || !image_segments(base, &base_segs))
+        goto fail;
+
+    ret = PFSDL_VectorRWOps();
+    if(!ret)
+        goto fail;
+
+    struct attr version = (struct attr){
+        .type = TYPE_FLOAT,
+        .val.as_float = PFSAVE_VERSION
+    };
+    if(!Attr_Write(ret, &version, "version"))
+        goto fail;
+
+    struct attr attr = (struct attr){ .type = TYPE_STRING };
+    pf_strlcpy(attr.val.as_string, base_path, sizeof(attr.val.as_string));
+    if(!Attr_Write(ret, &attr, "base"))
+        goto fail;
+
+    attr = (struct attr){
+        .type = TYPE_INT,
+        .val.as_int = vec_size(&segs)
+    };
+    if(!Attr_Write(ret, &attr, "num_segments"))
+        goto fail;
+
+    const char *data = PFSDL_VectorRWOpsRaw(image);
+    const char *base_data = PFSDL_VectorRWOpsRaw(base);
+
+    for(int i = 0; i < vec_size(&segs); i++) {
+
+        struct segment seg = vec_AT(&segs, i);
+        struct segment base_seg = (i < vec_size(&base_segs)) ? vec_AT(&base_segs, i)
+                                                             : (struct segment){0, 0};
+        if(!delta_write_segment(ret, data + seg.offset, seg.size, 
+            base_data + base_seg.offset, base_seg.size))
+            goto fail;
+        Sched_TryYield();
+    }
+
+    vec_segment_destroy(&segs);
+    vec_segment_destroy(&base_segs);
+    return ret;
+
+fail:
+    if(ret) {
+        SDL_RWclose(ret);
+    }
+    vec_segment_destroy(&segs);
+    vec_segment_destroy(&base_segs);
+    return NULL;
+}
+
+/* Re-creates the full session image from the base image and the delta. 
+ * The delta stream must be positioned after the 'base' attribute. 
+ */
+static SDL_RWops *delta_apply(SDL_RWops *delta, SDL_RWops *base)
+{
+    struct attr attr;
+    char *buff = NULL;
+    vec_segment_t base_segs;
+    vec_segment_init(&base_segs);
+
+    SDL_RWops *ret = PFSDL_VectorRWOps();
+    if(!ret)
+        goto fail;
+    PFSDL_VectorRWOpsReserve(ret, SDL_RWsize(base));
+
+    if(!image_segments(base, &base_segs))
+        goto fail;
+
+    if(!Attr_Parse(delta, &attr, true) || attr.type != TYPE_INT || attr.val.as_int < 0)
+        goto fail;
+
+    const char *base_data = PFSDL_VectorRWOpsRaw(base);
+    int nsegs = attr.val.as_int;
+
+    for(int i = 0; i < nsegs; i++) {
+
+        if(!Attr_Parse(delta, &attr, true) || attr.type != TYPE_INT || attr.val.as_int < 0)
+            goto fail;
+
+        size_t size = attr.val.as_int;
+        size_t nblocks = (size + DELTA_BLOCK_SIZE - 1) / DELTA_BLOCK_SIZE;
+        struct segment base_seg = (i < vec_size(&base_segs)) ? vec_AT(&base_segs, i)
+                                                             : (struct segment){0, 0};
+        buff = calloc(1, size + 1);
+        if(!buff)
+            goto fail;
+        memcpy(buff, base_data + base_seg.offset, MIN(size, base_seg.size));
+
+        if(!Attr_Parse(delta, &attr, true) || attr.type != TYPE_INT || attr.val.as_int < 0)
+            goto fail;
+
+        int ndirty = attr.val.as_int;
+        for(int j = 0; j < ndirty; j++) {
+
+            if(!Attr_Parse(delta, &attr, true) || attr.type != TYPE_INT)
+                goto fail;
+            if(attr.val.as_int < 0 || attr.val.as_int >= nblocks)
+                goto fail;
+
+            size_t begin = attr.val.as_int * DELTA_BLOCK_SIZE;
+            size_t len = MIN(DELTA_BLOCK_SIZE, size - begin);
+            if(SDL_RWread(delta, buff + begin, len, 1) != 1)
+                goto fail;
+        }
+
+        if(size > 0 && SDL_RWwrite(ret, buff, size, 1) != 1)
+            goto fail;
+
+        free(buff);
+        buff = NULL;
+        Sched_TryYield();
+    }
+
+    SDL_RWseek(ret, 0, RW_SEEK_SET);
+    vec_segment_destroy(&base_segs);
+    return ret;
+
+fail:
+    free(buff);
+    if(ret) {
+        SDL_RWclose(ret);
+    }
+    vec_segment_destroy(&base_segs);
+    return NULL;
+}
+
+static void session_drop_base(const char *path)
+{
+    if(!s_base.image)
+        return;
+    if(path && 0 != strcmp(path, s_base.path))
+        return;
+    SDL_RWclose(s_base.image);
+    s_base.image = NULL;
+}
+
+static void session_set_base(SDL_RWops *image, const char *path)
+{
+    session_drop_base(NULL);
+    s_base.image = image;
+    pf_strlcpy(s_base.path, path, sizeof(s_base.path));
+}
+
+/* Returns a borrowed reference to the full session image stored at 'path' 
+ */
+static SDL_RWops *session_get_base(const char *path)
+{
+    if(s_base.image && 0 == strcmp(path, s_base.path))
+        return s_base.image;
+
+    SDL_RWops *file = session_file_read(path);
+    if(!file)
+        return NULL;
+
+    Sint64 size = SDL_RWsize(file);
+    SDL_RWops *image = (size >= 0) ? stream_read_mem(file, size) : NULL;
+    SDL_RWclose(file);
+
+    if(!image)
+        return NULL;
+
+    session_set_base(image, path);
+    return image;
+}
+
+/* Opens the session file for reading. A delta file is resolved against 
+ * its' base, resulting in an in-memory image of the full session. 
+ */
+static SDL_RWops *session_open(const char *file, char *errstr, size_t errlen)
+{
+    struct attr attr;
+    SDL_RWops *stream = session_file_read(file);
+    if(!stream) {
+        pf_snprintf(errstr, errlen, "Could not open session file: %s", file);
+        return NULL;
+    }
+
+    bool delta = Attr_Parse(stream, &attr, true) && attr.type == TYPE_FLOAT
+              && Attr_Parse(stream, &attr, true) && attr.type == TYPE_STRING
+              && (0 == strcmp(attr.key, "base"));
+
+    if(!delta) {
+        SDL_RWseek(stream, 0, RW_SEEK_SET);
+        return stream;
+    }
+
+    SDL_RWops *base = session_get_base(attr.val.as_string);
+    if(!base) {
+        pf_snprintf(errstr, errlen, "Could not read base session file: %s", attr.val.as_string);
+        SDL_RWclose(stream);
+        return NULL;
+    }
+
+    SDL_RWops *ret = delta_apply(stream, base);
+    if(!ret) {
+        pf_snprintf(errstr, errlen, "Could not apply session delta: %s", file);
+    }
+    SDL_RWclose(stream);
+    return ret;
+}
+
 static bool session_load(const char *file, char *errstr, size_t errlen)
 {
     bool ret = false;
@@ -264,18 +1217,15 @@ static bool session_load(const char *file, char *errstr, size_t errlen)
     vec_stream_init(&loaded);
 
     /* First save the current subsession to memory. If things go sour, we will roll back to it */
-    SDL_RWops *current = PFSDL_VectorRWOps();
-    PFSDL_VectorRWOpsReserve(current, 64 * 1024 * 1024);
+    SDL_RWops *current = PFSDL_VMemRWOps(SUBSESSION_RESERVE_SIZE, false);
 
     bool result = subsession_save(current);
     assert(result);
     SDL_RWseek(current, 0, RW_SEEK_SET);
 
-    SDL_RWops *stream = SDL_RWFromFile(file, "r");
-    if(!stream) {
-        pf_snprintf(errstr, errlen, "Could not open session file: %s", file);
+    SDL_RWops *stream = session_open(file, errstr, errlen);
+    if(!stream)
         goto fail_stream;
-    }
 
     if(!Attr_Parse(stream, &attr, true) || attr.type != TYPE_FLOAT) {
         pf_snprintf(errstr, errlen, "Could not read PFSAVE version");
@@ -289,22 +1239,49 @@ static bool session_load(const char *file, char *errstr, size_t errlen)
         goto fail_parse;
     }
 
+    bool chunked = (attr.val.as_float >= PFSAVE_CHUNKED_VERSION);
+
+    if(!session_parse_format(stream, attr.val.as_float)) {
+        pf_snprintf(errstr, errlen, "Could not read PFSAVE attribute format");
+        goto fail_parse;
+    }
+
     if(!Attr_Parse(stream, &attr, true) || attr.type != TYPE_INT) {
         pf_snprintf(errstr, errlen, "Could not read number of subsessions");
         goto fail_parse;
     }
 
-    for(int i = 0; i < attr.val.as_int; i++) {
+    int nsubsessions = attr.val.as_int;
+    struct readahead ra, *pra = NULL;
+    if(chunked && readahead_begin(&ra, stream, nsubsessions)) {
+        pra = &ra;
+    }
+
+    for(int i = 0; i < nsubsessions; i++) {
+
+        /* Only the topmost subsession needs to be loaded. The sections of 
+         * the ones beneath it are kept in memory as they are in the file. 
+         */
+        if(pra && i < nsubsessions - 1) {
+
+            SDL_RWops *sub = readahead_copy_subsession(pra);
+            if(!sub) {
+                pf_snprintf(errstr, errlen, "Could not read subsession %d from session file", i);
+                goto fail_load;
+            }
+            vec_stream_push(&loaded, sub);
+            Sched_TryYield();
+            continue;
+        }
     
-        if(!subsession_load(stream, errstr, errlen)) {
+        if(!subsession_load(stream, chunked, pra, errstr, errlen)) {
 
-            bool result = subsession_load(current, errstr, errlen);
+            bool result = subsession_load(current, true, NULL, errstr, errlen);
             assert(result);
-            goto fail_parse;
+            goto fail_load;
         }
 
-        SDL_RWops *sub = PFSDL_VectorRWOps();
-        PFSDL_VectorRWOpsReserve(sub, 64 * 1024 * 1024);
+        SDL_RWops *sub = PFSDL_VMemRWOps(SUBSESSION_RESERVE_SIZE, false);
 
         bool result = subsession_save(sub);
         assert(result);
@@ -314,14 +1291,28 @@ static bool session_load(const char *file, char *errstr, size_t errlen)
     }
 
     while(vec_size(&s_subsession_stack) > 0) {
-        SDL_RWops *stream = vec_stream_pop(&s_subsession_stack);
-        SDL_RWclose(stream);
+        struct snapshot snap = vec_snapshot_pop(&s_subsession_stack);
+        snapshot_destroy(&snap);
     }
 
     SDL_RWclose(vec_stream_pop(&loaded));
-    vec_stream_copy(&s_subsession_stack, &loaded);
+    for(int i = 0; i < vec_size(&loaded); i++) {
+        struct snapshot snap;
+        snapshot_init(&snap, vec_AT(&loaded, i));
+        vec_snapshot_push(&s_subsession_stack, snap);
+    }
+    vec_stream_reset(&loaded);
     ret = true;
 
+fail_load:
+    if(pra) {
+        readahead_end(pra);
+    }
+    if(!ret) {
+        while(vec_size(&loaded) > 0) {
+            SDL_RWclose(vec_stream_pop(&loaded));
+        }
+    }
 fail_parse:
     SDL_RWclose(stream);
 fail_stream:
@@ -337,16 +1328,24 @@ static bool session_pop_subsession(char *errstr, size_t errlen)
         return false;
     }
 
+    struct snapshot *top = &vec_AT(&s_subsession_stack, vec_size(&s_subsession_stack) - 1);
+    SDL_RWops *stream = snapshot_open(top);
+    if(!stream) {
+        pf_snprintf(errstr, errlen, "Cannot pop subsession: could not read its' snapshot");
+        return false;
+    }
+
     subsession_save_args();
     subsession_clear();
 
-    SDL_RWops *stream = vec_stream_pop(&s_subsession_stack);
-    bool result = subsession_load(stream, errstr, errlen);
+    bool result = subsession_load(stream, true, NULL, errstr, errlen);
     assert(result);
 
     E_Global_Notify(EVENT_SESSION_POPPED, &s_saved_args, ES_ENGINE);
 
     SDL_RWclose(stream);
+    struct snapshot snap = vec_snapshot_pop(&s_subsession_stack);
+    snapshot_destroy(&snap);
     return true;
 }
 
@@ -357,15 +1356,21 @@ static bool session_pop_subsession_to_root(char *errstr, size_t errlen)
         return false;
     }
 
+    SDL_RWops *stream = snapshot_open(&vec_AT(&s_subsession_stack, 0));
+    if(!stream) {
+        pf_snprintf(errstr, errlen, "Cannot pop subsession: could not read its' snapshot");
+        return false;
+    }
+
     subsession_save_args();
 
-    SDL_RWops *stream = vec_AT(&s_subsession_stack, 0);
-    bool result = subsession_load(stream, errstr, errlen);
+    bool result = subsession_load(stream, true, NULL, errstr, errlen);
     assert(result);
+    SDL_RWclose(stream);
 
     while(vec_size(&s_subsession_stack) > 0) {
-        stream = vec_stream_pop(&s_subsession_stack);
-        SDL_RWclose(stream);
+        struct snapshot snap = vec_snapshot_pop(&s_subsession_stack);
+        snapshot_destroy(&snap);
     }
 
     E_Global_Notify(EVENT_SESSION_POPPED, &s_saved_args, ES_ENGINE);
@@ -374,8 +1379,7 @@ static bool session_pop_subsession_to_root(char *errstr, size_t errlen)
 
 static bool session_push_subsession(const char *script, char *errstr, size_t errlen)
 {
-    SDL_RWops *stream = PFSDL_VectorRWOps();
-    PFSDL_VectorRWOpsReserve(stream, 64 * 1024 * 1024);
+    SDL_RWops *stream = PFSDL_VMemRWOps(SUBSESSION_RESERVE_SIZE, false);
 
     bool result, ret = false;
     (void)result;
@@ -386,6 +1390,11 @@ static bool session_push_subsession(const char *script, char *errstr, size_t err
     }
     SDL_RWseek(stream, 0, RW_SEEK_SET);
 
+    /* Compress or spill the snapshot before the new subsession starts 
+     * taking up memory */
+    struct snapshot snap;
+    snapshot_init(&snap, stream);
+
     subsession_clear();
 
     STALLOC(char*, argv, s_argc);
@@ -393,13 +1402,16 @@ static bool session_push_subsession(const char *script, char *errstr, size_t err
         argv[i] = s_argv[i];
 
     if(!S_RunFile(script, s_argc, argv)) {
-        result = subsession_load(stream, errstr, errlen);
+        stream = snapshot_open(&snap);
+        assert(stream);
+        result = subsession_load(stream, true, NULL, errstr, errlen);
         assert(result);
         SDL_RWclose(stream);
+        snapshot_destroy(&snap);
         goto out;
     }
 
-    vec_stream_push(&s_subsession_stack, stream);
+    vec_snapshot_push(&s_subsession_stack, snap);
     ret = true;
 
 out:
@@ -413,19 +1425,13 @@ static bool session_exec_subsession(const char *script, char *errstr, size_t err
         return false;
 
     assert(vec_size(&s_subsession_stack) > 0);
-    SDL_RWops *stream = vec_stream_pop(&s_subsession_stack);
-    SDL_RWclose(stream);
+    struct snapshot snap = vec_snapshot_pop(&s_subsession_stack);
+    snapshot_destroy(&snap);
     return true;
 }
 
-static bool session_save(const char *file, char* errstr, size_t errlen)
+static bool session_write(SDL_RWops *stream)
 {
-    SDL_RWops *stream = SDL_RWFromFile(file, "w");
-    if(!stream) {
-        pf_snprintf(errstr, errlen, "Could not open session file: %s", file);
-        goto fail_stream;
-    }
-
     struct attr version = (struct attr){
         .type = TYPE_FLOAT,
         .val.as_float = PFSAVE_VERSION
@@ -433,6 +1439,14 @@ static bool session_save(const char *file, char* errstr, size_t errlen)
     if(!Attr_Write(stream, &version, "version"))
         return false;
 
+    /* The header itself is always text */
+    struct attr format = (struct attr){
+        .type = TYPE_INT,
+        .val.as_int = session_attr_format()
+    };
+    if(!Attr_Write(stream, &format, "attr_format"))
+        return false;
+
     struct attr num_subsessions = (struct attr){
         .type = TYPE_INT,
         .val.as_int = 1 + vec_size(&s_subsession_stack)
@@ -441,19 +1455,30 @@ static bool session_save(const char *file, char* errstr, size_t errlen)
         return false;
 
     for(int i = 0; i < vec_size(&s_subsession_stack); i++) {
-
-        SDL_RWops *sub = vec_AT(&s_subsession_stack, i);
-        const char *data = PFSDL_VectorRWOpsRaw(sub);
-        size_t size = SDL_RWsize(sub);
-        SDL_RWwrite(stream, data, size, 1);
+        if(!snapshot_write_to(&vec_AT(&s_subsession_stack, i), stream))
+            return false;
     }
 
     Sched_TryYield();
+    return subsession_save(stream);
+}
+
+static bool session_save(const char *file, char* errstr, size_t errlen)
+{
+    SDL_RWops *stream = session_file_write(file, session_compress());
+    if(!stream) {
+        pf_snprintf(errstr, errlen, "Could not open session file: %s", file);
+        goto fail_stream;
+    }
 
-    if(!subsession_save(stream))
+    session_drop_base(file);
+    if(!session_write(stream))
         goto fail_save;
 
-    SDL_RWclose(stream);
+    if(SDL_RWclose(stream) < 0) {
+        pf_snprintf(errstr, errlen, "Could not write session file: %s", file);
+        goto fail_stream;
+    }
     return true;
 
 fail_save:
@@ -462,15 +1487,144 @@ fail_stream:
     return false;
 }
 
+static int session_write_thread(void *arg)
+{
+    SDL_RWops *stream = session_file_write(s_write.path, s_write.compress);
+    if(!stream) {
+        pf_snprintf(s_write.errbuff, sizeof(s_write.errbuff), 
+            "Could not open session file: %s", s_write.path);
+        s_write.result = false;
+        goto out;
+    }
+
+    size_t size = SDL_RWsize(s_write.image);
+    s_write.result = (SDL_RWwrite(stream, PFSDL_VectorRWOpsRaw(s_write.image), size, 1) == 1);
+    s_write.result = (SDL_RWclose(stream) == 0) && s_write.result;
+    if(!s_write.result) {
+        pf_snprintf(s_write.errbuff, sizeof(s_write.errbuff), 
+            "Could not write session file: %s", s_write.path);
+    }
+
+out:
+    SDL_AtomicSet(&s_write.done, 1);
+    return 0;
+}
+
+/* Returns true if a background save was in progress. 
+ */
+static bool session_join_write(void)
+{
+    if(!s_write.thread)
+        return false;
+
+    SDL_WaitThread(s_write.thread, NULL);
+
+    /* Hold on to the last full image so that the deltas against it 
+     * don't need to read it back from disk */
+    if(s_write.full && s_write.result) {
+        session_set_base(s_write.image, s_write.path);
+    }else{
+        SDL_RWclose(s_write.image);
+    }
+    s_write.thread = NULL;
+    s_write.image = NULL;
+    return true;
+}
+
+static void session_finish_write(bool block)
+{
+    if(!s_write.thread)
+        return;
+    if(!block && !SDL_AtomicGet(&s_write.done))
+        return;
+
+    session_join_write();
+    if(s_write.result) {
+        E_Global_Notify(EVENT_SESSION_SAVED, NULL, ES_ENGINE);
+    }else{
+        E_Global_Notify(EVENT_SESSION_FAIL_SAVE, s_write.errbuff, ES_ENGINE);
+    }
+}
+
+static bool session_save_async(const char *file, const char *base, char *errstr, size_t errlen)
+{
+    assert(!s_write.thread);
+
+    if(base && 0 == strcmp(base, file)) {
+        pf_snprintf(errstr, errlen, "A session delta cannot overwrite its' own base: %s", file);
+        goto fail_alloc;
+    }
+
+    /* Serializing the state into memory is comparatively cheap - it's the
+     * file write that we hand off */
+    SDL_RWops *image = PFSDL_VMemRWOps(SUBSESSION_RESERVE_SIZE, false);
+    if(!image) {
+        pf_snprintf(errstr, errlen, "Could not allocate memory for session image");
+        goto fail_alloc;
+    }
+
+    if(!session_write(image)) {
+        pf_snprintf(errstr, errlen, "Could not serialize the session");
+        goto fail_write;
+    }
+
+    if(base) {
+
+        SDL_RWops *base_image = session_get_base(base);
+        if(!base_image) {
+            pf_snprintf(errstr, errlen, "Could not read base session file: %s", base);
+            goto fail_write;
+        }
+
+        SDL_RWops *delta = delta_encode(image, base_image, base);
+        if(!delta) {
+            pf_snprintf(errstr, errlen, "Could not encode the session delta");
+            goto fail_write;
+        }
+
+        SDL_RWclose(image);
+        image = delta;
+    }
+
+    session_drop_base(file);
+    s_write.image = image;
+    s_write.full = !base;
+    s_write.compress = session_compress();
+    s_write.result = false;
+    SDL_AtomicSet(&s_write.done, 0);
+    pf_strlcpy(s_write.path, file, sizeof(s_write.path));
+
+    s_write.thread = SDL_CreateThread(session_write_thread, "session_write", NULL);
+    if(!s_write.thread) {
+        pf_snprintf(errstr, errlen, "Could not create the session writer thread");
+        s_write.image = NULL;
+        goto fail_write;
+    }
+    return true;
+
+fail_write:
+    SDL_RWclose(image);
+fail_alloc:
+    return false;
+}
+
 static struct result session_task(void* arg)
 {
     ASSERT_IN_MAIN_THREAD();
     bool result = false;
 
+    /* Make sure a background save has been written out completely before
+     * the file can be read or a new save can be started */
+    session_finish_write(true);
+
     switch(s_current) {
     case SESH_REQ_SAVE:
         result = session_save(s_req_path, s_errbuff, sizeof(s_errbuff));
         break;
+    case SESH_REQ_SAVE_ASYNC:
+        result = session_save_async(s_req_path, s_req_base[0] ? s_req_base : NULL, 
+            s_errbuff, sizeof(s_errbuff));
+        break;
     case SESH_REQ_LOAD:
         result = session_load(s_req_path, s_errbuff, sizeof(s_errbuff));
         break;
@@ -491,14 +1645,15 @@ static struct result session_task(void* arg)
     default: assert(0);
     }
 
-    int success_event = (s_current == SESH_REQ_SAVE) ? EVENT_SESSION_SAVED     
-                                                     : EVENT_SESSION_LOADED;
-    int failure_event = (s_current == SESH_REQ_SAVE) ? EVENT_SESSION_FAIL_SAVE 
-                                                     : EVENT_SESSION_FAIL_LOAD;
+    bool save = (s_current == SESH_REQ_SAVE || s_current == SESH_REQ_SAVE_ASYNC);
+    int success_event = save ? EVENT_SESSION_SAVED     : EVENT_SESSION_LOADED;
+    int failure_event = save ? EVENT_SESSION_FAIL_SAVE : EVENT_SESSION_FAIL_LOAD;
 
-    if(result) {
+    /* The completion of a background save is notified once the file 
+     * is written out */
+    if(result && s_current != SESH_REQ_SAVE_ASYNC) {
         E_Global_Notify(success_event, NULL, ES_ENGINE);
-    }else {
+    }else if(!result) {
         E_Global_Notify(failure_event, s_errbuff, ES_ENGINE);
     }
 
@@ -524,6 +1679,20 @@ void Session_RequestSave(const char *path)
     pf_snprintf(s_req_path, sizeof(s_req_path), "%s", path);
 }
 
+void Session_RequestSaveAsync(const char *path)
+{
+    s_request = SESH_REQ_SAVE_ASYNC;
+    pf_snprintf(s_req_path, sizeof(s_req_path), "%s", path);
+    s_req_base[0] = '\0';
+}
+
+void Session_RequestSaveDelta(const char *path, const char *base)
+{
+    s_request = SESH_REQ_SAVE_ASYNC;
+    pf_snprintf(s_req_path, sizeof(s_req_path), "%s", path);
+    pf_snprintf(s_req_base, sizeof(s_req_base), "%s", base);
+}
+
 void Session_RequestLoad(const char *path)
 {
     s_request = SESH_REQ_LOAD;
@@ -570,6 +1739,8 @@ void Session_RequestPopToRoot(int argc, char **argv)
 
 bool Session_ServiceRequests(struct future *result)
 {
+    session_finish_write(false);
+
     if(s_request == SESH_REQ_NONE)
         return false;
 
@@ -597,18 +1768,78 @@ uint64_t Session_ChangeTick(void)
 
 bool Session_Init(void)
 {
-    vec_stream_init(&s_subsession_stack);
-    if(!vec_stream_resize(&s_subsession_stack, 64))
+    vec_snapshot_init(&s_subsession_stack);
+    if(!vec_snapshot_resize(&s_subsession_stack, 64))
         return false;
+
+    /* Compressed saves are several times smaller, at the cost of a little
+     * extra time spent writing and reading them. Loading detects them
+     * automatically. */
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.game.compress_saves",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Binary attributes are several times faster to write and parse. Text 
+     * saves are still useful for debugging. Loading accepts either. */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.binary_saves",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Every subsession on the stack keeps a full serialized copy of its' 
+     * state. Compressing the copies trades a little time on every push and 
+     * pop for several times less memory. Spilling them writes them out to 
+     * files instead, which are mapped back in when they are popped. */
+    status = Settings_Create((struct setting){
+        .name = "pf.game.compress_subsessions",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.spill_subsessions",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+    (void)status;
     return true;
 }
 
 void Session_Shutdown(void)
 {
+    session_join_write();
+    session_drop_base(NULL);
     while(vec_size(&s_subsession_stack) > 0) {
-        SDL_RWops *stream = vec_stream_pop(&s_subsession_stack);
-        SDL_RWclose(stream);
+        struct snapshot snap = vec_snapshot_pop(&s_subsession_stack);
+        snapshot_destroy(&snap);
     }
-    vec_stream_destroy(&s_subsession_stack);
+    vec_snapshot_destroy(&s_subsession_stack);
 }
 
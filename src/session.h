@@ -55,6 +55,12 @@ void     Session_Shutdown(void);
 bool     Session_ServiceRequests(struct future *result);
 
 void     Session_RequestSave(const char *path);
+/* Serializes the session into memory and writes it out to the file in 
+ * the background. EVENT_SESSION_SAVED is notified once the write completes. */
+void     Session_RequestSaveAsync(const char *path);
+/* Like Session_RequestSaveAsync, but only the parts of the session that 
+ * differ from the full session saved at 'base' are written out. */
+void     Session_RequestSaveDelta(const char *path, const char *base);
 void     Session_RequestLoad(const char *path);
 
 void     Session_RequestPush(const char *script, int argc, char **argv);
@@ -51,6 +51,7 @@
 #define STR(x)  STR2(x)
 
 #define SETT_FLAGS_NOPERSIST (1 << 0)
+#define SETT_MAX_HANDLES     (512)
 
 struct named_val{
     char name[SETT_NAME_LEN];
@@ -66,6 +67,7 @@ struct setting_priv{
 
 KHASH_MAP_INIT_STR(setting, struct setting)
 KHASH_MAP_INIT_STR(settpriv, struct setting_priv)
+KHASH_MAP_INIT_STR(handle, sett_handle_t)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -74,6 +76,11 @@ KHASH_MAP_INIT_STR(settpriv, struct setting_priv)
 static khash_t(setting)  *s_settings_table;
 static khash_t(settpriv) *s_priv_table;
 static char               s_settings_filepath[512];
+/* The bit pattern of the current value of every setting that 
+ * a handle has been taken for, indexed by the handle. */
+static khash_t(handle)   *s_handle_table;
+static SDL_atomic_t       s_handle_vals[SETT_MAX_HANDLES];
+static int                s_nhandles;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -177,6 +184,27 @@ static struct setting_priv sett_get_priv(const char *name)
     return kh_value(s_priv_table, k);
 }
 
+static int sett_bits(const struct sval *val)
+{
+    int ret = 0;
+    switch(val->type) {
+    case ST_TYPE_BOOL:  ret = val->as_bool; break;
+    case ST_TYPE_INT:   ret = val->as_int;  break;
+    case ST_TYPE_FLOAT: memcpy(&ret, &val->as_float, sizeof(ret)); break;
+    default: break;
+    }
+    return ret;
+}
+
+static void sett_publish(const char *name, const struct sval *val)
+{
+    khiter_t k = kh_get(handle, s_handle_table, name);
+    if(k == kh_end(s_handle_table))
+        return;
+    sett_handle_t handle = kh_value(s_handle_table, k);
+    SDL_AtomicSet(&s_handle_vals[handle], sett_bits(val));
+}
+
 static int compare_strings(const void* a, const void* b)
 {
     const char *stra = *(const char **)a;
@@ -202,6 +230,14 @@ ss_e Settings_Init(void)
         return SS_BADALLOC;
     }
 
+    s_handle_table = kh_init(handle);
+    if(!s_handle_table) {
+        kh_destroy(settpriv, s_priv_table);
+        kh_destroy(setting, s_settings_table);
+        return SS_BADALLOC;
+    }
+    s_nhandles = 0;
+
     extern const char *g_basepath;
     strcpy(s_settings_filepath, g_basepath);
     strcat(s_settings_filepath, "/");
@@ -223,6 +259,14 @@ void Settings_Shutdown(void)
     });
     kh_destroy(setting, s_settings_table);
     kh_destroy(settpriv, s_priv_table);
+
+    sett_handle_t handle;
+    kh_foreach(s_handle_table, key, handle, {
+        (void)handle;
+        free((char*)key);
+    });
+    kh_destroy(handle, s_handle_table);
+    s_nhandles = 0;
 }
 
 ss_e Settings_Create(struct setting sett)
@@ -252,6 +296,7 @@ ss_e Settings_Create(struct setting sett)
     }
 
     kh_value(s_settings_table, k) = sett;
+    sett_publish(sett.name, &sett.val);
 
     if(sett.commit)
         sett.commit(&sett.val);
@@ -298,6 +343,7 @@ ss_e Settings_Set(const char *name, const struct sval *new_val)
         return SS_INVALID_VAL;
 
     sett->val = *new_val;
+    sett_publish(sett->name, new_val);
 
     if(sett->commit)
         sett->commit(new_val);
@@ -316,6 +362,7 @@ ss_e Settings_SetNoValidate(const char *name, const struct sval *new_val)
 
     struct setting *sett = &kh_value(s_settings_table, k);
     sett->val = *new_val;
+    sett_publish(sett->name, new_val);
 
     if(sett->commit)
         sett->commit(new_val);
@@ -352,6 +399,58 @@ ss_e Settings_SetNoPersist(const char *name, const struct sval *new_val)
     return ret;
 }
 
+sett_handle_t Settings_GetHandle(const char *name)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    khiter_t k = kh_get(handle, s_handle_table, name);
+    if(k != kh_end(s_handle_table))
+        return kh_value(s_handle_table, k);
+
+    if(s_nhandles == SETT_MAX_HANDLES)
+        return SETT_HANDLE_INVALID;
+
+    const char *key = pf_strdup(name);
+    if(!key)
+        return SETT_HANDLE_INVALID;
+
+    int status;
+    k = kh_put(handle, s_handle_table, key, &status);
+    if(status == -1) {
+        free((char*)key);
+        return SETT_HANDLE_INVALID;
+    }
+
+    sett_handle_t ret = s_nhandles++;
+    kh_value(s_handle_table, k) = ret;
+
+    struct sval curr = {0};
+    Settings_Get(name, &curr);
+    SDL_AtomicSet(&s_handle_vals[ret], sett_bits(&curr));
+    return ret;
+}
+
+bool Settings_ReadBool(sett_handle_t handle)
+{
+    assert(handle >= 0 && handle < SETT_MAX_HANDLES);
+    return !!SDL_AtomicGet(&s_handle_vals[handle]);
+}
+
+int Settings_ReadInt(sett_handle_t handle)
+{
+    assert(handle >= 0 && handle < SETT_MAX_HANDLES);
+    return SDL_AtomicGet(&s_handle_vals[handle]);
+}
+
+float Settings_ReadFloat(sett_handle_t handle)
+{
+    assert(handle >= 0 && handle < SETT_MAX_HANDLES);
+    int bits = SDL_AtomicGet(&s_handle_vals[handle]);
+    float ret;
+    memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
+
 ss_e Settings_SaveToFile(void)
 {
     ASSERT_IN_MAIN_THREAD();
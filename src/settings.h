@@ -78,6 +78,14 @@ struct setting{
     void (*commit)(const struct sval *new_val);
 };
 
+/* A handle allows reading the value of a scalar (bool, int or float) setting 
+ * without looking it up by name. Reads are lock-free and can be done from any
+ * thread; the value is updated atomically whenever the setting is committed.
+ * A handle can be taken before the setting is created, in which case it reads 
+ * as zero until then. Handles remain valid until Settings_Shutdown. */
+typedef int sett_handle_t;
+#define SETT_HANDLE_INVALID (-1)
+
 typedef enum settings_status{
     SS_OKAY = 0,
     SS_NO_SETTING,
@@ -102,6 +110,11 @@ ss_e Settings_SetNoValidate(const char *name, const struct sval *new_val);
  * with a persistent value, the old value will be written. */
 ss_e Settings_SetNoPersist(const char *name, const struct sval *new_val);
 
+sett_handle_t Settings_GetHandle(const char *name);
+bool          Settings_ReadBool(sett_handle_t handle);
+int           Settings_ReadInt(sett_handle_t handle);
+float         Settings_ReadFloat(sett_handle_t handle);
+
 ss_e Settings_SaveToFile(void);
 ss_e Settings_LoadFromFile(void);
 const char *Settings_GetFile(void);
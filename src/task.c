@@ -38,7 +38,6 @@
 #include "event.h"
 #include "main.h"
 #include "lib/public/pf_string.h"
-#include "lib/public/pqueue.h"
 #include "lib/public/queue.h"
 #include "lib/public/khash.h"
 
@@ -49,19 +48,6 @@
 #include <windows.h>
 #endif
 
-struct delay_desc{
-    uint32_t tid;
-    uint32_t wake_tick;
-};
-
-struct ts_req{
-    enum{
-        TS_REQ_NOTIFY, 
-        TS_REQ_DELAY,
-    }type;
-    uint32_t ticks;
-};
-
 struct ns_req{
     enum{
         NS_REQ_REGISTER,
@@ -75,9 +61,6 @@ struct ns_req{
 QUEUE_TYPE(tid, uint32_t)
 QUEUE_IMPL(static, tid, uint32_t)
 
-PQUEUE_TYPE(delay, struct delay_desc)
-PQUEUE_IMPL(static, delay, struct delay_desc)
-
 KHASH_MAP_INIT_STR(tid, uint32_t)
 KHASH_MAP_INIT_STR(tidq, queue_tid_t)
 
@@ -91,79 +74,11 @@ struct ns_state{
 /*****************************************************************************/
 
 static uint32_t s_ns_tid; /* write-once */
-static uint32_t s_ts_tid; /* write-once */
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static struct result tick_notifier(void *arg)
-{
-    uint32_t ts_tid = Task_ParentTid();
-    struct ts_req request = (struct ts_req){ .type = TS_REQ_NOTIFY };
-    int resp, source;
-
-    while(1) {
-        Task_AwaitEvent(EVENT_60HZ_TICK, &source);
-        Task_Send(ts_tid, &request, sizeof(request), &resp, sizeof(resp));
-    }
-    return NULL_RESULT;
-}
-
-static void timeserver_exit(void *arg)
-{
-    pq_delay_t *pq = (pq_delay_t*)arg;
-    pq_delay_destroy(pq);
-}
-
-static struct result timeserver_task(void *arg)
-{
-    pq_delay_t descs;
-    pq_delay_init(&descs);
-    Task_SetDestructor(timeserver_exit, &descs);
-
-    struct future res;
-    uint32_t notifier = Task_Create(0, tick_notifier, NULL, &res, 0);
-
-    while(1) {
-        struct ts_req request;
-        uint32_t tid;
-        int reply = 0;
-
-        Task_Receive(&tid, &request, sizeof(request));
-        uint32_t curr_tick = SDL_GetTicks();
-
-        switch(request.type) {
-        case TS_REQ_NOTIFY:
-            Task_Reply(tid, &reply, sizeof(reply));
-            break;
-        case TS_REQ_DELAY: {
-            struct delay_desc dd = (struct delay_desc){
-                .tid = tid,
-                .wake_tick = curr_tick + request.ticks
-            };
-            pq_delay_push(&descs, dd.wake_tick, dd);
-            break;
-        }
-        default: assert(0);
-        }
-
-        /* Check if any tasks need waking */
-        struct delay_desc curr;
-        do{
-            if(!pq_delay_pop(&descs, &curr))
-                break;
-            if(curr.wake_tick > curr_tick) {
-                pq_delay_push(&descs, curr.wake_tick, curr);
-            }else{
-                Task_Reply(curr.tid, &reply, sizeof(reply));
-            }
-        }while(curr.wake_tick <= curr_tick);
-    }
-
-    return NULL_RESULT;
-}
-
 static void nameserver_exit(void *arg)
 {
     struct ns_state *state = (struct ns_state*)arg;
@@ -294,6 +209,11 @@ void Task_Yield(void)
     Sched_Request((struct request){ .type = SCHED_REQ_YIELD });
 }
 
+void Task_YieldFrame(void)
+{
+    Sched_Request((struct request){ .type = SCHED_REQ_YIELD_FRAME });
+}
+
 void Task_Send(uint32_t tid, void *msg, size_t msglen, void *reply, size_t replylen)
 {
     Sched_Request((struct request){ 
@@ -316,6 +236,26 @@ void Task_Receive(uint32_t *tid, void *msg, size_t msglen)
     });
 }
 
+bool Task_Post(uint32_t tid, void *msg, size_t msglen)
+{
+    return Sched_Request((struct request){
+        .type = SCHED_REQ_POST,
+        .argv[0] = (uint64_t)tid,
+        .argv[1] = (uint64_t)msg,
+        .argv[2] = (uint64_t)msglen,
+    });
+}
+
+size_t Task_ReceiveBatch(struct task_msg *out, size_t maxmsgs, bool posted)
+{
+    return Sched_Request((struct request){
+        .type = SCHED_REQ_RECEIVE_BATCH,
+        .argv[0] = (uint64_t)out,
+        .argv[1] = (uint64_t)maxmsgs,
+        .argv[2] = (uint64_t)posted,
+    });
+}
+
 void Task_Reply(uint32_t tid, void *reply, size_t replylen)
 {
     Sched_Request((struct request){
@@ -376,12 +316,10 @@ bool Task_Wait(uint32_t tid)
 
 void Task_Sleep(int ms)
 {
-    struct ts_req tr = (struct ts_req){
-        .type = TS_REQ_DELAY,
-        .ticks = ms
-    };
-    int resp;
-    Task_Send(s_ts_tid, &tr, sizeof(tr), &resp, sizeof(resp));
+    Sched_Request((struct request){
+        .type = SCHED_REQ_SLEEP,
+        .argv[0] = (uint64_t)(ms > 0 ? ms : 0)
+    });
 }
 
 void Task_Register(const char *name)
@@ -419,6 +357,5 @@ void Task_CreateServices(void)
 {
     ASSERT_IN_MAIN_THREAD();
     s_ns_tid = Sched_Create(0, nameserver_task, NULL, NULL, 0);
-    s_ts_tid = Sched_Create(0, timeserver_task, NULL, NULL, 0);
 }
 
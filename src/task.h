@@ -45,6 +45,13 @@ struct future;
 
 typedef struct result (*task_t)(void *);
 
+struct task_msg{
+    uint32_t tid;
+    void    *msg;
+    size_t   msglen;
+    bool     reply; /* the sender is blocked until it gets a reply */
+};
+
 /* The following may only be called from task context 
  * (i.e. from the body of a task function) */
 
@@ -53,9 +60,24 @@ bool     Task_Wait(uint32_t child_tid);
 uint32_t Task_MyTid(void);
 uint32_t Task_ParentTid(void);
 void     Task_Yield(void);
+/* Like Task_Yield, but the task is not resumed before the next tick */
+void     Task_YieldFrame(void);
 void     Task_Send(uint32_t tid, void *msg, size_t msglen, void *reply, size_t replylen);
 void     Task_Receive(uint32_t *tid, void *msg, size_t msglen);
 void     Task_Reply(uint32_t tid, void *reply, size_t replylen);
+/* Pass ownership of the 'msg' buffer to the receiver without blocking. The
+ * buffer may come from Sched_FrameAlloc, in which case the receiver must be
+ * done with it by the end of the next tick. Posted messages are only handed
+ * out by Task_ReceiveBatch. 
+ */
+bool     Task_Post(uint32_t tid, void *msg, size_t msglen);
+/* Block until there is at least one message and then drain up to 'maxmsgs'
+ * of them, all in a single context switch. The messages of blocking senders
+ * are not copied - they point into the sender's buffer, which remains valid
+ * until the receiver calls Task_Reply. When 'posted' is set, the messages
+ * sent with Task_Post are drained as well.
+ */
+size_t   Task_ReceiveBatch(struct task_msg *out, size_t maxmsgs, bool posted);
 void    *Task_AwaitEvent(int event, int *source);
 void     Task_SetDestructor(void (*destructor)(void*), void *darg);
 void     Task_Sleep(int ms);
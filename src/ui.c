@@ -54,6 +54,8 @@
 
 #define MAX_VERTEX_MEMORY   (2 * 1024* 1024)
 #define MAX_ELEMENT_MEMORY      (512 * 1024)
+#define UI_FNV_BASIS        (0xcbf29ce484222325ull)
+#define UI_FNV_PRIME        (0x100000001b3ull)
 
 struct text_desc{
     char        text[256];
@@ -78,6 +80,12 @@ static khash_t(font)               *s_fontmap;
 static const char                  *s_active_font = NULL;
 static SDL_mutex                   *s_lock;
 static vec2_t                       s_vres = {1920, 1080};
+/* Fingerprint of the command buffers of the last frame which was converted 
+ * and uploaded. When the next frame's commands hash to the same value, the
+ * render thread redraws the vertex data it already has.
+ */
+static uint64_t                     s_frame_hash;
+static bool                         s_frame_cached = false;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -229,6 +237,53 @@ static int bot_y_point(struct rect from_bounds, vec2_t from_res, vec2_t to_res,
     }
 }
 
+static uint64_t ui_hash(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *curr = data;
+    while(size >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, curr, sizeof(word));
+        hash = (hash ^ word) * UI_FNV_PRIME;
+        hash ^= hash >> 29;
+        curr += sizeof(word);
+        size -= sizeof(word);
+    }
+    while(size--) {
+        hash = (hash ^ *curr++) * UI_FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Hash the command buffers of all the windows that will be drawn this frame, 
+ * in the order that they will be drawn in. Popups are built inside their 
+ * parent's buffer range so they are covered by it. This must be called before 
+ * the commands are built into a single list, as that patches the links between 
+ * the window buffers.
+ */
+static uint64_t ui_frame_hash(const struct nk_context *ctx)
+{
+    uint64_t hash = UI_FNV_BASIS;
+    const nk_byte *base = ctx->memory.memory.ptr;
+
+    for(const struct nk_window *win = ctx->begin; win; win = win->next) {
+
+        if(win->buffer.begin == win->buffer.end
+        || (win->flags & NK_WINDOW_HIDDEN)
+        || win->seq != ctx->seq)
+            continue;
+
+        hash = ui_hash(hash, &win->name, sizeof(win->name));
+        hash = ui_hash(hash, base + win->buffer.begin, win->buffer.end - win->buffer.begin);
+    }
+
+    /* The cursor overlay is generated at build time */
+    if(ctx->style.cursor_visible && !ctx->input.mouse.grabbed) {
+        hash = ui_hash(hash, &ctx->style.cursor_active, sizeof(ctx->style.cursor_active));
+        hash = ui_hash(hash, &ctx->input.mouse.pos, sizeof(ctx->input.mouse.pos));
+    }
+    return hash;
+}
+
 static void *push_draw_list(const struct nk_draw_list *dl)
 {
     struct nk_draw_list *st_dl = R_PushArg(dl, sizeof(struct nk_draw_list));
@@ -368,6 +423,25 @@ static void ui_render(void *user, void *event)
     struct nk_buffer cmds, vbuf, ebuf;
     const enum nk_anti_aliasing aa = NK_ANTI_ALIASING_ON;
 
+    /* There is nothing to draw to - just drop this frame's commands */
+    if(Engine_IsDedicated()) {
+        nk_clear(&s_ctx);
+        return;
+    }
+
+    /* Nothing on screen changed - skip the conversion and the upload. The 
+     * commands still have to be built, as that retires this frame's popup
+     * buffers.
+     */
+    uint64_t hash = ui_frame_hash(&s_ctx);
+    if(s_frame_cached && hash == s_frame_hash) {
+
+        nk__begin(&s_ctx);
+        R_PushCmd((struct rcmd){ R_GL_UI_RenderCached, 0 });
+        nk_clear(&s_ctx);
+        return;
+    }
+
     void *vbuff = stalloc(&G_GetSimWS()->args, MAX_VERTEX_MEMORY);
     void *ebuff = stalloc(&G_GetSimWS()->args, MAX_ELEMENT_MEMORY);
     assert(vbuff && ebuff);
@@ -407,6 +481,9 @@ static void ui_render(void *user, void *event)
         },
     });
 
+    s_frame_hash = hash;
+    s_frame_cached = true;
+
     nk_buffer_free(&cmds);
     nk_clear(&s_ctx);
 }
@@ -454,6 +531,7 @@ void UI_Shutdown(void)
     nk_font_atlas_clear(&s_atlas);
     nk_free(&s_ctx);
     memset(&s_ctx, 0, sizeof(s_ctx));
+    s_frame_cached = false;
     SDL_DestroyMutex(s_lock);
 
     const char *key;
@@ -583,6 +661,20 @@ void UI_DrawText(const char *text, struct rect rect, struct rgba rgba)
     SDL_UnlockMutex(s_lock);
 }
 
+void UI_DrawTextBatch(size_t count, const char *const texts[], const struct rect rects[], 
+                      struct rgba rgba)
+{
+    SDL_LockMutex(s_lock);
+    vec_td_resize(&s_curr_frame_labels, vec_size(&s_curr_frame_labels) + count);
+
+    for(size_t i = 0; i < count; i++) {
+        struct text_desc d = (struct text_desc){.rect = rects[i], .rgba = rgba};
+        pf_strlcpy(d.text, texts[i], sizeof(d.text));
+        vec_td_push(&s_curr_frame_labels, d);
+    }
+    SDL_UnlockMutex(s_lock);
+}
+
 vec2_t UI_ArAdjustedVRes(vec2_t vres)
 {
     int winw, winh;
@@ -656,5 +748,6 @@ void UI_ClearState(void)
 {
     UI_SetActiveFont("__default__");
     nk_clear(&s_ctx);
+    s_frame_cached = false;
 }
 
@@ -76,6 +76,9 @@ void               UI_InputBegin(void);
 void               UI_InputEnd(void);
 void               UI_HandleEvent(SDL_Event *evt);
 void               UI_DrawText(const char *text, struct rect rect, struct rgba rgba);
+/* Same as calling UI_DrawText for every text, but takes the lock only once */
+void               UI_DrawTextBatch(size_t count, const char *const texts[], 
+                                    const struct rect rects[], struct rgba rgba);
 vec2_t             UI_GetTextVres(void);
 
 /* Returns a trimmed version of the virtual resolution when the aspect ratio of the window is 